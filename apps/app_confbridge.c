@@ -70,6 +70,7 @@
 #include "asterisk/stasis_channels.h"
 #include "asterisk/json.h"
 #include "asterisk/format_cache.h"
+#include "asterisk/translate.h"
 #include "asterisk/taskprocessor.h"
 #include "asterisk/stream.h"
 #include "asterisk/message.h"
@@ -1551,6 +1552,8 @@ static struct confbridge_conference *join_conference_bridge(const char *conferen
 		ast_bridge_set_internal_sample_rate(conference->bridge, conference->b_profile.internal_sample_rate);
 		/* Set the internal mixing interval on the bridge from the bridge profile */
 		ast_bridge_set_mixing_interval(conference->bridge, conference->b_profile.mix_interval);
+		ast_bridge_set_mixing_threads(conference->bridge, conference->b_profile.mixing_threads);
+		ast_bridge_set_resample_quality(conference->bridge, conference->b_profile.resample_quality);
 		ast_bridge_set_binaural_active(conference->bridge, ast_test_flag(&conference->b_profile, BRIDGE_OPT_BINAURAL_ACTIVE));
 
 		if (ast_test_flag(&conference->b_profile, BRIDGE_OPT_VIDEO_SRC_FOLLOW_TALKER)) {
@@ -1720,6 +1723,313 @@ static void leave_conference(struct confbridge_user *user)
 	user->conference = NULL;
 }
 
+/*!
+ * \brief A short system sound, decoded once and kept for every conference
+ *
+ * Join, leave, mute and similar prompts are played over and over. Keeping
+ * them decoded saves looking up, opening and translating the file for each
+ * announcement. Sounds are re-read after a reload.
+ */
+struct confbridge_sound {
+	/*! Number of samples, or 0 if the sound is too long to keep */
+	size_t samples;
+	/*! Signed linear audio */
+	int16_t *data;
+	/*! Language and file name */
+	char key[0];
+};
+
+/*! Longest sound kept decoded, in seconds */
+#define SOUND_CACHE_MAX_SECONDS 10
+
+/*! Number of buckets in the sound cache */
+#define SOUND_CACHE_BUCKETS 37
+
+/*! \brief Decoded sounds, by language and file name */
+static struct ao2_container *sound_cache;
+
+static int confbridge_sound_hash_cb(const void *obj, const int flags)
+{
+	const struct confbridge_sound *sound = obj;
+	const char *key;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		key = obj;
+		break;
+	case OBJ_SEARCH_OBJECT:
+		key = sound->key;
+		break;
+	default:
+		ast_assert(0);
+		return 0;
+	}
+	return ast_str_hash(key);
+}
+
+static int confbridge_sound_cmp_cb(void *obj, void *arg, int flags)
+{
+	const struct confbridge_sound *left = obj;
+	const struct confbridge_sound *right = arg;
+	const char *right_key = arg;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_OBJECT:
+		right_key = right->key;
+		/* Fall through */
+	case OBJ_SEARCH_KEY:
+		if (strcmp(left->key, right_key)) {
+			return 0;
+		}
+		break;
+	default:
+		ast_assert(0);
+		return 0;
+	}
+	return CMP_MATCH;
+}
+
+static void confbridge_sound_destroy(void *obj)
+{
+	struct confbridge_sound *sound = obj;
+
+	ast_free(sound->data);
+}
+
+/*!
+ * \internal
+ * \brief Decode a sound file for the playback channel
+ *
+ * \param chan Playback channel, which must not be in autoservice
+ * \param filename Sound file
+ * \param key Cache key of the sound
+ *
+ * \return The sound, which has no samples if it is too long to keep
+ * \retval NULL if it could not be decoded
+ */
+static struct confbridge_sound *confbridge_sound_decode(struct ast_channel *chan, const char *filename, const char *key)
+{
+	const size_t max_samples = ast_format_get_sample_rate(ast_format_slin) * SOUND_CACHE_MAX_SECONDS;
+	struct ast_trans_pvt *trans = NULL;
+	struct confbridge_sound *sound;
+	struct ast_filestream *fs;
+	struct ast_frame *f;
+	size_t size = 0;
+	int too_long = 0;
+	int res = 0;
+
+	sound = ao2_alloc_options(sizeof(*sound) + strlen(key) + 1, confbridge_sound_destroy,
+		AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!sound) {
+		return NULL;
+	}
+	strcpy(sound->key, key); /* Safe */
+
+	if (!(fs = ast_openstream(chan, filename, ast_channel_language(chan)))) {
+		ao2_ref(sound, -1);
+		return NULL;
+	}
+
+	while ((f = ast_readframe(fs))) {
+		struct ast_frame *out = f;
+		struct ast_frame *cur;
+
+		if (ast_format_cmp(f->subclass.format, ast_format_slin) != AST_FORMAT_CMP_EQUAL) {
+			if (!trans && !(trans = ast_translator_build_path(ast_format_slin, f->subclass.format))) {
+				ast_frfree(f);
+				res = -1;
+				break;
+			}
+			/* May be NULL while the translator buffers */
+			out = ast_translate(trans, f, 0);
+		}
+
+		for (cur = out; cur; cur = AST_LIST_NEXT(cur, frame_list)) {
+			if (!cur->data.ptr || !cur->samples) {
+				continue;
+			}
+			if (sound->samples + cur->samples > max_samples) {
+				too_long = 1;
+				break;
+			}
+			if (sound->samples + cur->samples > size) {
+				int16_t *data;
+
+				size = MAX(size * 2, sound->samples + cur->samples);
+				if (!(data = ast_realloc(sound->data, size * sizeof(*data)))) {
+					res = -1;
+					break;
+				}
+				sound->data = data;
+			}
+			memcpy(sound->data + sound->samples, cur->data.ptr, cur->samples * sizeof(*sound->data));
+			sound->samples += cur->samples;
+		}
+
+		if (out && out != f) {
+			ast_frfree(out);
+		}
+		ast_frfree(f);
+
+		if (res || too_long) {
+			break;
+		}
+	}
+
+	/* Closes the stream and puts the channel back to its old write format */
+	ast_stopstream(chan);
+	if (trans) {
+		ast_translator_free_path(trans);
+	}
+
+	if (res || (!too_long && !sound->samples)) {
+		ao2_ref(sound, -1);
+		return NULL;
+	}
+
+	if (too_long) {
+		/* Remember not to try again */
+		ast_free(sound->data);
+		sound->data = NULL;
+		sound->samples = 0;
+	}
+
+	return sound;
+}
+
+/*!
+ * \internal
+ * \brief Get the decoded sound to play on the playback channel
+ *
+ * \param chan Playback channel, which must not be in autoservice
+ * \param filename Sound file
+ *
+ * \retval NULL if the file needs to be streamed
+ */
+static struct confbridge_sound *confbridge_sound_get(struct ast_channel *chan, const char *filename)
+{
+	struct confbridge_sound *sound;
+	char *key;
+
+	/* Recorded names and other absolute paths are per user, so not worth keeping */
+	if (!sound_cache || filename[0] == '/') {
+		return NULL;
+	}
+
+	if (ast_asprintf(&key, "%s|%s", ast_channel_language(chan), filename) < 0) {
+		return NULL;
+	}
+
+	if (!(sound = ao2_find(sound_cache, key, OBJ_SEARCH_KEY))
+		&& (sound = confbridge_sound_decode(chan, filename, key))) {
+		struct confbridge_sound *existing;
+
+		/* Another conference may have decoded it meanwhile */
+		ao2_lock(sound_cache);
+		if ((existing = ao2_find(sound_cache, key, OBJ_SEARCH_KEY | OBJ_NOLOCK))) {
+			ao2_ref(sound, -1);
+			sound = existing;
+		} else {
+			ao2_link_flags(sound_cache, sound, OBJ_NOLOCK);
+		}
+		ao2_unlock(sound_cache);
+	}
+	ast_free(key);
+
+	if (sound && !sound->samples) {
+		ao2_ref(sound, -1);
+		return NULL;
+	}
+	return sound;
+}
+
+struct confbridge_sound_state {
+	struct confbridge_sound *sound;
+	size_t pos;
+};
+
+static void *confbridge_sound_alloc(struct ast_channel *chan, void *params)
+{
+	struct confbridge_sound_state *state;
+
+	if (!(state = ast_calloc(1, sizeof(*state)))) {
+		return NULL;
+	}
+	state->sound = ao2_bump(params);
+	return state;
+}
+
+static void confbridge_sound_release(struct ast_channel *chan, void *data)
+{
+	struct confbridge_sound_state *state = data;
+
+	ao2_ref(state->sound, -1);
+	ast_free(state);
+}
+
+static int confbridge_sound_generate(struct ast_channel *chan, void *data, int len, int samples)
+{
+	struct confbridge_sound_state *state = data;
+	short buf[2048 + AST_FRIENDLY_OFFSET / 2];
+	struct ast_frame fr = {
+		.frametype = AST_FRAME_VOICE,
+		.subclass.format = ast_format_slin,
+		.offset = AST_FRIENDLY_OFFSET,
+		.data.ptr = buf + AST_FRIENDLY_OFFSET / 2,
+		.src = __PRETTY_FUNCTION__,
+	};
+
+	if (state->pos >= state->sound->samples) {
+		return -1;
+	}
+
+	samples = MIN(samples, state->sound->samples - state->pos);
+	if (samples > ARRAY_LEN(buf) - AST_FRIENDLY_OFFSET / 2) {
+		samples = ARRAY_LEN(buf) - AST_FRIENDLY_OFFSET / 2;
+	}
+
+	/* Copied, so nothing writing to the frame can touch the shared sound */
+	memcpy(fr.data.ptr, state->sound->data + state->pos, samples * sizeof(short));
+	fr.samples = samples;
+	fr.datalen = samples * sizeof(short);
+	state->pos += samples;
+
+	return ast_write(chan, &fr) ? -1 : 0;
+}
+
+static struct ast_generator confbridge_sound_generator = {
+	.alloc = confbridge_sound_alloc,
+	.release = confbridge_sound_release,
+	.generate = confbridge_sound_generate,
+};
+
+static int confbridge_sound_playing(void *data)
+{
+	struct ast_channel *chan = data;
+	int playing;
+
+	ast_channel_lock(chan);
+	playing = ast_channel_generator(chan) == &confbridge_sound_generator;
+	ast_channel_unlock(chan);
+
+	return playing;
+}
+
+/*!
+ * \internal
+ * \brief Play a decoded sound on the playback channel and wait for it to finish
+ */
+static void confbridge_sound_play(struct ast_channel *chan, struct confbridge_sound *sound)
+{
+	int ms = sound->samples * 1000 / ast_format_get_sample_rate(ast_format_slin);
+
+	if (ast_activate_generator(chan, &confbridge_sound_generator, sound)) {
+		return;
+	}
+	ast_safe_sleep_conditional(chan, ms + 1000, confbridge_sound_playing, chan);
+	ast_deactivate_generator(chan);
+}
+
 static void playback_common(struct confbridge_conference *conference, const char *filename, int say_number)
 {
 	/* Don't try to play if the playback channel has been hung up */
@@ -1731,7 +2041,14 @@ static void playback_common(struct confbridge_conference *conference, const char
 
 	/* The channel is all under our control, in goes the prompt */
 	if (!ast_strlen_zero(filename)) {
-		ast_stream_and_wait(conference->playback_chan, filename, "");
+		struct confbridge_sound *sound = confbridge_sound_get(conference->playback_chan, filename);
+
+		if (sound) {
+			confbridge_sound_play(conference->playback_chan, sound);
+			ao2_ref(sound, -1);
+		} else {
+			ast_stream_and_wait(conference->playback_chan, filename, "");
+		}
 	} else if (say_number >= 0) {
 		ast_say_number(conference->playback_chan, say_number, "",
 			ast_channel_language(conference->playback_chan), NULL);
@@ -4162,6 +4479,9 @@ static int unload_module(void)
 	ao2_cleanup(conference_bridges);
 	conference_bridges = NULL;
 
+	ao2_cleanup(sound_cache);
+	sound_cache = NULL;
+
 	conf_destroy_config();
 
 	unregister_channel_tech(conf_announce_get_tech());
@@ -4204,6 +4524,13 @@ static int load_module(void)
 		return AST_MODULE_LOAD_DECLINE;
 	}
 
+	sound_cache = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0,
+		SOUND_CACHE_BUCKETS, confbridge_sound_hash_cb, NULL, confbridge_sound_cmp_cb);
+	if (!sound_cache) {
+		unload_module();
+		return AST_MODULE_LOAD_DECLINE;
+	}
+
 	/* Setup manager stasis subscriptions */
 	res |= manager_confbridge_init();
 
@@ -4234,6 +4561,9 @@ static int load_module(void)
 
 static int reload(void)
 {
+	/* Sound files may have changed too */
+	ao2_callback(sound_cache, OBJ_UNLINK | OBJ_NODATA | OBJ_MULTIPLE, NULL, NULL);
+
 	return conf_reload_config();
 }
 
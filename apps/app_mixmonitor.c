@@ -627,6 +627,8 @@ static void mixmonitor_save_prep(struct mixmonitor *mixmonitor, char *filename,
 				*errflag = 1;
 			} else {
 				struct ast_filestream *tmp = *fs;
+				/* Keep a slow disk from holding up the audiohook */
+				ast_filestream_set_async(tmp, 0, 1000);
 				mixmonitor->mixmonitor_ds->samp_rate = MAX(mixmonitor->mixmonitor_ds->samp_rate, ast_format_get_sample_rate(tmp->fmt->format));
 			}
 		}
@@ -108,6 +108,13 @@
 					<option name="n">
 						<para>Do not play announcement to caller (alters <literal>A(x)</literal> behavior)</para>
 					</option>
+					<option name="p">
+						<argument name="rate" required="true">
+							<para>Maximum number of devices to dial per second</para>
+						</argument>
+						<para>Pace the outbound calls instead of dialing every device at once.
+						The caller is joined to the conference once every device has been dialed.</para>
+					</option>
 				</optionlist>
 			</parameter>
 			<parameter name="timeout">
@@ -139,13 +146,15 @@ enum page_opt_flags {
 	PAGE_NOCALLERANNOUNCE = (1 << 6),
 	PAGE_PREDIAL_CALLEE = (1 << 7),
 	PAGE_PREDIAL_CALLER = (1 << 8),
+	PAGE_PACE = (1 << 9),
 };
 
 enum {
 	OPT_ARG_ANNOUNCE = 0,
 	OPT_ARG_PREDIAL_CALLEE = 1,
 	OPT_ARG_PREDIAL_CALLER = 2,
-	OPT_ARG_ARRAY_SIZE = 3,
+	OPT_ARG_PACE = 3,
+	OPT_ARG_ARRAY_SIZE = 4,
 };
 
 AST_APP_OPTIONS(page_opts, {
@@ -158,6 +167,7 @@ AST_APP_OPTIONS(page_opts, {
 	AST_APP_OPTION('i', PAGE_IGNORE_FORWARDS),
 	AST_APP_OPTION_ARG('A', PAGE_ANNOUNCE, OPT_ARG_ANNOUNCE),
 	AST_APP_OPTION('n', PAGE_NOCALLERANNOUNCE),
+	AST_APP_OPTION_ARG('p', PAGE_PACE, OPT_ARG_PACE),
 });
 
 /* We use this structure as a way to pass this to all dialed channels */
@@ -262,6 +272,8 @@ static int page_exec(struct ast_channel *chan, const char *data)
 	struct ast_dial **dial_list;
 	unsigned int num_dials;
 	int timeout = 0;
+	unsigned int rate = 0;
+	struct timeval start;
 	char *parse;
 
 	AST_DECLARE_APP_ARGS(args,
@@ -297,6 +309,14 @@ static int page_exec(struct ast_channel *chan, const char *data)
 		timeout = atoi(args.timeout);
 	}
 
+	if (ast_test_flag(&options.flags, PAGE_PACE)
+		&& (ast_strlen_zero(options.opts[OPT_ARG_PACE])
+			|| sscanf(options.opts[OPT_ARG_PACE], "%30u", &rate) != 1 || !rate)) {
+		ast_log(LOG_WARNING, "Invalid pace '%s', dialing every device at once.\n",
+			S_OR(options.opts[OPT_ARG_PACE], ""));
+		rate = 0;
+	}
+
 	snprintf(confbridgeopts, sizeof(confbridgeopts), "ConfBridge,%u", confid);
 
 	/* Count number of extensions in list by number of ampersands + 1 */
@@ -329,6 +349,8 @@ static int page_exec(struct ast_channel *chan, const char *data)
 		ast_app_exec_sub(NULL, chan, options.opts[OPT_ARG_PREDIAL_CALLER], 0);
 	}
 
+	start = ast_tvnow();
+
 	/* Go through parsing/calling each device */
 	while ((tech = strsep(&args.devices, "&"))) {
 		int state = 0;
@@ -388,6 +410,17 @@ static int page_exec(struct ast_channel *chan, const char *data)
 		ast_dial_set_state_callback(dial, &page_state_callback);
 		ast_dial_set_user_data(dial, &options);
 
+		/* Hold off until this call is within the rate, giving up if the caller hangs up */
+		if (rate) {
+			int64_t due = (int64_t) pos * 1000 / rate - ast_tvdiff_ms(ast_tvnow(), start);
+
+			if (due > 0 && ast_safe_sleep(chan, due)) {
+				ast_dial_destroy(dial);
+				res = -1;
+				break;
+			}
+		}
+
 		/* Run this dial in async mode */
 		ast_dial_run(dial, chan, 1);
 
@@ -397,7 +430,7 @@ static int page_exec(struct ast_channel *chan, const char *data)
 
 	ast_free(predial_callee);
 
-	if (!ast_test_flag(&options.flags, PAGE_QUIET)) {
+	if (!res && !ast_test_flag(&options.flags, PAGE_QUIET)) {
 		res = ast_streamfile(chan, "beep", ast_channel_language(chan));
 		if (!res)
 			res = ast_waitstream(chan, "");
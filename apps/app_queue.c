@@ -109,6 +109,7 @@
 #include "asterisk/mixmonitor.h"
 #include "asterisk/bridge_basic.h"
 #include "asterisk/max_forwards.h"
+#include "asterisk/alertpipe.h"
 
 /*!
  * \par Please read before modifying this file.
@@ -1486,6 +1487,19 @@ static int realtime_rules = 0;
 /*! \brief Subscription to device state change messages */
 static struct stasis_subscription *device_state_sub;
 
+/*!
+ * \brief Incremented whenever anything deciding if a member is available changes
+ *
+ * Queues cache their number of available members until this changes.
+ */
+static unsigned int member_state_generation = 1;
+
+/*! \brief Note that a member's availability may have changed */
+static void member_state_changed(void)
+{
+	ast_atomic_fetch_add(&member_state_generation, 1, __ATOMIC_RELEASE);
+}
+
 /*! \brief queues.conf [general] option */
 static int update_cdr = 0;
 
@@ -1595,6 +1609,7 @@ struct queue_ent {
 	AST_LIST_HEAD_NOLOCK(,penalty_rule) qe_rules; /*!< Local copy of the queue's penalty rules */
 	struct penalty_rule *pr;               /*!< Pointer to the next penalty rule to implement */
 	struct queue_ent *next;                /*!< The next queue entry */
+	int wakeup[2];                         /*!< Alert pipe written when it may have become our turn */
 };
 
 struct member {
@@ -1757,6 +1772,11 @@ struct call_queue {
 	int memberdelay;                    /*!< Seconds to delay connecting member to caller */
 	int autofill;                       /*!< Ignore the head call status and ring an available agent */
 
+	/* Cached num_available_members() result */
+	int available_count;                /*!< Number of available members */
+	unsigned int available_generation;  /*!< member_state_generation the count was made at */
+	time_t available_until;             /*!< When a counted out member's wrapup time ends, 0 if none */
+
 	struct ao2_container *members;      /*!< Head of the list of members */
 	struct queue_ent *head;             /*!< Head of the list of callers */
 	AST_LIST_ENTRY(call_queue) list;    /*!< Next call queue */
@@ -1777,6 +1797,7 @@ static void update_realtime_members(struct call_queue *q);
 static struct member *interface_exists(struct call_queue *q, const char *interface);
 static int set_member_paused(const char *queuename, const char *interface, const char *reason, int paused);
 static int update_queue(struct call_queue *q, struct member *member, int callcompletedinsl, time_t starttime);
+static void queue_wake_callers(struct call_queue *q);
 
 static struct member *find_member_by_queuename_and_interface(const char *queuename, const char *interface);
 /*! \brief sets the QUEUESTATUS channel variable */
@@ -2437,6 +2458,159 @@ static void pending_members_remove(struct member *mem)
 	ao2_find(pending_members, mem, OBJ_POINTER | OBJ_NODATA | OBJ_UNLINK);
 }
 
+/*!
+ * \brief Queues that have a member using a device for its state
+ *
+ * This lets device_state_cb() look at only the queues a device is in rather
+ * than every member of every queue. Queue names are added as members are
+ * added and are dropped lazily, once a state change finds the queue gone
+ * or no longer has a member using the device.
+ */
+static struct ao2_container *device_queues;
+#define MAX_DEVICE_QUEUES_BUCKETS 353
+
+struct device_queues_entry {
+	/*! Names of the queues the device is used in */
+	AST_VECTOR(, char *) queues;
+	/*! Device name, as it appears in device state messages */
+	char device[0];
+};
+
+static int device_queues_hash(const void *obj, const int flags)
+{
+	const struct device_queues_entry *object;
+	const char *key;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		key = obj;
+		break;
+	case OBJ_SEARCH_OBJECT:
+		object = obj;
+		key = object->device;
+		break;
+	default:
+		ast_assert(0);
+		return 0;
+	}
+	return ast_str_case_hash(key);
+}
+
+static int device_queues_cmp(void *obj, void *arg, int flags)
+{
+	const struct device_queues_entry *object_left = obj;
+	const struct device_queues_entry *object_right = arg;
+	const char *right_key = arg;
+	int cmp;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_OBJECT:
+		right_key = object_right->device;
+		/* Fall through */
+	case OBJ_SEARCH_KEY:
+		cmp = strcasecmp(object_left->device, right_key);
+		break;
+	case OBJ_SEARCH_PARTIAL_KEY:
+		/* Not supported by container. */
+		ast_assert(0);
+		return 0;
+	default:
+		cmp = 0;
+		break;
+	}
+	if (cmp) {
+		return 0;
+	}
+	return CMP_MATCH;
+}
+
+static void device_queues_entry_destroy(void *obj)
+{
+	struct device_queues_entry *entry = obj;
+
+	AST_VECTOR_CALLBACK_VOID(&entry->queues, ast_free);
+	AST_VECTOR_FREE(&entry->queues);
+}
+
+/*! \brief Get the name device state messages use for a member's state_interface */
+static void member_device_name(const struct member *mem, char *device, size_t size)
+{
+	char *slash_pos;
+
+	ast_copy_string(device, mem->state_interface, size);
+	if ((slash_pos = strchr(device, '/'))) {
+		if (!strncasecmp(device, "Local/", 6) && (slash_pos = strchr(slash_pos + 1, '/'))) {
+			*slash_pos = '\0';
+		}
+	}
+}
+
+/*! \brief Record that a queue has a member using the member's device */
+static void device_queues_add(struct call_queue *q, struct member *mem)
+{
+	struct device_queues_entry *entry;
+	char device[80];
+	char *name;
+	int i;
+
+	member_device_name(mem, device, sizeof(device));
+
+	ao2_lock(device_queues);
+	entry = ao2_find(device_queues, device, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if (!entry) {
+		entry = ao2_alloc_options(sizeof(*entry) + strlen(device) + 1,
+			device_queues_entry_destroy, AO2_ALLOC_OPT_LOCK_NOLOCK);
+		if (!entry || AST_VECTOR_INIT(&entry->queues, 1)) {
+			ao2_cleanup(entry);
+			ao2_unlock(device_queues);
+			ast_log(LOG_ERROR, "Unable to track device '%s' for queue '%s'\n", device, q->name);
+			return;
+		}
+		strcpy(entry->device, device); /* Safe */
+		ao2_link_flags(device_queues, entry, OBJ_NOLOCK);
+	}
+
+	for (i = 0; i < AST_VECTOR_SIZE(&entry->queues); i++) {
+		if (!strcmp(AST_VECTOR_GET(&entry->queues, i), q->name)) {
+			break;
+		}
+	}
+	if (i == AST_VECTOR_SIZE(&entry->queues)) {
+		name = ast_strdup(q->name);
+		if (!name || AST_VECTOR_APPEND(&entry->queues, name)) {
+			ast_free(name);
+			ast_log(LOG_ERROR, "Unable to track device '%s' for queue '%s'\n", device, q->name);
+		}
+	}
+	ao2_unlock(device_queues);
+	ao2_ref(entry, -1);
+}
+
+/*! \brief Forget that a queue has a member using a device */
+static void device_queues_prune(const char *device, const char *queuename)
+{
+	struct device_queues_entry *entry;
+	int i;
+
+	ao2_lock(device_queues);
+	entry = ao2_find(device_queues, device, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if (!entry) {
+		ao2_unlock(device_queues);
+		return;
+	}
+	for (i = 0; i < AST_VECTOR_SIZE(&entry->queues); i++) {
+		if (!strcmp(AST_VECTOR_GET(&entry->queues, i), queuename)) {
+			ast_free(AST_VECTOR_REMOVE_UNORDERED(&entry->queues, i));
+			break;
+		}
+	}
+	if (!AST_VECTOR_SIZE(&entry->queues)) {
+		ao2_unlink_flags(device_queues, entry, OBJ_NOLOCK);
+	}
+	ao2_unlock(device_queues);
+	ao2_ref(entry, -1);
+}
+
 /*! \brief set a member's status based on device state of that member's state_interface.
  *
  * Lock interface list find sc, iterate through each queues queue_member list for member to
@@ -2454,6 +2628,8 @@ static void update_status(struct call_queue *q, struct member *m, const int stat
 		}
 
 		m->status = status;
+		member_state_changed();
+		queue_wake_callers(q);
 
 		/* Remove the member from the pending members pool only when the status changes.
 		 * This is not done unconditionally because we can occasionally see multiple
@@ -2510,14 +2686,17 @@ static int is_member_available(struct call_queue *q, struct member *mem)
 /*! \brief set a member's status based on device state of that member's interface*/
 static void device_state_cb(void *unused, struct stasis_subscription *sub, struct stasis_message *msg)
 {
-	struct ao2_iterator miter, qiter;
+	struct ao2_iterator miter;
 	struct ast_device_state_message *dev_state;
+	struct device_queues_entry *entry;
+	AST_VECTOR(, char *) queuenames;
 	struct member *m;
 	struct call_queue *q;
-	char interface[80], *slash_pos;
+	char interface[80];
 	int found = 0;			/* Found this member in any queue */
 	int found_member;		/* Found this member in this queue */
 	int avail = 0;			/* Found an available member in this queue */
+	int i;
 
 	if (ast_device_state_message_type() != stasis_message_type(msg)) {
 		return;
@@ -2529,8 +2708,33 @@ static void device_state_cb(void *unused, struct stasis_subscription *sub, struc
 		return;
 	}
 
-	qiter = ao2_iterator_init(queues, 0);
-	while ((q = ao2_t_iterator_next(&qiter, "Iterate over queues"))) {
+	/* Copy the queue names so no queue is locked while holding the index */
+	AST_VECTOR_INIT(&queuenames, 0);
+	ao2_lock(device_queues);
+	entry = ao2_find(device_queues, dev_state->device, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if (entry) {
+		for (i = 0; i < AST_VECTOR_SIZE(&entry->queues); i++) {
+			char *name = ast_strdup(AST_VECTOR_GET(&entry->queues, i));
+
+			if (!name || AST_VECTOR_APPEND(&queuenames, name)) {
+				ast_free(name);
+			}
+		}
+		ao2_ref(entry, -1);
+	}
+	ao2_unlock(device_queues);
+
+	for (i = 0; i < AST_VECTOR_SIZE(&queuenames); i++) {
+		struct call_queue tmpq = {
+			.name = AST_VECTOR_GET(&queuenames, i),
+		};
+
+		q = ao2_t_find(queues, &tmpq, OBJ_POINTER, "Look for queue using device");
+		if (!q) {
+			device_queues_prune(dev_state->device, tmpq.name);
+			continue;
+		}
+
 		ao2_lock(q);
 
 		avail = 0;
@@ -2538,13 +2742,7 @@ static void device_state_cb(void *unused, struct stasis_subscription *sub, struc
 		miter = ao2_iterator_init(q->members, 0);
 		for (; (m = ao2_iterator_next(&miter)); ao2_ref(m, -1)) {
 			if (!found_member) {
-				ast_copy_string(interface, m->state_interface, sizeof(interface));
-
-				if ((slash_pos = strchr(interface, '/'))) {
-					if (!strncasecmp(interface, "Local/", 6) && (slash_pos = strchr(slash_pos + 1, '/'))) {
-						*slash_pos = '\0';
-					}
-				}
+				member_device_name(m, interface, sizeof(interface));
 
 				if (!strcasecmp(interface, dev_state->device)) {
 					found_member = 1;
@@ -2575,9 +2773,14 @@ static void device_state_cb(void *unused, struct stasis_subscription *sub, struc
 		ao2_iterator_destroy(&miter);
 
 		ao2_unlock(q);
-		queue_t_unref(q, "Done with iterator");
+		queue_t_unref(q, "Done with device state");
+
+		if (!found_member) {
+			device_queues_prune(dev_state->device, tmpq.name);
+		}
 	}
-	ao2_iterator_destroy(&qiter);
+	AST_VECTOR_CALLBACK_VOID(&queuenames, ast_free);
+	AST_VECTOR_FREE(&queuenames);
 
 	if (found) {
 		ast_debug(1, "Device '%s' changed to state '%u' (%s)\n",
@@ -2773,6 +2976,7 @@ static void init_queue(struct call_queue *q)
 	int i;
 	struct penalty_rule *pr_iter;
 
+	member_state_changed();
 	q->dead = 0;
 	q->retry = DEFAULT_RETRY;
 	q->timeout = DEFAULT_TIMEOUT;
@@ -2882,6 +3086,7 @@ static void clear_queue(struct call_queue *q)
 			ao2_ref(mem, -1);
 		}
 		ao2_iterator_destroy(&mem_iter);
+		member_state_changed();
 	}
 }
 
@@ -3145,6 +3350,9 @@ static void parse_empty_options(const char *value, enum empty_conditions *empty,
 */
 static void queue_set_param(struct call_queue *q, const char *param, const char *val, int linenum, int failunknown)
 {
+	/* The strategy, autofill, ringinuse and wrapuptime options decide who is available */
+	member_state_changed();
+
 	if (!strcasecmp(param, "musicclass") ||
 		!strcasecmp(param, "music") || !strcasecmp(param, "musiconhold")) {
 		ast_string_field_set(q, moh, val);
@@ -3364,6 +3572,8 @@ static void member_add_to_queue(struct call_queue *queue, struct member *mem)
 	ao2_lock(queue->members);
 	mem->queuepos = ao2_container_count(queue->members);
 	ao2_link(queue->members, mem);
+	member_state_changed();
+	device_queues_add(queue, mem);
 	ast_devstate_changed(mem->paused ? QUEUE_PAUSED_DEVSTATE : QUEUE_UNPAUSED_DEVSTATE,
 		AST_DEVSTATE_CACHABLE, "Queue:%s_pause_%s", queue->name, mem->interface);
 	ao2_unlock(queue->members);
@@ -3382,6 +3592,7 @@ static void member_remove_from_queue(struct call_queue *queue, struct member *me
 	ast_devstate_changed(QUEUE_UNKNOWN_PAUSED_DEVSTATE, AST_DEVSTATE_CACHABLE, "Queue:%s_pause_%s", queue->name, mem->interface);
 	queue_member_follower_removal(queue, mem);
 	ao2_unlink(queue->members, mem);
+	member_state_changed();
 	ao2_unlock(queue->members);
 }
 
@@ -3471,10 +3682,12 @@ static void rt_handle_member_record(struct call_queue *q, char *category, struct
 			}
 			if (strcasecmp(state_interface, m->state_interface)) {
 				ast_copy_string(m->state_interface, state_interface, sizeof(m->state_interface));
+				device_queues_add(q, m);
 			}
 			m->penalty = penalty;
 			m->ringinuse = ringinuse;
 			m->wrapuptime = wrapuptime;
+			member_state_changed();
 			found = 1;
 			ao2_ref(m, -1);
 			break;
@@ -4216,6 +4429,8 @@ static void leave_queue(struct queue_ent *qe)
 			prev = current;
 		}
 	}
+	/* The callers behind us have moved up */
+	queue_wake_callers(q);
 	ao2_unlock(q);
 
 	/*If the queue is a realtime queue, check to see if it's still defined in real time*/
@@ -4312,11 +4527,34 @@ static int num_available_members(struct call_queue *q)
 	struct member *mem;
 	int avl = 0;
 	struct ao2_iterator mem_iter;
+	unsigned int generation;
+	time_t now;
+	time_t until = 0;
+
+	/*
+	 * Waiting callers all ask this every time they check if it is their turn,
+	 * so reuse the last count until a member changes or a wrapup time ends.
+	 */
+	generation = __atomic_load_n(&member_state_generation, __ATOMIC_ACQUIRE);
+	now = time(NULL);
+	if (q->available_generation == generation
+		&& (!q->available_until || now < q->available_until)) {
+		return q->available_count;
+	}
 
 	mem_iter = ao2_iterator_init(q->members, 0);
 	while ((mem = ao2_iterator_next(&mem_iter))) {
+		int wrapuptime;
 
-		avl += is_member_available(q, mem);
+		if (is_member_available(q, mem)) {
+			avl++;
+		} else if (mem->lastcall && (wrapuptime = get_wrapuptime(q, mem))
+			&& now - wrapuptime < mem->lastcall) {
+			/* The member becomes available when the wrapup time ends */
+			if (!until || mem->lastcall + wrapuptime < until) {
+				until = mem->lastcall + wrapuptime;
+			}
+		}
 		ao2_ref(mem, -1);
 
 		/* If autofill is not enabled or if the queue's strategy is ringall, then
@@ -4335,9 +4573,43 @@ static int num_available_members(struct call_queue *q)
 	}
 	ao2_iterator_destroy(&mem_iter);
 
+	q->available_count = avl;
+	q->available_generation = generation;
+	q->available_until = until;
+
 	return avl;
 }
 
+/*!
+ * \internal
+ * \brief Wake the waiting callers that may now have their turn
+ *
+ * The callers wake up from wait_our_turn() right away instead of at their
+ * next periodic check.
+ *
+ * \note The queue must be locked
+ */
+static void queue_wake_callers(struct call_queue *q)
+{
+	struct queue_ent *qe;
+	int avl;
+
+	if (!q->head) {
+		return;
+	}
+
+	avl = num_available_members(q);
+	for (qe = q->head; qe && avl > 0; qe = qe->next) {
+		if (qe->pending) {
+			continue;
+		}
+		if (ast_alertpipe_writable(qe->wakeup)) {
+			ast_alertpipe_write(qe->wakeup);
+		}
+		avl--;
+	}
+}
+
 /* traverse all defined queues which have calls waiting and contain this member
    return 0 if no other queue has precedence (higher weight) or 1 if found  */
 static int compare_weight(struct call_queue *rq, struct member *member)
@@ -5699,9 +5971,13 @@ static int wait_our_turn(struct queue_ent *qe, int ringing, enum queue_result *r
 			break;
 		}
 
-		/* Wait a second before checking again */
-		if ((res = ast_waitfordigit(qe->chan, RECHECK * 1000))) {
-			if (res > 0 && !valid_exit(qe, res)) {
+		/* Wait a second before checking again, unless woken up for our turn */
+		if ((res = ast_waitfordigit_full(qe->chan, RECHECK * 1000, NULL, -1, ast_alertpipe_readfd(qe->wakeup)))) {
+			if (res == 1) {
+				/* Woken up, DTMF digits are never 1 */
+				ast_alertpipe_flush(qe->wakeup);
+				res = 0;
+			} else if (res > 0 && !valid_exit(qe, res)) {
 				res = 0;
 			} else {
 				break;
@@ -5748,6 +6024,7 @@ static int update_queue(struct call_queue *q, struct member *member, int callcom
 				mem->callcompletedinsl = 0;
 				mem->starttime = 0;
 				mem->lastqueue = q;
+				member_state_changed();
 				ao2_ref(mem, -1);
 			}
 			ao2_unlock(qtmp);
@@ -5760,6 +6037,7 @@ static int update_queue(struct call_queue *q, struct member *member, int callcom
 		member->callcompletedinsl = 0;
 		member->calls++;
 		member->starttime = 0;
+		member_state_changed();
 		member->lastqueue = q;
 		ao2_unlock(q);
 	}
@@ -7389,6 +7667,7 @@ static int add_to_queue(const char *queuename, const char *interface, const char
 			}
 			member_add_to_queue(q, new_member);
 			queue_publish_member_blob(queue_member_added_type(), queue_member_blob_create(q, new_member));
+			queue_wake_callers(q);
 
 			if (is_member_available(q, new_member)) {
 				ast_devstate_changed(AST_DEVICE_NOT_INUSE, AST_DEVSTATE_CACHABLE, "Queue:%s_avail", q->name);
@@ -7493,6 +7772,10 @@ static void set_queue_member_pause(struct call_queue *q, struct member *mem, con
 	}
 
 	mem->paused = paused;
+	member_state_changed();
+	if (!paused) {
+		queue_wake_callers(q);
+	}
 	if (paused) {
 		time(&mem->lastpause); /* update last pause field */
 	}
@@ -7625,6 +7908,7 @@ static void set_queue_member_ringinuse(struct call_queue *q, struct member *mem,
 	}
 
 	mem->ringinuse = ringinuse;
+	member_state_changed();
 
 	ast_queue_log(q->name, "NONE", mem->interface, "RINGINUSE", "%d", ringinuse);
 	queue_publish_member_blob(queue_member_ringinuse_type(), queue_member_blob_create(q, mem));
@@ -8343,9 +8627,14 @@ static int queue_exec(struct ast_channel *chan, const char *data)
 	qe.last_periodic_announce_time = time(NULL);
 	qe.last_periodic_announce_sound = 0;
 	qe.valid_digits = 0;
+	if (ast_alertpipe_init(qe.wakeup)) {
+		/* Without it we only notice our turn by checking periodically */
+		ast_alertpipe_clear(qe.wakeup);
+	}
 	if (join_queue(args.queuename, &qe, &reason, position)) {
 		ast_log(LOG_WARNING, "Unable to join queue '%s'\n", args.queuename);
 		set_queue_result(chan, reason);
+		ast_alertpipe_close(qe.wakeup);
 		return 0;
 	}
 	ast_assert(qe.parent != NULL);
@@ -8527,6 +8816,7 @@ stop:
 	set_queue_variables(qe.parent, qe.chan);
 
 	leave_queue(&qe);
+	ast_alertpipe_close(qe.wakeup);
 	if (reason != QUEUE_UNKNOWN)
 		set_queue_result(chan, reason);
 
@@ -9321,6 +9611,8 @@ static void reload_single_member(const char *memberdata, struct call_queue *q)
 			newm->queuepos = cur->queuepos;
 			ao2_link(q->members, newm);
 			ao2_unlink(q->members, cur);
+			member_state_changed();
+			device_queues_add(q, newm);
 			ao2_unlock(q->members);
 		} else {
 			/* Otherwise we need to add using the function that will apply a round robin queue position manually. */
@@ -9348,6 +9640,7 @@ static int kill_dead_members(void *obj, void *arg, int flags)
 {
 	struct member *member = obj;
 
+	member_state_changed();
 	if (!member->delme) {
 		member->status = get_queue_member_status(member);
 		return 0;
@@ -9458,6 +9751,7 @@ static void reload_single_queue(struct ast_config *cfg, struct ast_flags *mask,
 		while ((member = ao2_iterator_next(&mem_iter))) {
 			if (member->dynamic) {
 				member->ringinuse = q->ringinuse;
+				member_state_changed();
 			}
 			ao2_ref(member, -1);
 		}
@@ -11158,6 +11452,7 @@ static int qupd_exec(struct ast_channel *chan, const char *data)
 					oldtalktime = q->talktime;
 					q->talktime = (((oldtalktime << 2) - oldtalktime) + newtalktime) >> 2;
 					time(&mem->lastcall);
+					member_state_changed();
 					mem->calls++;
 					mem->lastqueue = q;
 					q->callscompleted++;
@@ -11168,6 +11463,7 @@ static int qupd_exec(struct ast_channel *chan, const char *data)
 				} else {
 
 					time(&mem->lastcall);
+					member_state_changed();
 					q->callsabandoned++;
 				}
 
@@ -11261,6 +11557,7 @@ static int unload_module(void)
 	ast_unload_realtime("queue_members");
 	ao2_cleanup(queues);
 	ao2_cleanup(pending_members);
+	ao2_cleanup(device_queues);
 
 	queues = NULL;
 	return 0;
@@ -11297,6 +11594,13 @@ static int load_module(void)
 		return AST_MODULE_LOAD_DECLINE;
 	}
 
+	device_queues = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0,
+		MAX_DEVICE_QUEUES_BUCKETS, device_queues_hash, NULL, device_queues_cmp);
+	if (!device_queues) {
+		unload_module();
+		return AST_MODULE_LOAD_DECLINE;
+	}
+
 	use_weight = 0;
 
 	if (reload_handler(0, &mask, NULL)) {
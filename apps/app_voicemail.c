@@ -522,6 +522,7 @@ static int imapversion = 1;
 static int expungeonhangup = 1;
 static int imapgreetings = 0;
 static int imap_poll_logout = 0;
+static int imap_count_cache = 0;
 static char delimiter = '\0';
 
 /* mail_open cannot be protected on a stream basis */
@@ -605,7 +606,6 @@ static AST_LIST_HEAD_STATIC(vmstates, vmstate);
 #define MINPASSWORD 0 /*!< Default minimum mailbox password length */
 
 #define BASELINELEN 72
-#define BASEMAXINLINE 256
 #ifdef IMAP_STORAGE
 #define ENDL "\r\n"
 #else
@@ -802,14 +802,6 @@ and vm-Old are spelled plural, to make them sound more as folder name than an ad
 
 */
 
-struct baseio {
-	int iocp;
-	int iolen;
-	int linelength;
-	int ateof;
-	unsigned char iobuf[BASEMAXINLINE];
-};
-
 #define MAX_VM_MBOX_ID_LEN (AST_MAX_EXTENSION)
 #define MAX_VM_CONTEXT_LEN (AST_MAX_CONTEXT)
 /* MAX_VM_MAILBOX_LEN allows enough room for the '@' and NULL terminator */
@@ -889,6 +881,8 @@ struct vm_state {
 #ifdef IMAP_STORAGE
 	ast_mutex_t lock;
 	int updated;                         /*!< decremented on each mail check until 1 -allows delay */
+	unsigned int counts_valid;           /*!< Bitmask of message counts cached from the last search */
+	time_t counts_checked;               /*!< When the cached message counts were last searched */
 	long *msgArray;
 	unsigned msg_array_max;
 	MAILSTREAM *mailstream;
@@ -1005,6 +999,10 @@ static char aliasescontext[MAX_VM_CONTEXT_LEN];
  *  app_voicemail that may change them. */
 static unsigned int poll_mailboxes;
 
+/*! Build and send voicemail e-mail outside of the channel thread */
+static unsigned int async_email;
+static struct ast_taskprocessor *email_tps;
+
 /*! Polling frequency */
 static unsigned int poll_freq;
 /*! By default, poll every 30 seconds */
@@ -1073,6 +1071,94 @@ static struct ao2_container *mailbox_alias_mappings;
 AO2_STRING_FIELD_HASH_FN(mailbox_alias_mapping, mailbox);
 AO2_STRING_FIELD_CMP_FN(mailbox_alias_mapping, mailbox);
 
+#if !(defined(ODBC_STORAGE) || defined(IMAP_STORAGE))
+/*!
+ * \brief Cached number of messages in a mailbox folder
+ *
+ * Counting means reading the whole folder directory, which adds up when
+ * MWI polling asks about many mailboxes. The count is reused for as long as
+ * the directory modification time is unchanged, so messages saved, moved or
+ * deleted by anything (us included) are picked up on the next check.
+ */
+struct message_count {
+	/*! Modification time of the directory when it was counted */
+	time_t mtime;
+	/*! When the directory was counted */
+	time_t counted;
+	/*! Number of messages */
+	int count;
+	/*! Path of the folder directory */
+	char path[0];
+};
+
+#define MESSAGE_COUNT_BUCKETS 1021
+static struct ao2_container *message_counts;
+AO2_STRING_FIELD_HASH_FN(message_count, path);
+AO2_STRING_FIELD_CMP_FN(message_count, path);
+
+/*!
+ * \internal
+ * \brief Get the cached message count of a folder directory
+ *
+ * \param path Folder directory
+ * \param mtime Current modification time of the directory
+ *
+ * \retval -1 if there is no usable count
+ * \return the number of messages otherwise
+ */
+static int message_count_get(const char *path, time_t mtime)
+{
+	struct message_count *cached;
+	int count = -1;
+
+	ao2_lock(message_counts);
+	cached = ao2_find(message_counts, path, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	/*
+	 * A directory changed in the same second it was counted can change
+	 * again without its modification time moving, so don't trust it.
+	 */
+	if (cached && cached->mtime == mtime && cached->mtime < cached->counted) {
+		count = cached->count;
+	}
+	ao2_unlock(message_counts);
+	ao2_cleanup(cached);
+
+	return count;
+}
+
+/*!
+ * \internal
+ * \brief Save the message count of a folder directory
+ *
+ * \param path Folder directory
+ * \param mtime Modification time of the directory before it was read
+ * \param counted When the directory was read
+ * \param count Number of messages found
+ */
+static void message_count_set(const char *path, time_t mtime, time_t counted, int count)
+{
+	struct message_count *cached;
+
+	ao2_lock(message_counts);
+	cached = ao2_find(message_counts, path, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if (!cached) {
+		cached = ao2_alloc_options(sizeof(*cached) + strlen(path) + 1, NULL,
+			AO2_ALLOC_OPT_LOCK_NOLOCK);
+		if (!cached) {
+			ao2_unlock(message_counts);
+			return;
+		}
+		strcpy(cached->path, path); /* SAFE */
+		ao2_link_flags(message_counts, cached, OBJ_NOLOCK);
+	}
+	cached->mtime = mtime;
+	cached->counted = counted;
+	cached->count = count;
+	ao2_unlock(message_counts);
+	ao2_ref(cached, -1);
+}
+#endif
+
 /* custom audio control prompts for voicemail playback */
 static char listen_control_forward_key[12];
 static char listen_control_reverse_key[12];
@@ -2537,6 +2623,7 @@ static int __messagecount(const char *context, const char *mailbox, const char *
 	int ret = 0;
 	int fold = folder_int(folder);
 	int urgent = 0;
+	unsigned int count_bit;
 
 	/* If URGENT, then look at INBOX */
 	if (fold == 11) {
@@ -2596,7 +2683,31 @@ static int __messagecount(const char *context, const char *mailbox, const char *
 	if (!vms_p) {
 		vms_p = create_vm_state_from_user(vmu);
 	}
-	ret = init_mailstream(vms_p, fold);
+
+	/* While counts are cached the stream is still on the voicemail folder, so a
+	 * NOOP is enough to learn whether anything changed since they were searched. */
+	count_bit = 1 << (urgent ? 2 : fold);
+	if (imap_count_cache > 0 && fold <= OLD_FOLDER && vms_p->mailstream && vms_p->counts_valid) {
+		if (time(NULL) - vms_p->counts_checked >= imap_count_cache) {
+			vms_p->counts_valid = 0;
+		} else {
+			ast_mutex_lock(&vms_p->lock);
+			mail_ping(vms_p->mailstream);
+			ast_mutex_unlock(&vms_p->lock);
+			if (vms_p->updated) {
+				vms_p->counts_valid = 0;
+			} else if (vms_p->counts_valid & count_bit) {
+				ast_debug(3, "Returning cached message count for %s\n", vmu->imapuser);
+				free_user(vmu);
+				if (urgent) {
+					return vms_p->urgentmessages;
+				}
+				return fold == NEW_FOLDER ? vms_p->newmessages : vms_p->oldmessages;
+			}
+		}
+	}
+
+	ret = (fold <= OLD_FOLDER && vms_p->counts_valid) ? 0 : init_mailstream(vms_p, fold);
 	if (!vms_p->mailstream) {
 		ast_log(AST_LOG_ERROR, "Houston we have a problem - IMAP mailstream is NULL\n");
 		free_user(vmu);
@@ -2642,6 +2753,12 @@ static int __messagecount(const char *context, const char *mailbox, const char *
 			vms_p->urgentmessages = vms_p->vmArrayIndex;
 		/*Freeing the searchpgm also frees the searchhdr*/
 		mail_free_searchpgm(&pgm);
+		if (imap_count_cache > 0 && fold <= OLD_FOLDER) {
+			if (!vms_p->counts_valid) {
+				vms_p->counts_checked = time(NULL);
+			}
+			vms_p->counts_valid |= count_bit;
+		}
 		ast_mutex_unlock(&vms_p->lock);
 		free_user(vmu);
 		vms_p->updated = 0;
@@ -3075,6 +3192,9 @@ static int init_mailstream(struct vm_state *vms, int box)
 	/* debug = T;  user wants protocol telemetry? */
 	debug = NIL;  /* NO protocol telemetry? */
 
+	/* Reselecting a folder means a NOOP can no longer vouch for cached counts */
+	vms->counts_valid = 0;
+
 	if (delimiter == '\0') {		/* did not probe the server yet */
 		char *cp;
 #ifdef USE_SYSTEM_IMAP
@@ -4842,71 +4962,12 @@ static int vm_delete(char *file)
 	return ast_filedelete(file, NULL);
 }
 
-/*!
- * \brief utility used by inchar(), for base_encode()
- */
-static int inbuf(struct baseio *bio, FILE *fi)
-{
-	int l;
-
-	if (bio->ateof)
-		return 0;
-
-	if ((l = fread(bio->iobuf, 1, BASEMAXINLINE, fi)) != BASEMAXINLINE) {
-		bio->ateof = 1;
-		if (l == 0) {
-			/* Assume EOF */
-			return 0;
-		}
-	}
-
-	bio->iolen = l;
-	bio->iocp = 0;
-
-	return 1;
-}
-
-/*!
- * \brief utility used by base_encode()
- */
-static int inchar(struct baseio *bio, FILE *fi)
-{
-	if (bio->iocp>=bio->iolen) {
-		if (!inbuf(bio, fi))
-			return EOF;
-	}
-
-	return bio->iobuf[bio->iocp++];
-}
-
-/*!
- * \brief utility used by base_encode()
- */
-static int ochar(struct baseio *bio, int c, FILE *so)
-{
-	if (bio->linelength >= BASELINELEN) {
-		if (fputs(ENDL, so) == EOF) {
-			return -1;
-		}
-
-		bio->linelength = 0;
-	}
-
-	if (putc(((unsigned char) c), so) == EOF) {
-		return -1;
-	}
-
-	bio->linelength++;
-
-	return 1;
-}
-
 /*!
  * \brief Performs a base 64 encode algorithm on the contents of a File
  * \param filename The path to the file to be encoded. Must be readable, file is opened in read mode.
  * \param so A FILE handle to the output file to receive the base 64 encoded contents of the input file, identified by filename.
  *
- * TODO: shouldn't this (and the above 3 support functions) be put into some kind of external utility location, such as funcs/func_base64.c ?
+ * TODO: shouldn't this be put into some kind of external utility location, such as funcs/func_base64.c ?
  *
  * \return zero on success, -1 on error.
  */
@@ -4916,48 +4977,54 @@ static int base_encode(char *filename, FILE *so)
 		'L', 'M', 'N', 'O', 'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z', 'a', 'b', 'c', 'd', 'e', 'f',
 		'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z', '0',
 		'1', '2', '3', '4', '5', '6', '7', '8', '9', '+', '/'};
-	int i, hiteof = 0;
+	/* Whole output lines of input, so every line but the last is full */
+	unsigned char ibuf[BASELINELEN / 4 * 3 * 64];
+	char obuf[BASELINELEN + sizeof(ENDL)];
+	int first = 1;
+	size_t len;
 	FILE *fi;
-	struct baseio bio;
-
-	memset(&bio, 0, sizeof(bio));
-	bio.iocp = BASEMAXINLINE;
 
 	if (!(fi = fopen(filename, "rb"))) {
 		ast_log(AST_LOG_WARNING, "Failed to open file: %s: %s\n", filename, strerror(errno));
 		return -1;
 	}
 
-	while (!hiteof){
-		unsigned char igroup[3], ogroup[4];
-		int c, n;
+	while ((len = fread(ibuf, 1, sizeof(ibuf), fi)) > 0) {
+		size_t i = 0;
 
-		memset(igroup, 0, sizeof(igroup));
+		while (i < len) {
+			char *o = obuf;
+			size_t end = MIN(len, i + BASELINELEN / 4 * 3);
 
-		for (n = 0; n < 3; n++) {
-			if ((c = inchar(&bio, fi)) == EOF) {
-				hiteof = 1;
-				break;
+			if (!first) {
+				memcpy(o, ENDL, sizeof(ENDL) - 1);
+				o += sizeof(ENDL) - 1;
 			}
+			first = 0;
 
-			igroup[n] = (unsigned char) c;
-		}
-
-		if (n > 0) {
-			ogroup[0]= dtable[igroup[0] >> 2];
-			ogroup[1]= dtable[((igroup[0] & 3) << 4) | (igroup[1] >> 4)];
-			ogroup[2]= dtable[((igroup[1] & 0xF) << 2) | (igroup[2] >> 6)];
-			ogroup[3]= dtable[igroup[2] & 0x3F];
-
-			if (n < 3) {
-				ogroup[3] = '=';
+			for (; i + 3 <= end; i += 3) {
+				*o++ = dtable[ibuf[i] >> 2];
+				*o++ = dtable[((ibuf[i] & 3) << 4) | (ibuf[i + 1] >> 4)];
+				*o++ = dtable[((ibuf[i + 1] & 0xF) << 2) | (ibuf[i + 2] >> 6)];
+				*o++ = dtable[ibuf[i + 2] & 0x3F];
+			}
+			if (i < end) {
+				unsigned char second = end - i > 1 ? ibuf[i + 1] : 0;
+
+				*o++ = dtable[ibuf[i] >> 2];
+				*o++ = dtable[((ibuf[i] & 3) << 4) | (second >> 4)];
+				*o++ = end - i > 1 ? dtable[(second & 0xF) << 2] : '=';
+				*o++ = '=';
+				i = end;
+			}
 
-				if (n < 2)
-					ogroup[2] = '=';
+			if (fwrite(obuf, 1, o - obuf, so) != o - obuf) {
+				break;
 			}
+		}
 
-			for (i = 0; i < 4; i++)
-				ochar(&bio, ogroup[i], so);
+		if (len < sizeof(ibuf)) {
+			break;
 		}
 	}
 
@@ -5604,6 +5671,113 @@ static int sendmail(char *srcemail,
 	return 0;
 }
 
+/*! \brief An e-mail waiting to be built and sent by the e-mail taskprocessor */
+struct email_task {
+	AST_DECLARE_STRING_FIELDS(
+		AST_STRING_FIELD(srcemail);
+		AST_STRING_FIELD(fromfolder);
+		AST_STRING_FIELD(cidnum);
+		AST_STRING_FIELD(cidname);
+		AST_STRING_FIELD(attach);
+		AST_STRING_FIELD(format);
+		AST_STRING_FIELD(category);
+		AST_STRING_FIELD(flag);
+		AST_STRING_FIELD(msg_id);
+	);
+	/*! Copy of the mailbox, safe from reloads */
+	struct ast_vm_user *vmu;
+	int msgnum;
+	int duration;
+	int attach_user_voicemail;
+	/*! Dialplan priority of the channel that left the message */
+	int priority;
+};
+
+static void email_task_free(struct email_task *task)
+{
+	free_user(task->vmu);
+	ast_string_field_free_memory(task);
+	ast_free(task);
+}
+
+static int email_task_exec(void *data)
+{
+	struct email_task *task = data;
+	char *cidnum = ast_strlen_zero(task->cidnum) ? NULL : ast_strdupa(task->cidnum);
+	char *cidname = ast_strlen_zero(task->cidname) ? NULL : ast_strdupa(task->cidname);
+	struct ast_channel *chan;
+
+	/* Only used for the priority header */
+	if ((chan = ast_dummy_channel_alloc())) {
+		ast_channel_priority_set(chan, task->priority);
+	}
+
+	sendmail(ast_strdupa(task->srcemail), task->vmu, task->msgnum, task->vmu->context,
+		task->vmu->mailbox, task->fromfolder, cidnum, cidname,
+		ast_strdupa(task->attach), NULL, ast_strdupa(task->format), task->duration,
+		task->attach_user_voicemail, chan, S_OR(task->category, NULL), S_OR(task->flag, NULL),
+		S_OR(task->msg_id, NULL));
+
+	ast_channel_cleanup(chan);
+	email_task_free(task);
+	return 0;
+}
+
+/*!
+ * \brief Hand an e-mail notification off to the e-mail taskprocessor
+ *
+ * Building the e-mail encodes the attachment, and possibly runs sox on it
+ * first, which can keep the channel busy for a while with large messages.
+ * The parameters are the same as for sendmail().
+ *
+ * \retval 0 if the e-mail will be sent
+ * \retval -1 if it must be sent by the caller
+ */
+static int queue_sendmail(char *srcemail, struct ast_vm_user *vmu, int msgnum, const char *fromfolder,
+	char *cidnum, char *cidname, char *attach, char *format, int duration, int attach_user_voicemail,
+	struct ast_channel *chan, const char *category, const char *flag, const char *msg_id)
+{
+	struct email_task *task;
+
+	if (!email_tps || !(task = ast_calloc(1, sizeof(*task)))) {
+		return -1;
+	}
+	if (ast_string_field_init(task, 256)
+		|| !(task->vmu = ast_calloc(1, sizeof(*task->vmu)))) {
+		ast_string_field_free_memory(task);
+		ast_free(task);
+		return -1;
+	}
+
+	*task->vmu = *vmu;
+	task->vmu->email = ast_strdup(vmu->email);
+	task->vmu->emailbody = ast_strdup(vmu->emailbody);
+	task->vmu->emailsubject = ast_strdup(vmu->emailsubject);
+	ast_set_flag(task->vmu, VM_ALLOCED);
+	AST_LIST_NEXT(task->vmu, list) = NULL;
+
+	ast_string_field_set(task, srcemail, srcemail);
+	ast_string_field_set(task, fromfolder, fromfolder);
+	ast_string_field_set(task, cidnum, cidnum);
+	ast_string_field_set(task, cidname, cidname);
+	ast_string_field_set(task, attach, attach);
+	ast_string_field_set(task, format, format);
+	ast_string_field_set(task, category, category);
+	ast_string_field_set(task, flag, flag);
+	ast_string_field_set(task, msg_id, msg_id);
+	task->msgnum = msgnum;
+	task->duration = duration;
+	task->attach_user_voicemail = attach_user_voicemail;
+	task->priority = chan ? ast_channel_priority(chan) : 0;
+
+	if (ast_taskprocessor_push(email_tps, email_task_exec, task)) {
+		email_task_free(task);
+		return -1;
+	}
+
+	return 0;
+}
+
 static int sendpage(char *srcemail, char *pager, int msgnum, char *context, char *mailbox, const char *fromfolder, char *cidnum, char *cidname, int duration, struct ast_vm_user *vmu, const char *category, const char *flag)
 {
 	char enc_cidnum[256], enc_cidname[256];
@@ -6101,6 +6275,8 @@ static int __has_voicemail(const char *context, const char *mailbox, const char
 	char fn[256];
 	int ret = 0;
 	struct alias_mailbox_mapping *mapping;
+	struct stat st;
+	time_t counted = 0;
 	char *c;
 	char *m;
 
@@ -6129,6 +6305,17 @@ static int __has_voicemail(const char *context, const char *mailbox, const char
 
 	snprintf(fn, sizeof(fn), "%s%s/%s/%s", VM_SPOOL_DIR, c, m, folder);
 
+	if (!shortcircuit) {
+		if (stat(fn, &st)) {
+			return 0;
+		}
+		if ((ret = message_count_get(fn, st.st_mtime)) >= 0) {
+			return ret;
+		}
+		ret = 0;
+		counted = time(NULL);
+	}
+
 	if (!(dir = opendir(fn)))
 		return 0;
 
@@ -6145,6 +6332,10 @@ static int __has_voicemail(const char *context, const char *mailbox, const char
 
 	closedir(dir);
 
+	if (!shortcircuit) {
+		message_count_set(fn, st.st_mtime, counted, ret);
+	}
+
 	return ret;
 }
 
@@ -8246,8 +8437,12 @@ static int notify_new_message(struct ast_channel *chan, struct ast_vm_user *vmu,
 		if (attach_user_voicemail)
 			RETRIEVE(todir, msgnum, vmu->mailbox, vmu->context);
 
-		/* XXX possible imap issue, should category be NULL XXX */
-		sendmail(myserveremail, vmu, msgnum, vmu->context, vmu->mailbox, mbox(vmu, 0), cidnum, cidname, fn, NULL, fmt, duration, attach_user_voicemail, chan, category, flag, msg_id);
+		/* The e-mail taskprocessor can't send it if the message may be gone by then */
+		if (!async_email || ast_test_flag(vmu, VM_DELETE)
+			|| queue_sendmail(myserveremail, vmu, msgnum, mbox(vmu, 0), cidnum, cidname, fn, fmt, duration, attach_user_voicemail, chan, category, flag, msg_id)) {
+			/* XXX possible imap issue, should category be NULL XXX */
+			sendmail(myserveremail, vmu, msgnum, vmu->context, vmu->mailbox, mbox(vmu, 0), cidnum, cidname, fn, NULL, fmt, duration, attach_user_voicemail, chan, category, flag, msg_id);
+		}
 
 		if (attach_user_voicemail)
 			DISPOSE(todir, msgnum);
@@ -14076,6 +14271,14 @@ static int actual_load_config(int reload, struct ast_config *cfg, struct ast_con
 		} else {
 			imap_poll_logout = 0;
 		}
+		if ((val = ast_variable_retrieve(cfg, "general", "imap_count_cache"))) {
+			if (sscanf(val, "%30d", &imap_count_cache) != 1 || imap_count_cache < 0) {
+				ast_log(AST_LOG_WARNING, "Invalid imap_count_cache value '%s', disabling\n", val);
+				imap_count_cache = 0;
+			}
+		} else {
+			imap_count_cache = 0;
+		}
 
 		/* There is some very unorthodox casting done here. This is due
 		 * to the way c-client handles the argument passed in. It expects a
@@ -14416,6 +14619,17 @@ static int actual_load_config(int reload, struct ast_config *cfg, struct ast_con
 		if ((val = ast_variable_retrieve(cfg, "general", "pollmailboxes")))
 			poll_mailboxes = ast_true(val);
 
+		async_email = 0;
+		if ((val = ast_variable_retrieve(cfg, "general", "asyncemail"))) {
+#if !(defined(ODBC_STORAGE) || defined(IMAP_STORAGE))
+			async_email = ast_true(val);
+#else
+			if (ast_true(val)) {
+				ast_log(AST_LOG_WARNING, "asyncemail is only supported with file storage\n");
+			}
+#endif
+		}
+
 		memset(fromstring, 0, sizeof(fromstring));
 		memset(pagerfromstring, 0, sizeof(pagerfromstring));
 		strcpy(charset, "ISO-8859-1");
@@ -15271,8 +15485,13 @@ static int unload_module(void)
 
 	if (poll_thread != AST_PTHREADT_NULL)
 		stop_poll_thread();
+#if !(defined(ODBC_STORAGE) || defined(IMAP_STORAGE))
+	ao2_cleanup(message_counts);
+#endif
 
 	mwi_subscription_tps = ast_taskprocessor_unreference(mwi_subscription_tps);
+	/* Sends any e-mail still queued */
+	email_tps = ast_taskprocessor_unreference(email_tps);
 	ast_unload_realtime("voicemail");
 	ast_unload_realtime("voicemail_data");
 
@@ -15352,6 +15571,18 @@ static int load_module(void)
 		return AST_MODULE_LOAD_DECLINE;
 	}
 
+#if !(defined(ODBC_STORAGE) || defined(IMAP_STORAGE))
+	message_counts = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0, MESSAGE_COUNT_BUCKETS,
+		message_count_hash_fn, NULL, message_count_cmp_fn);
+	if (!message_counts) {
+		ast_log(LOG_ERROR, "Unable to create message_counts container\n");
+		ao2_cleanup(inprocess_container);
+		ao2_cleanup(alias_mailbox_mappings);
+		ao2_cleanup(mailbox_alias_mappings);
+		return AST_MODULE_LOAD_DECLINE;
+	}
+#endif
+
 	/* compute the location of the voicemail spool directory */
 	snprintf(VM_SPOOL_DIR, sizeof(VM_SPOOL_DIR), "%s/voicemail/", ast_config_AST_SPOOL_DIR);
 
@@ -15359,6 +15590,10 @@ static int load_module(void)
 		ast_log(AST_LOG_WARNING, "failed to reference mwi subscription taskprocessor.  MWI will not work\n");
 	}
 
+	if (!(email_tps = ast_taskprocessor_get("app_voicemail_email", TPS_REF_DEFAULT))) {
+		ast_log(AST_LOG_WARNING, "failed to reference e-mail taskprocessor.  E-mail will be sent synchronously\n");
+	}
+
 	if ((res = load_config(0))) {
 		unload_module();
 		return AST_MODULE_LOAD_DECLINE;
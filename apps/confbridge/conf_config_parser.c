@@ -38,6 +38,7 @@
 #include "asterisk/bridge_features.h"
 #include "asterisk/stringfields.h"
 #include "asterisk/pbx.h"
+#include "asterisk/translate.h"
 
 
 /*** DOCUMENTATION
@@ -294,6 +295,28 @@
 						or 80.
 					</para></description>
 				</configOption>
+				<configOption name="mixing_threads" default="1">
+					<synopsis>Sets the most threads used to mix the audio of the bridge</synopsis>
+					<description><para>
+						Sets the most threads used to produce the audio sent to each
+						participant every mixing interval.  With large conferences mixing
+						on a single thread may not finish within the mixing interval.
+						Larger values spread the participants over shared helper threads
+						once the conference is big enough to benefit.  Valid values are
+						1 through 64.  Binaural bridges always mix on a single thread.
+					</para></description>
+				</configOption>
+				<configOption name="resample_quality" default="0">
+					<synopsis>Sets the quality of the resampling done for participants</synopsis>
+					<description><para>
+						Sets the quality of the resamplers converting between the
+						participants' sample rates and the internal sample rate of the
+						bridge.  Valid values are 1 (cheapest) through 10 (best).  Lower
+						values save CPU in large conferences where many participants use
+						a sample rate other than the bridge's.  The default of 0 leaves
+						the resamplers at their own default quality, which is 5.
+					</para></description>
+				</configOption>
 				<configOption name="binaural_active">
 					<synopsis>If true binaural conferencing with stereo audio is active</synopsis>
 					<description><para>
@@ -1676,6 +1699,14 @@ static char *handle_cli_confbridge_show_bridge_profile(struct ast_cli_entry *e,
 		ast_cli(a->fd,"Mixing Interval:      Default 20ms\n");
 	}
 
+	ast_cli(a->fd,"Mixing Threads:       %u\n", b_profile.mixing_threads);
+
+	if (b_profile.resample_quality) {
+		ast_cli(a->fd,"Resample Quality:     %u\n", b_profile.resample_quality);
+	} else {
+		ast_cli(a->fd,"Resample Quality:     Default\n");
+	}
+
 	ast_cli(a->fd,"Record Conference:    %s\n",
 		b_profile.flags & BRIDGE_OPT_RECORD_CONFERENCE ?
 		"yes" : "no");
@@ -2346,6 +2377,8 @@ int conf_load_config(void)
 	aco_option_register(&cfg_info, "internal_sample_rate", ACO_EXACT, bridge_types, "0", OPT_UINT_T, PARSE_DEFAULT, FLDSET(struct bridge_profile, internal_sample_rate), 0);
 	aco_option_register(&cfg_info, "binaural_active", ACO_EXACT, bridge_types, "no", OPT_BOOLFLAG_T, 1, FLDSET(struct bridge_profile, flags), BRIDGE_OPT_BINAURAL_ACTIVE);
 	aco_option_register_custom(&cfg_info, "mixing_interval", ACO_EXACT, bridge_types, "20", mix_interval_handler, 0);
+	aco_option_register(&cfg_info, "mixing_threads", ACO_EXACT, bridge_types, "1", OPT_UINT_T, PARSE_IN_RANGE, FLDSET(struct bridge_profile, mixing_threads), 1, 64);
+	aco_option_register(&cfg_info, "resample_quality", ACO_EXACT, bridge_types, "0", OPT_UINT_T, PARSE_IN_RANGE, FLDSET(struct bridge_profile, resample_quality), 0, AST_TRANSLATOR_QUALITY_MAX);
 	aco_option_register(&cfg_info, "record_conference", ACO_EXACT, bridge_types, "no", OPT_BOOLFLAG_T, 1, FLDSET(struct bridge_profile, flags), BRIDGE_OPT_RECORD_CONFERENCE);
 	aco_option_register_custom(&cfg_info, "video_mode", ACO_EXACT, bridge_types, NULL, video_mode_handler, 0);
 	aco_option_register(&cfg_info, "record_file_append", ACO_EXACT, bridge_types, "yes", OPT_BOOLFLAG_T, 1, FLDSET(struct bridge_profile, flags), BRIDGE_OPT_RECORD_FILE_APPEND);
@@ -38,11 +38,63 @@
 #include <sys/stat.h>
 
 #include "asterisk/module.h"
+#include "asterisk/alertpipe.h"
 #include "asterisk/channel.h"
 #include "asterisk/bridge.h"
 #include "asterisk/bridge_technology.h"
+#include "asterisk/config.h"
 #include "asterisk/frame.h"
+#include "asterisk/poll-compat.h"
 #include "asterisk/rtp_engine.h"
+#include "asterisk/vector.h"
+
+/*! \brief Most relay threads that may be configured */
+#define NATIVE_RTP_RELAY_THREADS_MAX 32
+
+/*! \brief A socket of a locally bridged RTP instance serviced by a relay thread */
+struct native_rtp_relay_leg {
+	/*! \brief RTP instance the socket belongs to */
+	struct ast_rtp_instance *instance;
+	/*! \brief Channel given any frames that could not be relayed */
+	struct ast_channel *chan;
+	/*! \brief The socket */
+	int fd;
+	/*! \brief Which of the channel's file descriptors was the socket, -1 if none */
+	int fdno;
+	/*! \brief Set if this is the RTCP socket */
+	unsigned int rtcp:1;
+	/*! \brief Set once reading failed, the channel is hung up */
+	unsigned int failed:1;
+};
+
+/*!
+ * \brief A thread forwarding the packets of locally bridged RTP instances
+ *
+ * The relay thread reads the sockets instead of the channel threads,
+ * so packets the RTP engine relays itself never wake the channels.
+ *
+ * \note Lock order is channel, then relay, then RTP instance.
+ */
+struct native_rtp_relay {
+	ast_mutex_t lock;
+	pthread_t thread;
+	/*! \brief Wakes the thread to see changed legs or to exit */
+	int alert_pipe[2];
+	/*! \brief Bumped each time the legs change */
+	unsigned int generation;
+	/*! \brief Set when the thread should exit */
+	unsigned int stop:1;
+	AST_VECTOR(, struct native_rtp_relay_leg *) legs;
+};
+
+/*! \brief Number of relay threads configured, 0 if relaying is disabled */
+static unsigned int relay_threads;
+
+/*! \brief The relay threads */
+static struct native_rtp_relay **relays;
+
+/*! \brief The relay thread given the next bridge */
+static unsigned int relay_next;
 
 /*! \brief Internal structure which contains bridged RTP channel hook data */
 struct native_rtp_framehook_data {
@@ -83,8 +135,360 @@ struct native_rtp_bridge_channel_data {
 	struct ast_rtp_glue *remote_cb;
 	/*! \brief Channel's cached RTP glue information */
 	struct rtp_glue_data glue;
+	/*! \brief Relay thread servicing the channel's RTP while locally bridged */
+	struct native_rtp_relay *relay;
+	/*! \brief The channel's sockets given to the relay thread */
+	struct native_rtp_relay_leg *relay_legs[2];
 };
 
+/*!
+ * \internal
+ * \brief Make copies of the frames read for a relay leg to queue later
+ *
+ * The RTP engine may reuse the frames once the instance is read again.
+ */
+static struct ast_frame *native_rtp_relay_frames_isolate(struct ast_frame *frame)
+{
+	AST_LIST_HEAD_NOLOCK(, ast_frame) frames;
+	struct ast_frame *next;
+
+	AST_LIST_HEAD_INIT_NOLOCK(&frames);
+	for (; frame; frame = next) {
+		next = AST_LIST_NEXT(frame, frame_list);
+		AST_LIST_NEXT(frame, frame_list) = NULL;
+		if (frame == &ast_null_frame || !(frame = ast_frisolate(frame))) {
+			continue;
+		}
+		AST_LIST_INSERT_TAIL(&frames, frame, frame_list);
+	}
+
+	return AST_LIST_FIRST(&frames);
+}
+
+/*! \brief Frames for a channel read by a relay thread */
+struct native_rtp_relay_delivery {
+	struct ast_channel *chan;
+	/*! \brief The frames to queue, NULL to hang up the channel */
+	struct ast_frame *frames;
+};
+
+static void *native_rtp_relay_thread(void *data)
+{
+	struct native_rtp_relay *relay = data;
+	struct pollfd *fds = NULL;
+	unsigned int fds_size = 0;
+	AST_VECTOR(, struct native_rtp_relay_delivery) deliveries;
+	struct native_rtp_relay_delivery *delivery;
+	struct native_rtp_relay_leg *leg;
+	struct ast_frame *frame;
+	unsigned int generation;
+	unsigned int count;
+	unsigned int idx;
+
+	AST_VECTOR_INIT(&deliveries, 0);
+
+	for (;;) {
+		ast_mutex_lock(&relay->lock);
+		if (relay->stop) {
+			ast_mutex_unlock(&relay->lock);
+			break;
+		}
+		count = AST_VECTOR_SIZE(&relay->legs);
+		if (count + 1 > fds_size) {
+			struct pollfd *grown = ast_realloc(fds, (count + 1) * sizeof(*fds));
+
+			if (!grown) {
+				ast_mutex_unlock(&relay->lock);
+				usleep(1000);
+				continue;
+			}
+			fds = grown;
+			fds_size = count + 1;
+		}
+		fds[0].fd = ast_alertpipe_readfd(relay->alert_pipe);
+		fds[0].events = POLLIN;
+		for (idx = 0; idx < count; ++idx) {
+			leg = AST_VECTOR_GET(&relay->legs, idx);
+			/* poll() skips negative descriptors */
+			fds[idx + 1].fd = leg->failed ? -1 : leg->fd;
+			fds[idx + 1].events = POLLIN;
+		}
+		generation = relay->generation;
+		ast_mutex_unlock(&relay->lock);
+
+		if (ast_poll(fds, count + 1, -1) < 0) {
+			if (errno != EINTR) {
+				ast_log(LOG_WARNING, "RTP relay poll failed: %s\n", strerror(errno));
+				usleep(1000);
+			}
+			continue;
+		}
+		if (fds[0].revents) {
+			ast_alertpipe_read(relay->alert_pipe);
+		}
+
+		ast_mutex_lock(&relay->lock);
+		/* If the legs changed the descriptors polled may be gone, poll again */
+		for (idx = 0; generation == relay->generation && idx < count; ++idx) {
+			struct native_rtp_relay_delivery pending;
+
+			if (!fds[idx + 1].revents) {
+				continue;
+			}
+			leg = AST_VECTOR_GET(&relay->legs, idx);
+			frame = ast_rtp_instance_read(leg->instance, leg->rtcp);
+			if (frame == &ast_null_frame) {
+				/* Relayed by the RTP engine, or nothing to do */
+				continue;
+			}
+			if (!frame) {
+				/* The channel thread would hang up on a read error */
+				leg->failed = 1;
+			}
+			pending.chan = ao2_bump(leg->chan);
+			pending.frames = frame ? native_rtp_relay_frames_isolate(frame) : NULL;
+			if ((frame && !pending.frames) || AST_VECTOR_APPEND(&deliveries, pending)) {
+				ast_frfree(pending.frames);
+				ast_channel_unref(pending.chan);
+			}
+		}
+		ast_mutex_unlock(&relay->lock);
+
+		/* Queue outside of the relay lock to keep to the lock order */
+		for (idx = 0; idx < AST_VECTOR_SIZE(&deliveries); ++idx) {
+			delivery = AST_VECTOR_GET_ADDR(&deliveries, idx);
+			if (delivery->frames) {
+				ast_queue_frame(delivery->chan, delivery->frames);
+				ast_frfree(delivery->frames);
+			} else {
+				ast_queue_hangup(delivery->chan);
+			}
+			ast_channel_unref(delivery->chan);
+		}
+		AST_VECTOR_RESET(&deliveries, AST_VECTOR_ELEM_CLEANUP_NOOP);
+	}
+
+	AST_VECTOR_FREE(&deliveries);
+	ast_free(fds);
+
+	return NULL;
+}
+
+/*!
+ * \internal
+ * \brief Give one of an RTP instance's sockets to a relay thread
+ *
+ * \pre chan is locked
+ * \pre relay is locked
+ */
+static struct native_rtp_relay_leg *native_rtp_relay_leg_add(struct native_rtp_relay *relay,
+	struct ast_channel *chan, struct ast_rtp_instance *instance, int fd, int rtcp)
+{
+	struct native_rtp_relay_leg *leg;
+	int fdno;
+
+	leg = ast_calloc(1, sizeof(*leg));
+	if (!leg) {
+		return NULL;
+	}
+	leg->instance = ao2_bump(instance);
+	leg->chan = ast_channel_ref(chan);
+	leg->fd = fd;
+	leg->fdno = -1;
+	leg->rtcp = rtcp;
+
+	if (AST_VECTOR_APPEND(&relay->legs, leg)) {
+		ao2_ref(leg->instance, -1);
+		ast_channel_unref(leg->chan);
+		ast_free(leg);
+		return NULL;
+	}
+
+	/* Stop the channel thread from waking up for the socket */
+	for (fdno = 0; fdno < ast_channel_fd_count(chan); ++fdno) {
+		if (ast_channel_fd(chan, fdno) == fd) {
+			ast_channel_set_fd(chan, fdno, -1);
+			leg->fdno = fdno;
+			break;
+		}
+	}
+
+	return leg;
+}
+
+/*!
+ * \internal
+ * \brief Take a socket back from a relay thread
+ *
+ * \pre chan is locked
+ * \pre relay is locked
+ */
+static void native_rtp_relay_leg_remove(struct native_rtp_relay *relay,
+	struct native_rtp_relay_leg *leg)
+{
+	AST_VECTOR_REMOVE_ELEM_UNORDERED(&relay->legs, leg, AST_VECTOR_ELEM_CLEANUP_NOOP);
+
+	/* Leave the descriptors alone if the channel driver has changed them since */
+	if (leg->fdno >= 0 && ast_channel_fd(leg->chan, leg->fdno) == -1) {
+		ast_channel_set_fd(leg->chan, leg->fdno, leg->fd);
+	}
+
+	ao2_ref(leg->instance, -1);
+	ast_channel_unref(leg->chan);
+	ast_free(leg);
+}
+
+/*!
+ * \internal
+ * \brief Have a relay thread service a channel's locally bridged audio
+ *
+ * \pre chan is locked
+ */
+static void native_rtp_relay_start(struct native_rtp_relay *relay,
+	struct native_rtp_bridge_channel_data *data, struct ast_channel *chan,
+	struct ast_rtp_instance *instance)
+{
+	int rtp_fd = ast_rtp_instance_fd(instance, 0);
+	int rtcp_fd = ast_rtp_instance_fd(instance, 1);
+
+	if (data->relay || rtp_fd < 0) {
+		return;
+	}
+
+	ast_mutex_lock(&relay->lock);
+	data->relay = relay;
+	data->relay_legs[0] = native_rtp_relay_leg_add(relay, chan, instance, rtp_fd, 0);
+	if (rtcp_fd >= 0 && rtcp_fd != rtp_fd) {
+		data->relay_legs[1] = native_rtp_relay_leg_add(relay, chan, instance, rtcp_fd, 1);
+	}
+	relay->generation++;
+	ast_mutex_unlock(&relay->lock);
+
+	ast_alertpipe_write(relay->alert_pipe);
+}
+
+/*!
+ * \internal
+ * \brief Give a channel's audio back to the channel thread
+ *
+ * Once this returns the relay thread no longer uses the RTP instance.
+ *
+ * \pre chan is locked
+ */
+static void native_rtp_relay_stop(struct native_rtp_bridge_channel_data *data)
+{
+	struct native_rtp_relay *relay = data->relay;
+	int idx;
+
+	if (!relay) {
+		return;
+	}
+
+	ast_mutex_lock(&relay->lock);
+	for (idx = 0; idx < ARRAY_LEN(data->relay_legs); ++idx) {
+		if (data->relay_legs[idx]) {
+			native_rtp_relay_leg_remove(relay, data->relay_legs[idx]);
+			data->relay_legs[idx] = NULL;
+		}
+	}
+	relay->generation++;
+	ast_mutex_unlock(&relay->lock);
+
+	ast_alertpipe_write(relay->alert_pipe);
+	data->relay = NULL;
+}
+
+static void native_rtp_relays_destroy(void)
+{
+	unsigned int idx;
+
+	for (idx = 0; idx < relay_threads; ++idx) {
+		struct native_rtp_relay *relay = relays[idx];
+
+		if (relay->thread != AST_PTHREADT_NULL) {
+			ast_mutex_lock(&relay->lock);
+			relay->stop = 1;
+			ast_mutex_unlock(&relay->lock);
+			ast_alertpipe_write(relay->alert_pipe);
+			pthread_join(relay->thread, NULL);
+		}
+		ast_alertpipe_close(relay->alert_pipe);
+		ast_mutex_destroy(&relay->lock);
+		AST_VECTOR_FREE(&relay->legs);
+		ast_free(relay);
+	}
+	ast_free(relays);
+	relays = NULL;
+	relay_threads = 0;
+}
+
+static int native_rtp_relays_create(unsigned int count)
+{
+	unsigned int idx;
+
+	if (!count) {
+		return 0;
+	}
+
+	relays = ast_calloc(count, sizeof(*relays));
+	if (!relays) {
+		return -1;
+	}
+
+	for (relay_threads = 0; relay_threads < count; ++relay_threads) {
+		struct native_rtp_relay *relay = ast_calloc(1, sizeof(*relay));
+
+		if (!relay) {
+			goto failure;
+		}
+		ast_mutex_init(&relay->lock);
+		relay->thread = AST_PTHREADT_NULL;
+		AST_VECTOR_INIT(&relay->legs, 0);
+		relays[relay_threads] = relay;
+		if (ast_alertpipe_init(relay->alert_pipe)) {
+			relay_threads++;
+			goto failure;
+		}
+	}
+
+	for (idx = 0; idx < relay_threads; ++idx) {
+		if (ast_pthread_create(&relays[idx]->thread, NULL, native_rtp_relay_thread, relays[idx])) {
+			relays[idx]->thread = AST_PTHREADT_NULL;
+			goto failure;
+		}
+	}
+
+	return 0;
+
+failure:
+	native_rtp_relays_destroy();
+	return -1;
+}
+
+static void native_rtp_load_config(void)
+{
+	struct ast_flags config_flags = { 0 };
+	struct ast_config *cfg;
+	const char *value;
+
+	relay_threads = 0;
+
+	cfg = ast_config_load("bridge_native_rtp.conf", config_flags);
+	if (!cfg || cfg == CONFIG_STATUS_FILEINVALID) {
+		return;
+	}
+
+	if ((value = ast_variable_retrieve(cfg, "general", "relay_threads"))) {
+		if (sscanf(value, "%30u", &relay_threads) != 1
+			|| relay_threads > NATIVE_RTP_RELAY_THREADS_MAX) {
+			ast_log(LOG_WARNING, "Invalid relay_threads '%s', RTP relaying disabled\n", value);
+			relay_threads = 0;
+		}
+	}
+
+	ast_config_destroy(cfg);
+}
+
 static void rtp_glue_data_init(struct rtp_glue_data *glue)
 {
 	glue->cb = NULL;
@@ -323,8 +727,18 @@ static void native_rtp_bridge_start(struct ast_bridge *bridge, struct ast_channe
 		}
 		ast_rtp_instance_set_bridged(glue0->audio.instance, glue1->audio.instance);
 		ast_rtp_instance_set_bridged(glue1->audio.instance, glue0->audio.instance);
-		ast_verb(4, "Locally RTP bridged '%s' and '%s' in stack\n",
-			ast_channel_name(bc0->chan), ast_channel_name(bc1->chan));
+		if (relay_threads) {
+			struct native_rtp_relay *relay = data0->relay ?: data1->relay;
+
+			if (!relay) {
+				relay = relays[ast_atomic_fetch_add(&relay_next, 1, __ATOMIC_RELAXED) % relay_threads];
+			}
+			native_rtp_relay_start(relay, data0, bc0->chan, glue0->audio.instance);
+			native_rtp_relay_start(relay, data1, bc1->chan, glue1->audio.instance);
+		}
+		ast_verb(4, "Locally RTP bridged '%s' and '%s' in stack%s\n",
+			ast_channel_name(bc0->chan), ast_channel_name(bc1->chan),
+			data0->relay ? " using a relay thread" : "");
 		break;
 	case AST_RTP_GLUE_RESULT_REMOTE:
 		cap0 = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
@@ -468,6 +882,9 @@ static void native_rtp_bridge_stop(struct ast_bridge *bridge, struct ast_channel
 
 	switch (glue0->result) {
 	case AST_RTP_GLUE_RESULT_LOCAL:
+		/* The relay must be done with the instances before they are unbridged */
+		native_rtp_relay_stop(data0);
+		native_rtp_relay_stop(data1);
 		if (ast_rtp_instance_get_engine(glue0->audio.instance)->local_bridge) {
 			ast_rtp_instance_get_engine(glue0->audio.instance)->local_bridge(glue0->audio.instance, NULL);
 		}
@@ -771,6 +1188,7 @@ static int native_rtp_bridge_framehook_attach(struct ast_bridge_channel *bridge_
 		.destroy_cb = __ao2_cleanup,
 		.consume_cb = native_rtp_framehook_consume,
 		.disable_inheritance = 1,
+		.frame_types = AST_FRAMEHOOK_FRAME_TYPE(AST_FRAME_CONTROL),
 	};
 
 	ast_assert(data->hook_data == NULL);
@@ -949,11 +1367,17 @@ static struct ast_bridge_technology native_rtp_bridge = {
 static int unload_module(void)
 {
 	ast_bridge_technology_unregister(&native_rtp_bridge);
+	native_rtp_relays_destroy();
 	return 0;
 }
 
 static int load_module(void)
 {
+	native_rtp_load_config();
+	if (native_rtp_relays_create(relay_threads)) {
+		ast_log(LOG_WARNING, "Unable to start the RTP relay threads, RTP relaying disabled\n");
+	}
+
 	if (ast_bridge_technology_register(&native_rtp_bridge)) {
 		unload_module();
 		return AST_MODULE_LOAD_DECLINE;
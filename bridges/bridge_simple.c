@@ -41,6 +41,7 @@
 #include "asterisk/channel.h"
 #include "asterisk/bridge.h"
 #include "asterisk/bridge_technology.h"
+#include "asterisk/format.h"
 #include "asterisk/frame.h"
 #include "asterisk/stream.h"
 
@@ -69,11 +70,96 @@ static int simple_bridge_join(struct ast_bridge *bridge, struct ast_bridge_chann
 	return 0;
 }
 
+/*!
+ * \internal
+ * \brief Write a voice frame straight to the other channel in the bridge
+ *
+ * Queuing a frame for the other channel's bridge thread costs a copy, an
+ * alert and a thread wakeup. When nothing on the other channel needs to
+ * see or translate the frame, and nothing is already queued ahead of it,
+ * the frame is written from this thread instead. As soon as a hook is
+ * attached, the formats differ or the other channel is busy, frames go
+ * back to being queued.
+ *
+ * \note The bridge is locked on entry and exit, but it is unlocked while
+ * the frame is written so a slow channel driver cannot stall everything
+ * else waiting on the bridge.
+ *
+ * \retval 0 The frame was written, or dropped because the channel left
+ * the bridge while it was unlocked.
+ * \retval -1 The frame needs to be queued.
+ */
+static int simple_bridge_write_direct(struct ast_bridge *bridge,
+	struct ast_bridge_channel *bridge_channel, struct ast_frame *frame)
+{
+	struct ast_bridge_channel *other;
+	struct ast_channel *chan;
+	int num = -1;
+	int direct;
+	int moved;
+	int res;
+
+	if (frame->frametype != AST_FRAME_VOICE || bridge->num_channels != 2 || !bridge_channel) {
+		return -1;
+	}
+
+	other = AST_LIST_FIRST(&bridge->channels);
+	if (other == bridge_channel) {
+		other = AST_LIST_LAST(&bridge->channels);
+	}
+
+	ast_bridge_channel_lock(other);
+	direct = other->state == BRIDGE_CHANNEL_STATE_WAIT
+		&& !other->suspended
+		&& AST_LIST_EMPTY(&other->wr_queue);
+	if (direct && frame->stream_num > -1) {
+		if (frame->stream_num < (int)AST_VECTOR_SIZE(&other->stream_map.to_channel)) {
+			num = AST_VECTOR_GET(&other->stream_map.to_channel, frame->stream_num);
+		}
+		direct = num != -1;
+	}
+	ast_bridge_channel_unlock(other);
+
+	if (!direct) {
+		return -1;
+	}
+
+	chan = other->chan;
+	ast_channel_lock(chan);
+	direct = !ast_channel_has_hook_requiring_audio(chan)
+		&& ast_format_cmp(frame->subclass.format, ast_channel_writeformat(chan)) == AST_FORMAT_CMP_EQUAL
+		&& ast_format_cmp(frame->subclass.format, ast_channel_rawwriteformat(chan)) == AST_FORMAT_CMP_EQUAL;
+	ast_channel_unlock(chan);
+
+	if (!direct) {
+		return -1;
+	}
+
+	ast_channel_ref(chan);
+	ao2_ref(bridge, +1);
+	ast_bridge_unlock(bridge);
+	res = ast_write_stream(chan, num, frame);
+	ast_channel_unref(chan);
+	ast_bridge_channel_lock_bridge(bridge_channel);
+	moved = bridge_channel->bridge != bridge;
+	ao2_ref(bridge, -1);
+
+	if (res && !moved) {
+		/* Let the other channel's bridge thread have a go at it */
+		return -1;
+	}
+	return 0;
+}
+
 static int simple_bridge_write(struct ast_bridge *bridge, struct ast_bridge_channel *bridge_channel, struct ast_frame *frame)
 {
 	const struct ast_control_t38_parameters *t38_parameters;
 	int defer = 0;
 
+	if (!simple_bridge_write_direct(bridge, bridge_channel, frame)) {
+		return 0;
+	}
+
 	if (!ast_bridge_queue_everyone_else(bridge, bridge_channel, frame)) {
 		/* This frame was successfully queued so no need to defer */
 		return 0;
@@ -39,6 +39,9 @@
 #include "asterisk/test.h"
 #include "asterisk/vector.h"
 #include "asterisk/message.h"
+#include "asterisk/threadpool.h"
+#include "asterisk/format_cache.h"
+#include "asterisk/opus.h"
 #include "bridge_softmix/include/bridge_softmix_internal.h"
 
 /*! The minimum sample rate of the bridge. */
@@ -101,12 +104,17 @@ struct softmix_translate_helper_entry {
 								  and re-init if it was usable. */
 	struct ast_format *dst_format; /*!< The destination format for this helper */
 	struct ast_trans_pvt *trans_pvt; /*!< the translator for this slot. */
-	struct ast_frame *out_frame; /*!< The output frame from the last translation */
+	struct ast_frame *out_frame; /*!< The output frame from the last translation, shared by every
+								  listener hearing the whole mix in this format */
 	AST_LIST_ENTRY(softmix_translate_helper_entry) entry;
 };
 
 struct softmix_translate_helper {
 	struct ast_format *slin_src; /*!< the source format expected for all the translators */
+	/*! Quality of the translators built, 0 for their default */
+	unsigned int quality;
+	/*! Protects the entries while participants are processed by several threads */
+	ast_mutex_t lock;
 	AST_LIST_HEAD_NOLOCK(, softmix_translate_helper_entry) entries;
 };
 
@@ -137,10 +145,28 @@ static void *softmix_translate_helper_free_entry(struct softmix_translate_helper
 	return NULL;
 }
 
+/*!
+ * \internal
+ * \brief Build the shared translation path of an entry.
+ */
+static struct ast_trans_pvt *softmix_translate_helper_build_path(struct softmix_translate_helper *trans_helper,
+	struct softmix_translate_helper_entry *entry)
+{
+	struct ast_trans_pvt *trans_pvt;
+
+	trans_pvt = ast_translator_build_path(entry->dst_format, trans_helper->slin_src);
+	if (trans_pvt && trans_helper->quality) {
+		ast_translator_set_quality(trans_pvt, trans_helper->quality);
+	}
+
+	return trans_pvt;
+}
+
 static void softmix_translate_helper_init(struct softmix_translate_helper *trans_helper, unsigned int sample_rate)
 {
 	memset(trans_helper, 0, sizeof(*trans_helper));
 	trans_helper->slin_src = ast_format_cache_get_slin_by_rate(sample_rate);
+	ast_mutex_init(&trans_helper->lock);
 }
 
 static void softmix_translate_helper_destroy(struct softmix_translate_helper *trans_helper)
@@ -150,6 +176,7 @@ static void softmix_translate_helper_destroy(struct softmix_translate_helper *tr
 	while ((entry = AST_LIST_REMOVE_HEAD(&trans_helper->entries, entry))) {
 		softmix_translate_helper_free_entry(entry);
 	}
+	ast_mutex_destroy(&trans_helper->lock);
 }
 
 static void softmix_translate_helper_change_rate(struct softmix_translate_helper *trans_helper, unsigned int sample_rate)
@@ -160,7 +187,7 @@ static void softmix_translate_helper_change_rate(struct softmix_translate_helper
 	AST_LIST_TRAVERSE_SAFE_BEGIN(&trans_helper->entries, entry, entry) {
 		if (entry->trans_pvt) {
 			ast_translator_free_path(entry->trans_pvt);
-			if (!(entry->trans_pvt = ast_translator_build_path(entry->dst_format, trans_helper->slin_src))) {
+			if (!(entry->trans_pvt = softmix_translate_helper_build_path(trans_helper, entry))) {
 				AST_LIST_REMOVE_CURRENT(entry);
 				entry = softmix_translate_helper_free_entry(entry);
 			}
@@ -196,37 +223,48 @@ static int16_t *softmix_process_read_audio(struct softmix_channel *sc, unsigned
  * possibly even do the channel's write translation for it depending on how many other
  * channels use the same write format.
  */
-static void softmix_process_write_audio(struct softmix_translate_helper *trans_helper,
+/*!
+ * \internal
+ * \brief Produce the audio to write to a softmix channel
+ *
+ * \param mix The whole mix of the interval when the channel hears all of it,
+ * otherwise NULL and the channel's write frame holds the audio to process.
+ *
+ * \return The frame to queue to the channel.  A frame other than the
+ * channel's write frame is shared with other listeners and stays valid
+ * until the translate helper is cleaned up.
+ */
+static struct ast_frame *softmix_process_write_audio(struct softmix_translate_helper *trans_helper,
 	struct ast_format *raw_write_fmt,
-	struct softmix_channel *sc, unsigned int default_sample_size)
+	struct softmix_channel *sc, unsigned int default_sample_size, struct ast_frame *mix)
 {
 	struct softmix_translate_helper_entry *entry = NULL;
-	int i;
+	struct ast_frame *out = mix ?: &sc->write_frame;
 
 	/* If we provided audio that was not determined to be silence,
 	 * then take it out while in slinear format. */
 	if (sc->have_audio && sc->talking && !sc->binaural) {
-		for (i = 0; i < sc->write_frame.samples; i++) {
-			ast_slinear_saturated_subtract(&sc->final_buf[i], &sc->our_buf[i]);
-		}
+		ast_slinear_saturated_subtract_array(sc->final_buf, sc->our_buf, sc->write_frame.samples);
 		/* check to see if any entries exist for the format. if not we'll want
 		   to remove it during cleanup */
+		ast_mutex_lock(&trans_helper->lock);
 		AST_LIST_TRAVERSE(&trans_helper->entries, entry, entry) {
 			if (ast_format_cmp(entry->dst_format, raw_write_fmt) == AST_FORMAT_CMP_EQUAL) {
 				++entry->num_times_requested;
 				break;
 			}
 		}
+		ast_mutex_unlock(&trans_helper->lock);
 		/* do not do any special write translate optimization if we had to make
 		 * a special mix for them to remove their own audio. */
-		return;
+		return out;
 	} else if (sc->have_audio && sc->talking && sc->binaural > 0) {
 		/*
 		 * Binaural audio requires special saturated substract since we have two
 		 * audio signals per channel now.
 		 */
 		softmix_process_write_binaural_audio(sc, default_sample_size);
-		return;
+		return out;
 	}
 
 	/* Attempt to optimize channels using the same translation path/codec. Build a list of entries
@@ -234,6 +272,7 @@ static void softmix_process_write_audio(struct softmix_translate_helper *trans_h
 	   type should be able to use the same out_frame. Since the optimization is only necessary for
 	   multiple channels (>=2) using the same codec make sure resources are allocated only when
 	   needed and released when not (see also softmix_translate_helper_cleanup */
+	ast_mutex_lock(&trans_helper->lock);
 	AST_LIST_TRAVERSE(&trans_helper->entries, entry, entry) {
 		if (sc->binaural != 0) {
 			continue;
@@ -244,17 +283,14 @@ static void softmix_process_write_audio(struct softmix_translate_helper *trans_h
 			continue;
 		}
 		if (!entry->trans_pvt && (entry->num_times_requested > 1)) {
-			entry->trans_pvt = ast_translator_build_path(entry->dst_format, trans_helper->slin_src);
+			entry->trans_pvt = softmix_translate_helper_build_path(trans_helper, entry);
 		}
 		if (entry->trans_pvt && !entry->out_frame) {
-			entry->out_frame = ast_translate(entry->trans_pvt, &sc->write_frame, 0);
+			entry->out_frame = ast_translate(entry->trans_pvt, out, 0);
 		}
-		if (entry->out_frame && entry->out_frame->frametype == AST_FRAME_VOICE
-				&& entry->out_frame->datalen < MAX_DATALEN) {
-			ao2_replace(sc->write_frame.subclass.format, entry->out_frame->subclass.format);
-			memcpy(sc->final_buf, entry->out_frame->data.ptr, entry->out_frame->datalen);
-			sc->write_frame.datalen = entry->out_frame->datalen;
-			sc->write_frame.samples = entry->out_frame->samples;
+		if (entry->out_frame && entry->out_frame->frametype == AST_FRAME_VOICE) {
+			/* Hand out the one encoding instead of copying it to every listener. */
+			out = entry->out_frame;
 		}
 		break;
 	}
@@ -263,6 +299,9 @@ static void softmix_process_write_audio(struct softmix_translate_helper *trans_h
 	if (!entry && (entry = softmix_translate_helper_entry_alloc(raw_write_fmt))) {
 		AST_LIST_INSERT_HEAD(&trans_helper->entries, entry, entry);
 	}
+	ast_mutex_unlock(&trans_helper->lock);
+
+	return out;
 }
 
 static void softmix_translate_helper_cleanup(struct softmix_translate_helper *trans_helper)
@@ -317,7 +356,6 @@ static void set_softmix_bridge_data(int rate, int interval, struct ast_bridge_ch
 	ast_mutex_lock(&sc->lock);
 	if (reset) {
 		ast_slinfactory_destroy(&sc->factory);
-		ast_dsp_free(sc->dsp);
 	}
 
 	/* Setup write frame parameters */
@@ -375,20 +413,32 @@ static void set_softmix_bridge_data(int rate, int interval, struct ast_bridge_ch
 		setup_fail |= ast_set_write_format(bridge_channel->chan, slin_format);
 	}
 
-	/* set up new DSP.  This is on the read side only right before the read frame enters the smoother.  */
-	sc->dsp = ast_dsp_new_with_rate(rate);
-	if (setup_fail || !sc->dsp) {
+	if (bridge_channel->bridge->softmix.resample_quality) {
+		ast_channel_lock(bridge_channel->chan);
+		ast_translator_set_quality(ast_channel_readtrans(bridge_channel->chan),
+			bridge_channel->bridge->softmix.resample_quality);
+		ast_translator_set_quality(ast_channel_writetrans(bridge_channel->chan),
+			bridge_channel->bridge->softmix.resample_quality);
+		ast_channel_unlock(bridge_channel->chan);
+	}
+
+	if (setup_fail) {
 		/* Bad news.  Could not setup the channel for softmix. */
 		ast_mutex_unlock(&sc->lock);
 		ast_bridge_channel_leave_bridge(bridge_channel, BRIDGE_CHANNEL_STATE_END, 0);
 		return;
 	}
 
-	/* we want to aggressively detect silence to avoid feedback */
+	/*
+	 * Talk detection is done on the read side right before the read frame
+	 * enters the smoother.  We want to aggressively detect silence to avoid
+	 * feedback.
+	 */
+	sc->totalsilence = 0;
 	if (bridge_channel->tech_args.talking_threshold) {
-		ast_dsp_set_threshold(sc->dsp, bridge_channel->tech_args.talking_threshold);
+		sc->talking_threshold = bridge_channel->tech_args.talking_threshold;
 	} else {
-		ast_dsp_set_threshold(sc->dsp, DEFAULT_SOFTMIX_TALKING_THRESHOLD);
+		sc->talking_threshold = DEFAULT_SOFTMIX_TALKING_THRESHOLD;
 	}
 
 	ast_mutex_unlock(&sc->lock);
@@ -586,6 +636,25 @@ static int append_all_streams(struct ast_stream_topology *dest,
 	return 0;
 }
 
+/*!
+ * \brief Request a participant's ideal stream topology be negotiated.
+ *
+ * \note While the bridge is batching joins and leaves the request is
+ * deferred to softmix_bridge_batch_end() so each participant renegotiates
+ * once per batch instead of once per channel.
+ */
+static void sfu_request_topology_change(struct ast_bridge *bridge,
+	struct ast_bridge_channel *participant)
+{
+	struct softmix_channel *sc = participant->tech_pvt;
+
+	if (bridge->batching) {
+		sc->topology_change_pending = 1;
+		return;
+	}
+	ast_channel_request_stream_topology_change(participant->chan, sc->topology, NULL);
+}
+
 /*!
  * \brief Issue channel stream topology change requests.
  *
@@ -627,7 +696,8 @@ static void sfu_topologies_on_join(struct ast_bridge *bridge,
 	}
 
 	AST_LIST_TRAVERSE(participants, participant, entry) {
-		if (participant == joiner) {
+		if (participant == joiner || !participant->tech_pvt) {
+			/* Participants yet to join add their own sources when they do */
 			continue;
 		}
 		ast_channel_lock(participant->chan);
@@ -640,10 +710,10 @@ static void sfu_topologies_on_join(struct ast_bridge *bridge,
 		}
 	}
 
-	ast_channel_request_stream_topology_change(joiner->chan, sc->topology, NULL);
+	sfu_request_topology_change(bridge, joiner);
 
 	AST_LIST_TRAVERSE(participants, participant, entry) {
-		if (participant == joiner) {
+		if (participant == joiner || !participant->tech_pvt) {
 			continue;
 		}
 
@@ -651,7 +721,7 @@ static void sfu_topologies_on_join(struct ast_bridge *bridge,
 		if (append_all_streams(sc->topology, joiner_video)) {
 			goto cleanup;
 		}
-		ast_channel_request_stream_topology_change(participant->chan, sc->topology, NULL);
+		sfu_request_topology_change(bridge, participant);
 	}
 
 cleanup:
@@ -749,17 +819,17 @@ static int remove_destination_streams(struct ast_stream_topology *topology,
 	return stream_removed;
 }
 
-static int sfu_topologies_on_leave(struct ast_bridge_channel *leaver, struct ast_bridge_channels_list *participants)
+static int sfu_topologies_on_leave(struct ast_bridge *bridge, struct ast_bridge_channel *leaver)
 {
 	struct ast_bridge_channel *participant;
 	struct softmix_channel *sc;
 
-	AST_LIST_TRAVERSE(participants, participant, entry) {
+	AST_LIST_TRAVERSE(&bridge->channels, participant, entry) {
 		sc = participant->tech_pvt;
-		if (!remove_destination_streams(sc->topology, ast_channel_name(leaver->chan))) {
+		if (!sc || !remove_destination_streams(sc->topology, ast_channel_name(leaver->chan))) {
 			continue;
 		}
-		ast_channel_request_stream_topology_change(participant->chan, sc->topology, NULL);
+		sfu_request_topology_change(bridge, participant);
 	}
 
 	sc = leaver->tech_pvt;
@@ -783,7 +853,7 @@ static void softmix_bridge_leave(struct ast_bridge *bridge, struct ast_bridge_ch
 	}
 
 	if (bridge->softmix.video_mode.mode == AST_BRIDGE_VIDEO_MODE_SFU) {
-		sfu_topologies_on_leave(bridge_channel, &bridge->channels);
+		sfu_topologies_on_leave(bridge, bridge_channel);
 	}
 
 	if (bridge->softmix.binaural_active) {
@@ -811,7 +881,6 @@ static void softmix_bridge_leave(struct ast_bridge *bridge, struct ast_bridge_ch
 	ao2_cleanup(sc->write_frame.subclass.format);
 
 	/* Drop the DSP */
-	ast_dsp_free(sc->dsp);
 
 	/* Eep! drop ourselves */
 	ast_free(sc);
@@ -846,6 +915,7 @@ static void softmix_pass_video_top_priority(struct ast_bridge *bridge, struct as
 static void softmix_bridge_write_video(struct ast_bridge *bridge, struct ast_bridge_channel *bridge_channel, struct ast_frame *frame)
 {
 	struct softmix_channel *sc;
+	struct ast_frame *shared;
 	int video_src_priority;
 
 	/* Determine if the video frame should be distributed or not */
@@ -878,9 +948,12 @@ static void softmix_bridge_write_video(struct ast_bridge *bridge, struct ast_bri
 		break;
 	case AST_BRIDGE_VIDEO_MODE_SFU:
 		/* Nothing special to do here, the bridge channel stream map will ensure the
-		 * video goes everywhere it needs to
+		 * video goes everywhere it needs to.  The payload is copied once and shared
+		 * by the frames queued to each participant.
 		 */
-		ast_bridge_queue_everyone_else(bridge, bridge_channel, frame);
+		shared = ast_frdup_shared(frame);
+		ast_bridge_queue_everyone_else(bridge, bridge_channel, shared ?: frame);
+		ast_frfree(shared);
 		break;
 	}
 }
@@ -936,10 +1009,27 @@ static void softmix_bridge_write_voice(struct ast_bridge *bridge, struct ast_bri
 		ast_channel_unlock(bridge_channel->chan);
 	}
 
-	/* The channel will be leaving soon if there is no dsp. */
-	if (sc->dsp) {
-		silent = ast_dsp_silence_with_energy(sc->dsp, frame, &totalsilence, &cur_energy);
+	if (bridge_channel->features->mute) {
+		/*
+		 * Audio read before the channel was muted.  Muted audio is not
+		 * mixed so there is no need to detect talking in it.
+		 */
+		ast_mutex_unlock(&sc->lock);
+		return;
+	}
+
+	if (ast_format_cache_is_slinear(frame->subclass.format)) {
+		int samples = frame->datalen / 2;
+
+		cur_energy = ast_slinear_average_magnitude(frame->data.ptr, samples);
+		if (cur_energy < sc->talking_threshold) {
+			silent = 1;
+			sc->totalsilence += samples / (ast_format_get_sample_rate(frame->subclass.format) / 1000);
+		} else {
+			sc->totalsilence = 0;
+		}
 	}
+	totalsilence = sc->totalsilence;
 
 	if (bridge->softmix.video_mode.mode == AST_BRIDGE_VIDEO_MODE_TALKER_SRC) {
 		int cur_slot = sc->video_talker.energy_history_cur_slot;
@@ -1304,6 +1394,14 @@ static int softmix_bridge_write(struct ast_bridge *bridge, struct ast_bridge_cha
 	case AST_FRAME_VOICE:
 		softmix_bridge_write_voice(bridge, bridge_channel, frame);
 		break;
+	case AST_FRAME_CNG:
+		/*
+		 * The channel stopped sending audio until it has something to
+		 * say, so it is not going to send the silence that would tell
+		 * us it stopped talking.
+		 */
+		clear_talking(bridge_channel);
+		break;
 	case AST_FRAME_VIDEO:
 		softmix_bridge_write_video(bridge, bridge_channel, frame);
 		break;
@@ -1645,6 +1743,230 @@ static int softmix_mixing_array_grow(struct softmix_mixing_array *mixing_array,
 	return 0;
 }
 
+/*! \brief What every participant's write audio is made from in a mixing interval */
+struct softmix_mixing_interval {
+	struct ast_bridge *bridge;
+	struct softmix_bridge_data *softmix_data;
+	struct softmix_translate_helper *trans_helper;
+	struct ast_format *cur_slin;
+	/*! The mix of every participant's audio */
+	int16_t *buf;
+	/*! The mix as a frame for the listeners not talking, who all hear it whole */
+	struct ast_frame mix_frame;
+#ifdef BINAURAL_RENDERING
+	int16_t *bin_buf;
+	int16_t *ann_buf;
+#endif
+	unsigned int softmix_samples;
+	unsigned int softmix_datalen;
+	/*! Number of talking participants whose audio is in the mix */
+	unsigned int num_talking;
+};
+
+/*!
+ * \internal
+ * \brief Determine if a channel writing a format may be sent nothing during silence
+ *
+ * An Opus receiver that asked for discontinuous transmission conceals the
+ * gaps itself, so a silent mix does not need to be encoded and sent to it.
+ */
+static int softmix_format_allows_dtx(struct ast_format *format)
+{
+	const int *dtx;
+
+	if (ast_format_cmp(format, ast_format_opus) != AST_FORMAT_CMP_EQUAL) {
+		return 0;
+	}
+	dtx = ast_format_attribute_get(format, CODEC_OPUS_ATTR_DTX);
+	return dtx && *dtx;
+}
+
+/*!
+ * \internal
+ * \brief Remove a participant's own audio from the mix and queue it to them
+ *
+ * Participants whose audio is not in the mix are given the shared mix
+ * frame, or its shared translation, without copying it.
+ *
+ * \note The bridge is locked by the mixing thread, which may be waiting
+ * for a helper thread calling this.
+ */
+static void softmix_process_participant(struct softmix_mixing_interval *interval,
+	struct ast_bridge_channel *bridge_channel)
+{
+	struct softmix_channel *sc = bridge_channel->tech_pvt;
+	struct ast_format *raw_write_fmt = ast_channel_rawwriteformat(bridge_channel->chan);
+	struct ast_frame *mix = NULL;
+	struct ast_frame *out;
+
+	ast_mutex_lock(&sc->lock);
+
+	/* Nobody else is talking so let the receiver fill in the silence. */
+	if (!sc->binaural
+		&& interval->num_talking == (sc->have_audio && sc->talking)
+		&& softmix_format_allows_dtx(raw_write_fmt)) {
+		ast_mutex_unlock(&sc->lock);
+		return;
+	}
+
+	/* Make SLINEAR write frame from local buffer */
+	ao2_t_replace(sc->write_frame.subclass.format, interval->cur_slin,
+		"Replace softmix channel slin format");
+#ifdef BINAURAL_RENDERING
+	if (interval->bridge->softmix.binaural_active
+			&& interval->softmix_data->convolve.binaural_active
+			&& sc->binaural) {
+		create_binaural_frame(bridge_channel, sc, interval->bin_buf, interval->ann_buf,
+				interval->softmix_datalen, interval->softmix_samples, interval->buf);
+	} else
+#endif
+	if (!sc->binaural && !(sc->have_audio && sc->talking)) {
+		mix = &interval->mix_frame;
+	} else {
+		sc->write_frame.datalen = interval->softmix_datalen;
+		sc->write_frame.samples = interval->softmix_samples;
+		memcpy(sc->final_buf, interval->buf, interval->softmix_datalen);
+	}
+	/* process the softmix channel's new write audio */
+	out = softmix_process_write_audio(interval->trans_helper,
+			raw_write_fmt, sc,
+			interval->softmix_data->default_sample_size, mix);
+
+	ast_mutex_unlock(&sc->lock);
+
+	/* A frame is now ready for the channel. */
+	ast_bridge_channel_queue_frame(bridge_channel, out);
+}
+
+/*!
+ * \brief Number of participants handed to a thread at a time
+ *
+ * Partitions are claimed in order by the mixing thread and the helper
+ * threads alike, so a helper thread that starts late does not hold up
+ * the interval.
+ */
+#define SOFTMIX_PARTITION_SIZE 16
+
+/*! \brief Helper threads shared by all softmix bridges */
+static struct ast_threadpool *softmix_pool;
+
+/*!
+ * \brief Participants of one mixing interval split between threads
+ *
+ * Each helper thread task holds a reference.  A task that runs after
+ * every partition was claimed only looks at next_partition, so the
+ * interval and participants may be gone by then.
+ */
+struct softmix_mixing_job {
+	struct softmix_mixing_interval *interval;
+	struct ast_bridge_channel **participants;
+	unsigned int num_participants;
+	unsigned int num_partitions;
+	/*! The next partition to claim */
+	unsigned int next_partition;
+	/*! Number of partitions completed, protected by the job lock */
+	unsigned int completed;
+	/*! Signaled when the last partition completes */
+	ast_cond_t cond;
+};
+
+static void softmix_mixing_job_destructor(void *obj)
+{
+	struct softmix_mixing_job *job = obj;
+
+	ast_cond_destroy(&job->cond);
+}
+
+/*! \brief Process partitions of the job until none are left to claim */
+static void softmix_mixing_job_run(struct softmix_mixing_job *job)
+{
+	unsigned int partition;
+	unsigned int completed = 0;
+	unsigned int idx;
+	unsigned int end;
+
+	while ((partition = ast_atomic_fetch_add(&job->next_partition, 1, __ATOMIC_RELAXED))
+		< job->num_partitions) {
+		end = MIN((partition + 1) * SOFTMIX_PARTITION_SIZE, job->num_participants);
+		for (idx = partition * SOFTMIX_PARTITION_SIZE; idx < end; ++idx) {
+			softmix_process_participant(job->interval, job->participants[idx]);
+		}
+		++completed;
+	}
+
+	if (completed) {
+		ao2_lock(job);
+		job->completed += completed;
+		if (job->completed == job->num_partitions) {
+			ast_cond_signal(&job->cond);
+		}
+		ao2_unlock(job);
+	}
+}
+
+static int softmix_mixing_job_task(void *data)
+{
+	struct softmix_mixing_job *job = data;
+
+	softmix_mixing_job_run(job);
+	ao2_ref(job, -1);
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Process the write audio of every participant for an interval
+ *
+ * When the bridge may use several mixing threads and has enough
+ * participants, helper threads from the pool share the work with the
+ * mixing thread, which returns once every participant is done.
+ */
+static void softmix_process_participants(struct softmix_mixing_interval *interval,
+	struct ast_bridge_channel **participants, unsigned int num_participants)
+{
+	struct ast_bridge *bridge = interval->bridge;
+	struct softmix_mixing_job *job = NULL;
+	unsigned int num_partitions = (num_participants + SOFTMIX_PARTITION_SIZE - 1) / SOFTMIX_PARTITION_SIZE;
+	unsigned int helpers;
+	unsigned int idx;
+
+	if (softmix_pool && bridge->softmix.mixing_threads > 1 && num_partitions > 1
+		&& !bridge->softmix.binaural_active) {
+		job = ao2_alloc(sizeof(*job), softmix_mixing_job_destructor);
+	}
+
+	if (!job) {
+		for (idx = 0; idx < num_participants; ++idx) {
+			softmix_process_participant(interval, participants[idx]);
+		}
+		return;
+	}
+
+	ast_cond_init(&job->cond, NULL);
+	job->interval = interval;
+	job->participants = participants;
+	job->num_participants = num_participants;
+	job->num_partitions = num_partitions;
+
+	helpers = MIN(bridge->softmix.mixing_threads, num_partitions) - 1;
+	for (idx = 0; idx < helpers; ++idx) {
+		if (ast_threadpool_push(softmix_pool, softmix_mixing_job_task, ao2_bump(job))) {
+			ao2_ref(job, -1);
+			break;
+		}
+	}
+
+	softmix_mixing_job_run(job);
+
+	ao2_lock(job);
+	while (job->completed < job->num_partitions) {
+		ast_cond_wait(&job->cond, ao2_object_get_lockaddr(job));
+	}
+	ao2_unlock(job);
+
+	ao2_ref(job, -1);
+}
+
 /*!
  * \brief Mixing loop.
  *
@@ -1663,11 +1985,25 @@ static int softmix_mixing_loop(struct ast_bridge *bridge)
 	int16_t bin_buf[MAX_DATALEN];
 	int16_t ann_buf[MAX_DATALEN];
 #endif
+	struct softmix_mixing_interval interval = {
+		.bridge = bridge,
+		.softmix_data = softmix_data,
+		.trans_helper = &trans_helper,
+		.buf = buf,
+		.mix_frame = {
+			.frametype = AST_FRAME_VOICE,
+			.data.ptr = buf,
+		},
+#ifdef BINAURAL_RENDERING
+		.bin_buf = bin_buf,
+		.ann_buf = ann_buf,
+#endif
+	};
+	AST_VECTOR(, struct ast_bridge_channel *) participants;
 	unsigned int stat_iteration_counter = 0; /* counts down, gather stats at zero and reset. */
 	int timingfd;
 	int update_all_rates = 0; /* set this when the internal sample rate has changed */
 	unsigned int idx;
-	unsigned int x;
 	int res = -1;
 
 	timer = softmix_data->timer;
@@ -1678,6 +2014,10 @@ static int softmix_mixing_loop(struct ast_bridge *bridge)
 	/* Give the mixing array room to grow, memory is cheap but allocations are expensive. */
 	if (softmix_mixing_array_init(&mixing_array, bridge->num_channels + 10,
 			bridge->softmix.binaural_active)) {
+		AST_VECTOR_INIT(&participants, 0);
+		goto softmix_cleanup;
+	}
+	if (AST_VECTOR_INIT(&participants, bridge->num_channels + 10)) {
 		goto softmix_cleanup;
 	}
 
@@ -1714,6 +2054,7 @@ static int softmix_mixing_loop(struct ast_bridge *bridge)
 		/* init the number of buffers stored in the mixing array to 0.
 		 * As buffers are added for mixing, this number is incremented. */
 		mixing_array.used_entries = 0;
+		interval.num_talking = 0;
 
 		/* These variables help determine if a rate change is required */
 		if (!stat_iteration_counter) {
@@ -1721,6 +2062,9 @@ static int softmix_mixing_loop(struct ast_bridge *bridge)
 			stats.locked_rate = bridge->softmix.internal_sample_rate;
 		}
 
+		/* Paths built from now on pick up quality changes. */
+		trans_helper.quality = bridge->softmix.resample_quality;
+
 		/* If the sample rate has changed, update the translator helper */
 		if (update_all_rates) {
 			softmix_translate_helper_change_rate(&trans_helper, softmix_data->internal_rate);
@@ -1771,6 +2115,7 @@ static int softmix_mixing_loop(struct ast_bridge *bridge)
 						ast_channel_name(bridge_channel->chan));
 #endif
 				mixing_array.used_entries++;
+				interval.num_talking += sc->talking;
 			}
 			if (remb_update) {
 				remb_collect_report(bridge, bridge_channel, softmix_data, sc);
@@ -1781,9 +2126,7 @@ static int softmix_mixing_loop(struct ast_bridge *bridge)
 		/* mix it like crazy (non binaural channels)*/
 		memset(buf, 0, softmix_datalen);
 		for (idx = 0; idx < mixing_array.used_entries; ++idx) {
-			for (x = 0; x < softmix_samples; ++x) {
-				ast_slinear_saturated_add(buf + x, mixing_array.buffers[idx] + x);
-			}
+			ast_slinear_saturated_add_array(buf, mixing_array.buffers[idx], softmix_samples);
 		}
 
 #ifdef BINAURAL_RENDERING
@@ -1791,43 +2134,32 @@ static int softmix_mixing_loop(struct ast_bridge *bridge)
 #endif
 
 		/* Next step go through removing the channel's own audio and creating a good frame... */
+		AST_VECTOR_RESET(&participants, AST_VECTOR_ELEM_CLEANUP_NOOP);
 		AST_LIST_TRAVERSE(&bridge->channels, bridge_channel, entry) {
-			struct softmix_channel *sc = bridge_channel->tech_pvt;
-
-			if (!sc || bridge_channel->suspended) {
+			if (!bridge_channel->tech_pvt || bridge_channel->suspended) {
 				/* This channel failed to join successfully or is suspended. */
 				continue;
 			}
-
-			ast_mutex_lock(&sc->lock);
-
-			/* Make SLINEAR write frame from local buffer */
-			ao2_t_replace(sc->write_frame.subclass.format, cur_slin,
-				"Replace softmix channel slin format");
-#ifdef BINAURAL_RENDERING
-			if (bridge->softmix.binaural_active && softmix_data->convolve.binaural_active
-					&& sc->binaural) {
-				create_binaural_frame(bridge_channel, sc, bin_buf, ann_buf, softmix_datalen,
-						softmix_samples, buf);
-			} else
-#endif
-			{
-				sc->write_frame.datalen = softmix_datalen;
-				sc->write_frame.samples = softmix_samples;
-				memcpy(sc->final_buf, buf, softmix_datalen);
+			if (AST_VECTOR_APPEND(&participants, bridge_channel)) {
+				/* Without room for everyone nobody gets this interval. */
+				AST_VECTOR_RESET(&participants, AST_VECTOR_ELEM_CLEANUP_NOOP);
+				break;
 			}
-			/* process the softmix channel's new write audio */
-			softmix_process_write_audio(&trans_helper,
-					ast_channel_rawwriteformat(bridge_channel->chan), sc,
-					softmix_data->default_sample_size);
-
-			ast_mutex_unlock(&sc->lock);
+		}
 
-			/* A frame is now ready for the channel. */
-			ast_bridge_channel_queue_frame(bridge_channel, &sc->write_frame);
+		interval.cur_slin = cur_slin;
+		interval.softmix_samples = softmix_samples;
+		interval.softmix_datalen = softmix_datalen;
+		interval.mix_frame.subclass.format = cur_slin;
+		interval.mix_frame.samples = softmix_samples;
+		interval.mix_frame.datalen = softmix_datalen;
+		softmix_process_participants(&interval, participants.elems,
+			AST_VECTOR_SIZE(&participants));
 
-			if (remb_update) {
-				remb_send_report(bridge_channel, sc);
+		if (remb_update) {
+			for (idx = 0; idx < AST_VECTOR_SIZE(&participants); ++idx) {
+				bridge_channel = AST_VECTOR_GET(&participants, idx);
+				remb_send_report(bridge_channel, bridge_channel->tech_pvt);
 			}
 		}
 
@@ -1864,6 +2196,7 @@ static int softmix_mixing_loop(struct ast_bridge *bridge)
 	res = 0;
 
 softmix_cleanup:
+	AST_VECTOR_FREE(&participants);
 	softmix_translate_helper_destroy(&trans_helper);
 	softmix_mixing_array_destroy(&mixing_array, bridge->softmix.binaural_active);
 	return res;
@@ -2181,6 +2514,12 @@ static void softmix_bridge_stream_topology_changed(struct ast_bridge *bridge, st
 		break;
 	}
 
+	if (bridge->batching) {
+		/* Every participant gets remapped so do it once when the batch ends */
+		softmix_data->sfu_remap_pending = 1;
+		return;
+	}
+
 	AST_VECTOR_INIT(&media_types, AST_MEDIA_TYPE_END);
 
 	/* The bridge stream identifiers may change, so reset the mapping for them.
@@ -2289,6 +2628,33 @@ static void softmix_bridge_stream_topology_changed(struct ast_bridge *bridge, st
 	AST_VECTOR_FREE(&media_types);
 }
 
+/*! \brief Function called when a batch of joins and leaves on the bridge has completed */
+static void softmix_bridge_batch_end(struct ast_bridge *bridge)
+{
+	struct softmix_bridge_data *softmix_data = bridge->tech_pvt;
+	struct ast_bridge_channel *participant;
+	struct softmix_channel *sc;
+
+	if (!softmix_data) {
+		return;
+	}
+
+	if (softmix_data->sfu_remap_pending) {
+		softmix_data->sfu_remap_pending = 0;
+		/* The SFU remap covers all participants so no specific channel is needed */
+		softmix_bridge_stream_topology_changed(bridge, NULL);
+	}
+
+	AST_LIST_TRAVERSE(&bridge->channels, participant, entry) {
+		sc = participant->tech_pvt;
+		if (!sc || !sc->topology_change_pending) {
+			continue;
+		}
+		sc->topology_change_pending = 0;
+		ast_channel_request_stream_topology_change(participant->chan, sc->topology, NULL);
+	}
+}
+
 static struct ast_bridge_technology softmix_bridge = {
 	.name = "softmix",
 	.capabilities = AST_BRIDGE_CAPABILITY_MULTIMIX,
@@ -2301,6 +2667,7 @@ static struct ast_bridge_technology softmix_bridge = {
 	.unsuspend = softmix_bridge_unsuspend,
 	.write = softmix_bridge_write,
 	.stream_topology_changed = softmix_bridge_stream_topology_changed,
+	.batch_end = softmix_bridge_batch_end,
 };
 
 #ifdef TEST_FRAMEWORK
@@ -2590,11 +2957,27 @@ static int unload_module(void)
 	ast_bridge_technology_unregister(&softmix_bridge);
 	AST_TEST_UNREGISTER(sfu_append_source_streams);
 	AST_TEST_UNREGISTER(sfu_remove_destination_streams);
+	ast_threadpool_shutdown(softmix_pool);
+	softmix_pool = NULL;
 	return 0;
 }
 
 static int load_module(void)
 {
+	struct ast_threadpool_options options = {
+		.version = AST_THREADPOOL_OPTIONS_VERSION,
+		.idle_timeout = 60,
+		.auto_increment = 1,
+		.initial_size = 0,
+		.max_size = 0,
+	};
+
+	/* Bridges still mix on their own thread if the pool is not available. */
+	softmix_pool = ast_threadpool_create("softmix", NULL, &options);
+	if (!softmix_pool) {
+		ast_log(LOG_WARNING, "Unable to create the softmix mixing threadpool, bridges will use a single mixing thread.\n");
+	}
+
 	if (ast_bridge_technology_register(&softmix_bridge)) {
 		unload_module();
 		return AST_MODULE_LOAD_DECLINE;
@@ -138,8 +138,10 @@ struct softmix_channel {
 	struct ast_frame write_frame;
 	/*! Current expected read slinear format. */
 	struct ast_format *read_slin_format;
-	/*! DSP for detecting silence */
-	struct ast_dsp *dsp;
+	/*! Average magnitude below which read audio is considered silence */
+	int talking_threshold;
+	/*! Milliseconds of consecutive silence read from the channel */
+	int totalsilence;
 	/*!
 	 * \brief TRUE if a channel is talking.
 	 *
@@ -179,6 +181,8 @@ struct softmix_channel {
 	struct softmix_remb_collector *remb_collector;
 	/*! The bridge streams which are feeding us video sources */
 	AST_VECTOR(, int) video_sources;
+	/*! TRUE if a stream topology change request was deferred by a bridge batch */
+	unsigned int topology_change_pending:1;
 };
 
 struct softmix_bridge_data {
@@ -201,6 +205,8 @@ struct softmix_bridge_data {
 	unsigned int internal_mixing_interval;
 	/*! TRUE if the mixing thread should stop */
 	unsigned int stop:1;
+	/*! TRUE if the SFU stream mapping was deferred by a bridge batch */
+	unsigned int sfu_remap_pending:1;
 	/*! The default sample size (e.g. using Opus at 48khz and 20 ms mixing
 	 * interval, sample size is 960) */
 	unsigned int default_sample_size;
@@ -55,9 +55,13 @@
 #include "asterisk/res_odbc.h"
 #include "asterisk/cdr.h"
 #include "asterisk/module.h"
+#include "asterisk/sched.h"
 
 #define	CONFIG	"cdr_adaptive_odbc.conf"
 
+/*! How often batches are checked for having waited batch_time, in ms */
+#define BATCH_CHECK_INTERVAL 1000
+
 static const char name[] = "Adaptive ODBC";
 /* Optimization to reduce number of memory allocations */
 static int maxsize = 512, maxsize2 = 512;
@@ -83,12 +87,31 @@ struct tables {
 	char *schema;
 	char quoted_identifiers;
 	unsigned int usegmtime:1;
+	/*! Most CDRs inserted by one statement (1 inserts each on its own) */
+	unsigned int batch_size;
+	/*! Longest time in seconds a CDR waits for its batch to fill (0 for no limit) */
+	unsigned int batch_time;
+	/*! Protects the batch_* fields below */
+	ast_mutex_t batch_lock;
+	/*! INSERT of the CDRs waiting, one row of VALUES for each */
+	struct ast_str *batch_sql;
+	/*! Length of the INSERT INTO ... (columns) part of batch_sql */
+	size_t batch_head;
+	/*! Number of CDRs in batch_sql */
+	unsigned int batch_rows;
+	/*! When the first CDR of the batch came in */
+	struct timeval batch_start;
 	AST_LIST_HEAD_NOLOCK(odbc_columns, columns) columns;
 	AST_RWLIST_ENTRY(tables) list;
 };
 
 static AST_RWLIST_HEAD_STATIC(odbc_tables, tables);
 
+/*! Flushes batches that waited batch_time */
+static struct ast_sched_context *batch_sched;
+
+static SQLHSTMT generic_prepare(struct odbc_obj *obj, void *data);
+
 static int load_config(void)
 {
 	struct ast_config *cfg;
@@ -103,6 +126,7 @@ static int load_config(void)
 	char schema[40];
 	char quoted_identifiers;
 	int lenconnection, lentable, lenschema, usegmtime = 0;
+	unsigned int batch_size, batch_time;
 	SQLLEN sqlptr;
 	int res = 0;
 	SQLHSTMT stmt = NULL;
@@ -130,6 +154,20 @@ static int load_config(void)
 			usegmtime = ast_true(tmp);
 		}
 
+		batch_size = 1;
+		if (!ast_strlen_zero(tmp = ast_variable_retrieve(cfg, catg, "batch_size"))
+			&& (sscanf(tmp, "%30u", &batch_size) != 1 || !batch_size)) {
+			ast_log(LOG_WARNING, "Invalid batch_size '%s' in '%s'.  Inserting CDRs one at a time.\n", tmp, catg);
+			batch_size = 1;
+		}
+
+		batch_time = 5;
+		if (!ast_strlen_zero(tmp = ast_variable_retrieve(cfg, catg, "batch_time"))
+			&& sscanf(tmp, "%30u", &batch_time) != 1) {
+			ast_log(LOG_WARNING, "Invalid batch_time '%s' in '%s'.  Using 5 seconds.\n", tmp, catg);
+			batch_time = 5;
+		}
+
 		/* When loading, we want to be sure we can connect. */
 		obj = ast_odbc_request_obj(connection, 1);
 		if (!obj) {
@@ -186,6 +224,8 @@ static int load_config(void)
 		}
 
 		tableptr->usegmtime = usegmtime;
+		tableptr->batch_size = batch_size;
+		tableptr->batch_time = batch_time;
 		tableptr->connection = (char *)tableptr + sizeof(*tableptr);
 		tableptr->table = (char *)tableptr + sizeof(*tableptr) + lenconnection + 1;
 		tableptr->schema = (char *)tableptr + sizeof(*tableptr) + lenconnection + 1 + lentable + 1;
@@ -302,20 +342,145 @@ static int load_config(void)
 		SQLFreeHandle(SQL_HANDLE_STMT, stmt);
 		ast_odbc_release_obj(obj);
 
-		if (AST_LIST_FIRST(&(tableptr->columns)))
+		if (AST_LIST_FIRST(&(tableptr->columns))) {
+			ast_mutex_init(&tableptr->batch_lock);
+			if (tableptr->batch_size > 1 && !(tableptr->batch_sql = ast_str_create(maxsize * tableptr->batch_size))) {
+				tableptr->batch_size = 1;
+			}
 			AST_RWLIST_INSERT_TAIL(&odbc_tables, tableptr, list);
-		else
+		} else {
 			ast_free(tableptr);
+		}
 	}
 	ast_config_destroy(cfg);
 	return res;
 }
 
+/*!
+ * \internal
+ * \brief Insert the CDRs waiting in the batch of a table.
+ *
+ * \note Called with the batch_lock of the table held.
+ *
+ * \param tableptr Table to insert the CDRs into
+ * \param obj Handle of the table's connection, NULL to request one
+ */
+static void batch_flush(struct tables *tableptr, struct odbc_obj *obj)
+{
+	struct odbc_obj *own = NULL;
+	SQLHSTMT stmt;
+	SQLLEN rows = 0;
+
+	if (!tableptr->batch_rows) {
+		return;
+	}
+
+	if (!obj && !(obj = own = ast_odbc_request_obj(tableptr->connection, 0))) {
+		ast_log(LOG_WARNING, "cdr_adaptive_odbc: Unable to retrieve database handle for '%s:%s'.  %u CDRs failed: %s\n",
+			tableptr->connection, tableptr->table, tableptr->batch_rows, ast_str_buffer(tableptr->batch_sql));
+	} else {
+		ast_debug(3, "Executing [%s]\n", ast_str_buffer(tableptr->batch_sql));
+
+		stmt = ast_odbc_prepare_and_execute(obj, generic_prepare, ast_str_buffer(tableptr->batch_sql));
+		if (stmt) {
+			SQLRowCount(stmt, &rows);
+			SQLFreeHandle(SQL_HANDLE_STMT, stmt);
+		}
+		if (rows != tableptr->batch_rows) {
+			ast_log(LOG_WARNING, "cdr_adaptive_odbc: Insert of %u CDRs failed on '%s:%s' (%ld inserted): %s\n",
+				tableptr->batch_rows, tableptr->connection, tableptr->table, (long) rows,
+				ast_str_buffer(tableptr->batch_sql));
+		}
+		if (own) {
+			ast_odbc_release_obj(own);
+		}
+	}
+
+	tableptr->batch_rows = 0;
+	ast_str_reset(tableptr->batch_sql);
+}
+
+/*!
+ * \internal
+ * \brief Add a CDR to the batch of a table, inserting the batch when full.
+ *
+ * \param tableptr Table to insert the CDR into
+ * \param obj Handle of the table's connection
+ * \param head INSERT INTO ... (columns) of the CDR
+ * \param values VALUES (...) of the CDR
+ */
+static void batch_add(struct tables *tableptr, struct odbc_obj *obj, struct ast_str *head, struct ast_str *values)
+{
+	ast_mutex_lock(&tableptr->batch_lock);
+
+	/* Only CDRs setting the same columns can share a statement */
+	if (tableptr->batch_rows && (ast_str_strlen(head) != tableptr->batch_head
+		|| strncmp(ast_str_buffer(head), ast_str_buffer(tableptr->batch_sql), tableptr->batch_head))) {
+		batch_flush(tableptr, obj);
+	}
+
+	if (!tableptr->batch_rows) {
+		if (ast_str_set(&tableptr->batch_sql, 0, "%s%s", ast_str_buffer(head), ast_str_buffer(values)) < 0) {
+			ast_log(LOG_ERROR, "Unable to allocate sufficient memory.  Insert CDR '%s:%s' failed.\n", tableptr->connection, tableptr->table);
+			ast_str_reset(tableptr->batch_sql);
+			ast_mutex_unlock(&tableptr->batch_lock);
+			return;
+		}
+		tableptr->batch_head = ast_str_strlen(head);
+		tableptr->batch_start = ast_tvnow();
+	} else {
+		size_t len = ast_str_strlen(tableptr->batch_sql);
+
+		/* Append the row without the leading " VALUES " */
+		if (ast_str_append(&tableptr->batch_sql, 0, ", %s", ast_str_buffer(values) + 8) < 0) {
+			ast_log(LOG_ERROR, "Unable to allocate sufficient memory.  Insert CDR '%s:%s' failed.\n", tableptr->connection, tableptr->table);
+			ast_str_truncate(tableptr->batch_sql, len);
+			ast_mutex_unlock(&tableptr->batch_lock);
+			return;
+		}
+	}
+
+	if (++tableptr->batch_rows >= tableptr->batch_size) {
+		batch_flush(tableptr, obj);
+	}
+
+	ast_mutex_unlock(&tableptr->batch_lock);
+}
+
+static int batch_check(const void *data)
+{
+	struct tables *tableptr;
+	struct timeval now = ast_tvnow();
+
+	AST_RWLIST_RDLOCK(&odbc_tables);
+	AST_LIST_TRAVERSE(&odbc_tables, tableptr, list) {
+		if (tableptr->batch_size <= 1 || !tableptr->batch_time) {
+			continue;
+		}
+		ast_mutex_lock(&tableptr->batch_lock);
+		if (tableptr->batch_rows && ast_tvdiff_ms(now, tableptr->batch_start) >= tableptr->batch_time * 1000LL) {
+			batch_flush(tableptr, NULL);
+		}
+		ast_mutex_unlock(&tableptr->batch_lock);
+	}
+	AST_RWLIST_UNLOCK(&odbc_tables);
+
+	/* Check again after another interval */
+	return 1;
+}
+
 static int free_config(void)
 {
 	struct tables *table;
 	struct columns *entry;
 	while ((table = AST_RWLIST_REMOVE_HEAD(&odbc_tables, list))) {
+		if (table->batch_sql) {
+			ast_mutex_lock(&table->batch_lock);
+			batch_flush(table, NULL);
+			ast_mutex_unlock(&table->batch_lock);
+			ast_free(table->batch_sql);
+		}
+		ast_mutex_destroy(&table->batch_lock);
 		while ((entry = AST_LIST_REMOVE_HEAD(&(table->columns), list))) {
 			ast_free(entry);
 		}
@@ -752,6 +917,12 @@ static int odbc_log(struct ast_cdr *cdr)
 		LENGTHEN_BUF1(ast_str_strlen(sql2));
 		ast_str_append(&sql, 0, ")");
 		ast_str_append(&sql2, 0, ")");
+
+		if (tableptr->batch_size > 1) {
+			batch_add(tableptr, obj, sql, sql2);
+			goto early_release;
+		}
+
 		ast_str_append(&sql, 0, "%s", ast_str_buffer(sql2));
 
 		ast_debug(3, "Executing [%s]\n", ast_str_buffer(sql));
@@ -788,6 +959,10 @@ static int unload_module(void)
 		return -1;
 	}
 
+	/* The check takes the table list lock so it must stop first */
+	ast_sched_context_destroy(batch_sched);
+	batch_sched = NULL;
+
 	if (AST_RWLIST_WRLOCK(&odbc_tables)) {
 		ast_cdr_register(name, ast_module_info->description, odbc_log);
 		ast_log(LOG_ERROR, "Unable to lock column list.  Unload failed.\n");
@@ -801,6 +976,18 @@ static int unload_module(void)
 
 static int load_module(void)
 {
+	if (!(batch_sched = ast_sched_context_create())) {
+		ast_log(LOG_ERROR, "Unable to create scheduler context.  Load failed.\n");
+		return AST_MODULE_LOAD_DECLINE;
+	}
+	if (ast_sched_start_thread(batch_sched)
+		|| ast_sched_add(batch_sched, BATCH_CHECK_INTERVAL, batch_check, NULL) < 0) {
+		ast_log(LOG_ERROR, "Unable to start CDR batch timer.  Load failed.\n");
+		ast_sched_context_destroy(batch_sched);
+		batch_sched = NULL;
+		return AST_MODULE_LOAD_DECLINE;
+	}
+
 	if (AST_RWLIST_WRLOCK(&odbc_tables)) {
 		ast_log(LOG_ERROR, "Unable to lock column list.  Load failed.\n");
 		return 0;
@@ -409,6 +409,10 @@ static int (*iax2_regfunk)(const char *username, int onoff) = NULL;
 	} while(0)
 
 static struct io_context *io;
+/*! I/O context of the trunk thread, only watching the trunk timer */
+static struct io_context *trunk_io;
+/*! Trunk peers being sent to, only used by the trunk thread and reused between passes */
+static AST_VECTOR(, struct iax2_trunk_peer *) trunk_sending;
 static struct ast_sched_context *sched;
 
 static iax2_format iax2_capability = IAX_CAPABILITY_FULLBANDWIDTH;
@@ -436,6 +440,8 @@ static int iax2_encryption = 0;
 static struct ast_flags64 globalflags = { 0 };
 
 static pthread_t netthreadid = AST_PTHREADT_NULL;
+/*! Thread sending trunk frames, kept apart so trunk processing does not delay socket reads */
+static pthread_t trunkthreadid = AST_PTHREADT_NULL;
 
 enum iax2_state {
 	IAX_STATE_STARTED =			(1 << 0),
@@ -9444,6 +9450,7 @@ static int timing_read(int *id, int fd, short events, void *cbdata)
 	int res, processed = 0, totalcalls = 0;
 	struct iax2_trunk_peer *tpeer = NULL, *drop = NULL;
 	struct timeval now = ast_tvnow();
+	int idx;
 
 	if (iaxtrunkdebug) {
 		ast_verbose("Beginning trunk processing. Trunk queue ceiling is %d bytes per host\n", trunkmaxsize);
@@ -9456,11 +9463,16 @@ static int timing_read(int *id, int fd, short events, void *cbdata)
 		}
 	}
 
-	/* For each peer that supports trunking... */
+	/*
+	 * Collect the trunk peers to send to, then send without holding the list
+	 * lock so voice frames can keep being queued to other peers meanwhile.
+	 * Trunk peers are only freed by this function, so the collected
+	 * pointers stay valid.
+	 */
+	AST_VECTOR_RESET(&trunk_sending, AST_VECTOR_ELEM_CLEANUP_NOOP);
 	AST_LIST_LOCK(&tpeers);
 	AST_LIST_TRAVERSE_SAFE_BEGIN(&tpeers, tpeer, list) {
 		processed++;
-		res = 0;
 		ast_mutex_lock(&tpeer->lock);
 		/* We can drop a single tpeer per pass.  That makes all this logic
 		   substantially easier */
@@ -9469,25 +9481,34 @@ static int timing_read(int *id, int fd, short events, void *cbdata)
 			   could be in use */
 			AST_LIST_REMOVE_CURRENT(list);
 			drop = tpeer;
-		} else {
-			res = send_trunk(tpeer, &now);
+		} else if (AST_VECTOR_APPEND(&trunk_sending, tpeer)) {
+			/* Could not defer it, so send while still holding the list */
+			totalcalls += send_trunk(tpeer, &now);
 			trunk_timed++;
-			if (iaxtrunkdebug) {
-				ast_verbose(" - Trunk peer (%s) has %d call chunk%s in transit, %u bytes backloged and has hit a high water mark of %u bytes\n",
-							ast_sockaddr_stringify(&tpeer->addr),
-							res,
-							(res != 1) ? "s" : "",
-							tpeer->trunkdatalen,
-							tpeer->trunkdataalloc);
-			}
 		}
-		totalcalls += res;
-		res = 0;
 		ast_mutex_unlock(&tpeer->lock);
 	}
 	AST_LIST_TRAVERSE_SAFE_END;
 	AST_LIST_UNLOCK(&tpeers);
 
+	/* For each peer that supports trunking... */
+	for (idx = 0; idx < AST_VECTOR_SIZE(&trunk_sending); ++idx) {
+		tpeer = AST_VECTOR_GET(&trunk_sending, idx);
+		ast_mutex_lock(&tpeer->lock);
+		res = send_trunk(tpeer, &now);
+		trunk_timed++;
+		if (iaxtrunkdebug) {
+			ast_verbose(" - Trunk peer (%s) has %d call chunk%s in transit, %u bytes backloged and has hit a high water mark of %u bytes\n",
+						ast_sockaddr_stringify(&tpeer->addr),
+						res,
+						(res != 1) ? "s" : "",
+						tpeer->trunkdatalen,
+						tpeer->trunkdataalloc);
+		}
+		totalcalls += res;
+		ast_mutex_unlock(&tpeer->lock);
+	}
+
 	if (drop) {
 		ast_mutex_lock(&drop->lock);
 		/*  Once we have this lock, we're sure nobody else is using it or could use it once we release it,
@@ -12554,14 +12575,33 @@ static struct ast_channel *iax2_request(const char *type, struct ast_format_cap
 	return c;
 }
 
-static void *network_thread(void *ignore)
+static void *trunk_thread(void *ignore)
 {
 	int res;
 
-	if (timer) {
-		ast_io_add(io, ast_timer_fd(timer), timing_read, AST_IO_IN | AST_IO_PRI, NULL);
+	ast_io_add(trunk_io, ast_timer_fd(timer), timing_read, AST_IO_IN | AST_IO_PRI, NULL);
+
+	for (;;) {
+		pthread_testcancel();
+		/* Wake up once a second just in case SIGURG was sent while
+		 * we weren't in poll(), to make sure we don't hang when trying
+		 * to unload. */
+		res = ast_io_wait(trunk_io, 1000);
+		/* Timeout(=0), and EINTR is not a thread exit condition. We do
+		 * not want to exit the thread loop on these conditions. */
+		if (res < 0 && errno != -EINTR) {
+			ast_log(LOG_ERROR, "IAX2 trunk thread unexpected exit: %s\n", strerror(errno));
+			break;
+		}
 	}
 
+	return NULL;
+}
+
+static void *network_thread(void *ignore)
+{
+	int res;
+
 	for (;;) {
 		pthread_testcancel();
 		/* Wake up once a second just in case SIGURG was sent while
@@ -12618,6 +12658,16 @@ static int start_network_thread(void)
 			AST_LIST_UNLOCK(&idle_list);
 		}
 	}
+	if (timer) {
+		if (!(trunk_io = io_context_create())) {
+			ast_log(LOG_ERROR, "Failed to create trunk I/O context\n");
+			return -1;
+		}
+		if (ast_pthread_create_background(&trunkthreadid, NULL, trunk_thread, NULL)) {
+			ast_log(LOG_ERROR, "Failed to create new thread!\n");
+			return -1;
+		}
+	}
 	if (ast_pthread_create_background(&netthreadid, NULL, network_thread, NULL)) {
 		ast_log(LOG_ERROR, "Failed to create new thread!\n");
 		return -1;
@@ -14596,6 +14646,17 @@ static int __unload_module(void)
 		pthread_kill(netthreadid, SIGURG);
 		pthread_join(netthreadid, NULL);
 	}
+	if (trunkthreadid != AST_PTHREADT_NULL) {
+		pthread_cancel(trunkthreadid);
+		pthread_kill(trunkthreadid, SIGURG);
+		pthread_join(trunkthreadid, NULL);
+		trunkthreadid = AST_PTHREADT_NULL;
+	}
+	if (trunk_io) {
+		io_context_destroy(trunk_io);
+		trunk_io = NULL;
+	}
+	AST_VECTOR_FREE(&trunk_sending);
 
 	for (x = 0; x < ARRAY_LEN(iaxs); x++) {
 		if (iaxs[x]) {
@@ -14825,7 +14886,7 @@ static int load_module(void)
 		ast_mutex_init(&iaxsl[x]);
 	}
 
-	if (!(sched = ast_sched_context_create())) {
+	if (!(sched = ast_sched_context_create_with_backend(AST_SCHED_BACKEND_WHEEL))) {
 		ast_log(LOG_ERROR, "Failed to create scheduler thread\n");
 		ao2_ref(iax2_tech.capabilities, -1);
 		iax2_tech.capabilities = NULL;
@@ -29271,6 +29271,7 @@ static int sipsock_read(int *id, int fd, short events, void *ignore)
 	struct sip_request req;
 	struct ast_sockaddr addr;
 	int res;
+	size_t len;
 	static char readbuf[65535];
 
 	memset(&req, 0, sizeof(req));
@@ -29288,13 +29289,13 @@ static int sipsock_read(int *id, int fd, short events, void *ignore)
 
 	readbuf[res] = '\0';
 
-	if (!(req.data = ast_str_create(SIP_MIN_PACKET))) {
+	/* Size the request for the packet so it is copied once, without any formatting */
+	len = strlen(readbuf);
+	if (!(req.data = ast_str_create(MAX(SIP_MIN_PACKET, len + 1)))) {
 		return 1;
 	}
-
-	if (ast_str_set(&req.data, 0, "%s", readbuf) == AST_DYNSTR_BUILD_FAILED) {
-		return -1;
-	}
+	memcpy(ast_str_buffer(req.data), readbuf, len + 1);
+	ast_str_update(req.data);
 
 	req.socket.fd = sipsock;
 	set_socket_transport(&req.socket, AST_TRANSPORT_UDP);
@@ -35443,7 +35444,7 @@ static int load_module(void)
 	subscription_mwi_list = ao2_t_container_alloc_list(AO2_ALLOC_OPT_LOCK_MUTEX,
 		AO2_CONTAINER_ALLOC_OPT_INSERT_BEGIN, NULL, NULL, "allocate subscription_mwi_list");
 
-	if (!(sched = ast_sched_context_create())) {
+	if (!(sched = ast_sched_context_create_with_backend(AST_SCHED_BACKEND_WHEEL))) {
 		ast_log(LOG_ERROR, "Unable to create scheduler context\n");
 		unload_module();
 		return AST_MODULE_LOAD_DECLINE;
@@ -387,6 +387,8 @@
 					<enum name="stdevrtt"><para>Standard deviation round trip time</para></enum>
 					<enum name="local_ssrc"><para>Our Synchronization Source identifier</para></enum>
 					<enum name="remote_ssrc"><para>Their Synchronization Source identifier</para></enum>
+					<enum name="txpacketspersyscall"><para>Average packets sent per system call</para></enum>
+					<enum name="rxpacketspersyscall"><para>Average packets received per system call</para></enum>
 				</enumlist>
 			</parameter>
 			<parameter name="media_type" required="false">
@@ -695,6 +697,8 @@ static int channel_read_rtcp(struct ast_channel *chan, const char *type, const c
 			{ "stdevrtt",              DBL, { .d8 = &stats.stdevrtt, }, },
 			{ "local_ssrc",            INT, { .i4 = &stats.local_ssrc, }, },
 			{ "remote_ssrc",           INT, { .i4 = &stats.remote_ssrc, }, },
+			{ "txpacketspersyscall",   DBL, { .d8 = &stats.txpacketspersyscall, }, },
+			{ "rxpacketspersyscall",   DBL, { .d8 = &stats.rxpacketspersyscall, }, },
 			{ NULL, },
 		};
 
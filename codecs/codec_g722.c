@@ -148,6 +148,7 @@ static struct ast_translator g722tolin = {
 	},
 	.format = "slin",
 	.newpvt = g722tolin_new,	/* same for both directions */
+	.reset = g722tolin_new,	/* initializing again starts over */
 	.framein = g722tolin_framein,
 	.sample = g722_sample,
 	.desc_size = sizeof(struct g722_decoder_pvt),
@@ -169,6 +170,7 @@ static struct ast_translator lintog722 = {
 	},
 	.format = "g722",
 	.newpvt = lintog722_new,	/* same for both directions */
+	.reset = lintog722_new,	/* initializing again starts over */
 	.framein = lintog722_framein,
 	.sample = slin8_sample,
 	.desc_size = sizeof(struct g722_encoder_pvt),
@@ -190,6 +192,7 @@ static struct ast_translator g722tolin16 = {
 	},
 	.format = "slin16",
 	.newpvt = g722tolin16_new,	/* same for both directions */
+	.reset = g722tolin16_new,	/* initializing again starts over */
 	.framein = g722tolin_framein,
 	.sample = g722_sample,
 	.desc_size = sizeof(struct g722_decoder_pvt),
@@ -211,6 +214,7 @@ static struct ast_translator lin16tog722 = {
 	},
 	.format = "g722",
 	.newpvt = lin16tog722_new,	/* same for both directions */
+	.reset = lin16tog722_new,	/* initializing again starts over */
 	.framein = lintog722_framein,
 	.sample = slin16_sample,
 	.desc_size = sizeof(struct g722_encoder_pvt),
@@ -38,6 +38,9 @@
 
 #define OUTBUF_SAMPLES   11520
 
+/*! Speex quality of new resamplers, from 0 to 10 */
+#define RESAMPLER_QUALITY 5
+
 static struct ast_translator *translators;
 static int trans_size;
 static struct ast_codec codec_list[] = {
@@ -92,7 +95,7 @@ static int resamp_new(struct ast_trans_pvt *pvt)
 {
 	int err;
 
-	if (!(pvt->pvt = speex_resampler_init(1, pvt->t->src_codec.sample_rate, pvt->t->dst_codec.sample_rate, 5, &err))) {
+	if (!(pvt->pvt = speex_resampler_init(1, pvt->t->src_codec.sample_rate, pvt->t->dst_codec.sample_rate, RESAMPLER_QUALITY, &err))) {
 		return -1;
 	}
 
@@ -102,6 +105,18 @@ static int resamp_new(struct ast_trans_pvt *pvt)
 	return 0;
 }
 
+static int resamp_reset(struct ast_trans_pvt *pvt)
+{
+	return speex_resampler_set_quality(pvt->pvt, RESAMPLER_QUALITY)
+		|| speex_resampler_reset_mem(pvt->pvt);
+}
+
+static int resamp_set_quality(struct ast_trans_pvt *pvt, int quality)
+{
+	/* The speex quality scale matches the translator one. */
+	return speex_resampler_set_quality(pvt->pvt, quality) ? -1 : 0;
+}
+
 static void resamp_destroy(struct ast_trans_pvt *pvt)
 {
 	SpeexResamplerState *resamp_pvt = pvt->pvt;
@@ -162,6 +177,8 @@ static int load_module(void)
 				continue;
 			}
 			translators[idx].newpvt = resamp_new;
+			translators[idx].reset = resamp_reset;
+			translators[idx].set_quality = resamp_set_quality;
 			translators[idx].destroy = resamp_destroy;
 			translators[idx].framein = resamp_framein;
 			translators[idx].desc_size = 0;
@@ -92,6 +92,14 @@ static void speex_free (void *ptr) {free(ptr);}
 #include "resample_sse.h"
 #endif
 
+#if defined(FIXED_POINT) && defined(__SSE2__)
+#include "resample_sse2_fixed.h"
+#endif
+
+#ifdef SHARED_SINC_TABLES
+#include <pthread.h>
+#endif
+
 /* Numer of elements to allocate on the stack */
 #ifdef VAR_ARRAYS
 #define FIXED_STACK_ALLOC 8192
@@ -127,6 +135,9 @@ struct SpeexResamplerState_ {
    spx_word16_t *mem;
    spx_word16_t *sinc_table;
    spx_uint32_t sinc_table_length;
+#ifdef SHARED_SINC_TABLES
+   struct SharedSincTable_ *shared_sinc_table;
+#endif
    resampler_basic_func resampler_ptr;
 
    int    in_stride;
@@ -330,7 +341,9 @@ static int resampler_basic_direct_single(SpeexResamplerState *st, spx_uint32_t c
    const int frac_advance = st->frac_advance;
    const spx_uint32_t den_rate = st->den_rate;
    spx_word32_t sum;
+#ifndef OVERRIDE_INNER_PRODUCT_SINGLE
    int j;
+#endif
 
    while (!(last_sample >= (spx_int32_t)*in_len || out_sample >= (spx_int32_t)*out_len))
    {
@@ -428,7 +441,9 @@ static int resampler_basic_interpolate_single(SpeexResamplerState *st, spx_uint3
    const int int_advance = st->int_advance;
    const int frac_advance = st->frac_advance;
    const spx_uint32_t den_rate = st->den_rate;
+#ifndef OVERRIDE_INTERPOLATE_PRODUCT_SINGLE
    int j;
+#endif
    spx_word32_t sum;
 
    while (!(last_sample >= (spx_int32_t)*in_len || out_sample >= (spx_int32_t)*out_len))
@@ -540,6 +555,109 @@ static int resampler_basic_interpolate_double(SpeexResamplerState *st, spx_uint3
 }
 #endif
 
+/* Fill the sinc table for the current filter */
+static void compute_sinc_table(SpeexResamplerState *st, spx_word16_t *sinc_table, int direct)
+{
+   if (direct)
+   {
+      spx_uint32_t i;
+      for (i=0;i<st->den_rate;i++)
+      {
+         spx_int32_t j;
+         for (j=0;j<st->filt_len;j++)
+         {
+            sinc_table[i*st->filt_len+j] = sinc(st->cutoff,((j-(spx_int32_t)st->filt_len/2+1)-((float)i)/st->den_rate), st->filt_len, quality_map[st->quality].window_func);
+         }
+      }
+   } else {
+      spx_int32_t i;
+      for (i=-4;i<(spx_int32_t)(st->oversample*st->filt_len+4);i++)
+         sinc_table[i+4] = sinc(st->cutoff,(i/(float)st->oversample - st->filt_len/2), st->filt_len, quality_map[st->quality].window_func);
+   }
+}
+
+#ifdef SHARED_SINC_TABLES
+/* The sinc table only depends on the quality and the reduced ratio so
+   resamplers with the same ones share a single read-only copy. */
+typedef struct SharedSincTable_ {
+   struct SharedSincTable_ *next;
+   int quality;
+   spx_uint32_t num_rate;
+   spx_uint32_t den_rate;
+   spx_uint32_t length;
+   unsigned int refs;
+   spx_word16_t table[];
+} SharedSincTable;
+
+static SharedSincTable *shared_sinc_tables;
+static pthread_mutex_t shared_sinc_tables_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void shared_sinc_table_release(SharedSincTable *shared)
+{
+   SharedSincTable **prev;
+
+   if (!shared)
+      return;
+   pthread_mutex_lock(&shared_sinc_tables_lock);
+   if (!--shared->refs)
+   {
+      for (prev=&shared_sinc_tables;*prev!=shared;prev=&(*prev)->next);
+      *prev = shared->next;
+      speex_free(shared);
+   }
+   pthread_mutex_unlock(&shared_sinc_tables_lock);
+}
+
+/* Point the resampler at the shared table for its filter, building it
+   if no other resampler uses it yet. */
+static void update_sinc_table(SpeexResamplerState *st, spx_uint32_t length, int direct)
+{
+   SharedSincTable *old = st->shared_sinc_table;
+   SharedSincTable *shared;
+
+   pthread_mutex_lock(&shared_sinc_tables_lock);
+   for (shared=shared_sinc_tables;shared;shared=shared->next)
+   {
+      if (shared->quality == st->quality && shared->num_rate == st->num_rate
+         && shared->den_rate == st->den_rate && shared->length == length)
+         break;
+   }
+   if (shared)
+   {
+      shared->refs++;
+   } else {
+      /* The table is built under the lock so it is never seen half done */
+      shared = (SharedSincTable *)speex_alloc(sizeof(*shared) + length*sizeof(spx_word16_t));
+      shared->quality = st->quality;
+      shared->num_rate = st->num_rate;
+      shared->den_rate = st->den_rate;
+      shared->length = length;
+      shared->refs = 1;
+      compute_sinc_table(st, shared->table, direct);
+      shared->next = shared_sinc_tables;
+      shared_sinc_tables = shared;
+   }
+   pthread_mutex_unlock(&shared_sinc_tables_lock);
+
+   st->shared_sinc_table = shared;
+   st->sinc_table = shared->table;
+   st->sinc_table_length = length;
+   shared_sinc_table_release(old);
+}
+#else
+static void update_sinc_table(SpeexResamplerState *st, spx_uint32_t length, int direct)
+{
+   if (!st->sinc_table)
+      st->sinc_table = (spx_word16_t *)speex_alloc(length*sizeof(spx_word16_t));
+   else if (st->sinc_table_length < length)
+   {
+      st->sinc_table = (spx_word16_t *)speex_realloc(st->sinc_table,length*sizeof(spx_word16_t));
+      st->sinc_table_length = length;
+   }
+   compute_sinc_table(st, st->sinc_table, direct);
+}
+#endif
+
 static void update_filter(SpeexResamplerState *st)
 {
    spx_uint32_t old_length;
@@ -574,22 +692,7 @@ static void update_filter(SpeexResamplerState *st)
    /* Choose the resampling type that requires the least amount of memory */
    if (st->den_rate <= st->oversample)
    {
-      spx_uint32_t i;
-      if (!st->sinc_table)
-         st->sinc_table = (spx_word16_t *)speex_alloc(st->filt_len*st->den_rate*sizeof(spx_word16_t));
-      else if (st->sinc_table_length < st->filt_len*st->den_rate)
-      {
-         st->sinc_table = (spx_word16_t *)speex_realloc(st->sinc_table,st->filt_len*st->den_rate*sizeof(spx_word16_t));
-         st->sinc_table_length = st->filt_len*st->den_rate;
-      }
-      for (i=0;i<st->den_rate;i++)
-      {
-         spx_int32_t j;
-         for (j=0;j<st->filt_len;j++)
-         {
-            st->sinc_table[i*st->filt_len+j] = sinc(st->cutoff,((j-(spx_int32_t)st->filt_len/2+1)-((float)i)/st->den_rate), st->filt_len, quality_map[st->quality].window_func);
-         }
-      }
+      update_sinc_table(st, st->filt_len*st->den_rate, 1);
 #ifdef FIXED_POINT
       st->resampler_ptr = resampler_basic_direct_single;
 #else
@@ -600,16 +703,7 @@ static void update_filter(SpeexResamplerState *st)
 #endif
       /*fprintf (stderr, "resampler uses direct sinc table and normalised cutoff %f\n", cutoff);*/
    } else {
-      spx_int32_t i;
-      if (!st->sinc_table)
-         st->sinc_table = (spx_word16_t *)speex_alloc((st->filt_len*st->oversample+8)*sizeof(spx_word16_t));
-      else if (st->sinc_table_length < st->filt_len*st->oversample+8)
-      {
-         st->sinc_table = (spx_word16_t *)speex_realloc(st->sinc_table,(st->filt_len*st->oversample+8)*sizeof(spx_word16_t));
-         st->sinc_table_length = st->filt_len*st->oversample+8;
-      }
-      for (i=-4;i<(spx_int32_t)(st->oversample*st->filt_len+4);i++)
-         st->sinc_table[i+4] = sinc(st->cutoff,(i/(float)st->oversample - st->filt_len/2), st->filt_len, quality_map[st->quality].window_func);
+      update_sinc_table(st, st->filt_len*st->oversample+8, 0);
 #ifdef FIXED_POINT
       st->resampler_ptr = resampler_basic_interpolate_single;
 #else
@@ -731,7 +825,11 @@ static void update_filter(SpeexResamplerState *st)
    st->num_rate = 0;
    st->den_rate = 0;
    st->quality = -1;
+   st->sinc_table = 0;
    st->sinc_table_length = 0;
+#ifdef SHARED_SINC_TABLES
+   st->shared_sinc_table = 0;
+#endif
    st->mem_alloc_size = 0;
    st->filt_len = 0;
    st->mem = 0;
@@ -775,7 +873,11 @@ static void update_filter(SpeexResamplerState *st)
  void speex_resampler_destroy(SpeexResamplerState *st)
 {
    speex_free(st->mem);
+#ifdef SHARED_SINC_TABLES
+   shared_sinc_table_release(st->shared_sinc_table);
+#else
    speex_free(st->sinc_table);
+#endif
    speex_free(st->last_sample);
    speex_free(st->magic_samples);
    speex_free(st->samp_frac_num);
@@ -1099,6 +1201,12 @@ static int speex_resampler_magic(SpeexResamplerState *st, spx_uint32_t channel_i
  int speex_resampler_reset_mem(SpeexResamplerState *st)
 {
    spx_uint32_t i;
+   for (i=0;i<st->nb_channels;i++)
+   {
+      st->last_sample[i] = 0;
+      st->magic_samples[i] = 0;
+      st->samp_frac_num[i] = 0;
+   }
    for (i=0;i<st->nb_channels*(st->filt_len-1);i++)
       st->mem[i] = 0;
    return RESAMPLER_ERR_SUCCESS;
@@ -0,0 +1,78 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2019, Sangoma Technologies Corporation
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*! \file
+ *
+ * \brief Resampler inner products for the fixed point build (SSE2 version)
+ *
+ * resample_sse.h only covers the floating point build.  These keep the
+ * arithmetic of the generic fixed point loops: the direct product sums
+ * in float and the interpolating one in 32 bit integers.
+ */
+
+#include <emmintrin.h>
+
+#define OVERRIDE_INNER_PRODUCT_SINGLE
+static inline float inner_product_single(const spx_word16_t *a, const spx_word16_t *b, unsigned int len)
+{
+   unsigned int i;
+   float ret;
+   __m128 sum = _mm_setzero_ps();
+
+   /* The sinc table never holds -32768 so a pair of products cannot overflow */
+   for (i=0;i+8<=len;i+=8)
+   {
+      __m128i prod = _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(a+i)), _mm_loadu_si128((const __m128i *)(b+i)));
+      sum = _mm_add_ps(sum, _mm_cvtepi32_ps(prod));
+   }
+   sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+   sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 0x55));
+   _mm_store_ss(&ret, sum);
+   for (;i<len;i++)
+      ret += MULT16_16(a[i], b[i]);
+   return ret;
+}
+
+#define OVERRIDE_INTERPOLATE_PRODUCT_SINGLE
+static inline spx_word32_t interpolate_product_single(const spx_word16_t *a, const spx_word16_t *b, unsigned int len, const spx_uint32_t oversample, spx_word16_t *frac)
+{
+   unsigned int i;
+   spx_word32_t accum[4];
+   __m128i sum1 = _mm_setzero_si128();
+   __m128i sum2 = _mm_setzero_si128();
+
+   /* Two input samples at a time, each against its four coefficients */
+   for (i=0;i+2<=len;i+=2)
+   {
+      __m128i x = _mm_unpacklo_epi64(_mm_set1_epi16(a[i]), _mm_set1_epi16(a[i+1]));
+      __m128i c = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)(b+i*oversample)),
+         _mm_loadl_epi64((const __m128i *)(b+(i+1)*oversample)));
+      __m128i lo = _mm_mullo_epi16(x, c);
+      __m128i hi = _mm_mulhi_epi16(x, c);
+
+      sum1 = _mm_add_epi32(sum1, _mm_unpacklo_epi16(lo, hi));
+      sum2 = _mm_add_epi32(sum2, _mm_unpackhi_epi16(lo, hi));
+   }
+   _mm_storeu_si128((__m128i *)accum, _mm_add_epi32(sum1, sum2));
+   for (;i<len;i++)
+   {
+      accum[0] += MULT16_16(a[i], b[i*oversample]);
+      accum[1] += MULT16_16(a[i], b[i*oversample+1]);
+      accum[2] += MULT16_16(a[i], b[i*oversample+2]);
+      accum[3] += MULT16_16(a[i], b[i*oversample+3]);
+   }
+   return MULT16_32_Q15(frac[0],accum[0]) + MULT16_32_Q15(frac[1],accum[1]) + MULT16_32_Q15(frac[2],accum[2]) + MULT16_32_Q15(frac[3],accum[3]);
+}
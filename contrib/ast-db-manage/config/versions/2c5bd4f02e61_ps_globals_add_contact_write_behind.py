@@ -0,0 +1,20 @@
+"""ps_globals add contact_write_behind
+
+Revision ID: 2c5bd4f02e61
+Revises: 3778f0a80a5c
+Create Date: 2026-10-14 15:48:09.530112
+
+"""
+
+# revision identifiers, used by Alembic.
+revision = '2c5bd4f02e61'
+down_revision = '3778f0a80a5c'
+
+from alembic import op
+import sqlalchemy as sa
+
+def upgrade():
+    op.add_column('ps_globals', sa.Column('contact_write_behind', sa.Integer))
+
+def downgrade():
+    op.drop_column('ps_globals', 'contact_write_behind')
@@ -0,0 +1,39 @@
+"""ps_globals add stateless_options
+
+Revision ID: 3778f0a80a5c
+Revises: 3a094a18e75b
+Create Date: 2026-10-14 15:02:41.117325
+
+"""
+
+# revision identifiers, used by Alembic.
+revision = '3778f0a80a5c'
+down_revision = '3a094a18e75b'
+
+from alembic import op
+import sqlalchemy as sa
+from sqlalchemy.dialects.postgresql import ENUM
+
+AST_BOOL_NAME = 'ast_bool_values'
+# We'll just ignore the n/y and f/t abbreviations as Asterisk does not write
+# those aliases.
+AST_BOOL_VALUES = [ '0', '1',
+                    'off', 'on',
+                    'false', 'true',
+                    'no', 'yes' ]
+
+
+def upgrade():
+    ############################# Enums ##############################
+
+    # ast_bool_values has already been created, so use postgres enum object
+    # type to get around "already created" issue - works okay with mysql
+    ast_bool_values = ENUM(*AST_BOOL_VALUES, name=AST_BOOL_NAME, create_type=False)
+
+    op.add_column('ps_globals', sa.Column('stateless_options', ast_bool_values))
+
+
+def downgrade():
+    if op.get_context().bind.dialect.name == 'mssql':
+        op.drop_constraint('ck_ps_globals_stateless_options_ast_bool_values', 'ps_globals')
+    op.drop_column('ps_globals', 'stateless_options')
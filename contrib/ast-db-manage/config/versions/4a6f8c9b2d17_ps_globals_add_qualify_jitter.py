@@ -0,0 +1,20 @@
+"""ps_globals add qualify_jitter
+
+Revision ID: 4a6f8c9b2d17
+Revises: 2c5bd4f02e61
+Create Date: 2026-10-14 16:32:40.118305
+
+"""
+
+# revision identifiers, used by Alembic.
+revision = '4a6f8c9b2d17'
+down_revision = '2c5bd4f02e61'
+
+from alembic import op
+import sqlalchemy as sa
+
+def upgrade():
+    op.add_column('ps_globals', sa.Column('qualify_jitter', sa.Integer))
+
+def downgrade():
+    op.drop_column('ps_globals', 'qualify_jitter')
@@ -0,0 +1,20 @@
+"""ps_systems add pool_cache_size
+
+Revision ID: 7e3b5d08c4a2
+Revises: 4a6f8c9b2d17
+Create Date: 2026-10-14 17:21:05.640913
+
+"""
+
+# revision identifiers, used by Alembic.
+revision = '7e3b5d08c4a2'
+down_revision = '4a6f8c9b2d17'
+
+from alembic import op
+import sqlalchemy as sa
+
+def upgrade():
+    op.add_column('ps_systems', sa.Column('pool_cache_size', sa.Integer))
+
+def downgrade():
+    op.drop_column('ps_systems', 'pool_cache_size')
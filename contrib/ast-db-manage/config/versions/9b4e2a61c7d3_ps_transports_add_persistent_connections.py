@@ -0,0 +1,22 @@
+"""ps_transports add persistent_connections
+
+Revision ID: 9b4e2a61c7d3
+Revises: 7e3b5d08c4a2
+Create Date: 2026-10-14 18:02:47.118357
+
+"""
+
+# revision identifiers, used by Alembic.
+revision = '9b4e2a61c7d3'
+down_revision = '7e3b5d08c4a2'
+
+from alembic import op
+import sqlalchemy as sa
+
+def upgrade():
+    op.add_column('ps_transports', sa.Column('persistent_connections', sa.String(255)))
+    op.add_column('ps_transports', sa.Column('persistent_connection_pool', sa.Integer))
+
+def downgrade():
+    op.drop_column('ps_transports', 'persistent_connection_pool')
+    op.drop_column('ps_transports', 'persistent_connections')
@@ -76,10 +76,24 @@ static int pcma_rewrite(struct ast_filestream *s, const char *comment)
 }
 #endif
 
+static int pcm_open(struct ast_filestream *s)
+{
+	ast_filestream_map(s, -1);
+	return 0;
+}
+
 static struct ast_frame *pcm_read(struct ast_filestream *s, int *whennext)
 {
 	size_t res;
 
+	if (s->map) {
+		if (!ast_filestream_map_read(s, BUF_SIZE)) {
+			return NULL;
+		}
+		*whennext = s->fr.samples = s->fr.datalen;
+		return &s->fr;
+	}
+
 	/* Send a frame from the file to the appropriate channel */
 	AST_FRAME_SET_BUFFER(&s->fr, s->buf, AST_FRIENDLY_OFFSET, BUF_SIZE);
 	if ((res = fread(s->fr.data.ptr, 1, s->fr.datalen, s->f)) < 1) {
@@ -100,17 +114,16 @@ static int pcm_seek(struct ast_filestream *fs, off_t sample_offset, int whence)
 	off_t cur, max, offset = 0;
  	int ret = -1;	/* assume error */
 
-	if ((cur = ftello(fs->f)) < 0) {
+	if (fs->map) {
+		cur = fs->map_pos;
+		max = fs->map_end;
+	} else if ((cur = ftello(fs->f)) < 0) {
 		ast_log(AST_LOG_WARNING, "Unable to determine current position in pcm filestream %p: %s\n", fs, strerror(errno));
 		return -1;
-	}
-
-	if (fseeko(fs->f, 0, SEEK_END) < 0) {
+	} else if (fseeko(fs->f, 0, SEEK_END) < 0) {
 		ast_log(AST_LOG_WARNING, "Unable to seek to end of pcm filestream %p: %s\n", fs, strerror(errno));
 		return -1;
-	}
-
-	if ((max = ftello(fs->f)) < 0) {
+	} else if ((max = ftello(fs->f)) < 0) {
 		ast_log(AST_LOG_WARNING, "Unable to determine max position in pcm filestream %p: %s\n", fs, strerror(errno));
 		return -1;
 	}
@@ -134,7 +147,7 @@ static int pcm_seek(struct ast_filestream *fs, off_t sample_offset, int whence)
 		ast_log(LOG_WARNING, "negative offset %ld, resetting to 0\n", (long) offset);
 		offset = 0;
 	}
-	if (whence == SEEK_FORCECUR && offset > max) { /* extend the file */
+	if (whence == SEEK_FORCECUR && offset > max && !fs->map) { /* extend the file */
 		size_t left = offset - max;
 		const char *src = (ast_format_cmp(fs->fmt->format, ast_format_alaw) == AST_FORMAT_CMP_EQUAL) ? alaw_silence : ulaw_silence;
 
@@ -151,7 +164,11 @@ static int pcm_seek(struct ast_filestream *fs, off_t sample_offset, int whence)
 			ast_log(LOG_WARNING, "offset too large %ld, truncating to %ld\n", (long) offset, (long) max);
 			offset = max;
 		}
-		ret = fseeko(fs->f, offset, SEEK_SET);
+		if (fs->map) {
+			ret = ast_filestream_map_seek(fs, offset);
+		} else {
+			ret = fseeko(fs->f, offset, SEEK_SET);
+		}
 	}
 	return ret;
 }
@@ -174,6 +191,9 @@ static int pcm_trunc(struct ast_filestream *fs)
 
 static off_t pcm_tell(struct ast_filestream *fs)
 {
+	if (fs->map) {
+		return fs->map_pos;
+	}
 	return ftello(fs->f);
 }
 
@@ -389,6 +409,7 @@ static int au_open(struct ast_filestream *s)
 {
 	if (check_header(s) < 0)
 		return -1;
+	ast_filestream_map(s, -1);
 	return 0;
 }
 
@@ -412,17 +433,16 @@ static int au_seek(struct ast_filestream *fs, off_t sample_offset, int whence)
 
 	min = desc->hdr_size;
 
-	if ((cur = ftello(fs->f)) < 0) {
+	if (fs->map) {
+		cur = fs->map_pos;
+		max = fs->map_end;
+	} else if ((cur = ftello(fs->f)) < 0) {
 		ast_log(AST_LOG_WARNING, "Unable to determine current position in au filestream %p: %s\n", fs, strerror(errno));
 		return -1;
-	}
-
-	if (fseeko(fs->f, 0, SEEK_END) < 0) {
+	} else if (fseeko(fs->f, 0, SEEK_END) < 0) {
 		ast_log(AST_LOG_WARNING, "Unable to seek to end of au filestream %p: %s\n", fs, strerror(errno));
 		return -1;
-	}
-
-	if ((max = ftello(fs->f)) < 0) {
+	} else if ((max = ftello(fs->f)) < 0) {
 		ast_log(AST_LOG_WARNING, "Unable to determine max position in au filestream %p: %s\n", fs, strerror(errno));
 		return -1;
 	}
@@ -441,6 +461,9 @@ static int au_seek(struct ast_filestream *fs, off_t sample_offset, int whence)
 	/* always protect the header space. */
 	offset = (offset < min) ? min : offset;
 
+	if (fs->map) {
+		return ast_filestream_map_seek(fs, offset);
+	}
 	return fseeko(fs->f, offset, SEEK_SET);
 }
 
@@ -467,7 +490,7 @@ static int au_trunc(struct ast_filestream *fs)
 static off_t au_tell(struct ast_filestream *fs)
 {
 	struct au_desc *desc = fs->_private;
-	off_t offset = ftello(fs->f);
+	off_t offset = fs->map ? fs->map_pos : ftello(fs->f);
 	return offset - desc->hdr_size;
 }
 
@@ -501,6 +524,8 @@ static struct ast_format_def alaw_f = {
 	.open = pcma_open,
 	.rewrite = pcma_rewrite,
 	.desc_size = sizeof(struct pcm_desc),
+#else
+	.open = pcm_open,
 #endif
 };
 
@@ -508,6 +533,7 @@ static struct ast_format_def pcm_f = {
 	.name = "pcm",
 	.exts = "pcm|ulaw|ul|mu|ulw",
 	.mime_types = "audio/basic",
+	.open = pcm_open,
 	.write = pcm_write,
 	.seek = pcm_seek,
 	.trunc = pcm_trunc,
@@ -519,6 +545,7 @@ static struct ast_format_def pcm_f = {
 static struct ast_format_def g722_f = {
 	.name = "g722",
 	.exts = "g722",
+	.open = pcm_open,
 	.write = pcm_write,
 	.seek = g722_seek,
 	.trunc = pcm_trunc,
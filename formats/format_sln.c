@@ -36,6 +36,14 @@ static struct ast_frame *generic_read(struct ast_filestream *s, int *whennext, u
 {
 	size_t res;
 
+	if (s->map) {
+		if (!ast_filestream_map_read(s, buf_size)) {
+			return NULL;
+		}
+		*whennext = s->fr.samples = s->fr.datalen / 2;
+		return &s->fr;
+	}
+
 	/* Send a frame from the file to the appropriate channel */
 	AST_FRAME_SET_BUFFER(&s->fr, s->buf, AST_FRIENDLY_OFFSET, buf_size);
 	if ((res = fread(s->fr.data.ptr, 1, s->fr.datalen, s->f)) < 1) {
@@ -51,6 +59,12 @@ static struct ast_frame *generic_read(struct ast_filestream *s, int *whennext, u
 	return &s->fr;
 }
 
+static int slinear_open(struct ast_filestream *s)
+{
+	ast_filestream_map(s, -1);
+	return 0;
+}
+
 static int slinear_write(struct ast_filestream *fs, struct ast_frame *f)
 {
 	int res;
@@ -73,17 +87,16 @@ static int slinear_seek(struct ast_filestream *fs, off_t sample_offset, int when
 
 	sample_offset <<= 1;
 
-	if ((cur = ftello(fs->f)) < 0) {
+	if (fs->map) {
+		cur = fs->map_pos;
+		max = fs->map_end;
+	} else if ((cur = ftello(fs->f)) < 0) {
 		ast_log(AST_LOG_WARNING, "Unable to determine current position in sln filestream %p: %s\n", fs, strerror(errno));
 		return -1;
-	}
-
-	if (fseeko(fs->f, 0, SEEK_END) < 0) {
+	} else if (fseeko(fs->f, 0, SEEK_END) < 0) {
 		ast_log(AST_LOG_WARNING, "Unable to seek to end of sln filestream %p: %s\n", fs, strerror(errno));
 		return -1;
-	}
-
-	if ((max = ftello(fs->f)) < 0) {
+	} else if ((max = ftello(fs->f)) < 0) {
 		ast_log(AST_LOG_WARNING, "Unable to determine max position in sln filestream %p: %s\n", fs, strerror(errno));
 		return -1;
 	}
@@ -99,6 +112,9 @@ static int slinear_seek(struct ast_filestream *fs, off_t sample_offset, int when
 	}
 	/* always protect against seeking past begining. */
 	offset = (offset < min)?min:offset;
+	if (fs->map) {
+		return ast_filestream_map_seek(fs, offset);
+	}
 	return fseeko(fs->f, offset, SEEK_SET);
 }
 
@@ -121,13 +137,14 @@ static int slinear_trunc(struct ast_filestream *fs)
 
 static off_t slinear_tell(struct ast_filestream *fs)
 {
-	return ftello(fs->f) / 2;
+	return (fs->map ? fs->map_pos : ftello(fs->f)) / 2;
 }
 
 static struct ast_frame *slinear_read(struct ast_filestream *s, int *whennext){return generic_read(s, whennext, 320);}
 static struct ast_format_def slin_f = {
 	.name = "sln",
 	.exts = "sln|raw",
+	.open = slinear_open,
 	.write = slinear_write,
 	.seek = slinear_seek,
 	.trunc = slinear_trunc,
@@ -140,6 +157,7 @@ static struct ast_frame *slinear12_read(struct ast_filestream *s, int *whennext)
 static struct ast_format_def slin12_f = {
 	.name = "sln12",
 	.exts = "sln12",
+	.open = slinear_open,
 	.write = slinear_write,
 	.seek = slinear_seek,
 	.trunc = slinear_trunc,
@@ -152,6 +170,7 @@ static struct ast_frame *slinear16_read(struct ast_filestream *s, int *whennext)
 static struct ast_format_def slin16_f = {
 	.name = "sln16",
 	.exts = "sln16",
+	.open = slinear_open,
 	.write = slinear_write,
 	.seek = slinear_seek,
 	.trunc = slinear_trunc,
@@ -164,6 +183,7 @@ static struct ast_frame *slinear24_read(struct ast_filestream *s, int *whennext)
 static struct ast_format_def slin24_f = {
 	.name = "sln24",
 	.exts = "sln24",
+	.open = slinear_open,
 	.write = slinear_write,
 	.seek = slinear_seek,
 	.trunc = slinear_trunc,
@@ -176,6 +196,7 @@ static struct ast_frame *slinear32_read(struct ast_filestream *s, int *whennext)
 static struct ast_format_def slin32_f = {
 	.name = "sln32",
 	.exts = "sln32",
+	.open = slinear_open,
 	.write = slinear_write,
 	.seek = slinear_seek,
 	.trunc = slinear_trunc,
@@ -188,6 +209,7 @@ static struct ast_frame *slinear44_read(struct ast_filestream *s, int *whennext)
 static struct ast_format_def slin44_f = {
 	.name = "sln44",
 	.exts = "sln44",
+	.open = slinear_open,
 	.write = slinear_write,
 	.seek = slinear_seek,
 	.trunc = slinear_trunc,
@@ -200,6 +222,7 @@ static struct ast_frame *slinear48_read(struct ast_filestream *s, int *whennext)
 static struct ast_format_def slin48_f = {
 	.name = "sln48",
 	.exts = "sln48",
+	.open = slinear_open,
 	.write = slinear_write,
 	.seek = slinear_seek,
 	.trunc = slinear_trunc,
@@ -212,6 +235,7 @@ static struct ast_frame *slinear96_read(struct ast_filestream *s, int *whennext)
 static struct ast_format_def slin96_f = {
 	.name = "sln96",
 	.exts = "sln96",
+	.open = slinear_open,
 	.write = slinear_write,
 	.seek = slinear_seek,
 	.trunc = slinear_trunc,
@@ -224,6 +248,7 @@ static struct ast_frame *slinear192_read(struct ast_filestream *s, int *whennext
 static struct ast_format_def slin192_f = {
 	.name = "sln192",
 	.exts = "sln192",
+	.open = slinear_open,
 	.write = slinear_write,
 	.seek = slinear_seek,
 	.trunc = slinear_trunc,
@@ -330,6 +330,10 @@ static int wav_open(struct ast_filestream *s)
 	}
 
 	tmp->hz = sample_rate;
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+	/* The samples need no swapping so frames can point into the file */
+	ast_filestream_map(s, tmp->maxlen);
+#endif
 	return 0;
 }
 
@@ -382,6 +386,14 @@ static struct ast_frame *wav_read(struct ast_filestream *s, int *whennext)
 
 	bytes = (fs->hz == 16000 ? (WAV_BUF_SIZE * 2) : WAV_BUF_SIZE);
 
+	if (s->map) {
+		if (!ast_filestream_map_read(s, bytes)) {
+			return NULL;
+		}
+		*whennext = s->fr.samples = s->fr.datalen / 2;
+		return &s->fr;
+	}
+
 	here = ftello(s->f);
 	if (fs->maxlen - here < bytes)		/* truncate if necessary */
 		bytes = fs->maxlen - here;
@@ -456,17 +468,16 @@ static int wav_seek(struct ast_filestream *fs, off_t sample_offset, int whence)
 
 	samples = sample_offset * 2; /* SLINEAR is 16 bits mono, so sample_offset * 2 = bytes */
 
-	if ((cur = ftello(fs->f)) < 0) {
+	if (fs->map) {
+		cur = fs->map_pos;
+		max = fs->map_end;
+	} else if ((cur = ftello(fs->f)) < 0) {
 		ast_log(AST_LOG_WARNING, "Unable to determine current position in wav filestream %p: %s\n", fs, strerror(errno));
 		return -1;
-	}
-
-	if (fseeko(fs->f, 0, SEEK_END) < 0) {
+	} else if (fseeko(fs->f, 0, SEEK_END) < 0) {
 		ast_log(AST_LOG_WARNING, "Unable to seek to end of wav filestream %p: %s\n", fs, strerror(errno));
 		return -1;
-	}
-
-	if ((max = ftello(fs->f)) < 0) {
+	} else if ((max = ftello(fs->f)) < 0) {
 		ast_log(AST_LOG_WARNING, "Unable to determine max position in wav filestream %p: %s\n", fs, strerror(errno));
 		return -1;
 	}
@@ -483,6 +494,9 @@ static int wav_seek(struct ast_filestream *fs, off_t sample_offset, int whence)
 	}
 	/* always protect the header space. */
 	offset = (offset < min)?min:offset;
+	if (fs->map) {
+		return ast_filestream_map_seek(fs, offset);
+	}
 	return fseeko(fs->f, offset, SEEK_SET);
 }
 
@@ -509,7 +523,7 @@ static int wav_trunc(struct ast_filestream *fs)
 static off_t wav_tell(struct ast_filestream *fs)
 {
 	off_t offset;
-	offset = ftello(fs->f);
+	offset = fs->map ? fs->map_pos : ftello(fs->f);
 	/* subtract header size to get samples, then divide by 2 for 16 bit samples */
 	return (offset - 44)/2;
 }
@@ -150,6 +150,7 @@ static int set_hold_intercept(struct ast_channel *chan)
 		.event_cb = hold_intercept_framehook,
 		.consume_cb = hold_intercept_framehook_consume,
 		.disable_inheritance = 1,
+		.frame_types = AST_FRAMEHOOK_FRAME_TYPE(AST_FRAME_CONTROL),
 	};
 	SCOPED_CHANNELLOCK(chan_lock, chan);
 
@@ -120,9 +120,34 @@ struct acf_odbc_query {
 	char *sql_insert;
 	unsigned int flags;
 	int rowlimit;
+	int cache_ttl;			/*!< Seconds a single row read result is cached, 0 to not cache */
+	int negative_cache_ttl;		/*!< Seconds a read that found no rows is cached */
 	struct ast_custom_function *acf;
 };
 
+/*!
+ * \brief A cached result of a single row read
+ *
+ * While the query runs the entry is pending, and readers of the same
+ * query wait for its result instead of running it again.
+ */
+struct read_cache_entry {
+	struct timeval expires;		/*!< When the result may no longer be used */
+	unsigned int pending:1;		/*!< The query is being run */
+	unsigned int nodata:1;		/*!< The query found no rows */
+	char *value;			/*!< The row, as returned by the function */
+	char *colnames;			/*!< The column names of the row */
+	char key[0];			/*!< The function name and the SQL that was run */
+};
+
+#define READ_CACHE_BUCKETS 563
+
+/*! \brief Read results by function name and SQL, protected by read_cache_lock */
+static struct ao2_container *read_cache;
+AST_MUTEX_DEFINE_STATIC(read_cache_lock);
+/*! \brief Signalled when a pending entry gets its result */
+static ast_cond_t read_cache_cond;
+
 static void odbc_datastore_free(void *data);
 
 static const struct ast_datastore_info odbc_info = {
@@ -710,6 +735,167 @@ static int acf_odbc_write(struct ast_channel *chan, const char *cmd, char *s, co
 	return 0;
 }
 
+static int read_cache_hash_fn(const void *obj, const int flags)
+{
+	const struct read_cache_entry *entry;
+	const char *key;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		key = obj;
+		break;
+	case OBJ_SEARCH_OBJECT:
+		entry = obj;
+		key = entry->key;
+		break;
+	default:
+		ast_assert(0);
+		return 0;
+	}
+	return ast_str_hash(key);
+}
+
+static int read_cache_cmp_fn(void *obj, void *arg, int flags)
+{
+	const struct read_cache_entry *left = obj;
+	const struct read_cache_entry *right = arg;
+	const char *right_key = arg;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_OBJECT:
+		right_key = right->key;
+		/* Fall through */
+	case OBJ_SEARCH_KEY:
+		return strcmp(left->key, right_key) ? 0 : CMP_MATCH;
+	default:
+		return 0;
+	}
+}
+
+/*! \brief Matches the entries that have a result, pending ones are finished by their reader */
+static int read_cache_unlink_done_cb(void *obj, void *arg, int flags)
+{
+	struct read_cache_entry *entry = obj;
+
+	return entry->pending ? 0 : CMP_MATCH;
+}
+
+static void read_cache_entry_destructor(void *obj)
+{
+	struct read_cache_entry *entry = obj;
+
+	ast_free(entry->value);
+	ast_free(entry->colnames);
+}
+
+static int read_cache_expired_cb(void *obj, void *arg, int flags)
+{
+	struct read_cache_entry *entry = obj;
+	struct timeval *now = arg;
+
+	return !entry->pending && ast_tvcmp(entry->expires, *now) <= 0 ? CMP_MATCH : 0;
+}
+
+/*!
+ * \internal
+ * \brief Look up a read in the cache or claim it
+ *
+ * \param key The function name and SQL of the read
+ * \param[out] claim Set to the pending entry when the caller has to run the query
+ *
+ * \return The cached entry, which no longer changes
+ * \retval NULL if the caller has to run the query, or on allocation failure
+ *
+ * \note If a query with the same key is running, waits for its result.
+ */
+static struct read_cache_entry *read_cache_get(const char *key, struct read_cache_entry **claim)
+{
+	static unsigned int lookups;
+	struct read_cache_entry *entry;
+	struct timeval now;
+
+	*claim = NULL;
+
+	ast_mutex_lock(&read_cache_lock);
+	for (;;) {
+		now = ast_tvnow();
+		entry = ao2_find(read_cache, key, OBJ_SEARCH_KEY);
+		if (!entry) {
+			break;
+		}
+		if (entry->pending) {
+			/* Somebody is running this query right now, use its result */
+			ao2_ref(entry, -1);
+			ast_cond_wait(&read_cache_cond, &read_cache_lock);
+			continue;
+		}
+		if (ast_tvcmp(entry->expires, now) > 0) {
+			ast_mutex_unlock(&read_cache_lock);
+			return entry;
+		}
+		ao2_unlink(read_cache, entry);
+		ao2_ref(entry, -1);
+		break;
+	}
+
+	/* Now and then drop everything that has expired */
+	if (!(++lookups % 1024)) {
+		ao2_callback(read_cache, OBJ_NODATA | OBJ_MULTIPLE | OBJ_UNLINK,
+			read_cache_expired_cb, &now);
+	}
+
+	entry = ao2_alloc_options(sizeof(*entry) + strlen(key) + 1,
+		read_cache_entry_destructor, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (entry) {
+		strcpy(entry->key, key); /* SAFE */
+		entry->pending = 1;
+		ao2_link(read_cache, entry);
+		*claim = entry;
+	}
+	ast_mutex_unlock(&read_cache_lock);
+
+	return NULL;
+}
+
+/*!
+ * \internal
+ * \brief Store the result of a claimed read and wake up the readers waiting for it
+ *
+ * \param claim The claimed entry, set to NULL on return
+ * \param ttl Seconds to keep the result, 0 or less to not keep it
+ * \param nodata Set if the query found no rows
+ * \param value The row, NULL if the query failed
+ * \param colnames The column names of the row
+ */
+static void read_cache_finish(struct read_cache_entry **claim, int ttl, int nodata,
+	const char *value, const char *colnames)
+{
+	struct read_cache_entry *entry = *claim;
+
+	if (!entry) {
+		return;
+	}
+	*claim = NULL;
+
+	ast_mutex_lock(&read_cache_lock);
+	if (ttl > 0 && value) {
+		entry->value = ast_strdup(value);
+		entry->colnames = ast_strdup(S_OR(colnames, ""));
+	}
+	if (entry->value && entry->colnames) {
+		entry->nodata = nodata;
+		entry->expires = ast_tvadd(ast_tvnow(), ast_tv(ttl, 0));
+		entry->pending = 0;
+	} else {
+		/* Not kept, the waiting readers run the query themselves */
+		ao2_unlink(read_cache, entry);
+	}
+	ast_cond_broadcast(&read_cache_cond);
+	ast_mutex_unlock(&read_cache_lock);
+
+	ao2_ref(entry, -1);
+}
+
 static int acf_odbc_read(struct ast_channel *chan, const char *cmd, char *s, char *buf, size_t len)
 {
 	struct odbc_obj *obj = NULL;
@@ -729,6 +915,8 @@ static int acf_odbc_read(struct ast_channel *chan, const char *cmd, char *s, cha
 	struct ast_str *sql = ast_str_thread_get(&sql_buf, 16);
 	const char *status = "FAILURE";
 	struct dsn *dsn = NULL;
+	struct read_cache_entry *cached = NULL;
+	int cache_ttl, negative_cache_ttl;
 
 	if (!sql || !colnames) {
 		if (chan) {
@@ -788,6 +976,8 @@ static int acf_odbc_read(struct ast_channel *chan, const char *cmd, char *s, cha
 
 	/* Save these flags, so we can release the lock */
 	escapecommas = ast_test_flag(query, OPT_ESCAPECOMMAS);
+	cache_ttl = query->cache_ttl;
+	negative_cache_ttl = query->negative_cache_ttl;
 	if (!bogus_chan && ast_test_flag(query, OPT_MULTIROW)) {
 		if (!(resultset = ast_calloc(1, sizeof(*resultset)))) {
 			pbx_builtin_setvar_helper(chan, "ODBCROWS", rowcount);
@@ -818,6 +1008,28 @@ static int acf_odbc_read(struct ast_channel *chan, const char *cmd, char *s, cha
 	}
 	AST_RWLIST_UNLOCK(&queries);
 
+	/* Only results that are returned whole, as a single row, are cached */
+	if ((cache_ttl > 0 || negative_cache_ttl > 0) && !resultset) {
+		char *key = ast_alloca(strlen(cmd) + ast_str_strlen(sql) + 2);
+		struct read_cache_entry *entry;
+
+		sprintf(key, "%s %s", cmd, ast_str_buffer(sql)); /* SAFE */
+		if ((entry = read_cache_get(key, &cached))) {
+			ast_debug(2, "Using cached result for %s [%s]\n", cmd, ast_str_buffer(sql));
+			ast_copy_string(buf, entry->value, len);
+			if (!bogus_chan) {
+				pbx_builtin_setvar_helper(chan, "ODBCROWS", entry->nodata ? "0" : "1");
+				pbx_builtin_setvar_helper(chan, "ODBCSTATUS", entry->nodata ? "NODATA" : "SUCCESS");
+				if (!entry->nodata) {
+					pbx_builtin_setvar_helper(chan, "~ODBCFIELDS~", entry->colnames);
+				}
+				ast_autoservice_stop(chan);
+			}
+			ao2_ref(entry, -1);
+			return 0;
+		}
+	}
+
 	for (dsn_num = 0; dsn_num < 5; dsn_num++) {
 		if (!ast_strlen_zero(query->readhandle[dsn_num])) {
 			obj = get_odbc_obj(query->readhandle[dsn_num], &dsn);
@@ -834,6 +1046,7 @@ static int acf_odbc_read(struct ast_channel *chan, const char *cmd, char *s, cha
 
 	if (!stmt) {
 		ast_log(LOG_ERROR, "Unable to execute query [%s]\n", ast_str_buffer(sql));
+		read_cache_finish(&cached, 0, 0, NULL, NULL);
 		release_obj_or_dsn (&obj, &dsn);
 		if (!bogus_chan) {
 			pbx_builtin_setvar_helper(chan, "ODBCROWS", rowcount);
@@ -846,6 +1059,7 @@ static int acf_odbc_read(struct ast_channel *chan, const char *cmd, char *s, cha
 	res = SQLNumResultCols(stmt, &colcount);
 	if ((res != SQL_SUCCESS) && (res != SQL_SUCCESS_WITH_INFO)) {
 		ast_log(LOG_WARNING, "SQL Column Count error!\n[%s]\n\n", ast_str_buffer(sql));
+		read_cache_finish(&cached, 0, 0, NULL, NULL);
 		SQLCloseCursor(stmt);
 		SQLFreeHandle (SQL_HANDLE_STMT, stmt);
 		release_obj_or_dsn (&obj, &dsn);
@@ -860,6 +1074,7 @@ static int acf_odbc_read(struct ast_channel *chan, const char *cmd, char *s, cha
 	if (colcount <= 0) {
 		ast_verb(4, "Returned %d columns [%s]\n", colcount, ast_str_buffer(sql));
 		buf[0] = '\0';
+		read_cache_finish(&cached, negative_cache_ttl, 1, "", NULL);
 		SQLCloseCursor(stmt);
 		SQLFreeHandle (SQL_HANDLE_STMT, stmt);
 		release_obj_or_dsn (&obj, &dsn);
@@ -885,6 +1100,7 @@ static int acf_odbc_read(struct ast_channel *chan, const char *cmd, char *s, cha
 			ast_log(LOG_WARNING, "Error %d in FETCH [%s]\n", res, ast_str_buffer(sql));
 			status = "FETCHERROR";
 		}
+		read_cache_finish(&cached, negative_cache_ttl, 1, res1 ? NULL : "", NULL);
 		SQLCloseCursor(stmt);
 		SQLFreeHandle(SQL_HANDLE_STMT, stmt);
 		release_obj_or_dsn (&obj, &dsn);
@@ -907,6 +1123,7 @@ static int acf_odbc_read(struct ast_channel *chan, const char *cmd, char *s, cha
 			char *ptrcoldata;
 
 			if (!coldata) {
+				read_cache_finish(&cached, 0, 0, NULL, NULL);
 				odbc_datastore_free(resultset);
 				SQLCloseCursor(stmt);
 				SQLFreeHandle(SQL_HANDLE_STMT, stmt);
@@ -1022,6 +1239,7 @@ static int acf_odbc_read(struct ast_channel *chan, const char *cmd, char *s, cha
 	}
 
 end_acf_read:
+	read_cache_finish(&cached, cache_ttl, 0, y == 1 ? buf : NULL, ast_str_buffer(colnames));
 	if (!bogus_chan) {
 		snprintf(rowcount, sizeof(rowcount), "%d", y);
 		pbx_builtin_setvar_helper(chan, "ODBCROWS", rowcount);
@@ -1288,6 +1506,19 @@ static int init_acf_query(struct ast_config *cfg, char *catg, struct acf_odbc_qu
 			sscanf(tmp, "%30d", &((*query)->rowlimit));
 	}
 
+	if ((tmp = ast_variable_retrieve(cfg, catg, "cache_ttl"))) {
+		if (sscanf(tmp, "%30d", &((*query)->cache_ttl)) != 1 || (*query)->cache_ttl < 0) {
+			ast_log(LOG_WARNING, "cache_ttl must be a non-negative integer in %s\n", catg);
+			(*query)->cache_ttl = 0;
+		}
+	}
+	if ((tmp = ast_variable_retrieve(cfg, catg, "negative_cache_ttl"))) {
+		if (sscanf(tmp, "%30d", &((*query)->negative_cache_ttl)) != 1 || (*query)->negative_cache_ttl < 0) {
+			ast_log(LOG_WARNING, "negative_cache_ttl must be a non-negative integer in %s\n", catg);
+			(*query)->negative_cache_ttl = 0;
+		}
+	}
+
 	(*query)->acf = ast_calloc(1, sizeof(struct ast_custom_function));
 	if (!(*query)->acf) {
 		free_acf_query(*query);
@@ -1774,6 +2005,13 @@ static int load_module(void)
 	const char *s;
 	struct ast_flags config_flags = { 0 };
 
+	read_cache = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_NOLOCK, 0, READ_CACHE_BUCKETS,
+		read_cache_hash_fn, NULL, read_cache_cmp_fn);
+	if (!read_cache) {
+		return AST_MODULE_LOAD_DECLINE;
+	}
+	ast_cond_init(&read_cache_cond, NULL);
+
 	res |= ast_custom_function_register(&fetch_function);
 	res |= ast_register_application_xml(app_odbcfinish, exec_odbcfinish);
 
@@ -1862,6 +2100,10 @@ static int unload_module(void)
 	if (dsns) {
 		ao2_ref(dsns, -1);
 	}
+
+	ao2_cleanup(read_cache);
+	read_cache = NULL;
+	ast_cond_destroy(&read_cache_cond);
 	return res;
 }
 
@@ -1904,6 +2146,11 @@ static int reload(void)
 
 	AST_RWLIST_WRLOCK(&queries);
 
+	/* The queries may have changed, forget their results */
+	ast_mutex_lock(&read_cache_lock);
+	ao2_callback(read_cache, OBJ_NODATA | OBJ_MULTIPLE | OBJ_UNLINK, read_cache_unlink_done_cb, NULL);
+	ast_mutex_unlock(&read_cache_lock);
+
 	while (!AST_RWLIST_EMPTY(&queries)) {
 		oldquery = AST_RWLIST_REMOVE_HEAD(&queries, list);
 		ast_custom_function_unregister(oldquery->acf);
@@ -47,6 +47,11 @@ int ast_named_locks_init(void);		/*!< Provided by named_locks.c */
 int ast_file_init(void);		/*!< Provided by file.c */
 void ast_autoservice_init(void);	/*!< Provided by autoservice.c */
 int ast_tps_init(void); 		/*!< Provided by taskprocessor.c */
+int ast_frame_init(void);		/*!< Provided by frame.c */
+int ast_slinear_simd_init(void);	/*!< Provided by slinear_simd.c */
+int ast_g711_simd_init(void);		/*!< Provided by g711_simd.c */
+int ast_goertzel_simd_init(void);	/*!< Provided by dsp_simd.c */
+int ast_media_trace_init(void);		/*!< Provided by media_trace.c */
 int ast_timing_init(void);		/*!< Provided by timing.c */
 void ast_stun_init(void);               /*!< Provided by stun.c */
 int ast_ssl_init(void);                 /*!< Provided by ssl.c */
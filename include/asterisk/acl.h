@@ -56,6 +56,19 @@ struct ast_ha {
 	struct ast_ha *next;
 };
 
+/*!
+ * \brief A list of host access rules compiled into a trie of networks
+ *
+ * \details
+ * Applying an ast_ha_trie gives the same result as applying the ast_ha
+ * list it was compiled from, in time proportional to the address length
+ * rather than the number of rules. It is an immutable ao2 object which
+ * can be shared freely.
+ *
+ * \since 17.0.0
+ */
+struct ast_ha_trie;
+
 #define ACL_NAME_LENGTH 80
 
 /*!
@@ -69,6 +82,7 @@ struct ast_acl {
 	int is_realtime;                /*!< If raised, this named ACL was retrieved from realtime storage */
 	int is_invalid;                 /*!< If raised, this is an invalid ACL which will automatically reject everything. */
 	char name[ACL_NAME_LENGTH];     /*!< If this was retrieved from the named ACL subsystem, this is the name of the ACL. */
+	struct ast_ha_trie *trie;       /*!< Compiled form of the rules, built when first applied if not supplied by the named ACL */
 	AST_LIST_ENTRY(ast_acl) list;
 };
 
@@ -194,6 +208,37 @@ int ast_acl_list_is_empty(struct ast_acl_list *acl_list);
  */
 enum ast_acl_sense ast_apply_ha(const struct ast_ha *ha, const struct ast_sockaddr *addr);
 
+/*!
+ * \brief Compile a list of host access rules
+ *
+ * \param ha The head of the list of host access rules, which may be NULL
+ *
+ * \note The trie does not refer to the list, which may be changed or freed
+ * afterwards. Release the trie with ao2_cleanup.
+ *
+ * \retval NULL on allocation failure
+ * \return The compiled rules
+ *
+ * \since 17.0.0
+ */
+struct ast_ha_trie *ast_ha_trie_alloc(const struct ast_ha *ha);
+
+/*!
+ * \brief Apply a compiled set of rules to a given IP address
+ *
+ * \details
+ * This returns what ast_apply_ha would for the list of rules the trie was
+ * compiled from, so the last rule matching the address decides.
+ *
+ * \param trie The compiled host access rules
+ * \param addr An ast_sockaddr whose address is considered when matching rules
+ * \retval AST_SENSE_ALLOW The IP address passes our ACL
+ * \retval AST_SENSE_DENY The IP address fails our ACL
+ *
+ * \since 17.0.0
+ */
+enum ast_acl_sense ast_apply_ha_trie(const struct ast_ha_trie *trie, const struct ast_sockaddr *addr);
+
 /*!
  * \brief Apply a set of rules to a given IP address
  *
@@ -381,6 +426,27 @@ const char *ast_tos2str(unsigned int tos);
  */
 struct ast_ha *ast_named_acl_find(const char *name, int *is_realtime, int *is_undefined);
 
+/*!
+ * \brief Retrieve a named ACL along with its compiled rules
+ *
+ * \details
+ * This works like ast_named_acl_find, but also hands back the rules of
+ * the named ACL compiled when its configuration was loaded.
+ *
+ * \param name Name of the ACL sought
+ * \param[out] trie Receives a reference to the compiled rules, or NULL
+ *        if they are not available, such as for realtime ACLs
+ * \param[out] is_realtime will be true if the ACL being returned is from realtime
+ * \param[out] is_undefined will be true if no ACL profile can be found for the requested name
+ *
+ * \retval A copy of the named ACL as an ast_ha
+ * \retval NULL if no ACL could be found.
+ *
+ * \since 17.0.0
+ */
+struct ast_ha *ast_named_acl_find_compiled(const char *name, struct ast_ha_trie **trie,
+	int *is_realtime, int *is_undefined);
+
 /*!
  * \brief a \ref stasis_message_type for changes against a named ACL or the set of all named ACLs
  * \since 12
@@ -83,4 +83,30 @@ static inline unsigned char AST_LIN2A(short sample)
 
 #define AST_ALAW(a) (__ast_alaw[(int)(a)])
 
+/*!
+ * \brief Convert an array of A-law samples to signed linear
+ * \since 17.0.0
+ *
+ * The result is the same as calling AST_ALAW() on each sample, but AVX2
+ * is used when the CPU supports it.
+ *
+ * \param dst Receives the signed linear samples
+ * \param src A-law samples
+ * \param samples Number of samples to convert
+ */
+void ast_alaw_decode_array(short *dst, const unsigned char *src, size_t samples);
+
+/*!
+ * \brief Convert an array of signed linear samples to A-law
+ * \since 17.0.0
+ *
+ * The result is the same as calling AST_LIN2A() on each sample, but AVX2
+ * is used when the CPU supports it.
+ *
+ * \param dst Receives the A-law samples
+ * \param src Signed linear samples
+ * \param samples Number of samples to convert
+ */
+void ast_alaw_encode_array(unsigned char *dst, const short *src, size_t samples);
+
 #endif /* _ASTERISK_ALAW_H */
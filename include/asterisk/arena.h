@@ -0,0 +1,137 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2019, Sangoma Technologies Corporation
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*! \file
+ * \brief Arena (bump) allocator for short lived allocations
+ *
+ * An arena hands out memory by advancing a pointer through large chunks
+ * and frees everything allocated after a given point in one go.  This
+ * suits code that makes many small temporary allocations while handling
+ * a single request and then throws them all away.
+ *
+ * Each thread has a reusable arena available through
+ * ast_arena_thread_get().  Since other code running on the same thread
+ * may use it too, users must bracket their allocations with
+ * ast_arena_mark() and ast_arena_release() rather than resetting it:
+ *
+ * \code
+ * struct ast_arena *arena = ast_arena_thread_get();
+ * struct ast_arena_mark mark;
+ *
+ * ast_arena_mark(arena, &mark);
+ * copy = ast_arena_strdup(arena, header);
+ * ...
+ * ast_arena_release(arena, &mark);
+ * \endcode
+ *
+ * \note Memory from an arena must never be passed to ast_free().
+ *
+ * \since 17.0.0
+ */
+
+#ifndef _ASTERISK_ARENA_H
+#define _ASTERISK_ARENA_H
+
+struct ast_arena;
+
+/*!
+ * \brief A position in an arena that can later be released back to
+ *
+ * \note The contents are private to the arena implementation.
+ */
+struct ast_arena_mark {
+	void *chunk;
+	size_t used;
+};
+
+/*!
+ * \brief Create an arena
+ * \since 17.0.0
+ *
+ * \param chunk_size Size of the chunks the arena carves allocations from,
+ *        or 0 for a default.  Larger allocations get a chunk of their own.
+ *
+ * \retval NULL on error
+ * \retval non-NULL the new arena, free with ast_arena_destroy()
+ */
+struct ast_arena *ast_arena_create(size_t chunk_size);
+
+/*!
+ * \brief Destroy an arena and all memory allocated from it
+ * \since 17.0.0
+ *
+ * \param arena The arena (may be NULL)
+ */
+void ast_arena_destroy(struct ast_arena *arena);
+
+/*!
+ * \brief Get the calling thread's arena
+ * \since 17.0.0
+ *
+ * The arena is created on first use and destroyed when the thread exits.
+ *
+ * \retval NULL on allocation failure
+ * \retval non-NULL the thread's arena
+ */
+struct ast_arena *ast_arena_thread_get(void);
+
+/*!
+ * \brief Record the current position of an arena
+ * \since 17.0.0
+ *
+ * \param arena The arena
+ * \param[out] mark Where to store the position
+ */
+void ast_arena_mark(struct ast_arena *arena, struct ast_arena_mark *mark);
+
+/*!
+ * \brief Free everything allocated from an arena since a mark was taken
+ * \since 17.0.0
+ *
+ * Marks must be released in the reverse order they were taken.
+ *
+ * \param arena The arena
+ * \param mark Position previously filled in by ast_arena_mark()
+ */
+void ast_arena_release(struct ast_arena *arena, const struct ast_arena_mark *mark);
+
+/*!
+ * \brief Allocate memory from an arena
+ * \since 17.0.0
+ *
+ * The memory is suitably aligned for any type and is not initialized.
+ *
+ * \param arena The arena
+ * \param size Number of bytes to allocate
+ *
+ * \retval NULL on allocation failure
+ * \retval non-NULL the memory
+ */
+void *ast_arena_alloc(struct ast_arena *arena, size_t size);
+
+/*!
+ * \brief Duplicate a string into an arena
+ * \since 17.0.0
+ *
+ * \param arena The arena
+ * \param str String to copy
+ *
+ * \retval NULL on allocation failure or if \a str is NULL
+ * \retval non-NULL the copy
+ */
+char *ast_arena_strdup(struct ast_arena *arena, const char *str);
+
+#endif /* _ASTERISK_ARENA_H */
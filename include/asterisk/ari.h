@@ -91,6 +91,8 @@ struct stasis_rest_handlers {
 struct ast_ari_response {
 	/*! Response message */
 	struct ast_json *message;
+	/*! Response body already encoded as JSON, sent when there is no \ref message */
+	struct ast_str *encoded;
 	/*! \r\n seperated response headers */
 	struct ast_str *headers;
 	/*! HTTP response code.
@@ -173,6 +175,9 @@ struct ast_ari_websocket_session *ast_ari_websocket_session_create(
 /*!
  * \brief Read a message from an ARI WebSocket.
  *
+ * \c RESTRequest messages are handled and answered with a \c RESTResponse
+ * message without being returned.
+ *
  * \param session Session to read from.
  * \return Message received.
  * \return \c NULL if WebSocket could not be read.
@@ -242,6 +247,20 @@ __attribute__((format(printf, 4, 5)));
 void ast_ari_response_ok(struct ast_ari_response *response,
 			     struct ast_json *message);
 
+/*!
+ * \brief Fill in an \c OK (200) \a ast_ari_response with an encoded body.
+ * \since 17.0.0
+ *
+ * For large list responses built with an \ref ast_json_array_encoder.
+ * Fills in an allocation failure if \a encoded is \c NULL.
+ *
+ * \param response Response to fill in.
+ * \param encoded JSON text of the response, as encoded with
+ *                \ref ast_ari_json_format(). Ownership is taken.
+ */
+void ast_ari_response_ok_encoded(struct ast_ari_response *response,
+	struct ast_str *encoded);
+
 /*!
  * \brief Fill in a <tt>No Content</tt> (204) \a ast_ari_response.
  */
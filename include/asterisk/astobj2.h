@@ -376,6 +376,19 @@ enum ao2_alloc_opts {
 	 * should never be passed directly to ao2_alloc.
 	 */
 	AO2_ALLOC_OPT_LOCK_OBJ = AO2_ALLOC_OPT_LOCK_MASK,
+	/*!
+	 * \brief The ao2 object may count its references per CPU.
+	 * \since 17.0.0
+	 *
+	 * \details Between ao2_ref_shard() and ao2_ref_unshard() the
+	 * references of the object are counted on a counter of the CPU
+	 * the thread runs on instead of one shared counter.  Meant for
+	 * immutable objects referenced from every thread, such as
+	 * cached formats and global configuration snapshots.
+	 *
+	 * \note The object cannot have a weakproxy.
+	 */
+	AO2_ALLOC_OPT_REF_SHARDED = (1 << 2),
 };
 
 /*!
@@ -518,6 +531,39 @@ int __ao2_ref(void *o, int delta, const char *tag, const char *file, int line, c
 #define ao2_replace(dst, src) \
 	ao2_t_replace((dst), (src), "")
 
+/*!
+ * \brief Start counting the references of a published object per CPU.
+ * \since 17.0.0
+ *
+ * \param obj Object allocated with AO2_ALLOC_OPT_REF_SHARDED.
+ *
+ * \details Once sharded ao2_ref() changes a counter of the CPU
+ * the thread runs on, so threads referencing the object no longer
+ * contend for one cache line.  Calls nest.
+ *
+ * \note The caller must keep a reference until the matching
+ * ao2_ref_unshard().  The object cannot be destroyed while it is
+ * sharded as the total count is not known.
+ *
+ * \note ao2_ref() of a sharded object returns an estimate of the
+ * count.
+ *
+ * \note Objects allocated without AO2_ALLOC_OPT_REF_SHARDED are
+ * left alone.
+ */
+void ao2_ref_shard(void *obj);
+
+/*!
+ * \brief Stop counting the references of an object per CPU.
+ * \since 17.0.0
+ *
+ * \param obj Object passed to ao2_ref_shard().
+ *
+ * \details The last unshard waits for threads still changing a
+ * CPU counter and folds the counters back into the object.
+ */
+void ao2_ref_unshard(void *obj);
+
 /*! @} */
 
 /*! \brief ao2_weakproxy
@@ -1214,6 +1260,45 @@ enum ao2_container_opts {
 	 * ao2_sort_fn.
 	 */
 	AO2_CONTAINER_ALLOC_OPT_DUPS_REPLACE = (3 << 1),
+	/*!
+	 * \brief Grow the number of hash buckets with the number of objects.
+	 * \since 17.0.0
+	 *
+	 * \details The bucket count given at allocation is where the
+	 * container starts.  Buckets are split one at a time as objects
+	 * are linked, so no single link rehashes the whole container.
+	 * Iterators see every object linked for their whole life exactly
+	 * once, as with a fixed size container.
+	 *
+	 * \note Only hash containers with a hash function resize.  The
+	 * option is ignored otherwise.
+	 *
+	 * \note Traversals that are not restricted to one bucket visit
+	 * the buckets in an order other than bucket number.
+	 */
+	AO2_CONTAINER_ALLOC_OPT_HASH_RESIZE = (1 << 3),
+	/*!
+	 * \brief Let lookups skip the container lock.
+	 * \since 17.0.0
+	 *
+	 * \details The container keeps a copy of its contents that
+	 * ao2_find() with OBJ_SEARCH_OBJECT or OBJ_SEARCH_KEY reads
+	 * without locking.  The copy is thrown away by any link or
+	 * unlink and rebuilt by the next lookup, so this is only a win
+	 * for containers that are searched far more often than they
+	 * are changed.
+	 *
+	 * \note Only hash containers with a hash function and a lock
+	 * have a lookup copy.  The option is ignored otherwise.
+	 *
+	 * \note Lookups that unlink, return multiple objects, or search
+	 * in descending order always lock the container.
+	 *
+	 * \note Objects unlinked from the container may be released a
+	 * little later than with other containers, once no lookup could
+	 * still be using the copy that held them.
+	 */
+	AO2_CONTAINER_ALLOC_OPT_READ_MOSTLY = (1 << 4),
 };
 
 /*!
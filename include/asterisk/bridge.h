@@ -289,6 +289,20 @@ struct ast_bridge_softmix {
 	 * for itself.
 	 */
 	unsigned int internal_mixing_interval;
+	/*!
+	 * \brief The most threads softmix may use to produce the
+	 * participants' audio each mixing interval.
+	 *
+	 * \note 0 or 1 keeps all of the work on the mixing thread.
+	 */
+	unsigned int mixing_threads;
+	/*!
+	 * \brief Quality of the resamplers softmix sets up for the
+	 * participants, from 1 (cheapest) to 10 (best).
+	 *
+	 * \note 0 leaves the translators at their default quality.
+	 */
+	unsigned int resample_quality;
 	/*! TRUE if binaural convolve is activated in configuration. */
 	unsigned int binaural_active;
 	/*!
@@ -374,6 +388,11 @@ struct ast_bridge {
 	 * \note Temporary as in try again in a moment.
 	 */
 	unsigned int inhibit_merge;
+	/*!
+	 * \brief Count of batched join/leave operations in progress on the bridge.
+	 * Zero if each join and leave is completed as it happens.
+	 */
+	unsigned int batching;
 	/*! Cause code of the dissolved bridge. */
 	int cause;
 	/*! TRUE if the bridge was reconfigured. */
@@ -382,6 +401,8 @@ struct ast_bridge {
 	unsigned int dissolved:1;
 	/*! TRUE if the bridge construction was completed. */
 	unsigned int construction_completed:1;
+	/*! TRUE if a bridge state publication was deferred by a batch. */
+	unsigned int batch_state_stale:1;
 
 	AST_DECLARE_STRING_FIELDS(
 		/*! Immutable name of the creator for the bridge */
@@ -957,6 +978,30 @@ void ast_bridge_set_internal_sample_rate(struct ast_bridge *bridge, unsigned int
  */
 void ast_bridge_set_mixing_interval(struct ast_bridge *bridge, unsigned int mixing_interval);
 
+/*!
+ * \brief Set the number of threads that may produce the participants'
+ * audio of a bridge during multimix mode.
+ *
+ * \param bridge Bridge to change the mixing threads on.
+ * \param mixing_threads The most threads to use.  0 or 1 does all of the
+ * mixing on the bridge's own mixing thread.
+ *
+ * \since 17.0.0
+ */
+void ast_bridge_set_mixing_threads(struct ast_bridge *bridge, unsigned int mixing_threads);
+
+/*!
+ * \brief Set the quality of the resamplers used for the participants of
+ * a bridge during multimix mode.
+ *
+ * \param bridge Bridge to change the resampling quality on.
+ * \param resample_quality From 1 (cheapest) to 10 (best).  0 leaves the
+ * translators at their default quality.
+ *
+ * \since 17.0.0
+ */
+void ast_bridge_set_resample_quality(struct ast_bridge *bridge, unsigned int resample_quality);
+
 /*!
  * \brief Activates the use of binaural signals in a conference bridge.
  *
@@ -190,6 +190,19 @@ struct ast_bridge_technology {
 	 * \note On entry, bridge is already locked.
 	 */
 	void (*stream_topology_changed)(struct ast_bridge *bridge, struct ast_bridge_channel *bridge_channel);
+	/*!
+	 * \brief Callback for when a batch of joins and leaves has completed
+	 *
+	 * \details
+	 * While bridge->batching is non-zero several channels may join
+	 * or leave the bridge technology one after another, such as
+	 * during a bridge merge.  A bridge technology may defer work
+	 * that depends upon the full set of participants, such as
+	 * stream topology renegotiation, until this is called.
+	 *
+	 * \note On entry, bridge is already locked.
+	 */
+	void (*batch_end)(struct ast_bridge *bridge);
 	/*! TRUE if the bridge technology is currently suspended. */
 	unsigned int suspended:1;
 	/*! Module this bridge technology belongs to. It is used for reference counting bridges using the technology. */
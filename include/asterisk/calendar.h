@@ -54,6 +54,11 @@
  * baesd on the refresh interval in the ast_calendar object.  Each call to
  * the load_calendar callback will be will run in its own thread.
  *
+ * The refresh loop should wait with ast_calendar_refresh_wait, which spreads the
+ * refreshes of calendars loaded together across the interval and limits how many
+ * calendars fetch from their servers at once.  Each fetch it allows, and each fetch
+ * started with ast_calendar_fetch_begin, must be finished with ast_calendar_fetch_end.
+ *
  * Updating events involves creating an astobj2 container of new events and passing
  * it to the API through ast_calendar_merge_events.
  *
@@ -203,4 +208,39 @@ const struct ast_config *ast_calendar_config_acquire(void);
  */
 void ast_calendar_config_release(void);
 
+/*! \brief Wait for a fetch slot before contacting a calendar server
+ *
+ * Blocks while maxfetches calendars are already fetching.
+ *
+ * \param cal calendar about to be fetched
+ *
+ * \retval 0 a slot was taken, release it with ast_calendar_fetch_end
+ * \retval -1 the calendar is unloading
+ *
+ * \since 17.0.0
+ */
+int ast_calendar_fetch_begin(struct ast_calendar *cal);
+
+/*! \brief Release a fetch slot taken by ast_calendar_fetch_begin or ast_calendar_refresh_wait
+ *
+ * \since 17.0.0
+ */
+void ast_calendar_fetch_end(void);
+
+/*! \brief Wait until a calendar is due to be refreshed
+ *
+ * Waits for the refresh interval of the calendar and then for a fetch slot.  The
+ * first wait after loading is shortened by a random amount of up to half the
+ * interval, so that calendars loaded together do not refresh together.
+ *
+ * \param cal calendar to wait for
+ * \param first non-zero for the first refresh after the calendar was loaded
+ *
+ * \retval 0 the calendar should be refreshed, then ast_calendar_fetch_end called
+ * \retval -1 the calendar is unloading
+ *
+ * \since 17.0.0
+ */
+int ast_calendar_refresh_wait(struct ast_calendar *cal, int first);
+
 #endif /* _ASTERISK_CALENDAR_H */
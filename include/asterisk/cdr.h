@@ -268,6 +268,7 @@ struct ast_cdr_config {
 		unsigned int size;				/*!< Size to trigger a batch */
 		struct ast_flags settings;		/*!< Settings for batches */
 	} batch_settings;
+	unsigned int shards;				/*!< Threads processing CDR messages (since 17.0.0) */
 };
 
 /*!
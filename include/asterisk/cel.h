@@ -281,6 +281,42 @@ typedef void (*ast_cel_backend_cb)(struct ast_event *event);
  */
 int ast_cel_backend_register(const char *name, ast_cel_backend_cb backend_callback);
 
+/*!
+ * \brief CEL backend callback writing a batch of events
+ * \since 17.0.0
+ *
+ * \param events Events in the order they happened
+ * \param count Number of events
+ *
+ * \retval 0 once the events were written, or given up on for good
+ * \retval -1 if they could not be written now and should be retried later
+ */
+typedef int (*ast_cel_backend_batch_cb)(struct ast_event **events, size_t count);
+
+/*!
+ * \brief Register a CEL backend written in batches from a thread of its own
+ * \since 17.0.0
+ *
+ * \param name Name of backend to register
+ * \param batch_callback Callback writing the events
+ * \param batch_size Most events passed to one call of batch_callback
+ * \param batch_time Longest time in ms an event waits for its batch to fill
+ * \param queue_size Most events waiting in memory
+ *
+ * The events are queued as they happen, so a slow backend no longer holds
+ * up the CEL engine.  Events past queue_size, and batches batch_callback
+ * could not write, are spooled to astspooldir/cel/<name>.spool, with
+ * spaces in name replaced by underscores, and written once batch_callback
+ * works again, even after a restart.
+ * ast_cel_backend_unregister() waits for the queue to be written or
+ * spooled and batch_callback is not called once it returns.
+ *
+ * \retval zero on success
+ * \retval non-zero on failure
+ */
+int ast_cel_backend_register_batch(const char *name, ast_cel_backend_batch_cb batch_callback,
+	unsigned int batch_size, unsigned int batch_time, unsigned int queue_size);
+
 /*!
  * \brief Unregister a CEL backend
  *
@@ -2920,6 +2920,25 @@ struct ast_channel_iterator *ast_channel_iterator_by_exten_new(const char *exten
  */
 struct ast_channel_iterator *ast_channel_iterator_by_name_new(const char *name,	size_t name_len);
 
+/*!
+ * \brief Create a new channel iterator based on linkedid
+ *
+ * \param linkedid The linkedid that channels must have
+ *
+ * \details
+ * After creating an iterator using this function, the ast_channel_iterator_next()
+ * function can be used to iterate through all channels that currently share
+ * the specified linkedid.
+ *
+ * \note You must call ast_channel_iterator_destroy() when done.
+ *
+ * \retval NULL on failure
+ * \retval a new channel iterator based on the specified parameters
+ *
+ * \since 17.0.0
+ */
+struct ast_channel_iterator *ast_channel_iterator_by_linkedid_new(const char *linkedid);
+
 /*!
  * \brief Create a new channel iterator
  *
@@ -4360,6 +4379,18 @@ int ast_channel_alert_write(struct ast_channel *chan);
 int ast_channel_alert_writable(struct ast_channel *chan);
 ast_alert_status_t ast_channel_internal_alert_flush(struct ast_channel *chan);
 ast_alert_status_t ast_channel_internal_alert_read(struct ast_channel *chan);
+/*!
+ * \brief Wake the channel's reader for frames on its read queue
+ *
+ * Only one alert is outstanding at a time, nothing is written while the
+ * reader has not yet taken the previous one.
+ *
+ * \retval 0 the reader has been woken
+ * \retval -1 the alert could not be written
+ */
+int ast_channel_internal_alert_raise(struct ast_channel *chan);
+/*! \brief Take the alert raised by ast_channel_internal_alert_raise(), if any */
+ast_alert_status_t ast_channel_internal_alert_lower(struct ast_channel *chan);
 int ast_channel_internal_alert_readable(struct ast_channel *chan);
 void ast_channel_internal_alertpipe_clear(struct ast_channel *chan);
 void ast_channel_internal_alertpipe_close(struct ast_channel *chan);
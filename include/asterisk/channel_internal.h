@@ -33,3 +33,10 @@ void ast_channel_internal_set_stream_topology_change_source(
 	struct ast_channel *chan, void *change_source);
 void ast_channel_internal_swap_stream_topology(struct ast_channel *chan1,
 	struct ast_channel *chan2);
+
+/* Changes whenever the channel's fds change, never repeating a value another channel had. */
+unsigned int ast_channel_internal_fd_generation(const struct ast_channel *chan);
+
+/* The linkedid index only follows changes made between these calls. */
+int ast_channel_linkedid_index_begin(struct ast_channel *chan);
+void ast_channel_linkedid_index_end(struct ast_channel *chan, int indexed);
@@ -28,6 +28,8 @@
 struct ast_var_t {
 	AST_LIST_ENTRY(ast_var_t) entries;
 	char *value;
+	/*! ast_var_hash() of the name without the initial underscores. */
+	unsigned int hash;
 	char name[0];
 };
 
@@ -44,6 +46,33 @@ const char *ast_var_name(const struct ast_var_t *var);
 const char *ast_var_full_name(const struct ast_var_t *var);
 const char *ast_var_value(const struct ast_var_t *var);
 char *ast_var_find(const struct varshead *head, const char *name);
+
+/*!
+ * \brief Hash a variable name for ast_var_list_find().
+ *
+ * \param name Variable name without the initial underscores.
+ *
+ * \return The hash stored in every ast_var_t with that name.
+ *
+ * \since 17.0.0
+ */
+unsigned int ast_var_hash(const char *name);
+
+/*!
+ * \brief Find a variable by its name without the initial underscores.
+ *
+ * \param head List of variables to search.
+ * \param name Variable name without the initial underscores.
+ * \param hash ast_var_hash() of name.
+ *
+ * \details Names are compared only when their hashes match, so a
+ * caller searching several lists hashes the name once.
+ *
+ * \retval NULL if no variable has that name.
+ *
+ * \since 17.0.0
+ */
+struct ast_var_t *ast_var_list_find(const struct varshead *head, const char *name, unsigned int hash);
 struct varshead *ast_var_list_clone(struct varshead *head);
 
 #define AST_VAR_LIST_TRAVERSE(head, var) AST_LIST_TRAVERSE(head, var, entries)
@@ -477,6 +477,21 @@ struct ast_variable *ast_load_realtime_all(const char *family, ...) attribute_se
  */
 int ast_unload_realtime(const char *family);
 
+/*!
+ * \brief Drop cached realtime results
+ * \since 17.0.0
+ *
+ * \param family which family to drop, or NULL for all families
+ *
+ * \details
+ * Families configured in the [cache] section of extconfig.conf keep the
+ * results of ast_load_realtime and ast_load_realtime_multientry for a while.
+ * Writes done through the realtime API drop the cached results of their
+ * family by themselves; this is for modules that learn of changes made to
+ * the backend some other way.
+ */
+void ast_realtime_cache_invalidate(const char *family);
+
 /*!
  * \brief Inform realtime what fields that may be stored
  * \since 1.6.1
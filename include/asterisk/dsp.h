@@ -193,4 +193,10 @@ int ast_dsp_get_tcount(struct ast_dsp *dsp);
  */
 int ast_dsp_get_threshold_from_settings(enum threshold which);
 
+/*!
+ * \brief Name of the instruction set the DTMF and MF goertzels use
+ * \since 17.0.0
+ */
+const char *ast_goertzel_simd_name(void);
+
 #endif /* _ASTERISK_DSP_H */
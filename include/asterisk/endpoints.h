@@ -111,6 +111,24 @@ struct ast_endpoint *ast_endpoint_find_by_id(const char *id);
  */
 struct ast_endpoint *ast_endpoint_create(const char *tech, const char *resource);
 
+/*!
+ * \brief Create an endpoint struct with an initial state.
+ *
+ * Same as ast_endpoint_create(), except the endpoint starts out in
+ * \a state. Only one snapshot is published for the new endpoint, instead
+ * of one for the UNKNOWN state and another when the caller sets the real
+ * state.
+ *
+ * \param tech Technology for this endpoint.
+ * \param resource Name of this endpoint.
+ * \param state Initial state of the endpoint.
+ * \return Newly created endpoint.
+ * \return \c NULL on error.
+ * \since 17.0.0
+ */
+struct ast_endpoint *ast_endpoint_create_with_state(const char *tech, const char *resource,
+	enum ast_endpoint_state state);
+
 /*!
  * \brief Shutsdown an \ref ast_endpoint.
  *
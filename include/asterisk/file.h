@@ -284,6 +284,28 @@ struct ast_filestream *ast_writefile(const char *filename, const char *type, con
  */
 int ast_writestream(struct ast_filestream *fs, struct ast_frame *f);
 
+/*!
+ * \brief Write a stream from a background thread
+ * \since 17.0.0
+ *
+ * \param fs filestream opened with ast_writefile()
+ * \param buffer_size Bytes of stdio buffer for the file, 0 for the default
+ * \param flush_ms Longest time written frames may sit in the buffer, 0 to
+ *        leave flushing to stdio
+ *
+ * Once set, ast_writestream() queues a copy of each voice frame to one of
+ * the file_writer_threads from asterisk.conf, which translates and writes
+ * it.  A slow disk then no longer holds up the caller.  Seeking, telling,
+ * truncating and closing the stream wait for the queued frames first.
+ * Frames are dropped, and ast_writestream() fails, while a megabyte of
+ * them is already queued.
+ *
+ * \retval 0 on success.
+ * \retval -1 if the writer threads are disabled or on failure.  The stream
+ *         is still written in place.
+ */
+int ast_filestream_set_async(struct ast_filestream *fs, size_t buffer_size, unsigned int flush_ms);
+
 /*!
  * \brief Closes a stream
  * \param f filestream to close
@@ -188,6 +188,10 @@ struct ast_frame {
 	int seqno;
 	/*! Stream number the frame originated from */
 	int stream_num;
+	/*! When a traced frame was received, zero if the frame is not traced */
+	struct timeval trace_start;
+	/*! Media trace group the frame is counted in */
+	int trace_group;
 };
 
 /*!
@@ -228,6 +232,12 @@ extern struct ast_frame ast_null_frame;
 #define AST_MALLOCD_DATA	(1 << 1)
 /*! Need the source be free'd? (haha!) */
 #define AST_MALLOCD_SRC		(1 << 2)
+/*! The header came from a frame slab (internal to frame.c, set along with AST_MALLOCD_HDR) */
+#define AST_MALLOCD_HDR_SLAB	(1 << 3)
+/*! The data came from a frame slab (internal to frame.c, set along with AST_MALLOCD_DATA) */
+#define AST_MALLOCD_DATA_SLAB	(1 << 4)
+/*! The data is a reference to a shared payload (internal to frame.c, set along with AST_MALLOCD_DATA) */
+#define AST_MALLOCD_DATA_SHARED	(1 << 5)
 
 /* MODEM subclasses */
 /*! T.38 Fax-over-IP */
@@ -569,6 +579,41 @@ struct ast_frame *ast_frisolate(struct ast_frame *fr);
  */
 struct ast_frame *ast_frdup(const struct ast_frame *fr);
 
+/*!
+ * \brief Copies a frame into one whose payload can be shared
+ * \since 17.0.0
+ *
+ * \param fr frame to copy
+ *
+ * The payload is copied once into a reference counted buffer.  Calling
+ * ast_frdup_readonly() on the returned frame, or on any duplicate of it,
+ * only copies the frame header and shares the payload, so the same frame
+ * can be queued to many destinations without copying the payload again.
+ * If the frame already has a shared payload it is not copied again.
+ *
+ * \note The shared payload is read-only.  Frames referencing it have no
+ * AST_FRIENDLY_OFFSET, so code that writes headers in front of the
+ * payload copies the frame first as it would any other frame without room.
+ *
+ * \return Returns a frame on success, NULL on error
+ */
+struct ast_frame *ast_frdup_shared(const struct ast_frame *fr);
+
+/*!
+ * \brief Copies a frame that will not be written to
+ * \since 17.0.0
+ *
+ * \param fr frame to copy
+ *
+ * If the frame's payload is shared (see ast_frdup_shared()) only the frame
+ * header is copied and the payload is referenced, so the returned frame
+ * must not be modified and has no AST_FRIENDLY_OFFSET.  Any other frame is
+ * copied exactly like ast_frdup() does.
+ *
+ * \return Returns a frame on success, NULL on error
+ */
+struct ast_frame *ast_frdup_readonly(const struct ast_frame *fr);
+
 void ast_swapcopy_samples(void *dst, const void *src, int samples);
 
 /* Helpers for byteswapping native samples to/from
@@ -224,7 +224,13 @@ typedef int (*ast_framehook_consume_callback)(void *data, enum ast_frame_type ty
 typedef void (*ast_framehook_chan_fixup_callback)(void *data, int framehook_id,
 	struct ast_channel *old_chan, struct ast_channel *new_chan);
 
-#define AST_FRAMEHOOK_INTERFACE_VERSION 4
+/*!
+ * \brief Bit representing a frame type in ast_framehook_interface::frame_types
+ * \since 17.0.0
+ */
+#define AST_FRAMEHOOK_FRAME_TYPE(type) (1U << (type))
+
+#define AST_FRAMEHOOK_INTERFACE_VERSION 5
 /*! This interface is required for attaching a framehook to a channel. */
 struct ast_framehook_interface {
 	/*! framehook interface version number */
@@ -253,6 +259,10 @@ struct ast_framehook_interface {
 	 * data pointer will be provided during each event callback which allows the framehook
 	 * to store any stateful data associated with the application using the hook. */
 	void *data;
+	/*! frame_types is optional. A mask built from AST_FRAMEHOOK_FRAME_TYPE() of the frame
+	 * types this framehook wants to see on read and write. Frames of any other type are
+	 * passed along without calling event_cb. If zero the framehook receives all frames. */
+	unsigned int frame_types;
 };
 
 /*!
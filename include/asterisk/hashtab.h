@@ -74,6 +74,7 @@ This implementation is pretty generic, because:
 struct ast_hashtab_bucket
 {
 	const void *object;                    /*!< whatever it is we are storing in this table */
+	unsigned int hash;                     /*!< the unreduced hash of object, kept so resizing needn't rehash */
 	struct ast_hashtab_bucket *next;       /*!< a DLL of buckets in hash collision */
 	struct ast_hashtab_bucket *prev;       /*!< a DLL of buckets in hash collision */
 	struct ast_hashtab_bucket *tnext;      /*!< a DLL of all the hash buckets for traversal */
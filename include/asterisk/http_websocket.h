@@ -273,6 +273,23 @@ AST_OPTIONAL_API(int, ast_websocket_read_string,
  */
 AST_OPTIONAL_API(int, ast_websocket_write, (struct ast_websocket *session, enum ast_websocket_opcode opcode, char *payload, uint64_t payload_size), { errno = ENOSYS; return -1;});
 
+/*!
+ * \brief Construct and transmit several WebSocket frames with one write
+ * \since 17.0.0
+ *
+ * A burst of small messages costs one system call instead of one each.
+ *
+ * \param session Pointer to the WebSocket session
+ * \param opcode WebSocket operation code to place in each frame
+ * \param payloads Payloads, one per frame
+ * \param payload_sizes Length of each payload
+ * \param count Number of frames
+ *
+ * \retval 0 if successfully written
+ * \retval -1 if error occurred
+ */
+AST_OPTIONAL_API(int, ast_websocket_write_batch, (struct ast_websocket *session, enum ast_websocket_opcode opcode, char **payloads, const uint64_t *payload_sizes, size_t count), { errno = ENOSYS; return -1;});
+
 /*!
  * \brief Construct and transmit a WebSocket frame containing string data.
  *
@@ -34,6 +34,7 @@
 struct ssl_st;                  /* forward declaration */
 struct ssl_ctx_st;              /* forward declaration */
 struct timeval;                 /* forward declaration */
+struct iovec;                   /* forward declaration */
 typedef struct ssl_st SSL;
 typedef struct ssl_ctx_st SSL_CTX;
 
@@ -116,6 +117,20 @@ void ast_iostream_set_timeout_sequence(struct ast_iostream *stream, struct timev
  */
 void ast_iostream_set_exclusive_input(struct ast_iostream *stream, int exclusive_input);
 
+/*!
+ * \brief Check whether an iostream holds input not yet read by its user.
+ * \since 17.0.0
+ *
+ * Input read ahead from the descriptor, or decrypted but unread TLS data,
+ * will not wake a poll of the descriptor.
+ *
+ * \param stream A pointer to an iostream
+ *
+ * \retval 1 if input is buffered.
+ * \retval 0 if reading would go to the file descriptor.
+ */
+int ast_iostream_has_buffered_input(struct ast_iostream *stream);
+
 /*!
  * \brief Get an iostream's file descriptor.
  *
@@ -204,6 +219,43 @@ ssize_t ast_iostream_discard(struct ast_iostream *stream, size_t count);
  */
 ssize_t ast_iostream_write(struct ast_iostream *stream, const void *buffer, size_t count);
 
+/*!
+ * \brief Write several buffers to an iostream.
+ *
+ * \param stream A pointer to an iostream
+ * \param iov The buffers to write, in order.
+ * \param iovcnt The number of buffers in \a iov.
+ *
+ * \details The buffers are handed to the kernel in as few writev(2) calls as
+ * possible.  On a TLS stream they are written one after the other.
+ *
+ * \return Upon successful completion, returns the number of bytes actually
+ *         written to the iostream. This number shall never be greater than
+ *         the total length of the buffers. Otherwise, returns \c -1 and may
+ *         set \c errno to indicate the error.
+ */
+ssize_t ast_iostream_writev(struct ast_iostream *stream, const struct iovec *iov, int iovcnt);
+
+/*!
+ * \brief Write the contents of a file to an iostream.
+ *
+ * \param stream A pointer to an iostream
+ * \param fd The file to read from, starting at its current offset.
+ * \param count The number of bytes to write.
+ *
+ * \details On a plain TCP stream the file is handed to the kernel with
+ * sendfile(2) so it is never copied through user space.  Otherwise it is
+ * read and written in large chunks.
+ *
+ * \return Upon successful completion, returns the number of bytes actually
+ *         written to the iostream. This number shall never be greater than
+ *         \a count. Otherwise, returns \c -1 and may set \c errno to indicate
+ *         the error.
+ *
+ * \since 17.0.0
+ */
+ssize_t ast_iostream_sendfile(struct ast_iostream *stream, int fd, size_t count);
+
 /*!
  * \brief Write a formatted string to an iostream.
  *
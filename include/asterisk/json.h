@@ -791,6 +791,62 @@ char *ast_json_dump_string_format(struct ast_json *root, enum ast_json_encoding_
  */
 int ast_json_dump_str_format(struct ast_json *root, struct ast_str **dst, enum ast_json_encoding_format format);
 
+/*!
+ * \brief Incremental encoder for a JSON array.
+ * \since 17.0.0
+ *
+ * Encodes an array one element at a time straight into an \ref ast_str, so
+ * a large array never has to exist as a single JSON tree. The result is the
+ * same text ast_json_dump_str_format() would produce for the whole array.
+ */
+struct ast_json_array_encoder;
+
+/*!
+ * \brief Start encoding a JSON array.
+ * \since 17.0.0
+ *
+ * \param format encoding format type.
+ * \return New encoder, to be passed to ast_json_array_encoder_finish() or
+ *         ast_json_array_encoder_free().
+ * \return \c NULL on error.
+ */
+struct ast_json_array_encoder *ast_json_array_encoder_create(enum ast_json_encoding_format format);
+
+/*!
+ * \brief Encode the next element of a JSON array.
+ * \since 17.0.0
+ *
+ * \note The reference to \a value is stolen, as with ast_json_array_append(),
+ *       and released once it is encoded. A \c NULL \a value fails the array,
+ *       so the result of a conversion function can be passed directly.
+ *
+ * \param encoder Encoder to append to.
+ * \param value JSON value to encode.
+ * \return 0 on success.
+ * \return -1 on error, after which ast_json_array_encoder_finish() fails.
+ */
+int ast_json_array_encoder_append(struct ast_json_array_encoder *encoder, struct ast_json *value);
+
+/*!
+ * \brief Finish encoding a JSON array.
+ * \since 17.0.0
+ *
+ * The encoder is freed, whether or not encoding succeeded.
+ *
+ * \param encoder Encoder to finish.
+ * \return Encoded array, to be freed with ast_free().
+ * \return \c NULL if any element failed to encode.
+ */
+struct ast_str *ast_json_array_encoder_finish(struct ast_json_array_encoder *encoder);
+
+/*!
+ * \brief Abandon encoding a JSON array.
+ * \since 17.0.0
+ *
+ * \param encoder Encoder to free. May be \c NULL.
+ */
+void ast_json_array_encoder_free(struct ast_json_array_encoder *encoder);
+
 #define ast_json_dump_file(root, output) ast_json_dump_file_format(root, output, AST_JSON_COMPACT)
 
 /*!
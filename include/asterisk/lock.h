@@ -237,6 +237,59 @@ int __ast_rwlock_trywrlock(const char *filename, int lineno, const char *func, a
 #define ast_rwlock_timedrdlock(a, b)       __ast_rwlock_timedrdlock(__FILE__, __LINE__, __PRETTY_FUNCTION__, a, #a, b)
 #define ast_rwlock_timedwrlock(a, b)       __ast_rwlock_timedwrlock(__FILE__, __LINE__, __PRETTY_FUNCTION__, a, #a, b)
 
+/*! \brief Contention recorded at one lock acquisition site */
+struct ast_lock_contention_site {
+	/*! Number of times the lock was found held */
+	unsigned long contended;
+	/*! Total time spent waiting, in microseconds */
+	int64_t total_wait;
+	/*! Longest wait, in microseconds */
+	int64_t max_wait;
+	/*! Line of the acquisition */
+	int lineno;
+	/*! File of the acquisition */
+	char filename[64];
+	/*! Name of the lock as written at the acquisition */
+	char lock_name[64];
+};
+
+/*!
+ * \brief Turn the lock contention profiler on or off
+ *
+ * While on, every ast_mutex, ast_rwlock and ao2 lock acquisition first
+ * tries the lock. Only acquisitions that find the lock held are timed and
+ * recorded against their file and line.
+ *
+ * \note The profiler is not available when built with DETECT_DEADLOCKS.
+ *
+ * \since 17.0.0
+ */
+void ast_lock_contention_enable(int enable);
+
+/*!
+ * \brief Whether the lock contention profiler is on
+ * \since 17.0.0
+ */
+int ast_lock_contention_enabled(void);
+
+/*!
+ * \brief Copy out the recorded lock contention
+ *
+ * \param sites Array to copy the sites into
+ * \param max Size of the array
+ * \param reset Clear the recorded contention after copying it
+ * \param dropped Set to the number of contended acquisitions not recorded
+ *        because the site table was full
+ *
+ * \return Number of sites copied
+ * \since 17.0.0
+ */
+size_t ast_lock_contention_snapshot(struct ast_lock_contention_site *sites, size_t max,
+	int reset, unsigned long *dropped);
+
+/*! Number of acquisition sites the lock contention profiler can record */
+#define AST_LOCK_CONTENTION_SITES 1024
+
 #define	ROFFSET	((lt->reentrancy > 0) ? (lt->reentrancy-1) : 0)
 
 #ifdef DEBUG_THREADS
@@ -683,14 +736,30 @@ static void  __attribute__((destructor)) fini_##rwlock(void) \
 #define ast_atomic_fetch_xor(ptr, val, memorder)  __atomic_fetch_xor((ptr), (val), (memorder))
 #define ast_atomic_xor_fetch(ptr, val, memorder)  __atomic_xor_fetch((ptr), (val), (memorder))
 
-#if 0
-/* Atomic compare and swap
+/*! Atomic exchange, returns the previous value of *ptr */
+#define ast_atomic_exchange_n(ptr, val, memorder) __atomic_exchange_n((ptr), (val), (memorder))
+
+/*! Atomic load */
+#define ast_atomic_load_n(ptr, memorder)          __atomic_load_n((ptr), (memorder))
+
+/*! Atomic store */
+#define ast_atomic_store_n(ptr, val, memorder)    __atomic_store_n((ptr), (val), (memorder))
+
+/*!
+ * Atomic compare and swap (strong)
  *
- * See comments near the __atomic implementation for why this is disabled.
+ * If *ptr equals *expected, desired is stored in *ptr and true is returned.
+ * Otherwise the current value of *ptr is stored in *expected and false is
+ * returned.
  */
 #define ast_atomic_compare_exchange_n(ptr, expected, desired, success_memorder, failure_memorder) \
 	__atomic_compare_exchange_n((ptr), (expected), (desired), 0, success_memorder, failure_memorder)
 
+#if 0
+/* Atomic compare and swap
+ *
+ * See comments near the __sync implementation for why this is disabled.
+ */
 #define ast_atomic_compare_exchange(ptr, expected, desired, success_memorder, failure_memorder) \
 	__atomic_compare_exchange((ptr), (expected), (desired), 0, success_memorder, failure_memorder)
 #endif
@@ -716,19 +785,44 @@ static void  __attribute__((destructor)) fini_##rwlock(void) \
 #define ast_atomic_fetch_xor(ptr, val, memorder)  __sync_fetch_and_xor((ptr), (val))
 #define ast_atomic_xor_fetch(ptr, val, memorder)  __sync_xor_and_fetch((ptr), (val))
 
-#if 0
-/* Atomic compare and swap
+/*!
+ * Atomic exchange, returns the previous value of *ptr
  *
- * The \a expected argument is a pointer, I'm guessing __atomic built-ins
- * perform all memory reads/writes in a single atomic operation.  I don't
- * believe this is possible to exactly replicate using __sync built-ins.
- * Will need to determine potential use cases of this feature and write a
- * wrapper which provides consistant behavior between __sync and __atomic
- * implementations.
+ * \note __sync_lock_test_and_set is only an acquire barrier so a full
+ * barrier is issued first to match the __atomic behavior.
+ */
+#define ast_atomic_exchange_n(ptr, val, memorder) \
+	({ __sync_synchronize(); __sync_lock_test_and_set((ptr), (val)); })
+
+/*! Atomic load */
+#define ast_atomic_load_n(ptr, memorder) \
+	({ __typeof__(*(ptr)) __ast_v = *(volatile __typeof__(*(ptr)) *)(ptr); __sync_synchronize(); __ast_v; })
+
+/*! Atomic store */
+#define ast_atomic_store_n(ptr, val, memorder) \
+	do { __sync_synchronize(); *(volatile __typeof__(*(ptr)) *)(ptr) = (val); __sync_synchronize(); } while (0)
+
+/*!
+ * Atomic compare and swap (strong)
+ *
+ * \note The value seen in *ptr is written back to *expected, as the
+ * __atomic built-in does.  *expected is a separate object owned by the
+ * caller so the write back does not need to be atomic.
  */
 #define ast_atomic_compare_exchange_n(ptr, expected, desired, success_memorder, failure_memorder) \
-	__sync_bool_compare_and_swap((ptr), *(expected), (desired))
+	({ \
+		__typeof__(*(ptr)) __ast_e = *(expected); \
+		__typeof__(*(ptr)) __ast_o = __sync_val_compare_and_swap((ptr), __ast_e, (desired)); \
+		*(expected) = __ast_o; \
+		__ast_o == __ast_e; \
+	})
 
+#if 0
+/* Atomic compare and swap
+ *
+ * The \a desired argument is a pointer to a value of any size, which
+ * __sync built-ins cannot swap in a single atomic operation.
+ */
 #define ast_atomic_compare_exchange(ptr, expected, desired, success_memorder, failure_memorder) \
 	__sync_bool_compare_and_swap((ptr), *(expected), *(desired))
 #endif
@@ -309,6 +309,17 @@ void ast_console_toggle_loglevel(int fd, int level, int state);
  */
 unsigned int ast_debug_get_by_module(const char *module);
 
+/*!
+ * \brief Get the debug level for the call the current thread is working on
+ *
+ * \details The call is identified by the callid bound to the thread with
+ * ast_callid_threadassoc_add().
+ *
+ * \return the debug level, 0 if no level was set for the call
+ * \since 17.0.0
+ */
+unsigned int ast_debug_get_by_callid(void);
+
 /*!
  * \brief Register a new logger level
  * \param name The name of the level to be registered
@@ -423,7 +434,9 @@ void ast_callid_strnprint(char *buffer, size_t buffer_size, ast_callid callid);
 	(option_debug >= (level) \
 		|| (ast_opt_dbg_module \
         	&& ((int)ast_debug_get_by_module(AST_MODULE) >= (level) \
-				|| (int)ast_debug_get_by_module(__FILE__) >= (level))))
+				|| (int)ast_debug_get_by_module(__FILE__) >= (level))) \
+		|| (ast_opt_dbg_callid \
+			&& (int)ast_debug_get_by_callid() >= (level)))
 
 /*!
  * \brief Log a DEBUG message
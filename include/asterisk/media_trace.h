@@ -0,0 +1,86 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2019, Sangoma Technologies Corporation
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*! \file
+ *
+ * \brief Sampled media frame latency tracing
+ *
+ * A small share of received media frames are stamped with the time they
+ * entered Asterisk. The stamp is copied along with the frame through
+ * duplication and translation. Each stage the frame passes adds the time
+ * since the stamp to a latency histogram. Once a frame is written into a
+ * bridge, the histograms of its later stages are kept per bridge
+ * technology.
+ *
+ * \since 17.0.0
+ */
+
+#ifndef _ASTERISK_MEDIA_TRACE_H
+#define _ASTERISK_MEDIA_TRACE_H
+
+#include "asterisk/frame.h"
+#include "asterisk/time.h"
+
+/*! \brief Points in the media path where traced frames are timed */
+enum ast_media_trace_stage {
+	/*! Returned by ast_read(), after jitterbuffer, framehooks and translation */
+	AST_MEDIA_TRACE_READ = 0,
+	/*! Written into a bridge technology */
+	AST_MEDIA_TRACE_BRIDGE,
+	/*! Passed to ast_write() */
+	AST_MEDIA_TRACE_WRITE,
+	/*! Sent out by the RTP engine */
+	AST_MEDIA_TRACE_SEND,
+	AST_MEDIA_TRACE_STAGES,
+};
+
+/*!
+ * \brief Start tracing a newly received frame, if it is picked for sampling
+ *
+ * Always sets the frame's trace stamp, clearing it when the frame is not
+ * sampled, so it can be used on frames whose header is reused.
+ *
+ * \param f The frame
+ */
+void ast_media_trace_start(struct ast_frame *f);
+
+/*!
+ * \brief Record a traced frame reaching a stage
+ *
+ * \param f The frame
+ * \param stage The stage reached
+ * \param group Bridge technology the frame is entering, NULL to keep
+ *        the frame's current one
+ */
+void __ast_media_trace_stage(struct ast_frame *f, enum ast_media_trace_stage stage,
+	const char *group);
+
+/*! \brief Record a frame reaching a stage, if it is being traced */
+#define ast_media_trace_stage(f, stage, group) \
+	do { \
+		if (!ast_tvzero((f)->trace_start)) { \
+			__ast_media_trace_stage((f), (stage), (group)); \
+		} \
+	} while (0)
+
+/*! \brief Copy the trace of one frame to another */
+#define ast_media_trace_copy(dst, src) \
+	do { \
+		(dst)->trace_start = (src)->trace_start; \
+		(dst)->trace_group = (src)->trace_group; \
+	} while (0)
+
+#endif /* _ASTERISK_MEDIA_TRACE_H */
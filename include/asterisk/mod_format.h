@@ -98,6 +98,9 @@ struct ast_format_def {
  * together with buf_size and desc_size bytes of memory
  * to be used for private purposes (e.g. buffers etc.)
  */
+struct ast_prompt_cache_entry;
+struct ast_filestream_writer;
+
 struct ast_filestream {
 	/*! Everybody reserves a block of AST_RESERVED_POINTERS pointers for us */
 	struct ast_format_def *fmt;	/* need to write to the lock and usecnt */
@@ -124,8 +127,70 @@ struct ast_filestream {
 	void *_private;	/*!< pointer to private buffer */
 	const char *orig_chan_name;
 	char *write_buffer;
+	/*! Prompt cache entry played or filled by this stream (NULL if none) */
+	struct ast_prompt_cache_entry *cache_entry;
+	/*! Translator filling cache_entry (NULL while playing it) */
+	struct ast_trans_pvt *cache_trans;
+	/*! Next step of cache_entry to play */
+	size_t cache_step;
+	/*! Set once the prompt cache was consulted for this stream */
+	unsigned int cache_checked:1;
+	/*! Whole file mapped by ast_filestream_map() (NULL if read with f) */
+	char *map;
+	/*! Size of the mapping */
+	size_t map_size;
+	/*! File offsets of the first audio byte, the end of the audio and the next byte to read */
+	off_t map_start;
+	off_t map_end;
+	off_t map_pos;
+	/*! Background writer set up by ast_filestream_set_async() (NULL if written in place) */
+	struct ast_filestream_writer *writer;
 };
 
+/*!
+ * \brief Map the audio of a stream opened for reading into memory.
+ * \since 17.0.0
+ *
+ * \param s Stream positioned at its first byte of audio.
+ * \param len Bytes of audio from there on, -1 for up to the end of the file.
+ *
+ * Meant for the open callback of formats storing raw samples.  Once
+ * mapped, the read, seek and tell callbacks of the format use
+ * ast_filestream_map_read(), ast_filestream_map_seek() and
+ * s->map_pos in place of s->f.  The frames read point into the
+ * mapping so playbacks of a file share the page cache and nothing is
+ * copied.
+ *
+ * \retval 0 The audio is mapped.
+ * \retval -1 Mapping is disabled or failed.  The stream keeps using s->f.
+ */
+int ast_filestream_map(struct ast_filestream *s, off_t len);
+
+/*!
+ * \brief Read the next frame of a mapped stream.
+ * \since 17.0.0
+ *
+ * \param s Mapped stream.
+ * \param bytes Most bytes to put in the frame.
+ *
+ * The frame has no room in front of its data. The caller sets the
+ * samples of the frame.
+ *
+ * \return s->fr pointing at the audio, NULL at the end of the audio.
+ */
+struct ast_frame *ast_filestream_map_read(struct ast_filestream *s, int bytes);
+
+/*!
+ * \brief Move the read position of a mapped stream.
+ * \since 17.0.0
+ *
+ * \param s Mapped stream.
+ * \param offset File offset, limited to the audio mapped.
+ *
+ * \retval 0 Always.
+ */
+int ast_filestream_map_seek(struct ast_filestream *s, off_t offset);
+
 /*!
  * \brief Register a new file format capability.
  * Adds a format to Asterisk's format abilities.
@@ -1623,6 +1623,7 @@ struct pbx_find_info {
 	struct ast_switch *swo;         /* set on return */
 	const char *data;               /* set on return */
 	const char *foundcontext;       /* set on return */
+	int uncacheable;                /* set during the search if the result depends on more than the dialplan */
 };
 
 struct ast_exten *pbx_find_extension(struct ast_channel *chan,
@@ -52,6 +52,7 @@ struct odbc_obj {
 	int lineno;
 #endif
 	char *sql_text;					/*!< The SQL text currently executing */
+	struct timeval last_alive;		/*!< When the connection was last known to work */
 	AST_LIST_ENTRY(odbc_obj) list;
 };
 
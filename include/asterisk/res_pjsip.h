@@ -172,6 +172,8 @@ struct ast_sip_transport {
 		AST_STRING_FIELD(external_media_address);
 		/*! Optional domain to use for messages if provided could not be found */
 		AST_STRING_FIELD(domain);
+		/*! Targets to keep connections open to */
+		AST_STRING_FIELD(persistent_connections);
 		);
 	/*! Type of transport */
 	enum ast_transport type;
@@ -233,6 +235,8 @@ struct ast_sip_transport {
 	int symmetric_transport;
 	/*! This is a flow to another target */
 	int flow;
+	/*! Number of connections to keep open to each persistent connection target */
+	unsigned int persistent_connection_pool;
 };
 
 #define SIP_SORCERY_DOMAIN_ALIAS_TYPE "domain_alias"
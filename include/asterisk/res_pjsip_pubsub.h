@@ -620,6 +620,38 @@ struct ast_sip_pubsub_body_generator {
 	 * \param body Body to be destroyed
 	 */
 	void (*destroy_body)(void *body);
+	/*!
+	 * \brief Build the key under which a generated body may be shared
+	 * \since 17.0.0
+	 *
+	 * Optional callback for generators whose bodies differ between
+	 * subscriptions to the same resource only in a few fields, such as a
+	 * version counter. The key is appended to \a key and must cover every
+	 * input the body depends on apart from those fields. Bodies generated
+	 * from the same key are cached and handed to \ref patch_body instead
+	 * of being generated again. Bodies are not shared while a body
+	 * supplement is registered for the content type.
+	 *
+	 * \param data The subscription data used to populate the body
+	 * \param key The key to append to
+	 * \retval 0 Success
+	 * \retval non-zero This body cannot be shared
+	 */
+	int (*body_cache_key)(void *data, struct ast_str **key);
+	/*!
+	 * \brief Fill the per-subscription fields into a shared body
+	 * \since 17.0.0
+	 *
+	 * Required if \ref body_cache_key is provided. It has the same
+	 * side effects on \a data as generating the body would have.
+	 *
+	 * \param data The subscription data used to populate the body
+	 * \param str On entry a body generated for another subscription from
+	 * the same key, on exit the body for this one
+	 * \retval 0 Success
+	 * \retval non-zero Failure
+	 */
+	int (*patch_body)(void *data, struct ast_str **str);
 	AST_LIST_ENTRY(ast_sip_pubsub_body_generator) list;
 };
 
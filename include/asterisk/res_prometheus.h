@@ -0,0 +1,88 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2019, Sangoma Technologies Corporation
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+#ifndef _RES_PROMETHEUS_H
+#define _RES_PROMETHEUS_H
+
+/*!
+ * \file
+ * \brief Prometheus metrics exposed over the Asterisk HTTP server
+ *
+ * Modules that want to expose their own metrics register a callback,
+ * which is run every time the metrics URI is scraped. Callbacks must
+ * only read values that can be read without taking locks that are
+ * also taken on call processing paths, such as container counts or
+ * counters updated with ast_atomic_fetchadd_int().
+ *
+ * \since 17.0.0
+ */
+
+#include <stdint.h>
+
+struct ast_str;
+
+/*! Metric types in the Prometheus text exposition format */
+#define PROMETHEUS_METRIC_COUNTER "counter"
+#define PROMETHEUS_METRIC_GAUGE "gauge"
+
+/*! \brief A source of metrics for a scrape */
+struct prometheus_callback {
+	/*! Name of the source, for debugging */
+	const char *name;
+	/*!
+	 * \brief Append metrics to the scrape output
+	 *
+	 * \param output The scrape output, use prometheus_metric_append()
+	 */
+	void (*callback_fn)(struct ast_str **output);
+};
+
+/*!
+ * \brief Register a source of metrics
+ *
+ * \param callback Callback to run on every scrape, must stay valid until unregistered
+ *
+ * \retval 0 success
+ * \retval -1 error
+ *
+ * \since 17.0.0
+ */
+int prometheus_callback_register(struct prometheus_callback *callback);
+
+/*!
+ * \brief Unregister a source of metrics
+ *
+ * \param callback Callback previously registered
+ *
+ * \since 17.0.0
+ */
+void prometheus_callback_unregister(struct prometheus_callback *callback);
+
+/*!
+ * \brief Append one metric to the scrape output
+ *
+ * \param output The scrape output
+ * \param name Metric name, without the configured prefix
+ * \param type PROMETHEUS_METRIC_COUNTER or PROMETHEUS_METRIC_GAUGE
+ * \param help Description of the metric
+ * \param value Current value
+ *
+ * \since 17.0.0
+ */
+void prometheus_metric_append(struct ast_str **output, const char *name,
+	const char *type, const char *help, intmax_t value);
+
+#endif /* _RES_PROMETHEUS_H */
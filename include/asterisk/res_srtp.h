@@ -50,6 +50,14 @@ struct ast_srtp_res {
 	int (*protect)(struct ast_srtp *srtp, void **buf, int *size, int rtcp);
 	/* Obtain a random cryptographic key */
 	int (*get_random)(unsigned char *key, size_t len);
+	/*!
+	 * \brief Protect several RTP packets in place
+	 *
+	 * Each of the \a count buffers holds a packet of \a lens bytes and has room
+	 * for \a size bytes. On return \a lens holds the protected length, or -1 for
+	 * a packet that could not be protected. Returns the number protected.
+	 */
+	int (*protect_batch)(struct ast_srtp *srtp, void **bufs, int *lens, int count, size_t size, int rtcp);
 };
 
 /* Crypto suites */
@@ -249,6 +249,10 @@ enum ast_rtp_instance_stat {
 	AST_RTP_INSTANCE_STAT_TXOCTETCOUNT,
 	/*! Retrieve number of octets received */
 	AST_RTP_INSTANCE_STAT_RXOCTETCOUNT,
+	/*! Retrieve average number of packets sent per system call */
+	AST_RTP_INSTANCE_STAT_TXPACKETSPERSYSCALL,
+	/*! Retrieve average number of packets received per system call */
+	AST_RTP_INSTANCE_STAT_RXPACKETSPERSYSCALL,
 };
 
 enum ast_rtp_instance_rtcp {
@@ -425,6 +429,10 @@ struct ast_rtp_instance_stats {
 	unsigned int txoctetcount;
 	/*! Number of octets received */
 	unsigned int rxoctetcount;
+	/*! Average number of packets sent per system call */
+	double txpacketspersyscall;
+	/*! Average number of packets received per system call */
+	double rxpacketspersyscall;
 };
 
 #define AST_RTP_STAT_SET(current_stat, combined, placement, value) \
@@ -668,6 +676,11 @@ struct ast_rtp_engine {
 	struct ast_rtp_engine_dtls *dtls;
 	/*! Callback to enable an RTP extension (returns non-zero if supported) */
 	int (*extension_enable)(struct ast_rtp_instance *instance, enum ast_rtp_extension extension);
+	/*!
+	 * Callback for when the owner destroys an RTP instance, called without
+	 * the instance locked. Other references may still keep it alive.
+	 */
+	void (*release)(struct ast_rtp_instance *instance);
 	/*! Linked list information */
 	AST_RWLIST_ENTRY(ast_rtp_engine) entry;
 };
@@ -682,10 +695,12 @@ struct ast_rtp_codecs {
 	AST_VECTOR(, struct ast_rtp_payload_type *) payload_mapping_tx;
 	/*! The framing for this media session */
 	unsigned int framing;
+	/*! Incremented whenever the tx payload mapping changes */
+	unsigned int tx_generation;
 };
 
 #define AST_RTP_CODECS_NULL_INIT \
-    { .codecs_lock = AST_RWLOCK_INIT_VALUE, .payload_mapping_rx = { 0, }, .payload_mapping_tx = { 0, }, .framing = 0, }
+    { .codecs_lock = AST_RWLOCK_INIT_VALUE, .payload_mapping_rx = { 0, }, .payload_mapping_tx = { 0, }, .framing = 0, .tx_generation = 0, }
 
 /*! Structure that represents the glue that binds an RTP instance to a channel */
 struct ast_rtp_glue {
@@ -1729,6 +1744,20 @@ int ast_rtp_codecs_payload_set_rx(struct ast_rtp_codecs *codecs, int code, struc
  */
 int ast_rtp_codecs_payload_code_tx(struct ast_rtp_codecs *codecs, int asterisk_format, const struct ast_format *format, int code);
 
+/*!
+ * \brief Get a value that changes whenever tx payload code lookups may give a different result
+ * \since 17.0.0
+ *
+ * \param codecs Codecs structure to check
+ *
+ * This allows caching the results of ast_rtp_codecs_payload_code_tx() without
+ * locking the codecs. Read the generation before the lookup and only use the
+ * cached result while the generation is unchanged.
+ *
+ * \return The tx generation
+ */
+unsigned int ast_rtp_codecs_get_tx_generation(struct ast_rtp_codecs *codecs);
+
 /*!
  * \brief Search for the tx payload type in the ast_rtp_codecs structure
  *
@@ -2567,6 +2596,20 @@ struct ast_json;
  */
 struct ast_rtp_rtcp_report *ast_rtp_rtcp_report_alloc(unsigned int report_blocks);
 
+/*!
+ * \since 17.0.0
+ * \brief Allocate an ao2 ref counted \ref ast_rtp_rtcp_report with its report blocks
+ *
+ * \param report_blocks The number of report blocks to allocate
+ *
+ * The report blocks are allocated zeroed in the same allocation as the report
+ * and are already set in report_block, so they must not be replaced or freed.
+ *
+ * \retval An ao2 ref counted \ref ast_rtp_rtcp_report object on success
+ * \retval NULL on error
+ */
+struct ast_rtp_rtcp_report *ast_rtp_rtcp_report_alloc_inline(unsigned int report_blocks);
+
 /*!
  * \since 12
  * \brief Publish an RTCP message to \ref stasis
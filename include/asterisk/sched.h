@@ -152,6 +152,35 @@ extern "C" {
  */
 struct ast_sched_context *ast_sched_context_create(void);
 
+/*!
+ * \brief Scheduler queue implementations
+ * \since 17.0.0
+ */
+enum ast_sched_backend {
+	/*! Binary heap, O(log n) add and delete.  The default. */
+	AST_SCHED_BACKEND_HEAP = 0,
+	/*!
+	 * Hierarchical timing wheel with 1ms ticks, O(1) add and delete.
+	 * Suited to contexts holding many timers that are mostly cancelled
+	 * before they fire, such as retransmission and qualify timers.
+	 */
+	AST_SCHED_BACKEND_WHEEL,
+};
+
+/*!
+ * \brief Create a scheduler context using a specific queue implementation
+ * \since 17.0.0
+ *
+ * The backend only changes the cost of the operations, ast_sched_runq(),
+ * ast_sched_wait() and the ordering of events expiring at the same time
+ * behave the same for every backend.
+ *
+ * \param backend The queue implementation to use
+ *
+ * \return Returns a malloc'd sched_context structure, NULL on failure
+ */
+struct ast_sched_context *ast_sched_context_create_with_backend(enum ast_sched_backend backend);
+
 /*!
  * \brief destroys a schedule context
  *
@@ -85,6 +85,22 @@ void ast_slinfactory_destroy(struct ast_slinfactory *sf);
  */
 int ast_slinfactory_feed(struct ast_slinfactory *sf, struct ast_frame *f);
 
+/*!
+ * \brief Queue an already duplicated frame in a slinfactory
+ *
+ * \param sf The slinfactory to queue into
+ * \param f Frame duplicated with ast_frdup() in the factory's output format
+ *
+ * Unlike ast_slinfactory_feed() this neither translates nor copies the frame,
+ * so it can be duplicated before taking whatever lock protects the factory.
+ *
+ * \retval 0 on success, the factory now owns the frame
+ * \retval -1 if the frame is not in the output format, the caller still owns it
+ *
+ * \since 17.0.0
+ */
+int ast_slinfactory_queue(struct ast_slinfactory *sf, struct ast_frame *f);
+
 /*!
  * \brief Read samples from a slinfactory
  *
@@ -323,6 +323,22 @@ struct ast_sorcery_wizard {
 
 	/* \brief Callback for whether or not the wizard believes the object is stale */
 	int (*is_stale)(const struct ast_sorcery *sorcery, void *data, void *object);
+
+	/*!
+	 * \brief Optional callback for a caching wizard which knows no object with an id exists
+	 *
+	 * \retval non-zero if retrieval of the id should stop without consulting further wizards
+	 *
+	 * \since 17.0.0
+	 */
+	int (*is_missing)(const struct ast_sorcery *sorcery, void *data, const char *type, const char *id);
+
+	/*!
+	 * \brief Optional callback telling a caching wizard that no wizard has an object with an id
+	 *
+	 * \since 17.0.0
+	 */
+	void (*missing)(const struct ast_sorcery *sorcery, void *data, const char *type, const char *id);
 };
 
 /*! \brief Interface for a sorcery object type observer */
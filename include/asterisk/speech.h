@@ -102,6 +102,25 @@ struct ast_speech_engine {
 	/*! Accepted formats by the engine */
 	struct ast_format_cap *formats;
 	AST_LIST_ENTRY(ast_speech_engine) list;
+	/*!
+	 * \brief Return a finished speech structure to a clean state so it can be reused
+	 * \since 17.0.0
+	 *
+	 * If set along with pool_size, ast_speech_destroy() keeps the engine's
+	 * session around instead of destroying it, and a later ast_speech_new()
+	 * with the same format picks it up again after calling this.  Engines
+	 * talking to a network service can keep their connection open here.
+	 */
+	int (*reset)(struct ast_speech *speech);
+	/*! \since 17.0.0 Maximum number of idle speech structures to keep for reuse */
+	unsigned int pool_size;
+	/*!
+	 * \since 17.0.0 If non-zero, ast_speech_write() collects audio in to chunks
+	 * of at least this many bytes and hands them to the write callback from a
+	 * threadpool instead of the channel thread.  The write callback is still
+	 * called with the speech structure locked and in order.
+	 */
+	unsigned int write_chunk;
 };
 
 /* Result structure */
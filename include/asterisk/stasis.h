@@ -87,6 +87,11 @@
  * between the two topics, and returns a \ref stasis_subscription, which can be
  * unsubscribed to stop the forwarding.
  *
+ * Forwards are flattened when subscribing, so a message published to a topic
+ * is dispatched directly to the subscribers of every topic it is forwarded
+ * to. A subscriber reached through more than one chain of forwards receives
+ * each message only once.
+ *
  * \par Caching
  *
  * Another common use case is to want to cache certain messages that are
@@ -454,6 +459,10 @@ const struct timeval *stasis_message_timestamp(const struct stasis_message *msg)
  * May return \c NULL, to indicate no representation. The returned object should
  * be ast_json_unref()'ed.
  *
+ * The representation is rendered once per message and sanitizer, then cached
+ * on the message for later callers. Each caller gets its own deep copy, which
+ * it may modify.
+ *
  * \param msg Message to convert to JSON string.
  * \param sanitize Snapshot sanitization callback.
  *
@@ -469,6 +478,9 @@ struct ast_json *stasis_message_to_json(struct stasis_message *msg, struct stasi
  * May return \c NULL, to indicate no representation. The returned object should
  * be ao2_cleanup()'ed.
  *
+ * The representation is rendered once per message and cached on it, so the
+ * returned blob is shared with other callers and must not be modified.
+ *
  * \param msg Message to convert to AMI.
  * \return \c NULL on error.
  * \return \c NULL if AMI format is not supported.
@@ -577,6 +589,22 @@ const char *stasis_topic_detail(const struct stasis_topic *topic);
  */
 size_t stasis_topic_subscribers(const struct stasis_topic *topic);
 
+/*!
+ * \brief Check whether any subscriber of a topic accepts a message type.
+ *
+ * Publishers may use this to skip building a message that every
+ * subscriber would filter out.  The answer may be stale as soon as it
+ * is returned, so publishing anyway must still be harmless.
+ *
+ * \param topic Topic.
+ * \param type Message type.
+ * \retval 1 if a message of \a type published to \a topic would be dispatched
+ * \retval 0 if not
+ * \since 17.0.0
+ */
+int stasis_topic_wants_message_type(struct stasis_topic *topic,
+	struct stasis_message_type *type);
+
 /*!
  * \brief Publish a message to a topic's subscribers.
  * \param topic Topic.
@@ -747,6 +775,27 @@ int stasis_subscription_set_filter(struct stasis_subscription *subscription,
 void stasis_subscription_accept_formatters(struct stasis_subscription *subscription,
 	enum stasis_subscription_message_formatters formatters);
 
+/*!
+ * \brief Coalesce the cache updates waiting for a subscription.
+ *
+ * While a \ref stasis_cache_update for a snapshot is waiting in the
+ * subscription's mailbox, a newer update for the same snapshot type, EID
+ * and cache ID replaces it instead of being queued behind it.  Subscribers
+ * that only care about the newest value of each snapshot then do bounded
+ * work when their mailbox backs up.
+ *
+ * The update dispatched carries the old snapshot of the newest update, not
+ * of the first one replaced, and is dispatched in the place of the first
+ * one in the mailbox.  Other messages are not affected.
+ *
+ * \param subscription Subscription to alter, which must have a mailbox.
+ * \retval 0 on success
+ * \retval -1 failure
+ *
+ * \since 17.0.0
+ */
+int stasis_subscription_coalesce_cache_updates(struct stasis_subscription *subscription);
+
 /*!
  * \brief Get a bitmap of available formatters for a message type
  *
@@ -970,6 +1019,8 @@ struct stasis_cache_update {
 	struct stasis_message *old_snapshot;
 	/*! \brief New value */
 	struct stasis_message *new_snapshot;
+	/*! \brief Cache ID of the snapshots */
+	const char *id;
 };
 
 /*!
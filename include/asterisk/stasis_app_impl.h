@@ -105,4 +105,37 @@ int stasis_app_send_command(struct stasis_app_control *control,
 int stasis_app_send_command_async(struct stasis_app_control *control,
 	stasis_app_command_cb command, void *data, command_data_destructor_fn data_destructor);
 
+/*!
+ * \brief A command sent as part of a batch by stasis_app_send_commands()
+ */
+struct stasis_app_command_request {
+	/*! Command function to execute */
+	stasis_app_command_cb command;
+	/*! Optional data to pass along with the control function */
+	void *data;
+	/*! Optional function called on the data when the command is done with */
+	command_data_destructor_fn data_destructor;
+	/*! Set to the return value of the command, or -1 if it did not run */
+	int result;
+};
+
+/*!
+ * \since 17.0.0
+ * \brief Invokes several commands on a \a control's channel.
+ *
+ * The commands are queued together with a single wakeup of the channel's
+ * control loop, which runs them back to back in order without any other
+ * command in between.  This function blocks until all of them are done.
+ *
+ * \param control Control object for the channel to send the commands to.
+ * \param requests The commands to run.  The result of each command is
+ *        stored in its request.
+ * \param count Number of commands in \a requests.
+ *
+ * \return 0 if the commands were run.
+ * \return Non-zero if none of them could be queued.
+ */
+int stasis_app_send_commands(struct stasis_app_control *control,
+	struct stasis_app_command_request *requests, size_t count);
+
 #endif /* _ASTERISK_RES_STASIS_H */
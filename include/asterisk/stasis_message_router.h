@@ -142,6 +142,19 @@ void stasis_message_router_publish_sync(struct stasis_message_router *router,
 int stasis_message_router_set_congestion_limits(struct stasis_message_router *router,
 	long low_water, long high_water);
 
+/*!
+ * \brief Coalesce the cache updates waiting for the stasis message router.
+ * \since 17.0.0
+ *
+ * \param router Pointer to a stasis message router
+ *
+ * \retval 0 on success.
+ * \retval -1 on error.
+ *
+ * \see stasis_subscription_coalesce_cache_updates
+ */
+int stasis_message_router_coalesce_cache_updates(struct stasis_message_router *router);
+
 /*!
  * \brief Add a route to a message router.
  *
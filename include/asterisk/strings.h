@@ -1027,6 +1027,90 @@ AST_INLINE_API(char *ast_str_append_escapecommas(struct ast_str **buf, ssize_t m
 }
 )
 
+/*!
+ * \brief Append a buffer of known length to a dynamic string
+ * \since 17.0.0
+ *
+ * Copies \a len bytes of \a src onto the end of \a buf without going
+ * through the printf machinery, growing the buffer at most once.  The
+ * \a max_len argument has the same meaning as for ast_str_append().
+ *
+ * \note Care should be taken when using this function. The function can
+ * result in reallocating the ast_str.
+ *
+ * \param buf, max_len
+ * \param src Bytes to append (need not be NULL terminated)
+ * \param len Number of bytes to append
+ *
+ * \return The number of characters appended (may be less than \a len if
+ *         the string had to be truncated)
+ * \retval AST_DYNSTR_BUILD_FAILED on allocation failure
+ */
+int ast_str_append_raw(struct ast_str **buf, ssize_t max_len, const char *src, size_t len);
+
+/*!
+ * \brief Append a NULL terminated string to a dynamic string
+ * \since 17.0.0
+ *
+ * Equivalent to ast_str_append(buf, max_len, "%s", src) but without the
+ * format string overhead.
+ */
+AST_INLINE_API(int ast_str_append_cstr(struct ast_str **buf, ssize_t max_len, const char *src),
+{
+	return ast_str_append_raw(buf, max_len, src, strlen(src));
+}
+)
+
+/*!
+ * \brief Append a string literal to a dynamic string
+ * \since 17.0.0
+ *
+ * The length of \a literal is known at compile time so no strlen() or
+ * format parsing is needed.
+ */
+#define ast_str_append_literal(buf, max_len, literal) \
+	ast_str_append_raw(buf, max_len, "" literal, sizeof(literal) - 1)
+
+/*!
+ * \brief Append the decimal representation of an integer to a dynamic string
+ * \since 17.0.0
+ *
+ * Equivalent to ast_str_append(buf, max_len, "%jd", value) but without the
+ * format string overhead.
+ *
+ * \return Same as ast_str_append_raw()
+ */
+int ast_str_append_int(struct ast_str **buf, ssize_t max_len, intmax_t value);
+
+/*!
+ * \brief Ensure a dynamic string can hold additional characters without regrowing
+ * \since 17.0.0
+ *
+ * Builders that know roughly how much they are about to append (for
+ * instance from a field count) can call this once up front instead of
+ * letting each append grow the buffer in turn.  Has no effect on strings
+ * that cannot grow or that already have enough space.
+ *
+ * \param buf The dynamic string
+ * \param extra Number of characters expected to be appended
+ *
+ * \retval 0 the space is available
+ * \retval -1 the string could not be extended
+ */
+AST_INLINE_API(int ast_str_reserve(struct ast_str **buf, size_t extra),
+{
+	return ast_str_make_space(buf, (*buf)->__AST_STR_USED + extra + 1);
+}
+)
+
+/*!
+ * \brief Estimate the number of characters needed for a number of "Key: Value" lines
+ * \since 17.0.0
+ *
+ * Intended to be passed to ast_str_create() or ast_str_reserve().
+ */
+#define AST_STR_FIELDS_SIZE_HINT(fields) ((fields) * 48)
+
 /*!
  * \brief Set a dynamic string using variable arguments
  *
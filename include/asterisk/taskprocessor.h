@@ -75,6 +75,17 @@ enum ast_tps_options {
 	TPS_REF_DEFAULT = 0,
 	/*! \brief return a reference to a taskprocessor ONLY if it already exists */
 	TPS_REF_IF_EXISTS = (1 << 0),
+	/*!
+	 * \brief back the queue with a lock-free multi-producer single-consumer list
+	 * \since 17.0.0
+	 *
+	 * Pushing a task onto an MPSC taskprocessor never blocks on the
+	 * taskprocessor lock.  Only valid when exactly one thread at a time
+	 * calls ast_taskprocessor_execute(), as the default listener and
+	 * threadpool serializers do.  Only honored when the taskprocessor is
+	 * created.
+	 */
+	TPS_QUEUE_MPSC = (1 << 1),
 };
 
 struct ast_taskprocessor_listener;
@@ -181,6 +192,23 @@ struct ast_taskprocessor *ast_taskprocessor_get(const char *name, enum ast_tps_o
  */
 struct ast_taskprocessor *ast_taskprocessor_create_with_listener(const char *name, struct ast_taskprocessor_listener *listener);
 
+/*!
+ * \brief Create a taskprocessor with a custom listener and creation options
+ *
+ * \since 17.0.0
+ *
+ * Same as ast_taskprocessor_create_with_listener() except that \a options
+ * may select the queue implementation (see TPS_QUEUE_MPSC).
+ *
+ * \param name The name of the taskprocessor to create
+ * \param listener The listener for operations on this taskprocessor
+ * \param options Creation options, TPS_REF_IF_EXISTS is ignored
+ * \retval NULL Failure
+ * \reval non-NULL success
+ */
+struct ast_taskprocessor *ast_taskprocessor_create_with_listener_options(const char *name,
+	struct ast_taskprocessor_listener *listener, enum ast_tps_options options);
+
 /*!
  * \brief Sets the local data associated with a taskprocessor.
  *
@@ -243,6 +271,29 @@ int ast_taskprocessor_push_local(struct ast_taskprocessor *tps,
 	int (*task_exe)(struct ast_taskprocessor_local *local), void *datap)
 	attribute_warn_unused_result;
 
+/*!
+ * \brief Push several tasks into the specified taskprocessor queue at once.
+ *
+ * \since 17.0.0
+ *
+ * The tasks are queued in array order with a single acquisition of the
+ * taskprocessor lock (or a single atomic exchange for TPS_QUEUE_MPSC
+ * taskprocessors).  The listener is still notified once per task, exactly
+ * as if each had been pushed with ast_taskprocessor_push().
+ *
+ * Either all of the tasks are queued or none are.
+ *
+ * \param tps The taskprocessor structure
+ * \param task_exe The task handling function each task runs
+ * \param datap Array of data pointers, one task is queued per element
+ * \param count Number of elements in \a datap
+ * \retval 0 success
+ * \retval -1 failure
+ */
+int ast_taskprocessor_push_batch(struct ast_taskprocessor *tps,
+	int (*task_exe)(void *datap), void **datap, size_t count)
+	attribute_warn_unused_result;
+
 /*!
  * \brief Indicate the taskprocessor is suspended.
  *
@@ -275,11 +326,34 @@ int ast_taskprocessor_unsuspend(struct ast_taskprocessor *tps);
  */
 int ast_taskprocessor_is_suspended(struct ast_taskprocessor *tps);
 
+/*!
+ * \brief Set how many tasks ast_taskprocessor_execute() may run per call.
+ *
+ * \since 17.0.0
+ *
+ * With a batch size above one, ast_taskprocessor_execute() pops up to
+ * \a batch_size queued tasks in one critical section and runs them back to
+ * back before updating the taskprocessor state once.  Tasks still run in
+ * order on the executing thread.  The default is one.
+ *
+ * \note Batching on a taskprocessor drained by several threads, such as a
+ * threadpool's own queue, keeps a batch on a single thread.
+ *
+ * \param tps Task processor.
+ * \param batch_size Maximum number of tasks to execute per call, at least one.
+ * \retval 0 success
+ * \retval -1 failure
+ */
+int ast_taskprocessor_set_batch_size(struct ast_taskprocessor *tps, unsigned int batch_size);
+
 /*!
  * \brief Pop a task off the taskprocessor and execute it.
  *
  * \since 12.0.0
  *
+ * Up to the batch size set by ast_taskprocessor_set_batch_size() tasks are
+ * popped and executed by one call.
+ *
  * \param tps The taskprocessor from which to execute.
  * \retval 0 There is no further work to be done.
  * \retval 1 Tasks still remain in the taskprocessor queue.
@@ -122,6 +122,25 @@ struct ast_threadpool_options {
 	 * a thread completes
 	 */
 	void (*thread_end)(void);
+	/*!
+	 * \brief Give each worker its own task queue and let idle workers steal
+	 * \since 17.0.0
+	 *
+	 * By default every task pushed to the pool goes through a single shared
+	 * taskprocessor queue. When this is non-zero, tasks pushed from one of the
+	 * pool's own worker threads are queued locally on that worker and tasks
+	 * pushed from elsewhere are spread across the workers. A worker that runs
+	 * out of local tasks takes tasks from the other workers' queues before
+	 * going idle.
+	 *
+	 * A serializer is queued to the pool as a single task that drains the
+	 * serializer, so a serializer is always stolen as a whole and its tasks
+	 * still execute in order.
+	 *
+	 * \note In this mode the listener's task_pushed callback is called once
+	 * per wakeup of idle workers rather than once per pushed task.
+	 */
+	int work_stealing;
 };
 
 /*!
@@ -80,6 +80,12 @@ struct ast_timing_interface {
 	enum ast_timer_event (*timer_get_event)(void *data);
 	unsigned int (*timer_get_max_rate)(void *data);
 	int (*timer_fd)(void *data);
+	/*!
+	 * \brief Optional: get how many timers are open and how many kernel
+	 * timers they share
+	 * \since 17.0.0
+	 */
+	void (*timer_get_sources)(void *data, unsigned int *timers, unsigned int *sources);
 };
 
 /*!
@@ -37,6 +37,7 @@ extern "C" {
 #endif
 
 struct ast_trans_pvt;	/* declared below */
+struct ast_translator_pool;
 
 /*!
  * \brief Translator Cost Table definition.
@@ -169,6 +170,35 @@ struct ast_translator {
 
 	struct ast_frame * (*sample)(void);    /*!< Generate an example frame */
 
+	/*!
+	 * \brief Return a pvt to the state newpvt left it in.  (optional)
+	 * \since 17.0.0
+	 *
+	 * \details Translators supplying this let the core keep a few
+	 * released pvts and hand them to later translation paths
+	 * instead of allocating and initializing new ones.  The core
+	 * resets its own fields, the callback only needs to reset the
+	 * codec state.  pvt->f.subclass.format is kept as is.
+	 *
+	 * \retval 0 if the pvt can be reused.
+	 * \retval non-zero to destroy the pvt instead.
+	 */
+	int (*reset)(struct ast_trans_pvt *pvt);
+
+	/*!
+	 * \brief Trade quality for CPU.  (optional)
+	 * \since 17.0.0
+	 *
+	 * \details A reset callback must also restore the default quality.
+	 *
+	 * \param pvt The pvt to change
+	 * \param quality From 0 (cheapest) to AST_TRANSLATOR_QUALITY_MAX (best)
+	 *
+	 * \retval 0 on success.
+	 * \retval -1 on failure.
+	 */
+	int (*set_quality)(struct ast_trans_pvt *pvt, int quality);
+
 	/*!\brief size of outbuf, in samples. Leave it 0 if you want the framein
 	 * callback deal with the frame. Set it appropriately if you
 	 * want the code to checks if the incoming frame fits the
@@ -190,6 +220,7 @@ struct ast_translator {
 	int src_fmt_index;                     /*!< index of the source format in the matrix table */
 	int dst_fmt_index;                     /*!< index of the destination format in the matrix table */
 	AST_LIST_ENTRY(ast_translator) list;   /*!< link field */
+	struct ast_translator_pool *pool;      /*!< Released pvts kept for reuse.  Private to the core. */
 };
 
 /*! \brief
@@ -317,6 +348,21 @@ struct ast_trans_pvt *ast_translator_build_path(struct ast_format *dest, struct
  */
 void ast_translator_free_path(struct ast_trans_pvt *tr);
 
+/*! \brief The best quality ast_translator_set_quality() accepts */
+#define AST_TRANSLATOR_QUALITY_MAX 10
+
+/*!
+ * \brief Trade quality for CPU on a translator path
+ * \since 17.0.0
+ *
+ * \details Only steps whose translator supports it, like the resampler,
+ * change.  The others ignore the quality.
+ *
+ * \param tr translator path to change
+ * \param quality From 0 (cheapest) to AST_TRANSLATOR_QUALITY_MAX (best)
+ */
+void ast_translator_set_quality(struct ast_trans_pvt *tr, int quality);
+
 /*!
  * \brief translates one or more frames
  * Apply an input frame into the translator and receive zero or one output frames.  Consume
@@ -84,4 +84,36 @@ static inline unsigned char AST_LIN2MU(short sample)
 
 #define AST_MULAW(a) (__ast_mulaw[(a)])
 
+/*!
+ * \brief Convert an array of mu-law samples to signed linear
+ * \since 17.0.0
+ *
+ * The result is the same as calling AST_MULAW() on each sample, but AVX2
+ * is used when the CPU supports it.
+ *
+ * \param dst Receives the signed linear samples
+ * \param src mu-law samples
+ * \param samples Number of samples to convert
+ */
+void ast_ulaw_decode_array(short *dst, const unsigned char *src, size_t samples);
+
+/*!
+ * \brief Convert an array of signed linear samples to mu-law
+ * \since 17.0.0
+ *
+ * The result is the same as calling AST_LIN2MU() on each sample, but AVX2
+ * is used when the CPU supports it.
+ *
+ * \param dst Receives the mu-law samples
+ * \param src Signed linear samples
+ * \param samples Number of samples to convert
+ */
+void ast_ulaw_encode_array(unsigned char *dst, const short *src, size_t samples);
+
+/*!
+ * \brief Name of the instruction set the mu-law and A-law array functions use
+ * \since 17.0.0
+ */
+const char *ast_g711_simd_name(void);
+
 #endif /* _ASTERISK_ULAW_H */
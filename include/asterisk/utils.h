@@ -380,6 +380,53 @@ static force_inline void ast_slinear_saturated_divide(short *input, short *value
 	*input /= *value;
 }
 
+/*!
+ * \brief Saturated add of an array of signed linear samples
+ * \since 17.0.0
+ *
+ * The result is the same as calling ast_slinear_saturated_add() on each
+ * sample, but SSE2, AVX2 or NEON is used when the CPU supports it.
+ *
+ * \param input Samples to add to, receives the result
+ * \param value Samples to add
+ * \param samples Number of samples in each array
+ */
+void ast_slinear_saturated_add_array(short *input, const short *value, size_t samples);
+
+/*!
+ * \brief Saturated subtraction of an array of signed linear samples
+ * \since 17.0.0
+ *
+ * The result is the same as calling ast_slinear_saturated_subtract() on
+ * each sample, but SSE2, AVX2 or NEON is used when the CPU supports it.
+ *
+ * \param input Samples to subtract from, receives the result
+ * \param value Samples to subtract
+ * \param samples Number of samples in each array
+ */
+void ast_slinear_saturated_subtract_array(short *input, const short *value, size_t samples);
+
+/*!
+ * \brief Average magnitude of an array of signed linear samples
+ * \since 17.0.0
+ *
+ * This is the energy measure ast_dsp_silence_with_energy() compares
+ * against its threshold, computed with SSE2, AVX2 or NEON when the CPU
+ * supports it.
+ *
+ * \param samples Samples to measure
+ * \param samples_len Number of samples
+ *
+ * \return The mean of the absolute sample values, 0 if there are none
+ */
+int ast_slinear_average_magnitude(const short *samples, size_t samples_len);
+
+/*!
+ * \brief Name of the instruction set the signed linear array functions use
+ * \since 17.0.0
+ */
+const char *ast_slinear_simd_name(void);
+
 #ifdef localtime_r
 #undef localtime_r
 #endif
@@ -433,6 +480,38 @@ int ast_background_stacksize(void);
 void ast_register_thread(char *name);
 void ast_unregister_thread(void *id);
 
+/*!
+ * \brief Name what the calling thread does, for CPU accounting
+ * \since 17.0.0
+ *
+ * \param role Role to account the thread's CPU time to, copied
+ *
+ * \note Threads are accounted to their start routine until they set a role.
+ */
+void ast_thread_role_set(const char *role);
+
+/*!
+ * \brief Callback given the CPU time used by one thread role
+ *
+ * \param role Name of the role
+ * \param threads Running threads with the role
+ * \param cpu_usec CPU time used by the role's threads, including exited ones
+ * \param data Data given to ast_thread_role_cpu_foreach()
+ */
+typedef void (*ast_thread_role_cpu_cb)(const char *role, int threads, int64_t cpu_usec, void *data);
+
+/*!
+ * \brief Report the CPU time used by each thread role
+ * \since 17.0.0
+ *
+ * \param callback Called once per role
+ * \param data Passed to callback
+ *
+ * \note The callback runs with the thread list read locked and must not
+ * start or stop threads.
+ */
+void ast_thread_role_cpu_foreach(ast_thread_role_cpu_cb callback, void *data);
+
 int ast_pthread_create_stack(pthread_t *thread, pthread_attr_t *attr, void *(*start_routine)(void *),
 			     void *data, size_t stacksize, const char *file, const char *caller,
 			     int line, const char *start_fn);
@@ -113,6 +113,8 @@ typedef struct jitterbuf {
 	long hist_maxbuf[JB_HISTORY_MAXBUF_SZ];	/*!< a sorted buffer of the max delays (highest first) */
 	long hist_minbuf[JB_HISTORY_MAXBUF_SZ];	/*!< a sorted buffer of the min delays (lowest first) */
 	int  hist_maxbuf_valid;			/*!< are the "maxbuf"/minbuf valid? */
+	int  hist_maxbuf_len;			/*!< number of valid entries in maxbuf */
+	int  hist_minbuf_len;			/*!< number of valid entries in minbuf */
 	unsigned int dropem:1;                  /*!< flag to indicate dropping frames (overload) */
 
 	jb_frame *frames; 		/*!< queued frames */
@@ -41,6 +41,8 @@
 #include "asterisk/utils.h"
 #include "asterisk/pbx.h"
 #include "asterisk/timing.h"
+#include "asterisk/alertpipe.h"
+#include "asterisk/vector.h"
 
 #include "asterisk/abstract_jb.h"
 #include "fixedjitterbuf.h"
@@ -832,23 +834,186 @@ static int jb_is_late_adaptive(void *jb, long ts)
 #define DEFAULT_RESYNC  1000
 #define DEFAULT_TYPE AST_JB_FIXED
 
+/*! Interval of the shared timer delivering frames out of the jitterbuffers, in ms */
+#define JB_DELIVERY_TICK 10
+
+/*!
+ * \brief A framehook jitterbuffer waiting on the shared delivery timer
+ *
+ * Rather than each channel arming its own timer, one thread checks every
+ * jitterbuffer each tick and only wakes the channels with a frame due.
+ */
+struct jb_wakeup {
+	/*! Written to wake the channel, the read end is its AST_JITTERBUFFER_FD */
+	int alert_pipe[2];
+	/*! When the next frame is due out of the jitterbuffer, zero when none is */
+	struct timeval due;
+	/*! The channel was woken and has not read its jitterbuffer since */
+	unsigned int pending:1;
+	/*! The jitterbuffer is gone, the delivery thread drops it on its next tick */
+	unsigned int gone:1;
+};
+
+AST_MUTEX_DEFINE_STATIC(jb_delivery_lock);
+/*! Jitterbuffers checked by the delivery thread, protected by jb_delivery_lock */
+static AST_VECTOR(, struct jb_wakeup *) jb_delivery_wakeups;
+static struct ast_timer *jb_delivery_timer;
+static pthread_t jb_delivery_thread = AST_PTHREADT_NULL;
+static int jb_delivery_stop;
+
+static void jb_wakeup_destroy(void *obj)
+{
+	struct jb_wakeup *wakeup = obj;
+
+	ast_alertpipe_close(wakeup->alert_pipe);
+}
+
+static void *jb_delivery_run(void *data)
+{
+	struct pollfd pfd = { .fd = ast_timer_fd(jb_delivery_timer), .events = POLLIN, };
+
+	while (!jb_delivery_stop) {
+		struct timeval now;
+		int i;
+
+		if (ast_poll(&pfd, 1, 1000) < 1) {
+			continue;
+		}
+		ast_timer_ack(jb_delivery_timer, 1);
+
+		now = ast_tvnow();
+		ast_mutex_lock(&jb_delivery_lock);
+		for (i = AST_VECTOR_SIZE(&jb_delivery_wakeups) - 1; i >= 0; i--) {
+			struct jb_wakeup *wakeup = AST_VECTOR_GET(&jb_delivery_wakeups, i);
+
+			ao2_lock(wakeup);
+			if (wakeup->gone) {
+				ao2_unlock(wakeup);
+				AST_VECTOR_REMOVE_UNORDERED(&jb_delivery_wakeups, i);
+				ao2_ref(wakeup, -1);
+				continue;
+			}
+			if (!wakeup->pending && !ast_tvzero(wakeup->due) && ast_tvcmp(now, wakeup->due) >= 0) {
+				ast_alertpipe_write(wakeup->alert_pipe);
+				wakeup->pending = 1;
+			}
+			ao2_unlock(wakeup);
+		}
+		ast_mutex_unlock(&jb_delivery_lock);
+	}
+
+	return NULL;
+}
+
+static void jb_delivery_shutdown(void)
+{
+	ast_mutex_lock(&jb_delivery_lock);
+	jb_delivery_stop = 1;
+	ast_mutex_unlock(&jb_delivery_lock);
+
+	if (jb_delivery_thread != AST_PTHREADT_NULL) {
+		pthread_join(jb_delivery_thread, NULL);
+		jb_delivery_thread = AST_PTHREADT_NULL;
+	}
+
+	AST_VECTOR_CALLBACK_VOID(&jb_delivery_wakeups, ao2_cleanup);
+	AST_VECTOR_FREE(&jb_delivery_wakeups);
+	if (jb_delivery_timer) {
+		ast_timer_close(jb_delivery_timer);
+		jb_delivery_timer = NULL;
+	}
+}
+
+/*! \brief Start the delivery thread if needed, jb_delivery_lock must be held */
+static int jb_delivery_start(void)
+{
+	if (jb_delivery_thread != AST_PTHREADT_NULL) {
+		return 0;
+	}
+	if (jb_delivery_stop) {
+		return -1;
+	}
+
+	if (!jb_delivery_timer) {
+		if (!(jb_delivery_timer = ast_timer_open())) {
+			return -1;
+		}
+		if (ast_timer_set_rate(jb_delivery_timer, 1000 / JB_DELIVERY_TICK)) {
+			ast_timer_close(jb_delivery_timer);
+			jb_delivery_timer = NULL;
+			return -1;
+		}
+		AST_VECTOR_INIT(&jb_delivery_wakeups, 64);
+		ast_register_cleanup(jb_delivery_shutdown);
+	}
+
+	if (ast_pthread_create_background(&jb_delivery_thread, NULL, jb_delivery_run, NULL)) {
+		jb_delivery_thread = AST_PTHREADT_NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*! \brief Create a jitterbuffer wakeup and have the delivery thread check it */
+static struct jb_wakeup *jb_wakeup_alloc(void)
+{
+	struct jb_wakeup *wakeup;
+
+	wakeup = ao2_alloc(sizeof(*wakeup), jb_wakeup_destroy);
+	if (!wakeup) {
+		return NULL;
+	}
+	wakeup->alert_pipe[0] = wakeup->alert_pipe[1] = -1;
+
+	if (ast_alertpipe_init(wakeup->alert_pipe)) {
+		ao2_ref(wakeup, -1);
+		return NULL;
+	}
+
+	ast_mutex_lock(&jb_delivery_lock);
+	if (jb_delivery_start() || AST_VECTOR_APPEND(&jb_delivery_wakeups, wakeup)) {
+		ast_mutex_unlock(&jb_delivery_lock);
+		ao2_ref(wakeup, -1);
+		return NULL;
+	}
+	ao2_ref(wakeup, +1);
+	ast_mutex_unlock(&jb_delivery_lock);
+
+	return wakeup;
+}
+
+/*! \brief Clear a wakeup once the channel reads its jitterbuffer, and set when it is next due */
+static void jb_wakeup_update(struct jb_wakeup *wakeup, struct timeval due)
+{
+	ao2_lock(wakeup);
+	if (wakeup->pending) {
+		ast_alertpipe_flush(wakeup->alert_pipe);
+		wakeup->pending = 0;
+	}
+	wakeup->due = due;
+	ao2_unlock(wakeup);
+}
+
 struct jb_framedata {
 	const struct ast_jb_impl *jb_impl;
 	struct ast_jb_conf jb_conf;
 	struct timeval start_tv;
 	struct ast_format *last_format;
-	struct ast_timer *timer;
+	struct jb_wakeup *wakeup;
 	int timer_interval; /* ms between deliveries */
-	int timer_fd;
 	int first;
 	void *jb_obj;
 };
 
 static void jb_framedata_destroy(struct jb_framedata *framedata)
 {
-	if (framedata->timer) {
-		ast_timer_close(framedata->timer);
-		framedata->timer = NULL;
+	if (framedata->wakeup) {
+		ao2_lock(framedata->wakeup);
+		framedata->wakeup->gone = 1;
+		ao2_unlock(framedata->wakeup);
+		ao2_ref(framedata->wakeup, -1);
+		framedata->wakeup = NULL;
 	}
 	if (framedata->jb_impl && framedata->jb_obj) {
 		struct ast_frame *f;
@@ -886,29 +1051,12 @@ static void hook_destroy_cb(void *framedata)
 	jb_framedata_destroy((struct jb_framedata *) framedata);
 }
 
-static struct ast_frame *hook_event_cb(struct ast_channel *chan, struct ast_frame *frame, enum ast_framehook_event event, void *data)
+static struct ast_frame *hook_event_read(struct ast_channel *chan, struct ast_frame *frame, struct jb_framedata *framedata)
 {
-	struct jb_framedata *framedata = data;
 	struct timeval now_tv;
 	unsigned long now;
 	int putframe = 0; /* signifies if audio frame was placed into the buffer or not */
 
-	switch (event) {
-	case AST_FRAMEHOOK_EVENT_READ:
-		break;
-	case AST_FRAMEHOOK_EVENT_ATTACHED:
-	case AST_FRAMEHOOK_EVENT_DETACHED:
-	case AST_FRAMEHOOK_EVENT_WRITE:
-		return frame;
-	}
-
-	if (ast_channel_fdno(chan) == AST_JITTERBUFFER_FD && framedata->timer) {
-		if (ast_timer_ack(framedata->timer, 1) < 0) {
-			ast_log(LOG_ERROR, "Failed to acknowledge timer in jitter buffer\n");
-			return frame;
-		}
-	}
-
 	/*
 	 * If the frame has been requeued (for instance when the translate core returns
 	 * more than one frame) then if the frame is late we want to immediately return
@@ -945,7 +1093,6 @@ static struct ast_frame *hook_event_cb(struct ast_channel *chan, struct ast_fram
 
 		if (frame->len && (frame->len != framedata->timer_interval)) {
 			framedata->timer_interval = frame->len;
-			ast_timer_set_rate(framedata->timer, 1000 / framedata->timer_interval);
 		}
 		if (!framedata->first) {
 			framedata->first = 1;
@@ -1038,12 +1185,36 @@ static struct ast_frame *hook_event_cb(struct ast_channel *chan, struct ast_fram
 	return frame;
 }
 
+static struct ast_frame *hook_event_cb(struct ast_channel *chan, struct ast_frame *frame, enum ast_framehook_event event, void *data)
+{
+	struct jb_framedata *framedata = data;
+	struct timeval due = { 0, };
+
+	switch (event) {
+	case AST_FRAMEHOOK_EVENT_READ:
+		break;
+	case AST_FRAMEHOOK_EVENT_ATTACHED:
+	case AST_FRAMEHOOK_EVENT_DETACHED:
+	case AST_FRAMEHOOK_EVENT_WRITE:
+		return frame;
+	}
+
+	frame = hook_event_read(chan, frame, framedata);
+
+	/* Nothing comes out of the jitterbuffer until the first frame went in */
+	if (framedata->first) {
+		due = ast_tvadd(framedata->start_tv, ast_samp2tv(framedata->jb_impl->next(framedata->jb_obj), 1000));
+	}
+	jb_wakeup_update(framedata->wakeup, due);
+
+	return frame;
+}
+
 /* set defaults */
 static int jb_framedata_init(struct jb_framedata *framedata, struct ast_jb_conf *jb_conf)
 {
 	int jb_impl_type = DEFAULT_TYPE;
 	/* Initialize defaults */
-	framedata->timer_fd = -1;
 	memcpy(&framedata->jb_conf, jb_conf, sizeof(*jb_conf));
 
 	/* Figure out implementation type from the configuration implementation string */
@@ -1062,13 +1233,11 @@ static int jb_framedata_init(struct jb_framedata *framedata, struct ast_jb_conf
 		return -1;
 	}
 
-	if (!(framedata->timer = ast_timer_open())) {
+	if (!(framedata->wakeup = jb_wakeup_alloc())) {
 		return -1;
 	}
 
-	framedata->timer_fd = ast_timer_fd(framedata->timer);
 	framedata->timer_interval = DEFAULT_TIMER_INTERVAL;
-	ast_timer_set_rate(framedata->timer, 1000 / framedata->timer_interval);
 	framedata->start_tv = ast_tvnow();
 
 	framedata->jb_obj = framedata->jb_impl->create(&framedata->jb_conf);
@@ -1148,7 +1317,7 @@ void ast_jb_create_framehook(struct ast_channel *chan, struct ast_jb_conf *jb_co
 		datastore->data = id;
 		ast_channel_datastore_add(chan, datastore);
 
-		ast_channel_set_fd(chan, AST_JITTERBUFFER_FD, framedata->timer_fd);
+		ast_channel_set_fd(chan, AST_JITTERBUFFER_FD, ast_alertpipe_readfd(framedata->wakeup->alert_pipe));
 	} else {
 		jb_framedata_destroy(framedata);
 		framedata = NULL;
@@ -44,6 +44,7 @@
 #endif
 
 #include "asterisk/acl.h"
+#include "asterisk/astobj2.h"
 #include "asterisk/channel.h"
 #include "asterisk/utils.h"
 #include "asterisk/lock.h"
@@ -240,6 +241,7 @@ struct ast_acl_list *ast_free_acl_list(struct ast_acl_list *acl_list)
 	AST_LIST_LOCK(acl_list);
 	while ((current = AST_LIST_REMOVE_HEAD(acl_list, list))) {
 		ast_free_ha(current->acl);
+		ao2_cleanup(current->trie);
 		ast_free(current);
 	}
 	AST_LIST_UNLOCK(acl_list);
@@ -341,6 +343,7 @@ struct ast_acl_list *ast_duplicate_acl_list(struct ast_acl_list *original)
 
 		/* Copy data from original ACL to clone ACL */
 		current_clone->acl = ast_duplicate_ha_list(current_cursor->acl);
+		current_clone->trie = ao2_bump(current_cursor->trie);
 
 		current_clone->is_invalid = current_cursor->is_invalid;
 		current_clone->is_realtime = current_cursor->is_realtime;
@@ -477,6 +480,8 @@ void ast_append_acl(const char *sense, const char *stuff, struct ast_acl_list **
 
 		/* With the proper ACL set for modification, we can just pass this off to the ast_ha append function. */
 		acl->acl = ast_append_ha(sense, stuff, acl->acl, error);
+		ao2_cleanup(acl->trie);
+		acl->trie = NULL;
 
 		AST_LIST_UNLOCK(working_list);
 		return;
@@ -520,7 +525,7 @@ void ast_append_acl(const char *sense, const char *stuff, struct ast_acl_list **
 		}
 
 		/* Attempt to grab the Named ACL we are looking for. */
-		named_ha = ast_named_acl_find(tmp, &acl->is_realtime, &acl->is_invalid);
+		named_ha = ast_named_acl_find_compiled(tmp, &acl->trie, &acl->is_realtime, &acl->is_invalid);
 
 		/* Set the ACL's ast_ha to the duplicated named ACL retrieved above. */
 		acl->acl = named_ha;
@@ -744,7 +749,15 @@ enum ast_acl_sense ast_apply_acl(struct ast_acl_list *acl_list, const struct ast
 		}
 
 		if (acl->acl) {
-			if (ast_apply_ha(acl->acl, addr) == AST_SENSE_DENY) {
+			enum ast_acl_sense sense;
+
+			/* Compile the rules on first use, the list lock keeps it to one thread */
+			if (!acl->trie) {
+				acl->trie = ast_ha_trie_alloc(acl->acl);
+			}
+			sense = acl->trie ? ast_apply_ha_trie(acl->trie, addr) : ast_apply_ha(acl->acl, addr);
+
+			if (sense == AST_SENSE_DENY) {
 				ast_log(LOG_NOTICE, "%sRejecting '%s' due to a failure to pass ACL '%s'\n", purpose ? purpose : "", ast_sockaddr_stringify_addr(addr),
 						ast_strlen_zero(acl->name) ? "(BASELINE)" : acl->name);
 				AST_LIST_UNLOCK(acl_list);
@@ -758,6 +771,55 @@ enum ast_acl_sense ast_apply_acl(struct ast_acl_list *acl_list, const struct ast
 	return AST_SENSE_ALLOW;
 }
 
+/*!
+ * \internal
+ * \brief Determine whether a single host access rule applies to an address
+ *
+ * \retval 1 The rule applies
+ * \retval 0 The rule does not apply
+ */
+static int ha_rule_matches(const struct ast_ha *ha, const struct ast_sockaddr *addr)
+{
+	struct ast_sockaddr result;
+	struct ast_sockaddr mapped_addr;
+	const struct ast_sockaddr *addr_to_use;
+
+	if (ast_sockaddr_is_ipv4(&ha->addr)) {
+		if (ast_sockaddr_is_ipv6(addr)) {
+			if (ast_sockaddr_is_ipv4_mapped(addr)) {
+				/* IPv4 ACLs apply to IPv4-mapped addresses */
+				if (!ast_sockaddr_ipv4_mapped(addr, &mapped_addr)) {
+					ast_log(LOG_ERROR, "%s provided to ast_sockaddr_ipv4_mapped could not be converted. That shouldn't be possible.\n",
+						ast_sockaddr_stringify(addr));
+					return 0;
+				}
+				addr_to_use = &mapped_addr;
+			} else {
+				/* An IPv4 ACL does not apply to an IPv6 address */
+				return 0;
+			}
+		} else {
+			/* Address is IPv4 and ACL is IPv4. No biggie */
+			addr_to_use = addr;
+		}
+	} else {
+		if (ast_sockaddr_is_ipv6(addr) && !ast_sockaddr_is_ipv4_mapped(addr)) {
+			addr_to_use = addr;
+		} else {
+			/* Address is IPv4 or IPv4 mapped but ACL is IPv6. Skip */
+			return 0;
+		}
+	}
+
+	/* If this address and the netmask = the net address the rule applies */
+	if (ast_sockaddr_apply_netmask(addr_to_use, &ha->netmask, &result)) {
+		/* Unlikely to happen since we know the address to be IPv4 or IPv6 */
+		return 0;
+	}
+
+	return !ast_sockaddr_cmp_addr(&result, &ha->addr);
+}
+
 enum ast_acl_sense ast_apply_ha(const struct ast_ha *ha, const struct ast_sockaddr *addr)
 {
 	/* Start optimistic */
@@ -765,54 +827,223 @@ enum ast_acl_sense ast_apply_ha(const struct ast_ha *ha, const struct ast_sockad
 	const struct ast_ha *current_ha;
 
 	for (current_ha = ha; current_ha; current_ha = current_ha->next) {
-		struct ast_sockaddr result;
-		struct ast_sockaddr mapped_addr;
-		const struct ast_sockaddr *addr_to_use;
-#if 0	/* debugging code */
-		char iabuf[INET_ADDRSTRLEN];
-		char iabuf2[INET_ADDRSTRLEN];
-		/* DEBUG */
-		ast_copy_string(iabuf, ast_sockaddr_stringify(addr), sizeof(iabuf));
-		ast_copy_string(iabuf2, ast_sockaddr_stringify(&current_ha->addr), sizeof(iabuf2));
-		ast_debug(1, "##### Testing %s with %s\n", iabuf, iabuf2);
-#endif
-		if (ast_sockaddr_is_ipv4(&current_ha->addr)) {
-			if (ast_sockaddr_is_ipv6(addr)) {
-				if (ast_sockaddr_is_ipv4_mapped(addr)) {
-					/* IPv4 ACLs apply to IPv4-mapped addresses */
-					if (!ast_sockaddr_ipv4_mapped(addr, &mapped_addr)) {
-						ast_log(LOG_ERROR, "%s provided to ast_sockaddr_ipv4_mapped could not be converted. That shouldn't be possible.\n",
-							ast_sockaddr_stringify(addr));
-						continue;
-					}
-					addr_to_use = &mapped_addr;
-				} else {
-					/* An IPv4 ACL does not apply to an IPv6 address */
-					continue;
-				}
-			} else {
-				/* Address is IPv4 and ACL is IPv4. No biggie */
-				addr_to_use = addr;
-			}
-		} else {
-			if (ast_sockaddr_is_ipv6(addr) && !ast_sockaddr_is_ipv4_mapped(addr)) {
-				addr_to_use = addr;
-			} else {
-				/* Address is IPv4 or IPv4 mapped but ACL is IPv6. Skip */
-				continue;
+		if (ha_rule_matches(current_ha, addr)) {
+			res = current_ha->sense;
+		}
+	}
+	return res;
+}
+
+/*! \brief Index of the IPv4 root in the nodes of an ast_ha_trie */
+#define HA_TRIE_ROOT_IPV4 0
+/*! \brief Index of the IPv6 root in the nodes of an ast_ha_trie */
+#define HA_TRIE_ROOT_IPV6 1
+
+/*! \brief Get a bit of an address in network byte order, counting from the most significant */
+#define HA_TRIE_BIT(bytes, bit) (((bytes)[(bit) / 8] >> (7 - (bit) % 8)) & 1)
+
+/*! \brief A node of a compiled host access rule trie */
+struct ha_trie_node {
+	/*! \brief Nodes for the next address bit being 0 or 1, 0 if there is none */
+	unsigned int child[2];
+	/*! \brief Position in the rule list plus one of the last rule for this network, 0 if none */
+	unsigned int rule;
+	/*! \brief Sense of that rule */
+	enum ast_acl_sense sense;
+};
+
+/*! \brief A rule the trie cannot hold, kept with its position in the rule list */
+struct ha_trie_rule {
+	struct ast_ha ha;
+	unsigned int rule;
+};
+
+struct ast_ha_trie {
+	/*! \brief All nodes of the IPv4 and IPv6 tries, starting with their roots */
+	AST_VECTOR(, struct ha_trie_node) nodes;
+	/*! \brief Rules with a netmask that is not a prefix, checked one by one */
+	AST_VECTOR(, struct ha_trie_rule) others;
+};
+
+/*!
+ * \internal
+ * \brief Copy the address of an ast_sockaddr in network byte order
+ *
+ * \return The number of bits in the address, or 0 if it is neither IPv4 nor IPv6
+ */
+static int ha_trie_address(const struct ast_sockaddr *addr, unsigned char bytes[16])
+{
+	if (ast_sockaddr_is_ipv4(addr)) {
+		uint32_t ipv4 = htonl(ast_sockaddr_ipv4(addr));
+
+		memcpy(bytes, &ipv4, sizeof(ipv4));
+		return 32;
+	} else if (ast_sockaddr_is_ipv6(addr)) {
+		memcpy(bytes, &((const struct sockaddr_in6 *) &addr->ss)->sin6_addr, 16);
+		return 128;
+	}
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Find the prefix a rule matches on
+ *
+ * \param ha The rule
+ * \param[out] bytes The network address of the rule
+ * \param[out] bits The number of bits in the address
+ *
+ * \return The prefix length, or -1 if the rule is not a plain network prefix
+ */
+static int ha_trie_prefix(const struct ast_ha *ha, unsigned char bytes[16], int *bits)
+{
+	unsigned char netmask[16];
+	int prefix;
+	int bit;
+
+	*bits = ha_trie_address(&ha->addr, bytes);
+	if (!*bits || ha_trie_address(&ha->netmask, netmask) != *bits) {
+		return -1;
+	}
+
+	for (prefix = 0; prefix < *bits && HA_TRIE_BIT(netmask, prefix); ++prefix) {
+	}
+
+	/* The rest of the netmask must be zeroes, and so must the address under them */
+	for (bit = prefix; bit < *bits; ++bit) {
+		if (HA_TRIE_BIT(netmask, bit) || HA_TRIE_BIT(bytes, bit)) {
+			return -1;
+		}
+	}
+
+	return prefix;
+}
+
+static int ha_trie_insert(struct ast_ha_trie *trie, const struct ast_ha *ha, unsigned int rule)
+{
+	unsigned char bytes[16];
+	struct ha_trie_node *node;
+	unsigned int current;
+	int prefix;
+	int bits;
+	int bit;
+
+	prefix = ha_trie_prefix(ha, bytes, &bits);
+	if (prefix < 0) {
+		struct ha_trie_rule other = { .rule = rule, };
+
+		ast_copy_ha(ha, &other.ha);
+		return AST_VECTOR_APPEND(&trie->others, other);
+	}
+
+	current = bits == 32 ? HA_TRIE_ROOT_IPV4 : HA_TRIE_ROOT_IPV6;
+	for (bit = 0; bit < prefix; ++bit) {
+		int next = HA_TRIE_BIT(bytes, bit);
+		unsigned int child = AST_VECTOR_GET_ADDR(&trie->nodes, current)->child[next];
+
+		if (!child) {
+			struct ha_trie_node empty = { .sense = AST_SENSE_ALLOW, };
+
+			child = AST_VECTOR_SIZE(&trie->nodes);
+			if (AST_VECTOR_APPEND(&trie->nodes, empty)) {
+				return -1;
 			}
+			AST_VECTOR_GET_ADDR(&trie->nodes, current)->child[next] = child;
 		}
+		current = child;
+	}
 
-		/* For each rule, if this address and the netmask = the net address
-		   apply the current rule */
-		if (ast_sockaddr_apply_netmask(addr_to_use, &current_ha->netmask, &result)) {
-			/* Unlikely to happen since we know the address to be IPv4 or IPv6 */
-			continue;
+	/* A later rule for the same network always wins over an earlier one */
+	node = AST_VECTOR_GET_ADDR(&trie->nodes, current);
+	node->rule = rule;
+	node->sense = ha->sense;
+
+	return 0;
+}
+
+static void ha_trie_destroy(void *obj)
+{
+	struct ast_ha_trie *trie = obj;
+
+	AST_VECTOR_FREE(&trie->nodes);
+	AST_VECTOR_FREE(&trie->others);
+}
+
+struct ast_ha_trie *ast_ha_trie_alloc(const struct ast_ha *ha)
+{
+	struct ast_ha_trie *trie;
+	struct ha_trie_node root = { .sense = AST_SENSE_ALLOW, };
+	unsigned int rule = 0;
+
+	trie = ao2_alloc_options(sizeof(*trie), ha_trie_destroy, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!trie) {
+		return NULL;
+	}
+
+	if (AST_VECTOR_INIT(&trie->nodes, 64)
+		|| AST_VECTOR_APPEND(&trie->nodes, root)
+		|| AST_VECTOR_APPEND(&trie->nodes, root)) {
+		ao2_ref(trie, -1);
+		return NULL;
+	}
+
+	for (; ha; ha = ha->next) {
+		if (ha_trie_insert(trie, ha, ++rule)) {
+			ao2_ref(trie, -1);
+			return NULL;
 		}
-		if (!ast_sockaddr_cmp_addr(&result, &current_ha->addr)) {
-			res = current_ha->sense;
+	}
+
+	AST_VECTOR_COMPACT(&trie->nodes);
+	AST_VECTOR_COMPACT(&trie->others);
+
+	return trie;
+}
+
+enum ast_acl_sense ast_apply_ha_trie(const struct ast_ha_trie *trie, const struct ast_sockaddr *addr)
+{
+	struct ast_sockaddr mapped_addr;
+	unsigned char bytes[16];
+	unsigned int current;
+	unsigned int rule = 0;
+	enum ast_acl_sense res = AST_SENSE_ALLOW;
+	int bits;
+	int bit;
+	int idx;
+
+	/* IPv4 ACLs apply to IPv4-mapped addresses */
+	if (ast_sockaddr_is_ipv4_mapped(addr) && ast_sockaddr_ipv4_mapped(addr, &mapped_addr)) {
+		bits = ha_trie_address(&mapped_addr, bytes);
+	} else {
+		bits = ha_trie_address(addr, bytes);
+	}
+
+	/* Every network on the path applies, and the rule latest in the list wins */
+	if (bits) {
+		current = bits == 32 ? HA_TRIE_ROOT_IPV4 : HA_TRIE_ROOT_IPV6;
+		for (bit = 0; ; ++bit) {
+			const struct ha_trie_node *node = AST_VECTOR_GET_ADDR(&trie->nodes, current);
+
+			if (node->rule > rule) {
+				rule = node->rule;
+				res = node->sense;
+			}
+			if (bit == bits || !(current = node->child[HA_TRIE_BIT(bytes, bit)])) {
+				break;
+			}
 		}
 	}
+
+	for (idx = 0; idx < AST_VECTOR_SIZE(&trie->others); ++idx) {
+		const struct ha_trie_rule *other = AST_VECTOR_GET_ADDR(&trie->others, idx);
+
+		if (other->rule > rule && ha_rule_matches(&other->ha, addr)) {
+			rule = other->rule;
+			res = other->ha.sense;
+		}
+	}
+
 	return res;
 }
 
@@ -0,0 +1,188 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2019, Sangoma Technologies Corporation
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*! \file
+ *
+ * \brief Arena (bump) allocator for short lived allocations
+ */
+
+/*** MODULEINFO
+	<support_level>core</support_level>
+ ***/
+
+#include "asterisk.h"
+
+#include "asterisk/arena.h"
+#include "asterisk/utils.h"
+#include "asterisk/threadstorage.h"
+
+/*! Chunk size used when none is given */
+#define ARENA_DEFAULT_CHUNK_SIZE 4096
+
+/*! Alignment of every allocation */
+#define ARENA_ALIGN (2 * sizeof(void *))
+
+#define ARENA_ROUND(size) (((size) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+struct arena_chunk {
+	/*! The chunk allocated before this one */
+	struct arena_chunk *prev;
+	/*! Usable bytes in data */
+	size_t size;
+	/*! Bytes of data handed out */
+	size_t used;
+	/*! Start of the usable memory, aligned to ARENA_ALIGN */
+	unsigned char data[] __attribute__((aligned(2 * sizeof(void *))));
+};
+
+struct ast_arena {
+	/*! Chunk allocations currently come from */
+	struct arena_chunk *current;
+	/*! Most recently released standard sized chunk, kept to avoid malloc churn */
+	struct arena_chunk *spare;
+	/*! Size of standard chunks */
+	size_t chunk_size;
+};
+
+static void arena_free_chunks(struct ast_arena *arena)
+{
+	struct arena_chunk *chunk;
+
+	while ((chunk = arena->current)) {
+		arena->current = chunk->prev;
+		ast_free(chunk);
+	}
+	ast_free(arena->spare);
+	arena->spare = NULL;
+}
+
+struct ast_arena *ast_arena_create(size_t chunk_size)
+{
+	struct ast_arena *arena;
+
+	arena = ast_calloc(1, sizeof(*arena));
+	if (!arena) {
+		return NULL;
+	}
+	arena->chunk_size = chunk_size ? ARENA_ROUND(chunk_size) : ARENA_DEFAULT_CHUNK_SIZE;
+
+	return arena;
+}
+
+void ast_arena_destroy(struct ast_arena *arena)
+{
+	if (!arena) {
+		return;
+	}
+	arena_free_chunks(arena);
+	ast_free(arena);
+}
+
+static void arena_thread_cleanup(void *data)
+{
+	struct ast_arena *arena = data;
+
+	arena_free_chunks(arena);
+	ast_free(arena);
+}
+
+AST_THREADSTORAGE_CUSTOM(arena_thread_buf, NULL, arena_thread_cleanup);
+
+struct ast_arena *ast_arena_thread_get(void)
+{
+	struct ast_arena *arena;
+
+	arena = ast_threadstorage_get(&arena_thread_buf, sizeof(*arena));
+	if (arena && !arena->chunk_size) {
+		arena->chunk_size = ARENA_DEFAULT_CHUNK_SIZE;
+	}
+
+	return arena;
+}
+
+void ast_arena_mark(struct ast_arena *arena, struct ast_arena_mark *mark)
+{
+	mark->chunk = arena->current;
+	mark->used = arena->current ? arena->current->used : 0;
+}
+
+void ast_arena_release(struct ast_arena *arena, const struct ast_arena_mark *mark)
+{
+	struct arena_chunk *chunk;
+
+	while ((chunk = arena->current) && chunk != mark->chunk) {
+		arena->current = chunk->prev;
+		if (chunk->size == arena->chunk_size) {
+			ast_free(arena->spare);
+			arena->spare = chunk;
+		} else {
+			ast_free(chunk);
+		}
+	}
+
+	if (arena->current) {
+		arena->current->used = mark->used;
+	}
+}
+
+void *ast_arena_alloc(struct ast_arena *arena, size_t size)
+{
+	struct arena_chunk *chunk = arena->current;
+	void *ptr;
+
+	size = ARENA_ROUND(size ? size : 1);
+
+	if (!chunk || chunk->size - chunk->used < size) {
+		if (size <= arena->chunk_size && arena->spare) {
+			chunk = arena->spare;
+			arena->spare = NULL;
+		} else {
+			size_t chunk_size = MAX(size, arena->chunk_size);
+
+			chunk = ast_malloc(sizeof(*chunk) + chunk_size);
+			if (!chunk) {
+				return NULL;
+			}
+			chunk->size = chunk_size;
+		}
+		chunk->used = 0;
+		chunk->prev = arena->current;
+		arena->current = chunk;
+	}
+
+	ptr = chunk->data + chunk->used;
+	chunk->used += size;
+
+	return ptr;
+}
+
+char *ast_arena_strdup(struct ast_arena *arena, const char *str)
+{
+	size_t len;
+	char *copy;
+
+	if (!str) {
+		return NULL;
+	}
+
+	len = strlen(str) + 1;
+	copy = ast_arena_alloc(arena, len);
+	if (copy) {
+		memcpy(copy, str, len);
+	}
+
+	return copy;
+}
@@ -201,6 +201,7 @@ int daemon(int, int);  /* defined in libresolv of all places */
 #include "asterisk/pickup.h"
 #include "asterisk/acl.h"
 #include "asterisk/ulaw.h"
+#include "asterisk/dsp.h"
 #include "asterisk/alaw.h"
 #include "asterisk/callerid.h"
 #include "asterisk/image.h"
@@ -399,12 +400,40 @@ static struct {
 struct thread_list_t {
 	AST_RWLIST_ENTRY(thread_list_t) list;
 	char *name;
+	/*! What the thread does, for CPU accounting */
+	char *role;
 	pthread_t id;
 	int lwp;
 };
 
 static AST_RWLIST_HEAD_STATIC(thread_list, thread_list_t);
 
+/*! \brief CPU time used by the exited threads of a role */
+struct thread_role_retired {
+	char *role;
+	int64_t cpu_usec;
+};
+
+/*! Exited thread CPU time by role, protected by the thread_list lock */
+static AST_VECTOR(, struct thread_role_retired) retired_roles;
+
+/*!
+ * \internal
+ * \brief CPU time a running registered thread has used
+ *
+ * \note The thread_list lock must be held so the thread can not exit.
+ */
+static int64_t thread_cpu_usec(pthread_t id)
+{
+	clockid_t clock;
+	struct timespec ts;
+
+	if (pthread_getcpuclockid(id, &clock) || clock_gettime(clock, &ts)) {
+		return 0;
+	}
+	return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 void ast_register_thread(char *name)
 {
 	struct thread_list_t *new = ast_calloc(1, sizeof(*new));
@@ -416,6 +445,8 @@ void ast_register_thread(char *name)
 	new->id = pthread_self();
 	new->lwp = ast_get_tid();
 	new->name = name; /* steal the allocated memory for the thread name */
+	/* The name starts with the start routine, which is the default role */
+	new->role = ast_strndup(S_OR(name, "unknown"), strcspn(S_OR(name, "unknown"), " "));
 	AST_RWLIST_WRLOCK(&thread_list);
 	AST_RWLIST_INSERT_HEAD(&thread_list, new, list);
 	AST_RWLIST_UNLOCK(&thread_list);
@@ -424,6 +455,8 @@ void ast_register_thread(char *name)
 void ast_unregister_thread(void *id)
 {
 	struct thread_list_t *x;
+	struct thread_role_retired retired;
+	int i;
 
 	AST_RWLIST_WRLOCK(&thread_list);
 	AST_RWLIST_TRAVERSE_SAFE_BEGIN(&thread_list, x, list) {
@@ -433,13 +466,108 @@ void ast_unregister_thread(void *id)
 		}
 	}
 	AST_RWLIST_TRAVERSE_SAFE_END;
+	if (x && x->role && pthread_equal(x->id, pthread_self())) {
+		/* Keep the time of exited threads so a role's total does not drop */
+		for (i = 0; i < AST_VECTOR_SIZE(&retired_roles); ++i) {
+			if (!strcmp(AST_VECTOR_GET(&retired_roles, i).role, x->role)) {
+				AST_VECTOR_GET_ADDR(&retired_roles, i)->cpu_usec += thread_cpu_usec(x->id);
+				break;
+			}
+		}
+		if (i == AST_VECTOR_SIZE(&retired_roles)) {
+			retired.role = x->role;
+			retired.cpu_usec = thread_cpu_usec(x->id);
+			if (!AST_VECTOR_APPEND(&retired_roles, retired)) {
+				x->role = NULL;
+			}
+		}
+	}
 	AST_RWLIST_UNLOCK(&thread_list);
 	if (x) {
+		ast_free(x->role);
 		ast_free(x->name);
 		ast_free(x);
 	}
 }
 
+void ast_thread_role_set(const char *role)
+{
+	struct thread_list_t *cur;
+	pthread_t self = pthread_self();
+	char *copy = ast_strdup(role);
+
+	if (!copy) {
+		return;
+	}
+
+	AST_RWLIST_WRLOCK(&thread_list);
+	AST_RWLIST_TRAVERSE(&thread_list, cur, list) {
+		if (pthread_equal(cur->id, self)) {
+			ast_free(cur->role);
+			cur->role = copy;
+			copy = NULL;
+			break;
+		}
+	}
+	AST_RWLIST_UNLOCK(&thread_list);
+
+	ast_free(copy);
+}
+
+/*! \brief CPU time of a role while it is being totalled */
+struct thread_role_cpu {
+	const char *role;
+	int threads;
+	int64_t cpu_usec;
+};
+
+AST_VECTOR(thread_role_cpus, struct thread_role_cpu);
+
+static void thread_role_cpu_add(struct thread_role_cpus *roles, const char *role, int threads,
+	int64_t cpu_usec)
+{
+	struct thread_role_cpu entry = { role, threads, cpu_usec };
+	int i;
+
+	for (i = 0; i < AST_VECTOR_SIZE(roles); ++i) {
+		if (!strcmp(AST_VECTOR_GET(roles, i).role, role)) {
+			AST_VECTOR_GET_ADDR(roles, i)->threads += threads;
+			AST_VECTOR_GET_ADDR(roles, i)->cpu_usec += cpu_usec;
+			return;
+		}
+	}
+	AST_VECTOR_APPEND(roles, entry);
+}
+
+void ast_thread_role_cpu_foreach(ast_thread_role_cpu_cb callback, void *data)
+{
+	struct thread_role_cpus roles;
+	struct thread_list_t *cur;
+	int i;
+
+	if (AST_VECTOR_INIT(&roles, 32)) {
+		return;
+	}
+
+	AST_RWLIST_RDLOCK(&thread_list);
+	for (i = 0; i < AST_VECTOR_SIZE(&retired_roles); ++i) {
+		thread_role_cpu_add(&roles, AST_VECTOR_GET(&retired_roles, i).role, 0,
+			AST_VECTOR_GET(&retired_roles, i).cpu_usec);
+	}
+	AST_RWLIST_TRAVERSE(&thread_list, cur, list) {
+		if (cur->role) {
+			thread_role_cpu_add(&roles, cur->role, 1, thread_cpu_usec(cur->id));
+		}
+	}
+	for (i = 0; i < AST_VECTOR_SIZE(&roles); ++i) {
+		callback(AST_VECTOR_GET(&roles, i).role, AST_VECTOR_GET(&roles, i).threads,
+			AST_VECTOR_GET(&roles, i).cpu_usec, data);
+	}
+	AST_RWLIST_UNLOCK(&thread_list);
+
+	AST_VECTOR_FREE(&roles);
+}
+
 /*! \brief Give an overview of core settings */
 static char *handle_show_settings(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
@@ -512,6 +640,11 @@ static char *handle_show_settings(struct ast_cli_entry *e, int cmd, struct ast_c
 #if !defined(LOW_MEMORY)
 	ast_cli(a->fd, "  Cache media frames:          %s\n", ast_opt_cache_media_frames ? "Enabled" : "Disabled");
 #endif
+	ast_cli(a->fd, "  Map sound files:             %s\n", ast_opt_mmap_sound_files ? "Enabled" : "Disabled");
+	ast_cli(a->fd, "  File writer threads:         %u\n", ast_option_file_writer_threads);
+	ast_cli(a->fd, "  Signed linear mixing:        %s\n", ast_slinear_simd_name());
+	ast_cli(a->fd, "  G.711 conversion:            %s\n", ast_g711_simd_name());
+	ast_cli(a->fd, "  DTMF/MF goertzels:           %s\n", ast_goertzel_simd_name());
 	ast_cli(a->fd, "  RTP use dynamic payloads:    %u\n", ast_option_rtpusedynamic);
 
 	if (ast_option_rtpptdynamic == AST_RTP_PT_LAST_REASSIGN) {
@@ -579,6 +712,103 @@ static char *handle_show_threads(struct ast_cli_entry *e, int cmd, struct ast_cl
 	return CLI_SUCCESS;
 }
 
+/*! \brief CPU time of a role when core show threads cpu last ran */
+struct thread_cpu_sample {
+	char *role;
+	int64_t cpu_usec;
+};
+
+AST_VECTOR(thread_cpu_samples, struct thread_cpu_sample);
+
+/*! Totals from the previous core show threads cpu, protected by threads_cpu_lock */
+static struct thread_cpu_samples threads_cpu_last;
+static struct timeval threads_cpu_last_time;
+AST_MUTEX_DEFINE_STATIC(threads_cpu_lock);
+
+struct threads_cpu_show {
+	int fd;
+	int64_t elapsed_usec;
+	struct thread_cpu_samples samples;
+};
+
+static void threads_cpu_show_role(const char *role, int threads, int64_t cpu_usec, void *data)
+{
+	struct threads_cpu_show *show = data;
+	struct thread_cpu_sample sample;
+	int64_t previous = 0;
+	int i;
+
+	for (i = 0; i < AST_VECTOR_SIZE(&threads_cpu_last); ++i) {
+		if (!strcmp(AST_VECTOR_GET(&threads_cpu_last, i).role, role)) {
+			previous = AST_VECTOR_GET(&threads_cpu_last, i).cpu_usec;
+			break;
+		}
+	}
+
+	if (show->elapsed_usec) {
+		ast_cli(show->fd, "%-40.40s %7d %12.2f %7.1f\n", role, threads, cpu_usec / 1000000.0,
+			(cpu_usec - previous) * 100.0 / show->elapsed_usec);
+	} else {
+		ast_cli(show->fd, "%-40.40s %7d %12.2f %7s\n", role, threads, cpu_usec / 1000000.0, "-");
+	}
+
+	sample.role = ast_strdup(role);
+	sample.cpu_usec = cpu_usec;
+	if (!sample.role || AST_VECTOR_APPEND(&show->samples, sample)) {
+		ast_free(sample.role);
+	}
+}
+
+static void thread_cpu_sample_free(struct thread_cpu_sample sample)
+{
+	ast_free(sample.role);
+}
+
+static char *handle_show_threads_cpu(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct threads_cpu_show show;
+	struct timeval now;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "core show threads cpu";
+		e->usage =
+			"Usage: core show threads cpu\n"
+			"       Show the CPU time used by registered threads, grouped by\n"
+			"       role. The role is the thread's start routine unless the\n"
+			"       thread names it, thread pool workers are named after their\n"
+			"       pool. %CPU is the use since the previous run of this\n"
+			"       command, 100 being one CPU fully busy.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 4) {
+		return CLI_SHOWUSAGE;
+	}
+
+	if (AST_VECTOR_INIT(&show.samples, 32)) {
+		return CLI_FAILURE;
+	}
+	show.fd = a->fd;
+
+	ast_mutex_lock(&threads_cpu_lock);
+	now = ast_tvnow();
+	show.elapsed_usec = threads_cpu_last_time.tv_sec ? ast_tvdiff_us(now, threads_cpu_last_time) : 0;
+
+	ast_cli(a->fd, "%-40s %7s %12s %7s\n", "Role", "Threads", "CPU seconds", "%CPU");
+	ast_thread_role_cpu_foreach(threads_cpu_show_role, &show);
+
+	AST_VECTOR_RESET(&threads_cpu_last, thread_cpu_sample_free);
+	AST_VECTOR_FREE(&threads_cpu_last);
+	threads_cpu_last = show.samples;
+	threads_cpu_last_time = now;
+	ast_mutex_unlock(&threads_cpu_lock);
+
+	return CLI_SUCCESS;
+}
+
 #if defined (HAVE_SYSCTL) && defined(HAVE_SWAPCTL)
 /*
  * swapmode is rewritten by Tobias Weingartner <weingart@openbsd.org>
@@ -744,6 +974,14 @@ struct profile_data {
 };
 
 static struct profile_data *prof_data;
+#else /* if defined(LOW_MEMORY) */
+void ast_thread_role_set(const char *role)
+{
+}
+
+void ast_thread_role_cpu_foreach(ast_thread_role_cpu_cb callback, void *data)
+{
+}
 #endif /* ! LOW_MEMORY */
 
 /*! \brief allocates a counter with a given name and scale.
@@ -2578,6 +2816,7 @@ static struct ast_cli_entry cli_asterisk[] = {
 	AST_CLI_DEFINE(handle_bang, "Execute a shell command"),
 #if !defined(LOW_MEMORY)
 	AST_CLI_DEFINE(handle_show_threads, "Show running threads"),
+	AST_CLI_DEFINE(handle_show_threads_cpu, "Show CPU time used by thread role"),
 #if defined(HAVE_SYSINFO) || defined(HAVE_SYSCTL)
 	AST_CLI_DEFINE(handle_show_sysinfo, "Show System Information"),
 #endif
@@ -4067,7 +4306,12 @@ static void asterisk_daemon(int isroot, const char *runuser, const char *rungrou
 	ast_builtins_init();
 
 	check_init(ast_utils_init(), "Utilities");
+	check_init(ast_slinear_simd_init(), "Signed Linear SIMD");
+	check_init(ast_g711_simd_init(), "G.711 SIMD");
+	check_init(ast_goertzel_simd_init(), "Goertzel SIMD");
 	check_init(ast_tps_init(), "Task Processor Core");
+	check_init(ast_frame_init(), "Frame Slabs");
+	check_init(ast_media_trace_init(), "Media Tracing");
 	check_init(ast_fd_init(), "File Descriptor Debugging");
 	check_init(ast_pbx_init(), "ast_pbx_init");
 	check_init(aco_init(), "Configuration Option Framework");
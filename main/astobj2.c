@@ -53,7 +53,10 @@ static FILE *ref_log;
  */
 struct __priv_data {
 	ao2_destructor_fn destructor_fn;
-	/*! This field is used for astobj2 and ao2_weakproxy objects to reference each other */
+	/*!
+	 * This field is used for astobj2 and ao2_weakproxy objects to reference each other.
+	 * Objects allocated with AO2_ALLOC_OPT_REF_SHARDED keep their struct ao2_ref_shards here.
+	 */
 	void *weakptr;
 #if defined(AO2_DEBUG)
 	/*! User data size for stats */
@@ -67,7 +70,7 @@ struct __priv_data {
 	 * \note This field is constant after object creation.  It shares
 	 *       a uint32_t with \ref lockused and \ref magic.
 	 */
-	uint32_t options:2;
+	uint32_t options:3;
 	/*!
 	 * \brief Set to 1 when the lock is used if refdebug is enabled.
 	 *
@@ -90,11 +93,15 @@ struct __priv_data {
 	 *          all bitfields into a single 'uint32_t flags' field and use
 	 *          atomic operations from \file lock.h to perform writes.
 	 */
-	uint32_t magic:29;
+	uint32_t magic:28;
+	/*! Bytes allocated for the object, including this header and its lock */
+	uint32_t alloc_size;
+	/*! Slot in ao2_accounts the object is counted against */
+	uint16_t account;
 };
 
-#define	AO2_MAGIC	0x1a70b123
-#define	AO2_WEAK	0x1a70b122
+#define	AO2_MAGIC	0xa70b123
+#define	AO2_WEAK	0xa70b122
 #define IS_AO2_MAGIC_BAD(p) (AO2_MAGIC != (p->priv_data.magic | 1))
 
 /*!
@@ -106,6 +113,46 @@ struct astobj2 {
 	void *user_data[0];
 };
 
+/*! Bytes between counters that must not share a cache line. */
+#define AO2_REF_SHARD_STRIDE 64
+
+/*! Most counters a sharded object gets. */
+#define AO2_REF_SHARDS_MAX 32
+
+/*!
+ * \brief Reference counter of one CPU.
+ *
+ * \note Padded so neighboring counters never share a cache line
+ * however the array is aligned.
+ */
+struct ao2_ref_shard {
+	int32_t count;
+	char pad[AO2_REF_SHARD_STRIDE - sizeof(int32_t)];
+};
+
+/*! Per CPU reference counts of an AO2_ALLOC_OPT_REF_SHARDED object. */
+struct ao2_ref_shards {
+	/*! TRUE while references are counted per CPU. */
+	int active;
+	/*! Number of ao2_ref_shard() calls not yet undone.  (Protected by ref_shards_lock) */
+	int sharders;
+	/*! Number of counters. */
+	int count;
+	struct ao2_ref_shard shard[0];
+};
+
+/*! Serializes objects entering and leaving the sharded state. */
+static ast_mutex_t ref_shards_lock;
+
+/*!
+ * \brief Bias added to the shared count while the counters are folded.
+ *
+ * \details References taken on a CPU counter may be released on
+ * the shared count once the object is unsharded.  The bias keeps the
+ * shared count from reaching zero until the CPU counters are added.
+ */
+#define AO2_REF_SHARD_BIAS (1 << 24)
+
 struct ao2_weakproxy_notification {
 	ao2_weakproxy_notification_cb cb;
 	void *data;
@@ -495,6 +542,373 @@ void *ao2_object_get_lockaddr(void *user_data)
 	return NULL;
 }
 
+/*!
+ * \internal
+ * \brief Get the number of reference counters a sharded object gets.
+ * \since 17.0.0
+ */
+static int ref_shards_size(void)
+{
+	static int size;
+	int cpus;
+
+	if (!size) {
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		size = MAX(1, MIN(cpus, AO2_REF_SHARDS_MAX));
+	}
+	return size;
+}
+
+/*!
+ * \internal
+ * \brief Pick the reference counter of the CPU the thread runs on.
+ * \since 17.0.0
+ */
+static struct ao2_ref_shard *ref_shard_get(struct ao2_ref_shards *shards)
+{
+	int cpu = -1;
+
+#if defined(__linux__)
+	cpu = sched_getcpu();
+#endif
+	if (cpu < 0) {
+		cpu = ast_get_tid();
+	}
+	return &shards->shard[cpu % shards->count];
+}
+
+/*!
+ * \internal
+ * \brief Change the reference counter of the current CPU of a sharded object.
+ * \since 17.0.0
+ *
+ * \param obj Object allocated with AO2_ALLOC_OPT_REF_SHARDED.
+ * \param user_data User data of the object.
+ * \param delta Value to add to the reference counter.
+ * \param tag used for debugging.
+ * \param file Debug file name invoked from
+ * \param line Debug line invoked from
+ * \param func Debug function name invoked from
+ * \param ret Where to put the estimated count before the change.
+ *
+ * \note Kept out of line so __ao2_ref() of other objects stays small.
+ *
+ * \retval 0 if the delta was counted.
+ * \retval -1 if the object is not sharded and the shared count must be used.
+ */
+static int __attribute__((noinline)) ref_shards_add(struct astobj2 *obj, void *user_data,
+	int delta, const char *tag, const char *file, int line, const char *func, int32_t *ret)
+{
+	struct ao2_ref_shards *shards;
+
+	shards = ast_atomic_load_n((struct ao2_ref_shards **) &obj->priv_data.weakptr,
+		__ATOMIC_ACQUIRE);
+	if (!shards || ao2_rcu_read_begin()) {
+		return -1;
+	}
+
+	/*
+	 * The read section keeps ao2_ref_unshard() from folding the
+	 * counters until this delta is on one.
+	 */
+	if (!ast_atomic_load_n(&shards->active, __ATOMIC_SEQ_CST)) {
+		ao2_rcu_read_end();
+		return -1;
+	}
+	ast_atomic_fetch_add(&ref_shard_get(shards)->count, delta, __ATOMIC_RELAXED);
+	ao2_rcu_read_end();
+
+	/* The object cannot go away while sharded, the shared count is good enough. */
+	*ret = ast_atomic_load_n(&obj->priv_data.ref_counter, __ATOMIC_RELAXED);
+#ifdef AO2_DEBUG
+	ast_atomic_fetchadd_int(&ao2.total_refs, delta);
+#endif
+	if (ref_log && tag) {
+		fprintf(ref_log, "%p,%s%d,%d,%s,%d,%s,%d,%s\n", user_data,
+			(delta < 0 ? "" : "+"), delta, ast_get_tid(),
+			file, line, func, (int)*ret, tag);
+		fflush(ref_log);
+	}
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Add up all reference counters of a sharded object.
+ * \since 17.0.0
+ */
+static int32_t ref_shards_count(struct astobj2 *obj)
+{
+	struct ao2_ref_shards *shards;
+	int32_t count = ast_atomic_load_n(&obj->priv_data.ref_counter, __ATOMIC_RELAXED);
+	int idx;
+
+	shards = ast_atomic_load_n((struct ao2_ref_shards **) &obj->priv_data.weakptr,
+		__ATOMIC_ACQUIRE);
+	if (shards) {
+		for (idx = 0; idx < shards->count; ++idx) {
+			count += ast_atomic_load_n(&shards->shard[idx].count, __ATOMIC_RELAXED);
+		}
+	}
+
+	return count;
+}
+
+void ao2_ref_shard(void *user_data)
+{
+	struct astobj2 *obj = INTERNAL_OBJ_CHECK(user_data);
+	struct ao2_ref_shards *shards;
+
+	if (!obj || !(obj->priv_data.options & AO2_ALLOC_OPT_REF_SHARDED)) {
+		return;
+	}
+
+	ast_mutex_lock(&ref_shards_lock);
+	shards = obj->priv_data.weakptr;
+	if (!shards) {
+		/* Most objects that can be sharded never are, so the counters are made on demand. */
+		shards = ast_calloc(1, sizeof(*shards)
+			+ ref_shards_size() * sizeof(shards->shard[0]));
+		if (!shards) {
+			ast_mutex_unlock(&ref_shards_lock);
+			return;
+		}
+		shards->count = ref_shards_size();
+		ast_atomic_store_n((struct ao2_ref_shards **) &obj->priv_data.weakptr, shards,
+			__ATOMIC_RELEASE);
+	}
+	if (!shards->sharders++) {
+		ast_atomic_store_n(&shards->active, 1, __ATOMIC_SEQ_CST);
+	}
+	ast_mutex_unlock(&ref_shards_lock);
+}
+
+void ao2_ref_unshard(void *user_data)
+{
+	struct astobj2 *obj = INTERNAL_OBJ_CHECK(user_data);
+	struct ao2_ref_shards *shards;
+	int32_t count = 0;
+	int idx;
+
+	if (!obj || !(obj->priv_data.options & AO2_ALLOC_OPT_REF_SHARDED)) {
+		return;
+	}
+
+	ast_mutex_lock(&ref_shards_lock);
+	shards = obj->priv_data.weakptr;
+	if (!shards || !shards->sharders) {
+		ast_mutex_unlock(&ref_shards_lock);
+		ast_log(LOG_ERROR, "ao2 object %p is not sharded\n", user_data);
+		ast_assert(0);
+		return;
+	}
+	if (--shards->sharders) {
+		ast_mutex_unlock(&ref_shards_lock);
+		return;
+	}
+
+	ast_atomic_fetch_add(&obj->priv_data.ref_counter, AO2_REF_SHARD_BIAS, __ATOMIC_SEQ_CST);
+	ast_atomic_store_n(&shards->active, 0, __ATOMIC_SEQ_CST);
+	ao2_rcu_synchronize();
+
+	/* Nobody changes the CPU counters anymore. */
+	for (idx = 0; idx < shards->count; ++idx) {
+		count += shards->shard[idx].count;
+		shards->shard[idx].count = 0;
+	}
+	ast_atomic_fetch_add(&obj->priv_data.ref_counter, count - AO2_REF_SHARD_BIAS,
+		__ATOMIC_SEQ_CST);
+	ast_mutex_unlock(&ref_shards_lock);
+}
+
+/*! Source files ao2 memory is accounted against, must be a power of two */
+#define AO2_ACCOUNTS 2048
+
+/*! Slots probed for a source file before it is counted as other */
+#define AO2_ACCOUNT_PROBES 32
+
+/*!
+ * \brief Memory held by the live ao2 objects allocated from one source file
+ *
+ * \note Slot 0 collects the objects that did not fit in the table.
+ */
+struct ao2_account {
+	/*! The __FILE__ the objects were allocated from, NULL while the slot is free */
+	const char *file;
+	/*! Bytes held by live objects */
+	int64_t bytes;
+	/*! Live objects */
+	int32_t objects;
+	/*! Set once name has been filled in */
+	int named;
+	/*! Copy of file that stays valid after the module it came from unloads */
+	char name[64];
+};
+
+static struct ao2_account ao2_accounts[AO2_ACCOUNTS];
+
+/*! Entries in each thread's cache of account deltas, must be a power of two */
+#define AO2_ACCOUNT_DELTAS 64
+
+/*! Objects a delta may drift by before it is folded into its account */
+#define AO2_ACCOUNT_DELTA_OBJECTS 65536
+
+/*!
+ * \brief Bytes and objects a thread added to one account and has not folded in yet
+ *
+ * \note Only the owning thread writes a delta.  The report reads the deltas
+ * of live threads, so the fields are stored and loaded atomically.
+ */
+struct ao2_account_delta {
+	/*! Slot in ao2_accounts the delta belongs to */
+	uint16_t account;
+	int32_t objects;
+	int64_t bytes;
+};
+
+/*!
+ * \brief A thread's account deltas
+ *
+ * Counting into the thread's own deltas keeps allocations from different
+ * threads off the shared account counters.  A delta is folded into its
+ * account when its entry is needed for another account, when it drifts
+ * too far, and when the thread exits.
+ */
+struct ao2_account_deltas {
+	struct ao2_account_delta deltas[AO2_ACCOUNT_DELTAS];
+	AST_LIST_ENTRY(ao2_account_deltas) list;
+};
+
+static int ao2_account_deltas_init(void *data);
+static void ao2_account_deltas_cleanup(void *data);
+
+/*! \brief The account deltas of each thread */
+AST_THREADSTORAGE_CUSTOM(ao2_account_deltas_storage, ao2_account_deltas_init, ao2_account_deltas_cleanup);
+
+/*! \brief Account deltas of live threads, for the report (protected by ao2_account_threads_lock) */
+static AST_LIST_HEAD_NOLOCK_STATIC(ao2_account_threads, ao2_account_deltas);
+static ast_mutex_t ao2_account_threads_lock;
+
+/*! Set once ao2_account_threads_lock is usable, objects are counted directly before that */
+static int ao2_account_threads_ready;
+
+static int ao2_account_deltas_init(void *data)
+{
+	struct ao2_account_deltas *deltas = data;
+
+	ast_mutex_lock(&ao2_account_threads_lock);
+	AST_LIST_INSERT_TAIL(&ao2_account_threads, deltas, list);
+	ast_mutex_unlock(&ao2_account_threads_lock);
+
+	return 0;
+}
+
+/*! \brief Move a delta into its account, only called by the owning thread */
+static void ao2_account_fold(struct ao2_account_delta *delta)
+{
+	struct ao2_account *account = &ao2_accounts[delta->account];
+
+	if (!delta->objects && !delta->bytes) {
+		return;
+	}
+
+	ast_atomic_fetch_add(&account->bytes, delta->bytes, __ATOMIC_RELAXED);
+	ast_atomic_fetch_add(&account->objects, delta->objects, __ATOMIC_RELAXED);
+	ast_atomic_store_n(&delta->bytes, 0, __ATOMIC_RELAXED);
+	ast_atomic_store_n(&delta->objects, 0, __ATOMIC_RELAXED);
+}
+
+static void ao2_account_deltas_cleanup(void *data)
+{
+	struct ao2_account_deltas *deltas = data;
+	int i;
+
+	ast_mutex_lock(&ao2_account_threads_lock);
+	AST_LIST_REMOVE(&ao2_account_threads, deltas, list);
+	for (i = 0; i < AO2_ACCOUNT_DELTAS; ++i) {
+		ao2_account_fold(&deltas->deltas[i]);
+	}
+	ast_mutex_unlock(&ao2_account_threads_lock);
+
+	ast_free(deltas);
+}
+
+/*!
+ * \internal
+ * \brief Find or claim the account slot for a source file
+ *
+ * \note Objects from a module reloaded at another address get a new slot,
+ * the report merges slots by name.
+ */
+static uint16_t ao2_account_get(const char *file)
+{
+	unsigned int slot;
+	unsigned int probe;
+	const char *key;
+
+	if (!file) {
+		return 0;
+	}
+
+	slot = (((uintptr_t) file >> 3) * 2654435761U) & (AO2_ACCOUNTS - 1);
+	for (probe = 0; probe < AO2_ACCOUNT_PROBES; ++probe, slot = (slot + 1) & (AO2_ACCOUNTS - 1)) {
+		if (!slot) {
+			continue;
+		}
+
+		key = ast_atomic_load_n(&ao2_accounts[slot].file, __ATOMIC_ACQUIRE);
+		if (key == file) {
+			return slot;
+		}
+		if (key) {
+			continue;
+		}
+
+		/* Claim the free slot, a racing claim by another file moves on */
+		if (ast_atomic_compare_exchange_n(&ao2_accounts[slot].file, &key, file,
+			__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			ast_copy_string(ao2_accounts[slot].name, file, sizeof(ao2_accounts[slot].name));
+			ast_atomic_store_n(&ao2_accounts[slot].named, 1, __ATOMIC_RELEASE);
+			return slot;
+		}
+
+		if (key == file) {
+			return slot;
+		}
+	}
+
+	return 0;
+}
+
+static void ao2_account_add(struct astobj2 *obj, int sign)
+{
+	struct ao2_account_deltas *deltas;
+	struct ao2_account_delta *delta;
+	uint16_t account = obj->priv_data.account;
+	int64_t bytes = sign * (int64_t) obj->priv_data.alloc_size;
+
+	deltas = ast_atomic_load_n(&ao2_account_threads_ready, __ATOMIC_ACQUIRE)
+		? ast_threadstorage_get(&ao2_account_deltas_storage, sizeof(*deltas)) : NULL;
+	if (!deltas) {
+		ast_atomic_fetch_add(&ao2_accounts[account].bytes, bytes, __ATOMIC_RELAXED);
+		ast_atomic_fetch_add(&ao2_accounts[account].objects, sign, __ATOMIC_RELAXED);
+		return;
+	}
+
+	delta = &deltas->deltas[account & (AO2_ACCOUNT_DELTAS - 1)];
+	if (delta->account != account) {
+		ao2_account_fold(delta);
+		ast_atomic_store_n(&delta->account, account, __ATOMIC_RELAXED);
+	}
+	ast_atomic_store_n(&delta->bytes, delta->bytes + bytes, __ATOMIC_RELAXED);
+	ast_atomic_store_n(&delta->objects, delta->objects + sign, __ATOMIC_RELAXED);
+
+	if (delta->objects >= AO2_ACCOUNT_DELTA_OBJECTS || delta->objects <= -AO2_ACCOUNT_DELTA_OBJECTS) {
+		ao2_account_fold(delta);
+	}
+}
+
 int __ao2_ref(void *user_data, int delta,
 	const char *tag, const char *file, int line, const char *func)
 {
@@ -518,10 +932,18 @@ int __ao2_ref(void *user_data, int delta,
 
 	/* if delta is 0, just return the refcount */
 	if (delta == 0) {
-		return obj->priv_data.ref_counter;
+		return (obj->priv_data.options & AO2_ALLOC_OPT_REF_SHARDED)
+			? ref_shards_count(obj) : obj->priv_data.ref_counter;
+	}
+
+	if ((obj->priv_data.options & AO2_ALLOC_OPT_REF_SHARDED)
+		&& !ref_shards_add(obj, user_data, delta, tag, file, line, func, &ret)) {
+		return ret;
 	}
 
-	if (delta < 0 && obj->priv_data.magic == AO2_MAGIC && (weakproxy = obj->priv_data.weakptr)) {
+	if (delta < 0 && obj->priv_data.magic == AO2_MAGIC
+		&& !(obj->priv_data.options & AO2_ALLOC_OPT_REF_SHARDED)
+		&& (weakproxy = obj->priv_data.weakptr)) {
 		ao2_lock(weakproxy);
 	}
 
@@ -619,6 +1041,12 @@ int __ao2_ref(void *user_data, int delta,
 	ast_atomic_fetchadd_int(&ao2.total_objects, -1);
 #endif
 
+	if (obj->priv_data.options & AO2_ALLOC_OPT_REF_SHARDED) {
+		ast_free(obj->priv_data.weakptr);
+	}
+
+	ao2_account_add(obj, -1);
+
 	/* In case someone uses an object after it's been freed */
 	obj->priv_data.magic = 0;
 
@@ -744,6 +1172,9 @@ static void *internal_ao2_alloc(size_t data_size, ao2_destructor_fn destructor_f
 	obj->priv_data.ref_counter = 1;
 	obj->priv_data.options = options;
 	obj->priv_data.magic = AO2_MAGIC;
+	obj->priv_data.alloc_size = MIN(overhead + data_size, UINT32_MAX);
+	obj->priv_data.account = ao2_account_get(file);
+	ao2_account_add(obj, 1);
 
 #ifdef AO2_DEBUG
 	obj->priv_data.data_size = data_size;
@@ -804,12 +1235,18 @@ void *__ao2_global_obj_replace(struct ao2_global_obj *holder, void *obj, const c
 
 	if (obj) {
 		__ao2_ref(obj, +1, tag, file, line, func);
+		ao2_ref_shard(obj);
 	}
 	obj_old = holder->obj;
 	holder->obj = obj;
 
 	__ast_rwlock_unlock(file, line, func, &holder->lock, name);
 
+	if (obj_old) {
+		/* The reference the holder had is the caller's now. */
+		ao2_ref_unshard(obj_old);
+	}
+
 	return obj_old;
 }
 
@@ -892,7 +1329,8 @@ int __ao2_weakproxy_set_object(void *weakproxy, void *obj, int flags,
 
 	if (!obj_internal
 		|| obj_internal->priv_data.weakptr
-		|| obj_internal->priv_data.magic != AO2_MAGIC) {
+		|| obj_internal->priv_data.magic != AO2_MAGIC
+		|| (obj_internal->priv_data.options & AO2_ALLOC_OPT_REF_SHARDED)) {
 		return -1;
 	}
 
@@ -981,7 +1419,8 @@ void *__ao2_get_weakproxy(void *obj, const char *tag, const char *file, int line
 {
 	struct astobj2 *obj_internal = __INTERNAL_OBJ_CHECK(obj, file, line, func);
 
-	if (!obj_internal || obj_internal->priv_data.magic != AO2_MAGIC) {
+	if (!obj_internal || obj_internal->priv_data.magic != AO2_MAGIC
+		|| (obj_internal->priv_data.options & AO2_ALLOC_OPT_REF_SHARDED)) {
 		/* This method is meant to be run on normal ao2 objects! */
 		return NULL;
 	}
@@ -1210,6 +1649,121 @@ static char *handle_astobj2_test(struct ast_cli_entry *e, int cmd, struct ast_cl
 }
 #endif /* AO2_DEBUG */
 
+/*! \brief One line of the memory show subsystems report */
+struct ao2_account_line {
+	const char *name;
+	int64_t bytes;
+	int64_t objects;
+};
+
+static int ao2_account_line_name_cmp(const void *left, const void *right)
+{
+	return strcmp(((const struct ao2_account_line *) left)->name,
+		((const struct ao2_account_line *) right)->name);
+}
+
+static int ao2_account_line_bytes_cmp(const void *left, const void *right)
+{
+	int64_t l = ((const struct ao2_account_line *) left)->bytes;
+	int64_t r = ((const struct ao2_account_line *) right)->bytes;
+
+	return l > r ? -1 : l < r;
+}
+
+static char *handle_memory_show_subsystems(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct ao2_account_line *lines;
+	struct ao2_account_deltas *deltas;
+	int64_t total_bytes = 0;
+	int64_t total_objects = 0;
+	int count = 0;
+	int merged;
+	int i;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "memory show subsystems";
+		e->usage =
+			"Usage: memory show subsystems\n"
+			"       Show the memory held by live astobj2 objects, by the\n"
+			"       source file that allocated them.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	lines = ast_calloc(AO2_ACCOUNTS, sizeof(*lines));
+	if (!lines) {
+		return CLI_FAILURE;
+	}
+
+	/*
+	 * Add what live threads have not folded in yet to the accounts.  A
+	 * thread folding a delta while it is read may be counted twice or not
+	 * at all, so the report is approximate while objects come and go.
+	 */
+	ast_mutex_lock(&ao2_account_threads_lock);
+	for (i = 0; i < AO2_ACCOUNTS; ++i) {
+		lines[i].bytes = ast_atomic_load_n(&ao2_accounts[i].bytes, __ATOMIC_RELAXED);
+		lines[i].objects = ast_atomic_load_n(&ao2_accounts[i].objects, __ATOMIC_RELAXED);
+	}
+	AST_LIST_TRAVERSE(&ao2_account_threads, deltas, list) {
+		for (i = 0; i < AO2_ACCOUNT_DELTAS; ++i) {
+			struct ao2_account_delta *delta = &deltas->deltas[i];
+			uint16_t account = ast_atomic_load_n(&delta->account, __ATOMIC_RELAXED);
+
+			lines[account].bytes += ast_atomic_load_n(&delta->bytes, __ATOMIC_RELAXED);
+			lines[account].objects += ast_atomic_load_n(&delta->objects, __ATOMIC_RELAXED);
+		}
+	}
+	ast_mutex_unlock(&ao2_account_threads_lock);
+
+	for (i = 0; i < AO2_ACCOUNTS; ++i) {
+		if (i && !ast_atomic_load_n(&ao2_accounts[i].named, __ATOMIC_ACQUIRE)) {
+			continue;
+		}
+		lines[count].name = i ? ao2_accounts[i].name : "(other)";
+		lines[count].bytes = lines[i].bytes;
+		lines[count].objects = lines[i].objects;
+		if (lines[count].objects) {
+			++count;
+		}
+	}
+
+	/* A module loaded more than once has a slot per load */
+	qsort(lines, count, sizeof(*lines), ao2_account_line_name_cmp);
+	for (merged = 0, i = 0; i < count; ++i) {
+		if (merged && !strcmp(lines[merged - 1].name, lines[i].name)) {
+			lines[merged - 1].bytes += lines[i].bytes;
+			lines[merged - 1].objects += lines[i].objects;
+		} else {
+			lines[merged++] = lines[i];
+		}
+	}
+	qsort(lines, merged, sizeof(*lines), ao2_account_line_bytes_cmp);
+
+	ast_cli(a->fd, "%15s %10s  %s\n", "Bytes", "Objects", "Source");
+	for (i = 0; i < merged; ++i) {
+		ast_cli(a->fd, "%15" PRId64 " %10" PRId64 "  %s\n",
+			lines[i].bytes, lines[i].objects, lines[i].name);
+		total_bytes += lines[i].bytes;
+		total_objects += lines[i].objects;
+	}
+	ast_cli(a->fd, "%15" PRId64 " %10" PRId64 "  total\n", total_bytes, total_objects);
+
+	ast_free(lines);
+
+	return CLI_SUCCESS;
+}
+
+static struct ast_cli_entry cli_astobj2_memory[] = {
+	AST_CLI_DEFINE(handle_memory_show_subsystems, "Show astobj2 memory by source file"),
+};
+
 #if defined(AO2_DEBUG)
 static struct ast_cli_entry cli_astobj2[] = {
 	AST_CLI_DEFINE(handle_astobj2_stats, "Print astobj2 statistics"),
@@ -1219,6 +1773,7 @@ static struct ast_cli_entry cli_astobj2[] = {
 
 static void astobj2_cleanup(void)
 {
+	ast_cli_unregister_multiple(cli_astobj2_memory, ARRAY_LEN(cli_astobj2_memory));
 #if defined(AO2_DEBUG)
 	ast_cli_unregister_multiple(cli_astobj2, ARRAY_LEN(cli_astobj2));
 #endif
@@ -1241,6 +1796,9 @@ int astobj2_init(void)
 		}
 	}
 
+	ast_mutex_init(&ref_shards_lock);
+	ast_mutex_init(&ao2_account_threads_lock);
+	ast_atomic_store_n(&ao2_account_threads_ready, 1, __ATOMIC_RELEASE);
 	ast_register_cleanup(astobj2_cleanup);
 
 	if (container_init() != 0) {
@@ -1249,6 +1807,7 @@ int astobj2_init(void)
 		return -1;
 	}
 
+	ast_cli_register_multiple(cli_astobj2_memory, ARRAY_LEN(cli_astobj2_memory));
 #if defined(AO2_DEBUG)
 	ast_cli_register_multiple(cli_astobj2, ARRAY_LEN(cli_astobj2));
 #endif	/* defined(AO2_DEBUG) */
@@ -45,6 +45,10 @@ int __container_unlink_node_debug(struct ao2_container_node *node, uint32_t flag
 		return 0;
 	}
 
+	if (container && node->obj && !container->destroying && container->v_table->changed) {
+		container->v_table->changed(container);
+	}
+
 	if ((flags & AO2_UNLINK_NODE_UNLINK_OBJECT)
 		&& !(flags & AO2_UNLINK_NODE_NOUNREF_OBJECT)) {
 		__ao2_ref(node->obj, -1, tag ?: "Remove obj from container", file, line, func);
@@ -143,6 +147,9 @@ int __ao2_link(struct ao2_container *self, void *obj_new, int flags,
 				ast_log(LOG_ERROR, "Container integrity failed after insert or replace.\n");
 			}
 #endif	/* defined(AO2_DEBUG) */
+			if (self->v_table->changed) {
+				self->v_table->changed(self);
+			}
 			res = 1;
 			break;
 		case AO2_CONTAINER_INSERT_NODE_REJECTED:
@@ -428,12 +435,24 @@ void *__ao2_find(struct ao2_container *c, const void *arg, enum search_flags fla
 	const char *tag, const char *file, int line, const char *func)
 {
 	void *arged = (void *) arg;/* Done to avoid compiler const warning */
+	void *obj;
 
 	if (!c) {
 		/* Sanity checks. */
 		ast_assert(0);
 		return NULL;
 	}
+
+	/* Plain lookups of read-mostly containers may not need the lock. */
+	if (c->v_table && c->v_table->find_lockless
+		&& ((flags & OBJ_SEARCH_MASK) == OBJ_SEARCH_OBJECT
+			|| (flags & OBJ_SEARCH_MASK) == OBJ_SEARCH_KEY)
+		&& !(flags & (OBJ_UNLINK | OBJ_NODATA | OBJ_MULTIPLE))
+		&& (flags & OBJ_ORDER_MASK) == OBJ_ORDER_ASCENDING
+		&& !c->v_table->find_lockless(c, arged, flags, &obj, tag, file, line, func)) {
+		return obj;
+	}
+
 	return __ao2_callback(c, flags, c->cmp_fn, arged, tag, file, line, func);
 }
 
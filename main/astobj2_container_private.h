@@ -233,6 +233,38 @@ typedef void (*ao2_link_node_stat_fn)(struct ao2_container *container, struct ao
  */
 typedef void (*ao2_unlink_node_stat_fn)(struct ao2_container *container, struct ao2_container_node *node);
 
+/*!
+ * \brief Find an object without locking the container.
+ * \since 17.0.0
+ *
+ * \param self Container to operate upon.
+ * \param arg Search key or object.
+ * \param flags search_flags of the ao2_find().
+ * \param obj Where to put the object found.  (Reffed or NULL)
+ * \param tag used for debugging.
+ * \param file Debug file name invoked from
+ * \param line Debug line invoked from
+ * \param func Debug function name invoked from
+ *
+ * \retval 0 if the search was answered.
+ * \retval -1 if the container must be searched with its lock held.
+ */
+typedef int (*ao2_container_find_lockless_fn)(struct ao2_container *self, void *arg,
+	enum search_flags flags, void **obj, const char *tag, const char *file, int line,
+	const char *func);
+
+/*!
+ * \brief Note that objects were linked or unlinked.
+ * \since 17.0.0
+ *
+ * \param self Container to operate upon.
+ *
+ * \note The container is already write locked.
+ *
+ * \return Nothing
+ */
+typedef void (*ao2_container_changed_fn)(struct ao2_container *self);
+
 /*! Container virtual methods template. */
 struct ao2_container_methods {
 	/*! Destroy this container. */
@@ -251,6 +283,10 @@ struct ao2_container_methods {
 	ao2_container_find_cleanup_fn traverse_cleanup;
 	/*! Find the next iteration element in the container. */
 	ao2_iterator_next_fn iterator_next;
+	/*! Find an object without locking the container. (Optional) */
+	ao2_container_find_lockless_fn find_lockless;
+	/*! Note that the container contents changed. (Optional) */
+	ao2_container_changed_fn changed;
 #if defined(AO2_DEBUG)
 	/*! Increment the container linked object statistic. */
 	ao2_link_node_stat_fn link_stat;
@@ -30,6 +30,12 @@
 #include "asterisk/dlinkedlists.h"
 #include "asterisk/utils.h"
 
+/*!
+ * \brief Average number of objects per bucket a resizable hash
+ * container grows beyond.
+ */
+#define HASH_RESIZE_MAX_LOAD 2
+
 /*!
  * A structure to create a linked list of entries,
  * used within a bucket.
@@ -57,10 +63,49 @@ struct hash_bucket {
 #endif	/* defined(AO2_DEBUG) */
 };
 
+/*!
+ * \brief Copy of a read-mostly hash container searched without locking.
+ * \since 17.0.0
+ */
+struct hash_snapshot {
+	/*!
+	 * \brief Retirement bookkeeping.
+	 * \note Must be first in the snapshot struct.
+	 */
+	struct ao2_rcu_head rcu;
+	/*! Number of hash buckets of the container when copied. */
+	int n_buckets;
+	/*! Number of buckets in the current level when copied. */
+	int level_buckets;
+	/*! Next bucket of the current level to split when copied. */
+	int split;
+	/*! Number of objects held. */
+	int count;
+	/*! Index in objs of the first object of each bucket, and one past the last. */
+	int *first;
+	/*! Objects of the container in traversal order of each bucket.  (Reffed) */
+	void *objs[0];
+};
+
 /*!
  * A hash container in addition to values common to all
  * container types, stores the hash callback function, the
  * number of hash buckets, and the hash bucket heads.
+ *
+ * \details
+ * A container allocated with AO2_CONTAINER_ALLOC_OPT_HASH_RESIZE
+ * grows by linear hashing.  Each link that takes the container
+ * over its maximum load splits the bucket at the split index in
+ * two: objects that hash to a new bucket at twice the level size
+ * move there.  Once every bucket of a level has been split the
+ * level doubles.  Only one bucket is rehashed at a time.
+ *
+ * Traversals visit the buckets of a resizable container in an
+ * order that splitting only ever refines.  Buckets made from a
+ * bucket that has already been visited sort with it, so Iterators
+ * never see an object twice or miss one across a split.  A bucket
+ * holding the node an iterator stopped on is not split until the
+ * iterator moves on.
  */
 struct ao2_container_hash {
 	/*!
@@ -71,10 +116,245 @@ struct ao2_container_hash {
 	ao2_hash_fn *hash_fn;
 	/*! Number of hash buckets in this container. */
 	int n_buckets;
-	/*! Hash bucket array of n_buckets.  Variable size. */
-	struct hash_bucket buckets[0];
+	/*! Number of buckets the container was created with. */
+	int base_buckets;
+	/*! Number of buckets in the current level of a resizable container. */
+	int level_buckets;
+	/*! Next bucket of the current level to split in two. */
+	int split;
+	/*! Number of buckets allocated. */
+	int capacity;
+	/*! Hash bucket array of n_buckets. */
+	struct hash_bucket *buckets;
+	/*! Copy of the contents for lookups without locking.  (Read-mostly only) */
+	struct hash_snapshot *snapshot;
+	/*! Copies that lookups may still be reading. */
+	struct ao2_rcu_head *retired;
+	/*! Bucket storage of fixed size containers.  Variable size. */
+	struct hash_bucket fixed_buckets[0];
 };
 
+/*!
+ * \internal
+ * \brief Determine the bucket a hash value belongs in for a bucket layout.
+ * \since 17.0.0
+ *
+ * \param n_buckets Number of hash buckets.
+ * \param level_buckets Number of buckets in the current level.  (0 if fixed size)
+ * \param split Next bucket of the current level to split.
+ * \param hash Value returned by the container hash function.
+ *
+ * \return Bucket index.
+ */
+static int hash_bucket_index(int n_buckets, int level_buckets, int split, int hash)
+{
+	int bucket;
+
+	if (!level_buckets) {
+		return abs(hash % n_buckets);
+	}
+
+	bucket = abs(hash % level_buckets);
+	if (bucket < split) {
+		bucket = abs(hash % (level_buckets * 2));
+	}
+	return bucket;
+}
+
+/*!
+ * \internal
+ * \brief Determine the bucket a hash value belongs in.
+ * \since 17.0.0
+ *
+ * \param self Container to operate upon.
+ * \param hash Value returned by the container hash function.
+ *
+ * \return Bucket index.
+ */
+static int hash_ao2_bucket(struct ao2_container_hash *self, int hash)
+{
+	return hash_bucket_index(self->n_buckets, self->level_buckets, self->split, hash);
+}
+
+/*!
+ * \internal
+ * \brief Find the bucket traversed after the given one.
+ * \since 17.0.0
+ *
+ * \param self Container to operate upon.
+ * \param bucket Current bucket.
+ *
+ * \details
+ * A resizable container orders the buckets of a level by their
+ * remainder of the base bucket count, then by the remaining bits
+ * of the index reversed.  A bucket split in two is followed by
+ * the bucket it split off.
+ *
+ * \retval next bucket index.
+ * \retval -1 if there are no more buckets.
+ */
+static int hash_ao2_bucket_next(struct ao2_container_hash *self, int bucket)
+{
+	int remainder;
+	int bits;
+	int bit;
+
+	if (!self->level_buckets) {
+		return ++bucket < self->n_buckets ? bucket : -1;
+	}
+
+	if (bucket >= self->level_buckets) {
+		bucket -= self->level_buckets;
+	} else if (bucket < self->split) {
+		return bucket + self->level_buckets;
+	}
+
+	remainder = bucket % self->base_buckets;
+	bits = bucket / self->base_buckets;
+	for (bit = self->level_buckets / self->base_buckets / 2; bit; bit >>= 1) {
+		if (!(bits & bit)) {
+			return remainder + self->base_buckets * (bits | bit);
+		}
+		bits &= ~bit;
+	}
+
+	return ++remainder < self->base_buckets ? remainder : -1;
+}
+
+/*!
+ * \internal
+ * \brief Find the bucket traversed before the given one.
+ * \since 17.0.0
+ *
+ * \param self Container to operate upon.
+ * \param bucket Current bucket.
+ *
+ * \retval previous bucket index.
+ * \retval -1 if there are no more buckets.
+ */
+static int hash_ao2_bucket_prev(struct ao2_container_hash *self, int bucket)
+{
+	int remainder;
+	int bits;
+	int bit;
+
+	if (!self->level_buckets) {
+		return bucket - 1;
+	}
+
+	if (bucket >= self->level_buckets) {
+		return bucket - self->level_buckets;
+	}
+
+	remainder = bucket % self->base_buckets;
+	bits = bucket / self->base_buckets;
+	for (bit = self->level_buckets / self->base_buckets / 2; bit; bit >>= 1) {
+		if (bits & bit) {
+			bits &= ~bit;
+			break;
+		}
+		bits |= bit;
+	}
+	if (!bit && --remainder < 0) {
+		return -1;
+	}
+
+	bucket = remainder + self->base_buckets * bits;
+	return bucket < self->split ? bucket + self->level_buckets : bucket;
+}
+
+/*!
+ * \internal
+ * \brief Find the last bucket traversed.
+ * \since 17.0.0
+ *
+ * \param self Container to operate upon.
+ *
+ * \return Bucket index.
+ */
+static int hash_ao2_bucket_last(struct ao2_container_hash *self)
+{
+	int bucket;
+
+	if (!self->level_buckets) {
+		return self->n_buckets - 1;
+	}
+
+	bucket = self->level_buckets - 1;
+	return bucket < self->split ? bucket + self->level_buckets : bucket;
+}
+
+/*!
+ * \internal
+ * \brief Split a bucket of a resizable container if it is overloaded.
+ * \since 17.0.0
+ *
+ * \param self Container to operate upon.
+ *
+ * \note The container must be write locked.
+ *
+ * \return Nothing
+ */
+static void hash_ao2_grow(struct ao2_container_hash *self)
+{
+	struct hash_bucket *bucket;
+	struct hash_bucket *twin;
+	struct hash_bucket_node *node;
+	int twin_idx;
+
+	if (ao2_container_count(&self->common) <= self->n_buckets * HASH_RESIZE_MAX_LOAD
+		|| self->level_buckets > INT_MAX / 4) {
+		return;
+	}
+
+	if (self->capacity < self->level_buckets * 2) {
+		/* Only the bucket heads move, nodes do not point back at them. */
+		bucket = ast_realloc(self->buckets, self->level_buckets * 2 * sizeof(*bucket));
+		if (!bucket) {
+			return;
+		}
+		memset(bucket + self->capacity, 0,
+			(self->level_buckets * 2 - self->capacity) * sizeof(*bucket));
+		self->buckets = bucket;
+		self->capacity = self->level_buckets * 2;
+	}
+
+	bucket = &self->buckets[self->split];
+	AST_DLLIST_TRAVERSE(&bucket->list, node, links) {
+		if (!node->common.obj || ao2_ref(node, 0) > 1) {
+			/* An iterator is positioned in this bucket. */
+			return;
+		}
+	}
+
+	twin_idx = self->split + self->level_buckets;
+	twin = &self->buckets[twin_idx];
+	AST_DLLIST_TRAVERSE_SAFE_BEGIN(&bucket->list, node, links) {
+		if (abs(self->hash_fn(node->common.obj, OBJ_SEARCH_OBJECT)
+			% (self->level_buckets * 2)) == self->split) {
+			continue;
+		}
+
+		/* Moved nodes keep their relative order so sorted buckets stay sorted. */
+		AST_DLLIST_REMOVE_CURRENT(links);
+		AST_DLLIST_INSERT_TAIL(&twin->list, node, links);
+		node->my_bucket = twin_idx;
+#if defined(AO2_DEBUG)
+		--bucket->elements;
+		if (twin->max_elements < ++twin->elements) {
+			twin->max_elements = twin->elements;
+		}
+#endif	/* defined(AO2_DEBUG) */
+	}
+	AST_DLLIST_TRAVERSE_SAFE_END;
+
+	++self->n_buckets;
+	if (++self->split == self->level_buckets) {
+		self->level_buckets *= 2;
+		self->split = 0;
+	}
+}
+
 /*! Traversal state to restart a hash container traversal. */
 struct hash_traversal_state {
 	/*! Active sort function in the traversal if not NULL. */
@@ -83,7 +363,7 @@ struct hash_traversal_state {
 	void *arg;
 	/*! Starting hash bucket */
 	int bucket_start;
-	/*! Stopping hash bucket */
+	/*! Stopping hash bucket, -1 to traverse all buckets */
 	int bucket_last;
 	/*! Saved search flags to control traversing the container. */
 	enum search_flags flags;
@@ -121,8 +401,8 @@ static struct ao2_container *hash_ao2_alloc_empty_clone(struct ao2_container_has
 	}
 
 	return __ao2_container_alloc_hash(ao2_options_get(self), self->common.options,
-		self->n_buckets, self->hash_fn, self->common.sort_fn, self->common.cmp_fn,
-		tag, file, line, func);
+		self->level_buckets ? self->base_buckets : self->n_buckets, self->hash_fn,
+		self->common.sort_fn, self->common.cmp_fn, tag, file, line, func);
 }
 
 /*!
@@ -215,7 +495,10 @@ static struct hash_bucket_node *hash_ao2_new_node(struct ao2_container_hash *sel
 		return NULL;
 	}
 
-	i = abs(self->hash_fn(obj_new, OBJ_SEARCH_OBJECT) % self->n_buckets);
+	if (self->level_buckets) {
+		hash_ao2_grow(self);
+	}
+	i = hash_ao2_bucket(self, self->hash_fn(obj_new, OBJ_SEARCH_OBJECT));
 
 	__ao2_ref(obj_new, +1, tag ?: "Container node creation", file, line, func);
 	node->common.obj = obj_new;
@@ -361,8 +644,7 @@ static struct hash_bucket_node *hash_ao2_find_first(struct ao2_container_hash *s
 	case OBJ_SEARCH_OBJECT:
 	case OBJ_SEARCH_KEY:
 		/* we know hash can handle this case */
-		bucket_cur = abs(self->hash_fn(arg, flags & OBJ_SEARCH_MASK)
-				% self->n_buckets);
+		bucket_cur = hash_ao2_bucket(self, self->hash_fn(arg, flags & OBJ_SEARCH_MASK));
 		state->sort_fn = self->common.sort_fn;
 		break;
 	case OBJ_SEARCH_PARTIAL_KEY:
@@ -384,15 +666,16 @@ static struct hash_bucket_node *hash_ao2_find_first(struct ao2_container_hash *s
 		 * bucket_cur downto state->bucket_last
 		 */
 		if (bucket_cur < 0) {
-			bucket_cur = self->n_buckets - 1;
-			state->bucket_last = 0;
+			bucket_cur = hash_ao2_bucket_last(self);
+			state->bucket_last = -1;
 		} else {
 			state->bucket_last = bucket_cur;
 		}
 		state->bucket_start = bucket_cur;
 
 		/* For each bucket */
-		for (; state->bucket_last <= bucket_cur; --bucket_cur) {
+		for (; 0 <= bucket_cur; bucket_cur = bucket_cur == state->bucket_last
+			? -1 : hash_ao2_bucket_prev(self, bucket_cur)) {
 			/* For each node in the bucket. */
 			for (node = AST_DLLIST_LAST(&self->buckets[bucket_cur].list);
 				node;
@@ -423,18 +706,19 @@ static struct hash_bucket_node *hash_ao2_find_first(struct ao2_container_hash *s
 		/*
 		 * Determine the search boundaries of an ascending traversal.
 		 *
-		 * bucket_cur to state->bucket_last-1
+		 * bucket_cur to state->bucket_last
 		 */
 		if (bucket_cur < 0) {
 			bucket_cur = 0;
-			state->bucket_last = self->n_buckets;
+			state->bucket_last = -1;
 		} else {
-			state->bucket_last = bucket_cur + 1;
+			state->bucket_last = bucket_cur;
 		}
 		state->bucket_start = bucket_cur;
 
 		/* For each bucket */
-		for (; bucket_cur < state->bucket_last; ++bucket_cur) {
+		for (; 0 <= bucket_cur; bucket_cur = bucket_cur == state->bucket_last
+			? -1 : hash_ao2_bucket_next(self, bucket_cur)) {
 			/* For each node in the bucket. */
 			for (node = AST_DLLIST_FIRST(&self->buckets[bucket_cur].list);
 				node;
@@ -503,7 +787,8 @@ static struct hash_bucket_node *hash_ao2_find_next(struct ao2_container_hash *se
 		goto hash_descending_resume;
 
 		/* For each bucket */
-		for (; state->bucket_last <= bucket_cur; --bucket_cur) {
+		for (; 0 <= bucket_cur; bucket_cur = bucket_cur == state->bucket_last
+			? -1 : hash_ao2_bucket_prev(self, bucket_cur)) {
 			/* For each node in the bucket. */
 			for (node = AST_DLLIST_LAST(&self->buckets[bucket_cur].list);
 				node;
@@ -547,7 +832,8 @@ hash_descending_resume:;
 		goto hash_ascending_resume;
 
 		/* For each bucket */
-		for (; bucket_cur < state->bucket_last; ++bucket_cur) {
+		for (; 0 <= bucket_cur; bucket_cur = bucket_cur == state->bucket_last
+			? -1 : hash_ao2_bucket_next(self, bucket_cur)) {
 			/* For each node in the bucket. */
 			for (node = AST_DLLIST_FIRST(&self->buckets[bucket_cur].list);
 				node;
@@ -615,7 +901,7 @@ static struct hash_bucket_node *hash_ao2_iterator_next(struct ao2_container_hash
 
 	if (flags & AO2_ITERATOR_DESCENDING) {
 		if (node) {
-			cur_bucket = node->my_bucket;
+			cur_bucket = hash_ao2_bucket_prev(self, node->my_bucket);
 
 			/* Find next non-empty node. */
 			for (;;) {
@@ -630,11 +916,11 @@ static struct hash_bucket_node *hash_ao2_iterator_next(struct ao2_container_hash
 			}
 		} else {
 			/* Find first non-empty node. */
-			cur_bucket = self->n_buckets;
+			cur_bucket = hash_ao2_bucket_last(self);
 		}
 
 		/* Find a non-empty node in the remaining buckets */
-		while (0 <= --cur_bucket) {
+		for (; 0 <= cur_bucket; cur_bucket = hash_ao2_bucket_prev(self, cur_bucket)) {
 			node = AST_DLLIST_LAST(&self->buckets[cur_bucket].list);
 			while (node) {
 				if (node->common.obj) {
@@ -646,7 +932,7 @@ static struct hash_bucket_node *hash_ao2_iterator_next(struct ao2_container_hash
 		}
 	} else {
 		if (node) {
-			cur_bucket = node->my_bucket;
+			cur_bucket = hash_ao2_bucket_next(self, node->my_bucket);
 
 			/* Find next non-empty node. */
 			for (;;) {
@@ -661,11 +947,11 @@ static struct hash_bucket_node *hash_ao2_iterator_next(struct ao2_container_hash
 			}
 		} else {
 			/* Find first non-empty node. */
-			cur_bucket = -1;
+			cur_bucket = 0;
 		}
 
 		/* Find a non-empty node in the remaining buckets */
-		while (++cur_bucket < self->n_buckets) {
+		for (; 0 <= cur_bucket; cur_bucket = hash_ao2_bucket_next(self, cur_bucket)) {
 			node = AST_DLLIST_FIRST(&self->buckets[cur_bucket].list);
 			while (node) {
 				if (node->common.obj) {
@@ -725,6 +1011,206 @@ static void hash_ao2_unlink_node_stat(struct ao2_container *hash, struct ao2_con
 }
 #endif	/* defined(AO2_DEBUG) */
 
+/*!
+ * \internal
+ * \brief Release a retired lookup copy.
+ * \since 17.0.0
+ *
+ * \param head Snapshot to release.
+ *
+ * \return Nothing
+ */
+static void hash_snapshot_release(struct ao2_rcu_head *head)
+{
+	struct hash_snapshot *snapshot = (struct hash_snapshot *) head;
+	int idx;
+
+	for (idx = 0; idx < snapshot->count; ++idx) {
+		ao2_t_ref(snapshot->objs[idx], -1, "Release container lookup copy");
+	}
+	ast_free(snapshot);
+}
+
+/*!
+ * \internal
+ * \brief Copy the contents of a read-mostly container.
+ * \since 17.0.0
+ *
+ * \param self Container to operate upon.
+ *
+ * \note The container is already write locked.
+ *
+ * \retval snapshot on success.
+ * \retval NULL on error.
+ */
+static struct hash_snapshot *hash_snapshot_create(struct ao2_container_hash *self)
+{
+	struct hash_snapshot *snapshot;
+	struct hash_bucket_node *node;
+	int count = self->common.elements;
+	int bucket;
+	int idx = 0;
+
+	snapshot = ast_malloc(sizeof(*snapshot) + count * sizeof(snapshot->objs[0])
+		+ (self->n_buckets + 1) * sizeof(snapshot->first[0]));
+	if (!snapshot) {
+		return NULL;
+	}
+	snapshot->rcu.release = hash_snapshot_release;
+	snapshot->n_buckets = self->n_buckets;
+	snapshot->level_buckets = self->level_buckets;
+	snapshot->split = self->split;
+	snapshot->first = (int *) &snapshot->objs[count];
+
+	for (bucket = 0; bucket < self->n_buckets; ++bucket) {
+		snapshot->first[bucket] = idx;
+		AST_DLLIST_TRAVERSE(&self->buckets[bucket].list, node, links) {
+			if (node->common.obj && idx < count) {
+				snapshot->objs[idx++] = ao2_t_bump(node->common.obj, "Container lookup copy");
+			}
+		}
+	}
+	snapshot->first[bucket] = idx;
+	snapshot->count = idx;
+
+	return snapshot;
+}
+
+/*!
+ * \internal
+ * \brief Search a lookup copy like hash_ao2_find_first() would the container.
+ * \since 17.0.0
+ *
+ * \param self Container to operate upon.
+ * \param snapshot Lookup copy of the container.
+ * \param arg Search key or object.
+ * \param flags search_flags of the ao2_find().
+ *
+ * \return Object found.  (Not reffed)
+ * \retval NULL if not found.
+ */
+static void *hash_snapshot_find(struct ao2_container_hash *self,
+	struct hash_snapshot *snapshot, void *arg, enum search_flags flags)
+{
+	int bucket;
+	int idx;
+	int cmp;
+	int match;
+
+	bucket = hash_bucket_index(snapshot->n_buckets, snapshot->level_buckets,
+		snapshot->split, self->hash_fn(arg, flags & OBJ_SEARCH_MASK));
+	for (idx = snapshot->first[bucket]; idx < snapshot->first[bucket + 1]; ++idx) {
+		void *obj = snapshot->objs[idx];
+
+		if (self->common.sort_fn) {
+			cmp = self->common.sort_fn(obj, arg, flags & OBJ_SEARCH_MASK);
+			if (cmp < 0) {
+				continue;
+			}
+			if (cmp > 0) {
+				/* No more objects in this bucket are possible to match. */
+				break;
+			}
+		}
+
+		match = CMP_MATCH | CMP_STOP;
+		if (self->common.cmp_fn) {
+			match &= self->common.cmp_fn(obj, arg, flags);
+		}
+		if (match & CMP_MATCH) {
+			return obj;
+		}
+		if (match == CMP_STOP) {
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/*!
+ * \internal
+ * \brief Find an object in a read-mostly container without locking.
+ * \since 17.0.0
+ *
+ * \param self Container to operate upon.
+ * \param arg Search key or object.
+ * \param flags search_flags of the ao2_find().
+ * \param obj Where to put the object found.  (Reffed or NULL)
+ * \param tag used for debugging.
+ * \param file Debug file name invoked from
+ * \param line Debug line invoked from
+ * \param func Debug function name invoked from
+ *
+ * \details Lookups after a change find no copy.  The first one
+ * to get the write lock makes a new copy and searches that.
+ *
+ * \retval 0 if the search was answered.
+ * \retval -1 if the container must be searched with its lock held.
+ */
+static int hash_ao2_find_lockless(struct ao2_container_hash *self, void *arg,
+	enum search_flags flags, void **obj, const char *tag, const char *file, int line,
+	const char *func)
+{
+	struct hash_snapshot *snapshot;
+	int copied = 0;
+
+	for (;;) {
+		if (ao2_rcu_read_begin()) {
+			return -1;
+		}
+		snapshot = ast_atomic_load_n(&self->snapshot, __ATOMIC_SEQ_CST);
+		if (snapshot) {
+			*obj = hash_snapshot_find(self, snapshot, arg, flags);
+			if (*obj) {
+				__ao2_ref(*obj, +1, tag ?: "Traversal found object", file, line, func);
+			}
+			ao2_rcu_read_end();
+			return 0;
+		}
+		ao2_rcu_read_end();
+
+		/*
+		 * Without the lock the caller may already hold it, possibly
+		 * only for reading, so only try to lock for the copy.
+		 */
+		if (copied || (flags & OBJ_NOLOCK) || ao2_trywrlock(self)) {
+			return -1;
+		}
+		if (!self->snapshot) {
+			snapshot = hash_snapshot_create(self);
+			if (snapshot) {
+				ast_atomic_store_n(&self->snapshot, snapshot, __ATOMIC_SEQ_CST);
+			}
+		}
+		ao2_rcu_reclaim(&self->retired, 0);
+		ao2_unlock(self);
+		copied = 1;
+	}
+}
+
+/*!
+ * \internal
+ * \brief Drop the lookup copy of a read-mostly container that changed.
+ * \since 17.0.0
+ *
+ * \param self Container to operate upon.
+ *
+ * \note The container is already write locked.
+ *
+ * \return Nothing
+ */
+static void hash_ao2_changed(struct ao2_container_hash *self)
+{
+	struct hash_snapshot *snapshot;
+
+	snapshot = ast_atomic_exchange_n(&self->snapshot, NULL, __ATOMIC_SEQ_CST);
+	if (snapshot) {
+		ao2_rcu_retire(&self->retired, &snapshot->rcu);
+	}
+	ao2_rcu_reclaim(&self->retired, 0);
+}
+
 /*!
  * \internal
  *
@@ -747,6 +1233,17 @@ static void hash_ao2_destroy(struct ao2_container_hash *self)
 			break;
 		}
 	}
+
+	/* Nobody can be looking up objects in a container being destroyed. */
+	if (self->snapshot) {
+		hash_snapshot_release(&self->snapshot->rcu);
+		self->snapshot = NULL;
+	}
+	ao2_rcu_reclaim(&self->retired, 1);
+
+	if (self->buckets != self->fixed_buckets) {
+		ast_free(self->buckets);
+	}
 }
 
 #if defined(AO2_DEBUG)
@@ -825,7 +1322,26 @@ static void hash_ao2_stats(struct ao2_container_hash *self, void *where, ao2_prn
 	int bucket;
 	int suppressed_buckets = 0;
 
-	prnt(where, "Number of buckets: %d\n\n", self->n_buckets);
+	prnt(where, "Number of buckets: %d\n", self->n_buckets);
+	prnt(where, "Load factor: %.2f\n",
+		(double) ao2_container_count(&self->common) / self->n_buckets);
+	if (self->level_buckets) {
+		prnt(where, "Resizable: yes (level %d buckets, %d split, grows above load %d)\n",
+			self->level_buckets, self->split, HASH_RESIZE_MAX_LOAD);
+	} else {
+		prnt(where, "Resizable: no\n");
+	}
+	if (self->common.options & AO2_CONTAINER_ALLOC_OPT_READ_MOSTLY) {
+		struct ao2_rcu_head *head;
+		int retired = 0;
+
+		for (head = self->retired; head; head = head->next) {
+			++retired;
+		}
+		prnt(where, "Read-mostly: yes (lookup copy %s, %d retired)\n",
+			self->snapshot ? "current" : "none", retired);
+	}
+	prnt(where, "\n");
 
 	prnt(where, FORMAT, "Bucket", "Objects", "Max");
 	for (bucket = 0; bucket < self->n_buckets; ++bucket) {
@@ -959,8 +1475,8 @@ static int hash_ao2_integrity(struct ao2_container_hash *self)
 			++count_obj;
 
 			/* Check container hash key for expected bucket. */
-			bucket_exp = abs(self->hash_fn(node->common.obj, OBJ_SEARCH_OBJECT)
-					% self->n_buckets);
+			bucket_exp = hash_ao2_bucket(self,
+				self->hash_fn(node->common.obj, OBJ_SEARCH_OBJECT));
 			if (bucket != bucket_exp) {
 				ast_log(LOG_ERROR, "Bucket %d node hashes to bucket %d!\n",
 					bucket, bucket_exp);
@@ -1027,6 +1543,26 @@ static const struct ao2_container_methods v_table_hash = {
 #endif	/* defined(AO2_DEBUG) */
 };
 
+/*! Read-mostly hash container virtual method table. */
+static const struct ao2_container_methods v_table_hash_read_mostly = {
+	.alloc_empty_clone = (ao2_container_alloc_empty_clone_fn) hash_ao2_alloc_empty_clone,
+	.new_node = (ao2_container_new_node_fn) hash_ao2_new_node,
+	.insert = (ao2_container_insert_fn) hash_ao2_insert_node,
+	.traverse_first = (ao2_container_find_first_fn) hash_ao2_find_first,
+	.traverse_next = (ao2_container_find_next_fn) hash_ao2_find_next,
+	.iterator_next = (ao2_iterator_next_fn) hash_ao2_iterator_next,
+	.find_lockless = (ao2_container_find_lockless_fn) hash_ao2_find_lockless,
+	.changed = (ao2_container_changed_fn) hash_ao2_changed,
+	.destroy = (ao2_container_destroy_fn) hash_ao2_destroy,
+#if defined(AO2_DEBUG)
+	.link_stat = hash_ao2_link_node_stat,
+	.unlink_stat = hash_ao2_unlink_node_stat,
+	.dump = (ao2_container_display) hash_ao2_dump,
+	.stats = (ao2_container_statistics) hash_ao2_stats,
+	.integrity = (ao2_container_integrity) hash_ao2_integrity,
+#endif	/* defined(AO2_DEBUG) */
+};
+
 /*!
  * \brief always zero hash function
  *
@@ -1061,12 +1597,14 @@ static struct ao2_container *hash_ao2_container_init(
 		return NULL;
 	}
 
-	self->common.v_table = &v_table_hash;
+	self->common.v_table = (options & AO2_CONTAINER_ALLOC_OPT_READ_MOSTLY)
+		? &v_table_hash_read_mostly : &v_table_hash;
 	self->common.sort_fn = sort_fn;
 	self->common.cmp_fn = cmp_fn;
 	self->common.options = options;
 	self->hash_fn = hash_fn ? hash_fn : hash_zero;
 	self->n_buckets = n_buckets;
+	self->base_buckets = n_buckets;
 
 #ifdef AO2_DEBUG
 	ast_atomic_fetchadd_int(&ao2.total_containers, 1);
@@ -1083,12 +1621,40 @@ struct ao2_container *__ao2_container_alloc_hash(unsigned int ao2_options,
 	unsigned int num_buckets;
 	size_t container_size;
 	struct ao2_container_hash *self;
+	struct hash_bucket *buckets = NULL;
 
 	num_buckets = hash_fn ? n_buckets : 1;
-	container_size = sizeof(struct ao2_container_hash) + num_buckets * sizeof(struct hash_bucket);
+	if (!hash_fn || (ao2_options & AO2_ALLOC_OPT_LOCK_MASK) == AO2_ALLOC_OPT_LOCK_NOLOCK) {
+		container_options &= ~AO2_CONTAINER_ALLOC_OPT_READ_MOSTLY;
+	}
+	if (!hash_fn || !(container_options & AO2_CONTAINER_ALLOC_OPT_HASH_RESIZE)) {
+		container_options &= ~AO2_CONTAINER_ALLOC_OPT_HASH_RESIZE;
+		container_size = sizeof(struct ao2_container_hash) + num_buckets * sizeof(struct hash_bucket);
+	} else {
+		/* A resizable container keeps its buckets apart so they can be reallocated. */
+		buckets = ast_calloc(num_buckets, sizeof(struct hash_bucket));
+		if (!buckets) {
+			return NULL;
+		}
+		container_size = sizeof(struct ao2_container_hash);
+	}
 
 	self = __ao2_alloc(container_size, container_destruct, ao2_options,
 		tag ?: __PRETTY_FUNCTION__, file, line, func);
+	if (!self) {
+		ast_free(buckets);
+		return NULL;
+	}
+
+	if (buckets) {
+		self->buckets = buckets;
+		self->capacity = num_buckets;
+		self->level_buckets = num_buckets;
+	} else {
+		self->buckets = self->fixed_buckets;
+		self->capacity = num_buckets;
+	}
+
 	return hash_ao2_container_init(self, container_options, num_buckets, hash_fn,
 		sort_fn, cmp_fn);
 }
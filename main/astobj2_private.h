@@ -63,4 +63,68 @@ int internal_is_ao2_object(void *user_data);
 
 enum ao2_lock_req __adjust_lock(void *user_data, enum ao2_lock_req lock_how, int keep_stronger);
 
+/*!
+ * \brief Memory retired by a read-mostly container.
+ * \since 17.0.0
+ *
+ * \note Must be first in the retired memory block.
+ */
+struct ao2_rcu_head {
+	/*! Next retired block of the same container. */
+	struct ao2_rcu_head *next;
+	/*! Function releasing the block once no reader can see it. */
+	void (*release)(struct ao2_rcu_head *head);
+	/*! Epoch the block was retired in. */
+	unsigned int epoch;
+};
+
+/*!
+ * \brief Start reading memory that a writer may retire.
+ * \since 17.0.0
+ *
+ * \retval 0 on success.
+ * \retval -1 if the thread could not be registered as a reader.
+ *
+ * \note Sections may nest.  No lock is taken.
+ */
+int ao2_rcu_read_begin(void);
+
+/*!
+ * \brief Stop reading memory that a writer may retire.
+ * \since 17.0.0
+ *
+ * \note Only call after ao2_rcu_read_begin() succeeded.
+ */
+void ao2_rcu_read_end(void);
+
+/*!
+ * \brief Wait for the read sections already started to end.
+ * \since 17.0.0
+ *
+ * \note A read section of the calling thread is not waited for.
+ */
+void ao2_rcu_synchronize(void);
+
+/*!
+ * \brief Queue a block that new readers can no longer find.
+ * \since 17.0.0
+ *
+ * \param retired List of blocks waiting to be released.
+ * \param head Block to queue.
+ *
+ * \note The caller serializes access to the retired list.
+ */
+void ao2_rcu_retire(struct ao2_rcu_head **retired, struct ao2_rcu_head *head);
+
+/*!
+ * \brief Release the queued blocks no reader can be using anymore.
+ * \since 17.0.0
+ *
+ * \param retired List of blocks waiting to be released.
+ * \param all Release every block.  (No readers can exist)
+ *
+ * \return Number of blocks still waiting.
+ */
+int ao2_rcu_reclaim(struct ao2_rcu_head **retired, int all);
+
 #endif /* ASTOBJ2_PRIVATE_H_ */
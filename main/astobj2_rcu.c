@@ -0,0 +1,209 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2019, Sangoma Technologies Corporation
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*! \file
+ *
+ * \brief Epoch based reclamation for read-mostly astobj2 containers.
+ *
+ * \details Readers announce the epoch they started in and never
+ * lock.  Writers retire the memory they unpublished with a new
+ * epoch and only release it once every reader still inside a
+ * section started after it was retired.
+ */
+
+#include "asterisk.h"
+
+#include "asterisk/astobj2.h"
+#include "asterisk/linkedlists.h"
+#include "asterisk/lock.h"
+#include "asterisk/utils.h"
+#include "asterisk/threadstorage.h"
+#include "astobj2_private.h"
+
+/*! Read section state of a thread. */
+struct rcu_reader {
+	/*! Epoch the outermost section started in.  (0 if not reading) */
+	unsigned int epoch;
+	/*! Number of nested sections. */
+	unsigned int depth;
+	AST_LIST_ENTRY(rcu_reader) list;
+};
+
+/*! Every thread that ever read a read-mostly container. */
+static AST_LIST_HEAD_STATIC(rcu_readers, rcu_reader);
+
+/*! Current epoch.  Never 0. */
+static unsigned int rcu_epoch = 1;
+
+static int rcu_reader_init(void *data)
+{
+	struct rcu_reader *reader = data;
+
+	AST_LIST_LOCK(&rcu_readers);
+	AST_LIST_INSERT_TAIL(&rcu_readers, reader, list);
+	AST_LIST_UNLOCK(&rcu_readers);
+
+	return 0;
+}
+
+static void rcu_reader_cleanup(void *data)
+{
+	struct rcu_reader *reader = data;
+
+	AST_LIST_LOCK(&rcu_readers);
+	AST_LIST_REMOVE(&rcu_readers, reader, list);
+	AST_LIST_UNLOCK(&rcu_readers);
+
+	ast_free(reader);
+}
+
+AST_THREADSTORAGE_CUSTOM(rcu_reader_storage, rcu_reader_init, rcu_reader_cleanup);
+
+int ao2_rcu_read_begin(void)
+{
+	struct rcu_reader *reader = ast_threadstorage_get(&rcu_reader_storage, sizeof(*reader));
+	unsigned int epoch;
+
+	if (!reader) {
+		return -1;
+	}
+
+	if (reader->depth++) {
+		return 0;
+	}
+
+	/*
+	 * The store must be visible before the reader loads any
+	 * published pointer so a writer scanning the readers either
+	 * sees this epoch or the reader sees the writer's unpublish.
+	 * Caught in the middle of the counter wrapping, claim the
+	 * older epoch.
+	 */
+	epoch = ast_atomic_load_n(&rcu_epoch, __ATOMIC_SEQ_CST);
+	ast_atomic_store_n(&reader->epoch, epoch ?: UINT_MAX, __ATOMIC_SEQ_CST);
+
+	return 0;
+}
+
+void ao2_rcu_read_end(void)
+{
+	struct rcu_reader *reader = ast_threadstorage_get(&rcu_reader_storage, sizeof(*reader));
+
+	if (--reader->depth) {
+		return;
+	}
+
+	ast_atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+}
+
+/*!
+ * \internal
+ * \brief Start a new epoch.
+ *
+ * \return The new epoch.
+ */
+static unsigned int rcu_epoch_advance(void)
+{
+	unsigned int epoch;
+
+	epoch = ast_atomic_add_fetch(&rcu_epoch, 1, __ATOMIC_SEQ_CST);
+	if (!epoch) {
+		/* Epoch 0 means not reading so skip it when the counter wraps. */
+		epoch = ast_atomic_add_fetch(&rcu_epoch, 1, __ATOMIC_SEQ_CST);
+	}
+
+	return epoch;
+}
+
+void ao2_rcu_synchronize(void)
+{
+	struct rcu_reader *self = ast_threadstorage_get(&rcu_reader_storage, sizeof(*self));
+	struct rcu_reader *reader;
+	unsigned int epoch = rcu_epoch_advance();
+	int waiting;
+
+	for (;;) {
+		waiting = 0;
+		AST_LIST_LOCK(&rcu_readers);
+		AST_LIST_TRAVERSE(&rcu_readers, reader, list) {
+			unsigned int started = ast_atomic_load_n(&reader->epoch, __ATOMIC_SEQ_CST);
+
+			/* Sections started in this epoch or later cannot have seen the change. */
+			if (reader != self && started && epoch - started - 1 < UINT_MAX / 2) {
+				waiting = 1;
+				break;
+			}
+		}
+		AST_LIST_UNLOCK(&rcu_readers);
+
+		if (!waiting) {
+			break;
+		}
+		/* Read sections are short and never block. */
+		sched_yield();
+	}
+}
+
+void ao2_rcu_retire(struct ao2_rcu_head **retired, struct ao2_rcu_head *head)
+{
+	head->epoch = rcu_epoch_advance();
+	head->next = *retired;
+	*retired = head;
+}
+
+int ao2_rcu_reclaim(struct ao2_rcu_head **retired, int all)
+{
+	struct rcu_reader *reader;
+	struct ao2_rcu_head **prev;
+	struct ao2_rcu_head *head;
+	unsigned int now = 0;
+	unsigned int oldest = 0;
+	int readers = 0;
+	int waiting = 0;
+
+	if (!*retired) {
+		return 0;
+	}
+
+	if (!all) {
+		/* Ages are relative to now so the comparisons survive the counter wrapping. */
+		now = ast_atomic_load_n(&rcu_epoch, __ATOMIC_SEQ_CST);
+		AST_LIST_LOCK(&rcu_readers);
+		AST_LIST_TRAVERSE(&rcu_readers, reader, list) {
+			unsigned int epoch = ast_atomic_load_n(&reader->epoch, __ATOMIC_SEQ_CST);
+
+			if (epoch && (!readers || now - epoch > oldest)) {
+				oldest = now - epoch;
+				readers = 1;
+			}
+		}
+		AST_LIST_UNLOCK(&rcu_readers);
+	}
+
+	prev = retired;
+	while ((head = *prev)) {
+		/* A reader that started before the block was retired may still see it. */
+		if (!all && readers && now - head->epoch < oldest) {
+			prev = &head->next;
+			++waiting;
+			continue;
+		}
+		*prev = head->next;
+		head->release(head);
+	}
+
+	return waiting;
+}
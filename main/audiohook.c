@@ -52,6 +52,18 @@ struct ast_audiohook_translate {
 	struct ast_format *format;
 };
 
+/*! Number of spy sample rates a list resamples for itself */
+#define AUDIOHOOK_RESAMPLE_RATES 4
+
+/*! \brief Resampling of the list's signed linear audio to one spy sample rate */
+struct ast_audiohook_resample {
+	struct ast_trans_pvt *trans_pvt;
+	/*! Format translated from */
+	struct ast_format *from;
+	/*! Format translated to, NULL if unused */
+	struct ast_format *to;
+};
+
 struct ast_audiohook_list {
 	/* If all the audiohooks in this list are capable
 	 * of processing slinear at any sample rate, this
@@ -62,6 +74,8 @@ struct ast_audiohook_list {
 
 	struct ast_audiohook_translate in_translate[2];
 	struct ast_audiohook_translate out_translate[2];
+	/* Shared by all spies at the same rate, so each frame is resampled once per rate */
+	struct ast_audiohook_resample resample[2][AUDIOHOOK_RESAMPLE_RATES];
 	AST_LIST_HEAD_NOLOCK(, ast_audiohook) spy_list;
 	AST_LIST_HEAD_NOLOCK(, ast_audiohook) whisper_list;
 	AST_LIST_HEAD_NOLOCK(, ast_audiohook) manipulate_list;
@@ -167,7 +181,16 @@ int ast_audiohook_destroy(struct ast_audiohook *audiohook)
  * \param frame Frame to write in
  * \return Returns 0 on success, -1 on failure
  */
-int ast_audiohook_write_frame(struct ast_audiohook *audiohook, enum ast_audiohook_direction direction, struct ast_frame *frame)
+/*!
+ * \brief Write a frame to an audiohook, optionally handing over a copy made beforehand
+ *
+ * \param audiohook Audiohook to write to
+ * \param direction Direction the audio frame came from
+ * \param frame Frame to write
+ * \param dup If not NULL, a copy of \a frame made with ast_frdup() that the factory
+ *        takes instead of copying \a frame while locked. Set to NULL if it was taken.
+ */
+static int audiohook_write_frame(struct ast_audiohook *audiohook, enum ast_audiohook_direction direction, struct ast_frame *frame, struct ast_frame **dup)
 {
 	struct ast_slinfactory *factory = (direction == AST_AUDIOHOOK_DIRECTION_READ ? &audiohook->read_factory : &audiohook->write_factory);
 	struct ast_slinfactory *other_factory = (direction == AST_AUDIOHOOK_DIRECTION_READ ? &audiohook->write_factory : &audiohook->read_factory);
@@ -202,7 +225,11 @@ int ast_audiohook_write_frame(struct ast_audiohook *audiohook, enum ast_audiohoo
 	}
 
 	/* Write frame out to respective factory */
-	ast_slinfactory_feed(factory, frame);
+	if (dup && *dup && !ast_slinfactory_queue(factory, *dup)) {
+		*dup = NULL;
+	} else {
+		ast_slinfactory_feed(factory, frame);
+	}
 
 	/* If we need to notify the respective handler of this audiohook, do so */
 	if ((ast_test_flag(audiohook, AST_AUDIOHOOK_TRIGGER_MODE) == AST_AUDIOHOOK_TRIGGER_READ) && (direction == AST_AUDIOHOOK_DIRECTION_READ)) {
@@ -216,6 +243,11 @@ int ast_audiohook_write_frame(struct ast_audiohook *audiohook, enum ast_audiohoo
 	return 0;
 }
 
+int ast_audiohook_write_frame(struct ast_audiohook *audiohook, enum ast_audiohook_direction direction, struct ast_frame *frame)
+{
+	return audiohook_write_frame(audiohook, direction, frame, NULL);
+}
+
 static struct ast_frame *audiohook_read_frame_single(struct ast_audiohook *audiohook, size_t samples, enum ast_audiohook_direction direction)
 {
 	struct ast_slinfactory *factory = (direction == AST_AUDIOHOOK_DIRECTION_READ ? &audiohook->read_factory : &audiohook->write_factory);
@@ -574,6 +606,7 @@ int ast_audiohook_detach(struct ast_audiohook *audiohook)
 void ast_audiohook_detach_list(struct ast_audiohook_list *audiohook_list)
 {
 	int i;
+	int j;
 	struct ast_audiohook *audiohook;
 
 	if (!audiohook_list) {
@@ -604,7 +637,16 @@ void ast_audiohook_detach_list(struct ast_audiohook_list *audiohook_list)
 		}
 		if (audiohook_list->out_translate[i].trans_pvt) {
 			ast_translator_free_path(audiohook_list->out_translate[i].trans_pvt);
-			ao2_cleanup(audiohook_list->in_translate[i].format);
+			ao2_cleanup(audiohook_list->out_translate[i].format);
+		}
+		for (j = 0; j < AUDIOHOOK_RESAMPLE_RATES; j++) {
+			struct ast_audiohook_resample *resample = &audiohook_list->resample[i][j];
+
+			if (resample->trans_pvt) {
+				ast_translator_free_path(resample->trans_pvt);
+			}
+			ao2_cleanup(resample->from);
+			ao2_cleanup(resample->to);
 		}
 	}
 
@@ -879,6 +921,71 @@ static struct ast_frame *audiohook_list_translate_to_native(struct ast_audiohook
 	return outframe;
 }
 
+/*!
+ * \brief Get a spy's copy of a signed linear frame at the spy's sample rate
+ *
+ * \param audiohook_list audiohook_list data object
+ * \param direction Direction the frame is coming in from
+ * \param audiohook the spy to feed
+ * \param slin_frame the list's signed linear frame
+ * \param resampled frames already resampled for this slin_frame, one per rate
+ *
+ * \details Spies at the same rate share a single resampled frame rather than
+ * each resampling it in their own slinfactory. If the list is out of rates, or
+ * resampling fails, the frame is returned as is and left to the spy's factory.
+ *
+ * \return the frame to feed to the spy, to be freed with \a resampled
+ */
+static struct ast_frame *audiohook_list_resample_for_hook(struct ast_audiohook_list *audiohook_list,
+	enum ast_audiohook_direction direction, struct ast_audiohook *audiohook,
+	struct ast_frame *slin_frame, struct ast_frame **resampled)
+{
+	struct ast_audiohook_resample *resample = (direction == AST_AUDIOHOOK_DIRECTION_READ ?
+		audiohook_list->resample[0] : audiohook_list->resample[1]);
+	struct ast_format *slin;
+	int i;
+
+	if (audiohook->hook_internal_samp_rate == ast_format_get_sample_rate(slin_frame->subclass.format)) {
+		return slin_frame;
+	}
+
+	slin = ast_format_cache_get_slin_by_rate(audiohook->hook_internal_samp_rate);
+	for (i = 0; i < AUDIOHOOK_RESAMPLE_RATES; i++) {
+		if (!resample[i].to || ast_format_cmp(resample[i].to, slin) == AST_FORMAT_CMP_EQUAL) {
+			break;
+		}
+	}
+	if (i == AUDIOHOOK_RESAMPLE_RATES) {
+		return slin_frame;
+	}
+
+	if (resampled[i]) {
+		return resampled[i];
+	}
+
+	if (!resample[i].to
+		|| ast_format_cmp(resample[i].from, slin_frame->subclass.format) != AST_FORMAT_CMP_EQUAL) {
+		struct ast_trans_pvt *new_trans;
+
+		new_trans = ast_translator_build_path(slin, slin_frame->subclass.format);
+		if (!new_trans) {
+			return slin_frame;
+		}
+
+		if (resample[i].trans_pvt) {
+			ast_translator_free_path(resample[i].trans_pvt);
+		}
+		resample[i].trans_pvt = new_trans;
+
+		ao2_replace(resample[i].from, slin_frame->subclass.format);
+		ao2_replace(resample[i].to, slin);
+	}
+
+	resampled[i] = ast_translate(resample[i].trans_pvt, slin_frame, 0);
+
+	return resampled[i] ?: slin_frame;
+}
+
 /*!
  *\brief Set the audiohook's internal sample rate to the audiohook_list's rate,
  *       but only when native slin compatibility is turned on.
@@ -935,8 +1042,11 @@ static void audiohook_list_set_hook_rate(struct ast_audiohook_list *audiohook_li
 static struct ast_frame *audio_audiohook_write_list(struct ast_channel *chan, struct ast_audiohook_list *audiohook_list, enum ast_audiohook_direction direction, struct ast_frame *frame)
 {
 	struct ast_frame *start_frame = frame, *middle_frame = frame, *end_frame = frame;
+	struct ast_frame *resampled[AUDIOHOOK_RESAMPLE_RATES] = { NULL, };
+	struct ast_frame *dup = NULL;
 	struct ast_audiohook *audiohook = NULL;
 	int samples;
+	int rate;
 	int middle_frame_manipulated = 0;
 	int removed = 0;
 	int internal_sample_rate;
@@ -974,6 +1084,13 @@ static struct ast_frame *audio_audiohook_write_list(struct ast_channel *chan, st
 	/* ---Part_2: Send middle_frame to spy and manipulator lists.  middle_frame is guaranteed to be SLINEAR here.*/
 	/* Queue up signed linear frame to each spy */
 	AST_LIST_TRAVERSE_SAFE_BEGIN(&audiohook_list->spy_list, audiohook, list) {
+		struct ast_frame *hook_frame;
+
+		/* Copy the frame before locking, so the spy's reader is held up for less time */
+		if (!dup) {
+			dup = ast_frdup(middle_frame);
+		}
+
 		ast_audiohook_lock(audiohook);
 		if (audiohook->status != AST_AUDIOHOOK_STATUS_RUNNING) {
 			AST_LIST_REMOVE_CURRENT(list);
@@ -986,11 +1103,22 @@ static struct ast_frame *audio_audiohook_write_list(struct ast_channel *chan, st
 			continue;
 		}
 		audiohook_list_set_hook_rate(audiohook_list, audiohook, &internal_sample_rate);
-		ast_audiohook_write_frame(audiohook, direction, middle_frame);
+		hook_frame = audiohook_list_resample_for_hook(audiohook_list, direction, audiohook, middle_frame, resampled);
+		audiohook_write_frame(audiohook, direction, hook_frame, hook_frame == middle_frame ? &dup : NULL);
 		ast_audiohook_unlock(audiohook);
 	}
 	AST_LIST_TRAVERSE_SAFE_END;
 
+	if (dup) {
+		ast_frfree(dup);
+	}
+
+	for (rate = 0; rate < AUDIOHOOK_RESAMPLE_RATES; rate++) {
+		if (resampled[rate]) {
+			ast_frfree(resampled[rate]);
+		}
+	}
+
 	/* If this frame is being written out to the channel then we need to use whisper sources */
 	if (!AST_LIST_EMPTY(&audiohook_list->whisper_list)) {
 		int i = 0;
@@ -1440,19 +1440,63 @@ static void set_bridge_peer_vars(struct ast_bridge *bridge)
 	}
 }
 
+/*!
+ * \internal
+ * \brief Start a batch of joins and leaves on the bridge.
+ * \since 17.0.0
+ *
+ * \param bridge Bridge to batch operations on.
+ *
+ * \note On entry, bridge is already locked.
+ *
+ * \note Batches nest.  Bridge state publication and any work the
+ * bridge technology defers are done when the outermost batch ends.
+ */
+static void bridge_batch_begin(struct ast_bridge *bridge)
+{
+	++bridge->batching;
+}
+
+/*!
+ * \internal
+ * \brief End a batch of joins and leaves on the bridge.
+ * \since 17.0.0
+ *
+ * \param bridge Bridge to end the batch on.
+ *
+ * \note On entry, bridge is already locked.
+ */
+static void bridge_batch_end(struct ast_bridge *bridge)
+{
+	ast_assert(bridge->batching > 0);
+	if (--bridge->batching) {
+		return;
+	}
+
+	if (bridge->technology->batch_end) {
+		bridge->technology->batch_end(bridge);
+	}
+	if (bridge->batch_state_stale) {
+		ast_bridge_publish_state(bridge);
+	}
+}
+
 void bridge_reconfigured(struct ast_bridge *bridge, unsigned int colp_update)
 {
 	if (!bridge->reconfigured) {
 		return;
 	}
 	bridge->reconfigured = 0;
+	bridge_batch_begin(bridge);
 	if (ast_test_flag(&bridge->feature_flags, AST_BRIDGE_FLAG_SMART)
 		&& smart_bridge_operation(bridge)) {
 		/* Smart bridge failed. */
+		bridge_batch_end(bridge);
 		bridge_dissolve(bridge, 0);
 		return;
 	}
 	bridge_complete_join(bridge);
+	bridge_batch_end(bridge);
 
 	if (bridge->dissolved) {
 		return;
@@ -2091,6 +2135,13 @@ void bridge_do_merge(struct ast_bridge *dst_bridge, struct ast_bridge *src_bridg
 
 	ast_bridge_publish_merge(dst_bridge, src_bridge);
 
+	/*
+	 * Batch the moves so the bridge state is published and the
+	 * bridge technologies finish up once rather than per channel.
+	 */
+	bridge_batch_begin(dst_bridge);
+	bridge_batch_begin(src_bridge);
+
 	/*
 	 * Move channels from src_bridge over to dst_bridge.
 	 *
@@ -2162,6 +2213,9 @@ void bridge_do_merge(struct ast_bridge *dst_bridge, struct ast_bridge *src_bridg
 	bridge_reconfigured(dst_bridge, !optimized);
 	bridge_reconfigured(src_bridge, !optimized);
 
+	bridge_batch_end(src_bridge);
+	bridge_batch_end(dst_bridge);
+
 	ast_debug(1, "Merged bridge %s into bridge %s\n",
 		src_bridge->uniqueid, dst_bridge->uniqueid);
 }
@@ -2365,6 +2419,7 @@ int bridge_do_move(struct ast_bridge *dst_bridge, struct ast_bridge_channel *bri
 	orig_bridge = bridge_channel->bridge;
 	was_in_bridge = bridge_channel->in_bridge;
 
+	bridge_batch_begin(orig_bridge);
 	bridge_channel_internal_pull(bridge_channel);
 	if (bridge_channel->state != BRIDGE_CHANNEL_STATE_WAIT) {
 		/*
@@ -2376,8 +2431,10 @@ int bridge_do_move(struct ast_bridge *dst_bridge, struct ast_bridge_channel *bri
 		 */
 		bridge_channel->swap = NULL;
 		bridge_reconfigured(orig_bridge, 0);
+		bridge_batch_end(orig_bridge);
 		return -1;
 	}
+	bridge_batch_begin(dst_bridge);
 
 	/* Point to new bridge.*/
 	ao2_ref(orig_bridge, +1);/* Keep a ref in case the push fails. */
@@ -2411,6 +2468,8 @@ int bridge_do_move(struct ast_bridge *dst_bridge, struct ast_bridge_channel *bri
 
 	bridge_reconfigured(dst_bridge, !optimized);
 	bridge_reconfigured(orig_bridge, !optimized);
+	bridge_batch_end(dst_bridge);
+	bridge_batch_end(orig_bridge);
 	ao2_ref(orig_bridge, -1);
 	return res;
 }
@@ -3755,6 +3814,20 @@ void ast_bridge_set_mixing_interval(struct ast_bridge *bridge, unsigned int mixi
 	ast_bridge_unlock(bridge);
 }
 
+void ast_bridge_set_mixing_threads(struct ast_bridge *bridge, unsigned int mixing_threads)
+{
+	ast_bridge_lock(bridge);
+	bridge->softmix.mixing_threads = mixing_threads;
+	ast_bridge_unlock(bridge);
+}
+
+void ast_bridge_set_resample_quality(struct ast_bridge *bridge, unsigned int resample_quality)
+{
+	ast_bridge_lock(bridge);
+	bridge->softmix.resample_quality = resample_quality;
+	ast_bridge_unlock(bridge);
+}
+
 void ast_bridge_set_binaural_active(struct ast_bridge *bridge, unsigned int binaural_active)
 {
 	ast_bridge_lock(bridge);
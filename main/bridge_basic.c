@@ -3103,6 +3103,7 @@ static int attach_framehook(struct attended_transfer_properties *props, struct a
 		.destroy_cb = transfer_target_framehook_destroy_cb,
 		.consume_cb = transfer_target_framehook_consume,
 		.disable_inheritance = 1,
+		.frame_types = AST_FRAMEHOOK_FRAME_TYPE(AST_FRAME_CONTROL),
 	};
 
 	ao2_ref(props, +1);
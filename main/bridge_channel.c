@@ -57,6 +57,7 @@
 #include "asterisk/sem.h"
 #include "asterisk/stream.h"
 #include "asterisk/message.h"
+#include "asterisk/media_trace.h"
 
 /*!
  * \brief Used to queue an action frame onto a bridge channel and write an action frame into a bridge.
@@ -693,6 +694,7 @@ static int bridge_channel_write_frame(struct ast_bridge_channel *bridge_channel,
 		frame->stream_num = -1;
 	}
 
+	ast_media_trace_stage(frame, AST_MEDIA_TRACE_BRIDGE, bridge_channel->bridge->technology->name);
 	deferred = bridge_channel->bridge->technology->write(bridge_channel->bridge, bridge_channel, frame);
 	if (deferred) {
 		struct ast_frame *dup;
@@ -1043,7 +1045,8 @@ int ast_bridge_channel_queue_frame(struct ast_bridge_channel *bridge_channel, st
 		return 0;
 	}
 
-	dup = ast_frdup(fr);
+	/* Queued frames are only written out, so a shared payload stays shared */
+	dup = ast_frdup_readonly(fr);
 	if (!dup) {
 		return -1;
 	}
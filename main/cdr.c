@@ -70,6 +70,8 @@
 #include "asterisk/stasis_message_router.h"
 #include "asterisk/astobj2.h"
 #include "asterisk/taskprocessor.h"
+#include "asterisk/threadpool.h"
+#include "asterisk/vector.h"
 
 /*** DOCUMENTATION
 	<configInfo name="cdr" language="en_US">
@@ -181,6 +183,18 @@
 					submission of CDR data during asterisk shutdown, set this to <literal>yes</literal>.</para>
 					</description>
 				</configOption>
+				<configOption name="shards">
+					<synopsis>Number of threads processing channel and bridge messages into CDRs</synopsis>
+					<description><para>By default a single thread turns all channel and bridge
+					activity into CDRs, which can fall behind on a busy system.  Setting this
+					above <literal>1</literal> spreads the calls over that many threads.  The
+					messages of a channel are still processed in order, and the channels of
+					a call are normally processed by the same thread.  Work relating the
+					CDRs of different calls to each other, such as bridging, holds off the
+					other threads while it runs.</para>
+					<para>This option only takes effect when Asterisk is started.</para>
+					</description>
+				</configOption>
 			</configObject>
 		</configFile>
 	</configInfo>
@@ -199,6 +213,8 @@
 #define MAX_BATCH_TIME 86400
 #define DEFAULT_BATCH_SCHEDULER_ONLY "0"
 #define DEFAULT_BATCH_SAFE_SHUTDOWN "1"
+#define DEFAULT_SHARDS "0"
+#define MAX_SHARDS 64
 
 #define cdr_set_debug_mode(mod_cfg) \
 	do { \
@@ -302,7 +318,9 @@ static void *module_config_alloc(void)
 	struct module_config *mod_cfg;
 	struct ast_cdr_config *cdr_config;
 
-	mod_cfg = ao2_alloc(sizeof(*mod_cfg), module_config_destructor);
+	/* Referenced for every CDR event so let the global holder shard its count. */
+	mod_cfg = ao2_alloc_options(sizeof(*mod_cfg), module_config_destructor,
+		AO2_ALLOC_OPT_LOCK_MUTEX | AO2_ALLOC_OPT_REF_SHARDED);
 	if (!mod_cfg) {
 		return NULL;
 	}
@@ -385,6 +403,24 @@ static struct stasis_topic *cdr_topic;
 /*! \brief A message type used to synchronize with the CDR topic */
 STASIS_MESSAGE_TYPE_DEFN_LOCAL(cdr_sync_message_type);
 
+/*! \brief Serializers the CDR messages are spread over (empty if all are handled by the router) */
+static AST_VECTOR(, struct ast_taskprocessor *) cdr_shards;
+
+/*! \brief Thread pool running the shard serializers */
+static struct ast_threadpool *cdr_shard_pool;
+
+/*! \brief The shard of every channel by uniqueid.  Only changed by the router thread. */
+static struct ao2_container *cdr_shard_channels;
+
+/*!
+ * \brief Held shared by shard handlers touching only the CDRs of their own
+ * channel and exclusively by those touching the CDRs of other channels.
+ */
+AST_RWLOCK_DEFINE_STATIC(cdr_shard_lock);
+
+/*! \brief Taken around acquiring cdr_shard_lock so shared holders cannot starve a waiting exclusive one */
+AST_MUTEX_DEFINE_STATIC(cdr_shard_gate);
+
 struct cdr_object;
 
 /*! \brief Return types for \ref process_bridge_enter functions */
@@ -698,14 +734,25 @@ struct cdr_object_fn_table finalized_state_fn_table = {
 	.process_bridge_enter = base_process_bridge_enter,
 };
 
+/*!
+ * \brief CDR variables of a party
+ *
+ * The CDRs in a chain start out with the variables of the one before
+ * them, so the list is shared by reference until one of them changes
+ * it.  A list held by more than one party is never modified.
+ */
+struct cdr_object_variables {
+	struct varshead head;                   /*!< The variables */
+};
+
 /*! \brief A wrapper object around a snapshot.
  * Fields that are mutable by the CDR engine are replicated here.
  */
 struct cdr_object_snapshot {
 	struct ast_channel_snapshot *snapshot;  /*!< The channel snapshot */
-	char userfield[AST_MAX_USER_FIELD];     /*!< Userfield for the channel */
+	char *userfield;                        /*!< Userfield for the channel, NULL if not set */
 	unsigned int flags;                     /*!< Specific flags for this party */
-	struct varshead variables;              /*!< CDR variables for the channel */
+	struct cdr_object_variables *variables; /*!< CDR variables for the channel, NULL if none */
 };
 
 /*! \brief An in-memory representation of an active CDR */
@@ -782,6 +829,77 @@ static void free_variables(struct varshead *headp)
 	}
 }
 
+/*! \brief The variables of a party that has none */
+static struct varshead cdr_no_variables;
+
+static void cdr_object_variables_dtor(void *obj)
+{
+	struct cdr_object_variables *variables = obj;
+
+	free_variables(&variables->head);
+}
+
+/*!
+ * \internal
+ * \brief Get the variables of a party for reading
+ */
+static struct varshead *cdr_party_variables(struct cdr_object_snapshot *party)
+{
+	return party->variables ? &party->variables->head : &cdr_no_variables;
+}
+
+/*!
+ * \internal
+ * \brief Get the variables of a party for modification
+ *
+ * \note A list shared with other parties is copied first.
+ *
+ * \retval NULL on allocation failure
+ */
+static struct varshead *cdr_party_variables_writable(struct cdr_object_snapshot *party)
+{
+	struct cdr_object_variables *variables;
+
+	if (party->variables && ao2_ref(party->variables, 0) == 1) {
+		return &party->variables->head;
+	}
+
+	variables = ao2_alloc_options(sizeof(*variables), cdr_object_variables_dtor,
+		AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!variables) {
+		return NULL;
+	}
+	if (party->variables) {
+		copy_variables(&variables->head, &party->variables->head);
+		ao2_ref(party->variables, -1);
+	}
+	party->variables = variables;
+
+	return &variables->head;
+}
+
+/*!
+ * \internal
+ * \brief Drop all variables of a party
+ */
+static void cdr_party_variables_clear(struct cdr_object_snapshot *party)
+{
+	ao2_cleanup(party->variables);
+	party->variables = NULL;
+}
+
+/*!
+ * \internal
+ * \brief Set the userfield of a party
+ *
+ * \note The userfield is truncated to what the public CDR can hold.
+ */
+static void cdr_party_set_userfield(struct cdr_object_snapshot *party, const char *userfield)
+{
+	ast_free(party->userfield);
+	party->userfield = ast_strlen_zero(userfield) ? NULL : ast_strndup(userfield, AST_MAX_USER_FIELD - 1);
+}
+
 /*!
  * \brief Copy a snapshot and its details
  * \param dst The destination
@@ -789,10 +907,16 @@ static void free_variables(struct varshead *headp)
  */
 static void cdr_object_snapshot_copy(struct cdr_object_snapshot *dst, struct cdr_object_snapshot *src)
 {
+	struct varshead *headp;
+
 	ao2_t_replace(dst->snapshot, src->snapshot, "CDR snapshot copy");
-	strcpy(dst->userfield, src->userfield);
+	cdr_party_set_userfield(dst, src->userfield);
 	dst->flags = src->flags;
-	copy_variables(&dst->variables, &src->variables);
+	if (!dst->variables || AST_LIST_EMPTY(&dst->variables->head)) {
+		ao2_replace(dst->variables, src->variables);
+	} else if (src->variables && (headp = cdr_party_variables_writable(dst))) {
+		copy_variables(headp, &src->variables->head);
+	}
 }
 
 /*!
@@ -998,16 +1122,13 @@ static void cdr_all_unlink(struct cdr_object *cdr)
 static void cdr_object_dtor(void *obj)
 {
 	struct cdr_object *cdr = obj;
-	struct ast_var_t *it_var;
 
 	ao2_cleanup(cdr->party_a.snapshot);
 	ao2_cleanup(cdr->party_b.snapshot);
-	while ((it_var = AST_LIST_REMOVE_HEAD(&cdr->party_a.variables, entries))) {
-		ast_var_delete(it_var);
-	}
-	while ((it_var = AST_LIST_REMOVE_HEAD(&cdr->party_b.variables, entries))) {
-		ast_var_delete(it_var);
-	}
+	ao2_cleanup(cdr->party_a.variables);
+	ao2_cleanup(cdr->party_b.variables);
+	ast_free(cdr->party_a.userfield);
+	ast_free(cdr->party_b.userfield);
 	ast_string_field_free_memory(cdr);
 
 	/* CDR destruction used to work by calling ao2_cleanup(next) and
@@ -1275,6 +1396,27 @@ static void set_variable(struct varshead *headp, const char *name, const char *v
 	}
 }
 
+/*!
+ * \internal
+ * \brief Set a variable on a party of a CDR object
+ *
+ * \param party The party to set the variable on
+ * \param name The name of the variable
+ * \param value The value of the variable, or NULL to remove it
+ */
+static void cdr_party_set_variable(struct cdr_object_snapshot *party, const char *name, const char *value)
+{
+	struct varshead *headp;
+
+	if (!value && !party->variables) {
+		return;
+	}
+	headp = cdr_party_variables_writable(party);
+	if (headp) {
+		set_variable(headp, name, value);
+	}
+}
+
 /*!
  * \brief Create a chain of \ref ast_cdr objects from a chain of \ref cdr_object
  * suitable for consumption by the registered CDR backends
@@ -1327,7 +1469,7 @@ static struct ast_cdr *cdr_object_create_public_records(struct cdr_object *cdr)
 			ast_copy_string(cdr_copy->dstchannel, party_b->base->name, sizeof(cdr_copy->dstchannel));
 			ast_copy_string(cdr_copy->peeraccount, party_b->base->accountcode, sizeof(cdr_copy->peeraccount));
 			if (!ast_strlen_zero(it_cdr->party_b.userfield)) {
-				snprintf(cdr_copy->userfield, sizeof(cdr_copy->userfield), "%s;%s", it_cdr->party_a.userfield, it_cdr->party_b.userfield);
+				snprintf(cdr_copy->userfield, sizeof(cdr_copy->userfield), "%s;%s", S_OR(it_cdr->party_a.userfield, ""), it_cdr->party_b.userfield);
 			}
 		}
 		if (ast_strlen_zero(cdr_copy->userfield) && !ast_strlen_zero(it_cdr->party_a.userfield)) {
@@ -1348,8 +1490,8 @@ static struct ast_cdr *cdr_object_create_public_records(struct cdr_object *cdr)
 		cdr_copy->sequence = it_cdr->sequence;
 
 		/* Variables */
-		copy_variables(&cdr_copy->varshead, &it_cdr->party_a.variables);
-		AST_LIST_TRAVERSE(&it_cdr->party_b.variables, it_var, entries) {
+		copy_variables(&cdr_copy->varshead, cdr_party_variables(&it_cdr->party_a));
+		AST_LIST_TRAVERSE(cdr_party_variables(&it_cdr->party_b), it_var, entries) {
 			int found = 0;
 			struct ast_var_t *newvariable;
 			AST_LIST_TRAVERSE(&cdr_copy->varshead, it_copy_var, entries) {
@@ -1502,19 +1644,19 @@ static void cdr_object_check_party_a_answer(struct cdr_object *cdr)
 static void cdr_object_update_cid(struct cdr_object_snapshot *old_snapshot, struct ast_channel_snapshot *new_snapshot)
 {
 	if (!old_snapshot->snapshot) {
-		set_variable(&old_snapshot->variables, "dnid", new_snapshot->caller->dnid);
-		set_variable(&old_snapshot->variables, "callingsubaddr", new_snapshot->caller->subaddr);
-		set_variable(&old_snapshot->variables, "calledsubaddr", new_snapshot->caller->dialed_subaddr);
+		cdr_party_set_variable(old_snapshot, "dnid", new_snapshot->caller->dnid);
+		cdr_party_set_variable(old_snapshot, "callingsubaddr", new_snapshot->caller->subaddr);
+		cdr_party_set_variable(old_snapshot, "calledsubaddr", new_snapshot->caller->dialed_subaddr);
 		return;
 	}
 	if (strcmp(old_snapshot->snapshot->caller->dnid, new_snapshot->caller->dnid)) {
-		set_variable(&old_snapshot->variables, "dnid", new_snapshot->caller->dnid);
+		cdr_party_set_variable(old_snapshot, "dnid", new_snapshot->caller->dnid);
 	}
 	if (strcmp(old_snapshot->snapshot->caller->subaddr, new_snapshot->caller->subaddr)) {
-		set_variable(&old_snapshot->variables, "callingsubaddr", new_snapshot->caller->subaddr);
+		cdr_party_set_variable(old_snapshot, "callingsubaddr", new_snapshot->caller->subaddr);
 	}
 	if (strcmp(old_snapshot->snapshot->caller->dialed_subaddr, new_snapshot->caller->dialed_subaddr)) {
-		set_variable(&old_snapshot->variables, "calledsubaddr", new_snapshot->caller->dialed_subaddr);
+		cdr_party_set_variable(old_snapshot, "calledsubaddr", new_snapshot->caller->dialed_subaddr);
 	}
 }
 
@@ -2264,13 +2406,12 @@ static int check_new_cdr_needed(struct ast_channel_snapshot *old_snapshot,
 }
 
 /*!
- * \brief Handler for channel snapshot update messages
+ * \brief Update the CDRs of a channel as Party A from its snapshot update message
  * \param data Passed on
  * \param sub The stasis subscription for this message callback
- * \param topic The topic this message was published for
  * \param message The message
  */
-static void handle_channel_snapshot_update_message(void *data, struct stasis_subscription *sub, struct stasis_message *message)
+static void handle_channel_snapshot_party_a_message(void *data, struct stasis_subscription *sub, struct stasis_message *message)
 {
 	struct cdr_object *cdr;
 	struct ast_channel_snapshot_update *update = stasis_message_data(message);
@@ -2330,7 +2471,23 @@ static void handle_channel_snapshot_update_message(void *data, struct stasis_sub
 		ao2_unlink(active_cdrs_master, cdr);
 	}
 
-	/* Handle Party B */
+	ao2_cleanup(cdr);
+}
+
+/*!
+ * \brief Update the CDRs a channel is Party B in from its snapshot update message
+ * \param data Passed on
+ * \param sub The stasis subscription for this message callback
+ * \param message The message
+ */
+static void handle_channel_snapshot_party_b_message(void *data, struct stasis_subscription *sub, struct stasis_message *message)
+{
+	struct ast_channel_snapshot_update *update = stasis_message_data(message);
+
+	if (filter_channel_snapshot_message(update->old_snapshot, update->new_snapshot)) {
+		return;
+	}
+
 	if (update->new_snapshot) {
 		ao2_callback_data(active_cdrs_all, OBJ_NODATA | OBJ_MULTIPLE | OBJ_SEARCH_KEY,
 			cdr_object_update_party_b, (char *) update->new_snapshot->base->name, update->new_snapshot);
@@ -2340,8 +2497,18 @@ static void handle_channel_snapshot_update_message(void *data, struct stasis_sub
 		ao2_callback_data(active_cdrs_all, OBJ_NODATA | OBJ_MULTIPLE | OBJ_SEARCH_KEY,
 			cdr_object_finalize_party_b, (char *) update->new_snapshot->base->name, update->new_snapshot);
 	}
+}
 
-	ao2_cleanup(cdr);
+/*!
+ * \brief Handler for channel snapshot update messages
+ * \param data Passed on
+ * \param sub The stasis subscription for this message callback
+ * \param message The message
+ */
+static void handle_channel_snapshot_update_message(void *data, struct stasis_subscription *sub, struct stasis_message *message)
+{
+	handle_channel_snapshot_party_a_message(data, sub, message);
+	handle_channel_snapshot_party_b_message(data, sub, message);
 }
 
 struct bridge_leave_data {
@@ -2792,6 +2959,371 @@ static void handle_parked_call_message(void *data, struct stasis_subscription *s
 	ao2_cleanup(cdr);
 }
 
+/*! \brief The shard a channel was assigned when it was first seen */
+struct cdr_shard_channel {
+	/*! Index of the shard in cdr_shards */
+	unsigned int shard;
+	/*! Uniqueid of the channel */
+	char uniqueid[0];
+};
+
+/*! \brief Hashing function for cdr_shard_channel */
+AO2_STRING_FIELD_HASH_FN(cdr_shard_channel, uniqueid)
+
+/*! \brief Comparator function for cdr_shard_channel */
+AO2_STRING_FIELD_CMP_FN(cdr_shard_channel, uniqueid)
+
+/*! \brief How the messages of a type are handled on the shards */
+struct cdr_shard_route {
+	/*! Handler run alongside the handlers of other shards (optional) */
+	stasis_subscription_cb shared;
+	/*! Handler run while the handlers of all other shards are held off (optional) */
+	stasis_subscription_cb exclusive;
+	/*! Whether the exclusive handler has anything to do for a message (optional) */
+	int (*needs_exclusive)(struct stasis_message *message);
+};
+
+/*! \brief A message waiting on its shard */
+struct cdr_shard_task {
+	const struct cdr_shard_route *route;
+	struct stasis_message *message;
+};
+
+/*!
+ * \internal
+ * \brief Whether a channel snapshot update has to update the CDRs of other channels.
+ *
+ * \note A channel becoming someone's Party B on another shard after the check
+ * only misses this update of the Party B snapshot.  The next one is seen.
+ */
+static int cdr_shard_is_party_b(struct stasis_message *message)
+{
+	struct ast_channel_snapshot_update *update = stasis_message_data(message);
+	struct cdr_object *cdr;
+
+	if (!update->new_snapshot) {
+		return 0;
+	}
+	cdr = ao2_find(active_cdrs_all, update->new_snapshot->base->name, OBJ_SEARCH_KEY);
+	ao2_cleanup(cdr);
+
+	return cdr != NULL;
+}
+
+static const struct cdr_shard_route channel_snapshot_route = {
+	.shared = handle_channel_snapshot_party_a_message,
+	.exclusive = handle_channel_snapshot_party_b_message,
+	.needs_exclusive = cdr_shard_is_party_b,
+};
+
+static const struct cdr_shard_route dial_route = {
+	.shared = handle_dial_message,
+};
+
+/* These pair up or update the CDRs of every channel in the bridge */
+static const struct cdr_shard_route bridge_enter_route = {
+	.exclusive = handle_bridge_enter_message,
+};
+
+static const struct cdr_shard_route bridge_leave_route = {
+	.exclusive = handle_bridge_leave_message,
+};
+
+static const struct cdr_shard_route parked_call_route = {
+	.exclusive = handle_parked_call_message,
+};
+
+static int cdr_shard_task_run(void *data)
+{
+	struct cdr_shard_task *task = data;
+	const struct cdr_shard_route *route = task->route;
+
+	if (route->shared) {
+		ast_mutex_lock(&cdr_shard_gate);
+		ast_rwlock_rdlock(&cdr_shard_lock);
+		ast_mutex_unlock(&cdr_shard_gate);
+		route->shared(NULL, NULL, task->message);
+		ast_rwlock_unlock(&cdr_shard_lock);
+	}
+
+	if (route->exclusive && (!route->needs_exclusive || route->needs_exclusive(task->message))) {
+		ast_mutex_lock(&cdr_shard_gate);
+		ast_rwlock_wrlock(&cdr_shard_lock);
+		ast_mutex_unlock(&cdr_shard_gate);
+		route->exclusive(NULL, NULL, task->message);
+		ast_rwlock_unlock(&cdr_shard_lock);
+	}
+
+	ao2_cleanup(task->message);
+	ast_free(task);
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Find the shard a channel was assigned.
+ *
+ * \retval -1 if it was never seen or is gone
+ */
+static int cdr_shard_find(const char *uniqueid)
+{
+	struct cdr_shard_channel *channel;
+	int shard;
+
+	channel = ao2_find(cdr_shard_channels, uniqueid, OBJ_SEARCH_KEY);
+	if (!channel) {
+		return -1;
+	}
+	shard = channel->shard;
+	ao2_ref(channel, -1);
+
+	return shard;
+}
+
+/*!
+ * \internal
+ * \brief Get the shard of a channel, assigning one when it is new.
+ *
+ * A new channel goes to the shard of its linkedid so the channels a call
+ * creates stay together.  It keeps that shard when its linkedid changes
+ * later on so its messages all stay in order.
+ */
+static unsigned int cdr_shard_get(struct ast_channel_snapshot *snapshot)
+{
+	struct cdr_shard_channel *channel;
+	int shard = cdr_shard_find(snapshot->base->uniqueid);
+
+	if (shard >= 0) {
+		return shard;
+	}
+
+	shard = ast_str_hash(snapshot->peer->linkedid) % AST_VECTOR_SIZE(&cdr_shards);
+	channel = ao2_alloc_options(sizeof(*channel) + strlen(snapshot->base->uniqueid) + 1, NULL,
+		AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (channel) {
+		channel->shard = shard;
+		strcpy(channel->uniqueid, snapshot->base->uniqueid); /* Safe */
+		ao2_link(cdr_shard_channels, channel);
+		ao2_ref(channel, -1);
+	}
+
+	return shard;
+}
+
+/*!
+ * \internal
+ * \brief Router callback passing a message on to the shard of its channel.
+ */
+static void cdr_shard_route_cb(void *data, struct stasis_subscription *sub, struct stasis_message *message)
+{
+	const struct cdr_shard_route *route = data;
+	struct stasis_message_type *type = stasis_message_type(message);
+	struct ast_channel_snapshot *snapshot = NULL;
+	struct cdr_shard_task *task;
+	int dead = 0;
+
+	if (type == ast_channel_snapshot_type()) {
+		struct ast_channel_snapshot_update *update = stasis_message_data(message);
+
+		snapshot = update->new_snapshot ?: update->old_snapshot;
+		dead = ast_test_flag(&snapshot->flags, AST_FLAG_DEAD);
+	} else if (type == ast_channel_dial_type()) {
+		struct ast_multi_channel_blob *payload = stasis_message_data(message);
+
+		snapshot = ast_multi_channel_blob_get_channel(payload, "caller")
+			?: ast_multi_channel_blob_get_channel(payload, "peer");
+	} else if (type == ast_parked_call_type()) {
+		struct ast_parked_call_payload *payload = stasis_message_data(message);
+
+		snapshot = payload->parkee;
+	} else {
+		struct ast_bridge_blob *update = stasis_message_data(message);
+
+		snapshot = update->channel;
+	}
+	if (!snapshot) {
+		return;
+	}
+
+	task = ast_malloc(sizeof(*task));
+	if (!task) {
+		return;
+	}
+	task->route = route;
+	task->message = ao2_bump(message);
+	if (ast_taskprocessor_push(AST_VECTOR_GET(&cdr_shards, cdr_shard_get(snapshot)),
+		cdr_shard_task_run, task)) {
+		ao2_cleanup(task->message);
+		ast_free(task);
+	}
+
+	if (dead) {
+		ao2_find(cdr_shard_channels, snapshot->base->uniqueid,
+			OBJ_SEARCH_KEY | OBJ_UNLINK | OBJ_NODATA);
+	}
+}
+
+/*! \brief Lets a thread waiting on a shard know it got to the wait */
+struct cdr_shard_wait {
+	ast_mutex_t lock;
+	ast_cond_t cond;
+	int done;
+};
+
+static int cdr_shard_wait_task(void *data)
+{
+	struct cdr_shard_wait *wait = data;
+
+	ast_mutex_lock(&wait->lock);
+	wait->done = 1;
+	ast_cond_signal(&wait->cond);
+	ast_mutex_unlock(&wait->lock);
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Wait until a shard handled the messages passed to it so far.
+ */
+static void cdr_shard_wait(struct ast_taskprocessor *shard)
+{
+	struct cdr_shard_wait wait = { .done = 0, };
+
+	ast_mutex_init(&wait.lock);
+	ast_cond_init(&wait.cond, NULL);
+	if (!ast_taskprocessor_push(shard, cdr_shard_wait_task, &wait)) {
+		ast_mutex_lock(&wait.lock);
+		while (!wait.done) {
+			ast_cond_wait(&wait.cond, &wait.lock);
+		}
+		ast_mutex_unlock(&wait.lock);
+	}
+	ast_cond_destroy(&wait.cond);
+	ast_mutex_destroy(&wait.lock);
+}
+
+/*!
+ * \internal
+ * \brief Get the shard the calling thread is running.
+ *
+ * \retval NULL if it is not running one
+ */
+static struct ast_taskprocessor *cdr_shard_current(void)
+{
+	int i;
+
+	for (i = 0; i < AST_VECTOR_SIZE(&cdr_shards); ++i) {
+		if (ast_taskprocessor_is_task(AST_VECTOR_GET(&cdr_shards, i))) {
+			return AST_VECTOR_GET(&cdr_shards, i);
+		}
+	}
+	return NULL;
+}
+
+/*!
+ * \internal
+ * \brief Wait until all shards handled the messages passed to them so far.
+ */
+static void cdr_shards_wait(void)
+{
+	int i;
+
+	if (cdr_shard_current()) {
+		return;
+	}
+	for (i = 0; i < AST_VECTOR_SIZE(&cdr_shards); ++i) {
+		cdr_shard_wait(AST_VECTOR_GET(&cdr_shards, i));
+	}
+}
+
+/*!
+ * \internal
+ * \brief Wait until the shard of a channel handled the messages routed so far.
+ *
+ * The public functions changing or reading the CDRs of a channel by name are
+ * mostly called by message handlers added to the CDR router.  Waiting on the
+ * channel's shard first keeps them seeing what they did when the router
+ * handled everything.
+ */
+static void cdr_shard_sync_channel(const char *channel_name)
+{
+	struct ast_channel_snapshot *snapshot;
+	int shard;
+
+	if (!AST_VECTOR_SIZE(&cdr_shards) || ast_strlen_zero(channel_name) || cdr_shard_current()) {
+		return;
+	}
+
+	snapshot = ast_channel_snapshot_get_latest_by_name(channel_name);
+	if (!snapshot) {
+		return;
+	}
+	shard = cdr_shard_find(snapshot->base->uniqueid);
+	ao2_ref(snapshot, -1);
+	if (shard >= 0) {
+		cdr_shard_wait(AST_VECTOR_GET(&cdr_shards, shard));
+	}
+}
+
+/*!
+ * \internal
+ * \brief Start the shards and the thread pool running them.
+ */
+static int cdr_shards_init(unsigned int count)
+{
+	struct ast_threadpool_options options = {
+		.version = AST_THREADPOOL_OPTIONS_VERSION,
+		.auto_increment = 1,
+		.max_size = count,
+		.idle_timeout = 60,
+		.initial_size = 0,
+	};
+	char tps_name[AST_TASKPROCESSOR_MAX_NAME + 1];
+	unsigned int i;
+
+	if (AST_VECTOR_INIT(&cdr_shards, count)) {
+		return -1;
+	}
+	cdr_shard_channels = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0,
+		AST_NUM_CHANNEL_BUCKETS, cdr_shard_channel_hash_fn, NULL, cdr_shard_channel_cmp_fn);
+	if (!cdr_shard_channels) {
+		return -1;
+	}
+	cdr_shard_pool = ast_threadpool_create("cdr", NULL, &options);
+	if (!cdr_shard_pool) {
+		return -1;
+	}
+	for (i = 0; i < count; ++i) {
+		struct ast_taskprocessor *shard;
+
+		ast_taskprocessor_build_name(tps_name, sizeof(tps_name), "cdr/shard-%u", i);
+		shard = ast_threadpool_serializer(tps_name, cdr_shard_pool);
+		if (!shard || AST_VECTOR_APPEND(&cdr_shards, shard)) {
+			ast_taskprocessor_unreference(shard);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Handle what is left on the shards and stop them.
+ */
+static void cdr_shards_shutdown(void)
+{
+	/* The second round gets the CDRs posted by the messages of the first */
+	cdr_shards_wait();
+	cdr_shards_wait();
+	AST_VECTOR_CALLBACK_VOID(&cdr_shards, ast_taskprocessor_unreference);
+	AST_VECTOR_FREE(&cdr_shards);
+	ast_threadpool_shutdown(cdr_shard_pool);
+	cdr_shard_pool = NULL;
+	ao2_cleanup(cdr_shard_channels);
+	cdr_shard_channels = NULL;
+}
+
 /*!
  * \brief Handler for a synchronization message
  * \param data Passed on
@@ -2802,7 +3334,7 @@ static void handle_parked_call_message(void *data, struct stasis_subscription *s
 static void handle_cdr_sync_message(void *data, struct stasis_subscription *sub,
 		struct stasis_message *message)
 {
-	return;
+	cdr_shards_wait();
 }
 
 struct ast_cdr_config *ast_cdr_get_config(void)
@@ -3172,6 +3704,7 @@ int ast_cdr_setvar(const char *channel_name, const char *name, const char *value
 		}
 	}
 
+	cdr_shard_sync_channel(channel_name);
 	it_cdrs = ao2_callback(active_cdrs_master, OBJ_MULTIPLE, cdr_object_select_all_by_name_cb, arg);
 	if (!it_cdrs) {
 		ast_log(AST_LOG_ERROR, "Unable to find CDR for channel %s\n", channel_name);
@@ -3179,23 +3712,43 @@ int ast_cdr_setvar(const char *channel_name, const char *name, const char *value
 	}
 
 	for (; (cdr = ao2_iterator_next(it_cdrs)); ao2_unlock(cdr), ao2_cleanup(cdr)) {
+		/*
+		 * The CDRs of a chain usually share one list of variables.
+		 * The first one to be updated gets a list of its own and the
+		 * rest that shared the old list take on the new one.
+		 */
+		struct cdr_object_variables *old_variables = NULL;
+		struct cdr_object_variables *new_variables = NULL;
+		int updated = 0;
+
 		ao2_lock(cdr);
 		for (it_cdr = cdr; it_cdr; it_cdr = it_cdr->next) {
-			struct varshead *headp = NULL;
+			struct cdr_object_snapshot *party = NULL;
 
 			if (it_cdr->fn_table == &finalized_state_fn_table && it_cdr->next != NULL) {
 				continue;
 			}
 			if (!strcasecmp(channel_name, it_cdr->party_a.snapshot->base->name)) {
-				headp = &it_cdr->party_a.variables;
+				party = &it_cdr->party_a;
 			} else if (it_cdr->party_b.snapshot
 				&& !strcasecmp(channel_name, it_cdr->party_b.snapshot->base->name)) {
-				headp = &it_cdr->party_b.variables;
+				party = &it_cdr->party_b;
+			}
+			if (!party) {
+				continue;
 			}
-			if (headp) {
-				set_variable(headp, name, value);
+			if (updated && party->variables == old_variables) {
+				ao2_replace(party->variables, new_variables);
+				continue;
 			}
+			/* Still referenced through this party, or through the ones sharing it if replaced */
+			ao2_replace(old_variables, party->variables);
+			cdr_party_set_variable(party, name, value);
+			ao2_replace(new_variables, party->variables);
+			updated = 1;
 		}
+		ao2_cleanup(old_variables);
+		ao2_cleanup(new_variables);
 	}
 	ao2_iterator_destroy(it_cdrs);
 
@@ -3209,7 +3762,7 @@ static void cdr_object_format_var_internal(struct cdr_object *cdr, const char *n
 {
 	struct ast_var_t *variable;
 
-	AST_LIST_TRAVERSE(&cdr->party_a.variables, variable, entries) {
+	AST_LIST_TRAVERSE(cdr_party_variables(&cdr->party_a), variable, entries) {
 		if (!strcasecmp(name, ast_var_name(variable))) {
 			ast_copy_string(value, ast_var_value(variable), length);
 			return;
@@ -3274,7 +3827,7 @@ static int cdr_object_format_property(struct cdr_object *cdr_obj, const char *na
 	} else if (!strcasecmp(name, "linkedid")) {
 		ast_copy_string(value, cdr_obj->linkedid, length);
 	} else if (!strcasecmp(name, "userfield")) {
-		ast_copy_string(value, cdr_obj->party_a.userfield, length);
+		ast_copy_string(value, S_OR(cdr_obj->party_a.userfield, ""), length);
 	} else if (!strcasecmp(name, "sequence")) {
 		snprintf(value, length, "%u", cdr_obj->sequence);
 	} else {
@@ -3299,6 +3852,7 @@ static struct cdr_object *cdr_object_get_by_name(const char *name)
 		return NULL;
 	}
 
+	cdr_shard_sync_channel(name);
 	param = ast_strdupa(name);
 	return ao2_callback(active_cdrs_master, 0, cdr_object_get_by_name_cb, param);
 }
@@ -3357,7 +3911,7 @@ int ast_cdr_serialize_variables(const char *channel_name, struct ast_str **buf,
 			ast_str_append(buf, 0, "\n");
 		}
 
-		AST_LIST_TRAVERSE(&it_cdr->party_a.variables, variable, entries) {
+		AST_LIST_TRAVERSE(cdr_party_variables(&it_cdr->party_a), variable, entries) {
 			if (!(var = ast_var_name(variable))) {
 				continue;
 			}
@@ -3449,8 +4003,7 @@ static int cdr_object_update_party_b_userfield_cb(void *obj, void *arg, void *da
 		ast_assert(cdr->party_b.snapshot
 			&& !strcasecmp(cdr->party_b.snapshot->base->name, info->channel_name));
 
-		ast_copy_string(cdr->party_b.userfield, info->userfield,
-			sizeof(cdr->party_b.userfield));
+		cdr_party_set_userfield(&cdr->party_b, info->userfield);
 	}
 
 	return 0;
@@ -3473,8 +4026,7 @@ void ast_cdr_setuserfield(const char *channel_name, const char *userfield)
 			if (it_cdr->fn_table == &finalized_state_fn_table && it_cdr->next != NULL) {
 				continue;
 			}
-			ast_copy_string(it_cdr->party_a.userfield, userfield,
-				sizeof(it_cdr->party_a.userfield));
+			cdr_party_set_userfield(&it_cdr->party_a, userfield);
 		}
 		ao2_unlock(cdr);
 	}
@@ -3580,7 +4132,6 @@ int ast_cdr_clear_property(const char *channel_name, enum ast_cdr_options option
 int ast_cdr_reset(const char *channel_name, int keep_variables)
 {
 	struct cdr_object *cdr;
-	struct ast_var_t *vardata;
 	struct cdr_object *it_cdr;
 
 	cdr = cdr_object_get_by_name(channel_name);
@@ -3592,13 +4143,9 @@ int ast_cdr_reset(const char *channel_name, int keep_variables)
 	for (it_cdr = cdr; it_cdr; it_cdr = it_cdr->next) {
 		/* clear variables */
 		if (!keep_variables) {
-			while ((vardata = AST_LIST_REMOVE_HEAD(&it_cdr->party_a.variables, entries))) {
-				ast_var_delete(vardata);
-			}
+			cdr_party_variables_clear(&it_cdr->party_a);
 			if (cdr->party_b.snapshot) {
-				while ((vardata = AST_LIST_REMOVE_HEAD(&it_cdr->party_b.variables, entries))) {
-					ast_var_delete(vardata);
-				}
+				cdr_party_variables_clear(&it_cdr->party_b);
 			}
 		}
 
@@ -3663,10 +4210,10 @@ int ast_cdr_fork(const char *channel_name, struct ast_flags *options)
 			new_cdr->party_b.snapshot = cdr_obj->party_b.snapshot;
 			ao2_ref(new_cdr->party_b.snapshot, +1);
 			cdr_all_relink(new_cdr);
-			strcpy(new_cdr->party_b.userfield, cdr_obj->party_b.userfield);
+			cdr_party_set_userfield(&new_cdr->party_b, cdr_obj->party_b.userfield);
 			new_cdr->party_b.flags = cdr_obj->party_b.flags;
 			if (ast_test_flag(options, AST_CDR_FLAG_KEEP_VARS)) {
-				copy_variables(&new_cdr->party_b.variables, &cdr_obj->party_b.variables);
+				ao2_replace(new_cdr->party_b.variables, cdr_obj->party_b.variables);
 			}
 		}
 		new_cdr->start = cdr_obj->start;
@@ -3684,7 +4231,7 @@ int ast_cdr_fork(const char *channel_name, struct ast_flags *options)
 
 		/* Create and append, by default, copies over the variables */
 		if (!ast_test_flag(options, AST_CDR_FLAG_KEEP_VARS)) {
-			free_variables(&new_cdr->party_a.variables);
+			cdr_party_variables_clear(&new_cdr->party_a);
 		}
 
 		/* Finalize any current CDRs */
@@ -3817,6 +4364,28 @@ static void start_batch_mode(void)
 	ast_mutex_unlock(&cdr_pending_lock);
 }
 
+static int cdr_shard_post_task(void *data)
+{
+	post_cdr(data);
+	ast_cdr_free(data);
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Post a CDR dispatched by a shard after its handler finished.
+ *
+ * Slow backends then do not hold cdr_shard_lock.
+ *
+ * \retval 0 if the posting was left to the shard
+ */
+static int cdr_shard_post(struct ast_cdr *cdr)
+{
+	struct ast_taskprocessor *shard = cdr_shard_current();
+
+	return !shard || ast_taskprocessor_push(shard, cdr_shard_post_task, cdr);
+}
+
 static void cdr_detach(struct ast_cdr *cdr)
 {
 	struct cdr_batch_item *newtail;
@@ -3837,6 +4406,9 @@ static void cdr_detach(struct ast_cdr *cdr)
 
 	/* post stuff immediately if we are not in batch mode, this is legacy behaviour */
 	if (!ast_test_flag(&mod_cfg->general->settings, CDR_BATCHMODE)) {
+		if (!cdr_shard_post(cdr)) {
+			return;
+		}
 		post_cdr(cdr);
 		ast_cdr_free(cdr);
 		return;
@@ -4155,7 +4727,8 @@ static char *handle_cli_status(struct ast_cli_entry *e, int cmd, struct ast_cli_
 	ast_cli(a->fd, "  Mode:                       %s\n", ast_test_flag(&mod_cfg->general->settings, CDR_BATCHMODE) ? "Batch" : "Simple");
 	if (ast_test_flag(&mod_cfg->general->settings, CDR_ENABLED)) {
 		ast_cli(a->fd, "  Log unanswered calls:       %s\n", ast_test_flag(&mod_cfg->general->settings, CDR_UNANSWERED) ? "Yes" : "No");
-		ast_cli(a->fd, "  Log congestion:             %s\n\n", ast_test_flag(&mod_cfg->general->settings, CDR_CONGESTION) ? "Yes" : "No");
+		ast_cli(a->fd, "  Log congestion:             %s\n", ast_test_flag(&mod_cfg->general->settings, CDR_CONGESTION) ? "Yes" : "No");
+		ast_cli(a->fd, "  Processing threads:         %zu\n\n", MAX(AST_VECTOR_SIZE(&cdr_shards), 1));
 		if (ast_test_flag(&mod_cfg->general->settings, CDR_BATCHMODE)) {
 			ast_cli(a->fd, "* Batch Mode Settings\n");
 			ast_cli(a->fd, "  -------------------\n");
@@ -4334,6 +4907,7 @@ static int process_config(int reload)
 		aco_option_register(&cfg_info, "safeshutdown", ACO_EXACT, general_options, DEFAULT_BATCH_SAFE_SHUTDOWN, OPT_BOOLFLAG_T, 1, FLDSET(struct ast_cdr_config, batch_settings.settings), BATCH_MODE_SAFE_SHUTDOWN);
 		aco_option_register(&cfg_info, "size", ACO_EXACT, general_options, DEFAULT_BATCH_SIZE, OPT_UINT_T, PARSE_IN_RANGE, FLDSET(struct ast_cdr_config, batch_settings.size), 0, MAX_BATCH_SIZE);
 		aco_option_register(&cfg_info, "time", ACO_EXACT, general_options, DEFAULT_BATCH_TIME, OPT_UINT_T, PARSE_IN_RANGE, FLDSET(struct ast_cdr_config, batch_settings.time), 1, MAX_BATCH_TIME);
+		aco_option_register(&cfg_info, "shards", ACO_EXACT, general_options, DEFAULT_SHARDS, OPT_UINT_T, PARSE_IN_RANGE, FLDSET(struct ast_cdr_config, shards), 0, MAX_SHARDS);
 	}
 
 	if (aco_process_config(&cfg_info, reload) == ACO_PROCESS_ERROR) {
@@ -4365,6 +4939,7 @@ static void cdr_engine_shutdown(void)
 {
 	stasis_message_router_unsubscribe_and_join(stasis_router);
 	stasis_router = NULL;
+	cdr_shards_shutdown();
 
 	ao2_cleanup(cdr_topic);
 	cdr_topic = NULL;
@@ -4500,6 +5075,9 @@ static int unload_module(void)
 
 static int load_module(void)
 {
+	struct module_config *mod_cfg;
+	unsigned int shards;
+
 	if (process_config(0)) {
 		return AST_MODULE_LOAD_FAILURE;
 	}
@@ -4520,11 +5098,25 @@ static int load_module(void)
 		return AST_MODULE_LOAD_FAILURE;
 	}
 
-	stasis_message_router_add(stasis_router, ast_channel_snapshot_type(), handle_channel_snapshot_update_message, NULL);
-	stasis_message_router_add(stasis_router, ast_channel_dial_type(), handle_dial_message, NULL);
-	stasis_message_router_add(stasis_router, ast_channel_entered_bridge_type(), handle_bridge_enter_message, NULL);
-	stasis_message_router_add(stasis_router, ast_channel_left_bridge_type(), handle_bridge_leave_message, NULL);
-	stasis_message_router_add(stasis_router, ast_parked_call_type(), handle_parked_call_message, NULL);
+	mod_cfg = ao2_global_obj_ref(module_configs);
+	shards = mod_cfg ? mod_cfg->general->shards : 0;
+	ao2_cleanup(mod_cfg);
+	if (shards > 1) {
+		if (cdr_shards_init(shards)) {
+			return AST_MODULE_LOAD_FAILURE;
+		}
+		stasis_message_router_add(stasis_router, ast_channel_snapshot_type(), cdr_shard_route_cb, (void *) &channel_snapshot_route);
+		stasis_message_router_add(stasis_router, ast_channel_dial_type(), cdr_shard_route_cb, (void *) &dial_route);
+		stasis_message_router_add(stasis_router, ast_channel_entered_bridge_type(), cdr_shard_route_cb, (void *) &bridge_enter_route);
+		stasis_message_router_add(stasis_router, ast_channel_left_bridge_type(), cdr_shard_route_cb, (void *) &bridge_leave_route);
+		stasis_message_router_add(stasis_router, ast_parked_call_type(), cdr_shard_route_cb, (void *) &parked_call_route);
+	} else {
+		stasis_message_router_add(stasis_router, ast_channel_snapshot_type(), handle_channel_snapshot_update_message, NULL);
+		stasis_message_router_add(stasis_router, ast_channel_dial_type(), handle_dial_message, NULL);
+		stasis_message_router_add(stasis_router, ast_channel_entered_bridge_type(), handle_bridge_enter_message, NULL);
+		stasis_message_router_add(stasis_router, ast_channel_left_bridge_type(), handle_bridge_leave_message, NULL);
+		stasis_message_router_add(stasis_router, ast_parked_call_type(), handle_parked_call_message, NULL);
+	}
 	stasis_message_router_add(stasis_router, cdr_sync_message_type(), handle_cdr_sync_message, NULL);
 
 	active_cdrs_master = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0,
@@ -4606,6 +5198,10 @@ static int reload_module(void)
 	}
 
 	mod_cfg = ao2_global_obj_ref(module_configs);
+	if (mod_cfg && mod_cfg->general->shards != old_mod_cfg->general->shards) {
+		ast_log(LOG_NOTICE, "CDR shards changed from %u to %u.  This takes effect when Asterisk is restarted.\n",
+			old_mod_cfg->general->shards, mod_cfg->general->shards);
+	}
 	if (!mod_cfg
 		|| !ast_test_flag(&mod_cfg->general->settings, CDR_ENABLED)
 		|| !ast_test_flag(&mod_cfg->general->settings, CDR_BATCHMODE)) {
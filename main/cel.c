@@ -38,6 +38,8 @@
 
 #include "asterisk.h"
 
+#include <sys/stat.h>
+
 #include "asterisk/module.h"
 
 #include "asterisk/channel.h"
@@ -58,6 +60,7 @@
 #include "asterisk/pickup.h"
 #include "asterisk/core_local.h"
 #include "asterisk/taskprocessor.h"
+#include "asterisk/paths.h"
 
 /*** DOCUMENTATION
 	<configInfo name="cel" language="en_US">
@@ -323,8 +326,45 @@ static const char * const cel_event_types[CEL_MAX_EVENT_IDS] = {
 	[AST_CEL_LOCAL_OPTIMIZE]   = "LOCAL_OPTIMIZE",
 };
 
+/*! \brief An event queued to a batched backend */
+struct cel_batch_event {
+	AST_LIST_ENTRY(cel_batch_event) list;
+	/*! Copy of the event, allocated along with this */
+	struct ast_event *event;
+};
+
+/*! \brief Thread writing the events of a backend registered with ast_cel_backend_register_batch() */
+struct cel_batch_writer {
+	ast_cel_backend_batch_cb callback;
+	/*! Most events passed to one call of callback */
+	unsigned int batch_size;
+	/*! Longest time in ms an event waits for its batch to fill */
+	unsigned int batch_time;
+	/*! Most events kept in queue before they are spooled */
+	unsigned int queue_size;
+	ast_mutex_t lock;
+	ast_cond_t cond;
+	AST_LIST_HEAD_NOLOCK(, cel_batch_event) queue;
+	/*! Number of events in queue */
+	unsigned int queued;
+	/*! When the first event in queue came in */
+	struct timeval oldest;
+	/*! Writing is retried after this when callback failed */
+	struct timeval retry;
+	/*! File holding the events waiting on disk */
+	char *spool;
+	/*! Offset in spool of the first event not written yet */
+	off_t spool_pos;
+	/*! Number of events in spool past spool_pos */
+	unsigned int spooled;
+	/*! Set when the backend is unregistered */
+	unsigned int stop:1;
+	pthread_t thread;
+};
+
 struct cel_backend {
 	ast_cel_backend_cb callback; /*!< Callback for this backend */
+	struct cel_batch_writer *writer; /*!< Writer of a batched backend (NULL if called directly) */
 	char name[0];                /*!< Name of this backend */
 };
 
@@ -405,7 +445,14 @@ static char *handle_cli_status(struct ast_cli_entry *e, int cmd, struct ast_cli_
 
 		iter = ao2_iterator_init(backends, 0);
 		for (; (backend = ao2_iterator_next(&iter)); ao2_ref(backend, -1)) {
-			ast_cli(a->fd, "CEL Event Subscriber: %s\n", backend->name);
+			if (backend->writer) {
+				ast_mutex_lock(&backend->writer->lock);
+				ast_cli(a->fd, "CEL Event Subscriber: %s (%u queued, %u spooled)\n", backend->name,
+					backend->writer->queued, backend->writer->spooled);
+				ast_mutex_unlock(&backend->writer->lock);
+			} else {
+				ast_cli(a->fd, "CEL Event Subscriber: %s\n", backend->name);
+			}
 		}
 		ao2_iterator_destroy(&iter);
 	}
@@ -549,10 +596,16 @@ struct ast_event *ast_cel_create_event(struct ast_channel_snapshot *snapshot,
 		AST_EVENT_IE_END);
 }
 
+static void cel_batch_queue(struct cel_batch_writer *writer, struct ast_event *event);
+
 static int cel_backend_send_cb(void *obj, void *arg, int flags)
 {
 	struct cel_backend *backend = obj;
 
+	if (backend->writer) {
+		cel_batch_queue(backend->writer, arg);
+		return 0;
+	}
 	backend->callback(arg);
 	return 0;
 }
@@ -1703,15 +1756,384 @@ void ast_cel_set_config(struct ast_cel_general_config *config)
 	}
 }
 
+/*! How long writing a batched backend pauses after its callback failed, in ms */
+#define CEL_BATCH_RETRY 5000
+
+/*!
+ * \internal
+ * \brief Append events to the spool file of a batched backend.
+ *
+ * \note Called with the writer locked.
+ */
+static void cel_batch_spool(struct cel_batch_writer *writer, struct ast_event **events, size_t count)
+{
+	FILE *file;
+	size_t i;
+
+	if (!(file = fopen(writer->spool, "a"))) {
+		ast_log(LOG_ERROR, "Unable to open CEL spool file '%s': %s.  %zu CEL events lost.\n",
+			writer->spool, strerror(errno), count);
+		return;
+	}
+	for (i = 0; i < count; ++i) {
+		uint32_t size = ast_event_get_size(events[i]);
+
+		if (fwrite(&size, sizeof(size), 1, file) != 1 || fwrite(events[i], size, 1, file) != 1) {
+			ast_log(LOG_ERROR, "Unable to write CEL spool file '%s': %s.  %zu CEL events lost.\n",
+				writer->spool, strerror(errno), count - i);
+			break;
+		}
+		++writer->spooled;
+	}
+	if (fclose(file)) {
+		ast_log(LOG_ERROR, "Unable to write CEL spool file '%s': %s.\n", writer->spool, strerror(errno));
+	}
+}
+
+/*!
+ * \internal
+ * \brief Read the next batch of events from the spool file of a batched backend.
+ *
+ * \note Called with the writer locked.
+ *
+ * \param writer Writer of the backend
+ * \param events Filled with up to batch_size events, to be freed with ast_free()
+ * \param end Set to the offset past the events read
+ *
+ * \return Number of events read
+ */
+static size_t cel_batch_unspool(struct cel_batch_writer *writer, struct ast_event **events, off_t *end)
+{
+	FILE *file;
+	size_t count = 0;
+	uint32_t size;
+
+	*end = writer->spool_pos;
+	if (!(file = fopen(writer->spool, "r"))) {
+		ast_log(LOG_ERROR, "Unable to open CEL spool file '%s': %s.  %u CEL events lost.\n",
+			writer->spool, strerror(errno), writer->spooled);
+		writer->spooled = 0;
+		return 0;
+	}
+	if (fseeko(file, writer->spool_pos, SEEK_SET)) {
+		fclose(file);
+		return 0;
+	}
+
+	while (count < writer->batch_size && fread(&size, sizeof(size), 1, file) == 1) {
+		/* The type and length of the event header come first */
+		if (size < 2 * sizeof(uint16_t) || size > UINT16_MAX) {
+			events[count] = NULL;
+		} else if (!(events[count] = ast_malloc(size))) {
+			break;
+		}
+		if (!events[count] || fread(events[count], size, 1, file) != 1
+			|| ast_event_get_size(events[count]) != size) {
+			/* A partial write of a crash, nothing after it can be trusted */
+			ast_log(LOG_WARNING, "CEL spool file '%s' is damaged at offset %jd.  Skipping the rest.\n",
+				writer->spool, (intmax_t) *end);
+			ast_free(events[count]);
+			fseeko(file, 0, SEEK_END);
+			*end = ftello(file);
+			writer->spooled = count;
+			break;
+		}
+		++count;
+		*end = ftello(file);
+	}
+	fclose(file);
+
+	return count;
+}
+
+/*!
+ * \internal
+ * \brief Drop the events of the spool file written by the backend.
+ *
+ * \note Called with the writer locked.
+ */
+static void cel_batch_unspool_done(struct cel_batch_writer *writer, off_t end, size_t count)
+{
+	struct stat st;
+
+	writer->spool_pos = end;
+	writer->spooled = writer->spooled > count ? writer->spooled - count : 0;
+	if (stat(writer->spool, &st) || st.st_size <= end) {
+		unlink(writer->spool);
+		writer->spool_pos = 0;
+		writer->spooled = 0;
+	}
+}
+
+static void cel_batch_queue(struct cel_batch_writer *writer, struct ast_event *event)
+{
+	size_t size = ast_event_get_size(event);
+	struct cel_batch_event *entry = NULL;
+
+	ast_mutex_lock(&writer->lock);
+	if (!writer->stop && writer->queued < writer->queue_size
+		&& (entry = ast_calloc(1, sizeof(*entry) + size))) {
+		entry->event = (struct ast_event *) (entry + 1);
+		memcpy(entry->event, event, size);
+		AST_LIST_INSERT_TAIL(&writer->queue, entry, list);
+		if (!writer->queued++) {
+			writer->oldest = ast_tvnow();
+			ast_cond_signal(&writer->cond);
+		} else if (writer->queued == writer->batch_size) {
+			ast_cond_signal(&writer->cond);
+		}
+	} else {
+		cel_batch_spool(writer, &event, 1);
+	}
+	ast_mutex_unlock(&writer->lock);
+}
+
+/*!
+ * \internal
+ * \brief Take the next batch off the queue of a batched backend.
+ *
+ * \note Called with the writer locked.
+ */
+static size_t cel_batch_dequeue(struct cel_batch_writer *writer, struct cel_batch_event **entries,
+	struct ast_event **events)
+{
+	size_t count = 0;
+
+	while (count < writer->batch_size && (entries[count] = AST_LIST_REMOVE_HEAD(&writer->queue, list))) {
+		events[count] = entries[count]->event;
+		++count;
+	}
+	writer->queued -= count;
+	writer->oldest = ast_tvnow();
+
+	return count;
+}
+
+static void *cel_batch_thread(void *data)
+{
+	struct cel_backend *backend = data;
+	struct cel_batch_writer *writer = backend->writer;
+	struct cel_batch_event **entries = ast_calloc(writer->batch_size, sizeof(*entries));
+	struct ast_event **events = ast_calloc(writer->batch_size, sizeof(*events));
+	struct timeval now;
+	size_t count;
+	size_t i;
+	off_t end;
+	int res;
+
+	if (!entries || !events) {
+		ast_free(entries);
+		ast_free(events);
+		return NULL;
+	}
+
+	ast_mutex_lock(&writer->lock);
+	for (;;) {
+		int ready;
+		int backoff;
+
+		now = ast_tvnow();
+		backoff = !ast_tvzero(writer->retry) && ast_tvcmp(writer->retry, now) > 0;
+		ready = writer->queued && (writer->stop || writer->queued >= writer->batch_size
+			|| ast_tvdiff_ms(now, writer->oldest) >= writer->batch_time);
+
+		if (writer->stop && (!writer->queued || backoff)) {
+			/* Whatever is left waits on disk for the backend to come back */
+			while ((count = cel_batch_dequeue(writer, entries, events))) {
+				cel_batch_spool(writer, events, count);
+				for (i = 0; i < count; ++i) {
+					ast_free(entries[i]);
+				}
+			}
+			break;
+		}
+
+		if (!backoff && writer->spooled && !writer->stop) {
+			/* Older events first */
+			count = cel_batch_unspool(writer, events, &end);
+			ast_mutex_unlock(&writer->lock);
+			res = count ? writer->callback(events, count) : 0;
+			for (i = 0; i < count; ++i) {
+				ast_free(events[i]);
+			}
+			ast_mutex_lock(&writer->lock);
+			if (!res) {
+				cel_batch_unspool_done(writer, end, count);
+			}
+			if (res || (!count && writer->spooled)) {
+				writer->retry = ast_tvadd(ast_tvnow(), ast_samp2tv(CEL_BATCH_RETRY, 1000));
+			}
+			continue;
+		}
+
+		if (!backoff && ready) {
+			count = cel_batch_dequeue(writer, entries, events);
+			ast_mutex_unlock(&writer->lock);
+			res = writer->callback(events, count);
+			ast_mutex_lock(&writer->lock);
+			if (res) {
+				ast_log(LOG_WARNING, "CEL backend '%s' failed to write %zu events.  Spooling them to '%s'.\n",
+					backend->name, count, writer->spool);
+				cel_batch_spool(writer, events, count);
+				writer->retry = ast_tvadd(ast_tvnow(), ast_samp2tv(CEL_BATCH_RETRY, 1000));
+			}
+			for (i = 0; i < count; ++i) {
+				ast_free(entries[i]);
+			}
+			continue;
+		}
+
+		if (backoff || writer->queued) {
+			struct timeval wake = backoff ? writer->retry
+				: ast_tvadd(writer->oldest, ast_samp2tv(writer->batch_time, 1000));
+			struct timespec ts = {
+				.tv_sec = wake.tv_sec,
+				.tv_nsec = wake.tv_usec * 1000,
+			};
+
+			ast_cond_timedwait(&writer->cond, &writer->lock, &ts);
+		} else {
+			ast_cond_wait(&writer->cond, &writer->lock);
+		}
+	}
+	ast_mutex_unlock(&writer->lock);
+
+	ast_free(entries);
+	ast_free(events);
+	return NULL;
+}
+
+/*!
+ * \internal
+ * \brief Stop the thread of a batched backend once it wrote or spooled its queue.
+ */
+static void cel_batch_stop(struct cel_batch_writer *writer)
+{
+	if (writer->thread == AST_PTHREADT_NULL) {
+		return;
+	}
+
+	ast_mutex_lock(&writer->lock);
+	writer->stop = 1;
+	ast_cond_signal(&writer->cond);
+	ast_mutex_unlock(&writer->lock);
+	pthread_join(writer->thread, NULL);
+	writer->thread = AST_PTHREADT_NULL;
+}
+
+/*!
+ * \internal
+ * \brief Count the events in a spool file left by an earlier registration.
+ */
+static unsigned int cel_batch_spool_count(const char *spool)
+{
+	FILE *file = fopen(spool, "r");
+	unsigned int count = 0;
+	uint32_t size;
+
+	if (!file) {
+		return 0;
+	}
+	while (fread(&size, sizeof(size), 1, file) == 1 && !fseeko(file, size, SEEK_CUR)) {
+		++count;
+	}
+	fclose(file);
+
+	return count;
+}
+
+static void cel_backend_destroy(void *obj)
+{
+	struct cel_backend *backend = obj;
+
+	if (backend->writer) {
+		cel_batch_stop(backend->writer);
+		ast_mutex_destroy(&backend->writer->lock);
+		ast_cond_destroy(&backend->writer->cond);
+		ast_free(backend->writer->spool);
+		ast_free(backend->writer);
+	}
+}
+
 int ast_cel_backend_unregister(const char *name)
 {
 	struct ao2_container *backends = ao2_global_obj_ref(cel_backends);
+	struct cel_backend *backend;
 
 	if (backends) {
-		ao2_find(backends, name, OBJ_SEARCH_KEY | OBJ_NODATA | OBJ_UNLINK);
+		backend = ao2_find(backends, name, OBJ_SEARCH_KEY | OBJ_UNLINK);
 		ao2_ref(backends, -1);
+		if (backend && backend->writer) {
+			/* The callback must not be called once this returns */
+			cel_batch_stop(backend->writer);
+		}
+		ao2_cleanup(backend);
+	}
+
+	return 0;
+}
+
+int ast_cel_backend_register_batch(const char *name, ast_cel_backend_batch_cb batch_callback,
+	unsigned int batch_size, unsigned int batch_time, unsigned int queue_size)
+{
+	RAII_VAR(struct ao2_container *, backends, ao2_global_obj_ref(cel_backends), ao2_cleanup);
+	struct cel_backend *backend;
+	struct cel_batch_writer *writer;
+	char dir[PATH_MAX];
+	char *file;
+
+	if (!backends || ast_strlen_zero(name) || !batch_callback || !batch_size) {
+		return -1;
+	}
+
+	snprintf(dir, sizeof(dir), "%s/cel", ast_config_AST_SPOOL_DIR);
+	if (ast_mkdir(dir, 0777)) {
+		ast_log(LOG_ERROR, "Unable to create CEL spool directory '%s': %s\n", dir, strerror(errno));
+		return -1;
+	}
+
+	backend = ao2_alloc_options(sizeof(*backend) + 1 + strlen(name), cel_backend_destroy,
+		AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!backend) {
+		return -1;
+	}
+	strcpy(backend->name, name);/* Safe */
+
+	if (!(writer = ast_calloc(1, sizeof(*writer)))) {
+		ao2_ref(backend, -1);
+		return -1;
+	}
+	ast_mutex_init(&writer->lock);
+	ast_cond_init(&writer->cond, NULL);
+	writer->thread = AST_PTHREADT_NULL;
+	backend->writer = writer;
+	writer->callback = batch_callback;
+	writer->batch_size = batch_size;
+	writer->batch_time = batch_time;
+	writer->queue_size = MAX(queue_size, batch_size);
+	if (ast_asprintf(&writer->spool, "%s/%s.spool", dir, name) < 0) {
+		ao2_ref(backend, -1);
+		return -1;
+	}
+	for (file = writer->spool + strlen(dir) + 1; *file; ++file) {
+		if (*file == ' ' || *file == '/') {
+			*file = '_';
+		}
 	}
 
+	/* Left over from before the backend was unregistered */
+	if ((writer->spooled = cel_batch_spool_count(writer->spool))) {
+		ast_log(LOG_NOTICE, "Writing %u CEL events of '%s' left in '%s'.\n",
+			writer->spooled, name, writer->spool);
+	}
+
+	if (ast_pthread_create(&writer->thread, NULL, cel_batch_thread, backend)) {
+		ao2_ref(backend, -1);
+		return -1;
+	}
+
+	ao2_link(backends, backend);
+	ao2_ref(backend, -1);
 	return 0;
 }
 
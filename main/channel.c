@@ -34,6 +34,10 @@
 #include <sys/time.h>
 #include <signal.h>
 #include <math.h>
+#ifdef __linux__
+#include <sched.h>
+#include <sys/epoll.h>
+#endif
 
 #include "asterisk/paths.h"	/* use ast_config_AST_SYSTEM_NAME */
 
@@ -67,12 +71,14 @@
 #include "asterisk/stringfields.h"
 #include "asterisk/global_datastores.h"
 #include "asterisk/channel_internal.h"
+#include "asterisk/threadpool.h"
 #include "asterisk/features.h"
 #include "asterisk/bridge.h"
 #include "asterisk/test.h"
 #include "asterisk/stasis_channels.h"
 #include "asterisk/max_forwards.h"
 #include "asterisk/stream.h"
+#include "asterisk/media_trace.h"
 #include "asterisk/message.h"
 
 /*** DOCUMENTATION
@@ -119,6 +125,53 @@ static AST_RWLIST_HEAD_STATIC(backends, chanlist);
 /*! \brief All active channels on the system */
 static struct ao2_container *channels;
 
+/*! \brief All active channels sorted by name for prefix searches */
+static struct ao2_container *channels_by_name;
+
+/*! \brief All active channels hashed by linkedid */
+static struct ao2_container *channels_by_linkedid;
+
+/*! \brief Threads freeing what destroyed channels leave behind */
+static struct ast_threadpool *channel_reaper;
+/*! \brief Held for reading while pushing to channel_reaper, for writing to clear it */
+AST_RWLOCK_DEFINE_STATIC(channel_reaper_lock);
+
+/*! \brief Partial key for searching channels_by_name */
+struct channel_name_partial_key {
+	const char *name;
+	size_t len;
+};
+
+/*!
+ * \internal
+ * \brief Link a channel into the channels container and its indexes.
+ *
+ * \param chan Channel to link.
+ * \param flags OBJ_NOLOCK if the channels container is already locked.
+ *
+ * \note The indexes have their own locks which are never held while
+ * taking another lock.
+ */
+static void channel_link(struct ast_channel *chan, int flags)
+{
+	ao2_link_flags(channels, chan, flags);
+	ao2_link(channels_by_name, chan);
+	ao2_link(channels_by_linkedid, chan);
+}
+
+/*!
+ * \internal
+ * \brief Unlink a channel from the channels container and its indexes.
+ *
+ * \note Safe, even if already unlinked.
+ */
+static void channel_unlink(struct ast_channel *chan)
+{
+	ao2_unlink(channels, chan);
+	ao2_unlink(channels_by_name, chan);
+	ao2_unlink(channels_by_linkedid, chan);
+}
+
 /*! \brief map AST_CAUSE's to readable string representations
  *
  * \ref causes.h
@@ -934,7 +987,7 @@ __ast_channel_alloc_ap(int needqueue, int state, const char *cid_num, const char
 	/* Finalize and link into the channels container. */
 	ast_channel_internal_finalize(tmp);
 	ast_atomic_fetchadd_int(&chancount, +1);
-	ao2_link_flags(channels, tmp, OBJ_NOLOCK);
+	channel_link(tmp, OBJ_NOLOCK);
 
 	ao2_unlock(channels);
 
@@ -1094,9 +1147,6 @@ static int __ast_queue_frame(struct ast_channel *chan, struct ast_frame *fin, in
 				}
 				AST_LIST_REMOVE_CURRENT(frame_list);
 				ast_frfree(cur);
-
-				/* Read from the alert pipe for each flushed frame. */
-				ast_channel_internal_alert_read(chan);
 			}
 		}
 		AST_LIST_TRAVERSE_SAFE_END;
@@ -1113,13 +1163,13 @@ static int __ast_queue_frame(struct ast_channel *chan, struct ast_frame *fin, in
 	}
 
 	if (ast_channel_alert_writable(chan)) {
-		/* Write to the alert pipe for each added frame */
-		while (new_frames--) {
-			if (ast_channel_alert_write(chan)) {
-				ast_log(LOG_WARNING, "Unable to write to alert pipe on %s (qlen = %u): %s!\n",
-					ast_channel_name(chan), queued_frames, strerror(errno));
-				break;
-			}
+		/*
+		 * One alert covers everything on the queue, a reader that has
+		 * not taken it yet will find these frames too.
+		 */
+		if (ast_channel_internal_alert_raise(chan)) {
+			ast_log(LOG_WARNING, "Unable to write to alert pipe on %s (qlen = %u): %s!\n",
+				ast_channel_name(chan), queued_frames, strerror(errno));
 		}
 	} else if (ast_channel_timingfd(chan) > -1) {
 		ast_timer_enable_continuous(ast_channel_timer(chan));
@@ -1379,9 +1429,39 @@ struct ast_channel_iterator *ast_channel_iterator_by_name_new(const char *name,
 		return NULL;
 	}
 
-	i->active_iterator = (void *) ast_channel_callback(ast_channel_by_name_cb,
-		l_name, &name_len,
-		OBJ_MULTIPLE | (name_len == 0 /* match the whole word, so optimize */ ? OBJ_KEY : 0));
+	if (name_len && !ast_strlen_zero(name)) {
+		struct channel_name_partial_key key = { .name = name, .len = name_len, };
+
+		i->active_iterator = ao2_find(channels_by_name, &key,
+			OBJ_MULTIPLE | OBJ_SEARCH_PARTIAL_KEY);
+	} else {
+		i->active_iterator = (void *) ast_channel_callback(ast_channel_by_name_cb,
+			l_name, &name_len,
+			OBJ_MULTIPLE | (name_len == 0 /* match the whole word, so optimize */ ? OBJ_KEY : 0));
+	}
+	if (!i->active_iterator) {
+		ast_free(i);
+		return NULL;
+	}
+
+	return i;
+}
+
+struct ast_channel_iterator *ast_channel_iterator_by_linkedid_new(const char *linkedid)
+{
+	struct ast_channel_iterator *i;
+
+	if (ast_strlen_zero(linkedid)) {
+		ast_log(LOG_ERROR, "BUG! Must supply a linkedid to match!\n");
+		return NULL;
+	}
+
+	if (!(i = ast_calloc(1, sizeof(*i)))) {
+		return NULL;
+	}
+
+	i->active_iterator = ao2_find(channels_by_linkedid, linkedid,
+		OBJ_MULTIPLE | OBJ_SEARCH_KEY);
 	if (!i->active_iterator) {
 		ast_free(i);
 		return NULL;
@@ -1421,8 +1501,14 @@ struct ast_channel *ast_channel_get_by_name_prefix(const char *name, size_t name
 	struct ast_channel *chan;
 	char *l_name = (char *) name;
 
-	chan = ast_channel_callback(ast_channel_by_name_cb, l_name, &name_len,
-		(name_len == 0) /* optimize if it is a complete name match */ ? OBJ_KEY : 0);
+	if (name_len && !ast_strlen_zero(name)) {
+		struct channel_name_partial_key key = { .name = name, .len = name_len, };
+
+		chan = ao2_find(channels_by_name, &key, OBJ_SEARCH_PARTIAL_KEY);
+	} else {
+		chan = ast_channel_callback(ast_channel_by_name_cb, l_name, &name_len,
+			(name_len == 0) /* optimize if it is a complete name match */ ? OBJ_KEY : 0);
+	}
 	if (chan) {
 		return chan;
 	}
@@ -1559,7 +1645,7 @@ int ast_safe_sleep(struct ast_channel *chan, int ms)
 struct ast_channel *ast_channel_release(struct ast_channel *chan)
 {
 	/* Safe, even if already unlinked. */
-	ao2_unlink(channels, chan);
+	channel_unlink(chan);
 	return ast_channel_unref(chan);
 }
 
@@ -2163,13 +2249,113 @@ void ast_party_redirecting_free(struct ast_party_redirecting *doomed)
 	ast_party_redirecting_reason_free(&doomed->orig_reason);
 }
 
+/*!
+ * \brief What a destroyed channel leaves behind to free
+ *
+ * \details None of this refers back to the channel, so it can be freed
+ * by the reaper threads instead of the thread that happened to drop
+ * the last channel reference.
+ */
+struct channel_remains {
+	struct varshead varshead;
+	struct ast_readq_list readq;
+	struct ast_trans_pvt *readtrans;
+	struct ast_trans_pvt *writetrans;
+	struct ast_sched_context *sched;
+	struct ast_cdr *cdr;
+};
+
+static void channel_remains_free(struct channel_remains *remains)
+{
+	struct ast_var_t *vardata;
+	struct ast_frame *f;
+
+	while ((vardata = AST_LIST_REMOVE_HEAD(&remains->varshead, entries))) {
+		ast_var_delete(vardata);
+	}
+	while ((f = AST_LIST_REMOVE_HEAD(&remains->readq, frame_list))) {
+		ast_frfree(f);
+	}
+	if (remains->readtrans) {
+		ast_translator_free_path(remains->readtrans);
+	}
+	if (remains->writetrans) {
+		ast_translator_free_path(remains->writetrans);
+	}
+	if (remains->sched) {
+		ast_sched_context_destroy(remains->sched);
+	}
+	if (remains->cdr) {
+		ast_cdr_free(remains->cdr);
+	}
+}
+
+static int channel_remains_task(void *data)
+{
+	channel_remains_free(data);
+	ast_free(data);
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Take what can be freed later from a channel being destroyed.
+ *
+ * \param chan Channel being destroyed.
+ * \param remains Where to move the channel's leftovers.
+ */
+static void channel_remains_take(struct ast_channel *chan, struct channel_remains *remains)
+{
+	AST_LIST_HEAD_INIT_NOLOCK(&remains->varshead);
+	AST_LIST_APPEND_LIST(&remains->varshead, ast_channel_varshead(chan), entries);
+	AST_LIST_HEAD_INIT_NOLOCK(&remains->readq);
+	AST_LIST_APPEND_LIST(&remains->readq, ast_channel_readq(chan), frame_list);
+
+	remains->readtrans = ast_channel_readtrans(chan);
+	ast_channel_readtrans_set(chan, NULL);
+	remains->writetrans = ast_channel_writetrans(chan);
+	ast_channel_writetrans_set(chan, NULL);
+	remains->sched = ast_channel_sched(chan);
+	ast_channel_sched_set(chan, NULL);
+	remains->cdr = ast_channel_cdr(chan);
+	ast_channel_cdr_set(chan, NULL);
+}
+
+/*!
+ * \internal
+ * \brief Free the leftovers of a destroyed channel on the reaper threads.
+ *
+ * \details Falls back to freeing them on the calling thread when they
+ * cannot be handed off, such as during shutdown.
+ */
+static void channel_remains_dispose(struct ast_channel *chan)
+{
+	struct channel_remains *remains;
+	struct channel_remains local;
+	int res;
+
+	ast_rwlock_rdlock(&channel_reaper_lock);
+	remains = channel_reaper ? ast_calloc(1, sizeof(*remains)) : NULL;
+	if (remains) {
+		channel_remains_take(chan, remains);
+		res = ast_threadpool_push(channel_reaper, channel_remains_task, remains);
+		ast_rwlock_unlock(&channel_reaper_lock);
+		if (res) {
+			channel_remains_task(remains);
+		}
+		return;
+	}
+	ast_rwlock_unlock(&channel_reaper_lock);
+
+	memset(&local, 0, sizeof(local));
+	channel_remains_take(chan, &local);
+	channel_remains_free(&local);
+}
+
 /*! \brief Free a channel structure */
 static void ast_channel_destructor(void *obj)
 {
 	struct ast_channel *chan = obj;
-	struct ast_var_t *vardata;
-	struct ast_frame *f;
-	struct varshead *headp;
 	struct ast_datastore *datastore;
 	char device_name[AST_CHANNEL_NAME];
 	ast_callid callid;
@@ -2223,10 +2409,6 @@ static void ast_channel_destructor(void *obj)
 		ast_free(ast_channel_tech_pvt(chan));
 	}
 
-	if (ast_channel_sched(chan)) {
-		ast_sched_context_destroy(ast_channel_sched(chan));
-	}
-
 	if (ast_channel_internal_is_finalized(chan)) {
 		char *dashptr;
 
@@ -2238,11 +2420,6 @@ static void ast_channel_destructor(void *obj)
 		device_name[0] = '\0';
 	}
 
-	/* Free translators */
-	if (ast_channel_readtrans(chan))
-		ast_translator_free_path(ast_channel_readtrans(chan));
-	if (ast_channel_writetrans(chan))
-		ast_translator_free_path(ast_channel_writetrans(chan));
 	if (ast_channel_pbx(chan))
 		ast_log_callid(LOG_WARNING, callid, "PBX may not have been terminated properly on '%s'\n", ast_channel_name(chan));
 
@@ -2265,25 +2442,15 @@ static void ast_channel_destructor(void *obj)
 		ast_timer_close(ast_channel_timer(chan));
 		ast_channel_timer_set(chan, NULL);
 	}
-	while ((f = AST_LIST_REMOVE_HEAD(ast_channel_readq(chan), frame_list)))
-		ast_frfree(f);
 
-	/* loop over the variables list, freeing all data and deleting list items */
-	/* no need to lock the list, as the channel is already locked */
-	headp = ast_channel_varshead(chan);
-	while ((vardata = AST_LIST_REMOVE_HEAD(headp, entries)))
-		ast_var_delete(vardata);
+	/* Variables, queued frames, translators, the scheduler and the CDR are freed off this thread */
+	channel_remains_dispose(chan);
 
 	ast_app_group_discard(chan);
 
 	/* Destroy the jitterbuffer */
 	ast_jb_destroy(chan);
 
-	if (ast_channel_cdr(chan)) {
-		ast_cdr_free(ast_channel_cdr(chan));
-		ast_channel_cdr_set(chan, NULL);
-	}
-
 	if (ast_channel_zone(chan)) {
 		ast_channel_zone_set(chan, ast_tone_zone_unref(ast_channel_zone(chan)));
 	}
@@ -2553,7 +2720,7 @@ void ast_hangup(struct ast_channel *chan)
 	 * longer be needed.
 	 */
 	ast_pbx_hangup_handler_run(chan);
-	ao2_unlink(channels, chan);
+	channel_unlink(chan);
 	ast_channel_lock(chan);
 
 	destroy_hooks(chan);
@@ -2915,6 +3082,297 @@ int ast_waitfor_n_fd(int *fds, int n, int *ms, int *exception)
 	return winner;
 }
 
+/*! \brief Where each pollfd of an ast_waitfor_nandfds() call came from */
+struct waitfor_fdmap {
+	/*! Index of the channel, -1 for an individual fd */
+	int chan;
+	/*! Which of the channel's fds */
+	int fdno;
+	/*! ast_channel_internal_fd_generation() of the channel */
+	unsigned int generation;
+};
+
+#ifdef __linux__
+/*! \brief Fewest channel fds a wait needs before using the thread's epoll set */
+#define WAITFOR_EPOLL_MIN_FDS 8
+
+/*! \brief Number of waits a thread polls after its epoll set could not be used */
+#define WAITFOR_EPOLL_BACKOFF 100
+
+/*! \brief A channel fd registered in a thread's epoll set */
+struct waitfor_epoll_slot {
+	/*! Channel the fd belongs to.  Only compared, no reference is held. */
+	const struct ast_channel *chan;
+	/*! ast_channel_internal_fd_generation() when the fd was registered */
+	unsigned int generation;
+	/*! The registered fd.  (-1 if the slot is free) */
+	int fd;
+	/*! Position of the fd in the pollfd array of the current wait */
+	int pos;
+};
+
+/*! \brief The epoll set a thread waits on channels with */
+struct waitfor_epoll {
+	int epfd;
+	/*! Waits left to poll before trying epoll again */
+	unsigned int backoff;
+	AST_VECTOR(, struct waitfor_epoll_slot) slots;
+};
+
+static int waitfor_epoll_init(void *data)
+{
+	struct waitfor_epoll *waiter = data;
+
+	waiter->epfd = -1;
+	return AST_VECTOR_INIT(&waiter->slots, 0);
+}
+
+static void waitfor_epoll_reset(struct waitfor_epoll *waiter)
+{
+	if (waiter->epfd >= 0) {
+		close(waiter->epfd);
+		waiter->epfd = -1;
+	}
+	AST_VECTOR_RESET(&waiter->slots, AST_VECTOR_ELEM_CLEANUP_NOOP);
+}
+
+static void waitfor_epoll_cleanup(void *data)
+{
+	struct waitfor_epoll *waiter = data;
+
+	waitfor_epoll_reset(waiter);
+	AST_VECTOR_FREE(&waiter->slots);
+	ast_free(waiter);
+}
+
+AST_THREADSTORAGE_CUSTOM(waitfor_epoll_storage, waitfor_epoll_init, waitfor_epoll_cleanup);
+
+/*!
+ * \internal
+ * \brief Find the slot a channel fd is still registered in.
+ *
+ * \param waiter The thread's epoll set.
+ * \param chan Channel the fd belongs to.
+ * \param generation Fd generation of the channel.
+ * \param fd The fd.
+ * \param hint Slot to try first.  Waits on the same channels fill the
+ * slots in the same order.
+ */
+static struct waitfor_epoll_slot *waitfor_epoll_slot_find(struct waitfor_epoll *waiter,
+	const struct ast_channel *chan, unsigned int generation, int fd, size_t hint)
+{
+	struct waitfor_epoll_slot *slot;
+	size_t i;
+
+#define SLOT_MATCHES(slot) \
+	((slot)->pos < 0 && (slot)->fd == fd && (slot)->chan == chan && (slot)->generation == generation)
+
+	if (hint < AST_VECTOR_SIZE(&waiter->slots)) {
+		slot = AST_VECTOR_GET_ADDR(&waiter->slots, hint);
+		if (SLOT_MATCHES(slot)) {
+			return slot;
+		}
+	}
+	for (i = 0; i < AST_VECTOR_SIZE(&waiter->slots); i++) {
+		slot = AST_VECTOR_GET_ADDR(&waiter->slots, i);
+		if (SLOT_MATCHES(slot)) {
+			return slot;
+		}
+	}
+
+#undef SLOT_MATCHES
+
+	return NULL;
+}
+
+/*!
+ * \internal
+ * \brief Register the channel fds of a wait that are not registered yet.
+ *
+ * \details Fds are only added and removed when the channels waited on
+ * or their fds changed since the thread's last wait.  Everything not
+ * part of this wait is removed so it cannot wake the thread.
+ *
+ * \retval 0 on success.
+ * \retval -1 if the set could not be updated.  It is emptied.
+ */
+static int waitfor_epoll_sync(struct waitfor_epoll *waiter, struct ast_channel **c,
+	struct pollfd *pfds, const struct waitfor_fdmap *fdmap, int chan_fds)
+{
+	struct waitfor_epoll_slot *slot;
+	char *pending = ast_alloca(chan_fds);
+	size_t i;
+	size_t free_slot = 0;
+	int x;
+
+	for (i = 0; i < AST_VECTOR_SIZE(&waiter->slots); i++) {
+		AST_VECTOR_GET_ADDR(&waiter->slots, i)->pos = -1;
+	}
+
+	for (x = 0; x < chan_fds; x++) {
+		slot = waitfor_epoll_slot_find(waiter, c[fdmap[x].chan], fdmap[x].generation, pfds[x].fd, x);
+		if (slot) {
+			slot->pos = x;
+		}
+		pending[x] = !slot;
+	}
+
+	/* Removals first, a stale registration may hold an fd number about to be added. */
+	for (i = 0; i < AST_VECTOR_SIZE(&waiter->slots); i++) {
+		slot = AST_VECTOR_GET_ADDR(&waiter->slots, i);
+		if (slot->pos < 0 && slot->fd >= 0) {
+			/* The fd may already be closed, which unregistered it. */
+			epoll_ctl(waiter->epfd, EPOLL_CTL_DEL, slot->fd, NULL);
+			slot->fd = -1;
+		}
+	}
+
+	for (x = 0; x < chan_fds; x++) {
+		struct waitfor_epoll_slot added = {
+			.chan = c[fdmap[x].chan],
+			.generation = fdmap[x].generation,
+			.fd = pfds[x].fd,
+			.pos = x,
+		};
+		struct epoll_event event = { .events = EPOLLIN | EPOLLPRI, };
+
+		if (!pending[x]) {
+			continue;
+		}
+
+		while (free_slot < AST_VECTOR_SIZE(&waiter->slots)
+			&& AST_VECTOR_GET_ADDR(&waiter->slots, free_slot)->fd >= 0) {
+			++free_slot;
+		}
+		event.data.u32 = free_slot;
+		if (epoll_ctl(waiter->epfd, EPOLL_CTL_ADD, added.fd, &event)
+			|| AST_VECTOR_REPLACE(&waiter->slots, free_slot, added)) {
+			/* Duplicate fds and fds epoll does not support are left to poll. */
+			waitfor_epoll_reset(waiter);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Wait for the fds of an ast_waitfor_nandfds() call with epoll.
+ *
+ * \param c Channels being waited on.
+ * \param pfds The channel fds followed by the individual fds.
+ * \param fdmap Where each of the pfds came from.
+ * \param chan_fds Number of channel fds at the start of pfds.
+ * \param max Number of pfds.
+ * \param ms Timeout as for ast_poll().
+ *
+ * \details The revents of pfds are left as ast_poll() leaves them.
+ * Individual fds are not kept registered.  They are polled together
+ * with the epoll set.
+ *
+ * \retval -2 if epoll cannot be used for this wait.
+ * \return Otherwise as ast_poll().
+ */
+static int waitfor_epoll(struct ast_channel **c, struct pollfd *pfds,
+	const struct waitfor_fdmap *fdmap, int chan_fds, int max, int ms)
+{
+	struct waitfor_epoll *waiter;
+	struct epoll_event *events;
+	int ready;
+	int res = 0;
+	int x;
+
+	waiter = ast_threadstorage_get(&waitfor_epoll_storage, sizeof(*waiter));
+	if (!waiter) {
+		return -2;
+	}
+	if (waiter->backoff) {
+		--waiter->backoff;
+		return -2;
+	}
+	if (waiter->epfd < 0) {
+		waiter->epfd = epoll_create1(EPOLL_CLOEXEC);
+	}
+	if (waiter->epfd < 0 || waitfor_epoll_sync(waiter, c, pfds, fdmap, chan_fds)) {
+		waiter->backoff = WAITFOR_EPOLL_BACKOFF;
+		return -2;
+	}
+
+	events = ast_alloca(sizeof(*events) * chan_fds);
+	if (max > chan_fds) {
+		struct pollfd *others = ast_alloca(sizeof(*others) * (max - chan_fds + 1));
+
+		others[0].fd = waiter->epfd;
+		others[0].events = POLLIN;
+		memcpy(&others[1], &pfds[chan_fds], sizeof(*others) * (max - chan_fds));
+		ready = ast_poll(others, max - chan_fds + 1, ms);
+		if (ready < 0) {
+			return ready;
+		}
+		for (x = chan_fds; x < max; x++) {
+			pfds[x].revents = others[x - chan_fds + 1].revents;
+			res += !!pfds[x].revents;
+		}
+		ready = (others[0].revents & POLLIN) ? epoll_wait(waiter->epfd, events, chan_fds, 0) : 0;
+	} else {
+		ready = epoll_wait(waiter->epfd, events, chan_fds, ms);
+	}
+	if (ready < 0) {
+		return ready;
+	}
+
+	for (x = 0; x < chan_fds; x++) {
+		pfds[x].revents = 0;
+	}
+	for (x = 0; x < ready; x++) {
+		struct waitfor_epoll_slot *slot = AST_VECTOR_GET_ADDR(&waiter->slots, events[x].data.u32);
+
+		if (slot->pos < 0) {
+			continue;
+		}
+		if (events[x].events & EPOLLIN) {
+			pfds[slot->pos].revents |= POLLIN;
+		}
+		if (events[x].events & EPOLLPRI) {
+			pfds[slot->pos].revents |= POLLPRI;
+		}
+		if (events[x].events & EPOLLERR) {
+			pfds[slot->pos].revents |= POLLERR;
+		}
+		if (events[x].events & EPOLLHUP) {
+			pfds[slot->pos].revents |= POLLHUP;
+		}
+		++res;
+	}
+
+	return res;
+}
+#endif
+
+/*!
+ * \internal
+ * \brief Wait for the fds of an ast_waitfor_nandfds() call.
+ *
+ * \details Same as ast_poll(), except that waits on many channel fds
+ * use the thread's epoll set where available.
+ */
+static int waitfor_fds(struct ast_channel **c, struct pollfd *pfds,
+	const struct waitfor_fdmap *fdmap, int chan_fds, int max, int ms)
+{
+#ifdef __linux__
+	if (chan_fds >= WAITFOR_EPOLL_MIN_FDS) {
+		int res = waitfor_epoll(c, pfds, fdmap, chan_fds, max, ms);
+
+		if (res != -2) {
+			return res;
+		}
+	}
+#endif
+
+	return ast_poll(pfds, max, ms);
+}
+
 /*! \brief Wait for x amount of time on a file descriptor to have input.  */
 struct ast_channel *ast_waitfor_nandfds(struct ast_channel **c, int n, int *fds, int nfds,
 					int *exception, int *outfd, int *ms)
@@ -2923,15 +3381,12 @@ struct ast_channel *ast_waitfor_nandfds(struct ast_channel **c, int n, int *fds,
 	struct pollfd *pfds = NULL;
 	int res;
 	long rms;
-	int x, y, max;
+	int x, y, max, chan_fds;
 	int sz = nfds;
 	struct timeval now = { 0, 0 };
 	struct timeval whentohangup = { 0, 0 }, diff;
 	struct ast_channel *winner = NULL;
-	struct fdmap {
-		int chan;
-		int fdno;
-	} *fdmap = NULL;
+	struct waitfor_fdmap *fdmap = NULL;
 
 	if (outfd) {
 		*outfd = -99999;
@@ -2990,11 +3445,13 @@ struct ast_channel *ast_waitfor_nandfds(struct ast_channel **c, int n, int *fds,
 		for (y = 0; y < ast_channel_fd_count(c[x]); y++) {
 			fdmap[max].fdno = y;  /* fd y is linked to this pfds */
 			fdmap[max].chan = x;  /* channel x is linked to this pfds */
+			fdmap[max].generation = ast_channel_internal_fd_generation(c[x]);
 			max += ast_add_fd(&pfds[max], ast_channel_fd(c[x], y));
 		}
 		CHECK_BLOCKING(c[x]);
 		ast_channel_unlock(c[x]);
 	}
+	chan_fds = max;
 	/* Add the individual fds */
 	for (x = 0; x < nfds; x++) {
 		fdmap[max].chan = -1;
@@ -3011,13 +3468,13 @@ struct ast_channel *ast_waitfor_nandfds(struct ast_channel **c, int n, int *fds,
 			if (kbrms > 600000) {
 				kbrms = 600000;
 			}
-			res = ast_poll(pfds, max, kbrms);
+			res = waitfor_fds(c, pfds, fdmap, chan_fds, max, kbrms);
 			if (!res) {
 				rms -= kbrms;
 			}
 		} while (!res && (rms > 0));
 	} else {
-		res = ast_poll(pfds, max, rms);
+		res = waitfor_fds(c, pfds, fdmap, chan_fds, max, rms);
 	}
 	for (x = 0; x < n; x++) {
 		ast_channel_lock(c[x]);
@@ -3200,7 +3657,7 @@ int ast_waitfordigit_full(struct ast_channel *c, int timeout_ms, const char *bre
 			return -1;
 		} else if (outfd > -1) {
 			/* The FD we were watching has something waiting */
-			ast_log(LOG_WARNING, "The FD we were waiting for has something waiting. Waitfordigit returning numeric 1\n");
+			ast_debug(3, "The FD we were waiting for has something waiting. Waitfordigit returning numeric 1\n");
 			ast_channel_clear_flag(c, AST_FLAG_END_DTMF_ONLY);
 			return 1;
 		} else if (rchan) {
@@ -3557,9 +4014,9 @@ static struct ast_frame *__ast_read(struct ast_channel *chan, int dropaudio, int
 		ast_clear_flag(ast_channel_flags(chan), AST_FLAG_EXCEPTION);
 	}
 
-	/* Read and ignore anything on the alertpipe, but read only
-	   one sizeof(blah) per frame that we send from it */
-	if (ast_channel_internal_alert_read(chan) == AST_ALERT_READ_FATAL) {
+	/* The alert stays raised for as long as frames remain queued */
+	if (AST_LIST_EMPTY(ast_channel_readq(chan))
+		&& ast_channel_internal_alert_lower(chan) == AST_ALERT_READ_FATAL) {
 		f = &ast_null_frame;
 		goto done;
 	}
@@ -3583,9 +4040,10 @@ static struct ast_frame *__ast_read(struct ast_channel *chan, int dropaudio, int
 		AST_LIST_TRAVERSE_SAFE_END;
 
 		if (!f) {
-			/* There were no acceptable frames on the readq. */
+			/* There were no acceptable frames on the readq, the alert stays raised. */
 			f = &ast_null_frame;
-			ast_channel_alert_write(chan);
+		} else if (AST_LIST_EMPTY(ast_channel_readq(chan))) {
+			ast_channel_internal_alert_lower(chan);
 		}
 
 		/* Interpret hangup and end-of-Q frames to return NULL */
@@ -4128,6 +4586,9 @@ done:
 		ast_channel_audiohooks_set(chan, NULL);
 	}
 	ast_channel_unlock(chan);
+	if (f) {
+		ast_media_trace_stage(f, AST_MEDIA_TRACE_READ, NULL);
+	}
 	return f;
 }
 
@@ -4949,6 +5410,8 @@ int ast_write_stream(struct ast_channel *chan, int stream_num, struct ast_frame
 	int count = 0;
 	int hooked = 0;
 
+	ast_media_trace_stage(fr, AST_MEDIA_TRACE_WRITE, NULL);
+
 	/*Deadlock avoidance*/
 	while(ast_channel_trylock(chan)) {
 		/*cannot goto done since the channel is not locked*/
@@ -6585,9 +7048,9 @@ void ast_change_name(struct ast_channel *chan, const char *newname)
 	/* We must re-link, as the hash value will change here. */
 	ao2_lock(channels);
 	ast_channel_lock(chan);
-	ao2_unlink(channels, chan);
+	channel_unlink(chan);
 	__ast_change_name_nolink(chan, newname);
-	ao2_link(channels, chan);
+	channel_link(chan, 0);
 	ast_channel_unlock(chan);
 	ao2_unlock(channels);
 }
@@ -6736,8 +7199,8 @@ static void channel_do_masquerade(struct ast_channel *original, struct ast_chann
 	ast_channel_ref(clonechan);
 
 	/* unlink from channels container as name (which is the hash value) will change */
-	ao2_unlink(channels, original);
-	ao2_unlink(channels, clonechan);
+	channel_unlink(original);
+	channel_unlink(clonechan);
 
 	moh_is_playing = ast_test_flag(ast_channel_flags(original), AST_FLAG_MOH);
 	if (moh_is_playing) {
@@ -6824,9 +7287,9 @@ static void channel_do_masquerade(struct ast_channel *original, struct ast_chann
 	 *  2) Any frames that were already on the new channel before this
 	 *     masquerade need to be at the end of the readq, after all of the
 	 *     frames on the old (clone) channel.
-	 *  3) The alertpipe needs to get poked for every frame that was already
-	 *     on the new channel, since we are now using the alert pipe from the
-	 *     old (clone) channel.
+	 *  3) The alertpipe from the old (clone) channel needs to be raised if
+	 *     it was not already, since it now covers the frames that were on
+	 *     the new channel.
 	 */
 	{
 		AST_LIST_HEAD_NOLOCK(, ast_frame) tmp_readq;
@@ -6837,9 +7300,11 @@ static void channel_do_masquerade(struct ast_channel *original, struct ast_chann
 
 		while ((current = AST_LIST_REMOVE_HEAD(&tmp_readq, frame_list))) {
 			AST_LIST_INSERT_TAIL(ast_channel_readq(original), current, frame_list);
-			if (ast_channel_alert_write(original)) {
-				ast_log(LOG_WARNING, "write() failed: %s\n", strerror(errno));
-			}
+		}
+
+		if (!AST_LIST_EMPTY(ast_channel_readq(original))
+			&& ast_channel_internal_alert_raise(original)) {
+			ast_log(LOG_WARNING, "write() failed: %s\n", strerror(errno));
 		}
 	}
 
@@ -7148,8 +7613,8 @@ static void channel_do_masquerade(struct ast_channel *original, struct ast_chann
 	ast_channel_unlock(original);
 	ast_channel_unlock(clonechan);
 
-	ao2_link(channels, clonechan);
-	ao2_link(channels, original);
+	channel_link(clonechan, 0);
+	channel_link(original, 0);
 	ao2_unlock(channels);
 
 	/* Release our held safety references. */
@@ -7627,6 +8092,105 @@ static int ast_channel_hash_cb(const void *obj, const int flags)
 	return ast_str_case_hash(name);
 }
 
+/*!
+ * \internal
+ * \brief Sort channels_by_name by channel name.
+ * \since 17.0.0
+ */
+static int channel_name_sort_cb(const void *obj_left, const void *obj_right, int flags)
+{
+	const char *left = ast_channel_name((struct ast_channel *) obj_left);
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_OBJECT:
+		return strcasecmp(left, ast_channel_name((struct ast_channel *) obj_right));
+	case OBJ_SEARCH_KEY:
+		return strcasecmp(left, obj_right);
+	case OBJ_SEARCH_PARTIAL_KEY:
+		{
+			const struct channel_name_partial_key *key = obj_right;
+
+			return strncasecmp(left, key->name, key->len);
+		}
+	default:
+		/* Sort can only work on something with a full or partial key. */
+		ast_assert(0);
+		return 0;
+	}
+}
+
+/*!
+ * \internal
+ * \brief Hash channels_by_linkedid by linkedid.
+ * \since 17.0.0
+ */
+static int channel_linkedid_hash_cb(const void *obj, const int flags)
+{
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		return ast_str_hash(obj);
+	case OBJ_SEARCH_OBJECT:
+		return ast_str_hash(ast_channel_linkedid((struct ast_channel *) obj));
+	default:
+		/* Hash can only work on something with a full key. */
+		ast_assert(0);
+		return 0;
+	}
+}
+
+/*!
+ * \internal
+ * \brief Match channels_by_linkedid entries by linkedid.
+ * \since 17.0.0
+ */
+static int channel_linkedid_cmp_cb(void *obj, void *arg, int flags)
+{
+	const char *right;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_OBJECT:
+		right = ast_channel_linkedid(arg);
+		break;
+	case OBJ_SEARCH_KEY:
+		right = arg;
+		break;
+	default:
+		ast_assert(0);
+		return 0;
+	}
+
+	return strcmp(ast_channel_linkedid(obj), right) ? 0 : CMP_MATCH;
+}
+
+static int channel_match_by_addr(void *obj, void *arg, int flags)
+{
+	return obj == arg ? CMP_MATCH | CMP_STOP : 0;
+}
+
+int ast_channel_linkedid_index_begin(struct ast_channel *chan)
+{
+	struct ast_channel *indexed;
+
+	ao2_wrlock(channels_by_linkedid);
+	indexed = ao2_callback(channels_by_linkedid, OBJ_UNLINK | OBJ_SEARCH_OBJECT | OBJ_NOLOCK,
+		channel_match_by_addr, chan);
+	if (!indexed) {
+		return 0;
+	}
+
+	/* The caller still holds a reference. */
+	ao2_ref(indexed, -1);
+	return 1;
+}
+
+void ast_channel_linkedid_index_end(struct ast_channel *chan, int indexed)
+{
+	if (indexed) {
+		ao2_link_flags(channels_by_linkedid, chan, OBJ_NOLOCK);
+	}
+	ao2_unlock(channels_by_linkedid);
+}
+
 /*!
  * \internal
  * \brief Print channel object key (name).
@@ -7823,6 +8387,8 @@ struct varshead *ast_channel_get_ari_vars(struct ast_channel *chan)
 
 static void channels_shutdown(void)
 {
+	struct ast_threadpool *reaper;
+
 	free_external_channelvars(&ami_vars);
 	free_external_channelvars(&ari_vars);
 
@@ -7832,18 +8398,68 @@ static void channels_shutdown(void)
 		ao2_ref(channels, -1);
 		channels = NULL;
 	}
+	ast_rwlock_wrlock(&channel_reaper_lock);
+	reaper = channel_reaper;
+	channel_reaper = NULL;
+	ast_rwlock_unlock(&channel_reaper_lock);
+	if (reaper) {
+		/* Nothing is pushed anymore, let what was pushed be freed before the threads go */
+		while (ast_threadpool_queue_size(reaper) > 0) {
+			usleep(1000);
+		}
+		ast_threadpool_shutdown(reaper);
+	}
+	ao2_cleanup(channels_by_name);
+	channels_by_name = NULL;
+	ao2_cleanup(channels_by_linkedid);
+	channels_by_linkedid = NULL;
 	ast_channel_unregister(&surrogate_tech);
 }
 
+/*! \brief Reaper threads never run at the realtime priority media threads may use */
+static void channel_reaper_thread_start(void)
+{
+#ifdef __linux__
+	struct sched_param sched = { .sched_priority = 0, };
+
+	/* Only Linux applies this to the calling thread rather than the whole process */
+	sched_setscheduler(0, SCHED_OTHER, &sched);
+#endif
+}
+
 int ast_channels_init(void)
 {
-	channels = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0, AST_NUM_CHANNEL_BUCKETS,
+	struct ast_threadpool_options options = {
+		.version = AST_THREADPOOL_OPTIONS_VERSION,
+		.auto_increment = 1,
+		.max_size = 2,
+		.idle_timeout = 60,
+		.initial_size = 0,
+		.thread_start = channel_reaper_thread_start,
+	};
+
+	channels = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX,
+		AO2_CONTAINER_ALLOC_OPT_HASH_RESIZE, AST_NUM_CHANNEL_BUCKETS,
 		ast_channel_hash_cb, NULL, ast_channel_cmp_cb);
 	if (!channels) {
 		return -1;
 	}
 	ao2_container_register("channels", channels, prnt_channel_key);
 
+	channels_by_name = ao2_container_alloc_rbtree(AO2_ALLOC_OPT_LOCK_RWLOCK, 0,
+		channel_name_sort_cb, NULL);
+	channels_by_linkedid = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_RWLOCK,
+		AO2_CONTAINER_ALLOC_OPT_HASH_RESIZE, AST_NUM_CHANNEL_BUCKETS,
+		channel_linkedid_hash_cb, NULL, channel_linkedid_cmp_cb);
+	if (!channels_by_name || !channels_by_linkedid) {
+		return -1;
+	}
+
+	channel_reaper = ast_threadpool_create("channel_reaper", NULL, &options);
+	if (!channel_reaper) {
+		return -1;
+	}
+
 	ast_channel_register(&surrogate_tech);
 
 	ast_stasis_channels_init();
@@ -10452,7 +11068,7 @@ int ast_channel_get_cc_agent_type(struct ast_channel *chan, char *agent_type, si
 
 void ast_channel_unlink(struct ast_channel *chan)
 {
-	ao2_unlink(channels, chan);
+	channel_unlink(chan);
 }
 
 struct ast_bridge *ast_channel_get_bridge(const struct ast_channel *chan)
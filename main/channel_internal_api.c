@@ -168,6 +168,7 @@ struct ast_channel {
 	AST_VECTOR(, int) fds;				/*!< File descriptors for channel -- Drivers will poll on
 							 *   these file descriptors, so at least one must be non -1.
 							 *   See \arg \ref AstFileDesc */
+	unsigned int fd_generation;			/*!< Changes whenever any of the fds change */
 	int softhangup;				/*!< Whether or not we have been hung up...  Do not set this value
 							 *   directly, use ast_softhangup() */
 	int fdno;					/*!< Which fd had an event detected on */
@@ -189,6 +190,7 @@ struct ast_channel {
 	unsigned int finalized:1;       /*!< Whether or not the channel has been successfully allocated */
 	struct ast_flags flags;				/*!< channel flags of AST_FLAG_ type */
 	int alertpipe[2];
+	int alert_pending;				/*!< An alert is in alertpipe for the frames on readq */
 	struct ast_format_cap *nativeformats;         /*!< Kinds of data this channel can natively handle */
 	struct ast_format *readformat;            /*!< Requested read format (after translation) */
 	struct ast_format *writeformat;           /*!< Requested write format (before translation) */
@@ -1116,6 +1118,32 @@ ast_alert_status_t ast_channel_internal_alert_read(struct ast_channel *chan)
 	return ast_alertpipe_read(chan->alertpipe);
 }
 
+int ast_channel_internal_alert_raise(struct ast_channel *chan)
+{
+	if (chan->alert_pending) {
+		return 0;
+	}
+	if (ast_alertpipe_write(chan->alertpipe)) {
+		return -1;
+	}
+	chan->alert_pending = 1;
+	return 0;
+}
+
+ast_alert_status_t ast_channel_internal_alert_lower(struct ast_channel *chan)
+{
+	ast_alert_status_t res;
+
+	if (!chan->alert_pending) {
+		return AST_ALERT_READ_SUCCESS;
+	}
+	res = ast_alertpipe_read(chan->alertpipe);
+	if (res == AST_ALERT_READ_SUCCESS) {
+		chan->alert_pending = 0;
+	}
+	return res;
+}
+
 int ast_channel_alert_writable(struct ast_channel *chan)
 {
 	return ast_alertpipe_writable(chan->alertpipe);
@@ -1129,6 +1157,7 @@ int ast_channel_internal_alert_readable(struct ast_channel *chan)
 void ast_channel_internal_alertpipe_clear(struct ast_channel *chan)
 {
 	ast_alertpipe_clear(chan->alertpipe);
+	chan->alert_pending = 0;
 }
 
 void ast_channel_internal_alertpipe_close(struct ast_channel *chan)
@@ -1146,9 +1175,28 @@ int ast_channel_internal_alert_readfd(struct ast_channel *chan)
 	return ast_alertpipe_readfd(chan->alertpipe);
 }
 
+/*! \brief Source of fd generations, so a channel never reuses one another channel had */
+static unsigned int fd_generation_next;
+
+static void fds_changed(struct ast_channel *chan)
+{
+	chan->fd_generation = ast_atomic_add_fetch(&fd_generation_next, 1, __ATOMIC_RELAXED);
+}
+
 void ast_channel_internal_alertpipe_swap(struct ast_channel *chan1, struct ast_channel *chan2)
 {
+	int pending = chan1->alert_pending;
+
 	ast_alertpipe_swap(chan1->alertpipe, chan2->alertpipe);
+	chan1->alert_pending = chan2->alert_pending;
+	chan2->alert_pending = pending;
+	fds_changed(chan1);
+	fds_changed(chan2);
+}
+
+unsigned int ast_channel_internal_fd_generation(const struct ast_channel *chan)
+{
+	return chan->fd_generation;
 }
 
 /* file descriptor array accessors */
@@ -1156,6 +1204,8 @@ void ast_channel_internal_fd_set(struct ast_channel *chan, int which, int value)
 {
 	int pos;
 
+	fds_changed(chan);
+
 	/* This ensures that if the vector has to grow with unused positions they will be
 	 * initialized to -1.
 	 */
@@ -1171,10 +1221,12 @@ void ast_channel_internal_fd_clear(struct ast_channel *chan, int which)
 		return;
 	}
 
+	fds_changed(chan);
 	AST_VECTOR_REPLACE(&chan->fds, which, -1);
 }
 void ast_channel_internal_fd_clear_all(struct ast_channel *chan)
 {
+	fds_changed(chan);
 	AST_VECTOR_RESET(&chan->fds, AST_VECTOR_ELEM_CLEANUP_NOOP);
 }
 int ast_channel_fd(const struct ast_channel *chan, int which)
@@ -1199,6 +1251,7 @@ int ast_channel_fd_add(struct ast_channel *chan, int value)
 		pos += 1;
 	}
 
+	fds_changed(chan);
 	AST_VECTOR_REPLACE(&chan->fds, pos, value);
 
 	return pos;
@@ -1397,12 +1450,16 @@ struct ast_channel *ast_channel_internal_oldest_linkedid(struct ast_channel *a,
 
 void ast_channel_internal_copy_linkedid(struct ast_channel *dest, struct ast_channel *source)
 {
+	int indexed;
+
 	if (dest->linkedid.creation_time == source->linkedid.creation_time
 		&& dest->linkedid.creation_unique == source->linkedid.creation_unique
 		&& !strcmp(dest->linkedid.unique_id, source->linkedid.unique_id)) {
 		return;
 	}
+	indexed = ast_channel_linkedid_index_begin(dest);
 	dest->linkedid = source->linkedid;
+	ast_channel_linkedid_index_end(dest, indexed);
 	ast_channel_snapshot_invalidate_segment(dest, AST_CHANNEL_SNAPSHOT_INVALIDATE_PEER);
 	ast_channel_publish_snapshot(dest);
 }
@@ -48,6 +48,7 @@ struct ast_var_t *_ast_var_assign(const char *name, const char *value, const cha
 	ast_copy_string(var->name, name, name_len);
 	var->value = var->name + name_len;
 	ast_copy_string(var->value, value, value_len);
+	var->hash = ast_var_hash(ast_var_name(var));
 
 	return var;
 }
@@ -82,12 +83,40 @@ const char *ast_var_value(const struct ast_var_t *var)
 	return (var ? var->value : NULL);
 }
 
+unsigned int ast_var_hash(const char *name)
+{
+	return ast_str_hash(name);
+}
+
+struct ast_var_t *ast_var_list_find(const struct varshead *head, const char *name, unsigned int hash)
+{
+	struct ast_var_t *var;
+
+	AST_LIST_TRAVERSE(head, var, entries) {
+		if (var->hash == hash && !strcmp(name, ast_var_name(var))) {
+			return var;
+		}
+	}
+	return NULL;
+}
+
 char *ast_var_find(const struct varshead *head, const char *name)
 {
 	struct ast_var_t *var;
+	const char *tail = name;
+	unsigned int hash;
+
+	/* Matching full names also match without the initial underscores */
+	if (tail[0] == '_') {
+		tail++;
+		if (tail[0] == '_') {
+			tail++;
+		}
+	}
+	hash = ast_var_hash(tail);
 
 	AST_LIST_TRAVERSE(head, var, entries) {
-		if (!strcmp(name, var->name)) {
+		if (var->hash == hash && !strcmp(name, var->name)) {
 			return var->value;
 		}
 	}
@@ -105,6 +105,18 @@ AST_RWLIST_HEAD(module_level_list, module_level);
 /*! list of module names and their debug levels */
 static struct module_level_list debug_modules = AST_RWLIST_HEAD_INIT_VALUE;
 
+/*!
+ * \brief map a debug level to a callid
+ */
+struct callid_level {
+	ast_callid callid;
+	unsigned int level;
+	AST_RWLIST_ENTRY(callid_level) entry;
+};
+
+/*! list of callids and their debug levels */
+static AST_RWLIST_HEAD_STATIC(debug_callids, callid_level);
+
 AST_THREADSTORAGE(ast_cli_buf);
 
 AST_RWLOCK_DEFINE_STATIC(shutdown_commands_lock);
@@ -148,6 +160,28 @@ unsigned int ast_debug_get_by_module(const char *module)
 	return res;
 }
 
+unsigned int ast_debug_get_by_callid(void)
+{
+	struct callid_level *cl;
+	ast_callid callid = ast_read_threadstorage_callid();
+	unsigned int res = 0;
+
+	if (!callid) {
+		return 0;
+	}
+
+	AST_RWLIST_RDLOCK(&debug_callids);
+	AST_RWLIST_TRAVERSE(&debug_callids, cl, entry) {
+		if (cl->callid == callid) {
+			res = cl->level;
+			break;
+		}
+	}
+	AST_RWLIST_UNLOCK(&debug_callids);
+
+	return res;
+}
+
 /*! \internal
  *  \brief Check if the user with 'uid' and 'gid' is allow to execute 'command',
  *	   if command starts with '_' then not check permissions, just permit
@@ -410,6 +444,19 @@ static void status_debug_verbose(struct ast_cli_args *a, const char *what, int o
 	}
 }
 
+/*! \brief Remove every per-callid debug level */
+static void debug_callids_clear(void)
+{
+	struct callid_level *cl;
+
+	AST_RWLIST_WRLOCK(&debug_callids);
+	while ((cl = AST_RWLIST_REMOVE_HEAD(&debug_callids, entry))) {
+		ast_free(cl);
+	}
+	ast_clear_flag(&ast_options, AST_OPT_FLAG_DEBUG_CALLID);
+	AST_RWLIST_UNLOCK(&debug_callids);
+}
+
 static char *handle_debug(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
 	int oldval;
@@ -550,6 +597,8 @@ static char *handle_debug(struct ast_cli_entry *e, int cmd, struct ast_cli_args
 		}
 		ast_clear_flag(&ast_options, AST_OPT_FLAG_DEBUG_MODULE);
 		AST_RWLIST_UNLOCK(&debug_modules);
+
+		debug_callids_clear();
 	}
 	oldval = option_debug;
 	if (!atleast || newlevel > option_debug) {
@@ -1421,6 +1470,100 @@ static char *handle_core_set_debug_channel(struct ast_cli_entry *e, int cmd, str
 	return CLI_SUCCESS;
 }
 
+static char *handle_core_set_debug_callid(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	static const char * const completions_off[] = { "off", NULL };
+	struct callid_level *cl;
+	struct ast_channel *chan;
+	ast_callid callid = 0;
+	char callid_str[13];
+	unsigned int oldval = 0;
+	int newlevel;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "core set debug callid";
+		e->usage =
+			"Usage: core set debug callid <callid|channel> <level|off>\n"
+			"       Sets the level of debug messages to be displayed for one\n"
+			"       call, in addition to the core debug level. The call is\n"
+			"       given by its callid, as shown in log messages (C-0000002a),\n"
+			"       or by the name of one of its channels.\n";
+		return NULL;
+	case CLI_GENERATE:
+		if (a->pos == 4) {
+			return ast_complete_channels(a->line, a->word, a->pos, a->n, e->args);
+		} else if (a->pos == 5) {
+			return ast_cli_complete(a->word, completions_off, a->n);
+		}
+		return NULL;
+	}
+
+	if (a->argc != e->args + 2) {
+		return CLI_SHOWUSAGE;
+	}
+
+	if (!strcasecmp(a->argv[e->args + 1], "off")) {
+		newlevel = 0;
+	} else if (sscanf(a->argv[e->args + 1], "%30d", &newlevel) != 1 || newlevel < 0) {
+		return CLI_SHOWUSAGE;
+	}
+
+	if (sscanf(a->argv[e->args], "[C-%8x]", &callid) != 1
+		&& sscanf(a->argv[e->args], "C-%8x", &callid) != 1) {
+		chan = ast_channel_get_by_name(a->argv[e->args]);
+		if (!chan) {
+			ast_cli(a->fd, "No such channel %s\n", a->argv[e->args]);
+			return CLI_FAILURE;
+		}
+		callid = ast_channel_callid(chan);
+		ast_channel_unref(chan);
+	}
+	if (!callid) {
+		ast_cli(a->fd, "%s has no callid\n", a->argv[e->args]);
+		return CLI_FAILURE;
+	}
+	ast_callid_strnprint(callid_str, sizeof(callid_str), callid);
+
+	AST_RWLIST_WRLOCK(&debug_callids);
+	AST_RWLIST_TRAVERSE_SAFE_BEGIN(&debug_callids, cl, entry) {
+		if (cl->callid == callid) {
+			oldval = cl->level;
+			if (!newlevel) {
+				AST_RWLIST_REMOVE_CURRENT(entry);
+				ast_free(cl);
+			} else {
+				cl->level = newlevel;
+			}
+			break;
+		}
+	}
+	AST_RWLIST_TRAVERSE_SAFE_END;
+
+	if (!cl && newlevel) {
+		cl = ast_calloc(1, sizeof(*cl));
+		if (!cl) {
+			AST_RWLIST_UNLOCK(&debug_callids);
+			return CLI_FAILURE;
+		}
+		cl->callid = callid;
+		cl->level = newlevel;
+		AST_RWLIST_INSERT_TAIL(&debug_callids, cl, entry);
+	}
+
+	if (AST_RWLIST_EMPTY(&debug_callids)) {
+		ast_clear_flag(&ast_options, AST_OPT_FLAG_DEBUG_CALLID);
+	} else {
+		ast_set_flag(&ast_options, AST_OPT_FLAG_DEBUG_CALLID);
+	}
+	AST_RWLIST_UNLOCK(&debug_callids);
+
+	ast_cli(a->fd, "Core debug was %u and has been set to %d for '%s'.\n",
+		oldval, newlevel, callid_str);
+
+	return CLI_SUCCESS;
+}
+
 static char *handle_nodebugchan_deprecated(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
 	char *res;
@@ -1835,6 +1978,8 @@ static struct ast_cli_entry cli_cli[] = {
 
 	AST_CLI_DEFINE(handle_core_set_debug_channel, "Enable/disable debugging on a channel"),
 
+	AST_CLI_DEFINE(handle_core_set_debug_callid, "Set level of debug chattiness for a call"),
+
 	AST_CLI_DEFINE(handle_debug, "Set level of debug chattiness"),
 	AST_CLI_DEFINE(handle_verbose, "Set level of verbose chattiness"),
 
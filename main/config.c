@@ -58,6 +58,7 @@
 #include "asterisk/strings.h"	/* for the ast_str_*() API */
 #include "asterisk/netsock2.h"
 #include "asterisk/module.h"
+#include "asterisk/taskprocessor.h"
 
 #define MAX_NESTED_COMMENTS 128
 #define COMMENT_START ";--"
@@ -79,6 +80,7 @@ static void config_hook_exec(const char *filename, const char *module, const str
 static inline struct ast_variable *variable_list_switch(struct ast_variable *l1, struct ast_variable *l2);
 static int does_category_match(struct ast_category *cat, const char *category_name,
 	const char *match, char sep);
+static int realtime_cache_init(void);
 
 /*! \brief Structure to keep comments for rewriting configuration files */
 struct ast_comment {
@@ -211,6 +213,16 @@ static struct ast_config_map {
 	char stuff[0];
 } *config_maps = NULL;
 
+/*! \brief Realtime result caching policy for a family, from the [cache] section of extconfig.conf */
+static struct realtime_cache_policy {
+	struct realtime_cache_policy *next;
+	/*! Seconds a cached result is served without asking the driver */
+	int ttl;
+	/*! Seconds past the ttl a result may still be served while it is refreshed */
+	int stale;
+	char family[0];
+} *cache_policies = NULL;
+
 AST_MUTEX_DEFINE_STATIC(config_lock);
 static struct ast_config_engine *config_engine_list;
 
@@ -256,6 +268,17 @@ struct ast_config {
 	int include_level;
 	int max_include_level;
 	struct ast_config_include *includes;  /*!< a list of inclusions, which should describe the entire tree */
+	/*! Categories by name, only present while a text file is being parsed */
+	struct ao2_container *category_index;
+};
+
+/*! Number of buckets in the category name index used while parsing */
+#define CATEGORY_INDEX_BUCKETS 1021
+
+/*! \brief Categories sharing a name, in list order */
+struct category_index_entry {
+	AST_VECTOR(, struct ast_category *) categories;
+	char name[0];
 };
 
 struct ast_config_include {
@@ -838,7 +861,26 @@ const char *ast_variable_find_last_in_list(const struct ast_variable *list, cons
 
 static struct ast_variable *variable_clone(const struct ast_variable *old)
 {
-	struct ast_variable *new = ast_variable_new(old->name, old->value, old->file);
+	struct ast_variable *new;
+
+	if (old->file == old->stuff && old->name > old->file && old->value > old->name) {
+		/*
+		 * The variable was laid out by ast_variable_new(), so its strings can be
+		 * copied as a single block.  Templates are cloned into every category that
+		 * inherits from them so this avoids rescanning each string on every copy.
+		 */
+		size_t len = (old->value - old->stuff) + strlen(old->value) + 1;
+
+		new = ast_calloc(1, sizeof(*new) + len);
+		if (new) {
+			memcpy(new->stuff, old->stuff, len);
+			new->file = new->stuff;
+			new->name = new->stuff + (old->name - old->stuff);
+			new->value = new->stuff + (old->value - old->stuff);
+		}
+	} else {
+		new = ast_variable_new(old->name, old->value, old->file);
+	}
 
 	if (new) {
 		new->lineno = old->lineno;
@@ -981,11 +1023,147 @@ struct ast_category *ast_category_new_template(const char *name, const char *in_
 	return new_category(name, in_file, lineno, 1);
 }
 
+static int category_index_hash(const void *obj, const int flags)
+{
+	const struct category_index_entry *object;
+	const char *key;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		key = obj;
+		break;
+	case OBJ_SEARCH_OBJECT:
+		object = obj;
+		key = object->name;
+		break;
+	default:
+		ast_assert(0);
+		return 0;
+	}
+	return ast_str_case_hash(key);
+}
+
+static int category_index_cmp(void *obj, void *arg, int flags)
+{
+	const struct category_index_entry *object_left = obj;
+	const struct category_index_entry *object_right = arg;
+	const char *right_key = arg;
+	int cmp;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_OBJECT:
+		right_key = object_right->name;
+		/* Fall through */
+	case OBJ_SEARCH_KEY:
+		cmp = strcasecmp(object_left->name, right_key);
+		break;
+	default:
+		cmp = 0;
+		break;
+	}
+	return cmp ? 0 : CMP_MATCH;
+}
+
+static void category_index_entry_destroy(void *obj)
+{
+	struct category_index_entry *entry = obj;
+
+	AST_VECTOR_FREE(&entry->categories);
+}
+
+/*!
+ * \internal
+ * \brief Add a category appended to the config to the name index.
+ *
+ * \note On failure the index is dropped and lookups go back to walking the list.
+ */
+static void category_index_add(struct ast_config *config, struct ast_category *category)
+{
+	struct category_index_entry *entry;
+
+	if (!config->category_index) {
+		return;
+	}
+
+	entry = ao2_find(config->category_index, category->name, OBJ_SEARCH_KEY);
+	if (!entry) {
+		entry = ao2_alloc_options(sizeof(*entry) + strlen(category->name) + 1,
+			category_index_entry_destroy, AO2_ALLOC_OPT_LOCK_NOLOCK);
+		if (!entry || AST_VECTOR_INIT(&entry->categories, 1)
+			|| !ao2_link(config->category_index, entry)) {
+			goto failed;
+		}
+		strcpy(entry->name, category->name); /* Safe */
+	}
+	if (AST_VECTOR_APPEND(&entry->categories, category)) {
+		goto failed;
+	}
+	ao2_ref(entry, -1);
+	return;
+
+failed:
+	ao2_cleanup(entry);
+	ao2_cleanup(config->category_index);
+	config->category_index = NULL;
+}
+
+static void category_index_remove(struct ast_config *config, struct ast_category *category)
+{
+	struct category_index_entry *entry;
+
+	if (!config->category_index) {
+		return;
+	}
+
+	entry = ao2_find(config->category_index, category->name, OBJ_SEARCH_KEY);
+	if (entry) {
+		AST_VECTOR_REMOVE_ELEM_ORDERED(&entry->categories, category, AST_VECTOR_ELEM_CLEANUP_NOOP);
+		ao2_ref(entry, -1);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Index the categories already in a config by name.
+ *
+ * \details Category headers that inherit from a template or append to an
+ * existing category look it up by name.  Walking the category list for each
+ * of those made loading files with many such categories quadratic.
+ */
+static void category_index_create(struct ast_config *config)
+{
+	struct ast_category *cat;
+
+	config->category_index = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_NOLOCK, 0,
+		CATEGORY_INDEX_BUCKETS, category_index_hash, NULL, category_index_cmp);
+	for (cat = config->root; cat && config->category_index; cat = cat->next) {
+		category_index_add(config, cat);
+	}
+}
+
 static struct ast_category *category_get_sep(const struct ast_config *config,
 	const char *category_name, const char *filter, char sep, char pointer_match_possible)
 {
 	struct ast_category *cat;
 
+	if (!pointer_match_possible && config->category_index && !ast_strlen_zero(category_name)) {
+		struct category_index_entry *entry;
+		int i;
+
+		cat = NULL;
+		entry = ao2_find(config->category_index, category_name, OBJ_SEARCH_KEY);
+		if (entry) {
+			for (i = 0; i < AST_VECTOR_SIZE(&entry->categories); i++) {
+				if (does_category_match(AST_VECTOR_GET(&entry->categories, i), category_name, filter, sep)) {
+					cat = AST_VECTOR_GET(&entry->categories, i);
+					break;
+				}
+			}
+			ao2_ref(entry, -1);
+		}
+		return cat;
+	}
+
 	if (pointer_match_possible) {
 		for (cat = config->root; cat; cat = cat->next) {
 			if (cat->name == category_name && does_category_match(cat, category_name, filter, sep)) {
@@ -1351,6 +1529,8 @@ void ast_category_rename(struct ast_category *cat, const char *name)
 int ast_category_inherit(struct ast_category *new, const struct ast_category *base)
 {
 	struct ast_variable *var;
+	struct ast_variable *head = NULL;
+	struct ast_variable *tail = NULL;
 	struct ast_category_template_instance *x;
 
 	x = ast_calloc(1, sizeof(*x));
@@ -1360,14 +1540,22 @@ int ast_category_inherit(struct ast_category *new, const struct ast_category *ba
 	strcpy(x->name, base->name);
 	x->inst = base;
 	AST_LIST_INSERT_TAIL(&new->template_instances, x, next);
+	/* Build the copy as a separate chain so it is appended in one operation */
 	for (var = base->root; var; var = var->next) {
 		struct ast_variable *cloned = variable_clone(var);
 		if (!cloned) {
+			ast_variable_append(new, head);
 			return -1;
 		}
 		cloned->inherited = 1;
-		ast_variable_append(new, cloned);
+		if (tail) {
+			tail->next = cloned;
+		} else {
+			head = cloned;
+		}
+		tail = cloned;
 	}
+	ast_variable_append(new, head);
 	return 0;
 }
 
@@ -1486,6 +1674,7 @@ struct ast_category *ast_category_delete(struct ast_config *config,
 		config->last_browse = prev;
 	}
 
+	category_index_remove(config, category);
 	ast_category_destroy(category);
 
 	return prev;
@@ -1838,6 +2027,7 @@ static int process_text_line(struct ast_config *cfg, struct ast_category **cat,
 		*last_cat = newcat;
 		if (newcat) {
 			ast_category_append(cfg, newcat);
+			category_index_add(cfg, newcat);
 		}
 	} else if (cur[0] == '#') { /* A directive - #include or #exec */
 		char *cur2;
@@ -2023,7 +2213,7 @@ set_new_variable:
 	return 0;
 }
 
-static struct ast_config *config_text_file_load(const char *database, const char *table, const char *filename, struct ast_config *cfg, struct ast_flags flags, const char *suggested_include_file, const char *who_asked)
+static struct ast_config *config_text_file_parse(const char *database, const char *table, const char *filename, struct ast_config *cfg, struct ast_flags flags, const char *suggested_include_file, const char *who_asked)
 {
 	char fn[256];
 #if defined(LOW_MEMORY)
@@ -2146,7 +2336,7 @@ static struct ast_config *config_text_file_load(const char *database, const char
 
 					/* File is unchanged, what about the (cached) includes (if any)? */
 					AST_LIST_TRAVERSE(&cfmtime->includes, cfinclude, list) {
-						if (!config_text_file_load(NULL, NULL, cfinclude->include,
+						if (!config_text_file_parse(NULL, NULL, cfinclude->include,
 							NULL, flags, "", who_asked)) {
 							/* One change is enough to short-circuit and reload the whole shebang */
 							unchanged = 0;
@@ -2836,6 +3026,41 @@ static void clear_config_maps(void)
 	}
 }
 
+static void clear_cache_policies(void)
+{
+	struct realtime_cache_policy *policy;
+
+	while (cache_policies) {
+		policy = cache_policies;
+		cache_policies = cache_policies->next;
+		ast_free(policy);
+	}
+}
+
+static int realtime_cache_append_policy(const char *family, const char *value)
+{
+	struct realtime_cache_policy *policy;
+	int ttl = 0, stale = 0;
+
+	if (sscanf(value, "%30d,%30d", &ttl, &stale) < 1 || ttl <= 0 || stale < 0) {
+		ast_log(LOG_WARNING, "Invalid realtime cache setting '%s' for '%s', expected ttl[,stale]\n", value, family);
+		return -1;
+	}
+
+	if (!(policy = ast_calloc(1, sizeof(*policy) + strlen(family) + 1))) {
+		return -1;
+	}
+	strcpy(policy->family, family); /* Safe */
+	policy->ttl = ttl;
+	policy->stale = stale;
+	policy->next = cache_policies;
+	cache_policies = policy;
+
+	ast_verb(2, "Caching realtime results for %s for %d seconds (stale %d)\n", family, ttl, stale);
+
+	return 0;
+}
+
 #ifdef TEST_FRAMEWORK
 int ast_realtime_append_mapping(const char *name, const char *driver, const char *database, const char *table, int priority)
 #else
@@ -2885,6 +3110,8 @@ static int reload_module(void)
 	SCOPED_MUTEX(lock, &config_lock);
 
 	clear_config_maps();
+	clear_cache_policies();
+	ast_realtime_cache_invalidate(NULL);
 
 	configtmp = ast_config_new();
 	if (!configtmp) {
@@ -2952,6 +3179,15 @@ static int reload_module(void)
 			ast_realtime_append_mapping(v->name, driver, database, table, pri);
 	}
 
+	for (v = ast_variable_browse(config, "cache"); v; v = v->next) {
+		realtime_cache_append_policy(v->name, v->value);
+	}
+
+	if (cache_policies && realtime_cache_init()) {
+		ast_log(LOG_WARNING, "Unable to set up the realtime result cache, results will not be cached\n");
+		clear_cache_policies();
+	}
+
 	ast_config_destroy(config);
 	return 0;
 }
@@ -3040,6 +3276,27 @@ static struct ast_config_engine *find_engine(const char *family, int priority, c
 	return ret;
 }
 
+static struct ast_config *config_text_file_load(const char *database, const char *table, const char *filename, struct ast_config *cfg, struct ast_flags flags, const char *suggested_include_file, const char *who_asked)
+{
+	struct ast_config *result;
+	int own_index = 0;
+
+	/* Included files share the index of the file that includes them */
+	if (!cfg->category_index) {
+		category_index_create(cfg);
+		own_index = 1;
+	}
+
+	result = config_text_file_parse(database, table, filename, cfg, flags, suggested_include_file, who_asked);
+
+	if (own_index) {
+		ao2_cleanup(cfg->category_index);
+		cfg->category_index = NULL;
+	}
+
+	return result;
+}
+
 static struct ast_config_engine text_file_engine = {
 	.name = "text",
 	.load_func = config_text_file_load,
@@ -3232,7 +3489,7 @@ static int realtime_arguments_to_fields2(va_list ap, int skip, struct ast_variab
 	return 0;
 }
 
-struct ast_variable *ast_load_realtime_all_fields(const char *family, const struct ast_variable *fields)
+static struct ast_variable *realtime_load_all_uncached(const char *family, const struct ast_variable *fields)
 {
 	struct ast_config_engine *eng;
 	char db[256];
@@ -3253,6 +3510,354 @@ struct ast_variable *ast_load_realtime_all_fields(const char *family, const stru
 	return res;
 }
 
+static struct ast_config *realtime_load_multi_uncached(const char *family, const struct ast_variable *fields)
+{
+	struct ast_config_engine *eng;
+	char db[256];
+	char table[256];
+	struct ast_config *res = NULL;
+	int i;
+
+	for (i = 1; ; i++) {
+		if ((eng = find_engine(family, i, db, sizeof(db), table, sizeof(table)))) {
+			if (eng->realtime_multi_func && (res = eng->realtime_multi_func(db, table, fields))) {
+				/* If we were returned an empty cfg, destroy it and return NULL */
+				if (!res->root) {
+					ast_config_destroy(res);
+					res = NULL;
+				}
+				break;
+			}
+		} else {
+			break;
+		}
+	}
+
+	return res;
+}
+
+/*!
+ * \brief Realtime result cache
+ *
+ * Families listed in the [cache] section of extconfig.conf have their
+ * ast_load_realtime and ast_load_realtime_multientry results kept for the
+ * configured ttl, keyed by the family and the lookup fields. Once the ttl
+ * has passed an entry may still be served for the configured stale period
+ * while a single refresh runs in the background. Any write to a family
+ * through the realtime API, an ast_unload_realtime on it, or a call to
+ * ast_realtime_cache_invalidate drops its cached results.
+ *
+ * Only found rows are cached, so a row that is added shows up right away.
+ */
+static struct ao2_container *realtime_cache;
+static struct ast_taskprocessor *realtime_cache_tps;
+/*! Bumped on every invalidation so results loaded before it are not stored. Protected by the realtime_cache lock. */
+static unsigned int realtime_cache_generation;
+
+#define REALTIME_CACHE_BUCKETS 257
+
+/*! \brief Immutable cached result, shared between the entry and readers copying it */
+struct realtime_cache_data {
+	struct ast_variable *var;
+	struct ast_config *cfg;
+};
+
+/*! \brief Cached result of one lookup, protected by the realtime_cache lock */
+struct realtime_cache_entry {
+	/*! Served without asking the driver until this time */
+	struct timeval fresh_until;
+	/*! Served, while being refreshed, until this time */
+	struct timeval stale_until;
+	struct realtime_cache_data *data;
+	/*! Copy of the lookup fields, used to refresh the entry */
+	struct ast_variable *fields;
+	/*! Stored in key[] after the key */
+	const char *family;
+	unsigned int multi:1;
+	unsigned int refreshing:1;
+	char key[0];
+};
+
+AO2_STRING_FIELD_HASH_FN(realtime_cache_entry, key)
+AO2_STRING_FIELD_CMP_FN(realtime_cache_entry, key)
+
+static void realtime_cache_data_destroy(void *obj)
+{
+	struct realtime_cache_data *data = obj;
+
+	ast_variables_destroy(data->var);
+	if (data->cfg) {
+		ast_config_destroy(data->cfg);
+	}
+}
+
+static void realtime_cache_entry_destroy(void *obj)
+{
+	struct realtime_cache_entry *entry = obj;
+
+	ao2_cleanup(entry->data);
+	ast_variables_destroy(entry->fields);
+}
+
+static void realtime_cache_shutdown(void)
+{
+	/* Dropping the last reference waits for a running refresh to finish */
+	ast_taskprocessor_unreference(realtime_cache_tps);
+	realtime_cache_tps = NULL;
+	ao2_cleanup(realtime_cache);
+	realtime_cache = NULL;
+}
+
+static int realtime_cache_init(void)
+{
+	if (!realtime_cache) {
+		realtime_cache = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0,
+			REALTIME_CACHE_BUCKETS, realtime_cache_entry_hash_fn, NULL, realtime_cache_entry_cmp_fn);
+		if (!realtime_cache) {
+			return -1;
+		}
+	}
+
+	if (!realtime_cache_tps) {
+		realtime_cache_tps = ast_taskprocessor_get("config/realtime_cache", TPS_REF_DEFAULT);
+		if (!realtime_cache_tps) {
+			return -1;
+		}
+		ast_register_cleanup(realtime_cache_shutdown);
+	}
+
+	return 0;
+}
+
+/*! \brief Look up the cache policy of a family, returns 0 if its results are not cached */
+static int realtime_cache_policy(const char *family, int *ttl, int *stale)
+{
+	struct realtime_cache_policy *policy;
+	SCOPED_MUTEX(lock, &config_lock);
+
+	if (!realtime_cache) {
+		return 0;
+	}
+
+	for (policy = cache_policies; policy; policy = policy->next) {
+		if (!strcasecmp(policy->family, family)) {
+			*ttl = policy->ttl;
+			*stale = policy->stale;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static struct ast_str *realtime_cache_key(const char *family, const struct ast_variable *fields, int multi)
+{
+	struct ast_str *key = ast_str_create(128);
+
+	if (!key) {
+		return NULL;
+	}
+
+	ast_str_set(&key, 0, "%s\001%c", family, multi ? 'M' : 'S');
+	for (; fields; fields = fields->next) {
+		ast_str_append(&key, 0, "\001%s\002%s", fields->name, fields->value);
+	}
+
+	return key;
+}
+
+/*!
+ * \internal
+ * \brief Store a loaded result, taking ownership of \a var and \a cfg
+ *
+ * \note A NULL result removes the entry, so a deleted row is not served stale.
+ */
+static void realtime_cache_store(const char *family, const char *key, const struct ast_variable *fields,
+	int multi, struct ast_variable *var, struct ast_config *cfg, int ttl, int stale, unsigned int generation)
+{
+	struct realtime_cache_entry *entry;
+	struct realtime_cache_data *data = NULL;
+	size_t key_len = strlen(key);
+
+	if ((var || cfg)
+		&& !(data = ao2_alloc_options(sizeof(*data), realtime_cache_data_destroy, AO2_ALLOC_OPT_LOCK_NOLOCK))) {
+		ast_variables_destroy(var);
+		if (cfg) {
+			ast_config_destroy(cfg);
+		}
+		return;
+	}
+	if (data) {
+		data->var = var;
+		data->cfg = cfg;
+	}
+
+	ao2_lock(realtime_cache);
+	if (generation != realtime_cache_generation) {
+		/* The cache was invalidated while this result was being loaded */
+		ao2_unlock(realtime_cache);
+		ao2_cleanup(data);
+		return;
+	}
+
+	if (!data) {
+		ao2_find(realtime_cache, key, OBJ_SEARCH_KEY | OBJ_NOLOCK | OBJ_UNLINK | OBJ_NODATA);
+		ao2_unlock(realtime_cache);
+		return;
+	}
+
+	entry = ao2_find(realtime_cache, key, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if (!entry) {
+		entry = ao2_alloc_options(sizeof(*entry) + key_len + strlen(family) + 2,
+			realtime_cache_entry_destroy, AO2_ALLOC_OPT_LOCK_NOLOCK);
+		if (!entry || !(entry->fields = ast_variables_dup((struct ast_variable *) fields))) {
+			ao2_unlock(realtime_cache);
+			ao2_cleanup(entry);
+			ao2_ref(data, -1);
+			return;
+		}
+		strcpy(entry->key, key); /* Safe */
+		entry->family = strcpy(entry->key + key_len + 1, family); /* Safe */
+		entry->multi = multi;
+		ao2_link_flags(realtime_cache, entry, OBJ_NOLOCK);
+	}
+
+	ao2_cleanup(entry->data);
+	entry->data = data;
+	entry->refreshing = 0;
+	entry->fresh_until = ast_tvadd(ast_tvnow(), ast_samp2tv(ttl, 1));
+	entry->stale_until = ast_tvadd(entry->fresh_until, ast_samp2tv(stale, 1));
+	ao2_unlock(realtime_cache);
+
+	ao2_ref(entry, -1);
+}
+
+static int realtime_cache_refresh(void *obj)
+{
+	struct realtime_cache_entry *entry = obj;
+	struct ast_variable *var = NULL;
+	struct ast_config *cfg = NULL;
+	unsigned int generation;
+	int ttl, stale;
+
+	ao2_lock(realtime_cache);
+	generation = realtime_cache_generation;
+	ao2_unlock(realtime_cache);
+
+	if (realtime_cache_policy(entry->family, &ttl, &stale)) {
+		if (entry->multi) {
+			cfg = realtime_load_multi_uncached(entry->family, entry->fields);
+		} else {
+			var = realtime_load_all_uncached(entry->family, entry->fields);
+		}
+		realtime_cache_store(entry->family, entry->key, entry->fields, entry->multi, var, cfg,
+			ttl, stale, generation);
+	}
+
+	ao2_lock(realtime_cache);
+	entry->refreshing = 0;
+	ao2_unlock(realtime_cache);
+
+	ao2_ref(entry, -1);
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Find a cached result for a lookup
+ *
+ * \retval NULL if the driver has to be asked, with \a generation set to
+ *         pass to realtime_cache_store
+ * \retval data reference otherwise
+ */
+static struct realtime_cache_data *realtime_cache_find(const char *key, unsigned int *generation)
+{
+	struct realtime_cache_entry *entry;
+	struct realtime_cache_data *data = NULL;
+	struct timeval now = ast_tvnow();
+
+	ao2_lock(realtime_cache);
+	*generation = realtime_cache_generation;
+	entry = ao2_find(realtime_cache, key, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if (!entry) {
+		ao2_unlock(realtime_cache);
+		return NULL;
+	}
+
+	if (ast_tvcmp(now, entry->fresh_until) < 0) {
+		data = ao2_bump(entry->data);
+	} else if (ast_tvcmp(now, entry->stale_until) < 0) {
+		data = ao2_bump(entry->data);
+		if (!entry->refreshing) {
+			entry->refreshing = 1;
+			if (ast_taskprocessor_push(realtime_cache_tps, realtime_cache_refresh, ao2_bump(entry))) {
+				entry->refreshing = 0;
+				ao2_ref(entry, -1);
+			}
+		}
+	} else {
+		ao2_unlink_flags(realtime_cache, entry, OBJ_NOLOCK);
+	}
+	ao2_unlock(realtime_cache);
+
+	ao2_ref(entry, -1);
+	return data;
+}
+
+static int realtime_cache_family_cb(void *obj, void *arg, int flags)
+{
+	struct realtime_cache_entry *entry = obj;
+
+	return !strcasecmp(entry->family, arg) ? CMP_MATCH : 0;
+}
+
+void ast_realtime_cache_invalidate(const char *family)
+{
+	if (!realtime_cache) {
+		return;
+	}
+
+	ao2_lock(realtime_cache);
+	realtime_cache_generation++;
+	if (ast_strlen_zero(family)) {
+		ao2_callback(realtime_cache, OBJ_NOLOCK | OBJ_MULTIPLE | OBJ_UNLINK | OBJ_NODATA, NULL, NULL);
+	} else {
+		ao2_callback(realtime_cache, OBJ_NOLOCK | OBJ_MULTIPLE | OBJ_UNLINK | OBJ_NODATA,
+			realtime_cache_family_cb, (void *) family);
+	}
+	ao2_unlock(realtime_cache);
+}
+
+struct ast_variable *ast_load_realtime_all_fields(const char *family, const struct ast_variable *fields)
+{
+	struct realtime_cache_data *data;
+	struct ast_variable *res;
+	struct ast_str *key;
+	unsigned int generation;
+	int ttl, stale;
+
+	if (!realtime_cache_policy(family, &ttl, &stale)
+		|| !(key = realtime_cache_key(family, fields, 0))) {
+		return realtime_load_all_uncached(family, fields);
+	}
+
+	if ((data = realtime_cache_find(ast_str_buffer(key), &generation))) {
+		res = ast_variables_dup(data->var);
+		ao2_ref(data, -1);
+		ast_free(key);
+		return res;
+	}
+
+	res = realtime_load_all_uncached(family, fields);
+	if (res) {
+		realtime_cache_store(family, ast_str_buffer(key), fields, 0, ast_variables_dup(res), NULL,
+			ttl, stale, generation);
+	}
+	ast_free(key);
+
+	return res;
+}
+
 struct ast_variable *ast_load_realtime_all(const char *family, ...)
 {
 	RAII_VAR(struct ast_variable *, fields, NULL, ast_variables_destroy);
@@ -3389,32 +3994,39 @@ int ast_unload_realtime(const char *family)
 			break;
 		}
 	}
+
+	ast_realtime_cache_invalidate(family);
+
 	return res;
 }
 
 struct ast_config *ast_load_realtime_multientry_fields(const char *family, const struct ast_variable *fields)
 {
-	struct ast_config_engine *eng;
-	char db[256];
-	char table[256];
-	struct ast_config *res = NULL;
-	int i;
+	struct realtime_cache_data *data;
+	struct ast_config *res;
+	struct ast_str *key;
+	unsigned int generation;
+	int ttl, stale;
 
-	for (i = 1; ; i++) {
-		if ((eng = find_engine(family, i, db, sizeof(db), table, sizeof(table)))) {
-			if (eng->realtime_multi_func && (res = eng->realtime_multi_func(db, table, fields))) {
-				/* If we were returned an empty cfg, destroy it and return NULL */
-				if (!res->root) {
-					ast_config_destroy(res);
-					res = NULL;
-				}
-				break;
-			}
-		} else {
-			break;
-		}
+	if (!realtime_cache_policy(family, &ttl, &stale)
+		|| !(key = realtime_cache_key(family, fields, 1))) {
+		return realtime_load_multi_uncached(family, fields);
+	}
+
+	if ((data = realtime_cache_find(ast_str_buffer(key), &generation))) {
+		res = ast_config_copy(data->cfg);
+		ao2_ref(data, -1);
+		ast_free(key);
+		return res;
 	}
 
+	res = realtime_load_multi_uncached(family, fields);
+	if (res) {
+		realtime_cache_store(family, ast_str_buffer(key), fields, 1, NULL, ast_config_copy(res),
+			ttl, stale, generation);
+	}
+	ast_free(key);
+
 	return res;
 }
 
@@ -3452,6 +4064,8 @@ int ast_update_realtime_fields(const char *family, const char *keyfield, const c
 		}
 	}
 
+	ast_realtime_cache_invalidate(family);
+
 	return res;
 }
 
@@ -3488,6 +4102,8 @@ int ast_update2_realtime_fields(const char *family, const struct ast_variable *l
 		}
 	}
 
+	ast_realtime_cache_invalidate(family);
+
 	return res;
 }
 
@@ -3533,6 +4149,8 @@ int ast_store_realtime_fields(const char *family, const struct ast_variable *fie
 		}
 	}
 
+	ast_realtime_cache_invalidate(family);
+
 	return res;
 }
 
@@ -3569,6 +4187,8 @@ int ast_destroy_realtime_fields(const char *family, const char *keyfield, const
 		}
 	}
 
+	ast_realtime_cache_invalidate(family);
+
 	return res;
 }
 
@@ -3888,6 +4508,7 @@ static char *handle_cli_core_show_config_mappings(struct ast_cli_entry *e, int c
 {
 	struct ast_config_engine *eng;
 	struct ast_config_map *map;
+	struct realtime_cache_policy *policy;
 
 	switch (cmd) {
 	case CLI_INIT:
@@ -3916,6 +4537,10 @@ static char *handle_cli_core_show_config_mappings(struct ast_cli_entry *e, int c
 				}
 			}
 		}
+
+		for (policy = cache_policies; policy; policy = policy->next) {
+			ast_cli(a->fd, "Realtime cache: %s (ttl=%d, stale=%d)\n", policy->family, policy->ttl, policy->stale);
+		}
 	}
 
 	return CLI_SUCCESS;
@@ -4027,6 +4652,7 @@ static void config_shutdown(void)
 	ast_cli_unregister_multiple(cli_config, ARRAY_LEN(cli_config));
 
 	clear_config_maps();
+	clear_cache_policies();
 
 	ao2_cleanup(cfg_hooks);
 	cfg_hooks = NULL;
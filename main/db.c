@@ -51,6 +51,7 @@
 #include "asterisk/cli.h"
 #include "asterisk/utils.h"
 #include "asterisk/manager.h"
+#include "asterisk/threadstorage.h"
 
 /*** DOCUMENTATION
 	<manager name="DBGet" language="en_US">
@@ -111,6 +112,12 @@ static sqlite3 *astdb;
 static pthread_t syncthread;
 static int doexit;
 static int dosync;
+/*! \brief Non-zero when the database is in WAL mode and readers may use their own connections */
+static int db_readers_enabled;
+/*! \brief Non-zero while the sync thread holds writes that have not been committed yet */
+static int db_uncommitted;
+/*! \brief Path of the opened database, used to open the per-thread read connections */
+static char *db_filename;
 
 static void db_sync(void);
 
@@ -236,6 +243,14 @@ static int db_create_astdb(void)
 	return res;
 }
 
+static int db_execute_sql(const char *sql, int (*callback)(void *, int, char **, char **), void *arg);
+
+static int db_journal_mode_cb(void *arg, int columns, char **values, char **colnames)
+{
+	db_readers_enabled = columns > 0 && values[0] && !strcasecmp(values[0], "wal");
+	return 0;
+}
+
 static int db_open(void)
 {
 	char *dbname;
@@ -274,6 +289,18 @@ static int db_open(void)
 		return -1;
 	}
 
+	/* In WAL mode readers never block the writer (or each other), so reads
+	 * can be served from per-thread connections instead of under dblock. */
+	db_readers_enabled = 0;
+	if (!db_execute_sql("PRAGMA journal_mode=WAL", db_journal_mode_cb, NULL)) {
+		ast_free(db_filename);
+		db_filename = ast_strdup(dbname);
+		db_readers_enabled = db_filename ? db_readers_enabled : 0;
+	}
+	if (!db_readers_enabled) {
+		ast_log(LOG_NOTICE, "Asterisk database is not in WAL mode, all reads will be serialized\n");
+	}
+
 	ast_mutex_unlock(&dblock);
 
 	return 0;
@@ -324,6 +351,105 @@ static int ast_db_rollback_transaction(void)
 	return db_execute_sql("ROLLBACK", NULL, NULL);
 }
 
+/*!
+ * \internal
+ * \brief Per-thread read-only connection to the astdb
+ *
+ * When the database is in WAL mode each reading thread gets its own
+ * connection and prepared statements, so lookups do not contend on dblock
+ * with each other or with the sync thread.
+ */
+struct db_reader {
+	sqlite3 *db;
+	sqlite3_stmt *get_stmt;
+	sqlite3_stmt *gettree_stmt;
+	sqlite3_stmt *gettree_all_stmt;
+	sqlite3_stmt *gettree_prefix_stmt;
+	/*! Set if the connection could not be opened; stop retrying for this thread */
+	unsigned int failed:1;
+};
+
+static void db_reader_close(struct db_reader *reader)
+{
+	sqlite3_finalize(reader->get_stmt);
+	sqlite3_finalize(reader->gettree_stmt);
+	sqlite3_finalize(reader->gettree_all_stmt);
+	sqlite3_finalize(reader->gettree_prefix_stmt);
+	sqlite3_close(reader->db);
+	reader->get_stmt = NULL;
+	reader->gettree_stmt = NULL;
+	reader->gettree_all_stmt = NULL;
+	reader->gettree_prefix_stmt = NULL;
+	reader->db = NULL;
+}
+
+static void db_reader_destroy(void *data)
+{
+	struct db_reader *reader = data;
+
+	db_reader_close(reader);
+	ast_free(reader);
+}
+
+AST_THREADSTORAGE_CUSTOM(db_reader_buf, NULL, db_reader_destroy);
+
+static int db_reader_open(struct db_reader *reader)
+{
+	if (sqlite3_open_v2(db_filename, &reader->db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+		ast_log(LOG_WARNING, "Unable to open read connection to Asterisk database '%s': %s\n",
+			db_filename, sqlite3_errmsg(reader->db));
+		db_reader_close(reader);
+		return -1;
+	}
+
+	/* A reader only waits on the writer while the WAL is being checkpointed */
+	sqlite3_busy_timeout(reader->db, 1000);
+
+	if (sqlite3_prepare_v2(reader->db, get_stmt_sql, sizeof(get_stmt_sql), &reader->get_stmt, NULL) != SQLITE_OK
+		|| sqlite3_prepare_v2(reader->db, gettree_stmt_sql, sizeof(gettree_stmt_sql), &reader->gettree_stmt, NULL) != SQLITE_OK
+		|| sqlite3_prepare_v2(reader->db, gettree_all_stmt_sql, sizeof(gettree_all_stmt_sql), &reader->gettree_all_stmt, NULL) != SQLITE_OK
+		|| sqlite3_prepare_v2(reader->db, gettree_prefix_stmt_sql, sizeof(gettree_prefix_stmt_sql), &reader->gettree_prefix_stmt, NULL) != SQLITE_OK) {
+		ast_log(LOG_WARNING, "Couldn't prepare read statements: %s\n", sqlite3_errmsg(reader->db));
+		db_reader_close(reader);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Get the calling thread's read connection, if reads may bypass dblock
+ *
+ * Writes are batched into a transaction that the sync thread commits later,
+ * and uncommitted rows are only visible on the main connection. So while any
+ * write is pending the caller must fall back to the main connection to keep
+ * seeing its own writes.
+ *
+ * \retval NULL if the read must be done on the main connection under dblock
+ */
+static struct db_reader *db_reader_get(void)
+{
+	struct db_reader *reader;
+
+	if (!ast_atomic_fetchadd_int(&db_readers_enabled, 0)
+		|| ast_atomic_fetchadd_int(&db_uncommitted, 0)) {
+		return NULL;
+	}
+
+	reader = ast_threadstorage_get(&db_reader_buf, sizeof(*reader));
+	if (!reader || reader->failed) {
+		return NULL;
+	}
+
+	if (!reader->db && db_reader_open(reader)) {
+		reader->failed = 1;
+		return NULL;
+	}
+
+	return reader;
+}
+
 int ast_db_put(const char *family, const char *key, const char *value)
 {
 	char fullkey[MAX_DB_FIELD];
@@ -370,28 +496,19 @@ int ast_db_put(const char *family, const char *key, const char *value)
  * \retval -1 An error occurred
  * \retval 0 Success
  */
-static int db_get_common(const char *family, const char *key, char **buffer, int bufferlen)
+static int db_get_exec(sqlite3 *db, sqlite3_stmt *stmt, const char *fullkey, size_t fullkey_len,
+	const char *family, const char *key, char **buffer, int bufferlen)
 {
 	const unsigned char *result;
-	char fullkey[MAX_DB_FIELD];
-	size_t fullkey_len;
 	int res = 0;
 
-	if (strlen(family) + strlen(key) + 2 > sizeof(fullkey) - 1) {
-		ast_log(LOG_WARNING, "Family and key length must be less than %zu bytes\n", sizeof(fullkey) - 3);
-		return -1;
-	}
-
-	fullkey_len = snprintf(fullkey, sizeof(fullkey), "/%s/%s", family, key);
-
-	ast_mutex_lock(&dblock);
-	if (sqlite3_bind_text(get_stmt, 1, fullkey, fullkey_len, SQLITE_STATIC) != SQLITE_OK) {
-		ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(astdb));
+	if (sqlite3_bind_text(stmt, 1, fullkey, fullkey_len, SQLITE_STATIC) != SQLITE_OK) {
+		ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(db));
 		res = -1;
-	} else if (sqlite3_step(get_stmt) != SQLITE_ROW) {
+	} else if (sqlite3_step(stmt) != SQLITE_ROW) {
 		ast_debug(1, "Unable to find key '%s' in family '%s'\n", key, family);
 		res = -1;
-	} else if (!(result = sqlite3_column_text(get_stmt, 0))) {
+	} else if (!(result = sqlite3_column_text(stmt, 0))) {
 		ast_log(LOG_WARNING, "Couldn't get value\n");
 		res = -1;
 	} else {
@@ -403,7 +520,45 @@ static int db_get_common(const char *family, const char *key, char **buffer, int
 			ast_copy_string(*buffer, value, bufferlen);
 		}
 	}
-	sqlite3_reset(get_stmt);
+	sqlite3_reset(stmt);
+
+	return res;
+}
+
+/*!
+ * \internal
+ * \brief Get key value specified by family/key.
+ *
+ * Gets the value associated with the specified \a family and \a key, and
+ * stores it, either into the fixed sized buffer specified by \a buffer
+ * and \a bufferlen, or as a heap allocated string if \a bufferlen is -1.
+ *
+ * \note If \a bufferlen is -1, \a buffer points to heap allocated memory
+ *       and must be freed by calling ast_free().
+ *
+ * \retval -1 An error occurred
+ * \retval 0 Success
+ */
+static int db_get_common(const char *family, const char *key, char **buffer, int bufferlen)
+{
+	struct db_reader *reader;
+	char fullkey[MAX_DB_FIELD];
+	size_t fullkey_len;
+	int res;
+
+	if (strlen(family) + strlen(key) + 2 > sizeof(fullkey) - 1) {
+		ast_log(LOG_WARNING, "Family and key length must be less than %zu bytes\n", sizeof(fullkey) - 3);
+		return -1;
+	}
+
+	fullkey_len = snprintf(fullkey, sizeof(fullkey), "/%s/%s", family, key);
+
+	if ((reader = db_reader_get())) {
+		return db_get_exec(reader->db, reader->get_stmt, fullkey, fullkey_len, family, key, buffer, bufferlen);
+	}
+
+	ast_mutex_lock(&dblock);
+	res = db_get_exec(astdb, get_stmt, fullkey, fullkey_len, family, key, buffer, bufferlen);
 	ast_mutex_unlock(&dblock);
 
 	return res;
@@ -528,8 +683,29 @@ static struct ast_db_entry *db_gettree_common(sqlite3_stmt *stmt)
 	return head;
 }
 
+/*!
+ * \internal
+ * \brief Run a gettree style statement, binding \a prefix unless \a prefix_len is 0
+ */
+static struct ast_db_entry *db_gettree_exec(sqlite3 *db, sqlite3_stmt *stmt, const char *prefix, size_t prefix_len)
+{
+	struct ast_db_entry *ret;
+
+	if (prefix_len && (sqlite3_bind_text(stmt, 1, prefix, prefix_len, SQLITE_STATIC) != SQLITE_OK)) {
+		ast_log(LOG_WARNING, "Could not bind %s to stmt: %s\n", prefix, sqlite3_errmsg(db));
+		sqlite3_reset(stmt);
+		return NULL;
+	}
+
+	ret = db_gettree_common(stmt);
+	sqlite3_reset(stmt);
+
+	return ret;
+}
+
 struct ast_db_entry *ast_db_gettree(const char *family, const char *keytree)
 {
+	struct db_reader *reader;
 	char prefix[MAX_DB_FIELD];
 	sqlite3_stmt *stmt = gettree_stmt;
 	size_t res = 0;
@@ -553,16 +729,13 @@ struct ast_db_entry *ast_db_gettree(const char *family, const char *keytree)
 		stmt = gettree_all_stmt;
 	}
 
-	ast_mutex_lock(&dblock);
-	if (res && (sqlite3_bind_text(stmt, 1, prefix, res, SQLITE_STATIC) != SQLITE_OK)) {
-		ast_log(LOG_WARNING, "Could not bind %s to stmt: %s\n", prefix, sqlite3_errmsg(astdb));
-		sqlite3_reset(stmt);
-		ast_mutex_unlock(&dblock);
-		return NULL;
+	if ((reader = db_reader_get())) {
+		return db_gettree_exec(reader->db, ast_strlen_zero(prefix) ? reader->gettree_all_stmt : reader->gettree_stmt,
+			prefix, res);
 	}
 
-	ret = db_gettree_common(stmt);
-	sqlite3_reset(stmt);
+	ast_mutex_lock(&dblock);
+	ret = db_gettree_exec(astdb, stmt, prefix, res);
 	ast_mutex_unlock(&dblock);
 
 	return ret;
@@ -570,6 +743,7 @@ struct ast_db_entry *ast_db_gettree(const char *family, const char *keytree)
 
 struct ast_db_entry *ast_db_gettree_by_prefix(const char *family, const char *key_prefix)
 {
+	struct db_reader *reader;
 	char prefix[MAX_DB_FIELD];
 	size_t res;
 	struct ast_db_entry *ret;
@@ -580,16 +754,12 @@ struct ast_db_entry *ast_db_gettree_by_prefix(const char *family, const char *ke
 		return NULL;
 	}
 
-	ast_mutex_lock(&dblock);
-	if (sqlite3_bind_text(gettree_prefix_stmt, 1, prefix, res, SQLITE_STATIC) != SQLITE_OK) {
-		ast_log(LOG_WARNING, "Could not bind %s to stmt: %s\n", prefix, sqlite3_errmsg(astdb));
-		sqlite3_reset(gettree_prefix_stmt);
-		ast_mutex_unlock(&dblock);
-		return NULL;
+	if ((reader = db_reader_get())) {
+		return db_gettree_exec(reader->db, reader->gettree_prefix_stmt, prefix, res);
 	}
 
-	ret = db_gettree_common(gettree_prefix_stmt);
-	sqlite3_reset(gettree_prefix_stmt);
+	ast_mutex_lock(&dblock);
+	ret = db_gettree_exec(astdb, gettree_prefix_stmt, prefix, res);
 	ast_mutex_unlock(&dblock);
 
 	return ret;
@@ -1008,6 +1178,7 @@ static int manager_dbdeltree(struct mansession *s, const struct message *m)
  */
 static void db_sync(void)
 {
+	db_uncommitted = 1;
 	dosync = 1;
 	ast_cond_signal(&dbcond);
 }
@@ -1038,6 +1209,8 @@ static void *db_sync_thread(void *data)
 		if (ast_db_commit_transaction()) {
 			ast_db_rollback_transaction();
 		}
+		/* Everything written so far is now visible to the read connections */
+		db_uncommitted = 0;
 		if (doexit) {
 			ast_mutex_unlock(&dblock);
 			break;
@@ -1072,6 +1245,7 @@ static void astdb_atexit(void)
 
 	pthread_join(syncthread, NULL);
 	ast_mutex_lock(&dblock);
+	db_readers_enabled = 0;
 	clean_statements();
 	if (sqlite3_close(astdb) == SQLITE_OK) {
 		astdb = NULL;
@@ -207,6 +207,13 @@ struct state_change {
 	for processing by a separate thread */
 static AST_LIST_HEAD_STATIC(state_changes, state_change);
 
+/*! \brief Number of buckets for the queued state change container */
+#define STATE_CHANGE_BUCKETS 577
+
+/*! \brief Queued state changes by device, used to coalesce repeated changes.
+	Protected by the state_changes list lock. */
+static struct ao2_container *pending_changes;
+
 /*! \brief The device state change notification thread */
 static pthread_t change_thread = AST_PTHREADT_NULL;
 
@@ -455,6 +462,44 @@ static int getproviderstate(const char *provider, const char *address)
 	return res;
 }
 
+static int state_change_hash(const void *obj, const int flags)
+{
+	const struct state_change *change;
+	const char *key;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		key = obj;
+		break;
+	case OBJ_SEARCH_OBJECT:
+		change = obj;
+		key = change->device;
+		break;
+	default:
+		ast_assert(0);
+		return 0;
+	}
+	return ast_str_hash(key);
+}
+
+static int state_change_cmp(void *obj, void *arg, int flags)
+{
+	const struct state_change *left = obj;
+	const struct state_change *right = arg;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_OBJECT:
+		if (left->cachable != right->cachable || strcmp(left->device, right->device)) {
+			return 0;
+		}
+		break;
+	default:
+		ast_assert(0);
+		return 0;
+	}
+	return CMP_MATCH;
+}
+
 /*! Called by the state change thread to find out what the state is, and then
  *  to queue up the state change event */
 static void do_state_change(const char *device, enum ast_devstate_cache cachable)
@@ -465,6 +510,24 @@ static void do_state_change(const char *device, enum ast_devstate_cache cachable
 
 	ast_debug(3, "Changing state for %s - state %u (%s)\n", device, state, ast_devstate2str(state));
 
+	if (cachable == AST_DEVSTATE_CACHABLE) {
+		struct stasis_message *cached_msg;
+		int unchanged = 0;
+
+		/* The cache would not change, so there is nothing for anyone to see */
+		cached_msg = stasis_cache_get_by_eid(ast_device_state_cache(),
+			ast_device_state_message_type(), device, &ast_eid_default);
+		if (cached_msg) {
+			struct ast_device_state_message *device_state = stasis_message_data(cached_msg);
+
+			unchanged = device_state->state == state;
+			ao2_ref(cached_msg, -1);
+		}
+		if (unchanged) {
+			return;
+		}
+	}
+
 	ast_publish_device_state(device, state, cachable);
 }
 
@@ -490,18 +553,33 @@ int ast_devstate_changed_literal(enum ast_device_state state, enum ast_devstate_
 
 	if (state != AST_DEVICE_UNKNOWN) {
 		ast_publish_device_state(device, state, cachable);
-	} else if (change_thread == AST_PTHREADT_NULL || !(change = ast_calloc(1, sizeof(*change) + strlen(device)))) {
+	} else if (change_thread == AST_PTHREADT_NULL
+		|| !(change = ao2_alloc_options(sizeof(*change) + strlen(device), NULL, AO2_ALLOC_OPT_LOCK_NOLOCK))) {
 		/* we could not allocate a change struct, or */
 		/* there is no background thread, so process the change now */
 		do_state_change(device, cachable);
 	} else {
-		/* queue the change */
+		struct state_change *queued;
+
 		strcpy(change->device, device);
 		change->cachable = cachable;
 		AST_LIST_LOCK(&state_changes);
-		AST_LIST_INSERT_TAIL(&state_changes, change, list);
-		ast_cond_signal(&change_pending);
+		/*
+		 * If the same change is already waiting it will query the current state
+		 * when it is processed, so there is no need to queue another one.
+		 */
+		queued = ao2_find(pending_changes, change, OBJ_SEARCH_OBJECT | OBJ_NOLOCK);
+		if (queued) {
+			ao2_ref(queued, -1);
+		} else {
+			/* queue the change */
+			ao2_link_flags(pending_changes, change, OBJ_NOLOCK);
+			AST_LIST_INSERT_TAIL(&state_changes, change, list);
+			ao2_ref(change, +1);
+			ast_cond_signal(&change_pending);
+		}
 		AST_LIST_UNLOCK(&state_changes);
+		ao2_ref(change, -1);
 	}
 
 	return 0;
@@ -531,13 +609,15 @@ static void *do_devstate_changes(void *data)
 			ast_cond_wait(&change_pending, &state_changes.lock);
 		next = AST_LIST_FIRST(&state_changes);
 		AST_LIST_HEAD_INIT_NOLOCK(&state_changes);
+		/* Changes queued from now on are not covered by this batch */
+		ao2_callback(pending_changes, OBJ_UNLINK | OBJ_NODATA | OBJ_MULTIPLE | OBJ_NOLOCK, NULL, NULL);
 		AST_LIST_UNLOCK(&state_changes);
 
 		/* Process each state change */
 		while ((current = next)) {
 			next = AST_LIST_NEXT(current, list);
 			do_state_change(current->device, current->cachable);
-			ast_free(current);
+			ao2_ref(current, -1);
 		}
 	}
 
@@ -617,6 +697,12 @@ static void device_state_engine_cleanup(void)
 /*! \brief Initialize the device state engine in separate thread */
 int ast_device_state_engine_init(void)
 {
+	pending_changes = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_NOLOCK, 0,
+		STATE_CHANGE_BUCKETS, state_change_hash, NULL, state_change_cmp);
+	if (!pending_changes) {
+		return -1;
+	}
+
 	ast_cond_init(&change_pending, NULL);
 	if (ast_pthread_create_background(&change_thread, NULL, do_devstate_changes, NULL) < 0) {
 		ast_log(LOG_ERROR, "Unable to start device state change thread.\n");
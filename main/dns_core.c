@@ -48,6 +48,25 @@ AST_RWLIST_HEAD_STATIC(resolvers, ast_dns_resolver);
 
 static struct ast_sched_context *sched;
 
+/*! \brief Number of buckets for the DNS cache */
+#define DNS_CACHE_BUCKETS 53
+
+/*! \brief Maximum number of answers kept in the DNS cache */
+#define DNS_CACHE_MAX_ENTRIES 1024
+
+/*! \brief A cached DNS answer */
+struct dns_cache_entry {
+	/*! \brief When the answer was received */
+	struct timeval received;
+	/*! \brief When the first record of the answer expires */
+	struct timeval expires;
+	/*! \brief Query holding a private copy of the answer */
+	struct ast_dns_query *query;
+};
+
+/*! \brief Answers from resolvers, kept until their lowest TTL expires */
+static struct ao2_container *dns_cache;
+
 struct ast_sched_context *ast_dns_get_sched(void)
 {
 	return sched;
@@ -189,6 +208,273 @@ static void dns_query_destroy(void *data)
 	ast_dns_result_free(query->result);
 }
 
+/*! \brief A query being answered from the DNS cache */
+struct dns_cache_delivery {
+	/*! \brief The cached answer */
+	struct dns_cache_entry *entry;
+	/*! \brief Scheduler id of the pending completion */
+	int sched_id;
+};
+
+static void dns_cache_entry_destroy(void *obj)
+{
+	struct dns_cache_entry *entry = obj;
+
+	ao2_cleanup(entry->query);
+}
+
+static void dns_cache_delivery_destroy(void *obj)
+{
+	struct dns_cache_delivery *delivery = obj;
+
+	ao2_cleanup(delivery->entry);
+}
+
+static int dns_cache_hash(const void *obj, const int flags)
+{
+	const struct ast_dns_query *query;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		query = obj;
+		break;
+	case OBJ_SEARCH_OBJECT:
+		query = ((const struct dns_cache_entry *) obj)->query;
+		break;
+	default:
+		ast_assert(0);
+		return 0;
+	}
+
+	return ast_str_case_hash(query->name) ^ query->rr_type;
+}
+
+static int dns_cache_cmp(void *obj, void *arg, int flags)
+{
+	const struct ast_dns_query *left = ((const struct dns_cache_entry *) obj)->query;
+	const struct ast_dns_query *right;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		right = arg;
+		break;
+	case OBJ_SEARCH_OBJECT:
+		right = ((const struct dns_cache_entry *) arg)->query;
+		break;
+	default:
+		ast_assert(0);
+		return 0;
+	}
+
+	if (left->rr_type != right->rr_type
+		|| left->rr_class != right->rr_class
+		|| strcasecmp(left->name, right->name)) {
+		return 0;
+	}
+
+	return CMP_MATCH;
+}
+
+static int dns_cache_entry_expired(void *obj, void *arg, int flags)
+{
+	const struct dns_cache_entry *entry = obj;
+
+	return ast_tvcmp(entry->expires, ast_tvnow()) <= 0 ? CMP_MATCH : 0;
+}
+
+/*!
+ * \brief Copy a result into a query, aging the TTL of its records
+ *
+ * \param query The query to set the result on
+ * \param result The result to copy
+ * \param elapsed Seconds to take off the TTL of each record
+ *
+ * \retval 0 success
+ * \retval -1 failure
+ */
+static int dns_result_copy(struct ast_dns_query *query, const struct ast_dns_result *result, int elapsed)
+{
+	const struct ast_dns_record *record;
+
+	if (ast_dns_resolver_set_result(query, result->secure, result->bogus, result->rcode,
+		result->canonical, result->answer, result->answer_size)) {
+		return -1;
+	}
+
+	AST_LIST_TRAVERSE(&result->records, record, list) {
+		if (ast_dns_resolver_add_record(query, record->rr_type, record->rr_class,
+			MAX(record->ttl - elapsed, 0), record->data_ptr, record->data_len)) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*! \brief Scheduler callback which completes a query answered from the cache */
+static int dns_cache_deliver(const void *data)
+{
+	struct ast_dns_query *query = (struct ast_dns_query *) data;
+
+	ast_dns_resolver_completed(query);
+	ao2_ref(query, -1);
+
+	return 0;
+}
+
+static int dns_cache_resolve(struct ast_dns_query *query)
+{
+	struct dns_cache_delivery *delivery = ast_dns_resolver_get_data(query);
+	int elapsed = (ast_tvdiff_ms(ast_tvnow(), delivery->entry->received) + 999) / 1000;
+
+	if (dns_result_copy(query, delivery->entry->query->result, elapsed)) {
+		return -1;
+	}
+
+	/* The answer is delivered from the scheduler thread, as a resolver would */
+	delivery->sched_id = ast_sched_add(sched, 0, dns_cache_deliver, ao2_bump(query));
+	if (delivery->sched_id < 0) {
+		ao2_ref(query, -1);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int dns_cache_cancel(struct ast_dns_query *query)
+{
+	struct dns_cache_delivery *delivery = ast_dns_resolver_get_data(query);
+
+	if (delivery->sched_id < 0 || ast_sched_del(sched, delivery->sched_id)) {
+		return -1;
+	}
+	ao2_ref(query, -1);
+
+	return 0;
+}
+
+/*! \brief Pseudo resolver used for queries answered from the DNS cache */
+static struct ast_dns_resolver dns_cache_resolver = {
+	.name = "cache",
+	.resolve = dns_cache_resolve,
+	.cancel = dns_cache_cancel,
+};
+
+/*!
+ * \brief Answer a query from the DNS cache if possible
+ *
+ * \param query The query, with no resolver set on it yet
+ *
+ * \retval 1 the query will be answered from the cache
+ * \retval 0 the query must go to a resolver
+ */
+static int dns_cache_lookup(struct ast_dns_query *query)
+{
+	struct dns_cache_entry *entry;
+	struct dns_cache_delivery *delivery;
+
+	entry = ao2_find(dns_cache, query, OBJ_SEARCH_KEY);
+	if (!entry) {
+		return 0;
+	}
+
+	/*
+	 * An answer about to expire is treated as expired, so the records
+	 * handed out always have at least a second to live.
+	 */
+	if (ast_tvdiff_ms(entry->expires, ast_tvnow()) < 1000) {
+		ao2_unlink(dns_cache, entry);
+		ao2_ref(entry, -1);
+		return 0;
+	}
+
+	delivery = ao2_alloc_options(sizeof(*delivery), dns_cache_delivery_destroy,
+		AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!delivery) {
+		ao2_ref(entry, -1);
+		return 0;
+	}
+	delivery->entry = entry;
+	delivery->sched_id = -1;
+
+	ast_dns_resolver_set_data(query, delivery);
+	ao2_ref(delivery, -1);
+
+	query->resolver = &dns_cache_resolver;
+
+	return 1;
+}
+
+/*! \brief Keep a copy of a successful answer until its lowest TTL expires */
+static void dns_cache_store(const struct ast_dns_query *query)
+{
+	const struct ast_dns_record *record;
+	struct dns_cache_entry *entry;
+	int ttl = 0;
+
+	if (query->resolver == &dns_cache_resolver
+		|| !query->result || query->result->rcode != NOERROR) {
+		return;
+	}
+
+	/* A record with no TTL must not be cached, nor may an empty answer */
+	AST_LIST_TRAVERSE(&query->result->records, record, list) {
+		if (!record->ttl) {
+			return;
+		}
+		if (!ttl || record->ttl < ttl) {
+			ttl = record->ttl;
+		}
+	}
+	if (!ttl) {
+		return;
+	}
+
+	entry = ao2_alloc_options(sizeof(*entry), dns_cache_entry_destroy, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!entry) {
+		return;
+	}
+
+	entry->query = ao2_alloc_options(sizeof(*entry->query) + strlen(query->name) + 1,
+		dns_query_destroy, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!entry->query) {
+		ao2_ref(entry, -1);
+		return;
+	}
+	entry->query->rr_type = query->rr_type;
+	entry->query->rr_class = query->rr_class;
+	strcpy(entry->query->name, query->name); /* SAFE */
+
+	if (dns_result_copy(entry->query, query->result, 0)) {
+		ao2_ref(entry, -1);
+		return;
+	}
+
+	entry->received = ast_tvnow();
+	entry->expires = ast_tvadd(entry->received, ast_tv(ttl, 0));
+
+	ao2_lock(dns_cache);
+	ao2_find(dns_cache, entry, OBJ_SEARCH_OBJECT | OBJ_UNLINK | OBJ_NODATA | OBJ_NOLOCK);
+	if (ao2_container_count(dns_cache) >= DNS_CACHE_MAX_ENTRIES) {
+		ao2_callback(dns_cache, OBJ_UNLINK | OBJ_NODATA | OBJ_MULTIPLE | OBJ_NOLOCK,
+			dns_cache_entry_expired, NULL);
+	}
+	if (ao2_container_count(dns_cache) < DNS_CACHE_MAX_ENTRIES) {
+		ao2_link_flags(dns_cache, entry, OBJ_NOLOCK);
+	}
+	ao2_unlock(dns_cache);
+
+	ao2_ref(entry, -1);
+}
+
+/*! \brief Forget every cached answer */
+static void dns_cache_flush(void)
+{
+	if (dns_cache) {
+		ao2_callback(dns_cache, OBJ_UNLINK | OBJ_NODATA | OBJ_MULTIPLE, NULL, NULL);
+	}
+}
+
 struct ast_dns_query *dns_query_alloc(const char *name, int rr_type, int rr_class, ast_dns_resolve_callback callback, void *data)
 {
 	struct ast_dns_query *query;
@@ -229,6 +515,10 @@ struct ast_dns_query *dns_query_alloc(const char *name, int rr_type, int rr_clas
 	query->rr_class = rr_class;
 	strcpy(query->name, name); /* SAFE */
 
+	if (dns_cache_lookup(query)) {
+		return query;
+	}
+
 	AST_RWLIST_RDLOCK(&resolvers);
 	query->resolver = AST_RWLIST_FIRST(&resolvers);
 	AST_RWLIST_UNLOCK(&resolvers);
@@ -525,6 +815,9 @@ static void sort_result(int rr_type, struct ast_dns_result *result)
 
 void ast_dns_resolver_completed(struct ast_dns_query *query)
 {
+	/* Cached before sorting, so each answer from the cache is sorted anew */
+	dns_cache_store(query);
+
 	sort_result(ast_dns_query_get_rr_type(query), query->result);
 
 	query->callback(query);
@@ -536,6 +829,9 @@ static void dns_shutdown(void)
 		ast_sched_context_destroy(sched);
 		sched = NULL;
 	}
+
+	ao2_cleanup(dns_cache);
+	dns_cache = NULL;
 }
 
 int dns_core_init(void)
@@ -549,6 +845,12 @@ int dns_core_init(void)
 		return -1;
 	}
 
+	dns_cache = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0, DNS_CACHE_BUCKETS,
+		dns_cache_hash, NULL, dns_cache_cmp);
+	if (!dns_cache) {
+		return -1;
+	}
+
 	ast_register_cleanup(dns_shutdown);
 
 	return 0;
@@ -599,6 +901,9 @@ int ast_dns_resolver_register(struct ast_dns_resolver *resolver)
 
 	AST_RWLIST_UNLOCK(&resolvers);
 
+	/* A different resolver may give different answers */
+	dns_cache_flush();
+
 	ast_verb(2, "Registered DNS resolver '%s' with priority '%d'\n", resolver->name, resolver->priority);
 
 	return 0;
@@ -622,6 +927,8 @@ void ast_dns_resolver_unregister(struct ast_dns_resolver *resolver)
 	AST_RWLIST_TRAVERSE_SAFE_END;
 	AST_RWLIST_UNLOCK(&resolvers);
 
+	dns_cache_flush();
+
 	ast_verb(2, "Unregistered DNS resolver '%s'\n", resolver->name);
 }
 
@@ -58,6 +58,7 @@
 #include "asterisk/cli.h"
 #include "asterisk/manager.h"
 #include "asterisk/acl.h"
+#include "asterisk/vector.h"
 
 static struct ast_sched_context *sched;
 static int refresh_sched = -1;
@@ -87,9 +88,18 @@ static AST_RWLIST_HEAD_STATIC(entry_list, ast_dnsmgr_entry);
 AST_MUTEX_DEFINE_STATIC(refresh_lock);
 
 #define REFRESH_DEFAULT 300
+#define REFRESH_THREADS_DEFAULT 8
+#define REFRESH_THREADS_MAX 64
 
 static int enabled;
 static int refresh_interval;
+/*! Maximum number of entries refreshed at the same time */
+static int refresh_threads = REFRESH_THREADS_DEFAULT;
+
+/*! Number of entries refreshed by the last refresh cycle */
+static unsigned int last_refresh_count;
+/*! How long the last refresh cycle took, in milliseconds */
+static int64_t last_refresh_ms;
 
 struct refresh_info {
 	struct entry_list *entries;
@@ -269,10 +279,37 @@ static void *do_refresh(void *data)
 	return NULL;
 }
 
+/*! \brief The entries of one refresh cycle, shared by its workers */
+struct refresh_cycle {
+	AST_VECTOR(, struct ast_dnsmgr_entry *) entries;
+	/*! Index of the next entry to refresh */
+	int next;
+	int verbose;
+};
+
+static void *refresh_worker(void *data)
+{
+	struct refresh_cycle *cycle = data;
+	int idx;
+
+	while ((idx = ast_atomic_fetchadd_int(&cycle->next, +1)) < AST_VECTOR_SIZE(&cycle->entries)) {
+		dnsmgr_refresh(AST_VECTOR_GET(&cycle->entries, idx), cycle->verbose);
+	}
+
+	return NULL;
+}
+
 static int refresh_list(const void *data)
 {
 	struct refresh_info *info = (struct refresh_info *)data;
 	struct ast_dnsmgr_entry *entry;
+	struct refresh_cycle cycle = {
+		.verbose = info->verbose,
+	};
+	pthread_t *workers;
+	int num_workers = 0;
+	struct timeval start = ast_tvnow();
+	int i;
 
 	/* if a refresh or reload is already in progress, exit now */
 	if (ast_mutex_trylock(&refresh_lock)) {
@@ -283,18 +320,47 @@ static int refresh_list(const void *data)
 	}
 
 	ast_debug(6, "Refreshing DNS lookups.\n");
+	AST_VECTOR_INIT(&cycle.entries, 0);
+
+	/* The list stays locked until every worker is done, so no entry can be released */
 	AST_RWLIST_RDLOCK(info->entries);
 	AST_RWLIST_TRAVERSE(info->entries, entry, list) {
 		if (info->regex_present && regexec(&info->filter, entry->name, 0, NULL, 0)) {
 			continue;
 		}
 
-		dnsmgr_refresh(entry, info->verbose);
+		if (AST_VECTOR_APPEND(&cycle.entries, entry)) {
+			/* Out of memory, refresh this one here and now */
+			dnsmgr_refresh(entry, info->verbose);
+		}
+	}
+
+	/*
+	 * A slow lookup only holds up its own worker; this thread works
+	 * through the entries along with the others.
+	 */
+	workers = ast_alloca(sizeof(*workers) * refresh_threads);
+	for (i = 1; i < refresh_threads && i < AST_VECTOR_SIZE(&cycle.entries); ++i) {
+		if (ast_pthread_create(&workers[num_workers], NULL, refresh_worker, &cycle)) {
+			break;
+		}
+		++num_workers;
+	}
+	refresh_worker(&cycle);
+	for (i = 0; i < num_workers; ++i) {
+		pthread_join(workers[i], NULL);
 	}
 	AST_RWLIST_UNLOCK(info->entries);
 
+	last_refresh_count = AST_VECTOR_SIZE(&cycle.entries);
+	last_refresh_ms = ast_tvdiff_ms(ast_tvnow(), start);
+	AST_VECTOR_FREE(&cycle.entries);
+
 	ast_mutex_unlock(&refresh_lock);
 
+	ast_debug(6, "Refreshed %u DNS lookups in %" PRId64 " ms.\n",
+		last_refresh_count, last_refresh_ms);
+
 	/* automatically reschedule based on the interval */
 	return refresh_interval * 1000;
 }
@@ -399,6 +465,9 @@ static char *handle_cli_status(struct ast_cli_entry *e, int cmd, struct ast_cli_
 		count++;
 	AST_RWLIST_UNLOCK(&entry_list);
 	ast_cli(a->fd, "Number of entries: %d\n", count);
+	ast_cli(a->fd, "Refresh Threads: %d\n", refresh_threads);
+	ast_cli(a->fd, "Last Refresh: %u entries in %" PRId64 " ms\n",
+		last_refresh_count, last_refresh_ms);
 
 	return CLI_SUCCESS;
 }
@@ -464,6 +533,7 @@ static int do_reload(int loading)
 
 	/* reset defaults in preparation for reading config file */
 	refresh_interval = REFRESH_DEFAULT;
+	refresh_threads = REFRESH_THREADS_DEFAULT;
 	was_enabled = enabled;
 	enabled = 0;
 
@@ -485,6 +555,13 @@ static int do_reload(int loading)
 			} else {
 				refresh_interval = interval;
 			}
+		} else if (!strcasecmp(v->name, "refreshthreads")) {
+			if (sscanf(v->value, "%30d", &interval) < 1
+				|| interval < 1 || interval > REFRESH_THREADS_MAX) {
+				ast_log(LOG_WARNING, "Invalid refresh thread count '%s' specified, using default\n", v->value);
+			} else {
+				refresh_threads = interval;
+			}
 		}
 	}
 	ast_config_destroy(config);
@@ -69,6 +69,8 @@
 #include "asterisk/config.h"
 #include "asterisk/test.h"
 
+#include "dsp_private.h"
+
 /*! Number of goertzels for progress detect */
 enum gsamp_size {
 	GSAMP_SIZE_NA = 183,			/*!< North America - 350, 440, 480, 620, 950, 1400, 1800 Hz */
@@ -236,6 +238,17 @@ enum gsamp_thresh {
  */
 #define DEF_DTMF_MISSES_TO_END	3
 
+/* RMS amplitude below which a frame is quiet enough to skip tone and digit
+ * detection.  0 disables the energy gate.
+ * IE. Override with energy_gate_level=32 in dsp.conf
+ */
+#define DEF_ENERGY_GATE_LEVEL	0
+
+/* How many successive quiet frames before detection is skipped
+ * IE. Override with energy_gate_frames=10 in dsp.conf
+ */
+#define DEF_ENERGY_GATE_FRAMES	5
+
 /*!
  * \brief The default silence threshold we will use if an alternate
  * configured value is not present or is invalid.
@@ -332,6 +345,8 @@ static float relax_dtmf_normal_twist;	/* AT&T = 8dB */
 static float relax_dtmf_reverse_twist;	/* AT&T = 6dB */
 static int dtmf_hits_to_begin;		/* How many successive hits needed to consider begin of a digit */
 static int dtmf_misses_to_end;		/* How many successive misses needed to consider end of a digit */
+static int energy_gate_level;		/* RMS amplitude of a quiet frame, 0 to never skip detection */
+static int energy_gate_frames;		/* How many successive quiet frames needed to skip detection */
 
 static inline void goertzel_sample(goertzel_state_t *s, short sample)
 {
@@ -384,6 +399,34 @@ static inline void goertzel_reset(goertzel_state_t *s)
 	s->v2 = s->v3 = s->chunky = 0;
 }
 
+/*!
+ * \internal
+ * \brief Feed the same samples to several goertzels as one bank.
+ *
+ * \param states Goertzels to update.  (At most GOERTZEL_BANK_SIZE)
+ * \param count Number of goertzels.
+ * \param amp Samples to feed.
+ * \param samples Number of samples.
+ */
+static void goertzel_bank_sample(goertzel_state_t *states[], int count, const short *amp, int samples)
+{
+	struct goertzel_bank bank = { { 0, }, };
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		bank.v2[i] = states[i]->v2;
+		bank.v3[i] = states[i]->v3;
+		bank.chunky[i] = states[i]->chunky;
+		bank.fac[i] = states[i]->fac;
+	}
+	goertzel_bank_update(&bank, amp, samples);
+	for (i = 0; i < count; ++i) {
+		states[i]->v2 = bank.v2[i];
+		states[i]->v3 = bank.v3[i];
+		states[i]->chunky = bank.chunky[i];
+	}
+}
+
 typedef struct {
 	int start;
 	int end;
@@ -431,6 +474,10 @@ struct ast_dsp {
 	int mute_fragments;
 	unsigned int sample_rate;
 	fragment_t mute_data[5];
+	/*! Successive quiet frames seen by the energy gate */
+	int quiet_frames;
+	/*! Set while the energy gate skips tone and digit detection */
+	int energy_gated;
 	digit_detect_state_t digit_state;
 	tone_detect_state_t cng_tone_state;
 	tone_detect_state_t ced_tone_state;
@@ -707,21 +754,36 @@ static int dtmf_detect(struct ast_dsp *dsp, digit_detect_state_t *s, int16_t amp
 		} else {
 			limit = samples;
 		}
-		/* The following unrolled loop takes only 35% (rough estimate) of the
-		   time of a rolled loop on the machine on which it was developed */
-		for (j = sample; j < limit; j++) {
-			samp = amp[j];
-			s->td.dtmf.energy += (int32_t) samp * (int32_t) samp;
-			/* With GCC 2.95, the following unrolled code seems to take about 35%
-			   (rough estimate) as long as a neat little 0-3 loop */
-			goertzel_sample(s->td.dtmf.row_out, samp);
-			goertzel_sample(s->td.dtmf.col_out, samp);
-			goertzel_sample(s->td.dtmf.row_out + 1, samp);
-			goertzel_sample(s->td.dtmf.col_out + 1, samp);
-			goertzel_sample(s->td.dtmf.row_out + 2, samp);
-			goertzel_sample(s->td.dtmf.col_out + 2, samp);
-			goertzel_sample(s->td.dtmf.row_out + 3, samp);
-			goertzel_sample(s->td.dtmf.col_out + 3, samp);
+		if (goertzel_bank_vectorized()) {
+			goertzel_state_t *bank[] = {
+				&s->td.dtmf.row_out[0], &s->td.dtmf.row_out[1],
+				&s->td.dtmf.row_out[2], &s->td.dtmf.row_out[3],
+				&s->td.dtmf.col_out[0], &s->td.dtmf.col_out[1],
+				&s->td.dtmf.col_out[2], &s->td.dtmf.col_out[3],
+			};
+
+			for (j = sample; j < limit; j++) {
+				samp = amp[j];
+				s->td.dtmf.energy += (int32_t) samp * (int32_t) samp;
+			}
+			goertzel_bank_sample(bank, ARRAY_LEN(bank), amp + sample, limit - sample);
+		} else {
+			/* The following unrolled loop takes only 35% (rough estimate) of the
+			   time of a rolled loop on the machine on which it was developed */
+			for (j = sample; j < limit; j++) {
+				samp = amp[j];
+				s->td.dtmf.energy += (int32_t) samp * (int32_t) samp;
+				/* With GCC 2.95, the following unrolled code seems to take about 35%
+				   (rough estimate) as long as a neat little 0-3 loop */
+				goertzel_sample(s->td.dtmf.row_out, samp);
+				goertzel_sample(s->td.dtmf.col_out, samp);
+				goertzel_sample(s->td.dtmf.row_out + 1, samp);
+				goertzel_sample(s->td.dtmf.col_out + 1, samp);
+				goertzel_sample(s->td.dtmf.row_out + 2, samp);
+				goertzel_sample(s->td.dtmf.col_out + 2, samp);
+				goertzel_sample(s->td.dtmf.row_out + 3, samp);
+				goertzel_sample(s->td.dtmf.col_out + 3, samp);
+			}
 		}
 		s->td.dtmf.current_sample += (limit - sample);
 		if (s->td.dtmf.current_sample < DTMF_GSIZE) {
@@ -915,18 +977,28 @@ static int mf_detect(struct ast_dsp *dsp, digit_detect_state_t *s, int16_t amp[]
 		} else {
 			limit = samples;
 		}
-		/* The following unrolled loop takes only 35% (rough estimate) of the
-		   time of a rolled loop on the machine on which it was developed */
-		for (j = sample; j < limit; j++) {
-			/* With GCC 2.95, the following unrolled code seems to take about 35%
-			   (rough estimate) as long as a neat little 0-3 loop */
-			samp = amp[j];
-			goertzel_sample(s->td.mf.tone_out, samp);
-			goertzel_sample(s->td.mf.tone_out + 1, samp);
-			goertzel_sample(s->td.mf.tone_out + 2, samp);
-			goertzel_sample(s->td.mf.tone_out + 3, samp);
-			goertzel_sample(s->td.mf.tone_out + 4, samp);
-			goertzel_sample(s->td.mf.tone_out + 5, samp);
+		if (goertzel_bank_vectorized()) {
+			goertzel_state_t *bank[] = {
+				&s->td.mf.tone_out[0], &s->td.mf.tone_out[1],
+				&s->td.mf.tone_out[2], &s->td.mf.tone_out[3],
+				&s->td.mf.tone_out[4], &s->td.mf.tone_out[5],
+			};
+
+			goertzel_bank_sample(bank, ARRAY_LEN(bank), amp + sample, limit - sample);
+		} else {
+			/* The following unrolled loop takes only 35% (rough estimate) of the
+			   time of a rolled loop on the machine on which it was developed */
+			for (j = sample; j < limit; j++) {
+				/* With GCC 2.95, the following unrolled code seems to take about 35%
+				   (rough estimate) as long as a neat little 0-3 loop */
+				samp = amp[j];
+				goertzel_sample(s->td.mf.tone_out, samp);
+				goertzel_sample(s->td.mf.tone_out + 1, samp);
+				goertzel_sample(s->td.mf.tone_out + 2, samp);
+				goertzel_sample(s->td.mf.tone_out + 3, samp);
+				goertzel_sample(s->td.mf.tone_out + 4, samp);
+				goertzel_sample(s->td.mf.tone_out + 5, samp);
+			}
 		}
 		s->td.mf.current_sample += (limit - sample);
 		if (s->td.mf.current_sample < MF_GSIZE) {
@@ -1424,7 +1496,6 @@ static int ast_dsp_silence_noise_with_energy(struct ast_dsp *dsp, struct ast_fra
 {
 	short *s;
 	int len;
-	int x;
 	unsigned char *odata;
 
 	if (!f) {
@@ -1444,14 +1515,10 @@ static int ast_dsp_silence_noise_with_energy(struct ast_dsp *dsp, struct ast_fra
 		len = f->datalen;
 		if (ast_format_cmp(f->subclass.format, ast_format_ulaw)) {
 			s = ast_alloca(len * 2);
-			for (x = 0; x < len; x++) {
-				s[x] = AST_MULAW(odata[x]);
-			}
+			ast_ulaw_decode_array(s, odata, len);
 		} else if (ast_format_cmp(f->subclass.format, ast_format_alaw)) {
 			s = ast_alloca(len * 2);
-			for (x = 0; x < len; x++) {
-				s[x] = AST_ALAW(odata[x]);
-			}
+			ast_alaw_decode_array(s, odata, len);
 		} else {
 			ast_log(LOG_WARNING, "Can only calculate silence on signed-linear, alaw or ulaw frames :(\n");
 			return 0;
@@ -1481,11 +1548,77 @@ int ast_dsp_noise(struct ast_dsp *dsp, struct ast_frame *f, int *totalnoise)
 }
 
 
+static void tone_detect_reset(tone_detect_state_t *s)
+{
+	goertzel_reset(&s->tone);
+	s->energy = 0.0;
+	s->samples_pending = s->block_size;
+	s->hit_count = 0;
+	s->last_hit = 0;
+}
+
+/*!
+ * \internal
+ * \brief Check if tone and digit detection can skip a frame.
+ *
+ * \details After energy_gate_frames successive frames below the
+ * energy_gate_level the detectors are reset and skip frames until a
+ * louder one comes along.  They then start over with fresh blocks as if
+ * the quiet frames had never been fed to them.  Detection is never
+ * skipped while a digit is in progress or a tone still needs muting.
+ *
+ * \retval non-zero if the detectors can skip the frame.
+ */
+static int dsp_energy_gate(struct ast_dsp *dsp, const short *amp, int len)
+{
+	int64_t energy = 0;
+	int mute_samples;
+	int x;
+
+	if (!energy_gate_level || !len) {
+		dsp->quiet_frames = 0;
+		dsp->energy_gated = 0;
+		return 0;
+	}
+
+	for (x = 0; x < len; x++) {
+		energy += (int32_t) amp[x] * (int32_t) amp[x];
+	}
+	if (energy >= (int64_t) energy_gate_level * energy_gate_level * len) {
+		dsp->quiet_frames = 0;
+		dsp->energy_gated = 0;
+		return 0;
+	}
+
+	if (dsp->energy_gated) {
+		return 1;
+	}
+	if (dsp->quiet_frames < energy_gate_frames) {
+		++dsp->quiet_frames;
+		return 0;
+	}
+
+	mute_samples = (dsp->digitmode & DSP_DIGITMODE_MF)
+		? dsp->digit_state.td.mf.mute_samples : dsp->digit_state.td.dtmf.mute_samples;
+	if (dsp->dtmf_began || dsp->digit_state.current_digits || mute_samples
+		|| dsp->cng_tone_state.mute_samples || dsp->ced_tone_state.mute_samples) {
+		return 0;
+	}
+
+	ast_dsp_digitreset(dsp);
+	tone_detect_reset(&dsp->cng_tone_state);
+	tone_detect_reset(&dsp->ced_tone_state);
+	dsp->energy_gated = 1;
+
+	return 1;
+}
+
 struct ast_frame *ast_dsp_process(struct ast_channel *chan, struct ast_dsp *dsp, struct ast_frame *af)
 {
 	int silence;
 	int res;
 	int digit = 0, fax_digit = 0;
+	int quiet;
 	int x;
 	short *shortdata;
 	unsigned char *odata;
@@ -1548,7 +1681,11 @@ struct ast_frame *ast_dsp_process(struct ast_channel *chan, struct ast_dsp *dsp,
 		return ast_frisolate(&dsp->f);
 	}
 
-	if ((dsp->features & DSP_FEATURE_FAX_DETECT)) {
+	/* Silence and busy detection above still need every frame */
+	quiet = (dsp->features & (DSP_FEATURE_FAX_DETECT | DSP_FEATURE_DIGIT_DETECT | DSP_FEATURE_BUSY_DETECT))
+		&& dsp_energy_gate(dsp, shortdata, len);
+
+	if ((dsp->features & DSP_FEATURE_FAX_DETECT) && !quiet) {
 		if ((dsp->faxmode & DSP_FAXMODE_DETECT_CNG) && tone_detect(dsp, &dsp->cng_tone_state, shortdata, len)) {
 			fax_digit = 'f';
 		}
@@ -1558,7 +1695,7 @@ struct ast_frame *ast_dsp_process(struct ast_channel *chan, struct ast_dsp *dsp,
 		}
 	}
 
-	if (dsp->features & (DSP_FEATURE_DIGIT_DETECT | DSP_FEATURE_BUSY_DETECT)) {
+	if ((dsp->features & (DSP_FEATURE_DIGIT_DETECT | DSP_FEATURE_BUSY_DETECT)) && !quiet) {
 		if (dsp->digitmode & DSP_DIGITMODE_MF) {
 			digit = mf_detect(dsp, &dsp->digit_state, shortdata, len, (dsp->digitmode & DSP_DIGITMODE_NOQUELCH) == 0, (dsp->digitmode & DSP_DIGITMODE_RELAXDTMF));
 		} else {
@@ -1887,6 +2024,8 @@ static int _dsp_init(int reload)
 	relax_dtmf_reverse_twist = DEF_RELAX_DTMF_REVERSE_TWIST;
         dtmf_hits_to_begin = DEF_DTMF_HITS_TO_BEGIN;
         dtmf_misses_to_end = DEF_DTMF_MISSES_TO_END;
+	energy_gate_level = DEF_ENERGY_GATE_LEVEL;
+	energy_gate_frames = DEF_ENERGY_GATE_FRAMES;
 
 	if (cfg == CONFIG_STATUS_FILEMISSING || cfg == CONFIG_STATUS_FILEINVALID) {
 		return 0;
@@ -1949,6 +2088,22 @@ static int _dsp_init(int reload)
 			} else {
 				dtmf_misses_to_end = cfg_threshold;
 			}
+		} else if (!strcasecmp(v->name, "energy_gate_level")) {
+			if (sscanf(v->value, "%30d", &cfg_threshold) < 1) {
+				ast_log(LOG_WARNING, "Unable to convert '%s' to a numeric value.\n", v->value);
+			} else if (cfg_threshold < 0 || cfg_threshold > 32767) {
+				ast_log(LOG_WARNING, "Invalid energy_gate_level value '%d' specified, using default of %d\n", cfg_threshold, energy_gate_level);
+			} else {
+				energy_gate_level = cfg_threshold;
+			}
+		} else if (!strcasecmp(v->name, "energy_gate_frames")) {
+			if (sscanf(v->value, "%30d", &cfg_threshold) < 1) {
+				ast_log(LOG_WARNING, "Unable to convert '%s' to a numeric value.\n", v->value);
+			} else if (cfg_threshold < 1) {		/* must be 1 or greater */
+				ast_log(LOG_WARNING, "Invalid energy_gate_frames value '%d' specified, using default of %d\n", cfg_threshold, energy_gate_frames);
+			} else {
+				energy_gate_frames = cfg_threshold;
+			}
 		}
 	}
 	ast_config_destroy(cfg);
@@ -2394,10 +2549,204 @@ AST_TEST_DEFINE(test_dsp_dtmf_detect)
 }
 #endif
 
+#ifdef TEST_FRAMEWORK
+AST_TEST_DEFINE(test_dsp_goertzel_bank)
+{
+	static const float freqs[GOERTZEL_BANK_SIZE] = {
+		697.0, 941.0, 1209.0, 1633.0, 700.0, 1700.0, 20.0, 3990.0,
+	};
+	goertzel_state_t single[GOERTZEL_BANK_SIZE];
+	goertzel_state_t banked[GOERTZEL_BANK_SIZE];
+	goertzel_state_t *bank[GOERTZEL_BANK_SIZE];
+	short amp[DTMF_GSIZE];
+	int block;
+	int idx;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "goertzel_bank";
+		info->category = "/main/dsp/";
+		info->summary = "DSP goertzel bank unit test";
+		info->description =
+			"Tests a goertzel bank gives exactly the results of single goertzels.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	ast_test_status_update(test, "Goertzel kernel: %s\n", ast_goertzel_simd_name());
+	if (!goertzel_bank_vectorized()) {
+		/* goertzel_bank_sample() is never used without a vector kernel */
+		return AST_TEST_PASS;
+	}
+
+	for (idx = 0; idx < GOERTZEL_BANK_SIZE; ++idx) {
+		goertzel_init(&single[idx], freqs[idx], DEFAULT_SAMPLE_RATE);
+		banked[idx] = single[idx];
+		bank[idx] = &banked[idx];
+	}
+
+	/* Full scale noise and square waves push chunky up and exercise the wrap around */
+	for (block = 0; block < 200; ++block) {
+		for (i = 0; i < ARRAY_LEN(amp); ++i) {
+			if (block % 3) {
+				amp[i] = ast_random();
+			} else {
+				amp[i] = (i / (block % 7 + 1)) & 1 ? SHRT_MAX : SHRT_MIN;
+			}
+		}
+		for (idx = 0; idx < GOERTZEL_BANK_SIZE; ++idx) {
+			for (i = 0; i < ARRAY_LEN(amp); ++i) {
+				goertzel_sample(&single[idx], amp[i]);
+			}
+		}
+		goertzel_bank_sample(bank, GOERTZEL_BANK_SIZE - block % 3, amp, ARRAY_LEN(amp));
+
+		for (idx = 0; idx < GOERTZEL_BANK_SIZE - block % 3; ++idx) {
+			if (single[idx].v2 != banked[idx].v2
+				|| single[idx].v3 != banked[idx].v3
+				|| single[idx].chunky != banked[idx].chunky) {
+				ast_test_status_update(test, "Goertzel %d differs after block %d: v2 %d/%d v3 %d/%d chunky %d/%d\n",
+					idx, block, single[idx].v2, banked[idx].v2, single[idx].v3, banked[idx].v3,
+					single[idx].chunky, banked[idx].chunky);
+				return AST_TEST_FAIL;
+			}
+		}
+		for (; idx < GOERTZEL_BANK_SIZE; ++idx) {
+			/* Not in the bank this time, keep the pair in step */
+			banked[idx] = single[idx];
+		}
+
+		if (block % 5 == 4) {
+			for (idx = 0; idx < GOERTZEL_BANK_SIZE; ++idx) {
+				goertzel_reset(&single[idx]);
+				goertzel_reset(&banked[idx]);
+			}
+		}
+	}
+
+	return AST_TEST_PASS;
+}
+#endif
+
+#ifdef TEST_FRAMEWORK
+/*!
+ * \internal
+ * \brief Run a signed linear frame through ast_dsp_process().
+ *
+ * \return Frame type ast_dsp_process() returned.
+ */
+static enum ast_frame_type test_dsp_process_slin(struct ast_dsp *dsp, short *slin_buf, int samples)
+{
+	struct ast_frame frame = {
+		.frametype = AST_FRAME_VOICE,
+		.datalen = samples * sizeof(*slin_buf),
+		.samples = samples,
+		.src = __PRETTY_FUNCTION__,
+	};
+	struct ast_frame *out;
+	enum ast_frame_type type;
+
+	frame.subclass.format = ast_format_slin;
+	frame.data.ptr = slin_buf;
+
+	out = ast_dsp_process(NULL, dsp, &frame);
+	type = out->frametype;
+	if (out != &frame) {
+		ast_frfree(out);
+	}
+
+	return type;
+}
+
+AST_TEST_DEFINE(test_dsp_energy_gate)
+{
+	/* One block per frame keeps the generated tones in phase */
+	short slin_buf[DTMF_GSIZE];
+	int saved_level = energy_gate_level;
+	int saved_frames = energy_gate_frames;
+	enum ast_frame_type type;
+	struct ast_dsp *dsp;
+	int result;
+	int idx;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "energy_gate";
+		info->category = "/main/dsp/";
+		info->summary = "DSP energy gate unit test";
+		info->description =
+			"Tests the energy gate skips detection on quiet frames only.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	dsp = ast_dsp_new();
+	if (!dsp) {
+		return AST_TEST_FAIL;
+	}
+	ast_dsp_set_features(dsp, DSP_FEATURE_DIGIT_DETECT);
+
+	energy_gate_level = 32;
+	energy_gate_frames = 5;
+	result = AST_TEST_PASS;
+
+	/* Low noise */
+	for (idx = 0; idx < ARRAY_LEN(slin_buf); ++idx) {
+		slin_buf[idx] = (ast_random() % 21) - 10;
+	}
+	for (idx = 0; idx < energy_gate_frames; ++idx) {
+		test_dsp_process_slin(dsp, slin_buf, ARRAY_LEN(slin_buf));
+		if (dsp->energy_gated) {
+			ast_test_status_update(test, "Gated after only %d quiet frames\n", idx + 1);
+			result = AST_TEST_FAIL;
+		}
+	}
+	test_dsp_process_slin(dsp, slin_buf, ARRAY_LEN(slin_buf));
+	if (!dsp->energy_gated) {
+		ast_test_status_update(test, "Not gated after %d quiet frames\n", energy_gate_frames + 1);
+		result = AST_TEST_FAIL;
+	}
+
+	/* A digit right after the quiet frames must still be detected */
+	type = AST_FRAME_VOICE;
+	for (idx = 0; type != AST_FRAME_DTMF_BEGIN && idx < 5; ++idx) {
+		/* Squelching mutes the buffer so make it again each time */
+		test_dual_sample_gen(slin_buf, ARRAY_LEN(slin_buf), DEFAULT_SAMPLE_RATE,
+			(int) dtmf_row[1], 1000, (int) dtmf_col[1], 1000);
+		type = test_dsp_process_slin(dsp, slin_buf, ARRAY_LEN(slin_buf));
+	}
+	if (type != AST_FRAME_DTMF_BEGIN || dsp->energy_gated) {
+		ast_test_status_update(test, "Digit not detected after gating\n");
+		result = AST_TEST_FAIL;
+	}
+
+	/* The quiet frames after it must still end the digit */
+	memset(slin_buf, 0, sizeof(slin_buf));
+	type = AST_FRAME_VOICE;
+	for (idx = 0; type != AST_FRAME_DTMF_END && idx < energy_gate_frames * 2; ++idx) {
+		type = test_dsp_process_slin(dsp, slin_buf, ARRAY_LEN(slin_buf));
+	}
+	if (type != AST_FRAME_DTMF_END) {
+		ast_test_status_update(test, "Digit did not end on quiet frames\n");
+		result = AST_TEST_FAIL;
+	}
+
+	energy_gate_level = saved_level;
+	energy_gate_frames = saved_frames;
+	ast_dsp_free(dsp);
+	return result;
+}
+#endif
+
 static int unload_module(void)
 {
 	AST_TEST_UNREGISTER(test_dsp_fax_detect);
 	AST_TEST_UNREGISTER(test_dsp_dtmf_detect);
+	AST_TEST_UNREGISTER(test_dsp_goertzel_bank);
+	AST_TEST_UNREGISTER(test_dsp_energy_gate);
 
 	return 0;
 }
@@ -2410,6 +2759,8 @@ static int load_module(void)
 
 	AST_TEST_REGISTER(test_dsp_fax_detect);
 	AST_TEST_REGISTER(test_dsp_dtmf_detect);
+	AST_TEST_REGISTER(test_dsp_goertzel_bank);
+	AST_TEST_REGISTER(test_dsp_energy_gate);
 
 	return AST_MODULE_LOAD_SUCCESS;
 }
@@ -0,0 +1,60 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2019, Sangoma Technologies Corporation
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*! \file
+ *
+ * \brief Private definitions shared by dsp.c and dsp_simd.c.
+ */
+
+#ifndef DSP_PRIVATE_H_
+#define DSP_PRIVATE_H_
+
+/*! Number of goertzels a bank runs side by side */
+#define GOERTZEL_BANK_SIZE 8
+
+/*!
+ * \brief Goertzel states laid out one per vector lane.
+ *
+ * \note Each array holds the goertzel_state_t field of the same name.
+ * Unused lanes are left zeroed.
+ */
+struct goertzel_bank {
+	int v2[GOERTZEL_BANK_SIZE];
+	int v3[GOERTZEL_BANK_SIZE];
+	int chunky[GOERTZEL_BANK_SIZE];
+	int fac[GOERTZEL_BANK_SIZE];
+};
+
+/*!
+ * \brief Feed the same samples to every goertzel in a bank.
+ *
+ * \param bank Goertzels to update.
+ * \param amp Samples to feed.
+ * \param samples Number of samples.
+ *
+ * \note Gives exactly the results of feeding each goertzel on its own.
+ * Only call it when goertzel_bank_vectorized() is true.
+ */
+void goertzel_bank_update(struct goertzel_bank *bank, const short *amp, int samples);
+
+/*!
+ * \brief Check if there is a vector kernel for this CPU.
+ *
+ * \retval non-zero if goertzel_bank_update() is worth the packing.
+ */
+int goertzel_bank_vectorized(void);
+
+#endif /* DSP_PRIVATE_H_ */
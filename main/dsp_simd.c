@@ -0,0 +1,146 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2019, Sangoma Technologies Corporation
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*! \file
+ *
+ * \brief Vectorized goertzel banks for the DTMF and MF detectors
+ *
+ * Every goertzel of a detector sees the same samples, so a bank of them
+ * runs in the lanes of one vector.  The lanes use the same 32 bit
+ * integer arithmetic as goertzel_sample() in dsp.c, wrap around
+ * included, so the detectors see identical energies.
+ */
+
+/*** MODULEINFO
+	<support_level>core</support_level>
+ ***/
+
+/* Needed for the inline allocators in the intrinsics headers */
+#define ASTMM_LIBC ASTMM_IGNORE
+#include "asterisk.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define GOERTZEL_SIMD_X86
+#endif
+
+#include "asterisk/_private.h"
+#include "asterisk/dsp.h"
+#include "dsp_private.h"
+
+static void goertzel_bank_scalar(struct goertzel_bank *bank, const short *amp, int samples)
+{
+	int lane;
+	int i;
+
+	for (lane = 0; lane < GOERTZEL_BANK_SIZE; ++lane) {
+		int v2 = bank->v2[lane];
+		int v3 = bank->v3[lane];
+		int chunky = bank->chunky[lane];
+		int fac = bank->fac[lane];
+
+		for (i = 0; i < samples; ++i) {
+			int v1 = v2;
+
+			v2 = v3;
+			v3 = (fac * v2) >> 15;
+			v3 = v3 - v1 + (amp[i] >> chunky);
+			if (abs(v3) > (1 << 15)) {
+				chunky++;
+				v3 = v3 >> 1;
+				v2 = v2 >> 1;
+			}
+		}
+
+		bank->v2[lane] = v2;
+		bank->v3[lane] = v3;
+		bank->chunky[lane] = chunky;
+	}
+}
+
+#if defined(GOERTZEL_SIMD_X86)
+/*
+ * The kernel carries its own target attribute so it builds without
+ * -mavx2 and is only called when the CPU supports it.
+ */
+static __attribute__((target("avx2"))) void goertzel_bank_avx2(struct goertzel_bank *bank, const short *amp, int samples)
+{
+	const __m256i limit = _mm256_set1_epi32(1 << 15);
+	const __m256i count_mask = _mm256_set1_epi32(31);
+	__m256i v2 = _mm256_loadu_si256((const __m256i *) bank->v2);
+	__m256i v3 = _mm256_loadu_si256((const __m256i *) bank->v3);
+	__m256i chunky = _mm256_loadu_si256((const __m256i *) bank->chunky);
+	__m256i fac = _mm256_loadu_si256((const __m256i *) bank->fac);
+	int i;
+
+	for (i = 0; i < samples; ++i) {
+		__m256i v1 = v2;
+		__m256i big;
+
+		v2 = v3;
+		v3 = _mm256_srai_epi32(_mm256_mullo_epi32(fac, v2), 15);
+		/*
+		 * Overdriven goertzels can push chunky past 31 within a block.
+		 * The scalar shift then only uses the low five bits of the
+		 * count on x86, so do the same.
+		 */
+		v3 = _mm256_add_epi32(_mm256_sub_epi32(v3, v1),
+			_mm256_srav_epi32(_mm256_set1_epi32(amp[i]), _mm256_and_si256(chunky, count_mask)));
+
+		/* All ones in the lanes that have to rescale, so subtracting it counts them up */
+		big = _mm256_cmpgt_epi32(_mm256_abs_epi32(v3), limit);
+		chunky = _mm256_sub_epi32(chunky, big);
+		v3 = _mm256_blendv_epi8(v3, _mm256_srai_epi32(v3, 1), big);
+		v2 = _mm256_blendv_epi8(v2, _mm256_srai_epi32(v2, 1), big);
+	}
+
+	_mm256_storeu_si256((__m256i *) bank->v2, v2);
+	_mm256_storeu_si256((__m256i *) bank->v3, v3);
+	_mm256_storeu_si256((__m256i *) bank->chunky, chunky);
+}
+#endif
+
+/*! \brief Goertzel bank kernel, picked for the CPU by ast_goertzel_simd_init() */
+static void (*goertzel_bank_kernel)(struct goertzel_bank *bank, const short *amp, int samples) = goertzel_bank_scalar;
+static const char *goertzel_simd_name = "scalar";
+
+int ast_goertzel_simd_init(void)
+{
+#if defined(GOERTZEL_SIMD_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		goertzel_bank_kernel = goertzel_bank_avx2;
+		goertzel_simd_name = "avx2";
+	}
+#endif
+
+	return 0;
+}
+
+void goertzel_bank_update(struct goertzel_bank *bank, const short *amp, int samples)
+{
+	goertzel_bank_kernel(bank, amp, samples);
+}
+
+int goertzel_bank_vectorized(void)
+{
+	return goertzel_bank_kernel != goertzel_bank_scalar;
+}
+
+const char *ast_goertzel_simd_name(void)
+{
+	return goertzel_simd_name;
+}
@@ -31,6 +31,7 @@
 
 #include "asterisk/astobj2.h"
 #include "asterisk/endpoints.h"
+#include "asterisk/sched.h"
 #include "asterisk/stasis.h"
 #include "asterisk/stasis_channels.h"
 #include "asterisk/stasis_endpoints.h"
@@ -47,6 +48,19 @@
 /*! Buckets for technology endpoints. */
 #define TECH_ENDPOINT_BUCKETS 11
 
+/*!
+ * Channel count at which snapshots for channel membership changes are
+ * coalesced. Every snapshot lists all of the endpoint's channels, so
+ * publishing one per channel on a busy trunk is quadratic.
+ */
+#define ENDPOINT_SNAPSHOT_COALESCE_CHANNELS 64
+
+/*! Minimum time between coalesced channel membership snapshots. */
+#define ENDPOINT_SNAPSHOT_COALESCE_MS 100
+
+/*! Scheduler for coalesced endpoint snapshots */
+static struct ast_sched_context *endpoint_sched;
+
 static struct ao2_container *endpoints;
 
 static struct ao2_container *tech_endpoints;
@@ -74,6 +88,10 @@ struct ast_endpoint {
 	struct ao2_container *channel_ids;
 	/*! Forwarding subscription from an endpoint to its tech endpoint */
 	struct stasis_forward *tech_forward;
+	/*! When a snapshot was last published for a channel membership change */
+	struct timeval last_channel_publish;
+	/*! Scheduler ID of a pending coalesced snapshot, or -1 */
+	int publish_sched_id;
 };
 
 AO2_STRING_FIELD_HASH_FN(ast_endpoint, id)
@@ -142,6 +160,70 @@ static void endpoint_publish_snapshot(struct ast_endpoint *endpoint)
 	stasis_publish(ast_endpoint_topic(endpoint), message);
 }
 
+/*! \brief Scheduler callback publishing a coalesced snapshot */
+static int endpoint_publish_deferred(const void *data)
+{
+	struct ast_endpoint *endpoint = (struct ast_endpoint *) data;
+
+	ao2_lock(endpoint);
+	endpoint->publish_sched_id = -1;
+	endpoint->last_channel_publish = ast_tvnow();
+	ao2_unlock(endpoint);
+
+	/* The endpoint may have been shut down while this was waiting to run */
+	if (endpoint->tech_forward) {
+		endpoint_publish_snapshot(endpoint);
+	}
+
+	ao2_ref(endpoint, -1);
+	return 0;
+}
+
+/*!
+ * \brief Publish a snapshot after the channels on an endpoint changed.
+ *
+ * Endpoints with many channels publish at most one snapshot for channel
+ * changes every \ref ENDPOINT_SNAPSHOT_COALESCE_MS. Changes in between are
+ * picked up by a scheduled snapshot.
+ */
+static void endpoint_channels_changed(struct ast_endpoint *endpoint)
+{
+	int64_t elapsed;
+
+	ao2_lock(endpoint);
+	if (!endpoint_sched
+		|| ao2_container_count(endpoint->channel_ids) < ENDPOINT_SNAPSHOT_COALESCE_CHANNELS) {
+		ao2_unlock(endpoint);
+		endpoint_publish_snapshot(endpoint);
+		return;
+	}
+
+	if (endpoint->publish_sched_id > -1) {
+		/* The pending snapshot will include this change */
+		ao2_unlock(endpoint);
+		return;
+	}
+
+	elapsed = ast_tvdiff_ms(ast_tvnow(), endpoint->last_channel_publish);
+	if (elapsed >= ENDPOINT_SNAPSHOT_COALESCE_MS || elapsed < 0) {
+		endpoint->last_channel_publish = ast_tvnow();
+		ao2_unlock(endpoint);
+		endpoint_publish_snapshot(endpoint);
+		return;
+	}
+
+	ao2_ref(endpoint, +1);
+	endpoint->publish_sched_id = ast_sched_add(endpoint_sched,
+		ENDPOINT_SNAPSHOT_COALESCE_MS - elapsed, endpoint_publish_deferred, endpoint);
+	if (endpoint->publish_sched_id < 0) {
+		ao2_unlock(endpoint);
+		ao2_ref(endpoint, -1);
+		endpoint_publish_snapshot(endpoint);
+		return;
+	}
+	ao2_unlock(endpoint);
+}
+
 static void endpoint_dtor(void *obj)
 {
 	struct ast_endpoint *endpoint = obj;
@@ -174,7 +256,7 @@ int ast_endpoint_add_channel(struct ast_endpoint *endpoint,
 	ast_str_container_add(endpoint->channel_ids, ast_channel_uniqueid(chan));
 	ao2_unlock(endpoint);
 
-	endpoint_publish_snapshot(endpoint);
+	endpoint_channels_changed(endpoint);
 
 	return 0;
 }
@@ -197,7 +279,7 @@ static void endpoint_cache_clear(void *data,
 	ao2_lock(endpoint);
 	ast_str_container_remove(endpoint->channel_ids, update->new_snapshot->base->uniqueid);
 	ao2_unlock(endpoint);
-	endpoint_publish_snapshot(endpoint);
+	endpoint_channels_changed(endpoint);
 }
 
 static void endpoint_subscription_change(void *data,
@@ -211,7 +293,8 @@ static void endpoint_subscription_change(void *data,
 	}
 }
 
-static struct ast_endpoint *endpoint_internal_create(const char *tech, const char *resource)
+static struct ast_endpoint *endpoint_internal_create(const char *tech, const char *resource,
+	enum ast_endpoint_state state)
 {
 	RAII_VAR(struct ast_endpoint *, endpoint, NULL, ao2_cleanup);
 	RAII_VAR(struct ast_endpoint *, tech_endpoint, NULL, ao2_cleanup);
@@ -221,7 +304,7 @@ static struct ast_endpoint *endpoint_internal_create(const char *tech, const cha
 	if (!ast_strlen_zero(resource)) {
 		tech_endpoint = ao2_find(tech_endpoints, tech, OBJ_KEY);
 		if (!tech_endpoint) {
-			tech_endpoint = endpoint_internal_create(tech, NULL);
+			tech_endpoint = endpoint_internal_create(tech, NULL, AST_ENDPOINT_UNKNOWN);
 			if (!tech_endpoint) {
 				return NULL;
 			}
@@ -234,7 +317,8 @@ static struct ast_endpoint *endpoint_internal_create(const char *tech, const cha
 	}
 
 	endpoint->max_channels = -1;
-	endpoint->state = AST_ENDPOINT_UNKNOWN;
+	endpoint->state = state;
+	endpoint->publish_sched_id = -1;
 
 	if (ast_string_field_init(endpoint, 80) != 0) {
 		return NULL;
@@ -316,7 +400,8 @@ static struct ast_endpoint *endpoint_internal_create(const char *tech, const cha
 	return endpoint;
 }
 
-struct ast_endpoint *ast_endpoint_create(const char *tech, const char *resource)
+struct ast_endpoint *ast_endpoint_create_with_state(const char *tech, const char *resource,
+	enum ast_endpoint_state state)
 {
 	if (ast_strlen_zero(tech)) {
 		ast_log(LOG_ERROR, "Endpoint tech cannot be empty\n");
@@ -328,7 +413,12 @@ struct ast_endpoint *ast_endpoint_create(const char *tech, const char *resource)
 		return NULL;
 	}
 
-	return endpoint_internal_create(tech, resource);
+	return endpoint_internal_create(tech, resource, state);
+}
+
+struct ast_endpoint *ast_endpoint_create(const char *tech, const char *resource)
+{
+	return ast_endpoint_create_with_state(tech, resource, AST_ENDPOINT_UNKNOWN);
 }
 
 static struct stasis_message *create_endpoint_snapshot_message(struct ast_endpoint *endpoint)
@@ -358,6 +448,18 @@ void ast_endpoint_shutdown(struct ast_endpoint *endpoint)
 	ao2_unlink(endpoints, endpoint);
 	endpoint->tech_forward = stasis_forward_cancel(endpoint->tech_forward);
 
+	if (endpoint_sched) {
+		int sched_id;
+
+		ao2_lock(endpoint);
+		sched_id = endpoint->publish_sched_id;
+		ao2_unlock(endpoint);
+		/* If it could not be deleted it is running and releases its own reference */
+		if (sched_id > -1 && !ast_sched_del(endpoint_sched, sched_id)) {
+			ao2_ref(endpoint, -1);
+		}
+	}
+
 	clear_msg = create_endpoint_snapshot_message(endpoint);
 	if (clear_msg) {
 		RAII_VAR(struct stasis_message *, message, NULL, ao2_cleanup);
@@ -486,6 +588,9 @@ struct ast_endpoint_snapshot *ast_endpoint_snapshot_create(
 
 static void endpoint_cleanup(void)
 {
+	ast_sched_context_destroy(endpoint_sched);
+	endpoint_sched = NULL;
+
 	ao2_cleanup(endpoints);
 	endpoints = NULL;
 
@@ -509,5 +614,15 @@ int ast_endpoint_init(void)
 		return -1;
 	}
 
+	endpoint_sched = ast_sched_context_create();
+	if (!endpoint_sched) {
+		return -1;
+	}
+	if (ast_sched_start_thread(endpoint_sched)) {
+		ast_sched_context_destroy(endpoint_sched);
+		endpoint_sched = NULL;
+		return -1;
+	}
+
 	return 0;
 }
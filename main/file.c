@@ -32,6 +32,7 @@
 #include <dirent.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
 #include <math.h>
 
 #include "asterisk/_private.h"	/* declare ast_file_init() */
@@ -46,6 +47,7 @@
 #include "asterisk/app.h"
 #include "asterisk/pbx.h"
 #include "asterisk/linkedlists.h"
+#include "asterisk/dlinkedlists.h"
 #include "asterisk/module.h"
 #include "asterisk/astobj2.h"
 #include "asterisk/test.h"
@@ -53,6 +55,9 @@
 #include "asterisk/json.h"
 #include "asterisk/stasis_system.h"
 #include "asterisk/media_cache.h"
+#include "asterisk/options.h"
+#include "asterisk/taskprocessor.h"
+#include "asterisk/threadpool.h"
 
 /*! \brief
  * The following variable controls the layout of localized sound files.
@@ -206,26 +211,53 @@ int ast_stopstream(struct ast_channel *tmp)
 	return 0;
 }
 
-int ast_writestream(struct ast_filestream *fs, struct ast_frame *f)
+/*! Most bytes of frames queued to a stream writer before more are dropped */
+#define FILE_WRITER_MAX_QUEUED (1024 * 1024)
+/*! Default stdio buffer size of a stream writer */
+#define FILE_WRITER_BUFFER_SIZE (64 * 1024)
+
+/*! \brief Background writer of a stream set up by ast_filestream_set_async() */
+struct ast_filestream_writer {
+	/*! Serializer writing the frames in order */
+	struct ast_taskprocessor *serializer;
+	/*! Stream written */
+	struct ast_filestream *fs;
+	/*! Longest time written frames sit in the stdio buffer in ms (0 for no limit) */
+	unsigned int flush_ms;
+	/*! When the stdio buffer was last flushed */
+	struct timeval last_flush;
+	/*! Bytes of frames queued and not written yet */
+	size_t queued;
+	/*! Frames dropped because too many were queued */
+	unsigned int dropped;
+	/*! Set while frames are being dropped */
+	unsigned int dropping:1;
+	AST_LIST_ENTRY(ast_filestream_writer) list;
+};
+
+/*! Threads of the stream writers (NULL if disabled) */
+static struct ast_threadpool *file_writer_pool;
+
+/*! Every stream writer, for the CLI */
+static AST_LIST_HEAD_STATIC(file_writers, ast_filestream_writer);
+
+/*! \brief A frame queued to a stream writer */
+struct filestream_write {
+	struct ast_filestream *fs;
+	struct ast_frame *frame;
+};
+
+/*! \brief Wait for the frames queued to a stream writer */
+struct filestream_drain {
+	ast_mutex_t lock;
+	ast_cond_t cond;
+	int done;
+};
+
+static int filestream_write_voice(struct ast_filestream *fs, struct ast_frame *f)
 {
 	int res = -1;
-	if (f->frametype == AST_FRAME_VIDEO) {
-		if (ast_format_get_type(fs->fmt->format) == AST_MEDIA_TYPE_AUDIO) {
-			/* This is the audio portion.  Call the video one... */
-			if (!fs->vfs && fs->filename) {
-				const char *type = ast_format_get_name(f->subclass.format);
-				fs->vfs = ast_writefile(fs->filename, type, NULL, fs->flags, 0, fs->mode);
-				ast_debug(1, "Opened video output file\n");
-			}
-			if (fs->vfs)
-				return ast_writestream(fs->vfs, f);
-			/* else ignore */
-			return 0;
-		}
-	} else if (f->frametype != AST_FRAME_VOICE) {
-		ast_log(LOG_WARNING, "Tried to write non-voice frame\n");
-		return -1;
-	}
+
 	if (ast_format_cmp(f->subclass.format, fs->fmt->format) != AST_FORMAT_CMP_NOT_EQUAL) {
 		res =  fs->fmt->write(fs, f);
 		if (res < 0)
@@ -268,6 +300,174 @@ int ast_writestream(struct ast_filestream *fs, struct ast_frame *f)
 	return res;
 }
 
+static int filestream_write_task(void *data)
+{
+	struct filestream_write *entry = data;
+	struct ast_filestream *fs = entry->fs;
+	struct ast_filestream_writer *writer = fs->writer;
+
+	filestream_write_voice(fs, entry->frame);
+	if (writer->flush_ms) {
+		struct timeval now = ast_tvnow();
+
+		if (ast_tvdiff_ms(now, writer->last_flush) >= writer->flush_ms) {
+			fflush(fs->f);
+			writer->last_flush = now;
+		}
+	}
+
+	ast_atomic_fetch_sub(&writer->queued, entry->frame->datalen, __ATOMIC_RELAXED);
+	ast_frfree(entry->frame);
+	ao2_ref(fs, -1);
+	ast_free(entry);
+	return 0;
+}
+
+static int filestream_writer_queue(struct ast_filestream *fs, struct ast_frame *f)
+{
+	struct ast_filestream_writer *writer = fs->writer;
+	struct filestream_write *entry;
+
+	if (ast_atomic_load_n(&writer->queued, __ATOMIC_RELAXED) >= FILE_WRITER_MAX_QUEUED) {
+		if (!writer->dropping) {
+			ast_log(LOG_WARNING, "Writing '%s' is falling behind, dropping frames\n", fs->filename);
+			writer->dropping = 1;
+		}
+		++writer->dropped;
+		return -1;
+	}
+	if (writer->dropping) {
+		ast_log(LOG_NOTICE, "Writing '%s' caught up, %u frames dropped so far\n",
+			fs->filename, writer->dropped);
+		writer->dropping = 0;
+	}
+
+	entry = ast_malloc(sizeof(*entry));
+	if (!entry) {
+		return -1;
+	}
+	entry->frame = ast_frdup(f);
+	if (!entry->frame) {
+		ast_free(entry);
+		return -1;
+	}
+	entry->fs = ao2_bump(fs);
+
+	ast_atomic_fetch_add(&writer->queued, entry->frame->datalen, __ATOMIC_RELAXED);
+	if (ast_taskprocessor_push(writer->serializer, filestream_write_task, entry)) {
+		ast_atomic_fetch_sub(&writer->queued, entry->frame->datalen, __ATOMIC_RELAXED);
+		ast_frfree(entry->frame);
+		ao2_ref(fs, -1);
+		ast_free(entry);
+		return -1;
+	}
+	return 0;
+}
+
+static int filestream_drain_task(void *data)
+{
+	struct filestream_drain *drain = data;
+
+	ast_mutex_lock(&drain->lock);
+	drain->done = 1;
+	ast_cond_signal(&drain->cond);
+	ast_mutex_unlock(&drain->lock);
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Wait until the frames queued to the writer of a stream are written.
+ */
+static void filestream_writer_drain(struct ast_filestream *fs)
+{
+	struct filestream_drain drain = { .done = 0, };
+
+	if (!fs->writer || ast_taskprocessor_is_task(fs->writer->serializer)) {
+		return;
+	}
+
+	ast_mutex_init(&drain.lock);
+	ast_cond_init(&drain.cond, NULL);
+	if (!ast_taskprocessor_push(fs->writer->serializer, filestream_drain_task, &drain)) {
+		ast_mutex_lock(&drain.lock);
+		while (!drain.done) {
+			ast_cond_wait(&drain.cond, &drain.lock);
+		}
+		ast_mutex_unlock(&drain.lock);
+	}
+	ast_cond_destroy(&drain.cond);
+	ast_mutex_destroy(&drain.lock);
+}
+
+int ast_filestream_set_async(struct ast_filestream *fs, size_t buffer_size, unsigned int flush_ms)
+{
+	struct ast_filestream_writer *writer;
+	char tps_name[AST_TASKPROCESSOR_MAX_NAME + 1];
+	char *buf;
+
+	if (!file_writer_pool || !fs->f) {
+		return -1;
+	}
+	if (fs->writer) {
+		return 0;
+	}
+
+	writer = ast_calloc(1, sizeof(*writer));
+	if (!writer) {
+		return -1;
+	}
+	ast_taskprocessor_build_name(tps_name, sizeof(tps_name), "file_writer/%s", fs->fmt->name);
+	writer->serializer = ast_threadpool_serializer(tps_name, file_writer_pool);
+	if (!writer->serializer) {
+		ast_free(writer);
+		return -1;
+	}
+	writer->fs = fs;
+	writer->flush_ms = flush_ms;
+	writer->last_flush = ast_tvnow();
+
+	/* The buffer set by ast_writefile() is only replaced by a bigger one */
+	buffer_size = buffer_size ?: FILE_WRITER_BUFFER_SIZE;
+	if ((buf = ast_malloc(buffer_size))) {
+		fflush(fs->f);
+		setvbuf(fs->f, buf, _IOFBF, buffer_size);
+		ast_free(fs->write_buffer);
+		fs->write_buffer = buf;
+	}
+
+	fs->writer = writer;
+	AST_LIST_LOCK(&file_writers);
+	AST_LIST_INSERT_TAIL(&file_writers, writer, list);
+	AST_LIST_UNLOCK(&file_writers);
+	return 0;
+}
+
+int ast_writestream(struct ast_filestream *fs, struct ast_frame *f)
+{
+	if (f->frametype == AST_FRAME_VIDEO) {
+		if (ast_format_get_type(fs->fmt->format) == AST_MEDIA_TYPE_AUDIO) {
+			/* This is the audio portion.  Call the video one... */
+			if (!fs->vfs && fs->filename) {
+				const char *type = ast_format_get_name(f->subclass.format);
+				fs->vfs = ast_writefile(fs->filename, type, NULL, fs->flags, 0, fs->mode);
+				ast_debug(1, "Opened video output file\n");
+			}
+			if (fs->vfs)
+				return ast_writestream(fs->vfs, f);
+			/* else ignore */
+			return 0;
+		}
+	} else if (f->frametype != AST_FRAME_VOICE) {
+		ast_log(LOG_WARNING, "Tried to write non-voice frame\n");
+		return -1;
+	}
+	if (fs->writer) {
+		return filestream_writer_queue(fs, f);
+	}
+	return filestream_write_voice(fs, f);
+}
+
 static int copy(const char *infile, const char *outfile)
 {
 	int ifd, ofd, len;
@@ -352,6 +552,457 @@ static int type_in_list(const char *list, const char *type, int (*cmp)(const cha
  * \internal
  * \brief Close the file stream by canceling any pending read / write callbacks
  */
+/*! \brief Translated frame of a cached prompt */
+struct prompt_cache_frame {
+	int samples;
+	int datalen;
+	void *data;
+};
+
+/*! \brief Translated frames of one read of a cached prompt */
+struct prompt_cache_step {
+	/*! First frame of the step in the frames vector */
+	size_t first;
+	/*! Number of frames.  (0 if the translator held on to the samples) */
+	size_t count;
+	/*! Samples until the next read, as the file format reported them */
+	int whennext;
+	/*! File position after the read */
+	off_t offset;
+};
+
+/*! \brief What a prompt cache entry is looked up by */
+struct prompt_cache_key {
+	/*! Identity of the file.  Rewriting it makes for a new key. */
+	dev_t dev;
+	ino_t ino;
+	time_t mtime;
+	off_t size;
+	/*! Format of the file */
+	struct ast_format *src;
+	/*! Format the frames were translated to */
+	struct ast_format *dst;
+};
+
+/*! \brief A prompt translated to one format */
+struct ast_prompt_cache_entry {
+	struct prompt_cache_key key;
+	AST_VECTOR(, struct prompt_cache_frame) frames;
+	AST_VECTOR(, struct prompt_cache_step) steps;
+	/*! Memory held by the frames and steps */
+	size_t bytes;
+	/*! Number of playbacks served from the entry. (container lock) */
+	unsigned int hits;
+	/*! Set once the whole prompt is in the entry. (container lock) */
+	unsigned int complete:1;
+	/*! Set when the entry stopped being filled before the end. */
+	unsigned int abandoned:1;
+	/*! Complete entries, most recently played first. (container lock) */
+	AST_DLLIST_ENTRY(ast_prompt_cache_entry) lru;
+	/*! File name for the CLI */
+	char name[0];
+};
+
+#define PROMPT_CACHE_BUCKETS 61
+
+/*! Prompts translated to the formats of the channels playing them */
+static struct ao2_container *prompt_cache;
+
+/*! Complete entries of prompt_cache, least recently played last. (container lock) */
+static AST_DLLIST_HEAD_NOLOCK_STATIC(prompt_cache_lru, ast_prompt_cache_entry);
+
+/*! Memory held by the complete entries. (container lock) */
+static size_t prompt_cache_bytes;
+
+static int prompt_cache_hash(const void *obj, const int flags)
+{
+	const struct prompt_cache_key *key;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		key = obj;
+		break;
+	case OBJ_SEARCH_OBJECT:
+		key = &((const struct ast_prompt_cache_entry *) obj)->key;
+		break;
+	default:
+		ast_assert(0);
+		return 0;
+	}
+
+	return abs((int) (key->ino ^ key->size ^ ast_format_get_codec_id(key->dst)));
+}
+
+static int prompt_cache_cmp(void *obj, void *arg, int flags)
+{
+	const struct ast_prompt_cache_entry *entry = obj;
+	const struct prompt_cache_key *key;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		key = arg;
+		break;
+	case OBJ_SEARCH_OBJECT:
+		key = &((const struct ast_prompt_cache_entry *) arg)->key;
+		break;
+	default:
+		ast_assert(0);
+		return 0;
+	}
+
+	if (entry->key.dev != key->dev || entry->key.ino != key->ino
+		|| entry->key.mtime != key->mtime || entry->key.size != key->size
+		|| ast_format_cmp(entry->key.src, key->src) != AST_FORMAT_CMP_EQUAL
+		|| ast_format_cmp(entry->key.dst, key->dst) != AST_FORMAT_CMP_EQUAL) {
+		return 0;
+	}
+
+	return CMP_MATCH;
+}
+
+static void prompt_cache_frames_free(struct ast_prompt_cache_entry *entry)
+{
+	size_t idx;
+
+	for (idx = 0; idx < AST_VECTOR_SIZE(&entry->frames); ++idx) {
+		ast_free(AST_VECTOR_GET_ADDR(&entry->frames, idx)->data);
+	}
+	AST_VECTOR_RESET(&entry->frames, AST_VECTOR_ELEM_CLEANUP_NOOP);
+	AST_VECTOR_RESET(&entry->steps, AST_VECTOR_ELEM_CLEANUP_NOOP);
+	entry->bytes = 0;
+}
+
+static void prompt_cache_entry_destructor(void *obj)
+{
+	struct ast_prompt_cache_entry *entry = obj;
+
+	prompt_cache_frames_free(entry);
+	AST_VECTOR_FREE(&entry->frames);
+	AST_VECTOR_FREE(&entry->steps);
+	ao2_cleanup(entry->key.src);
+	ao2_cleanup(entry->key.dst);
+}
+
+/*!
+ * \internal
+ * \brief Drop least recently played entries until the cache fits its cap.
+ *
+ * \note The prompt_cache container must be locked.
+ */
+static void prompt_cache_trim(size_t cap)
+{
+	struct ast_prompt_cache_entry *entry;
+
+	while (prompt_cache_bytes > cap && (entry = AST_DLLIST_REMOVE_TAIL(&prompt_cache_lru, lru))) {
+		prompt_cache_bytes -= entry->bytes;
+		ast_debug(3, "Dropping %s as %s from the prompt cache\n",
+			entry->name, ast_format_get_name(entry->key.dst));
+		/* Streams still playing the entry keep it until they are done */
+		ao2_unlink_flags(prompt_cache, entry, OBJ_NOLOCK);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Stop filling an entry that cannot be completed.
+ *
+ * \note The stream keeps translating with its own translator so the
+ * channel does not hear the change.
+ */
+static void prompt_cache_abandon(struct ast_filestream *s)
+{
+	struct ast_prompt_cache_entry *entry = s->cache_entry;
+
+	if (entry->abandoned) {
+		return;
+	}
+	entry->abandoned = 1;
+	ao2_unlink(prompt_cache, entry);
+	prompt_cache_frames_free(entry);
+}
+
+/*!
+ * \internal
+ * \brief Look for a playback of the stream in the prompt cache.
+ *
+ * \details A stream starting at the beginning of a file in a format the
+ * channel cannot take either plays a complete cache entry or fills a
+ * new one as it goes.
+ */
+static void prompt_cache_start(struct ast_filestream *s)
+{
+	struct ast_prompt_cache_entry *entry;
+	struct prompt_cache_key key;
+	struct stat st;
+	struct ast_format *dst;
+
+	s->cache_checked = 1;
+	if (!ast_option_prompt_cache_size || !prompt_cache || !s->f || !s->open_filename) {
+		return;
+	}
+	/* Only whole prompts go into the cache */
+	if (s->fmt->tell(s) || fstat(fileno(s->f), &st) || !S_ISREG(st.st_mode)) {
+		return;
+	}
+
+	ast_channel_lock(s->owner);
+	dst = ao2_bump(ast_channel_rawwriteformat(s->owner));
+	ast_channel_unlock(s->owner);
+	if (!dst || ast_format_cmp(dst, s->fmt->format) != AST_FORMAT_CMP_NOT_EQUAL) {
+		/* Nothing to translate */
+		ao2_cleanup(dst);
+		return;
+	}
+
+	key.dev = st.st_dev;
+	key.ino = st.st_ino;
+	key.mtime = st.st_mtime;
+	key.size = st.st_size;
+	key.src = s->fmt->format;
+	key.dst = dst;
+
+	ao2_lock(prompt_cache);
+	entry = ao2_find(prompt_cache, &key, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if (entry) {
+		if (entry->complete) {
+			++entry->hits;
+			AST_DLLIST_REMOVE(&prompt_cache_lru, entry, lru);
+			AST_DLLIST_INSERT_HEAD(&prompt_cache_lru, entry, lru);
+			s->cache_entry = entry;
+			s->cache_step = 0;
+		} else {
+			/* Another playback is still filling it */
+			ao2_ref(entry, -1);
+		}
+		ao2_unlock(prompt_cache);
+		ao2_ref(dst, -1);
+		return;
+	}
+
+	entry = ao2_alloc_options(sizeof(*entry) + strlen(s->open_filename) + 1,
+		prompt_cache_entry_destructor, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!entry || AST_VECTOR_INIT(&entry->frames, 64) || AST_VECTOR_INIT(&entry->steps, 64)) {
+		ao2_unlock(prompt_cache);
+		ao2_cleanup(entry);
+		ao2_ref(dst, -1);
+		return;
+	}
+	entry->key = key;
+	entry->key.src = ao2_bump(s->fmt->format);
+	/* The entry takes over the dst reference */
+	strcpy(entry->name, s->open_filename); /* Safe */
+	ao2_link_flags(prompt_cache, entry, OBJ_NOLOCK);
+	ao2_unlock(prompt_cache);
+
+	s->cache_trans = ast_translator_build_path(entry->key.dst, entry->key.src);
+	if (!s->cache_trans) {
+		ao2_unlink(prompt_cache, entry);
+		ao2_ref(entry, -1);
+		return;
+	}
+	s->cache_entry = entry;
+}
+
+/*!
+ * \internal
+ * \brief Write a translated frame to the channel.
+ *
+ * \note The frame is copied because audiohooks may change the frames
+ * written in place.
+ */
+static int prompt_cache_write(struct ast_filestream *s, const struct ast_frame *f)
+{
+	struct ast_frame *dup;
+	int res;
+
+	dup = ast_frdup(f);
+	if (!dup) {
+		return -1;
+	}
+	res = ast_write(s->owner, dup);
+	ast_frfree(dup);
+
+	return res;
+}
+
+static int prompt_cache_write_step(struct ast_filestream *s, const struct prompt_cache_step *step)
+{
+	struct ast_prompt_cache_entry *entry = s->cache_entry;
+	size_t idx;
+
+	for (idx = step->first; idx < step->first + step->count; ++idx) {
+		const struct prompt_cache_frame *frame = AST_VECTOR_GET_ADDR(&entry->frames, idx);
+		struct ast_frame f = {
+			.frametype = AST_FRAME_VOICE,
+			.samples = frame->samples,
+			.datalen = frame->datalen,
+			.src = "prompt_cache",
+		};
+
+		f.subclass.format = entry->key.dst;
+		f.data.ptr = frame->data;
+		if (prompt_cache_write(s, &f)) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Add the frames translated from one read to an entry.
+ *
+ * \retval 0 on success.
+ * \retval -1 on memory allocation failure.
+ */
+static int prompt_cache_store(struct ast_prompt_cache_entry *entry, struct ast_frame *out,
+	int whennext, off_t offset)
+{
+	struct prompt_cache_step step = {
+		.first = AST_VECTOR_SIZE(&entry->frames),
+		.whennext = whennext,
+		.offset = offset,
+	};
+	struct ast_frame *cur;
+
+	for (cur = out; cur; cur = AST_LIST_NEXT(cur, frame_list)) {
+		struct prompt_cache_frame frame = {
+			.samples = cur->samples,
+			.datalen = cur->datalen,
+		};
+
+		if (!(frame.data = ast_malloc(cur->datalen ?: 1))) {
+			return -1;
+		}
+		memcpy(frame.data, cur->data.ptr, cur->datalen);
+		if (AST_VECTOR_APPEND(&entry->frames, frame)) {
+			ast_free(frame.data);
+			return -1;
+		}
+		entry->bytes += sizeof(frame) + cur->datalen;
+		++step.count;
+	}
+	if (AST_VECTOR_APPEND(&entry->steps, step)) {
+		return -1;
+	}
+	entry->bytes += sizeof(step);
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Translate a frame read from the file for the channel and the cache.
+ *
+ * \retval 0 on success.
+ * \retval -1 if the channel could not take the frames.
+ */
+static int prompt_cache_fill(struct ast_filestream *s, struct ast_frame *fr, int whennext)
+{
+	struct ast_prompt_cache_entry *entry = s->cache_entry;
+	struct ast_frame *out;
+	struct ast_frame *cur;
+	int res = 0;
+
+	out = ast_translate(s->cache_trans, fr, 0);
+	if (!entry->abandoned) {
+		if (prompt_cache_store(entry, out, whennext, s->fmt->tell(s))) {
+			prompt_cache_abandon(s);
+		} else if (entry->bytes > ast_option_prompt_cache_size * 1024) {
+			ast_debug(3, "%s is too large for the prompt cache\n", entry->name);
+			prompt_cache_abandon(s);
+		}
+	}
+
+	for (cur = out; cur && !res; cur = AST_LIST_NEXT(cur, frame_list)) {
+		res = prompt_cache_write(s, cur);
+	}
+	ast_frfree(out);
+
+	return res;
+}
+
+/*!
+ * \internal
+ * \brief Play the next step of a cached prompt.
+ *
+ * \retval 0 on success.
+ * \retval -1 at the end of the prompt or if the channel could not take the frames.
+ */
+static int prompt_cache_play(struct ast_filestream *s, int *whennext)
+{
+	const struct prompt_cache_step *step;
+
+	if (s->cache_step >= AST_VECTOR_SIZE(&s->cache_entry->steps)) {
+		return -1;
+	}
+	step = AST_VECTOR_GET_ADDR(&s->cache_entry->steps, s->cache_step++);
+	*whennext = step->whennext;
+
+	return prompt_cache_write_step(s, step);
+}
+
+/*!
+ * \internal
+ * \brief Finish filling a cache entry at the end of the file.
+ */
+static void prompt_cache_finish(struct ast_filestream *s)
+{
+	struct ast_prompt_cache_entry *entry = s->cache_entry;
+
+	if (!entry->abandoned) {
+		ao2_lock(prompt_cache);
+		entry->complete = 1;
+		AST_DLLIST_INSERT_HEAD(&prompt_cache_lru, entry, lru);
+		prompt_cache_bytes += entry->bytes;
+		prompt_cache_trim(ast_option_prompt_cache_size * 1024);
+		ao2_unlock(prompt_cache);
+	}
+
+	ast_translator_free_path(s->cache_trans);
+	s->cache_trans = NULL;
+	ao2_ref(entry, -1);
+	s->cache_entry = NULL;
+}
+
+/*!
+ * \internal
+ * \brief File position of a stream playing a cached prompt.
+ */
+static off_t prompt_cache_tell(struct ast_filestream *s)
+{
+	if (!s->cache_step) {
+		return 0;
+	}
+
+	return AST_VECTOR_GET_ADDR(&s->cache_entry->steps, s->cache_step - 1)->offset;
+}
+
+/*!
+ * \internal
+ * \brief Make the file itself the source of the stream again.
+ *
+ * \details Needed before the stream position changes since the cache
+ * only replays a prompt from start to end.
+ */
+static void prompt_cache_stop(struct ast_filestream *s)
+{
+	if (!s->cache_entry) {
+		return;
+	}
+
+	if (s->cache_trans) {
+		prompt_cache_abandon(s);
+		return;
+	}
+
+	/* Carry on reading the file where the cache left off */
+	s->fmt->seek(s, prompt_cache_tell(s), SEEK_SET);
+	ao2_ref(s->cache_entry, -1);
+	s->cache_entry = NULL;
+}
+
 static void filestream_close(struct ast_filestream *f)
 {
 	enum ast_media_type format_type = ast_format_get_type(f->fmt->format);
@@ -387,15 +1038,34 @@ static void filestream_destructor(void *arg)
 	/* Stop a running stream if there is one */
 	filestream_close(f);
 
+	if (f->writer) {
+		AST_LIST_LOCK(&file_writers);
+		AST_LIST_REMOVE(&file_writers, f->writer, list);
+		AST_LIST_UNLOCK(&file_writers);
+		ast_taskprocessor_unreference(f->writer->serializer);
+		ast_free(f->writer);
+	}
+
 	/* destroy the translator on exit */
 	if (f->trans)
 		ast_translator_free_path(f->trans);
 
+	if (f->cache_trans) {
+		/* Stopped before the end of the file */
+		prompt_cache_abandon(f);
+		ast_translator_free_path(f->cache_trans);
+	}
+	ao2_cleanup(f->cache_entry);
+
 	if (f->fmt->close) {
 		void (*closefn)(struct ast_filestream *) = f->fmt->close;
 		closefn(f);
 	}
 
+	if (f->map) {
+		munmap(f->map, f->map_size);
+	}
+
 	if (f->f) {
 		fclose(f->f);
 	}
@@ -414,6 +1084,7 @@ static void filestream_destructor(void *arg)
 
 	ast_free(f->filename);
 	ast_free(f->realfilename);
+	ast_free(f->open_filename);
 	if (f->vfs)
 		ast_closestream(f->vfs);
 	ast_free(f->write_buffer);
@@ -457,6 +1128,65 @@ static struct ast_filestream *get_filestream(struct ast_format_def *fmt, FILE *b
 	return s;
 }
 
+int ast_filestream_map(struct ast_filestream *s, off_t len)
+{
+	struct stat st;
+	off_t start;
+	void *map;
+
+	if (!ast_opt_mmap_sound_files || s->map) {
+		return -1;
+	}
+
+	if ((start = ftello(s->f)) < 0 || fstat(fileno(s->f), &st)
+		|| !S_ISREG(st.st_mode) || st.st_size <= start) {
+		return -1;
+	}
+
+	/*
+	 * Private and writable since whoever gets the frames may change
+	 * them in place.  Only the pages changed stop being shared.
+	 */
+	map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(s->f), 0);
+	if (map == MAP_FAILED) {
+		ast_debug(1, "Unable to map %s: %s\n", s->open_filename ?: s->fmt->name, strerror(errno));
+		return -1;
+	}
+
+	s->map = map;
+	s->map_size = st.st_size;
+	s->map_start = s->map_pos = start;
+	s->map_end = (len < 0 || len > st.st_size - start) ? st.st_size : start + len;
+
+	return 0;
+}
+
+struct ast_frame *ast_filestream_map_read(struct ast_filestream *s, int bytes)
+{
+	if (s->map_pos >= s->map_end) {
+		return NULL;
+	}
+
+	if (bytes > s->map_end - s->map_pos) {
+		bytes = s->map_end - s->map_pos;
+	}
+
+	/* What precedes the data is audio already played, not room for headers */
+	s->fr.data.ptr = s->map + s->map_pos;
+	s->fr.offset = 0;
+	s->fr.datalen = bytes;
+	s->map_pos += bytes;
+
+	return &s->fr;
+}
+
+int ast_filestream_map_seek(struct ast_filestream *s, off_t offset)
+{
+	s->map_pos = MIN(MAX(offset, s->map_start), s->map_end);
+
+	return 0;
+}
+
 /*
  * Default implementations of open and rewrite.
  * Only use them if you don't have expensive stuff to do.
@@ -576,6 +1306,7 @@ static int filehelper(const char *filename, const void *arg2, const char *fmt, c
 				s->fmt = f;
 				s->trans = NULL;
 				s->filename = NULL;
+				s->open_filename = ast_strdup(fn);
 				if (ast_format_get_type(s->fmt->format) == AST_MEDIA_TYPE_AUDIO) {
 					if (ast_channel_stream(chan))
 						ast_closestream(ast_channel_stream(chan));
@@ -905,6 +1636,10 @@ static enum fsread_res ast_readaudio_callback(struct ast_filestream *s)
 {
 	int whennext = 0;
 
+	if (!s->cache_checked) {
+		prompt_cache_start(s);
+	}
+
 	while (!whennext) {
 		struct ast_frame *fr;
 
@@ -912,7 +1647,37 @@ static enum fsread_res ast_readaudio_callback(struct ast_filestream *s)
 			goto return_failure;
 		}
 
-		fr = read_frame(s, &whennext);
+		if (s->cache_entry && !s->cache_trans) {
+			if (prompt_cache_play(s, &whennext)) {
+				goto return_failure;
+			}
+			continue;
+		}
+
+		if (s->map && !ast_channel_audiohooks(s->owner)) {
+			/*
+			 * Written before the next read so the frame can keep
+			 * pointing into the mapping.  Audiohooks may change it in
+			 * place though, which would stick to the mapped audio.
+			 */
+			fr = s->fmt->read(s, &whennext);
+		} else {
+			fr = read_frame(s, &whennext);
+		}
+
+		if (s->cache_trans) {
+			if (!fr) {
+				prompt_cache_finish(s);
+				goto return_failure;
+			}
+			if (prompt_cache_fill(s, fr, whennext)) {
+				ast_debug(2, "Failed to write frame\n");
+				ast_frfree(fr);
+				goto return_failure;
+			}
+			ast_frfree(fr);
+			continue;
+		}
 
 		if (!fr /* stream complete */ || ast_write(s->owner, fr) /* error writing */) {
 			if (fr) {
@@ -1027,16 +1792,23 @@ int ast_playstream(struct ast_filestream *s)
 
 int ast_seekstream(struct ast_filestream *fs, off_t sample_offset, int whence)
 {
+	prompt_cache_stop(fs);
+	filestream_writer_drain(fs);
 	return fs->fmt->seek(fs, sample_offset, whence);
 }
 
 int ast_truncstream(struct ast_filestream *fs)
 {
+	filestream_writer_drain(fs);
 	return fs->fmt->trunc(fs);
 }
 
 off_t ast_tellstream(struct ast_filestream *fs)
 {
+	filestream_writer_drain(fs);
+	if (fs->cache_entry && !fs->cache_trans) {
+		return prompt_cache_tell(fs);
+	}
 	return fs->fmt->tell(fs);
 }
 
@@ -1065,6 +1837,7 @@ int ast_closestream(struct ast_filestream *f)
 		return 0;
 	}
 	filestream_close(f);
+	filestream_writer_drain(f);
 	ao2_ref(f, -1);
 	return 0;
 }
@@ -1948,13 +2721,114 @@ int ast_get_extension_for_mime_type(const char *mime_type, char *buffer, size_t
 	return 0;
 }
 
+static char *handle_cli_core_show_prompt_cache(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+#define FORMAT "%-50.50s %-10.10s %10s %8s\n"
+#define FORMAT2 "%-50.50s %-10.10s %10zu %8u\n"
+	struct ast_prompt_cache_entry *entry;
+	int count = 0;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "core show prompt cache";
+		e->usage =
+			"Usage: core show prompt cache\n"
+			"       Displays the sound files kept translated in memory,\n"
+			"       most recently played first.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 4) {
+		return CLI_SHOWUSAGE;
+	}
+
+	if (!ast_option_prompt_cache_size) {
+		ast_cli(a->fd, "The prompt cache is disabled by prompt_cache_size in asterisk.conf.\n");
+		return CLI_SUCCESS;
+	}
+
+	ast_cli(a->fd, FORMAT, "File", "Format", "Bytes", "Hits");
+	ao2_lock(prompt_cache);
+	AST_DLLIST_TRAVERSE(&prompt_cache_lru, entry, lru) {
+		ast_cli(a->fd, FORMAT2, entry->name, ast_format_get_name(entry->key.dst),
+			entry->bytes, entry->hits);
+		++count;
+	}
+	ast_cli(a->fd, "%d cached prompts using %zu of %u KiB.\n", count,
+		prompt_cache_bytes / 1024, ast_option_prompt_cache_size);
+	ao2_unlock(prompt_cache);
+
+	return CLI_SUCCESS;
+#undef FORMAT
+#undef FORMAT2
+}
+
+static char *handle_cli_core_show_file_writers(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+#define FORMAT "%-60.60s %10s %8s\n"
+#define FORMAT2 "%-60.60s %10zu %8u\n"
+	struct ast_filestream_writer *writer;
+	size_t queued = 0;
+	int count = 0;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "core show file writers";
+		e->usage =
+			"Usage: core show file writers\n"
+			"       Displays the files written in the background, the bytes\n"
+			"       queued to be written to each and the frames dropped.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 4) {
+		return CLI_SHOWUSAGE;
+	}
+
+	if (!file_writer_pool) {
+		ast_cli(a->fd, "Writing files in the background is disabled by file_writer_threads in asterisk.conf.\n");
+		return CLI_SUCCESS;
+	}
+
+	ast_cli(a->fd, FORMAT, "File", "Queued", "Dropped");
+	AST_LIST_LOCK(&file_writers);
+	AST_LIST_TRAVERSE(&file_writers, writer, list) {
+		size_t bytes = ast_atomic_load_n(&writer->queued, __ATOMIC_RELAXED);
+
+		ast_cli(a->fd, FORMAT2, writer->fs->filename, bytes, writer->dropped);
+		queued += bytes;
+		++count;
+	}
+	AST_LIST_UNLOCK(&file_writers);
+	ast_cli(a->fd, "%d files with %zu bytes queued.\n", count, queued);
+
+	return CLI_SUCCESS;
+#undef FORMAT
+#undef FORMAT2
+}
+
 static struct ast_cli_entry cli_file[] = {
-	AST_CLI_DEFINE(handle_cli_core_show_file_formats, "Displays file formats")
+	AST_CLI_DEFINE(handle_cli_core_show_file_formats, "Displays file formats"),
+	AST_CLI_DEFINE(handle_cli_core_show_prompt_cache, "Displays the translated prompt cache"),
+	AST_CLI_DEFINE(handle_cli_core_show_file_writers, "Displays the files written in the background"),
 };
 
 static void file_shutdown(void)
 {
 	ast_cli_unregister_multiple(cli_file, ARRAY_LEN(cli_file));
+	if (prompt_cache) {
+		ao2_lock(prompt_cache);
+		prompt_cache_trim(0);
+		ao2_unlock(prompt_cache);
+		ao2_ref(prompt_cache, -1);
+		prompt_cache = NULL;
+	}
+	ast_threadpool_shutdown(file_writer_pool);
+	file_writer_pool = NULL;
 	STASIS_MESSAGE_TYPE_CLEANUP(ast_format_register_type);
 	STASIS_MESSAGE_TYPE_CLEANUP(ast_format_unregister_type);
 }
@@ -1963,6 +2837,25 @@ int ast_file_init(void)
 {
 	STASIS_MESSAGE_TYPE_INIT(ast_format_register_type);
 	STASIS_MESSAGE_TYPE_INIT(ast_format_unregister_type);
+	prompt_cache = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0,
+		PROMPT_CACHE_BUCKETS, prompt_cache_hash, NULL, prompt_cache_cmp);
+	if (!prompt_cache) {
+		return -1;
+	}
+	if (ast_option_file_writer_threads) {
+		struct ast_threadpool_options options = {
+			.version = AST_THREADPOOL_OPTIONS_VERSION,
+			.auto_increment = 1,
+			.max_size = ast_option_file_writer_threads,
+			.idle_timeout = 60,
+			.initial_size = 0,
+		};
+
+		file_writer_pool = ast_threadpool_create("file_writer", NULL, &options);
+		if (!file_writer_pool) {
+			return -1;
+		}
+	}
 	ast_cli_register_multiple(cli_file, ARRAY_LEN(cli_file));
 	ast_register_cleanup(file_shutdown);
 	return 0;
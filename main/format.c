@@ -160,7 +160,7 @@ struct ast_format *ast_format_create_named(const char *format_name, struct ast_c
 	struct format_interface *format_interface;
 
 	format = ao2_t_alloc_options(sizeof(*format), format_destroy,
-		AO2_ALLOC_OPT_LOCK_NOLOCK, S_OR(codec->description, ""));
+		AO2_ALLOC_OPT_LOCK_NOLOCK | AO2_ALLOC_OPT_REF_SHARDED, S_OR(codec->description, ""));
 	if (!format) {
 		return NULL;
 	}
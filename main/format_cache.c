@@ -307,9 +307,18 @@ static int format_cmp_cb(void *obj, void *arg, int flags)
 	return CMP_MATCH;
 }
 
+static int format_unshard_cb(void *obj, void *arg, int flags)
+{
+	ao2_ref_unshard(obj);
+	return 0;
+}
+
 /*! \brief Function called when the process is shutting down */
 static void format_cache_shutdown(void)
 {
+	if (formats) {
+		ao2_callback(formats, OBJ_NODATA, format_unshard_cb, NULL);
+	}
 	ao2_cleanup(formats);
 	formats = NULL;
 
@@ -363,7 +372,8 @@ static void format_cache_shutdown(void)
 
 int ast_format_cache_init(void)
 {
-	formats = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_RWLOCK, 0, CACHE_BUCKETS,
+	formats = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_RWLOCK,
+		AO2_CONTAINER_ALLOC_OPT_READ_MOSTLY, CACHE_BUCKETS,
 		format_hash_cb, NULL, format_cmp_cb);
 	if (!formats) {
 		return -1;
@@ -487,6 +497,8 @@ int ast_format_cache_set(struct ast_format *format)
 		ao2_unlink_flags(formats, old_format, OBJ_NOLOCK);
 	}
 	ao2_link_flags(formats, format, OBJ_NOLOCK);
+	/* Cached formats are referenced for every frame from every thread. */
+	ao2_ref_shard(format);
 
 	set_cached_format(ast_format_get_name(format), format);
 
@@ -494,7 +506,10 @@ int ast_format_cache_set(struct ast_format *format)
 		old_format ? "Updated" : "Created",
 		ast_format_get_name(format));
 
-	ao2_cleanup(old_format);
+	if (old_format) {
+		ao2_ref_unshard(old_format);
+		ao2_ref(old_format, -1);
+	}
 
 	return 0;
 }
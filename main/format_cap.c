@@ -40,6 +40,11 @@
 #include "asterisk/linkedlists.h"
 #include "asterisk/utils.h"
 
+/*! \brief Number of 64 bit words in the codec identifier bitmap */
+#define FORMAT_CAP_MAP_WORDS 4
+/*! \brief Codec identifiers below this are tracked by the bitmap */
+#define FORMAT_CAP_MAP_BITS (FORMAT_CAP_MAP_WORDS * 64)
+
 /*! \brief Structure used for capability formats, adds framing */
 struct format_cap_framed {
 	/*! \brief A pointer to the format */
@@ -58,6 +63,15 @@ struct ast_format_cap {
 	AST_VECTOR(, struct format_cap_framed *) preference_order;
 	/*! \brief Global framing size, applies to all formats if no framing present on format */
 	unsigned int framing;
+	/*!
+	 * \brief Bitmap of the codec identifiers present in formats
+	 *
+	 * Lets two capabilities structures be checked for any overlap without
+	 * walking either of them.
+	 */
+	uint64_t codec_map[FORMAT_CAP_MAP_WORDS];
+	/*! \brief Set once a codec identifier too large for codec_map has been added */
+	unsigned int codec_map_overflow:1;
 };
 
 /*! \brief Linked list for formats */
@@ -66,6 +80,48 @@ AST_LIST_HEAD_NOLOCK(format_cap_framed_list, format_cap_framed);
 /*! \brief Dummy empty list for when we are inserting a new list */
 static const struct format_cap_framed_list format_cap_framed_list_empty = AST_LIST_HEAD_NOLOCK_INIT_VALUE;
 
+/*! \brief Mark a codec identifier as present in the bitmap */
+static inline void format_cap_map_set(struct ast_format_cap *cap, unsigned int id)
+{
+	if (id < FORMAT_CAP_MAP_BITS) {
+		cap->codec_map[id / 64] |= (uint64_t) 1 << (id % 64);
+	} else {
+		cap->codec_map_overflow = 1;
+	}
+}
+
+/*! \brief Clear a codec identifier from the bitmap if no format for it remains */
+static inline void format_cap_map_update(struct ast_format_cap *cap, unsigned int id)
+{
+	if (id < FORMAT_CAP_MAP_BITS
+		&& AST_LIST_EMPTY(AST_VECTOR_GET_ADDR(&cap->formats, id))) {
+		cap->codec_map[id / 64] &= ~((uint64_t) 1 << (id % 64));
+	}
+}
+
+/*!
+ * \brief Determine if two capabilities structures may have a codec in common
+ *
+ * \retval 0 if they definitely do not
+ * \retval 1 if they might, the formats themselves need to be compared
+ */
+static inline int format_cap_map_overlaps(const struct ast_format_cap *cap1, const struct ast_format_cap *cap2)
+{
+	int i;
+
+	if (cap1->codec_map_overflow || cap2->codec_map_overflow) {
+		return 1;
+	}
+
+	for (i = 0; i < FORMAT_CAP_MAP_WORDS; i++) {
+		if (cap1->codec_map[i] & cap2->codec_map[i]) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
 /*! \brief Destructor for format capabilities structure */
 static void format_cap_destroy(void *obj)
 {
@@ -169,27 +225,24 @@ static inline int format_cap_framed_init(struct format_cap_framed *framed, struc
 	/* Order doesn't matter for formats, so insert at the head for performance reasons */
 	ao2_ref(framed, +1);
 	AST_LIST_INSERT_HEAD(list, framed, entry);
+	format_cap_map_set(cap, ast_format_get_codec_id(format));
 
 	cap->framing = MIN(cap->framing, framing ? framing : ast_format_get_default_ms(format));
 
 	return 0;
 }
 
-/*! \internal \brief Determine if \c format is in \c cap */
-static int format_in_format_cap(struct ast_format_cap *cap, struct ast_format *format)
+/*! \internal \brief Determine if a format with the same codec as \c format is in \c cap */
+static int format_in_format_cap(const struct ast_format_cap *cap, const struct ast_format *format)
 {
-	struct format_cap_framed *framed;
-	int i;
-
-	for (i = 0; i < AST_VECTOR_SIZE(&cap->preference_order); i++) {
-		framed = AST_VECTOR_GET(&cap->preference_order, i);
+	unsigned int id = ast_format_get_codec_id(format);
 
-		if (ast_format_get_codec_id(format) == ast_format_get_codec_id(framed->format)) {
-			return 1;
-		}
+	if (id < FORMAT_CAP_MAP_BITS) {
+		return (cap->codec_map[id / 64] >> (id % 64)) & 1;
 	}
 
-	return 0;
+	return id < AST_VECTOR_SIZE(&cap->formats)
+		&& !AST_LIST_EMPTY(AST_VECTOR_GET_ADDR(&cap->formats, id));
 }
 
 int __ast_format_cap_append(struct ast_format_cap *cap, struct ast_format *format, unsigned int framing, const char *tag, const char *file, int line, const char *func)
@@ -517,6 +570,7 @@ int ast_format_cap_remove(struct ast_format_cap *cap, struct ast_format *format)
 		break;
 	}
 	AST_LIST_TRAVERSE_SAFE_END;
+	format_cap_map_update(cap, ast_format_get_codec_id(format));
 
 	return AST_VECTOR_REMOVE_CMP_ORDERED(&cap->preference_order, format,
 		FORMAT_CAP_FRAMED_ELEM_CMP, FORMAT_CAP_FRAMED_ELEM_CLEANUP);
@@ -542,6 +596,7 @@ void ast_format_cap_remove_by_type(struct ast_format_cap *cap, enum ast_media_ty
 			ao2_ref(framed, -1);
 		}
 		AST_LIST_TRAVERSE_SAFE_END;
+		format_cap_map_update(cap, idx);
 	}
 }
 
@@ -632,10 +687,18 @@ int ast_format_cap_get_compatible(const struct ast_format_cap *cap1, const struc
 {
 	int idx, res = 0;
 
+	if (!format_cap_map_overlaps(cap1, cap2)) {
+		return 0;
+	}
+
 	for (idx = 0; idx < AST_VECTOR_SIZE(&cap1->preference_order); ++idx) {
 		struct format_cap_framed *framed = AST_VECTOR_GET(&cap1->preference_order, idx);
 		struct ast_format *format;
 
+		if (!format_in_format_cap(cap2, framed->format)) {
+			continue;
+		}
+
 		format = ast_format_cap_get_compatible_format(cap2, framed->format);
 		if (!format) {
 			continue;
@@ -656,6 +719,10 @@ int ast_format_cap_iscompatible(const struct ast_format_cap *cap1, const struct
 {
 	int idx;
 
+	if (!format_cap_map_overlaps(cap1, cap2)) {
+		return 0;
+	}
+
 	for (idx = 0; idx < AST_VECTOR_SIZE(&cap1->preference_order); ++idx) {
 		struct format_cap_framed *framed = AST_VECTOR_GET(&cap1->preference_order, idx);
 
@@ -692,6 +759,11 @@ int ast_format_cap_identical(const struct ast_format_cap *cap1, const struct ast
 		return 0; /* if they are not the same size, they are not identical */
 	}
 
+	if (!cap1->codec_map_overflow && !cap2->codec_map_overflow
+		&& memcmp(cap1->codec_map, cap2->codec_map, sizeof(cap1->codec_map))) {
+		return 0; /* if they do not hold the same codecs, they are not identical */
+	}
+
 	if (!internal_format_cap_identical(cap1, cap2)) {
 		return 0;
 	}
@@ -42,109 +42,346 @@
 #include "asterisk/translate.h"
 #include "asterisk/dsp.h"
 #include "asterisk/file.h"
+#include "asterisk/media_trace.h"
 
 #if !defined(LOW_MEMORY)
-static void frame_cache_cleanup(void *data);
+/*!
+ * \brief Usable sizes of the frame slab block classes
+ *
+ * A block holds the ast_frame header, AST_FRIENDLY_OFFSET, the payload and
+ * the source string when a frame is duplicated, so the classes are picked
+ * to leave a bare header, or 20ms of ulaw/alaw, opus, or signed linear at
+ * 8, 16 and 48kHz each in a class of its own.
+ */
+static const size_t frame_slab_sizes[] = { 256, 512, 640, 1024, 2304 };
+
+#define FRAME_SLAB_CLASSES ARRAY_LEN(frame_slab_sizes)
 
-/*! \brief A per-thread cache of frame headers */
-AST_THREADSTORAGE_CUSTOM(frame_cache, NULL, frame_cache_cleanup);
+/*! \brief Number of blocks carved out of each chunk a slab allocates */
+#define FRAME_SLAB_CHUNK_BLOCKS 16
 
 /*!
- * \brief Maximum ast_frame cache size
+ * \brief Maximum number of chunks a thread's slab allocates per class
  *
- * In most cases where the frame header cache will be useful, the size
- * of the cache will stay very small.  However, it is not always the case that
- * the same thread that allocates the frame will be the one freeing them, so
- * sometimes a thread will never have any frames in its cache, or the cache
- * will never be pulled from.  For the latter case, we limit the maximum size.
+ * Slab memory is only returned when the thread exits, so a thread that
+ * once had a burst of frames outstanding does not keep growing its slab.
+ * Allocations past the limit fall back to the heap.
  */
-#define FRAME_CACHE_MAX_SIZE	10
+#define FRAME_SLAB_MAX_CHUNKS 16
+
+struct frame_slab;
+
+/*! \brief Header in front of every frame slab block */
+struct frame_slab_block {
+	/*! The slab the block was carved from */
+	struct frame_slab *slab;
+	/*! Next block on a free list */
+	struct frame_slab_block *next;
+	/*! Size class of the block */
+	size_t cls;
+	/*! The usable memory of the block */
+	char data[0];
+};
 
-/*! \brief This is just so ast_frames, a list head struct for holding a list of
- *  ast_frame structures, is defined. */
-AST_LIST_HEAD_NOLOCK(ast_frames, ast_frame);
+/*! \brief Memory the blocks of a slab are carved from */
+struct frame_slab_chunk {
+	struct frame_slab_chunk *next;
+	char blocks[0];
+};
 
-struct ast_frame_cache {
-	struct ast_frames list;
-	size_t size;
+struct frame_slab_stats {
+	/*! Allocations served from a free list */
+	unsigned long hits;
+	/*! Allocations that needed a new chunk */
+	unsigned long misses;
+	/*! Allocations that fell back to the heap */
+	unsigned long fallbacks;
+	/*! Blocks freed by another thread */
+	unsigned long remote_frees;
 };
-#endif
 
-struct ast_frame ast_null_frame = { AST_FRAME_NULL, };
+struct frame_slab_class {
+	/*! Free blocks, only used by the owning thread */
+	struct frame_slab_block *free;
+	/*! Blocks freed by other threads, protected by the slab lock */
+	struct frame_slab_block *remote;
+	/*! Chunks allocated for the class */
+	unsigned int chunks;
+	struct frame_slab_stats stats;
+};
 
-static struct ast_frame *ast_frame_header_new(void)
+/*!
+ * \brief A per-thread slab of frame headers and payload buffers
+ *
+ * Only the owning thread allocates from the slab.  Blocks freed by the
+ * owning thread go straight back on its free list, blocks freed by other
+ * threads are handed back through the remote list and reclaimed by the
+ * owner once its free list runs dry.  When the owning thread exits while
+ * blocks are still out, the slab is orphaned and released by whichever
+ * thread frees the last of them.
+ */
+struct frame_slab {
+	ast_mutex_t lock;
+	struct frame_slab_class classes[FRAME_SLAB_CLASSES];
+	struct frame_slab_chunk *chunks;
+	/*! Number of blocks handed out and not freed yet */
+	int outstanding;
+	/*! The owning thread has exited */
+	unsigned int orphaned:1;
+	AST_LIST_ENTRY(frame_slab) list;
+};
+
+static int frame_slab_init(void *data);
+static void frame_slab_cleanup(void *data);
+
+/*! \brief The frame slab of each thread */
+AST_THREADSTORAGE_CUSTOM(frame_slab_storage, frame_slab_init, frame_slab_cleanup);
+
+/*! \brief Slabs of live threads, for statistics */
+static AST_LIST_HEAD_STATIC(frame_slabs, frame_slab);
+
+/*! \brief Statistics of slabs whose thread exited, protected by the frame_slabs lock */
+static struct frame_slab_stats frame_slab_retired[FRAME_SLAB_CLASSES];
+
+/*! \brief Allocations too large for any slab class */
+static unsigned int frame_slab_oversize;
+
+static int frame_slab_init(void *data)
 {
-	struct ast_frame *f;
+	struct frame_slab *slab = data;
 
-#if !defined(LOW_MEMORY)
-	struct ast_frame_cache *frames;
+	ast_mutex_init(&slab->lock);
 
-	if ((frames = ast_threadstorage_get(&frame_cache, sizeof(*frames)))) {
-		if ((f = AST_LIST_REMOVE_HEAD(&frames->list, frame_list))) {
-			size_t mallocd_len = f->mallocd_hdr_len;
+	AST_LIST_LOCK(&frame_slabs);
+	AST_LIST_INSERT_TAIL(&frame_slabs, slab, list);
+	AST_LIST_UNLOCK(&frame_slabs);
 
-			memset(f, 0, sizeof(*f));
-			f->mallocd_hdr_len = mallocd_len;
-			frames->size--;
-			return f;
-		}
+	return 0;
+}
+
+static void frame_slab_destroy(struct frame_slab *slab)
+{
+	struct frame_slab_chunk *chunk;
+
+	while ((chunk = slab->chunks)) {
+		slab->chunks = chunk->next;
+		ast_free(chunk);
+	}
+	ast_mutex_destroy(&slab->lock);
+	ast_free(slab);
+}
+
+static void frame_slab_cleanup(void *data)
+{
+	struct frame_slab *slab = data;
+	int remaining;
+	int i;
+
+	AST_LIST_LOCK(&frame_slabs);
+	AST_LIST_REMOVE(&frame_slabs, slab, list);
+	for (i = 0; i < FRAME_SLAB_CLASSES; ++i) {
+		frame_slab_retired[i].hits += slab->classes[i].stats.hits;
+		frame_slab_retired[i].misses += slab->classes[i].stats.misses;
+		frame_slab_retired[i].fallbacks += slab->classes[i].stats.fallbacks;
+		frame_slab_retired[i].remote_frees += slab->classes[i].stats.remote_frees;
+	}
+	AST_LIST_UNLOCK(&frame_slabs);
+
+	ast_mutex_lock(&slab->lock);
+	slab->orphaned = 1;
+	remaining = slab->outstanding;
+	ast_mutex_unlock(&slab->lock);
+
+	if (!remaining) {
+		frame_slab_destroy(slab);
+	}
+}
+
+/*! \brief Carve a new chunk of blocks for a class */
+static int frame_slab_grow(struct frame_slab *slab, size_t cls)
+{
+	struct frame_slab_class *class = &slab->classes[cls];
+	size_t stride = sizeof(struct frame_slab_block) + frame_slab_sizes[cls];
+	struct frame_slab_chunk *chunk;
+	struct frame_slab_block *block;
+	int i;
+
+	if (class->chunks >= FRAME_SLAB_MAX_CHUNKS) {
+		return -1;
+	}
+
+	chunk = ast_malloc(sizeof(*chunk) + stride * FRAME_SLAB_CHUNK_BLOCKS);
+	if (!chunk) {
+		return -1;
+	}
+	chunk->next = slab->chunks;
+	slab->chunks = chunk;
+	++class->chunks;
+
+	for (i = 0; i < FRAME_SLAB_CHUNK_BLOCKS; ++i) {
+		block = (struct frame_slab_block *) (chunk->blocks + i * stride);
+		block->slab = slab;
+		block->cls = cls;
+		block->next = class->free;
+		class->free = block;
+	}
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Allocate a block from the calling thread's frame slab
+ *
+ * \param len Number of bytes needed
+ *
+ * \return The uninitialized block or NULL if the heap has to be used
+ */
+static void *frame_slab_alloc(size_t len)
+{
+	struct frame_slab *slab;
+	struct frame_slab_class *class;
+	struct frame_slab_block *block;
+	size_t cls;
+
+	for (cls = 0; cls < FRAME_SLAB_CLASSES && frame_slab_sizes[cls] < len; ++cls) {
+	}
+	if (cls == FRAME_SLAB_CLASSES) {
+		ast_atomic_fetch_add(&frame_slab_oversize, 1, __ATOMIC_RELAXED);
+		return NULL;
 	}
-	if (!(f = ast_calloc_cache(1, sizeof(*f))))
+
+	if (!(slab = ast_threadstorage_get(&frame_slab_storage, sizeof(*slab)))) {
 		return NULL;
-#else
-	if (!(f = ast_calloc(1, sizeof(*f))))
+	}
+	class = &slab->classes[cls];
+
+	if (!class->free && ast_atomic_load_n(&class->remote, __ATOMIC_RELAXED)) {
+		ast_mutex_lock(&slab->lock);
+		class->free = class->remote;
+		class->remote = NULL;
+		ast_mutex_unlock(&slab->lock);
+	}
+
+	if (class->free) {
+		++class->stats.hits;
+	} else if (!frame_slab_grow(slab, cls)) {
+		++class->stats.misses;
+	} else {
+		++class->stats.fallbacks;
 		return NULL;
+	}
+
+	block = class->free;
+	class->free = block->next;
+	ast_atomic_fetch_add(&slab->outstanding, 1, __ATOMIC_RELAXED);
+
+	return block->data;
+}
+
+/*!
+ * \internal
+ * \brief Return a block to the frame slab it was allocated from
+ *
+ * \param ptr A block returned by frame_slab_alloc(), from any thread
+ */
+static void frame_slab_free(void *ptr)
+{
+	struct frame_slab_block *block = ptr - offsetof(struct frame_slab_block, data);
+	struct frame_slab *slab = block->slab;
+	struct frame_slab_class *class = &slab->classes[block->cls];
+	unsigned int orphaned;
+	int remaining;
+
+	if (slab == ast_threadstorage_get_ptr(&frame_slab_storage)) {
+		block->next = class->free;
+		class->free = block;
+		ast_atomic_fetch_sub(&slab->outstanding, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	ast_mutex_lock(&slab->lock);
+	orphaned = slab->orphaned;
+	if (!orphaned) {
+		block->next = class->remote;
+		ast_atomic_store_n(&class->remote, block, __ATOMIC_RELAXED);
+		++class->stats.remote_frees;
+	}
+	remaining = ast_atomic_sub_fetch(&slab->outstanding, 1, __ATOMIC_RELAXED);
+	ast_mutex_unlock(&slab->lock);
+
+	if (orphaned && !remaining) {
+		frame_slab_destroy(slab);
+	}
+}
 #endif
 
-	f->mallocd_hdr_len = sizeof(*f);
+/*!
+ * \internal
+ * \brief Allocate memory for a frame header or payload
+ *
+ * \param len Number of bytes needed
+ * \param[out] from_slab Set when the memory came from the frame slab
+ *
+ * \return The uninitialized memory or NULL on failure
+ */
+static void *frame_buf_alloc(size_t len, int *from_slab)
+{
+#if !defined(LOW_MEMORY)
+	void *buf;
 
-	return f;
+	if (ast_opt_cache_media_frames && (buf = frame_slab_alloc(len))) {
+		*from_slab = 1;
+		return buf;
+	}
+#endif
+
+	*from_slab = 0;
+	return ast_malloc(len);
 }
 
+static void frame_buf_free(void *buf, int from_slab)
+{
 #if !defined(LOW_MEMORY)
-static void frame_cache_cleanup(void *data)
+	if (from_slab) {
+		frame_slab_free(buf);
+		return;
+	}
+#endif
+
+	ast_free(buf);
+}
+
+struct ast_frame ast_null_frame = { AST_FRAME_NULL, };
+
+static struct ast_frame *ast_frame_header_new(void)
 {
-	struct ast_frame_cache *frames = data;
 	struct ast_frame *f;
+	int from_slab;
+
+	if (!(f = frame_buf_alloc(sizeof(*f), &from_slab))) {
+		return NULL;
+	}
 
-	while ((f = AST_LIST_REMOVE_HEAD(&frames->list, frame_list)))
-		ast_free(f);
+	memset(f, 0, sizeof(*f));
+	f->mallocd = AST_MALLOCD_HDR | (from_slab ? AST_MALLOCD_HDR_SLAB : 0);
+	f->mallocd_hdr_len = sizeof(*f);
 
-	ast_free(frames);
+	return f;
 }
-#endif
 
 static void __frame_free(struct ast_frame *fr, int cache)
 {
 	if (!fr->mallocd)
 		return;
 
-#if !defined(LOW_MEMORY)
-	if (fr->mallocd == AST_MALLOCD_HDR
-		&& cache
-		&& ast_opt_cache_media_frames) {
-		/* Cool, only the header is malloc'd, let's just cache those for now
-		 * to keep things simple... */
-		struct ast_frame_cache *frames;
-
-		frames = ast_threadstorage_get(&frame_cache, sizeof(*frames));
-		if (frames && frames->size < FRAME_CACHE_MAX_SIZE) {
-			if (fr->frametype == AST_FRAME_VOICE
-				|| fr->frametype == AST_FRAME_VIDEO
-				|| fr->frametype == AST_FRAME_IMAGE) {
-				ao2_cleanup(fr->subclass.format);
-			}
-
-			AST_LIST_INSERT_HEAD(&frames->list, fr, frame_list);
-			frames->size++;
-			return;
-		}
-	}
-#endif
-
 	if (fr->mallocd & AST_MALLOCD_DATA) {
-		if (fr->data.ptr) {
-			ast_free(fr->data.ptr - fr->offset);
+		if (!fr->data.ptr) {
+			/* Nothing to free */
+		} else if (fr->mallocd & AST_MALLOCD_DATA_SHARED) {
+			ao2_ref(fr->data.ptr - fr->offset, -1);
+		} else {
+			frame_buf_free(fr->data.ptr - fr->offset, fr->mallocd & AST_MALLOCD_DATA_SLAB);
 		}
 	}
 	if (fr->mallocd & AST_MALLOCD_SRC) {
@@ -157,7 +394,7 @@ static void __frame_free(struct ast_frame *fr, int cache)
 			ao2_cleanup(fr->subclass.format);
 		}
 
-		ast_free(fr);
+		frame_buf_free(fr, fr->mallocd & AST_MALLOCD_HDR_SLAB);
 	} else {
 		fr->mallocd = 0;
 	}
@@ -189,6 +426,7 @@ struct ast_frame *ast_frisolate(struct ast_frame *fr)
 {
 	struct ast_frame *out;
 	void *newdata;
+	int from_slab;
 
 	/* if none of the existing frame is malloc'd, let ast_frdup() do it
 	   since it is more efficient
@@ -216,7 +454,6 @@ struct ast_frame *ast_frisolate(struct ast_frame *fr)
 		}
 		out->datalen = fr->datalen;
 		out->samples = fr->samples;
-		out->mallocd = AST_MALLOCD_HDR;
 		out->offset = fr->offset;
 		/* Copy the timing data */
 		ast_copy_flags(out, fr, AST_FLAGS_ALL);
@@ -226,6 +463,7 @@ struct ast_frame *ast_frisolate(struct ast_frame *fr)
 			out->seqno = fr->seqno;
 		}
 		out->stream_num = fr->stream_num;
+		ast_media_trace_copy(out, fr);
 	} else {
 		out = fr;
 	}
@@ -268,7 +506,7 @@ struct ast_frame *ast_frisolate(struct ast_frame *fr)
 		 * Duplicate the data buffer and put it into the isolated frame
 		 * which may also be the original frame.
 		 */
-		newdata = ast_malloc(fr->datalen + AST_FRIENDLY_OFFSET);
+		newdata = frame_buf_alloc(fr->datalen + AST_FRIENDLY_OFFSET, &from_slab);
 		if (!newdata) {
 			if (out != fr) {
 				ast_frame_free(out, 0);
@@ -279,27 +517,118 @@ struct ast_frame *ast_frisolate(struct ast_frame *fr)
 		out->offset = AST_FRIENDLY_OFFSET;
 		memcpy(newdata, fr->data.ptr, fr->datalen);
 		out->data.ptr = newdata;
-		out->mallocd |= AST_MALLOCD_DATA;
+		out->mallocd |= AST_MALLOCD_DATA | (from_slab ? AST_MALLOCD_DATA_SLAB : 0);
 	} else if (out != fr) {
 		/* Steal the data buffer from the original frame. */
 		out->data = fr->data;
 		memset(&fr->data, 0, sizeof(fr->data));
-		fr->mallocd &= ~AST_MALLOCD_DATA;
-		out->mallocd |= AST_MALLOCD_DATA;
+		out->mallocd |= fr->mallocd & (AST_MALLOCD_DATA | AST_MALLOCD_DATA_SLAB | AST_MALLOCD_DATA_SHARED);
+		fr->mallocd &= ~(AST_MALLOCD_DATA | AST_MALLOCD_DATA_SLAB | AST_MALLOCD_DATA_SHARED);
+	}
+
+	return out;
+}
+
+/*!
+ * \internal
+ * \brief Duplicate a frame header referencing a shared payload
+ *
+ * \param f Frame to copy the header and source of
+ * \param payload Reference counted payload of f->datalen bytes
+ *
+ * \return The new frame which holds its own reference to payload, or NULL on failure
+ */
+static struct ast_frame *frame_dup_shared(const struct ast_frame *f, void *payload)
+{
+	struct ast_frame *out;
+	int len, srclen = 0;
+	void *buf;
+	int from_slab;
+
+	len = sizeof(*out);
+	if (f->src) {
+		srclen = strlen(f->src);
+	}
+	if (srclen > 0) {
+		len += srclen + 1;
+	}
+
+	if (!(buf = frame_buf_alloc(len, &from_slab))) {
+		return NULL;
+	}
+	out = buf;
+	memset(out, 0, sizeof(*out));
+	out->mallocd_hdr_len = len;
+
+	out->frametype = f->frametype;
+	out->subclass = f->subclass;
+	if ((f->frametype == AST_FRAME_VOICE) || (f->frametype == AST_FRAME_VIDEO) ||
+		(f->frametype == AST_FRAME_IMAGE)) {
+		ao2_bump(out->subclass.format);
 	}
+	out->datalen = f->datalen;
+	out->samples = f->samples;
+	out->delivery = f->delivery;
+	/* The header and source string are one allocation, the payload is referenced */
+	out->mallocd = AST_MALLOCD_HDR | (from_slab ? AST_MALLOCD_HDR_SLAB : 0)
+		| AST_MALLOCD_DATA | AST_MALLOCD_DATA_SHARED;
+	out->offset = 0;
+	out->data.ptr = ao2_bump(payload);
+	if (srclen > 0) {
+		char *src;
 
+		out->src = buf + sizeof(*out);
+		src = (char *) out->src;
+		strcpy(src, f->src);
+	}
+	ast_copy_flags(out, f, AST_FLAGS_ALL);
+	out->ts = f->ts;
+	out->len = f->len;
+	out->seqno = f->seqno;
+	out->stream_num = f->stream_num;
+	ast_media_trace_copy(out, f);
 	return out;
 }
 
+struct ast_frame *ast_frdup_shared(const struct ast_frame *f)
+{
+	struct ast_frame *out;
+	void *payload;
+
+	if (f->mallocd & AST_MALLOCD_DATA_SHARED) {
+		return ast_frdup_readonly(f);
+	}
+	if (!f->datalen) {
+		return ast_frdup(f);
+	}
+
+	payload = ao2_alloc_options(f->datalen, NULL, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!payload) {
+		return NULL;
+	}
+	memcpy(payload, f->data.ptr, f->datalen);
+
+	out = frame_dup_shared(f, payload);
+	ao2_ref(payload, -1);
+	return out;
+}
+
+struct ast_frame *ast_frdup_readonly(const struct ast_frame *f)
+{
+	if ((f->mallocd & AST_MALLOCD_DATA_SHARED) && f->data.ptr) {
+		/* Only the header needs copying, the payload is shared */
+		return frame_dup_shared(f, f->data.ptr - f->offset);
+	}
+
+	return ast_frdup(f);
+}
+
 struct ast_frame *ast_frdup(const struct ast_frame *f)
 {
 	struct ast_frame *out = NULL;
 	int len, srclen = 0;
 	void *buf = NULL;
-
-#if !defined(LOW_MEMORY)
-	struct ast_frame_cache *frames;
-#endif
+	int from_slab;
 
 	/* Start with standard stuff */
 	len = sizeof(*out) + AST_FRIENDLY_OFFSET + f->datalen;
@@ -313,30 +642,12 @@ struct ast_frame *ast_frdup(const struct ast_frame *f)
 	if (srclen > 0)
 		len += srclen + 1;
 
-#if !defined(LOW_MEMORY)
-	if ((frames = ast_threadstorage_get(&frame_cache, sizeof(*frames)))) {
-		AST_LIST_TRAVERSE_SAFE_BEGIN(&frames->list, out, frame_list) {
-			if (out->mallocd_hdr_len >= len) {
-				size_t mallocd_len = out->mallocd_hdr_len;
-
-				AST_LIST_REMOVE_CURRENT(frame_list);
-				memset(out, 0, sizeof(*out));
-				out->mallocd_hdr_len = mallocd_len;
-				buf = out;
-				frames->size--;
-				break;
-			}
-		}
-		AST_LIST_TRAVERSE_SAFE_END;
-	}
-#endif
-
-	if (!buf) {
-		if (!(buf = ast_calloc_cache(1, len)))
-			return NULL;
-		out = buf;
-		out->mallocd_hdr_len = len;
+	if (!(buf = frame_buf_alloc(len, &from_slab))) {
+		return NULL;
 	}
+	out = buf;
+	memset(out, 0, sizeof(*out));
+	out->mallocd_hdr_len = len;
 
 	out->frametype = f->frametype;
 	out->subclass = f->subclass;
@@ -354,7 +665,7 @@ struct ast_frame *ast_frdup(const struct ast_frame *f)
 	 * was allocated in a single allocation, we'll only mark it as if the header
 	 * was heap-allocated; this will result in the entire frame being properly freed.
 	 */
-	out->mallocd = AST_MALLOCD_HDR;
+	out->mallocd = AST_MALLOCD_HDR | (from_slab ? AST_MALLOCD_HDR_SLAB : 0);
 	out->offset = AST_FRIENDLY_OFFSET;
 	/* Make sure that empty text frames have a valid data.ptr */
 	if (out->datalen || f->frametype == AST_FRAME_TEXT) {
@@ -376,6 +687,7 @@ struct ast_frame *ast_frdup(const struct ast_frame *f)
 	out->len = f->len;
 	out->seqno = f->seqno;
 	out->stream_num = f->stream_num;
+	ast_media_trace_copy(out, f);
 	return out;
 }
 
@@ -705,9 +1017,6 @@ int ast_frame_adjust_volume(struct ast_frame *f, int adjustment)
 
 int ast_frame_slinear_sum(struct ast_frame *f1, struct ast_frame *f2)
 {
-	int count;
-	short *data1, *data2;
-
 	if ((f1->frametype != AST_FRAME_VOICE) || (ast_format_cmp(f1->subclass.format, ast_format_slin) != AST_FORMAT_CMP_NOT_EQUAL))
 		return -1;
 
@@ -717,10 +1026,7 @@ int ast_frame_slinear_sum(struct ast_frame *f1, struct ast_frame *f2)
 	if (f1->samples != f2->samples)
 		return -1;
 
-	for (count = 0, data1 = f1->data.ptr, data2 = f2->data.ptr;
-	     count < f1->samples;
-	     count++, data1++, data2++)
-		ast_slinear_saturated_add(data1, data2);
+	ast_slinear_saturated_add_array(f1->data.ptr, f2->data.ptr, f1->samples);
 
 	return 0;
 }
@@ -736,3 +1042,79 @@ int ast_frame_clear(struct ast_frame *frame)
 	}
 	return 0;
 }
+
+#if !defined(LOW_MEMORY)
+static char *handle_cli_frame_slabs(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct frame_slab_stats totals[FRAME_SLAB_CLASSES];
+	struct frame_slab *slab;
+	int threads = 0;
+	int i;
+#define FMT_HEADERS		"%-10s %15s %15s %15s %15s\n"
+#define FMT_FIELDS		"%-10zu %15lu %15lu %15lu %15lu\n"
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "core show frame slabs";
+		e->usage =
+			"Usage: core show frame slabs\n"
+			"	Shows allocation statistics of the per-thread frame slabs.  Hits\n"
+			"	are served from a free list, misses needed a new chunk, and\n"
+			"	fallbacks had to use the heap.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != e->args) {
+		return CLI_SHOWUSAGE;
+	}
+
+	/* The counters of live slabs are read without their owners' cooperation. */
+	AST_LIST_LOCK(&frame_slabs);
+	memcpy(totals, frame_slab_retired, sizeof(totals));
+	AST_LIST_TRAVERSE(&frame_slabs, slab, list) {
+		for (i = 0; i < FRAME_SLAB_CLASSES; ++i) {
+			totals[i].hits += slab->classes[i].stats.hits;
+			totals[i].misses += slab->classes[i].stats.misses;
+			totals[i].fallbacks += slab->classes[i].stats.fallbacks;
+			totals[i].remote_frees += slab->classes[i].stats.remote_frees;
+		}
+		++threads;
+	}
+	AST_LIST_UNLOCK(&frame_slabs);
+
+	ast_cli(a->fd, "\n" FMT_HEADERS, "Size", "Hits", "Misses", "Fallbacks", "Remote frees");
+	for (i = 0; i < FRAME_SLAB_CLASSES; ++i) {
+		ast_cli(a->fd, FMT_FIELDS, frame_slab_sizes[i], totals[i].hits, totals[i].misses,
+			totals[i].fallbacks, totals[i].remote_frees);
+	}
+	ast_cli(a->fd, "\n%u oversize allocations\n%d threads with a frame slab\n",
+		ast_atomic_load_n(&frame_slab_oversize, __ATOMIC_RELAXED), threads);
+	ast_cli(a->fd, "Frame slabs are %s\n\n",
+		ast_opt_cache_media_frames ? "enabled" : "disabled by cache_media_frames");
+
+	return CLI_SUCCESS;
+#undef FMT_HEADERS
+#undef FMT_FIELDS
+}
+
+static struct ast_cli_entry frame_clis[] = {
+	AST_CLI_DEFINE(handle_cli_frame_slabs, "Show frame slab allocation statistics"),
+};
+
+static void frame_shutdown(void)
+{
+	ast_cli_unregister_multiple(frame_clis, ARRAY_LEN(frame_clis));
+}
+#endif
+
+int ast_frame_init(void)
+{
+#if !defined(LOW_MEMORY)
+	ast_cli_register_multiple(frame_clis, ARRAY_LEN(frame_clis));
+	ast_register_cleanup(frame_shutdown);
+#endif
+
+	return 0;
+}
@@ -51,6 +51,10 @@ struct ast_framehook_list {
 	unsigned int count;
 	/*! id for next framehook added */
 	unsigned int id_count;
+	/*! union of the frame types the attached framehooks are interested in */
+	unsigned int frame_types;
+	/*! set when a framehook is waiting to be removed by the next traversal */
+	unsigned int detach_pending:1;
 	AST_LIST_HEAD_NOLOCK(, ast_framehook) list;
 };
 
@@ -80,6 +84,24 @@ static void framehook_detach(struct ast_framehook *framehook, enum framehook_det
 	ast_free(framehook);
 }
 
+/*! \brief Frame types a framehook wants to receive, zero meaning all of them */
+static unsigned int framehook_frame_types(const struct ast_framehook *framehook)
+{
+	return framehook->i.frame_types ? framehook->i.frame_types : ~0U;
+}
+
+static void framehook_list_update_frame_types(struct ast_framehook_list *framehooks)
+{
+	struct ast_framehook *framehook;
+
+	framehooks->frame_types = 0;
+	AST_LIST_TRAVERSE(&framehooks->list, framehook, list) {
+		if (!framehook->detach_and_destroy_me) {
+			framehooks->frame_types |= framehook_frame_types(framehook);
+		}
+	}
+}
+
 static struct ast_frame *framehook_list_push_event(struct ast_framehook_list *framehooks, struct ast_frame *frame, enum ast_framehook_event event)
 {
 	struct ast_framehook *framehook;
@@ -91,6 +113,13 @@ static struct ast_frame *framehook_list_push_event(struct ast_framehook_list *fr
 		return frame;
 	}
 
+	/* Nothing attached cares about this type of frame, so skip the traversal
+	 * unless a detached framehook is still waiting to be cleaned up. */
+	if (frame && !framehooks->detach_pending
+		&& !(framehooks->frame_types & AST_FRAMEHOOK_FRAME_TYPE(frame->frametype))) {
+		return frame;
+	}
+
 	skip_size = sizeof(int) * framehooks->count;
 	skip = ast_alloca(skip_size);
 	memset(skip, 0, skip_size);
@@ -108,7 +137,8 @@ static struct ast_frame *framehook_list_push_event(struct ast_framehook_list *fr
 			}
 
 			/* If this framehook has been marked as needing to be skipped, do so */
-			if (skip[num]) {
+			if (skip[num] || (frame
+				&& !(framehook_frame_types(framehook) & AST_FRAMEHOOK_FRAME_TYPE(frame->frametype)))) {
 				num++;
 				continue;
 			}
@@ -126,6 +156,17 @@ static struct ast_frame *framehook_list_push_event(struct ast_framehook_list *fr
 		AST_LIST_TRAVERSE_SAFE_END;
 	} while (frame != original_frame);
 
+	if (framehooks->detach_pending) {
+		/* A framehook detached during its own callback is removed on the next pass */
+		framehooks->detach_pending = 0;
+		AST_LIST_TRAVERSE(&framehooks->list, framehook, list) {
+			if (framehook->detach_and_destroy_me) {
+				framehooks->detach_pending = 1;
+				break;
+			}
+		}
+	}
+
 	return frame;
 }
 
@@ -157,6 +198,7 @@ int ast_framehook_attach(struct ast_channel *chan, struct ast_framehook_interfac
 	ast_channel_framehooks(chan)->count++;
 	framehook->id = ++ast_channel_framehooks(chan)->id_count;
 	AST_LIST_INSERT_TAIL(&ast_channel_framehooks(chan)->list, framehook, list);
+	ast_channel_framehooks(chan)->frame_types |= framehook_frame_types(framehook);
 
 	/* Tell the event callback we're live and rocking */
 	frame = framehook->i.event_cb(framehook->chan, NULL, AST_FRAMEHOOK_EVENT_ATTACHED, framehook->i.data);
@@ -196,6 +238,11 @@ int ast_framehook_detach(struct ast_channel *chan, int id)
 	}
 	AST_LIST_TRAVERSE_SAFE_END;
 
+	if (!res) {
+		ast_channel_framehooks(chan)->detach_pending = 1;
+		framehook_list_update_frame_types(ast_channel_framehooks(chan));
+	}
+
 	if (!res && ast_channel_is_bridged(chan)) {
 		ast_channel_set_unbridged_nolock(chan, 1);
 	}
@@ -269,6 +316,8 @@ void ast_framehook_list_fixup(struct ast_channel *old_chan, struct ast_channel *
 			framehook_detach(framehook, FRAMEHOOK_DETACH_PRESERVE);
 		}
 	}
+	ast_channel_framehooks(old_chan)->frame_types = 0;
+	ast_channel_framehooks(old_chan)->detach_pending = 0;
 }
 
 int ast_framehook_list_is_empty(struct ast_framehook_list *framehooks)
@@ -301,6 +350,9 @@ int ast_framehook_list_contains_no_active_of_type(struct ast_framehook_list *fra
 		if (cur->detach_and_destroy_me) {
 			continue;
 		}
+		if (type && !(framehook_frame_types(cur) & AST_FRAMEHOOK_FRAME_TYPE(type))) {
+			continue;
+		}
 		if (type && cur->i.consume_cb && !cur->i.consume_cb(cur->i.data, type)) {
 			continue;
 		}
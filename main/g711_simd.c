@@ -0,0 +1,223 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2019, Sangoma Technologies Corporation
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*! \file
+ *
+ * \brief Vectorized G.711 to signed linear conversion
+ *
+ * The vector kernels gather from copies of the mu-law and A-law tables
+ * so they produce exactly what the per-sample macros do.  The kernel
+ * matching the CPU is picked once at startup, after the tables are
+ * built.
+ */
+
+/*** MODULEINFO
+	<support_level>core</support_level>
+ ***/
+
+/* Needed for the inline allocators in the intrinsics headers */
+#define ASTMM_LIBC ASTMM_IGNORE
+#include "asterisk.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define G711_SIMD_X86
+#endif
+
+#include "asterisk/_private.h"
+#include "asterisk/ulaw.h"
+#include "asterisk/alaw.h"
+
+static void ulaw_decode_scalar(short *dst, const unsigned char *src, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i < samples; ++i) {
+		dst[i] = AST_MULAW(src[i]);
+	}
+}
+
+static void ulaw_encode_scalar(unsigned char *dst, const short *src, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i < samples; ++i) {
+		dst[i] = AST_LIN2MU(src[i]);
+	}
+}
+
+static void alaw_decode_scalar(short *dst, const unsigned char *src, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i < samples; ++i) {
+		dst[i] = AST_ALAW(src[i]);
+	}
+}
+
+static void alaw_encode_scalar(unsigned char *dst, const short *src, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i < samples; ++i) {
+		dst[i] = AST_LIN2A(src[i]);
+	}
+}
+
+#if defined(G711_SIMD_X86)
+/*! Decode tables widened so each entry is a whole gather element */
+static int ulaw_decode_table[256];
+static int alaw_decode_table[256];
+
+#ifndef G711_NEW_ALGORITHM
+/*
+ * Encode tables with room for the three bytes a gather of the last
+ * entry reads past it.
+ */
+static unsigned char ulaw_encode_table[16384 + 3];
+static unsigned char alaw_encode_table[8192 + 3];
+#endif
+
+/*
+ * The kernels carry their own target attribute so they build without
+ * -mavx2 and are only called when the CPU supports them.
+ */
+static __attribute__((target("avx2"))) void g711_decode_avx2(const int *table,
+	short *dst, const unsigned char *src, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		__m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (src + i)));
+		__m256i lin = _mm256_i32gather_epi32(table, idx, 4);
+
+		_mm_storeu_si128((__m128i *) (dst + i),
+			_mm_packs_epi32(_mm256_castsi256_si128(lin), _mm256_extracti128_si256(lin, 1)));
+	}
+	for (; i < samples; ++i) {
+		dst[i] = table[src[i]];
+	}
+}
+
+static __attribute__((target("avx2"))) void ulaw_decode_avx2(short *dst, const unsigned char *src, size_t samples)
+{
+	g711_decode_avx2(ulaw_decode_table, dst, src, samples);
+}
+
+static __attribute__((target("avx2"))) void alaw_decode_avx2(short *dst, const unsigned char *src, size_t samples)
+{
+	g711_decode_avx2(alaw_decode_table, dst, src, samples);
+}
+
+#ifndef G711_NEW_ALGORITHM
+/*!
+ * \internal
+ * \brief Encode through a table indexed by the unsigned sample shifted right.
+ */
+static __attribute__((target("avx2"))) void g711_encode_avx2(const unsigned char *table, int shift,
+	unsigned char *dst, const short *src, size_t samples)
+{
+	const __m256i mask = _mm256_set1_epi32(0xff);
+	size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		__m256i idx = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) (src + i)));
+		__m256i law;
+		__m128i packed;
+
+		idx = _mm256_srli_epi32(idx, shift);
+		law = _mm256_and_si256(_mm256_i32gather_epi32((const int *) table, idx, 1), mask);
+		packed = _mm_packus_epi32(_mm256_castsi256_si128(law), _mm256_extracti128_si256(law, 1));
+		_mm_storel_epi64((__m128i *) (dst + i), _mm_packus_epi16(packed, packed));
+	}
+	for (; i < samples; ++i) {
+		dst[i] = table[((unsigned short) src[i]) >> shift];
+	}
+}
+
+static __attribute__((target("avx2"))) void ulaw_encode_avx2(unsigned char *dst, const short *src, size_t samples)
+{
+	g711_encode_avx2(ulaw_encode_table, 2, dst, src, samples);
+}
+
+static __attribute__((target("avx2"))) void alaw_encode_avx2(unsigned char *dst, const short *src, size_t samples)
+{
+	g711_encode_avx2(alaw_encode_table, 3, dst, src, samples);
+}
+#endif
+#endif
+
+/*! \brief G.711 array kernels, picked for the CPU by ast_g711_simd_init() */
+static void (*ulaw_decode_kernel)(short *dst, const unsigned char *src, size_t samples) = ulaw_decode_scalar;
+static void (*ulaw_encode_kernel)(unsigned char *dst, const short *src, size_t samples) = ulaw_encode_scalar;
+static void (*alaw_decode_kernel)(short *dst, const unsigned char *src, size_t samples) = alaw_decode_scalar;
+static void (*alaw_encode_kernel)(unsigned char *dst, const short *src, size_t samples) = alaw_encode_scalar;
+static const char *g711_simd_name = "scalar";
+
+int ast_g711_simd_init(void)
+{
+#if defined(G711_SIMD_X86)
+	int i;
+
+	__builtin_cpu_init();
+	if (!__builtin_cpu_supports("avx2")) {
+		return 0;
+	}
+
+	for (i = 0; i < 256; ++i) {
+		ulaw_decode_table[i] = AST_MULAW(i);
+		alaw_decode_table[i] = AST_ALAW(i);
+	}
+	ulaw_decode_kernel = ulaw_decode_avx2;
+	alaw_decode_kernel = alaw_decode_avx2;
+	g711_simd_name = "avx2 (decode only)";
+
+#ifndef G711_NEW_ALGORITHM
+	memcpy(ulaw_encode_table, __ast_lin2mu, sizeof(__ast_lin2mu));
+	memcpy(alaw_encode_table, __ast_lin2a, sizeof(__ast_lin2a));
+	ulaw_encode_kernel = ulaw_encode_avx2;
+	alaw_encode_kernel = alaw_encode_avx2;
+	g711_simd_name = "avx2";
+#endif
+#endif
+
+	return 0;
+}
+
+void ast_ulaw_decode_array(short *dst, const unsigned char *src, size_t samples)
+{
+	ulaw_decode_kernel(dst, src, samples);
+}
+
+void ast_ulaw_encode_array(unsigned char *dst, const short *src, size_t samples)
+{
+	ulaw_encode_kernel(dst, src, samples);
+}
+
+void ast_alaw_decode_array(short *dst, const unsigned char *src, size_t samples)
+{
+	alaw_decode_kernel(dst, src, samples);
+}
+
+void ast_alaw_encode_array(unsigned char *dst, const short *src, size_t samples)
+{
+	alaw_encode_kernel(dst, src, samples);
+}
+
+const char *ast_g711_simd_name(void)
+{
+	return g711_simd_name;
+}
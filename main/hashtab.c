@@ -46,6 +46,7 @@ static void _ast_hashtab_resize(struct ast_hashtab *tab, const char *file, int l
 	_ast_hashtab_resize(tab, __FILE__, __LINE__, __PRETTY_FUNCTION__)
 
 static void *ast_hashtab_lookup_internal(struct ast_hashtab *tab, const void *obj, unsigned int h);
+static int ast_hashtab_insert_internal(struct ast_hashtab *tab, const void *obj, unsigned int hash, const char *file, int lineno, const char *func);
 
 /* some standard, default routines for general use */
 
@@ -293,7 +294,7 @@ struct ast_hashtab *_ast_hashtab_dup(struct ast_hashtab *tab, void *(*obj_dup_fu
 		while (b) {
 			void *newobj = (*obj_dup_func)(b->object);
 			if (newobj) {
-				_ast_hashtab_insert_immediate_bucket(ht, newobj, i, file, lineno, func);
+				ast_hashtab_insert_internal(ht, newobj, b->hash, file, lineno, func);
 			}
 			b = b->next;
 		}
@@ -403,7 +404,6 @@ void ast_hashtab_destroy(struct ast_hashtab *tab, void (*objdestroyfunc)(void *o
 
 int _ast_hashtab_insert_immediate(struct ast_hashtab *tab, const void *obj, const char *file, int lineno, const char *func)
 {
-	unsigned int h;
 	int res=0;
 
 	if (!tab || !obj)
@@ -412,9 +412,7 @@ int _ast_hashtab_insert_immediate(struct ast_hashtab *tab, const void *obj, cons
 	if (tab->do_locking)
 		ast_rwlock_wrlock(&tab->lock);
 
-	h = (*tab->hash)(obj) % tab->hash_tab_size;
-
-	res = _ast_hashtab_insert_immediate_bucket(tab, obj, h, file, lineno, func);
+	res = ast_hashtab_insert_internal(tab, obj, (*tab->hash)(obj), file, lineno, func);
 
 	if (tab->do_locking)
 		ast_rwlock_unlock(&tab->lock);
@@ -424,12 +422,29 @@ int _ast_hashtab_insert_immediate(struct ast_hashtab *tab, const void *obj, cons
 
 int _ast_hashtab_insert_immediate_bucket(struct ast_hashtab *tab, const void *obj, unsigned int h, const char *file, int lineno, const char *func)
 {
-	int c;
-	struct ast_hashtab_bucket *b;
+	unsigned int hash;
 
 	if (!tab || !obj)
 		return 0;
 
+	hash = (*tab->hash)(obj);
+	ast_assert(hash % tab->hash_tab_size == h);
+
+	return ast_hashtab_insert_internal(tab, obj, hash, file, lineno, func);
+}
+
+/*!
+ * \internal
+ * \brief Add obj to the table given its unreduced hash value.
+ *
+ * \note The table must already be locked if locking is in use.
+ */
+static int ast_hashtab_insert_internal(struct ast_hashtab *tab, const void *obj, unsigned int hash, const char *file, int lineno, const char *func)
+{
+	int c;
+	unsigned int h = hash % tab->hash_tab_size;
+	struct ast_hashtab_bucket *b;
+
 	for (c = 0, b = tab->array[h]; b; b= b->next)
 		c++;
 
@@ -442,6 +457,7 @@ int _ast_hashtab_insert_immediate_bucket(struct ast_hashtab *tab, const void *ob
 	}
 
 	b->object = obj;
+	b->hash = hash;
 	b->next = tab->array[h];
 	tab->array[h] = b;
 
@@ -463,13 +479,14 @@ int _ast_hashtab_insert_safe(struct ast_hashtab *tab, const void *obj, const cha
 	   it is not there. */
 	/* will force a resize if the resize func returns 1 */
 	/* returns 1 on success, 0 if there's a problem, or it's already there. */
-	unsigned int bucket = 0;
+	unsigned int hash;
 
 	if (tab->do_locking)
 		ast_rwlock_wrlock(&tab->lock);
 
-	if (!ast_hashtab_lookup_bucket(tab, obj, &bucket)) {
-		int ret2 = _ast_hashtab_insert_immediate_bucket(tab, obj, bucket, file, lineno, func);
+	hash = (*tab->hash)(obj);
+	if (!ast_hashtab_lookup_internal(tab, obj, hash % tab->hash_tab_size)) {
+		int ret2 = ast_hashtab_insert_internal(tab, obj, hash, file, lineno, func);
 
 		if (tab->do_locking)
 			ast_rwlock_unlock(&tab->lock);
@@ -595,21 +612,20 @@ static void _ast_hashtab_resize(struct ast_hashtab *tab, const char *file, int l
 	int newsize = (*tab->newsize)(tab), i, c;
 	unsigned int h;
 	struct ast_hashtab_bucket *b,*bn;
+	struct ast_hashtab_bucket **array;
 
 	/* Since we keep a DLL of all the buckets in tlist,
-	   all we have to do is free the array, malloc a new one,
-	   and then go thru the tlist array and reassign them into
-	   the bucket arrayj.
+	   all we have to do is malloc a new array, go thru the
+	   tlist array and reassign them into the new bucket array,
+	   then free the old one.  If the allocation fails we simply
+	   keep the old, still valid, array.
 	*/
-	for (i = 0; i < tab->hash_tab_size; i++) { /* don't absolutely have to do this, but
-											why leave ptrs laying around */
-		tab->array[i] = 0; /* erase old ptrs */
-	}
-	ast_free(tab->array);
-	tab->array = __ast_calloc(newsize, sizeof(*(tab->array)), file, lineno, func);
-	if (!tab->array) {
+	array = __ast_calloc(newsize, sizeof(*array), file, lineno, func);
+	if (!array) {
 		return;
 	}
+	ast_free(tab->array);
+	tab->array = array;
 
 	/* now sort the buckets into their rightful new slots */
 	tab->resize_count++;
@@ -619,7 +635,8 @@ static void _ast_hashtab_resize(struct ast_hashtab *tab, const char *file, int l
 	for (b = tab->tlist; b; b = bn) {
 		b->prev = 0;
 		bn = b->tnext;
-		h = (*tab->hash)(b->object) % tab->hash_tab_size;
+		/* the bucket remembers its hash, no need to call the hash func again */
+		h = b->hash % tab->hash_tab_size;
 		b->next = tab->array[h];
 		if (b->next)
 			b->next->prev = b;
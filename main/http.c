@@ -64,6 +64,10 @@
 #include "asterisk/astobj2.h"
 #include "asterisk/netsock2.h"
 #include "asterisk/json.h"
+#include "asterisk/alertpipe.h"
+#include "asterisk/poll-compat.h"
+#include "asterisk/threadpool.h"
+#include "asterisk/vector.h"
 
 #define MAX_PREFIX 80
 #define DEFAULT_PORT 8088
@@ -75,6 +79,8 @@
 #define MIN_INITIAL_REQUEST_TIMEOUT	10000
 /*! (ms) Idle time between HTTP requests */
 #define DEFAULT_SESSION_KEEP_ALIVE 15000
+/*! Requests served over a persistent connection before closing it, 0 for no limit */
+#define DEFAULT_SESSION_MAX_REQUESTS 0
 /*! Max size for the http server name */
 #define	MAX_SERVER_NAME_LENGTH 128
 /*! Max size for the http response header */
@@ -106,7 +112,34 @@ static char http_server_name[MAX_SERVER_NAME_LENGTH];
 static int session_limit = DEFAULT_SESSION_LIMIT;
 static int session_inactivity = DEFAULT_SESSION_INACTIVITY;
 static int session_keep_alive = DEFAULT_SESSION_KEEP_ALIVE;
+static int session_max_requests = DEFAULT_SESSION_MAX_REQUESTS;
 static int session_count = 0;
+static int park_idle_sessions;
+
+/*! \brief A persistent connection waiting for its next request */
+struct http_parked_session {
+	/*! \brief The session, whose reference is held while parked */
+	struct ast_tcptls_session_instance *ser;
+	/*! \brief When waiting for the next request times out */
+	struct timeval expires;
+};
+
+/*!
+ * \brief Idle persistent connections
+ *
+ * Rather than each connection holding a thread blocked until its next
+ * request arrives, idle connections are parked and polled together by a
+ * single thread. A connection whose request arrives is handed to the park
+ * threadpool to be served.
+ */
+AST_MUTEX_DEFINE_STATIC(park_lock);
+static AST_VECTOR(, struct http_parked_session) parked_sessions;
+/*! \brief The thread polling parked sessions */
+static pthread_t park_thread = AST_PTHREADT_NULL;
+/*! \brief Wakes the park thread to see new sessions or to exit */
+static int park_alert_pipe[2] = { -1, -1 };
+/*! \brief Serves sessions taken out of parking, NULL if parking is stopped */
+static struct ast_threadpool *park_pool;
 
 static struct ast_tls_config http_tls_cfg;
 
@@ -446,6 +479,8 @@ struct http_worker_private_data {
 	int body_length;
 	/*! HTTP body tracking flags */
 	struct ast_flags flags;
+	/*! Number of requests received over the connection */
+	unsigned int requests;
 };
 
 void ast_http_send(struct ast_tcptls_session_instance *ser,
@@ -456,9 +491,8 @@ void ast_http_send(struct ast_tcptls_session_instance *ser,
 	struct timeval now = ast_tvnow();
 	struct ast_tm tm;
 	char timebuf[80];
-	char buf[256];
-	int len;
 	int content_length = 0;
+	int file_length = 0;
 	int close_connection;
 	struct ast_str *server_header_field = ast_str_create(MAX_SERVER_NAME_LENGTH);
 	int send_content;
@@ -508,7 +542,8 @@ void ast_http_send(struct ast_tcptls_session_instance *ser,
 	}
 
 	if (fd) {
-		content_length += lseek(fd, 0, SEEK_END);
+		file_length = lseek(fd, 0, SEEK_END);
+		content_length += file_length;
 		lseek(fd, 0, SEEK_SET);
 	}
 
@@ -538,12 +573,9 @@ void ast_http_send(struct ast_tcptls_session_instance *ser,
 		close_connection = 1;
 	} else if (send_content && fd) {
 		/* send file content */
-		while ((len = read(fd, buf, sizeof(buf))) > 0) {
-			if (ast_iostream_write(ser->stream, buf, len) != len) {
-				ast_debug(1, "ast_iostream_write() failed: %s\n", strerror(errno));
-				close_connection = 1;
-				break;
-			}
+		if (ast_iostream_sendfile(ser->stream, fd, file_length) != file_length) {
+			ast_debug(1, "ast_iostream_sendfile() failed: %s\n", strerror(errno));
+			close_connection = 1;
 		}
 	}
 
@@ -867,10 +899,16 @@ static int http_request_tracking_setup(struct ast_tcptls_session_instance *ser,
 {
 	struct http_worker_private_data *request = ser->private_data;
 	const char *transfer_encoding;
+	int max_requests_reached;
+
+	++request->requests;
+	max_requests_reached = session_max_requests > 0
+		&& request->requests >= session_max_requests;
 
 	ast_set_flags_to(&request->flags,
 		HTTP_FLAG_HAS_BODY | HTTP_FLAG_BODY_READ | HTTP_FLAG_CLOSE_ON_COMPLETION,
-		http_check_connection_close(headers) ? HTTP_FLAG_CLOSE_ON_COMPLETION : 0);
+		http_check_connection_close(headers) || max_requests_reached
+			? HTTP_FLAG_CLOSE_ON_COMPLETION : 0);
 
 	transfer_encoding = get_transfer_encoding(headers);
 	if (transfer_encoding && !strcasecmp(transfer_encoding, "chunked")) {
@@ -1929,6 +1967,246 @@ static int httpd_process_request(struct ast_tcptls_session_instance *ser)
 	return res;
 }
 
+static void httpd_session_close(struct ast_tcptls_session_instance *ser)
+{
+	ast_atomic_fetchadd_int(&session_count, -1);
+
+	ast_debug(1, "HTTP closing session.  Top level\n");
+	ast_tcptls_close_session_file(ser);
+
+	ao2_ref(ser, -1);
+}
+
+/*!
+ * \internal
+ * \brief Park an idle session until its next request arrives.
+ *
+ * \retval 0 the session was parked and no longer belongs to the caller.
+ * \retval -1 the caller must keep waiting for the next request itself.
+ */
+static int httpd_session_park(struct ast_tcptls_session_instance *ser)
+{
+	struct http_parked_session parked;
+	int res = -1;
+
+	if (ast_iostream_has_buffered_input(ser->stream)) {
+		/* A pipelined request has already been read in */
+		return -1;
+	}
+
+	parked.ser = ser;
+	parked.expires = ast_tvadd(ast_tvnow(), ast_samp2tv(session_keep_alive, 1000));
+
+	ast_mutex_lock(&park_lock);
+	if (park_pool && !AST_VECTOR_APPEND(&parked_sessions, parked)) {
+		ast_alertpipe_write(park_alert_pipe);
+		res = 0;
+	}
+	ast_mutex_unlock(&park_lock);
+
+	return res;
+}
+
+/*!
+ * \internal
+ * \brief Serve requests on a session until it is done or goes idle.
+ *
+ * \param ser The session.
+ * \param timeout (ms) How long to wait for the first request.
+ *
+ * \retval 0 the session is done and must be closed.
+ * \retval 1 the session was parked and no longer belongs to the caller.
+ */
+static int httpd_serve_requests(struct ast_tcptls_session_instance *ser, int timeout)
+{
+	for (;;) {
+		/* Wait for next potential HTTP request message. */
+		ast_iostream_set_timeout_idle_inactivity(ser->stream, timeout, session_inactivity);
+		if (httpd_process_request(ser)) {
+			/* Break the connection or the connection closed */
+			break;
+		}
+		if (!ser->stream) {
+			/* Web-socket or similar that took the connection */
+			break;
+		}
+
+		timeout = session_keep_alive;
+		if (timeout <= 0) {
+			/* Persistent connections not enabled. */
+			break;
+		}
+
+		if (park_idle_sessions && !httpd_session_park(ser)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*! \brief Threadpool task serving a session whose next request arrived */
+static int httpd_session_resume(void *data)
+{
+	struct ast_tcptls_session_instance *ser = data;
+
+	if (!httpd_serve_requests(ser, session_keep_alive)) {
+		httpd_session_close(ser);
+	}
+
+	return 0;
+}
+
+static void *httpd_park_thread(void *data)
+{
+	struct pollfd *fds = NULL;
+	unsigned int fds_size = 0;
+	struct http_parked_session parked;
+	struct timeval now;
+	unsigned int count;
+	unsigned int idx;
+	int wait;
+
+	for (;;) {
+		ast_mutex_lock(&park_lock);
+		if (!park_pool) {
+			ast_mutex_unlock(&park_lock);
+			break;
+		}
+		count = AST_VECTOR_SIZE(&parked_sessions);
+		if (count + 1 > fds_size) {
+			struct pollfd *grown = ast_realloc(fds, (count + 1) * sizeof(*fds));
+
+			if (!grown) {
+				ast_mutex_unlock(&park_lock);
+				usleep(1000);
+				continue;
+			}
+			fds = grown;
+			fds_size = count + 1;
+		}
+		fds[0].fd = ast_alertpipe_readfd(park_alert_pipe);
+		fds[0].events = POLLIN;
+		wait = -1;
+		now = ast_tvnow();
+		for (idx = 0; idx < count; ++idx) {
+			int64_t remaining;
+
+			parked = AST_VECTOR_GET(&parked_sessions, idx);
+			fds[idx + 1].fd = ast_iostream_get_fd(parked.ser->stream);
+			fds[idx + 1].events = POLLIN;
+			remaining = MAX(ast_tvdiff_ms(parked.expires, now), 0);
+			if (wait < 0 || remaining < wait) {
+				wait = (int) remaining;
+			}
+		}
+		ast_mutex_unlock(&park_lock);
+
+		if (ast_poll(fds, count + 1, wait) < 0) {
+			if (errno != EINTR) {
+				ast_log(LOG_WARNING, "HTTP session park poll failed: %s\n", strerror(errno));
+				usleep(1000);
+			}
+			continue;
+		}
+		if (fds[0].revents) {
+			ast_alertpipe_read(park_alert_pipe);
+		}
+
+		ast_mutex_lock(&park_lock);
+		now = ast_tvnow();
+		/*
+		 * Only this thread removes sessions, so the first count are still
+		 * the ones polled. Walking down keeps the unordered removal from
+		 * moving an unvisited one.
+		 */
+		for (idx = count; idx-- > 0;) {
+			parked = AST_VECTOR_GET(&parked_sessions, idx);
+			if (!fds[idx + 1].revents && ast_tvcmp(parked.expires, now) > 0) {
+				continue;
+			}
+			AST_VECTOR_REMOVE_UNORDERED(&parked_sessions, idx);
+			if (fds[idx + 1].revents && park_pool
+				&& !ast_threadpool_push(park_pool, httpd_session_resume, parked.ser)) {
+				continue;
+			}
+			/* The next request did not come in time, or cannot be served */
+			httpd_session_close(parked.ser);
+		}
+		ast_mutex_unlock(&park_lock);
+	}
+
+	ast_free(fds);
+
+	return NULL;
+}
+
+static int httpd_park_start(void)
+{
+	struct ast_threadpool_options options = {
+		.version = AST_THREADPOOL_OPTIONS_VERSION,
+		.auto_increment = 1,
+		.max_size = 0,
+		.idle_timeout = 60,
+		.initial_size = 0,
+	};
+
+	if (park_thread != AST_PTHREADT_NULL) {
+		return 0;
+	}
+
+	if (ast_alertpipe_init(park_alert_pipe)) {
+		return -1;
+	}
+
+	park_pool = ast_threadpool_create("httpd", NULL, &options);
+	if (!park_pool) {
+		ast_alertpipe_close(park_alert_pipe);
+		return -1;
+	}
+
+	if (ast_pthread_create(&park_thread, NULL, httpd_park_thread, NULL)) {
+		park_thread = AST_PTHREADT_NULL;
+		ast_threadpool_shutdown(park_pool);
+		park_pool = NULL;
+		ast_alertpipe_close(park_alert_pipe);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void httpd_park_stop(void)
+{
+	struct ast_threadpool *pool;
+	unsigned int idx;
+
+	if (park_thread == AST_PTHREADT_NULL) {
+		return;
+	}
+
+	ast_mutex_lock(&park_lock);
+	pool = park_pool;
+	park_pool = NULL;
+	ast_alertpipe_write(park_alert_pipe);
+	ast_mutex_unlock(&park_lock);
+
+	pthread_join(park_thread, NULL);
+	park_thread = AST_PTHREADT_NULL;
+
+	/* Sessions resumed from here on keep their thread instead of parking */
+	ast_threadpool_shutdown(pool);
+
+	ast_mutex_lock(&park_lock);
+	for (idx = 0; idx < AST_VECTOR_SIZE(&parked_sessions); ++idx) {
+		httpd_session_close(AST_VECTOR_GET(&parked_sessions, idx).ser);
+	}
+	AST_VECTOR_FREE(&parked_sessions);
+	ast_mutex_unlock(&park_lock);
+
+	ast_alertpipe_close(park_alert_pipe);
+}
+
 static void *httpd_helper_thread(void *data)
 {
 	struct ast_tcptls_session_instance *ser = data;
@@ -1980,32 +2258,13 @@ static void *httpd_helper_thread(void *data)
 	/* We can let the stream wait for data to arrive. */
 	ast_iostream_set_exclusive_input(ser->stream, 1);
 
-	for (;;) {
-		/* Wait for next potential HTTP request message. */
-		ast_iostream_set_timeout_idle_inactivity(ser->stream, timeout, session_inactivity);
-		if (httpd_process_request(ser)) {
-			/* Break the connection or the connection closed */
-			break;
-		}
-		if (!ser->stream) {
-			/* Web-socket or similar that took the connection */
-			break;
-		}
-
-		timeout = session_keep_alive;
-		if (timeout <= 0) {
-			/* Persistent connections not enabled. */
-			break;
-		}
+	if (httpd_serve_requests(ser, timeout)) {
+		/* Parked, the thread is no longer needed */
+		return NULL;
 	}
 
 done:
-	ast_atomic_fetchadd_int(&session_count, -1);
-
-	ast_debug(1, "HTTP closing session.  Top level\n");
-	ast_tcptls_close_session_file(ser);
-
-	ao2_ref(ser, -1);
+	httpd_session_close(ser);
 	return NULL;
 }
 
@@ -2073,6 +2332,7 @@ static int __ast_http_load(int reload)
 	struct ast_variable *v;
 	int enabled=0;
 	int newenablestatic=0;
+	int new_park_idle_sessions = 0;
 	char newprefix[MAX_PREFIX] = "";
 	char server_name[MAX_SERVER_NAME_LENGTH];
 	struct http_uri_redirect *redirect;
@@ -2125,6 +2385,7 @@ static int __ast_http_load(int reload)
 	session_limit = DEFAULT_SESSION_LIMIT;
 	session_inactivity = DEFAULT_SESSION_INACTIVITY;
 	session_keep_alive = DEFAULT_SESSION_KEEP_ALIVE;
+	session_max_requests = DEFAULT_SESSION_MAX_REQUESTS;
 
 	snprintf(server_name, sizeof(server_name), "Asterisk/%s", ast_get_version());
 
@@ -2183,6 +2444,8 @@ static int __ast_http_load(int reload)
 				ast_log(LOG_WARNING, "Invalid %s '%s' at line %d of http.conf\n",
 					v->name, v->value, v->lineno);
 			}
+		} else if (!strcasecmp(v->name, "park_idle_sessions")) {
+			new_park_idle_sessions = ast_true(v->value);
 		} else if (!strcasecmp(v->name, "session_keep_alive")) {
 			if (sscanf(v->value, "%30d", &session_keep_alive) != 1
 				|| session_keep_alive < 0) {
@@ -2190,6 +2453,13 @@ static int __ast_http_load(int reload)
 				ast_log(LOG_WARNING, "Invalid %s '%s' at line %d of http.conf\n",
 					v->name, v->value, v->lineno);
 			}
+		} else if (!strcasecmp(v->name, "session_max_requests")) {
+			if (sscanf(v->value, "%30d", &session_max_requests) != 1
+				|| session_max_requests < 0) {
+				session_max_requests = DEFAULT_SESSION_MAX_REQUESTS;
+				ast_log(LOG_WARNING, "Invalid %s '%s' at line %d of http.conf\n",
+					v->name, v->value, v->lineno);
+			}
 		} else {
 			ast_log(LOG_WARNING, "Ignoring unknown option '%s' in http.conf\n", v->name);
 		}
@@ -2204,6 +2474,13 @@ static int __ast_http_load(int reload)
 	ast_copy_string(http_server_name, server_name, sizeof(http_server_name));
 	enablestatic = newenablestatic;
 
+	/* Once started, parking stays up so sessions parked earlier are still served */
+	if (new_park_idle_sessions && httpd_park_start()) {
+		ast_log(LOG_WARNING, "Could not start parking idle HTTP sessions\n");
+		new_park_idle_sessions = 0;
+	}
+	park_idle_sessions = new_park_idle_sessions;
+
 	if (num_addrs && enabled) {
 		int i;
 		for (i = 0; i < num_addrs; ++i) {
@@ -2273,6 +2550,11 @@ static char *handle_show_http(struct ast_cli_entry *e, int cmd, struct ast_cli_a
 	ast_cli(a->fd, "HTTP Server Status:\n");
 	ast_cli(a->fd, "Prefix: %s\n", prefix);
 	ast_cli(a->fd, "Server: %s\n", http_server_name);
+	if (park_idle_sessions) {
+		ast_mutex_lock(&park_lock);
+		ast_cli(a->fd, "Parked Idle Sessions: %zu\n", AST_VECTOR_SIZE(&parked_sessions));
+		ast_mutex_unlock(&park_lock);
+	}
 	if (ast_sockaddr_isnull(&http_desc.old_address)) {
 		ast_cli(a->fd, "Server Disabled\n\n");
 	} else {
@@ -2324,6 +2606,8 @@ static int unload_module(void)
 	if (http_tls_cfg.enabled) {
 		ast_tcptls_server_stop(&https_desc);
 	}
+	park_idle_sessions = 0;
+	httpd_park_stop();
 	ast_free(http_tls_cfg.certfile);
 	ast_free(http_tls_cfg.capath);
 	ast_free(http_tls_cfg.pvtfile);
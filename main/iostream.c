@@ -21,6 +21,7 @@
 #include "asterisk/iostream.h"          /* for DO_SSL */
 
 #include <fcntl.h>                      /* for O_NONBLOCK */
+#include <limits.h>                     /* for IOV_MAX */
 #ifdef DO_SSL
 #include <openssl/err.h>                /* for ERR_error_string */
 #include <openssl/opensslv.h>           /* for OPENSSL_VERSION_NUMBER */
@@ -28,6 +29,10 @@
 #endif
 #include <sys/socket.h>                 /* for shutdown, SHUT_RDWR */
 #include <sys/time.h>                   /* for timeval */
+#include <sys/uio.h>                    /* for writev, iovec */
+#ifdef __linux__
+#include <sys/sendfile.h>               /* for sendfile */
+#endif
 
 #include "asterisk/astobj2.h"           /* for ao2_alloc_options, ao2_alloc_... */
 #include "asterisk/logger.h"            /* for ast_debug, ast_log, LOG_ERROR */
@@ -36,6 +41,10 @@
 #include "asterisk/time.h"              /* for ast_remaining_ms, ast_tvnow */
 #include "asterisk/utils.h"             /* for ast_wait_for_input, ast_wait_... */
 
+#ifndef IOV_MAX
+#define IOV_MAX 16
+#endif
+
 struct ast_iostream {
 	SSL *ssl;
 	struct timeval start;
@@ -138,6 +147,22 @@ void ast_iostream_set_exclusive_input(struct ast_iostream *stream, int exclusive
 	stream->exclusive_input = exclusive_input;
 }
 
+int ast_iostream_has_buffered_input(struct ast_iostream *stream)
+{
+	ast_assert(stream != NULL);
+
+	if (stream->rbuflen) {
+		return 1;
+	}
+#if defined(DO_SSL)
+	if (stream->ssl && SSL_pending(stream->ssl) > 0) {
+		return 1;
+	}
+#endif
+
+	return 0;
+}
+
 static ssize_t iostream_read(struct ast_iostream *stream, void *buf, size_t size)
 {
 	struct timeval start;
@@ -474,6 +499,177 @@ ssize_t ast_iostream_write(struct ast_iostream *stream, const void *buffer, size
 	}
 }
 
+ssize_t ast_iostream_writev(struct ast_iostream *stream, const struct iovec *iov, int iovcnt)
+{
+	struct timeval start;
+	struct iovec *vec;
+	size_t size = 0;
+	size_t written = 0;
+	ssize_t res;
+	int ms;
+	int i;
+
+	for (i = 0; i < iovcnt; i++) {
+		size += iov[i].iov_len;
+	}
+	if (!size) {
+		/* You asked to write no data you wrote no data. */
+		return 0;
+	}
+
+	if (!stream || stream->fd == -1) {
+		errno = EBADF;
+		return -1;
+	}
+
+#if defined(DO_SSL)
+	if (stream->ssl) {
+		/* SSL_write() takes one buffer at a time. */
+		for (i = 0; i < iovcnt; i++) {
+			res = ast_iostream_write(stream, iov[i].iov_base, iov[i].iov_len);
+			if (res < 0) {
+				return written ? written : -1;
+			}
+			written += res;
+			if (res < iov[i].iov_len) {
+				/* Report partial write. */
+				break;
+			}
+		}
+		return written;
+	}
+#endif	/* defined(DO_SSL) */
+
+	if (stream->start.tv_sec) {
+		start = stream->start;
+	} else {
+		start = ast_tvnow();
+	}
+
+	/* Partial writes advance through a copy of the caller's buffers. */
+	vec = ast_alloca(sizeof(*vec) * iovcnt);
+	memcpy(vec, iov, sizeof(*vec) * iovcnt);
+
+	for (;;) {
+		res = writev(stream->fd, vec, MIN(iovcnt, IOV_MAX));
+		if (0 < res) {
+			written += res;
+			if (written == size) {
+				/* Yay everything was written. */
+				return size;
+			}
+			/* Skip over what was written and try to write the rest. */
+			while (res >= vec->iov_len) {
+				res -= vec->iov_len;
+				vec++;
+				iovcnt--;
+			}
+			vec->iov_base = (char *) vec->iov_base + res;
+			vec->iov_len -= res;
+			continue;
+		}
+		if (errno != EINTR && errno != EAGAIN) {
+			/* Not a retryable error. */
+			ast_debug(1, "TCP socket error writing: %s\n", strerror(errno));
+			if (written) {
+				return written;
+			}
+			return -1;
+		}
+		ms = ast_remaining_ms(start, stream->timeout);
+		if (!ms) {
+			/* Report partial write. */
+			ast_debug(1, "TCP timeout writing data\n");
+			return written;
+		}
+		ast_wait_for_output(stream->fd, ms);
+	}
+}
+
+ssize_t ast_iostream_sendfile(struct ast_iostream *stream, int fd, size_t count)
+{
+	char buf[16384];
+	size_t written = 0;
+	ssize_t res;
+
+	if (!count) {
+		return 0;
+	}
+
+	if (!stream || stream->fd == -1) {
+		errno = EBADF;
+		return -1;
+	}
+
+#ifdef __linux__
+	if (!stream->ssl) {
+		struct timeval start;
+		int ms;
+
+		if (stream->start.tv_sec) {
+			start = stream->start;
+		} else {
+			start = ast_tvnow();
+		}
+
+		/* Let the kernel copy straight from the page cache to the socket. */
+		for (;;) {
+			res = sendfile(stream->fd, fd, NULL, count - written);
+			if (0 < res) {
+				written += res;
+				if (written == count) {
+					return count;
+				}
+				continue;
+			}
+			if (!res) {
+				/* The file is shorter than expected. */
+				return written;
+			}
+			if (errno == EINVAL || errno == ENOSYS) {
+				/* Not supported for this pair of descriptors. */
+				break;
+			}
+			if (errno != EINTR && errno != EAGAIN) {
+				/* Not a retryable error. */
+				ast_debug(1, "TCP socket error sending file: %s\n", strerror(errno));
+				if (written) {
+					return written;
+				}
+				return -1;
+			}
+			ms = ast_remaining_ms(start, stream->timeout);
+			if (!ms) {
+				/* Report partial write. */
+				ast_debug(1, "TCP timeout sending file\n");
+				return written;
+			}
+			ast_wait_for_output(stream->fd, ms);
+		}
+	}
+#endif
+
+	while (written < count) {
+		ssize_t len;
+
+		len = read(fd, buf, MIN(sizeof(buf), count - written));
+		if (len <= 0) {
+			break;
+		}
+		res = ast_iostream_write(stream, buf, len);
+		if (res < 0) {
+			return written ? written : -1;
+		}
+		written += res;
+		if (res < len) {
+			/* Report partial write. */
+			break;
+		}
+	}
+
+	return written;
+}
+
 ssize_t ast_iostream_printf(struct ast_iostream *stream, const char *format, ...)
 {
 	char sbuf[512], *buf = sbuf;
@@ -160,54 +160,95 @@ static int check_resync(jitterbuf *jb, long ts, long now, long ms, const enum jb
 	return 0;
 }
 
+/*!
+ * \brief Add a delay to a sorted maxbuf or minbuf
+ *
+ * The buffer holds the top *len delays of the history, highest first for
+ * a sign of 1 and lowest first for a sign of -1.  A delay beyond its last
+ * entry only belongs in it when it holds all count delays of the history.
+ */
+static void history_buf_insert(long *buf, int *len, long delay, int count, long sign)
+{
+	int i;
+
+	if (*len < count && (!*len || sign * delay < sign * buf[*len - 1])) {
+		return;
+	}
+
+	if (*len == JB_HISTORY_MAXBUF_SZ) {
+		if (sign * delay <= sign * buf[*len - 1]) {
+			return;
+		}
+		/* the last entry is no longer among the top ones */
+		(*len)--;
+	}
+
+	for (i = *len; i > 0 && sign * delay > sign * buf[i - 1]; i--) {
+		buf[i] = buf[i - 1];
+	}
+	buf[i] = delay;
+	(*len)++;
+}
+
+/*!
+ * \brief Remove a delay that left the history from a sorted maxbuf or minbuf
+ *
+ * \retval 0 the buffer still holds the top *len delays
+ * \retval -1 the delay was expected but not found, the buffer must be recalculated
+ */
+static int history_buf_remove(long *buf, int *len, long delay, long sign)
+{
+	int i;
+
+	if (!*len || sign * delay < sign * buf[*len - 1]) {
+		return 0;
+	}
+
+	for (i = *len - 1; i >= 0; i--) {
+		if (buf[i] == delay) {
+			memmove(buf + i, buf + i + 1, (*len - (i + 1)) * sizeof(buf[0]));
+			(*len)--;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
 static int history_put(jitterbuf *jb, long ts, long now, long ms, long delay)
 {
 	long kicked;
+	int count;
 
 	/* don't add special/negative times to history */
 	if (ts <= 0)
 		return 0;
 
+	count = (jb->hist_ptr < JB_HISTORY_SZ) ? jb->hist_ptr : JB_HISTORY_SZ;
+
 	kicked = jb->history[jb->hist_ptr % JB_HISTORY_SZ];
 
 	jb->history[(jb->hist_ptr++) % JB_HISTORY_SZ] = delay;
 
-	/* optimization; the max/min buffers don't need to be recalculated, if this packet's
-	 * entry doesn't change them.  This happens if this packet is not involved, _and_ any packet
-	 * that got kicked out of the history is also not involved
-	 * We do a number of comparisons, but it's probably still worthwhile, because it will usually
-	 * succeed, and should be a lot faster than going through all 500 packets in history */
+	/* Rather than sorting all 500 packets in history again whenever this packet
+	 * or the one it kicked out is among the highest or lowest, the max/min buffers
+	 * are updated in place.  They only need to be recalculated once too many of
+	 * their entries have left the history for the percentile to be read from them. */
 	if (!jb->hist_maxbuf_valid)
 		return 0;
 
-	/* don't do this until we've filled history
-	 * (reduces some edge cases below) */
-	if (jb->hist_ptr < JB_HISTORY_SZ)
-		goto invalidate;
-
-	/* if the new delay would go into min */
-	if (delay < jb->hist_minbuf[JB_HISTORY_MAXBUF_SZ-1])
-		goto invalidate;
-
-	/* or max.. */
-	if (delay > jb->hist_maxbuf[JB_HISTORY_MAXBUF_SZ-1])
-		goto invalidate;
-
-	/* or the kicked delay would be in min */
-	if (kicked <= jb->hist_minbuf[JB_HISTORY_MAXBUF_SZ-1])
-		goto invalidate;
-
-	if (kicked >= jb->hist_maxbuf[JB_HISTORY_MAXBUF_SZ-1])
-		goto invalidate;
-
-	/* if we got here, we don't need to invalidate, 'cause this delay didn't
-	 * affect things */
-	return 0;
-	/* end optimization */
+	if (count == JB_HISTORY_SZ) {
+		if (history_buf_remove(jb->hist_maxbuf, &jb->hist_maxbuf_len, kicked, 1)
+			|| history_buf_remove(jb->hist_minbuf, &jb->hist_minbuf_len, kicked, -1)) {
+			jb->hist_maxbuf_valid = 0;
+			return 0;
+		}
+		count--;
+	}
 
+	history_buf_insert(jb->hist_maxbuf, &jb->hist_maxbuf_len, delay, count, 1);
+	history_buf_insert(jb->hist_minbuf, &jb->hist_minbuf_len, delay, count, -1);
 
-invalidate:
-	jb->hist_maxbuf_valid = 0;
 	return 0;
 }
 
@@ -289,6 +330,8 @@ static void history_calc_maxbuf(jitterbuf *jb)
 		}
 	}
 
+	/* they hold every delay in history until it grows larger than them */
+	jb->hist_maxbuf_len = jb->hist_minbuf_len = (jb->hist_ptr < JB_HISTORY_MAXBUF_SZ) ? jb->hist_ptr : JB_HISTORY_MAXBUF_SZ;
 	jb->hist_maxbuf_valid = 1;
 }
 
@@ -298,9 +341,6 @@ static void history_get(jitterbuf *jb)
 	int idx;
 	int count;
 
-	if (!jb->hist_maxbuf_valid)
-		history_calc_maxbuf(jb);
-
 	/* count is how many items in history we're examining */
 	count = (jb->hist_ptr < JB_HISTORY_SZ) ? jb->hist_ptr : JB_HISTORY_SZ;
 
@@ -317,6 +357,10 @@ static void history_get(jitterbuf *jb)
 		return;
 	}
 
+	/* recalculate if the delays that left history took the "n"th one with them */
+	if (!jb->hist_maxbuf_valid || jb->hist_maxbuf_len <= idx || jb->hist_minbuf_len <= idx)
+		history_calc_maxbuf(jb);
+
 	max = jb->hist_maxbuf[idx];
 	min = jb->hist_minbuf[idx];
 
@@ -501,6 +501,119 @@ int ast_json_dump_str_format(struct ast_json *root, struct ast_str **dst, enum a
 	return json_dump_callback((json_t *)root, write_to_ast_str, dst, dump_flags(format));
 }
 
+struct ast_json_array_encoder {
+	/*! Array encoded so far */
+	struct ast_str *out;
+	/*! Encoding format type */
+	enum ast_json_encoding_format format;
+	/*! Number of elements encoded so far */
+	size_t count;
+	/*! Set once an append has failed */
+	int failed;
+};
+
+/*!
+ * \internal
+ * \brief Write an array element, nesting a pretty encoding one level deeper.
+ *
+ * Newlines never appear in an encoding other than as formatting, since
+ * they are escaped within strings.
+ */
+static int write_element_to_ast_str(const char *buffer, size_t size, void *data)
+{
+	const char *newline;
+
+	while ((newline = memchr(buffer, '\n', size))) {
+		size_t line = newline - buffer + 1;
+
+		if (write_to_ast_str(buffer, line, data) || write_to_ast_str("  ", 2, data)) {
+			return -1;
+		}
+		buffer += line;
+		size -= line;
+	}
+
+	return size ? write_to_ast_str(buffer, size, data) : 0;
+}
+
+struct ast_json_array_encoder *ast_json_array_encoder_create(enum ast_json_encoding_format format)
+{
+	struct ast_json_array_encoder *encoder;
+
+	encoder = ast_calloc(1, sizeof(*encoder));
+	if (!encoder) {
+		return NULL;
+	}
+
+	encoder->out = ast_str_create(1024);
+	if (!encoder->out) {
+		ast_free(encoder);
+		return NULL;
+	}
+	encoder->format = format;
+	ast_str_set(&encoder->out, 0, "[");
+
+	return encoder;
+}
+
+int ast_json_array_encoder_append(struct ast_json_array_encoder *encoder, struct ast_json *value)
+{
+	const char *separator;
+
+	if (!value || encoder->failed) {
+		ast_json_unref(value);
+		encoder->failed = 1;
+		return -1;
+	}
+
+	if (encoder->format == AST_JSON_PRETTY) {
+		separator = encoder->count ? ",\n  " : "\n  ";
+	} else {
+		separator = encoder->count ? "," : "";
+	}
+
+	if (write_to_ast_str(separator, strlen(separator), &encoder->out)
+		|| json_dump_callback((json_t *)value,
+			encoder->format == AST_JSON_PRETTY ? write_element_to_ast_str : write_to_ast_str,
+			&encoder->out, dump_flags(encoder->format) | JSON_ENCODE_ANY)) {
+		encoder->failed = 1;
+	}
+	ast_json_unref(value);
+	++encoder->count;
+
+	return encoder->failed ? -1 : 0;
+}
+
+struct ast_str *ast_json_array_encoder_finish(struct ast_json_array_encoder *encoder)
+{
+	struct ast_str *out;
+	const char *terminator;
+
+	if (!encoder) {
+		return NULL;
+	}
+
+	out = encoder->out;
+	encoder->out = NULL;
+	terminator = encoder->format == AST_JSON_PRETTY && encoder->count ? "\n]" : "]";
+	if (encoder->failed || write_to_ast_str(terminator, strlen(terminator), &out)) {
+		ast_free(out);
+		out = NULL;
+	}
+	ast_json_array_encoder_free(encoder);
+
+	return out;
+}
+
+void ast_json_array_encoder_free(struct ast_json_array_encoder *encoder)
+{
+	if (!encoder) {
+		return;
+	}
+	ast_free(encoder->out);
+	ast_free(encoder);
+}
+
 
 int ast_json_dump_file_format(struct ast_json *root, FILE *output, enum ast_json_encoding_format format)
 {
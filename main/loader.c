@@ -202,6 +202,8 @@ struct ast_module {
 	 * to this list with a reference.
 	 */
 	struct module_vector reffed_deps;
+	/*! Milliseconds the module's load function took at its last start. */
+	int64_t load_time;
 	struct {
 		/*! The module running and ready to accept requests. */
 		unsigned int running:1;
@@ -235,6 +237,9 @@ static const struct load_results_map load_results[] = {
 	{ AST_MODULE_LOAD_PRIORITY, "Priority" },
 	{ AST_MODULE_LOAD_FAILURE, "Failure" },
 };
+/*! Number of slowest module loads reported once startup loading is done */
+#define SLOWEST_MODULE_LOADS 5
+
 #define AST_MODULE_LOAD_UNKNOWN_STRING		"Unknown"		/* Status string for unknown load status */
 
 static void publish_load_message_type(const char* type, const char *name, const char *status);
@@ -1538,6 +1543,7 @@ static unsigned int inspect_module(const struct ast_module *mod)
 static enum ast_module_load_result start_resource(struct ast_module *mod)
 {
 	char tmp[256];
+	struct timeval start;
 	enum ast_module_load_result res;
 
 	if (mod->flags.running) {
@@ -1570,7 +1576,10 @@ static enum ast_module_load_result start_resource(struct ast_module *mod)
 	if (!ast_fully_booted) {
 		ast_verb(1, "Loading %s.\n", mod->resource);
 	}
+	start = ast_tvnow();
 	res = mod->info->load();
+	mod->load_time = ast_tvdiff_ms(ast_tvnow(), start);
+	ast_debug(1, "%s load took %" PRId64 " ms\n", mod->resource, mod->load_time);
 
 	switch (res) {
 	case AST_MODULE_LOAD_SUCCESS:
@@ -2195,6 +2204,47 @@ done:
 	return res;
 }
 
+/*!
+ * \internal
+ * \brief Log the total startup load time and the modules that took longest.
+ *
+ * \pre module_list must be locked.
+ */
+static void log_module_load_times(struct timeval start)
+{
+	struct ast_module *slowest[SLOWEST_MODULE_LOADS] = { NULL, };
+	struct ast_module *mod;
+	struct ast_str *buf;
+	int i;
+
+	AST_DLLIST_TRAVERSE(&module_list, mod, entry) {
+		if (!mod->flags.running || !mod->load_time) {
+			continue;
+		}
+		for (i = 0; i < SLOWEST_MODULE_LOADS; i++) {
+			if (!slowest[i] || mod->load_time > slowest[i]->load_time) {
+				memmove(&slowest[i + 1], &slowest[i],
+					sizeof(slowest[0]) * (SLOWEST_MODULE_LOADS - i - 1));
+				slowest[i] = mod;
+				break;
+			}
+		}
+	}
+
+	buf = ast_str_create(256);
+	if (!buf) {
+		return;
+	}
+	for (i = 0; i < SLOWEST_MODULE_LOADS && slowest[i]; i++) {
+		ast_str_append(&buf, 0, "%s%s (%" PRId64 " ms)", i ? ", " : "",
+			slowest[i]->resource, slowest[i]->load_time);
+	}
+	ast_log(LOG_NOTICE, "Module loading took %" PRId64 " ms%s%s\n",
+		ast_tvdiff_ms(ast_tvnow(), start),
+		ast_str_strlen(buf) ? ", slowest: " : "", ast_str_buffer(buf));
+	ast_free(buf);
+}
+
 int load_modules(void)
 {
 	struct load_order_entry *order;
@@ -2203,6 +2253,7 @@ int load_modules(void)
 	int res = 0;
 	int modulecount = 0;
 	int i;
+	struct timeval start = ast_tvnow();
 
 	ast_verb(1, "Asterisk Dynamic Loader Starting:\n");
 
@@ -2234,6 +2285,7 @@ int load_modules(void)
 		ast_log(LOG_WARNING, "Some non-required modules failed to load.\n");
 		res = 0;
 	}
+	log_module_load_times(start);
 
 done:
 	while ((order = AST_LIST_REMOVE_HEAD(&load_order, entry))) {
@@ -250,6 +250,133 @@ lt_cleanup:
 	return res;
 }
 
+/*! Set while the lock contention profiler is on */
+static int lock_contention_on;
+
+/*! Protects the contention table, a plain pthread mutex so it is never itself profiled */
+static pthread_mutex_t lock_contention_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*! \brief A site in the contention table */
+struct lock_contention_entry {
+	/*! The file as passed by the caller, compared by address */
+	const char *file_key;
+	struct ast_lock_contention_site site;
+};
+
+/*! Contention by acquisition site, open addressed by file and line */
+static struct lock_contention_entry lock_contention_table[AST_LOCK_CONTENTION_SITES];
+
+/*! Contended acquisitions not recorded because the table was full */
+static unsigned long lock_contention_dropped;
+
+void ast_lock_contention_enable(int enable)
+{
+	lock_contention_on = enable ? 1 : 0;
+}
+
+int ast_lock_contention_enabled(void)
+{
+	return lock_contention_on;
+}
+
+size_t ast_lock_contention_snapshot(struct ast_lock_contention_site *sites, size_t max,
+	int reset, unsigned long *dropped)
+{
+	size_t count = 0;
+	size_t i;
+
+	pthread_mutex_lock(&lock_contention_lock);
+	for (i = 0; i < AST_LOCK_CONTENTION_SITES && count < max; ++i) {
+		if (lock_contention_table[i].file_key) {
+			sites[count++] = lock_contention_table[i].site;
+		}
+	}
+	if (dropped) {
+		*dropped = lock_contention_dropped;
+	}
+	if (reset) {
+		memset(lock_contention_table, 0, sizeof(lock_contention_table));
+		lock_contention_dropped = 0;
+	}
+	pthread_mutex_unlock(&lock_contention_lock);
+
+	return count;
+}
+
+/*!
+ * \internal
+ * \brief Record a wait for a lock at an acquisition site
+ */
+static void lock_contention_record(const char *filename, int lineno, const char *lock_name,
+	struct timeval start)
+{
+	int64_t wait = ast_tvdiff_us(ast_tvnow(), start);
+	const char *file_key = S_OR(filename, "");
+	unsigned int hash = (unsigned int) (((uintptr_t) file_key >> 3) * 31 + lineno);
+	struct lock_contention_entry *entry;
+	size_t i;
+
+	pthread_mutex_lock(&lock_contention_lock);
+	for (i = 0; i < AST_LOCK_CONTENTION_SITES; ++i) {
+		entry = &lock_contention_table[(hash + i) % AST_LOCK_CONTENTION_SITES];
+		if (!entry->file_key) {
+			/* Copy the names, the caller's module could be unloaded */
+			entry->file_key = file_key;
+			entry->site.lineno = lineno;
+			ast_copy_string(entry->site.filename, file_key, sizeof(entry->site.filename));
+			ast_copy_string(entry->site.lock_name, S_OR(lock_name, ""), sizeof(entry->site.lock_name));
+			break;
+		}
+		if (entry->file_key == file_key && entry->site.lineno == lineno) {
+			break;
+		}
+	}
+	if (i < AST_LOCK_CONTENTION_SITES) {
+		++entry->site.contended;
+		entry->site.total_wait += wait;
+		if (wait > entry->site.max_wait) {
+			entry->site.max_wait = wait;
+		}
+	} else {
+		++lock_contention_dropped;
+	}
+	pthread_mutex_unlock(&lock_contention_lock);
+}
+
+#if !defined(DETECT_DEADLOCKS) || !defined(DEBUG_THREADS)
+/*! \brief Lock a mutex, timing the wait if it is found held */
+static int lock_contention_mutex_lock(const char *filename, int lineno, const char *lock_name,
+	pthread_mutex_t *mutex)
+{
+	struct timeval start;
+	int res;
+
+	res = pthread_mutex_trylock(mutex);
+	if (res == EBUSY) {
+		start = ast_tvnow();
+		res = pthread_mutex_lock(mutex);
+		lock_contention_record(filename, lineno, lock_name, start);
+	}
+	return res;
+}
+
+/*! \brief Lock a rwlock, timing the wait if it is found held */
+static int lock_contention_rwlock_lock(const char *filename, int lineno, const char *lock_name,
+	pthread_rwlock_t *rwlock, int write)
+{
+	struct timeval start;
+	int res;
+
+	res = write ? pthread_rwlock_trywrlock(rwlock) : pthread_rwlock_tryrdlock(rwlock);
+	if (res == EBUSY) {
+		start = ast_tvnow();
+		res = write ? pthread_rwlock_wrlock(rwlock) : pthread_rwlock_rdlock(rwlock);
+		lock_contention_record(filename, lineno, lock_name, start);
+	}
+	return res;
+}
+#endif
+
 int __ast_pthread_mutex_lock(const char *filename, int lineno, const char *func,
 				const char* mutex_name, ast_mutex_t *t)
 {
@@ -317,13 +444,17 @@ int __ast_pthread_mutex_lock(const char *filename, int lineno, const char *func,
 		} while (res == EBUSY);
 	}
 #else /* !DETECT_DEADLOCKS || !DEBUG_THREADS */
+	if (lock_contention_on) {
+		res = lock_contention_mutex_lock(filename, lineno, mutex_name, &t->mutex);
+	} else {
 #ifdef	HAVE_MTX_PROFILE
-	ast_mark(mtx_prof, 1);
-	res = pthread_mutex_trylock(&t->mutex);
-	ast_mark(mtx_prof, 0);
-	if (res)
+		ast_mark(mtx_prof, 1);
+		res = pthread_mutex_trylock(&t->mutex);
+		ast_mark(mtx_prof, 0);
+		if (res)
 #endif
-	res = pthread_mutex_lock(&t->mutex);
+		res = pthread_mutex_lock(&t->mutex);
+	}
 #endif /* !DETECT_DEADLOCKS || !DEBUG_THREADS */
 
 #ifdef DEBUG_THREADS
@@ -876,7 +1007,11 @@ int __ast_rwlock_rdlock(const char *filename, int line, const char *func, ast_rw
 		} while (res == EBUSY);
 	}
 #else /* !DETECT_DEADLOCKS || !DEBUG_THREADS */
-	res = pthread_rwlock_rdlock(&t->lock);
+	if (lock_contention_on) {
+		res = lock_contention_rwlock_lock(filename, line, name, &t->lock, 0);
+	} else {
+		res = pthread_rwlock_rdlock(&t->lock);
+	}
 #endif /* !DETECT_DEADLOCKS || !DEBUG_THREADS */
 
 #ifdef DEBUG_THREADS
@@ -974,7 +1109,11 @@ int __ast_rwlock_wrlock(const char *filename, int line, const char *func, ast_rw
 		} while (res == EBUSY);
 	}
 #else /* !DETECT_DEADLOCKS || !DEBUG_THREADS */
-	res = pthread_rwlock_wrlock(&t->lock);
+	if (lock_contention_on) {
+		res = lock_contention_rwlock_lock(filename, line, name, &t->lock, 1);
+	} else {
+		res = pthread_rwlock_wrlock(&t->lock);
+	}
 #endif /* !DETECT_DEADLOCKS || !DEBUG_THREADS */
 
 #ifdef DEBUG_THREADS
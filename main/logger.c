@@ -166,6 +166,8 @@ struct logmsg {
 	int line;
 	int lwp;
 	ast_callid callid;
+	/*! When the message was logged; \a date is formatted from it on output */
+	struct timeval when;
 	AST_DECLARE_STRING_FIELDS(
 		AST_STRING_FIELD(date);
 		AST_STRING_FIELD(file);
@@ -1494,12 +1496,70 @@ static struct sigaction handle_SIGXFSZ = {
 };
 
 /*! \brief Print a normal log message to the channels */
+/*!
+ * \internal
+ * \brief Format the date of a log message
+ *
+ * \details This is left until the message is output so that the thread
+ * that logged it does not pay for the time zone conversion.
+ */
+static void logmsg_format_date(struct logmsg *logmsg)
+{
+	struct ast_tm tm;
+	char datestring[256];
+
+	if (!ast_strlen_zero(logmsg->date)) {
+		return;
+	}
+
+	ast_localtime(&logmsg->when, &tm, NULL);
+	ast_strftime(datestring, sizeof(datestring), dateformat, &tm);
+	ast_string_field_set(logmsg, date, datestring);
+}
+
+/*!
+ * \internal
+ * \brief Format a message for a channel, reusing the previous result when possible
+ *
+ * \details Channels with the same formatter and type produce the same text,
+ * so when several log files are configured the message is formatted once.
+ *
+ * \param chan The channel the message is being formatted for
+ * \param logmsg The message
+ * \param buf Buffer holding the text formatted for \a formatted_for
+ * \param size Size of \a buf
+ * \param formatted_for The channel \a buf currently holds the text for, or NULL
+ *
+ * \retval 0 on success, \a buf holds the text for \a chan
+ * \retval non-zero if the message could not be formatted
+ */
+static int logchannel_format(struct logchannel *chan, struct logmsg *logmsg,
+	char *buf, size_t size, struct logchannel **formatted_for)
+{
+	if (*formatted_for
+		&& (*formatted_for)->formatter.format_log == chan->formatter.format_log
+		&& (*formatted_for)->type == chan->type) {
+		return 0;
+	}
+
+	if (chan->formatter.format_log(chan, logmsg, buf, size)) {
+		*formatted_for = NULL;
+		return -1;
+	}
+
+	*formatted_for = chan;
+	return 0;
+}
+
 static void logger_print_normal(struct logmsg *logmsg)
 {
 	struct logchannel *chan = NULL;
+	struct logchannel *formatted_for = NULL;
 	char buf[BUFSIZ];
 	int level = 0;
 
+	logmsg_format_date(logmsg);
+
 	AST_RWLIST_RDLOCK(&logchannels);
 	if (!AST_RWLIST_EMPTY(&logchannels)) {
 		AST_RWLIST_TRAVERSE(&logchannels, chan, list) {
@@ -1530,13 +1590,13 @@ static void logger_print_normal(struct logmsg *logmsg)
 
 					/* Don't use LOG_MAKEPRI because it's broken in glibc<2.17 */
 					syslog_level = chan->facility | syslog_level; /* LOG_MAKEPRI(chan->facility, syslog_level); */
-					if (!chan->formatter.format_log(chan, logmsg, buf, BUFSIZ)) {
+					if (!logchannel_format(chan, logmsg, buf, BUFSIZ, &formatted_for)) {
 						syslog(syslog_level, "%s", buf);
 					}
 				}
 				break;
 			case LOGTYPE_CONSOLE:
-				if (!chan->formatter.format_log(chan, logmsg, buf, BUFSIZ)) {
+				if (!logchannel_format(chan, logmsg, buf, BUFSIZ, &formatted_for)) {
 					ast_console_puts_mutable_full(buf, logmsg->level, logmsg->sublevel);
 				}
 				break;
@@ -1548,7 +1608,7 @@ static void logger_print_normal(struct logmsg *logmsg)
 						continue;
 					}
 
-					if (chan->formatter.format_log(chan, logmsg, buf, BUFSIZ)) {
+					if (logchannel_format(chan, logmsg, buf, BUFSIZ, &formatted_for)) {
 						continue;
 					}
 
@@ -1602,10 +1662,8 @@ static struct logmsg * __attribute__((format(printf, 7, 0))) format_log_message_
 {
 	struct logmsg *logmsg = NULL;
 	struct ast_str *buf = NULL;
-	struct ast_tm tm;
 	struct timeval now = ast_tvnow();
 	int res = 0;
-	char datestring[256];
 
 	if (!(buf = ast_str_thread_get(&log_buf, LOG_BUF_INIT_SIZE))) {
 		return NULL;
@@ -1638,10 +1696,8 @@ static struct logmsg * __attribute__((format(printf, 7, 0))) format_log_message_
 		logmsg->callid = callid;
 	}
 
-	/* Create our date/time */
-	ast_localtime(&now, &tm, NULL);
-	ast_strftime(datestring, sizeof(datestring), dateformat, &tm);
-	ast_string_field_set(logmsg, date, datestring);
+	/* The date/time string is created when the message is output */
+	logmsg->when = now;
 
 	/* Copy over data */
 	logmsg->level = level;
@@ -1958,6 +2014,37 @@ void ast_callid_threadstorage_auto_clean(ast_callid callid, int callid_created)
 /*!
  * \brief send log messages to syslog and/or the console
  */
+/*!
+ * \internal
+ * \brief Account for a message that does not fit in the log queue
+ *
+ * \note Assumes logmsgs is locked on entry.
+ *
+ * \retval 0 if there is room for the message.
+ * \retval 1 if the message must be discarded.
+ */
+static int logger_queue_discard(void)
+{
+	struct logmsg *logmsg;
+
+	if (logger_queue_size < logger_queue_limit || close_logger_thread) {
+		return 0;
+	}
+
+	logger_messages_discarded++;
+	if (!high_water_alert) {
+		logmsg = format_log_message(__LOG_WARNING, 0, "logger", 0, "***", 0,
+			"Log queue threshold (%d) exceeded.  Discarding new messages.\n", logger_queue_limit);
+		if (logmsg) {
+			AST_LIST_INSERT_TAIL(&logmsgs, logmsg, list);
+		}
+		high_water_alert = 1;
+		ast_cond_signal(&logcond);
+	}
+
+	return 1;
+}
+
 static void __attribute__((format(printf, 7, 0))) ast_log_full(int level, int sublevel,
 	const char *file, int line, const char *function, ast_callid callid,
 	const char *fmt, va_list ap)
@@ -1968,20 +2055,19 @@ static void __attribute__((format(printf, 7, 0))) ast_log_full(int level, int su
 		return;
 	}
 
-	AST_LIST_LOCK(&logmsgs);
-	if (logger_queue_size >= logger_queue_limit && !close_logger_thread) {
-		logger_messages_discarded++;
-		if (!high_water_alert && !close_logger_thread) {
-			logmsg = format_log_message(__LOG_WARNING, 0, "logger", 0, "***", 0,
-				"Log queue threshold (%d) exceeded.  Discarding new messages.\n", logger_queue_limit);
-			AST_LIST_INSERT_TAIL(&logmsgs, logmsg, list);
-			high_water_alert = 1;
-			ast_cond_signal(&logcond);
+	/*
+	 * Peek at the queue size without the lock so a flood of messages
+	 * over the limit is not formatted only to be thrown away.  It is
+	 * checked again below with the lock held.
+	 */
+	if (logger_queue_size >= logger_queue_limit) {
+		AST_LIST_LOCK(&logmsgs);
+		if (logger_queue_discard()) {
+			AST_LIST_UNLOCK(&logmsgs);
+			return;
 		}
 		AST_LIST_UNLOCK(&logmsgs);
-		return;
 	}
-	AST_LIST_UNLOCK(&logmsgs);
 
 	logmsg = format_log_message_ap(level, sublevel, file, line, function, callid, fmt, ap);
 	if (!logmsg) {
@@ -1991,8 +2077,8 @@ static void __attribute__((format(printf, 7, 0))) ast_log_full(int level, int su
 	/* If the logger thread is active, append it to the tail end of the list - otherwise skip that step */
 	if (logthread != AST_PTHREADT_NULL) {
 		AST_LIST_LOCK(&logmsgs);
-		if (close_logger_thread) {
-			/* Logger is either closing or closed.  We cannot log this message. */
+		if (close_logger_thread || logger_queue_discard()) {
+			/* Logger is either closing or closed, or the queue is full.  We cannot log this message. */
 			logmsg_free(logmsg);
 		} else {
 			AST_LIST_INSERT_TAIL(&logmsgs, logmsg, list);
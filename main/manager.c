@@ -60,8 +60,10 @@
 #include <signal.h>
 #include <sys/mman.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <regex.h>
 
+#include "asterisk/arena.h"
 #include "asterisk/channel.h"
 #include "asterisk/file.h"
 #include "asterisk/manager.h"
@@ -99,6 +101,7 @@
 #include "asterisk/format_cache.h"
 #include "asterisk/translate.h"
 #include "asterisk/taskprocessor.h"
+#include "asterisk/threadpool.h"
 
 /*** DOCUMENTATION
 	<manager name="Ping" language="en_US">
@@ -1259,6 +1262,35 @@
 				<para>- If there are black filters only: implied white all filter processed first, then black filters.</para>
 				<para>- If there are both white and black filters: implied black all filter processed first, then white
 				filters, and lastly black filters.</para>
+				<para>When <replaceable>MatchCriteria</replaceable> is given, the filter is
+				compared as set out there instead, and a leading exclamation point is part of
+				the filter.</para>
+			</parameter>
+			<parameter name="MatchCriteria">
+				<para>A comma separated list of criteria that select which events the
+				filter applies to and how <replaceable>Filter</replaceable> is compared.
+				These filters are checked against the headers of the event rather than
+				its whole text, and a filter on an event name lets events of other names
+				be skipped before they are built.</para>
+				<enumlist>
+					<enum name="action(include|exclude)">
+						<para>Add the filter to the white list (the default) or to the black list.</para>
+					</enum>
+					<enum name="name(event)">
+						<para>Only match events with this name.</para>
+					</enum>
+					<enum name="header(header)">
+						<para>Compare <replaceable>Filter</replaceable> with the value of this header.
+						Events without the header do not match. Without it the whole event is used.</para>
+					</enum>
+					<enum name="method(regex|exact|starts_with|contains|none)">
+						<para>How <replaceable>Filter</replaceable> is compared. The default is
+						<literal>regex</literal>, or <literal>none</literal> when only an event
+						name is given. With <literal>none</literal> the filter must be empty.</para>
+					</enum>
+				</enumlist>
+				<para>Example: <literal>MatchCriteria: name(Newchannel),header(Channel),method(starts_with)</literal>
+				with <literal>Filter: PJSIP/</literal></para>
 			</parameter>
 		</syntax>
 		<description>
@@ -1428,6 +1460,37 @@ enum add_filter_result {
 	FILTER_COMPILE_FAIL,
 };
 
+/*! \brief How the pattern of an event filter is compared */
+enum event_filter_match_type {
+	FILTER_MATCH_REGEX = 0,
+	FILTER_MATCH_EXACT,
+	FILTER_MATCH_STARTS_WITH,
+	FILTER_MATCH_CONTAINS,
+	FILTER_MATCH_NONE,
+};
+
+/*!
+ * \brief A manager event filter
+ *
+ * A filter compares its pattern either with the whole text of an event,
+ * or with the value of one header when a header name is given.  A filter
+ * with an event name only matches events of that name, which is checked
+ * before anything else is looked at.
+ *
+ * A pattern without any regular expression syntax can only match its own
+ * text, so it is searched for as a plain string instead of being run
+ * through regexec().
+ */
+struct event_filter_entry {
+	enum event_filter_match_type match_type;
+	regex_t *regex_filter;	/*!< Compiled pattern for FILTER_MATCH_REGEX */
+	char *string_filter;	/*!< Pattern for the plain string match types */
+	char *event_name;	/*!< Event name to match, NULL for all events */
+	unsigned int event_name_hash;	/*!< Case insensitive hash of event_name */
+	char *header_name;	/*!< Header whose value is matched, NULL for the whole event */
+	unsigned int is_excludefilter:1;	/*!< Set when linked in the black list */
+};
+
 /*!
  * Linked list of events.
  * Global events are appended to the list by append_event().
@@ -1452,6 +1515,8 @@ struct eventqent {
 	int category;
 	unsigned int seq;	/*!< sequence number */
 	struct timeval tv;  /*!< When event was allocated */
+	unsigned int event_name_hash;	/*!< Case insensitive hash of event_name */
+	const char *event_name;	/*!< The name of the event, stored after eventdata */
 	AST_RWLIST_ENTRY(eventqent) eq_next;
 	char eventdata[1];	/*!< really variable size, allocated by append_event() */
 };
@@ -1470,6 +1535,15 @@ static int manager_debug = 0;	/*!< enable some debugging code in the manager */
 static int authtimeout;
 static int authlimit;
 static char *manager_channelvars;
+static int originate_threads;	/*!< Maximum threads used for async originates, 0 for one thread each */
+static int originate_rate;	/*!< Maximum async originates started per second, 0 for no limit */
+
+/*! \brief Pool that runs async originates when originatethreads is set */
+static struct ast_threadpool *originate_pool;
+
+/*! \brief Earliest time the next async originate may be started */
+static struct timeval originate_next;
+AST_MUTEX_DEFINE_STATIC(originate_pace_lock);
 
 #define DEFAULT_REALM		"asterisk"
 static char global_realm[MAXHOSTNAMELEN];	/*!< Default realm */
@@ -1674,9 +1748,11 @@ static int __attribute__((format(printf, 9, 0))) __manager_event_sessions(
 	const char *func,
 	const char *fmt,
 	...);
-static enum add_filter_result manager_add_filter(const char *filter_pattern, struct ao2_container *whitefilters, struct ao2_container *blackfilters);
+static enum add_filter_result manager_add_filter(const char *criteria, const char *filter_pattern, struct ao2_container *whitefilters, struct ao2_container *blackfilters);
+
+static int match_filter(struct mansession *s, struct eventqent *eqe);
 
-static int match_filter(struct mansession *s, char *eventdata);
+static int manager_event_wanted(struct ao2_container *sessions, int category, const char *event);
 
 /*!
  * @{ \brief Define AMI message types.
@@ -1721,23 +1797,27 @@ struct stasis_message_router *ast_manager_get_message_router(void)
 static void manager_json_value_str_append(struct ast_json *value, const char *key,
 					  struct ast_str **res)
 {
+	ast_str_append_cstr(res, 0, key);
+	ast_str_append_literal(res, 0, ": ");
+
 	switch (ast_json_typeof(value)) {
 	case AST_JSON_STRING:
-		ast_str_append(res, 0, "%s: %s\r\n", key, ast_json_string_get(value));
+		ast_str_append_cstr(res, 0, ast_json_string_get(value));
 		break;
 	case AST_JSON_INTEGER:
-		ast_str_append(res, 0, "%s: %jd\r\n", key, ast_json_integer_get(value));
+		ast_str_append_int(res, 0, ast_json_integer_get(value));
 		break;
 	case AST_JSON_TRUE:
-		ast_str_append(res, 0, "%s: True\r\n", key);
+		ast_str_append_literal(res, 0, "True");
 		break;
 	case AST_JSON_FALSE:
-		ast_str_append(res, 0, "%s: False\r\n", key);
+		ast_str_append_literal(res, 0, "False");
 		break;
 	default:
-		ast_str_append(res, 0, "%s: \r\n", key);
 		break;
 	}
+
+	ast_str_append_literal(res, 0, "\r\n");
 }
 
 static void manager_json_to_ast_str(struct ast_json *obj, const char *key,
@@ -1786,6 +1866,12 @@ void manager_json_to_ast_str(struct ast_json *obj, const char *key,
 		return;
 	}
 
+	if (ast_json_typeof(obj) == AST_JSON_OBJECT) {
+		ast_str_reserve(res, AST_STR_FIELDS_SIZE_HINT(ast_json_object_size(obj)));
+	} else if (ast_json_typeof(obj) == AST_JSON_ARRAY) {
+		ast_str_reserve(res, AST_STR_FIELDS_SIZE_HINT(ast_json_array_size(obj)));
+	}
+
 	if (ast_json_typeof(obj) != AST_JSON_OBJECT &&
 	    ast_json_typeof(obj) != AST_JSON_ARRAY) {
 		manager_json_value_str_append(obj, key, res);
@@ -1879,6 +1965,12 @@ static void manager_generic_msg_cb(void *data, struct stasis_subscription *sub,
 	type = ast_json_string_get(ast_json_object_get(payload->json, "type"));
 	event = ast_json_object_get(payload->json, "event");
 
+	if (!manager_event_wanted(sessions, class_type, type)) {
+		/* Everybody listening filters it out */
+		ao2_cleanup(sessions);
+		return;
+	}
+
 	event_buffer = ast_manager_str_from_json_object(event, NULL);
 	if (!event_buffer) {
 		ast_log(AST_LOG_WARNING, "Error while creating payload for event %s\n", type);
@@ -2182,8 +2274,15 @@ static struct mansession_session *unref_mansession(struct mansession_session *s)
 
 static void event_filter_destructor(void *obj)
 {
-	regex_t *regex_filter = obj;
-	regfree(regex_filter);
+	struct event_filter_entry *entry = obj;
+
+	if (entry->regex_filter) {
+		regfree(entry->regex_filter);
+		ast_free(entry->regex_filter);
+	}
+	ast_free(entry->string_filter);
+	ast_free(entry->event_name);
+	ast_free(entry->header_name);
 }
 
 static void session_destructor(void *obj)
@@ -3039,6 +3138,45 @@ static int send_string(struct mansession *s, char *string)
 	return res;
 }
 
+/*! \brief Maximum number of events written to a session at once */
+#define MANAGER_EVENT_BATCH 64
+
+/*!
+ * \brief Send queued events to the socket in a single write.
+ *
+ * \note Releases the queue reference held on each event.
+ *
+ * Return -1 on error (e.g. buffer full).
+ */
+static int send_events(struct mansession *s, struct eventqent **events, int count)
+{
+	struct ast_iostream *stream = s->stream ? s->stream : s->session->stream;
+	struct iovec iov[MANAGER_EVENT_BATCH];
+	size_t len = 0;
+	ssize_t res;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		iov[i].iov_base = events[i]->eventdata;
+		iov[i].iov_len = strlen(events[i]->eventdata);
+		len += iov[i].iov_len;
+	}
+
+	ast_iostream_set_timeout_inactivity(stream, s->session->writetimeout);
+	res = ast_iostream_writev(stream, iov, count);
+	ast_iostream_set_timeout_disable(stream);
+
+	for (i = 0; i < count; i++) {
+		ast_atomic_fetchadd_int(&events[i]->usecount, -1);
+	}
+
+	if (res < len) {
+		s->write_error = 1;
+	}
+
+	return res;
+}
+
 /*!
  * \brief thread local buffer for astman_append
  *
@@ -3451,7 +3589,7 @@ static int authenticate(struct mansession *s, const struct message *m)
 	const char *password = astman_get_header(m, "Secret");
 	int error = -1;
 	struct ast_manager_user *user = NULL;
-	regex_t *regex_filter;
+	struct event_filter_entry *regex_filter;
 	struct ao2_iterator filter_iter;
 
 	if (ast_strlen_zero(username)) {	/* missing username */
@@ -4244,7 +4382,7 @@ static int action_waitevent(struct mansession *s, const struct message *m)
 		while ((eqe = advance_event(eqe))) {
 			if (((s->session->readperm & eqe->category) == eqe->category)
 				&& ((s->session->send_events & eqe->category) == eqe->category)
-				&& match_filter(s, eqe->eventdata)) {
+				&& match_filter(s, eqe)) {
 				astman_append(s, "%s", eqe->eventdata);
 			}
 			s->session->last_ev = eqe;
@@ -5283,6 +5421,34 @@ static void destroy_fast_originate_helper(struct fast_originate_helper *doomed)
 	ast_free(doomed);
 }
 
+/*!
+ * \internal
+ * \brief Hold an async originate back until the originaterate allows it to start
+ */
+static void originate_pace(void)
+{
+	struct timeval now;
+	int rate = originate_rate;
+	int64_t delay;
+
+	if (!rate) {
+		return;
+	}
+
+	ast_mutex_lock(&originate_pace_lock);
+	now = ast_tvnow();
+	if (ast_tvcmp(originate_next, now) < 0) {
+		originate_next = now;
+	}
+	delay = ast_tvdiff_ms(originate_next, now);
+	originate_next = ast_tvadd(originate_next, ast_samp2tv(1, rate));
+	ast_mutex_unlock(&originate_pace_lock);
+
+	if (delay > 0) {
+		usleep(delay * 1000);
+	}
+}
+
 static void *fast_originate(void *data)
 {
 	struct fast_originate_helper *in = data;
@@ -5295,6 +5461,8 @@ static void *fast_originate(void *data)
 		.uniqueid2 = in->otherchannelid
 	};
 
+	originate_pace();
+
 	if (!ast_strlen_zero(in->app)) {
 		res = ast_pbx_outgoing_app(in->tech, in->cap, in->data,
 			in->timeout, in->app, in->appdata, &reason,
@@ -5363,6 +5531,29 @@ static void *fast_originate(void *data)
 	return NULL;
 }
 
+static int fast_originate_task(void *data)
+{
+	fast_originate(data);
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Start an async originate on the originate pool or its own thread
+ *
+ * \retval 0 on success, the helper is owned by the originate
+ * \retval -1 on failure
+ */
+static int fast_originate_start(struct fast_originate_helper *fast)
+{
+	pthread_t th;
+
+	if (originate_pool) {
+		return ast_threadpool_push(originate_pool, fast_originate_task, fast);
+	}
+	return ast_pthread_create_detached(&th, NULL, fast_originate, fast) ? -1 : 0;
+}
+
 static int aocmessage_get_unit_entry(const struct message *m, struct ast_aoc_unit_entry *entry, unsigned int entry_num)
 {
 	const char *unitamount;
@@ -5622,7 +5813,6 @@ static int action_originate(struct mansession *s, const struct message *m)
 	char tmp[256];
 	char tmp2[256];
 	struct ast_format_cap *cap = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
-	pthread_t th;
 	int bridge_early = 0;
 
 	if (!cap) {
@@ -5768,7 +5958,7 @@ static int action_originate(struct mansession *s, const struct message *m)
 			fast->timeout = to;
 			fast->early_media = bridge_early;
 			fast->priority = pi;
-			if (ast_pthread_create_detached(&th, NULL, fast_originate, fast)) {
+			if (fast_originate_start(fast)) {
 				destroy_fast_originate_helper(fast);
 				res = -1;
 			} else {
@@ -5947,13 +6137,112 @@ static int action_timeout(struct mansession *s, const struct message *m)
 	return 0;
 }
 
+/*!
+ * \internal
+ * \brief Find the value of a header in the text of an event
+ *
+ * \param eventdata The text of the event
+ * \param header The name of the header
+ * \param[out] len The length of the value
+ *
+ * \return The start of the value, which is not terminated
+ * \retval NULL if the event has no such header
+ */
+static const char *event_header_value(const char *eventdata, const char *header, size_t *len)
+{
+	size_t header_len = strlen(header);
+	const char *line = eventdata;
+	const char *end;
+
+	while (*line) {
+		end = strstr(line, "\r\n");
+		if (!end) {
+			end = line + strlen(line);
+		}
+		if (!strncasecmp(line, header, header_len) && line[header_len] == ':') {
+			const char *value = line + header_len + 1;
+
+			while (*value == ' ' || *value == '\t') {
+				value++;
+			}
+			*len = end - value;
+			return value;
+		}
+		if (!*end) {
+			break;
+		}
+		line = end + 2;
+	}
+
+	return NULL;
+}
+
+/*!
+ * \internal
+ * \brief Test an event filter against an event
+ *
+ * \retval 1 if the filter matches
+ * \retval 0 if it does not
+ */
+static int event_filter_match(struct event_filter_entry *entry, struct eventqent *eqe)
+{
+	const char *value;
+	char *copy;
+	size_t len;
+	size_t filter_len;
+
+	if (entry->event_name && (entry->event_name_hash != eqe->event_name_hash
+		|| strcasecmp(entry->event_name, eqe->event_name))) {
+		return 0;
+	}
+
+	if (entry->match_type == FILTER_MATCH_NONE) {
+		return 1;
+	}
+
+	if (!entry->header_name) {
+		if (entry->match_type == FILTER_MATCH_CONTAINS) {
+			return strstr(eqe->eventdata, entry->string_filter) != NULL;
+		} else if (entry->match_type == FILTER_MATCH_REGEX) {
+			return !regexec(entry->regex_filter, eqe->eventdata, 0, NULL, 0);
+		}
+		value = eqe->eventdata;
+		len = strlen(value);
+	} else if (!(value = event_header_value(eqe->eventdata, entry->header_name, &len))) {
+		return 0;
+	}
+
+	switch (entry->match_type) {
+	case FILTER_MATCH_EXACT:
+		filter_len = strlen(entry->string_filter);
+		return len == filter_len && !strncmp(value, entry->string_filter, len);
+	case FILTER_MATCH_STARTS_WITH:
+		filter_len = strlen(entry->string_filter);
+		return len >= filter_len && !strncmp(value, entry->string_filter, filter_len);
+	case FILTER_MATCH_CONTAINS:
+	case FILTER_MATCH_REGEX:
+		/* Header values are not terminated in the event text */
+		copy = ast_alloca(len + 1);
+		memcpy(copy, value, len);
+		copy[len] = '\0';
+		if (entry->match_type == FILTER_MATCH_CONTAINS) {
+			return strstr(copy, entry->string_filter) != NULL;
+		}
+		return !regexec(entry->regex_filter, copy, 0, NULL, 0);
+	case FILTER_MATCH_NONE:
+		break;
+	}
+
+	return 1;
+}
+
 static int whitefilter_cmp_fn(void *obj, void *arg, void *data, int flags)
 {
-	regex_t *regex_filter = obj;
-	const char *eventdata = arg;
+	struct event_filter_entry *entry = obj;
+	struct eventqent *eqe = arg;
 	int *result = data;
 
-	if (!regexec(regex_filter, eventdata, 0, NULL, 0)) {
+	if (event_filter_match(entry, eqe)) {
 		*result = 1;
 		return (CMP_MATCH | CMP_STOP);
 	}
@@ -5963,11 +6252,11 @@ static int whitefilter_cmp_fn(void *obj, void *arg, void *data, int flags)
 
 static int blackfilter_cmp_fn(void *obj, void *arg, void *data, int flags)
 {
-	regex_t *regex_filter = obj;
-	const char *eventdata = arg;
+	struct event_filter_entry *entry = obj;
+	struct eventqent *eqe = arg;
 	int *result = data;
 
-	if (!regexec(regex_filter, eventdata, 0, NULL, 0)) {
+	if (event_filter_match(entry, eqe)) {
 		*result = 0;
 		return (CMP_MATCH | CMP_STOP);
 	}
@@ -5983,11 +6272,12 @@ static int blackfilter_cmp_fn(void *obj, void *arg, void *data, int flags)
 static int action_filter(struct mansession *s, const struct message *m)
 {
 	const char *filter = astman_get_header(m, "Filter");
+	const char *criteria = astman_get_header(m, "MatchCriteria");
 	const char *operation = astman_get_header(m, "Operation");
 	int res;
 
 	if (!strcasecmp(operation, "Add")) {
-		res = manager_add_filter(filter, s->session->whitefilters, s->session->blackfilters);
+		res = manager_add_filter(criteria, filter, s->session->whitefilters, s->session->blackfilters);
 
 	        if (res != FILTER_SUCCESS) {
 		        if (res == FILTER_ALLOC_FAILED) {
@@ -6010,48 +6300,171 @@ static int action_filter(struct mansession *s, const struct message *m)
 	return 0;
 }
 
+/*!
+ * \internal
+ * \brief Parse the match criteria of an event filter
+ *
+ * \param entry The filter to set the criteria on
+ * \param criteria Comma separated list of action(), name(), header() and method()
+ *
+ * \retval 0 on success
+ * \retval -1 on a syntax error
+ * \retval -2 on allocation failure
+ */
+static int event_filter_parse_criteria(struct event_filter_entry *entry, const char *criteria)
+{
+	char *parse = ast_strdupa(criteria);
+	char *criterion;
+	int have_method = 0;
+
+	while ((criterion = ast_strip(strsep(&parse, ",")))) {
+		char *value = strchr(criterion, '(');
+		size_t len;
+
+		if (ast_strlen_zero(criterion)) {
+			continue;
+		}
+		len = value ? strlen(value) : 0;
+		if (len < 2 || value[len - 1] != ')') {
+			return -1;
+		}
+		*value++ = '\0';
+		value[len - 2] = '\0';
+		criterion = ast_strip(criterion);
+		value = ast_strip(value);
+
+		if (!strcasecmp(criterion, "action")) {
+			if (!strcasecmp(value, "include")) {
+				entry->is_excludefilter = 0;
+			} else if (!strcasecmp(value, "exclude")) {
+				entry->is_excludefilter = 1;
+			} else {
+				return -1;
+			}
+		} else if (!strcasecmp(criterion, "name")) {
+			if (ast_strlen_zero(value) || entry->event_name) {
+				return -1;
+			}
+			if (!(entry->event_name = ast_strdup(value))) {
+				return -2;
+			}
+			entry->event_name_hash = ast_str_case_hash(value);
+		} else if (!strcasecmp(criterion, "header")) {
+			if (ast_strlen_zero(value) || entry->header_name) {
+				return -1;
+			}
+			if (!(entry->header_name = ast_strdup(value))) {
+				return -2;
+			}
+		} else if (!strcasecmp(criterion, "method")) {
+			if (!strcasecmp(value, "regex")) {
+				entry->match_type = FILTER_MATCH_REGEX;
+			} else if (!strcasecmp(value, "exact")) {
+				entry->match_type = FILTER_MATCH_EXACT;
+			} else if (!strcasecmp(value, "starts_with")) {
+				entry->match_type = FILTER_MATCH_STARTS_WITH;
+			} else if (!strcasecmp(value, "contains")) {
+				entry->match_type = FILTER_MATCH_CONTAINS;
+			} else if (!strcasecmp(value, "none")) {
+				entry->match_type = FILTER_MATCH_NONE;
+			} else {
+				return -1;
+			}
+			have_method = 1;
+		} else {
+			return -1;
+		}
+	}
+
+	if (!have_method && !entry->header_name && entry->event_name) {
+		/* A filter on the event name alone */
+		entry->match_type = FILTER_MATCH_NONE;
+	}
+
+	return 0;
+}
+
 /*!
  * \brief Add an event filter to a manager session
  *
+ * \param criteria  Match criteria of the filter, see below for syntax
  * \param filter_pattern  Filter syntax to add, see below for syntax
  *
  * \return FILTER_ALLOC_FAILED   Memory allocation failure
  * \return FILTER_COMPILE_FAIL   If the filter did not compile
  * \return FILTER_SUCCESS        Success
  *
+ * Without criteria:
  * Filter will be used to match against each line of a manager event
  * Filter can be any valid regular expression
+ * Filter without any regular expression syntax is matched as plain text
  * Filter can be a valid regular expression prefixed with !, which will add the filter as a black filter
  *
+ * With criteria:
+ * action(include|exclude) selects the white or black list
+ * name(Event) only matches events of that name
+ * header(Header) matches the pattern against the value of that header
+ * method(regex|exact|starts_with|contains|none) sets how the pattern is compared
+ *
  * Examples:
  * \code
  *   filter_pattern = "Event: Newchannel"
  *   filter_pattern = "Event: New.*"
  *   filter_pattern = "!Channel: DAHDI.*"
+ *   criteria = "name(Newchannel)", filter_pattern = ""
+ *   criteria = "action(exclude),header(Channel),method(starts_with)", filter_pattern = "DAHDI/"
  * \endcode
  *
  */
-static enum add_filter_result manager_add_filter(const char *filter_pattern, struct ao2_container *whitefilters, struct ao2_container *blackfilters) {
-	regex_t *new_filter = ao2_t_alloc(sizeof(*new_filter), event_filter_destructor, "event_filter allocation");
-	int is_blackfilter;
+static enum add_filter_result manager_add_filter(const char *criteria, const char *filter_pattern, struct ao2_container *whitefilters, struct ao2_container *blackfilters) {
+	struct event_filter_entry *new_filter = ao2_t_alloc(sizeof(*new_filter), event_filter_destructor, "event_filter allocation");
 
 	if (!new_filter) {
 		return FILTER_ALLOC_FAILED;
 	}
 
-	if (filter_pattern[0] == '!') {
-		is_blackfilter = 1;
+	if (!ast_strlen_zero(criteria)) {
+		int res = event_filter_parse_criteria(new_filter, criteria);
+
+		if (res) {
+			ao2_t_ref(new_filter, -1, "failed to parse criteria");
+			return res == -2 ? FILTER_ALLOC_FAILED : FILTER_COMPILE_FAIL;
+		}
+	} else if (filter_pattern[0] == '!') {
+		new_filter->is_excludefilter = 1;
 		filter_pattern++;
-	} else {
-		is_blackfilter = 0;
 	}
 
-	if (regcomp(new_filter, filter_pattern, REG_EXTENDED | REG_NOSUB)) {
-		ao2_t_ref(new_filter, -1, "failed to make regex");
-		return FILTER_COMPILE_FAIL;
+	if (new_filter->match_type == FILTER_MATCH_NONE) {
+		if (!ast_strlen_zero(filter_pattern)) {
+			ao2_t_ref(new_filter, -1, "pattern given without a method");
+			return FILTER_COMPILE_FAIL;
+		}
+	} else if (new_filter->match_type != FILTER_MATCH_REGEX
+		|| !filter_pattern[strcspn(filter_pattern, ".[]()*+?{}|^$\\")]) {
+		if (new_filter->match_type == FILTER_MATCH_REGEX) {
+			new_filter->match_type = FILTER_MATCH_CONTAINS;
+		}
+		new_filter->string_filter = ast_strdup(filter_pattern);
+		if (!new_filter->string_filter) {
+			ao2_t_ref(new_filter, -1, "failed to copy filter");
+			return FILTER_ALLOC_FAILED;
+		}
+	} else {
+		new_filter->regex_filter = ast_calloc(1, sizeof(*new_filter->regex_filter));
+		if (!new_filter->regex_filter) {
+			ao2_t_ref(new_filter, -1, "failed to allocate regex");
+			return FILTER_ALLOC_FAILED;
+		}
+		if (regcomp(new_filter->regex_filter, filter_pattern, REG_EXTENDED | REG_NOSUB)) {
+			ast_free(new_filter->regex_filter);
+			new_filter->regex_filter = NULL;
+			ao2_t_ref(new_filter, -1, "failed to make regex");
+			return FILTER_COMPILE_FAIL;
+		}
 	}
 
-	if (is_blackfilter) {
+	if (new_filter->is_excludefilter) {
 		ao2_t_link(blackfilters, new_filter, "link new filter into black user container");
 	} else {
 		ao2_t_link(whitefilters, new_filter, "link new filter into white user container");
@@ -6062,35 +6475,145 @@ static enum add_filter_result manager_add_filter(const char *filter_pattern, str
 	return FILTER_SUCCESS;
 }
 
-static int match_filter(struct mansession *s, char *eventdata)
+static int match_filter(struct mansession *s, struct eventqent *eqe)
 {
 	int result = 0;
 
 	if (manager_debug) {
-		ast_verbose("<-- Examining AMI event: -->\n%s\n", eventdata);
+		ast_verbose("<-- Examining AMI event: -->\n%s\n", eqe->eventdata);
 	} else {
-		ast_debug(3, "Examining AMI event:\n%s\n", eventdata);
+		ast_debug(3, "Examining AMI event:\n%s\n", eqe->eventdata);
 	}
 	if (!ao2_container_count(s->session->whitefilters) && !ao2_container_count(s->session->blackfilters)) {
 		return 1; /* no filtering means match all */
 	} else if (ao2_container_count(s->session->whitefilters) && !ao2_container_count(s->session->blackfilters)) {
 		/* white filters only: implied black all filter processed first, then white filters */
-		ao2_t_callback_data(s->session->whitefilters, OBJ_NODATA, whitefilter_cmp_fn, eventdata, &result, "find filter in session filter container");
+		ao2_t_callback_data(s->session->whitefilters, OBJ_NODATA, whitefilter_cmp_fn, eqe, &result, "find filter in session filter container");
 	} else if (!ao2_container_count(s->session->whitefilters) && ao2_container_count(s->session->blackfilters)) {
 		/* black filters only: implied white all filter processed first, then black filters */
-		ao2_t_callback_data(s->session->blackfilters, OBJ_NODATA, blackfilter_cmp_fn, eventdata, &result, "find filter in session filter container");
+		ao2_t_callback_data(s->session->blackfilters, OBJ_NODATA, blackfilter_cmp_fn, eqe, &result, "find filter in session filter container");
 	} else {
 		/* white and black filters: implied black all filter processed first, then white filters, and lastly black filters */
-		ao2_t_callback_data(s->session->whitefilters, OBJ_NODATA, whitefilter_cmp_fn, eventdata, &result, "find filter in session filter container");
+		ao2_t_callback_data(s->session->whitefilters, OBJ_NODATA, whitefilter_cmp_fn, eqe, &result, "find filter in session filter container");
 		if (result) {
 			result = 0;
-			ao2_t_callback_data(s->session->blackfilters, OBJ_NODATA, blackfilter_cmp_fn, eventdata, &result, "find filter in session filter container");
+			ao2_t_callback_data(s->session->blackfilters, OBJ_NODATA, blackfilter_cmp_fn, eqe, &result, "find filter in session filter container");
 		}
 	}
 
 	return result;
 }
 
+/*! \brief An event name being checked against the filters of the sessions */
+struct event_name_check {
+	const char *name;
+	unsigned int hash;
+};
+
+/*!
+ * \internal
+ * \brief Find a white filter that could let an event of the name through
+ */
+static int filter_allows_name_cmp_fn(void *obj, void *arg, int flags)
+{
+	struct event_filter_entry *entry = obj;
+	struct event_name_check *check = arg;
+
+	if (!entry->event_name || (entry->event_name_hash == check->hash
+		&& !strcasecmp(entry->event_name, check->name))) {
+		return CMP_MATCH | CMP_STOP;
+	}
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Find a black filter that drops every event of the name
+ */
+static int filter_denies_name_cmp_fn(void *obj, void *arg, int flags)
+{
+	struct event_filter_entry *entry = obj;
+	struct event_name_check *check = arg;
+
+	if (entry->event_name && entry->match_type == FILTER_MATCH_NONE
+		&& entry->event_name_hash == check->hash && !strcasecmp(entry->event_name, check->name)) {
+		return CMP_MATCH | CMP_STOP;
+	}
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Check whether a session can receive an event
+ *
+ * \note Only the category and the filters on event names are looked at,
+ * so a session may still drop the event once it is built.
+ */
+static int session_may_want_event(struct mansession_session *session, int category, struct event_name_check *check)
+{
+	struct event_filter_entry *entry;
+
+	if (!session->authenticated
+		|| (session->readperm & category) != category
+		|| (session->send_events & category) != category) {
+		return 0;
+	}
+
+	if (ao2_container_count(session->whitefilters)) {
+		entry = ao2_callback(session->whitefilters, 0, filter_allows_name_cmp_fn, check);
+		if (!entry) {
+			return 0;
+		}
+		ao2_ref(entry, -1);
+	}
+
+	if (ao2_container_count(session->blackfilters)) {
+		entry = ao2_callback(session->blackfilters, 0, filter_denies_name_cmp_fn, check);
+		if (entry) {
+			ao2_ref(entry, -1);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/*!
+ * \internal
+ * \brief Check whether an event needs to be built at all
+ *
+ * \retval 0 if no session and no hook can receive the event
+ * \retval 1 otherwise
+ */
+static int manager_event_wanted(struct ao2_container *sessions, int category, const char *event)
+{
+	struct event_name_check check = {
+		.name = event,
+		.hash = ast_str_case_hash(event),
+	};
+	struct ao2_iterator iter;
+	struct mansession_session *session;
+	int wanted = 0;
+
+	if (category == EVENT_FLAG_SHUTDOWN || !AST_RWLIST_EMPTY(&manager_hooks)) {
+		return 1;
+	}
+	if (!sessions) {
+		return 0;
+	}
+
+	iter = ao2_iterator_init(sessions, 0);
+	while (!wanted && (session = ao2_iterator_next(&iter))) {
+		wanted = session_may_want_event(session, category, &check);
+		unref_mansession(session);
+	}
+	ao2_iterator_destroy(&iter);
+
+	return wanted;
+}
+
 /*!
  * Send any applicable events to the client listening on this socket.
  * Wait only for a finite time on each event, and drop all events whether
@@ -6103,6 +6626,8 @@ static int process_events(struct mansession *s)
 	ao2_lock(s->session);
 	if (s->session->stream != NULL) {
 		struct eventqent *eqe = s->session->last_ev;
+		struct eventqent *batch[MANAGER_EVENT_BATCH];
+		int count = 0;
 
 		while ((eqe = advance_event(eqe))) {
 			if (eqe->category == EVENT_FLAG_SHUTDOWN) {
@@ -6112,13 +6637,22 @@ static int process_events(struct mansession *s)
 			if (!ret && s->session->authenticated &&
 			    (s->session->readperm & eqe->category) == eqe->category &&
 			    (s->session->send_events & eqe->category) == eqe->category) {
-					if (match_filter(s, eqe->eventdata)) {
-						if (send_string(s, eqe->eventdata) < 0)
-							ret = -1;	/* don't send more */
+					if (match_filter(s, eqe)) {
+						/* Keep the event in the queue until it is written */
+						ast_atomic_fetchadd_int(&eqe->usecount, 1);
+						batch[count++] = eqe;
+						if (count == ARRAY_LEN(batch)) {
+							if (send_events(s, batch, count) < 0)
+								ret = -1;	/* don't send more */
+							count = 0;
+						}
 					}
 			}
 			s->session->last_ev = eqe;
 		}
+		if (count && send_events(s, batch, count) < 0) {
+			ret = -1;
+		}
 	}
 	ao2_unlock(s->session);
 	return ret;
@@ -6698,10 +7232,19 @@ static int do_message(struct mansession *s)
 {
 	struct message m = { 0 };
 	char header_buf[sizeof(s->session->inbuf)] = { '\0' };
+	struct ast_arena *arena;
+	struct ast_arena_mark mark;
 	int res;
 	int hdr_loss;
 	time_t now;
 
+	/* The header lines only live as long as this message, keep them in the thread's arena */
+	arena = ast_arena_thread_get();
+	if (!arena) {
+		return -1;
+	}
+	ast_arena_mark(arena, &mark);
+
 	hdr_loss = 0;
 	for (;;) {
 		/* Check if any events are pending and do them if needed */
@@ -6749,7 +7292,7 @@ static int do_message(struct mansession *s)
 				}
 				break;
 			} else if (m.hdrcount < ARRAY_LEN(m.headers)) {
-				m.headers[m.hdrcount] = ast_strdup(header_buf);
+				m.headers[m.hdrcount] = ast_arena_strdup(arena, header_buf);
 				if (!m.headers[m.hdrcount]) {
 					/* Allocation failure. */
 					hdr_loss = 1;
@@ -6766,7 +7309,7 @@ static int do_message(struct mansession *s)
 		}
 	}
 
-	astman_free_headers(&m);
+	ast_arena_release(arena, &mark);
 
 	return res;
 }
@@ -6910,9 +7453,10 @@ static void purge_sessions(int n_max)
  * events are appended to a queue from where they
  * can be dispatched to clients.
  */
-static int append_event(const char *str, int category)
+static int append_event(const char *str, const char *event, int category)
 {
-	struct eventqent *tmp = ast_malloc(sizeof(*tmp) + strlen(str));
+	size_t len = strlen(str);
+	struct eventqent *tmp = ast_malloc(sizeof(*tmp) + len + strlen(event) + 1);
 	static int seq;	/* sequence number */
 
 	if (!tmp) {
@@ -6926,6 +7470,8 @@ static int append_event(const char *str, int category)
 	tmp->tv = ast_tvnow();
 	AST_RWLIST_NEXT(tmp, eq_next) = NULL;
 	strcpy(tmp->eventdata, str);
+	tmp->event_name = strcpy(tmp->eventdata + len + 1, event);
+	tmp->event_name_hash = ast_str_case_hash(event);
 
 	AST_RWLIST_WRLOCK(&all_events);
 	AST_RWLIST_INSERT_TAIL(&all_events, tmp, eq_next);
@@ -6978,10 +7524,12 @@ static int __attribute__((format(printf, 9, 0))) __manager_event_sessions_va(
 	}
 
 	cat_str = authority_to_str(category, &auth);
-	ast_str_set(&buf, 0,
-		"Event: %s\r\n"
-		"Privilege: %s\r\n",
-		event, cat_str);
+	ast_str_reset(buf);
+	ast_str_append_literal(&buf, 0, "Event: ");
+	ast_str_append_cstr(&buf, 0, event);
+	ast_str_append_literal(&buf, 0, "\r\nPrivilege: ");
+	ast_str_append_cstr(&buf, 0, cat_str);
+	ast_str_append_literal(&buf, 0, "\r\n");
 
 	if (timestampevents) {
 		now = ast_tvnow();
@@ -7002,19 +7550,24 @@ static int __attribute__((format(printf, 9, 0))) __manager_event_sessions_va(
 			file, line, func);
 	}
 	if (!ast_strlen_zero(ast_config_AST_SYSTEM_NAME)) {
-		ast_str_append(&buf, 0,
-			"SystemName: %s\r\n",
-			ast_config_AST_SYSTEM_NAME);
+		ast_str_append_literal(&buf, 0, "SystemName: ");
+		ast_str_append_cstr(&buf, 0, ast_config_AST_SYSTEM_NAME);
+		ast_str_append_literal(&buf, 0, "\r\n");
 	}
 
+	/*
+	 * The body usually carries a handful of fields per line of format
+	 * string, so size for that and let vsnprintf succeed on its first pass.
+	 */
+	ast_str_reserve(&buf, strlen(fmt) * 2);
 	ast_str_append_va(&buf, 0, fmt, ap);
 	for (i = 0; i < chancount; i++) {
 		append_channel_vars(&buf, chans[i]);
 	}
 
-	ast_str_append(&buf, 0, "\r\n");
+	ast_str_append_literal(&buf, 0, "\r\n");
 
-	append_event(ast_str_buffer(buf), category);
+	append_event(ast_str_buffer(buf), event, category);
 
 	/* Wake up any sleeping sessions */
 	if (sessions) {
@@ -7083,7 +7636,8 @@ int __ast_manager_event_multichan(int category, const char *event, int chancount
 	va_list ap;
 	int res;
 
-	if (!any_manager_listeners(sessions)) {
+	if (!any_manager_listeners(sessions)
+		|| !manager_event_wanted(sessions, category, event)) {
 		/* Nobody is listening */
 		ao2_cleanup(sessions);
 		return 0;
@@ -8538,6 +9092,8 @@ static char *handle_manager_show_settings(struct ast_cli_entry *e, int cmd, stru
 	ast_cli(a->fd, FORMAT, "Allow multiple login:", AST_CLI_YESNO(allowmultiplelogin));
 	ast_cli(a->fd, FORMAT, "Display connects:", AST_CLI_YESNO(displayconnects));
 	ast_cli(a->fd, FORMAT, "Timestamp events:", AST_CLI_YESNO(timestampevents));
+	ast_cli(a->fd, FORMAT2, "Originate threads:", originate_threads);
+	ast_cli(a->fd, FORMAT2, "Originate rate:", originate_rate);
 	ast_cli(a->fd, FORMAT, "Channel vars:", S_OR(manager_channelvars, ""));
 	ast_cli(a->fd, FORMAT, "Debug:", AST_CLI_YESNO(manager_debug));
 #undef FORMAT
@@ -8847,6 +9403,9 @@ static void manager_shutdown(void)
 	ast_custom_function_unregister(&managerclient_function);
 	ast_cli_unregister_multiple(cli_manager, ARRAY_LEN(cli_manager));
 
+	ast_threadpool_shutdown(originate_pool);
+	originate_pool = NULL;
+
 #ifdef AST_XML_DOCS
 	ao2_t_global_obj_release(event_docs, "Dispose of event_docs");
 #endif
@@ -8966,6 +9525,7 @@ static void manager_set_defaults(void)
 	broken_events_action = 0;
 	authtimeout = 30;
 	authlimit = 50;
+	originate_rate = 0;
 	manager_debug = 0;		/* Debug disabled by default */
 
 	/* default values */
@@ -9068,7 +9628,7 @@ static int __init_manager(int reload, int by_external_config)
 		ast_extension_state_add(NULL, NULL, manager_state_cb, NULL);
 
 		/* Append placeholder event so master_eventq never runs dry */
-		if (append_event("Event: Placeholder\r\n\r\n", 0)) {
+		if (append_event("Event: Placeholder\r\n\r\n", "Placeholder", 0)) {
 			return -1;
 		}
 
@@ -9182,6 +9742,21 @@ static int __init_manager(int reload, int by_external_config)
 			} else {
 				authlimit = limit;
 			}
+		} else if (!strcasecmp(var->name, "originatethreads")) {
+			int threads;
+
+			if (ast_parse_arg(val, PARSE_INT32 | PARSE_IN_RANGE, &threads, 0, 1000)) {
+				ast_log(LOG_WARNING, "Invalid originatethreads value '%s'\n", val);
+			} else if (originate_pool && threads != originate_threads) {
+				ast_log(LOG_NOTICE, "Changing originatethreads requires a restart\n");
+			} else {
+				originate_threads = threads;
+			}
+		} else if (!strcasecmp(var->name, "originaterate")) {
+			if (ast_parse_arg(val, PARSE_INT32 | PARSE_IN_RANGE, &originate_rate, 0, 1000)) {
+				ast_log(LOG_WARNING, "Invalid originaterate value '%s'\n", val);
+				originate_rate = 0;
+			}
 		} else if (!strcasecmp(var->name, "channelvars")) {
 			load_channelvars(var);
 		} else {
@@ -9190,6 +9765,21 @@ static int __init_manager(int reload, int by_external_config)
 		}
 	}
 
+	if (originate_threads && !originate_pool) {
+		struct ast_threadpool_options options = {
+			.version = AST_THREADPOOL_OPTIONS_VERSION,
+			.auto_increment = 1,
+			.max_size = originate_threads,
+			.idle_timeout = 60,
+			.initial_size = 0,
+		};
+
+		originate_pool = ast_threadpool_create("manager_originate", NULL, &options);
+		if (!originate_pool) {
+			ast_log(LOG_WARNING, "Unable to create originate pool, using a thread per originate\n");
+		}
+	}
+
 	if (manager_enabled && !subscribed) {
 		if (subscribe_all() != 0) {
 			ast_log(LOG_ERROR, "Manager subscription error\n");
@@ -9406,7 +9996,19 @@ static int __init_manager(int reload, int by_external_config)
 				}
 			} else if (!strcasecmp(var->name, "eventfilter")) {
 				const char *value = var->value;
-				manager_add_filter(value, user->whitefilters, user->blackfilters);
+				manager_add_filter(NULL, value, user->whitefilters, user->blackfilters);
+			} else if (!strncasecmp(var->name, "eventfilter(", 12)) {
+				char *criteria = ast_strdupa(var->name + 12);
+				size_t len = strlen(criteria);
+
+				if (!len || criteria[len - 1] != ')') {
+					ast_log(LOG_WARNING, "Invalid %s for user %s\n", var->name, user->username);
+					continue;
+				}
+				criteria[len - 1] = '\0';
+				if (manager_add_filter(criteria, var->value, user->whitefilters, user->blackfilters) != FILTER_SUCCESS) {
+					ast_log(LOG_WARNING, "Invalid %s for user %s\n", var->name, user->username);
+				}
 			} else {
 				ast_debug(1, "%s is an unknown option.\n", var->name);
 			}
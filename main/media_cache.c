@@ -197,8 +197,8 @@ int ast_media_cache_retrieve(const char *uri, const char *preferred_file_name,
 	char *file_path, size_t len)
 {
 	struct ast_bucket_file *bucket_file;
+	struct ast_bucket_file *existing;
 	char *ext;
-	SCOPED_AO2LOCK(media_lock, media_cache);
 
 	if (ast_strlen_zero(uri)) {
 		return -1;
@@ -207,8 +207,12 @@ int ast_media_cache_retrieve(const char *uri, const char *preferred_file_name,
 	/* First, retrieve from the ao2 cache here. If we find a bucket_file
 	 * matching the requested URI, ask the appropriate backend if it is
 	 * stale. If not; return it.
+	 *
+	 * The container is not kept locked while the backend is asked, as that
+	 * may mean a round trip to a remote server; other lookups must not wait
+	 * behind it.
 	 */
-	bucket_file = ao2_find(media_cache, uri, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	bucket_file = ao2_find(media_cache, uri, OBJ_SEARCH_KEY);
 	if (bucket_file) {
 		if (!ast_bucket_file_is_stale(bucket_file)
 			&& ast_file_is_readable(bucket_file->path)) {
@@ -223,8 +227,13 @@ int ast_media_cache_retrieve(const char *uri, const char *preferred_file_name,
 		}
 
 		/* Stale! Remove the item completely, as we're going to replace it next */
-		ao2_unlink_flags(media_cache, bucket_file, OBJ_NOLOCK);
-		ast_bucket_file_delete(bucket_file);
+		existing = ao2_callback(media_cache, OBJ_UNLINK | OBJ_SEARCH_OBJECT,
+			ao2_match_by_addr, bucket_file);
+		if (existing) {
+			/* Only the caller that unlinked it gets to remove the file */
+			ast_bucket_file_delete(existing);
+			ao2_ref(existing, -1);
+		}
 		ao2_ref(bucket_file, -1);
 	}
 
@@ -241,12 +250,27 @@ int ast_media_cache_retrieve(const char *uri, const char *preferred_file_name,
 	 * let anyone know of its existence yet
 	 */
 	bucket_file_update_path(bucket_file, preferred_file_name);
-	media_cache_item_sync_to_astdb(bucket_file);
+
+	ao2_lock(media_cache);
+	existing = ao2_find(media_cache, uri, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if (existing) {
+		/* Someone else retrieved the same media meanwhile; their copy may
+		 * already be playing, so keep it and drop ours.
+		 */
+		ao2_unlock(media_cache);
+		ast_bucket_file_delete(bucket_file);
+		ao2_ref(bucket_file, -1);
+		bucket_file = existing;
+	} else {
+		media_cache_item_sync_to_astdb(bucket_file);
+		ao2_link_flags(media_cache, bucket_file, OBJ_NOLOCK);
+		ao2_unlock(media_cache);
+	}
+
 	ast_copy_string(file_path, bucket_file->path, len);
 	if ((ext = strrchr(file_path, '.'))) {
 		*ext = '\0';
 	}
-	ao2_link_flags(media_cache, bucket_file, OBJ_NOLOCK);
 	ao2_ref(bucket_file, -1);
 
 	ast_debug(5, "Returning media at local file: %s\n", file_path);
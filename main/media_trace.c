@@ -0,0 +1,282 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2019, Sangoma Technologies Corporation
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*! \file
+ *
+ * \brief Sampled media frame latency tracing
+ */
+
+/*** MODULEINFO
+	<support_level>core</support_level>
+ ***/
+
+#include "asterisk.h"
+
+#include "asterisk/_private.h"
+#include "asterisk/cli.h"
+#include "asterisk/lock.h"
+#include "asterisk/media_trace.h"
+#include "asterisk/utils.h"
+
+/*!
+ * \brief Number of log2 microsecond buckets in the latency histograms
+ *
+ * Bucket 0 counts everything under 2us, bucket n counts [2^n, 2^(n+1)) us
+ * and the last bucket counts everything from about 1 second up.
+ */
+#define MEDIA_TRACE_BUCKETS 21
+
+/*! Latencies above this are from frames with a stale stamp and are ignored */
+#define MEDIA_TRACE_MAX_LATENCY (60 * 1000000LL)
+
+/*! Number of bridge technologies latencies are kept apart for */
+#define MEDIA_TRACE_GROUPS 16
+
+/*! \brief Latency histograms of one bridge technology */
+struct media_trace_group {
+	/*! Bridge technology name, empty for frames not written into a bridge */
+	char name[32];
+	/*! Traced frames by latency, per stage */
+	unsigned long histogram[AST_MEDIA_TRACE_STAGES][MEDIA_TRACE_BUCKETS];
+};
+
+static const char *stage_names[AST_MEDIA_TRACE_STAGES] = {
+	[AST_MEDIA_TRACE_READ] = "ast_read",
+	[AST_MEDIA_TRACE_BRIDGE] = "bridge write",
+	[AST_MEDIA_TRACE_WRITE] = "ast_write",
+	[AST_MEDIA_TRACE_SEND] = "RTP send",
+};
+
+/*! Protects groups and group_count */
+AST_MUTEX_DEFINE_STATIC(media_trace_lock);
+static struct media_trace_group groups[MEDIA_TRACE_GROUPS];
+static int group_count = 1;
+
+/*! Trace one in this many received frames, 0 to trace none */
+static unsigned int sample_interval;
+
+/*! Received frames counted towards the next sample */
+static int sample_count;
+
+void ast_media_trace_start(struct ast_frame *f)
+{
+	unsigned int interval = sample_interval;
+
+	f->trace_group = 0;
+	if (interval && !(((unsigned int) ast_atomic_fetchadd_int(&sample_count, +1)) % interval)) {
+		f->trace_start = ast_tvnow();
+	} else {
+		f->trace_start = ast_tv(0, 0);
+	}
+}
+
+/*! \brief Histogram bucket for a time in microseconds */
+static unsigned int media_trace_bucket(int64_t usec)
+{
+	unsigned int bucket = 0;
+
+	while (usec > 1 && bucket < MEDIA_TRACE_BUCKETS - 1) {
+		usec >>= 1;
+		++bucket;
+	}
+	return bucket;
+}
+
+/*!
+ * \internal
+ * \brief Find or add the group of a bridge technology
+ * \pre media_trace_lock is held
+ * \return Group index, 0 if the table is full
+ */
+static int media_trace_group_find(const char *name)
+{
+	int i;
+
+	for (i = 1; i < group_count; ++i) {
+		if (!strcmp(groups[i].name, name)) {
+			return i;
+		}
+	}
+	if (group_count == MEDIA_TRACE_GROUPS) {
+		return 0;
+	}
+	ast_copy_string(groups[group_count].name, name, sizeof(groups[group_count].name));
+	return group_count++;
+}
+
+void __ast_media_trace_stage(struct ast_frame *f, enum ast_media_trace_stage stage,
+	const char *group)
+{
+	int64_t latency = ast_tvdiff_us(ast_tvnow(), f->trace_start);
+
+	if (latency < 0 || latency > MEDIA_TRACE_MAX_LATENCY) {
+		return;
+	}
+
+	ast_mutex_lock(&media_trace_lock);
+	if (group) {
+		f->trace_group = media_trace_group_find(group);
+	}
+	if (f->trace_group < 0 || f->trace_group >= group_count) {
+		f->trace_group = 0;
+	}
+	++groups[f->trace_group].histogram[stage][media_trace_bucket(latency)];
+	ast_mutex_unlock(&media_trace_lock);
+}
+
+static char *handle_set_media_trace(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	unsigned int interval;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "core set media trace";
+		e->usage =
+			"Usage: core set media trace {off|<n>}\n"
+			"       Traces one in every <n> received media frames through the\n"
+			"media path, or stops tracing.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 5) {
+		return CLI_SHOWUSAGE;
+	}
+
+	if (!strcasecmp(a->argv[4], "off")) {
+		interval = 0;
+	} else if (sscanf(a->argv[4], "%30u", &interval) != 1 || !interval) {
+		return CLI_SHOWUSAGE;
+	}
+
+	sample_interval = interval;
+	if (interval) {
+		ast_cli(a->fd, "Tracing one in every %u received media frames.\n", interval);
+	} else {
+		ast_cli(a->fd, "Media tracing is off.\n");
+	}
+
+	return CLI_SUCCESS;
+}
+
+static char *handle_show_media_trace(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct media_trace_group *snapshot;
+	int count;
+	int reset = 0;
+	int i;
+	int stage;
+	int bucket;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "core show media trace";
+		e->usage =
+			"Usage: core show media trace [reset]\n"
+			"       Shows the latency of traced media frames at each stage of the\n"
+			"media path since they were received, per bridge technology.  With\n"
+			"'reset', the histograms are cleared after they are shown.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return a->pos == 4 ? ast_cli_complete(a->word, (const char * const []){ "reset", NULL }, a->n) : NULL;
+	}
+
+	if (a->argc == 5 && !strcasecmp(a->argv[4], "reset")) {
+		reset = 1;
+	} else if (a->argc != 4) {
+		return CLI_SHOWUSAGE;
+	}
+
+	snapshot = ast_malloc(sizeof(groups));
+	if (!snapshot) {
+		return CLI_FAILURE;
+	}
+
+	ast_mutex_lock(&media_trace_lock);
+	memcpy(snapshot, groups, sizeof(groups));
+	count = group_count;
+	if (reset) {
+		memset(groups, 0, sizeof(groups));
+		group_count = 1;
+	}
+	ast_mutex_unlock(&media_trace_lock);
+
+	if (sample_interval) {
+		ast_cli(a->fd, "\nTracing one in every %u received media frames.\n", sample_interval);
+	} else {
+		ast_cli(a->fd, "\nMedia tracing is off.\n");
+	}
+
+	for (i = 0; i < count; ++i) {
+		ast_cli(a->fd, "\n%s:\n%-20s", i ? snapshot[i].name : "Not bridged", "Latency (us)");
+		for (stage = 0; stage < AST_MEDIA_TRACE_STAGES; ++stage) {
+			ast_cli(a->fd, " %12s", stage_names[stage]);
+		}
+		ast_cli(a->fd, "\n");
+
+		for (bucket = 0; bucket < MEDIA_TRACE_BUCKETS; ++bucket) {
+			char range[32];
+			int used = 0;
+
+			for (stage = 0; stage < AST_MEDIA_TRACE_STAGES; ++stage) {
+				used |= !!snapshot[i].histogram[stage][bucket];
+			}
+			if (!used) {
+				continue;
+			}
+
+			if (bucket == 0) {
+				snprintf(range, sizeof(range), "< 2");
+			} else if (bucket == MEDIA_TRACE_BUCKETS - 1) {
+				snprintf(range, sizeof(range), ">= %lu", 1UL << bucket);
+			} else {
+				snprintf(range, sizeof(range), "%lu - %lu", 1UL << bucket, (1UL << (bucket + 1)) - 1);
+			}
+			ast_cli(a->fd, "%-20s", range);
+			for (stage = 0; stage < AST_MEDIA_TRACE_STAGES; ++stage) {
+				ast_cli(a->fd, " %12lu", snapshot[i].histogram[stage][bucket]);
+			}
+			ast_cli(a->fd, "\n");
+		}
+	}
+	ast_cli(a->fd, "\n");
+
+	ast_free(snapshot);
+
+	return CLI_SUCCESS;
+}
+
+static struct ast_cli_entry media_trace_cli[] = {
+	AST_CLI_DEFINE(handle_set_media_trace, "Trace a share of received media frames"),
+	AST_CLI_DEFINE(handle_show_media_trace, "Show media path latency of traced frames"),
+};
+
+static void media_trace_shutdown(void)
+{
+	sample_interval = 0;
+	ast_cli_unregister_multiple(media_trace_cli, ARRAY_LEN(media_trace_cli));
+}
+
+int ast_media_trace_init(void)
+{
+	if (ast_cli_register_multiple(media_trace_cli, ARRAY_LEN(media_trace_cli))) {
+		return -1;
+	}
+	ast_register_cleanup(media_trace_shutdown);
+
+	return 0;
+}
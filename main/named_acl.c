@@ -100,13 +100,17 @@ struct aco_file named_acl_conf = {
 	.types = ACO_TYPES(&named_acl_type),
 };
 
+static int named_acl_pre_apply_config(void);
+
 /* Create a config info struct that describes the config processing for named ACLs. */
 CONFIG_INFO_CORE("named_acl", cfg_info, globals, named_acl_config_alloc,
 	.files = ACO_FILES(&named_acl_conf),
+	.pre_apply_config = named_acl_pre_apply_config,
 );
 
 struct named_acl {
 	struct ast_ha *ha;
+	struct ast_ha_trie *trie; /* Compiled rules shared by everything using this ACL */
 	char name[ACL_NAME_LENGTH]; /* Same max length as a configuration category */
 };
 
@@ -149,6 +153,7 @@ static void destroy_named_acl(void *obj)
 {
 	struct named_acl *named_acl = obj;
 	ast_free_ha(named_acl->ha);
+	ao2_cleanup(named_acl->trie);
 }
 
 /*!
@@ -186,6 +191,36 @@ static void *named_acl_find(struct ao2_container *container, const char *cat)
 	return ao2_find(container, &tmp, OBJ_POINTER);
 }
 
+/*! \brief Compile the rules of a named ACL */
+static int named_acl_compile(void *obj, void *arg, int flags)
+{
+	struct named_acl *named_acl = obj;
+
+	ao2_cleanup(named_acl->trie);
+	named_acl->trie = ast_ha_trie_alloc(named_acl->ha);
+	if (!named_acl->trie) {
+		ast_log(LOG_ERROR, "Failed to compile named ACL '%s'\n", named_acl->name);
+		return CMP_MATCH | CMP_STOP;
+	}
+
+	return 0;
+}
+
+/*! \brief Compile every named ACL before a new configuration is applied */
+static int named_acl_pre_apply_config(void)
+{
+	struct named_acl_config *cfg = aco_pending_config(&cfg_info);
+	struct named_acl *failed;
+
+	failed = ao2_callback(cfg->named_acl_list, 0, named_acl_compile, NULL);
+	if (failed) {
+		ao2_ref(failed, -1);
+		return -1;
+	}
+
+	return 0;
+}
+
 /*!
  * \internal
  * \brief Callback function to compare the ACL order of two given categories.
@@ -291,6 +326,12 @@ static struct named_acl *named_acl_find_realtime(const char *name)
 }
 
 struct ast_ha *ast_named_acl_find(const char *name, int *is_realtime, int *is_undefined)
+{
+	return ast_named_acl_find_compiled(name, NULL, is_realtime, is_undefined);
+}
+
+struct ast_ha *ast_named_acl_find_compiled(const char *name, struct ast_ha_trie **trie,
+	int *is_realtime, int *is_undefined)
 {
 	struct ast_ha *ha = NULL;
 
@@ -305,6 +346,10 @@ struct ast_ha *ast_named_acl_find(const char *name, int *is_realtime, int *is_un
 		*is_undefined = 0;
 	}
 
+	if (trie) {
+		*trie = NULL;
+	}
+
 	/* If the config or its named_acl_list hasn't been initialized, abort immediately. */
 	if ((!cfg) || (!(cfg->named_acl_list))) {
 		ast_log(LOG_ERROR, "Attempted to find named ACL '%s', but the ACL configuration isn't available.\n", name);
@@ -344,6 +389,10 @@ struct ast_ha *ast_named_acl_find(const char *name, int *is_realtime, int *is_un
 
 	ha = ast_duplicate_ha_list(named_acl->ha);
 
+	if (trie && (ha || !named_acl->ha)) {
+		*trie = ao2_bump(named_acl->trie);
+	}
+
 	if (!ha) {
 		ast_log(LOG_NOTICE, "ACL '%s' contains no rules. It is valid, but it will accept addresses unconditionally.\n", name);
 	}
@@ -79,6 +79,9 @@ int ast_option_maxcalls;
 int ast_option_maxfiles;
 /*! Minimum duration of DTMF. */
 unsigned int option_dtmfminduration = AST_MIN_DTMF_DURATION;
+/*! Memory cap of the translated prompt cache in KiB. (0 disables it) */
+unsigned int ast_option_prompt_cache_size;
+unsigned int ast_option_file_writer_threads = 2;
 #if defined(HAVE_SYSINFO)
 /*! Minimum amount of free system memory - stop accepting calls if free memory falls below this watermark */
 long option_minmemfree;
@@ -343,6 +346,8 @@ void load_asterisk_conf(void)
 		/* Cache recorded sound files to another directory during recording */
 		} else if (!strcasecmp(v->name, "cache_record_files")) {
 			ast_set2_flag(&ast_options, ast_true(v->value), AST_OPT_FLAG_CACHE_RECORD_FILES);
+		} else if (!strcasecmp(v->name, "mmap_sound_files")) {
+			ast_set2_flag(&ast_options, ast_true(v->value), AST_OPT_FLAG_MMAP_SOUND_FILES);
 #if !defined(LOW_MEMORY)
 		/* Cache media frames for performance */
 		} else if (!strcasecmp(v->name, "cache_media_frames")) {
@@ -361,6 +366,14 @@ void load_asterisk_conf(void)
 			if (sscanf(v->value, "%30u", &option_dtmfminduration) != 1) {
 				option_dtmfminduration = AST_MIN_DTMF_DURATION;
 			}
+		} else if (!strcasecmp(v->name, "prompt_cache_size")) {
+			if (sscanf(v->value, "%30u", &ast_option_prompt_cache_size) != 1) {
+				ast_option_prompt_cache_size = 0;
+			}
+		} else if (!strcasecmp(v->name, "file_writer_threads")) {
+			if (sscanf(v->value, "%30u", &ast_option_file_writer_threads) != 1) {
+				ast_option_file_writer_threads = 2;
+			}
 		} else if (!strcasecmp(v->name, "rtp_use_dynamic")) {
 			ast_option_rtpusedynamic = ast_true(v->value);
 		/* http://www.iana.org/assignments/rtp-parameters
@@ -72,6 +72,7 @@
 #include "asterisk/dial.h"
 #include "asterisk/vector.h"
 #include "pbx_private.h"
+#include "astobj2_private.h"
 
 /*!
  * \note I M P O R T A N T :
@@ -247,6 +248,7 @@ struct ast_exten {
 	struct ast_app *cached_app;     /*!< Cached location of application */
 	void *data;			/*!< Data to use (arguments) */
 	void (*datad)(void *);		/*!< Data destructor */
+	struct pbx_substitution *substitution; /*!< Data parsed for substitution, if it substitutes anything */
 	struct ast_exten *peer;		/*!< Next higher priority with our extension */
 	struct ast_hashtab *peer_table;    /*!< Priorities list in hashtab form -- only on the head of the peer list */
 	struct ast_hashtab *peer_label_table; /*!< labeled priorities in the peers -- only on the head of the peer list */
@@ -280,6 +282,41 @@ struct scoreboard  /* make sure all fields are 0 before calling new_find_extensi
 	struct ast_exten *exten;
 };
 
+/*! Number of sets in the lookup cache of a context. */
+#define EXTEN_CACHE_SETS 32
+/*! Number of lookups remembered per set. */
+#define EXTEN_CACHE_WAYS 2
+
+/*! \brief A remembered lookup */
+struct exten_cache_entry {
+	/*! Dialplan version the lookup was made in.  (0 if unused) */
+	unsigned int version;
+	/*! Priority looked up. */
+	int priority;
+	/*! Extension found. */
+	struct ast_exten *e;
+	/*! Name of the context it was found in. */
+	const char *foundcontext;
+	/*! Extension looked up. */
+	char exten[AST_MAX_EXTENSION];
+	/*! Caller ID looked up. */
+	char callerid[AST_MAX_EXTENSION];
+};
+
+/*!
+ * \brief Lookups recently resolved starting in a context
+ *
+ * \details Each lookup hashes to a set and replaces the least
+ * recently used entry of that set.  Entries are only used while
+ * the dialplan version they were made in is current.
+ */
+struct exten_cache {
+	ast_mutex_t lock;
+	/*! Entry of each set used last. */
+	unsigned char recent[EXTEN_CACHE_SETS];
+	struct exten_cache_entry entries[EXTEN_CACHE_SETS][EXTEN_CACHE_WAYS];
+};
+
 /*! \brief ast_context: An extension context - must remain in sync with fake_context */
 struct ast_context {
 	ast_rwlock_t lock;			/*!< A lock to prevent multiple threads from clobbering the context */
@@ -294,6 +331,9 @@ struct ast_context {
 	int refcount;                   /*!< each module that would have created this context should inc/dec this as appropriate */
 	int autohints;                  /*!< Whether autohints support is enabled or not */
 	ast_mutex_t macrolock;			/*!< A lock to implement "exclusive" macros - held whilst a call is executing in the macro */
+	struct exten_cache *cache;		/*!< Recent lookups starting in this context.  (Allocated on first lookup) */
+	int writing;				/*!< Set while the context is write locked */
+	int live;				/*!< Set while the context is part of the running dialplan */
 	char name[0];				/*!< Name of the context */
 };
 
@@ -343,6 +383,18 @@ struct ast_hint {
 	char exten_name[AST_MAX_EXTENSION];/*!< Extension of destroyed hint extension. */
 
 	AST_VECTOR(, char *) devices; /*!< Devices associated with the hint */
+
+	/*!
+	 * \brief Last known state of each device in the hint, in hint order
+	 *
+	 * \note Together with device_state_counts this allows a device state
+	 * change to be applied without querying every device in the hint.
+	 */
+	AST_VECTOR(, struct ast_device_state_info *) device_states;
+	/*! Number of devices in the hint currently in each device state */
+	int device_state_counts[AST_DEVICE_TOTAL];
+	/*! Set when device_states reflects the current hint extension */
+	int device_states_valid;
 };
 
 STASIS_MESSAGE_TYPE_DEFN_LOCAL(hint_change_message_type);
@@ -784,6 +836,22 @@ static struct ast_hashtab *contexts_table = NULL;
  */
 AST_MUTEX_DEFINE_STATIC(conlock);
 
+/*! Nesting depth of conlock. */
+static int conlock_depth;
+/*! Set while conlock is held by a writer at any depth. */
+static int conlock_writing;
+
+/*!
+ * \brief Dialplan version.
+ * \note Changes whenever a writer releases a dialplan lock.  Never 0.
+ */
+static unsigned int dialplan_version = 1;
+/*! Number of dialplan writers holding a lock. */
+static int dialplan_writers;
+
+/*! Protects creating the lookup caches of contexts. */
+AST_MUTEX_DEFINE_STATIC(exten_cache_create_lock);
+
 /*!
  * \brief Lock to hold off restructuring of hints by ast_merge_contexts_and_delete.
  */
@@ -2422,6 +2490,9 @@ struct fake_context /* this struct is purely for matching in the hashtab */
 	int refcount;
 	int autohints;
 	ast_mutex_t macrolock;
+	struct exten_cache *cache;
+	int writing;
+	int live;
 	char name[256];
 };
 
@@ -2467,10 +2538,233 @@ static int matchcid(const char *cidpattern, const char *callerid)
 	return ast_extension_match(cidpattern, callerid);
 }
 
+/*!
+ * \internal
+ * \brief Note that a dialplan writer took a lock.
+ *
+ * \details Lookups answered from the caches hold no lock.  Once
+ * this returns every such lookup has either finished or will see
+ * the writer and take the locks instead, so the writer may free
+ * what they were using.
+ */
+static void dialplan_write_begin(void)
+{
+	ast_atomic_fetch_add(&dialplan_writers, 1, __ATOMIC_SEQ_CST);
+	ao2_rcu_synchronize();
+}
+
+/*!
+ * \internal
+ * \brief Note that a dialplan writer is done.
+ *
+ * \note The version changes before the writer stops counting so
+ * a lookup that sees no writers also sees every finished change.
+ */
+static void dialplan_write_end(void)
+{
+	if (!ast_atomic_add_fetch(&dialplan_version, 1, __ATOMIC_SEQ_CST)) {
+		ast_atomic_add_fetch(&dialplan_version, 1, __ATOMIC_SEQ_CST);
+	}
+	ast_atomic_fetch_add(&dialplan_writers, -1, __ATOMIC_SEQ_CST);
+}
+
+/*!
+ * \internal
+ * \brief Get the dialplan version lookups can be cached in.
+ *
+ * \retval 0 if a writer is changing the dialplan.
+ */
+static unsigned int dialplan_version_stable(void)
+{
+	if (ast_atomic_load_n(&dialplan_writers, __ATOMIC_SEQ_CST)) {
+		return 0;
+	}
+	return ast_atomic_load_n(&dialplan_version, __ATOMIC_SEQ_CST);
+}
+
+static struct exten_cache *exten_cache_get(struct ast_context *con)
+{
+	struct exten_cache *cache = ast_atomic_load_n(&con->cache, __ATOMIC_ACQUIRE);
+
+	if (cache) {
+		return cache;
+	}
+
+	ast_mutex_lock(&exten_cache_create_lock);
+	cache = con->cache;
+	if (!cache && (cache = ast_calloc(1, sizeof(*cache)))) {
+		ast_mutex_init(&cache->lock);
+		ast_atomic_store_n(&con->cache, cache, __ATOMIC_RELEASE);
+	}
+	ast_mutex_unlock(&exten_cache_create_lock);
+
+	return cache;
+}
+
+static unsigned int exten_cache_set(const char *exten, int priority, const char *callerid)
+{
+	unsigned int hash = ast_hashtab_hash_string(exten);
+
+	hash = hash * 31 + priority;
+	if (callerid) {
+		hash = hash * 31 + ast_hashtab_hash_string(callerid);
+	}
+	return hash % EXTEN_CACHE_SETS;
+}
+
+/*!
+ * \internal
+ * \brief Look for a lookup made in the current dialplan version.
+ *
+ * \retval The extension found the last time, or NULL.
+ */
+static struct ast_exten *exten_cache_find(struct ast_context *con, unsigned int version,
+	const char *exten, int priority, const char *callerid, const char **foundcontext)
+{
+	struct exten_cache *cache = ast_atomic_load_n(&con->cache, __ATOMIC_ACQUIRE);
+	struct ast_exten *e = NULL;
+	unsigned int set;
+	int way;
+
+	if (!cache) {
+		return NULL;
+	}
+
+	set = exten_cache_set(exten, priority, callerid);
+	ast_mutex_lock(&cache->lock);
+	for (way = 0; way < EXTEN_CACHE_WAYS; ++way) {
+		struct exten_cache_entry *entry = &cache->entries[set][way];
+
+		if (entry->version == version && entry->priority == priority
+			&& !strcmp(entry->exten, exten) && !strcmp(entry->callerid, S_OR(callerid, ""))) {
+			cache->recent[set] = way;
+			e = entry->e;
+			*foundcontext = entry->foundcontext;
+			break;
+		}
+	}
+	ast_mutex_unlock(&cache->lock);
+
+	return e;
+}
+
+/*!
+ * \internal
+ * \brief Remember a lookup in place of the least recently used one.
+ */
+static void exten_cache_add(struct ast_context *con, unsigned int version,
+	const char *exten, int priority, const char *callerid,
+	struct ast_exten *e, const char *foundcontext)
+{
+	struct exten_cache *cache = exten_cache_get(con);
+	struct exten_cache_entry *entry;
+	unsigned int set;
+	int way;
+
+	if (!cache) {
+		return;
+	}
+
+	set = exten_cache_set(exten, priority, callerid);
+	ast_mutex_lock(&cache->lock);
+	for (way = 0; way < EXTEN_CACHE_WAYS; ++way) {
+		if (cache->entries[set][way].version != version) {
+			break;
+		}
+	}
+	if (way == EXTEN_CACHE_WAYS) {
+		way = (cache->recent[set] + 1) % EXTEN_CACHE_WAYS;
+	}
+	entry = &cache->entries[set][way];
+	entry->version = version;
+	entry->priority = priority;
+	entry->e = e;
+	entry->foundcontext = foundcontext;
+	ast_copy_string(entry->exten, exten, sizeof(entry->exten));
+	ast_copy_string(entry->callerid, S_OR(callerid, ""), sizeof(entry->callerid));
+	cache->recent[set] = way;
+	ast_mutex_unlock(&cache->lock);
+}
+
+static struct ast_exten *find_extension(struct ast_channel *chan,
+	struct ast_context *bypass, struct pbx_find_info *q,
+	const char *context, const char *exten, int priority,
+	const char *label, const char *callerid, enum ext_match_t action);
+
+/*!
+ * \internal
+ * \brief Look for a lookup in the cache of the context it starts in.
+ *
+ * \param q Search results, filled in when found.
+ * \param[out] con Context the lookup starts in.
+ * \param[out] version Current dialplan version.
+ *
+ * \note Only whole lookups for a priority are remembered.  Partial
+ * matches depend on more than one extension and the key would not
+ * fit extensions longer than the entries hold.
+ *
+ * \retval The extension found, or NULL with *con left NULL if the
+ * lookup cannot be cached.
+ */
+static struct ast_exten *exten_cache_lookup(struct pbx_find_info *q,
+	const char *context, const char *exten, int priority, const char *label,
+	const char *callerid, enum ext_match_t action,
+	struct ast_context **con, unsigned int *version)
+{
+	const char *foundcontext;
+	struct ast_exten *e;
+
+	*con = NULL;
+	if (q->stacklen
+		|| (action != E_MATCH && action != E_SPAWN && (action != E_FINDLABEL || label))
+		|| strlen(exten) >= AST_MAX_EXTENSION
+		|| (callerid && strlen(callerid) >= AST_MAX_EXTENSION)
+		|| !(*version = dialplan_version_stable())
+		|| !contexts_table
+		|| !(*con = find_context(context))) {
+		return NULL;
+	}
+
+	if (!(e = exten_cache_find(*con, *version, exten, priority, callerid, &foundcontext))) {
+		return NULL;
+	}
+
+	q->status = STATUS_SUCCESS;
+	q->swo = NULL;
+	q->data = NULL;
+	q->foundcontext = foundcontext;
+	return e;
+}
+
 struct ast_exten *pbx_find_extension(struct ast_channel *chan,
 	struct ast_context *bypass, struct pbx_find_info *q,
 	const char *context, const char *exten, int priority,
 	const char *label, const char *callerid, enum ext_match_t action)
+{
+	struct ast_context *con = NULL;
+	struct ast_exten *e;
+	unsigned int version;
+
+	if (!bypass && (e = exten_cache_lookup(q, context, exten, priority, label, callerid, action, &con, &version))) {
+		return e;
+	}
+	if (!con) {
+		return find_extension(chan, bypass, q, context, exten, priority, label, callerid, action);
+	}
+
+	q->uncacheable = 0;
+	e = find_extension(chan, bypass, q, context, exten, priority, label, callerid, action);
+	/* Nothing may have changed the dialplan while it was searched. */
+	if (e && !q->uncacheable && dialplan_version_stable() == version) {
+		exten_cache_add(con, version, exten, priority, callerid, e, q->foundcontext);
+	}
+	return e;
+}
+
+static struct ast_exten *find_extension(struct ast_channel *chan,
+	struct ast_context *bypass, struct pbx_find_info *q,
+	const char *context, const char *exten, int priority,
+	const char *label, const char *callerid, enum ext_match_t action)
 {
 	int x, res;
 	struct ast_context *tmp = NULL;
@@ -2541,6 +2835,7 @@ struct ast_exten *pbx_find_extension(struct ast_channel *chan,
 			char *datap;
 			int eval = 0;
 
+			q->uncacheable = 1;
 			name = strsep(&osw, "/");
 			asw = pbx_findswitch(name);
 
@@ -2697,6 +2992,11 @@ struct ast_exten *pbx_find_extension(struct ast_channel *chan,
 		}
 	}
 
+	/* Switches and timed includes can answer differently next time. */
+	if (ast_context_switches_count(tmp)) {
+		q->uncacheable = 1;
+	}
+
 	/* Check alternative switches */
 	for (idx = 0; idx < ast_context_switches_count(tmp); idx++) {
 		const struct ast_sw *sw = ast_context_switches_get(tmp, idx);
@@ -2751,8 +3051,11 @@ struct ast_exten *pbx_find_extension(struct ast_channel *chan,
 	for (idx = 0; idx < ast_context_includes_count(tmp); idx++) {
 		const struct ast_include *i = ast_context_includes_get(tmp, idx);
 
+		if (include_is_timed(i)) {
+			q->uncacheable = 1;
+		}
 		if (include_valid(i)) {
-			if ((e = pbx_find_extension(chan, bypass, q, include_rname(i), exten, priority, label, callerid, action))) {
+			if ((e = find_extension(chan, bypass, q, include_rname(i), exten, priority, label, callerid, action))) {
 #ifdef NEED_DEBUG_HERE
 				ast_log(LOG_NOTICE,"Returning recursive match of %s\n", e->exten);
 #endif
@@ -2857,6 +3160,49 @@ static struct ast_custom_function exception_function = {
  * auto-service code will queue up any important signalling frames to be processed
  * after this is done.
  */
+/*!
+ * \internal
+ * \brief Find an extension for pbx_extension_helper().
+ *
+ * \details A lookup remembered since the dialplan last changed is
+ * answered without taking the contexts lock, so calls keep finding
+ * their extensions while a reload merges the new dialplan.
+ *
+ * \param[out] locked Set if the contexts lock is held, otherwise a
+ * read section is open.  Release either with extension_helper_unlock().
+ */
+static struct ast_exten *extension_helper_find(struct ast_channel *c, struct ast_context *con,
+	struct pbx_find_info *q, const char *context, const char *exten, int priority,
+	const char *label, const char *callerid, enum ext_match_t action, int *locked)
+{
+	struct ast_context *start;
+	struct ast_exten *e;
+	unsigned int version;
+
+	if (!con && !ao2_rcu_read_begin()) {
+		e = exten_cache_lookup(q, context, exten, priority, label, callerid, action, &start, &version);
+		/* Looking up the application takes locks, which a read section must not. */
+		if (e && (action != E_SPAWN || e->cached_app)) {
+			*locked = 0;
+			return e;
+		}
+		ao2_rcu_read_end();
+	}
+
+	*locked = 1;
+	ast_rdlock_contexts();
+	return pbx_find_extension(c, con, q, context, exten, priority, label, callerid, action);
+}
+
+static void extension_helper_unlock(int locked)
+{
+	if (locked) {
+		ast_unlock_contexts();
+	} else {
+		ao2_rcu_read_end();
+	}
+}
+
 static int pbx_extension_helper(struct ast_channel *c, struct ast_context *con,
   const char *context, const char *exten, int priority,
   const char *label, const char *callerid, enum ext_match_t action, int *found, int combined_find_spawn)
@@ -2864,25 +3210,26 @@ static int pbx_extension_helper(struct ast_channel *c, struct ast_context *con,
 	struct ast_exten *e;
 	struct ast_app *app;
 	char *substitute = NULL;
+	struct pbx_substitution *compiled = NULL;
 	struct pbx_find_info q = { .stacklen = 0 }; /* the rest is reset in pbx_find_extension */
 	char passdata[EXT_DATA_SIZE];
 	int matching_action = (action == E_MATCH || action == E_CANMATCH || action == E_MATCHMORE);
+	int locked;
 
-	ast_rdlock_contexts();
 	if (found)
 		*found = 0;
 
-	e = pbx_find_extension(c, con, &q, context, exten, priority, label, callerid, action);
+	e = extension_helper_find(c, con, &q, context, exten, priority, label, callerid, action, &locked);
 	if (e) {
 		if (found)
 			*found = 1;
 		if (matching_action) {
-			ast_unlock_contexts();
+			extension_helper_unlock(locked);
 			return -1;	/* success, we found it */
 		} else if (action == E_FINDLABEL) { /* map the label to a priority */
 			int res = e->priority;
 
-			ast_unlock_contexts();
+			extension_helper_unlock(locked);
 
 			/* the priority we were looking for */
 			return res;
@@ -2892,6 +3239,9 @@ static int pbx_extension_helper(struct ast_channel *c, struct ast_context *con,
 			app = e->cached_app;
 			if (ast_strlen_zero(e->data)) {
 				*passdata = '\0';
+			} else if (e->substitution) {
+				/* keep the parsed data for later processing after lock released */
+				compiled = ao2_bump(e->substitution);
 			} else {
 				const char *tmp;
 				if ((!(tmp = strchr(e->data, '$'))) || (!strstr(tmp, "${") && !strstr(tmp, "$["))) {
@@ -2902,9 +3252,10 @@ static int pbx_extension_helper(struct ast_channel *c, struct ast_context *con,
 					substitute = ast_strdupa(e->data);
 				}
 			}
-			ast_unlock_contexts();
+			extension_helper_unlock(locked);
 			if (!app) {
 				ast_log(LOG_WARNING, "No application '%s' for extension (%s, %s, %d)\n", e->app, context, exten, priority);
+				ao2_cleanup(compiled);
 				return -1;
 			}
 			if (ast_channel_context(c) != context)
@@ -2912,7 +3263,10 @@ static int pbx_extension_helper(struct ast_channel *c, struct ast_context *con,
 			if (ast_channel_exten(c) != exten)
 				ast_channel_exten_set(c, exten);
 			ast_channel_priority_set(c, priority);
-			if (substitute) {
+			if (compiled) {
+				pbx_substitution_apply(c, ast_channel_varshead(c), compiled, passdata, sizeof(passdata)-1);
+				ao2_ref(compiled, -1);
+			} else if (substitute) {
 				pbx_substitute_variables_helper(c, substitute, passdata, sizeof(passdata)-1);
 			}
 			ast_debug(1, "Launching '%s'\n", app_name(app));
@@ -2929,7 +3283,7 @@ static int pbx_extension_helper(struct ast_channel *c, struct ast_context *con,
 	} else if (q.swo) {	/* not found here, but in another switch */
 		if (found)
 			*found = 1;
-		ast_unlock_contexts();
+		extension_helper_unlock(locked);
 		if (matching_action) {
 			return -1;
 		} else {
@@ -2940,7 +3294,7 @@ static int pbx_extension_helper(struct ast_channel *c, struct ast_context *con,
 			return q.swo->exec(c, q.foundcontext ? q.foundcontext : context, exten, priority, callerid, q.data);
 		}
 	} else {	/* not found anywhere, see what happened */
-		ast_unlock_contexts();
+		extension_helper_unlock(locked);
 		/* Using S_OR here because Solaris doesn't like NULL being passed to ast_log */
 		switch (q.status) {
 		case STATUS_NO_CONTEXT:
@@ -3058,6 +3412,134 @@ static struct ao2_container *alloc_device_state_info(void)
 	return ao2_container_alloc_list(AO2_ALLOC_OPT_LOCK_NOLOCK, 0, NULL, NULL);
 }
 
+/*!
+ * \internal
+ * \brief Forget the device states cached on a hint.
+ *
+ * \note The hint must be locked.
+ */
+static void hint_device_states_clear(struct ast_hint *hint)
+{
+	AST_VECTOR_CALLBACK_VOID(&hint->device_states, ao2_ref, -1);
+	AST_VECTOR_RESET(&hint->device_states, AST_VECTOR_ELEM_CLEANUP_NOOP);
+	memset(hint->device_state_counts, 0, sizeof(hint->device_state_counts));
+	hint->device_states_valid = 0;
+}
+
+/*!
+ * \internal
+ * \brief Cache the device states found by a full hint evaluation.
+ *
+ * \note The hint must be locked.
+ */
+static void hint_device_states_set(struct ast_hint *hint, struct ao2_container *device_state_info)
+{
+	struct ao2_iterator iter;
+	struct ast_device_state_info *info;
+	struct ast_device_state_info *cached;
+
+	hint_device_states_clear(hint);
+
+	iter = ao2_iterator_init(device_state_info, 0);
+	for (; (info = ao2_iterator_next(&iter)); ao2_ref(info, -1)) {
+		cached = ao2_alloc_options(sizeof(*cached) + strlen(info->device_name),
+			device_state_info_dt, AO2_ALLOC_OPT_LOCK_NOLOCK);
+		if (!cached || AST_VECTOR_APPEND(&hint->device_states, cached)) {
+			ao2_cleanup(cached);
+			ao2_ref(info, -1);
+			ao2_iterator_destroy(&iter);
+			hint_device_states_clear(hint);
+			return;
+		}
+		cached->device_state = info->device_state;
+		strcpy(cached->device_name, info->device_name);
+		++hint->device_state_counts[info->device_state];
+	}
+	ao2_iterator_destroy(&iter);
+
+	hint->device_states_valid = 1;
+}
+
+/*!
+ * \internal
+ * \brief Apply a device state change to the device states cached on a hint.
+ *
+ * \note The hint must be locked.
+ */
+static void hint_device_states_update(struct ast_hint *hint, const char *device,
+	enum ast_device_state state)
+{
+	int idx;
+
+	for (idx = 0; idx < AST_VECTOR_SIZE(&hint->device_states); ++idx) {
+		struct ast_device_state_info *cached = AST_VECTOR_GET(&hint->device_states, idx);
+
+		if (!strcasecmp(cached->device_name, device)) {
+			--hint->device_state_counts[cached->device_state];
+			++hint->device_state_counts[state];
+			cached->device_state = state;
+		}
+	}
+}
+
+/*!
+ * \internal
+ * \brief Calculate the extension state from the device states cached on a hint.
+ *
+ * \note The aggregate only depends on which device states are present, so
+ * each state is added once no matter how many devices are in it.
+ *
+ * \note The hint must be locked.
+ */
+static int hint_device_states_aggregate(struct ast_hint *hint)
+{
+	struct ast_devstate_aggregate agg;
+	int state;
+
+	ast_devstate_aggregate_init(&agg);
+	for (state = 0; state < AST_DEVICE_TOTAL; ++state) {
+		if (hint->device_state_counts[state]) {
+			ast_devstate_aggregate_add(&agg, state);
+		}
+	}
+
+	return ast_devstate_to_extenstate(ast_devstate_aggregate_result(&agg));
+}
+
+/*!
+ * \internal
+ * \brief Build the device state info for watchers from the states cached on a hint.
+ *
+ * \note The hint must be locked.
+ */
+static struct ao2_container *hint_device_states_info(struct ast_hint *hint)
+{
+	struct ao2_container *device_state_info;
+	int idx;
+
+	device_state_info = alloc_device_state_info();
+	if (!device_state_info) {
+		return NULL;
+	}
+
+	for (idx = 0; idx < AST_VECTOR_SIZE(&hint->device_states); ++idx) {
+		struct ast_device_state_info *cached = AST_VECTOR_GET(&hint->device_states, idx);
+		struct ast_device_state_info *obj;
+
+		obj = ao2_alloc_options(sizeof(*obj) + strlen(cached->device_name),
+			device_state_info_dt, AO2_ALLOC_OPT_LOCK_NOLOCK);
+		/* if failed we cannot add this device */
+		if (obj) {
+			obj->device_state = cached->device_state;
+			strcpy(obj->device_name, cached->device_name);
+			ao2_link(device_state_info, obj);
+			ao2_ref(obj, -1);
+		}
+	}
+
+	return device_state_info;
+}
+
 static int ast_extension_state3(struct ast_str *hint_app, struct ao2_container *device_state_info)
 {
 	char *cur;
@@ -3340,7 +3822,17 @@ static void get_device_state_causing_channels(struct ao2_container *c)
 	ao2_iterator_destroy(&iter);
 }
 
-static void device_state_notify_callbacks(struct ast_hint *hint, struct ast_str **hint_app)
+/*!
+ * \internal
+ * \brief Recalculate the state of a hint and notify its watchers of any change.
+ *
+ * \param hint The hint to update.
+ * \param hint_app Scratch buffer for the hint string.
+ * \param dev_state The device state change that triggered the update, or NULL
+ * if every device in the hint needs to be checked.
+ */
+static void device_state_notify_callbacks(struct ast_hint *hint, struct ast_str **hint_app,
+	const struct ast_device_state_message *dev_state)
 {
 	struct ao2_iterator cb_iter;
 	struct ast_state_cb *state_cb;
@@ -3350,6 +3842,7 @@ static void device_state_notify_callbacks(struct ast_hint *hint, struct ast_str
 	int first_extended_cb_call = 1;
 	char context_name[AST_MAX_CONTEXT];
 	char exten_name[AST_MAX_EXTENSION];
+	struct ast_exten *exten;
 
 	ao2_lock(hint);
 	if (!hint->exten) {
@@ -3367,23 +3860,48 @@ static void device_state_notify_callbacks(struct ast_hint *hint, struct ast_str
 			sizeof(context_name));
 	ast_copy_string(exten_name, ast_get_extension_name(hint->exten),
 			sizeof(exten_name));
-	ast_str_set(hint_app, 0, "%s", ast_get_extension_app(hint->exten));
-	ao2_unlock(hint);
 
 	/*
-	 * Get device state for this hint.
-	 *
-	 * NOTE: We cannot hold any locks while determining the hint
-	 * device state or notifying the watchers without causing a
-	 * deadlock.  (conlock, hints, and hint)
+	 * A cachable device state message carries the same state that querying
+	 * the device would return, so it can be applied to the cached device
+	 * states without checking every other device in the hint.
 	 */
+	if (dev_state && hint->device_states_valid
+		&& dev_state->cachable == AST_DEVSTATE_CACHABLE
+		&& dev_state->state != AST_DEVICE_UNKNOWN) {
+		hint_device_states_update(hint, dev_state->device, dev_state->state);
+		state = hint_device_states_aggregate(hint);
+		device_state_info = hint_device_states_info(hint);
+		ao2_unlock(hint);
+	} else {
+		exten = hint->exten;
+		ast_str_set(hint_app, 0, "%s", ast_get_extension_app(hint->exten));
+		ao2_unlock(hint);
 
-	/* Make a container so state3 can fill it if we wish.
-	 * If that failed we simply do not provide the extended state info.
-	 */
-	device_state_info = alloc_device_state_info();
+		/*
+		 * Get device state for this hint.
+		 *
+		 * NOTE: We cannot hold any locks while determining the hint
+		 * device state or notifying the watchers without causing a
+		 * deadlock.  (conlock, hints, and hint)
+		 */
+
+		/* Make a container so state3 can fill it if we wish.
+		 * If that failed we simply do not provide the extended state info.
+		 */
+		device_state_info = alloc_device_state_info();
+
+		state = ast_extension_state3(*hint_app, device_state_info);
+
+		ao2_lock(hint);
+		if (!device_state_info || hint->exten != exten) {
+			hint_device_states_clear(hint);
+		} else {
+			hint_device_states_set(hint, device_state_info);
+		}
+		ao2_unlock(hint);
+	}
 
-	state = ast_extension_state3(*hint_app, device_state_info);
 	same_state = state == hint->laststate;
 	if (same_state && (~state & AST_EXTENSION_RINGING)) {
 		ao2_cleanup(device_state_info);
@@ -3524,7 +4042,7 @@ static int handle_hint_change_message_type(struct stasis_message *msg, enum ast_
 
 	switch (reason) {
 	case AST_HINT_UPDATE_DEVICE:
-		device_state_notify_callbacks(hint, &hint_app);
+		device_state_notify_callbacks(hint, &hint_app, NULL);
 		break;
 	case AST_HINT_UPDATE_PRESENCE:
 		{
@@ -3629,7 +4147,7 @@ static void device_state_cb(void *unused, struct stasis_subscription *sub, struc
 	if (dev_iter) {
 		for (; (device = ao2_iterator_next(dev_iter)); ao2_t_ref(device, -1, "Next device")) {
 			if (device->hint) {
-				device_state_notify_callbacks(device->hint, &hint_app);
+				device_state_notify_callbacks(device->hint, &hint_app, dev_state);
 			}
 		}
 		ao2_iterator_destroy(dev_iter);
@@ -3887,6 +4405,8 @@ static void destroy_hint(void *obj)
 		ast_free(device);
 	}
 	AST_VECTOR_FREE(&hint->devices);
+	AST_VECTOR_CALLBACK_VOID(&hint->device_states, ao2_ref, -1);
+	AST_VECTOR_FREE(&hint->device_states);
 	ast_free(hint->last_presence_subtype);
 	ast_free(hint->last_presence_message);
 }
@@ -3972,6 +4492,7 @@ static int ast_add_hint(struct ast_exten *e)
 		return -1;
 	}
 	AST_VECTOR_INIT(&hint_new->devices, 8);
+	AST_VECTOR_INIT(&hint_new->device_states, 0);
 
 	/* Initialize new hint. */
 	hint_new->callbacks = ao2_container_alloc_list(AO2_ALLOC_OPT_LOCK_MUTEX, 0, NULL, hint_id_cmp);
@@ -4090,7 +4611,7 @@ static int ast_change_hint(struct ast_exten *oe, struct ast_exten *ne)
 	/* Update the hint and put it back in the hints container. */
 	ao2_lock(hint);
 	hint->exten = ne;
-
+	hint_device_states_clear(hint);
 	ao2_unlock(hint);
 
 	ao2_link(hints, hint);
@@ -4655,6 +5176,7 @@ static void destroy_exten(struct ast_exten *e)
 		ast_hashtab_destroy(e->peer_label_table, 0);
 	if (e->datad)
 		e->datad(e->data);
+	ao2_cleanup(e->substitution);
 	ast_free(e);
 }
 
@@ -4750,12 +5272,18 @@ int pbx_set_autofallthrough(int newval)
 int pbx_set_extenpatternmatchnew(int newval)
 {
 	int oldval = extenpatternmatchnew;
+
+	/* The algorithms may prefer different extensions so forget what was looked up. */
+	dialplan_write_begin();
 	extenpatternmatchnew = newval;
+	dialplan_write_end();
 	return oldval;
 }
 
 void pbx_set_overrideswitch(const char *newval)
 {
+	/* Lookups made without the switch are no longer valid. */
+	dialplan_write_begin();
 	if (overrideswitch) {
 		ast_free(overrideswitch);
 	}
@@ -4764,6 +5292,7 @@ void pbx_set_overrideswitch(const char *newval)
 	} else {
 		overrideswitch = NULL;
 	}
+	dialplan_write_end();
 }
 
 /*!
@@ -6223,10 +6752,14 @@ struct ast_context *ast_context_find_or_create(struct ast_context **extcontexts,
 	}
 
 	if (!extcontexts) {
+		/* Lookups without the lock may be searching the table. */
+		ast_wrlock_contexts();
+		tmp->live = 1;
 		tmp->next = *local_contexts;
 		*local_contexts = tmp;
 		ast_hashtab_insert_safe(contexts_table, tmp); /*put this context into the tree */
 		ast_unlock_contexts();
+		ast_unlock_contexts();
 	} else {
 		tmp->next = *local_contexts;
 		if (exttable)
@@ -6469,15 +7002,25 @@ void ast_merge_contexts_and_delete(struct ast_context **extcontexts, struct ast_
 
 	begintime = ast_tvnow();
 	ast_mutex_lock(&context_merge_lock);/* Serialize ast_merge_contexts_and_delete */
-	ast_wrlock_contexts();
+	/*
+	 * Merging only reads the running dialplan so cached lookups
+	 * keep being answered until the new one is swapped in.
+	 */
+	ast_rdlock_contexts();
 
 	if (!contexts_table) {
+		ast_wrlock_contexts();
+
 		/* Create any autohint contexts */
 		context_table_create_autohints(exttable);
 
 		/* Well, that's odd. There are no contexts. */
 		contexts_table = exttable;
 		contexts = *extcontexts;
+		for (tmp = contexts; tmp; tmp = tmp->next) {
+			tmp->live = 1;
+		}
+		ast_unlock_contexts();
 		ast_unlock_contexts();
 		ast_mutex_unlock(&context_merge_lock);
 		return;
@@ -6538,13 +7081,21 @@ void ast_merge_contexts_and_delete(struct ast_context **extcontexts, struct ast_
 	}
 	ao2_iterator_destroy(&i);
 
+	ast_wrlock_contexts();
+
 	/* save the old table and list */
 	oldtable = contexts_table;
 	oldcontextslist = contexts;
+	for (tmp = oldcontextslist; tmp; tmp = tmp->next) {
+		tmp->live = 0;
+	}
 
 	/* move in the new table and list */
 	contexts_table = exttable;
 	contexts = *extcontexts;
+	for (tmp = contexts; tmp; tmp = tmp->next) {
+		tmp->live = 1;
+	}
 
 	/*
 	 * Restore the watchers for hints that can be found; notify
@@ -6603,6 +7154,7 @@ void ast_merge_contexts_and_delete(struct ast_context **extcontexts, struct ast_
 
 	ao2_unlock(hints);
 	ast_unlock_contexts();
+	ast_unlock_contexts();
 
 	/*
 	 * Notify watchers of all removed hints with the same lock
@@ -7202,6 +7754,7 @@ static int add_priority(struct ast_context *con, struct ast_exten *tmp,
 		/* Destroy the old one */
 		if (e->datad)
 			e->datad(e->data);
+		ao2_cleanup(e->substitution);
 		ast_free(e);
 	} else {	/* Slip ourselves in just before e */
 		tmp->peer = e;
@@ -7418,6 +7971,10 @@ static int ast_add_extension2_lockopt(struct ast_context *con,
 	tmp->parent = con;
 	tmp->data = data;
 	tmp->datad = datad;
+	/* Parse the arguments once instead of every time the priority runs. */
+	if (priority != PRIORITY_HINT && !ast_strlen_zero(data)) {
+		tmp->substitution = pbx_substitution_compile(data);
+	}
 	tmp->registrar = registrar;
 	tmp->registrar_line = registrar_line;
 
@@ -7473,6 +8030,7 @@ static int ast_add_extension2_lockopt(struct ast_context *con,
 				/* if you free this, null it out */
 				tmp->data = NULL;
 			}
+			ao2_cleanup(tmp->substitution);
 
 			ast_free(tmp);
 		}
@@ -8040,6 +8598,10 @@ static void __ast_internal_context_destroy( struct ast_context *con)
 		destroy_exten(el);
 	}
 	tmp->root = NULL;
+	if (tmp->cache) {
+		ast_mutex_destroy(&tmp->cache->lock);
+		ast_free(tmp->cache);
+	}
 	ast_rwlock_destroy(&tmp->lock);
 	ast_mutex_destroy(&tmp->macrolock);
 	ast_free(tmp);
@@ -8455,16 +9017,35 @@ int load_pbx(void)
  */
 int ast_wrlock_contexts(void)
 {
-	return ast_mutex_lock(&conlock);
+	int res = ast_mutex_lock(&conlock);
+
+	if (!res) {
+		++conlock_depth;
+		if (!conlock_writing) {
+			conlock_writing = 1;
+			dialplan_write_begin();
+		}
+	}
+	return res;
 }
 
 int ast_rdlock_contexts(void)
 {
-	return ast_mutex_lock(&conlock);
+	int res = ast_mutex_lock(&conlock);
+
+	if (!res) {
+		++conlock_depth;
+	}
+	return res;
 }
 
 int ast_unlock_contexts(void)
 {
+	/* conlock is recursive so the change is only over once the outermost lock goes. */
+	if (!--conlock_depth && conlock_writing) {
+		conlock_writing = 0;
+		dialplan_write_end();
+	}
 	return ast_mutex_unlock(&conlock);
 }
 
@@ -8473,7 +9054,14 @@ int ast_unlock_contexts(void)
  */
 int ast_wrlock_context(struct ast_context *con)
 {
-	return ast_rwlock_wrlock(&con->lock);
+	int res = ast_rwlock_wrlock(&con->lock);
+
+	/* Contexts still being built are not visible to lookups. */
+	if (!res && con->live) {
+		con->writing = 1;
+		dialplan_write_begin();
+	}
+	return res;
 }
 
 int ast_rdlock_context(struct ast_context *con)
@@ -8483,6 +9071,11 @@ int ast_rdlock_context(struct ast_context *con)
 
 int ast_unlock_context(struct ast_context *con)
 {
+	/* Readers and writers never hold the lock together. */
+	if (con->writing) {
+		con->writing = 0;
+		dialplan_write_end();
+	}
 	return ast_rwlock_unlock(&con->lock);
 }
 
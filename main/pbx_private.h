@@ -47,6 +47,8 @@ struct ast_include *include_alloc(const char *value, const char *registrar);
 /*! Free an ast_include and associated data. */
 void include_free(struct ast_include *inc);
 int include_valid(const struct ast_include *inc);
+/*! Whether an include is only valid at certain times. */
+int include_is_timed(const struct ast_include *inc);
 const char *include_rname(const struct ast_include *inc);
 
 /*! pbx_sw.c */
@@ -62,6 +64,21 @@ int indicate_busy(struct ast_channel *, const char *);
 /*! pbx_switch.c functions needed by pbx.c */
 struct ast_switch *pbx_findswitch(const char *sw);
 
+/*! pbx_variables.c functions needed by pbx.c */
+struct pbx_substitution;
+/*!
+ * \brief Parse a substitution template once for repeated use.
+ *
+ * \retval NULL if the template substitutes nothing or cannot be compiled.
+ * \return ao2 object to pass to pbx_substitution_apply().
+ */
+struct pbx_substitution *pbx_substitution_compile(const char *templ);
+/*!
+ * \brief Substitute a compiled template as pbx_substitute_variables_helper_full() would.
+ */
+void pbx_substitution_apply(struct ast_channel *c, struct varshead *headp,
+	struct pbx_substitution *sub, char *cp2, int count);
+
 /*! pbx_app.c functions needed by pbx.c */
 const char *app_name(struct ast_app *app);
 
@@ -40,6 +40,7 @@
 #include "asterisk/paths.h"
 #include "asterisk/pbx.h"
 #include "asterisk/stasis_channels.h"
+#include "asterisk/test.h"
 #include "pbx_private.h"
 
 /*** DOCUMENTATION
@@ -255,6 +256,7 @@ const char *ast_str_retrieve_variable(struct ast_str **str, ssize_t maxlen, stru
 	const char *s;	/* the result */
 	int offset, length;
 	int i, need_substring;
+	unsigned int hash;
 	struct varshead *places[2] = { headp, &globals };	/* list of places where we may look */
 	char workspace[20];
 
@@ -357,17 +359,15 @@ const char *ast_str_retrieve_variable(struct ast_str **str, ssize_t maxlen, stru
 		}
 	}
 	/* if not found, look into chanvars or global vars */
+	hash = ast_var_hash(var);
 	for (i = 0; s == &not_found && i < ARRAY_LEN(places); i++) {
 		struct ast_var_t *variables;
 		if (!places[i])
 			continue;
 		if (places[i] == &globals)
 			ast_rwlock_rdlock(&globalslock);
-		AST_LIST_TRAVERSE(places[i], variables, entries) {
-			if (!strcmp(ast_var_name(variables), var)) {
-				s = ast_var_value(variables);
-				break;
-			}
+		if ((variables = ast_var_list_find(places[i], var, hash))) {
+			s = ast_var_value(variables);
 		}
 		if (places[i] == &globals)
 			ast_rwlock_unlock(&globalslock);
@@ -393,6 +393,43 @@ const char *ast_str_retrieve_variable(struct ast_str **str, ssize_t maxlen, stru
 	return ret;
 }
 
+/*!
+ * \internal
+ * \brief Find the end of a ${...} or $[...] substitution.
+ *
+ * \param vars Just past the opening bracket.
+ * \param open Opening bracket of the substitution.
+ * \param close Closing bracket of the substitution.
+ * \param[out] brackets Brackets left open.  (0 if the substitution is complete)
+ * \param[out] needsub Number of substitutions nested inside.
+ *
+ * \return Just past the closing bracket.
+ */
+static const char *substitution_end(const char *vars, char open, char close,
+	int *brackets, int *needsub)
+{
+	const char *vare = vars;
+
+	*brackets = 1;
+	*needsub = 0;
+	while (*brackets && *vare) {
+		if ((vare[0] == '$') && (vare[1] == open)) {
+			++*needsub;
+			++*brackets;
+			vare++;
+		} else if (vare[0] == open) {
+			++*brackets;
+		} else if (vare[0] == close) {
+			--*brackets;
+		} else if ((vare[0] == '$') && (vare[1] == '{' || vare[1] == '[')) {
+			++*needsub;
+			vare++;
+		}
+		vare++;
+	}
+	return vare;
+}
+
 void ast_str_substitute_variables_full(struct ast_str **buf, ssize_t maxlen, struct ast_channel *c, struct varshead *headp, const char *templ, size_t *used)
 {
 	/* Substitutes variables into buf, based on string templ */
@@ -467,26 +504,8 @@ void ast_str_substitute_variables_full(struct ast_str **buf, ssize_t maxlen, str
 			/* We have a variable.  Find the start and end, and determine
 			   if we are going to have to recursively call ourselves on the
 			   contents */
-			vars = vare = nextvar + 2;
-			brackets = 1;
-			needsub = 0;
-
-			/* Find the end of it */
-			while (brackets && *vare) {
-				if ((vare[0] == '$') && (vare[1] == '{')) {
-					needsub++;
-					brackets++;
-					vare++;
-				} else if (vare[0] == '{') {
-					brackets++;
-				} else if (vare[0] == '}') {
-					brackets--;
-				} else if ((vare[0] == '$') && (vare[1] == '[')) {
-					needsub++;
-					vare++;
-				}
-				vare++;
-			}
+			vars = nextvar + 2;
+			vare = substitution_end(vars, '{', '}', &brackets, &needsub);
 			len = vare - vars;
 			if (brackets) {
 				ast_log(LOG_WARNING, "Error in extension logic (missing '}')\n");
@@ -553,26 +572,8 @@ void ast_str_substitute_variables_full(struct ast_str **buf, ssize_t maxlen, str
 			/* We have an expression.  Find the start and end, and determine
 			   if we are going to have to recursively call ourselves on the
 			   contents */
-			vars = vare = nextexp + 2;
-			brackets = 1;
-			needsub = 0;
-
-			/* Find the end of it */
-			while (brackets && *vare) {
-				if ((vare[0] == '$') && (vare[1] == '[')) {
-					needsub++;
-					brackets++;
-					vare++;
-				} else if (vare[0] == '[') {
-					brackets++;
-				} else if (vare[0] == ']') {
-					brackets--;
-				} else if ((vare[0] == '$') && (vare[1] == '{')) {
-					needsub++;
-					vare++;
-				}
-				vare++;
-			}
+			vars = nextexp + 2;
+			vare = substitution_end(vars, '[', ']', &brackets, &needsub);
 			len = vare - vars;
 			if (brackets) {
 				ast_log(LOG_WARNING, "Error in extension logic (missing ']')\n");
@@ -625,6 +626,49 @@ void ast_str_substitute_variables_varshead(struct ast_str **buf, ssize_t maxlen,
 	ast_str_substitute_variables_full(buf, maxlen, NULL, headp, templ, NULL);
 }
 
+/*!
+ * \internal
+ * \brief Get the value of a variable or function for substitution.
+ *
+ * \return The value, or NULL if there is none.
+ */
+static char *substitution_value(struct ast_channel *c, struct varshead *headp,
+	const char *vars, int isfunction, char *workspace)
+{
+	char *cp4;
+
+	workspace[0] = '\0';
+
+	if (isfunction) {
+		/* Evaluate function */
+		if (c || !headp)
+			cp4 = ast_func_read(c, vars, workspace, VAR_BUF_SIZE) ? NULL : workspace;
+		else {
+			struct varshead old;
+			struct ast_channel *bogus;
+
+			bogus = ast_dummy_channel_alloc();
+			if (bogus) {
+				old = *ast_channel_varshead(bogus);
+				*ast_channel_varshead(bogus) = *headp;
+				cp4 = ast_func_read(bogus, vars, workspace, VAR_BUF_SIZE) ? NULL : workspace;
+				/* Don't deallocate the varshead that was passed in */
+				*ast_channel_varshead(bogus) = old;
+				ast_channel_unref(bogus);
+			} else {
+				ast_log(LOG_ERROR, "Unable to allocate bogus channel for function value substitution.\n");
+				cp4 = NULL;
+			}
+		}
+		ast_debug(2, "Function %s result is '%s'\n", vars, cp4 ? cp4 : "(null)");
+	} else {
+		/* Retrieve variable value */
+		pbx_retrieve_variable(c, vars, &cp4, workspace, VAR_BUF_SIZE, headp);
+	}
+
+	return cp4;
+}
+
 void pbx_substitute_variables_helper_full(struct ast_channel *c, struct varshead *headp, const char *cp1, char *cp2, int count, size_t *used)
 {
 	/* Substitutes variables into cp2, based on string cp1, cp2 NO LONGER NEEDS TO BE ZEROED OUT!!!!  */
@@ -641,7 +685,7 @@ void pbx_substitute_variables_helper_full(struct ast_channel *c, struct varshead
 		char *nextexp = NULL;
 		char *nextthing;
 		char *vars;
-		char *vare;
+		const char *vare;
 		int length;
 		int pos;
 		int brackets;
@@ -694,26 +738,8 @@ void pbx_substitute_variables_helper_full(struct ast_channel *c, struct varshead
 			/* We have a variable.  Find the start and end, and determine
 			   if we are going to have to recursively call ourselves on the
 			   contents */
-			vars = vare = nextvar + 2;
-			brackets = 1;
-			needsub = 0;
-
-			/* Find the end of it */
-			while (brackets && *vare) {
-				if ((vare[0] == '$') && (vare[1] == '{')) {
-					needsub++;
-					brackets++;
-					vare++;
-				} else if (vare[0] == '{') {
-					brackets++;
-				} else if (vare[0] == '}') {
-					brackets--;
-				} else if ((vare[0] == '$') && (vare[1] == '[')) {
-					needsub++;
-					vare++;
-				}
-				vare++;
-			}
+			vars = nextvar + 2;
+			vare = substitution_end(vars, '{', '}', &brackets, &needsub);
 			len = vare - vars;
 			if (brackets) {
 				ast_log(LOG_WARNING, "Error in extension logic (missing '}')\n");
@@ -745,35 +771,8 @@ void pbx_substitute_variables_helper_full(struct ast_channel *c, struct varshead
 			if (!workspace)
 				workspace = ast_alloca(VAR_BUF_SIZE);
 
-			workspace[0] = '\0';
-
 			parse_variable_name(vars, &offset, &offset2, &isfunction);
-			if (isfunction) {
-				/* Evaluate function */
-				if (c || !headp)
-					cp4 = ast_func_read(c, vars, workspace, VAR_BUF_SIZE) ? NULL : workspace;
-				else {
-					struct varshead old;
-					struct ast_channel *bogus;
-
-					bogus = ast_dummy_channel_alloc();
-					if (bogus) {
-						old = *ast_channel_varshead(bogus);
-						*ast_channel_varshead(bogus) = *headp;
-						cp4 = ast_func_read(bogus, vars, workspace, VAR_BUF_SIZE) ? NULL : workspace;
-						/* Don't deallocate the varshead that was passed in */
-						*ast_channel_varshead(bogus) = old;
-						ast_channel_unref(bogus);
-					} else {
-						ast_log(LOG_ERROR, "Unable to allocate bogus channel for function value substitution.\n");
-						cp4 = NULL;
-					}
-				}
-				ast_debug(2, "Function %s result is '%s'\n", vars, cp4 ? cp4 : "(null)");
-			} else {
-				/* Retrieve variable value */
-				pbx_retrieve_variable(c, vars, &cp4, workspace, VAR_BUF_SIZE, headp);
-			}
+			cp4 = substitution_value(c, headp, vars, isfunction, workspace);
 			if (cp4) {
 				cp4 = substring(cp4, offset, offset2, workspace, VAR_BUF_SIZE);
 
@@ -789,26 +788,8 @@ void pbx_substitute_variables_helper_full(struct ast_channel *c, struct varshead
 			/* We have an expression.  Find the start and end, and determine
 			   if we are going to have to recursively call ourselves on the
 			   contents */
-			vars = vare = nextexp + 2;
-			brackets = 1;
-			needsub = 0;
-
-			/* Find the end of it */
-			while (brackets && *vare) {
-				if ((vare[0] == '$') && (vare[1] == '[')) {
-					needsub++;
-					brackets++;
-					vare++;
-				} else if (vare[0] == '[') {
-					brackets++;
-				} else if (vare[0] == ']') {
-					brackets--;
-				} else if ((vare[0] == '$') && (vare[1] == '{')) {
-					needsub++;
-					vare++;
-				}
-				vare++;
-			}
+			vars = nextexp + 2;
+			vare = substitution_end(vars, '[', ']', &brackets, &needsub);
 			len = vare - vars;
 			if (brackets) {
 				ast_log(LOG_WARNING, "Error in extension logic (missing ']')\n");
@@ -861,6 +842,215 @@ void pbx_substitute_variables_varshead(struct varshead *headp, const char *cp1,
 	pbx_substitute_variables_helper_full(NULL, headp, cp1, cp2, count, NULL);
 }
 
+/*! \brief Kinds of pieces of a compiled substitution template */
+enum substitution_part_type {
+	/*! Literal text */
+	SUBSTITUTION_TEXT,
+	/*! ${name} of a variable */
+	SUBSTITUTION_VARIABLE,
+	/*! ${FUNC(args)} */
+	SUBSTITUTION_FUNCTION,
+	/*! ${...} whose name is only known once substituted */
+	SUBSTITUTION_INDIRECT,
+	/*! $[...] */
+	SUBSTITUTION_EXPRESSION,
+};
+
+/*! \brief A piece of a compiled substitution template */
+struct substitution_part {
+	enum substitution_part_type type;
+	/*! Substring of the value to use. */
+	int offset;
+	int length;
+	/*! Length of literal text. */
+	size_t len;
+	/*! Literal text, variable name, function call or expression. */
+	char *text;
+	/*! Template to substitute before the name is looked up or the expression evaluated. */
+	struct pbx_substitution *inner;
+};
+
+/*! \brief A substitution template parsed once for repeated use */
+struct pbx_substitution {
+	AST_VECTOR(, struct substitution_part) parts;
+};
+
+static void substitution_part_free(struct substitution_part part)
+{
+	ast_free(part.text);
+	ao2_cleanup(part.inner);
+}
+
+static void substitution_destroy(void *obj)
+{
+	struct pbx_substitution *sub = obj;
+
+	AST_VECTOR_CALLBACK_VOID(&sub->parts, substitution_part_free);
+	AST_VECTOR_FREE(&sub->parts);
+}
+
+/*!
+ * \internal
+ * \brief Find the next ${ or $[ of a template.
+ */
+static const char *substitution_next(const char *templ)
+{
+	while ((templ = strchr(templ, '$'))) {
+		if (templ[1] == '{' || templ[1] == '[') {
+			break;
+		}
+		++templ;
+	}
+	return templ;
+}
+
+struct pbx_substitution *pbx_substitution_compile(const char *templ)
+{
+	struct pbx_substitution *sub;
+	const char *whereweare = templ;
+
+	if (!substitution_next(templ)) {
+		return NULL;
+	}
+
+	sub = ao2_alloc_options(sizeof(*sub), substitution_destroy, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!sub || AST_VECTOR_INIT(&sub->parts, 4)) {
+		ao2_cleanup(sub);
+		return NULL;
+	}
+
+	while (*whereweare) {
+		const char *nextthing = substitution_next(whereweare);
+		struct substitution_part part = { .type = SUBSTITUTION_TEXT, };
+		const char *vars;
+		const char *vare;
+		int brackets;
+		int needsub;
+		int isfunction;
+		int isvariable;
+
+		if (nextthing != whereweare) {
+			part.len = nextthing ? nextthing - whereweare : strlen(whereweare);
+			part.text = ast_strndup(whereweare, part.len);
+			if (!part.text || AST_VECTOR_APPEND(&sub->parts, part)) {
+				ast_free(part.text);
+				break;
+			}
+			whereweare += part.len;
+			continue;
+		}
+
+		isvariable = nextthing[1] == '{';
+		vars = nextthing + 2;
+		vare = substitution_end(vars, isvariable ? '{' : '[', isvariable ? '}' : ']',
+			&brackets, &needsub);
+		/* Leave templates that warn about missing brackets or get truncated to the parser. */
+		if (brackets || vare - vars > VAR_BUF_SIZE) {
+			break;
+		}
+		whereweare = vare;
+
+		part.text = ast_strndup(vars, vare - vars - 1);
+		if (!part.text) {
+			break;
+		}
+		if (needsub) {
+			part.inner = pbx_substitution_compile(part.text);
+			if (!part.inner) {
+				ast_free(part.text);
+				break;
+			}
+			part.type = isvariable ? SUBSTITUTION_INDIRECT : SUBSTITUTION_EXPRESSION;
+		} else if (isvariable) {
+			parse_variable_name(part.text, &part.offset, &part.length, &isfunction);
+			part.type = isfunction ? SUBSTITUTION_FUNCTION : SUBSTITUTION_VARIABLE;
+		} else {
+			part.type = SUBSTITUTION_EXPRESSION;
+		}
+		if (AST_VECTOR_APPEND(&sub->parts, part)) {
+			substitution_part_free(part);
+			break;
+		}
+	}
+
+	if (*whereweare) {
+		ao2_ref(sub, -1);
+		return NULL;
+	}
+	return sub;
+}
+
+void pbx_substitution_apply(struct ast_channel *c, struct varshead *headp,
+	struct pbx_substitution *sub, char *cp2, int count)
+{
+	char *workspace = NULL;
+	char *ltmp = NULL;
+	int idx;
+
+	*cp2 = 0;
+	for (idx = 0; idx < AST_VECTOR_SIZE(&sub->parts) && count; ++idx) {
+		struct substitution_part *part = AST_VECTOR_GET_ADDR(&sub->parts, idx);
+		const char *vars = part->text;
+		int offset = part->offset;
+		int offset2 = part->length;
+		int isfunction = part->type == SUBSTITUTION_FUNCTION;
+		char *cp4;
+		int length;
+
+		if (part->type == SUBSTITUTION_TEXT) {
+			length = MIN(part->len, count);
+			memcpy(cp2, part->text, length);
+			count -= length;
+			cp2 += length;
+			*cp2 = 0;
+			continue;
+		}
+
+		if (part->inner || part->type == SUBSTITUTION_EXPRESSION) {
+			if (!ltmp) {
+				ltmp = ast_alloca(VAR_BUF_SIZE);
+			}
+			if (part->inner) {
+				pbx_substitution_apply(c, headp, part->inner, ltmp, VAR_BUF_SIZE - 1);
+			} else {
+				/* ast_expr() takes the expression as writable. */
+				ast_copy_string(ltmp, part->text, VAR_BUF_SIZE);
+			}
+			vars = ltmp;
+		}
+
+		if (part->type == SUBSTITUTION_EXPRESSION) {
+			length = ast_expr(ltmp, cp2, count, c);
+			if (length) {
+				ast_debug(1, "Expression result is '%s'\n", cp2);
+				count -= length;
+				cp2 += length;
+				*cp2 = 0;
+			}
+			continue;
+		}
+
+		if (!workspace) {
+			workspace = ast_alloca(VAR_BUF_SIZE);
+		}
+		if (part->type == SUBSTITUTION_INDIRECT) {
+			parse_variable_name(ltmp, &offset, &offset2, &isfunction);
+		}
+		cp4 = substitution_value(c, headp, vars, isfunction, workspace);
+		if (cp4) {
+			cp4 = substring(cp4, offset, offset2, workspace, VAR_BUF_SIZE);
+
+			length = strlen(cp4);
+			if (length > count)
+				length = count;
+			memcpy(cp2, cp4, length);
+			count -= length;
+			cp2 += length;
+			*cp2 = 0;
+		}
+	}
+}
+
 /*! \brief CLI support for listing global variables in a parseable way */
 static char *handle_show_globals(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
@@ -1020,6 +1210,7 @@ const char *pbx_builtin_getvar_helper(struct ast_channel *chan, const char *name
 {
 	struct ast_var_t *variables;
 	const char *ret = NULL;
+	unsigned int hash;
 	int i;
 	struct varshead *places[2] = { NULL, &globals };
 
@@ -1031,16 +1222,14 @@ const char *pbx_builtin_getvar_helper(struct ast_channel *chan, const char *name
 		places[0] = ast_channel_varshead(chan);
 	}
 
+	hash = ast_var_hash(name);
 	for (i = 0; i < 2; i++) {
 		if (!places[i])
 			continue;
 		if (places[i] == &globals)
 			ast_rwlock_rdlock(&globalslock);
-		AST_LIST_TRAVERSE(places[i], variables, entries) {
-			if (!strcmp(name, ast_var_name(variables))) {
-				ret = ast_var_value(variables);
-				break;
-			}
+		if ((variables = ast_var_list_find(places[i], name, hash))) {
+			ret = ast_var_value(variables);
 		}
 		if (places[i] == &globals)
 			ast_rwlock_unlock(&globalslock);
@@ -1092,6 +1281,7 @@ int pbx_builtin_setvar_helper(struct ast_channel *chan, const char *name, const
 	struct ast_var_t *newvariable;
 	struct varshead *headp;
 	const char *nametail = name;
+	unsigned int hash;
 	/*! True if the old value was not an empty string. */
 	int old_value_existed = 0;
 
@@ -1116,8 +1306,9 @@ int pbx_builtin_setvar_helper(struct ast_channel *chan, const char *name, const
 			nametail++;
 	}
 
+	hash = ast_var_hash(nametail);
 	AST_LIST_TRAVERSE_SAFE_BEGIN(headp, newvariable, entries) {
-		if (strcmp(ast_var_name(newvariable), nametail) == 0) {
+		if (newvariable->hash == hash && strcmp(ast_var_name(newvariable), nametail) == 0) {
 			/* there is already such a variable, delete it */
 			AST_LIST_REMOVE_CURRENT(entries);
 			old_value_existed = !ast_strlen_zero(ast_var_value(newvariable));
@@ -1224,8 +1415,82 @@ static struct ast_cli_entry vars_cli[] = {
 	AST_CLI_DEFINE(handle_set_chanvar, "Set a channel variable"),
 };
 
+#if defined(TEST_FRAMEWORK)
+AST_TEST_DEFINE(test_substitution_compile)
+{
+	static const char *templates[] = {
+		"${FOO}",
+		"a${FOO}b$c",
+		"${FOO:1:2}${FOO:-2}${FOO:9}",
+		"${LEN(${FOO})} ${LEN(bar)}",
+		"${${NAME}} ${${NAME}:1}",
+		"$[1 + 2] $[${NUM} * 2] $[$[${NUM} + 1] * 3]",
+		"${UNSET}$${BAR:${NUM}}$",
+		"}${FOO}{]$[${NUM}]",
+	};
+	static const int counts[] = { VAR_BUF_SIZE - 1, 4, 1 };
+	char expected[VAR_BUF_SIZE];
+	char actual[VAR_BUF_SIZE];
+	struct ast_channel *chan;
+	struct pbx_substitution *sub;
+	int res = AST_TEST_PASS;
+	int i;
+	int j;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "substitution_compile";
+		info->category = "/main/pbx/";
+		info->summary = "Compiled substitution templates";
+		info->description =
+			"Verify compiled substitution templates substitute the same as the parser.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	chan = ast_dummy_channel_alloc();
+	if (!chan) {
+		return AST_TEST_FAIL;
+	}
+	pbx_builtin_setvar_helper(chan, "FOO", "foobar");
+	pbx_builtin_setvar_helper(chan, "BAR", "barbaz");
+	pbx_builtin_setvar_helper(chan, "NAME", "BAR");
+	pbx_builtin_setvar_helper(chan, "NUM", "2");
+
+	if (pbx_substitution_compile("plain") || pbx_substitution_compile("${FOO")) {
+		ast_test_status_update(test, "Compiled a template there is no point compiling\n");
+		res = AST_TEST_FAIL;
+	}
+
+	for (i = 0; i < ARRAY_LEN(templates); ++i) {
+		sub = pbx_substitution_compile(templates[i]);
+		if (!sub) {
+			ast_test_status_update(test, "Failed to compile '%s'\n", templates[i]);
+			res = AST_TEST_FAIL;
+			continue;
+		}
+		for (j = 0; j < ARRAY_LEN(counts); ++j) {
+			pbx_substitute_variables_helper(chan, templates[i], expected, counts[j]);
+			pbx_substitution_apply(chan, ast_channel_varshead(chan), sub, actual, counts[j]);
+			if (strcmp(expected, actual)) {
+				ast_test_status_update(test, "'%s' substituted to '%s' instead of '%s'\n",
+					templates[i], actual, expected);
+				res = AST_TEST_FAIL;
+			}
+		}
+		ao2_ref(sub, -1);
+	}
+
+	ast_channel_unref(chan);
+
+	return res;
+}
+#endif
+
 static void unload_pbx_variables(void)
 {
+	AST_TEST_UNREGISTER(test_substitution_compile);
 	ast_cli_unregister_multiple(vars_cli, ARRAY_LEN(vars_cli));
 	ast_unregister_application("Set");
 	ast_unregister_application("MSet");
@@ -1239,6 +1504,7 @@ int load_pbx_variables(void)
 	res |= ast_cli_register_multiple(vars_cli, ARRAY_LEN(vars_cli));
 	res |= ast_register_application2("Set", pbx_builtin_setvar, NULL, NULL, NULL);
 	res |= ast_register_application2("MSet", pbx_builtin_setvar_multiple, NULL, NULL, NULL);
+	AST_TEST_REGISTER(test_substitution_compile);
 	ast_register_cleanup(unload_pbx_variables);
 
 	return res;
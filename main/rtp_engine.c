@@ -272,6 +272,20 @@ static int mime_types_len = 0;
  */
 static struct ast_rtp_payload_type *static_RTP_PT[AST_RTP_MAX_PT];
 static ast_rwlock_t static_RTP_PT_lock;
+/*! Incremented whenever static_RTP_PT changes, see ast_rtp_codecs_get_tx_generation() */
+static unsigned int static_RTP_PT_generation;
+
+/*! \brief Note a change of static_RTP_PT, it must be write locked */
+static void static_RTP_PT_changed(void)
+{
+	ast_atomic_fetch_add(&static_RTP_PT_generation, 1, __ATOMIC_RELEASE);
+}
+
+/*! \brief Note a change of the tx payload mappings, the codecs must be write locked */
+static void codecs_tx_changed(struct ast_rtp_codecs *codecs)
+{
+	ast_atomic_fetch_add(&codecs->tx_generation, 1, __ATOMIC_RELEASE);
+}
 
 /*! \brief \ref stasis topic for RTP related messages */
 static struct stasis_topic *rtp_topic;
@@ -456,6 +470,10 @@ static void instance_destructor(void *obj)
 
 int ast_rtp_instance_destroy(struct ast_rtp_instance *instance)
 {
+	if (instance->engine->release) {
+		instance->engine->release(instance);
+	}
+
 	ao2_ref(instance, -1);
 
 	return 0;
@@ -975,6 +993,9 @@ void ast_rtp_codecs_payloads_destroy(struct ast_rtp_codecs *codecs)
 	int idx;
 	struct ast_rtp_payload_type *type;
 
+	/* Lookups cached from these mappings must not survive a clear */
+	codecs_tx_changed(codecs);
+
 	for (idx = 0; idx < AST_VECTOR_SIZE(&codecs->payload_mapping_rx); ++idx) {
 		type = AST_VECTOR_GET(&codecs->payload_mapping_rx, idx);
 		ao2_t_cleanup(type, "destroying ast_rtp_codec rx mapping");
@@ -1250,6 +1271,7 @@ void ast_rtp_codecs_payloads_copy(struct ast_rtp_codecs *src, struct ast_rtp_cod
 	dest->framing = src->framing;
 
 	ast_rwlock_unlock(&src->codecs_lock);
+	codecs_tx_changed(dest);
 	ast_rwlock_unlock(&dest->codecs_lock);
 }
 
@@ -1294,6 +1316,7 @@ void ast_rtp_codecs_payloads_xover(struct ast_rtp_codecs *src, struct ast_rtp_co
 	if (src != dest) {
 		ast_rwlock_unlock(&src->codecs_lock);
 	}
+	codecs_tx_changed(dest);
 	ast_rwlock_unlock(&dest->codecs_lock);
 }
 
@@ -1336,6 +1359,7 @@ void ast_rtp_codecs_payloads_set_m_type(struct ast_rtp_codecs *codecs, struct as
 		ao2_ref(new_type, -1);
 	}
 
+	codecs_tx_changed(codecs);
 	ast_rwlock_unlock(&codecs->codecs_lock);
 }
 
@@ -1418,6 +1442,7 @@ int ast_rtp_codecs_payloads_set_rtpmap_type_rate(struct ast_rtp_codecs *codecs,
 		break;
 	}
 
+	codecs_tx_changed(codecs);
 	ast_rwlock_unlock(&codecs->codecs_lock);
 	ast_rwlock_unlock(&mime_types_lock);
 
@@ -1453,6 +1478,7 @@ void ast_rtp_codecs_payloads_unset(struct ast_rtp_codecs *codecs, struct ast_rtp
 		ao2_unlock(instance);
 	}
 
+	codecs_tx_changed(codecs);
 	ast_rwlock_unlock(&codecs->codecs_lock);
 }
 
@@ -1528,6 +1554,7 @@ int ast_rtp_codecs_payload_replace_format(struct ast_rtp_codecs *codecs, int pay
 	} else {
 		ao2_ref(type, -1);
 	}
+	codecs_tx_changed(codecs);
 	ast_rwlock_unlock(&codecs->codecs_lock);
 
 	return 0;
@@ -1924,6 +1951,13 @@ int ast_rtp_codecs_payload_set_rx(struct ast_rtp_codecs *codecs, int code, struc
 	return rtp_codecs_assign_payload_code_rx(codecs, 1, format, code, 1);
 }
 
+unsigned int ast_rtp_codecs_get_tx_generation(struct ast_rtp_codecs *codecs)
+{
+	/* Both only ever grow, so their sum changes whenever either does */
+	return __atomic_load_n(&codecs->tx_generation, __ATOMIC_ACQUIRE)
+		+ __atomic_load_n(&static_RTP_PT_generation, __ATOMIC_ACQUIRE);
+}
+
 int ast_rtp_codecs_payload_code_tx(struct ast_rtp_codecs *codecs, int asterisk_format, const struct ast_format *format, int code)
 {
 	struct ast_rtp_payload_type *type;
@@ -3212,6 +3246,7 @@ static void add_static_payload(int payload, struct ast_format *format, int rtp_c
 		ao2_cleanup(static_RTP_PT[payload]);
 		static_RTP_PT[payload] = type;
 	}
+	static_RTP_PT_changed();
 	ast_rwlock_unlock(&static_RTP_PT_lock);
 }
 
@@ -3245,6 +3280,7 @@ int ast_rtp_engine_unload_format(struct ast_format *format)
 			static_RTP_PT[x] = NULL;
 		}
 	}
+	static_RTP_PT_changed();
 	ast_rwlock_unlock(&static_RTP_PT_lock);
 
 	ast_rwlock_wrlock(&mime_types_lock);
@@ -3471,6 +3507,28 @@ struct ast_rtp_rtcp_report *ast_rtp_rtcp_report_alloc(unsigned int report_blocks
 	return rtcp_report;
 }
 
+struct ast_rtp_rtcp_report *ast_rtp_rtcp_report_alloc_inline(unsigned int report_blocks)
+{
+	struct ast_rtp_rtcp_report *rtcp_report;
+	struct ast_rtp_rtcp_report_block *blocks;
+	size_t pointers = report_blocks * sizeof(struct ast_rtp_rtcp_report_block *);
+	unsigned int i;
+
+	/* The blocks follow the pointers and go away with the report, so no destructor */
+	rtcp_report = ao2_alloc_options(sizeof(*rtcp_report) + pointers
+		+ report_blocks * sizeof(*blocks), NULL, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!rtcp_report) {
+		return NULL;
+	}
+
+	blocks = (struct ast_rtp_rtcp_report_block *)((char *)rtcp_report->report_block + pointers);
+	for (i = 0; i < report_blocks; i++) {
+		rtcp_report->report_block[i] = &blocks[i];
+	}
+
+	return rtcp_report;
+}
+
 void ast_rtp_publish_rtcp_message(struct ast_rtp_instance *rtp,
 		struct stasis_message_type *message_type,
 		struct ast_rtp_rtcp_report *report,
@@ -3787,6 +3845,8 @@ struct ast_json *ast_rtp_convert_stats_json(const struct ast_rtp_instance_stats
 
 	/* set other items */
 	SET_AST_JSON_OBJ(j_res, "txjitter", ast_json_real_create(stats->txjitter));
+	SET_AST_JSON_OBJ(j_res, "txpacketspersyscall", ast_json_real_create(stats->txpacketspersyscall));
+	SET_AST_JSON_OBJ(j_res, "rxpacketspersyscall", ast_json_real_create(stats->rxpacketspersyscall));
 	SET_AST_JSON_OBJ(j_res, "rxjitter", ast_json_real_create(stats->rxjitter));
 
 	SET_AST_JSON_OBJ(j_res, "remote_maxjitter", ast_json_real_create(stats->remote_maxjitter));
@@ -44,6 +44,8 @@
 #include "asterisk/utils.h"
 #include "asterisk/heap.h"
 #include "asterisk/threadstorage.h"
+#include "asterisk/vector.h"
+#include "asterisk/dlinkedlists.h"
 
 /*!
  * \brief Max num of schedule structs
@@ -91,6 +93,11 @@ struct sched {
 	const void *data;             /*!< Data */
 	ast_sched_cb callback;        /*!< Callback */
 	ssize_t __heap_index;
+	/*! Timing wheel slot the entry is queued on (wheel backend) */
+	struct sched_wheel_slot *wheel_slot;
+	/*! Timing wheel tick the entry expires on (wheel backend) */
+	uint64_t wheel_tick;
+	AST_DLLIST_ENTRY(sched) wheel_list;
 	/*!
 	 * Used to synchronize between thread running a task and thread
 	 * attempting to delete a task
@@ -98,6 +105,30 @@ struct sched {
 	ast_cond_t cond;
 	/*! Indication that a running task was deleted. */
 	unsigned int deleted:1;
+	/*! Indication that the entry is in the scheduler queue. */
+	unsigned int queued:1;
+};
+
+/*!
+ * \brief A scheduler queue implementation
+ *
+ * The scheduler context lock is held for every call.
+ */
+struct sched_queue_methods {
+	/*! Allocate the queue, returns non-zero on failure */
+	int (*init)(struct ast_sched_context *con);
+	/*! Free the queue, it is empty by now */
+	void (*destroy)(struct ast_sched_context *con);
+	/*! Queue an entry by its when and tie_breaker */
+	void (*insert)(struct ast_sched_context *con, struct sched *s);
+	/*! Unqueue an entry, returns non-zero if it was not queued */
+	int (*remove)(struct ast_sched_context *con, struct sched *s);
+	/*! Peek at the earliest queued entry */
+	struct sched *(*first)(struct ast_sched_context *con);
+	/*! Unqueue the earliest entry if it expires before limit */
+	struct sched *(*pop_due)(struct ast_sched_context *con, struct timeval limit);
+	/*! Number of queued entries */
+	size_t (*size)(struct ast_sched_context *con);
 };
 
 struct sched_thread {
@@ -112,7 +143,10 @@ struct ast_sched_context {
 	unsigned int highwater;					/*!< highest count so far */
 	/*! Next tie breaker in case events expire at the same time. */
 	unsigned int tie_breaker;
+	/*! Queue implementation chosen when the context was created */
+	const struct sched_queue_methods *queue;
 	struct ast_heap *sched_heap;
+	struct sched_wheel *sched_wheel;
 	struct sched_thread *sched_thread;
 	/*! The scheduled task that is currently executing */
 	struct sched *currently_executing;
@@ -125,6 +159,8 @@ struct ast_sched_context {
 	AST_LIST_HEAD_NOLOCK(, sched_id) id_queue;
 	/*! The number of IDs in the id_queue */
 	int id_queue_size;
+	/*! Scheduled tasks indexed by ID - 1, NULL while the ID is unassigned */
+	AST_VECTOR(, struct sched *) id_map;
 };
 
 static void *sched_run(void *data)
@@ -231,7 +267,367 @@ static int sched_time_cmp(void *va, void *vb)
 	return cmp;
 }
 
-struct ast_sched_context *ast_sched_context_create(void)
+static int heap_queue_init(struct ast_sched_context *con)
+{
+	con->sched_heap = ast_heap_create(8, sched_time_cmp,
+		offsetof(struct sched, __heap_index));
+	return con->sched_heap ? 0 : -1;
+}
+
+static void heap_queue_destroy(struct ast_sched_context *con)
+{
+	ast_heap_destroy(con->sched_heap);
+	con->sched_heap = NULL;
+}
+
+static void heap_queue_insert(struct ast_sched_context *con, struct sched *s)
+{
+	ast_heap_push(con->sched_heap, s);
+}
+
+static int heap_queue_remove(struct ast_sched_context *con, struct sched *s)
+{
+	return ast_heap_remove(con->sched_heap, s) ? 0 : -1;
+}
+
+static struct sched *heap_queue_first(struct ast_sched_context *con)
+{
+	return ast_heap_peek(con->sched_heap, 1);
+}
+
+static struct sched *heap_queue_pop_due(struct ast_sched_context *con, struct timeval limit)
+{
+	struct sched *s = ast_heap_peek(con->sched_heap, 1);
+
+	if (!s || ast_tvcmp(s->when, limit) != -1) {
+		return NULL;
+	}
+	return ast_heap_pop(con->sched_heap);
+}
+
+static size_t heap_queue_size(struct ast_sched_context *con)
+{
+	return ast_heap_size(con->sched_heap);
+}
+
+static const struct sched_queue_methods heap_queue = {
+	.init = heap_queue_init,
+	.destroy = heap_queue_destroy,
+	.insert = heap_queue_insert,
+	.remove = heap_queue_remove,
+	.first = heap_queue_first,
+	.pop_due = heap_queue_pop_due,
+	.size = heap_queue_size,
+};
+
+/*! Number of bits of the tick indexing the 1ms slots of level 0 */
+#define WHEEL_LEVEL0_BITS 8
+#define WHEEL_LEVEL0_SIZE (1 << WHEEL_LEVEL0_BITS)
+/*! Number of bits of the tick indexing the slots of each upper level */
+#define WHEEL_LEVELN_BITS 6
+#define WHEEL_LEVELN_SIZE (1 << WHEEL_LEVELN_BITS)
+/*! Levels above level 0, together the wheel spans about 18.6 hours */
+#define WHEEL_UPPER_LEVELS 3
+/*! Entries further out than the span of the wheel go on the overflow list */
+#define WHEEL_SPAN_BITS (WHEEL_LEVEL0_BITS + WHEEL_UPPER_LEVELS * WHEEL_LEVELN_BITS)
+
+struct sched_wheel_slot {
+	AST_DLLIST_HEAD_NOLOCK(, sched) entries;
+	/*! Bitmap word tracking which slots of the level are nonempty, NULL if untracked */
+	uint64_t *map;
+	/*! This slot's bit in map */
+	uint64_t bit;
+};
+
+/*!
+ * \brief Hierarchical timing wheel with 1ms ticks
+ *
+ * An entry lives on the lowest level whose slot range still separates its
+ * tick from the current tick: level 0 if both are in the same 256ms block,
+ * level 1 if in the same 16.4s block, and so on.  Lower levels therefore
+ * always expire before higher levels and, within a level, lower slots
+ * before higher ones.  When the wheel advances into the range of an upper
+ * slot, that slot is cascaded down.  Entries on a tick that has been
+ * reached move to the expired list, which is kept in the same order as
+ * the heap (when, then tie breaker) so ordering semantics are unchanged.
+ */
+struct sched_wheel {
+	/*! Time of tick zero */
+	struct timeval epoch;
+	/*! Latest tick reached, entries due on or before it are on expired */
+	uint64_t now;
+	/*! Number of queued entries, including expired ones */
+	size_t count;
+	struct sched_wheel_slot level0[WHEEL_LEVEL0_SIZE];
+	struct sched_wheel_slot upper[WHEEL_UPPER_LEVELS][WHEEL_LEVELN_SIZE];
+	struct sched_wheel_slot overflow;
+	/*! Entries whose tick was reached, sorted */
+	struct sched_wheel_slot expired;
+	uint64_t level0_map[WHEEL_LEVEL0_SIZE / 64];
+	uint64_t upper_map[WHEEL_UPPER_LEVELS];
+};
+
+static uint64_t wheel_tick(struct sched_wheel *wheel, struct timeval tv)
+{
+	int64_t ms = ast_tvdiff_ms(tv, wheel->epoch);
+
+	return ms < 0 ? 0 : ms;
+}
+
+static void wheel_slot_add(struct sched_wheel_slot *slot, struct sched *s)
+{
+	AST_DLLIST_INSERT_TAIL(&slot->entries, s, wheel_list);
+	s->wheel_slot = slot;
+	if (slot->map) {
+		*slot->map |= slot->bit;
+	}
+}
+
+static void wheel_slot_remove(struct sched_wheel_slot *slot, struct sched *s)
+{
+	AST_DLLIST_REMOVE(&slot->entries, s, wheel_list);
+	s->wheel_slot = NULL;
+	if (slot->map && AST_DLLIST_EMPTY(&slot->entries)) {
+		*slot->map &= ~slot->bit;
+	}
+}
+
+/*! \brief The earliest entry on a slot */
+static struct sched *wheel_slot_first(struct sched_wheel_slot *slot)
+{
+	struct sched *s;
+	struct sched *first = NULL;
+
+	AST_DLLIST_TRAVERSE(&slot->entries, s, wheel_list) {
+		if (!first || sched_time_cmp(s, first) > 0) {
+			first = s;
+		}
+	}
+	return first;
+}
+
+/*!
+ * \brief Insert an entry whose tick was reached into the sorted expired list
+ *
+ * Entries mostly arrive in order so the search starts from the tail.
+ */
+static void wheel_expire(struct sched_wheel *wheel, struct sched *s)
+{
+	struct sched *prev = AST_DLLIST_LAST(&wheel->expired.entries);
+
+	while (prev && sched_time_cmp(s, prev) > 0) {
+		prev = AST_DLLIST_PREV(prev, wheel_list);
+	}
+	if (prev) {
+		AST_DLLIST_INSERT_AFTER(&wheel->expired.entries, prev, s, wheel_list);
+	} else {
+		AST_DLLIST_INSERT_HEAD(&wheel->expired.entries, s, wheel_list);
+	}
+	s->wheel_slot = &wheel->expired;
+}
+
+/*! \brief Put an entry on the slot matching its tick relative to the current tick */
+static void wheel_place(struct sched_wheel *wheel, struct sched *s)
+{
+	uint64_t diff;
+	unsigned int shift;
+	int level;
+
+	if (s->wheel_tick <= wheel->now) {
+		wheel_expire(wheel, s);
+		return;
+	}
+
+	diff = s->wheel_tick ^ wheel->now;
+	if (diff < WHEEL_LEVEL0_SIZE) {
+		wheel_slot_add(&wheel->level0[s->wheel_tick & (WHEEL_LEVEL0_SIZE - 1)], s);
+		return;
+	}
+
+	for (level = 0; level < WHEEL_UPPER_LEVELS; ++level) {
+		shift = WHEEL_LEVEL0_BITS + level * WHEEL_LEVELN_BITS;
+		if (diff < (1ULL << (shift + WHEEL_LEVELN_BITS))) {
+			wheel_slot_add(&wheel->upper[level][(s->wheel_tick >> shift) & (WHEEL_LEVELN_SIZE - 1)], s);
+			return;
+		}
+	}
+
+	wheel_slot_add(&wheel->overflow, s);
+}
+
+/*!
+ * \brief Find the nonempty slot holding the earliest unexpired entries
+ *
+ * \param wheel The timing wheel
+ * \param[out] start The first tick covered by the returned slot
+ *
+ * \return The slot or NULL if there are no unexpired entries
+ */
+static struct sched_wheel_slot *wheel_next_slot(struct sched_wheel *wheel, uint64_t *start)
+{
+	unsigned int shift;
+	unsigned int index;
+	int level;
+	int i;
+
+	for (i = 0; i < ARRAY_LEN(wheel->level0_map); ++i) {
+		if (wheel->level0_map[i]) {
+			index = i * 64 + __builtin_ctzll(wheel->level0_map[i]);
+			*start = (wheel->now & ~(uint64_t) (WHEEL_LEVEL0_SIZE - 1)) | index;
+			return &wheel->level0[index];
+		}
+	}
+
+	for (level = 0; level < WHEEL_UPPER_LEVELS; ++level) {
+		if (wheel->upper_map[level]) {
+			shift = WHEEL_LEVEL0_BITS + level * WHEEL_LEVELN_BITS;
+			index = __builtin_ctzll(wheel->upper_map[level]);
+			*start = (wheel->now & ~((1ULL << (shift + WHEEL_LEVELN_BITS)) - 1))
+				| ((uint64_t) index << shift);
+			return &wheel->upper[level][index];
+		}
+	}
+
+	if (!AST_DLLIST_EMPTY(&wheel->overflow.entries)) {
+		*start = wheel_slot_first(&wheel->overflow)->wheel_tick & ~((1ULL << WHEEL_SPAN_BITS) - 1);
+		return &wheel->overflow;
+	}
+
+	return NULL;
+}
+
+/*!
+ * \brief Advance the wheel to a tick, expiring and cascading entries
+ *
+ * The wheel jumps straight to the next nonempty slot each iteration so
+ * the cost depends on the entries moved rather than the time elapsed.
+ */
+static void wheel_advance(struct sched_wheel *wheel, uint64_t target)
+{
+	struct sched_wheel_slot *slot;
+	struct sched *s;
+	struct sched *next;
+	uint64_t start;
+
+	while ((slot = wheel_next_slot(wheel, &start)) && start <= target) {
+		wheel->now = start;
+
+		/* Detach the slot first, overflow entries may need to go right back. */
+		s = AST_DLLIST_FIRST(&slot->entries);
+		AST_DLLIST_HEAD_INIT_NOLOCK(&slot->entries);
+		if (slot->map) {
+			*slot->map &= ~slot->bit;
+		}
+		for (; s; s = next) {
+			next = AST_DLLIST_NEXT(s, wheel_list);
+			wheel_place(wheel, s);
+		}
+	}
+
+	/* No slot starts at or before target so no entry changes level. */
+	if (wheel->now < target) {
+		wheel->now = target;
+	}
+}
+
+static int wheel_queue_init(struct ast_sched_context *con)
+{
+	struct sched_wheel *wheel;
+	int level;
+	int i;
+
+	wheel = ast_calloc(1, sizeof(*wheel));
+	if (!wheel) {
+		return -1;
+	}
+
+	wheel->epoch = ast_tvnow();
+	for (i = 0; i < WHEEL_LEVEL0_SIZE; ++i) {
+		wheel->level0[i].map = &wheel->level0_map[i / 64];
+		wheel->level0[i].bit = 1ULL << (i % 64);
+	}
+	for (level = 0; level < WHEEL_UPPER_LEVELS; ++level) {
+		for (i = 0; i < WHEEL_LEVELN_SIZE; ++i) {
+			wheel->upper[level][i].map = &wheel->upper_map[level];
+			wheel->upper[level][i].bit = 1ULL << i;
+		}
+	}
+
+	con->sched_wheel = wheel;
+	return 0;
+}
+
+static void wheel_queue_destroy(struct ast_sched_context *con)
+{
+	ast_free(con->sched_wheel);
+	con->sched_wheel = NULL;
+}
+
+static void wheel_queue_insert(struct ast_sched_context *con, struct sched *s)
+{
+	struct sched_wheel *wheel = con->sched_wheel;
+
+	s->wheel_tick = wheel_tick(wheel, s->when);
+	wheel_place(wheel, s);
+	++wheel->count;
+}
+
+static int wheel_queue_remove(struct ast_sched_context *con, struct sched *s)
+{
+	if (!s->wheel_slot) {
+		return -1;
+	}
+	wheel_slot_remove(s->wheel_slot, s);
+	--con->sched_wheel->count;
+	return 0;
+}
+
+static struct sched *wheel_queue_first(struct ast_sched_context *con)
+{
+	struct sched_wheel *wheel = con->sched_wheel;
+	struct sched_wheel_slot *slot;
+	uint64_t start;
+
+	if (!AST_DLLIST_EMPTY(&wheel->expired.entries)) {
+		return AST_DLLIST_FIRST(&wheel->expired.entries);
+	}
+
+	slot = wheel_next_slot(wheel, &start);
+	return slot ? wheel_slot_first(slot) : NULL;
+}
+
+static struct sched *wheel_queue_pop_due(struct ast_sched_context *con, struct timeval limit)
+{
+	struct sched_wheel *wheel = con->sched_wheel;
+	struct sched *s;
+
+	wheel_advance(wheel, wheel_tick(wheel, limit));
+
+	/* The tick containing limit may hold entries due just after it. */
+	s = AST_DLLIST_FIRST(&wheel->expired.entries);
+	if (!s || ast_tvcmp(s->when, limit) != -1) {
+		return NULL;
+	}
+	wheel_queue_remove(con, s);
+	return s;
+}
+
+static size_t wheel_queue_size(struct ast_sched_context *con)
+{
+	return con->sched_wheel->count;
+}
+
+static const struct sched_queue_methods wheel_queue = {
+	.init = wheel_queue_init,
+	.destroy = wheel_queue_destroy,
+	.insert = wheel_queue_insert,
+	.remove = wheel_queue_remove,
+	.first = wheel_queue_first,
+	.pop_due = wheel_queue_pop_due,
+	.size = wheel_queue_size,
+};
+
+struct ast_sched_context *ast_sched_context_create_with_backend(enum ast_sched_backend backend)
 {
 	struct ast_sched_context *tmp;
 
@@ -244,8 +640,18 @@ struct ast_sched_context *ast_sched_context_create(void)
 
 	AST_LIST_HEAD_INIT_NOLOCK(&tmp->id_queue);
 
-	if (!(tmp->sched_heap = ast_heap_create(8, sched_time_cmp,
-			offsetof(struct sched, __heap_index)))) {
+	switch (backend) {
+	case AST_SCHED_BACKEND_WHEEL:
+		tmp->queue = &wheel_queue;
+		break;
+	case AST_SCHED_BACKEND_HEAP:
+	default:
+		tmp->queue = &heap_queue;
+		break;
+	}
+
+	if (AST_VECTOR_INIT(&tmp->id_map, 0) || tmp->queue->init(tmp)) {
+		tmp->queue = NULL;
 		ast_sched_context_destroy(tmp);
 		return NULL;
 	}
@@ -253,6 +659,11 @@ struct ast_sched_context *ast_sched_context_create(void)
 	return tmp;
 }
 
+struct ast_sched_context *ast_sched_context_create(void)
+{
+	return ast_sched_context_create_with_backend(AST_SCHED_BACKEND_HEAP);
+}
+
 static void sched_free(struct sched *task)
 {
 	/* task->sched_id will be NULL most of the time, but when the
@@ -268,6 +679,7 @@ void ast_sched_context_destroy(struct ast_sched_context *con)
 {
 	struct sched *s;
 	struct sched_id *sid;
+	int i;
 
 	sched_thread_destroy(con);
 	con->sched_thread = NULL;
@@ -280,12 +692,17 @@ void ast_sched_context_destroy(struct ast_sched_context *con)
 	}
 #endif
 
-	if (con->sched_heap) {
-		while ((s = ast_heap_pop(con->sched_heap))) {
+	for (i = 0; i < AST_VECTOR_SIZE(&con->id_map); ++i) {
+		s = AST_VECTOR_GET(&con->id_map, i);
+		if (s && s->queued) {
+			con->queue->remove(con, s);
 			sched_free(s);
 		}
-		ast_heap_destroy(con->sched_heap);
-		con->sched_heap = NULL;
+	}
+	AST_VECTOR_FREE(&con->id_map);
+
+	if (con->queue) {
+		con->queue->destroy(con);
 	}
 
 	while ((sid = AST_LIST_REMOVE_HEAD(&con->id_queue, list))) {
@@ -328,6 +745,10 @@ static int add_ids(struct ast_sched_context *con)
 		if (!new_id) {
 			break;
 		}
+		if (AST_VECTOR_APPEND(&con->id_map, NULL)) {
+			ast_free(new_id);
+			break;
+		}
 
 		/*
 		 * According to the API doxygen a sched ID of 0 is valid.
@@ -350,12 +771,14 @@ static int set_sched_id(struct ast_sched_context *con, struct sched *new_sched)
 	}
 
 	new_sched->sched_id = AST_LIST_REMOVE_HEAD(&con->id_queue, list);
+	AST_VECTOR_REPLACE(&con->id_map, new_sched->sched_id->id - 1, new_sched);
 	return 0;
 }
 
 static void sched_release(struct ast_sched_context *con, struct sched *tmp)
 {
 	if (tmp->sched_id) {
+		AST_VECTOR_REPLACE(&con->id_map, tmp->sched_id->id - 1, NULL);
 		AST_LIST_INSERT_TAIL(&con->id_queue, tmp->sched_id, list);
 		tmp->sched_id = NULL;
 	}
@@ -402,19 +825,26 @@ static struct sched *sched_alloc(struct ast_sched_context *con)
 	return tmp;
 }
 
+/*! \brief Take a queued sched structure out of the queue */
+static int sched_unqueue(struct ast_sched_context *con, struct sched *s)
+{
+	s->queued = 0;
+	return con->queue->remove(con, s);
+}
+
 void ast_sched_clean_by_callback(struct ast_sched_context *con, ast_sched_cb match, ast_sched_cb cleanup_cb)
 {
-	int i = 1;
+	int i;
 	struct sched *current;
 
 	ast_mutex_lock(&con->lock);
-	while ((current = ast_heap_peek(con->sched_heap, i))) {
-		if (current->callback != match) {
-			i++;
+	for (i = 0; i < AST_VECTOR_SIZE(&con->id_map); ++i) {
+		current = AST_VECTOR_GET(&con->id_map, i);
+		if (!current || !current->queued || current->callback != match) {
 			continue;
 		}
 
-		ast_heap_remove(con->sched_heap, current);
+		sched_unqueue(con, current);
 
 		cleanup_cb(current->data);
 		sched_release(con, current);
@@ -434,7 +864,7 @@ int ast_sched_wait(struct ast_sched_context *con)
 	DEBUG(ast_debug(1, "ast_sched_wait()\n"));
 
 	ast_mutex_lock(&con->lock);
-	if ((s = ast_heap_peek(con->sched_heap, 1))) {
+	if ((s = con->queue->first(con))) {
 		ms = ast_tvdiff_ms(s->when, ast_tvnow());
 		if (ms < 0) {
 			ms = 0;
@@ -457,9 +887,9 @@ static void schedule(struct ast_sched_context *con, struct sched *s)
 {
 	size_t size;
 
-	size = ast_heap_size(con->sched_heap);
+	size = con->queue->size(con);
 
-	/* Record the largest the scheduler heap became for reporting purposes. */
+	/* Record the largest the scheduler queue became for reporting purposes. */
 	if (con->highwater <= size) {
 		con->highwater = size + 1;
 	}
@@ -476,7 +906,8 @@ static void schedule(struct ast_sched_context *con, struct sched *s)
 	}
 	s->tie_breaker = con->tie_breaker;
 
-	ast_heap_push(con->sched_heap, s);
+	s->queued = 1;
+	con->queue->insert(con, s);
 }
 
 /*! \brief
@@ -567,19 +998,15 @@ int ast_sched_add(struct ast_sched_context *con, int when, ast_sched_cb callback
 
 static struct sched *sched_find(struct ast_sched_context *con, int id)
 {
-	int x;
-	size_t heap_size;
-
-	heap_size = ast_heap_size(con->sched_heap);
-	for (x = 1; x <= heap_size; x++) {
-		struct sched *cur = ast_heap_peek(con->sched_heap, x);
+	struct sched *cur;
 
-		if (cur->sched_id->id == id) {
-			return cur;
-		}
+	if (id < 1 || AST_VECTOR_SIZE(&con->id_map) < id) {
+		return NULL;
 	}
 
-	return NULL;
+	/* The currently executing task has an ID but is not queued */
+	cur = AST_VECTOR_GET(&con->id_map, id - 1);
+	return cur && cur->queued ? cur : NULL;
 }
 
 const void *ast_sched_find_data(struct ast_sched_context *con, int id)
@@ -620,8 +1047,8 @@ int ast_sched_del(struct ast_sched_context *con, int id)
 
 	s = sched_find(con, id);
 	if (s) {
-		if (!ast_heap_remove(con->sched_heap, s)) {
-			ast_log(LOG_WARNING,"sched entry %d not in the sched heap?\n", s->sched_id->id);
+		if (sched_unqueue(con, s)) {
+			ast_log(LOG_WARNING,"sched entry %d not in the sched queue?\n", s->sched_id->id);
 		}
 		sched_release(con, s);
 	} else if (con->currently_executing && (id == con->currently_executing->sched_id->id)) {
@@ -663,16 +1090,18 @@ void ast_sched_report(struct ast_sched_context *con, struct ast_str **buf, struc
 	int i, x;
 	struct sched *cur;
 	int countlist[cbnames->numassocs + 1];
-	size_t heap_size;
 
 	memset(countlist, 0, sizeof(countlist));
-	ast_str_set(buf, 0, " Highwater = %u\n schedcnt = %zu\n", con->highwater, ast_heap_size(con->sched_heap));
 
 	ast_mutex_lock(&con->lock);
 
-	heap_size = ast_heap_size(con->sched_heap);
-	for (x = 1; x <= heap_size; x++) {
-		cur = ast_heap_peek(con->sched_heap, x);
+	ast_str_set(buf, 0, " Highwater = %u\n schedcnt = %zu\n", con->highwater, con->queue->size(con));
+
+	for (x = 0; x < AST_VECTOR_SIZE(&con->id_map); x++) {
+		cur = AST_VECTOR_GET(&con->id_map, x);
+		if (!cur || !cur->queued) {
+			continue;
+		}
 		/* match the callback to the cblist */
 		for (i = 0; i < cbnames->numassocs; i++) {
 			if (cur->callback == cbnames->cblist[i]) {
@@ -701,7 +1130,6 @@ void ast_sched_dump(struct ast_sched_context *con)
 	struct sched *q;
 	struct timeval when;
 	int x;
-	size_t heap_size;
 
 	if (!DEBUG_ATLEAST(1)) {
 		return;
@@ -710,20 +1138,22 @@ void ast_sched_dump(struct ast_sched_context *con)
 	when = ast_tvnow();
 #ifdef SCHED_MAX_CACHE
 	ast_log(LOG_DEBUG, "Asterisk Schedule Dump (%zu in Q, %u Total, %u Cache, %u high-water)\n",
-		ast_heap_size(con->sched_heap), con->eventcnt - 1, con->schedccnt, con->highwater);
+		con->queue->size(con), con->eventcnt - 1, con->schedccnt, con->highwater);
 #else
 	ast_log(LOG_DEBUG, "Asterisk Schedule Dump (%zu in Q, %u Total, %u high-water)\n",
-		ast_heap_size(con->sched_heap), con->eventcnt - 1, con->highwater);
+		con->queue->size(con), con->eventcnt - 1, con->highwater);
 #endif
 
 	ast_log(LOG_DEBUG, "=============================================================\n");
 	ast_log(LOG_DEBUG, "|ID    Callback          Data              Time  (sec:ms)   |\n");
 	ast_log(LOG_DEBUG, "+-----+-----------------+-----------------+-----------------+\n");
 	ast_mutex_lock(&con->lock);
-	heap_size = ast_heap_size(con->sched_heap);
-	for (x = 1; x <= heap_size; x++) {
+	for (x = 0; x < AST_VECTOR_SIZE(&con->id_map); x++) {
 		struct timeval delta;
-		q = ast_heap_peek(con->sched_heap, x);
+		q = AST_VECTOR_GET(&con->id_map, x);
+		if (!q || !q->queued) {
+			continue;
+		}
 		delta = ast_tvsub(q->when, when);
 		ast_log(LOG_DEBUG, "|%.4d | %-15p | %-15p | %.6ld : %.6ld |\n",
 			q->sched_id->id,
@@ -751,17 +1181,13 @@ int ast_sched_runq(struct ast_sched_context *con)
 	ast_mutex_lock(&con->lock);
 
 	when = ast_tvadd(ast_tvnow(), ast_tv(0, 1000));
-	for (numevents = 0; (current = ast_heap_peek(con->sched_heap, 1)); numevents++) {
-		/* schedule all events which are going to expire within 1ms.
-		 * We only care about millisecond accuracy anyway, so this will
-		 * help us get more than one event at one time if they are very
-		 * close together.
-		 */
-		if (ast_tvcmp(current->when, when) != -1) {
-			break;
-		}
-
-		current = ast_heap_pop(con->sched_heap);
+	/* schedule all events which are going to expire within 1ms.
+	 * We only care about millisecond accuracy anyway, so this will
+	 * help us get more than one event at one time if they are very
+	 * close together.
+	 */
+	for (numevents = 0; (current = con->queue->pop_due(con, when)); numevents++) {
+		current->queued = 0;
 
 		/*
 		 * At this point, the schedule queue is still intact.  We
@@ -0,0 +1,261 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2019, Sangoma Technologies Corporation
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*! \file
+ *
+ * \brief Vectorized signed linear sample arithmetic and energy
+ *
+ * The kernel matching the CPU is picked once at startup, the scalar
+ * kernel is used when no vector instruction set is available.
+ */
+
+/*** MODULEINFO
+	<support_level>core</support_level>
+ ***/
+
+/* Needed for the inline allocators in the intrinsics headers */
+#define ASTMM_LIBC ASTMM_IGNORE
+#include "asterisk.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SLINEAR_SIMD_X86
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SLINEAR_SIMD_NEON
+#endif
+
+#include "asterisk/_private.h"
+#include "asterisk/utils.h"
+
+static void slinear_saturated_add_scalar(short *input, const short *value, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i < samples; ++i) {
+		ast_slinear_saturated_add(&input[i], (short *) &value[i]);
+	}
+}
+
+static void slinear_saturated_subtract_scalar(short *input, const short *value, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i < samples; ++i) {
+		ast_slinear_saturated_subtract(&input[i], (short *) &value[i]);
+	}
+}
+
+static unsigned int slinear_magnitude_sum_scalar(const short *samples, size_t count)
+{
+	unsigned int sum = 0;
+	size_t i;
+
+	for (i = 0; i < count; ++i) {
+		sum += abs(samples[i]);
+	}
+	return sum;
+}
+
+#if defined(SLINEAR_SIMD_X86)
+/*
+ * The kernels carry their own target attribute so they build without
+ * -msse2/-mavx2 and are only called when the CPU supports them.
+ */
+static __attribute__((target("sse2"))) void slinear_saturated_add_sse2(short *input, const short *value, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i *) (input + i));
+		__m128i b = _mm_loadu_si128((const __m128i *) (value + i));
+
+		_mm_storeu_si128((__m128i *) (input + i), _mm_adds_epi16(a, b));
+	}
+	slinear_saturated_add_scalar(input + i, value + i, samples - i);
+}
+
+static __attribute__((target("sse2"))) void slinear_saturated_subtract_sse2(short *input, const short *value, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i *) (input + i));
+		__m128i b = _mm_loadu_si128((const __m128i *) (value + i));
+
+		_mm_storeu_si128((__m128i *) (input + i), _mm_subs_epi16(a, b));
+	}
+	slinear_saturated_subtract_scalar(input + i, value + i, samples - i);
+}
+
+static __attribute__((target("sse2"))) unsigned int slinear_magnitude_sum_sse2(const short *samples, size_t count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc = _mm_setzero_si128();
+	unsigned int lanes[4];
+	size_t i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i *) (samples + i));
+		__m128i sign = _mm_srai_epi16(x, 15);
+		/* Read as unsigned the magnitude of -32768 is still right */
+		__m128i mag = _mm_sub_epi16(_mm_xor_si128(x, sign), sign);
+
+		acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(mag, zero));
+		acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(mag, zero));
+	}
+	_mm_storeu_si128((__m128i *) lanes, acc);
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3]
+		+ slinear_magnitude_sum_scalar(samples + i, count - i);
+}
+
+static __attribute__((target("avx2"))) void slinear_saturated_add_avx2(short *input, const short *value, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= samples; i += 16) {
+		__m256i a = _mm256_loadu_si256((const __m256i *) (input + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *) (value + i));
+
+		_mm256_storeu_si256((__m256i *) (input + i), _mm256_adds_epi16(a, b));
+	}
+	slinear_saturated_add_sse2(input + i, value + i, samples - i);
+}
+
+static __attribute__((target("avx2"))) void slinear_saturated_subtract_avx2(short *input, const short *value, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= samples; i += 16) {
+		__m256i a = _mm256_loadu_si256((const __m256i *) (input + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *) (value + i));
+
+		_mm256_storeu_si256((__m256i *) (input + i), _mm256_subs_epi16(a, b));
+	}
+	slinear_saturated_subtract_sse2(input + i, value + i, samples - i);
+}
+
+static __attribute__((target("avx2"))) unsigned int slinear_magnitude_sum_avx2(const short *samples, size_t count)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i acc = _mm256_setzero_si256();
+	unsigned int lanes[8];
+	unsigned int sum = 0;
+	size_t i;
+	int lane;
+
+	for (i = 0; i + 16 <= count; i += 16) {
+		/* Read as unsigned the magnitude of -32768 is still right */
+		__m256i mag = _mm256_abs_epi16(_mm256_loadu_si256((const __m256i *) (samples + i)));
+
+		acc = _mm256_add_epi32(acc, _mm256_unpacklo_epi16(mag, zero));
+		acc = _mm256_add_epi32(acc, _mm256_unpackhi_epi16(mag, zero));
+	}
+	_mm256_storeu_si256((__m256i *) lanes, acc);
+	for (lane = 0; lane < 8; ++lane) {
+		sum += lanes[lane];
+	}
+	return sum + slinear_magnitude_sum_sse2(samples + i, count - i);
+}
+#elif defined(SLINEAR_SIMD_NEON)
+static void slinear_saturated_add_neon(short *input, const short *value, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		vst1q_s16(input + i, vqaddq_s16(vld1q_s16(input + i), vld1q_s16(value + i)));
+	}
+	slinear_saturated_add_scalar(input + i, value + i, samples - i);
+}
+
+static void slinear_saturated_subtract_neon(short *input, const short *value, size_t samples)
+{
+	size_t i;
+
+	for (i = 0; i + 8 <= samples; i += 8) {
+		vst1q_s16(input + i, vqsubq_s16(vld1q_s16(input + i), vld1q_s16(value + i)));
+	}
+	slinear_saturated_subtract_scalar(input + i, value + i, samples - i);
+}
+
+static unsigned int slinear_magnitude_sum_neon(const short *samples, size_t count)
+{
+	uint32x4_t acc = vdupq_n_u32(0);
+	size_t i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		/* Read as unsigned the magnitude of -32768 is still right */
+		acc = vpadalq_u16(acc, vreinterpretq_u16_s16(vabsq_s16(vld1q_s16(samples + i))));
+	}
+	return vgetq_lane_u32(acc, 0) + vgetq_lane_u32(acc, 1) + vgetq_lane_u32(acc, 2)
+		+ vgetq_lane_u32(acc, 3) + slinear_magnitude_sum_scalar(samples + i, count - i);
+}
+#endif
+
+/*! \brief Saturated array kernels, picked for the CPU by ast_slinear_simd_init() */
+static void (*slinear_saturated_add_kernel)(short *input, const short *value, size_t samples) = slinear_saturated_add_scalar;
+static void (*slinear_saturated_subtract_kernel)(short *input, const short *value, size_t samples) = slinear_saturated_subtract_scalar;
+/*! \brief Magnitude sum kernel, picked for the CPU by ast_slinear_simd_init() */
+static unsigned int (*slinear_magnitude_sum_kernel)(const short *samples, size_t count) = slinear_magnitude_sum_scalar;
+static const char *slinear_simd_name = "scalar";
+
+int ast_slinear_simd_init(void)
+{
+#if defined(SLINEAR_SIMD_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		slinear_saturated_add_kernel = slinear_saturated_add_avx2;
+		slinear_saturated_subtract_kernel = slinear_saturated_subtract_avx2;
+		slinear_magnitude_sum_kernel = slinear_magnitude_sum_avx2;
+		slinear_simd_name = "avx2";
+	} else if (__builtin_cpu_supports("sse2")) {
+		slinear_saturated_add_kernel = slinear_saturated_add_sse2;
+		slinear_saturated_subtract_kernel = slinear_saturated_subtract_sse2;
+		slinear_magnitude_sum_kernel = slinear_magnitude_sum_sse2;
+		slinear_simd_name = "sse2";
+	}
+#elif defined(SLINEAR_SIMD_NEON)
+	slinear_saturated_add_kernel = slinear_saturated_add_neon;
+	slinear_saturated_subtract_kernel = slinear_saturated_subtract_neon;
+	slinear_magnitude_sum_kernel = slinear_magnitude_sum_neon;
+	slinear_simd_name = "neon";
+#endif
+
+	return 0;
+}
+
+void ast_slinear_saturated_add_array(short *input, const short *value, size_t samples)
+{
+	slinear_saturated_add_kernel(input, value, samples);
+}
+
+void ast_slinear_saturated_subtract_array(short *input, const short *value, size_t samples)
+{
+	slinear_saturated_subtract_kernel(input, value, samples);
+}
+
+int ast_slinear_average_magnitude(const short *samples, size_t samples_len)
+{
+	if (!samples_len) {
+		return 0;
+	}
+	return slinear_magnitude_sum_kernel(samples, samples_len) / samples_len;
+}
+
+const char *ast_slinear_simd_name(void)
+{
+	return slinear_simd_name;
+}
@@ -142,6 +142,23 @@ int ast_slinfactory_feed(struct ast_slinfactory *sf, struct ast_frame *f)
 	return x;
 }
 
+int ast_slinfactory_queue(struct ast_slinfactory *sf, struct ast_frame *f)
+{
+	if (ast_format_cmp(f->subclass.format, sf->output_format) == AST_FORMAT_CMP_NOT_EQUAL) {
+		return -1;
+	}
+
+	if (sf->trans) {
+		ast_translator_free_path(sf->trans);
+		sf->trans = NULL;
+	}
+
+	AST_LIST_INSERT_TAIL(&sf->queue, f, frame_list);
+	sf->size += f->samples;
+
+	return 0;
+}
+
 int ast_slinfactory_read(struct ast_slinfactory *sf, short *buf, size_t samples)
 {
 	struct ast_frame *frame_ptr;
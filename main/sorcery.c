@@ -1809,6 +1809,7 @@ void *ast_sorcery_retrieve_by_id(const struct ast_sorcery *sorcery, const char *
 	void *object = NULL;
 	int i;
 	unsigned int cached = 0;
+	unsigned int missing = 0;
 
 	if (ast_strlen_zero(id)) {
 		return NULL;
@@ -1826,6 +1827,12 @@ void *ast_sorcery_retrieve_by_id(const struct ast_sorcery *sorcery, const char *
 
 		if (wizard->wizard->callbacks.retrieve_id &&
 			!(object = wizard->wizard->callbacks.retrieve_id(sorcery, wizard->data, object_type->name, id))) {
+			/* A cache may know that none of the wizards after it have the object either */
+			if (wizard->caching && wizard->wizard->callbacks.is_missing
+				&& wizard->wizard->callbacks.is_missing(sorcery, wizard->data, object_type->name, id)) {
+				missing = 1;
+				break;
+			}
 			continue;
 		}
 
@@ -1840,6 +1847,15 @@ void *ast_sorcery_retrieve_by_id(const struct ast_sorcery *sorcery, const char *
 		};
 
 		AST_VECTOR_CALLBACK(&object_type->wizards, sorcery_cache_create, NULL, &sdetails, 0);
+	} else if (!object && !missing) {
+		for (i = 0; i < AST_VECTOR_SIZE(&object_type->wizards); i++) {
+			struct ast_sorcery_object_wizard *wizard =
+				AST_VECTOR_GET(&object_type->wizards, i);
+
+			if (wizard->caching && wizard->wizard->callbacks.missing) {
+				wizard->wizard->callbacks.missing(sorcery, wizard->data, object_type->name, id);
+			}
+		}
 	}
 	AST_VECTOR_RW_UNLOCK(&object_type->wizards);
 
@@ -42,6 +42,7 @@
 #include "asterisk/stasis_endpoints.h"
 #include "asterisk/config_options.h"
 #include "asterisk/cli.h"
+#include "asterisk/backtrace.h"
 
 /*** DOCUMENTATION
 	<managerEvent language="en_US" name="UserEvent">
@@ -297,6 +298,9 @@
 /*! Initial size of the subscribers list. */
 #define INITIAL_SUBSCRIBERS_MAX 4
 
+/*! Number of queued messages a subscription mailbox dispatches per wakeup. */
+#define SUBSCRIPTION_MAILBOX_BATCH_SIZE 16
+
 /*! The number of buckets to use for topic pools */
 #define TOPIC_POOL_BUCKETS 57
 
@@ -305,6 +309,35 @@ static struct ast_threadpool *pool;
 
 STASIS_MESSAGE_TYPE_DEFN(stasis_subscription_change_type);
 
+/*! Invocations of a subscription between dispatch cost samples */
+#define DISPATCH_COST_SAMPLE_RATE 64
+
+/*! The number of buckets to use for dispatch costs */
+#define DISPATCH_COST_BUCKETS 257
+
+/*! \brief Sampled time spent delivering one message type to one subscriber callback */
+struct dispatch_cost {
+	/*! The subscriber callback */
+	stasis_subscription_cb callback;
+	/*! Number of timed invocations */
+	unsigned long samples;
+	/*! Total time of the timed invocations, in microseconds */
+	int64_t total;
+	/*! Longest timed invocation, in microseconds */
+	int64_t max;
+	/*! Name of the message type */
+	char type_name[0];
+};
+
+/*! \brief Search key for a dispatch cost */
+struct dispatch_cost_key {
+	stasis_subscription_cb callback;
+	const char *type_name;
+};
+
+/*! Container of dispatch costs, by subscriber callback and message type */
+static struct ao2_container *dispatch_costs;
+
 #if defined(LOW_MEMORY)
 
 #define TOPIC_ALL_BUCKETS 257
@@ -369,6 +402,12 @@ struct stasis_topic {
 	/*! Variable length array of the subscribers */
 	AST_VECTOR(, struct stasis_subscription *) subscribers;
 
+	/*!
+	 * Number of forwarding paths each subscriber is reached through,
+	 * kept parallel to subscribers.
+	 */
+	AST_VECTOR(, unsigned int) subscriber_paths;
+
 	/*! Topics forwarding into this topic */
 	AST_VECTOR(, struct stasis_topic *) upstream_topics;
 
@@ -438,6 +477,7 @@ static void topic_dtor(void *obj)
 	ast_assert(AST_VECTOR_SIZE(&topic->subscribers) == 0);
 
 	AST_VECTOR_FREE(&topic->subscribers);
+	AST_VECTOR_FREE(&topic->subscriber_paths);
 	AST_VECTOR_FREE(&topic->upstream_topics);
 	ast_debug(1, "Topic '%s': %p destroyed\n", topic->name, topic);
 
@@ -570,6 +610,7 @@ struct stasis_topic *stasis_topic_create_with_detail(
 	}
 
 	res |= AST_VECTOR_INIT(&topic->subscribers, INITIAL_SUBSCRIBERS_MAX);
+	res |= AST_VECTOR_INIT(&topic->subscriber_paths, INITIAL_SUBSCRIBERS_MAX);
 	res |= AST_VECTOR_INIT(&topic->upstream_topics, 0);
 	if (res) {
 		ao2_ref(topic, -1);
@@ -643,6 +684,8 @@ struct stasis_subscription_statistics {
 	int messages_dropped;
 	/*! \brief The number of messages that passed filtering */
 	int messages_passed;
+	/*! \brief The number of cache updates replaced by a newer one before dispatch */
+	int messages_coalesced;
 	/*! \brief Using a mailbox to queue messages */
 	int uses_mailbox;
 	/*! \brief Using stasis threadpool for handling messages */
@@ -678,12 +721,16 @@ struct stasis_subscription {
 	 *  Be sure join_lock is held before reading/setting. */
 	int final_message_processed;
 
-	/*! The message types this subscription is accepting */
-	AST_VECTOR(, char) accepted_message_types;
+	/*! Bitmap, indexed by message type id, of the types this subscription is accepting */
+	AST_VECTOR(, unsigned long) accepted_message_types;
 	/*! The message formatters this subscription is accepting */
 	enum stasis_subscription_message_formatters accepted_formatters;
 	/*! The message filter currently in use */
 	enum stasis_subscription_message_filter filter;
+	/*! Cache updates waiting in the mailbox, by cache key, if coalescing */
+	struct ao2_container *coalesced;
+	/*! Number of times the callback has been invoked, drives cost sampling */
+	int invoke_count;
 
 #ifdef AST_DEVMODE
 	/*! Statistics information */
@@ -710,6 +757,7 @@ static void subscription_dtor(void *obj)
 	ast_cond_destroy(&sub->join_cond);
 
 	AST_VECTOR_FREE(&sub->accepted_message_types);
+	ao2_cleanup(sub->coalesced);
 
 #ifdef AST_DEVMODE
 	if (sub->statistics) {
@@ -719,6 +767,140 @@ static void subscription_dtor(void *obj)
 #endif
 }
 
+/*! \brief Number of message types in each word of a subscription's type bitmap */
+#define ACCEPTED_TYPES_PER_WORD (sizeof(unsigned long) * CHAR_BIT)
+
+/*!
+ * \internal
+ * \brief Check a subscription's type bitmap for a message type
+ *
+ * \retval 1 if the type has been accepted
+ * \retval 0 if not
+ */
+static int subscription_type_accepted(const struct stasis_subscription *sub, int type_id)
+{
+	size_t word = type_id / ACCEPTED_TYPES_PER_WORD;
+
+	return word < AST_VECTOR_SIZE(&sub->accepted_message_types)
+		&& (AST_VECTOR_GET(&sub->accepted_message_types, word)
+			& (1UL << (type_id % ACCEPTED_TYPES_PER_WORD))) != 0;
+}
+
+/*!
+ * \internal
+ * \brief Check whether a subscription's filters let a message type through
+ *
+ * Final messages are not considered, they are always let through.
+ *
+ * \retval 1 if messages of the type are dispatched to the subscription
+ * \retval 0 if they are dropped
+ */
+static int subscription_accepts_type(const struct stasis_subscription *sub,
+	struct stasis_message_type *message_type)
+{
+	int type_filter_specified = sub->filter & STASIS_SUBSCRIPTION_FILTER_SELECTIVE;
+	int formatter_filter_specified = sub->accepted_formatters != STASIS_SUBSCRIPTION_FORMATTER_NONE;
+
+	/* Accept if no filters of either type were specified */
+	if (!type_filter_specified && !formatter_filter_specified) {
+		return 1;
+	}
+
+	/* The type and formatter filters are OR'd */
+	if (type_filter_specified
+		&& subscription_type_accepted(sub, stasis_message_type_id(message_type))) {
+		return 1;
+	}
+
+	return formatter_filter_specified
+		&& (sub->accepted_formatters & stasis_message_type_available_formatters(message_type));
+}
+
+static int dispatch_cost_hash(const void *obj, const int flags)
+{
+	const struct dispatch_cost *object;
+	const struct dispatch_cost_key *key;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		key = obj;
+		return ast_str_hash_add(key->type_name, (int) (intptr_t) key->callback);
+	case OBJ_SEARCH_OBJECT:
+		object = obj;
+		return ast_str_hash_add(object->type_name, (int) (intptr_t) object->callback);
+	default:
+		/* Hash can only work on something with a full key. */
+		ast_assert(0);
+		return 0;
+	}
+}
+
+static int dispatch_cost_cmp(void *obj, void *arg, int flags)
+{
+	const struct dispatch_cost *object_left = obj;
+	const struct dispatch_cost *object_right = arg;
+	const struct dispatch_cost_key *key;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_OBJECT:
+		if (object_left->callback != object_right->callback
+			|| strcmp(object_left->type_name, object_right->type_name)) {
+			return 0;
+		}
+		break;
+	case OBJ_SEARCH_KEY:
+		key = arg;
+		if (object_left->callback != key->callback
+			|| strcmp(object_left->type_name, key->type_name)) {
+			return 0;
+		}
+		break;
+	default:
+		return 0;
+	}
+
+	return CMP_MATCH;
+}
+
+/*!
+ * \internal
+ * \brief Add a timed invocation to the cost of its subscriber callback and message type
+ */
+static void dispatch_cost_record(struct stasis_subscription *sub,
+	struct stasis_message *message, int64_t elapsed)
+{
+	struct dispatch_cost_key key = {
+		.callback = sub->callback,
+		.type_name = stasis_message_type_name(stasis_message_type(message)),
+	};
+	struct dispatch_cost *cost;
+
+	if (!dispatch_costs) {
+		return;
+	}
+
+	ao2_lock(dispatch_costs);
+	cost = ao2_find(dispatch_costs, &key, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if (!cost) {
+		cost = ao2_alloc_options(sizeof(*cost) + strlen(key.type_name) + 1, NULL,
+			AO2_ALLOC_OPT_LOCK_NOLOCK);
+		if (!cost) {
+			ao2_unlock(dispatch_costs);
+			return;
+		}
+		cost->callback = key.callback;
+		strcpy(cost->type_name, key.type_name); /* SAFE */
+		ao2_link_flags(dispatch_costs, cost, OBJ_NOLOCK);
+	}
+	++cost->samples;
+	cost->total += elapsed;
+	if (elapsed > cost->max) {
+		cost->max = elapsed;
+	}
+	ao2_unlock(dispatch_costs);
+	ao2_ref(cost, -1);
+}
+
 /*!
  * \brief Invoke the subscription's callback.
  * \param sub Subscription to invoke.
@@ -730,6 +912,8 @@ static void subscription_invoke(struct stasis_subscription *sub,
 {
 	unsigned int final = stasis_subscription_final_message(sub, message);
 	int message_type_id = stasis_message_type_id(stasis_subscription_change_type());
+	int sampled = !(ast_atomic_fetchadd_int(&sub->invoke_count, +1) % DISPATCH_COST_SAMPLE_RATE);
+	struct timeval sample_start;
 #ifdef AST_DEVMODE
 	struct timeval start;
 	long elapsed;
@@ -750,9 +934,15 @@ static void subscription_invoke(struct stasis_subscription *sub,
 	 * if the subscriber accepts subscription_change message types.
 	 */
 	if (!final || sub->filter != STASIS_SUBSCRIPTION_FILTER_SELECTIVE ||
-		(message_type_id < AST_VECTOR_SIZE(&sub->accepted_message_types) && AST_VECTOR_GET(&sub->accepted_message_types, message_type_id))) {
+		subscription_type_accepted(sub, message_type_id)) {
 		/* Since sub is mostly immutable, no need to lock sub */
-		sub->callback(sub->data, sub, message);
+		if (sampled) {
+			sample_start = ast_tvnow();
+			sub->callback(sub->data, sub, message);
+			dispatch_cost_record(sub, message, ast_tvdiff_us(ast_tvnow(), sample_start));
+		} else {
+			sub->callback(sub->data, sub, message);
+		}
 	}
 
 	/* Notify that the final message has been processed */
@@ -876,7 +1066,7 @@ struct stasis_subscription *internal_stasis_subscribe(
 		if (use_thread_pool) {
 			sub->mailbox = ast_threadpool_serializer(tps_name, pool);
 		} else {
-			sub->mailbox = ast_taskprocessor_get(tps_name, TPS_REF_DEFAULT);
+			sub->mailbox = ast_taskprocessor_get(tps_name, TPS_REF_DEFAULT | TPS_QUEUE_MPSC);
 		}
 		if (!sub->mailbox) {
 			ao2_ref(sub, -1);
@@ -884,6 +1074,7 @@ struct stasis_subscription *internal_stasis_subscribe(
 			return NULL;
 		}
 		ast_taskprocessor_set_local(sub->mailbox, sub);
+		ast_taskprocessor_set_batch_size(sub->mailbox, SUBSCRIPTION_MAILBOX_BATCH_SIZE);
 		/* Taskprocessor has a reference */
 		ao2_ref(sub, +1);
 	}
@@ -992,6 +1183,10 @@ int stasis_subscription_set_congestion_limits(struct stasis_subscription *subscr
 int stasis_subscription_accept_message_type(struct stasis_subscription *subscription,
 	const struct stasis_message_type *type)
 {
+	int type_id;
+	size_t word;
+	unsigned long bit;
+
 	if (!subscription) {
 		return -1;
 	}
@@ -1007,8 +1202,14 @@ int stasis_subscription_accept_message_type(struct stasis_subscription *subscrip
 		return 0;
 	}
 
+	type_id = stasis_message_type_id(type);
+	word = type_id / ACCEPTED_TYPES_PER_WORD;
+	bit = 1UL << (type_id % ACCEPTED_TYPES_PER_WORD);
+
 	ao2_lock(subscription->topic);
-	if (AST_VECTOR_REPLACE(&subscription->accepted_message_types, stasis_message_type_id(type), 1)) {
+	if (word < AST_VECTOR_SIZE(&subscription->accepted_message_types)) {
+		*AST_VECTOR_GET_ADDR(&subscription->accepted_message_types, word) |= bit;
+	} else if (AST_VECTOR_REPLACE(&subscription->accepted_message_types, word, bit)) {
 		/* We do this for the same reason as above. The subscription can still operate, so allow
 		 * it to do so by forcing all messages through.
 		 */
@@ -1022,6 +1223,9 @@ int stasis_subscription_accept_message_type(struct stasis_subscription *subscrip
 int stasis_subscription_decline_message_type(struct stasis_subscription *subscription,
 	const struct stasis_message_type *type)
 {
+	int type_id;
+	size_t word;
+
 	if (!subscription) {
 		return -1;
 	}
@@ -1033,10 +1237,13 @@ int stasis_subscription_decline_message_type(struct stasis_subscription *subscri
 		return 0;
 	}
 
+	type_id = stasis_message_type_id(type);
+	word = type_id / ACCEPTED_TYPES_PER_WORD;
+
 	ao2_lock(subscription->topic);
-	if (stasis_message_type_id(type) < AST_VECTOR_SIZE(&subscription->accepted_message_types)) {
-		/* The memory is already allocated so this can't fail */
-		AST_VECTOR_REPLACE(&subscription->accepted_message_types, stasis_message_type_id(type), 0);
+	if (word < AST_VECTOR_SIZE(&subscription->accepted_message_types)) {
+		*AST_VECTOR_GET_ADDR(&subscription->accepted_message_types, word) &=
+			~(1UL << (type_id % ACCEPTED_TYPES_PER_WORD));
 	}
 	ao2_unlock(subscription->topic);
 
@@ -1071,6 +1278,52 @@ void stasis_subscription_accept_formatters(struct stasis_subscription *subscript
 	return;
 }
 
+/*! \brief Number of buckets for a subscription's coalesced cache updates */
+#define COALESCED_BUCKETS 61
+
+/*! \brief A cache update waiting in a subscription's mailbox */
+struct coalesced_update {
+	/*! The newest update for the key, NULL once taken by the mailbox */
+	struct stasis_message *message;
+	/*! Snapshot type, EID and cache ID of the update */
+	char key[0];
+};
+
+static void coalesced_update_dtor(void *obj)
+{
+	struct coalesced_update *entry = obj;
+
+	ao2_cleanup(entry->message);
+}
+
+AO2_STRING_FIELD_HASH_FN(coalesced_update, key);
+AO2_STRING_FIELD_CMP_FN(coalesced_update, key);
+
+int stasis_subscription_coalesce_cache_updates(struct stasis_subscription *subscription)
+{
+	struct ao2_container *coalesced;
+
+	if (!subscription || !subscription->mailbox) {
+		return -1;
+	}
+
+	coalesced = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0, COALESCED_BUCKETS,
+		coalesced_update_hash_fn, NULL, coalesced_update_cmp_fn);
+	if (!coalesced) {
+		return -1;
+	}
+
+	/* Dispatching happens with the topic locked */
+	ao2_lock(subscription->topic);
+	if (!subscription->coalesced) {
+		subscription->coalesced = ao2_bump(coalesced);
+	}
+	ao2_unlock(subscription->topic);
+	ao2_ref(coalesced, -1);
+
+	return 0;
+}
+
 void stasis_subscription_join(struct stasis_subscription *subscription)
 {
 	if (subscription) {
@@ -1164,60 +1417,112 @@ int stasis_subscription_final_message(struct stasis_subscription *sub, struct st
  * \brief Add a subscriber to a topic.
  * \param topic Topic
  * \param sub Subscriber
+ * \param paths Number of forwarding paths the subscriber is reached through
  * \return 0 on success
  * \return Non-zero on error
  */
-static int topic_add_subscription(struct stasis_topic *topic, struct stasis_subscription *sub)
+static int topic_add_subscription_paths(struct stasis_topic *topic,
+	struct stasis_subscription *sub, unsigned int paths)
 {
 	size_t idx;
 
 	ao2_lock(topic);
-	/* The reference from the topic to the subscription is shared with
-	 * the owner of the subscription, which will explicitly unsubscribe
-	 * to release it.
-	 *
-	 * If we bumped the refcount here, the owner would have to unsubscribe
-	 * and cleanup, which is a bit awkward. */
-	AST_VECTOR_APPEND(&topic->subscribers, sub);
-
-	for (idx = 0; idx < AST_VECTOR_SIZE(&topic->upstream_topics); ++idx) {
-		topic_add_subscription(
-			AST_VECTOR_GET(&topic->upstream_topics, idx), sub);
+	for (idx = 0; idx < AST_VECTOR_SIZE(&topic->subscribers); ++idx) {
+		if (AST_VECTOR_GET(&topic->subscribers, idx) == sub) {
+			break;
+		}
 	}
 
+	if (idx < AST_VECTOR_SIZE(&topic->subscribers)) {
+		/* Already reachable through another forward; it still only
+		 * gets one dispatch per message. */
+		*AST_VECTOR_GET_ADDR(&topic->subscriber_paths, idx) += paths;
+	} else {
+		/* The reference from the topic to the subscription is shared with
+		 * the owner of the subscription, which will explicitly unsubscribe
+		 * to release it.
+		 *
+		 * If we bumped the refcount here, the owner would have to unsubscribe
+		 * and cleanup, which is a bit awkward. */
+		if (AST_VECTOR_APPEND(&topic->subscriber_paths, paths)) {
+			ao2_unlock(topic);
+			return -1;
+		}
+		if (AST_VECTOR_APPEND(&topic->subscribers, sub)) {
+			AST_VECTOR_REMOVE(&topic->subscriber_paths,
+				AST_VECTOR_SIZE(&topic->subscriber_paths) - 1, 0);
+			ao2_unlock(topic);
+			return -1;
+		}
+
 #ifdef AST_DEVMODE
-	ast_str_container_add(topic->statistics->subscribers, stasis_subscription_uniqueid(sub));
-	ast_str_container_add(sub->statistics->topics, stasis_topic_name(topic));
+		ast_str_container_add(topic->statistics->subscribers, stasis_subscription_uniqueid(sub));
+		ast_str_container_add(sub->statistics->topics, stasis_topic_name(topic));
 #endif
+	}
+
+	/* Flatten the forwards so publishing to any upstream topic reaches
+	 * the subscriber directly. */
+	for (idx = 0; idx < AST_VECTOR_SIZE(&topic->upstream_topics); ++idx) {
+		topic_add_subscription_paths(
+			AST_VECTOR_GET(&topic->upstream_topics, idx), sub, paths);
+	}
 
 	ao2_unlock(topic);
 
 	return 0;
 }
 
-static int topic_remove_subscription(struct stasis_topic *topic, struct stasis_subscription *sub)
+static int topic_add_subscription(struct stasis_topic *topic, struct stasis_subscription *sub)
+{
+	return topic_add_subscription_paths(topic, sub, 1);
+}
+
+static int topic_remove_subscription_paths(struct stasis_topic *topic,
+	struct stasis_subscription *sub, unsigned int paths)
 {
 	size_t idx;
-	int res;
+	unsigned int *remaining;
 
 	ao2_lock(topic);
 	for (idx = 0; idx < AST_VECTOR_SIZE(&topic->upstream_topics); ++idx) {
-		topic_remove_subscription(
-			AST_VECTOR_GET(&topic->upstream_topics, idx), sub);
+		topic_remove_subscription_paths(
+			AST_VECTOR_GET(&topic->upstream_topics, idx), sub, paths);
 	}
-	res = AST_VECTOR_REMOVE_ELEM_UNORDERED(&topic->subscribers, sub,
-		AST_VECTOR_ELEM_CLEANUP_NOOP);
 
-#ifdef AST_DEVMODE
-	if (!res) {
-		ast_str_container_remove(topic->statistics->subscribers, stasis_subscription_uniqueid(sub));
-		ast_str_container_remove(sub->statistics->topics, stasis_topic_name(topic));
+	for (idx = 0; idx < AST_VECTOR_SIZE(&topic->subscribers); ++idx) {
+		if (AST_VECTOR_GET(&topic->subscribers, idx) == sub) {
+			break;
+		}
+	}
+	if (idx == AST_VECTOR_SIZE(&topic->subscribers)) {
+		ao2_unlock(topic);
+		return -1;
 	}
+
+	remaining = AST_VECTOR_GET_ADDR(&topic->subscriber_paths, idx);
+	if (*remaining > paths) {
+		*remaining -= paths;
+		ao2_unlock(topic);
+		return 0;
+	}
+
+	AST_VECTOR_REMOVE_UNORDERED(&topic->subscribers, idx);
+	AST_VECTOR_REMOVE_UNORDERED(&topic->subscriber_paths, idx);
+
+#ifdef AST_DEVMODE
+	ast_str_container_remove(topic->statistics->subscribers, stasis_subscription_uniqueid(sub));
+	ast_str_container_remove(sub->statistics->topics, stasis_topic_name(topic));
 #endif
 
 	ao2_unlock(topic);
 
-	return res;
+	return 0;
+}
+
+static int topic_remove_subscription(struct stasis_topic *topic, struct stasis_subscription *sub)
+{
+	return topic_remove_subscription_paths(topic, sub, 1);
 }
 
 /*!
@@ -1236,6 +1541,96 @@ static int dispatch_exec_async(struct ast_taskprocessor_local *local)
 	return 0;
 }
 
+/*!
+ * \internal \brief Dispatch the newest cache update for a key
+ * \param local \ref ast_taskprocessor_local object
+ * \return 0
+ */
+static int dispatch_exec_coalesced(struct ast_taskprocessor_local *local)
+{
+	struct stasis_subscription *sub = local->local_data;
+	struct coalesced_update *entry = local->data;
+	struct stasis_message *message;
+
+	/* Later updates for the key now get a task of their own */
+	ao2_lock(sub->coalesced);
+	ao2_unlink_flags(sub->coalesced, entry, OBJ_NOLOCK);
+	message = entry->message;
+	entry->message = NULL;
+	ao2_unlock(sub->coalesced);
+
+	subscription_invoke(sub, message);
+	ao2_cleanup(message);
+	ao2_ref(entry, -1);
+
+	return 0;
+}
+
+/*!
+ * \internal \brief Queue a cache update, replacing any still waiting with the same key
+ * \param sub Subscription coalescing cache updates
+ * \param message Message to dispatch
+ * \retval 0 if the update was queued or replaced a waiting one
+ * \retval -1 if the message needs dispatching as usual
+ */
+static int dispatch_coalesced(struct stasis_subscription *sub,
+	struct stasis_message *message)
+{
+	struct stasis_cache_update *update;
+	const struct ast_eid *eid;
+	char eid_str[20] = "";
+	struct coalesced_update *entry;
+	size_t key_len;
+	char *key;
+
+	if (stasis_message_type(message) != stasis_cache_update_type()) {
+		return -1;
+	}
+
+	update = stasis_message_data(message);
+	eid = stasis_message_eid(update->new_snapshot ?: update->old_snapshot);
+	if (eid) {
+		ast_eid_to_str(eid_str, sizeof(eid_str), (struct ast_eid *) eid);
+	}
+
+	/* Aggregate snapshots have no EID, keeping them apart from the local ones */
+	key_len = snprintf(NULL, 0, "%p/%s/%s", update->type, eid_str, update->id) + 1;
+	key = ast_alloca(key_len);
+	snprintf(key, key_len, "%p/%s/%s", update->type, eid_str, update->id);
+
+	ao2_lock(sub->coalesced);
+	entry = ao2_find(sub->coalesced, key, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if (entry) {
+		ao2_replace(entry->message, message);
+		ao2_unlock(sub->coalesced);
+		ao2_ref(entry, -1);
+#ifdef AST_DEVMODE
+		ast_atomic_fetchadd_int(&sub->statistics->messages_coalesced, +1);
+#endif
+		return 0;
+	}
+
+	entry = ao2_alloc_options(sizeof(*entry) + key_len, coalesced_update_dtor,
+		AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!entry) {
+		ao2_unlock(sub->coalesced);
+		return -1;
+	}
+	strcpy(entry->key, key);/* Safe */
+	entry->message = ao2_bump(message);
+	ao2_link_flags(sub->coalesced, entry, OBJ_NOLOCK);
+	ao2_unlock(sub->coalesced);
+
+	/* The task owns the reference to the entry */
+	if (ast_taskprocessor_push_local(sub->mailbox, dispatch_exec_coalesced, entry)) {
+		ast_log(LOG_ERROR, "Dropping coalesced dispatch\n");
+		ao2_unlink(sub->coalesced, entry);
+		ao2_ref(entry, -1);
+	}
+
+	return 0;
+}
+
 /*!
  * \internal \brief Data passed to \ref dispatch_exec_sync to synchronize
  * a published message to a subscriber
@@ -1282,61 +1677,15 @@ static unsigned int dispatch_message(struct stasis_subscription *sub,
 	struct stasis_message *message,
 	int synchronous)
 {
-	int is_final = stasis_subscription_final_message(sub, message);
-
-	/*
-	 * The 'do while' gives us an easy way to skip remaining logic once
-	 * we determine the message should be accepted.
-	 * The code looks more verbose than it needs to be but it optimizes
-	 * down very nicely.  It's just easier to understand and debug this way.
-	 */
-	do {
-		struct stasis_message_type *message_type = stasis_message_type(message);
-		int type_id = stasis_message_type_id(message_type);
-		int type_filter_specified = 0;
-		int formatter_filter_specified = 0;
-		int type_filter_passed = 0;
-		int formatter_filter_passed = 0;
-
-		/* We always accept final messages so only run the filter logic if not final */
-		if (is_final) {
-			break;
-		}
-
-		type_filter_specified = sub->filter & STASIS_SUBSCRIPTION_FILTER_SELECTIVE;
-		formatter_filter_specified = sub->accepted_formatters != STASIS_SUBSCRIPTION_FORMATTER_NONE;
-
-		/* Accept if no filters of either type were specified */
-		if (!type_filter_specified && !formatter_filter_specified) {
-			break;
-		}
-
-		type_filter_passed = type_filter_specified
-			&& type_id < AST_VECTOR_SIZE(&sub->accepted_message_types)
-			&& AST_VECTOR_GET(&sub->accepted_message_types, type_id);
-
-		/*
-		 * Since the type and formatter filters are OR'd, we can skip
-		 * the formatter check if the type check passes.
-		 */
-		if (type_filter_passed) {
-			break;
-		}
-
-		formatter_filter_passed = formatter_filter_specified
-			&& (sub->accepted_formatters & stasis_message_type_available_formatters(message_type));
-
-		if (formatter_filter_passed) {
-			break;
-		}
-
+	/* We always accept final messages so only run the filter logic if not final */
+	if (!stasis_subscription_final_message(sub, message)
+		&& !subscription_accepts_type(sub, stasis_message_type(message))) {
 #ifdef AST_DEVMODE
 		ast_atomic_fetchadd_int(&sub->statistics->messages_dropped, +1);
 #endif
 
 		return 0;
-
-	} while (0);
+	}
 
 #ifdef AST_DEVMODE
 	ast_atomic_fetchadd_int(&sub->statistics->messages_passed, +1);
@@ -1348,6 +1697,10 @@ static unsigned int dispatch_message(struct stasis_subscription *sub,
 		return 1;
 	}
 
+	if (sub->coalesced && !synchronous && !dispatch_coalesced(sub, message)) {
+		return 1;
+	}
+
 	/* Bump the message for the taskprocessor push. This will get de-ref'd
 	 * by the task processor callback.
 	 */
@@ -1487,6 +1840,28 @@ void stasis_publish_sync(struct stasis_subscription *sub, struct stasis_message
 	publish_msg(sub->topic, message, sub);
 }
 
+int stasis_topic_wants_message_type(struct stasis_topic *topic,
+	struct stasis_message_type *type)
+{
+	size_t idx;
+	int res = 0;
+
+	if (!topic || !type) {
+		return 0;
+	}
+
+	ao2_lock(topic);
+	for (idx = 0; idx < AST_VECTOR_SIZE(&topic->subscribers); ++idx) {
+		if (subscription_accepts_type(AST_VECTOR_GET(&topic->subscribers, idx), type)) {
+			res = 1;
+			break;
+		}
+	}
+	ao2_unlock(topic);
+
+	return res;
+}
+
 /*!
  * \brief Forwarding information
  *
@@ -1531,7 +1906,8 @@ struct stasis_forward *stasis_forward_cancel(struct stasis_forward *forward)
 			AST_VECTOR_ELEM_CLEANUP_NOOP);
 
 		for (idx = 0; idx < AST_VECTOR_SIZE(&to->subscribers); ++idx) {
-			topic_remove_subscription(from, AST_VECTOR_GET(&to->subscribers, idx));
+			topic_remove_subscription_paths(from, AST_VECTOR_GET(&to->subscribers, idx),
+				AST_VECTOR_GET(&to->subscriber_paths, idx));
 		}
 		ao2_unlock(from);
 		ao2_unlock(to);
@@ -1576,7 +1952,8 @@ struct stasis_forward *stasis_forward_all(struct stasis_topic *from_topic,
 	}
 
 	for (idx = 0; idx < AST_VECTOR_SIZE(&to_topic->subscribers); ++idx) {
-		topic_add_subscription(from_topic, AST_VECTOR_GET(&to_topic->subscribers, idx));
+		topic_add_subscription_paths(from_topic, AST_VECTOR_GET(&to_topic->subscribers, idx),
+			AST_VECTOR_GET(&to_topic->subscriber_paths, idx));
 	}
 	ao2_unlock(from_topic);
 	ao2_unlock(to_topic);
@@ -2407,10 +2784,110 @@ static char *stasis_show_topic(struct ast_cli_entry *e, int cmd, struct ast_cli_
 	return CLI_SUCCESS;
 }
 
+/*! \brief Rank dispatch costs by most total time first */
+static int dispatch_cost_total_cmp(const void *left, const void *right)
+{
+	const struct dispatch_cost *cost_left = *(const struct dispatch_cost **) left;
+	const struct dispatch_cost *cost_right = *(const struct dispatch_cost **) right;
+
+	if (cost_left->total == cost_right->total) {
+		return 0;
+	}
+	return cost_left->total > cost_right->total ? -1 : 1;
+}
+
+/*!
+ * \internal
+ * \brief CLI command implementation for 'stasis show cost'
+ */
+static char *stasis_show_cost(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	AST_VECTOR(, struct dispatch_cost *) ranked;
+	struct ao2_iterator iter;
+	struct dispatch_cost *cost;
+	struct ast_vector_string *symbols;
+	void *callback;
+	int reset = 0;
+	int i;
+#define FMT_HEADERS		"%-48s %-40s %10s %10s %10s %12s\n"
+#define FMT_FIELDS		"%-48.48s %-40.40s %10lu %10" PRId64 " %10" PRId64 " %12" PRId64 "\n"
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "stasis show cost";
+		e->usage =
+			"Usage: stasis show cost [reset]\n"
+			"	Shows the sampled time spent delivering each message type to each\n"
+			"	subscriber callback, most expensive first. One in every "
+			__stringify(DISPATCH_COST_SAMPLE_RATE) "\n"
+			"	deliveries to a subscription is timed. The estimated total is the\n"
+			"	sampled total scaled by the sampling rate. With 'reset', the costs\n"
+			"	are cleared after they are shown.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return a->pos == 3 ? ast_cli_complete(a->word, (const char * const []){ "reset", NULL }, a->n) : NULL;
+	}
+
+	if (a->argc == 4 && !strcasecmp(a->argv[3], "reset")) {
+		reset = 1;
+	} else if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	if (AST_VECTOR_INIT(&ranked, ao2_container_count(dispatch_costs))) {
+		return CLI_FAILURE;
+	}
+
+	/* Copy the costs so the sort and output don't hold up dispatch */
+	ao2_lock(dispatch_costs);
+	iter = ao2_iterator_init(dispatch_costs, AO2_ITERATOR_DONTLOCK
+		| (reset ? AO2_ITERATOR_UNLINK : 0));
+	while ((cost = ao2_iterator_next(&iter))) {
+		struct dispatch_cost *copy;
+
+		copy = ao2_alloc_options(sizeof(*copy) + strlen(cost->type_name) + 1, NULL,
+			AO2_ALLOC_OPT_LOCK_NOLOCK);
+		if (copy) {
+			memcpy(copy, cost, sizeof(*copy) + strlen(cost->type_name) + 1);
+			if (AST_VECTOR_APPEND(&ranked, copy)) {
+				ao2_ref(copy, -1);
+			}
+		}
+		ao2_ref(cost, -1);
+	}
+	ao2_iterator_destroy(&iter);
+	ao2_unlock(dispatch_costs);
+
+	qsort(ranked.elems, AST_VECTOR_SIZE(&ranked),
+		sizeof(struct dispatch_cost *), dispatch_cost_total_cmp);
+
+	ast_cli(a->fd, "\n" FMT_HEADERS, "Subscriber", "Message Type", "Samples",
+		"Avg (us)", "Max (us)", "Est. (ms)");
+	for (i = 0; i < AST_VECTOR_SIZE(&ranked); ++i) {
+		cost = AST_VECTOR_GET(&ranked, i);
+		callback = cost->callback;
+		symbols = ast_bt_get_symbols(&callback, 1);
+		ast_cli(a->fd, FMT_FIELDS,
+			symbols && AST_VECTOR_SIZE(symbols) ? AST_VECTOR_GET(symbols, 0) : "unknown",
+			cost->type_name, cost->samples, cost->total / (int64_t) cost->samples, cost->max,
+			cost->total * DISPATCH_COST_SAMPLE_RATE / 1000);
+		ast_bt_free_symbols(symbols);
+	}
+	ast_cli(a->fd, "\n%zu subscriber and message type pairs\n\n", AST_VECTOR_SIZE(&ranked));
+
+	AST_VECTOR_CALLBACK_VOID(&ranked, ao2_ref, -1);
+	AST_VECTOR_FREE(&ranked);
+
+#undef FMT_HEADERS
+#undef FMT_FIELDS
+
+	return CLI_SUCCESS;
+}
 
 static struct ast_cli_entry cli_stasis[] = {
 	AST_CLI_DEFINE(stasis_show_topics, "Show all topics"),
 	AST_CLI_DEFINE(stasis_show_topic, "Show topic"),
+	AST_CLI_DEFINE(stasis_show_cost, "Show sampled subscriber dispatch costs"),
 };
 
 
@@ -2556,6 +3033,7 @@ static char *statistics_show_subscription(struct ast_cli_entry *e, int cmd, stru
 	ast_cli(a->fd, "Source function: %s\n", S_OR(statistics->func, "<unavailable>"));
 	ast_cli(a->fd, "Number of messages dropped due to filtering: %d\n", statistics->messages_dropped);
 	ast_cli(a->fd, "Number of messages passed to subscriber callback: %d\n", statistics->messages_passed);
+	ast_cli(a->fd, "Number of cache updates coalesced: %d\n", statistics->messages_coalesced);
 	ast_cli(a->fd, "Using mailbox to queue messages: %s\n", statistics->uses_mailbox ? "Yes" : "No");
 	ast_cli(a->fd, "Using stasis threadpool for handling messages: %s\n", statistics->uses_threadpool ? "Yes" : "No");
 	ast_cli(a->fd, "Lowest amount of time (in milliseconds) spent invoking message: %ld\n", statistics->lowest_time_invoked);
@@ -2931,6 +3409,8 @@ static void stasis_cleanup(void)
 	topic_all = NULL;
 	ast_threadpool_shutdown(pool);
 	pool = NULL;
+	ao2_cleanup(dispatch_costs);
+	dispatch_costs = NULL;
 	STASIS_MESSAGE_TYPE_CLEANUP(stasis_subscription_change_type);
 	STASIS_MESSAGE_TYPE_CLEANUP(ast_multi_user_event_type);
 	aco_info_destroy(&cfg_info);
@@ -3029,6 +3509,12 @@ int stasis_init(void)
 		return -1;
 	}
 
+	dispatch_costs = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0, DISPATCH_COST_BUCKETS,
+		dispatch_cost_hash, 0, dispatch_cost_cmp);
+	if (!dispatch_costs) {
+		return -1;
+	}
+
 	if (ast_cli_register_multiple(cli_stasis, ARRAY_LEN(cli_stasis))) {
 		return -1;
 	}
@@ -355,6 +355,7 @@ void ast_bridge_publish_state(struct ast_bridge *bridge)
 
 	ast_assert(bridge != NULL);
 
+	bridge->batch_state_stale = 0;
 	new_snapshot = ast_bridge_snapshot_create(bridge);
 	if (!new_snapshot) {
 		return;
@@ -568,7 +569,12 @@ void ast_bridge_publish_enter(struct ast_bridge *bridge, struct ast_channel *cha
 
 	/* enter blob first, then state */
 	stasis_publish(ast_bridge_topic(bridge), msg);
-	bridge_publish_state_from_blob(bridge, stasis_message_data(msg));
+	if (bridge->batching) {
+		/* The state is published once when the batch ends */
+		bridge->batch_state_stale = 1;
+	} else {
+		bridge_publish_state_from_blob(bridge, stasis_message_data(msg));
+	}
 	ao2_ref(msg, -1);
 }
 
@@ -585,7 +591,12 @@ void ast_bridge_publish_leave(struct ast_bridge *bridge, struct ast_channel *cha
 	}
 
 	/* state first, then leave blob (opposite of enter, preserves nesting of events) */
-	bridge_publish_state_from_blob(bridge, stasis_message_data(msg));
+	if (bridge->batching) {
+		/* The state is published once when the batch ends */
+		bridge->batch_state_stale = 1;
+	} else {
+		bridge_publish_state_from_blob(bridge, stasis_message_data(msg));
+	}
 	stasis_publish(ast_bridge_topic(bridge), msg);
 	ao2_ref(msg, -1);
 }
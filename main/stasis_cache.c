@@ -37,14 +37,19 @@
 #include "asterisk/vector.h"
 
 #ifdef LOW_MEMORY
+#define NUM_CACHE_SHARDS 1
 #define NUM_CACHE_BUCKETS 17
 #else
-#define NUM_CACHE_BUCKETS 563
+/*! Number of independently locked containers a cache is split into */
+#define NUM_CACHE_SHARDS 16
+/*! Number of buckets in each shard */
+#define NUM_CACHE_BUCKETS 37
 #endif
 
 /*! \internal */
 struct stasis_cache {
-	struct ao2_container *entries;
+	/*! Cached entries, spread over the shards by the hash of their key */
+	struct ao2_container *entries[NUM_CACHE_SHARDS];
 	snapshot_get_id id_fn;
 	cache_aggregate_calc_fn aggregate_calc_fn;
 	cache_aggregate_publish_fn aggregate_publish_fn;
@@ -59,6 +64,8 @@ struct stasis_caching_topic {
 	struct stasis_subscription *sub;
 };
 
+static void cache_containers_unregister(const char *name);
+
 static void stasis_caching_topic_dtor(void *obj)
 {
 	struct stasis_caching_topic *caching_topic = obj;
@@ -70,7 +77,7 @@ static void stasis_caching_topic_dtor(void *obj)
 	 * be bad. */
 	ast_assert(stasis_subscription_is_done(caching_topic->sub));
 
-	ao2_container_unregister(stasis_topic_name(caching_topic->topic));
+	cache_containers_unregister(stasis_topic_name(caching_topic->topic));
 
 	ao2_cleanup(caching_topic->sub);
 	caching_topic->sub = NULL;
@@ -326,9 +333,12 @@ static int cache_entry_cmp(void *obj, void *arg, int flags)
 static void cache_dtor(void *obj)
 {
 	struct stasis_cache *cache = obj;
+	int idx;
 
-	ao2_cleanup(cache->entries);
-	cache->entries = NULL;
+	for (idx = 0; idx < NUM_CACHE_SHARDS; ++idx) {
+		ao2_cleanup(cache->entries[idx]);
+		cache->entries[idx] = NULL;
+	}
 }
 
 struct stasis_cache *stasis_cache_create_full(snapshot_get_id id_fn,
@@ -336,6 +346,7 @@ struct stasis_cache *stasis_cache_create_full(snapshot_get_id id_fn,
 	cache_aggregate_publish_fn aggregate_publish_fn)
 {
 	struct stasis_cache *cache;
+	int idx;
 
 	cache = ao2_alloc_options(sizeof(*cache), cache_dtor,
 		AO2_ALLOC_OPT_LOCK_NOLOCK);
@@ -343,11 +354,13 @@ struct stasis_cache *stasis_cache_create_full(snapshot_get_id id_fn,
 		return NULL;
 	}
 
-	cache->entries = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_RWLOCK, 0,
-		NUM_CACHE_BUCKETS, cache_entry_hash, NULL, cache_entry_cmp);
-	if (!cache->entries) {
-		ao2_cleanup(cache);
-		return NULL;
+	for (idx = 0; idx < NUM_CACHE_SHARDS; ++idx) {
+		cache->entries[idx] = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_RWLOCK, 0,
+			NUM_CACHE_BUCKETS, cache_entry_hash, NULL, cache_entry_cmp);
+		if (!cache->entries[idx]) {
+			ao2_cleanup(cache);
+			return NULL;
+		}
 	}
 
 	cache->id_fn = id_fn;
@@ -380,33 +393,49 @@ struct stasis_message *stasis_cache_entry_get_remote(struct stasis_cache_entry *
 	return NULL;
 }
 
+/*!
+ * \internal
+ * \brief Build the key of a cache entry and pick the shard holding it.
+ *
+ * \param cache The cache.
+ * \param key Key to fill in.
+ * \param type Type of message of the cache entry.
+ * \param id Identity of the snapshot of the cache entry.
+ *
+ * \return Container of the cached entries in the shard.
+ */
+static struct ao2_container *cache_shard(struct stasis_cache *cache,
+	struct cache_entry_key *key, struct stasis_message_type *type, const char *id)
+{
+	key->type = type;
+	key->id = id;
+	cache_entry_compute_hash(key);
+
+	return cache->entries[key->hash % NUM_CACHE_SHARDS];
+}
+
 /*!
  * \internal
  * \brief Find the cache entry in the cache entries container.
  *
  * \param entries Container of cached entries.
- * \param type Type of message to retrieve the cache entry.
- * \param id Identity of the snapshot to retrieve the cache entry.
+ * \param search_key Key of the cache entry, from cache_shard().
  *
  * \note The entries container is already locked.
  *
  * \retval Cache-entry on success.
  * \retval NULL Not in cache.
  */
-static struct stasis_cache_entry *cache_find(struct ao2_container *entries, struct stasis_message_type *type, const char *id)
+static struct stasis_cache_entry *cache_find(struct ao2_container *entries, struct cache_entry_key *search_key)
 {
-	struct cache_entry_key search_key;
 	struct stasis_cache_entry *entry;
 
-	search_key.type = type;
-	search_key.id = id;
-	cache_entry_compute_hash(&search_key);
-	entry = ao2_find(entries, &search_key, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	entry = ao2_find(entries, search_key, OBJ_SEARCH_KEY | OBJ_NOLOCK);
 
 	/* Ensure that what we looked for is what we found. */
 	ast_assert(!entry
 		|| (!strcmp(stasis_message_type_name(entry->key.type),
-			stasis_message_type_name(type)) && !strcmp(entry->key.id, id)));
+			stasis_message_type_name(search_key->type)) && !strcmp(entry->key.id, search_key->id)));
 	return entry;
 }
 
@@ -508,23 +537,25 @@ static struct cache_put_snapshots cache_put(struct stasis_cache *cache,
 {
 	struct stasis_cache_entry *cached_entry;
 	struct cache_put_snapshots snapshots;
+	struct cache_entry_key search_key;
+	struct ao2_container *entries;
 
-	ast_assert(cache->entries != NULL);
 	ast_assert(eid != NULL);/* Aggregate snapshots not allowed to be put directly. */
 	ast_assert(new_snapshot == NULL ||
 		type == stasis_message_type(new_snapshot));
 
 	memset(&snapshots, 0, sizeof(snapshots));
 
-	ao2_wrlock(cache->entries);
+	entries = cache_shard(cache, &search_key, type, id);
+	ao2_wrlock(entries);
 
-	cached_entry = cache_find(cache->entries, type, id);
+	cached_entry = cache_find(entries, &search_key);
 
 	/* Update the eid snapshot. */
 	if (!new_snapshot) {
 		/* Remove snapshot from cache */
 		if (cached_entry) {
-			snapshots.old = cache_remove(cache->entries, cached_entry, eid);
+			snapshots.old = cache_remove(entries, cached_entry, eid);
 		}
 	} else if (cached_entry) {
 		/* Update snapshot in cache */
@@ -533,7 +564,7 @@ static struct cache_put_snapshots cache_put(struct stasis_cache *cache,
 		/* Insert into the cache */
 		cached_entry = cache_entry_create(type, id, new_snapshot);
 		if (cached_entry) {
-			ao2_link_flags(cache->entries, cached_entry, OBJ_NOLOCK);
+			ao2_link_flags(entries, cached_entry, OBJ_NOLOCK);
 		}
 	}
 
@@ -544,7 +575,7 @@ static struct cache_put_snapshots cache_put(struct stasis_cache *cache,
 		cached_entry->aggregate = ao2_bump(snapshots.aggregate_new);
 	}
 
-	ao2_unlock(cache->entries);
+	ao2_unlock(entries);
 
 	ao2_cleanup(cached_entry);
 	return snapshots;
@@ -588,9 +619,10 @@ struct ao2_container *stasis_cache_get_all(struct stasis_cache *cache, struct st
 {
 	struct stasis_cache_entry *cached_entry;
 	struct ao2_container *found;
+	struct cache_entry_key search_key;
+	struct ao2_container *entries;
 
 	ast_assert(cache != NULL);
-	ast_assert(cache->entries != NULL);
 	ast_assert(id != NULL);
 
 	if (!type) {
@@ -602,15 +634,16 @@ struct ao2_container *stasis_cache_get_all(struct stasis_cache *cache, struct st
 		return NULL;
 	}
 
-	ao2_rdlock(cache->entries);
+	entries = cache_shard(cache, &search_key, type, id);
+	ao2_rdlock(entries);
 
-	cached_entry = cache_find(cache->entries, type, id);
+	cached_entry = cache_find(entries, &search_key);
 	if (cached_entry && cache_entry_dump(found, cached_entry)) {
 		ao2_cleanup(found);
 		found = NULL;
 	}
 
-	ao2_unlock(cache->entries);
+	ao2_unlock(entries);
 
 	ao2_cleanup(cached_entry);
 	return found;
@@ -660,24 +693,26 @@ struct stasis_message *stasis_cache_get_by_eid(struct stasis_cache *cache, struc
 {
 	struct stasis_cache_entry *cached_entry;
 	struct stasis_message *snapshot = NULL;
+	struct cache_entry_key search_key;
+	struct ao2_container *entries;
 
 	ast_assert(cache != NULL);
-	ast_assert(cache->entries != NULL);
 	ast_assert(id != NULL);
 
 	if (!type) {
 		return NULL;
 	}
 
-	ao2_rdlock(cache->entries);
+	entries = cache_shard(cache, &search_key, type, id);
+	ao2_rdlock(entries);
 
-	cached_entry = cache_find(cache->entries, type, id);
+	cached_entry = cache_find(entries, &search_key);
 	if (cached_entry) {
 		snapshot = cache_entry_by_eid(cached_entry, eid);
 		ao2_bump(snapshot);
 	}
 
-	ao2_unlock(cache->entries);
+	ao2_unlock(entries);
 
 	ao2_cleanup(cached_entry);
 	return snapshot;
@@ -694,6 +729,24 @@ struct cache_dump_data {
 	const struct ast_eid *eid;
 };
 
+/*!
+ * \internal
+ * \brief Run a dump callback over the entries of every shard.
+ *
+ * \note Each shard is locked in turn, so the dump is not a snapshot of
+ * the whole cache at one instant.  Entries are independent, so this is
+ * no different from updates landing just before or after the dump.
+ */
+static void cache_dump_shards(struct stasis_cache *cache, ao2_callback_fn *cb,
+	struct cache_dump_data *cache_dump)
+{
+	int idx;
+
+	for (idx = 0; cache_dump->container && idx < NUM_CACHE_SHARDS; ++idx) {
+		ao2_callback(cache->entries[idx], OBJ_MULTIPLE | OBJ_NODATA, cb, cache_dump);
+	}
+}
+
 static int cache_dump_by_eid_cb(void *obj, void *arg, int flags)
 {
 	struct cache_dump_data *cache_dump = arg;
@@ -720,7 +773,6 @@ struct ao2_container *stasis_cache_dump_by_eid(struct stasis_cache *cache, struc
 	struct cache_dump_data cache_dump;
 
 	ast_assert(cache != NULL);
-	ast_assert(cache->entries != NULL);
 
 	cache_dump.eid = eid;
 	cache_dump.type = type;
@@ -729,7 +781,7 @@ struct ao2_container *stasis_cache_dump_by_eid(struct stasis_cache *cache, struc
 		return NULL;
 	}
 
-	ao2_callback(cache->entries, OBJ_MULTIPLE | OBJ_NODATA, cache_dump_by_eid_cb, &cache_dump);
+	cache_dump_shards(cache, cache_dump_by_eid_cb, &cache_dump);
 	return cache_dump.container;
 }
 
@@ -759,7 +811,6 @@ struct ao2_container *stasis_cache_dump_all(struct stasis_cache *cache, struct s
 	struct cache_dump_data cache_dump;
 
 	ast_assert(cache != NULL);
-	ast_assert(cache->entries != NULL);
 
 	cache_dump.eid = NULL;
 	cache_dump.type = type;
@@ -768,7 +819,7 @@ struct ao2_container *stasis_cache_dump_all(struct stasis_cache *cache, struct s
 		return NULL;
 	}
 
-	ao2_callback(cache->entries, OBJ_MULTIPLE | OBJ_NODATA, cache_dump_all_cb, &cache_dump);
+	cache_dump_shards(cache, cache_dump_all_cb, &cache_dump);
 	return cache_dump.container;
 }
 
@@ -792,10 +843,12 @@ static void stasis_cache_update_dtor(void *obj)
 	update->type = NULL;
 }
 
-static struct stasis_message *update_create(struct stasis_message *old_snapshot, struct stasis_message *new_snapshot)
+static struct stasis_message *update_create(struct stasis_message *old_snapshot,
+	struct stasis_message *new_snapshot, const char *id)
 {
 	struct stasis_cache_update *update;
 	struct stasis_message *msg;
+	size_t id_len = strlen(id) + 1;
 
 	ast_assert(old_snapshot != NULL || new_snapshot != NULL);
 
@@ -803,11 +856,12 @@ static struct stasis_message *update_create(struct stasis_message *old_snapshot,
 		return NULL;
 	}
 
-	update = ao2_alloc_options(sizeof(*update), stasis_cache_update_dtor,
+	update = ao2_alloc_options(sizeof(*update) + id_len, stasis_cache_update_dtor,
 		AO2_ALLOC_OPT_LOCK_NOLOCK);
 	if (!update) {
 		return NULL;
 	}
+	update->id = memcpy(update + 1, id, id_len);
 
 	if (old_snapshot) {
 		ao2_ref(old_snapshot, +1);
@@ -864,14 +918,18 @@ static void caching_topic_exec(void *data, struct stasis_subscription *sub,
 		 */
 		if (strcmp(change->description, "Unsubscribe") == 0) {
 			struct stasis_cache_entry *sub;
+			struct cache_entry_key search_key;
+			struct ao2_container *entries;
 
-			ao2_wrlock(caching_topic->cache->entries);
-			sub = cache_find(caching_topic->cache->entries, stasis_subscription_change_type(), change->uniqueid);
+			entries = cache_shard(caching_topic->cache, &search_key,
+				stasis_subscription_change_type(), change->uniqueid);
+			ao2_wrlock(entries);
+			sub = cache_find(entries, &search_key);
 			if (sub) {
-				cache_remove(caching_topic->cache->entries, sub, stasis_message_eid(message));
+				cache_remove(entries, sub, stasis_message_eid(message));
 				ao2_cleanup(sub);
 			}
-			ao2_unlock(caching_topic->cache->entries);
+			ao2_unlock(entries);
 			ao2_cleanup(caching_topic_needs_unref);
 			return;
 		}
@@ -899,7 +957,7 @@ static void caching_topic_exec(void *data, struct stasis_subscription *sub,
 		snapshots = cache_put(caching_topic->cache, msg_type, msg_id, msg_eid, msg_put);
 		if (snapshots.old || msg_put) {
 			if (stasis_topic_subscribers(caching_topic->topic)) {
-				update = update_create(snapshots.old, msg_put);
+				update = update_create(snapshots.old, msg_put, msg_id);
 				if (update) {
 					stasis_publish(caching_topic->topic, update);
 					ao2_ref(update, -1);
@@ -918,7 +976,7 @@ static void caching_topic_exec(void *data, struct stasis_subscription *sub,
 					snapshots.aggregate_new);
 			}
 			if (stasis_topic_subscribers(caching_topic->topic)) {
-				update = update_create(snapshots.aggregate_old, snapshots.aggregate_new);
+				update = update_create(snapshots.aggregate_old, snapshots.aggregate_new, msg_id);
 				if (update) {
 					stasis_publish(caching_topic->topic, update);
 					ao2_ref(update, -1);
@@ -945,6 +1003,45 @@ static void print_cache_entry(void *v_obj, void *where, ao2_prnt_fn *prnt)
 		entry->key.id, entry->key.hash);
 }
 
+/*!
+ * \internal
+ * \brief Register the shards of a cache for debugging, as name/shard
+ *
+ * \retval 0 on success.
+ * \retval -1 on error, with no shard registered.
+ */
+static int cache_containers_register(struct stasis_cache *cache, const char *name)
+{
+	char shard_name[strlen(name) + 12];
+	int idx;
+
+	for (idx = 0; idx < NUM_CACHE_SHARDS; ++idx) {
+		snprintf(shard_name, sizeof(shard_name), "%s/%d", name, idx);
+		if (ao2_container_register(shard_name, cache->entries[idx], print_cache_entry)) {
+			ast_log(LOG_ERROR, "Stasis cache container '%p' for '%s' did not register\n",
+				cache->entries[idx], shard_name);
+			while (idx--) {
+				snprintf(shard_name, sizeof(shard_name), "%s/%d", name, idx);
+				ao2_container_unregister(shard_name);
+			}
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void cache_containers_unregister(const char *name)
+{
+	char shard_name[strlen(name) + 12];
+	int idx;
+
+	for (idx = 0; idx < NUM_CACHE_SHARDS; ++idx) {
+		snprintf(shard_name, sizeof(shard_name), "%s/%d", name, idx);
+		ao2_container_unregister(shard_name);
+	}
+}
+
 struct stasis_caching_topic *stasis_caching_topic_create(struct stasis_topic *original_topic, struct stasis_cache *cache)
 {
 	struct stasis_caching_topic *caching_topic;
@@ -976,12 +1073,7 @@ struct stasis_caching_topic *stasis_caching_topic_create(struct stasis_topic *or
 	ao2_ref(cache, +1);
 	caching_topic->cache = cache;
 	if (!cache->registered) {
-		if (ao2_container_register(new_name, cache->entries, print_cache_entry)) {
-			ast_log(LOG_ERROR, "Stasis cache container '%p' for '%s' did not register\n",
-				cache->entries, new_name);
-		} else {
-			cache->registered = 1;
-		}
+		cache->registered = !cache_containers_register(cache, new_name);
 	}
 	ast_free(new_name);
 
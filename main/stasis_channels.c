@@ -355,6 +355,46 @@ static struct ast_channel_snapshot_caller *channel_snapshot_caller_create(struct
 	return snapshot;
 }
 
+/*!
+ * \internal
+ * \brief Check whether a caller segment still matches the channel
+ *
+ * \retval 1 if the segment can be shared with a new snapshot
+ * \retval 0 if it needs recreating
+ */
+static int channel_snapshot_caller_matches(const struct ast_channel_snapshot_caller *snapshot,
+	struct ast_channel *chan)
+{
+	struct ast_party_caller *caller = ast_channel_caller(chan);
+	struct ast_party_redirecting *redirecting = ast_channel_redirecting(chan);
+	struct ast_party_dialed *dialed = ast_channel_dialed(chan);
+
+	return snapshot->pres == ast_party_id_presentation(&caller->id)
+		&& !strcmp(snapshot->name, S_COR(caller->id.name.valid, caller->id.name.str, ""))
+		&& !strcmp(snapshot->number, S_COR(caller->id.number.valid, caller->id.number.str, ""))
+		&& !strcmp(snapshot->subaddr, S_COR(caller->id.subaddress.valid, caller->id.subaddress.str, ""))
+		&& !strcmp(snapshot->ani, S_COR(caller->ani.number.valid, caller->ani.number.str, ""))
+		&& !strcmp(snapshot->rdnis, S_COR(redirecting->from.number.valid, redirecting->from.number.str, ""))
+		&& !strcmp(snapshot->dnid, S_OR(dialed->number.str, ""))
+		&& !strcmp(snapshot->dialed_subaddr, S_COR(dialed->subaddress.valid, dialed->subaddress.str, ""));
+}
+
+/*!
+ * \internal
+ * \brief Check whether a connected segment still matches the channel
+ *
+ * \retval 1 if the segment can be shared with a new snapshot
+ * \retval 0 if it needs recreating
+ */
+static int channel_snapshot_connected_matches(const struct ast_channel_snapshot_connected *snapshot,
+	struct ast_channel *chan)
+{
+	struct ast_party_connected_line *connected = ast_channel_connected(chan);
+
+	return !strcmp(snapshot->name, S_COR(connected->id.name.valid, connected->id.name.str, ""))
+		&& !strcmp(snapshot->number, S_COR(connected->id.number.valid, connected->id.number.str, ""));
+}
+
 static struct ast_channel_snapshot_connected *channel_snapshot_connected_create(struct ast_channel *chan)
 {
 	const char *name = S_COR(ast_channel_connected(chan)->id.name.valid, ast_channel_connected(chan)->id.name.str, "");
@@ -496,18 +536,27 @@ struct ast_channel_snapshot *ast_channel_snapshot_create(struct ast_channel *cha
 	/* Unfortunately both caller and connected information do not have an enforced contract with
 	 * the channel API. This has allowed consumers to directly get the caller or connected structure
 	 * and manipulate it. Until such time as there is an enforced contract (which is being tracked under
-	 * ASTERISK-28164) they are each regenerated every time a channel snapshot is created.
+	 * ASTERISK-28164) they are each compared against the channel every time a channel snapshot is
+	 * created, and only regenerated if they differ.
 	 */
-	snapshot->caller = channel_snapshot_caller_create(chan);
-	if (!snapshot->caller) {
-		ao2_ref(snapshot, -1);
-		return NULL;
+	if (old_snapshot && channel_snapshot_caller_matches(old_snapshot->caller, chan)) {
+		snapshot->caller = ao2_bump(old_snapshot->caller);
+	} else {
+		snapshot->caller = channel_snapshot_caller_create(chan);
+		if (!snapshot->caller) {
+			ao2_ref(snapshot, -1);
+			return NULL;
+		}
 	}
 
-	snapshot->connected = channel_snapshot_connected_create(chan);
-	if (!snapshot->connected) {
-		ao2_ref(snapshot, -1);
-		return NULL;
+	if (old_snapshot && channel_snapshot_connected_matches(old_snapshot->connected, chan)) {
+		snapshot->connected = ao2_bump(old_snapshot->connected);
+	} else {
+		snapshot->connected = channel_snapshot_connected_create(chan);
+		if (!snapshot->connected) {
+			ao2_ref(snapshot, -1);
+			return NULL;
+		}
 	}
 
 	if (ast_test_flag(ast_channel_snapshot_segment_flags(chan), AST_CHANNEL_SNAPSHOT_INVALIDATE_BRIDGE)) {
@@ -1121,6 +1170,11 @@ void ast_channel_publish_cached_blob(struct ast_channel *chan, struct stasis_mes
 {
 	struct stasis_message *message;
 
+	/* Skip building the message if every subscriber would filter it out */
+	if (!stasis_topic_wants_message_type(ast_channel_topic(chan), type)) {
+		return;
+	}
+
 	if (!blob) {
 		blob = ast_json_null();
 	}
@@ -1136,6 +1190,11 @@ void ast_channel_publish_blob(struct ast_channel *chan, struct stasis_message_ty
 {
 	struct stasis_message *message;
 
+	/* Skip building the message if every subscriber would filter it out */
+	if (!stasis_topic_wants_message_type(ast_channel_topic(chan), type)) {
+		return;
+	}
+
 	if (!blob) {
 		blob = ast_json_null();
 	}
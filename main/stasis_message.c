@@ -30,6 +30,8 @@
 #include "asterisk.h"
 
 #include "asterisk/astobj2.h"
+#include "asterisk/json.h"
+#include "asterisk/lock.h"
 #include "asterisk/stasis.h"
 #include "asterisk/utils.h"
 #include "asterisk/hashtab.h"
@@ -129,12 +131,29 @@ struct stasis_message {
 	void *data;
 	/*! Where this message originated. */
 	struct ast_eid eid;
+	/*! AMI representation, published on first request and immutable after */
+	struct ast_manager_event_blob *ami;
+	/*! JSON representation, published on first request and immutable after */
+	struct stasis_message_json *json;
+};
+
+/*! \internal \brief A JSON rendering cached on a message */
+struct stasis_message_json {
+	/*! Sanitizer \ref json was rendered with */
+	struct stasis_message_sanitizer *sanitize;
+	/*! The rendering, never modified once published */
+	struct ast_json *json;
 };
 
 static void stasis_message_dtor(void *obj)
 {
 	struct stasis_message *message = obj;
 	ao2_cleanup(message->data);
+	ao2_cleanup(message->ami);
+	if (message->json) {
+		ast_json_unref(message->json->json);
+		ast_free(message->json);
+	}
 }
 
 struct stasis_message *stasis_message_create_full(struct stasis_message_type *type, void *data, const struct ast_eid *eid)
@@ -221,16 +240,87 @@ const struct timeval *stasis_message_timestamp(const struct stasis_message *msg)
 		msg->type->vtable->fn(__VA_ARGS__);		\
 	})
 
-struct ast_manager_event_blob *stasis_message_to_ami(struct stasis_message *msg)
+static struct ast_manager_event_blob *message_render_ami(struct stasis_message *msg)
 {
 	return INVOKE_VIRTUAL(to_ami, msg);
 }
 
+static struct ast_json *message_render_json(struct stasis_message *msg,
+	struct stasis_message_sanitizer *sanitize)
+{
+	return INVOKE_VIRTUAL(to_json, msg, sanitize);
+}
+
+struct ast_manager_event_blob *stasis_message_to_ami(struct stasis_message *msg)
+{
+	struct ast_manager_event_blob *ami;
+	struct ast_manager_event_blob *cached = NULL;
+
+	if (!msg) {
+		return NULL;
+	}
+
+	/* The message holds the published blob for as long as the caller holds the message */
+	ami = ast_atomic_load_n(&msg->ami, __ATOMIC_ACQUIRE);
+	if (ami) {
+		return ao2_bump(ami);
+	}
+
+	ami = message_render_ami(msg);
+	if (!ami) {
+		return NULL;
+	}
+
+	/* Whoever publishes first wins; a blob rendered concurrently is dropped */
+	if (!ast_atomic_compare_exchange_n(&msg->ami, &cached, ami, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		ao2_ref(ami, -1);
+		ami = cached;
+	}
+
+	return ao2_bump(ami);
+}
+
 struct ast_json *stasis_message_to_json(
 	struct stasis_message *msg,
 	struct stasis_message_sanitizer *sanitize)
 {
-	return INVOKE_VIRTUAL(to_json, msg, sanitize);
+	struct stasis_message_json *rendered;
+	struct stasis_message_json *cached = NULL;
+	struct ast_json *json;
+
+	if (!msg) {
+		return NULL;
+	}
+
+	/*
+	 * Callers own what they get back and commonly add fields to it, so
+	 * they get a deep copy of the published rendering.
+	 */
+	rendered = ast_atomic_load_n(&msg->json, __ATOMIC_ACQUIRE);
+	if (rendered && rendered->sanitize == sanitize) {
+		return ast_json_deep_copy(rendered->json);
+	}
+
+	json = message_render_json(msg, sanitize);
+	if (!json || rendered) {
+		/* Only the first sanitizer's rendering is kept */
+		return json;
+	}
+
+	rendered = ast_malloc(sizeof(*rendered));
+	if (!rendered) {
+		return json;
+	}
+	rendered->sanitize = sanitize;
+	rendered->json = json;
+
+	if (!ast_atomic_compare_exchange_n(&msg->json, &cached, rendered, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		/* Rendered concurrently, so this rendering is the caller's own */
+		ast_free(rendered);
+		return json;
+	}
+
+	return ast_json_deep_copy(json);
 }
 
 struct ast_event *stasis_message_to_event(struct stasis_message *msg)
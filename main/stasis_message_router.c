@@ -307,6 +307,16 @@ int stasis_message_router_set_congestion_limits(struct stasis_message_router *ro
 	return res;
 }
 
+int stasis_message_router_coalesce_cache_updates(struct stasis_message_router *router)
+{
+	int res = -1;
+
+	if (router) {
+		res = stasis_subscription_coalesce_cache_updates(router->subscription);
+	}
+	return res;
+}
+
 int stasis_message_router_add(struct stasis_message_router *router,
 	struct stasis_message_type *message_type,
 	stasis_subscription_cb callback, void *data)
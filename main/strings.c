@@ -170,6 +170,64 @@ char *__ast_str_helper2(struct ast_str **buf, ssize_t maxlen, const char *src, s
 	return (*buf)->__AST_STR_STR;
 }
 
+int ast_str_append_raw(struct ast_str **buf, ssize_t max_len, const char *src, size_t len)
+{
+	size_t used = (*buf)->__AST_STR_USED;
+	size_t need = used + len + 1;
+	int res = 0;
+
+	if (max_len < 0) {
+		max_len = (*buf)->__AST_STR_LEN;	/* don't exceed the allocated space */
+	}
+
+	if (need > (*buf)->__AST_STR_LEN) {
+		size_t grow = need;
+
+		if (max_len == 0) {
+			/* unbounded, give more room for next time */
+			grow += 16 + need / 4;
+		} else if ((size_t) max_len < grow) {
+			grow = max_len;
+		}
+
+		if (grow > (*buf)->__AST_STR_LEN && ast_str_make_space(buf, grow)
+			&& (*buf)->__AST_STR_TS != DS_ALLOCA && (*buf)->__AST_STR_TS != DS_STATIC) {
+			ast_log_safe(LOG_VERBOSE, "failed to extend from %d to %d\n",
+				(int) (*buf)->__AST_STR_LEN, (int) grow);
+			res = AST_DYNSTR_BUILD_FAILED;
+		}
+
+		/* Truncate to whatever space we ended up with. */
+		if (need > (*buf)->__AST_STR_LEN) {
+			len = (*buf)->__AST_STR_LEN > used + 1 ? (*buf)->__AST_STR_LEN - used - 1 : 0;
+		}
+	}
+
+	memcpy((*buf)->__AST_STR_STR + used, src, len);
+	(*buf)->__AST_STR_USED = used + len;
+	(*buf)->__AST_STR_STR[used + len] = '\0';
+
+	return res ? res : len;
+}
+
+int ast_str_append_int(struct ast_str **buf, ssize_t max_len, intmax_t value)
+{
+	char tmp[sizeof(intmax_t) * 3 + 2];
+	char *pos = tmp + sizeof(tmp);
+	uintmax_t magnitude = value < 0 ? -(uintmax_t) value : (uintmax_t) value;
+
+	do {
+		*--pos = '0' + (magnitude % 10);
+		magnitude /= 10;
+	} while (magnitude);
+
+	if (value < 0) {
+		*--pos = '-';
+	}
+
+	return ast_str_append_raw(buf, max_len, pos, tmp + sizeof(tmp) - pos);
+}
+
 static int str_hash(const void *obj, const int flags)
 {
 	return ast_str_hash(obj);
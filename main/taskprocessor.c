@@ -36,6 +36,15 @@
 #include "asterisk/cli.h"
 #include "asterisk/taskprocessor.h"
 #include "asterisk/sem.h"
+#include "asterisk/backtrace.h"
+
+/*!
+ * \brief Number of log2 microsecond buckets in the latency histograms
+ *
+ * Bucket 0 counts everything under 2us, bucket n counts [2^n, 2^(n+1)) us
+ * and the last bucket counts everything from about 8 seconds up.
+ */
+#define TPS_HISTOGRAM_BUCKETS 24
 
 /*!
  * \brief tps_task structure is queued to a taskprocessor
@@ -52,8 +61,10 @@ struct tps_task {
 	} callback;
 	/*! \brief The data pointer for the task execute() function */
 	void *datap;
-	/*! \brief AST_LIST_ENTRY overhead */
+	/*! \brief AST_LIST_ENTRY overhead, doubles as the MPSC queue link */
 	AST_LIST_ENTRY(tps_task) list;
+	/*! \brief When the task was queued */
+	struct timeval queued;
 	unsigned int wants_local:1;
 };
 
@@ -63,6 +74,14 @@ struct tps_taskprocessor_stats {
 	unsigned long max_qsize;
 	/*! \brief This is the current number of tasks processed */
 	unsigned long _tasks_processed_count;
+	/*! \brief Tasks by time from being queued to starting to run */
+	unsigned long wait_histogram[TPS_HISTOGRAM_BUCKETS];
+	/*! \brief Tasks by time spent running */
+	unsigned long exec_histogram[TPS_HISTOGRAM_BUCKETS];
+	/*! \brief Longest time a task has run, in microseconds */
+	int64_t slowest_exec;
+	/*! \brief Callback of the task that ran the longest */
+	void *slowest_callback;
 };
 
 /*! \brief A ast_taskprocessor structure is a singleton by name */
@@ -78,6 +97,16 @@ struct ast_taskprocessor {
 	long tps_queue_high;
 	/*! \brief Taskprocessor queue */
 	AST_LIST_HEAD_NOLOCK(tps_queue, tps_task) tps_queue;
+	/*! \brief MPSC queue producer end, swapped atomically by pushers */
+	struct tps_task *mpsc_head;
+	/*! \brief MPSC queue consumer end, only touched by the executing thread */
+	struct tps_task *mpsc_tail;
+	/*! \brief MPSC queue placeholder so the list is never truly empty */
+	struct tps_task mpsc_stub;
+	/*! \brief MPSC queued plus executing task count, used for was_empty */
+	long mpsc_pending;
+	/*! \brief Maximum number of tasks run per ast_taskprocessor_execute() */
+	unsigned int batch_size;
 	struct ast_taskprocessor_listener *listener;
 	/*! Current thread executing the tasks */
 	pthread_t thread;
@@ -89,6 +118,8 @@ struct ast_taskprocessor {
 	unsigned int high_water_alert:1;
 	/*! Indicates if the taskprocessor is currently suspended */
 	unsigned int suspended:1;
+	/*! Indicates the queue is the lock-free MPSC list rather than tps_queue */
+	unsigned int mpsc:1;
 	/*! \brief Anything before the first '/' in the name (if there is one) */
 	char *subsystem;
 	/*! \brief Friendly name of the taskprocessor.
@@ -153,10 +184,12 @@ static int tps_ping_handler(void *datap);
 static char *cli_tps_ping(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a);
 static char *cli_tps_report(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a);
 static char *cli_subsystem_alert_report(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a);
+static char *cli_tps_latency(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a);
 
 static struct ast_cli_entry taskprocessor_clis[] = {
 	AST_CLI_DEFINE(cli_tps_ping, "Ping a named task processor"),
 	AST_CLI_DEFINE(cli_tps_report, "List instantiated task processors and statistics"),
+	AST_CLI_DEFINE(cli_tps_latency, "Show task wait and run time histograms of a task processor"),
 	AST_CLI_DEFINE(cli_subsystem_alert_report, "List task processor subsystems in alert"),
 };
 
@@ -193,6 +226,8 @@ static void *default_tps_processing_function(void *data)
 	struct default_taskprocessor_listener_pvt *pvt = listener->user_data;
 	int sem_value;
 	int res;
+	unsigned long waits = 0;
+	unsigned long processed;
 
 	while (!pvt->dead) {
 		res = ast_sem_wait(&pvt->sem);
@@ -202,12 +237,24 @@ static void *default_tps_processing_function(void *data)
 			/* Just give up */
 			break;
 		}
+		if (!res) {
+			++waits;
+		}
 		ast_taskprocessor_execute(tps);
 	}
 
 	/* No posting to a dead taskprocessor! */
 	res = ast_sem_getvalue(&pvt->sem, &sem_value);
-	ast_assert(res == 0 && sem_value == 0);
+	if (tps->batch_size > 1) {
+		/* A batched execute consumes one post for several tasks.  Every task
+		 * was posted once, so exactly the posts of those extra tasks remain. */
+		ao2_lock(tps);
+		processed = tps->stats._tasks_processed_count;
+		ao2_unlock(tps);
+		ast_assert(res == 0 && sem_value >= 0 && (unsigned long) sem_value == processed - waits);
+	} else {
+		ast_assert(res == 0 && sem_value == 0);
+	}
 
 	/* Free the shutdown reference (see default_listener_shutdown) */
 	ao2_t_ref(listener->tps, -1, "tps-shutdown");
@@ -335,6 +382,7 @@ static struct tps_task *tps_task_alloc(int (*task_exe)(void *datap), void *datap
 
 	t->callback.execute = task_exe;
 	t->datap = datap;
+	t->queued = ast_tvnow();
 
 	return t;
 }
@@ -355,6 +403,7 @@ static struct tps_task *tps_task_alloc_local(int (*task_exe)(struct ast_taskproc
 
 	t->callback.execute_local = task_exe;
 	t->datap = datap;
+	t->queued = ast_tvnow();
 	t->wants_local = 1;
 
 	return t;
@@ -368,13 +417,13 @@ static void *tps_task_free(struct tps_task *task)
 }
 
 /* taskprocessor tab completion */
-static char *tps_taskprocessor_tab_complete(struct ast_cli_args *a)
+static char *tps_taskprocessor_tab_complete(struct ast_cli_args *a, int pos)
 {
 	int tklen;
 	struct ast_taskprocessor *p;
 	struct ao2_iterator i;
 
-	if (a->pos != 3) {
+	if (a->pos != pos) {
 		return NULL;
 	}
 
@@ -420,7 +469,7 @@ static char *cli_tps_ping(struct ast_cli_entry *e, int cmd, struct ast_cli_args
 			"	Displays the time required for a task to be processed\n";
 		return NULL;
 	case CLI_GENERATE:
-		return tps_taskprocessor_tab_complete(a);
+		return tps_taskprocessor_tab_complete(a, 3);
 	}
 
 	if (a->argc != 4)
@@ -554,6 +603,88 @@ static char *cli_tps_report(struct ast_cli_entry *e, int cmd, struct ast_cli_arg
 	return CLI_SUCCESS;
 }
 
+/*! \brief Histogram bucket for a time in microseconds */
+static unsigned int tps_histogram_bucket(int64_t usec)
+{
+	unsigned int bucket = 0;
+
+	while (usec > 1 && bucket < TPS_HISTOGRAM_BUCKETS - 1) {
+		usec >>= 1;
+		++bucket;
+	}
+	return bucket;
+}
+
+/* show the wait and run time histograms of the specified taskprocessor */
+static char *cli_tps_latency(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct ast_taskprocessor *tps;
+	struct tps_taskprocessor_stats stats;
+	struct ast_vector_string *symbols;
+	void *callback;
+	unsigned long waited = 0;
+	unsigned long ran = 0;
+	int i;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "core show taskprocessor latency";
+		e->usage =
+			"Usage: core show taskprocessor latency <taskprocessor>\n"
+			"	Shows how long tasks waited in the queue and how long they ran\n";
+		return NULL;
+	case CLI_GENERATE:
+		return tps_taskprocessor_tab_complete(a, 4);
+	}
+
+	if (a->argc != 5) {
+		return CLI_SHOWUSAGE;
+	}
+
+	if (!(tps = ast_taskprocessor_get(a->argv[4], TPS_REF_IF_EXISTS))) {
+		ast_cli(a->fd, "\n%s not found\n\n", a->argv[4]);
+		return CLI_SUCCESS;
+	}
+
+	ao2_lock(tps);
+	stats = tps->stats;
+	ao2_unlock(tps);
+	ast_taskprocessor_unreference(tps);
+
+	ast_cli(a->fd, "\n%-24s %12s %12s\n", "Time (us)", "Waited", "Ran");
+	for (i = 0; i < TPS_HISTOGRAM_BUCKETS; ++i) {
+		char range[32];
+
+		if (!stats.wait_histogram[i] && !stats.exec_histogram[i]) {
+			continue;
+		}
+		if (i == 0) {
+			snprintf(range, sizeof(range), "< 2");
+		} else if (i == TPS_HISTOGRAM_BUCKETS - 1) {
+			snprintf(range, sizeof(range), ">= %lu", 1UL << i);
+		} else {
+			snprintf(range, sizeof(range), "%lu - %lu", 1UL << i, (1UL << (i + 1)) - 1);
+		}
+		ast_cli(a->fd, "%-24s %12lu %12lu\n", range,
+			stats.wait_histogram[i], stats.exec_histogram[i]);
+		waited += stats.wait_histogram[i];
+		ran += stats.exec_histogram[i];
+	}
+	ast_cli(a->fd, "%-24s %12lu %12lu\n", "Total", waited, ran);
+
+	if (stats.slowest_callback) {
+		callback = stats.slowest_callback;
+		symbols = ast_bt_get_symbols(&callback, 1);
+		ast_cli(a->fd, "\nSlowest task: %" PRId64 " us in %s\n",
+			stats.slowest_exec,
+			symbols && AST_VECTOR_SIZE(symbols) ? AST_VECTOR_GET(symbols, 0) : "unknown");
+		ast_bt_free_symbols(symbols);
+	}
+	ast_cli(a->fd, "\n");
+
+	return CLI_SUCCESS;
+}
+
 /* hash callback for astobj2 */
 static int tps_hash_cb(const void *obj, const int flags)
 {
@@ -810,6 +941,107 @@ int ast_taskprocessor_alert_set_levels(struct ast_taskprocessor *tps, long low_w
 	return 0;
 }
 
+/*!
+ * \internal
+ * \brief Link a chain of tasks onto the producer end of the MPSC queue.
+ *
+ * Safe to call from any number of threads concurrently.  Between the
+ * exchange and the store the chain is not yet reachable by the consumer,
+ * which tps_mpsc_pop() accounts for.
+ *
+ * \param tps Taskprocessor to queue on.
+ * \param first First task of the chain.
+ * \param last Last task of the chain, its link is cleared.
+ */
+static void tps_mpsc_enqueue(struct ast_taskprocessor *tps, struct tps_task *first, struct tps_task *last)
+{
+	struct tps_task *prev;
+
+	AST_LIST_NEXT(last, list) = NULL;
+	prev = ast_atomic_exchange_n(&tps->mpsc_head, last, __ATOMIC_ACQ_REL);
+	ast_atomic_store_n(&AST_LIST_NEXT(prev, list), first, __ATOMIC_RELEASE);
+}
+
+/*!
+ * \internal
+ * \brief Unlink the oldest task from the consumer end of the MPSC queue.
+ *
+ * \retval NULL if the queue is empty or a producer is mid-push.
+ */
+static struct tps_task *tps_mpsc_dequeue(struct ast_taskprocessor *tps)
+{
+	struct tps_task *tail = tps->mpsc_tail;
+	struct tps_task *next = ast_atomic_load_n(&AST_LIST_NEXT(tail, list), __ATOMIC_ACQUIRE);
+
+	if (tail == &tps->mpsc_stub) {
+		if (!next) {
+			return NULL;
+		}
+		tps->mpsc_tail = next;
+		tail = next;
+		next = ast_atomic_load_n(&AST_LIST_NEXT(next, list), __ATOMIC_ACQUIRE);
+	}
+
+	if (next) {
+		tps->mpsc_tail = next;
+		return tail;
+	}
+
+	if (tail != ast_atomic_load_n(&tps->mpsc_head, __ATOMIC_ACQUIRE)) {
+		return NULL;
+	}
+
+	/* Last real task, put the stub back behind it so it can be unlinked. */
+	tps_mpsc_enqueue(tps, &tps->mpsc_stub, &tps->mpsc_stub);
+	next = ast_atomic_load_n(&AST_LIST_NEXT(tail, list), __ATOMIC_ACQUIRE);
+	if (next) {
+		tps->mpsc_tail = next;
+		return tail;
+	}
+
+	return NULL;
+}
+
+/*!
+ * \internal
+ * \brief Pop the front task of an MPSC taskprocessor.
+ *
+ * Water mark alerts are evaluated without the taskprocessor lock and only
+ * take it when the low water level is actually crossed.
+ *
+ * \param tps Taskprocessor to pop from.
+ * \param wait Non-zero to wait out producers that counted a task but have
+ *        not linked it yet.  Must be zero once this consumer holds popped
+ *        tasks, as those are still counted as pending.
+ */
+static struct tps_task *tps_mpsc_pop(struct ast_taskprocessor *tps, int wait)
+{
+	struct tps_task *task;
+	long size;
+
+	while (!(task = tps_mpsc_dequeue(tps))) {
+		if (!wait || !ast_atomic_load_n(&tps->mpsc_pending, __ATOMIC_ACQUIRE)) {
+			return NULL;
+		}
+		/* A producer has counted its task but not linked it yet. */
+		sched_yield();
+	}
+	/* Detach it from the queue, it may still point at the next task. */
+	AST_LIST_NEXT(task, list) = NULL;
+
+	size = ast_atomic_sub_fetch(&tps->tps_queue_size, 1, __ATOMIC_SEQ_CST);
+	if (tps->high_water_alert && size <= tps->tps_queue_low) {
+		ao2_lock(tps);
+		if (tps->high_water_alert && tps->tps_queue_size <= tps->tps_queue_low) {
+			tps->high_water_alert = 0;
+			tps_alert_add(tps, -1);
+		}
+		ao2_unlock(tps);
+	}
+
+	return task;
+}
+
 /* destroy the taskprocessor */
 static void tps_taskprocessor_dtor(void *tps)
 {
@@ -819,6 +1051,11 @@ static void tps_taskprocessor_dtor(void *tps)
 	while ((task = AST_LIST_REMOVE_HEAD(&t->tps_queue, list))) {
 		tps_task_free(task);
 	}
+	if (t->mpsc) {
+		while ((task = tps_mpsc_dequeue(t))) {
+			tps_task_free(task);
+		}
+	}
 	t->tps_queue_size = 0;
 
 	if (t->high_water_alert) {
@@ -923,12 +1160,14 @@ static void *default_listener_pvt_alloc(void)
  *
  * \param name Name of the task processor.
  * \param listener Listener to associate with the task processor.
+ * \param options Creation options selecting the queue implementation.
  *
  * \return The newly allocated task processor.
  *
  * \pre tps_singletons must be locked by the caller.
  */
-static struct ast_taskprocessor *__allocate_taskprocessor(const char *name, struct ast_taskprocessor_listener *listener)
+static struct ast_taskprocessor *__allocate_taskprocessor(const char *name,
+	struct ast_taskprocessor_listener *listener, enum ast_tps_options options)
 {
 	struct ast_taskprocessor *p;
 	char *subsystem_separator;
@@ -950,6 +1189,13 @@ static struct ast_taskprocessor *__allocate_taskprocessor(const char *name, stru
 	/* Set default congestion water level alert triggers. */
 	p->tps_queue_low = (AST_TASKPROCESSOR_HIGH_WATER_LEVEL * 9) / 10;
 	p->tps_queue_high = AST_TASKPROCESSOR_HIGH_WATER_LEVEL;
+	p->batch_size = 1;
+
+	if (options & TPS_QUEUE_MPSC) {
+		p->mpsc = 1;
+		p->mpsc_head = &p->mpsc_stub;
+		p->mpsc_tail = &p->mpsc_stub;
+	}
 
 	strcpy(p->name, name); /* Safe */
 	p->subsystem = p->name + name_length + 1;
@@ -1020,7 +1266,7 @@ struct ast_taskprocessor *ast_taskprocessor_get(const char *name, enum ast_tps_o
 		return NULL;
 	}
 
-	p = __allocate_taskprocessor(name, listener);
+	p = __allocate_taskprocessor(name, listener, create);
 	ao2_unlock(tps_singletons);
 	p = __start_taskprocessor(p);
 	ao2_ref(listener, -1);
@@ -1029,6 +1275,12 @@ struct ast_taskprocessor *ast_taskprocessor_get(const char *name, enum ast_tps_o
 }
 
 struct ast_taskprocessor *ast_taskprocessor_create_with_listener(const char *name, struct ast_taskprocessor_listener *listener)
+{
+	return ast_taskprocessor_create_with_listener_options(name, listener, TPS_REF_DEFAULT);
+}
+
+struct ast_taskprocessor *ast_taskprocessor_create_with_listener_options(const char *name,
+	struct ast_taskprocessor_listener *listener, enum ast_tps_options options)
 {
 	struct ast_taskprocessor *p;
 
@@ -1040,7 +1292,7 @@ struct ast_taskprocessor *ast_taskprocessor_create_with_listener(const char *nam
 		return NULL;
 	}
 
-	p = __allocate_taskprocessor(name, listener);
+	p = __allocate_taskprocessor(name, listener, options);
 	ao2_unlock(tps_singletons);
 
 	return __start_taskprocessor(p);
@@ -1083,25 +1335,65 @@ void *ast_taskprocessor_unreference(struct ast_taskprocessor *tps)
 	return NULL;
 }
 
-/* push the task into the taskprocessor queue */
-static int taskprocessor_push(struct ast_taskprocessor *tps, struct tps_task *t)
+/*!
+ * \internal
+ * \brief Notify the listener of pushed tasks, once per task.
+ */
+static void taskprocessor_notify_pushed(struct ast_taskprocessor *tps, int was_empty, size_t count)
 {
-	int previous_size;
-	int was_empty;
+	while (count--) {
+		tps->listener->callbacks->task_pushed(tps->listener, was_empty);
+		was_empty = 0;
+	}
+}
 
-	if (!tps) {
-		ast_log(LOG_ERROR, "tps is NULL!\n");
-		return -1;
+/*!
+ * \internal
+ * \brief Push tasks onto an MPSC taskprocessor without taking its lock.
+ *
+ * The lock is only taken when the push crosses the high water level.
+ */
+static int taskprocessor_push_mpsc(struct ast_taskprocessor *tps, struct tps_queue *tasks, size_t count)
+{
+	long previous_pending;
+	long size;
+
+	/* Count the tasks before they are reachable so the consumer waits for them. */
+	previous_pending = ast_atomic_fetch_add(&tps->mpsc_pending, count, __ATOMIC_SEQ_CST);
+	size = ast_atomic_add_fetch(&tps->tps_queue_size, count, __ATOMIC_SEQ_CST);
+	tps_mpsc_enqueue(tps, AST_LIST_FIRST(tasks), AST_LIST_LAST(tasks));
+
+	if (tps->tps_queue_high <= size && !tps->high_water_alert) {
+		ao2_lock(tps);
+		if (tps->tps_queue_high <= tps->tps_queue_size && !tps->high_water_alert) {
+			ast_log(LOG_WARNING, "The '%s' task processor queue reached %ld scheduled tasks%s.\n",
+				tps->name, tps->tps_queue_size, tps->high_water_warned ? " again" : "");
+			tps->high_water_warned = 1;
+			tps->high_water_alert = 1;
+			tps_alert_add(tps, +1);
+		}
+		ao2_unlock(tps);
 	}
 
-	if (!t) {
-		ast_log(LOG_ERROR, "t is NULL!\n");
-		return -1;
+	/* The currently executing task is included in mpsc_pending */
+	taskprocessor_notify_pushed(tps, previous_pending == 0, count);
+	return 0;
+}
+
+/* push the list of tasks into the taskprocessor queue */
+static int taskprocessor_push_list(struct ast_taskprocessor *tps, struct tps_queue *tasks, size_t count)
+{
+	long previous_size;
+	int was_empty;
+
+	if (tps->mpsc) {
+		return taskprocessor_push_mpsc(tps, tasks, count);
 	}
 
 	ao2_lock(tps);
-	AST_LIST_INSERT_TAIL(&tps->tps_queue, t, list);
-	previous_size = tps->tps_queue_size++;
+	AST_LIST_APPEND_LIST(&tps->tps_queue, tasks, list);
+	previous_size = tps->tps_queue_size;
+	tps->tps_queue_size += count;
 
 	if (tps->tps_queue_high <= tps->tps_queue_size) {
 		if (!tps->high_water_alert) {
@@ -1116,10 +1408,29 @@ static int taskprocessor_push(struct ast_taskprocessor *tps, struct tps_task *t)
 	/* The currently executing task counts as still in queue */
 	was_empty = tps->executing ? 0 : previous_size == 0;
 	ao2_unlock(tps);
-	tps->listener->callbacks->task_pushed(tps->listener, was_empty);
+	taskprocessor_notify_pushed(tps, was_empty, count);
 	return 0;
 }
 
+/* push the task into the taskprocessor queue */
+static int taskprocessor_push(struct ast_taskprocessor *tps, struct tps_task *t)
+{
+	struct tps_queue tasks = AST_LIST_HEAD_NOLOCK_INIT_VALUE;
+
+	if (!tps) {
+		ast_log(LOG_ERROR, "tps is NULL!\n");
+		return -1;
+	}
+
+	if (!t) {
+		ast_log(LOG_ERROR, "t is NULL!\n");
+		return -1;
+	}
+
+	AST_LIST_INSERT_TAIL(&tasks, t, list);
+	return taskprocessor_push_list(tps, &tasks, 1);
+}
+
 int ast_taskprocessor_push(struct ast_taskprocessor *tps, int (*task_exe)(void *datap), void *datap)
 {
 	return taskprocessor_push(tps, tps_task_alloc(task_exe, datap));
@@ -1130,6 +1441,35 @@ int ast_taskprocessor_push_local(struct ast_taskprocessor *tps, int (*task_exe)(
 	return taskprocessor_push(tps, tps_task_alloc_local(task_exe, datap));
 }
 
+int ast_taskprocessor_push_batch(struct ast_taskprocessor *tps, int (*task_exe)(void *datap), void **datap, size_t count)
+{
+	struct tps_queue tasks = AST_LIST_HEAD_NOLOCK_INIT_VALUE;
+	struct tps_task *t;
+	size_t i;
+
+	if (!tps) {
+		ast_log(LOG_ERROR, "tps is NULL!\n");
+		return -1;
+	}
+
+	if (!count) {
+		return 0;
+	}
+
+	for (i = 0; i < count; ++i) {
+		t = tps_task_alloc(task_exe, datap[i]);
+		if (!t) {
+			while ((t = AST_LIST_REMOVE_HEAD(&tasks, list))) {
+				tps_task_free(t);
+			}
+			return -1;
+		}
+		AST_LIST_INSERT_TAIL(&tasks, t, list);
+	}
+
+	return taskprocessor_push_list(tps, &tasks, count);
+}
+
 int ast_taskprocessor_suspend(struct ast_taskprocessor *tps)
 {
 	if (tps) {
@@ -1157,34 +1497,84 @@ int ast_taskprocessor_is_suspended(struct ast_taskprocessor *tps)
 	return tps ? tps->suspended : -1;
 }
 
+int ast_taskprocessor_set_batch_size(struct ast_taskprocessor *tps, unsigned int batch_size)
+{
+	if (!tps || !batch_size) {
+		return -1;
+	}
+
+	ao2_lock(tps);
+	tps->batch_size = batch_size;
+	ao2_unlock(tps);
+	return 0;
+}
+
 int ast_taskprocessor_execute(struct ast_taskprocessor *tps)
 {
 	struct ast_taskprocessor_local local;
+	struct tps_queue batch = AST_LIST_HEAD_NOLOCK_INIT_VALUE;
 	struct tps_task *t;
+	void *local_data;
+	unsigned int count = 0;
 	long size;
+	unsigned int wait_buckets[TPS_HISTOGRAM_BUCKETS] = { 0, };
+	unsigned int exec_buckets[TPS_HISTOGRAM_BUCKETS] = { 0, };
+	int64_t slowest_exec = -1;
+	void *slowest_callback = NULL;
+	struct timeval start;
+	struct timeval end;
+	int64_t elapsed;
+	int i;
 
-	ao2_lock(tps);
-	t = tps_taskprocessor_pop(tps);
-	if (!t) {
-		ao2_unlock(tps);
-		return 0;
+	if (tps->mpsc) {
+		/* Only the first pop may wait, popped tasks stay counted as pending. */
+		while (count < tps->batch_size && (t = tps_mpsc_pop(tps, !count))) {
+			AST_LIST_INSERT_TAIL(&batch, t, list);
+			++count;
+		}
+		if (!count) {
+			return 0;
+		}
+		ao2_lock(tps);
+	} else {
+		ao2_lock(tps);
+		while (count < tps->batch_size && (t = tps_taskprocessor_pop(tps))) {
+			AST_LIST_INSERT_TAIL(&batch, t, list);
+			++count;
+		}
+		if (!count) {
+			ao2_unlock(tps);
+			return 0;
+		}
 	}
 
 	tps->thread = pthread_self();
 	tps->executing = 1;
-
-	if (t->wants_local) {
-		local.local_data = tps->local_data;
-		local.data = t->datap;
-	}
+	local_data = tps->local_data;
 	ao2_unlock(tps);
 
-	if (t->wants_local) {
-		t->callback.execute_local(&local);
-	} else {
-		t->callback.execute(t->datap);
+	while ((t = AST_LIST_REMOVE_HEAD(&batch, list))) {
+		start = ast_tvnow();
+		++wait_buckets[tps_histogram_bucket(ast_tvdiff_us(start, t->queued))];
+
+		if (t->wants_local) {
+			local.local_data = local_data;
+			local.data = t->datap;
+			t->callback.execute_local(&local);
+		} else {
+			t->callback.execute(t->datap);
+		}
+
+		end = ast_tvnow();
+		elapsed = ast_tvdiff_us(end, start);
+		++exec_buckets[tps_histogram_bucket(elapsed)];
+		if (elapsed > slowest_exec) {
+			slowest_exec = elapsed;
+			slowest_callback = t->wants_local
+				? (void *) t->callback.execute_local : (void *) t->callback.execute;
+		}
+		tps_task_free(t);
 	}
-	tps_task_free(t);
 
 	ao2_lock(tps);
 	tps->thread = AST_PTHREADT_NULL;
@@ -1194,13 +1584,25 @@ int ast_taskprocessor_execute(struct ast_taskprocessor *tps)
 	 */
 	tps->executing = 0;
 	size = ast_taskprocessor_size(tps);
+	if (tps->mpsc) {
+		/* Tasks counted by a producer that are not linked yet count too. */
+		size = ast_atomic_sub_fetch(&tps->mpsc_pending, count, __ATOMIC_SEQ_CST);
+	}
 
 	/* Update the stats */
-	++tps->stats._tasks_processed_count;
+	tps->stats._tasks_processed_count += count;
+	for (i = 0; i < TPS_HISTOGRAM_BUCKETS; ++i) {
+		tps->stats.wait_histogram[i] += wait_buckets[i];
+		tps->stats.exec_histogram[i] += exec_buckets[i];
+	}
+	if (slowest_exec > tps->stats.slowest_exec) {
+		tps->stats.slowest_exec = slowest_exec;
+		tps->stats.slowest_callback = slowest_callback;
+	}
 
-	/* Include the task we just executed as part of the queue size. */
-	if (size >= tps->stats.max_qsize) {
-		tps->stats.max_qsize = size + 1;
+	/* Include the tasks we just executed as part of the queue size. */
+	if (size + count > tps->stats.max_qsize) {
+		tps->stats.max_qsize = size + count;
 	}
 	ao2_unlock(tps);
 
@@ -23,10 +23,28 @@
 #include "asterisk/taskprocessor.h"
 #include "asterisk/astobj2.h"
 #include "asterisk/utils.h"
+#include "asterisk/vector.h"
+#include "asterisk/dlinkedlists.h"
 
 /* Needs to stay prime if increased */
 #define THREAD_BUCKETS 89
 
+struct worker_thread;
+
+/*!
+ * \brief A task waiting on a worker's local queue
+ *
+ * Only used when the threadpool is in work-stealing mode.
+ */
+struct ws_task {
+	/*! The task to execute */
+	int (*execute)(void *data);
+	/*! The data to pass to the task */
+	void *data;
+	/*! Link to the next/previous task on the worker's queue */
+	AST_DLLIST_ENTRY(ws_task) list;
+};
+
 /*!
  * \brief An opaque threadpool structure
  *
@@ -98,6 +116,21 @@ struct ast_threadpool {
 	int shutting_down;
 	/*! Threadpool-specific options */
 	struct ast_threadpool_options options;
+	/*!
+	 * \brief Running worker threads that own a local task queue
+	 *
+	 * Only used in work-stealing mode. Worker threads add themselves
+	 * when they start and remove themselves before they exit, so no
+	 * references are held here. Anything reaching into a worker's
+	 * queue must hold at least the read lock.
+	 */
+	AST_VECTOR_RW(, struct worker_thread *) ws_workers;
+	/*! Round-robin cursor for tasks pushed from outside the pool */
+	unsigned int ws_next;
+	/*! Number of tasks currently waiting on worker local queues */
+	int ws_queued;
+	/*! Non-zero while a wakeup is queued on the control taskprocessor */
+	int ws_wake_pending;
 };
 
 /*!
@@ -157,6 +190,15 @@ struct worker_thread {
 	int wake_up;
 	/*! Options for this threadpool */
 	struct ast_threadpool_options options;
+	/*! Lock protecting the local task queue */
+	ast_mutex_t queue_lock;
+	/*!
+	 * \brief Local task queue used in work-stealing mode
+	 *
+	 * The owning worker takes tasks from the head. Other workers
+	 * steal from the tail.
+	 */
+	AST_DLLIST_HEAD_NOLOCK(, ws_task) queue;
 };
 
 /* Worker thread forward declarations. See definitions for documentation */
@@ -170,6 +212,7 @@ static int worker_thread_start(struct worker_thread *worker);
 static int worker_idle(struct worker_thread *worker);
 static int worker_set_state(struct worker_thread *worker, enum worker_state state);
 static void worker_shutdown(struct worker_thread *worker);
+static void threadpool_ws_activate(struct ast_threadpool *pool);
 
 /*!
  * \brief Notify the threadpool listener that the state has changed.
@@ -239,6 +282,16 @@ static int queued_active_thread_idle(void *data)
 	ao2_link(pair->pool->idle_threads, pair->worker);
 	ao2_unlink(pair->pool->active_threads, pair->worker);
 
+	/*
+	 * A task may have landed on a local queue after this worker last
+	 * looked but before it showed up as idle. Nobody would wake it for
+	 * that task so take care of it here.
+	 */
+	if (pair->pool->options.work_stealing
+		&& ast_atomic_fetch_add(&pair->pool->ws_queued, 0, __ATOMIC_SEQ_CST)) {
+		threadpool_ws_activate(pair->pool);
+	}
+
 	threadpool_send_state_changed(pair->pool);
 
 	thread_worker_pair_free(pair);
@@ -370,6 +423,113 @@ static int threadpool_execute(struct ast_threadpool *pool)
 	return 0;
 }
 
+/*!
+ * \brief Take the oldest task from a worker's own queue
+ *
+ * \param worker The worker whose queue is checked
+ * \retval NULL The queue is empty
+ * \retval non-NULL The task taken from the queue
+ */
+static struct ws_task *ws_task_pop(struct worker_thread *worker)
+{
+	struct ws_task *task;
+
+	ast_mutex_lock(&worker->queue_lock);
+	task = AST_DLLIST_REMOVE_HEAD(&worker->queue, list);
+	ast_mutex_unlock(&worker->queue_lock);
+
+	if (task) {
+		ast_atomic_fetch_sub(&worker->pool->ws_queued, 1, __ATOMIC_SEQ_CST);
+	}
+	return task;
+}
+
+/*!
+ * \brief Take a task from another worker's queue
+ *
+ * Victims are visited starting at a random position so that idle workers
+ * do not all pile onto the same queue. Tasks are taken from the tail,
+ * leaving the victim's oldest tasks for the victim.
+ *
+ * \param thief The worker looking for something to do
+ * \retval NULL No other worker had a queued task
+ * \retval non-NULL The stolen task
+ */
+static struct ws_task *ws_task_steal(struct worker_thread *thief)
+{
+	struct ast_threadpool *pool = thief->pool;
+	struct ws_task *task = NULL;
+	size_t count;
+	size_t start;
+	size_t i;
+
+	if (!ast_atomic_fetch_add(&pool->ws_queued, 0, __ATOMIC_SEQ_CST)) {
+		return NULL;
+	}
+
+	AST_VECTOR_RW_RDLOCK(&pool->ws_workers);
+	count = AST_VECTOR_SIZE(&pool->ws_workers);
+	start = count ? ast_random() % count : 0;
+	for (i = 0; i < count && !task; ++i) {
+		struct worker_thread *victim = AST_VECTOR_GET(&pool->ws_workers, (start + i) % count);
+
+		if (victim == thief) {
+			continue;
+		}
+
+		ast_mutex_lock(&victim->queue_lock);
+		task = AST_DLLIST_REMOVE_TAIL(&victim->queue, list);
+		ast_mutex_unlock(&victim->queue_lock);
+	}
+	AST_VECTOR_RW_UNLOCK(&pool->ws_workers);
+
+	if (task) {
+		ast_atomic_fetch_sub(&pool->ws_queued, 1, __ATOMIC_SEQ_CST);
+	}
+	return task;
+}
+
+/*!
+ * \brief Execute a task in a work-stealing threadpool
+ *
+ * The worker's own queue is tried first, then the other workers' queues
+ * and finally the shared taskprocessor, which only holds tasks pushed
+ * while no worker was running.
+ *
+ * \param worker The worker executing tasks
+ * \retval 0 Either the pool has been shut down or there are no tasks.
+ * \retval 1 There may still be tasks remaining in the pool.
+ */
+static int threadpool_ws_execute(struct worker_thread *worker)
+{
+	struct ast_threadpool *pool = worker->pool;
+	struct ws_task *task;
+	int (*execute)(void *data);
+	void *data;
+
+	/* Reading this without the pool lock is fine, a task that starts just as
+	 * the pool begins shutting down is no different from one that started a
+	 * moment earlier. */
+	if (pool->shutting_down) {
+		return 0;
+	}
+
+	task = ws_task_pop(worker);
+	if (!task) {
+		task = ws_task_steal(worker);
+	}
+	if (!task) {
+		return ast_taskprocessor_execute(pool->tps);
+	}
+
+	execute = task->execute;
+	data = task->data;
+	ast_free(task);
+
+	execute(data);
+	return 1;
+}
+
 /*!
  * \brief Destroy a threadpool's components.
  *
@@ -387,6 +547,9 @@ static void threadpool_destructor(void *obj)
 {
 	struct ast_threadpool *pool = obj;
 	ao2_cleanup(pool->listener);
+	if (pool->options.work_stealing) {
+		AST_VECTOR_RW_FREE(&pool->ws_workers);
+	}
 }
 
 /*
@@ -435,6 +598,9 @@ static struct ast_threadpool *threadpool_alloc(const char *name, const struct as
 	if (!pool->zombie_threads) {
 		return NULL;
 	}
+	if (options->work_stealing && AST_VECTOR_RW_INIT(&pool->ws_workers, 8)) {
+		return NULL;
+	}
 	pool->options = *options;
 
 	ao2_ref(pool, +1);
@@ -598,6 +764,109 @@ static int queued_task_pushed(void *data)
 	return 0;
 }
 
+/*!
+ * \brief ao2 callback to activate a set number of idle threads
+ *
+ * Called as an ao2_callback_data in the threadpool's control taskprocessor thread.
+ * \param obj The worker to activate
+ * \param arg The pool where the worker belongs
+ * \param data The number of threads still to activate
+ * \retval CMP_MATCH The worker was activated and should be unlinked from the idle threads
+ * \retval CMP_STOP No more threads need to be activated
+ */
+static int activate_threads_limited(void *obj, void *arg, void *data, int flags)
+{
+	int *num_to_activate = data;
+
+	if (*num_to_activate <= 0) {
+		return CMP_STOP;
+	}
+
+	if (activate_thread(obj, arg, flags)) {
+		--(*num_to_activate);
+		return CMP_MATCH;
+	}
+	return 0;
+}
+
+/*!
+ * \brief Wake enough idle threads to handle the tasks on local queues
+ *
+ * Woken threads do not have to own the queued tasks, they steal them.
+ * If no idle thread is available the pool is grown as permitted, just
+ * like when tasks are pushed to the shared queue.
+ *
+ * This function is called from the threadpool's control taskprocessor thread.
+ * \param pool The work-stealing threadpool
+ */
+static void threadpool_ws_activate(struct ast_threadpool *pool)
+{
+	int queued = ast_atomic_fetch_add(&pool->ws_queued, 0, __ATOMIC_SEQ_CST);
+	int to_activate = queued;
+
+	if (queued <= 0) {
+		return;
+	}
+
+	ao2_callback_data(pool->idle_threads, OBJ_UNLINK | OBJ_NOLOCK | OBJ_NODATA | OBJ_MULTIPLE,
+			activate_threads_limited, pool, &to_activate);
+
+	if (to_activate == queued && pool->options.auto_increment) {
+		grow(pool, pool->options.auto_increment);
+		ao2_callback_data(pool->idle_threads, OBJ_UNLINK | OBJ_NOLOCK | OBJ_NODATA | OBJ_MULTIPLE,
+				activate_threads_limited, pool, &to_activate);
+	}
+}
+
+/*!
+ * \brief Queued task called when tasks are pushed to local queues
+ *
+ * This is the work-stealing counterpart of queued_task_pushed(). Only one
+ * of these is queued at a time no matter how many tasks were pushed.
+ * \param data The work-stealing threadpool
+ * \return 0
+ */
+static int queued_ws_wake(void *data)
+{
+	struct ast_threadpool *pool = data;
+
+	/* Clear first so that a push racing with us queues another wakeup */
+	ast_atomic_fetch_and(&pool->ws_wake_pending, 0, __ATOMIC_SEQ_CST);
+
+	if (pool->listener && pool->listener->callbacks->task_pushed) {
+		pool->listener->callbacks->task_pushed(pool, pool->listener, 0);
+	}
+
+	threadpool_ws_activate(pool);
+	threadpool_send_state_changed(pool);
+	return 0;
+}
+
+/*!
+ * \brief Make sure someone will pick up a task just put on a local queue
+ *
+ * Busy workers find new tasks on their own when they look for more work
+ * so the control taskprocessor only needs involving when there is an
+ * idle thread to wake or the pool is allowed to grow.
+ *
+ * \param pool The work-stealing threadpool
+ */
+static void threadpool_ws_wake(struct ast_threadpool *pool)
+{
+	if (!ao2_container_count(pool->idle_threads) && !pool->options.auto_increment) {
+		return;
+	}
+
+	if (ast_atomic_fetch_or(&pool->ws_wake_pending, 1, __ATOMIC_SEQ_CST)) {
+		/* A wakeup is already on its way */
+		return;
+	}
+
+	if (ast_taskprocessor_push(pool->control_tps, queued_ws_wake, pool)) {
+		ast_atomic_fetch_and(&pool->ws_wake_pending, 0, __ATOMIC_SEQ_CST);
+	}
+}
+
 /*!
  * \brief Taskprocessor listener callback called when a task is added
  *
@@ -953,13 +1222,87 @@ struct ast_threadpool *ast_threadpool_create(const char *name,
 	return pool;
 }
 
+/*!
+ * \brief The worker thread currently running, if any
+ *
+ * Only set for worker threads of work-stealing threadpools.
+ */
+AST_THREADSTORAGE_RAW(current_worker);
+
+/*!
+ * \brief Push a task to a work-stealing threadpool
+ *
+ * A task pushed by one of the pool's own workers stays on that worker's
+ * queue, which keeps related work (such as a serializer queueing onto
+ * another serializer) on the same thread. Tasks pushed from outside the
+ * pool are spread across the workers.
+ *
+ * \param pool The work-stealing threadpool
+ * \param task The task to add
+ * \param data The parameter for the task
+ * \retval 0 success
+ * \retval -1 failure
+ */
+static int threadpool_ws_push(struct ast_threadpool *pool, int (*task)(void *data), void *data)
+{
+	struct worker_thread *self = ast_threadstorage_get_ptr(&current_worker);
+	struct worker_thread *worker;
+	struct ws_task *ws_task;
+	size_t count;
+
+	ws_task = ast_malloc(sizeof(*ws_task));
+	if (!ws_task) {
+		return -1;
+	}
+	ws_task->execute = task;
+	ws_task->data = data;
+
+	AST_VECTOR_RW_RDLOCK(&pool->ws_workers);
+	if (pool->shutting_down) {
+		AST_VECTOR_RW_UNLOCK(&pool->ws_workers);
+		ast_free(ws_task);
+		return -1;
+	}
+
+	count = AST_VECTOR_SIZE(&pool->ws_workers);
+	if (!count) {
+		AST_VECTOR_RW_UNLOCK(&pool->ws_workers);
+		ast_free(ws_task);
+		/* Nobody to give it to yet. The shared queue will start threads as needed. */
+		return ast_taskprocessor_push(pool->tps, task, data);
+	}
+
+	if (self && self->pool == pool) {
+		worker = self;
+	} else {
+		worker = AST_VECTOR_GET(&pool->ws_workers,
+			ast_atomic_fetch_add(&pool->ws_next, 1, __ATOMIC_RELAXED) % count);
+	}
+
+	ast_mutex_lock(&worker->queue_lock);
+	AST_DLLIST_INSERT_TAIL(&worker->queue, ws_task, list);
+	ast_mutex_unlock(&worker->queue_lock);
+	ast_atomic_fetch_add(&pool->ws_queued, 1, __ATOMIC_SEQ_CST);
+	AST_VECTOR_RW_UNLOCK(&pool->ws_workers);
+
+	threadpool_ws_wake(pool);
+	return 0;
+}
+
 int ast_threadpool_push(struct ast_threadpool *pool, int (*task)(void *data), void *data)
 {
-	SCOPED_AO2LOCK(lock, pool);
+	int res = -1;
+
+	if (pool->options.work_stealing) {
+		return threadpool_ws_push(pool, task, data);
+	}
+
+	ao2_lock(pool);
 	if (!pool->shutting_down) {
-		return ast_taskprocessor_push(pool->tps, task, data);
+		res = ast_taskprocessor_push(pool->tps, task, data);
 	}
-	return -1;
+	ao2_unlock(pool);
+	return res;
 }
 
 void ast_threadpool_shutdown(struct ast_threadpool *pool)
@@ -971,7 +1314,13 @@ void ast_threadpool_shutdown(struct ast_threadpool *pool)
 	 * takes care of itself via the taskprocessor callbacks
 	 */
 	ao2_lock(pool);
-	pool->shutting_down = 1;
+	if (pool->options.work_stealing) {
+		AST_VECTOR_RW_WRLOCK(&pool->ws_workers);
+		pool->shutting_down = 1;
+		AST_VECTOR_RW_UNLOCK(&pool->ws_workers);
+	} else {
+		pool->shutting_down = 1;
+	}
 	ao2_unlock(pool);
 	ast_taskprocessor_unreference(pool->control_tps);
 	ast_taskprocessor_unreference(pool->tps);
@@ -1029,6 +1378,83 @@ static void worker_thread_destroy(void *obj)
 	worker_shutdown(worker);
 	ast_mutex_destroy(&worker->lock);
 	ast_cond_destroy(&worker->cond);
+	ast_mutex_destroy(&worker->queue_lock);
+}
+
+/*!
+ * \brief Make a worker's local queue available to the pool
+ *
+ * Called by the worker thread itself when it starts.
+ *
+ * \param worker The worker thread in a work-stealing threadpool
+ */
+static void worker_ws_register(struct worker_thread *worker)
+{
+	struct ast_threadpool *pool = worker->pool;
+
+	AST_VECTOR_RW_WRLOCK(&pool->ws_workers);
+	if (AST_VECTOR_APPEND(&pool->ws_workers, worker)) {
+		ast_log(LOG_WARNING, "Worker thread %d will only run tasks from other threads\n",
+			worker->id);
+	}
+	AST_VECTOR_RW_UNLOCK(&pool->ws_workers);
+
+	ast_threadstorage_set_ptr(&current_worker, worker);
+}
+
+/*!
+ * \brief Withdraw a worker's local queue from the pool
+ *
+ * Called by the worker thread itself just before it exits. Any tasks still
+ * waiting on its queue are handed to the remaining workers or, if there are
+ * none, to the pool's shared queue. They are discarded if the pool is
+ * shutting down, as tasks left on the shared queue would be.
+ *
+ * \param worker The worker thread in a work-stealing threadpool
+ */
+static void worker_ws_unregister(struct worker_thread *worker)
+{
+	struct ast_threadpool *pool = worker->pool;
+	AST_DLLIST_HEAD_NOLOCK(, ws_task) orphans;
+	struct ws_task *task;
+	size_t count;
+	int moved = 0;
+
+	ast_threadstorage_set_ptr(&current_worker, NULL);
+	AST_DLLIST_HEAD_INIT_NOLOCK(&orphans);
+
+	AST_VECTOR_RW_WRLOCK(&pool->ws_workers);
+	AST_VECTOR_REMOVE_ELEM_UNORDERED(&pool->ws_workers, worker, AST_VECTOR_ELEM_CLEANUP_NOOP);
+	count = AST_VECTOR_SIZE(&pool->ws_workers);
+
+	ast_mutex_lock(&worker->queue_lock);
+	while ((task = AST_DLLIST_REMOVE_HEAD(&worker->queue, list))) {
+		if (!pool->shutting_down && count) {
+			struct worker_thread *heir = AST_VECTOR_GET(&pool->ws_workers, moved++ % count);
+
+			ast_mutex_lock(&heir->queue_lock);
+			AST_DLLIST_INSERT_TAIL(&heir->queue, task, list);
+			ast_mutex_unlock(&heir->queue_lock);
+		} else {
+			ast_atomic_fetch_sub(&pool->ws_queued, 1, __ATOMIC_SEQ_CST);
+			AST_DLLIST_INSERT_TAIL(&orphans, task, list);
+		}
+	}
+	ast_mutex_unlock(&worker->queue_lock);
+	AST_VECTOR_RW_UNLOCK(&pool->ws_workers);
+
+	while ((task = AST_DLLIST_REMOVE_HEAD(&orphans, list))) {
+		if (!pool->shutting_down
+			&& ast_taskprocessor_push(pool->tps, task->execute, task->data)) {
+			ast_log(LOG_WARNING, "Worker thread %d could not requeue a task. It is lost.\n",
+				worker->id);
+		}
+		ast_free(task);
+	}
+
+	if (moved) {
+		threadpool_ws_wake(pool);
+	}
 }
 
 /*!
@@ -1046,10 +1472,19 @@ static void *worker_start(void *arg)
 	struct worker_thread *worker = arg;
 	enum worker_state saved_state;
 
+	if (worker->pool->tps) {
+		/* Account every pool's workers separately */
+		ast_thread_role_set(ast_taskprocessor_name(worker->pool->tps));
+	}
+
 	if (worker->options.thread_start) {
 		worker->options.thread_start();
 	}
 
+	if (worker->options.work_stealing) {
+		worker_ws_register(worker);
+	}
+
 	ast_mutex_lock(&worker->lock);
 	while (worker_idle(worker)) {
 		ast_mutex_unlock(&worker->lock);
@@ -1071,6 +1506,10 @@ static void *worker_start(void *arg)
 	 * that the thread can be removed from the
 	 * list of zombie threads.
 	 */
+	if (worker->options.work_stealing) {
+		worker_ws_unregister(worker);
+	}
+
 	if (saved_state == ZOMBIE) {
 		threadpool_zombie_thread_dead(worker->pool, worker);
 	}
@@ -1099,6 +1538,8 @@ static struct worker_thread *worker_thread_alloc(struct ast_threadpool *pool)
 	worker->id = ast_atomic_fetchadd_int(&worker_id_counter, 1);
 	ast_mutex_init(&worker->lock);
 	ast_cond_init(&worker->cond, NULL);
+	ast_mutex_init(&worker->queue_lock);
+	AST_DLLIST_HEAD_INIT_NOLOCK(&worker->queue);
 	worker->pool = pool;
 	worker->thread = AST_PTHREADT_NULL;
 	worker->state = ALIVE;
@@ -1133,6 +1574,13 @@ static void worker_active(struct worker_thread *worker)
 	 * doing that can cause optimizers to (wrongly)
 	 * optimize the code away.
 	 */
+	if (worker->options.work_stealing) {
+		do {
+			alive = threadpool_ws_execute(worker);
+		} while (alive);
+		return;
+	}
+
 	do {
 		alive = threadpool_execute(worker->pool);
 	} while (alive);
@@ -1417,7 +1865,8 @@ struct ast_taskprocessor *ast_threadpool_serializer_group(const char *name,
 		return NULL;
 	}
 
-	tps = ast_taskprocessor_create_with_listener(name, listener);
+	/* Only one pool thread at a time executes a serializer's tasks. */
+	tps = ast_taskprocessor_create_with_listener_options(name, listener, TPS_QUEUE_MPSC);
 	if (!tps) {
 		/* ser ref transferred to listener but not cleaned without tps */
 		ao2_ref(ser, -1);
@@ -1436,5 +1885,10 @@ struct ast_taskprocessor *ast_threadpool_serializer(const char *name, struct ast
 
 long ast_threadpool_queue_size(struct ast_threadpool *pool)
 {
-	return ast_taskprocessor_size(pool->tps);
+	long size = ast_taskprocessor_size(pool->tps);
+
+	if (pool->options.work_stealing) {
+		size += ast_atomic_fetch_add(&pool->ws_queued, 0, __ATOMIC_SEQ_CST);
+	}
+	return size;
 }
@@ -238,6 +238,14 @@ static char *timing_test(struct ast_cli_entry *e, int cmd, struct ast_cli_args *
 
 	ast_cli(a->fd, "Using the '%s' timing module for this test.\n", timer->holder->iface->name);
 
+	if (timer->holder->iface->timer_get_sources) {
+		unsigned int timers;
+		unsigned int sources;
+
+		timer->holder->iface->timer_get_sources(timer->data, &timers, &sources);
+		ast_cli(a->fd, "%u open timers are multiplexed onto %u kernel timers.\n", timers, sources);
+	}
+
 	start = ast_tvnow();
 
 	ast_timer_set_rate(timer, test_rate);
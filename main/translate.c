@@ -43,6 +43,9 @@
 #include "asterisk/term.h"
 #include "asterisk/format.h"
 #include "asterisk/linkedlists.h"
+#include "asterisk/utils.h"
+#include "asterisk/media_trace.h"
+#include "astobj2_private.h"
 
 /*! \todo
  * TODO: sample frames for each supported input format.
@@ -85,6 +88,25 @@ static unsigned int *__indextable;
 /*! protects the __indextable for resizing */
 static ast_rwlock_t tablelock;
 
+/*!
+ * \brief Immutable copy of the translation matrix
+ *
+ * \details Path lookups read the current table without locking.  A new
+ * table is published every time the matrix is rebuilt and the old one
+ * is only released once no lookup can still be reading it.
+ */
+struct translator_table {
+	/*! Number of codecs in the table */
+	int size;
+	/*! Codec id of each index */
+	unsigned int *codec_ids;
+	/*! size * size paths indexed by src * size + dst */
+	struct translator_path paths[0];
+};
+
+/*! The published translator table.  (NULL if it could not be built) */
+static struct translator_table *translator_table;
+
 /* index size starts at this*/
 #define INIT_INDEX 32
 /* index size grows by this as necessary */
@@ -284,11 +306,126 @@ static struct translator_path *matrix_get(unsigned int x, unsigned int y)
 	return __matrix[x] + y;
 }
 
+/*!
+ * \internal
+ * \brief Start a lookup in the published translator table.
+ *
+ * \details Translators in the table stay registered until the
+ * lookup ends.
+ *
+ * \return Passed to translator_read_end().
+ */
+static int translator_read_begin(void)
+{
+	if (ao2_rcu_read_begin()) {
+		/* Tables are only published with the list write locked. */
+		AST_RWLIST_RDLOCK(&translators);
+		return 1;
+	}
+
+	return 0;
+}
+
+static void translator_read_end(int locked)
+{
+	if (locked) {
+		AST_RWLIST_UNLOCK(&translators);
+	} else {
+		ao2_rcu_read_end();
+	}
+}
+
+/*!
+ * \internal
+ * \brief Get a reference to the published translator table.
+ *
+ * \note The translators in the table may be unregistered while the
+ * reference is held.  Only use the costs.
+ */
+static struct translator_table *translator_table_get(void)
+{
+	struct translator_table *table;
+	int locked = translator_read_begin();
+
+	table = ao2_bump(ast_atomic_load_n(&translator_table, __ATOMIC_ACQUIRE));
+	translator_read_end(locked);
+
+	return table;
+}
+
+/*!
+ * \internal
+ * \brief converts format to index value of a translator table.
+ */
+static int translator_table_index(const struct translator_table *table, struct ast_format *format)
+{
+	unsigned int id = ast_format_get_codec_id(format);
+	int x;
+
+	for (x = 0; x < table->size; x++) {
+		if (table->codec_ids[x] == id) {
+			return x;
+		}
+	}
+
+	return -1;
+}
+
+static const struct translator_path *translator_table_path(const struct translator_table *table,
+	int src, int dst)
+{
+	return &table->paths[src * table->size + dst];
+}
+
+/*!
+ * \internal
+ * \brief Publish a copy of the matrix for lookups.
+ *
+ * \note Must be called with the translators list write locked.
+ */
+static void translator_table_publish(void)
+{
+	struct translator_table *table;
+	struct translator_table *old;
+	int size = cur_max_index;
+	int x;
+
+	table = ao2_alloc_options(sizeof(*table) + sizeof(table->paths[0]) * size * size
+		+ sizeof(*table->codec_ids) * size, NULL, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (table) {
+		table->size = size;
+		table->codec_ids = (unsigned int *) &table->paths[size * size];
+		memcpy(table->codec_ids, __indextable, sizeof(*table->codec_ids) * size);
+		for (x = 0; x < size; x++) {
+			memcpy(&table->paths[x * size], __matrix[x], sizeof(table->paths[0]) * size);
+		}
+	} else {
+		/* The old table may refer to translators that are gone. */
+		ast_log(LOG_ERROR, "Unable to publish the translation matrix, no translation paths are available\n");
+	}
+
+	old = translator_table;
+	ast_atomic_store_n(&translator_table, table, __ATOMIC_RELEASE);
+	ao2_rcu_synchronize();
+	ao2_cleanup(old);
+}
+
 /*
  * wrappers around the translator routines.
  */
 
-static void destroy(struct ast_trans_pvt *pvt)
+/*! \brief Most released pvts a translator keeps for reuse */
+#define TRANSLATOR_POOL_SIZE 8
+
+/*! \brief Released pvts of a translator with a reset callback */
+struct ast_translator_pool {
+	ast_mutex_t lock;
+	/*! Pvts linked by their next pointer */
+	struct ast_trans_pvt *head;
+	int count;
+};
+
+static void pvt_free(struct ast_trans_pvt *pvt)
 {
 	struct ast_translator *t = pvt->t;
 
@@ -301,7 +438,130 @@ static void destroy(struct ast_trans_pvt *pvt)
 		pvt->explicit_dst = NULL;
 	}
 	ast_free(pvt);
-	ast_module_unref(t->module);
+}
+
+/*!
+ * \internal
+ * \brief Set up the static translation frame of a pvt.
+ */
+static void pvt_init(struct ast_trans_pvt *pvt)
+{
+	pvt->f.frametype = AST_FRAME_VOICE;
+	pvt->f.mallocd = 0;
+	pvt->f.offset = AST_FRIENDLY_OFFSET;
+	pvt->f.src = pvt->t->name;
+	pvt->f.data.ptr = pvt->outbuf.c;
+}
+
+/*!
+ * \internal
+ * \brief Keep a released pvt in its translator's pool.
+ *
+ * \retval 0 if the pool took the pvt.
+ * \retval -1 if the pvt must be freed.
+ */
+static int pvt_pool_put(struct ast_trans_pvt *pvt)
+{
+	struct ast_translator_pool *pool = pvt->t->pool;
+
+	if (!pool || ast_atomic_load_n(&pool->count, __ATOMIC_RELAXED) >= TRANSLATOR_POOL_SIZE) {
+		return -1;
+	}
+	if (pvt->t->reset(pvt)) {
+		return -1;
+	}
+
+	ast_mutex_lock(&pool->lock);
+	if (pool->count >= TRANSLATOR_POOL_SIZE) {
+		ast_mutex_unlock(&pool->lock);
+		return -1;
+	}
+	pvt->next = pool->head;
+	pool->head = pvt;
+	ast_atomic_store_n(&pool->count, pool->count + 1, __ATOMIC_RELAXED);
+	ast_mutex_unlock(&pool->lock);
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Take a pooled pvt set up for the given explicit destination.
+ */
+static struct ast_trans_pvt *pvt_pool_get(struct ast_translator *t, struct ast_format *explicit_dst)
+{
+	struct ast_translator_pool *pool = t->pool;
+	struct ast_trans_pvt **prev;
+	struct ast_trans_pvt *pvt;
+
+	if (!pool || !ast_atomic_load_n(&pool->count, __ATOMIC_RELAXED)) {
+		return NULL;
+	}
+
+	ast_mutex_lock(&pool->lock);
+	for (prev = &pool->head; (pvt = *prev); prev = &pvt->next) {
+		/* The frame format may have been derived from the explicit destination. */
+		if (pvt->explicit_dst == explicit_dst) {
+			*prev = pvt->next;
+			ast_atomic_store_n(&pool->count, pool->count - 1, __ATOMIC_RELAXED);
+			break;
+		}
+	}
+	ast_mutex_unlock(&pool->lock);
+
+	if (pvt) {
+		struct ast_format *format = pvt->f.subclass.format;
+
+		/* Forget what the last path left behind. */
+		memset(&pvt->f, 0, sizeof(pvt->f));
+		pvt->f.subclass.format = format;
+		pvt->samples = 0;
+		pvt->datalen = 0;
+		pvt->next = NULL;
+		pvt->nextin = pvt->nextout = ast_tv(0, 0);
+		pvt->interleaved_stereo = 0;
+		pvt_init(pvt);
+	}
+
+	return pvt;
+}
+
+/*!
+ * \internal
+ * \brief Free every pvt in a translator's pool.
+ */
+static void pvt_pool_drain(struct ast_translator *t)
+{
+	struct ast_translator_pool *pool = t->pool;
+	struct ast_trans_pvt *pvt;
+
+	if (!pool) {
+		return;
+	}
+
+	ast_mutex_lock(&pool->lock);
+	pvt = pool->head;
+	pool->head = NULL;
+	pool->count = 0;
+	ast_mutex_unlock(&pool->lock);
+
+	while (pvt) {
+		struct ast_trans_pvt *next = pvt->next;
+
+		pvt_free(pvt);
+		pvt = next;
+	}
+}
+
+static void destroy(struct ast_trans_pvt *pvt)
+{
+	struct ast_module *module = pvt->t->module;
+
+	if (pvt_pool_put(pvt)) {
+		pvt_free(pvt);
+	}
+	/* Pooled pvts do not keep the module loaded, unregistering drains them. */
+	ast_module_unref(module);
 }
 
 /*!
@@ -314,6 +574,12 @@ static struct ast_trans_pvt *newpvt(struct ast_translator *t, struct ast_format
 	int len;
 	char *ofs;
 
+	pvt = pvt_pool_get(t, explicit_dst);
+	if (pvt) {
+		ast_module_ref(t->module);
+		return pvt;
+	}
+
 	/*
 	 * compute the required size adding private descriptor,
 	 * buffer, AST_FRIENDLY_OFFSET.
@@ -351,11 +617,7 @@ static struct ast_trans_pvt *newpvt(struct ast_translator *t, struct ast_format
 	}
 
 	/* Setup normal static translation frame. */
-	pvt->f.frametype = AST_FRAME_VOICE;
-	pvt->f.mallocd = 0;
-	pvt->f.offset = AST_FRIENDLY_OFFSET;
-	pvt->f.src = pvt->t->name;
-	pvt->f.data.ptr = pvt->outbuf.c;
+	pvt_init(pvt);
 
 	/*
 	 * If the translator has not provided a format
@@ -472,30 +734,44 @@ void ast_translator_free_path(struct ast_trans_pvt *p)
 	}
 }
 
+void ast_translator_set_quality(struct ast_trans_pvt *p, int quality)
+{
+	for (; p; p = p->next) {
+		if (p->t->set_quality && p->t->set_quality(p, quality)) {
+			ast_debug(1, "Translator '%s' could not change to quality %d\n", p->t->name, quality);
+		}
+	}
+}
+
 /*! \brief Build a chain of translators based upon the given source and dest formats */
 struct ast_trans_pvt *ast_translator_build_path(struct ast_format *dst, struct ast_format *src)
 {
 	struct ast_trans_pvt *head = NULL, *tail = NULL;
-	int src_index, dst_index;
+	struct translator_table *table;
+	int src_index = -1, dst_index = -1;
+	int locked;
 
-	src_index = format2index(src);
-	dst_index = format2index(dst);
+	locked = translator_read_begin();
+	table = ast_atomic_load_n(&translator_table, __ATOMIC_ACQUIRE);
+	if (table) {
+		src_index = translator_table_index(table, src);
+		dst_index = translator_table_index(table, dst);
+	}
 
 	if (src_index < 0 || dst_index < 0) {
+		translator_read_end(locked);
 		ast_log(LOG_WARNING, "No translator path: (%s codec is not valid)\n", src_index < 0 ? "starting" : "ending");
 		return NULL;
 	}
 
-	AST_RWLIST_RDLOCK(&translators);
-
 	while (src_index != dst_index) {
 		struct ast_trans_pvt *cur;
 		struct ast_format *explicit_dst = NULL;
-		struct ast_translator *t = matrix_get(src_index, dst_index)->step;
+		struct ast_translator *t = translator_table_path(table, src_index, dst_index)->step;
 		if (!t) {
 			ast_log(LOG_WARNING, "No translator path from %s to %s\n",
 				ast_format_get_name(src), ast_format_get_name(dst));
-			AST_RWLIST_UNLOCK(&translators);
+			translator_read_end(locked);
 			ast_translator_free_path(head);
 			return NULL;
 		}
@@ -506,7 +782,7 @@ struct ast_trans_pvt *ast_translator_build_path(struct ast_format *dst, struct a
 			ast_log(LOG_WARNING, "Failed to build translator step from %s to %s\n",
 				ast_format_get_name(src), ast_format_get_name(dst));
 			ast_translator_free_path(head);
-			AST_RWLIST_UNLOCK(&translators);
+			translator_read_end(locked);
 			return NULL;
 		}
 		if (!head) {
@@ -520,7 +796,7 @@ struct ast_trans_pvt *ast_translator_build_path(struct ast_format *dst, struct a
 		src_index = cur->t->dst_fmt_index;
 	}
 
-	AST_RWLIST_UNLOCK(&translators);
+	translator_read_end(locked);
 	return head;
 }
 
@@ -620,6 +896,13 @@ struct ast_frame *ast_translate(struct ast_trans_pvt *path, struct ast_frame *f,
 	}
 
 	if (out) {
+		struct ast_frame *traced;
+
+		/* Output frames carry on the trace of the frame they came from */
+		for (traced = out; traced; traced = AST_LIST_NEXT(traced, frame_list)) {
+			ast_media_trace_copy(traced, f);
+		}
+
 		/* we have a frame, play with times */
 		if (!ast_tvzero(delivery)) {
 			struct ast_frame *current = out;
@@ -905,6 +1188,8 @@ static void matrix_rebuild(int samples)
 			break;
 		}
 	}
+
+	translator_table_publish();
 }
 
 static void codec_append_name(const struct ast_codec *codec, struct ast_str **buf)
@@ -1286,6 +1571,14 @@ int __ast_register_translator(struct ast_translator *t, struct ast_module *mod)
 		t->frameout = default_frameout;
 	}
 
+	if (t->reset && !t->pool) {
+		/* Without a pool pvts are simply not reused. */
+		t->pool = ast_calloc(1, sizeof(*t->pool));
+		if (t->pool) {
+			ast_mutex_init(&t->pool->lock);
+		}
+	}
+
 	generate_computational_cost(t, 1);
 
 	ast_verb(2, "Registered translator '%s' from codec %s to %s, table cost, %d, computational cost %d\n",
@@ -1346,6 +1639,19 @@ int ast_unregister_translator(struct ast_translator *t)
 
 	AST_RWLIST_UNLOCK(&translators);
 
+	if (found) {
+		pvt_pool_drain(t);
+		/*
+		 * Without the rebuild a path being built may still pick
+		 * this translator so the pool has to stay around.
+		 */
+		if (t->pool && !ast_shutting_down()) {
+			ast_mutex_destroy(&t->pool->lock);
+			ast_free(t->pool);
+			t->pool = NULL;
+		}
+	}
+
 	return (u ? 0 : -1);
 }
 
@@ -1386,6 +1692,8 @@ int ast_translator_best_choice(struct ast_format_cap *dst_cap,
 	RAII_VAR(struct ast_format *, best, NULL, ao2_cleanup);
 	RAII_VAR(struct ast_format *, bestdst, NULL, ao2_cleanup);
 	struct ast_format_cap *joint_cap;
+	struct translator_table *table;
+	const struct translator_path *path;
 	int i;
 	int j;
 
@@ -1421,7 +1729,10 @@ int ast_translator_best_choice(struct ast_format_cap *dst_cap,
 	}
 
 	/* need to translate */
-	AST_RWLIST_RDLOCK(&translators);
+	table = translator_table_get();
+	if (!table) {
+		return -1;
+	}
 	for (i = 0; i < ast_format_cap_count(dst_cap); ++i, ao2_cleanup(dst)) {
 		dst = ast_format_cap_get_format(dst_cap, i);
 		if (!dst
@@ -1439,23 +1750,24 @@ int ast_translator_best_choice(struct ast_format_cap *dst_cap,
 				continue;
 			}
 
-			x = format2index(src);
-			y = format2index(dst);
+			x = translator_table_index(table, src);
+			y = translator_table_index(table, dst);
 			if (x < 0 || y < 0) {
 				continue;
 			}
-			if (!matrix_get(x, y) || !(matrix_get(x, y)->step)) {
+			path = translator_table_path(table, x, y);
+			if (!path->step) {
 				continue;
 			}
-			if (matrix_get(x, y)->table_cost < besttablecost
-				|| matrix_get(x, y)->multistep < beststeps) {
+			if (path->table_cost < besttablecost
+				|| path->multistep < beststeps) {
 				/* better than what we have so far */
 				ao2_replace(best, src);
 				ao2_replace(bestdst, dst);
-				besttablecost = matrix_get(x, y)->table_cost;
-				beststeps = matrix_get(x, y)->multistep;
-			} else if (matrix_get(x, y)->table_cost == besttablecost
-					&& matrix_get(x, y)->multistep == beststeps) {
+				besttablecost = path->table_cost;
+				beststeps = path->multistep;
+			} else if (path->table_cost == besttablecost
+					&& path->multistep == beststeps) {
 				unsigned int gap_selected = format_sample_rate_absdiff(best, bestdst);
 				unsigned int gap_current = format_sample_rate_absdiff(src, dst);
 
@@ -1463,13 +1775,13 @@ int ast_translator_best_choice(struct ast_format_cap *dst_cap,
 					/* better than what we have so far */
 					ao2_replace(best, src);
 					ao2_replace(bestdst, dst);
-					besttablecost = matrix_get(x, y)->table_cost;
-					beststeps = matrix_get(x, y)->multistep;
+					besttablecost = path->table_cost;
+					beststeps = path->multistep;
 				}
 			}
 		}
 	}
-	AST_RWLIST_UNLOCK(&translators);
+	ao2_ref(table, -1);
 
 	if (!best) {
 		return -1;
@@ -1482,21 +1794,22 @@ int ast_translator_best_choice(struct ast_format_cap *dst_cap,
 unsigned int ast_translate_path_steps(struct ast_format *dst_format, struct ast_format *src_format)
 {
 	unsigned int res = -1;
+	struct translator_table *table = translator_table_get();
 	/* convert bitwise format numbers into array indices */
-	int src = format2index(src_format);
-	int dest = format2index(dst_format);
+	int src = table ? translator_table_index(table, src_format) : -1;
+	int dest = table ? translator_table_index(table, dst_format) : -1;
 
 	if (src < 0 || dest < 0) {
+		ao2_cleanup(table);
 		ast_log(LOG_WARNING, "No translator path: (%s codec is not valid)\n", src < 0 ? "starting" : "ending");
 		return -1;
 	}
-	AST_RWLIST_RDLOCK(&translators);
 
-	if (matrix_get(src, dest)->step) {
-		res = matrix_get(src, dest)->multistep + 1;
+	if (translator_table_path(table, src, dest)->step) {
+		res = translator_table_path(table, src, dest)->multistep + 1;
 	}
 
-	AST_RWLIST_UNLOCK(&translators);
+	ao2_ref(table, -1);
 
 	return res;
 }
@@ -1604,6 +1917,8 @@ static void translate_shutdown(void)
 	__indextable = NULL;
 	ast_rwlock_unlock(&tablelock);
 	ast_rwlock_destroy(&tablelock);
+	ao2_cleanup(translator_table);
+	translator_table = NULL;
 }
 
 int ast_translate_init(void)
@@ -1193,6 +1193,116 @@ static struct ast_cli_entry utils_cli[] = {
 #endif /* ! LOW_MEMORY */
 #endif /* DEBUG_THREADS */
 
+#if !defined(LOW_MEMORY)
+static char *handle_set_lock_contention(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "core set lock contention {on|off}";
+		e->usage =
+			"Usage: core set lock contention {on|off}\n"
+			"       Turns the lock contention profiler on or off.  While on, every\n"
+			"lock acquisition that finds the lock held is timed and recorded\n"
+			"against the file and line of the acquisition.\n";
+		return NULL;
+
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != e->args) {
+		return CLI_SHOWUSAGE;
+	}
+
+#if defined(DETECT_DEADLOCKS) && defined(DEBUG_THREADS)
+	ast_cli(a->fd, "Lock contention profiling is not available with DETECT_DEADLOCKS.\n");
+	return CLI_FAILURE;
+#else
+	ast_lock_contention_enable(ast_true(a->argv[e->args - 1]));
+	ast_cli(a->fd, "Lock contention profiling is %s.\n",
+		ast_lock_contention_enabled() ? "on" : "off");
+	return CLI_SUCCESS;
+#endif
+}
+
+/*! \brief Rank contention sites by most total wait first */
+static int lock_contention_total_cmp(const void *left, const void *right)
+{
+	const struct ast_lock_contention_site *site_left = left;
+	const struct ast_lock_contention_site *site_right = right;
+
+	if (site_left->total_wait == site_right->total_wait) {
+		return 0;
+	}
+	return site_left->total_wait > site_right->total_wait ? -1 : 1;
+}
+
+static char *handle_show_lock_contention(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct ast_lock_contention_site *sites;
+	unsigned long dropped;
+	size_t count;
+	size_t i;
+	int reset = 0;
+#define FMT_HEADERS		"%-40s %-32s %10s %10s %10s %12s\n"
+#define FMT_FIELDS		"%-33.33s:%-6d %-32.32s %10lu %10" PRId64 " %10" PRId64 " %12" PRId64 "\n"
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "core show lock contention";
+		e->usage =
+			"Usage: core show lock contention [reset]\n"
+			"       Shows the lock acquisition sites that waited the longest in\n"
+			"total since the lock contention profiler was turned on.  With\n"
+			"'reset', the recorded contention is cleared after it is shown.\n";
+		return NULL;
+
+	case CLI_GENERATE:
+		return a->pos == 4 ? ast_cli_complete(a->word, (const char * const []){ "reset", NULL }, a->n) : NULL;
+	}
+
+	if (a->argc == 5 && !strcasecmp(a->argv[4], "reset")) {
+		reset = 1;
+	} else if (a->argc != 4) {
+		return CLI_SHOWUSAGE;
+	}
+
+	sites = ast_malloc(sizeof(*sites) * AST_LOCK_CONTENTION_SITES);
+	if (!sites) {
+		return CLI_FAILURE;
+	}
+
+	count = ast_lock_contention_snapshot(sites, AST_LOCK_CONTENTION_SITES, reset, &dropped);
+	qsort(sites, count, sizeof(*sites), lock_contention_total_cmp);
+
+	ast_cli(a->fd, "\nLock contention profiling is %s.\n\n",
+		ast_lock_contention_enabled() ? "on" : "off");
+	ast_cli(a->fd, FMT_HEADERS, "Location", "Lock", "Contended", "Avg (us)", "Max (us)", "Total (ms)");
+	for (i = 0; i < count; ++i) {
+		ast_cli(a->fd, FMT_FIELDS, sites[i].filename, sites[i].lineno, sites[i].lock_name,
+			sites[i].contended, sites[i].total_wait / (int64_t) sites[i].contended,
+			sites[i].max_wait, sites[i].total_wait / 1000);
+	}
+	ast_cli(a->fd, "\n%zu sites", count);
+	if (dropped) {
+		ast_cli(a->fd, ", %lu contended acquisitions not recorded", dropped);
+	}
+	ast_cli(a->fd, "\n\n");
+
+	ast_free(sites);
+
+#undef FMT_HEADERS
+#undef FMT_FIELDS
+
+	return CLI_SUCCESS;
+}
+
+static struct ast_cli_entry lock_contention_cli[] = {
+	AST_CLI_DEFINE(handle_set_lock_contention, "Turn the lock contention profiler on or off"),
+	AST_CLI_DEFINE(handle_show_lock_contention, "Show lock acquisition sites ranked by time spent waiting"),
+};
+#endif /* ! LOW_MEMORY */
+
 #if !defined(LOW_MEMORY)
 /*
  * support for 'show threads'. The start routine is wrapped by
@@ -2185,6 +2295,9 @@ static void utils_shutdown(void)
 #if defined(DEBUG_THREADS) && !defined(LOW_MEMORY)
 	ast_cli_unregister_multiple(utils_cli, ARRAY_LEN(utils_cli));
 #endif
+#if !defined(LOW_MEMORY)
+	ast_cli_unregister_multiple(lock_contention_cli, ARRAY_LEN(lock_contention_cli));
+#endif
 }
 
 int ast_utils_init(void)
@@ -2195,6 +2308,9 @@ int ast_utils_init(void)
 #if !defined(LOW_MEMORY)
 	ast_cli_register_multiple(utils_cli, ARRAY_LEN(utils_cli));
 #endif
+#endif
+#if !defined(LOW_MEMORY)
+	ast_cli_register_multiple(lock_contention_cli, ARRAY_LEN(lock_contention_cli));
 #endif
 	ast_register_cleanup(utils_shutdown);
 	return 0;
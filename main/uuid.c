@@ -31,15 +31,89 @@
 #include "asterisk/strings.h"
 #include "asterisk/logger.h"
 #include "asterisk/lock.h"
+#include "asterisk/threadstorage.h"
 
 AST_MUTEX_DEFINE_STATIC(uuid_lock);
 
 static int has_dev_urandom;
 
+/*! Descriptor kept open on /dev/urandom for the per-thread pools */
+static int dev_urandom_fd = -1;
+
 struct ast_uuid {
 	uuid_t uu;
 };
 
+/*! Number of UUIDs worth of random data fetched per read of /dev/urandom */
+#define UUID_POOL_COUNT 64
+
+/*!
+ * \internal
+ * \brief Per-thread pool of random bytes for version 4 UUIDs
+ *
+ * Filling the pool with one read and handing out 16 bytes at a time means
+ * most UUIDs cost a memcpy instead of a system call, and no lock is needed
+ * since each thread owns its pool.
+ */
+struct uuid_pool {
+	/*! Bytes not yet handed out, counted from the end of the buffer */
+	size_t remaining;
+	unsigned char bytes[UUID_POOL_COUNT * sizeof(uuid_t)];
+};
+
+AST_THREADSTORAGE(uuid_pool_buf);
+
+/*!
+ * \internal
+ * \brief Fill a UUID from the calling thread's random pool
+ *
+ * \retval 0 on success
+ * \retval -1 if the pool could not be used (caller should fall back to libuuid)
+ */
+static int generate_uuid_from_pool(struct ast_uuid *uuid)
+{
+	struct uuid_pool *pool;
+	unsigned char *uu;
+
+	if (dev_urandom_fd < 0) {
+		return -1;
+	}
+
+	pool = ast_threadstorage_get(&uuid_pool_buf, sizeof(*pool));
+	if (!pool) {
+		return -1;
+	}
+
+	if (pool->remaining < sizeof(uuid_t)) {
+		size_t filled = 0;
+
+		while (filled < sizeof(pool->bytes)) {
+			ssize_t res = read(dev_urandom_fd, pool->bytes + filled, sizeof(pool->bytes) - filled);
+
+			if (res < 0 && errno == EINTR) {
+				continue;
+			}
+			if (res <= 0) {
+				return -1;
+			}
+			filled += res;
+		}
+		pool->remaining = sizeof(pool->bytes);
+	}
+
+	uu = pool->bytes + sizeof(pool->bytes) - pool->remaining;
+	memcpy(uuid->uu, uu, sizeof(uuid_t));
+	/* Don't leave handed out values lying around in memory */
+	memset(uu, 0, sizeof(uuid_t));
+	pool->remaining -= sizeof(uuid_t);
+
+	/* RFC 4122 section 4.4: version 4, variant 10xx */
+	uuid->uu[6] = (uuid->uu[6] & 0x0f) | 0x40;
+	uuid->uu[8] = (uuid->uu[8] & 0x3f) | 0x80;
+
+	return 0;
+}
+
 /*!
  * \internal
  * \brief Generate a UUID.
@@ -107,7 +181,14 @@ static void generate_uuid(struct ast_uuid *uuid)
 	 *
 	 * Given these drawbacks, we stick to only using random UUIDs. The chance of /dev/random
 	 * or /dev/urandom not existing on systems in this age is next to none.
+	 *
+	 * When /dev/urandom is available we produce the random UUIDs ourselves
+	 * from a per-thread pool, which is what uuid_generate_random() would do
+	 * anyway minus the per-call read.
 	 */
+	if (!generate_uuid_from_pool(uuid)) {
+		return;
+	}
 
 	/* XXX Currently, we only protect this call if the user has no /dev/urandom on their system.
 	 * If it turns out that there are issues with UUID generation despite the presence of
@@ -135,9 +216,22 @@ struct ast_uuid *ast_uuid_generate(void)
 
 char *ast_uuid_to_str(struct ast_uuid *uuid, char *buf, size_t size)
 {
+	static const char hex[] = "0123456789abcdef";
+	char *pos = buf;
+	int i;
+
 	ast_assert(size >= AST_UUID_STR_LEN);
-	uuid_unparse(uuid->uu, buf);
-	return ast_str_to_lower(buf);
+
+	for (i = 0; i < sizeof(uuid_t); ++i) {
+		if (i == 4 || i == 6 || i == 8 || i == 10) {
+			*pos++ = '-';
+		}
+		*pos++ = hex[uuid->uu[i] >> 4];
+		*pos++ = hex[uuid->uu[i] & 0x0f];
+	}
+	*pos = '\0';
+
+	return buf;
 }
 
 char *ast_uuid_generate_str(char *buf, size_t size)
@@ -211,7 +305,6 @@ void ast_uuid_init(void)
 	 * Think of this along the same lines as initializing a singleton.
 	 */
 	uuid_t uu;
-	int dev_urandom_fd;
 
 	dev_urandom_fd = open("/dev/urandom", O_RDONLY);
 	if (dev_urandom_fd < 0) {
@@ -222,8 +315,10 @@ void ast_uuid_init(void)
 				"in decreased performance. It is highly recommended that you set up your\n"
 				"system to have /dev/urandom\n");
 	} else {
+		long flags = fcntl(dev_urandom_fd, F_GETFD);
+
+		fcntl(dev_urandom_fd, F_SETFD, flags | FD_CLOEXEC);
 		has_dev_urandom = 1;
-		close(dev_urandom_fd);
 	}
 	uuid_generate_random(uu);
 
@@ -37,6 +37,7 @@
 #include "asterisk/astobj2.h"
 #include "asterisk/xmldoc.h"
 #include "asterisk/cli.h"
+#include "asterisk/vector.h"
 
 #ifdef AST_XML_DOCS
 
@@ -50,13 +51,23 @@ static const int xmldoc_text_columns = 79;
 /*! \brief XML documentation language. */
 static char documentation_language[6];
 
+/*! \brief Number of buckets in the per document (type, name) index. */
+#define XMLDOC_INDEX_BUCKETS 1021
+
 /*! \brief XML documentation tree */
 struct documentation_tree {
 	char *filename;					/*!< XML document filename. */
 	struct ast_xml_doc *doc;			/*!< Open document pointer. */
+	struct ao2_container *index;			/*!< Top level nodes by (type, name). */
 	AST_RWLIST_ENTRY(documentation_tree) entry;
 };
 
+/*! \brief Top level nodes sharing a type and name, in document order */
+struct xmldoc_index_entry {
+	AST_VECTOR(, struct ast_xml_node *) nodes;
+	char key[0];					/*!< "type|name" */
+};
+
 static char *xmldoc_get_syntax_cmd(struct ast_xml_node *fixnode, const char *name, int printname);
 static int xmldoc_parse_enumlist(struct ast_xml_node *fixnode, const char *tabs, struct ast_str **buffer);
 static void xmldoc_parse_parameter(struct ast_xml_node *fixnode, const char *tabs, struct ast_str **buffer);
@@ -417,6 +428,128 @@ static int xmldoc_attribute_match(struct ast_xml_node *node, const char *attr, c
 	return match;
 }
 
+static int xmldoc_index_hash(const void *obj, const int flags)
+{
+	const struct xmldoc_index_entry *object;
+	const char *key;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_KEY:
+		key = obj;
+		break;
+	case OBJ_SEARCH_OBJECT:
+		object = obj;
+		key = object->key;
+		break;
+	default:
+		ast_assert(0);
+		return 0;
+	}
+	return ast_str_hash(key);
+}
+
+static int xmldoc_index_cmp(void *obj, void *arg, int flags)
+{
+	const struct xmldoc_index_entry *object_left = obj;
+	const struct xmldoc_index_entry *object_right = arg;
+	const char *right_key = arg;
+	int cmp;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_OBJECT:
+		right_key = object_right->key;
+		/* Fall through */
+	case OBJ_SEARCH_KEY:
+		cmp = strcmp(object_left->key, right_key);
+		break;
+	default:
+		cmp = 0;
+		break;
+	}
+	return cmp ? 0 : CMP_MATCH;
+}
+
+static void xmldoc_index_entry_destroy(void *obj)
+{
+	struct xmldoc_index_entry *entry = obj;
+
+	AST_VECTOR_FREE(&entry->nodes);
+}
+
+/*!
+ * \internal
+ * \brief Index the non-empty top level nodes of a document by type and name.
+ *
+ * \details Looking a node up used to mean walking every top level node of
+ * every document, which made registering all the applications, functions
+ * and manager actions at startup quadratic in the size of the docs.
+ *
+ * \retval NULL on error.
+ * \retval The index container.
+ */
+static struct ao2_container *xmldoc_build_index(struct ast_xml_doc *doc)
+{
+	struct ao2_container *index;
+	struct xmldoc_index_entry *found;
+	struct ast_xml_node *node;
+	const char *name;
+	struct ast_str *key;
+	int res;
+
+	key = ast_str_create(64);
+	if (!key) {
+		return NULL;
+	}
+	index = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_NOLOCK, 0,
+		XMLDOC_INDEX_BUCKETS, xmldoc_index_hash, NULL, xmldoc_index_cmp);
+	if (!index) {
+		ast_free(key);
+		return NULL;
+	}
+
+	for (node = ast_xml_node_get_children(ast_xml_get_root(doc)); node;
+		node = ast_xml_node_get_next(node)) {
+		if (!ast_xml_node_get_children(node)) {
+			/* ignore empty nodes, lookups skip them too */
+			continue;
+		}
+		name = ast_xml_get_attribute(node, "name");
+		if (!name) {
+			continue;
+		}
+		ast_str_set(&key, 0, "%s|%s", ast_xml_node_get_name(node), name);
+		ast_xml_free_attr(name);
+
+		found = ao2_find(index, ast_str_buffer(key), OBJ_SEARCH_KEY);
+		if (!found) {
+			found = ao2_alloc_options(sizeof(*found) + ast_str_strlen(key) + 1,
+				xmldoc_index_entry_destroy, AO2_ALLOC_OPT_LOCK_NOLOCK);
+			if (!found) {
+				break;
+			}
+			strcpy(found->key, ast_str_buffer(key)); /* Safe */
+			if (AST_VECTOR_INIT(&found->nodes, 1) || !ao2_link(index, found)) {
+				ao2_ref(found, -1);
+				break;
+			}
+		}
+		res = AST_VECTOR_APPEND(&found->nodes, node);
+		ao2_ref(found, -1);
+		if (res) {
+			break;
+		}
+	}
+	ast_free(key);
+
+	if (node) {
+		/* Stopped early on an allocation failure */
+		ao2_ref(index, -1);
+		return NULL;
+	}
+
+	return index;
+}
+
 /*!
  * \internal
  * \brief Get the application/function node for 'name' application/function with language 'language'
@@ -437,22 +570,24 @@ static struct ast_xml_node *xmldoc_get_node(const char *type, const char *name,
 	struct ast_xml_node *first_match = NULL;
 	struct ast_xml_node *lang_match = NULL;
 	struct documentation_tree *doctree;
+	struct xmldoc_index_entry *found;
+	char *key;
+	int i;
+
+	key = ast_alloca(strlen(type) + strlen(name) + 2);
+	sprintf(key, "%s|%s", type, name); /* Safe */
 
 	AST_RWLIST_RDLOCK(&xmldoc_tree);
 	AST_LIST_TRAVERSE(&xmldoc_tree, doctree, entry) {
 		/* the core xml documents have priority over thirdparty document. */
-		node = ast_xml_get_root(doctree->doc);
-		if (!node) {
-			break;
+		found = ao2_find(doctree->index, key, OBJ_SEARCH_KEY);
+		if (!found) {
+			continue;
 		}
 
-		node = ast_xml_node_get_children(node);
-		while ((node = ast_xml_find_element(node, type, "name", name))) {
-			if (!ast_xml_node_get_children(node)) {
-				/* ignore empty nodes */
-				node = ast_xml_node_get_next(node);
-				continue;
-			}
+		node = NULL;
+		for (i = 0; i < AST_VECTOR_SIZE(&found->nodes); i++) {
+			node = AST_VECTOR_GET(&found->nodes, i);
 
 			if (!first_match) {
 				first_match = node;
@@ -475,8 +610,9 @@ static struct ast_xml_node *xmldoc_get_node(const char *type, const char *name,
 				}
 			}
 
-			node = ast_xml_node_get_next(node);
+			node = NULL;
 		}
+		ao2_ref(found, -1);
 
 		/* if we matched lang and module return this match */
 		if (node) {
@@ -2868,6 +3004,7 @@ static void xmldoc_unload_documentation(void)
 	AST_RWLIST_WRLOCK(&xmldoc_tree);
 	while ((doctree = AST_RWLIST_REMOVE_HEAD(&xmldoc_tree, entry))) {
 		ast_free(doctree->filename);
+		ao2_cleanup(doctree->index);
 		ast_xml_close(doctree->doc);
 		ast_free(doctree);
 	}
@@ -2980,6 +3117,13 @@ int ast_xmldoc_load_documentation(void)
 			ast_xml_close(tmpdoc);
 			continue;
 		}
+		doc_tree->index = xmldoc_build_index(tmpdoc);
+		if (!doc_tree->index) {
+			ast_log(LOG_ERROR, "Unable to index documentation at '%s'\n", globbuf.gl_pathv[i]);
+			ast_free(doc_tree);
+			ast_xml_close(tmpdoc);
+			continue;
+		}
 		doc_tree->doc = tmpdoc;
 		doc_tree->filename = ast_strdup(globbuf.gl_pathv[i]);
 		AST_RWLIST_INSERT_TAIL(&xmldoc_tree, doc_tree, entry);
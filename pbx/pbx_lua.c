@@ -55,6 +55,13 @@ static char *registrar = "pbx_lua";
 #endif
 #define LUA_BUF_SIZE 4096
 
+/*! Number of prewarmed channel-less lua_States kept around for reuse */
+#ifdef LOW_MEMORY
+#define LUA_STATE_POOL_SIZE 2
+#else
+#define LUA_STATE_POOL_SIZE 8
+#endif
+
 /* This value is used by the lua engine to signal that a Goto or dialplan jump
  * was detected. Ensure this value does not conflict with any values dialplan
  * applications might return */
@@ -64,6 +71,7 @@ static char *lua_read_extensions_file(lua_State *L, long *size, int *file_not_op
 static int lua_load_extensions(lua_State *L, struct ast_channel *chan);
 static int lua_reload_extensions(lua_State *L);
 static void lua_free_extensions(void);
+static char *lua_compile_extensions(lua_State *L, const char *data, long size, size_t *bytecode_size);
 static int lua_sort_extensions(lua_State *L);
 static int lua_register_switches(lua_State *L);
 static int lua_register_hints(lua_State *L);
@@ -97,6 +105,10 @@ static void lua_concat_args(lua_State *L, int start, int nargs);
 static void lua_state_destroy(void *data);
 static void lua_datastore_fixup(void *data, struct ast_channel *old_chan, struct ast_channel *new_chan);
 static lua_State *lua_get_state(struct ast_channel *chan);
+static lua_State *lua_new_state(struct ast_channel *chan);
+static void lua_put_state(lua_State *L);
+static void lua_state_pool_refill(void);
+static void lua_state_pool_drain(void);
 
 static int exists(struct ast_channel *chan, const char *context, const char *exten, int priority, const char *callerid, const char *data);
 static int canmatch(struct ast_channel *chan, const char *context, const char *exten, int priority, const char *callerid, const char *data);
@@ -106,6 +118,15 @@ static int exec(struct ast_channel *chan, const char *context, const char *exten
 AST_MUTEX_DEFINE_STATIC(config_file_lock);
 static char *config_file_data = NULL;
 static long config_file_size = 0;
+/*! Precompiled form of config_file_data, shared by every new lua_State */
+static char *config_bytecode_data = NULL;
+static size_t config_bytecode_size = 0;
+/*! Bumped on every successful reload so stale pooled states can be dropped */
+static unsigned int config_generation = 0;
+
+AST_MUTEX_DEFINE_STATIC(state_pool_lock);
+static lua_State *state_pool[LUA_STATE_POOL_SIZE];
+static int state_pool_count = 0;
 
 static struct ast_context *local_contexts = NULL;
 static struct ast_hashtab *local_table = NULL;
@@ -1155,6 +1176,65 @@ static char *lua_read_extensions_file(lua_State *L, long *size, int *file_not_op
 	return data;
 }
 
+/*!
+ * \brief lua_Writer callback used to collect the output of lua_dump()
+ */
+static int lua_bytecode_writer(lua_State *L, const void *p, size_t size, void *data)
+{
+	struct ast_str **buf = data;
+
+	return ast_str_append_raw(buf, 0, p, size) < 0;
+}
+
+/*!
+ * \brief Precompile the extensions.lua source in to bytecode
+ *
+ * \param L the lua_State to use for compiling
+ * \param data the source of extensions.lua
+ * \param size the size of the source
+ * \param bytecode_size a pointer to store the size of the bytecode
+ *
+ * The bytecode is loaded in place of the source for each new lua_State so
+ * that the file only has to be parsed once per reload.
+ *
+ * \note The caller is expected to free the buffer at some point.
+ *
+ * \return a pointer to the bytecode, or NULL if it could not be generated
+ */
+static char *lua_compile_extensions(lua_State *L, const char *data, long size, size_t *bytecode_size)
+{
+	struct ast_str *buf;
+	char *bytecode = NULL;
+	int res;
+
+	*bytecode_size = 0;
+
+	if (luaL_loadbuffer(L, data, size, "extensions.lua")) {
+		lua_pop(L, 1);
+		return NULL;
+	}
+
+	if (!(buf = ast_str_create(size))) {
+		lua_pop(L, 1);
+		return NULL;
+	}
+
+#if LUA_VERSION_NUM >= 503
+	res = lua_dump(L, lua_bytecode_writer, &buf, 0);
+#else
+	res = lua_dump(L, lua_bytecode_writer, &buf);
+#endif
+	lua_pop(L, 1);
+
+	if (!res && ast_str_strlen(buf) && (bytecode = ast_malloc(ast_str_strlen(buf)))) {
+		memcpy(bytecode, ast_str_buffer(buf), ast_str_strlen(buf));
+		*bytecode_size = ast_str_strlen(buf);
+	}
+
+	ast_free(buf);
+	return bytecode;
+}
+
 /*!
  * \brief Load the extensions.lua file from the internal buffer
  *
@@ -1169,6 +1249,7 @@ static char *lua_read_extensions_file(lua_State *L, long *size, int *file_not_op
  */
 static int lua_load_extensions(lua_State *L, struct ast_channel *chan)
 {
+	int res;
 
 	/* store a pointer to this channel */
 	lua_pushlightuserdata(L, chan);
@@ -1176,14 +1257,23 @@ static int lua_load_extensions(lua_State *L, struct ast_channel *chan)
 
 	luaL_openlibs(L);
 
-	/* load and sort extensions */
+	/* load and sort extensions, skipping the parser if we have bytecode */
 	ast_mutex_lock(&config_file_lock);
-	if (luaL_loadbuffer(L, config_file_data, config_file_size, "extensions.lua")
+	if (config_bytecode_data) {
+		res = luaL_loadbuffer(L, config_bytecode_data, config_bytecode_size, "extensions.lua");
+	} else {
+		res = luaL_loadbuffer(L, config_file_data, config_file_size, "extensions.lua");
+	}
+	if (res
 			|| lua_pcall(L, 0, LUA_MULTRET, 0)
 			|| lua_sort_extensions(L)) {
 		ast_mutex_unlock(&config_file_lock);
 		return 1;
 	}
+
+	/* remember which version of the config this state was built from */
+	lua_pushinteger(L, config_generation);
+	lua_setfield(L, LUA_REGISTRYINDEX, "generation");
 	ast_mutex_unlock(&config_file_lock);
 
 	/* now we setup special tables and functions */
@@ -1214,6 +1304,8 @@ static int lua_reload_extensions(lua_State *L)
 {
 	long size = 0;
 	char *data = NULL;
+	char *bytecode;
+	size_t bytecode_size;
 	int file_not_openable = 0;
 
 	luaL_openlibs(L);
@@ -1225,6 +1317,9 @@ static int lua_reload_extensions(lua_State *L)
 		return 1;
 	}
 
+	/* if this fails we just fall back to loading the source */
+	bytecode = lua_compile_extensions(L, data, size, &bytecode_size);
+
 	ast_mutex_lock(&config_file_lock);
 
 	if (config_file_data)
@@ -1233,6 +1328,12 @@ static int lua_reload_extensions(lua_State *L)
 	config_file_data = data;
 	config_file_size = size;
 
+	ast_free(config_bytecode_data);
+	config_bytecode_data = bytecode;
+	config_bytecode_size = bytecode_size;
+
+	config_generation++;
+
 	/* merge our new contexts */
 	ast_merge_contexts_and_delete(&local_contexts, local_table, registrar);
 	/* merge_contexts_and_delete will actually, at the correct moment,
@@ -1254,9 +1355,140 @@ static void lua_free_extensions()
 	ast_mutex_lock(&config_file_lock);
 	config_file_size = 0;
 	ast_free(config_file_data);
+	config_file_data = NULL;
+	config_bytecode_size = 0;
+	ast_free(config_bytecode_data);
+	config_bytecode_data = NULL;
 	ast_mutex_unlock(&config_file_lock);
 }
 
+/*!
+ * \brief Check if a lua_State was built from the current extensions.lua
+ */
+static int lua_state_is_current(lua_State *L)
+{
+	unsigned int generation;
+	int current;
+
+	lua_getfield(L, LUA_REGISTRYINDEX, "generation");
+	generation = lua_tointeger(L, -1);
+	lua_pop(L, 1);
+
+	ast_mutex_lock(&config_file_lock);
+	current = generation == config_generation;
+	ast_mutex_unlock(&config_file_lock);
+
+	return current;
+}
+
+/*!
+ * \brief Take a prewarmed lua_State from the pool or build a new one
+ *
+ * \param chan the channel the state will be used for (may be NULL)
+ *
+ * \return a lua_State with extensions.lua loaded, or NULL on error
+ */
+static lua_State *lua_new_state(struct ast_channel *chan)
+{
+	lua_State *L = NULL;
+
+	ast_mutex_lock(&state_pool_lock);
+	while (!L && state_pool_count) {
+		L = state_pool[--state_pool_count];
+		if (!lua_state_is_current(L)) {
+			lua_close(L);
+			L = NULL;
+		}
+	}
+	ast_mutex_unlock(&state_pool_lock);
+
+	if (L) {
+		lua_pushlightuserdata(L, chan);
+		lua_setfield(L, LUA_REGISTRYINDEX, "channel");
+		return L;
+	}
+
+	L = luaL_newstate();
+	if (!L) {
+		ast_log(LOG_ERROR, "Error allocating lua_State, no memory\n");
+		return NULL;
+	}
+
+	if (lua_load_extensions(L, chan)) {
+		const char *error = lua_tostring(L, -1);
+		if (chan) {
+			ast_log(LOG_ERROR, "Error loading extensions.lua for %s: %s\n", ast_channel_name(chan), error);
+		} else {
+			ast_log(LOG_ERROR, "Error loading extensions.lua: %s\n", error);
+		}
+		lua_close(L);
+		return NULL;
+	}
+
+	return L;
+}
+
+/*!
+ * \brief Return a channel-less lua_State to the pool
+ *
+ * The state is reset (empty stack, no channel) and kept for the next
+ * lookup if it is still current and the pool has room, otherwise it is
+ * closed.
+ */
+static void lua_put_state(lua_State *L)
+{
+	lua_settop(L, 0);
+	lua_pushlightuserdata(L, NULL);
+	lua_setfield(L, LUA_REGISTRYINDEX, "channel");
+
+	if (!lua_state_is_current(L)) {
+		lua_close(L);
+		return;
+	}
+
+	ast_mutex_lock(&state_pool_lock);
+	if (state_pool_count < LUA_STATE_POOL_SIZE) {
+		state_pool[state_pool_count++] = L;
+		L = NULL;
+	}
+	ast_mutex_unlock(&state_pool_lock);
+
+	if (L) {
+		lua_close(L);
+	}
+}
+
+/*!
+ * \brief Close every pooled lua_State
+ */
+static void lua_state_pool_drain(void)
+{
+	ast_mutex_lock(&state_pool_lock);
+	while (state_pool_count) {
+		lua_close(state_pool[--state_pool_count]);
+	}
+	ast_mutex_unlock(&state_pool_lock);
+}
+
+/*!
+ * \brief Replace the pooled lua_States with ones built from the current
+ * extensions.lua
+ */
+static void lua_state_pool_refill(void)
+{
+	int i;
+
+	lua_state_pool_drain();
+
+	for (i = 0; i < LUA_STATE_POOL_SIZE; i++) {
+		lua_State *L = lua_new_state(NULL);
+		if (!L) {
+			break;
+		}
+		lua_put_state(L);
+	}
+}
+
 /*!
  * \brief Get the lua_State for this channel
  *
@@ -1265,30 +1497,17 @@ static void lua_free_extensions()
  * If the channel does not yet have a lua state associated with it, one will be
  * created.
  *
- * \note If no channel was passed then the caller is expected to free the state
- * using lua_close().
+ * \note If no channel was passed then the caller is expected to hand the
+ * state back using lua_put_state().
  *
  * \return a lua_State
  */
 static lua_State *lua_get_state(struct ast_channel *chan)
 {
 	struct ast_datastore *datastore = NULL;
-	lua_State *L;
 
 	if (!chan) {
-		L = luaL_newstate();
-		if (!L) {
-			ast_log(LOG_ERROR, "Error allocating lua_State, no memory\n");
-			return NULL;
-		}
-
-		if (lua_load_extensions(L, NULL)) {
-			const char *error = lua_tostring(L, -1);
-			ast_log(LOG_ERROR, "Error loading extensions.lua: %s\n", error);
-			lua_close(L);
-			return NULL;
-		}
-		return L;
+		return lua_new_state(NULL);
 	} else {
 		ast_channel_lock(chan);
 		datastore = ast_channel_datastore_find(chan, &lua_datastore, NULL);
@@ -1302,30 +1521,15 @@ static lua_State *lua_get_state(struct ast_channel *chan)
 				return NULL;
 			}
 
-			datastore->data = luaL_newstate();
+			datastore->data = lua_new_state(chan);
 			if (!datastore->data) {
 				ast_datastore_free(datastore);
-				ast_log(LOG_ERROR, "Error allocating lua_State, no memory\n");
 				return NULL;
 			}
 
 			ast_channel_lock(chan);
 			ast_channel_datastore_add(chan, datastore);
 			ast_channel_unlock(chan);
-
-			L = datastore->data;
-
-			if (lua_load_extensions(L, chan)) {
-				const char *error = lua_tostring(L, -1);
-				ast_log(LOG_ERROR, "Error loading extensions.lua for %s: %s\n", ast_channel_name(chan), error);
-
-				ast_channel_lock(chan);
-				ast_channel_datastore_remove(chan, datastore);
-				ast_channel_unlock(chan);
-
-				ast_datastore_free(datastore);
-				return NULL;
-			}
 		}
 
 		return datastore->data;
@@ -1350,7 +1554,7 @@ static int exists(struct ast_channel *chan, const char *context, const char *ext
 
 	res = lua_find_extension(L, context, exten, priority, &exists, 0);
 
-	if (!chan) lua_close(L);
+	if (!chan) lua_put_state(L);
 	ast_module_user_remove(u);
 	return res;
 }
@@ -1373,7 +1577,7 @@ static int canmatch(struct ast_channel *chan, const char *context, const char *e
 
 	res = lua_find_extension(L, context, exten, priority, &canmatch, 0);
 
-	if (!chan) lua_close(L);
+	if (!chan) lua_put_state(L);
 	ast_module_user_remove(u);
 	return res;
 }
@@ -1396,7 +1600,7 @@ static int matchmore(struct ast_channel *chan, const char *context, const char *
 
 	res = lua_find_extension(L, context, exten, priority, &matchmore, 0);
 
-	if (!chan) lua_close(L);
+	if (!chan) lua_put_state(L);
 	ast_module_user_remove(u);
 	return res;
 }
@@ -1425,7 +1629,7 @@ static int exec(struct ast_channel *chan, const char *context, const char *exten
 	if (!lua_find_extension(L, context, exten, priority, &exists, 1)) {
 		lua_pop(L, 1); /* pop the debug function */
 		ast_log(LOG_ERROR, "Could not find extension %s in context %s\n", exten, context);
-		if (!chan) lua_close(L);
+		if (!chan) lua_put_state(L);
 		ast_module_user_remove(u);
 		return -1;
 	}
@@ -1661,6 +1865,11 @@ static int load_or_reload_lua_stuff(void)
 	}
 
 	lua_close(L);
+
+	if (!loaded) {
+		lua_state_pool_refill();
+	}
+
 	return res;
 }
 
@@ -1668,6 +1877,7 @@ static int unload_module(void)
 {
 	ast_context_destroy(NULL, registrar);
 	ast_unregister_switch(&lua_switch);
+	lua_state_pool_drain();
 	lua_free_extensions();
 	return 0;
 }
@@ -18,9 +18,12 @@
 
 #include "asterisk.h"
 
+#include "asterisk/alertpipe.h"
 #include "asterisk/ari.h"
 #include "asterisk/astobj2.h"
 #include "asterisk/http_websocket.h"
+#include "asterisk/linkedlists.h"
+#include "asterisk/poll-compat.h"
 #include "asterisk/stasis_app.h"
 #include "internal.h"
 
@@ -30,22 +33,71 @@
  * \author David M. Lee, II <dlee@digium.com>
  */
 
+/*! Most events written to a WebSocket with one write */
+#define MAX_WRITE_BATCH 32
+
+/*! \brief An event waiting to be written to a WebSocket */
+struct ari_websocket_event {
+	AST_LIST_ENTRY(ari_websocket_event) next;
+	/*! Length of the payload */
+	size_t len;
+	/*! Encoded event */
+	char payload[0];
+};
+
+/*!
+ * \brief An ARI WebSocket session.
+ *
+ * Events are queued by whichever thread publishes them and written by the
+ * session's own thread while it waits for input, so a slow client only
+ * fills its own queue.
+ */
 struct ast_ari_websocket_session {
 	struct ast_websocket *ws_session;
 	int (*validator)(struct ast_json *);
+	/*! Guards the outgoing queue and its statistics */
+	ast_mutex_t lock;
+	/*! Signalled as the outgoing queue drains */
+	ast_cond_t drained;
+	/*! Wakes the session thread to write queued events */
+	int alert_pipe[2];
+	/*! Events waiting for the session thread */
+	AST_LIST_HEAD_NOLOCK(, ari_websocket_event) queue;
+	/*! Statistics, where queued counts events until they are written */
+	struct ari_websocket_stats stats;
+	/*! Most bytes of events that may be queued */
+	size_t queue_limit;
+	/*! What to do with events once the queue is full */
+	enum ari_websocket_overflow overflow;
+	/*! (ms) How long a blocked publisher waits for room */
+	int write_timeout;
+	/*! Set once the session takes no more events */
+	unsigned int closed:1;
+	/*! Set when the session thread should hang up on a client left behind */
+	unsigned int disconnect:1;
+	/*! Set if REST requests made over the session may make changes */
+	unsigned int write_allowed:1;
 };
 
+/*! \brief Established sessions, for their statistics */
+static struct ao2_container *websocket_sessions;
+
 static void websocket_session_dtor(void *obj)
 {
 	struct ast_ari_websocket_session *session = obj;
+	struct ari_websocket_event *event;
+
+	while ((event = AST_LIST_REMOVE_HEAD(&session->queue, next))) {
+		ast_free(event);
+	}
+	ast_alertpipe_close(session->alert_pipe);
+	ast_cond_destroy(&session->drained);
+	ast_mutex_destroy(&session->lock);
 
 	ast_websocket_unref(session->ws_session);
 	session->ws_session = NULL;
 }
 
-/*!
- * \brief Validator that always succeeds.
- */
 static int null_validator(struct ast_json *json)
 {
 	return 1;
@@ -81,26 +133,158 @@ struct ast_ari_websocket_session *ast_ari_websocket_session_create(
 			config->general->write_timeout);
 	}
 
-	session = ao2_alloc(sizeof(*session), websocket_session_dtor);
+	session = ao2_alloc_options(sizeof(*session), websocket_session_dtor,
+		AO2_ALLOC_OPT_LOCK_NOLOCK);
 	if (!session) {
 		return NULL;
 	}
 
+	ast_mutex_init(&session->lock);
+	ast_cond_init(&session->drained, NULL);
+	ast_alertpipe_clear(session->alert_pipe);
+	if (ast_alertpipe_init(session->alert_pipe)) {
+		return NULL;
+	}
+	session->queue_limit = config->general->websocket_queue_limit;
+	session->overflow = config->general->websocket_overflow;
+	session->write_timeout = config->general->write_timeout;
+
 	ao2_ref(ws_session, +1);
 	session->ws_session = ws_session;
 	session->validator = validator;
+	/* The session is created while handling the request that upgraded to it */
+	session->write_allowed = ari_request_write_allowed();
+
+	if (websocket_sessions) {
+		ao2_link(websocket_sessions, session);
+	}
 
 	ao2_ref(session, +1);
 	return session;
 }
 
+/*!
+ * \internal
+ * \brief Stop taking events once the session thread is done with the session
+ */
+static void websocket_session_finish(struct ast_ari_websocket_session *session)
+{
+	ast_mutex_lock(&session->lock);
+	session->closed = 1;
+	ast_cond_broadcast(&session->drained);
+	ast_mutex_unlock(&session->lock);
+
+	if (websocket_sessions) {
+		ao2_unlink(websocket_sessions, session);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Write the queued events, several per write
+ *
+ * \retval 0 on success.
+ * \retval -1 if the session is no longer usable.
+ */
+static int websocket_session_flush(struct ast_ari_websocket_session *session)
+{
+	struct ari_websocket_event *batch[MAX_WRITE_BATCH];
+	char *payloads[MAX_WRITE_BATCH];
+	uint64_t payload_sizes[MAX_WRITE_BATCH];
+	size_t count;
+	size_t bytes;
+	size_t idx;
+	int res;
+
+	for (;;) {
+		ast_mutex_lock(&session->lock);
+		if (session->disconnect) {
+			ast_mutex_unlock(&session->lock);
+			/* 1008 - policy violation, the client could not keep up */
+			ast_websocket_close(session->ws_session, 1008);
+			return -1;
+		}
+		for (count = 0; count < MAX_WRITE_BATCH; ++count) {
+			batch[count] = AST_LIST_REMOVE_HEAD(&session->queue, next);
+			if (!batch[count]) {
+				break;
+			}
+		}
+		ast_mutex_unlock(&session->lock);
+
+		if (!count) {
+			return 0;
+		}
+
+		bytes = 0;
+		for (idx = 0; idx < count; ++idx) {
+			payloads[idx] = batch[idx]->payload;
+			payload_sizes[idx] = batch[idx]->len;
+			bytes += batch[idx]->len;
+		}
+		res = ast_websocket_write_batch(session->ws_session, AST_WEBSOCKET_OPCODE_TEXT,
+			payloads, payload_sizes, count);
+		for (idx = 0; idx < count; ++idx) {
+			ast_free(batch[idx]);
+		}
+
+		ast_mutex_lock(&session->lock);
+		session->stats.queued -= count;
+		session->stats.queued_bytes -= bytes;
+		ast_cond_broadcast(&session->drained);
+		ast_mutex_unlock(&session->lock);
+
+		if (res) {
+			ast_log(LOG_NOTICE, "Problem occurred during websocket write to %s, websocket closed\n",
+				ast_sockaddr_stringify(ast_ari_websocket_session_get_remote_addr(session)));
+			return -1;
+		}
+	}
+}
+
+/*!
+ * \internal
+ * \brief Handle a REST request received on the session and send its response
+ *
+ * Events queued before the request was read are written ahead of the response.
+ *
+ * \retval 0 on success.
+ * \retval -1 if the session is no longer usable.
+ */
+static int websocket_session_rest_request(struct ast_ari_websocket_session *session,
+	struct ast_json *request)
+{
+	RAII_VAR(struct ast_json *, response, NULL, ast_json_unref);
+	RAII_VAR(char *, str, NULL, ast_json_free);
+
+	response = ari_websocket_rest_request(request, session->write_allowed);
+	if (response) {
+		str = ast_json_dump_string_format(response, ast_ari_json_format());
+	}
+	if (!str) {
+		ast_log(LOG_ERROR, "Failed to respond to a REST request on ARI web socket\n");
+		return 0;
+	}
+
+	if (websocket_session_flush(session)) {
+		return -1;
+	}
+	if (ast_websocket_write_string(session->ws_session, str)) {
+		ast_log(LOG_NOTICE, "Problem occurred during websocket write to %s, websocket closed\n",
+			ast_sockaddr_stringify(ast_ari_websocket_session_get_remote_addr(session)));
+		return -1;
+	}
+
+	return 0;
+}
+
 struct ast_json *ast_ari_websocket_session_read(
 	struct ast_ari_websocket_session *session)
 {
 	RAII_VAR(struct ast_json *, message, NULL, ast_json_unref);
 
 	if (ast_websocket_fd(session->ws_session) < 0) {
-		return NULL;
+		goto failed;
 	}
 
 	while (!message) {
@@ -109,14 +293,29 @@ struct ast_json *ast_ari_websocket_session_read(
 		uint64_t payload_len;
 		enum ast_websocket_opcode opcode;
 		int fragmented;
-
-		res = ast_wait_for_input(
-			ast_websocket_fd(session->ws_session), -1);
-
+		struct pollfd fds[2] = {
+			{ .fd = ast_websocket_fd(session->ws_session), .events = POLLIN, },
+			{ .fd = ast_alertpipe_readfd(session->alert_pipe), .events = POLLIN, },
+		};
+
+		res = ast_poll(fds, ARRAY_LEN(fds), -1);
+		if (res < 0 && errno == EINTR) {
+			continue;
+		}
 		if (res <= 0) {
 			ast_log(LOG_WARNING, "WebSocket poll error: %s\n",
 				strerror(errno));
-			return NULL;
+			goto failed;
+		}
+
+		if (fds[1].revents) {
+			ast_alertpipe_read(session->alert_pipe);
+			if (websocket_session_flush(session)) {
+				goto failed;
+			}
+		}
+		if (!fds[0].revents) {
+			continue;
 		}
 
 		res = ast_websocket_read(session->ws_session, &payload,
@@ -125,18 +324,26 @@ struct ast_json *ast_ari_websocket_session_read(
 		if (res != 0) {
 			ast_log(LOG_WARNING, "WebSocket read error: %s\n",
 				strerror(errno));
-			return NULL;
+			goto failed;
 		}
 
 		switch (opcode) {
 		case AST_WEBSOCKET_OPCODE_CLOSE:
 			ast_debug(1, "WebSocket closed\n");
-			return NULL;
+			goto failed;
 		case AST_WEBSOCKET_OPCODE_TEXT:
 			message = ast_json_load_buf(payload, payload_len, NULL);
 			if (message == NULL) {
 				ast_log(LOG_WARNING,
 					"WebSocket input failed to parse\n");
+			} else if (!strcmp(S_OR(ast_json_string_get(ast_json_object_get(message, "type")), ""),
+					"RESTRequest")) {
+				/* Handled here rather than by the reader */
+				if (websocket_session_rest_request(session, message)) {
+					goto failed;
+				}
+				ast_json_unref(message);
+				message = NULL;
 			}
 
 			break;
@@ -147,6 +354,116 @@ struct ast_json *ast_ari_websocket_session_read(
 	}
 
 	return ast_json_ref(message);
+
+failed:
+	websocket_session_finish(session);
+	return NULL;
+}
+
+/*!
+ * \internal
+ * \brief Make room in the queue for an event of \a len bytes
+ *
+ * \pre session->lock is held
+ *
+ * \retval 1 if the event may be queued.
+ * \retval 0 if it must be discarded.
+ */
+static int websocket_session_make_room(struct ast_ari_websocket_session *session, size_t len)
+{
+	struct ari_websocket_event *event;
+	struct timeval deadline;
+	struct timespec ts;
+
+	if (session->closed) {
+		return 0;
+	}
+	/* An event larger than the whole queue still goes out on its own */
+	if (session->stats.queued_bytes + len <= session->queue_limit
+		|| AST_LIST_EMPTY(&session->queue)) {
+		return 1;
+	}
+
+	switch (session->overflow) {
+	case ARI_WEBSOCKET_OVERFLOW_DROP_OLDEST:
+		if (!session->stats.dropped) {
+			ast_log(LOG_WARNING, "ARI websocket to %s is not keeping up; dropping its oldest events\n",
+				ast_sockaddr_stringify(ast_ari_websocket_session_get_remote_addr(session)));
+		}
+		while (session->stats.queued_bytes + len > session->queue_limit
+			&& (event = AST_LIST_REMOVE_HEAD(&session->queue, next))) {
+			session->stats.queued--;
+			session->stats.queued_bytes -= event->len;
+			session->stats.dropped++;
+			ast_free(event);
+		}
+		return 1;
+	case ARI_WEBSOCKET_OVERFLOW_BLOCK:
+		deadline = ast_tvadd(ast_tvnow(), ast_samp2tv(session->write_timeout, 1000));
+		ts.tv_sec = deadline.tv_sec;
+		ts.tv_nsec = deadline.tv_usec * 1000;
+		while (!session->closed
+			&& session->stats.queued_bytes + len > session->queue_limit
+			&& !AST_LIST_EMPTY(&session->queue)) {
+			if (ast_cond_timedwait(&session->drained, &session->lock, &ts) == ETIMEDOUT) {
+				break;
+			}
+		}
+		if (session->closed) {
+			return 0;
+		}
+		if (session->stats.queued_bytes + len <= session->queue_limit
+			|| AST_LIST_EMPTY(&session->queue)) {
+			return 1;
+		}
+		/* Fall through */
+	case ARI_WEBSOCKET_OVERFLOW_DISCONNECT:
+		ast_log(LOG_WARNING, "ARI websocket to %s is %zu bytes of events behind; disconnecting\n",
+			ast_sockaddr_stringify(ast_ari_websocket_session_get_remote_addr(session)),
+			session->stats.queued_bytes);
+		session->closed = 1;
+		session->disconnect = 1;
+		ast_alertpipe_write(session->alert_pipe);
+		break;
+	}
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Queue an encoded event for the session thread to write
+ */
+static int websocket_session_queue(struct ast_ari_websocket_session *session,
+	const char *payload, size_t len)
+{
+	struct ari_websocket_event *event;
+	int was_empty;
+
+	event = ast_calloc(1, sizeof(*event) + len);
+	if (!event) {
+		return -1;
+	}
+	event->len = len;
+	memcpy(event->payload, payload, len);
+
+	ast_mutex_lock(&session->lock);
+	if (!websocket_session_make_room(session, len)) {
+		ast_mutex_unlock(&session->lock);
+		ast_free(event);
+		return -1;
+	}
+	was_empty = AST_LIST_EMPTY(&session->queue);
+	AST_LIST_INSERT_TAIL(&session->queue, event, next);
+	session->stats.queued++;
+	session->stats.queued_bytes += len;
+	session->stats.peak_bytes = MAX(session->stats.peak_bytes, session->stats.queued_bytes);
+	if (was_empty) {
+		ast_alertpipe_write(session->alert_pipe);
+	}
+	ast_mutex_unlock(&session->lock);
+
+	return 0;
 }
 
 #define VALIDATION_FAILED				\
@@ -163,7 +480,7 @@ int ast_ari_websocket_session_write(struct ast_ari_websocket_session *session,
 #ifdef AST_DEVMODE
 	if (!session->validator(message)) {
 		ast_log(LOG_ERROR, "Outgoing message failed validation\n");
-		return ast_websocket_write_string(session->ws_session, VALIDATION_FAILED);
+		return websocket_session_queue(session, VALIDATION_FAILED, strlen(VALIDATION_FAILED));
 	}
 #endif
 
@@ -174,12 +491,35 @@ int ast_ari_websocket_session_write(struct ast_ari_websocket_session *session,
 		return -1;
 	}
 
-	if (ast_websocket_write_string(session->ws_session, str)) {
-		ast_log(LOG_NOTICE, "Problem occurred during websocket write to %s, websocket closed\n",
-			ast_sockaddr_stringify(ast_ari_websocket_session_get_remote_addr(session)));
-		return -1;
+	return websocket_session_queue(session, str, strlen(str));
+}
+
+void ari_websocket_session_stats(struct ast_ari_websocket_session *session,
+	struct ari_websocket_stats *stats)
+{
+	ast_mutex_lock(&session->lock);
+	*stats = session->stats;
+	ast_mutex_unlock(&session->lock);
+}
+
+struct ao2_container *ari_websocket_sessions(void)
+{
+	return ao2_bump(websocket_sessions);
+}
+
+int ari_websocket_init(void)
+{
+	if (!websocket_sessions) {
+		websocket_sessions = ao2_container_alloc_list(AO2_ALLOC_OPT_LOCK_MUTEX, 0, NULL, NULL);
 	}
-	return 0;
+
+	return websocket_sessions ? 0 : -1;
+}
+
+void ari_websocket_cleanup(void)
+{
+	ao2_cleanup(websocket_sessions);
+	websocket_sessions = NULL;
 }
 
 struct ast_sockaddr *ast_ari_websocket_session_get_remote_addr(
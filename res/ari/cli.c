@@ -24,6 +24,7 @@
 
 #include "asterisk.h"
 
+#include "asterisk/ari.h"
 #include "asterisk/astobj2.h"
 #include "asterisk/cli.h"
 #include "asterisk/stasis_app.h"
@@ -71,6 +72,20 @@ static char *ari_show(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 	ast_cli(a->fd, "\n");
 	ast_cli(a->fd, "Auth realm: %s\n", conf->general->auth_realm);
 	ast_cli(a->fd, "Allowed Origins: %s\n", conf->general->allowed_origins);
+	ast_cli(a->fd, "WebSocket queue limit: %u bytes\n", conf->general->websocket_queue_limit);
+	ast_cli(a->fd, "WebSocket overflow: ");
+	switch (conf->general->websocket_overflow) {
+	case ARI_WEBSOCKET_OVERFLOW_BLOCK:
+		ast_cli(a->fd, "block");
+		break;
+	case ARI_WEBSOCKET_OVERFLOW_DROP_OLDEST:
+		ast_cli(a->fd, "drop_oldest");
+		break;
+	case ARI_WEBSOCKET_OVERFLOW_DISCONNECT:
+		ast_cli(a->fd, "disconnect");
+		break;
+	}
+	ast_cli(a->fd, "\n");
 	ast_cli(a->fd, "User count: %d\n", ao2_container_count(conf->users));
 	return CLI_SUCCESS;
 }
@@ -294,6 +309,58 @@ static char *ari_show_apps(struct ast_cli_entry *e, int cmd, struct ast_cli_args
 	return CLI_SUCCESS;
 }
 
+static char *ari_show_websockets(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct ao2_container *sessions;
+	struct ao2_iterator it_sessions;
+	struct ast_ari_websocket_session *session;
+	struct ari_websocket_stats stats;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "ari show websockets";
+		e->usage =
+			"Usage: ari show websockets\n"
+			"       Lists established WebSockets and the events waiting\n"
+			"       to be written to each, to find clients that are slow\n"
+			"       to read them.\n"
+			;
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	default:
+		break;
+	}
+
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	sessions = ari_websocket_sessions();
+	if (!sessions) {
+		ast_cli(a->fd, "Unable to retrieve WebSockets!\n");
+		return CLI_FAILURE;
+	}
+
+	ast_cli(a->fd, "%-46.46s %-8.8s %-12.12s %-12.12s %-8.8s\n",
+		"Remote Address", "Queued", "Queued Bytes", "Peak Bytes", "Dropped");
+	ast_cli(a->fd, "%-46.46s %-8.8s %-12.12s %-12.12s %-8.8s\n",
+		"==============", "======", "============", "==========", "=======");
+	it_sessions = ao2_iterator_init(sessions, 0);
+	while ((session = ao2_iterator_next(&it_sessions))) {
+		ari_websocket_session_stats(session, &stats);
+		ast_cli(a->fd, "%-46.46s %-8zu %-12zu %-12zu %-8u\n",
+			ast_sockaddr_stringify(ast_ari_websocket_session_get_remote_addr(session)),
+			stats.queued, stats.queued_bytes, stats.peak_bytes, stats.dropped);
+		ao2_ref(session, -1);
+	}
+
+	ao2_iterator_destroy(&it_sessions);
+	ao2_ref(sessions, -1);
+
+	return CLI_SUCCESS;
+}
+
 struct app_complete {
 	/*! Nth app to search for */
 	int state;
@@ -428,6 +495,7 @@ static struct ast_cli_entry cli_ari[] = {
 	AST_CLI_DEFINE(ari_mkpasswd, "Encrypts a password"),
 	AST_CLI_DEFINE(ari_show_apps, "List registered ARI applications"),
 	AST_CLI_DEFINE(ari_show_app, "Display details of a registered ARI application"),
+	AST_CLI_DEFINE(ari_show_websockets, "List ARI WebSockets and their queued events"),
 	AST_CLI_DEFINE(ari_set_debug, "Enable/disable debugging of an ARI application"),
 };
 
@@ -61,6 +61,25 @@ static int encoding_format_handler(const struct aco_option *opt,
 	return 0;
 }
 
+/*! \brief Parses the ari_websocket_overflow enum from a config file */
+static int websocket_overflow_handler(const struct aco_option *opt,
+	struct ast_variable *var, void *obj)
+{
+	struct ast_ari_conf_general *general = obj;
+
+	if (!strcasecmp(var->value, "block")) {
+		general->websocket_overflow = ARI_WEBSOCKET_OVERFLOW_BLOCK;
+	} else if (!strcasecmp(var->value, "drop_oldest")) {
+		general->websocket_overflow = ARI_WEBSOCKET_OVERFLOW_DROP_OLDEST;
+	} else if (!strcasecmp(var->value, "disconnect")) {
+		general->websocket_overflow = ARI_WEBSOCKET_OVERFLOW_DISCONNECT;
+	} else {
+		return -1;
+	}
+
+	return 0;
+}
+
 /*! \brief Parses the ast_ari_password_format enum from a config file */
 static int password_format_handler(const struct aco_option *opt,
 	struct ast_variable *var, void *obj)
@@ -357,6 +376,11 @@ int ast_ari_config_init(void)
 	aco_option_register(&cfg_info, "websocket_write_timeout", ACO_EXACT, general_options,
 		AST_DEFAULT_WEBSOCKET_WRITE_TIMEOUT_STR, OPT_INT_T, PARSE_IN_RANGE,
 		FLDSET(struct ast_ari_conf_general, write_timeout), 1, INT_MAX);
+	aco_option_register(&cfg_info, "websocket_queue_limit", ACO_EXACT, general_options,
+		"1048576", OPT_UINT_T, PARSE_IN_RANGE,
+		FLDSET(struct ast_ari_conf_general, websocket_queue_limit), 1024, UINT_MAX);
+	aco_option_register_custom(&cfg_info, "websocket_overflow", ACO_EXACT,
+		general_options, "block", websocket_overflow_handler, 0);
 	aco_option_register_custom(&cfg_info, "channelvars", ACO_EXACT, general_options,
 		"", channelvars_handler, 0);
 
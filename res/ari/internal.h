@@ -61,12 +61,26 @@ struct ast_ari_conf {
 /*! Max length for auth_realm field */
 #define ARI_AUTH_REALM_LEN 80
 
+/*! \brief What to do with an event for a websocket whose queue is full */
+enum ari_websocket_overflow {
+	/*! Wait for the queue to drain, for up to the write timeout */
+	ARI_WEBSOCKET_OVERFLOW_BLOCK,
+	/*! Throw away the oldest queued events to make room */
+	ARI_WEBSOCKET_OVERFLOW_DROP_OLDEST,
+	/*! Disconnect the websocket */
+	ARI_WEBSOCKET_OVERFLOW_DISCONNECT,
+};
+
 /*! \brief Global configuration options for ARI. */
 struct ast_ari_conf_general {
 	/*! Enabled by default, disabled if false. */
 	int enabled;
 	/*! Write timeout for websocket connections */
 	int write_timeout;
+	/*! Bytes of events each websocket may have waiting to be written */
+	unsigned int websocket_queue_limit;
+	/*! What to do when a websocket's queue is full */
+	enum ari_websocket_overflow websocket_overflow;
 	/*! Encoding format used during output (default compact). */
 	enum ast_json_encoding_format format;
 	/*! Authentication realm */
@@ -104,6 +118,49 @@ struct ast_ari_conf_user {
 	int read_only;
 };
 
+struct ast_ari_websocket_session;
+
+/*! \brief Outgoing queue statistics of an ARI websocket session */
+struct ari_websocket_stats {
+	/*! Events waiting to be written */
+	size_t queued;
+	/*! Bytes of events waiting to be written */
+	size_t queued_bytes;
+	/*! Most bytes ever waiting to be written */
+	size_t peak_bytes;
+	/*! Events thrown away because the queue was full */
+	unsigned int dropped;
+};
+
+/*!
+ * \brief Get the container of established ARI websocket sessions.
+ *
+ * \return The container, to be ao2_cleanup()'ed. May be \c NULL.
+ */
+struct ao2_container *ari_websocket_sessions(void);
+
+/*!
+ * \brief Get the outgoing queue statistics of an ARI websocket session.
+ *
+ * \param session Websocket session.
+ * \param[out] stats Filled in with the current statistics.
+ */
+void ari_websocket_session_stats(struct ast_ari_websocket_session *session,
+	struct ari_websocket_stats *stats);
+
+/*!
+ * \brief Set up tracking of ARI websocket sessions.
+ *
+ * \return 0 on success.
+ * \return Non-zero on error.
+ */
+int ari_websocket_init(void);
+
+/*!
+ * \brief Clean up tracking of ARI websocket sessions.
+ */
+void ari_websocket_cleanup(void);
+
 /*!
  * \brief Initialize the ARI configuration
  */
@@ -164,4 +221,28 @@ void ari_handle_websocket(struct ast_websocket_server *ws_server,
 	enum ast_http_method method, struct ast_variable *get_params,
 	struct ast_variable *headers);
 
+/*!
+ * \brief Whether the user of the request this thread is handling may make changes.
+ *
+ * \retval 1 if the request's user is not read only.
+ * \retval 0 otherwise, or when the thread is not handling a request.
+ */
+int ari_request_write_allowed(void);
+
+/*!
+ * \brief Handle a REST request received as a WebSocket message.
+ *
+ * The request is a \c RESTRequest message with a \c method, a \c uri
+ * relative to /ari, an optional \c query object of strings, an optional
+ * JSON \c body and an optional \c request_id.  It is routed through
+ * the same handlers as requests made over HTTP.
+ *
+ * \param request The request message.
+ * \param write_allowed If false, only GET and OPTIONS requests are allowed.
+ *
+ * \return A \c RESTResponse message carrying the \c request_id of the request.
+ * \retval NULL on allocation failure.
+ */
+struct ast_json *ari_websocket_rest_request(struct ast_json *request, int write_allowed);
+
 #endif /* ARI_INTERNAL_H_ */
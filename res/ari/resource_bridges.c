@@ -886,7 +886,7 @@ void ast_ari_bridges_list(struct ast_variable *headers,
 	struct ast_ari_response *response)
 {
 	RAII_VAR(struct ao2_container *, bridges, NULL, ao2_cleanup);
-	RAII_VAR(struct ast_json *, json, NULL, ast_json_unref);
+	struct ast_json_array_encoder *encoder;
 	struct ao2_iterator i;
 	struct ast_bridge *bridge;
 
@@ -896,8 +896,8 @@ void ast_ari_bridges_list(struct ast_variable *headers,
 		return;
 	}
 
-	json = ast_json_array_create();
-	if (!json) {
+	encoder = ast_json_array_encoder_create(ast_ari_json_format());
+	if (!encoder) {
 		ast_ari_response_alloc_failed(response);
 		return;
 	}
@@ -910,15 +910,16 @@ void ast_ari_bridges_list(struct ast_variable *headers,
 
 		ao2_ref(bridge, -1);
 		ao2_cleanup(snapshot);
-		if (!json_bridge || ast_json_array_append(json, json_bridge)) {
+		if (ast_json_array_encoder_append(encoder, json_bridge)) {
 			ao2_iterator_destroy(&i);
+			ast_json_array_encoder_free(encoder);
 			ast_ari_response_alloc_failed(response);
 			return;
 		}
 	}
 	ao2_iterator_destroy(&i);
 
-	ast_ari_response_ok(response, ast_json_ref(json));
+	ast_ari_response_ok_encoded(response, ast_json_array_encoder_finish(encoder));
 }
 
 void ast_ari_bridges_create(struct ast_variable *headers,
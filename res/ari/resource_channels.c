@@ -929,15 +929,16 @@ void ast_ari_channels_list(struct ast_variable *headers,
 	struct ast_ari_response *response)
 {
 	RAII_VAR(struct ao2_container *, snapshots, NULL, ao2_cleanup);
-	RAII_VAR(struct ast_json *, json, NULL, ast_json_unref);
+	struct ast_json_array_encoder *encoder;
 	struct ao2_iterator i;
 	void *obj;
 	struct stasis_message_sanitizer *sanitize = stasis_app_get_sanitizer();
 
 	snapshots = ast_channel_cache_all();
 
-	json = ast_json_array_create();
-	if (!json) {
+	/* Encode as we go, so only one channel is held as JSON at a time */
+	encoder = ast_json_array_encoder_create(ast_ari_json_format());
+	if (!encoder) {
 		ast_ari_response_alloc_failed(response);
 		return;
 	}
@@ -953,19 +954,20 @@ void ast_ari_channels_list(struct ast_variable *headers,
 			continue;
 		}
 
-		r = ast_json_array_append(
-			json, ast_channel_snapshot_to_json(snapshot, NULL));
+		r = ast_json_array_encoder_append(
+			encoder, ast_channel_snapshot_to_json(snapshot, NULL));
 		if (r != 0) {
 			ast_ari_response_alloc_failed(response);
 			ao2_iterator_destroy(&i);
 			ao2_ref(snapshot, -1);
+			ast_json_array_encoder_free(encoder);
 			return;
 		}
 		ao2_ref(snapshot, -1);
 	}
 	ao2_iterator_destroy(&i);
 
-	ast_ari_response_ok(response, ast_json_ref(json));
+	ast_ari_response_ok_encoded(response, ast_json_array_encoder_finish(encoder));
 }
 
 /*! \brief Structure used for origination */
@@ -40,7 +40,7 @@ void ast_ari_endpoints_list(struct ast_variable *headers,
 {
 	RAII_VAR(struct stasis_cache *, cache, NULL, ao2_cleanup);
 	RAII_VAR(struct ao2_container *, snapshots, NULL, ao2_cleanup);
-	RAII_VAR(struct ast_json *, json, NULL, ast_json_unref);
+	struct ast_json_array_encoder *encoder;
 	struct ao2_iterator i;
 	void *obj;
 
@@ -59,8 +59,8 @@ void ast_ari_endpoints_list(struct ast_variable *headers,
 		return;
 	}
 
-	json = ast_json_array_create();
-	if (!json) {
+	encoder = ast_json_array_encoder_create(ast_ari_json_format());
+	if (!encoder) {
 		ast_ari_response_alloc_failed(response);
 		return;
 	}
@@ -71,15 +71,16 @@ void ast_ari_endpoints_list(struct ast_variable *headers,
 		struct ast_endpoint_snapshot *snapshot = stasis_message_data(msg);
 		struct ast_json *json_endpoint = ast_endpoint_snapshot_to_json(snapshot, stasis_app_get_sanitizer());
 
-		if (!json_endpoint || ast_json_array_append(json, json_endpoint)) {
+		if (ast_json_array_encoder_append(encoder, json_endpoint)) {
 			ao2_iterator_destroy(&i);
+			ast_json_array_encoder_free(encoder);
 			ast_ari_response_alloc_failed(response);
 			return;
 		}
 	}
 	ao2_iterator_destroy(&i);
 
-	ast_ari_response_ok(response, ast_json_ref(json));
+	ast_ari_response_ok_encoded(response, ast_json_array_encoder_finish(encoder));
 }
 
 void ast_ari_endpoints_list_by_tech(struct ast_variable *headers,
@@ -88,7 +89,7 @@ void ast_ari_endpoints_list_by_tech(struct ast_variable *headers,
 {
 	RAII_VAR(struct stasis_cache *, cache, NULL, ao2_cleanup);
 	RAII_VAR(struct ao2_container *, snapshots, NULL, ao2_cleanup);
-	RAII_VAR(struct ast_json *, json, NULL, ast_json_unref);
+	struct ast_json_array_encoder *encoder;
 	struct ast_endpoint *tech_endpoint;
 	struct ao2_iterator i;
 	void *obj;
@@ -116,8 +117,8 @@ void ast_ari_endpoints_list_by_tech(struct ast_variable *headers,
 		return;
 	}
 
-	json = ast_json_array_create();
-	if (!json) {
+	encoder = ast_json_array_encoder_create(ast_ari_json_format());
+	if (!encoder) {
 		ast_ari_response_alloc_failed(response);
 		return;
 	}
@@ -138,16 +139,17 @@ void ast_ari_endpoints_list_by_tech(struct ast_variable *headers,
 			continue;
 		}
 
-		r = ast_json_array_append(
-			json, json_endpoint);
+		r = ast_json_array_encoder_append(
+			encoder, json_endpoint);
 		if (r != 0) {
 			ao2_iterator_destroy(&i);
+			ast_json_array_encoder_free(encoder);
 			ast_ari_response_alloc_failed(response);
 			return;
 		}
 	}
 	ao2_iterator_destroy(&i);
-	ast_ari_response_ok(response, ast_json_ref(json));
+	ast_ari_response_ok_encoded(response, ast_json_array_encoder_finish(encoder));
 }
 
 void ast_ari_endpoints_get(struct ast_variable *headers,
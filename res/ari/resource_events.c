@@ -114,7 +114,8 @@ static void stasis_app_message_handler(
 				"Queued '%s' message for Stasis app '%s'; websocket is not ready\n",
 				msg_type,
 				msg_application);
-	} else if (stasis_app_event_allowed(app_name, message)) {
+	} else {
+		/* The app's event filters were applied before the event was sent */
 		if (stasis_app_get_debug_by_name(app_name)) {
 			char *str = ast_json_dump_string_format(message, ast_ari_json_format());
 
@@ -514,7 +515,8 @@ void ast_ari_websocket_events_event_websocket_established(
 			"Failed to locate an event session for the provided websocket session\n");
 	}
 
-	/* We don't process any input, but we'll consume it waiting for EOF */
+	/* REST requests are answered by the read itself. We don't process any
+	 * other input, but we'll consume it waiting for EOF */
 	while ((msg = ast_ari_websocket_session_read(ws_session))) {
 		ast_json_unref(msg);
 	}
@@ -82,85 +82,173 @@ struct parking_limits_pvt {
 	struct parked_user *user;
 };
 
-int unpark_parked_user(struct parked_user *pu)
+/*! \brief Number of parking spaces tracked by each word of a lot's space map */
+#define SPACES_PER_WORD 64
+
+int parking_lot_spaces_update(struct parking_lot *lot)
 {
-	if (pu->lot) {
-		ao2_unlink(pu->lot->parked_users, pu);
-		parking_lot_remove_if_unused(pu->lot);
+	int start = lot->cfg->parking_start;
+	int stop = lot->cfg->parking_stop;
+	uint64_t *spaces;
+	struct ao2_iterator iter;
+	struct parked_user *user;
+
+	if (lot->spaces_in_use && lot->spaces_start == start && lot->spaces_stop == stop) {
 		return 0;
 	}
 
-	return -1;
+	spaces = ast_calloc((stop - start) / SPACES_PER_WORD + 1, sizeof(*spaces));
+	if (!spaces) {
+		return -1;
+	}
+
+	ao2_wrlock(lot->parked_users);
+	iter = ao2_iterator_init(lot->parked_users, AO2_ITERATOR_DONTLOCK);
+	for (; (user = ao2_iterator_next(&iter)); ao2_ref(user, -1)) {
+		int idx = user->parking_space - start;
+
+		if (user->parking_space >= start && user->parking_space <= stop) {
+			spaces[idx / SPACES_PER_WORD] |= UINT64_C(1) << (idx % SPACES_PER_WORD);
+		}
+	}
+	ao2_iterator_destroy(&iter);
+
+	ast_free(lot->spaces_in_use);
+	lot->spaces_in_use = spaces;
+	lot->spaces_start = start;
+	lot->spaces_stop = stop;
+	ao2_unlock(lot->parked_users);
+
+	return 0;
 }
 
-int parking_lot_get_space(struct parking_lot *lot, int target_override)
+/*!
+ * \internal
+ * \brief Mark a parking space as occupied or free in the lot's space map.
+ *
+ * \note The parked_users container must be write locked.
+ */
+static void parking_lot_space_set(struct parking_lot *lot, int space, int in_use)
 {
-	int original_target;
-	int current_target;
-	struct ao2_iterator i;
-	struct parked_user *user;
-	int wrap;
+	uint64_t *words = lot->spaces_in_use;
+	int idx = space - lot->spaces_start;
 
-	if (lot->cfg->parkfindnext) {
-		/* Use next_space if the lot already has next_space set; otherwise use lot start. */
-		original_target = lot->next_space ? lot->next_space : lot->cfg->parking_start;
-	} else {
-		original_target = lot->cfg->parking_start;
+	if (!words || space < lot->spaces_start || space > lot->spaces_stop) {
+		return;
 	}
 
-	if (target_override >= lot->cfg->parking_start && target_override <= lot->cfg->parking_stop) {
-		original_target = target_override;
+	if (in_use) {
+		words[idx / SPACES_PER_WORD] |= UINT64_C(1) << (idx % SPACES_PER_WORD);
+	} else {
+		words[idx / SPACES_PER_WORD] &= ~(UINT64_C(1) << (idx % SPACES_PER_WORD));
 	}
+}
 
-	current_target = original_target;
+/*!
+ * \internal
+ * \brief Find the first free parking space from start to stop.
+ *
+ * \note The parked_users container must be locked.
+ *
+ * \retval -1 if every space in the range is occupied
+ * \retval the free parking space
+ */
+static int parking_lot_space_find_free(struct parking_lot *lot, int start, int stop)
+{
+	uint64_t *words = lot->spaces_in_use;
+	int idx;
+	int last;
+	uint64_t free_bits;
 
-	wrap = lot->cfg->parking_start;
+	if (!words) {
+		return -1;
+	}
+	start = MAX(start, lot->spaces_start);
+	stop = MIN(stop, lot->spaces_stop);
+	if (start > stop) {
+		return -1;
+	}
 
-	i = ao2_iterator_init(lot->parked_users, 0);
-	while ((user = ao2_iterator_next(&i))) {
-		/* Increment the wrap on each pass until we find an empty space */
-		if (wrap == user->parking_space) {
-			wrap += 1;
+	idx = start - lot->spaces_start;
+	last = stop - lot->spaces_start;
+	while (idx <= last) {
+		/* Spaces past the end of the map are never marked so they look free. */
+		free_bits = ~words[idx / SPACES_PER_WORD] >> (idx % SPACES_PER_WORD);
+		if (free_bits) {
+			idx += __builtin_ctzll(free_bits);
+			return idx <= last ? idx + lot->spaces_start : -1;
 		}
+		idx = (idx / SPACES_PER_WORD + 1) * SPACES_PER_WORD;
+	}
 
-		if (user->parking_space < current_target) {
-			/* It's lower than the anticipated target, so we haven't reached the target yet. */
-			ao2_ref(user, -1);
-			continue;
-		}
+	return -1;
+}
 
-		if (user->parking_space > current_target) {
-			/* The current target is usable because all items below have been read and the next target is higher than the one we want. */
-			ao2_ref(user, -1);
-			break;
-		}
+int parking_lot_link_parked_user(struct parking_lot *lot, struct parked_user *user)
+{
+	int res;
 
-		/* We found one already parked here. */
-		current_target += 1;
-		ao2_ref(user, -1);
+	ao2_wrlock(lot->parked_users);
+	res = ao2_link_flags(lot->parked_users, user, OBJ_NOLOCK) ? 0 : -1;
+	if (!res) {
+		parking_lot_space_set(lot, user->parking_space, 1);
 	}
-	ao2_iterator_destroy(&i);
+	ao2_unlock(lot->parked_users);
+
+	return res;
+}
 
-	if (current_target <= lot->cfg->parking_stop) {
-		return current_target;
+void parking_lot_unlink_parked_user(struct parking_lot *lot, struct parked_user *user)
+{
+	struct parked_user *found;
+
+	ao2_wrlock(lot->parked_users);
+	found = ao2_find(lot->parked_users, user, OBJ_SEARCH_OBJECT | OBJ_NOLOCK);
+	if (found == user) {
+		/* Only free the space if it was still this user's. */
+		ao2_unlink_flags(lot->parked_users, user, OBJ_NOLOCK);
+		parking_lot_space_set(lot, user->parking_space, 0);
 	}
+	ao2_unlock(lot->parked_users);
+	ao2_cleanup(found);
+}
 
-	if (wrap <= lot->cfg->parking_stop) {
-		return wrap;
+int unpark_parked_user(struct parked_user *pu)
+{
+	if (pu->lot) {
+		parking_lot_unlink_parked_user(pu->lot, pu);
+		parking_lot_remove_if_unused(pu->lot);
+		return 0;
 	}
 
 	return -1;
 }
 
-static int retrieve_parked_user_targeted(void *obj, void *arg, int flags)
+int parking_lot_get_space(struct parking_lot *lot, int target_override)
 {
-	int *target = arg;
-	struct parked_user *user = obj;
-	if (user->parking_space == *target) {
-		return CMP_MATCH;
+	int original_target;
+	int space;
+
+	if (lot->cfg->parkfindnext) {
+		/* Use next_space if the lot already has next_space set; otherwise use lot start. */
+		original_target = lot->next_space ? lot->next_space : lot->cfg->parking_start;
+	} else {
+		original_target = lot->cfg->parking_start;
 	}
 
-	return 0;
+	if (target_override >= lot->cfg->parking_start && target_override <= lot->cfg->parking_stop) {
+		original_target = target_override;
+	}
+
+	ao2_rdlock(lot->parked_users);
+	space = parking_lot_space_find_free(lot, original_target, lot->cfg->parking_stop);
+	if (space == -1) {
+		/* Wrap around to the start of the lot. */
+		space = parking_lot_space_find_free(lot, lot->cfg->parking_start, lot->cfg->parking_stop);
+	}
+	ao2_unlock(lot->parked_users);
+
+	return space;
 }
 
 struct parked_user *parking_lot_inspect_parked_user(struct parking_lot *lot, int target)
@@ -170,7 +258,7 @@ struct parked_user *parking_lot_inspect_parked_user(struct parking_lot *lot, int
 	if (target < 0) {
 		user = ao2_callback(lot->parked_users, 0, NULL, NULL);
 	} else {
-		user = ao2_callback(lot->parked_users, 0, retrieve_parked_user_targeted, &target);
+		user = ao2_find(lot->parked_users, &target, OBJ_SEARCH_KEY);
 	}
 
 	if (!user) {
@@ -187,7 +275,7 @@ struct parked_user *parking_lot_retrieve_parked_user(struct parking_lot *lot, in
 	if (target < 0) {
 		user = ao2_callback(lot->parked_users, 0, NULL, NULL);
 	} else {
-		user = ao2_callback(lot->parked_users, 0, retrieve_parked_user_targeted, &target);
+		user = ao2_find(lot->parked_users, &target, OBJ_SEARCH_KEY);
 	}
 
 	if (!user) {
@@ -201,7 +289,7 @@ struct parked_user *parking_lot_retrieve_parked_user(struct parking_lot *lot, in
 		return NULL;
 	}
 
-	ao2_unlink(lot->parked_users, user);
+	parking_lot_unlink_parked_user(lot, user);
 	user->resolution = PARK_ANSWERED;
 	ao2_unlock(user);
 
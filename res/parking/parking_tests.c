@@ -832,6 +832,123 @@ cleanup:
 	return failed ? AST_TEST_FAIL : AST_TEST_PASS;
 }
 
+/*! \brief Occupy parking spaces start to stop of a test lot with placeholder users */
+static int occupy_test_spaces(struct parking_lot *lot, struct parked_user **users, int start, int stop)
+{
+	int space;
+
+	for (space = start; space <= stop; ++space) {
+		struct parked_user **user = &users[space - lot->cfg->parking_start];
+
+		*user = ao2_alloc(sizeof(**user), NULL);
+		if (!*user) {
+			return -1;
+		}
+		(*user)->parking_space = space;
+		if (parking_lot_link_parked_user(lot, *user)) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*! \brief Free parking spaces start to stop of a test lot */
+static void vacate_test_spaces(struct parking_lot *lot, struct parked_user **users, int start, int stop)
+{
+	int space;
+
+	for (space = start; space <= stop; ++space) {
+		struct parked_user **user = &users[space - lot->cfg->parking_start];
+
+		if (*user) {
+			parking_lot_unlink_parked_user(lot, *user);
+			ao2_ref(*user, -1);
+			*user = NULL;
+		}
+	}
+}
+
+#define TEST_SPACE(target, expected) \
+	do { \
+		int space = parking_lot_get_space(test_lot, (target)); \
+		if (space != (expected)) { \
+			ast_test_status_update(test, "Looking for a space from %d gave %d, expected %d.\n", \
+				(target), space, (expected)); \
+			res = AST_TEST_FAIL; \
+		} \
+	} while (0)
+
+AST_TEST_DEFINE(find_space)
+{
+	RAII_VAR(struct parking_lot *, test_lot, NULL, ao2_cleanup);
+	struct parked_user *users[100] = { NULL, };
+	enum ast_test_result_state res = AST_TEST_PASS;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "find_space";
+		info->category = TEST_CATEGORY;
+		info->summary = "Parking space selection";
+		info->description =
+			"Occupies spaces of a parking lot and checks which space a new call would be parked in.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	test_lot = generate_test_parking_lot(TEST_LOT_NAME, 701, 800, NULL, "unit_test_res_parking_create_lot_con", test);
+	if (!test_lot) {
+		ast_test_status_update(test, "Failed to create test parking lot. Test Failed.\n");
+		return AST_TEST_FAIL;
+	}
+
+	TEST_SPACE(-1, 701);
+	TEST_SPACE(750, 750);
+
+	/* Occupy spaces across the first word of the map of spaces. */
+	if (occupy_test_spaces(test_lot, users, 701, 770)) {
+		ast_test_status_update(test, "Failed to occupy parking spaces. Test Failed.\n");
+		res = AST_TEST_FAIL;
+		goto cleanup;
+	}
+	TEST_SPACE(-1, 771);
+	TEST_SPACE(720, 771);
+	TEST_SPACE(780, 780);
+
+	vacate_test_spaces(test_lot, users, 710, 710);
+	TEST_SPACE(-1, 710);
+
+	/* Wrap around to the start of the lot. */
+	test_lot->next_space = 790;
+	if (occupy_test_spaces(test_lot, users, 790, 800)) {
+		ast_test_status_update(test, "Failed to occupy parking spaces. Test Failed.\n");
+		res = AST_TEST_FAIL;
+		goto cleanup;
+	}
+	TEST_SPACE(-1, 710);
+
+	if (occupy_test_spaces(test_lot, users, 710, 710)
+		|| occupy_test_spaces(test_lot, users, 771, 789)) {
+		ast_test_status_update(test, "Failed to occupy parking spaces. Test Failed.\n");
+		res = AST_TEST_FAIL;
+		goto cleanup;
+	}
+	TEST_SPACE(-1, -1);
+
+cleanup:
+	vacate_test_spaces(test_lot, users, 701, 800);
+
+	if (dispose_test_lot(test_lot, 1)) {
+		ast_test_status_update(test, "Found parking lot in container after attempted removal. Test failed.\n");
+		return AST_TEST_FAIL;
+	}
+
+	return res;
+}
+
+#undef TEST_SPACE
+
 #endif /* TEST_FRAMEWORK */
 
 
@@ -845,6 +962,7 @@ void unload_parking_tests(void)
 	AST_TEST_UNREGISTER(park_extensions);
 	AST_TEST_UNREGISTER(extension_conflicts);
 	AST_TEST_UNREGISTER(dynamic_parking_variables);
+	AST_TEST_UNREGISTER(find_space);
 #endif
 }
 
@@ -860,6 +978,7 @@ int load_parking_tests(void)
 	res |= AST_TEST_REGISTER(park_extensions);
 	res |= AST_TEST_REGISTER(extension_conflicts);
 	res |= AST_TEST_REGISTER(dynamic_parking_variables);
+	res |= AST_TEST_REGISTER(find_space);
 #endif
 
 	return res;
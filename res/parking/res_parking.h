@@ -89,7 +89,10 @@ struct parking_lot_cfg {
 struct parking_lot {
 	int next_space;                           /*!< When using parkfindnext, which space we should start searching from next time we park */
 	struct ast_bridge *parking_bridge;        /*!< Bridged where parked calls will rest until they are answered or otherwise leave */
-	struct ao2_container *parked_users;       /*!< List of parked users rigidly ordered by their parking space */
+	struct ao2_container *parked_users;       /*!< Tree of parked users rigidly ordered by their parking space */
+	uint64_t *spaces_in_use;                  /*!< Bitmap of the occupied spaces from spaces_start. Protected by the parked_users lock */
+	int spaces_start;                         /*!< First parking space covered by spaces_in_use */
+	int spaces_stop;                          /*!< Last parking space covered by spaces_in_use */
 	struct parking_lot_cfg *cfg;              /*!< Reference to configuration object for the parking lot */
 	enum parking_lot_modes mode;              /*!< Whether a parking lot is operational, being reconfigured, primed for deletion, or dynamically created. */
 	int disable_mark;                         /*!< On reload, disable this parking lot if it doesn't receive a new configuration. */
@@ -195,6 +198,42 @@ struct ast_bridge *parking_lot_get_bridge(struct parking_lot *lot);
  */
 int parking_lot_get_space(struct parking_lot *lot, int target_override);
 
+/*!
+ * \since 17.0.0
+ * \brief Size the map of occupied parking spaces to the lot's configured range.
+ *
+ * \param lot Which parking lot to update
+ *
+ * \retval 0 on success
+ * \retval -1 on failure
+ *
+ * \note Call whenever the parking lot receives a configuration.
+ */
+int parking_lot_spaces_update(struct parking_lot *lot);
+
+/*!
+ * \since 17.0.0
+ * \brief Add a parked user to a parking lot and mark its space as occupied.
+ *
+ * \param lot Which parking lot the user is parked in
+ * \param user The parked user, with its parking space set
+ *
+ * \retval 0 on success
+ * \retval -1 on failure
+ *
+ * \note lot should be locked as for parking_lot_get_space.
+ */
+int parking_lot_link_parked_user(struct parking_lot *lot, struct parked_user *user);
+
+/*!
+ * \since 17.0.0
+ * \brief Remove a parked user from a parking lot and free its space.
+ *
+ * \param lot Which parking lot the user is parked in
+ * \param user The parked user, which need not still be in the lot
+ */
+void parking_lot_unlink_parked_user(struct parking_lot *lot, struct parked_user *user);
+
 /*!
  * \brief Determine if there is a parked user in a parking space and return it if there is.
  *
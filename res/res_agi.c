@@ -2049,6 +2049,7 @@ static enum agi_result launch_netscript(char *agiurl, char *argv[], int *fds)
 	int s = 0;
 	char *host, *script;
 	int num_addrs = 0, i = 0;
+	int nodelay = 1;
 	struct ast_sockaddr *addrs;
 
 	/* agiurl is "agi://host.domain[:port][/script/name]" */
@@ -2098,6 +2099,13 @@ static enum agi_result launch_netscript(char *agiurl, char *argv[], int *fds)
 		return AGI_RESULT_FAILURE;
 	}
 
+	/* The environment and every command response go out as small separate
+	 * writes.  With Nagle's algorithm enabled those get held back waiting for
+	 * the server's delayed ACK, adding tens of milliseconds per exchange. */
+	if (setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (char *) &nodelay, sizeof(nodelay)) < 0) {
+		ast_log(LOG_WARNING, "Failed to set TCP_NODELAY on FastAGI connection: %s\n", strerror(errno));
+	}
+
 	if (ast_agi_send(s, NULL, "agi_network: yes\n") < 0) {
 		if (errno != EINTR) {
 			ast_log(LOG_WARNING, "Connect to '%s' failed: %s\n", agiurl, strerror(errno));
@@ -4103,6 +4111,90 @@ static enum agi_result agi_handle_command(struct ast_channel *chan, AGI *agi, ch
 	return AGI_RESULT_SUCCESS;
 }
 
+/*!
+ * \brief Buffer for command lines read from an AGI script
+ *
+ * Reading through our own buffer rather than stdio lets us see when the
+ * script has already sent its next command, so pipelined commands get
+ * handled straight away instead of waiting for the descriptor to become
+ * readable again.
+ */
+struct agi_cmd_buf {
+	/*! Number of bytes in data */
+	size_t len;
+	/*! Set once the script has closed its end */
+	unsigned int eof:1;
+	char data[AGI_BUF_LEN - 1];
+};
+
+/*! \brief Is a complete line (or the end of input) waiting in the buffer? */
+static int agi_cmd_buf_ready(const struct agi_cmd_buf *cmds)
+{
+	return cmds->eof || memchr(cmds->data, '\n', cmds->len);
+}
+
+/*!
+ * \internal
+ * \brief Get the next command line sent by an AGI script
+ *
+ * \param cmds The command buffer
+ * \param fd Descriptor to read more data from if no complete line is buffered
+ * \param[out] line Receives the line, including its newline if it had one
+ * \param size Size of line
+ *
+ * \retval 1 a line was copied to \a line
+ * \retval 0 only part of a line has arrived so far
+ * \retval -1 the script closed its end and nothing is left
+ */
+static int agi_cmd_buf_next(struct agi_cmd_buf *cmds, int fd, char *line, size_t size)
+{
+	char *nl;
+	size_t line_len;
+	ssize_t res;
+
+	for (;;) {
+		nl = memchr(cmds->data, '\n', cmds->len);
+		if (nl) {
+			line_len = nl - cmds->data + 1;
+			break;
+		}
+		if (cmds->len == sizeof(cmds->data) || (cmds->eof && cmds->len)) {
+			/* Overlong line or a final line without a newline, hand over what we have */
+			line_len = cmds->len;
+			break;
+		}
+		if (cmds->eof) {
+			return -1;
+		}
+
+		res = read(fd, cmds->data + cmds->len, sizeof(cmds->data) - cmds->len);
+		if (res < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				return 0;
+			}
+			cmds->eof = 1;
+		} else if (!res) {
+			cmds->eof = 1;
+		} else {
+			cmds->len += res;
+		}
+	}
+
+	if (line_len >= size) {
+		line_len = size - 1;
+	}
+	memcpy(line, cmds->data, line_len);
+	line[line_len] = '\0';
+
+	cmds->len -= line_len;
+	memmove(cmds->data, cmds->data + line_len, cmds->len);
+
+	return 1;
+}
+
 static enum agi_result run_agi(struct ast_channel *chan, char *request, AGI *agi, int pid, int *status, int dead, int argc, char *argv[])
 {
 	struct ast_channel *c;
@@ -4112,8 +4204,7 @@ static enum agi_result run_agi(struct ast_channel *chan, char *request, AGI *agi
 	enum agi_result returnstatus = AGI_RESULT_SUCCESS;
 	struct ast_frame *f;
 	char buf[AGI_BUF_LEN];
-	char *res = NULL;
-	FILE *readf;
+	struct agi_cmd_buf cmds = { .len = 0, };
 	/* how many times we'll retry if ast_waitfor_nandfs will return without either
 	  channel or file descriptor in case select is interrupted by a system call (EINTR) */
 	int retry = AGI_NANDFS_RETRY;
@@ -4131,15 +4222,6 @@ static enum agi_result run_agi(struct ast_channel *chan, char *request, AGI *agi
 	exit_on_hangup = ast_true(exit_on_hangup_str);
 	ast_channel_unlock(chan);
 
-	if (!(readf = fdopen(agi->ctrl, "r"))) {
-		ast_log(LOG_WARNING, "Unable to fdopen file descriptor\n");
-		if (send_sighup && pid > -1)
-			kill(pid, SIGHUP);
-		close(agi->ctrl);
-		return AGI_RESULT_FAILURE;
-	}
-
-	setlinebuf(readf);
 	setup_env(chan, request, agi->fd, (agi->audio > -1), argc, argv);
 	for (;;) {
 		if (needhup) {
@@ -4157,7 +4239,11 @@ static enum agi_result run_agi(struct ast_channel *chan, char *request, AGI *agi
 			}
 		}
 		ms = -1;
-		if (dead || in_intercept) {
+		if (agi_cmd_buf_ready(&cmds)) {
+			/* The script has already sent its next command */
+			c = NULL;
+			outfd = agi->ctrl;
+		} else if (dead || in_intercept) {
 			c = ast_waitfor_nandfds(&chan, 0, &agi->ctrl, 1, NULL, &outfd, &ms);
 		} else if (!ast_check_hangup(chan)) {
 			c = ast_waitfor_nandfds(&chan, 1, &agi->ctrl, 1, NULL, &outfd, &ms);
@@ -4188,27 +4274,18 @@ static enum agi_result run_agi(struct ast_channel *chan, char *request, AGI *agi
 				ast_frfree(f);
 			}
 		} else if (outfd > -1) {
-			size_t len = sizeof(buf);
-			size_t buflen = 0;
+			size_t buflen;
 			enum agi_result cmd_status;
+			int got;
 
 			retry = AGI_NANDFS_RETRY;
 			buf[0] = '\0';
 
-			while (len > 1) {
-				res = fgets(buf + buflen, len, readf);
-				if (feof(readf))
-					break;
-				if (ferror(readf) && ((errno != EINTR) && (errno != EAGAIN)))
-					break;
-				if (res != NULL && !agi->fast)
-					break;
-				buflen = strlen(buf);
-				if (buflen && buf[buflen - 1] == '\n')
-					break;
-				len = sizeof(buf) - buflen;
+			got = agi_cmd_buf_next(&cmds, agi->ctrl, buf, sizeof(buf));
+			if (!got) {
 				if (agidebug)
-					ast_verbose("AGI Rx << temp buffer %s - errno %s\nNo \\n received, checking again.\n", buf, strerror(errno));
+					ast_verbose("AGI Rx << partial command, waiting for the rest.\n");
+				continue;
 			}
 
 			if (!buf[0]) {
@@ -4271,7 +4348,7 @@ static enum agi_result run_agi(struct ast_channel *chan, char *request, AGI *agi
 			ast_agi_send(agi->fd, chan, "HANGUP\n");
 		}
 	}
-	fclose(readf);
+	close(agi->ctrl);
 	return returnstatus;
 }
 
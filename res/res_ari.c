@@ -104,6 +104,28 @@
 						Value is in milliseconds; default is 100 ms.</para>
 					</description>
 				</configOption>
+				<configOption name="websocket_queue_limit">
+					<synopsis>The most bytes of events a WebSocket connection may have waiting to be written.</synopsis>
+					<description>
+						<para>Events are queued for each WebSocket connection and written
+						by the connection's own thread, several at a time, so a slow client
+						does not hold up event delivery to others. When a connection's queue
+						reaches this size, <literal>websocket_overflow</literal> decides what
+						happens to further events. Default is 1048576 bytes.</para>
+					</description>
+				</configOption>
+				<configOption name="websocket_overflow" default="block">
+					<synopsis>What to do with events for a WebSocket connection whose queue is full.</synopsis>
+					<description>
+						<enumlist>
+							<enum name="block"><para>Wait for the queue to drain, for up to
+							<literal>websocket_write_timeout</literal>, then disconnect.</para></enum>
+							<enum name="drop_oldest"><para>Throw away the oldest queued events
+							to make room.</para></enum>
+							<enum name="disconnect"><para>Disconnect at once.</para></enum>
+						</enumlist>
+					</description>
+				</configOption>
 				<configOption name="pretty">
 					<synopsis>Responses from ARI are formatted to be human readable</synopsis>
 				</configOption>
@@ -150,6 +172,7 @@
 #include "asterisk/module.h"
 #include "asterisk/paths.h"
 #include "asterisk/stasis_app.h"
+#include "asterisk/threadstorage.h"
 
 #include <string.h>
 #include <sys/stat.h>
@@ -162,11 +185,25 @@ static int is_enabled(void)
 	return cfg && cfg->general && cfg->general->enabled;
 }
 
-/*! Lock for \ref root_handler */
+/*! Serializes changes to \ref root_handler */
 static ast_mutex_t root_handler_lock;
 
-/*! Handler for root RESTful resource. */
-static struct stasis_rest_handlers *root_handler;
+/*!
+ * \brief Handler for root RESTful resource.
+ *
+ * The handler tree is never modified once published.  Adding or removing
+ * a resource publishes a new root, so requests only hold a read lock long
+ * enough to get a reference to the current one.
+ */
+static AO2_GLOBAL_OBJ_STATIC(root_handler);
+
+/*!
+ * \brief Whether the user of the request this thread is handling may make changes.
+ *
+ * WebSocket sessions are established while handling the request that
+ * upgraded to them, and inherit the permissions of its user.
+ */
+AST_THREADSTORAGE(request_write_allowed);
 
 /*! Pre-defined message for allocation failures. */
 static struct ast_json *oom_json;
@@ -178,68 +215,69 @@ struct ast_json *ast_ari_oom_json(void)
 
 int ast_ari_add_handler(struct stasis_rest_handlers *handler)
 {
-	RAII_VAR(struct stasis_rest_handlers *, new_handler, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_rest_handlers *, old_handler, NULL, ao2_cleanup);
+	struct stasis_rest_handlers *new_handler;
 	size_t old_size, new_size;
 
 	SCOPED_MUTEX(lock, &root_handler_lock);
 
-	old_size = sizeof(*new_handler) + root_handler->num_children * sizeof(handler);
+	old_handler = ao2_global_obj_ref(root_handler);
+	ast_assert(old_handler != NULL);
+
+	old_size = sizeof(*new_handler) + old_handler->num_children * sizeof(handler);
 	new_size = old_size + sizeof(handler);
 
 	new_handler = ao2_alloc(new_size, NULL);
 	if (!new_handler) {
 		return -1;
 	}
-	memcpy(new_handler, root_handler, old_size);
+	memcpy(new_handler, old_handler, old_size);
 	new_handler->children[new_handler->num_children++] = handler;
 
-	ao2_cleanup(root_handler);
-	ao2_ref(new_handler, +1);
-	root_handler = new_handler;
+	ao2_global_obj_replace_unref(root_handler, new_handler);
+	ao2_ref(new_handler, -1);
 	return 0;
 }
 
 int ast_ari_remove_handler(struct stasis_rest_handlers *handler)
 {
+	RAII_VAR(struct stasis_rest_handlers *, old_handler, NULL, ao2_cleanup);
 	struct stasis_rest_handlers *new_handler;
 	size_t size;
 	size_t i;
 	size_t j;
 
-	ast_assert(root_handler != NULL);
+	SCOPED_MUTEX(lock, &root_handler_lock);
 
-	ast_mutex_lock(&root_handler_lock);
-	size = sizeof(*new_handler) + root_handler->num_children * sizeof(handler);
+	old_handler = ao2_global_obj_ref(root_handler);
+	ast_assert(old_handler != NULL);
+
+	size = sizeof(*new_handler) + old_handler->num_children * sizeof(handler);
 
 	new_handler = ao2_alloc(size, NULL);
 	if (!new_handler) {
-		ast_mutex_unlock(&root_handler_lock);
 		return -1;
 	}
 
 	/* Create replacement root_handler less the handler to remove. */
-	memcpy(new_handler, root_handler, sizeof(*new_handler));
-	for (i = 0, j = 0; i < root_handler->num_children; ++i) {
-		if (root_handler->children[i] == handler) {
+	memcpy(new_handler, old_handler, sizeof(*new_handler));
+	for (i = 0, j = 0; i < old_handler->num_children; ++i) {
+		if (old_handler->children[i] == handler) {
 			continue;
 		}
-		new_handler->children[j++] = root_handler->children[i];
+		new_handler->children[j++] = old_handler->children[i];
 	}
 	new_handler->num_children = j;
 
 	/* Replace the old root_handler with the new. */
-	ao2_cleanup(root_handler);
-	root_handler = new_handler;
-
-	ast_mutex_unlock(&root_handler_lock);
+	ao2_global_obj_replace_unref(root_handler, new_handler);
+	ao2_ref(new_handler, -1);
 	return 0;
 }
 
 static struct stasis_rest_handlers *get_root_handler(void)
 {
-	SCOPED_MUTEX(lock, &root_handler_lock);
-	ao2_ref(root_handler, +1);
-	return root_handler;
+	return ao2_global_obj_ref(root_handler);
 }
 
 static struct stasis_rest_handlers *root_handler_create(void)
@@ -281,6 +319,19 @@ void ast_ari_response_ok(struct ast_ari_response *response,
 	response->response_text = "OK";
 }
 
+void ast_ari_response_ok_encoded(struct ast_ari_response *response,
+	struct ast_str *encoded)
+{
+	if (!encoded) {
+		ast_ari_response_alloc_failed(response);
+		return;
+	}
+
+	response->encoded = encoded;
+	response->response_code = 200;
+	response->response_text = "OK";
+}
+
 void ast_ari_response_no_content(struct ast_ari_response *response)
 {
 	response->message = ast_json_null();
@@ -552,7 +603,7 @@ void ast_ari_invoke(struct ast_tcptls_session_instance *ser,
 		return;
 	}
 
-	if (handler->ws_server && method == AST_HTTP_GET) {
+	if (handler->ws_server && method == AST_HTTP_GET && ser) {
 		/* WebSocket! */
 		ari_handle_websocket(handler->ws_server, ser, uri, method,
 			get_params, headers);
@@ -572,7 +623,8 @@ void ast_ari_invoke(struct ast_tcptls_session_instance *ser,
 	}
 
 	callback(ser, get_params, path_vars, headers, body, response);
-	if (response->message == NULL && response->response_code == 0) {
+	if (response->message == NULL && response->encoded == NULL
+		&& response->response_code == 0) {
 		/* Really should not happen */
 		ast_log(LOG_ERROR, "ARI %s %s not implemented\n",
 			ast_get_http_method(method), uri);
@@ -582,6 +634,110 @@ void ast_ari_invoke(struct ast_tcptls_session_instance *ser,
 	}
 }
 
+int ari_request_write_allowed(void)
+{
+	int *write_allowed = ast_threadstorage_get(&request_write_allowed, sizeof(*write_allowed));
+
+	return write_allowed && *write_allowed;
+}
+
+/*!
+ * \internal
+ * \brief Convert the query of a websocket REST request to query parameters
+ *
+ * \retval 0 on success.
+ * \retval -1 if a value is not a string or on allocation failure.
+ */
+static int websocket_rest_query(struct ast_json *query, struct ast_variable **get_params)
+{
+	struct ast_json_iter *iter;
+
+	for (iter = ast_json_object_iter(query); iter; iter = ast_json_object_iter_next(query, iter)) {
+		const char *value = ast_json_string_get(ast_json_object_iter_value(iter));
+		struct ast_variable *var;
+
+		if (!value) {
+			return -1;
+		}
+		var = ast_variable_new(ast_json_object_iter_key(iter), value, "");
+		if (!var) {
+			return -1;
+		}
+		var->next = *get_params;
+		*get_params = var;
+	}
+
+	return 0;
+}
+
+struct ast_json *ari_websocket_rest_request(struct ast_json *request, int write_allowed)
+{
+	struct ast_ari_response response = { .fd = -1, 0 };
+	RAII_VAR(struct ast_variable *, get_params, NULL, ast_variables_destroy);
+	const char *method_name = ast_json_string_get(ast_json_object_get(request, "method"));
+	const char *uri = ast_json_string_get(ast_json_object_get(request, "uri"));
+	struct ast_json *query = ast_json_object_get(request, "query");
+	struct ast_json *body = ast_json_object_get(request, "body");
+	struct ast_json *request_id = ast_json_object_get(request, "request_id");
+	enum ast_http_method method = AST_HTTP_UNKNOWN;
+	struct ast_json *message;
+	struct ast_json *reply;
+	int idx;
+
+	response.headers = ast_str_create(40);
+	if (!response.headers) {
+		return NULL;
+	}
+
+	for (idx = 0; method_name && idx < AST_HTTP_MAX_METHOD; ++idx) {
+		if (!strcasecmp(ast_get_http_method(idx), method_name)) {
+			method = idx;
+			break;
+		}
+	}
+
+	if (method == AST_HTTP_UNKNOWN || ast_strlen_zero(uri)) {
+		ast_ari_response_error(&response, 400, "Bad Request",
+			"REST requests need a method and a uri");
+	} else if (query && (ast_json_typeof(query) != AST_JSON_OBJECT
+		|| websocket_rest_query(query, &get_params))) {
+		ast_ari_response_error(&response, 400, "Bad Request",
+			"The query must be an object of strings");
+	} else if (!write_allowed && method != AST_HTTP_GET && method != AST_HTTP_OPTIONS) {
+		ast_ari_response_error(&response, 403, "Forbidden", "Write access denied");
+	} else {
+		ast_ari_invoke(NULL, uri[0] == '/' ? uri + 1 : uri, method, get_params, NULL,
+			body ?: ast_json_null(), &response);
+	}
+
+	if (response.fd >= 0) {
+		/* File responses cannot be carried in a message */
+		close(response.fd);
+	}
+
+	if (response.message) {
+		message = ast_json_ref(response.message);
+	} else if (response.encoded) {
+		message = ast_json_load_str(response.encoded, NULL);
+	} else {
+		message = ast_json_null();
+	}
+
+	reply = ast_json_pack("{s: s, s: i, s: s, s: o}",
+		"type", "RESTResponse",
+		"status_code", response.response_code,
+		"reason_phrase", S_OR(response.response_text, ""),
+		"message_body", message ?: ast_json_null());
+	if (reply && request_id) {
+		ast_json_object_set(reply, "request_id", ast_json_ref(request_id));
+	}
+
+	ast_json_unref(response.message);
+	ast_free(response.encoded);
+	ast_free(response.headers);
+	return reply;
+}
+
 void ast_ari_get_docs(const char *uri, const char *prefix, struct ast_variable *headers,
 			  struct ast_ari_response *response)
 {
@@ -1041,9 +1197,17 @@ static int ast_ari_callback(struct ast_tcptls_session_instance *ser,
 			ast_ari_get_docs(strchr(uri, '/') + 1, urih->prefix, headers, &response);
 		}
 	} else {
+		int *write_allowed = ast_threadstorage_get(&request_write_allowed, sizeof(*write_allowed));
+
 		/* Other RESTful resources */
+		if (write_allowed) {
+			*write_allowed = !user->read_only;
+		}
 		ast_ari_invoke(ser, uri, method, get_params, headers, body,
 			&response);
+		if (write_allowed) {
+			*write_allowed = 0;
+		}
 	}
 
 	if (response.no_response) {
@@ -1058,13 +1222,19 @@ request_failed:
 	/* If you explicitly want to have no content, set message to
 	 * ast_json_null().
 	 */
-	ast_assert(response.message != NULL);
+	ast_assert(response.message != NULL || response.encoded != NULL);
 	ast_assert(response.response_code > 0);
 
 	/* response.message could be NULL, in which case the empty response_body
 	 * is correct
 	 */
-	if (response.message && !ast_json_is_null(response.message)) {
+	if (!response.message && response.encoded) {
+		ast_str_append(&response.headers, 0,
+			       "Content-type: application/json\r\n");
+		ast_free(response_body);
+		response_body = response.encoded;
+		response.encoded = NULL;
+	} else if (response.message && !ast_json_is_null(response.message)) {
 		ast_str_append(&response.headers, 0,
 			       "Content-type: application/json\r\n");
 		if (ast_json_dump_str_format(response.message, &response_body,
@@ -1091,6 +1261,7 @@ request_failed:
 	response_body = NULL;
 
 	ast_json_unref(response.message);
+	ast_free(response.encoded);
 	if (response.fd >= 0) {
 		close(response.fd);
 	}
@@ -1117,9 +1288,9 @@ static int unload_module(void)
 	}
 
 	ast_ari_config_destroy();
+	ari_websocket_cleanup();
 
-	ao2_cleanup(root_handler);
-	root_handler = NULL;
+	ao2_global_obj_release(root_handler);
 	ast_mutex_destroy(&root_handler_lock);
 
 	ast_json_unref(oom_json);
@@ -1130,15 +1301,20 @@ static int unload_module(void)
 
 static int load_module(void)
 {
+	struct stasis_rest_handlers *handler;
+
 	ast_mutex_init(&root_handler_lock);
 
 	/* root_handler may have been built during a declined load */
-	if (!root_handler) {
-		root_handler = root_handler_create();
-	}
-	if (!root_handler) {
-		return AST_MODULE_LOAD_DECLINE;
+	handler = ao2_global_obj_ref(root_handler);
+	if (!handler) {
+		handler = root_handler_create();
+		if (!handler) {
+			return AST_MODULE_LOAD_DECLINE;
+		}
+		ao2_global_obj_replace_unref(root_handler, handler);
 	}
+	ao2_ref(handler, -1);
 
 	/* oom_json may have been built during a declined load */
 	if (!oom_json) {
@@ -1156,6 +1332,11 @@ static int load_module(void)
 		return AST_MODULE_LOAD_DECLINE;
 	}
 
+	if (ari_websocket_init() != 0) {
+		unload_module();
+		return AST_MODULE_LOAD_DECLINE;
+	}
+
 	if (is_enabled()) {
 		ast_debug(3, "ARI enabled\n");
 		ast_http_uri_link(&http_uri);
@@ -96,7 +96,9 @@ static void ast_ari_asterisk_get_object_cb(
 		break;
 	default:
 		if (200 <= code && code <= 299) {
-			is_valid = ast_ari_validate_list(response->message,
+			/* An encoded list is never held as JSON to validate */
+			is_valid = response->encoded
+				|| ast_ari_validate_list(response->message,
 				ast_ari_validate_config_tuple_fn());
 		} else {
 			ast_log(LOG_ERROR, "Invalid error response %d for /asterisk/config/dynamic/{configClass}/{objectType}/{id}\n", code);
@@ -171,7 +173,9 @@ static void ast_ari_asterisk_update_object_cb(
 		break;
 	default:
 		if (200 <= code && code <= 299) {
-			is_valid = ast_ari_validate_list(response->message,
+			/* An encoded list is never held as JSON to validate */
+			is_valid = response->encoded
+				|| ast_ari_validate_list(response->message,
 				ast_ari_validate_config_tuple_fn());
 		} else {
 			ast_log(LOG_ERROR, "Invalid error response %d for /asterisk/config/dynamic/{configClass}/{objectType}/{id}\n", code);
@@ -477,7 +481,9 @@ static void ast_ari_asterisk_list_modules_cb(
 		break;
 	default:
 		if (200 <= code && code <= 299) {
-			is_valid = ast_ari_validate_list(response->message,
+			/* An encoded list is never held as JSON to validate */
+			is_valid = response->encoded
+				|| ast_ari_validate_list(response->message,
 				ast_ari_validate_module_fn());
 		} else {
 			ast_log(LOG_ERROR, "Invalid error response %d for /asterisk/modules\n", code);
@@ -762,7 +768,9 @@ static void ast_ari_asterisk_list_log_channels_cb(
 		break;
 	default:
 		if (200 <= code && code <= 299) {
-			is_valid = ast_ari_validate_list(response->message,
+			/* An encoded list is never held as JSON to validate */
+			is_valid = response->encoded
+				|| ast_ari_validate_list(response->message,
 				ast_ari_validate_log_channel_fn());
 		} else {
 			ast_log(LOG_ERROR, "Invalid error response %d for /asterisk/logging\n", code);
@@ -83,7 +83,9 @@ static void ast_ari_device_states_list_cb(
 		break;
 	default:
 		if (200 <= code && code <= 299) {
-			is_valid = ast_ari_validate_list(response->message,
+			/* An encoded list is never held as JSON to validate */
+			is_valid = response->encoded
+				|| ast_ari_validate_list(response->message,
 				ast_ari_validate_device_state_fn());
 		} else {
 			ast_log(LOG_ERROR, "Invalid error response %d for /deviceStates\n", code);
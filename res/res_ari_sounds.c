@@ -113,7 +113,9 @@ static void ast_ari_sounds_list_cb(
 		break;
 	default:
 		if (200 <= code && code <= 299) {
-			is_valid = ast_ari_validate_list(response->message,
+			/* An encoded list is never held as JSON to validate */
+			is_valid = response->encoded
+				|| ast_ari_validate_list(response->message,
 				ast_ari_validate_sound_fn());
 		} else {
 			ast_log(LOG_ERROR, "Invalid error response %d for /sounds\n", code);
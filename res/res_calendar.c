@@ -227,6 +227,12 @@ static ast_cond_t refresh_condition;
 static ast_mutex_t reloadlock;
 static int module_unloading;
 
+/*! Maximum number of calendars fetching from their servers at once, 0 for no limit */
+static int max_fetches;
+static int active_fetches;
+AST_MUTEX_DEFINE_STATIC(fetch_lock);
+static ast_cond_t fetch_cond;
+
 static void event_notification_destroy(void *data);
 static void *event_notification_duplicate(void *data);
 static void eventlist_destroy(void *data);
@@ -272,6 +278,68 @@ void ast_calendar_config_release(void)
 	ast_rwlock_unlock(&config_lock);
 }
 
+int ast_calendar_fetch_begin(struct ast_calendar *cal)
+{
+	ast_mutex_lock(&fetch_lock);
+	while (max_fetches > 0 && active_fetches >= max_fetches && !cal->unloading) {
+		struct timeval tv = ast_tvadd(ast_tvnow(), ast_tv(1, 0));
+		struct timespec ts = {
+			.tv_sec = tv.tv_sec,
+			.tv_nsec = tv.tv_usec * 1000,
+		};
+
+		/* Timed so that an unloading calendar does not wait on other fetches */
+		ast_cond_timedwait(&fetch_cond, &fetch_lock, &ts);
+	}
+	if (cal->unloading) {
+		ast_mutex_unlock(&fetch_lock);
+		return -1;
+	}
+	active_fetches++;
+	ast_mutex_unlock(&fetch_lock);
+
+	return 0;
+}
+
+void ast_calendar_fetch_end(void)
+{
+	ast_mutex_lock(&fetch_lock);
+	active_fetches--;
+	ast_cond_signal(&fetch_cond);
+	ast_mutex_unlock(&fetch_lock);
+}
+
+int ast_calendar_refresh_wait(struct ast_calendar *cal, int first)
+{
+	ast_mutex_t lock;
+	struct timespec ts = {0,};
+	int wait = 60 * cal->refresh;
+
+	if (first && wait > 1) {
+		wait -= ast_random() % (wait / 2 + 1);
+	}
+	ts.tv_sec = ast_tvnow().tv_sec + wait;
+
+	ast_mutex_init(&lock);
+	ast_mutex_lock(&lock);
+	while (!cal->unloading) {
+		if (ast_cond_timedwait(&cal->unload, &lock, &ts) == ETIMEDOUT) {
+			break;
+		}
+	}
+	ast_mutex_unlock(&lock);
+	ast_mutex_destroy(&lock);
+
+	if (cal->unloading) {
+		ast_debug(10, "Skipping refresh since we got a shutdown signal\n");
+		return -1;
+	}
+
+	ast_debug(10, "Refreshing %s after %d second timeout\n", cal->name, wait);
+
+	return ast_calendar_fetch_begin(cal);
+}
+
 static struct ast_calendar *unref_calendar(struct ast_calendar *cal)
 {
 	ao2_ref(cal, -1);
@@ -1066,6 +1134,7 @@ static int load_config(int reload)
 {
 	struct ast_flags config_flags = { reload ? CONFIG_FLAG_FILEUNCHANGED : 0 };
 	struct ast_config *tmpcfg;
+	const char *val;
 
 	if (!(tmpcfg = ast_config_load2("calendar.conf", "calendar", config_flags)) ||
 		tmpcfg == CONFIG_STATUS_FILEINVALID) {
@@ -1077,6 +1146,16 @@ static int load_config(int reload)
 		return 0;
 	}
 
+	ast_mutex_lock(&fetch_lock);
+	max_fetches = 0;
+	if ((val = ast_variable_retrieve(tmpcfg, "general", "maxfetches"))
+		&& (sscanf(val, "%30d", &max_fetches) != 1 || max_fetches < 0)) {
+		ast_log(LOG_WARNING, "Invalid maxfetches value '%s', not limiting fetches\n", val);
+		max_fetches = 0;
+	}
+	ast_cond_broadcast(&fetch_cond);
+	ast_mutex_unlock(&fetch_lock);
+
 	ast_rwlock_wrlock(&config_lock);
 	if (calendar_config) {
 		ast_config_destroy(calendar_config);
@@ -1906,6 +1985,8 @@ static int load_module(void)
 		return AST_MODULE_LOAD_DECLINE;
 	}
 
+	ast_cond_init(&fetch_cond, NULL);
+
 	if (load_config(0)) {
 		/* We don't have calendar support enabled */
 		return AST_MODULE_LOAD_DECLINE;
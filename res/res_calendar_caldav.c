@@ -64,11 +64,14 @@ struct caldav_pvt {
 		AST_STRING_FIELD(url);
 		AST_STRING_FIELD(user);
 		AST_STRING_FIELD(secret);
+		AST_STRING_FIELD(ctag);   /*!< getctag and sync-token of the collection when report was fetched */
 	);
 	struct ast_calendar *owner;
 	ne_uri uri;
 	ne_session *session;
 	struct ao2_container *events;
+	struct ast_str *report;   /*!< Last calendar-query response, kept while the server reports a ctag */
+	time_t report_end;        /*!< End of the time range report covers */
 };
 
 static void caldav_destructor(void *obj)
@@ -80,6 +83,7 @@ static void caldav_destructor(void *obj)
 		ne_session_destroy(pvt->session);
 	}
 	ne_uri_free(&pvt->uri);
+	ast_free(pvt->report);
 	ast_string_field_free_memory(pvt);
 
 	ao2_callback(pvt->events, OBJ_UNLINK | OBJ_NODATA | OBJ_MULTIPLE, NULL, NULL);
@@ -135,7 +139,7 @@ static int debug_response_handler(void *userdata, ne_request *req, const ne_stat
 	return 1;
 }
 
-static struct ast_str *caldav_request(struct caldav_pvt *pvt, const char *method, struct ast_str *req_body, struct ast_str *subdir, const char *content_type)
+static struct ast_str *caldav_request(struct caldav_pvt *pvt, const char *method, struct ast_str *req_body, struct ast_str *subdir, const char *content_type, const char *depth)
 {
 	struct ast_str *response;
 	ne_request *req;
@@ -158,7 +162,7 @@ static struct ast_str *caldav_request(struct caldav_pvt *pvt, const char *method
 	ne_add_response_body_reader(req, debug_response_handler, fetch_response_reader, &response);
 	ne_set_request_body_buffer(req, ast_str_buffer(req_body), ast_str_strlen(req_body));
 	ne_add_request_header(req, "Content-type", ast_strlen_zero(content_type) ? "text/xml" : content_type);
-	ne_add_request_header(req, "Depth", "1");
+	ne_add_request_header(req, "Depth", depth);
 
 	ret = ne_request_dispatch(req);
 	ne_request_destroy(req);
@@ -255,7 +259,7 @@ static int caldav_write_event(struct ast_calendar_event *event)
 	ast_str_append(&body, 0, "%s", icalcomponent_as_ical_string(calendar));
 	ast_str_set(&subdir, 0, "%s%s.ics", pvt->url[strlen(pvt->url) - 1] == '/' ? "" : "/", event->uid);
 
-	if ((response = caldav_request(pvt, "PUT", body, subdir, "text/calendar"))) {
+	if ((response = caldav_request(pvt, "PUT", body, subdir, "text/calendar", "1"))) {
 		ret = 0;
 	}
 
@@ -311,7 +315,7 @@ static struct ast_str *caldav_get_events_between(struct caldav_pvt *pvt, time_t
 		"  </C:filter>\n"
 		"</C:calendar-query>\n", start_str, end_str, start_str, end_str);
 
-	response = caldav_request(pvt, "REPORT", body, NULL, NULL);
+	response = caldav_request(pvt, "REPORT", body, NULL, NULL, "1");
 	ast_free(body);
 	if (response && !ast_str_strlen(response)) {
 		ast_free(response);
@@ -544,11 +548,102 @@ static void handle_characters(void *data, const xmlChar *ch, int len)
 	xmlFree(tmp);
 }
 
+struct ctagstate {
+	int in_tag;
+	struct ast_str *value;
+};
+
+static void handle_ctag_start_element(void *data,
+								 const xmlChar *localname, const xmlChar *prefix, const xmlChar *uri,
+								 int nb_namespaces, const xmlChar **namespaces,
+								 int nb_attributes, int nb_defaulted, const xmlChar **attributes)
+{
+	struct ctagstate *state = data;
+
+	if ((!xmlStrcmp(localname, BAD_CAST "getctag") && !xmlStrcmp(uri, BAD_CAST "http://calendarserver.org/ns/"))
+		|| (!xmlStrcmp(localname, BAD_CAST "sync-token") && !xmlStrcmp(uri, BAD_CAST "DAV:"))) {
+		state->in_tag = 1;
+		ast_str_append(&state->value, 0, " ");
+	}
+}
+
+static void handle_ctag_end_element(void *data,
+							   const xmlChar *localname, const xmlChar *prefix, const xmlChar *uri)
+{
+	struct ctagstate *state = data;
+
+	state->in_tag = 0;
+}
+
+static void handle_ctag_characters(void *data, const xmlChar *ch, int len)
+{
+	struct ctagstate *state = data;
+
+	if (state->in_tag) {
+		ast_str_append(&state->value, 0, "%.*s", len, (const char *) ch);
+	}
+}
+
+/*!
+ * \brief Ask for the getctag and sync-token of the calendar collection
+ *
+ * Servers change both whenever anything in the collection changes.
+ *
+ * \return the values, or NULL if the server reports neither
+ */
+static struct ast_str *caldav_get_ctag(struct caldav_pvt *pvt)
+{
+	struct ast_str *body, *response;
+	xmlSAXHandler saxHandler;
+	struct ctagstate state = {
+		.in_tag = 0,
+	};
+
+	if (!(body = ast_str_create(256))) {
+		return NULL;
+	}
+	ast_str_set(&body, 0,
+		"<?xml version=\"1.0\" encoding=\"utf-8\" ?>\n"
+		"<D:propfind xmlns:D=\"DAV:\" xmlns:CS=\"http://calendarserver.org/ns/\">\n"
+		"  <D:prop>\n"
+		"    <CS:getctag/>\n"
+		"    <D:sync-token/>\n"
+		"  </D:prop>\n"
+		"</D:propfind>\n");
+
+	response = caldav_request(pvt, "PROPFIND", body, NULL, NULL, "0");
+	ast_free(body);
+	if (!response) {
+		return NULL;
+	}
+
+	if (!(state.value = ast_str_create(64))) {
+		ast_free(response);
+		return NULL;
+	}
+
+	memset(&saxHandler, 0, sizeof(saxHandler));
+	saxHandler.initialized = XML_SAX2_MAGIC;
+	saxHandler.startElementNs = handle_ctag_start_element;
+	saxHandler.endElementNs = handle_ctag_end_element;
+	saxHandler.characters = handle_ctag_characters;
+
+	xmlSAXUserParseMemory(&saxHandler, &state, ast_str_buffer(response), ast_str_strlen(response));
+	ast_free(response);
+
+	if (ast_strlen_zero(ast_skip_blanks(ast_str_buffer(state.value)))) {
+		ast_free(state.value);
+		return NULL;
+	}
+
+	return state.value;
+}
+
 static int update_caldav(struct caldav_pvt *pvt)
 {
 	struct timeval now = ast_tvnow();
-	time_t start, end;
-	struct ast_str *response;
+	time_t start, end, report_end;
+	struct ast_str *response, *ctag;
 	xmlSAXHandler saxHandler;
 	struct xmlstate state = {
 		.in_caldata = 0,
@@ -557,12 +652,37 @@ static int update_caldav(struct caldav_pvt *pvt)
 
 	start = now.tv_sec;
 	end = now.tv_sec + 60 * pvt->owner->timeframe;
-	if (!(response = caldav_get_events_between(pvt, start, end))) {
-		return -1;
+
+	/* While the collection is unchanged the last response still holds every event
+	 * in the timeframe, until the timeframe moves past what it was asked for. */
+	ctag = caldav_get_ctag(pvt);
+	if (ctag && pvt->report && end <= pvt->report_end && !strcmp(ast_str_buffer(ctag), pvt->ctag)) {
+		ast_debug(3, "CalDAV calendar '%s' is unchanged, reusing the last response\n", pvt->owner->name);
+		ast_free(ctag);
+		response = pvt->report;
+	} else {
+		ast_free(pvt->report);
+		pvt->report = NULL;
+
+		/* Ask for one refresh more than the timeframe so the next refresh can reuse it */
+		report_end = end + 60 * MIN(pvt->owner->refresh, pvt->owner->timeframe);
+		if (!(response = caldav_get_events_between(pvt, start, ctag ? report_end : end))) {
+			ast_free(ctag);
+			return -1;
+		}
+
+		if (ctag) {
+			pvt->report = response;
+			pvt->report_end = report_end;
+			ast_string_field_set(pvt, ctag, ast_str_buffer(ctag));
+			ast_free(ctag);
+		}
 	}
 
 	if (!(state.cdata = ast_str_create(512))) {
-		ast_free(response);
+		if (response != pvt->report) {
+			ast_free(response);
+		}
 		return -1;
 	}
 
@@ -592,7 +712,9 @@ static int update_caldav(struct caldav_pvt *pvt)
 
 	ast_calendar_merge_events(pvt->owner, pvt->events);
 
-	ast_free(response);
+	if (response != pvt->report) {
+		ast_free(response);
+	}
 	ast_free(state.cdata);
 
 	return 0;
@@ -610,7 +732,7 @@ static void *caldav_load_calendar(void *void_data)
 	const struct ast_config *cfg;
 	struct ast_variable *v;
 	struct ast_calendar *cal = void_data;
-	ast_mutex_t refreshlock;
+	int first;
 
 	if (!(cal && (cfg = ast_calendar_config_acquire()))) {
 		ast_log(LOG_ERROR, "You must enable calendar support for res_caldav to load\n");
@@ -695,36 +817,18 @@ static void *caldav_load_calendar(void *void_data)
 
 	cal->tech_pvt = pvt;
 
-	ast_mutex_init(&refreshlock);
-
 	/* Load it the first time */
-	update_caldav(pvt);
+	if (!ast_calendar_fetch_begin(cal)) {
+		update_caldav(pvt);
+		ast_calendar_fetch_end();
+	}
 
 	ao2_unlock(cal);
 
 	/* The only writing from another thread will be if unload is true */
-	for (;;) {
-		struct timeval tv = ast_tvnow();
-		struct timespec ts = {0,};
-
-		ts.tv_sec = tv.tv_sec + (60 * pvt->owner->refresh);
-
-		ast_mutex_lock(&refreshlock);
-		while (!pvt->owner->unloading) {
-			if (ast_cond_timedwait(&pvt->owner->unload, &refreshlock, &ts) == ETIMEDOUT) {
-				break;
-			}
-		}
-		ast_mutex_unlock(&refreshlock);
-
-		if (pvt->owner->unloading) {
-			ast_debug(10, "Skipping refresh since we got a shutdown signal\n");
-			return NULL;
-		}
-
-		ast_debug(10, "Refreshing after %d minute timeout\n", pvt->owner->refresh);
-
+	for (first = 1; !ast_calendar_refresh_wait(cal, first); first = 0) {
 		update_caldav(pvt);
+		ast_calendar_fetch_end();
 	}
 
 	return NULL;
@@ -772,7 +772,7 @@ static void *ewscal_load_calendar(void *void_data)
 	const struct ast_config *cfg;
 	struct ast_variable *v;
 	struct ast_calendar *cal = void_data;
-	ast_mutex_t refreshlock;
+	int first;
 
 	ast_debug(5, "EWS: ewscal_load_calendar()\n");
 
@@ -868,36 +868,18 @@ static void *ewscal_load_calendar(void *void_data)
 
 	cal->tech_pvt = pvt;
 
-	ast_mutex_init(&refreshlock);
-
 	/* Load it the first time */
-	update_ewscal(pvt);
+	if (!ast_calendar_fetch_begin(cal)) {
+		update_ewscal(pvt);
+		ast_calendar_fetch_end();
+	}
 
 	ao2_unlock(cal);
 
 	/* The only writing from another thread will be if unload is true */
-	for (;;) {
-		struct timeval tv = ast_tvnow();
-		struct timespec ts = {0,};
-
-		ts.tv_sec = tv.tv_sec + (60 * pvt->owner->refresh);
-
-		ast_mutex_lock(&refreshlock);
-		while (!pvt->owner->unloading) {
-			if (ast_cond_timedwait(&pvt->owner->unload, &refreshlock, &ts) == ETIMEDOUT) {
-				break;
-			}
-		}
-		ast_mutex_unlock(&refreshlock);
-
-		if (pvt->owner->unloading) {
-			ast_debug(10, "Skipping refresh since we got a shutdown signal\n");
-			return NULL;
-		}
-
-		ast_debug(10, "Refreshing after %d minute timeout\n", pvt->owner->refresh);
-
+	for (first = 1; !ast_calendar_refresh_wait(cal, first); first = 0) {
 		update_ewscal(pvt);
+		ast_calendar_fetch_end();
 	}
 
 	return NULL;
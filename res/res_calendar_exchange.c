@@ -602,7 +602,7 @@ static void *exchangecal_load_calendar(void *void_data)
 	const struct ast_config *cfg;
 	struct ast_variable *v;
 	struct ast_calendar *cal = void_data;
-	ast_mutex_t refreshlock;
+	int first;
 
 	if (!(cal && (cfg = ast_calendar_config_acquire()))) {
 		ast_log(LOG_ERROR, "You must enable calendar support for res_exchangecal to load\n");
@@ -686,36 +686,18 @@ static void *exchangecal_load_calendar(void *void_data)
 
 	cal->tech_pvt = pvt;
 
-	ast_mutex_init(&refreshlock);
-
 	/* Load it the first time */
-	update_exchangecal(pvt);
+	if (!ast_calendar_fetch_begin(cal)) {
+		update_exchangecal(pvt);
+		ast_calendar_fetch_end();
+	}
 
 	ao2_unlock(cal);
 
 	/* The only writing from another thread will be if unload is true */
-	for (;;) {
-		struct timeval tv = ast_tvnow();
-		struct timespec ts = {0,};
-
-		ts.tv_sec = tv.tv_sec + (60 * pvt->owner->refresh);
-
-		ast_mutex_lock(&refreshlock);
-		while (!pvt->owner->unloading) {
-			if (ast_cond_timedwait(&pvt->owner->unload, &refreshlock, &ts) == ETIMEDOUT) {
-				break;
-			}
-		}
-		ast_mutex_unlock(&refreshlock);
-
-		if (pvt->owner->unloading) {
-			ast_debug(10, "Skipping refresh since we got a shutdown signal\n");
-			return NULL;
-		}
-
-		ast_debug(10, "Refreshing after %d minute timeout\n", pvt->owner->refresh);
-
+	for (first = 1; !ast_calendar_refresh_wait(cal, first); first = 0) {
 		update_exchangecal(pvt);
+		ast_calendar_fetch_end();
 	}
 
 	return NULL;
@@ -59,6 +59,8 @@ struct icalendar_pvt {
 		AST_STRING_FIELD(url);
 		AST_STRING_FIELD(user);
 		AST_STRING_FIELD(secret);
+		AST_STRING_FIELD(etag);          /*!< ETag of the feed in data */
+		AST_STRING_FIELD(last_modified); /*!< Last-Modified of the feed in data */
 	);
 	struct ast_calendar *owner;
 	ne_uri uri;
@@ -124,12 +126,20 @@ static int auth_credentials(void *userdata, const char *realm, int attempts, cha
 	return 0;
 }
 
-static icalcomponent *fetch_icalendar(struct icalendar_pvt *pvt)
+/*!
+ * \brief Fetch and parse the feed
+ *
+ * While parsed data is held, the request is made conditional on the ETag and
+ * Last-Modified of that data, and *not_modified is set instead of parsing when
+ * the server answers 304.
+ */
+static icalcomponent *fetch_icalendar(struct icalendar_pvt *pvt, int *not_modified)
 {
 	int ret;
 	struct ast_str *response;
 	ne_request *req;
 	icalcomponent *comp = NULL;
+	const char *etag, *last_modified;
 
 	if (!pvt) {
 		ast_log(LOG_ERROR, "There is no private!\n");
@@ -141,10 +151,28 @@ static icalcomponent *fetch_icalendar(struct icalendar_pvt *pvt)
 		return NULL;
 	}
 
+	*not_modified = 0;
+
 	req = ne_request_create(pvt->session, "GET", pvt->uri.path);
 	ne_add_response_body_reader(req, ne_accept_2xx, fetch_response_reader, &response);
+	if (pvt->data && !ast_strlen_zero(pvt->etag)) {
+		ne_add_request_header(req, "If-None-Match", pvt->etag);
+	}
+	if (pvt->data && !ast_strlen_zero(pvt->last_modified)) {
+		ne_add_request_header(req, "If-Modified-Since", pvt->last_modified);
+	}
 
 	ret = ne_request_dispatch(req);
+	if (ret == NE_OK && ne_get_status(req)->code == 304) {
+		ast_debug(3, "iCalendar '%s' has not been modified\n", pvt->owner->name);
+		ne_request_destroy(req);
+		ast_free(response);
+		*not_modified = 1;
+		return NULL;
+	}
+	/* Only remembered once the body parses, so a 304 never refers to a bad fetch */
+	etag = ast_strdupa(S_OR(ne_get_response_header(req, "ETag"), ""));
+	last_modified = ast_strdupa(S_OR(ne_get_response_header(req, "Last-Modified"), ""));
 	ne_request_destroy(req);
 	if (ret != NE_OK || !ast_str_strlen(response)) {
 		ast_log(LOG_WARNING, "Unable to retrieve iCalendar '%s' from '%s': %s\n", pvt->owner->name, pvt->url, ne_get_error(pvt->session));
@@ -157,6 +185,11 @@ static icalcomponent *fetch_icalendar(struct icalendar_pvt *pvt)
 	}
 	ast_free(response);
 
+	if (comp) {
+		ast_string_field_set(pvt, etag, etag);
+		ast_string_field_set(pvt, last_modified, last_modified);
+	}
+
 	return comp;
 }
 
@@ -387,7 +420,7 @@ static void *ical_load_calendar(void *void_data)
 	const struct ast_config *cfg;
 	struct ast_variable *v;
 	struct ast_calendar *cal = void_data;
-	ast_mutex_t refreshlock;
+	int first, not_modified;
 
 	if (!(cal && (cfg = ast_calendar_config_acquire()))) {
 		ast_log(LOG_ERROR, "You must enable calendar support for res_icalendar to load\n");
@@ -470,11 +503,12 @@ static void *ical_load_calendar(void *void_data)
 
 	cal->tech_pvt = pvt;
 
-	ast_mutex_init(&refreshlock);
-
 	/* Load it the first time */
-	if (!(pvt->data = fetch_icalendar(pvt))) {
-		ast_log(LOG_WARNING, "Unable to parse iCalendar '%s'\n", cal->name);
+	if (!ast_calendar_fetch_begin(cal)) {
+		if (!(pvt->data = fetch_icalendar(pvt, &not_modified))) {
+			ast_log(LOG_WARNING, "Unable to parse iCalendar '%s'\n", cal->name);
+		}
+		ast_calendar_fetch_end();
 	}
 
 	icalendar_update_events(pvt);
@@ -482,37 +516,23 @@ static void *ical_load_calendar(void *void_data)
 	ao2_unlock(cal);
 
 	/* The only writing from another thread will be if unload is true */
-	for(;;) {
-		struct timeval tv = ast_tvnow();
-		struct timespec ts = {0,};
+	for (first = 1; !ast_calendar_refresh_wait(cal, first); first = 0) {
+		icalcomponent *data = fetch_icalendar(pvt, &not_modified);
 
-		ts.tv_sec = tv.tv_sec + (60 * pvt->owner->refresh);
+		ast_calendar_fetch_end();
 
-		ast_mutex_lock(&refreshlock);
-		while (!pvt->owner->unloading) {
-			if (ast_cond_timedwait(&pvt->owner->unload, &refreshlock, &ts) == ETIMEDOUT) {
-				break;
+		if (data) {
+			/* Free the old calendar data */
+			if (pvt->data) {
+				icalcomponent_free(pvt->data);
 			}
-		}
-		ast_mutex_unlock(&refreshlock);
-
-		if (pvt->owner->unloading) {
-			ast_debug(10, "Skipping refresh since we got a shutdown signal\n");
-			return NULL;
-		}
-
-		ast_debug(10, "Refreshing after %d minute timeout\n", pvt->owner->refresh);
-
-		/* Free the old calendar data */
-		if (pvt->data) {
-			icalcomponent_free(pvt->data);
-			pvt->data = NULL;
-		}
-		if (!(pvt->data = fetch_icalendar(pvt))) {
+			pvt->data = data;
+		} else if (!not_modified) {
 			ast_log(LOG_WARNING, "Unable to parse iCalendar '%s'\n", pvt->owner->name);
 			continue;
 		}
 
+		/* Even an unchanged feed has to be expanded again for the moved timeframe */
 		icalendar_update_events(pvt);
 	}
 
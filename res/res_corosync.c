@@ -469,20 +469,19 @@ static void cfg_shutdown_cb(corosync_cfg_handle_t cfg_handle,
 {
 }
 
-static void cpg_deliver_cb(cpg_handle_t handle, const struct cpg_name *group_name,
-		uint32_t nodeid, uint32_t pid, void *msg, size_t msg_len)
+/*!
+ * \internal
+ * \brief Publish a single event received from the cluster to stasis
+ *
+ * \param msg The event as received
+ * \param msg_len Length of the event
+ */
+static void deliver_event(const void *msg, size_t msg_len)
 {
 	struct ast_event *event;
 	void (*publish_handler)(struct ast_event *) = NULL;
 	enum ast_event_type event_type;
 
-	if (msg_len < ast_event_minimum_length()) {
-		ast_debug(1, "Ignoring event that's too small. %u < %u\n",
-			(unsigned int) msg_len,
-			(unsigned int) ast_event_minimum_length());
-		return;
-	}
-
 	if (!ast_eid_cmp(&ast_eid_default, ast_event_get_ie_raw(msg, AST_EVENT_IE_EID))) {
 		/* Don't feed events back in that originated locally. */
 		return;
@@ -523,6 +522,33 @@ static void cpg_deliver_cb(cpg_handle_t handle, const struct cpg_name *group_nam
 	publish_handler(event);
 }
 
+static void cpg_deliver_cb(cpg_handle_t handle, const struct cpg_name *group_name,
+		uint32_t nodeid, uint32_t pid, void *msg, size_t msg_len)
+{
+	if (msg_len < ast_event_minimum_length()) {
+		ast_debug(1, "Ignoring event that's too small. %u < %u\n",
+			(unsigned int) msg_len,
+			(unsigned int) ast_event_minimum_length());
+		return;
+	}
+
+	/* A message may carry several events back to back when the sender batches */
+	while (msg_len >= ast_event_minimum_length()) {
+		size_t event_len = ast_event_get_size(msg);
+
+		if (event_len < ast_event_minimum_length() || event_len > msg_len) {
+			ast_debug(1, "Ignoring malformed event of length %u with %u bytes remaining\n",
+				(unsigned int) event_len, (unsigned int) msg_len);
+			return;
+		}
+
+		deliver_event(msg, event_len);
+
+		msg = (char *) msg + event_len;
+		msg_len -= event_len;
+	}
+}
+
 static void publish_event_to_corosync(struct ast_event *event)
 {
 	cs_error_t cs_err;
@@ -542,6 +568,227 @@ static void publish_event_to_corosync(struct ast_event *event)
 	}
 }
 
+/*! \brief Largest corosync message that batched events are packed into */
+#define COROSYNC_BATCH_MAX_SIZE (64 * 1024)
+
+/*! \brief Most events packed into a single corosync message */
+#define COROSYNC_BATCH_MAX_EVENTS 256
+
+/*!
+ * \brief Milliseconds outbound state changes are held and coalesced for
+ *
+ * When zero every change is sent to the cluster as soon as it happens, in
+ * a message of its own.
+ */
+static unsigned int batch_interval;
+
+/*! \brief Outbound state of a single device or mailbox, used when batching */
+struct outbound_state {
+	/*! Newest event not yet sent to the cluster, if any */
+	struct ast_event *pending;
+	/*! Event most recently sent to the cluster */
+	struct ast_event *sent;
+	/*! Event type and device or mailbox the state is for */
+	char key[0];
+};
+
+/*! \brief All outbound_state objects, keyed by outbound_state::key */
+static struct ao2_container *outbound_states;
+
+/*! \brief Set when some outbound_state has a pending event */
+static int outbound_pending;
+
+AO2_STRING_FIELD_HASH_FN(outbound_state, key);
+AO2_STRING_FIELD_CMP_FN(outbound_state, key);
+
+static void outbound_state_dtor(void *obj)
+{
+	struct outbound_state *state = obj;
+
+	ast_event_destroy(state->pending);
+	ast_event_destroy(state->sent);
+}
+
+/*! \brief Events collected to be sent together as one corosync message */
+struct corosync_batch {
+	struct iovec iov[COROSYNC_BATCH_MAX_EVENTS];
+	/*! Events to destroy once sent, NULL for events the batch doesn't own */
+	struct ast_event *owned[COROSYNC_BATCH_MAX_EVENTS];
+	/*! Number of events in the batch */
+	size_t count;
+	/*! Total length of the events in the batch */
+	size_t len;
+};
+
+static void corosync_batch_init(struct corosync_batch *batch)
+{
+	batch->count = 0;
+	batch->len = 0;
+}
+
+static void corosync_batch_flush(struct corosync_batch *batch)
+{
+	cs_error_t cs_err;
+	size_t i;
+
+	if (!batch->count) {
+		return;
+	}
+
+	ast_debug(5, "Publishing batch of %u events (%u bytes) to corosync\n",
+		(unsigned int) batch->count, (unsigned int) batch->len);
+
+	if ((cs_err = cpg_mcast_joined(cpg_handle, CPG_TYPE_FIFO, batch->iov, batch->count)) != CS_OK) {
+		ast_log(LOG_WARNING, "CPG mcast failed (%u) for batch of %u events\n",
+			cs_err, (unsigned int) batch->count);
+	}
+
+	for (i = 0; i < batch->count; i++) {
+		ast_event_destroy(batch->owned[i]);
+	}
+	corosync_batch_init(batch);
+}
+
+/*!
+ * \internal
+ * \brief Add an event to a batch, sending the batch first if it is full
+ *
+ * \param batch The batch
+ * \param event The event
+ * \param owned Non-zero if the batch should destroy the event once sent
+ */
+static void corosync_batch_add(struct corosync_batch *batch, struct ast_event *event, int owned)
+{
+	size_t size = ast_event_get_size(event);
+
+	if (batch->count == COROSYNC_BATCH_MAX_EVENTS
+		|| (batch->count && batch->len + size > COROSYNC_BATCH_MAX_SIZE)) {
+		corosync_batch_flush(batch);
+	}
+
+	batch->iov[batch->count].iov_base = (void *) event;
+	batch->iov[batch->count].iov_len = size;
+	batch->owned[batch->count] = owned ? event : NULL;
+	batch->count++;
+	batch->len += size;
+}
+
+/*!
+ * \internal
+ * \brief Build the key identifying what an event describes the state of
+ *
+ * \return The snprintf() result, or -1 if the event is not state that can be coalesced
+ */
+static int outbound_state_key(const struct ast_event *event, char *buf, size_t size)
+{
+	switch (ast_event_get_type(event)) {
+	case AST_EVENT_DEVICE_STATE_CHANGE:
+		return snprintf(buf, size, "device_state:%s",
+			S_OR(ast_event_get_ie_str(event, AST_EVENT_IE_DEVICE), ""));
+	case AST_EVENT_MWI:
+		return snprintf(buf, size, "mwi:%s@%s",
+			S_OR(ast_event_get_ie_str(event, AST_EVENT_IE_MAILBOX), ""),
+			S_OR(ast_event_get_ie_str(event, AST_EVENT_IE_CONTEXT), ""));
+	default:
+		return -1;
+	}
+}
+
+static int corosync_events_equal(const struct ast_event *left, const struct ast_event *right)
+{
+	size_t size = ast_event_get_size(left);
+
+	return size == ast_event_get_size(right) && !memcmp(left, right, size);
+}
+
+/*!
+ * \internal
+ * \brief Hold an outbound event until the next batch is sent
+ *
+ * A newer event for the same device or mailbox replaces a pending one, and
+ * an event that matches what was last sent is dropped.
+ *
+ * \param event The event, ownership is taken on success
+ *
+ * \retval 0 the event was queued or dropped
+ * \retval -1 the event should be sent straight away
+ */
+static int queue_event_to_corosync(struct ast_event *event)
+{
+	char key[512];
+	struct outbound_state *state;
+	int res;
+
+	res = outbound_state_key(event, key, sizeof(key));
+	if (res < 0 || (size_t) res >= sizeof(key)) {
+		return -1;
+	}
+
+	ao2_lock(outbound_states);
+	state = ao2_find(outbound_states, key, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if (!state) {
+		state = ao2_alloc_options(sizeof(*state) + res + 1, outbound_state_dtor,
+			AO2_ALLOC_OPT_LOCK_NOLOCK);
+		if (!state) {
+			ao2_unlock(outbound_states);
+			return -1;
+		}
+		strcpy(state->key, key); /* Safe */
+		ao2_link_flags(outbound_states, state, OBJ_NOLOCK);
+	}
+
+	ast_event_destroy(state->pending);
+	if (state->sent && corosync_events_equal(state->sent, event)) {
+		/* The cluster already has this, nothing to send */
+		ast_event_destroy(event);
+		state->pending = NULL;
+	} else {
+		state->pending = event;
+		outbound_pending = 1;
+	}
+	ao2_unlock(outbound_states);
+	ao2_ref(state, -1);
+
+	return 0;
+}
+
+static int flush_outbound_state_cb(void *obj, void *arg, int flags)
+{
+	struct outbound_state *state = obj;
+	struct corosync_batch *batch = arg;
+
+	if (!state->pending) {
+		return 0;
+	}
+
+	ast_event_destroy(state->sent);
+	state->sent = state->pending;
+	state->pending = NULL;
+
+	/* The event now lives in state->sent, which stays put while we hold the container lock */
+	corosync_batch_add(batch, state->sent, 0);
+
+	return 0;
+}
+
+/*! \brief Send all pending outbound state changes to the cluster */
+static void flush_outbound_states(void)
+{
+	struct corosync_batch batch;
+
+	if (!outbound_states || !outbound_pending) {
+		return;
+	}
+
+	corosync_batch_init(&batch);
+
+	ao2_lock(outbound_states);
+	outbound_pending = 0;
+	ao2_callback(outbound_states, OBJ_NODATA | OBJ_NOLOCK, flush_outbound_state_cb, &batch);
+	corosync_batch_flush(&batch);
+	ao2_unlock(outbound_states);
+}
+
 static void publish_to_corosync(struct stasis_message *message)
 {
 	struct ast_event *event;
@@ -566,7 +813,12 @@ static void publish_to_corosync(struct stasis_message *message)
 		ast_log(LOG_NOTICE, "Sending event PING from this server with EID: '%s'\n", buf);
 	}
 
+	if (batch_interval && !queue_event_to_corosync(event)) {
+		return;
+	}
+
 	publish_event_to_corosync(event);
+	ast_event_destroy(event);
 }
 
 static void stasis_message_cb(void *data, struct stasis_subscription *sub, struct stasis_message *message)
@@ -581,12 +833,29 @@ static void stasis_message_cb(void *data, struct stasis_subscription *sub, struc
 static int dump_cache_cb(void *obj, void *arg, int flags)
 {
 	struct stasis_message *message = obj;
+	struct corosync_batch *batch = arg;
+	struct ast_event *event;
 
 	if (!message) {
 		return 0;
 	}
 
-	publish_to_corosync(message);
+	if (!batch) {
+		publish_to_corosync(message);
+		return 0;
+	}
+
+	event = stasis_message_to_event(message);
+	if (!event) {
+		return 0;
+	}
+
+	if (ast_eid_cmp(&ast_eid_default, ast_event_get_ie_raw(event, AST_EVENT_IE_EID))) {
+		ast_event_destroy(event);
+		return 0;
+	}
+
+	corosync_batch_add(batch, event, 1);
 
 	return 0;
 }
@@ -596,9 +865,10 @@ static void cpg_confchg_cb(cpg_handle_t handle, const struct cpg_name *group_nam
 		const struct cpg_address *left_list, size_t left_list_entries,
 		const struct cpg_address *joined_list, size_t joined_list_entries)
 {
+	struct corosync_batch batch;
+	int batching;
 	unsigned int i;
 
-
 	for (i = 0; i < left_list_entries; i++) {
 		const struct cpg_address *cpg_node = &left_list[i];
 		struct corosync_node* node;
@@ -618,6 +888,13 @@ static void cpg_confchg_cb(cpg_handle_t handle, const struct cpg_name *group_nam
 		return;
 	}
 
+	/*
+	 * When batching, send the snapshot in as few messages as possible rather
+	 * than one message per cached state.
+	 */
+	batching = batch_interval ? 1 : 0;
+	corosync_batch_init(&batch);
+
 	for (i = 0; i < ARRAY_LEN(event_types); i++) {
 		struct ao2_container *messages;
 
@@ -637,10 +914,12 @@ static void cpg_confchg_cb(cpg_handle_t handle, const struct cpg_name *group_nam
 			&ast_eid_default);
 		ast_rwlock_unlock(&event_types_lock);
 
-		ao2_callback(messages, OBJ_NODATA, dump_cache_cb, NULL);
+		ao2_callback(messages, OBJ_NODATA, dump_cache_cb, batching ? &batch : NULL);
 
 		ao2_t_ref(messages, -1, "Dispose of dumped cache");
 	}
+
+	corosync_batch_flush(&batch);
 }
 
 /*! \brief Informs the cluster of our EID and our IP addresses */
@@ -685,6 +964,7 @@ static void send_cluster_notify(void)
 static void *dispatch_thread_handler(void *data)
 {
 	cs_error_t cs_err;
+	struct timeval last_flush = ast_tvnow();
 	struct pollfd pfd[3] = {
 		{ .events = POLLIN, },
 		{ .events = POLLIN, },
@@ -706,6 +986,8 @@ static void *dispatch_thread_handler(void *data)
 	send_cluster_notify();
 	while (!dispatch_thread.stop) {
 		int res;
+		int timeout = -1;
+		int64_t elapsed;
 
 		cs_err = CS_OK;
 
@@ -713,12 +995,23 @@ static void *dispatch_thread_handler(void *data)
 		pfd[1].revents = 0;
 		pfd[2].revents = 0;
 
-		res = ast_poll(pfd, ARRAY_LEN(pfd), -1);
+		/* Wake up in time to send the next batch of outbound state changes */
+		if (batch_interval) {
+			elapsed = ast_tvdiff_ms(ast_tvnow(), last_flush);
+			timeout = elapsed >= batch_interval ? 0 : batch_interval - elapsed;
+		}
+
+		res = ast_poll(pfd, ARRAY_LEN(pfd), timeout);
 		if (res == -1 && errno != EINTR && errno != EAGAIN) {
 			ast_log(LOG_ERROR, "poll() error: %s (%d)\n", strerror(errno), errno);
 			continue;
 		}
 
+		if (!batch_interval || ast_tvdiff_ms(ast_tvnow(), last_flush) >= batch_interval) {
+			flush_outbound_states();
+			last_flush = ast_tvnow();
+		}
+
 		if (pfd[0].revents & POLLIN) {
 			if ((cs_err = cpg_dispatch(cpg_handle, CS_DISPATCH_ALL)) != CS_OK) {
 				ast_log(LOG_WARNING, "Failed CPG dispatch: %u\n", cs_err);
@@ -937,6 +1230,10 @@ static char *corosync_show_config(struct ast_cli_entry *e, int cmd, struct ast_c
 	}
 	ast_rwlock_unlock(&event_types_lock);
 
+	if (batch_interval) {
+		ast_cli(a->fd, "=== ==> Batching state changes every %u ms\n", batch_interval);
+	}
+
 	ast_cli(a->fd, "===\n"
 	               "=============================================================\n"
 	               "\n");
@@ -991,12 +1288,19 @@ static int load_general_config(struct ast_config *cfg)
 		event_types[i].publish = event_types[i].publish_default;
 		event_types[i].subscribe = event_types[i].subscribe_default;
 	}
+	batch_interval = 0;
 
 	for (v = ast_variable_browse(cfg, "general"); v && !res; v = v->next) {
 		if (!strcasecmp(v->name, "publish_event")) {
 			res = set_event(v->value, PUBLISH);
 		} else if (!strcasecmp(v->name, "subscribe_event")) {
 			res = set_event(v->value, SUBSCRIBE);
+		} else if (!strcasecmp(v->name, "batch_interval")) {
+			if (ast_parse_arg(v->value, PARSE_UINT32 | PARSE_IN_RANGE, &batch_interval, 0, 60000)) {
+				ast_log(LOG_WARNING, "Invalid batch_interval '%s', must be 0 to 60000 milliseconds\n",
+					v->value);
+				batch_interval = 0;
+			}
 		} else {
 			ast_log(LOG_WARNING, "Unknown option '%s'\n", v->name);
 		}
@@ -1101,6 +1405,10 @@ static void cleanup_module(void)
 		dispatch_thread.alert_pipe[1] = -1;
 	}
 
+	ao2_cleanup(outbound_states);
+	outbound_states = NULL;
+	outbound_pending = 0;
+
 	if (cpg_handle && (cs_err = cpg_finalize(cpg_handle)) != CS_OK) {
 		ast_log(LOG_ERROR, "Failed to finalize cpg (%d)\n", (int) cs_err);
 	}
@@ -1131,6 +1439,12 @@ static int load_module(void)
 		goto failed;
 	}
 
+	outbound_states = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0, 257,
+		outbound_state_hash_fn, NULL, outbound_state_cmp_fn);
+	if (!outbound_states) {
+		goto failed;
+	}
+
 	corosync_aggregate_topic = stasis_topic_create("corosync:aggregator");
 	if (!corosync_aggregate_topic) {
 		ast_log(AST_LOG_ERROR, "Failed to create stasis topic for corosync\n");
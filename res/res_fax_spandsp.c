@@ -70,6 +70,9 @@
 #define SPANDSP_FAX_SAMPLES 160
 #define SPANDSP_FAX_TIMER_RATE 8000 / SPANDSP_FAX_SAMPLES	/* 50 ticks per second, 20ms, 160 samples per second */
 #define SPANDSP_ENGAGE_UDPTL_NAT_RETRY 3
+#define SPANDSP_FAX_TICK_MS (SPANDSP_FAX_SAMPLES * 1000 / 8000)	/* 20ms */
+/*! Most timer ticks a late read may catch up on, anything older is dropped */
+#define SPANDSP_FAX_MAX_TICKS 10
 
 static void *spandsp_fax_new(struct ast_fax_session *s, struct ast_fax_tech_token *token);
 static void spandsp_fax_destroy(struct ast_fax_session *s);
@@ -158,6 +161,8 @@ struct spandsp_pvt {
 	t38_gateway_state_t t38_gw_state;
 
 	struct ast_timer *timer;
+	/*! The time the stack has been advanced up to */
+	struct timeval last_tick;
 	AST_LIST_HEAD(frame_queue, ast_frame) read_frames;
 
 	int v21_detected;
@@ -617,14 +622,46 @@ static void spandsp_fax_destroy(struct ast_fax_session *s)
 	s->fd = -1;
 }
 
+/*!
+ * \brief Work out how many timer ticks have passed since the stack was last advanced
+ *
+ * The timer only wakes us up, it does not say how late we are.  If the
+ * channel thread was descheduled for a while, advancing the stack by a
+ * single tick would leave the T.30/T.38 timers running slow for the rest
+ * of the call, so the wall clock decides how far to move them instead.
+ */
+static int spandsp_elapsed_ticks(struct spandsp_pvt *p)
+{
+	struct timeval now = ast_tvnow();
+	int64_t elapsed = ast_tvdiff_ms(now, p->last_tick);
+	int ticks;
+
+	/* Round to the nearest tick so a timer firing slightly early still counts */
+	ticks = (elapsed + SPANDSP_FAX_TICK_MS / 2) / SPANDSP_FAX_TICK_MS;
+	if (ticks < 1) {
+		ticks = 1;
+	}
+
+	if (ticks > SPANDSP_FAX_MAX_TICKS) {
+		/* Too far behind to be worth catching up, start over from now */
+		ticks = SPANDSP_FAX_MAX_TICKS;
+		p->last_tick = now;
+	} else {
+		p->last_tick = ast_tvadd(p->last_tick, ast_samp2tv(ticks * SPANDSP_FAX_SAMPLES, 8000));
+	}
+
+	return ticks;
+}
+
 /*! \brief Read a frame from the spandsp fax stack.
  */
 static struct ast_frame *spandsp_fax_read(struct ast_fax_session *s)
 {
 	struct spandsp_pvt *p = s->tech_pvt;
-	uint8_t buffer[AST_FRIENDLY_OFFSET + SPANDSP_FAX_SAMPLES * sizeof(uint16_t)];
+	uint8_t buffer[AST_FRIENDLY_OFFSET + SPANDSP_FAX_SAMPLES * SPANDSP_FAX_MAX_TICKS * sizeof(uint16_t)];
 	int16_t *buf = (int16_t *) (buffer + AST_FRIENDLY_OFFSET);
 	int samples;
+	int ticks;
 
 	struct ast_frame fax_frame = {
 		.frametype = AST_FRAME_VOICE,
@@ -645,13 +682,15 @@ static struct ast_frame *spandsp_fax_read(struct ast_fax_session *s)
 		return NULL;
 	}
 
+	ticks = spandsp_elapsed_ticks(p);
+
 	if (p->ist38) {
-		t38_terminal_send_timeout(&p->t38_state, SPANDSP_FAX_SAMPLES);
+		t38_terminal_send_timeout(&p->t38_state, SPANDSP_FAX_SAMPLES * ticks);
 		if ((f = AST_LIST_REMOVE_HEAD(&p->read_frames, frame_list))) {
 			return f;
 		}
 	} else {
-		if ((samples = fax_tx(&p->fax_state, buf, SPANDSP_FAX_SAMPLES)) > 0) {
+		if ((samples = fax_tx(&p->fax_state, buf, SPANDSP_FAX_SAMPLES * ticks)) > 0) {
 			f->samples = samples;
 			AST_FRAME_SET_BUFFER(f, buffer, AST_FRIENDLY_OFFSET, samples * sizeof(int16_t));
 			return ast_frisolate(f);
@@ -996,6 +1035,7 @@ static int spandsp_fax_start(struct ast_fax_session *s)
 		ast_log(LOG_ERROR, "FAX session '%u' error setting rate on timing source.\n", s->id);
 		return -1;
 	}
+	p->last_tick = ast_tvnow();
 
 	s->state = AST_FAX_STATE_ACTIVE;
 
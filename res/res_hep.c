@@ -78,6 +78,26 @@
 				<configOption name="capture_id" default="0">
 					<synopsis>The ID for this capture agent.</synopsis>
 				</configOption>
+				<configOption name="sampling_rate" default="100">
+					<synopsis>Percentage of calls to capture.</synopsis>
+					<description><para>Calls are picked by their correlation UUID so every
+					packet of a call is either sent or skipped together. Filtered packets
+					are dropped before they are encoded or queued.</para>
+					</description>
+				</configOption>
+				<configOption name="exclude_methods" default="">
+					<synopsis>Comma separated list of SIP methods that should not be captured.</synopsis>
+					<description><para>Responses are matched on the method in their CSeq
+					header, so <literal>OPTIONS</literal> excludes both OPTIONS requests
+					and the responses to them.</para>
+					</description>
+				</configOption>
+				<configOption name="queue_size" default="10000">
+					<synopsis>Number of captured packets that may wait to be sent.</synopsis>
+					<description><para>Packets captured while the queue is full are dropped
+					rather than backing up the threads that captured them.</para>
+					</description>
+				</configOption>
 			</configObject>
 		</configFile>
 	</configInfo>
@@ -90,6 +110,7 @@
 #include "asterisk/config_options.h"
 #include "asterisk/taskprocessor.h"
 #include "asterisk/res_hep.h"
+#include "asterisk/strings.h"
 
 #include <netinet/ip.h>
 #include <netinet/tcp.h>
@@ -102,6 +123,14 @@
 /*! Asterisk vendor ID. Used for custom data to send to a capture node */
 #define ASTERISK_VENDOR_ID 0x0004
 
+#if defined(MSG_WAITFORONE)
+/*! sendmmsg() is available to send several packets per system call */
+#define HAVE_HEP_BATCH_IO 1
+#endif
+
+/*! Most packets taken off the capture queue and sent together */
+#define HEP_BATCH_MAX 32
+
 /*! Chunk types from the HEPv3 Spec */
 enum hepv3_chunk_types {
 
@@ -236,10 +265,13 @@ struct hep_generic {
 struct hepv3_global_config {
 	unsigned int enabled;                    /*!< Whether or not sending is enabled */
 	unsigned int capture_id;                 /*!< Capture ID for this agent */
+	unsigned int sampling_rate;              /*!< Percentage of calls to capture */
+	unsigned int queue_size;                 /*!< Most packets waiting to be sent */
 	enum hep_uuid_type uuid_type;            /*!< The preferred type of the UUID */
 	AST_DECLARE_STRING_FIELDS(
 		AST_STRING_FIELD(capture_address);   /*!< Address to send to */
 		AST_STRING_FIELD(capture_password);  /*!< Password for Homer server */
+		AST_STRING_FIELD(exclude_methods);   /*!< SIP methods not to capture */
 	);
 };
 
@@ -277,6 +309,30 @@ static AO2_GLOBAL_OBJ_STATIC(global_data);
 
 static struct ast_taskprocessor *hep_queue_tp;
 
+/*!
+ * \brief Captured packets waiting to be encoded and sent
+ *
+ * Capturing threads only append to the ring.  A single task on
+ * \ref hep_queue_tp empties it in batches, and is only pushed when the
+ * ring goes from empty to non-empty, so a burst of traffic costs one
+ * taskprocessor task instead of one per packet.
+ */
+static struct {
+	ast_mutex_t lock;
+	/*! Ring of captured packets, each holding a reference */
+	struct hepv3_capture_info **ring;
+	/*! Number of slots in ring */
+	unsigned int size;
+	/*! Oldest packet in ring */
+	unsigned int head;
+	/*! Number of packets in ring */
+	unsigned int count;
+	/*! Packets dropped because the ring was full since the last report */
+	unsigned int dropped;
+	/*! Whether a task to empty the ring has been pushed */
+	unsigned int scheduled:1;
+} capture_queue;
+
 static void *module_config_alloc(void);
 static int hepv3_config_pre_apply(void);
 static void hepv3_config_post_apply(void);
@@ -448,27 +504,28 @@ struct hepv3_capture_info *hepv3_create_capture_info(const void *payload, size_t
 	return info;
 }
 
-/*! \brief Callback function for the \ref hep_queue_tp taskprocessor */
-static int hep_queue_cb(void *data)
+/*!
+ * \brief Encode a captured packet in to a HEPv3 packet
+ *
+ * \param config The current module configuration
+ * \param capture_info The captured packet
+ * \param[out] len The length of the returned packet
+ *
+ * \retval The encoded packet, to be freed with ast_free()
+ * \retval NULL on error
+ */
+static void *hep_build_packet(struct module_config *config, struct hepv3_capture_info *capture_info, unsigned int *len)
 {
-	RAII_VAR(struct module_config *, config, ao2_global_obj_ref(global_config), ao2_cleanup);
-	RAII_VAR(struct hepv3_runtime_data *, hepv3_data, ao2_global_obj_ref(global_data), ao2_cleanup);
-	RAII_VAR(struct hepv3_capture_info *, capture_info, data, ao2_cleanup);
 	struct hep_generic hg_pkt;
 	unsigned int packet_len = 0, sock_buffer_len;
 	struct hep_chunk_ip4 ipv4_src, ipv4_dst;
 	struct hep_chunk_ip6 ipv6_src, ipv6_dst;
 	struct hep_chunk auth_key, payload, uuid;
 	void *sock_buffer;
-	int res;
-
-	if (!capture_info || !config || !hepv3_data) {
-		return 0;
-	}
 
 	if (ast_sockaddr_is_ipv4(&capture_info->src_addr) != ast_sockaddr_is_ipv4(&capture_info->dst_addr)) {
 		ast_log(AST_LOG_NOTICE, "Unable to send packet: Address Family mismatch between source/destination\n");
-		return -1;
+		return NULL;
 	}
 
 	packet_len = sizeof(hg_pkt);
@@ -522,7 +579,7 @@ static int hep_queue_cb(void *data)
 	/* Build the buffer to send */
 	sock_buffer = ast_malloc(packet_len);
 	if (!sock_buffer) {
-		return -1;
+		return NULL;
 	}
 
 	/* Copy in the header */
@@ -564,38 +621,288 @@ static int hep_queue_cb(void *data)
 
 	ast_assert(sock_buffer_len == packet_len);
 
-	res = ast_sendto(hepv3_data->sockfd, sock_buffer, sock_buffer_len, 0, &hepv3_data->remote_addr);
-	if (res < 0) {
-		ast_log(AST_LOG_ERROR, "Error [%d] while sending packet to HEPv3 server: %s\n",
-			errno, strerror(errno));
-	} else if (res != sock_buffer_len) {
-		ast_log(AST_LOG_WARNING, "Failed to send complete packet to HEPv3 server: %d of %u sent\n",
-			res, sock_buffer_len);
-		res = -1;
+	*len = packet_len;
+	return sock_buffer;
+}
+
+/*! \brief Send a batch of encoded HEPv3 packets to the capture server */
+static void hep_send_batch(struct hepv3_runtime_data *hepv3_data, void **packets, unsigned int *lens, unsigned int count)
+{
+	unsigned int sent = 0;
+	int res;
+
+#ifdef HAVE_HEP_BATCH_IO
+	struct mmsghdr msgs[HEP_BATCH_MAX];
+	struct iovec iovs[HEP_BATCH_MAX];
+	unsigned int i;
+
+	memset(msgs, 0, sizeof(msgs));
+	for (i = 0; i < count; i++) {
+		iovs[i].iov_base = packets[i];
+		iovs[i].iov_len = lens[i];
+		msgs[i].msg_hdr.msg_name = &hepv3_data->remote_addr.ss;
+		msgs[i].msg_hdr.msg_namelen = hepv3_data->remote_addr.len;
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
 	}
 
-	ast_free(sock_buffer);
-	return res;
+	while (sent < count) {
+		res = sendmmsg(hepv3_data->sockfd, msgs + sent, count - sent, 0);
+		if (res <= 0) {
+			ast_log(AST_LOG_ERROR, "Error [%d] while sending %u packets to HEPv3 server: %s\n",
+				errno, count - sent, strerror(errno));
+			return;
+		}
+		sent += res;
+	}
+#else
+	for (; sent < count; sent++) {
+		res = ast_sendto(hepv3_data->sockfd, packets[sent], lens[sent], 0, &hepv3_data->remote_addr);
+		if (res < 0) {
+			ast_log(AST_LOG_ERROR, "Error [%d] while sending packet to HEPv3 server: %s\n",
+				errno, strerror(errno));
+		} else if (res != lens[sent]) {
+			ast_log(AST_LOG_WARNING, "Failed to send complete packet to HEPv3 server: %d of %u sent\n",
+				res, lens[sent]);
+		}
+	}
+#endif
+}
+
+/*! \brief Callback function for the \ref hep_queue_tp taskprocessor, empties the capture queue */
+static int hep_queue_cb(void *data)
+{
+	RAII_VAR(struct module_config *, config, ao2_global_obj_ref(global_config), ao2_cleanup);
+	RAII_VAR(struct hepv3_runtime_data *, hepv3_data, ao2_global_obj_ref(global_data), ao2_cleanup);
+	struct hepv3_capture_info *batch[HEP_BATCH_MAX];
+	void *packets[HEP_BATCH_MAX];
+	unsigned int lens[HEP_BATCH_MAX];
+	unsigned int count, encoded, dropped, i;
+
+	for (;;) {
+		ast_mutex_lock(&capture_queue.lock);
+		dropped = capture_queue.dropped;
+		capture_queue.dropped = 0;
+		for (count = 0; count < HEP_BATCH_MAX && capture_queue.count; count++) {
+			batch[count] = capture_queue.ring[capture_queue.head];
+			capture_queue.head = (capture_queue.head + 1) % capture_queue.size;
+			capture_queue.count--;
+		}
+		if (!count) {
+			capture_queue.scheduled = 0;
+		}
+		ast_mutex_unlock(&capture_queue.lock);
+
+		if (dropped) {
+			ast_log(AST_LOG_WARNING, "Dropped %u HEPv3 packets, the capture queue is full\n", dropped);
+		}
+
+		if (!count) {
+			break;
+		}
+
+		encoded = 0;
+		for (i = 0; i < count; i++) {
+			if (config && hepv3_data
+				&& (packets[encoded] = hep_build_packet(config, batch[i], &lens[encoded]))) {
+				encoded++;
+			}
+			ao2_ref(batch[i], -1);
+		}
+
+		if (encoded) {
+			hep_send_batch(hepv3_data, packets, lens, encoded);
+		}
+		for (i = 0; i < encoded; i++) {
+			ast_free(packets[i]);
+		}
+	}
+
+	return 0;
+}
+
+/*!
+ * \brief Find the method of a captured SIP message
+ *
+ * Requests use the method on the request line, responses the method
+ * in their CSeq header.
+ *
+ * \retval 0 if a method was found
+ * \retval -1 otherwise
+ */
+static int hep_sip_method(const char *msg, size_t len, const char **method, size_t *method_len)
+{
+	const char *end = msg + len;
+	const char *line = msg;
+	const char *pos;
+
+	if (len < 8 || strncmp(msg, "SIP/2.0 ", 8)) {
+		/* A request, the method is the first token */
+		if (!(pos = memchr(msg, ' ', len))) {
+			return -1;
+		}
+		*method = msg;
+		*method_len = pos - msg;
+		return 0;
+	}
+
+	/* A response, look through the headers for the CSeq */
+	while ((pos = memchr(line, '\n', end - line))) {
+		line = pos + 1;
+		if (line >= end || *line == '\r' || *line == '\n') {
+			/* End of the headers */
+			break;
+		}
+		if (end - line > 5 && !strncasecmp(line, "CSeq:", 5)) {
+			pos = line + 5;
+			while (pos < end && (*pos == ' ' || *pos == '\t')) {
+				pos++;
+			}
+			while (pos < end && isdigit(*pos)) {
+				pos++;
+			}
+			while (pos < end && (*pos == ' ' || *pos == '\t')) {
+				pos++;
+			}
+			*method = pos;
+			while (pos < end && !isspace(*pos)) {
+				pos++;
+			}
+			*method_len = pos - *method;
+			return *method_len ? 0 : -1;
+		}
+	}
+
+	return -1;
+}
+
+/*! \brief Check if a method is in a comma separated list */
+static int hep_method_in_list(const char *list, const char *method, size_t method_len)
+{
+	const char *item = list;
+
+	while (*item) {
+		const char *next = strchr(item, ',');
+		size_t item_len = next ? next - item : strlen(item);
+
+		/* Skip whitespace around the item */
+		while (item_len && isspace(*item)) {
+			item++;
+			item_len--;
+		}
+		while (item_len && isspace(item[item_len - 1])) {
+			item_len--;
+		}
+
+		if (item_len == method_len && !strncasecmp(item, method, method_len)) {
+			return 1;
+		}
+
+		if (!next) {
+			break;
+		}
+		item = next + 1;
+	}
+
+	return 0;
+}
+
+/*!
+ * \brief Decide if a captured packet should be sent
+ *
+ * \retval 1 if the packet should be sent
+ * \retval 0 if the configuration filters it out
+ */
+static int hep_capture_wanted(struct hepv3_global_config *general, struct hepv3_capture_info *capture_info)
+{
+	if (general->sampling_rate < 100) {
+		if (!general->sampling_rate || ast_strlen_zero(capture_info->uuid)) {
+			return 0;
+		}
+		/* Hash the UUID so every packet of a call makes the same decision */
+		if ((unsigned int) ast_str_hash(capture_info->uuid) % 100 >= general->sampling_rate) {
+			return 0;
+		}
+	}
+
+	if (capture_info->capture_type == HEPV3_CAPTURE_TYPE_SIP
+		&& !ast_strlen_zero(general->exclude_methods)) {
+		const char *method;
+		size_t method_len;
+
+		if (!hep_sip_method(capture_info->payload, capture_info->len, &method, &method_len)
+			&& hep_method_in_list(general->exclude_methods, method, method_len)) {
+			return 0;
+		}
+	}
+
+	return 1;
 }
 
 int hepv3_send_packet(struct hepv3_capture_info *capture_info)
 {
 	RAII_VAR(struct module_config *, config, ao2_global_obj_ref(global_config), ao2_cleanup);
-	int res;
+	int res = 0;
 
-	if (!config || !config->general->enabled) {
+	if (!config || !config->general->enabled || !hep_capture_wanted(config->general, capture_info)) {
 		ao2_ref(capture_info, -1);
 		return 0;
 	}
 
-	res = ast_taskprocessor_push(hep_queue_tp, hep_queue_cb, capture_info);
-	if (res == -1) {
+	ast_mutex_lock(&capture_queue.lock);
+	if (capture_queue.count == capture_queue.size) {
+		capture_queue.dropped++;
+		ast_mutex_unlock(&capture_queue.lock);
 		ao2_ref(capture_info, -1);
+		return -1;
+	}
+
+	capture_queue.ring[(capture_queue.head + capture_queue.count) % capture_queue.size] = capture_info;
+	capture_queue.count++;
+
+	if (!capture_queue.scheduled) {
+		res = ast_taskprocessor_push(hep_queue_tp, hep_queue_cb, NULL);
+		/* If the push failed the packet stays queued and the next one tries again */
+		capture_queue.scheduled = !res;
 	}
+	ast_mutex_unlock(&capture_queue.lock);
 
 	return res;
 }
 
+/*!
+ * \brief Resize the capture queue, dropping the oldest packets if they no longer fit
+ */
+static int hep_capture_queue_resize(unsigned int size)
+{
+	struct hepv3_capture_info **ring = NULL;
+	unsigned int count = 0;
+
+	if (size && !(ring = ast_calloc(size, sizeof(*ring)))) {
+		return -1;
+	}
+
+	ast_mutex_lock(&capture_queue.lock);
+	while (capture_queue.count) {
+		struct hepv3_capture_info *capture_info = capture_queue.ring[capture_queue.head];
+
+		capture_queue.head = (capture_queue.head + 1) % capture_queue.size;
+		if (capture_queue.count-- > size) {
+			ao2_ref(capture_info, -1);
+		} else {
+			ring[count++] = capture_info;
+		}
+	}
+	ast_free(capture_queue.ring);
+	capture_queue.ring = ring;
+	capture_queue.size = size;
+	capture_queue.head = 0;
+	capture_queue.count = count;
+	ast_mutex_unlock(&capture_queue.lock);
+
+	return 0;
+}
+
 /*!
  * \brief Pre-apply callback for the config framework.
  *
@@ -615,6 +922,16 @@ static int hepv3_config_pre_apply(void)
 		return -1;
 	}
 
+	if (config->general->sampling_rate > 100) {
+		ast_log(AST_LOG_ERROR, "Configuration option 'sampling_rate' must be between 0 and 100\n");
+		return -1;
+	}
+
+	if (!config->general->queue_size) {
+		ast_log(AST_LOG_ERROR, "Configuration option 'queue_size' must be at least 1\n");
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -629,6 +946,12 @@ static void hepv3_config_post_apply(void)
 	RAII_VAR(struct module_config *, mod_cfg, ao2_global_obj_ref(global_config), ao2_cleanup);
 	struct hepv3_runtime_data *data;
 
+	if (mod_cfg->general->queue_size != capture_queue.size
+		&& hep_capture_queue_resize(mod_cfg->general->queue_size)) {
+		ast_log(AST_LOG_WARNING, "Unable to resize the HEPv3 capture queue to %u\n",
+			mod_cfg->general->queue_size);
+	}
+
 	data = hepv3_data_alloc(mod_cfg->general);
 	if (!data) {
 		return;
@@ -655,6 +978,8 @@ static int reload_module(void)
 static int unload_module(void)
 {
 	hep_queue_tp = ast_taskprocessor_unreference(hep_queue_tp);
+	hep_capture_queue_resize(0);
+	ast_mutex_destroy(&capture_queue.lock);
 
 	ao2_global_obj_release(global_config);
 	ao2_global_obj_release(global_data);
@@ -668,6 +993,8 @@ static int unload_module(void)
  */
 static int load_module(void)
 {
+	ast_mutex_init(&capture_queue.lock);
+
 	if (aco_info_init(&cfg_info)) {
 		goto error;
 	}
@@ -682,6 +1009,9 @@ static int load_module(void)
 	aco_option_register(&cfg_info, "capture_password", ACO_EXACT, global_options, "", OPT_STRINGFIELD_T, 0, STRFLDSET(struct hepv3_global_config, capture_password));
 	aco_option_register(&cfg_info, "capture_id", ACO_EXACT, global_options, "0", OPT_UINT_T, 0, STRFLDSET(struct hepv3_global_config, capture_id));
 	aco_option_register_custom(&cfg_info, "uuid_type", ACO_EXACT, global_options, "call-id", uuid_type_handler, 0);
+	aco_option_register(&cfg_info, "sampling_rate", ACO_EXACT, global_options, "100", OPT_UINT_T, 0, FLDSET(struct hepv3_global_config, sampling_rate));
+	aco_option_register(&cfg_info, "exclude_methods", ACO_EXACT, global_options, "", OPT_STRINGFIELD_T, 0, STRFLDSET(struct hepv3_global_config, exclude_methods));
+	aco_option_register(&cfg_info, "queue_size", ACO_EXACT, global_options, "10000", OPT_UINT_T, 0, FLDSET(struct hepv3_global_config, queue_size));
 
 	if (aco_process_config(&cfg_info, 0) == ACO_PROCESS_ERROR) {
 		goto error;
@@ -690,6 +1020,9 @@ static int load_module(void)
 	return AST_MODULE_LOAD_SUCCESS;
 
 error:
+	hep_queue_tp = ast_taskprocessor_unreference(hep_queue_tp);
+	hep_capture_queue_resize(0);
+	ast_mutex_destroy(&capture_queue.lock);
 	aco_info_destroy(&cfg_info);
 	return AST_MODULE_LOAD_DECLINE;
 }
@@ -234,6 +234,7 @@ static long execute_curl_instance(CURL *curl)
 
 	if (curl_easy_perform(curl)) {
 		ast_log(LOG_WARNING, "%s\n", curl_errbuf);
+		curl_easy_cleanup(curl);
 		return -1;
 	}
 
@@ -296,23 +297,34 @@ static int bucket_http_wizard_is_stale(const struct ast_sorcery *sorcery, void *
 	struct curl_bucket_file_data cb_data = {
 		.bucket_file = bucket_file
 	};
-	char etag_buf[256];
+	char validator_buf[256];
 
 	if (!bucket_file_expired(bucket_file) && !bucket_file_always_revalidate(bucket_file)) {
 		return 0;
 	}
 
-	/* See if we have an ETag for this item. If not, it's stale. */
+	/* See if we have an ETag, or failing that a modification time, to
+	 * revalidate this item with. If not, it's stale.
+	 */
 	metadata = ast_bucket_file_metadata_get(bucket_file, "etag");
-	if (!metadata) {
-		return 1;
+	if (metadata) {
+		snprintf(validator_buf, sizeof(validator_buf), "If-None-Match: %s", metadata->value);
+	} else {
+		metadata = ast_bucket_file_metadata_get(bucket_file, "last-modified");
+		if (!metadata) {
+			return 1;
+		}
+		snprintf(validator_buf, sizeof(validator_buf), "If-Modified-Since: %s", metadata->value);
 	}
 
 	curl = get_curl_instance(&cb_data);
+	if (!curl) {
+		ao2_ref(metadata, -1);
+		return 1;
+	}
 
-	/* Set the ETag header on our outgoing request */
-	snprintf(etag_buf, sizeof(etag_buf), "If-None-Match: %s", metadata->value);
-	header_list = curl_slist_append(header_list, etag_buf);
+	/* Set the validator header on our outgoing request */
+	header_list = curl_slist_append(header_list, validator_buf);
 	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, header_list);
 	curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
 	ao2_ref(metadata, -1);
@@ -24,12 +24,18 @@
  */
 
 /*** MODULEINFO
+	<use type="external">zlib</use>
 	<support_level>core</support_level>
  ***/
 
 #include "asterisk.h"
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 #include "asterisk/module.h"
+#include "asterisk/config.h"
 #include "asterisk/http.h"
 #include "asterisk/astobj2.h"
 #include "asterisk/strings.h"
@@ -84,6 +90,38 @@
 #define MAX_WS_HDR_SZ 14
 #define MIN_WS_HDR_SZ 2
 
+/*! \brief Bit of the first header byte marking a compressed message (RSV1) */
+#define WS_COMPRESSED_BIT 0x40
+
+/*! \brief Largest message permessage-deflate will decompress, to stop payloads that expand without bound */
+#define MAXIMUM_INFLATE_SIZE (MAXIMUM_FRAME_SIZE * 32)
+
+/*! \brief Default zlib compression level for permessage-deflate */
+#define DEFAULT_DEFLATE_LEVEL 6
+
+/*! \brief permessage-deflate settings from the websocket section of http.conf */
+struct websocket_deflate_config {
+	int level;                                   /*!< zlib compression level */
+	unsigned int enabled:1;                      /*!< Bit to indicate compression may be negotiated */
+	unsigned int server_no_context_takeover:1;   /*!< Bit to indicate the server compresses each message on its own */
+	unsigned int client_no_context_takeover:1;   /*!< Bit to indicate the client compresses each message on its own */
+};
+
+/*! \brief Current permessage-deflate settings, applied as sessions are negotiated */
+static struct websocket_deflate_config deflate_config = {
+	.level = DEFAULT_DEFLATE_LEVEL,
+};
+
+AST_MUTEX_DEFINE_STATIC(deflate_config_lock);
+
+/*! \brief Parameters of a permessage-deflate extension offer or response (RFC 7692) */
+struct websocket_deflate_params {
+	int server_max_window_bits;                  /*!< Window the server compresses with, 0 if not given */
+	int client_max_window_bits;                  /*!< Window the client compresses with, 0 if not given, -1 if given without a value */
+	unsigned int server_no_context_takeover:1;   /*!< Bit to indicate the server resets its compressor for each message */
+	unsigned int client_no_context_takeover:1;   /*!< Bit to indicate the client resets its compressor for each message */
+};
+
 /*! \brief Structure definition for session */
 struct ast_websocket {
 	struct ast_iostream *stream;        /*!< iostream of the connection */
@@ -100,8 +138,343 @@ struct ast_websocket {
 	struct websocket_client *client;    /*!< Client object when connected as a client websocket */
 	char session_id[AST_UUID_STR_LEN];  /*!< The identifier for the websocket session */
 	uint16_t close_status_code;         /*!< Status code sent in a CLOSE frame upon shutdown */
+#ifdef HAVE_ZLIB
+	z_stream *deflate;                  /*!< Compressor for outgoing messages, if permessage-deflate is in use */
+	z_stream *inflate;                  /*!< Decompressor for incoming messages, if permessage-deflate is in use */
+#endif
+	unsigned int deflate_reset:1;       /*!< Bit to indicate the compressor is reset after each message */
+	unsigned int inflate_reset:1;       /*!< Bit to indicate the decompressor is reset after each message */
+	unsigned int compressed:1;          /*!< Bit to indicate the message being received is compressed */
 };
 
+#ifdef HAVE_ZLIB
+/*! \brief Release the permessage-deflate state of a session */
+static void websocket_deflate_destroy(struct ast_websocket *session)
+{
+	if (session->deflate) {
+		deflateEnd(session->deflate);
+		ast_free(session->deflate);
+		session->deflate = NULL;
+	}
+	if (session->inflate) {
+		inflateEnd(session->inflate);
+		ast_free(session->inflate);
+		session->inflate = NULL;
+	}
+}
+
+/*!
+ * \internal
+ * \brief Set up permessage-deflate on a session
+ *
+ * \param session The session
+ * \param level zlib compression level
+ * \param window_bits Window our compressor may use, 0 to leave outgoing messages uncompressed
+ * \param deflate_reset Reset the compressor after each outgoing message
+ * \param inflate_reset Reset the decompressor after each incoming message
+ *
+ * \retval 0 success
+ * \retval -1 failure
+ */
+static int websocket_deflate_init(struct ast_websocket *session, int level, int window_bits,
+	int deflate_reset, int inflate_reset)
+{
+	z_stream *stream;
+
+	if (window_bits) {
+		if (!(stream = ast_calloc(1, sizeof(*stream)))) {
+			return -1;
+		}
+		/* A negative window selects a raw deflate stream, without the zlib header */
+		if (deflateInit2(stream, level, Z_DEFLATED, -window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			ast_free(stream);
+			return -1;
+		}
+		session->deflate = stream;
+	}
+
+	if (!(stream = ast_calloc(1, sizeof(*stream)))) {
+		websocket_deflate_destroy(session);
+		return -1;
+	}
+	/* The largest window lets us decompress whatever window the peer chose */
+	if (inflateInit2(stream, -15) != Z_OK) {
+		ast_free(stream);
+		websocket_deflate_destroy(session);
+		return -1;
+	}
+	session->inflate = stream;
+
+	session->deflate_reset = deflate_reset;
+	session->inflate_reset = inflate_reset;
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Compress the payload of an outgoing message
+ *
+ * \param session The session, locked so messages are compressed in the order they are sent
+ * \param opcode Opcode of the message
+ * \param payload Payload of the message
+ * \param[in,out] payload_size Size of the payload, updated to the compressed size
+ *
+ * \return The compressed payload, to be freed by the caller
+ * \retval NULL the payload should be sent uncompressed
+ */
+static char *websocket_deflate(struct ast_websocket *session, enum ast_websocket_opcode opcode,
+	const char *payload, uint64_t *payload_size)
+{
+	z_stream *stream = session->deflate;
+	size_t compressed_size;
+	char *compressed;
+
+	if (!stream || !*payload_size || *payload_size > UINT_MAX
+		|| (opcode != AST_WEBSOCKET_OPCODE_TEXT && opcode != AST_WEBSOCKET_OPCODE_BINARY)) {
+		return NULL;
+	}
+
+	/* A sync flush adds an empty stored block on top of the usual bound */
+	compressed_size = deflateBound(stream, *payload_size) + 16;
+	if (!(compressed = ast_malloc(compressed_size))) {
+		return NULL;
+	}
+
+	stream->next_in = (Bytef *) payload;
+	stream->avail_in = *payload_size;
+	stream->next_out = (Bytef *) compressed;
+	stream->avail_out = compressed_size;
+
+	if (deflate(stream, Z_SYNC_FLUSH) != Z_OK || stream->avail_in || !stream->avail_out) {
+		/*
+		 * The compressor now remembers data the peer never receives, so it has
+		 * to forget everything before it may be used again.
+		 */
+		deflateReset(stream);
+		ast_free(compressed);
+		return NULL;
+	}
+
+	/* RFC 7692 section 7.2.1: the trailing 0x00 0x00 0xff 0xff of the flush is not sent */
+	compressed_size -= stream->avail_out + 4;
+
+	if (session->deflate_reset) {
+		deflateReset(stream);
+	}
+
+	if (compressed_size >= *payload_size) {
+		/* Not worth it, but the peer must not see references to data it does not have */
+		if (!session->deflate_reset) {
+			deflateReset(stream);
+		}
+		ast_free(compressed);
+		return NULL;
+	}
+
+	*payload_size = compressed_size;
+	return compressed;
+}
+
+/*!
+ * \internal
+ * \brief Decompress data onto the end of the payload being reconstructed
+ *
+ * \retval 0 success
+ * \retval -1 the data is not valid or expands beyond \ref MAXIMUM_INFLATE_SIZE
+ */
+static int websocket_inflate_data(struct ast_websocket *session, const char *data, size_t data_len)
+{
+	z_stream *stream = session->inflate;
+	int res;
+
+	stream->next_in = (Bytef *) data;
+	stream->avail_in = data_len;
+
+	do {
+		size_t available = MAX(session->payload_len, 4096);
+		char *new_payload;
+
+		if (session->payload_len + available > MAXIMUM_INFLATE_SIZE) {
+			available = MAXIMUM_INFLATE_SIZE - session->payload_len;
+			if (!available) {
+				ast_log(LOG_WARNING, "Compressed websocket message expands beyond %d bytes\n",
+					MAXIMUM_INFLATE_SIZE);
+				return -1;
+			}
+		}
+
+		if (!(new_payload = ast_realloc(session->payload, session->payload_len + available))) {
+			return -1;
+		}
+		session->payload = new_payload;
+
+		stream->next_out = (Bytef *) session->payload + session->payload_len;
+		stream->avail_out = available;
+		res = inflate(stream, Z_SYNC_FLUSH);
+		session->payload_len += available - stream->avail_out;
+
+		if (res == Z_STREAM_END) {
+			/* The peer ended the block with BFINAL set, what follows starts afresh */
+			inflateReset(stream);
+		} else if (res == Z_BUF_ERROR && stream->avail_out) {
+			/* No progress is possible because all of the input has been used */
+			break;
+		} else if (res != Z_OK && res != Z_BUF_ERROR) {
+			ast_log(LOG_WARNING, "Unable to decompress websocket message: %s\n",
+				stream->msg ? stream->msg : "unknown error");
+			return -1;
+		}
+	} while (stream->avail_in || !stream->avail_out);
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Decompress a frame of a compressed message
+ *
+ * \param session The session
+ * \param payload Payload of the frame
+ * \param payload_len Length of the payload
+ * \param fin Whether this is the last frame of the message
+ *
+ * \retval 0 success
+ * \retval -1 failure
+ */
+static int websocket_inflate(struct ast_websocket *session, const char *payload, size_t payload_len, int fin)
+{
+	/* The tail the sender removed from the end of the message, see websocket_deflate */
+	static const char tail[] = { 0x00, 0x00, 0xff, 0xff };
+
+	if (payload_len && websocket_inflate_data(session, payload, payload_len)) {
+		return -1;
+	}
+
+	if (!fin) {
+		return 0;
+	}
+
+	if (websocket_inflate_data(session, tail, sizeof(tail))) {
+		return -1;
+	}
+
+	if (session->inflate_reset) {
+		inflateReset(session->inflate);
+	}
+
+	return 0;
+}
+#else
+static void websocket_deflate_destroy(struct ast_websocket *session)
+{
+}
+
+static int websocket_deflate_init(struct ast_websocket *session, int level, int window_bits,
+	int deflate_reset, int inflate_reset)
+{
+	return -1;
+}
+
+static char *websocket_deflate(struct ast_websocket *session, enum ast_websocket_opcode opcode,
+	const char *payload, uint64_t *payload_size)
+{
+	return NULL;
+}
+
+static int websocket_inflate(struct ast_websocket *session, const char *payload, size_t payload_len, int fin)
+{
+	return -1;
+}
+#endif
+
+/*!
+ * \internal
+ * \brief Parse a window size parameter of a permessage-deflate extension
+ *
+ * \retval 0 success
+ * \retval -1 the value is missing or out of range
+ */
+static int websocket_deflate_window_bits(const char *value, int *window_bits)
+{
+	if (!value || sscanf(value, "%30d", window_bits) != 1 || *window_bits < 8 || *window_bits > 15) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Parse one permessage-deflate extension offer or response
+ *
+ * \param extension A single extension from a Sec-WebSocket-Extensions header, modified
+ * \param[out] params The parameters of the extension
+ *
+ * \retval 0 success
+ * \retval -1 the extension is not permessage-deflate or has unknown, repeated or invalid parameters
+ */
+static int websocket_deflate_params_parse(char *extension, struct websocket_deflate_params *params)
+{
+	char *param;
+
+	memset(params, 0, sizeof(*params));
+
+	if (strcasecmp(ast_strip(strsep(&extension, ";")), "permessage-deflate")) {
+		return -1;
+	}
+
+	while ((param = strsep(&extension, ";"))) {
+		char *value = param;
+
+		param = ast_strip(strsep(&value, "="));
+		if (value) {
+			value = ast_strip_quoted(ast_strip(value), "\"", "\"");
+		}
+
+		if (!strcasecmp(param, "server_no_context_takeover")
+			&& !value && !params->server_no_context_takeover) {
+			params->server_no_context_takeover = 1;
+		} else if (!strcasecmp(param, "client_no_context_takeover")
+			&& !value && !params->client_no_context_takeover) {
+			params->client_no_context_takeover = 1;
+		} else if (!strcasecmp(param, "server_max_window_bits") && !params->server_max_window_bits) {
+			if (websocket_deflate_window_bits(value, &params->server_max_window_bits)) {
+				return -1;
+			}
+		} else if (!strcasecmp(param, "client_max_window_bits") && !params->client_max_window_bits) {
+			if (!value) {
+				params->client_max_window_bits = -1;
+			} else if (websocket_deflate_window_bits(value, &params->client_max_window_bits)) {
+				return -1;
+			}
+		} else {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*! \brief Format permessage-deflate parameters as a Sec-WebSocket-Extensions value */
+static char *websocket_deflate_params_str(const struct websocket_deflate_params *params, char *buf, size_t size)
+{
+	int res = snprintf(buf, size, "permessage-deflate%s%s",
+		params->server_no_context_takeover ? "; server_no_context_takeover" : "",
+		params->client_no_context_takeover ? "; client_no_context_takeover" : "");
+
+	if (params->server_max_window_bits && res < size) {
+		res += snprintf(buf + res, size - res, "; server_max_window_bits=%d", params->server_max_window_bits);
+	}
+	if (params->client_max_window_bits > 0 && res < size) {
+		snprintf(buf + res, size - res, "; client_max_window_bits=%d", params->client_max_window_bits);
+	} else if (params->client_max_window_bits && res < size) {
+		snprintf(buf + res, size - res, "; client_max_window_bits");
+	}
+
+	return buf;
+}
+
 /*! \brief Hashing function for protocols */
 static int protocol_hash_fn(const void *obj, const int flags)
 {
@@ -185,6 +558,7 @@ static void session_destroy_fn(void *obj)
 
 	ao2_cleanup(session->client);
 	ast_free(session->payload);
+	websocket_deflate_destroy(session);
 }
 
 struct ast_websocket_protocol *AST_OPTIONAL_API_NAME(ast_websocket_sub_protocol_alloc)(const char *name)
@@ -341,16 +715,19 @@ static const char *websocket_opcode2str(enum ast_websocket_opcode opcode)
 	}
 }
 
-/*! \brief Write function for websocket traffic */
-int AST_OPTIONAL_API_NAME(ast_websocket_write)(struct ast_websocket *session, enum ast_websocket_opcode opcode, char *payload, uint64_t payload_size)
+/*! \brief Largest frame header, with a 64 bit extended length */
+#define MAX_FRAME_HEADER_SIZE 10
+
+/*!
+ * \internal
+ * \brief Fill in the header of an outgoing frame
+ *
+ * \return Size of the header written to \a frame.
+ */
+static size_t websocket_frame_header(char *frame, enum ast_websocket_opcode opcode, int compressed, uint64_t payload_size)
 {
 	size_t header_size = 2; /* The minimum size of a websocket frame is 2 bytes */
-	char *frame;
 	uint64_t length;
-	uint64_t frame_size;
-
-	ast_debug(3, "Writing websocket %s frame, length %" PRIu64 "\n",
-			websocket_opcode2str(opcode), payload_size);
 
 	if (payload_size < 126) {
 		length = payload_size;
@@ -364,12 +741,7 @@ int AST_OPTIONAL_API_NAME(ast_websocket_write)(struct ast_websocket *session, en
 		header_size += 8;
 	}
 
-	frame_size = header_size + payload_size;
-
-	frame = ast_alloca(frame_size + 1);
-	memset(frame, 0, frame_size + 1);
-
-	frame[0] = opcode | 0x80;
+	frame[0] = opcode | 0x80 | (compressed ? WS_COMPRESSED_BIT : 0);
 	frame[1] = length;
 
 	/* Use the additional available bytes to store the length */
@@ -379,8 +751,12 @@ int AST_OPTIONAL_API_NAME(ast_websocket_write)(struct ast_websocket *session, en
 		put_unaligned_uint64(&frame[2], htonll(payload_size));
 	}
 
-	memcpy(&frame[header_size], payload, payload_size);
+	return header_size;
+}
 
+/*! \internal \brief Write complete frames to the session in one write */
+static int websocket_write_frames(struct ast_websocket *session, char *frames, uint64_t frames_size)
+{
 	ao2_lock(session);
 	if (session->closing) {
 		ao2_unlock(session);
@@ -388,7 +764,7 @@ int AST_OPTIONAL_API_NAME(ast_websocket_write)(struct ast_websocket *session, en
 	}
 
 	ast_iostream_set_timeout_sequence(session->stream, ast_tvnow(), session->timeout);
-	if (ast_iostream_write(session->stream, frame, frame_size) != frame_size) {
+	if (ast_iostream_write(session->stream, frames, frames_size) != frames_size) {
 		ao2_unlock(session);
 		/* 1011 - server terminating connection due to not being able to fulfill the request */
 		ast_debug(1, "Closing WS with 1011 because we can't fulfill a write request\n");
@@ -402,6 +778,73 @@ int AST_OPTIONAL_API_NAME(ast_websocket_write)(struct ast_websocket *session, en
 	return 0;
 }
 
+/*! \brief Write function for websocket traffic */
+int AST_OPTIONAL_API_NAME(ast_websocket_write)(struct ast_websocket *session, enum ast_websocket_opcode opcode, char *payload, uint64_t payload_size)
+{
+	size_t header_size;
+	char *compressed;
+	char *frame;
+	int res;
+
+	ast_debug(3, "Writing websocket %s frame, length %" PRIu64 "\n",
+			websocket_opcode2str(opcode), payload_size);
+
+	/* Messages have to reach the wire in the order they were compressed */
+	ao2_lock(session);
+	if ((compressed = websocket_deflate(session, opcode, payload, &payload_size))) {
+		payload = compressed;
+	}
+
+	frame = ast_alloca(MAX_FRAME_HEADER_SIZE + payload_size + 1);
+	header_size = websocket_frame_header(frame, opcode, compressed != NULL, payload_size);
+	memcpy(&frame[header_size], payload, payload_size);
+	ast_free(compressed);
+
+	res = websocket_write_frames(session, frame, header_size + payload_size);
+	ao2_unlock(session);
+
+	return res;
+}
+
+int AST_OPTIONAL_API_NAME(ast_websocket_write_batch)(struct ast_websocket *session,
+	enum ast_websocket_opcode opcode, char **payloads, const uint64_t *payload_sizes, size_t count)
+{
+	uint64_t frames_size = 0;
+	uint64_t offset = 0;
+	char *frames;
+	size_t idx;
+	int res;
+
+	ast_debug(3, "Writing %zu websocket %s frames\n", count, websocket_opcode2str(opcode));
+
+	for (idx = 0; idx < count; ++idx) {
+		frames_size += MAX_FRAME_HEADER_SIZE + payload_sizes[idx];
+	}
+
+	frames = ast_malloc(frames_size + 1);
+	if (!frames) {
+		return -1;
+	}
+
+	/* A compressed payload is never larger than the original, so the frames still fit */
+	ao2_lock(session);
+	for (idx = 0; idx < count; ++idx) {
+		uint64_t payload_size = payload_sizes[idx];
+		char *compressed = websocket_deflate(session, opcode, payloads[idx], &payload_size);
+
+		offset += websocket_frame_header(&frames[offset], opcode, compressed != NULL, payload_size);
+		memcpy(&frames[offset], compressed ?: payloads[idx], payload_size);
+		offset += payload_size;
+		ast_free(compressed);
+	}
+
+	res = websocket_write_frames(session, frames, offset);
+	ao2_unlock(session);
+	ast_free(frames);
+
+	return res;
+}
+
 void AST_OPTIONAL_API_NAME(ast_websocket_reconstruct_enable)(struct ast_websocket *session, size_t bytes)
 {
 	session->reconstruct = MIN(bytes, MAXIMUM_RECONSTRUCTION_CEILING);
@@ -657,7 +1100,26 @@ int AST_OPTIONAL_API_NAME(ast_websocket_read)(struct ast_websocket *session, cha
 		}
 
 		/* Below this point we are handling TEXT, BINARY or CONTINUATION opcodes */
-		if (*payload_len) {
+		if ((buf[0] & WS_COMPRESSED_BIT)
+			&& (*opcode == AST_WEBSOCKET_OPCODE_CONTINUATION || !session->inflate)) {
+			ast_log(LOG_WARNING, "WebSocket frame has an unexpected compression bit\n");
+			*payload_len = 0;
+			ast_websocket_close(session, 1002);
+			return -1;
+		}
+
+		/* Only the first frame of a message says whether the message is compressed */
+		if (*opcode != AST_WEBSOCKET_OPCODE_CONTINUATION) {
+			session->compressed = (buf[0] & WS_COMPRESSED_BIT) ? 1 : 0;
+		}
+
+		if (session->compressed) {
+			if (websocket_inflate(session, *payload, *payload_len, fin)) {
+				*payload_len = 0;
+				ast_websocket_close(session, 1007);
+				return -1;
+			}
+		} else if (*payload_len) {
 			if (!(new_payload = ast_realloc(session->payload, (session->payload_len + *payload_len)))) {
 				ast_log(LOG_WARNING, "Failed allocation: %p, %zu, %"PRIu64"\n",
 					session->payload, session->payload_len, *payload_len);
@@ -747,6 +1209,66 @@ static void websocket_bad_request(struct ast_tcptls_session_instance *ser)
 	ast_http_send(ser, AST_HTTP_UNKNOWN, 400, "Bad Request", http_header, NULL, 0, 0);
 }
 
+/*!
+ * \internal
+ * \brief Accept the first permessage-deflate offer of a client that the server supports
+ *
+ * \param session The session being established
+ * \param headers Headers of the upgrade request
+ * \param[out] buf Filled in with the Sec-WebSocket-Extensions response header, or left empty
+ * \param size Size of \a buf
+ */
+static void websocket_deflate_accept(struct ast_websocket *session, struct ast_variable *headers,
+	char *buf, size_t size)
+{
+	struct websocket_deflate_config config;
+	struct websocket_deflate_params params;
+	struct ast_variable *v;
+	char extension[128];
+
+	*buf = '\0';
+
+	ast_mutex_lock(&deflate_config_lock);
+	config = deflate_config;
+	ast_mutex_unlock(&deflate_config_lock);
+
+	if (!config.enabled) {
+		return;
+	}
+
+	for (v = headers; v; v = v->next) {
+		char *offers;
+		char *offer;
+
+		if (strcasecmp(v->name, "Sec-WebSocket-Extensions")) {
+			continue;
+		}
+
+		offers = ast_strdupa(v->value);
+		while ((offer = strsep(&offers, ","))) {
+			/* zlib can not compress with the 256 byte window RFC 7692 also allows */
+			if (websocket_deflate_params_parse(offer, &params) || params.server_max_window_bits == 8) {
+				continue;
+			}
+
+			params.server_no_context_takeover |= config.server_no_context_takeover;
+			params.client_no_context_takeover |= config.client_no_context_takeover;
+			/* Any window can be decompressed, so the client is free to choose its own */
+			params.client_max_window_bits = 0;
+
+			if (websocket_deflate_init(session, config.level, params.server_max_window_bits ?: 15,
+				params.server_no_context_takeover, params.client_no_context_takeover)) {
+				ast_log(LOG_WARNING, "Unable to set up permessage-deflate, continuing without compression\n");
+				return;
+			}
+
+			snprintf(buf, size, "Sec-WebSocket-Extensions: %s\r\n",
+				websocket_deflate_params_str(&params, extension, sizeof(extension)));
+			return;
+		}
+	}
+}
+
 int AST_OPTIONAL_API_NAME(ast_websocket_uri_cb)(struct ast_tcptls_session_instance *ser, const struct ast_http_uri *urih, const char *uri, enum ast_http_method method, struct ast_variable *get_vars, struct ast_variable *headers)
 {
 	struct ast_variable *v;
@@ -832,6 +1354,7 @@ int AST_OPTIONAL_API_NAME(ast_websocket_uri_cb)(struct ast_tcptls_session_instan
 	/* Determine how to respond depending on the version */
 	if (version == 7 || version == 8 || version == 13) {
 		char base64[64];
+		char extensions[160];
 
 		if (!key || strlen(key) + strlen(WEBSOCKET_GUID) + 1 > 8192) { /* no stack overflows please */
 			websocket_bad_request(ser);
@@ -872,6 +1395,8 @@ int AST_OPTIONAL_API_NAME(ast_websocket_uri_cb)(struct ast_tcptls_session_instan
 			return 0;
 		}
 
+		websocket_deflate_accept(session, headers, extensions, sizeof(extensions));
+
 		/* RFC 6455, Section 4.1:
 		 *
 		 * 6. If the response includes a |Sec-WebSocket-Protocol| header
@@ -887,18 +1412,22 @@ int AST_OPTIONAL_API_NAME(ast_websocket_uri_cb)(struct ast_tcptls_session_instan
 				"Upgrade: %s\r\n"
 				"Connection: Upgrade\r\n"
 				"Sec-WebSocket-Accept: %s\r\n"
-				"Sec-WebSocket-Protocol: %s\r\n\r\n",
+				"Sec-WebSocket-Protocol: %s\r\n"
+				"%s\r\n",
 				upgrade,
 				websocket_combine_key(key, base64, sizeof(base64)),
-				protocol);
+				protocol,
+				extensions);
 		} else {
 			ast_iostream_printf(ser->stream,
 				"HTTP/1.1 101 Switching Protocols\r\n"
 				"Upgrade: %s\r\n"
 				"Connection: Upgrade\r\n"
-				"Sec-WebSocket-Accept: %s\r\n\r\n",
+				"Sec-WebSocket-Accept: %s\r\n"
+				"%s\r\n",
 				upgrade,
-				websocket_combine_key(key, base64, sizeof(base64)));
+				websocket_combine_key(key, base64, sizeof(base64)),
+				extensions);
 		}
 	} else {
 
@@ -1165,6 +1694,12 @@ struct websocket_client {
 	struct ast_tcptls_session_args *args;
 	/*! tcptls connection instance */
 	struct ast_tcptls_session_instance *ser;
+	/*! permessage-deflate settings when the client was created */
+	struct websocket_deflate_config deflate_config;
+	/*! permessage-deflate parameters accepted by the server */
+	struct websocket_deflate_params deflate;
+	/*! whether the server accepted permessage-deflate */
+	int deflate_accepted;
 };
 
 static void websocket_client_destroy(void *obj)
@@ -1220,6 +1755,10 @@ static struct ast_websocket * websocket_client_create(
 	}
 	ws->client->protocols = ast_strdup(protocols);
 
+	ast_mutex_lock(&deflate_config_lock);
+	ws->client->deflate_config = deflate_config;
+	ast_mutex_unlock(&deflate_config_lock);
+
 	ws->client->version = 13;
 	ws->opcode = -1;
 	ws->reconstruct = DEFAULT_RECONSTRUCTION_CEILING;
@@ -1315,9 +1854,15 @@ static enum ast_websocket_result websocket_client_handshake_get_response(
 			}
 			client->accept_protocol = ast_strdup(value);
 		} else if (!strcasecmp(name, "sec-websocket-extensions")) {
-			ast_log(LOG_ERROR, "Extensions received, but not "
-				"supported by client\n");
-			return WS_NOT_SUPPORTED;
+			/* Only permessage-deflate is offered, and the server must fix its window */
+			if (!client->deflate_config.enabled || client->deflate_accepted
+				|| websocket_deflate_params_parse(value, &client->deflate)
+				|| client->deflate.client_max_window_bits < 0) {
+				ast_log(LOG_ERROR, "Extensions received, but not "
+					"supported by client\n");
+				return WS_NOT_SUPPORTED;
+			}
+			client->deflate_accepted = 1;
 		}
 	}
 	return has_upgrade && has_connection && has_accept ?
@@ -1328,12 +1873,25 @@ static enum ast_websocket_result websocket_client_handshake(
 	struct websocket_client *client)
 {
 	char protocols[100] = "";
+	char extensions[160] = "";
 
 	if (!ast_strlen_zero(client->protocols)) {
 		sprintf(protocols, "Sec-WebSocket-Protocol: %s\r\n",
 			client->protocols);
 	}
 
+	if (client->deflate_config.enabled) {
+		struct websocket_deflate_params offer = {
+			.client_max_window_bits = -1,
+			.server_no_context_takeover = client->deflate_config.server_no_context_takeover,
+			.client_no_context_takeover = client->deflate_config.client_no_context_takeover,
+		};
+		char extension[128];
+
+		snprintf(extensions, sizeof(extensions), "Sec-WebSocket-Extensions: %s\r\n",
+			websocket_deflate_params_str(&offer, extension, sizeof(extension)));
+	}
+
 	if (ast_iostream_printf(client->ser->stream,
 			"GET /%s HTTP/1.1\r\n"
 			"Sec-WebSocket-Version: %d\r\n"
@@ -1341,11 +1899,13 @@ static enum ast_websocket_result websocket_client_handshake(
 			"Connection: Upgrade\r\n"
 			"Host: %s\r\n"
 			"Sec-WebSocket-Key: %s\r\n"
+			"%s"
 			"%s\r\n",
 			client->resource_name ? ast_str_buffer(client->resource_name) : "",
 			client->version,
 			client->host,
 			client->key,
+			extensions,
 			protocols) < 0) {
 		ast_log(LOG_ERROR, "Failed to send handshake.\n");
 		return WS_WRITE_ERROR;
@@ -1370,6 +1930,19 @@ static enum ast_websocket_result websocket_client_connect(struct ast_websocket *
 		return res;
 	}
 
+	if (ws->client->deflate_accepted) {
+		int window_bits = ws->client->deflate.client_max_window_bits ?: 15;
+
+		/* zlib can not compress with a 256 byte window, so only receive compressed messages */
+		if (websocket_deflate_init(ws, ws->client->deflate_config.level, window_bits == 8 ? 0 : window_bits,
+			ws->client->deflate.client_no_context_takeover || ws->client->deflate_config.client_no_context_takeover,
+			ws->client->deflate.server_no_context_takeover)) {
+			ao2_ref(ws->client->ser, -1);
+			ws->client->ser = NULL;
+			return WS_ALLOCATE_ERROR;
+		}
+	}
+
 	ws->stream = ws->client->ser->stream;
 	ws->secure = ast_iostream_get_ssl(ws->stream) ? 1 : 0;
 	ws->client->ser->stream = NULL;
@@ -1453,8 +2026,61 @@ int AST_OPTIONAL_API_NAME(ast_websocket_write_string)
 				   (char *)buf, len);
 }
 
+/*! \brief Load the websocket section of http.conf */
+static int websocket_load_config(int reload)
+{
+	struct websocket_deflate_config config = {
+		.level = DEFAULT_DEFLATE_LEVEL,
+	};
+	struct ast_flags config_flags = { reload ? CONFIG_FLAG_FILEUNCHANGED : 0 };
+	struct ast_config *cfg;
+	struct ast_variable *v;
+
+	cfg = ast_config_load2("http.conf", "res_http_websocket", config_flags);
+	if (cfg == CONFIG_STATUS_FILEUNCHANGED) {
+		return 0;
+	} else if (cfg == CONFIG_STATUS_FILEINVALID) {
+		ast_log(LOG_ERROR, "Contents of http.conf are invalid and cannot be parsed\n");
+		return -1;
+	}
+
+	for (v = cfg ? ast_variable_browse(cfg, "websocket") : NULL; v; v = v->next) {
+		if (!strcasecmp(v->name, "permessage_deflate")) {
+			config.enabled = ast_true(v->value);
+		} else if (!strcasecmp(v->name, "server_no_context_takeover")) {
+			config.server_no_context_takeover = ast_true(v->value);
+		} else if (!strcasecmp(v->name, "client_no_context_takeover")) {
+			config.client_no_context_takeover = ast_true(v->value);
+		} else if (!strcasecmp(v->name, "deflate_level")) {
+			if (sscanf(v->value, "%30d", &config.level) != 1 || config.level < 1 || config.level > 9) {
+				ast_log(LOG_WARNING, "Invalid deflate_level '%s' at line %d of http.conf, using %d\n",
+					v->value, v->lineno, DEFAULT_DEFLATE_LEVEL);
+				config.level = DEFAULT_DEFLATE_LEVEL;
+			}
+		} else {
+			ast_log(LOG_WARNING, "Ignoring unknown websocket option '%s' in http.conf\n", v->name);
+		}
+	}
+
+#ifndef HAVE_ZLIB
+	if (config.enabled) {
+		ast_log(LOG_WARNING, "permessage_deflate requires zlib, which Asterisk was built without\n");
+		config.enabled = 0;
+	}
+#endif
+
+	ast_mutex_lock(&deflate_config_lock);
+	deflate_config = config;
+	ast_mutex_unlock(&deflate_config_lock);
+
+	ast_config_destroy(cfg);
+	return 0;
+}
+
 static int load_module(void)
 {
+	websocket_load_config(0);
+
 	websocketuri.data = websocket_server_internal_create();
 	if (!websocketuri.data) {
 		return AST_MODULE_LOAD_DECLINE;
@@ -1475,10 +2101,16 @@ static int unload_module(void)
 	return 0;
 }
 
+static int reload_module(void)
+{
+	return websocket_load_config(1) ? AST_MODULE_LOAD_DECLINE : AST_MODULE_LOAD_SUCCESS;
+}
+
 AST_MODULE_INFO(ASTERISK_GPL_KEY, AST_MODFLAG_GLOBAL_SYMBOLS | AST_MODFLAG_LOAD_ORDER, "HTTP WebSocket Support",
 	.support_level = AST_MODULE_SUPPORT_EXTENDED,
 	.load = load_module,
 	.unload = unload_module,
+	.reload = reload_module,
 	.load_pri = AST_MODPRI_CHANNEL_DEPEND,
 	.requires = "http",
 );
@@ -74,6 +74,8 @@
 #include "asterisk/poll-compat.h"
 
 #define INITIAL_NUM_FILES   8
+/*! Frames of each format kept by the shared reader of a class */
+#define MOH_SHARED_FRAMES	16
 #define HANDLE_REF	1
 #define DONT_UNREF	0
 
@@ -152,6 +154,7 @@ struct moh_files_state {
 #define MOH_CACHERTCLASSES	(1 << 5)	/*!< Should we use a separate instance of MOH for each user or not */
 #define MOH_ANNOUNCEMENT	(1 << 6)	/*!< Do we play announcement files between songs on this channel? */
 #define MOH_PREFERCHANNELCLASS	(1 << 7)	/*!< Should queue moh override channel moh */
+#define MOH_SHARED		(1 << 8)	/*!< Do all channels listen to one reader of the files? */
 
 /* Custom astobj2 flag */
 #define MOH_NOTDELETED          (1 << 30)       /*!< Find only records that aren't deleted? */
@@ -195,10 +198,42 @@ struct mohclass {
 	/*! Created on the fly, from RT engine */
 	unsigned int realtime:1;
 	unsigned int delete:1;
+	/*! Tells the shared reader to exit */
+	unsigned int shared_stop:1;
+	/*! Reader of a shared files mode class (AST_PTHREADT_NULL if not shared) */
+	pthread_t shared_thread;
+	/*! Number of frames the shared reader has produced */
+	unsigned int shared_seq;
+	/*! Formats the channels listening to the shared reader take */
+	AST_LIST_HEAD_NOLOCK(, moh_shared_format) shared_formats;
 	AST_LIST_HEAD_NOLOCK(, mohdata) members;
 	AST_LIST_ENTRY(mohclass) list;
 };
 
+/*! \brief Frames of the shared reader of a class, in one format */
+struct moh_shared_format {
+	/*! Format of the frames */
+	struct ast_format *format;
+	/*! Format of the file translated from */
+	struct ast_format *src;
+	/*! Translator from src (NULL if no translation is needed) */
+	struct ast_trans_pvt *trans;
+	/*! Frames produced, indexed by sequence number.  (May be lists or NULL) */
+	struct ast_frame *frames[MOH_SHARED_FRAMES];
+	/*! Number of channels taking this format */
+	int listeners;
+	AST_LIST_ENTRY(moh_shared_format) list;
+};
+
+/*! \brief A channel listening to the shared reader of a class */
+struct moh_shared_listener {
+	struct mohclass *class;
+	/*! Format the channel takes */
+	struct moh_shared_format *format;
+	/*! Sequence number of the next frame to send */
+	unsigned int seq;
+};
+
 struct mohdata {
 	int pipe[2];
 	struct ast_format *origwfmt;
@@ -565,6 +600,442 @@ static struct ast_generator moh_file_stream = {
 	.write_format_change = moh_files_write_format_change,
 };
 
+/*!
+ * \internal
+ * \brief Get the extension of a file in the filearray of a class.
+ *
+ * \note moh_add_file() keeps it after the terminator of the name.
+ */
+static const char *moh_file_ext(const char *file)
+{
+	return file + strlen(file) + 1;
+}
+
+static void moh_shared_format_destroy(struct moh_shared_format *entry)
+{
+	int i;
+
+	for (i = 0; i < MOH_SHARED_FRAMES; ++i) {
+		if (entry->frames[i]) {
+			ast_frfree(entry->frames[i]);
+		}
+	}
+	if (entry->trans) {
+		ast_translator_free_path(entry->trans);
+	}
+	ao2_cleanup(entry->src);
+	ao2_cleanup(entry->format);
+	ast_free(entry);
+}
+
+/*!
+ * \internal
+ * \brief Make a listener take frames in another format.
+ *
+ * \note Call with the class locked.
+ *
+ * \retval 0 on success
+ * \retval -1 on failure, the listener then has no format
+ */
+static int moh_shared_listen(struct moh_shared_listener *listener, struct ast_format *format)
+{
+	struct mohclass *class = listener->class;
+	struct moh_shared_format *entry;
+
+	if (listener->format && --listener->format->listeners == 0) {
+		AST_LIST_REMOVE(&class->shared_formats, listener->format, list);
+		moh_shared_format_destroy(listener->format);
+	}
+	listener->format = NULL;
+
+	if (!format) {
+		return 0;
+	}
+
+	AST_LIST_TRAVERSE(&class->shared_formats, entry, list) {
+		if (ast_format_cmp(entry->format, format) == AST_FORMAT_CMP_EQUAL) {
+			break;
+		}
+	}
+	if (!entry) {
+		if (!(entry = ast_calloc(1, sizeof(*entry)))) {
+			return -1;
+		}
+		entry->format = ao2_bump(format);
+		AST_LIST_INSERT_TAIL(&class->shared_formats, entry, list);
+	}
+
+	++entry->listeners;
+	listener->format = entry;
+	/* Join at the frame the reader makes next */
+	listener->seq = class->shared_seq;
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Copy a frame and the frames following it.
+ */
+static struct ast_frame *moh_shared_dup(struct ast_frame *f)
+{
+	struct ast_frame *head = NULL;
+	struct ast_frame *tail = NULL;
+	struct ast_frame *dup;
+
+	for (; f; f = AST_LIST_NEXT(f, frame_list)) {
+		if (!(dup = ast_frdup(f))) {
+			break;
+		}
+		if (tail) {
+			AST_LIST_NEXT(tail, frame_list) = dup;
+		} else {
+			head = dup;
+		}
+		tail = dup;
+	}
+
+	return head;
+}
+
+/*!
+ * \internal
+ * \brief Turn a frame read from a file into the frames for every listening format.
+ *
+ * \note Call with the class locked.
+ */
+static void moh_shared_produce(struct mohclass *class, struct ast_frame *f)
+{
+	int slot = class->shared_seq % MOH_SHARED_FRAMES;
+	struct moh_shared_format *entry;
+
+	AST_LIST_TRAVERSE(&class->shared_formats, entry, list) {
+		struct ast_frame *out = NULL;
+
+		if (entry->frames[slot]) {
+			ast_frfree(entry->frames[slot]);
+			entry->frames[slot] = NULL;
+		}
+
+		if (ast_format_cmp(entry->format, f->subclass.format) == AST_FORMAT_CMP_EQUAL) {
+			entry->frames[slot] = ast_frdup(f);
+			continue;
+		}
+
+		if (!entry->src || ast_format_cmp(entry->src, f->subclass.format) != AST_FORMAT_CMP_EQUAL) {
+			/* The file changed format, or this is the first frame for this format */
+			if (entry->trans) {
+				ast_translator_free_path(entry->trans);
+			}
+			ao2_replace(entry->src, f->subclass.format);
+			entry->trans = ast_translator_build_path(entry->format, entry->src);
+			if (!entry->trans) {
+				ast_log(LOG_WARNING, "No translator from %s to %s for music on hold class '%s'\n",
+					ast_format_get_name(entry->src), ast_format_get_name(entry->format), class->name);
+			}
+		}
+
+		if (entry->trans && (out = ast_translate(entry->trans, f, 0))) {
+			entry->frames[slot] = moh_shared_dup(out);
+		}
+	}
+
+	++class->shared_seq;
+}
+
+/*!
+ * \internal
+ * \brief Open the next file the shared reader of a class plays.
+ *
+ * \param class The class
+ * \param pos Position of the file played last in the filearray, updated
+ */
+static struct ast_filestream *moh_shared_next(struct mohclass *class, int *pos)
+{
+	char name[PATH_MAX];
+	char ext[16];
+	struct ast_filestream *stream = NULL;
+	int tries;
+	int total;
+
+	ao2_lock(class);
+	total = class->total_files;
+	ao2_unlock(class);
+
+	for (tries = 0; !stream && tries < total; ++tries) {
+		ao2_lock(class);
+		if (!class->total_files) {
+			ao2_unlock(class);
+			break;
+		}
+		if (ast_test_flag(class, MOH_SORTMODE) == MOH_RANDOMIZE) {
+			*pos = ast_random() % class->total_files;
+		} else {
+			*pos = (*pos + 1) % class->total_files;
+		}
+		ast_copy_string(name, class->filearray[*pos], sizeof(name));
+		ast_copy_string(ext, moh_file_ext(class->filearray[*pos]), sizeof(ext));
+		ao2_unlock(class);
+
+		if ((stream = ast_readfile(name, ext, NULL, O_RDONLY, 0, 0))) {
+			ast_debug(1, "Shared music on hold class '%s' opened file %d '%s'\n", class->name, *pos, name);
+		}
+	}
+
+	return stream;
+}
+
+/*!
+ * \brief Reader of a shared files mode class.
+ *
+ * Reads the files in real time while channels listen, making each frame
+ * once for every format listened to.
+ *
+ * \note The thread holds no reference to the class.  moh_class_destructor()
+ * stops it.
+ */
+static void *moh_shared_thread(void *data)
+{
+	struct mohclass *class = data;
+	struct ast_filestream *stream = NULL;
+	struct timeval last = ast_tvnow();
+	int pos = -1;
+	/* Microseconds of audio owed to the listeners */
+	int64_t owed = 0;
+
+	if (ast_test_flag(class, MOH_SORTMODE) == MOH_RANDSTART && class->total_files) {
+		pos = ast_random() % class->total_files - 1;
+	}
+
+	while (!class->shared_stop) {
+		struct timeval now;
+		int listening;
+
+		if (class->timer) {
+			struct pollfd pfd = { .fd = ast_timer_fd(class->timer), .events = POLLIN | POLLPRI, };
+
+			if (ast_poll(&pfd, 1, 100) > 0) {
+				ast_timer_ack(class->timer, 1);
+			}
+		} else {
+			usleep(20000);
+		}
+
+		now = ast_tvnow();
+		owed += ast_tvdiff_us(now, last);
+		last = now;
+
+		ao2_lock(class);
+		listening = !AST_LIST_EMPTY(&class->shared_formats);
+		ao2_unlock(class);
+		if (!listening) {
+			/* Nobody to play to so pause in place */
+			owed = 0;
+			continue;
+		}
+		/* Catch up on a stall without sending a burst */
+		owed = MIN(owed, 200000);
+
+		while (owed > 0 && !class->shared_stop) {
+			struct ast_frame *f;
+
+			if (!stream && !(stream = moh_shared_next(class, &pos))) {
+				ast_log(LOG_WARNING, "No files available for class '%s'\n", class->name);
+				owed = 0;
+				break;
+			}
+
+			if (!(f = ast_readframe(stream))) {
+				ast_closestream(stream);
+				stream = NULL;
+				continue;
+			}
+
+			owed -= (int64_t) f->samples * 1000000 / ast_format_get_sample_rate(f->subclass.format);
+
+			ao2_lock(class);
+			moh_shared_produce(class, f);
+			ao2_unlock(class);
+
+			ast_frfree(f);
+		}
+	}
+
+	if (stream) {
+		ast_closestream(stream);
+	}
+
+	return NULL;
+}
+
+/*!
+ * \internal
+ * \brief Start the reader of a shared files mode class.
+ */
+static int moh_shared_start(struct mohclass *class)
+{
+	if (!(class->timer = ast_timer_open())) {
+		ast_log(LOG_WARNING, "Unable to create timer: %s\n", strerror(errno));
+	} else if (ast_timer_set_rate(class->timer, 50)) {
+		ast_log(LOG_WARNING, "Unable to set 20ms frame rate: %s\n", strerror(errno));
+		ast_timer_close(class->timer);
+		class->timer = NULL;
+	}
+
+	if (ast_pthread_create_background(&class->shared_thread, NULL, moh_shared_thread, class)) {
+		ast_log(LOG_WARNING, "Unable to create shared moh thread...\n");
+		class->shared_thread = AST_PTHREADT_NULL;
+		if (class->timer) {
+			ast_timer_close(class->timer);
+			class->timer = NULL;
+		}
+		return -1;
+	}
+
+	return 0;
+}
+
+static void *moh_shared_alloc(struct ast_channel *chan, void *params)
+{
+	struct mohclass *class = params;
+	struct moh_shared_listener *listener;
+	struct moh_files_state *state;
+	struct ast_format *format;
+	int res;
+
+	/* Initiating music_state for current channel. Channel should know name of moh class */
+	state = ast_channel_music_state(chan);
+	if (!state && (state = ast_calloc(1, sizeof(*state)))) {
+		ast_channel_music_state_set(chan, state);
+		ast_module_ref(ast_module_info->self);
+	} else {
+		if (!state) {
+			return NULL;
+		}
+		if (state->class) {
+			mohclass_unref(state->class, "Uh Oh. Restarting MOH with an active class");
+			ast_log(LOG_WARNING, "Uh Oh. Restarting MOH with an active class\n");
+		}
+		ao2_cleanup(state->origwfmt);
+		ao2_cleanup(state->mohwfmt);
+		memset(state, 0, sizeof(*state));
+	}
+
+	if (!(listener = ast_calloc(1, sizeof(*listener)))) {
+		return NULL;
+	}
+	listener->class = mohclass_ref(class, "Reffing music class for shared listener");
+
+	ast_channel_lock(chan);
+	format = ao2_bump(ast_channel_writeformat(chan));
+	ast_channel_unlock(chan);
+
+	ao2_lock(class);
+	res = moh_shared_listen(listener, format);
+	ao2_unlock(class);
+	ao2_cleanup(format);
+
+	if (res) {
+		mohclass_unref(listener->class, "Unreffing music class of failed shared listener");
+		ast_free(listener);
+		return NULL;
+	}
+
+	state->class = mohclass_ref(class, "Placing reference into state container");
+	moh_post_start(chan, class->name);
+
+	return listener;
+}
+
+static void moh_shared_release(struct ast_channel *chan, void *data)
+{
+	struct moh_shared_listener *listener = data;
+	struct mohclass *class = listener->class;
+
+	ao2_lock(class);
+	moh_shared_listen(listener, NULL);
+	ao2_unlock(class);
+
+	listener->class = mohclass_unref(class, "Unreffing music class of shared listener");
+	ast_free(listener);
+
+	if (chan) {
+		struct moh_files_state *state;
+
+		state = ast_channel_music_state(chan);
+		if (state && state->class) {
+			state->class = mohclass_unref(state->class, "Unreffing channel's music class upon deactivation of generator");
+		}
+
+		moh_post_stop(chan);
+	}
+}
+
+static int moh_shared_generate(struct ast_channel *chan, void *data, int len, int samples)
+{
+	struct moh_shared_listener *listener = data;
+	struct mohclass *class = listener->class;
+	struct ast_format *format;
+	struct ast_frame *head = NULL;
+	struct ast_frame *tail = NULL;
+	struct ast_frame *f;
+	int res = 0;
+
+	ast_channel_lock(chan);
+	format = ao2_bump(ast_channel_writeformat(chan));
+	ast_channel_unlock(chan);
+
+	ao2_lock(class);
+	if (!listener->format || ast_format_cmp(listener->format->format, format) != AST_FORMAT_CMP_EQUAL) {
+		/* The channel changed format so take the frames made for the new one */
+		if (moh_shared_listen(listener, format)) {
+			ao2_unlock(class);
+			ao2_cleanup(format);
+			return -1;
+		}
+	}
+	ao2_cleanup(format);
+
+	if (class->shared_seq - listener->seq > MOH_SHARED_FRAMES) {
+		/* Fell too far behind so skip what is gone */
+		listener->seq = class->shared_seq - MOH_SHARED_FRAMES;
+	}
+	for (; listener->seq != class->shared_seq; ++listener->seq) {
+		f = moh_shared_dup(listener->format->frames[listener->seq % MOH_SHARED_FRAMES]);
+		if (!f) {
+			continue;
+		}
+		if (tail) {
+			AST_LIST_NEXT(tail, frame_list) = f;
+		} else {
+			head = f;
+		}
+		for (tail = f; AST_LIST_NEXT(tail, frame_list); tail = AST_LIST_NEXT(tail, frame_list)) {
+		}
+	}
+	ao2_unlock(class);
+
+	/* Written without the class locked as ast_write may block */
+	while ((f = head)) {
+		head = AST_LIST_NEXT(f, frame_list);
+		AST_LIST_NEXT(f, frame_list) = NULL;
+		if (!res && ast_write(chan, f) < 0) {
+			ast_log(LOG_WARNING, "Failed to write frame to '%s': %s\n", ast_channel_name(chan), strerror(errno));
+			res = -1;
+		}
+		ast_frfree(f);
+	}
+
+	return res;
+}
+
+static struct ast_generator moh_shared_stream = {
+	.alloc    = moh_shared_alloc,
+	.release  = moh_shared_release,
+	.generate = moh_shared_generate,
+	.digit    = moh_handle_digit,
+};
+
 static int spawn_mp3(struct mohclass *class)
 {
 	int fds[2];
@@ -1108,6 +1579,8 @@ static void moh_parse_options(struct ast_variable *var, struct mohclass *mohclas
 			} else if (!strcasecmp(var->value, "randstart")) {
 				ast_set_flag(mohclass, MOH_RANDSTART);
 			}
+		} else if (!strcasecmp(var->name, "shared")) {
+			ast_set2_flag(mohclass, ast_true(var->value), MOH_SHARED);
 		} else if (!strcasecmp(var->name, "format")) {
 			ao2_cleanup(mohclass->format);
 			mohclass->format = ast_format_cache_get(var->value);
@@ -1135,8 +1608,18 @@ static void moh_parse_options(struct ast_variable *var, struct mohclass *mohclas
 	}
 }
 
-static int moh_add_file(struct mohclass *class, const char *filepath)
+/*!
+ * \internal
+ * \brief Add a file to the filearray of a class.
+ *
+ * \param class The class
+ * \param filepath Path of the file without extension
+ * \param ext Extension of the file, kept after the path for moh_file_ext()
+ */
+static int moh_add_file(struct mohclass *class, const char *filepath, const char *ext)
 {
+	size_t len = strlen(filepath) + 1;
+
 	if (!class->allowed_files) {
 		class->filearray = ast_calloc(1, INITIAL_NUM_FILES * sizeof(*class->filearray));
 		if (!class->filearray) {
@@ -1154,10 +1637,12 @@ static int moh_add_file(struct mohclass *class, const char *filepath)
 		class->allowed_files *= 2;
 	}
 
-	class->filearray[class->total_files] = ast_strdup(filepath);
+	class->filearray[class->total_files] = ast_malloc(len + strlen(ext) + 1);
 	if (!class->filearray[class->total_files]) {
 		return -1;
 	}
+	memcpy(class->filearray[class->total_files], filepath, len);
+	strcpy(class->filearray[class->total_files] + len, ext);
 
 	class->total_files++;
 
@@ -1223,7 +1708,7 @@ static int moh_scan_files(struct mohclass *class) {
 			continue;
 
 		if ((ext = strrchr(filepath, '.')))
-			*ext = '\0';
+			*ext++ = '\0';
 
 		/* if the file is present in multiple formats, ensure we only put it into the list once */
 		for (i = 0; i < class->total_files; i++)
@@ -1231,7 +1716,7 @@ static int moh_scan_files(struct mohclass *class) {
 				break;
 
 		if (i == class->total_files) {
-			if (moh_add_file(class, filepath))
+			if (moh_add_file(class, filepath, S_OR(ext, "")))
 				break;
 		}
 	}
@@ -1258,6 +1743,16 @@ static int init_files_class(struct mohclass *class)
 		return -1;
 	}
 
+	if (ast_test_flag(class, MOH_SHARED)) {
+		if (ast_test_flag(class, MOH_ANNOUNCEMENT)) {
+			/* Announcements are played to each channel in its language */
+			ast_log(LOG_WARNING, "Music on hold class '%s' has an announcement so it cannot be shared\n",
+				class->name);
+		} else if (moh_shared_start(class)) {
+			return -1;
+		}
+	}
+
 	return 0;
 }
 
@@ -1269,7 +1764,10 @@ static void moh_rescan_files(void) {
 
 	while ((c = ao2_iterator_next(&i))) {
 		if (!strcasecmp(c->mode, "files")) {
+			/* A shared reader may be picking its next file */
+			ao2_lock(c);
 			moh_scan_files(c);
+			ao2_unlock(c);
 		}
 		ao2_ref(c, -1);
 	}
@@ -1424,6 +1922,7 @@ static struct mohclass *_moh_class_malloc(const char *file, int line, const char
 		class->format = ao2_bump(ast_format_slin);
 		class->srcfd = -1;
 		class->kill_delay = 100000;
+		class->shared_thread = AST_PTHREADT_NULL;
 	}
 
 	return class;
@@ -1611,14 +2110,20 @@ static int local_ast_moh_start(struct ast_channel *chan, const char *mclass, con
 
 	/* If we are using a cached realtime class with files, re-scan the files */
 	if (!var && ast_test_flag(global_flags, MOH_CACHERTCLASSES) && mohclass->realtime && !strcasecmp(mohclass->mode, "files")) {
-		if (!moh_scan_files(mohclass)) {
+		ao2_lock(mohclass);
+		res = moh_scan_files(mohclass);
+		ao2_unlock(mohclass);
+		if (!res) {
 			mohclass = mohclass_unref(mohclass, "unreffing potential mohclass (moh_scan_files failed)");
 			return -1;
 		}
+		res = 0;
 	}
 
 	if (!state || !state->class || strcmp(mohclass->name, state->class->name)) {
-		if (mohclass->total_files) {
+		if (mohclass->shared_thread != AST_PTHREADT_NULL) {
+			res = ast_activate_generator(chan, &moh_shared_stream, mohclass);
+		} else if (mohclass->total_files) {
 			res = ast_activate_generator(chan, &moh_file_stream, mohclass);
 		} else {
 			res = ast_activate_generator(chan, &mohgen, mohclass);
@@ -1665,6 +2170,19 @@ static void moh_class_destructor(void *obj)
 	}
 	ao2_unlock(class);
 
+	if (class->shared_thread != AST_PTHREADT_NULL) {
+		struct moh_shared_format *entry;
+
+		class->shared_stop = 1;
+		pthread_join(class->shared_thread, NULL);
+		class->shared_thread = AST_PTHREADT_NULL;
+
+		/* Every listener held a reference so none are left */
+		while ((entry = AST_LIST_REMOVE_HEAD(&class->shared_formats, list))) {
+			moh_shared_format_destroy(entry);
+		}
+	}
+
 	/* Kill the thread first, so it cannot restart the child process while the
 	 * class is being destroyed */
 	if (class->thread != AST_PTHREADT_NULL && class->thread != 0) {
@@ -1939,6 +2457,16 @@ static char *handle_cli_moh_show_classes(struct ast_cli_entry *e, int cmd, struc
 		if (strcasecmp(class->mode, "files")) {
 			ast_cli(a->fd, "\tFormat: %s\n", ast_format_get_name(class->format));
 		}
+		if (class->shared_thread != AST_PTHREADT_NULL) {
+			struct moh_shared_format *entry;
+
+			ao2_lock(class);
+			AST_LIST_TRAVERSE(&class->shared_formats, entry, list) {
+				ast_cli(a->fd, "\tShared: %d listening in %s\n", entry->listeners,
+					ast_format_get_name(entry->format));
+			}
+			ao2_unlock(class);
+		}
 	}
 	ao2_iterator_destroy(&i);
 
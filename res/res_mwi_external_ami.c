@@ -122,6 +122,27 @@
 			<para>Update the mailbox message counts.</para>
 		</description>
 	</manager>
+	<manager name="MWIUpdateBulk" language="en_US">
+		<synopsis>
+			Update the message counts of several mailboxes.
+		</synopsis>
+		<syntax>
+			<xi:include xpointer="xpointer(/docs/manager[@name='Login']/syntax/parameter[@name='ActionID'])" />
+			<parameter name="Mailbox" required="true">
+				<para>A mailbox update in the form
+				<replaceable>mailbox</replaceable>,<replaceable>old</replaceable>,<replaceable>new</replaceable>.
+				The message counts default to zero if empty.</para>
+				<para>This header may be repeated to update more than one mailbox.</para>
+			</parameter>
+		</syntax>
+		<description>
+			<para>Update the message counts of several mailboxes in one action.
+			All of the updates are validated before any mailbox is changed.</para>
+		</description>
+		<see-also>
+			<ref type="manager">MWIUpdate</ref>
+		</see-also>
+	</manager>
  ***/
 
 
@@ -336,11 +357,156 @@ static int mwi_mailbox_update(struct mansession *s, const struct message *m)
 	return 0;
 }
 
+/*!
+ * \internal
+ * \brief Parse a message count, allowing it to be empty.
+ *
+ * \retval 0 on success.
+ * \retval -1 if the count is invalid.
+ */
+static int mwi_parse_msgs(const char *msgs, unsigned int *num)
+{
+	*num = 0;
+	if (!ast_strlen_zero(msgs) && sscanf(msgs, "%u", num) != 1) {
+		return -1;
+	}
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Build a mailbox object from one MWIUpdateBulk mailbox update.
+ * \since 17.0.0
+ *
+ * \param s AMI session.
+ * \param m AMI message.
+ * \param update Update in the form "mailbox,old,new".
+ *
+ * \return Mailbox object with the new counts set.
+ * \retval NULL on error.  An error response has been sent.
+ */
+static struct ast_mwi_mailbox_object *mwi_bulk_update_alloc(struct mansession *s,
+	const struct message *m, const char *update)
+{
+	struct ast_mwi_mailbox_object *mailbox = NULL;
+	char *mailbox_id;
+	char *msgs_old;
+	char *msgs_new;
+	unsigned int num_old;
+	unsigned int num_new;
+
+	mailbox_id = ast_strdup(update);
+	if (!mailbox_id) {
+		astman_send_error(s, m, "Memory Allocation Failure");
+		return NULL;
+	}
+
+	/* The counts are taken from the end since the mailbox ID may contain commas */
+	msgs_old = NULL;
+	msgs_new = strrchr(mailbox_id, ',');
+	if (msgs_new) {
+		*msgs_new++ = '\0';
+		msgs_old = strrchr(mailbox_id, ',');
+	}
+	if (!msgs_old) {
+		astman_send_error_va(s, m, "Invalid mailbox update: %s", update);
+		goto done;
+	}
+	*msgs_old++ = '\0';
+	ast_strip(mailbox_id);
+
+	if (ast_strlen_zero(mailbox_id)) {
+		astman_send_error_va(s, m, "Missing mailbox ID in: %s", update);
+	} else if (mwi_parse_msgs(ast_strip(msgs_old), &num_old)) {
+		astman_send_error_va(s, m, "Invalid OldMessages for %s: %s", mailbox_id, msgs_old);
+	} else if (mwi_parse_msgs(ast_strip(msgs_new), &num_new)) {
+		astman_send_error_va(s, m, "Invalid NewMessages for %s: %s", mailbox_id, msgs_new);
+	} else if (!(mailbox = ast_mwi_mailbox_alloc(mailbox_id))) {
+		astman_send_error(s, m, "Mailbox object creation failure");
+	} else {
+		ast_mwi_mailbox_set_msgs_old(mailbox, num_old);
+		ast_mwi_mailbox_set_msgs_new(mailbox, num_new);
+	}
+
+done:
+	ast_free(mailbox_id);
+	return mailbox;
+}
+
+/*!
+ * \internal
+ * \brief Update several mailboxes at once.
+ * \since 17.0.0
+ *
+ * \param s AMI session.
+ * \param m AMI message.
+ *
+ * \retval 0 to keep AMI connection.
+ * \retval -1 to disconnect AMI connection.
+ */
+static int mwi_mailbox_update_bulk(struct mansession *s, const struct message *m)
+{
+	AST_VECTOR(, struct ast_mwi_mailbox_object *) mailboxes;
+	unsigned int idx;
+	int failed = 0;
+
+	if (AST_VECTOR_INIT(&mailboxes, 8)) {
+		astman_send_error(s, m, "Memory Allocation Failure");
+		return 0;
+	}
+
+	/* Validate and build every update before changing anything */
+	for (idx = 0; idx < m->hdrcount; ++idx) {
+		struct ast_mwi_mailbox_object *mailbox;
+
+		if (strncasecmp(m->headers[idx], "Mailbox:", 8)) {
+			continue;
+		}
+
+		mailbox = mwi_bulk_update_alloc(s, m, ast_skip_blanks(m->headers[idx] + 8));
+		if (!mailbox) {
+			failed = 1;
+			break;
+		}
+		if (AST_VECTOR_APPEND(&mailboxes, mailbox)) {
+			ast_mwi_mailbox_unref(mailbox);
+			astman_send_error(s, m, "Memory Allocation Failure");
+			failed = 1;
+			break;
+		}
+	}
+
+	if (!failed && !AST_VECTOR_SIZE(&mailboxes)) {
+		astman_send_error(s, m, "Missing mailbox parameter in request");
+		failed = 1;
+	}
+
+	if (!failed) {
+		for (idx = 0; idx < AST_VECTOR_SIZE(&mailboxes); ++idx) {
+			if (ast_mwi_mailbox_update(AST_VECTOR_GET(&mailboxes, idx))) {
+				++failed;
+			}
+		}
+		if (failed) {
+			astman_send_error_va(s, m, "Update attempt failed for %d of %zu mailboxes",
+				failed, AST_VECTOR_SIZE(&mailboxes));
+		} else {
+			astman_send_ack(s, m, NULL);
+		}
+	}
+
+	AST_VECTOR_CALLBACK_VOID(&mailboxes, ast_mwi_mailbox_unref);
+	AST_VECTOR_FREE(&mailboxes);
+
+	return 0;
+}
+
 static int unload_module(void)
 {
 	ast_manager_unregister("MWIGet");
 	ast_manager_unregister("MWIDelete");
 	ast_manager_unregister("MWIUpdate");
+	ast_manager_unregister("MWIUpdateBulk");
 
 	return 0;
 }
@@ -353,6 +519,7 @@ static int load_module(void)
 	res |= ast_manager_register_xml("MWIGet", EVENT_FLAG_CALL | EVENT_FLAG_REPORTING, mwi_mailbox_get);
 	res |= ast_manager_register_xml("MWIDelete", EVENT_FLAG_CALL, mwi_mailbox_delete);
 	res |= ast_manager_register_xml("MWIUpdate", EVENT_FLAG_CALL, mwi_mailbox_update);
+	res |= ast_manager_register_xml("MWIUpdateBulk", EVENT_FLAG_CALL, mwi_mailbox_update_bulk);
 	if (res) {
 		unload_module();
 		return AST_MODULE_LOAD_DECLINE;
@@ -100,6 +100,8 @@ struct odbc_class
 	char *sql_text;
 	/*! Slow query limit (in milliseconds) */
 	unsigned int slowquerylimit;
+	/*! Seconds a connection is trusted after use without checking it, 0 to always check */
+	unsigned int health_check_interval;
 };
 
 static struct ao2_container *class_container;
@@ -112,6 +114,20 @@ static void odbc_register_class(struct odbc_class *class, int connect);
 
 AST_THREADSTORAGE(errors_buf);
 
+/*!
+ * \brief The connection last released by this thread
+ *
+ * The pointer is only compared with the connections in a pool, never
+ * dereferenced, so it does not hold a reference.
+ */
+AST_THREADSTORAGE(odbc_affinity);
+
+/*! \brief Thread checking idle connections of classes with a health_check_interval */
+static pthread_t health_thread = AST_PTHREADT_NULL;
+AST_MUTEX_DEFINE_STATIC(health_lock);
+static ast_cond_t health_cond;
+static int health_stop;
+
 struct odbc_txn_frame {
 	AST_LIST_ENTRY(odbc_txn_frame) list;
 	struct ast_channel *owner;
@@ -568,7 +584,7 @@ static int load_odbc_config(void)
 	struct ast_variable *v;
 	char *cat;
 	const char *dsn, *username, *password, *sanitysql;
-	int enabled, bse, conntimeout, forcecommit, isolation, maxconnections, logging, slowquerylimit;
+	int enabled, bse, conntimeout, forcecommit, isolation, maxconnections, logging, slowquerylimit, healthcheck;
 	struct timeval ncache = { 0, 0 };
 	int preconnect = 0, res = 0;
 	struct ast_flags config_flags = { 0 };
@@ -598,6 +614,7 @@ static int load_odbc_config(void)
 			maxconnections = 1;
 			logging = 0;
 			slowquerylimit = 5000;
+			healthcheck = 0;
 			for (v = ast_variable_browse(config, cat); v; v = v->next) {
 				if (!strcasecmp(v->name, "pooling") ||
 						!strncasecmp(v->name, "share", 5) ||
@@ -653,6 +670,11 @@ static int load_odbc_config(void)
 						ast_log(LOG_WARNING, "slow_query_limit must be a positive integer\n");
 						slowquerylimit = 5000;
 					}
+				} else if (!strcasecmp(v->name, "health_check_interval")) {
+					if (sscanf(v->value, "%30d", &healthcheck) != 1 || healthcheck < 0) {
+						ast_log(LOG_WARNING, "health_check_interval must be a non-negative integer\n");
+						healthcheck = 0;
+					}
 				}
 			}
 
@@ -681,6 +703,7 @@ static int load_odbc_config(void)
 				new->maxconnections = maxconnections;
 				new->logging = logging;
 				new->slowquerylimit = slowquerylimit;
+				new->health_check_interval = healthcheck;
 
 				if (cat)
 					ast_copy_string(new->name, cat, sizeof(new->name));
@@ -767,6 +790,9 @@ static char *handle_cli_odbc_show(struct ast_cli_entry *e, int cmd, struct ast_c
 			}
 
 			ast_cli(a->fd, "    Number of active connections: %zd (out of %d)\n", class->connection_cnt, class->maxconnections);
+			if (class->health_check_interval) {
+				ast_cli(a->fd, "    Health check interval: %u seconds\n", class->health_check_interval);
+			}
 			ast_cli(a->fd, "    Logging: %s\n", class->logging ? "Enabled" : "Disabled");
 			if (class->logging) {
 				ast_cli(a->fd, "    Number of prepares executed: %d\n", class->prepares_executed);
@@ -813,6 +839,7 @@ static void odbc_register_class(struct odbc_class *class, int preconnect)
 void ast_odbc_release_obj(struct odbc_obj *obj)
 {
 	struct odbc_class *class = obj->parent;
+	struct odbc_obj **preferred;
 
 	ast_debug(2, "Releasing ODBC handle %p into pool\n", obj);
 
@@ -831,6 +858,14 @@ void ast_odbc_release_obj(struct odbc_obj *obj)
 	ast_free(obj->sql_text);
 	obj->sql_text = NULL;
 
+	obj->last_alive = ast_tvnow();
+
+	/* This thread prefers to get the same connection back next time */
+	preferred = ast_threadstorage_get(&odbc_affinity, sizeof(*preferred));
+	if (preferred) {
+		*preferred = obj;
+	}
+
 	ast_mutex_lock(&class->lock);
 	AST_LIST_INSERT_HEAD(&class->connections, obj, list);
 	ast_cond_signal(&class->cond);
@@ -914,6 +949,43 @@ static int connection_dead(struct odbc_obj *connection, struct odbc_class *class
 	return SQL_SUCCEEDED(res) ? 0 : 1;
 }
 
+/*!
+ * \internal
+ * \brief Take a connection out of the pool of a class
+ *
+ * \note The class must be locked.
+ *
+ * The connection this thread last released is preferred, so a thread
+ * keeps working on the same connection while it is free.
+ */
+static struct odbc_obj *odbc_pool_take(struct odbc_class *class)
+{
+	struct odbc_obj **preferred = ast_threadstorage_get(&odbc_affinity, sizeof(*preferred));
+	struct odbc_obj *obj;
+
+	if (preferred && *preferred) {
+		AST_LIST_TRAVERSE_SAFE_BEGIN(&class->connections, obj, list) {
+			if (obj == *preferred) {
+				AST_LIST_REMOVE_CURRENT(list);
+				return obj;
+			}
+		}
+		AST_LIST_TRAVERSE_SAFE_END;
+	}
+
+	return AST_LIST_REMOVE_HEAD(&class->connections, list);
+}
+
+/*!
+ * \internal
+ * \brief Determine if a pooled connection has to be checked before use
+ */
+static int connection_needs_check(struct odbc_obj *connection, struct odbc_class *class)
+{
+	return !class->health_check_interval
+		|| ast_tvdiff_ms(ast_tvnow(), connection->last_alive) >= class->health_check_interval * 1000;
+}
+
 struct odbc_obj *_ast_odbc_request_obj2(const char *name, struct ast_flags flags, const char *file, const char *function, int lineno)
 {
 	struct odbc_obj *obj = NULL;
@@ -927,7 +999,7 @@ struct odbc_obj *_ast_odbc_request_obj2(const char *name, struct ast_flags flags
 	ast_mutex_lock(&class->lock);
 
 	while (!obj) {
-		obj = AST_LIST_REMOVE_HEAD(&class->connections, list);
+		obj = odbc_pool_take(class);
 
 		if (!obj) {
 			if (class->connection_cnt < class->maxconnections) {
@@ -958,7 +1030,7 @@ struct odbc_obj *_ast_odbc_request_obj2(const char *name, struct ast_flags flags
 				 */
 				ast_cond_wait(&class->cond, &class->lock);
 			}
-		} else if (connection_dead(obj, class)) {
+		} else if (connection_needs_check(obj, class) && connection_dead(obj, class)) {
 			/* If the connection is dead try to grab another functional one from the
 			 * pool instead of trying to resurrect this one.
 			 */
@@ -1075,9 +1147,83 @@ static odbc_status odbc_obj_connect(struct odbc_obj *obj)
 	}
 
 	obj->con = con;
+	obj->last_alive = ast_tvnow();
 	return ODBC_SUCCESS;
 }
 
+/*!
+ * \internal
+ * \brief Check the idle connections of a class
+ *
+ * Connections that have not been used or checked for health_check_interval
+ * seconds are taken out of the pool while they are checked, so requests
+ * do not have to check them.  Dead connections are dropped.
+ */
+static int odbc_class_health_check(void *obj, void *arg, int flags)
+{
+	struct odbc_class *class = obj;
+	AST_LIST_HEAD_NOLOCK(, odbc_obj) idle;
+	struct odbc_obj *connection;
+	struct timeval now = ast_tvnow();
+
+	if (!class->health_check_interval || class->delme) {
+		return 0;
+	}
+
+	AST_LIST_HEAD_INIT_NOLOCK(&idle);
+	ast_mutex_lock(&class->lock);
+	AST_LIST_TRAVERSE_SAFE_BEGIN(&class->connections, connection, list) {
+		if (ast_tvdiff_ms(now, connection->last_alive) >= class->health_check_interval * 1000) {
+			AST_LIST_REMOVE_CURRENT(list);
+			AST_LIST_INSERT_TAIL(&idle, connection, list);
+		}
+	}
+	AST_LIST_TRAVERSE_SAFE_END;
+	ast_mutex_unlock(&class->lock);
+
+	while ((connection = AST_LIST_REMOVE_HEAD(&idle, list))) {
+		int dead = connection_dead(connection, class);
+
+		ast_mutex_lock(&class->lock);
+		if (dead) {
+			class->connection_cnt--;
+			ast_debug(2, "ODBC handle %p dead - removing from class '%s', new count is %zd\n",
+				connection, class->name, class->connection_cnt);
+			ao2_ref(connection, -1);
+		} else {
+			connection->last_alive = ast_tvnow();
+			AST_LIST_INSERT_TAIL(&class->connections, connection, list);
+		}
+		/* Either a connection is back or a new one may be made */
+		ast_cond_signal(&class->cond);
+		ast_mutex_unlock(&class->lock);
+	}
+
+	return 0;
+}
+
+static void *health_check_thread(void *data)
+{
+	struct timeval wait;
+	struct timespec ts;
+
+	ast_mutex_lock(&health_lock);
+	while (!health_stop) {
+		ast_mutex_unlock(&health_lock);
+		ao2_callback(class_container, OBJ_NODATA | OBJ_MULTIPLE, odbc_class_health_check, NULL);
+		ast_mutex_lock(&health_lock);
+
+		wait = ast_tvadd(ast_tvnow(), ast_tv(1, 0));
+		ts.tv_sec = wait.tv_sec;
+		ts.tv_nsec = wait.tv_usec * 1000;
+		while (!health_stop && ast_cond_timedwait(&health_cond, &health_lock, &ts) != ETIMEDOUT) {
+		}
+	}
+	ast_mutex_unlock(&health_lock);
+
+	return NULL;
+}
+
 static int reload(void)
 {
 	struct odbc_cache_tables *table;
@@ -1114,6 +1260,16 @@ static int reload(void)
 
 static int unload_module(void)
 {
+	if (health_thread != AST_PTHREADT_NULL) {
+		ast_mutex_lock(&health_lock);
+		health_stop = 1;
+		ast_cond_signal(&health_cond);
+		ast_mutex_unlock(&health_lock);
+		pthread_join(health_thread, NULL);
+		health_thread = AST_PTHREADT_NULL;
+	}
+	ast_cond_destroy(&health_cond);
+
 	ao2_cleanup(class_container);
 	ast_cli_unregister_multiple(cli_odbc, ARRAY_LEN(cli_odbc));
 
@@ -1131,6 +1287,12 @@ static int load_module(void)
 		return AST_MODULE_LOAD_DECLINE;
 	}
 
+	ast_cond_init(&health_cond, NULL);
+	if (ast_pthread_create_background(&health_thread, NULL, health_check_thread, NULL)) {
+		ast_log(LOG_WARNING, "Unable to start ODBC health check thread\n");
+		health_thread = AST_PTHREADT_NULL;
+	}
+
 	ast_module_shutdown_ref(ast_module_info->self);
 	ast_cli_register_multiple(cli_odbc, ARRAY_LEN(cli_odbc));
 
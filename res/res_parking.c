@@ -431,14 +431,25 @@ static void parking_lot_cfg_destructor(void *obj)
 	ast_string_field_free_memory(lot_cfg);
 }
 
-/* The arg just needs to have the parking space with it */
 static int parked_user_cmp_fn(void *obj, void *arg, int flags)
 {
-	int *search_space = arg;
 	struct parked_user *user = obj;
-	int object_space = user->parking_space;
+	int search_space;
 
-	if (*search_space == object_space) {
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_OBJECT:
+		search_space = ((struct parked_user *) arg)->parking_space;
+		break;
+	case OBJ_SEARCH_KEY:
+		search_space = *(int *) arg;
+		break;
+	default:
+		/* The arg just needs to have the parking space with it */
+		search_space = *(int *) arg;
+		break;
+	}
+
+	if (search_space == user->parking_space) {
 		return CMP_MATCH;
 	}
 	return 0;
@@ -447,9 +458,21 @@ static int parked_user_cmp_fn(void *obj, void *arg, int flags)
 static int parked_user_sort_fn(const void *obj_left, const void *obj_right, int flags)
 {
 	const struct parked_user *left = obj_left;
-	const struct parked_user *right = obj_right;
+	int right_space;
+
+	switch (flags & OBJ_SEARCH_MASK) {
+	case OBJ_SEARCH_OBJECT:
+		right_space = ((const struct parked_user *) obj_right)->parking_space;
+		break;
+	case OBJ_SEARCH_KEY:
+		right_space = *(const int *) obj_right;
+		break;
+	default:
+		ast_assert(0);
+		return 0;
+	}
 
-	return left->parking_space - right->parking_space;
+	return left->parking_space - right_space;
 }
 
 /*!
@@ -630,6 +653,7 @@ static void parking_lot_destructor(void *obj)
 		ast_bridge_destroy(lot->parking_bridge, 0);
 	}
 	ao2_cleanup(lot->parked_users);
+	ast_free(lot->spaces_in_use);
 	ao2_cleanup(lot->cfg);
 	ast_string_field_free_memory(lot);
 }
@@ -645,8 +669,8 @@ static struct parking_lot *alloc_new_parking_lot(struct parking_lot_cfg *lot_cfg
 		return NULL;
 	}
 
-	/* Create parked user ordered list */
-	lot->parked_users = ao2_container_alloc_list(AO2_ALLOC_OPT_LOCK_RWLOCK,
+	/* Create parked user ordered tree */
+	lot->parked_users = ao2_container_alloc_rbtree(AO2_ALLOC_OPT_LOCK_RWLOCK,
 		AO2_CONTAINER_ALLOC_OPT_DUPS_REJECT,
 		parked_user_sort_fn,
 		parked_user_cmp_fn);
@@ -901,6 +925,14 @@ struct parking_lot *parking_lot_build_or_update(struct parking_lot_cfg *lot_cfg,
 
 	ao2_cleanup(replaced_cfg);
 
+	if (parking_lot_spaces_update(lot)) {
+		ast_log(LOG_ERROR, "Failed to track the parking spaces of parking lot '%s'.\n", lot_cfg->name);
+		if (!found) {
+			ao2_cleanup(lot);
+			return NULL;
+		}
+	}
+
 	/* Set the operating mode to normal since the parking lot has a configuration. */
 	lot->disable_mark = 0;
 	lot->mode = dynamic ? PARKINGLOT_DYNAMIC : PARKINGLOT_NORMAL;
@@ -1399,6 +1399,28 @@
 						</para>
 					</description>
 				</configOption>
+				<configOption name="persistent_connections" default="">
+					<synopsis>Targets to keep connections open to.</synopsis>
+					<description>
+						<para>A comma separated list of <literal>host[:port]</literal>
+						targets, such as the proxies of a trunk, that this transport keeps
+						connections open to whether or not there is traffic. Connections
+						that close are reopened every 10 seconds, so requests to a target
+						rarely wait on a connection being set up. Host names are resolved
+						when the transport is loaded. The port defaults to 5060 for TCP and
+						5061 for TLS. Only applies when <literal>protocol</literal> is
+						<literal>tcp</literal> or <literal>tls</literal>.</para>
+					</description>
+				</configOption>
+				<configOption name="persistent_connection_pool" default="1">
+					<synopsis>Number of connections to keep open to each persistent connection target.</synopsis>
+					<description>
+						<para>Requests to a target use one connection. Any others are kept
+						as spares that take over, already connected, when that one
+						closes. Can be from 1 to 16. More than one requires a pjproject
+						that supports disabling connection reuse.</para>
+					</description>
+				</configOption>
 			</configObject>
 			<configObject name="contact">
 				<synopsis>A way of creating an aliased name to a SIP URI</synopsis>
@@ -1708,6 +1730,29 @@
 					<synopsis>Maximum number of threads in the res_pjsip threadpool.
 					A value of 0 indicates no maximum.</synopsis>
 				</configOption>
+				<configOption name="pool_cache_size" default="1024">
+					<synopsis>Kilobytes of released memory pools to keep for reuse.</synopsis>
+					<description><para>
+						Every SIP request and response Asterisk sends or receives gets a
+						memory pool of its own. Released pools are kept for reuse up to
+						this many kilobytes, so busy systems do not allocate and free
+						them for every message. The CLI command
+						<literal>pjsip show pools</literal> shows how much is kept. A
+						value of 0 frees every released pool. This is only read at
+						startup.
+					</para></description>
+				</configOption>
+				<configOption name="threadpool_work_stealing" default="no">
+					<synopsis>Give each res_pjsip threadpool thread its own task queue.</synopsis>
+					<description><para>
+						By default all threads in the res_pjsip threadpool take their
+						tasks from one shared queue. When enabled, each thread gets its
+						own queue and a thread that runs out of work takes serializers
+						from the queues of busier threads. Tasks for a given serializer
+						still run in order. This reduces lock contention on systems
+						handling a large amount of SIP traffic on many cores.
+					</para></description>
+				</configOption>
 				<configOption name="disable_tcp_switch" default="yes">
 					<synopsis>Disable automatic switching from UDP to TCP transports.</synopsis>
 					<description><para>
@@ -1938,6 +1983,50 @@
 						</para></warning>
 					</description>
 				</configOption>
+				<configOption name="stateless_options" default="no">
+					<synopsis>Answer out-of-dialog OPTIONS pings without identifying the endpoint</synopsis>
+					<description><para>
+						When enabled, the distributor answers an out-of-dialog OPTIONS
+						request whose Request-URI has no user part with a stateless
+						200 OK, on the thread that received it.  Such requests skip
+						endpoint identification, ACLs and authentication, and are not
+						counted as unidentified requests.  OPTIONS requests for a
+						user still go to the endpoint's context as before.
+						</para>
+						<para>The number of requests answered this way is shown by
+						<literal>pjsip show distributor</literal>.</para>
+					</description>
+				</configOption>
+				<configOption name="contact_write_behind" default="0">
+					<synopsis>The time (in seconds) contact refreshes may be held before they are stored</synopsis>
+					<description><para>
+						When a REGISTER only moves the expiration time of a contact, the new
+						expiration time is kept in memory and written to the contact storage
+						within this many seconds, along with the other refreshes due by then.
+						Any other change to a contact is written straight away, and so is
+						everything held back when res_pjsip is unloaded.  A refresh is only
+						held back while the stored expiration time is at least twice this
+						long away, so a contact cannot expire early after a crash.
+						</para>
+						<para>This only applies when contacts are stored in astdb or in
+						memory.  A value of 0 writes every refresh straight away.</para>
+					</description>
+				</configOption>
+				<configOption name="qualify_jitter" default="0">
+					<synopsis>The percentage of the qualify frequency qualifies may be brought forward by</synopsis>
+					<description><para>
+						Each time the contacts of an AOR have been qualified, the next qualify is
+						scheduled a random amount of up to this percentage of its
+						<literal>qualify_frequency</literal> early, and the first qualify after a
+						contact registers to an empty AOR is delayed by up to the same amount.
+						This breaks up groups of AORs that would otherwise keep qualifying in the
+						same second, such as after many devices register at once.  It is never
+						qualified later than <literal>qualify_frequency</literal>.
+						</para>
+						<para>Valid values are 0 to 50.  A value of 0 qualifies at exactly
+						<literal>qualify_frequency</literal>.</para>
+					</description>
+				</configOption>
 			</configObject>
 		</configFile>
 	</configInfo>
@@ -3205,8 +3294,51 @@ static char *cli_show_settings(struct ast_cli_entry *e, int cmd, struct ast_cli_
 	return CLI_SUCCESS;
 }
 
+static char *cli_show_pools(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	unsigned long capacity;
+	unsigned long max_capacity;
+	unsigned long used_count;
+	unsigned long used_size;
+	unsigned long peak_used_size;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "pjsip show pools";
+		e->usage = "Usage: pjsip show pools\n"
+		            "      Show memory pool usage and how much released pool\n"
+		            "      memory is kept for reuse\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	pj_lock_acquire(caching_pool.lock);
+	capacity = caching_pool.capacity;
+	max_capacity = caching_pool.max_capacity;
+	used_count = caching_pool.used_count;
+	used_size = caching_pool.used_size;
+	peak_used_size = caching_pool.peak_used_size;
+	pj_lock_release(caching_pool.lock);
+
+	ast_cli(a->fd, "Pools in use:          %lu\n", used_count);
+	ast_cli(a->fd, "Memory in use:         %lu bytes (peak %lu bytes)\n", used_size, peak_used_size);
+	ast_cli(a->fd, "Kept for reuse:        %lu bytes (limit %lu bytes)\n", capacity, max_capacity);
+	if (!max_capacity) {
+		ast_cli(a->fd, "Released pools are not kept since pool_cache_size is 0 or\n"
+			"cache_pools is disabled in pjproject.conf.\n");
+	}
+
+	return CLI_SUCCESS;
+}
+
 static struct ast_cli_entry cli_commands[] = {
 	AST_CLI_DEFINE(cli_dump_endpt, "Dump the res_pjsip endpt internals"),
+	AST_CLI_DEFINE(cli_show_pools, "Show res_pjsip memory pool usage"),
 	AST_CLI_DEFINE(cli_show_settings, "Show global and system configuration options"),
 	AST_CLI_DEFINE(cli_show_endpoint_identifiers, "List registered endpoint identifiers")
 };
@@ -5240,11 +5372,11 @@ static int load_pjsip(void)
 	const unsigned int flags = 0; /* no port, no brackets */
 	pj_status_t status;
 
-	/* The third parameter is just copied from
-	 * example code from PJLIB. This can be adjusted
-	 * if necessary.
+	/*
+	 * Released pools, including those of every transmitted request and
+	 * response, are kept for reuse up to the configured pool_cache_size.
 	 */
-	ast_pjproject_caching_pool_init(&caching_pool, NULL, 1024 * 1024);
+	ast_pjproject_caching_pool_init(&caching_pool, NULL, sip_get_pool_cache_size() * 1024);
 	if (pjsip_endpt_create(&caching_pool.factory, "SIP", &ast_pjsip_endpoint) != PJ_SUCCESS) {
 		ast_log(LOG_ERROR, "Failed to create PJSIP endpoint structure. Aborting load\n");
 		goto error;
@@ -52,6 +52,9 @@
 #define DEFAULT_USE_CALLERID_CONTACT 0
 #define DEFAULT_SEND_CONTACT_STATUS_ON_UPDATE_REGISTRATION 0
 #define DEFAULT_TASKPROCESSOR_OVERLOAD_TRIGGER TASKPROCESSOR_OVERLOAD_TRIGGER_GLOBAL
+#define DEFAULT_STATELESS_OPTIONS 0
+#define DEFAULT_CONTACT_WRITE_BEHIND 0
+#define DEFAULT_QUALIFY_JITTER 0
 
 /*!
  * \brief Cached global config object
@@ -113,6 +116,12 @@ struct global_config {
 	unsigned int send_contact_status_on_update_registration;
 	/*! Trigger the distributor should use to pause accepting new dialogs */
 	enum ast_sip_taskprocessor_overload_trigger overload_trigger;
+	/*! Nonzero if the distributor answers out-of-dialog OPTIONS pings itself */
+	unsigned int stateless_options;
+	/*! Seconds contact refreshes may be held in memory before being written */
+	unsigned int contact_write_behind;
+	/*! Percentage of the qualify frequency qualifies may be brought forward by */
+	unsigned int qualify_jitter;
 };
 
 static void global_destructor(void *obj)
@@ -486,6 +495,51 @@ unsigned int ast_sip_get_send_contact_status_on_update_registration(void)
 	return send_contact_status_on_update_registration;
 }
 
+unsigned int ast_sip_get_stateless_options(void)
+{
+	unsigned int stateless_options;
+	struct global_config *cfg;
+
+	cfg = get_global_cfg();
+	if (!cfg) {
+		return DEFAULT_STATELESS_OPTIONS;
+	}
+
+	stateless_options = cfg->stateless_options;
+	ao2_ref(cfg, -1);
+	return stateless_options;
+}
+
+unsigned int ast_sip_get_contact_write_behind(void)
+{
+	unsigned int interval;
+	struct global_config *cfg;
+
+	cfg = get_global_cfg();
+	if (!cfg) {
+		return DEFAULT_CONTACT_WRITE_BEHIND;
+	}
+
+	interval = cfg->contact_write_behind;
+	ao2_ref(cfg, -1);
+	return interval;
+}
+
+unsigned int ast_sip_get_qualify_jitter(void)
+{
+	unsigned int jitter;
+	struct global_config *cfg;
+
+	cfg = get_global_cfg();
+	if (!cfg) {
+		return DEFAULT_QUALIFY_JITTER;
+	}
+
+	jitter = cfg->qualify_jitter;
+	ao2_ref(cfg, -1);
+	return jitter;
+}
+
 enum ast_sip_taskprocessor_overload_trigger ast_sip_get_taskprocessor_overload_trigger(void)
 {
 	enum ast_sip_taskprocessor_overload_trigger trigger;
@@ -704,6 +758,15 @@ int ast_sip_initialize_sorcery_global(void)
 	ast_sorcery_object_field_register_custom(sorcery, "global", "taskprocessor_overload_trigger",
 		overload_trigger_map[DEFAULT_TASKPROCESSOR_OVERLOAD_TRIGGER],
 		overload_trigger_handler, overload_trigger_to_str, NULL, 0, 0);
+	ast_sorcery_object_field_register(sorcery, "global", "stateless_options",
+		DEFAULT_STATELESS_OPTIONS ? "yes" : "no",
+		OPT_YESNO_T, 1, FLDSET(struct global_config, stateless_options));
+	ast_sorcery_object_field_register(sorcery, "global", "contact_write_behind",
+		__stringify(DEFAULT_CONTACT_WRITE_BEHIND),
+		OPT_UINT_T, 0, FLDSET(struct global_config, contact_write_behind));
+	ast_sorcery_object_field_register(sorcery, "global", "qualify_jitter",
+		__stringify(DEFAULT_QUALIFY_JITTER),
+		OPT_UINT_T, PARSE_IN_RANGE, FLDSET(struct global_config, qualify_jitter), 0, 50);
 
 	if (ast_sorcery_instance_observer_add(sorcery, &observer_callbacks_global)) {
 		return -1;
@@ -31,6 +31,7 @@
 #define TIMER_T1_MIN 100
 #define DEFAULT_TIMER_T1 500
 #define DEFAULT_TIMER_B 32000
+#define DEFAULT_POOL_CACHE_SIZE 1024
 
 struct system_config {
 	SORCERY_OBJECT(details);
@@ -49,6 +50,8 @@ struct system_config {
 		int idle_timeout;
 		/*! Maxumum number of threads in the threadpool */
 		int max_size;
+		/*! Nonzero to give each thread its own task queue with work stealing */
+		unsigned int work_stealing;
 	} threadpool;
 	/*! Nonzero to disable switching from UDP to TCP transport */
 	unsigned int disable_tcp_switch;
@@ -59,6 +62,8 @@ struct system_config {
 	 */
 	unsigned int follow_early_media_fork;
 	unsigned int accept_multiple_sdp_answers;
+	/*! Kilobytes of released memory pools kept for reuse */
+	unsigned int pool_cache_size;
 };
 
 static struct ast_threadpool_options sip_threadpool_options = {
@@ -70,6 +75,13 @@ void sip_get_threadpool_options(struct ast_threadpool_options *threadpool_option
 	*threadpool_options = sip_threadpool_options;
 }
 
+static unsigned int sip_pool_cache_size = DEFAULT_POOL_CACHE_SIZE;
+
+unsigned int sip_get_pool_cache_size(void)
+{
+	return sip_pool_cache_size;
+}
+
 static struct ast_sorcery *system_sorcery;
 
 static void *system_alloc(const char *name)
@@ -127,6 +139,9 @@ static int system_apply(const struct ast_sorcery *system_sorcery, void *obj)
 	sip_threadpool_options.auto_increment = system->threadpool.auto_increment;
 	sip_threadpool_options.idle_timeout = system->threadpool.idle_timeout;
 	sip_threadpool_options.max_size = system->threadpool.max_size;
+	sip_threadpool_options.work_stealing = system->threadpool.work_stealing;
+
+	sip_pool_cache_size = system->pool_cache_size;
 
 	pjsip_cfg()->endpt.disable_tcp_switch =
 		system->disable_tcp_switch ? PJ_TRUE : PJ_FALSE;
@@ -203,12 +218,17 @@ int ast_sip_initialize_system(void)
 			OPT_UINT_T, 0, FLDSET(struct system_config, threadpool.idle_timeout));
 	ast_sorcery_object_field_register(system_sorcery, "system", "threadpool_max_size", "50",
 			OPT_UINT_T, 0, FLDSET(struct system_config, threadpool.max_size));
+	ast_sorcery_object_field_register(system_sorcery, "system", "threadpool_work_stealing", "no",
+			OPT_BOOL_T, 1, FLDSET(struct system_config, threadpool.work_stealing));
 	ast_sorcery_object_field_register(system_sorcery, "system", "disable_tcp_switch", "yes",
 			OPT_BOOL_T, 1, FLDSET(struct system_config, disable_tcp_switch));
 	ast_sorcery_object_field_register(system_sorcery, "system", "follow_early_media_fork", "yes",
 			OPT_BOOL_T, 1, FLDSET(struct system_config, follow_early_media_fork));
 	ast_sorcery_object_field_register(system_sorcery, "system", "accept_multiple_sdp_answers", "no",
 			OPT_BOOL_T, 1, FLDSET(struct system_config, accept_multiple_sdp_answers));
+	ast_sorcery_object_field_register(system_sorcery, "system", "pool_cache_size",
+			__stringify(DEFAULT_POOL_CACHE_SIZE),
+			OPT_UINT_T, 0, FLDSET(struct system_config, pool_cache_size));
 
 	ast_sorcery_load(system_sorcery);
 
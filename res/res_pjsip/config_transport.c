@@ -29,6 +29,7 @@
 #include "asterisk/sorcery.h"
 #include "asterisk/acl.h"
 #include "asterisk/utils.h"
+#include "asterisk/res_pjproject.h"
 #include "include/res_pjsip_private.h"
 /* We're only using a #define from http_websocket.h, no OPTIONAL_API symbols are used. */
 #include "asterisk/http_websocket.h"
@@ -628,6 +629,293 @@ static void states_cleanup(void *states)
 	}
 }
 
+/*! \brief How often persistent connections are checked and reestablished (in milliseconds) */
+#define PERSISTENT_CONNECTION_INTERVAL 10000
+
+/*! \brief Most connections a transport keeps open to a single target */
+#define PERSISTENT_CONNECTION_POOL_MAX 16
+
+/*! \brief Number of persistent connection container buckets */
+#define PERSISTENT_CONNECTION_BUCKETS 53
+
+/*! \brief A target a transport keeps connections open to */
+struct persistent_target {
+	/*! Resolved address of the target */
+	pj_sockaddr addr;
+	/*! Transport type used to reach the target */
+	pjsip_transport_type_e type;
+	/*! Host name of the target, used for TLS server name verification */
+	char *host;
+	/*! Open connections, NULL where one needs (re)establishing */
+	pjsip_transport *connections[PERSISTENT_CONNECTION_POOL_MAX];
+};
+
+/*! \brief Connections a transport keeps open to its persistent connection targets */
+struct persistent_connection_set {
+	/*! Number of connections kept open to each target */
+	unsigned int pool;
+	/*! The targets */
+	AST_VECTOR(, struct persistent_target) targets;
+	/*! Name of the transport the connections are made from */
+	char transport_id[0];
+};
+
+/*! \brief Persistent connection sets, keyed by transport name */
+static struct ao2_container *persistent_connection_sets;
+
+/*! \brief Periodic task reestablishing persistent connections */
+static struct ast_sip_sched_task *persistent_connections_task;
+
+AO2_STRING_FIELD_HASH_FN(persistent_connection_set, transport_id)
+AO2_STRING_FIELD_CMP_FN(persistent_connection_set, transport_id)
+
+static int persistent_connection_set_release(void *data)
+{
+	struct persistent_connection_set *set = data;
+	int i;
+	unsigned int j;
+
+	for (i = 0; i < AST_VECTOR_SIZE(&set->targets); ++i) {
+		struct persistent_target *target = AST_VECTOR_GET_ADDR(&set->targets, i);
+
+		for (j = 0; j < set->pool; ++j) {
+			if (target->connections[j]) {
+				pjsip_transport_dec_ref(target->connections[j]);
+			}
+		}
+	}
+
+	return 0;
+}
+
+static void persistent_connection_set_destroy(void *obj)
+{
+	struct persistent_connection_set *set = obj;
+	int i;
+
+	/* Transport references have to be given up from a PJSIP thread */
+	ast_sip_push_task_wait_servant(NULL, persistent_connection_set_release, set);
+
+	for (i = 0; i < AST_VECTOR_SIZE(&set->targets); ++i) {
+		ast_free(AST_VECTOR_GET_ADDR(&set->targets, i)->host);
+	}
+	AST_VECTOR_FREE(&set->targets);
+}
+
+/*! \brief Open a connection to a persistent connection target */
+static pjsip_transport *persistent_target_connect(struct persistent_target *target,
+	pjsip_tpfactory *factory, int reuse)
+{
+	pjsip_tpselector selector = { .type = PJSIP_TPSELECTOR_LISTENER, };
+	pjsip_tx_data *tdata;
+	pjsip_transport *connection = NULL;
+	pj_status_t status;
+
+	selector.u.listener = factory;
+#ifdef HAVE_PJSIP_TRANSPORT_DISABLE_CONNECTION_REUSE
+	selector.disable_connection_reuse = reuse ? PJ_FALSE : PJ_TRUE;
+#endif
+
+	/* The TLS transport verifies the server certificate against the destination name of a request */
+	if (pjsip_endpt_create_tdata(ast_sip_get_pjsip_endpoint(), &tdata) != PJ_SUCCESS) {
+		return NULL;
+	}
+	pj_strdup2(tdata->pool, &tdata->dest_info.name, target->host);
+
+	status = pjsip_endpt_acquire_transport2(ast_sip_get_pjsip_endpoint(), target->type,
+		&target->addr, pj_sockaddr_get_len(&target->addr), &selector, tdata, &connection);
+	pjsip_tx_data_dec_ref(tdata);
+
+	if (status != PJ_SUCCESS) {
+		char msg[PJ_ERR_MSG_SIZE];
+
+		pj_strerror(status, msg, sizeof(msg));
+		ast_debug(1, "Persistent connection to '%s' could not be opened: %s\n", target->host, msg);
+		return NULL;
+	}
+
+	return connection;
+}
+
+/*! \brief Reestablish any connections of a set that have gone away */
+static int persistent_connection_set_maintain(void *obj, void *arg, int flags)
+{
+	struct persistent_connection_set *set = obj;
+	struct ast_sip_transport_state *state;
+	int i;
+	unsigned int j;
+
+	state = ast_sip_get_transport_state(set->transport_id);
+	if (!state) {
+		return 0;
+	}
+
+	ao2_lock(set);
+	for (i = 0; state->factory && i < AST_VECTOR_SIZE(&set->targets); ++i) {
+		struct persistent_target *target = AST_VECTOR_GET_ADDR(&set->targets, i);
+
+		for (j = 0; j < set->pool; ++j) {
+			pjsip_transport *connection = target->connections[j];
+
+			if (connection && !connection->is_shutdown && !connection->is_destroying) {
+				continue;
+			}
+
+			if (connection) {
+				pjsip_transport_dec_ref(connection);
+			}
+
+			/* The first connection may be shared with requests, the others are spares */
+			target->connections[j] = persistent_target_connect(target, state->factory, !j);
+		}
+	}
+	ao2_unlock(set);
+
+	ao2_ref(state, -1);
+
+	return 0;
+}
+
+static int persistent_connections_maintain(void *data)
+{
+	ao2_callback(persistent_connection_sets, OBJ_NODATA | OBJ_MULTIPLE,
+		persistent_connection_set_maintain, NULL);
+
+	return 0;
+}
+
+static int persistent_connection_set_maintain_task(void *data)
+{
+	struct persistent_connection_set *set = data;
+
+	persistent_connection_set_maintain(set, NULL, 0);
+	ao2_ref(set, -1);
+
+	return 0;
+}
+
+static int persistent_connection_set_unref_task(void *data)
+{
+	ao2_ref(data, -1);
+
+	return 0;
+}
+
+/*! \brief Resolve a persistent connection target and add it to a set */
+static int persistent_connection_set_add(struct persistent_connection_set *set,
+	const struct ast_sip_transport *transport, const struct ast_sip_transport_state *state,
+	char *name)
+{
+	struct persistent_target target = { .type = PJSIP_TRANSPORT_TCP, };
+	struct ast_sockaddr *addrs;
+	char *host;
+	char *port;
+	int family;
+	int count;
+
+	if (!ast_sockaddr_split_hostport(ast_strdupa(name), &host, &port, 0)) {
+		ast_log(LOG_ERROR, "Persistent connection target '%s' on transport '%s' is invalid\n",
+			name, set->transport_id);
+		return -1;
+	}
+
+	family = state->host.addr.sa_family == pj_AF_INET6() ? AF_INET6 : AF_INET;
+	count = ast_sockaddr_resolve(&addrs, name, 0, family);
+	if (count <= 0) {
+		ast_log(LOG_ERROR, "Persistent connection target '%s' on transport '%s' could not be resolved\n",
+			name, set->transport_id);
+		return -1;
+	}
+
+	if (!ast_sockaddr_port(&addrs[0])) {
+		ast_sockaddr_set_port(&addrs[0], transport->type == AST_TRANSPORT_TLS ? 5061 : 5060);
+	}
+	ast_sockaddr_to_pj_sockaddr(&addrs[0], &target.addr);
+	ast_free(addrs);
+
+	if (transport->type == AST_TRANSPORT_TLS) {
+		target.type = PJSIP_TRANSPORT_TLS;
+	}
+	if (family == AF_INET6) {
+		target.type |= PJSIP_TRANSPORT_IPV6;
+	}
+
+	target.host = ast_strdup(host);
+	if (!target.host || AST_VECTOR_APPEND(&set->targets, target)) {
+		ast_free(target.host);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*!
+ * \brief Replace the persistent connections of a transport with the configured ones
+ *
+ * \note Called with the transport states container locked.
+ */
+static void persistent_connections_apply(const struct ast_sip_transport *transport,
+	const struct ast_sip_transport_state *state)
+{
+	const char *transport_id = ast_sorcery_object_get_id(transport);
+	struct persistent_connection_set *set;
+	char *targets;
+	char *name;
+
+	set = ao2_find(persistent_connection_sets, transport_id, OBJ_SEARCH_KEY | OBJ_UNLINK);
+	if (set) {
+		/* The old connections are let go on a PJSIP thread without waiting on it here */
+		if (ast_sip_push_task(NULL, persistent_connection_set_unref_task, set)) {
+			ao2_ref(set, -1);
+		}
+	}
+
+	if (ast_strlen_zero(transport->persistent_connections)) {
+		return;
+	}
+
+	if (transport->type != AST_TRANSPORT_TCP && transport->type != AST_TRANSPORT_TLS) {
+		ast_log(LOG_WARNING, "Transport '%s' can only keep persistent connections when protocol is tcp or tls\n",
+			transport_id);
+		return;
+	}
+
+	set = ao2_alloc(sizeof(*set) + strlen(transport_id) + 1, persistent_connection_set_destroy);
+	if (!set) {
+		return;
+	}
+	strcpy(set->transport_id, transport_id); /* Safe */
+	set->pool = transport->persistent_connection_pool;
+#ifndef HAVE_PJSIP_TRANSPORT_DISABLE_CONNECTION_REUSE
+	if (set->pool > 1) {
+		ast_log(LOG_WARNING, "Transport '%s' can only keep one connection to each target as connection reuse can not be disabled\n",
+			transport_id);
+		set->pool = 1;
+	}
+#endif
+
+	if (AST_VECTOR_INIT(&set->targets, 1)) {
+		ao2_ref(set, -1);
+		return;
+	}
+
+	targets = ast_strdupa(transport->persistent_connections);
+	while ((name = ast_strip(strsep(&targets, ",")))) {
+		if (!ast_strlen_zero(name)) {
+			persistent_connection_set_add(set, transport, state, name);
+		}
+	}
+
+	if (AST_VECTOR_SIZE(&set->targets)) {
+		ao2_link(persistent_connection_sets, set);
+		/* Open the connections now rather than at the next periodic check */
+		if (ast_sip_push_task(NULL, persistent_connection_set_maintain_task, ao2_bump(set))) {
+			ao2_ref(set, -1);
+		}
+	}
+	ao2_ref(set, -1);
+}
+
 /*! \brief Apply handler for transports */
 static int transport_apply(const struct ast_sorcery *sorcery, void *obj)
 {
@@ -853,6 +1141,8 @@ static int transport_apply(const struct ast_sorcery *sorcery, void *obj)
 	}
 	ao2_link_flags(states, temp_state, OBJ_NOLOCK);
 
+	persistent_connections_apply(transport, temp_state->state);
+
 	return 0;
 }
 
@@ -1600,6 +1890,17 @@ int ast_sip_initialize_sorcery_transport(void)
 		return -1;
 	}
 
+	persistent_connection_sets = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0,
+		PERSISTENT_CONNECTION_BUCKETS, persistent_connection_set_hash_fn, NULL,
+		persistent_connection_set_cmp_fn);
+	if (!persistent_connection_sets) {
+		ast_log(LOG_ERROR, "Unable to allocate persistent connections container\n");
+		return -1;
+	}
+	persistent_connections_task = ast_sip_schedule_task(NULL, PERSISTENT_CONNECTION_INTERVAL,
+		persistent_connections_maintain, "pjsip/persistent_connections", NULL,
+		AST_SIP_SCHED_TASK_PERIODIC);
+
 	ast_sorcery_apply_default(sorcery, "transport", "config", "pjsip.conf,criteria=type=transport");
 
 	if (ast_sorcery_object_register(sorcery, "transport", sip_transport_alloc, NULL, transport_apply)) {
@@ -1633,6 +1934,8 @@ int ast_sip_initialize_sorcery_transport(void)
 	ast_sorcery_object_field_register(sorcery, "transport", "websocket_write_timeout", AST_DEFAULT_WEBSOCKET_WRITE_TIMEOUT_STR, OPT_INT_T, PARSE_IN_RANGE, FLDSET(struct ast_sip_transport, write_timeout), 1, INT_MAX);
 	ast_sorcery_object_field_register(sorcery, "transport", "allow_reload", "no", OPT_BOOL_T, 1, FLDSET(struct ast_sip_transport, allow_reload));
 	ast_sorcery_object_field_register(sorcery, "transport", "symmetric_transport", "no", OPT_BOOL_T, 1, FLDSET(struct ast_sip_transport, symmetric_transport));
+	ast_sorcery_object_field_register(sorcery, "transport", "persistent_connections", "", OPT_STRINGFIELD_T, 0, STRFLDSET(struct ast_sip_transport, persistent_connections));
+	ast_sorcery_object_field_register(sorcery, "transport", "persistent_connection_pool", "1", OPT_UINT_T, PARSE_IN_RANGE, FLDSET(struct ast_sip_transport, persistent_connection_pool), 1, PERSISTENT_CONNECTION_POOL_MAX);
 
 	ast_sip_register_endpoint_formatter(&endpoint_transport_formatter);
 
@@ -1666,6 +1969,14 @@ int ast_sip_destroy_sorcery_transport(void)
 
 	ast_sip_unregister_endpoint_formatter(&endpoint_transport_formatter);
 
+	if (persistent_connections_task) {
+		ast_sip_sched_task_cancel(persistent_connections_task);
+		ao2_ref(persistent_connections_task, -1);
+		persistent_connections_task = NULL;
+	}
+	ao2_cleanup(persistent_connection_sets);
+	persistent_connection_sets = NULL;
+
 	ao2_ref(transport_states, -1);
 	transport_states = NULL;
 
@@ -286,6 +286,13 @@ void ast_res_pjsip_cleanup_message_filter(void);
  */
 void sip_get_threadpool_options(struct ast_threadpool_options *threadpool_options);
 
+/*!
+ * \internal
+ * \brief Get the number of kilobytes of released memory pools to keep for reuse
+ * \since 17.0.0
+ */
+unsigned int sip_get_pool_cache_size(void);
+
 /*!
  * \internal
  * \brief Retrieve the name of the default outbound endpoint.
@@ -418,4 +425,33 @@ enum ast_sip_taskprocessor_overload_trigger ast_sip_get_taskprocessor_overload_t
 
 const char *ast_sip_overload_trigger_to_str(enum ast_sip_taskprocessor_overload_trigger trigger);
 
+/*!
+ * \internal
+ * \brief Retrieve the global setting 'stateless_options'.
+ * \since 17.0.0
+ *
+ * \retval non zero if the distributor answers out-of-dialog OPTIONS pings itself.
+ */
+unsigned int ast_sip_get_stateless_options(void);
+
+/*!
+ * \internal
+ * \brief Retrieve the global setting 'contact_write_behind'.
+ * \since 17.0.0
+ *
+ * \return The number of seconds a contact refresh may be held in memory before
+ *         it is written, 0 to write every refresh straight away.
+ */
+unsigned int ast_sip_get_contact_write_behind(void);
+
+/*!
+ * \internal
+ * \brief Retrieve the global setting 'qualify_jitter'.
+ * \since 17.0.0
+ *
+ * \return The percentage of an AOR's qualify frequency each qualify may be
+ *         brought forward by, 0 to qualify at exactly the frequency.
+ */
+unsigned int ast_sip_get_qualify_jitter(void);
+
 #endif /* RES_PJSIP_PRIVATE_H_ */
@@ -33,6 +33,18 @@
 
 #include "asterisk/res_pjproject.h"
 
+/*! \brief Number of buckets for the contact index, by AOR */
+#define CONTACT_INDEX_BUCKETS 1021
+
+/*! \brief Index of dynamic contacts by AOR, NULL if the contact wizards rule it out */
+static struct ao2_container *contact_index;
+
+/*! \brief Contact refreshes held in memory by contact id, NULL without the index */
+static struct ao2_container *contact_refreshes;
+
+/*! \brief Task writing held back contact refreshes to sorcery */
+static struct ast_sip_sched_task *contact_refreshes_task;
+
 static int pj_max_hostname = PJ_MAX_HOSTNAME;
 static int pjsip_max_url_size = PJSIP_MAX_URL_SIZE;
 
@@ -99,6 +111,10 @@ static void aor_deleted_observer(const void *object)
 	ao2_callback(contacts, OBJ_NODATA | OBJ_MULTIPLE | OBJ_UNLINK, destroy_contact, NULL);
 
 	ao2_ref(contacts, -1);
+
+	if (contact_index) {
+		ao2_find(contact_index, aor_id, OBJ_SEARCH_KEY | OBJ_UNLINK | OBJ_NODATA);
+	}
 }
 
 /*! \brief Observer for contacts so state can be updated on respective endpoints */
@@ -144,6 +160,566 @@ static void *contact_alloc(const char *name)
 	return contact;
 }
 
+/*!
+ * \brief Copy handler for contact
+ *
+ * The registrar and qualify code copy contacts just to change a field or two.
+ * Copying the members directly avoids building an object set and applying
+ * every field of it to the copy.
+ */
+static int contact_copy_handler(const void *src, void *dst)
+{
+	const struct ast_sip_contact *src_contact = src;
+	struct ast_sip_contact *dst_contact = dst;
+
+	if (ast_string_fields_copy(dst_contact, src_contact)) {
+		return -1;
+	}
+	dst_contact->expiration_time = src_contact->expiration_time;
+	dst_contact->qualify_frequency = src_contact->qualify_frequency;
+	dst_contact->authenticate_qualify = src_contact->authenticate_qualify;
+	dst_contact->qualify_timeout = src_contact->qualify_timeout;
+	dst_contact->endpoint = ao2_bump(src_contact->endpoint);
+	dst_contact->via_port = src_contact->via_port;
+	dst_contact->prune_on_boot = src_contact->prune_on_boot;
+
+	return 0;
+}
+
+/*! \brief A contact refresh which has yet to be written to sorcery */
+struct contact_refresh {
+	/*! \brief The refreshed contact, which is also the one in the index */
+	struct ast_sip_contact *contact;
+	/*! \brief Expiration time of the contact as last written to sorcery */
+	struct timeval stored;
+	/*! \brief When the oldest unwritten refresh happened */
+	struct timeval deferred;
+	/*! \brief Sorcery id of the contact */
+	char id[0];
+};
+
+AO2_STRING_FIELD_HASH_FN(contact_refresh, id)
+AO2_STRING_FIELD_CMP_FN(contact_refresh, id)
+
+/*!
+ * \brief The dynamic contacts of an AOR, kept so retrievals need not search
+ * the sorcery backend
+ */
+struct contact_index_entry {
+	/*! \brief Non-zero once the contacts have been read from sorcery */
+	int loaded;
+	/*! \brief The dynamic contacts of the AOR, sorted by id */
+	struct ao2_container *contacts;
+	/*! \brief Contacts deleted here whose observer has yet to run */
+	AST_VECTOR(, struct ast_sip_contact *) deleting;
+	/*! \brief Name of the AOR */
+	char aor[0];
+};
+
+AO2_STRING_FIELD_HASH_FN(contact_index_entry, aor)
+AO2_STRING_FIELD_CMP_FN(contact_index_entry, aor)
+
+static void contact_index_entry_destroy(void *obj)
+{
+	struct contact_index_entry *entry = obj;
+
+	ao2_cleanup(entry->contacts);
+	AST_VECTOR_CALLBACK_VOID(&entry->deleting, ao2_ref, -1);
+	AST_VECTOR_FREE(&entry->deleting);
+}
+
+/*! \brief Find the index entry of an AOR, creating it if needed */
+static struct contact_index_entry *contact_index_entry_get(const char *aor_name)
+{
+	struct contact_index_entry *entry;
+	size_t len = strlen(aor_name) + 1;
+
+	ao2_lock(contact_index);
+	entry = ao2_find(contact_index, aor_name, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if (!entry) {
+		entry = ao2_alloc(sizeof(*entry) + len, contact_index_entry_destroy);
+		if (entry) {
+			memcpy(entry->aor, aor_name, len);
+			ao2_link_flags(contact_index, entry, OBJ_NOLOCK);
+		}
+	}
+	ao2_unlock(contact_index);
+
+	return entry;
+}
+
+/*! \brief Forget the contacts of an index entry so they are read again from sorcery */
+static void contact_index_entry_invalidate(struct contact_index_entry *entry)
+{
+	ao2_lock(entry);
+	if (entry->loaded) {
+		ast_debug(3, "Contacts of AOR '%s' changed elsewhere, dropping them from the index\n",
+			entry->aor);
+		entry->loaded = 0;
+		ao2_cleanup(entry->contacts);
+		entry->contacts = NULL;
+	}
+	ao2_unlock(entry);
+}
+
+static void contact_index_store(struct contact_index_entry *entry, struct ast_sip_contact *contact);
+
+/*!
+ * \internal
+ * \brief Replace contacts just read from sorcery with refreshes it does not have yet
+ *
+ * \note The AOR entry must be locked.
+ */
+static void contact_index_apply_refreshes(struct contact_index_entry *entry)
+{
+	AST_VECTOR(, struct ast_sip_contact *) refreshed = { 0, };
+	struct ast_sip_contact *contact;
+	struct ao2_iterator iter;
+	int idx;
+
+	if (!contact_refreshes || !ao2_container_count(contact_refreshes)) {
+		return;
+	}
+
+	iter = ao2_iterator_init(entry->contacts, 0);
+	for (; (contact = ao2_iterator_next(&iter)); ao2_ref(contact, -1)) {
+		struct contact_refresh *refresh;
+
+		refresh = ao2_find(contact_refreshes, ast_sorcery_object_get_id(contact), OBJ_SEARCH_KEY);
+		if (refresh && !AST_VECTOR_APPEND(&refreshed, refresh->contact)) {
+			ao2_ref(refresh->contact, +1);
+		}
+		ao2_cleanup(refresh);
+	}
+	ao2_iterator_destroy(&iter);
+
+	for (idx = 0; idx < AST_VECTOR_SIZE(&refreshed); ++idx) {
+		contact = AST_VECTOR_GET(&refreshed, idx);
+		if (entry->loaded) {
+			contact_index_store(entry, contact);
+		}
+		ao2_ref(contact, -1);
+	}
+	AST_VECTOR_FREE(&refreshed);
+}
+
+/*!
+ * \internal
+ * \brief Retrieve the dynamic contacts of an AOR through the index
+ *
+ * \note The AOR entry must be locked.
+ */
+static struct ao2_container *contact_index_retrieve(struct contact_index_entry *entry,
+	const char *prefix, size_t prefix_len)
+{
+	struct ao2_container *contacts;
+
+	if (!entry->loaded) {
+		contacts = ast_sorcery_retrieve_by_prefix(ast_sip_get_sorcery(), "contact", prefix, prefix_len);
+		if (!contacts) {
+			return NULL;
+		}
+
+		entry->contacts = ao2_container_alloc_list(AO2_ALLOC_OPT_LOCK_NOLOCK, 0,
+			ast_sorcery_object_id_sort, NULL);
+		if (!entry->contacts || ao2_container_dup(entry->contacts, contacts, 0)) {
+			ao2_cleanup(entry->contacts);
+			entry->contacts = NULL;
+			return contacts;
+		}
+		ao2_ref(contacts, -1);
+		entry->loaded = 1;
+		contact_index_apply_refreshes(entry);
+	}
+
+	/* Callers are free to change the container they get back */
+	contacts = ao2_container_alloc_list(AO2_ALLOC_OPT_LOCK_NOLOCK, 0, NULL, NULL);
+	if (contacts && ao2_container_dup(contacts, entry->contacts, 0)) {
+		ao2_ref(contacts, -1);
+		contacts = NULL;
+	}
+
+	return contacts;
+}
+
+/*!
+ * \internal
+ * \brief Record a contact written to sorcery in the index
+ *
+ * \note The AOR entry must be locked.
+ */
+static void contact_index_store(struct contact_index_entry *entry, struct ast_sip_contact *contact)
+{
+	if (!entry->loaded) {
+		return;
+	}
+
+	ao2_find(entry->contacts, ast_sorcery_object_get_id(contact),
+		OBJ_SEARCH_KEY | OBJ_UNLINK | OBJ_NODATA);
+	if (!ao2_link(entry->contacts, contact)) {
+		/* Better to read the contacts again than to go without this one */
+		entry->loaded = 0;
+		ao2_cleanup(entry->contacts);
+		entry->contacts = NULL;
+	}
+}
+
+/*!
+ * \internal
+ * \brief Remove a contact deleted from sorcery from the index
+ *
+ * \note The AOR entry must be locked.
+ */
+static void contact_index_remove(struct contact_index_entry *entry, struct ast_sip_contact *contact)
+{
+	/* The observer will know the deletion came from here by the object */
+	if (!AST_VECTOR_APPEND(&entry->deleting, contact)) {
+		ao2_ref(contact, +1);
+	}
+
+	if (entry->loaded) {
+		ao2_find(entry->contacts, ast_sorcery_object_get_id(contact),
+			OBJ_SEARCH_KEY | OBJ_UNLINK | OBJ_NODATA);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Observer for contacts created or updated, possibly by someone else
+ *
+ * \details
+ * Contacts written through this module are in the index by the time their
+ * observers run, so only contacts written elsewhere, such as through ARI,
+ * cause the contacts of the AOR to be read again.
+ */
+static void contact_index_changed_observer(const void *object)
+{
+	const struct ast_sip_contact *contact = object;
+	struct contact_index_entry *entry;
+	struct ast_sip_contact *indexed = NULL;
+
+	entry = ao2_find(contact_index, contact->aor, OBJ_SEARCH_KEY);
+	if (!entry) {
+		return;
+	}
+
+	ao2_lock(entry);
+	if (entry->loaded) {
+		indexed = ao2_find(entry->contacts, ast_sorcery_object_get_id(contact), OBJ_SEARCH_KEY);
+		if (indexed != contact) {
+			contact_index_entry_invalidate(entry);
+		}
+	}
+	ao2_unlock(entry);
+
+	ao2_cleanup(indexed);
+	ao2_ref(entry, -1);
+}
+
+/*! \brief Observer for contacts deleted, possibly by someone else */
+static void contact_index_deleted_observer(const void *object)
+{
+	const struct ast_sip_contact *contact = object;
+	struct contact_index_entry *entry;
+	int idx;
+
+	entry = ao2_find(contact_index, contact->aor, OBJ_SEARCH_KEY);
+	if (!entry) {
+		return;
+	}
+
+	ao2_lock(entry);
+	for (idx = 0; idx < AST_VECTOR_SIZE(&entry->deleting); ++idx) {
+		if (AST_VECTOR_GET(&entry->deleting, idx) == contact) {
+			break;
+		}
+	}
+	if (idx < AST_VECTOR_SIZE(&entry->deleting)) {
+		ao2_ref(AST_VECTOR_REMOVE_UNORDERED(&entry->deleting, idx), -1);
+	} else {
+		contact_index_entry_invalidate(entry);
+	}
+	ao2_unlock(entry);
+
+	ao2_ref(entry, -1);
+}
+
+static int contact_index_entry_invalidate_cb(void *obj, void *arg, int flags)
+{
+	contact_index_entry_invalidate(obj);
+	return 0;
+}
+
+/*! \brief Observer for the contact type being reloaded, after which anything may have changed */
+static void contact_index_loaded_observer(const char *object_type)
+{
+	ao2_callback(contact_index, OBJ_NODATA, contact_index_entry_invalidate_cb, NULL);
+}
+
+/*! \brief Observer keeping the contact index in step with changes made elsewhere */
+static const struct ast_sorcery_observer contact_index_observer = {
+	.created = contact_index_changed_observer,
+	.updated = contact_index_changed_observer,
+	.deleted = contact_index_deleted_observer,
+	.loaded = contact_index_loaded_observer,
+};
+
+/*!
+ * \internal
+ * \brief Determine whether contacts can only change through sorcery in this process
+ *
+ * \details
+ * Contacts in realtime may be changed by other servers sharing the database
+ * without any observer noticing, so the index is only used for contacts
+ * kept in the local astdb or in memory.
+ */
+static int contact_index_usable(void)
+{
+	struct ast_sorcery_wizard *wizard;
+	int count;
+	int idx;
+
+	count = ast_sorcery_get_wizard_mapping_count(ast_sip_get_sorcery(), "contact");
+	if (count <= 0) {
+		return 0;
+	}
+
+	for (idx = 0; idx < count; ++idx) {
+		int local;
+
+		if (ast_sorcery_get_wizard_mapping(ast_sip_get_sorcery(), "contact", idx, &wizard, NULL)) {
+			return 0;
+		}
+		local = !strcmp(wizard->name, "astdb") || !strcmp(wizard->name, "memory");
+		ao2_ref(wizard, -1);
+		if (!local) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/*! \brief Ways of writing a contact to sorcery */
+enum contact_write_op {
+	CONTACT_WRITE_CREATE,
+	CONTACT_WRITE_UPDATE,
+	CONTACT_WRITE_DELETE,
+};
+
+static void contact_refresh_destroy(void *obj)
+{
+	struct contact_refresh *refresh = obj;
+
+	ao2_cleanup(refresh->contact);
+}
+
+/*!
+ * \internal
+ * \brief Write a contact to sorcery and the index
+ *
+ * \note The AOR entry must be locked.
+ */
+static int contact_write_through(struct contact_index_entry *entry,
+	struct ast_sip_contact *contact, enum contact_write_op op)
+{
+	int res;
+
+	switch (op) {
+	case CONTACT_WRITE_CREATE:
+		res = ast_sorcery_create(ast_sip_get_sorcery(), contact);
+		break;
+	case CONTACT_WRITE_UPDATE:
+		res = ast_sorcery_update(ast_sip_get_sorcery(), contact);
+		break;
+	case CONTACT_WRITE_DELETE:
+	default:
+		res = ast_sorcery_delete(ast_sip_get_sorcery(), contact);
+		break;
+	}
+	if (res || !entry) {
+		return res;
+	}
+
+	/* Any refresh still waiting to be written is part of this write now */
+	if (contact_refreshes) {
+		ao2_find(contact_refreshes, ast_sorcery_object_get_id(contact),
+			OBJ_SEARCH_KEY | OBJ_UNLINK | OBJ_NODATA);
+	}
+
+	if (op == CONTACT_WRITE_DELETE) {
+		contact_index_remove(entry, contact);
+	} else {
+		contact_index_store(entry, contact);
+	}
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Keep a refresh of a contact in memory instead of writing it to sorcery
+ *
+ * \details
+ * Only updates changing nothing but the expiration time are held back,
+ * and only while the expiration time in sorcery stays at least twice the
+ * write behind interval away. The contact is written within one interval,
+ * so after a crash no contact expires sooner than that.
+ *
+ * \note The AOR entry must be locked.
+ *
+ * \retval 1 The refresh was kept in memory
+ * \retval 0 The contact needs to be written now
+ */
+static int contact_refresh_defer(struct contact_index_entry *entry, struct ast_sip_contact *contact)
+{
+	const char *id = ast_sorcery_object_get_id(contact);
+	unsigned int interval = ast_sip_get_contact_write_behind();
+	struct ast_sip_contact *indexed;
+	struct contact_refresh *refresh = NULL;
+	struct ast_variable *changes = NULL;
+	struct timeval stored;
+	int deferred = 0;
+
+	if (!interval || !contact_refreshes || !entry->loaded) {
+		return 0;
+	}
+
+	indexed = ao2_find(entry->contacts, id, OBJ_SEARCH_KEY);
+	if (!indexed) {
+		return 0;
+	}
+
+	if (ast_sorcery_diff(ast_sip_get_sorcery(), indexed, contact, &changes)
+		|| !changes || changes->next || strcmp(changes->name, "expiration_time")) {
+		goto done;
+	}
+
+	refresh = ao2_find(contact_refreshes, id, OBJ_SEARCH_KEY);
+	stored = refresh ? refresh->stored : indexed->expiration_time;
+	if (ast_tvdiff_ms(stored, ast_tvnow()) <= 2000LL * interval) {
+		goto done;
+	}
+
+	if (!refresh) {
+		size_t len = strlen(id) + 1;
+
+		refresh = ao2_alloc_options(sizeof(*refresh) + len, contact_refresh_destroy,
+			AO2_ALLOC_OPT_LOCK_NOLOCK);
+		if (!refresh) {
+			goto done;
+		}
+		memcpy(refresh->id, id, len);
+		refresh->stored = stored;
+		refresh->deferred = ast_tvnow();
+		if (!ao2_link(contact_refreshes, refresh)) {
+			goto done;
+		}
+	}
+
+	ao2_replace(refresh->contact, contact);
+	contact_index_store(entry, contact);
+	deferred = entry->loaded;
+
+done:
+	ast_variables_destroy(changes);
+	ao2_cleanup(refresh);
+	ao2_ref(indexed, -1);
+	return deferred;
+}
+
+/*!
+ * \internal
+ * \brief Create, update or delete a contact in sorcery, keeping the index in step
+ *
+ * \details
+ * The AOR entry stays locked while sorcery is written so that its contacts
+ * cannot be read from the backend half way through.
+ */
+static int contact_write(struct ast_sip_contact *contact, enum contact_write_op op)
+{
+	struct contact_index_entry *entry;
+	int res;
+
+	if (!contact_index) {
+		return contact_write_through(NULL, contact, op);
+	}
+
+	entry = contact_index_entry_get(contact->aor);
+	if (!entry) {
+		return -1;
+	}
+
+	ao2_lock(entry);
+	if (op == CONTACT_WRITE_UPDATE && contact_refresh_defer(entry, contact)) {
+		res = 0;
+	} else {
+		res = contact_write_through(entry, contact, op);
+	}
+	ao2_unlock(entry);
+
+	ao2_ref(entry, -1);
+	return res;
+}
+
+/*!
+ * \internal
+ * \brief Write contact refreshes held in memory to sorcery
+ *
+ * \param all Non-zero to write every refresh, not only those due
+ */
+static void contact_refreshes_flush(int all)
+{
+	unsigned int interval = ast_sip_get_contact_write_behind();
+	struct contact_refresh *refresh;
+	struct ao2_iterator iter;
+	struct timeval now = ast_tvnow();
+	int written = 0;
+
+	iter = ao2_iterator_init(contact_refreshes, 0);
+	for (; (refresh = ao2_iterator_next(&iter)); ao2_ref(refresh, -1)) {
+		struct contact_index_entry *entry;
+		struct contact_refresh *current;
+
+		if (!all && interval && ast_tvdiff_ms(now, refresh->deferred) < 1000LL * interval) {
+			continue;
+		}
+
+		entry = contact_index_entry_get(refresh->contact->aor);
+		if (!entry) {
+			continue;
+		}
+
+		ao2_lock(entry);
+		/* A write since may have taken care of the refresh already */
+		current = ao2_find(contact_refreshes, refresh->id, OBJ_SEARCH_KEY);
+		if (current == refresh) {
+			if (contact_write_through(entry, refresh->contact, CONTACT_WRITE_UPDATE)) {
+				ast_log(LOG_WARNING, "Failed to write refreshed contact '%s', will try again\n",
+					refresh->id);
+			} else {
+				++written;
+			}
+		}
+		ao2_cleanup(current);
+		ao2_unlock(entry);
+
+		ao2_ref(entry, -1);
+	}
+	ao2_iterator_destroy(&iter);
+
+	if (written) {
+		ast_debug(3, "Wrote %d refreshed contacts\n", written);
+	}
+}
+
+/*! \brief Scheduled task writing the contact refreshes which are due */
+static int contact_refreshes_flush_task(void *data)
+{
+	contact_refreshes_flush(0);
+	return 1;
+}
+
 struct ast_sip_aor *ast_sip_location_retrieve_aor(const char *aor_name)
 {
 	return ast_sorcery_retrieve_by_id(ast_sip_get_sorcery(), "aor", aor_name);
@@ -225,7 +801,21 @@ struct ao2_container *ast_sip_location_retrieve_aor_contacts_nolock_filtered(con
 	struct ao2_container *contacts;
 
 	sprintf(prefix, "%s;@", ast_sorcery_object_get_id(aor)); /* Safe */
-	if (!(contacts = ast_sorcery_retrieve_by_prefix(ast_sip_get_sorcery(), "contact", prefix, prefix_len))) {
+	if (contact_index) {
+		struct contact_index_entry *entry;
+
+		entry = contact_index_entry_get(ast_sorcery_object_get_id(aor));
+		if (!entry) {
+			return NULL;
+		}
+		ao2_lock(entry);
+		contacts = contact_index_retrieve(entry, prefix, prefix_len);
+		ao2_unlock(entry);
+		ao2_ref(entry, -1);
+	} else {
+		contacts = ast_sorcery_retrieve_by_prefix(ast_sip_get_sorcery(), "contact", prefix, prefix_len);
+	}
+	if (!contacts) {
 		return NULL;
 	}
 
@@ -349,6 +939,29 @@ struct ao2_container *ast_sip_location_retrieve_contacts_from_aor_list(const cha
 
 struct ast_sip_contact *ast_sip_location_retrieve_contact(const char *contact_name)
 {
+	if (contact_refreshes) {
+		struct contact_refresh *refresh;
+		struct ast_sip_contact *contact = NULL;
+
+		/* The latest refresh may not have been written yet */
+		refresh = ao2_find(contact_refreshes, contact_name, OBJ_SEARCH_KEY);
+		if (refresh) {
+			struct contact_index_entry *entry;
+
+			entry = contact_index_entry_get(refresh->contact->aor);
+			if (entry) {
+				ao2_lock(entry);
+				contact = ao2_bump(refresh->contact);
+				ao2_unlock(entry);
+				ao2_ref(entry, -1);
+			}
+			ao2_ref(refresh, -1);
+		}
+		if (contact) {
+			return contact;
+		}
+	}
+
 	return ast_sorcery_retrieve_by_id(ast_sip_get_sorcery(), "contact", contact_name);
 }
 
@@ -406,7 +1019,7 @@ struct ast_sip_contact *ast_sip_location_create_contact(struct ast_sip_aor *aor,
 
 	contact->prune_on_boot = prune_on_boot;
 
-	if (ast_sorcery_create(ast_sip_get_sorcery(), contact)) {
+	if (contact_write(contact, CONTACT_WRITE_CREATE)) {
 		ao2_ref(contact, -1);
 		return NULL;
 	}
@@ -444,12 +1057,12 @@ int ast_sip_location_add_contact(struct ast_sip_aor *aor, const char *uri,
 
 int ast_sip_location_update_contact(struct ast_sip_contact *contact)
 {
-	return ast_sorcery_update(ast_sip_get_sorcery(), contact);
+	return contact_write(contact, CONTACT_WRITE_UPDATE);
 }
 
 int ast_sip_location_delete_contact(struct ast_sip_contact *contact)
 {
-	return ast_sorcery_delete(ast_sip_get_sorcery(), contact);
+	return contact_write(contact, CONTACT_WRITE_DELETE);
 }
 
 static int prune_boot_contacts_cb(void *obj, void *arg, int flags)
@@ -1355,8 +1968,26 @@ int ast_sip_initialize_sorcery_location(void)
 		return -1;
 	}
 
+	ast_sorcery_object_set_copy_handler(sorcery, "contact", contact_copy_handler);
 	ast_sorcery_observer_add(sorcery, "aor", &aor_observer);
 
+	if (contact_index_usable()) {
+		contact_index = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0,
+			CONTACT_INDEX_BUCKETS, contact_index_entry_hash_fn, NULL, contact_index_entry_cmp_fn);
+		if (!contact_index) {
+			return -1;
+		}
+		ast_sorcery_observer_add(sorcery, "contact", &contact_index_observer);
+
+		contact_refreshes = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0,
+			CONTACT_INDEX_BUCKETS, contact_refresh_hash_fn, NULL, contact_refresh_cmp_fn);
+		if (!contact_refreshes) {
+			return -1;
+		}
+		contact_refreshes_task = ast_sip_schedule_task(NULL, 1000, contact_refreshes_flush_task,
+			"pjsip/contact_refreshes", NULL, AST_SIP_SCHED_TASK_PERIODIC);
+	}
+
 	ast_sorcery_object_field_register(sorcery, "contact", "type", "", OPT_NOOP_T, 0, 0);
 	ast_sorcery_object_field_register(sorcery, "contact", "uri", "", OPT_STRINGFIELD_T, 0, STRFLDSET(struct ast_sip_contact, uri));
 	ast_sorcery_object_field_register(sorcery, "contact", "path", "", OPT_STRINGFIELD_T, 0, STRFLDSET(struct ast_sip_contact, path));
@@ -1440,6 +2071,22 @@ int ast_sip_initialize_sorcery_location(void)
 int ast_sip_destroy_sorcery_location(void)
 {
 	ast_sorcery_observer_remove(ast_sip_get_sorcery(), "aor", &aor_observer);
+	if (contact_refreshes_task) {
+		ast_sip_sched_task_cancel(contact_refreshes_task);
+		ao2_ref(contact_refreshes_task, -1);
+		contact_refreshes_task = NULL;
+	}
+	if (contact_refreshes) {
+		/* Nothing held back may be lost on the way out */
+		contact_refreshes_flush(1);
+		ao2_ref(contact_refreshes, -1);
+		contact_refreshes = NULL;
+	}
+	if (contact_index) {
+		ast_sorcery_observer_remove(ast_sip_get_sorcery(), "contact", &contact_index_observer);
+		ao2_ref(contact_index, -1);
+		contact_index = NULL;
+	}
 	ast_cli_unregister_multiple(cli_commands, ARRAY_LEN(cli_commands));
 	ast_sip_unregister_cli_formatter(contact_formatter);
 	ast_sip_unregister_cli_formatter(aor_formatter);
@@ -1259,14 +1259,12 @@ static struct ast_endpoint *persistent_endpoint_find_or_create(const struct ast_
 			return NULL;
 		}
 
-		persistent->endpoint = ast_endpoint_create("PJSIP",
-			ast_sorcery_object_get_id(endpoint));
+		persistent->endpoint = ast_endpoint_create_with_state("PJSIP",
+			ast_sorcery_object_get_id(endpoint), AST_ENDPOINT_OFFLINE);
 		if (!persistent->endpoint) {
 			return NULL;
 		}
 
-		ast_endpoint_set_state(persistent->endpoint, AST_ENDPOINT_OFFLINE);
-
 		ao2_link_flags(persistent_endpoints, persistent, OBJ_NOLOCK);
 	}
 
@@ -52,6 +52,17 @@ static unsigned int unidentified_period;
 static unsigned int unidentified_prune_interval;
 static int using_auth_username;
 static enum ast_sip_taskprocessor_overload_trigger overload_trigger;
+static unsigned int stateless_options;
+
+/*! Counters for messages the distributor handled, shown by "pjsip show distributor" */
+static struct {
+	/*! Out-of-dialog OPTIONS requests answered on the transport thread */
+	int options_answered;
+	/*! Retransmitted requests handed straight to their transaction */
+	int retransmissions_absorbed;
+	/*! Messages pushed to a serializer */
+	int distributed;
+} distributor_stats;
 
 struct unidentified_request{
 	struct timeval first_seen;
@@ -482,6 +493,112 @@ static pjsip_module endpoint_mod = {
 	.on_rx_request = endpoint_lookup,
 };
 
+/*!
+ * \internal
+ * \brief Hand a retransmitted request straight to its transaction.
+ * \since 17.0.0
+ *
+ * \details
+ * The transaction layer absorbs a retransmission by resending its last
+ * response, so there is no need to clone the request and wait for a
+ * serializer to get to it.  ACK requests are left alone since they move
+ * the INVITE transaction on and its users expect to see that on their
+ * serializer.
+ *
+ * \param rdata The incoming request.
+ *
+ * \retval PJ_TRUE if the request was a retransmission.
+ */
+static pj_bool_t absorb_retransmission(pjsip_rx_data *rdata)
+{
+	pj_str_t tsx_key;
+	pjsip_transaction *tsx;
+	pj_bool_t absorbed = PJ_FALSE;
+
+	if (rdata->msg_info.msg->line.req.method.id == PJSIP_ACK_METHOD) {
+		return PJ_FALSE;
+	}
+
+	pjsip_tsx_create_key(rdata->tp_info.pool, &tsx_key, PJSIP_ROLE_UAS,
+		&rdata->msg_info.cseq->method, rdata);
+
+	tsx = pjsip_tsx_layer_find_tsx(&tsx_key, PJ_TRUE);
+	if (!tsx) {
+		return PJ_FALSE;
+	}
+
+	/* The transaction layer does not pass requests to a terminated transaction either */
+	if (tsx->state < PJSIP_TSX_STATE_TERMINATED) {
+		ast_debug(3, "Transaction %s absorbs retransmission %s\n",
+			tsx->obj_name, pjsip_rx_data_get_info(rdata));
+		pjsip_tsx_recv_msg(tsx, rdata);
+		ast_atomic_fetchadd_int(&distributor_stats.retransmissions_absorbed, +1);
+		absorbed = PJ_TRUE;
+	}
+
+#ifdef HAVE_PJ_TRANSACTION_GRP_LOCK
+	pj_grp_lock_release(tsx->grp_lock);
+#else
+	pj_mutex_unlock(tsx->mutex);
+#endif
+
+	return absorbed;
+}
+
+/*!
+ * \internal
+ * \brief Answer an out-of-dialog OPTIONS ping statelessly.
+ * \since 17.0.0
+ *
+ * \details
+ * Only OPTIONS requests without a To tag and without a user in the
+ * Request-URI are answered, and only if the stateless_options global
+ * option is enabled.  Anything else needs an endpoint and takes the
+ * normal path to pjsip_options.c.
+ *
+ * \param rdata The incoming request.
+ *
+ * \retval PJ_TRUE if the request was answered.
+ */
+static pj_bool_t answer_options(pjsip_rx_data *rdata)
+{
+	pjsip_endpoint *endpt = ast_sip_get_pjsip_endpoint();
+	pjsip_uri *ruri = rdata->msg_info.msg->line.req.uri;
+	pjsip_tx_data *tdata;
+	const pjsip_hdr *hdr;
+
+	if (!stateless_options
+		|| rdata->msg_info.msg->line.req.method.id != PJSIP_OPTIONS_METHOD
+		|| rdata->msg_info.to->tag.slen
+		|| (!PJSIP_URI_SCHEME_IS_SIP(ruri) && !PJSIP_URI_SCHEME_IS_SIPS(ruri))
+		|| ((pjsip_sip_uri *) pjsip_uri_get_uri(ruri))->user.slen
+		|| ast_shutting_down()) {
+		return PJ_FALSE;
+	}
+
+	if (pjsip_endpt_create_response(endpt, rdata, 200, NULL, &tdata) != PJ_SUCCESS) {
+		return PJ_FALSE;
+	}
+
+	/* The same capabilities pjsip_options.c advertises */
+	if ((hdr = pjsip_endpt_get_capability(endpt, PJSIP_H_ACCEPT, NULL))) {
+		pjsip_msg_add_hdr(tdata->msg, (pjsip_hdr *) pjsip_hdr_clone(tdata->pool, hdr));
+	}
+	if ((hdr = pjsip_endpt_get_capability(endpt, PJSIP_H_ALLOW, NULL))) {
+		pjsip_msg_add_hdr(tdata->msg, (pjsip_hdr *) pjsip_hdr_clone(tdata->pool, hdr));
+	}
+	if ((hdr = pjsip_endpt_get_capability(endpt, PJSIP_H_SUPPORTED, NULL))) {
+		pjsip_msg_add_hdr(tdata->msg, (pjsip_hdr *) pjsip_hdr_clone(tdata->pool, hdr));
+	}
+
+	if (pjsip_endpt_send_response2(endpt, rdata, tdata, NULL, NULL) != PJ_SUCCESS) {
+		pjsip_tx_data_dec_ref(tdata);
+	}
+
+	ast_atomic_fetchadd_int(&distributor_stats.options_answered, +1);
+	return PJ_TRUE;
+}
+
 static pj_bool_t distributor(pjsip_rx_data *rdata)
 {
 	pjsip_dialog *dlg;
@@ -497,6 +614,12 @@ static pj_bool_t distributor(pjsip_rx_data *rdata)
 		return PJ_TRUE;
 	}
 
+	/* Handle what needs neither a serializer nor an endpoint right here */
+	if (rdata->msg_info.msg->type == PJSIP_REQUEST_MSG
+		&& (absorb_retransmission(rdata) || answer_options(rdata))) {
+		return PJ_TRUE;
+	}
+
 	dlg = find_dialog(rdata);
 	if (dlg) {
 		ast_debug(3, "Searching for serializer associated with dialog %s for %s\n",
@@ -584,6 +707,8 @@ static pj_bool_t distributor(pjsip_rx_data *rdata)
 	if (ast_sip_push_task(serializer, distribute, clone)) {
 		ao2_cleanup(clone->endpt_info.mod_data[endpoint_mod.id]);
 		pjsip_rx_data_free_cloned(clone);
+	} else {
+		ast_atomic_fetchadd_int(&distributor_stats.distributed, +1);
 	}
 
 	ast_taskprocessor_unreference(serializer);
@@ -1124,11 +1249,37 @@ static int cli_unid_print_body(void *obj, void *arg, int flags)
 	return 0;
 }
 
+static char *cli_show_distributor(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "pjsip show distributor";
+		e->usage =
+			"Usage: pjsip show distributor\n"
+			"       Show how the PJSIP distributor handled incoming messages\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	ast_cli(a->fd, "Stateless OPTIONS:         %s\n", stateless_options ? "Yes" : "No");
+	ast_cli(a->fd, "OPTIONS answered:          %d\n", distributor_stats.options_answered);
+	ast_cli(a->fd, "Retransmissions absorbed:  %d\n", distributor_stats.retransmissions_absorbed);
+	ast_cli(a->fd, "Messages distributed:      %d\n", distributor_stats.distributed);
+
+	return CLI_SUCCESS;
+}
+
 static struct ast_cli_entry cli_commands[] = {
 	AST_CLI_DEFINE(ast_sip_cli_traverse_objects, "Show PJSIP Unidentified Requests",
 		.command = "pjsip show unidentified_requests",
 		.usage = "Usage: pjsip show unidentified_requests\n"
 				"       Show the PJSIP Unidentified Requests\n"),
+	AST_CLI_DEFINE(cli_show_distributor, "Show PJSIP distributor statistics"),
 };
 
 struct ast_sip_cli_formatter_entry *unid_formatter;
@@ -1202,6 +1353,8 @@ static void global_loaded(const char *object_type)
 
 	overload_trigger = ast_sip_get_taskprocessor_overload_trigger();
 
+	stateless_options = ast_sip_get_stateless_options();
+
 	/* Clean out the old task, if any */
 	ast_sched_clean_by_callback(prune_context, prune_task, clean_task);
 	/* Have to do something with the return value to shut up the stupid compiler. */
@@ -113,6 +113,12 @@
 /*! \brief These are the number of buckets (per AOR) to use to store contacts */
 #define CONTACT_BUCKETS 13
 
+/*! \brief The number of contacts on an AOR qualified together before the rest are spread out */
+#define QUALIFY_BATCH_SIZE 50
+
+/*! \brief The longest time between two batches of qualifies on an AOR (milliseconds) */
+#define QUALIFY_BATCH_GAP 100
+
 /*! \brief These are the number of buckets to store endpoint state compositors */
 #define ENDPOINT_STATE_COMPOSITOR_BUCKETS 13
 
@@ -184,6 +190,10 @@ struct sip_options_aor {
 	int authenticate_qualify;
 	/*! \brief Qualify timeout. 0 is diabled. */
 	double qualify_timeout;
+	/*! \brief Contacts still to be qualified in the current batched qualify round */
+	AST_VECTOR(, struct ast_sip_contact *) qualify_pending;
+	/*! \brief When the current batched qualify round started */
+	struct timeval qualify_round_start;
 	/*! \brief The name of the AOR */
 	char name[0];
 };
@@ -934,6 +944,104 @@ static int sip_options_qualify_aor(void *obj)
 	return aor_options->qualify_frequency * 1000;
 }
 
+/*! \brief Determine the time until the next qualify round of an AOR, less any jitter */
+static int sip_options_determine_next_qualify_time(const struct sip_options_aor *aor_options)
+{
+	int interval = aor_options->qualify_frequency * 1000;
+	unsigned int jitter = ast_sip_get_qualify_jitter();
+
+	if (jitter) {
+		interval -= (int)(interval * (jitter / 100.0) * ast_random_double());
+	}
+	return 0 < interval ? interval : 1;
+}
+
+/*! \brief Add a contact of an AOR to its pending qualify round */
+static int sip_options_collect_qualify_contact(void *obj, void *arg, int flags)
+{
+	struct ast_sip_contact *contact = obj;
+	struct sip_options_aor *aor_options = arg;
+
+	if (!AST_VECTOR_APPEND(&aor_options->qualify_pending, contact)) {
+		ao2_ref(contact, +1);
+	}
+
+	return 0;
+}
+
+/*!
+ * \brief Scheduled task to qualify contacts of an AOR
+ * \note Run by aor_options->serializer
+ *
+ * AORs with more than QUALIFY_BATCH_SIZE contacts are qualified in
+ * batches spread over the first half of the qualify frequency, so a
+ * large AOR does not send all of its OPTIONS requests at once.
+ */
+static int sip_options_qualify_aor_scheduled(void *obj)
+{
+	struct sip_options_aor *aor_options = obj;
+	int elapsed;
+	int remaining;
+	int count;
+
+	if (!AST_VECTOR_SIZE(&aor_options->qualify_pending)) {
+		if (ao2_container_count(aor_options->contacts) <= QUALIFY_BATCH_SIZE) {
+			sip_options_qualify_aor(aor_options);
+			return sip_options_determine_next_qualify_time(aor_options);
+		}
+
+		ao2_callback(aor_options->contacts, OBJ_NODATA,
+			sip_options_collect_qualify_contact, aor_options);
+		aor_options->qualify_round_start = ast_tvnow();
+		ast_debug(3, "Qualifying %zu contacts on AOR '%s' in batches of %d\n",
+			AST_VECTOR_SIZE(&aor_options->qualify_pending), aor_options->name,
+			QUALIFY_BATCH_SIZE);
+	}
+
+	for (count = 0; count < QUALIFY_BATCH_SIZE && AST_VECTOR_SIZE(&aor_options->qualify_pending); ++count) {
+		struct ast_sip_contact *contact;
+		struct ast_sip_contact *current;
+
+		contact = AST_VECTOR_REMOVE(&aor_options->qualify_pending,
+			AST_VECTOR_SIZE(&aor_options->qualify_pending) - 1, 0);
+
+		/* The contact may have been removed from the AOR since the round started */
+		current = ao2_find(aor_options->contacts, contact, OBJ_SEARCH_OBJECT);
+		if (current) {
+			sip_options_qualify_contact(current, aor_options, 0);
+			ao2_ref(current, -1);
+		}
+		ao2_ref(contact, -1);
+	}
+
+	elapsed = ast_tvdiff_ms(ast_tvnow(), aor_options->qualify_round_start);
+
+	if (AST_VECTOR_SIZE(&aor_options->qualify_pending)) {
+		size_t batches = (AST_VECTOR_SIZE(&aor_options->qualify_pending) + QUALIFY_BATCH_SIZE - 1)
+			/ QUALIFY_BATCH_SIZE;
+
+		remaining = (int)((aor_options->qualify_frequency * 1000 / 2 - elapsed) / (int)batches);
+		return MAX(MIN(remaining, QUALIFY_BATCH_GAP), 1);
+	}
+
+	remaining = sip_options_determine_next_qualify_time(aor_options) - elapsed;
+	return 0 < remaining ? remaining : 1;
+}
+
+/*!
+ * \brief Stop qualifying the contacts of an AOR
+ * \note Run by aor_options->serializer
+ */
+static void sip_options_aor_cancel_qualify(struct sip_options_aor *aor_options)
+{
+	if (aor_options->sched_task) {
+		ast_sip_sched_task_cancel(aor_options->sched_task);
+		ao2_ref(aor_options->sched_task, -1);
+		aor_options->sched_task = NULL;
+	}
+	AST_VECTOR_RESET(&aor_options->qualify_pending, ao2_cleanup);
+}
+
 /*! \brief Forward declaration of this helpful function */
 static int sip_options_remove_contact(void *obj, void *arg, int flags);
 
@@ -957,6 +1065,9 @@ static void sip_options_aor_dtor(void *obj)
 
 	ast_assert(AST_VECTOR_SIZE(&aor_options->compositors) == 0);
 	AST_VECTOR_FREE(&aor_options->compositors);
+
+	AST_VECTOR_RESET(&aor_options->qualify_pending, ao2_cleanup);
+	AST_VECTOR_FREE(&aor_options->qualify_pending);
 }
 
 /*! \brief Allocator for AOR OPTIONS */
@@ -987,6 +1098,11 @@ static struct sip_options_aor *sip_options_aor_alloc(struct ast_sip_aor *aor)
 		return NULL;
 	}
 
+	if (AST_VECTOR_INIT(&aor_options->qualify_pending, 0)) {
+		ao2_ref(aor_options, -1);
+		return NULL;
+	}
+
 	aor_options->contacts = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_NOLOCK,
 		AO2_CONTAINER_ALLOC_OPT_DUPS_REJECT, CONTACT_BUCKETS, ast_sorcery_object_id_hash,
 		ast_sorcery_object_id_sort, ast_sorcery_object_id_compare);
@@ -1106,6 +1222,16 @@ static int sip_options_determine_initial_qualify_time(int qualify_frequency)
 	return 0 < initial_interval ? initial_interval : 1;
 }
 
+/*! \brief Determine a time for first qualifying an AOR that just got its first contact */
+static int sip_options_determine_first_contact_qualify_time(int qualify_frequency)
+{
+	int delay;
+
+	delay = (int)((qualify_frequency * 1000) * (ast_sip_get_qualify_jitter() / 100.0)
+		* ast_random_double());
+	return 0 < delay ? delay : 1;
+}
+
 /*! \brief Set the contact status for a contact */
 static void sip_options_set_contact_status(struct ast_sip_contact_status *contact_status,
 	enum ast_sip_contact_status_type status)
@@ -1351,11 +1477,7 @@ static void sip_options_apply_aor_configuration(struct sip_options_aor *aor_opti
 	if (aor_options->qualify_frequency != aor->qualify_frequency
 		|| (!aor_options->sched_task && ao2_container_count(aor_options->contacts))
 		|| (aor_options->sched_task && !ao2_container_count(aor_options->contacts))) {
-		if (aor_options->sched_task) {
-			ast_sip_sched_task_cancel(aor_options->sched_task);
-			ao2_ref(aor_options->sched_task, -1);
-			aor_options->sched_task = NULL;
-		}
+		sip_options_aor_cancel_qualify(aor_options);
 
 		/* If there is still a qualify frequency then schedule this */
 		aor_options->qualify_frequency = aor->qualify_frequency;
@@ -1363,7 +1485,7 @@ static void sip_options_apply_aor_configuration(struct sip_options_aor *aor_opti
 			&& ao2_container_count(aor_options->contacts)) {
 			aor_options->sched_task = ast_sip_schedule_task(aor_options->serializer,
 				sip_options_determine_initial_qualify_time(aor_options->qualify_frequency),
-				sip_options_qualify_aor, ast_taskprocessor_name(aor_options->serializer),
+				sip_options_qualify_aor_scheduled, ast_taskprocessor_name(aor_options->serializer),
 				aor_options, AST_SIP_SCHED_TASK_VARIABLE | AST_SIP_SCHED_TASK_DATA_AO2);
 			if (!aor_options->sched_task) {
 				ast_log(LOG_ERROR, "Unable to schedule qualify for contacts of AOR '%s'\n",
@@ -1688,11 +1810,7 @@ static int sip_options_aor_remove_task(void *obj)
 
 	sip_options_notify_endpoint_state_compositors(aor_options, REMOVED);
 
-	if (aor_options->sched_task) {
-		ast_sip_sched_task_cancel(aor_options->sched_task);
-		ao2_ref(aor_options->sched_task, -1);
-		aor_options->sched_task = NULL;
-	}
+	sip_options_aor_cancel_qualify(aor_options);
 
 	return 0;
 }
@@ -2108,15 +2226,15 @@ static int sip_options_contact_add_task(void *obj)
 			 * We immediately schedule the initial qualify so that we get
 			 * reachable/unreachable as soon as possible.  Realistically
 			 * since they pretty much just registered they should be
-			 * reachable.
+			 * reachable.  With qualify_jitter set it is held back by
+			 * up to that share of the frequency instead, so a flood of
+			 * registrations does not turn into a flood of qualifies.
 			 */
-			if (task_data->aor_options->sched_task) {
-				ast_sip_sched_task_cancel(task_data->aor_options->sched_task);
-				ao2_ref(task_data->aor_options->sched_task, -1);
-				task_data->aor_options->sched_task = NULL;
-			}
+			sip_options_aor_cancel_qualify(task_data->aor_options);
 			task_data->aor_options->sched_task = ast_sip_schedule_task(
-				task_data->aor_options->serializer, 1, sip_options_qualify_aor,
+				task_data->aor_options->serializer,
+				sip_options_determine_first_contact_qualify_time(task_data->aor_options->qualify_frequency),
+				sip_options_qualify_aor_scheduled,
 				ast_taskprocessor_name(task_data->aor_options->serializer),
 				task_data->aor_options,
 				AST_SIP_SCHED_TASK_VARIABLE | AST_SIP_SCHED_TASK_DATA_AO2);
@@ -2282,11 +2400,7 @@ static int sip_options_contact_delete_task(void *obj)
 		if (!ao2_container_count(task_data->aor_options->contacts)) {
 			ast_debug(3, "Terminating scheduled callback on AOR '%s' as there are no contacts to qualify\n",
 				task_data->aor_options->name);
-			if (task_data->aor_options->sched_task) {
-				ast_sip_sched_task_cancel(task_data->aor_options->sched_task);
-				ao2_ref(task_data->aor_options->sched_task, -1);
-				task_data->aor_options->sched_task = NULL;
-			}
+			sip_options_aor_cancel_qualify(task_data->aor_options);
 		}
 	} else {
 		task_data->aor_options->available =
@@ -2794,11 +2908,7 @@ static int sip_options_cleanup_aor_task(void *obj)
 	ast_debug(2, "Cleaning up AOR '%s' for shutdown\n", aor_options->name);
 
 	aor_options->qualify_frequency = 0;
-	if (aor_options->sched_task) {
-		ast_sip_sched_task_cancel(aor_options->sched_task);
-		ao2_ref(aor_options->sched_task, -1);
-		aor_options->sched_task = NULL;
-	}
+	sip_options_aor_cancel_qualify(aor_options);
 	AST_VECTOR_RESET(&aor_options->compositors, ao2_cleanup);
 
 	return 0;
@@ -97,6 +97,20 @@ static unsigned int dialog_info_xml_get_version(struct ao2_container *datastores
 	return 0;
 }
 
+/*! \brief Determine if early and in-use ringing is reported to the subscriber */
+static unsigned int dialog_info_early_inuse_ringing(const struct ast_sip_exten_state_data *state_data)
+{
+	struct ast_sip_endpoint *endpoint;
+	unsigned int notify_early_inuse_ringing = 0;
+
+	if (state_data->sub && (endpoint = ast_sip_subscription_get_endpoint(state_data->sub))) {
+		notify_early_inuse_ringing = endpoint->notify_early_inuse_ringing;
+		ao2_ref(endpoint, -1);
+	}
+
+	return notify_early_inuse_ringing;
+}
+
 static int dialog_info_generate_body_content(void *body, void *data)
 {
 	pj_xml_node *dialog_info = body, *dialog, *state;
@@ -106,8 +120,6 @@ static int dialog_info_generate_body_content(void *body, void *data)
 	enum ast_sip_pidf_state local_state;
 	unsigned int version;
 	char version_str[32], sanitized[PJSIP_MAX_URL_SIZE];
-	struct ast_sip_endpoint *endpoint = NULL;
-	unsigned int notify_early_inuse_ringing = 0;
 
 	if (!local || !state_data->datastores) {
 		return -1;
@@ -121,12 +133,8 @@ static int dialog_info_generate_body_content(void *body, void *data)
 	stripped = ast_strip_quoted(local, "<", ">");
 	ast_sip_sanitize_xml(stripped, sanitized, sizeof(sanitized));
 
-	if (state_data->sub && (endpoint = ast_sip_subscription_get_endpoint(state_data->sub))) {
-	    notify_early_inuse_ringing = endpoint->notify_early_inuse_ringing;
-	    ao2_cleanup(endpoint);
-	}
 	ast_sip_presence_exten_state_to_str(state_data->exten_state, &statestring,
-			&pidfstate, &pidfnote, &local_state, notify_early_inuse_ringing);
+			&pidfstate, &pidfnote, &local_state, dialog_info_early_inuse_ringing(state_data));
 
 	ast_sip_presence_xml_create_attr(state_data->pool, dialog_info, "xmlns", "urn:ietf:params:xml:ns:dialog-info");
 
@@ -186,6 +194,92 @@ static void dialog_info_to_string(void *body, struct ast_str **str)
 	ast_str_update(*str);
 }
 
+static int dialog_info_body_cache_key(void *data, struct ast_str **key)
+{
+	struct ast_sip_exten_state_data *state_data = data;
+
+	if (!state_data->datastores) {
+		return -1;
+	}
+
+	/* The version and entity are patched in, the rest only depends on these */
+	ast_str_append(key, 0, "%s:%d:%u", state_data->exten, state_data->exten_state,
+		dialog_info_early_inuse_ringing(state_data));
+
+	return 0;
+}
+
+/*!
+ * \brief Replace the value of every attribute called \a name in a body
+ *
+ * The XML prolog is left alone since it carries a version attribute of its own.
+ */
+static int dialog_info_replace_attr(struct ast_str **str, const char *name, const char *value)
+{
+	char pattern[32];
+	struct ast_str *patched;
+	const char *pos;
+	const char *found;
+	size_t pattern_len;
+
+	pattern_len = snprintf(pattern, sizeof(pattern), " %s=\"", name);
+
+	pos = strstr(ast_str_buffer(*str), "<dialog-info");
+	if (!pos) {
+		return -1;
+	}
+
+	patched = ast_str_create(ast_str_strlen(*str) + strlen(value) + 64);
+	if (!patched) {
+		return -1;
+	}
+	ast_str_set_substr(&patched, 0, ast_str_buffer(*str), pos - ast_str_buffer(*str));
+
+	while ((found = strstr(pos, pattern))) {
+		const char *end = strchr(found + pattern_len, '"');
+
+		if (!end) {
+			ast_free(patched);
+			return -1;
+		}
+		ast_str_append_substr(&patched, 0, pos, found + pattern_len - pos);
+		ast_str_append(&patched, 0, "%s", value);
+		pos = end;
+	}
+	ast_str_append(&patched, 0, "%s", pos);
+
+	ast_str_set(str, 0, "%s", ast_str_buffer(patched));
+	ast_free(patched);
+
+	return 0;
+}
+
+static int dialog_info_patch_body(void *data, struct ast_str **str)
+{
+	struct ast_sip_exten_state_data *state_data = data;
+	char *local = ast_strdupa(state_data->local), *stripped;
+	unsigned int version;
+	char version_str[32], sanitized[PJSIP_MAX_URL_SIZE];
+
+	if (dialog_info_xml_get_version(state_data->datastores, &version)) {
+		ast_log(LOG_WARNING, "dialog-info+xml version could not be retrieved from datastore\n");
+		return -1;
+	}
+
+	stripped = ast_strip_quoted(local, "<", ">");
+	ast_sip_sanitize_xml(stripped, sanitized, sizeof(sanitized));
+	snprintf(version_str, sizeof(version_str), "%u", version);
+
+	/* The entity also appears as the target of a held dialog */
+	if (dialog_info_replace_attr(str, "version", version_str)
+		|| dialog_info_replace_attr(str, "entity", sanitized)
+		|| dialog_info_replace_attr(str, "uri", sanitized)) {
+		return -1;
+	}
+
+	return 0;
+}
+
 static struct ast_sip_pubsub_body_generator dialog_info_body_generator = {
 	.type = "application",
 	.subtype = "dialog-info+xml",
@@ -194,6 +288,8 @@ static struct ast_sip_pubsub_body_generator dialog_info_body_generator = {
 	.generate_body_content = dialog_info_generate_body_content,
 	.to_string = dialog_info_to_string,
 	/* No need for a destroy_body callback since we use a pool */
+	.body_cache_key = dialog_info_body_cache_key,
+	.patch_body = dialog_info_patch_body,
 };
 
 static int load_module(void)
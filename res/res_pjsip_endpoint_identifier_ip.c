@@ -247,25 +247,301 @@ static int ip_identify_match_check(void *obj, void *arg, int flags)
 	}
 }
 
-static struct ast_sip_endpoint *common_identify(ao2_callback_fn *identify_match_cb, void *arg)
+/*! \brief A node of the binary trie indexing identify match networks by prefix */
+struct identify_index_node {
+	/*! \brief Children for the next address bit being 0 or 1 */
+	struct identify_index_node *child[2];
+	/*! \brief Identify objects with a match network of exactly this prefix */
+	AST_VECTOR(, struct ip_identify_match *) identifies;
+};
+
+/*! \brief Index over every identify object, rebuilt after any of them change */
+struct identify_index {
+	/*! \brief Trie of IPv4 match networks */
+	struct identify_index_node *ipv4;
+	/*! \brief Trie of IPv6 match networks */
+	struct identify_index_node *ipv6;
+	/*! \brief Identify objects that match on a header */
+	AST_VECTOR(, struct ip_identify_match *) headers;
+};
+
+/*! \brief The current index, built on first use after it was invalidated */
+static AO2_GLOBAL_OBJ_STATIC(current_index);
+
+/*! \brief Serializes building and invalidating the current index */
+AST_MUTEX_DEFINE_STATIC(index_lock);
+
+/*! \brief Non-zero if identify objects only change through sorcery, so the index can be used */
+static int index_usable;
+
+static void identify_index_node_free(struct identify_index_node *node)
 {
-	RAII_VAR(struct ao2_container *, candidates, NULL, ao2_cleanup);
-	struct ip_identify_match *match;
-	struct ast_sip_endpoint *endpoint;
+	if (!node) {
+		return;
+	}
 
-	/* If no possibilities exist return early to save some time */
-	candidates = ast_sorcery_retrieve_by_fields(ast_sip_get_sorcery(), "identify",
+	identify_index_node_free(node->child[0]);
+	identify_index_node_free(node->child[1]);
+	AST_VECTOR_CALLBACK_VOID(&node->identifies, ao2_cleanup);
+	AST_VECTOR_FREE(&node->identifies);
+	ast_free(node);
+}
+
+static void identify_index_destroy(void *obj)
+{
+	struct identify_index *index = obj;
+
+	identify_index_node_free(index->ipv4);
+	identify_index_node_free(index->ipv6);
+	AST_VECTOR_CALLBACK_VOID(&index->headers, ao2_cleanup);
+	AST_VECTOR_FREE(&index->headers);
+}
+
+/*!
+ * \internal
+ * \brief Copy the raw bytes of an address
+ *
+ * \return The number of bits in the address, or 0 if it is neither IPv4 nor IPv6
+ */
+static int identify_index_address(const struct ast_sockaddr *addr, unsigned char bytes[16])
+{
+	if (ast_sockaddr_is_ipv4(addr)) {
+		uint32_t ipv4 = htonl(ast_sockaddr_ipv4(addr));
+
+		memcpy(bytes, &ipv4, sizeof(ipv4));
+		return 32;
+	} else if (ast_sockaddr_is_ipv6(addr)) {
+		memcpy(bytes, &((const struct sockaddr_in6 *) &addr->ss)->sin6_addr, 16);
+		return 128;
+	}
+
+	return 0;
+}
+
+#define ADDRESS_BIT(bytes, bit) (((bytes)[(bit) / 8] >> (7 - (bit) % 8)) & 1)
+
+/*! \brief Add the network of a match rule to the index */
+static int identify_index_add(struct identify_index *index, const struct ast_ha *ha,
+	struct ip_identify_match *identify)
+{
+	unsigned char addr[16];
+	unsigned char netmask[16];
+	struct identify_index_node **node;
+	int bits;
+	int prefix;
+	int bit;
+
+	bits = identify_index_address(&ha->addr, addr);
+	if (!bits || identify_index_address(&ha->netmask, netmask) != bits) {
+		return 0;
+	}
+
+	/*
+	 * Only the leading ones of the netmask place the network in the trie.
+	 * The rules of every candidate are applied in full during a lookup, so
+	 * the odd non-contiguous netmask still matches correctly.
+	 */
+	for (prefix = 0; prefix < bits && ADDRESS_BIT(netmask, prefix); ++prefix) {
+	}
+
+	node = bits == 32 ? &index->ipv4 : &index->ipv6;
+	for (bit = 0; ; ++bit) {
+		if (!*node && !(*node = ast_calloc(1, sizeof(**node)))) {
+			return -1;
+		}
+		if (bit == prefix) {
+			break;
+		}
+		node = &(*node)->child[ADDRESS_BIT(addr, bit)];
+	}
+
+	if (AST_VECTOR_APPEND(&(*node)->identifies, identify)) {
+		return -1;
+	}
+	ao2_ref(identify, +1);
+
+	return 0;
+}
+
+/*! \brief Build an index of all current identify objects */
+static struct identify_index *identify_index_build(void)
+{
+	struct ao2_container *identifies;
+	struct identify_index *index;
+	struct ip_identify_match *identify;
+	struct ao2_iterator iter;
+	int res = 0;
+
+	identifies = ast_sorcery_retrieve_by_fields(ast_sip_get_sorcery(), "identify",
 		AST_RETRIEVE_FLAG_MULTIPLE | AST_RETRIEVE_FLAG_ALL, NULL);
-	if (!candidates || !ao2_container_count(candidates)) {
-		ast_debug(3, "No identify sections to match against\n");
+	if (!identifies) {
 		return NULL;
 	}
 
-	match = ao2_callback(candidates, 0, identify_match_cb, arg);
-	if (!match) {
+	index = ao2_alloc_options(sizeof(*index), identify_index_destroy, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!index) {
+		ao2_ref(identifies, -1);
+		return NULL;
+	}
+
+	iter = ao2_iterator_init(identifies, 0);
+	for (; !res && (identify = ao2_iterator_next(&iter)); ao2_ref(identify, -1)) {
+		struct ast_ha *ha;
+
+		if (!ast_strlen_zero(identify->match_header)) {
+			if (AST_VECTOR_APPEND(&index->headers, identify)) {
+				res = -1;
+				continue;
+			}
+			ao2_ref(identify, +1);
+		}
+
+		/* Negated rules only ever carve exceptions out of the others */
+		for (ha = identify->matches; !res && ha; ha = ha->next) {
+			if (ha->sense == AST_SENSE_DENY) {
+				res = identify_index_add(index, ha, identify);
+			}
+		}
+	}
+	ao2_iterator_destroy(&iter);
+	ast_debug(1, "Indexed %d identify objects\n", ao2_container_count(identifies));
+	ao2_ref(identifies, -1);
+
+	if (res) {
+		ao2_ref(index, -1);
+		return NULL;
+	}
+
+	return index;
+}
+
+/*! \brief Get the current index, building it if needed */
+static struct identify_index *identify_index_get(void)
+{
+	struct identify_index *index;
+
+	index = ao2_global_obj_ref(current_index);
+	if (index) {
+		return index;
+	}
+
+	ast_mutex_lock(&index_lock);
+	index = ao2_global_obj_ref(current_index);
+	if (!index && (index = identify_index_build())) {
+		ao2_global_obj_replace_unref(current_index, index);
+	}
+	ast_mutex_unlock(&index_lock);
+
+	return index;
+}
+
+/*! \brief Drop the current index so the next lookup rebuilds it */
+static void identify_index_invalidate(void)
+{
+	ast_mutex_lock(&index_lock);
+	ao2_global_obj_release(current_index);
+	ast_mutex_unlock(&index_lock);
+}
+
+static void identify_observer_changed(const void *object)
+{
+	identify_index_invalidate();
+}
+
+static void identify_observer_loaded(const char *object_type)
+{
+	identify_index_invalidate();
+}
+
+/*! \brief Observer which drops the index whenever an identify object changes */
+static const struct ast_sorcery_observer identify_observer = {
+	.created = identify_observer_changed,
+	.updated = identify_observer_changed,
+	.deleted = identify_observer_changed,
+	.loaded = identify_observer_loaded,
+};
+
+/*!
+ * \internal
+ * \brief Find the identify object matching an address using the index
+ *
+ * \details
+ * Every identify object with a network on the path to the address is
+ * checked against all of its rules.  When several match, the one with
+ * the longest matching network wins.
+ *
+ * \return The matching identify object with a reference, or NULL
+ */
+static struct ip_identify_match *identify_index_find(struct identify_index *index,
+	struct ast_sockaddr *addr)
+{
+	struct ip_identify_match *match = NULL;
+	struct identify_index_node *node;
+	struct ast_sockaddr mapped;
+	unsigned char bytes[16];
+	int bits;
+	int bit;
+
+	/* IPv4 rules apply to IPv4 mapped addresses, as in ast_apply_ha() */
+	bits = identify_index_address(ast_sockaddr_is_ipv4_mapped(addr)
+		&& ast_sockaddr_ipv4_mapped(addr, &mapped) ? &mapped : addr, bytes);
+	if (!bits) {
 		return NULL;
 	}
 
+	node = bits == 32 ? index->ipv4 : index->ipv6;
+	for (bit = 0; node; ++bit) {
+		int idx;
+
+		for (idx = 0; idx < AST_VECTOR_SIZE(&node->identifies); ++idx) {
+			struct ip_identify_match *identify = AST_VECTOR_GET(&node->identifies, idx);
+
+			if (ip_identify_match_check(identify, addr, 0)) {
+				match = identify;
+				break;
+			}
+		}
+
+		node = bit < bits ? node->child[ADDRESS_BIT(bytes, bit)] : NULL;
+	}
+
+	return ao2_bump(match);
+}
+
+/*! \brief Determine whether all sorcery wizards for identify keep objects in memory */
+static int identify_index_check_usable(void)
+{
+	struct ast_sorcery_wizard *wizard;
+	int count;
+	int idx;
+
+	count = ast_sorcery_get_wizard_mapping_count(ast_sip_get_sorcery(), "identify");
+	if (count <= 0) {
+		return 0;
+	}
+
+	for (idx = 0; idx < count; ++idx) {
+		int in_memory;
+
+		if (ast_sorcery_get_wizard_mapping(ast_sip_get_sorcery(), "identify", idx, &wizard, NULL)) {
+			return 0;
+		}
+		/* Other wizards may change their objects behind sorcery's back */
+		in_memory = !strcmp(wizard->name, "config") || !strcmp(wizard->name, "memory");
+		ao2_ref(wizard, -1);
+		if (!in_memory) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/*! \brief Look up the endpoint an identify object points to */
+static struct ast_sip_endpoint *identify_get_endpoint(struct ip_identify_match *match)
+{
+	struct ast_sip_endpoint *endpoint;
+
 	endpoint = ast_sorcery_retrieve_by_id(ast_sip_get_sorcery(), "endpoint",
 		match->endpoint_name);
 	if (endpoint) {
@@ -276,6 +552,29 @@ static struct ast_sip_endpoint *common_identify(ao2_callback_fn *identify_match_
 			ast_sorcery_object_get_id(match), match->endpoint_name);
 	}
 
+	return endpoint;
+}
+
+static struct ast_sip_endpoint *common_identify(ao2_callback_fn *identify_match_cb, void *arg)
+{
+	RAII_VAR(struct ao2_container *, candidates, NULL, ao2_cleanup);
+	struct ip_identify_match *match;
+	struct ast_sip_endpoint *endpoint;
+
+	/* If no possibilities exist return early to save some time */
+	candidates = ast_sorcery_retrieve_by_fields(ast_sip_get_sorcery(), "identify",
+		AST_RETRIEVE_FLAG_MULTIPLE | AST_RETRIEVE_FLAG_ALL, NULL);
+	if (!candidates || !ao2_container_count(candidates)) {
+		ast_debug(3, "No identify sections to match against\n");
+		return NULL;
+	}
+
+	match = ao2_callback(candidates, 0, identify_match_cb, arg);
+	if (!match) {
+		return NULL;
+	}
+
+	endpoint = identify_get_endpoint(match);
 	ao2_ref(match, -1);
 	return endpoint;
 }
@@ -283,11 +582,25 @@ static struct ast_sip_endpoint *common_identify(ao2_callback_fn *identify_match_
 static struct ast_sip_endpoint *ip_identify(pjsip_rx_data *rdata)
 {
 	struct ast_sockaddr addr = { { 0, } };
+	struct identify_index *index;
+	struct ip_identify_match *match;
+	struct ast_sip_endpoint *endpoint = NULL;
 
 	ast_sockaddr_parse(&addr, rdata->pkt_info.src_name, PARSE_PORT_FORBID);
 	ast_sockaddr_set_port(&addr, rdata->pkt_info.src_port);
 
-	return common_identify(ip_identify_match_check, &addr);
+	if (!index_usable || !(index = identify_index_get())) {
+		return common_identify(ip_identify_match_check, &addr);
+	}
+
+	match = identify_index_find(index, &addr);
+	ao2_ref(index, -1);
+	if (match) {
+		endpoint = identify_get_endpoint(match);
+		ao2_ref(match, -1);
+	}
+
+	return endpoint;
 }
 
 static struct ast_sip_endpoint_identifier ip_identifier = {
@@ -296,7 +609,25 @@ static struct ast_sip_endpoint_identifier ip_identifier = {
 
 static struct ast_sip_endpoint *header_identify(pjsip_rx_data *rdata)
 {
-	return common_identify(header_identify_match_check, rdata);
+	struct identify_index *index;
+	struct ast_sip_endpoint *endpoint = NULL;
+	int idx;
+
+	if (!index_usable || !(index = identify_index_get())) {
+		return common_identify(header_identify_match_check, rdata);
+	}
+
+	for (idx = 0; idx < AST_VECTOR_SIZE(&index->headers); ++idx) {
+		struct ip_identify_match *identify = AST_VECTOR_GET(&index->headers, idx);
+
+		if (header_identify_match_check(identify, rdata, 0)) {
+			endpoint = identify_get_endpoint(identify);
+			break;
+		}
+	}
+	ao2_ref(index, -1);
+
+	return endpoint;
 }
 
 static struct ast_sip_endpoint_identifier header_identifier = {
@@ -811,6 +1142,9 @@ static int load_module(void)
 	ast_sorcery_object_field_register(ast_sip_get_sorcery(), "identify", "srv_lookups", "yes", OPT_BOOL_T, 1, FLDSET(struct ip_identify_match, srv_lookups));
 	ast_sorcery_load_object(ast_sip_get_sorcery(), "identify");
 
+	index_usable = identify_index_check_usable();
+	ast_sorcery_observer_add(ast_sip_get_sorcery(), "identify", &identify_observer);
+
 	ast_sip_register_endpoint_identifier_with_name(&ip_identifier, "ip");
 	ast_sip_register_endpoint_identifier_with_name(&header_identifier, "header");
 	ast_sip_register_endpoint_formatter(&endpoint_identify_formatter);
@@ -848,6 +1182,8 @@ static int unload_module(void)
 	ast_sip_unregister_endpoint_formatter(&endpoint_identify_formatter);
 	ast_sip_unregister_endpoint_identifier(&header_identifier);
 	ast_sip_unregister_endpoint_identifier(&ip_identifier);
+	ast_sorcery_observer_remove(ast_sip_get_sorcery(), "identify", &identify_observer);
+	ao2_global_obj_release(current_index);
 
 	return 0;
 }
@@ -83,6 +83,8 @@ struct exten_state_subscription {
 	enum ast_extension_states last_exten_state;
 	/*! The last known presence state */
 	enum ast_presence_state last_presence_state;
+	/*! Notification queued on the serializer but not yet sent */
+	struct notify_task_data *pending_notify;
 };
 
 /*!
@@ -172,6 +174,7 @@ static void exten_state_subscription_destructor(void *obj)
 	struct exten_state_subscription *sub = obj;
 
 	ast_free(sub->user_agent);
+	ao2_cleanup(sub->pending_notify);
 	ast_sip_subscription_destroy(sub->sip_sub);
 	ast_taskprocessor_unreference(sub->serializer);
 }
@@ -324,11 +327,37 @@ static int notify_task(void *obj)
 	return 0;
 }
 
+/*!
+ * \internal
+ * \brief Send the most recent pending notification for a subscription.
+ */
+static int notify_pending_task(void *obj)
+{
+	struct exten_state_subscription *exten_state_sub = obj;
+	struct notify_task_data *task_data;
+
+	ao2_lock(exten_state_sub);
+	task_data = exten_state_sub->pending_notify;
+	exten_state_sub->pending_notify = NULL;
+	ao2_unlock(exten_state_sub);
+	ao2_ref(exten_state_sub, -1);
+
+	if (!task_data) {
+		return 0;
+	}
+
+	return notify_task(task_data);
+}
+
 /*!
  * \internal
  * \brief Callback for exten/device state changes.
  *
  * Upon state change, send the appropriate notification to the subscriber.
+ *
+ * If a notification is still waiting on the serializer it is replaced with
+ * this newer state, so rapid transitions such as RINGING to INUSE result in
+ * a single NOTIFY carrying the latest state.
  */
 static int state_changed(const char *context, const char *exten,
 	struct ast_state_cb_info *info, void *data)
@@ -340,11 +369,29 @@ static int state_changed(const char *context, const char *exten,
 		return -1;
 	}
 
+	ao2_lock(exten_state_sub);
+	if (exten_state_sub->pending_notify) {
+		/* A pending termination must still be sent, so never replace it */
+		if (!exten_state_sub->pending_notify->terminate) {
+			SWAP(exten_state_sub->pending_notify, task_data);
+		}
+		ao2_unlock(exten_state_sub);
+		ao2_ref(task_data, -1);
+		return 0;
+	}
+	exten_state_sub->pending_notify = task_data;
+	ao2_unlock(exten_state_sub);
+
 	/* safe to push this async since we copy the data from info and
 	   add a ref for the device state info */
-	if (ast_sip_push_task(task_data->exten_state_sub->serializer, notify_task,
-		task_data)) {
+	if (ast_sip_push_task(exten_state_sub->serializer, notify_pending_task,
+		ao2_bump(exten_state_sub))) {
+		ao2_lock(exten_state_sub);
+		task_data = exten_state_sub->pending_notify;
+		exten_state_sub->pending_notify = NULL;
+		ao2_unlock(exten_state_sub);
 		ao2_cleanup(task_data);
+		ao2_ref(exten_state_sub, -1);
 		return -1;
 	}
 	return 0;
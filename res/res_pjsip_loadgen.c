@@ -0,0 +1,482 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2019, Sangoma Technologies Corporation
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*!
+ * \file
+ * \brief PJSIP synthetic call generator
+ *
+ * Originates calls over PJSIP at a fixed rate, plays a sound file on each
+ * answered call and records how long each call took to be answered along
+ * with the RTCP quality of its audio stream. The calls go through the normal
+ * chan_pjsip, session supplement and RTP code so capacity can be measured
+ * without an external load generator. Pointing the calls at an endpoint
+ * that routes back to this system exercises both sides of the call.
+ *
+ * \since 17.0.0
+ */
+
+/*** MODULEINFO
+	<depend>pjproject</depend>
+	<depend>res_pjsip</depend>
+	<support_level>extended</support_level>
+ ***/
+
+#include "asterisk.h"
+
+#include "asterisk/astobj2.h"
+#include "asterisk/channel.h"
+#include "asterisk/cli.h"
+#include "asterisk/dial.h"
+#include "asterisk/file.h"
+#include "asterisk/lock.h"
+#include "asterisk/module.h"
+#include "asterisk/pbx.h"
+#include "asterisk/time.h"
+#include "asterisk/utils.h"
+#include "asterisk/vector.h"
+
+/*! Highest calls per second a run can be started with */
+#define LOADGEN_MAX_CPS 1000
+
+/*! Calls allowed up at once, calls due above this are throttled */
+#define LOADGEN_MAX_ACTIVE 2000
+
+/*! Most calls a single run can place */
+#define LOADGEN_MAX_CALLS 1000000
+
+/*! Seconds an outgoing call may ring before it counts as failed */
+#define LOADGEN_DIAL_TIMEOUT 30
+
+/*! \brief A load generation run and its results */
+struct loadgen_run {
+	/*! Calls per second */
+	int cps;
+	/*! Calls to place */
+	int calls;
+	/*! Calls placed so far */
+	int started;
+	/*! Calls that were answered */
+	int answered;
+	/*! Calls that failed to be answered */
+	int failed;
+	/*! Calls skipped because too many were up */
+	int throttled;
+	/*! Calls currently up or dialing */
+	int active;
+	/*! Set to stop placing calls */
+	int stop;
+	/*! Calls that returned RTCP quality */
+	int quality_samples;
+	/*! Sum of received jitter */
+	double rxjitter;
+	/*! Sum of received packets lost */
+	double rxploss;
+	/*! Sum of round trip times */
+	double rtt;
+	/*! When the run started */
+	struct timeval begun;
+	/*! Milliseconds each answered call took to be answered */
+	AST_VECTOR(, int) setup_ms;
+	/*! Generator thread */
+	pthread_t thread;
+	/*! Signalled when the run is stopped */
+	ast_cond_t cond;
+	/*! Sound file played on each call */
+	char *file;
+	/*! PJSIP dial string */
+	char dest[0];
+};
+
+/*! The current or last run, protected by its own lock */
+static struct loadgen_run *current_run;
+
+/*! Protects current_run */
+AST_MUTEX_DEFINE_STATIC(run_lock);
+
+static void loadgen_run_destroy(void *obj)
+{
+	struct loadgen_run *run = obj;
+
+	AST_VECTOR_FREE(&run->setup_ms);
+	ast_cond_destroy(&run->cond);
+}
+
+static struct loadgen_run *loadgen_run_alloc(const char *dest, int cps, int calls,
+	const char *file)
+{
+	size_t dest_len = strlen(dest) + 1;
+	struct loadgen_run *run;
+
+	run = ao2_alloc(sizeof(*run) + dest_len + strlen(file) + 1, loadgen_run_destroy);
+	if (!run) {
+		return NULL;
+	}
+
+	if (AST_VECTOR_INIT(&run->setup_ms, MIN(calls, 1024))) {
+		ao2_ref(run, -1);
+		return NULL;
+	}
+	ast_cond_init(&run->cond, NULL);
+	run->thread = AST_PTHREADT_NULL;
+	run->cps = cps;
+	run->calls = calls;
+	strcpy(run->dest, dest); /* Safe */
+	run->file = run->dest + dest_len;
+	strcpy(run->file, file); /* Safe */
+
+	return run;
+}
+
+/*!
+ * \internal
+ * \brief Read a numeric RTCP statistic from a PJSIP channel
+ */
+static int loadgen_read_rtcp(struct ast_channel *chan, const char *field, double *value)
+{
+	char function[64];
+	char buf[32];
+
+	snprintf(function, sizeof(function), "CHANNEL(rtcp,%s,audio)", field);
+	if (ast_func_read(chan, function, buf, sizeof(buf)) || sscanf(buf, "%30lf", value) != 1) {
+		return -1;
+	}
+	return 0;
+}
+
+/*! \brief Place one call, play the file on it and record the results */
+static void *loadgen_call(void *data)
+{
+	struct loadgen_run *run = data;
+	struct ast_dial *dial;
+	struct ast_channel *chan = NULL;
+	struct timeval start;
+	double rxjitter;
+	double rxploss;
+	double rtt;
+	int setup_ms = 0;
+	int have_quality = 0;
+
+	dial = ast_dial_create();
+	if (dial && !ast_dial_append(dial, "PJSIP", run->dest, NULL)) {
+		ast_dial_set_global_timeout(dial, LOADGEN_DIAL_TIMEOUT * 1000);
+
+		start = ast_tvnow();
+		if (ast_dial_run(dial, NULL, 0) == AST_DIAL_RESULT_ANSWERED) {
+			chan = ast_dial_answered_steal(dial);
+		}
+		setup_ms = ast_tvdiff_ms(ast_tvnow(), start);
+	}
+	if (dial) {
+		ast_dial_destroy(dial);
+	}
+
+	if (chan) {
+		ast_stream_and_wait(chan, run->file, "");
+
+		have_quality = !loadgen_read_rtcp(chan, "rxjitter", &rxjitter)
+			&& !loadgen_read_rtcp(chan, "rxploss", &rxploss)
+			&& !loadgen_read_rtcp(chan, "rtt", &rtt);
+
+		ast_hangup(chan);
+	}
+
+	ao2_lock(run);
+	if (chan) {
+		++run->answered;
+		AST_VECTOR_APPEND(&run->setup_ms, setup_ms);
+		if (have_quality) {
+			++run->quality_samples;
+			run->rxjitter += rxjitter;
+			run->rxploss += rxploss;
+			run->rtt += rtt;
+		}
+	} else {
+		++run->failed;
+	}
+	--run->active;
+	ao2_unlock(run);
+
+	ao2_ref(run, -1);
+	ast_module_unref(AST_MODULE_SELF);
+
+	return NULL;
+}
+
+/*! \brief Start calls at the run's rate until all are placed or the run is stopped */
+static void *loadgen_generate(void *data)
+{
+	struct loadgen_run *run = data;
+	struct timeval next = ast_tvnow();
+	struct timeval interval = ast_samp2tv(1, run->cps);
+	struct timespec ts;
+	pthread_t thread;
+
+	ao2_lock(run);
+	while (!run->stop && run->started + run->throttled < run->calls) {
+		if (run->active >= LOADGEN_MAX_ACTIVE) {
+			++run->throttled;
+		} else {
+			ast_module_ref(AST_MODULE_SELF);
+			ao2_ref(run, +1);
+			++run->active;
+			++run->started;
+			if (ast_pthread_create_detached_background(&thread, NULL, loadgen_call, run)) {
+				--run->active;
+				--run->started;
+				++run->failed;
+				ao2_ref(run, -1);
+				ast_module_unref(AST_MODULE_SELF);
+			}
+		}
+
+		next = ast_tvadd(next, interval);
+		ts.tv_sec = next.tv_sec;
+		ts.tv_nsec = next.tv_usec * 1000;
+		while (!run->stop && ast_tvcmp(ast_tvnow(), next) < 0) {
+			ast_cond_timedwait(&run->cond, ao2_object_get_lockaddr(run), &ts);
+		}
+	}
+	ao2_unlock(run);
+
+	return NULL;
+}
+
+/*!
+ * \internal
+ * \brief Stop placing calls for a run and wait for its generator to exit
+ *
+ * \note Calls already placed finish on their own.
+ */
+static void loadgen_run_stop(struct loadgen_run *run)
+{
+	pthread_t thread;
+
+	ao2_lock(run);
+	run->stop = 1;
+	ast_cond_signal(&run->cond);
+	thread = run->thread;
+	run->thread = AST_PTHREADT_NULL;
+	ao2_unlock(run);
+
+	if (thread != AST_PTHREADT_NULL) {
+		pthread_join(thread, NULL);
+	}
+}
+
+static int loadgen_setup_cmp(const void *left, const void *right)
+{
+	return *(const int *) left - *(const int *) right;
+}
+
+static char *cli_loadgen_start(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct loadgen_run *run;
+	struct loadgen_run *previous;
+	int cps;
+	int calls;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "pjsip loadgen start";
+		e->usage =
+			"Usage: pjsip loadgen start <dest> <cps> <calls> <file>\n"
+			"       Place <calls> calls to the PJSIP dial string <dest> at\n"
+			"       <cps> calls per second, playing <file> on each answered\n"
+			"       call before hanging it up. Any run in progress is stopped.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 7) {
+		return CLI_SHOWUSAGE;
+	}
+
+	if (sscanf(a->argv[4], "%30d", &cps) != 1 || cps < 1 || cps > LOADGEN_MAX_CPS) {
+		ast_cli(a->fd, "Calls per second must be between 1 and %d\n", LOADGEN_MAX_CPS);
+		return CLI_FAILURE;
+	}
+
+	if (sscanf(a->argv[5], "%30d", &calls) != 1 || calls < 1 || calls > LOADGEN_MAX_CALLS) {
+		ast_cli(a->fd, "Calls must be between 1 and %d\n", LOADGEN_MAX_CALLS);
+		return CLI_FAILURE;
+	}
+
+	run = loadgen_run_alloc(a->argv[3], cps, calls, a->argv[6]);
+	if (!run) {
+		return CLI_FAILURE;
+	}
+
+	ast_mutex_lock(&run_lock);
+	previous = current_run;
+	if (previous) {
+		loadgen_run_stop(previous);
+		ao2_ref(previous, -1);
+	}
+
+	run->begun = ast_tvnow();
+	ao2_lock(run);
+	if (ast_pthread_create(&run->thread, NULL, loadgen_generate, run)) {
+		run->thread = AST_PTHREADT_NULL;
+		ao2_unlock(run);
+		current_run = NULL;
+		ast_mutex_unlock(&run_lock);
+		ao2_ref(run, -1);
+		ast_cli(a->fd, "Unable to start the call generator\n");
+		return CLI_FAILURE;
+	}
+	ao2_unlock(run);
+	current_run = run;
+	ast_mutex_unlock(&run_lock);
+
+	ast_cli(a->fd, "Placing %d calls to PJSIP/%s at %d calls per second\n",
+		calls, a->argv[3], cps);
+
+	return CLI_SUCCESS;
+}
+
+static char *cli_loadgen_stop(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "pjsip loadgen stop";
+		e->usage =
+			"Usage: pjsip loadgen stop\n"
+			"       Stop placing calls. Calls already up finish normally.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	ast_mutex_lock(&run_lock);
+	if (current_run) {
+		loadgen_run_stop(current_run);
+	}
+	ast_mutex_unlock(&run_lock);
+
+	return CLI_SUCCESS;
+}
+
+static char *cli_loadgen_show(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct loadgen_run *run;
+	int *setup = NULL;
+	size_t count;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "pjsip loadgen show";
+		e->usage =
+			"Usage: pjsip loadgen show\n"
+			"       Show the progress and results of the current or last run.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	ast_mutex_lock(&run_lock);
+	run = ao2_bump(current_run);
+	ast_mutex_unlock(&run_lock);
+
+	if (!run) {
+		ast_cli(a->fd, "No load generation run has been started\n");
+		return CLI_SUCCESS;
+	}
+
+	ao2_lock(run);
+	count = AST_VECTOR_SIZE(&run->setup_ms);
+	if (count) {
+		setup = ast_malloc(count * sizeof(*setup));
+		if (setup) {
+			memcpy(setup, AST_VECTOR_GET_ADDR(&run->setup_ms, 0), count * sizeof(*setup));
+		} else {
+			count = 0;
+		}
+	}
+
+	ast_cli(a->fd, "Destination:   PJSIP/%s\n", run->dest);
+	ast_cli(a->fd, "State:         %s\n",
+		!run->stop && run->started + run->throttled < run->calls ? "running" : "stopped");
+	ast_cli(a->fd, "Elapsed:       %" PRId64 " s\n", ast_tvdiff_sec(ast_tvnow(), run->begun));
+	ast_cli(a->fd, "Rate:          %d calls/s\n", run->cps);
+	ast_cli(a->fd, "Placed:        %d of %d\n", run->started, run->calls);
+	ast_cli(a->fd, "Active:        %d\n", run->active);
+	ast_cli(a->fd, "Answered:      %d\n", run->answered);
+	ast_cli(a->fd, "Failed:        %d\n", run->failed);
+	ast_cli(a->fd, "Throttled:     %d\n", run->throttled);
+	if (run->quality_samples) {
+		ast_cli(a->fd, "Avg rxjitter:  %f\n", run->rxjitter / run->quality_samples);
+		ast_cli(a->fd, "Avg rxploss:   %f\n", run->rxploss / run->quality_samples);
+		ast_cli(a->fd, "Avg rtt:       %f\n", run->rtt / run->quality_samples);
+	}
+	ao2_unlock(run);
+
+	if (count) {
+		qsort(setup, count, sizeof(*setup), loadgen_setup_cmp);
+		ast_cli(a->fd, "Setup (ms):    p50 %d, p90 %d, p99 %d, max %d\n",
+			setup[count / 2], setup[count * 90 / 100], setup[count * 99 / 100],
+			setup[count - 1]);
+	}
+
+	ao2_ref(run, -1);
+	ast_free(setup);
+
+	return CLI_SUCCESS;
+}
+
+static struct ast_cli_entry cli_loadgen[] = {
+	AST_CLI_DEFINE(cli_loadgen_start, "Start placing synthetic PJSIP calls"),
+	AST_CLI_DEFINE(cli_loadgen_stop, "Stop placing synthetic PJSIP calls"),
+	AST_CLI_DEFINE(cli_loadgen_show, "Show synthetic PJSIP call results"),
+};
+
+static int unload_module(void)
+{
+	ast_cli_unregister_multiple(cli_loadgen, ARRAY_LEN(cli_loadgen));
+
+	ast_mutex_lock(&run_lock);
+	if (current_run) {
+		loadgen_run_stop(current_run);
+		ao2_ref(current_run, -1);
+		current_run = NULL;
+	}
+	ast_mutex_unlock(&run_lock);
+
+	return 0;
+}
+
+static int load_module(void)
+{
+	ast_cli_register_multiple(cli_loadgen, ARRAY_LEN(cli_loadgen));
+
+	return AST_MODULE_LOAD_SUCCESS;
+}
+
+AST_MODULE_INFO(ASTERISK_GPL_KEY, AST_MODFLAG_LOAD_ORDER, "PJSIP Synthetic Call Generator",
+	.support_level = AST_MODULE_SUPPORT_EXTENDED,
+	.load = load_module,
+	.unload = unload_module,
+	.load_pri = AST_MODPRI_APP_DEPEND,
+	.requires = "res_pjsip,chan_pjsip",
+);
@@ -247,6 +247,18 @@ static struct ast_sched_context *sched;
 /*! \brief Default expiration for subscriptions */
 #define DEFAULT_EXPIRES 3600
 
+/*! \brief Maximum number of tasks recreating persisted subscriptions at once */
+#define PERSISTENCE_RECREATE_MAX_TASKS 8
+
+/*! \brief Persisted subscriptions worth giving a recreation task of its own */
+#define PERSISTENCE_RECREATE_MIN_PER_TASK 100
+
+/*! \brief Number of buckets for shared generated bodies */
+#define BODY_CACHE_BUCKETS 257
+
+/*! \brief Maximum number of shared generated bodies kept before the cache is emptied */
+#define BODY_CACHE_MAX_ENTRIES 4096
+
 /*! \brief Defined method for PUBLISH */
 const pjsip_method pjsip_publish_method =
 {
@@ -527,6 +539,22 @@ AST_RWLIST_HEAD_STATIC(subscriptions, sip_subscription_tree);
 AST_RWLIST_HEAD_STATIC(body_generators, ast_sip_pubsub_body_generator);
 AST_RWLIST_HEAD_STATIC(body_supplements, ast_sip_pubsub_body_supplement);
 
+/*!
+ * \brief A generated body shared between subscriptions
+ */
+struct body_cache_entry {
+	/*! The generated body, stored after the key */
+	char *text;
+	/*! Content type, subtype and the generator's key */
+	char key[0];
+};
+
+AO2_STRING_FIELD_HASH_FN(body_cache_entry, key)
+AO2_STRING_FIELD_CMP_FN(body_cache_entry, key)
+
+/*! \brief Generated bodies shared between subscriptions, keyed by body_cache_key */
+static struct ao2_container *body_cache;
+
 static pjsip_media_type rlmi_media_type;
 
 static void pubsub_on_evsub_state(pjsip_evsub *sub, pjsip_event *event);
@@ -1714,28 +1742,96 @@ static int subscription_persistence_recreate(void *obj, void *arg, int flags)
 	return 0;
 }
 
-/*! \brief Function which loads and recreates persisted subscriptions upon startup when the system is fully booted */
-static int subscription_persistence_load(void *data)
+/*! \brief Persisted subscriptions shared out between the tasks recreating them */
+struct persistence_recreate_state {
+	/*! The persisted subscriptions */
+	struct ao2_container *persisted_subscriptions;
+	/*! Next persisted subscription to recreate, protected by the object lock */
+	struct ao2_iterator iter;
+};
+
+static void persistence_recreate_state_destroy(void *obj)
 {
-	struct ao2_container *persisted_subscriptions = ast_sorcery_retrieve_by_fields(ast_sip_get_sorcery(),
-		"subscription_persistence", AST_RETRIEVE_FLAG_MULTIPLE | AST_RETRIEVE_FLAG_ALL, NULL);
+	struct persistence_recreate_state *state = obj;
+
+	ao2_iterator_destroy(&state->iter);
+	ao2_cleanup(state->persisted_subscriptions);
+}
+
+/*!
+ * \brief Task which recreates persisted subscriptions until none are left
+ *
+ * Several of these run at once, each parsing with a pool of its own, so
+ * startup is not bound to parsing the stored packets one after another.
+ */
+static int subscription_persistence_recreate_task(void *data)
+{
+	struct persistence_recreate_state *state = data;
+	struct subscription_persistence *persistence;
 	pj_pool_t *pool;
 
 	pool = pjsip_endpt_create_pool(ast_sip_get_pjsip_endpoint(), "rtd%p", PJSIP_POOL_RDATA_LEN,
 		PJSIP_POOL_RDATA_INC);
 	if (!pool) {
 		ast_log(LOG_WARNING, "Could not create a memory pool for recreating SIP subscriptions\n");
+		ao2_ref(state, -1);
 		return 0;
 	}
 
-	ao2_callback(persisted_subscriptions, OBJ_NODATA, subscription_persistence_recreate, pool);
+	for (;;) {
+		ao2_lock(state);
+		persistence = ao2_iterator_next(&state->iter);
+		ao2_unlock(state);
+		if (!persistence) {
+			break;
+		}
 
-	pjsip_endpt_release_pool(ast_sip_get_pjsip_endpoint(), pool);
+		subscription_persistence_recreate(persistence, pool, 0);
+		ao2_ref(persistence, -1);
+	}
 
-	ao2_ref(persisted_subscriptions, -1);
+	pjsip_endpt_release_pool(ast_sip_get_pjsip_endpoint(), pool);
+	ao2_ref(state, -1);
 	return 0;
 }
 
+/*! \brief Function which loads and recreates persisted subscriptions upon startup when the system is fully booted */
+static int subscription_persistence_load(void *data)
+{
+	struct persistence_recreate_state *state;
+	long tasks;
+	int count;
+
+	state = ao2_alloc(sizeof(*state), persistence_recreate_state_destroy);
+	if (!state) {
+		return 0;
+	}
+
+	state->persisted_subscriptions = ast_sorcery_retrieve_by_fields(ast_sip_get_sorcery(),
+		"subscription_persistence", AST_RETRIEVE_FLAG_MULTIPLE | AST_RETRIEVE_FLAG_ALL, NULL);
+	if (!state->persisted_subscriptions) {
+		ao2_ref(state, -1);
+		return 0;
+	}
+	state->iter = ao2_iterator_init(state->persisted_subscriptions, 0);
+
+	/* Share the work out between the processors, this task being one of the workers */
+	count = ao2_container_count(state->persisted_subscriptions);
+	tasks = sysconf(_SC_NPROCESSORS_ONLN);
+	tasks = MIN(MIN(tasks, PERSISTENCE_RECREATE_MAX_TASKS), count / PERSISTENCE_RECREATE_MIN_PER_TASK);
+	ast_debug(3, "Recreating %d persisted subscriptions using %ld additional tasks\n",
+		count, MAX(tasks - 1, 0));
+
+	for (; tasks > 1; --tasks) {
+		if (ast_sip_push_task(NULL, subscription_persistence_recreate_task, ao2_bump(state))) {
+			ao2_ref(state, -1);
+			break;
+		}
+	}
+
+	return subscription_persistence_recreate_task(state);
+}
+
 /*! \brief Event callback which fires subscription persistence recreation when the system is fully booted */
 static void subscription_persistence_event_cb(void *data, struct stasis_subscription *sub, struct stasis_message *message)
 {
@@ -3431,6 +3527,11 @@ void ast_sip_pubsub_unregister_body_generator(struct ast_sip_pubsub_body_generat
 	}
 	AST_RWLIST_TRAVERSE_SAFE_END;
 	AST_RWLIST_UNLOCK(&body_generators);
+
+	/* The generator may be replaced by one producing different bodies */
+	if (body_cache) {
+		ao2_callback(body_cache, OBJ_NODATA | OBJ_MULTIPLE | OBJ_UNLINK, NULL, NULL);
+	}
 }
 
 int ast_sip_pubsub_register_body_supplement(struct ast_sip_pubsub_body_supplement *supplement)
@@ -3467,31 +3568,17 @@ const char *ast_sip_subscription_get_body_subtype(struct ast_sip_subscription *s
 	return sub->body_generator->subtype;
 }
 
-int ast_sip_pubsub_generate_body_content(const char *type, const char *subtype,
+static int generate_body_content(struct ast_sip_pubsub_body_generator *generator,
 		struct ast_sip_body_data *data, struct ast_str **str)
 {
 	struct ast_sip_pubsub_body_supplement *supplement;
-	struct ast_sip_pubsub_body_generator *generator;
 	int res = 0;
 	void *body;
 
-	generator = find_body_generator_type_subtype(type, subtype);
-	if (!generator) {
-		ast_log(LOG_WARNING, "Unable to find a body generator for %s/%s\n",
-				type, subtype);
-		return -1;
-	}
-
-	if (strcmp(data->body_type, generator->body_type)) {
-		ast_log(LOG_WARNING, "%s/%s body generator does not accept the type of data provided\n",
-			type, subtype);
-		return -1;
-	}
-
 	body = generator->allocate_body(data->body_data);
 	if (!body) {
 		ast_log(LOG_WARNING, "%s/%s body generator could not to allocate a body\n",
-			type, subtype);
+			generator->type, generator->subtype);
 		return -1;
 	}
 
@@ -3524,6 +3611,122 @@ end:
 	return res;
 }
 
+/*! \brief Determine if any body supplement applies to bodies of a generator */
+static int body_generator_is_supplemented(const struct ast_sip_pubsub_body_generator *generator)
+{
+	struct ast_sip_pubsub_body_supplement *supplement;
+	int res = 0;
+
+	AST_RWLIST_RDLOCK(&body_supplements);
+	AST_RWLIST_TRAVERSE(&body_supplements, supplement, list) {
+		if (!strcmp(generator->type, supplement->type) &&
+				!strcmp(generator->subtype, supplement->subtype)) {
+			res = 1;
+			break;
+		}
+	}
+	AST_RWLIST_UNLOCK(&body_supplements);
+
+	return res;
+}
+
+/*! \brief Keep a generated body for sharing with other subscriptions */
+static void body_cache_store(const char *key, const char *text)
+{
+	struct body_cache_entry *entry;
+	size_t key_len = strlen(key) + 1;
+
+	entry = ao2_alloc_options(sizeof(*entry) + key_len + strlen(text) + 1, NULL,
+		AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!entry) {
+		return;
+	}
+	strcpy(entry->key, key); /* SAFE */
+	entry->text = entry->key + key_len;
+	strcpy(entry->text, text); /* SAFE */
+
+	ao2_lock(body_cache);
+	if (ao2_container_count(body_cache) >= BODY_CACHE_MAX_ENTRIES) {
+		ao2_callback(body_cache, OBJ_NOLOCK | OBJ_NODATA | OBJ_MULTIPLE | OBJ_UNLINK, NULL, NULL);
+	}
+	ao2_find(body_cache, key, OBJ_SEARCH_KEY | OBJ_NOLOCK | OBJ_NODATA | OBJ_UNLINK);
+	ao2_link_flags(body_cache, entry, OBJ_NOLOCK);
+	ao2_unlock(body_cache);
+
+	ao2_ref(entry, -1);
+}
+
+/*!
+ * \brief Generate a body, sharing it with other subscriptions where the generator allows
+ *
+ * A body generated for one subscription is kept under the generator's key.
+ * Further subscriptions producing the same key get a copy of it with their
+ * own fields patched in, instead of building the body again.
+ */
+static int generate_body_content_shared(struct ast_sip_pubsub_body_generator *generator,
+		struct ast_sip_body_data *data, struct ast_str **str)
+{
+	struct ast_str *key;
+	struct body_cache_entry *entry;
+	int res;
+
+	if (!body_cache || body_generator_is_supplemented(generator)) {
+		return generate_body_content(generator, data, str);
+	}
+
+	key = ast_str_create(128);
+	if (!key) {
+		return generate_body_content(generator, data, str);
+	}
+
+	ast_str_set(&key, 0, "%s/%s:", generator->type, generator->subtype);
+	if (generator->body_cache_key(data->body_data, &key)) {
+		ast_free(key);
+		return generate_body_content(generator, data, str);
+	}
+
+	entry = ao2_find(body_cache, ast_str_buffer(key), OBJ_SEARCH_KEY);
+	if (entry) {
+		ast_free(key);
+		ast_str_set(str, 0, "%s", entry->text);
+		ao2_ref(entry, -1);
+		return generator->patch_body(data->body_data, str);
+	}
+
+	res = generate_body_content(generator, data, str);
+	if (!res && ast_str_strlen(*str)) {
+		body_cache_store(ast_str_buffer(key), ast_str_buffer(*str));
+	}
+	ast_free(key);
+
+	return res;
+}
+
+int ast_sip_pubsub_generate_body_content(const char *type, const char *subtype,
+		struct ast_sip_body_data *data, struct ast_str **str)
+{
+	struct ast_sip_pubsub_body_generator *generator;
+
+	generator = find_body_generator_type_subtype(type, subtype);
+	if (!generator) {
+		ast_log(LOG_WARNING, "Unable to find a body generator for %s/%s\n",
+				type, subtype);
+		return -1;
+	}
+
+	if (strcmp(data->body_type, generator->body_type)) {
+		ast_log(LOG_WARNING, "%s/%s body generator does not accept the type of data provided\n",
+			type, subtype);
+		return -1;
+	}
+
+	if (generator->body_cache_key && generator->patch_body) {
+		return generate_body_content_shared(generator, data, str);
+	}
+
+	return generate_body_content(generator, data, str);
+}
+
 struct simple_message_summary {
 	int messages_waiting;
 	int voice_messages_new;
@@ -5487,6 +5690,12 @@ static int load_module(void)
 		return AST_MODULE_LOAD_DECLINE;
 	}
 
+	body_cache = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0, BODY_CACHE_BUCKETS,
+		body_cache_entry_hash_fn, NULL, body_cache_entry_cmp_fn);
+	if (!body_cache) {
+		ast_log(LOG_WARNING, "Could not create the generated body cache, bodies will not be shared\n");
+	}
+
 	if (ast_sched_start_thread(sched)) {
 		ast_log(LOG_ERROR, "Could not start scheduler thread for publication expiration\n");
 		ast_sched_context_destroy(sched);
@@ -5618,6 +5827,9 @@ static int unload_module(void)
 		ast_sched_context_destroy(sched);
 	}
 
+	ao2_cleanup(body_cache);
+	body_cache = NULL;
+
 	return 0;
 }
 
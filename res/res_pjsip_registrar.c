@@ -1226,6 +1226,7 @@ static unsigned int check_interval;
 static int expire_contact(void *obj, void *arg, int flags)
 {
 	struct ast_sip_contact *contact = obj;
+	struct ast_sip_contact *current;
 	struct ast_named_lock *lock;
 
 	lock = ast_named_lock_get(AST_NAMED_LOCK_TYPE_MUTEX, "aor", contact->aor);
@@ -1236,11 +1237,14 @@ static int expire_contact(void *obj, void *arg, int flags)
 	/*
 	 * We need to check the expiration again with the aor lock held
 	 * in case another thread is attempting to renew the contact.
+	 * A renewal held back by contact_write_behind is only in memory.
 	 */
 	ao2_lock(lock);
-	if (ast_tvdiff_ms(ast_tvnow(), contact->expiration_time) > 0) {
-		registrar_contact_delete(CONTACT_DELETE_EXPIRE, NULL, contact, contact->aor);
+	current = ast_sip_location_retrieve_contact(ast_sorcery_object_get_id(contact));
+	if (current && ast_tvdiff_ms(ast_tvnow(), current->expiration_time) > 0) {
+		registrar_contact_delete(CONTACT_DELETE_EXPIRE, NULL, current, current->aor);
 	}
+	ao2_cleanup(current);
 	ao2_unlock(lock);
 	ast_named_lock_put(lock);
 
@@ -53,6 +53,8 @@
 #include "asterisk/linkedlists.h"       /* for AST_LIST_NEXT */
 #include "asterisk/stream.h"
 #include "asterisk/format_cache.h"
+#include "asterisk/astobj2.h"
+#include "asterisk/threadstorage.h"
 
 #include "asterisk/res_pjsip.h"
 #include "asterisk/res_pjsip_session.h"
@@ -66,6 +68,35 @@ static struct ast_sockaddr address_rtp;
 static const char STR_AUDIO[] = "audio";
 static const char STR_VIDEO[] = "video";
 
+/*! \brief Number of buckets for the offered codecs cache */
+#define SDP_CODECS_CACHE_BUCKETS 127
+/*! \brief Most distinct media descriptions kept in the offered codecs cache */
+#define SDP_CODECS_CACHE_MAX 512
+
+/*!
+ * \brief Codecs parsed from a remote media description
+ *
+ * Carriers tend to send the exact same media description on every call,
+ * so the result of interpreting its rtpmap, fmtp and ptime attributes is
+ * kept and copied instead of parsed again.
+ */
+struct sdp_codecs_entry {
+	/*! Payload mappings described by the remote media */
+	struct ast_rtp_codecs codecs;
+	/*! Whether telephone-event was offered */
+	int tel_event;
+	/*! Normalized media description, see sdp_codecs_key() */
+	char key[0];
+};
+
+/*! \brief Cache of \ref sdp_codecs_entry objects */
+static struct ao2_container *sdp_codecs_cache;
+
+AST_THREADSTORAGE(sdp_codecs_key_buf);
+
+AO2_STRING_FIELD_HASH_FN(sdp_codecs_entry, key);
+AO2_STRING_FIELD_CMP_FN(sdp_codecs_entry, key);
+
 static int send_keepalive(const void *data)
 {
 	struct ast_sip_session_media *session_media = (struct ast_sip_session_media *) data;
@@ -286,21 +317,22 @@ static int create_rtp(struct ast_sip_session *session, struct ast_sip_session_me
 	return 0;
 }
 
-static void get_codecs(struct ast_sip_session *session, const struct pjmedia_sdp_media *stream, struct ast_rtp_codecs *codecs,
-	struct ast_sip_session_media *session_media)
+/*! \brief Parse the codecs offered in a remote media description */
+static void parse_codecs(struct ast_sip_session *session, const struct pjmedia_sdp_media *stream, struct ast_rtp_codecs *codecs,
+	int *tel_event)
 {
 	pjmedia_sdp_attr *attr;
 	pjmedia_sdp_rtpmap *rtpmap;
 	pjmedia_sdp_fmtp fmtp;
 	struct ast_format *format;
-	int i, num = 0, tel_event = 0;
+	int i, num = 0;
 	char name[256];
 	char media[20];
 	char fmt_param[256];
 	enum ast_rtp_options options = session->endpoint->media.g726_non_standard ?
 		AST_RTP_OPT_G726_NONSTANDARD : 0;
 
-	ast_rtp_codecs_payloads_initialize(codecs);
+	*tel_event = 0;
 
 	/* Iterate through provided formats */
 	for (i = 0; i < stream->desc.fmt_count; ++i) {
@@ -318,7 +350,7 @@ static void get_codecs(struct ast_sip_session *session, const struct pjmedia_sdp
 
 		ast_copy_pj_str(name, &rtpmap->enc_name, sizeof(name));
 		if (strcmp(name, "telephone-event") == 0) {
-			tel_event++;
+			(*tel_event)++;
 		}
 
 		ast_copy_pj_str(media, (pj_str_t*)&stream->desc.media, sizeof(media));
@@ -350,6 +382,123 @@ static void get_codecs(struct ast_sip_session *session, const struct pjmedia_sdp
 			}
 		}
 	}
+
+	/* Get the packetization, if it exists */
+	if ((attr = pjmedia_sdp_media_find_attr2(stream, "ptime", NULL))) {
+		unsigned long framing = pj_strtoul(pj_strltrim(&attr->value));
+		if (framing && session->endpoint->media.rtp.use_ptime) {
+			ast_rtp_codecs_set_framing(codecs, framing);
+		}
+	}
+}
+
+/*! \brief Append a length prefixed string to a cache key so values can't run together */
+static void sdp_codecs_key_append(struct ast_str **key, const pj_str_t *value)
+{
+	ast_str_append_int(key, 0, value ? (intmax_t) pj_strlen(value) : -1);
+	ast_str_append_literal(key, 0, ":");
+	if (value) {
+		ast_str_append_raw(key, 0, pj_strbuf(value), pj_strlen(value));
+	}
+}
+
+/*!
+ * \brief Build the cache key for a remote media description
+ *
+ * The key holds everything parse_codecs() looks at: the endpoint options
+ * that change the result, the media type, and for every offered payload
+ * its rtpmap and fmtp attributes, plus the ptime.  Connection addresses,
+ * ports and everything else that differs per call are left out.
+ */
+static const char *sdp_codecs_key(struct ast_sip_session *session, const struct pjmedia_sdp_media *stream)
+{
+	struct ast_str *key = ast_str_thread_get(&sdp_codecs_key_buf, 512);
+	pjmedia_sdp_attr *attr;
+	int i;
+
+	if (!key) {
+		return NULL;
+	}
+
+	ast_str_reset(key);
+	ast_str_append_int(&key, 0, session->endpoint->media.g726_non_standard);
+	ast_str_append_int(&key, 0, session->endpoint->media.rtp.use_ptime);
+	sdp_codecs_key_append(&key, &stream->desc.media);
+
+	for (i = 0; i < stream->desc.fmt_count; ++i) {
+		sdp_codecs_key_append(&key, &stream->desc.fmt[i]);
+		attr = pjmedia_sdp_media_find_attr2(stream, "rtpmap", &stream->desc.fmt[i]);
+		sdp_codecs_key_append(&key, attr ? &attr->value : NULL);
+		attr = pjmedia_sdp_media_find_attr2(stream, "fmtp", &stream->desc.fmt[i]);
+		sdp_codecs_key_append(&key, attr ? &attr->value : NULL);
+	}
+
+	attr = pjmedia_sdp_media_find_attr2(stream, "ptime", NULL);
+	sdp_codecs_key_append(&key, attr ? &attr->value : NULL);
+
+	return ast_str_buffer(key);
+}
+
+static void sdp_codecs_entry_destroy(void *obj)
+{
+	struct sdp_codecs_entry *entry = obj;
+
+	ast_rtp_codecs_payloads_destroy(&entry->codecs);
+}
+
+/*! \brief Remember the codecs parsed for a media description */
+static void sdp_codecs_cache_add(const char *key, struct ast_rtp_codecs *codecs, int tel_event)
+{
+	struct sdp_codecs_entry *entry;
+	size_t key_len = strlen(key) + 1;
+
+	entry = ao2_alloc_options(sizeof(*entry) + key_len, sdp_codecs_entry_destroy,
+		AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!entry) {
+		return;
+	}
+
+	ast_rtp_codecs_payloads_initialize(&entry->codecs);
+	ast_rtp_codecs_payloads_copy(codecs, &entry->codecs, NULL);
+	entry->tel_event = tel_event;
+	memcpy(entry->key, key, key_len);
+
+	ao2_lock(sdp_codecs_cache);
+	if (ao2_container_count(sdp_codecs_cache) >= SDP_CODECS_CACHE_MAX) {
+		/* Make room by dropping whichever entry comes first */
+		ao2_callback(sdp_codecs_cache, OBJ_UNLINK | OBJ_NODATA | OBJ_NOLOCK, NULL, NULL);
+	}
+	ao2_link_flags(sdp_codecs_cache, entry, OBJ_NOLOCK);
+	ao2_unlock(sdp_codecs_cache);
+
+	ao2_ref(entry, -1);
+}
+
+static void get_codecs(struct ast_sip_session *session, const struct pjmedia_sdp_media *stream, struct ast_rtp_codecs *codecs,
+	struct ast_sip_session_media *session_media)
+{
+	struct sdp_codecs_entry *cached = NULL;
+	const char *key;
+	int tel_event = 0;
+
+	ast_rtp_codecs_payloads_initialize(codecs);
+
+	key = sdp_codecs_key(session, stream);
+	if (key) {
+		cached = ao2_find(sdp_codecs_cache, key, OBJ_SEARCH_KEY);
+	}
+
+	if (cached) {
+		ast_rtp_codecs_payloads_copy(&cached->codecs, codecs, NULL);
+		tel_event = cached->tel_event;
+		ao2_ref(cached, -1);
+	} else {
+		parse_codecs(session, stream, codecs, &tel_event);
+		if (key) {
+			sdp_codecs_cache_add(key, codecs, tel_event);
+		}
+	}
+
 	if (!tel_event && (session->dtmf == AST_SIP_DTMF_AUTO)) {
 		ast_rtp_instance_dtmf_mode_set(session_media->rtp, AST_RTP_DTMF_MODE_INBAND);
 	}
@@ -361,15 +510,6 @@ static void get_codecs(struct ast_sip_session *session, const struct pjmedia_sdp
 			ast_rtp_instance_dtmf_mode_set(session_media->rtp, AST_RTP_DTMF_MODE_NONE);
 		}
 	}
-
-
-	/* Get the packetization, if it exists */
-	if ((attr = pjmedia_sdp_media_find_attr2(stream, "ptime", NULL))) {
-		unsigned long framing = pj_strtoul(pj_strltrim(&attr->value));
-		if (framing && session->endpoint->media.rtp.use_ptime) {
-			ast_rtp_codecs_set_framing(codecs, framing);
-		}
-	}
 }
 
 static int set_caps(struct ast_sip_session *session,
@@ -2137,6 +2277,9 @@ static int unload_module(void)
 		ast_sched_context_destroy(sched);
 	}
 
+	ao2_cleanup(sdp_codecs_cache);
+	sdp_codecs_cache = NULL;
+
 	return 0;
 }
 
@@ -2158,6 +2301,13 @@ static int load_module(void)
 		ast_sockaddr_parse(&address_rtp, "0.0.0.0", 0);
 	}
 
+	sdp_codecs_cache = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0,
+		SDP_CODECS_CACHE_BUCKETS, sdp_codecs_entry_hash_fn, NULL, sdp_codecs_entry_cmp_fn);
+	if (!sdp_codecs_cache) {
+		ast_log(LOG_ERROR, "Unable to create offered codecs cache.\n");
+		goto end;
+	}
+
 	if (!(sched = ast_sched_context_create())) {
 		ast_log(LOG_ERROR, "Unable to create scheduler context.\n");
 		goto end;
@@ -0,0 +1,412 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2019, Sangoma Technologies Corporation
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*!
+ * \file
+ * \brief Prometheus metrics over the Asterisk HTTP server
+ *
+ * \since 17.0.0
+ */
+
+/*** MODULEINFO
+	<support_level>extended</support_level>
+ ***/
+
+/*** DOCUMENTATION
+	<configInfo name="res_prometheus" language="en_US">
+		<synopsis>Prometheus metrics.</synopsis>
+		<configFile name="prometheus.conf">
+			<configObject name="global">
+				<synopsis>Global configuration settings</synopsis>
+				<configOption name="enabled">
+					<synopsis>Enable/disable the metrics URI</synopsis>
+				</configOption>
+				<configOption name="uri">
+					<synopsis>URI, relative to the HTTP server prefix, to serve the metrics on</synopsis>
+				</configOption>
+				<configOption name="prefix">
+					<synopsis>Prefix to prepend to every metric name</synopsis>
+				</configOption>
+			</configObject>
+		</configFile>
+	</configInfo>
+***/
+
+#include "asterisk.h"
+
+#include "asterisk/bridge.h"
+#include "asterisk/channel.h"
+#include "asterisk/config_options.h"
+#include "asterisk/http.h"
+#include "asterisk/module.h"
+#include "asterisk/pbx.h"
+#include "asterisk/taskprocessor.h"
+#include "asterisk/vector.h"
+
+#define AST_API_MODULE
+#include "asterisk/res_prometheus.h"
+
+#define MAX_URI 64
+
+#define MAX_PREFIX 40
+
+/*! \brief Global configuration options for the metrics URI. */
+struct conf_global_options {
+	/*! Disabled by default. */
+	int enabled;
+	/*! URI to serve the metrics on. */
+	char uri[MAX_URI + 1];
+	/*! Prefix to put on every metric. */
+	char prefix[MAX_PREFIX + 1];
+};
+
+/*! \brief All configuration options for the metrics URI. */
+struct conf {
+	/*! The general section configuration options. */
+	struct conf_global_options *global;
+};
+
+/*! \brief Locking container for safe configuration access. */
+static AO2_GLOBAL_OBJ_STATIC(confs);
+
+/*! Registered sources of metrics, only this module's lock is held during a scrape */
+static AST_VECTOR_RW(, struct prometheus_callback *) callbacks;
+
+/*! The URI the metrics are currently served on */
+static char metrics_uri_path[MAX_URI + 1];
+
+void prometheus_metric_append(struct ast_str **output, const char *name,
+	const char *type, const char *help, intmax_t value)
+{
+	struct conf *cfg = ao2_global_obj_ref(confs);
+	const char *prefix = cfg ? cfg->global->prefix : "";
+	const char *sep = ast_strlen_zero(prefix) ? "" : "_";
+
+	ast_str_append(output, 0, "# HELP %s%s%s %s\n", prefix, sep, name, help);
+	ast_str_append(output, 0, "# TYPE %s%s%s %s\n", prefix, sep, name, type);
+	ast_str_append(output, 0, "%s%s%s %jd\n", prefix, sep, name, value);
+
+	ao2_cleanup(cfg);
+}
+
+int prometheus_callback_register(struct prometheus_callback *callback)
+{
+	int res;
+
+	if (!callback || !callback->callback_fn) {
+		return -1;
+	}
+
+	AST_VECTOR_RW_WRLOCK(&callbacks);
+	res = AST_VECTOR_APPEND(&callbacks, callback);
+	AST_VECTOR_RW_UNLOCK(&callbacks);
+
+	return res;
+}
+
+void prometheus_callback_unregister(struct prometheus_callback *callback)
+{
+	AST_VECTOR_RW_WRLOCK(&callbacks);
+	AST_VECTOR_REMOVE_CMP_UNORDERED(&callbacks, callback, AST_VECTOR_ELEM_DEFAULT_CMP,
+		AST_VECTOR_ELEM_CLEANUP_NOOP);
+	AST_VECTOR_RW_UNLOCK(&callbacks);
+}
+
+/*!
+ * \internal
+ * \brief Metrics that core keeps as counts or atomics and can be read without locking
+ */
+static void core_metrics_cb(struct ast_str **output)
+{
+	struct timeval now = ast_tvnow();
+	struct ao2_container *bridges = ast_bridges();
+
+	prometheus_metric_append(output, "core_uptime_seconds", PROMETHEUS_METRIC_GAUGE,
+		"Seconds since Asterisk started.",
+		ast_startuptime.tv_sec ? ast_tvdiff_sec(now, ast_startuptime) : 0);
+	prometheus_metric_append(output, "core_last_reload_seconds", PROMETHEUS_METRIC_GAUGE,
+		"Seconds since Asterisk last reloaded.",
+		ast_lastreloadtime.tv_sec ? ast_tvdiff_sec(now, ast_lastreloadtime) : 0);
+	prometheus_metric_append(output, "channels_count", PROMETHEUS_METRIC_GAUGE,
+		"Current number of channels.", ast_active_channels());
+	prometheus_metric_append(output, "calls_count", PROMETHEUS_METRIC_GAUGE,
+		"Current number of calls.", ast_active_calls());
+	prometheus_metric_append(output, "calls_sum", PROMETHEUS_METRIC_COUNTER,
+		"Calls processed since Asterisk started.", ast_processed_calls());
+	prometheus_metric_append(output, "bridges_count", PROMETHEUS_METRIC_GAUGE,
+		"Current number of bridges.", bridges ? ao2_container_count(bridges) : 0);
+	prometheus_metric_append(output, "taskprocessors_alerted_count", PROMETHEUS_METRIC_GAUGE,
+		"Taskprocessors whose queue is above its high water mark.",
+		ast_taskprocessor_alert_get());
+
+	ao2_cleanup(bridges);
+}
+
+static struct prometheus_callback core_metrics = {
+	.name = "core",
+	.callback_fn = core_metrics_cb,
+};
+
+/*! \brief Where thread role samples are written during a scrape */
+struct thread_metrics {
+	struct ast_str **output;
+	const char *prefix;
+	const char *sep;
+};
+
+static void thread_cpu_metric_cb(const char *role, int threads, int64_t cpu_usec, void *data)
+{
+	struct thread_metrics *metrics = data;
+
+	ast_str_append(metrics->output, 0, "%s%sthread_cpu_seconds_total{role=\"%s\"} %.3f\n",
+		metrics->prefix, metrics->sep, role, cpu_usec / 1000000.0);
+}
+
+static void thread_count_metric_cb(const char *role, int threads, int64_t cpu_usec, void *data)
+{
+	struct thread_metrics *metrics = data;
+
+	ast_str_append(metrics->output, 0, "%s%sthreads_count{role=\"%s\"} %d\n",
+		metrics->prefix, metrics->sep, role, threads);
+}
+
+/*!
+ * \internal
+ * \brief CPU time and thread count of each thread role
+ */
+static void thread_metrics_cb(struct ast_str **output)
+{
+	struct conf *cfg = ao2_global_obj_ref(confs);
+	struct thread_metrics metrics = {
+		.output = output,
+		.prefix = cfg ? cfg->global->prefix : "",
+	};
+
+	metrics.sep = ast_strlen_zero(metrics.prefix) ? "" : "_";
+
+	ast_str_append(output, 0, "# HELP %s%sthread_cpu_seconds_total CPU time used by the threads of a role.\n",
+		metrics.prefix, metrics.sep);
+	ast_str_append(output, 0, "# TYPE %s%sthread_cpu_seconds_total %s\n",
+		metrics.prefix, metrics.sep, PROMETHEUS_METRIC_COUNTER);
+	ast_thread_role_cpu_foreach(thread_cpu_metric_cb, &metrics);
+
+	ast_str_append(output, 0, "# HELP %s%sthreads_count Running threads of a role.\n",
+		metrics.prefix, metrics.sep);
+	ast_str_append(output, 0, "# TYPE %s%sthreads_count %s\n",
+		metrics.prefix, metrics.sep, PROMETHEUS_METRIC_GAUGE);
+	ast_thread_role_cpu_foreach(thread_count_metric_cb, &metrics);
+
+	ao2_cleanup(cfg);
+}
+
+static struct prometheus_callback thread_metrics = {
+	.name = "threads",
+	.callback_fn = thread_metrics_cb,
+};
+
+static int metrics_callback(struct ast_tcptls_session_instance *ser,
+	const struct ast_http_uri *urih, const char *uri,
+	enum ast_http_method method, struct ast_variable *get_params,
+	struct ast_variable *headers)
+{
+	struct ast_str *http_header;
+	struct ast_str *out;
+	int i;
+
+	if (method != AST_HTTP_GET && method != AST_HTTP_HEAD) {
+		ast_http_error(ser, 501, "Not Implemented", "Attempt to use unimplemented / unsupported method");
+		return 0;
+	}
+
+	http_header = ast_str_create(64);
+	out = ast_str_create(2048);
+	if (!http_header || !out) {
+		ast_free(http_header);
+		ast_free(out);
+		ast_http_request_close_on_completion(ser);
+		ast_http_error(ser, 500, "Server Error", "Out of memory");
+		return 0;
+	}
+
+	AST_VECTOR_RW_RDLOCK(&callbacks);
+	for (i = 0; i < AST_VECTOR_SIZE(&callbacks); i++) {
+		AST_VECTOR_GET(&callbacks, i)->callback_fn(&out);
+	}
+	AST_VECTOR_RW_UNLOCK(&callbacks);
+
+	ast_str_set(&http_header, 0, "Content-Type: text/plain; version=0.0.4\r\n");
+	ast_http_send(ser, method, 200, NULL, http_header, out, 0, 0);
+
+	return 0;
+}
+
+static struct ast_http_uri metrics_uri = {
+	.callback = metrics_callback,
+	.description = "Prometheus Metrics",
+	.uri = metrics_uri_path,
+	.has_subtree = 0,
+	.data = NULL,
+	.key = __FILE__,
+};
+
+/*! \brief Mapping of the prometheus conf struct's globals to the
+ *         general context in the config file. */
+static struct aco_type global_option = {
+	.type = ACO_GLOBAL,
+	.name = "global",
+	.item_offset = offsetof(struct conf, global),
+	.category = "general",
+	.category_match = ACO_WHITELIST_EXACT,
+};
+
+static struct aco_type *global_options[] = ACO_TYPES(&global_option);
+
+/*! \brief Disposes of the prometheus conf object */
+static void conf_destructor(void *obj)
+{
+	struct conf *cfg = obj;
+	ao2_cleanup(cfg->global);
+}
+
+/*! \brief Creates the prometheus conf object. */
+static void *conf_alloc(void)
+{
+	struct conf *cfg;
+
+	if (!(cfg = ao2_alloc(sizeof(*cfg), conf_destructor))) {
+		return NULL;
+	}
+
+	if (!(cfg->global = ao2_alloc(sizeof(*cfg->global), NULL))) {
+		ao2_ref(cfg, -1);
+		return NULL;
+	}
+	return cfg;
+}
+
+/*! \brief The conf file that's processed for the module. */
+static struct aco_file conf_file = {
+	/*! The config file name. */
+	.filename = "prometheus.conf",
+	/*! The mapping object types to be processed. */
+	.types = ACO_TYPES(&global_option),
+};
+
+CONFIG_INFO_STANDARD(cfg_info, confs, conf_alloc,
+		     .files = ACO_FILES(&conf_file));
+
+/*! \brief Serve the metrics on the configured URI, or stop serving them */
+static void metrics_uri_update(void)
+{
+	struct conf *cfg = ao2_global_obj_ref(confs);
+
+	ast_http_uri_unlink(&metrics_uri);
+	metrics_uri_path[0] = '\0';
+
+	if (cfg && cfg->global->enabled && !ast_strlen_zero(cfg->global->uri)) {
+		ast_copy_string(metrics_uri_path, cfg->global->uri, sizeof(metrics_uri_path));
+		ast_http_uri_link(&metrics_uri);
+	}
+
+	ao2_cleanup(cfg);
+}
+
+static int unload_module(void)
+{
+	ast_http_uri_unlink(&metrics_uri);
+	prometheus_callback_unregister(&thread_metrics);
+	prometheus_callback_unregister(&core_metrics);
+	aco_info_destroy(&cfg_info);
+	ao2_global_obj_release(confs);
+	AST_VECTOR_RW_FREE(&callbacks);
+	return 0;
+}
+
+static int load_module(void)
+{
+	if (AST_VECTOR_RW_INIT(&callbacks, 8)) {
+		return AST_MODULE_LOAD_DECLINE;
+	}
+
+	if (aco_info_init(&cfg_info)) {
+		aco_info_destroy(&cfg_info);
+		AST_VECTOR_RW_FREE(&callbacks);
+		return AST_MODULE_LOAD_DECLINE;
+	}
+
+	aco_option_register(&cfg_info, "enabled", ACO_EXACT, global_options,
+		"no", OPT_BOOL_T, 1,
+		FLDSET(struct conf_global_options, enabled));
+
+	aco_option_register(&cfg_info, "uri", ACO_EXACT, global_options,
+		"metrics", OPT_CHAR_ARRAY_T, 0,
+		CHARFLDSET(struct conf_global_options, uri));
+
+	aco_option_register(&cfg_info, "prefix", ACO_EXACT, global_options,
+		"asterisk", OPT_CHAR_ARRAY_T, 0,
+		CHARFLDSET(struct conf_global_options, prefix));
+
+	if (aco_process_config(&cfg_info, 0) == ACO_PROCESS_ERROR) {
+		struct conf *cfg;
+
+		ast_log(LOG_NOTICE, "Could not load prometheus config; using defaults\n");
+		cfg = conf_alloc();
+		if (!cfg || aco_set_defaults(&global_option, "general", cfg->global)) {
+			ao2_cleanup(cfg);
+			unload_module();
+			return AST_MODULE_LOAD_DECLINE;
+		}
+
+		ao2_global_obj_replace_unref(confs, cfg);
+		ao2_ref(cfg, -1);
+	}
+
+	if (prometheus_callback_register(&core_metrics)
+		|| prometheus_callback_register(&thread_metrics)) {
+		unload_module();
+		return AST_MODULE_LOAD_DECLINE;
+	}
+
+	metrics_uri_update();
+
+	return AST_MODULE_LOAD_SUCCESS;
+}
+
+static int reload_module(void)
+{
+	switch (aco_process_config(&cfg_info, 1)) {
+	case ACO_PROCESS_OK:
+		break;
+	case ACO_PROCESS_UNCHANGED:
+		return AST_MODULE_LOAD_SUCCESS;
+	case ACO_PROCESS_ERROR:
+	default:
+		return AST_MODULE_LOAD_DECLINE;
+	}
+
+	metrics_uri_update();
+
+	return AST_MODULE_LOAD_SUCCESS;
+}
+
+AST_MODULE_INFO(ASTERISK_GPL_KEY, AST_MODFLAG_GLOBAL_SYMBOLS | AST_MODFLAG_LOAD_ORDER, "Prometheus metrics support",
+	.support_level = AST_MODULE_SUPPORT_EXTENDED,
+	.load = load_module,
+	.unload = unload_module,
+	.reload = reload_module,
+	.load_pri = AST_MODPRI_DEFAULT,
+	.requires = "http",
+);
@@ -39,6 +39,7 @@
 #include <sys/time.h>
 #include <signal.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 
 #ifdef HAVE_OPENSSL
 #include <openssl/opensslconf.h>
@@ -64,6 +65,7 @@
 #endif
 
 #include "asterisk/options.h"
+#include "asterisk/alertpipe.h"
 #include "asterisk/stun.h"
 #include "asterisk/pbx.h"
 #include "asterisk/frame.h"
@@ -82,6 +84,7 @@
 #include "asterisk/uuid.h"
 #include "asterisk/test.h"
 #include "asterisk/data_buffer.h"
+#include "asterisk/media_trace.h"
 #ifdef HAVE_PJPROJECT
 #include "asterisk/res_pjproject.h"
 #endif
@@ -174,6 +177,23 @@ enum strict_rtp_mode {
 
 #define DEFAULT_STRICT_RTP STRICT_RTP_YES	/*!< Enabled by default */
 #define DEFAULT_ICESUPPORT 1
+#define DEFAULT_STUN_CACHE_INTERVAL 0	/*!< Seconds to reuse a STUN mapped address, 0 to disable */
+
+#if defined(MSG_WAITFORONE)
+/*! recvmmsg() and sendmmsg() are available to move several packets per system call */
+#define HAVE_RTP_BATCH_IO 1
+#endif
+
+#define DEFAULT_BATCHIO 0	/*!< Disabled by default */
+#define DEFAULT_IOTHREADS 0	/*!< Disabled by default */
+#define RTP_IO_THREADS_MAX 64	/*!< Most RTP I/O threads that may be configured */
+#define RTP_BATCH_MAX 32	/*!< Most packets moved by one system call */
+/*! Room for each batched packet, enough for any datagram on an Ethernet MTU */
+#define RTP_BATCH_PACKET_SIZE 2048
+/*! Room left in a batched packet for the SRTP trailer added when the batch is sent */
+#define RTP_BATCH_SRTP_ROOM 256
+/*! Slots in the per instance cache of payloads used to send formats */
+#define RTP_TX_PAYLOAD_CACHE_SIZE 4
 
 extern struct ast_srtp_res *res_srtp;
 extern struct ast_srtp_policy_res *res_srtp_policy;
@@ -196,9 +216,12 @@ static int nochecksums;
 static int strictrtp = DEFAULT_STRICT_RTP; /*!< Only accept RTP frames from a defined source. If we receive an indication of a changing source, enter learning mode. */
 static int learning_min_sequential = DEFAULT_LEARNING_MIN_SEQUENTIAL; /*!< Number of sequential RTP frames needed from a single source during learning mode to accept new source. */
 static int learning_min_duration = DEFAULT_LEARNING_MIN_DURATION; /*!< Lowest acceptable timeout between the first and the last sequential RTP frame. */
+static unsigned int batchio = DEFAULT_BATCHIO; /*!< Number of RTP packets to read or send per system call, 0 or 1 to use one per packet. */
+static unsigned int iothreads = DEFAULT_IOTHREADS; /*!< Number of threads reading RTP instead of the channel threads, 0 to disable. */
 #ifdef HAVE_PJPROJECT
 static int icesupport = DEFAULT_ICESUPPORT;
 static struct sockaddr_in stunaddr;
+static unsigned int stun_cache_interval = DEFAULT_STUN_CACHE_INTERVAL;
 static pj_str_t turnaddr;
 static int turnport = DEFAULT_TURN_PORT;
 static pj_str_t turnusername;
@@ -211,6 +234,12 @@ static ast_rwlock_t ice_blacklist_lock = AST_RWLOCK_INIT_VALUE;
 static struct ast_ha *stun_blacklist = NULL;
 static ast_rwlock_t stun_blacklist_lock = AST_RWLOCK_INIT_VALUE;
 
+/*! External address last mapped by the STUN server, reused for stun_cache_interval */
+static struct sockaddr_in stun_cache_answer;
+/*! When stun_cache_answer was mapped, zero if there is none */
+static struct timeval stun_cache_time;
+AST_MUTEX_DEFINE_STATIC(stun_cache_lock);
+
 
 /*! \brief Pool factory used by pjlib to allocate memory. */
 static pj_caching_pool cachingpool;
@@ -292,6 +321,7 @@ struct dtls_details {
 	enum ast_rtp_dtls_setup dtls_setup; /*!< Current setup state */
 	enum ast_rtp_dtls_connection connection; /*!< Whether this is a new or existing connection */
 	int timeout_timer; /*!< Scheduler id for timeout timer */
+	struct timeval handshake_start; /*!< When the current handshake started, zero if none is in progress */
 };
 #endif
 
@@ -312,6 +342,34 @@ struct rtp_ssrc_mapping {
 	struct ast_rtp_instance *instance;
 };
 
+/*! \brief RTP packets moved by a single recvmmsg() or sendmmsg() call */
+struct rtp_batch {
+	/*! The number of packets the batch can hold */
+	unsigned int size;
+	/*! The number of packets in the batch */
+	unsigned int count;
+	/*! The next received packet to hand out */
+	unsigned int next;
+	/*! SRTP session to protect the queued packets with when sending, NULL if they are ready to send */
+	struct ast_srtp *srtp;
+#ifdef HAVE_RTP_BATCH_IO
+	struct mmsghdr *msgs;
+	struct iovec *iovs;
+#endif
+	struct ast_sockaddr *addrs;
+	unsigned char *bufs;
+};
+
+/*! \brief Cached payload used to send a format */
+struct rtp_tx_payload_cache {
+	/*! The format the payload was looked up for (ref held) */
+	struct ast_format *format;
+	/*! Payload mapping generation the lookup was made at */
+	unsigned int generation;
+	/*! The payload to send the format with */
+	int payload;
+};
+
 /*! \brief RTP session description */
 struct ast_rtp {
 	int s;
@@ -337,11 +395,22 @@ struct ast_rtp {
 	unsigned int rxoctetcount;      /*!< How many octets have we received? should be rxcount *160*/
 	unsigned int txcount;           /*!< How many packets have we sent? */
 	unsigned int txoctetcount;      /*!< How many octets have we sent? (txcount*160)*/
+	unsigned int rxsyscalls;        /*!< How many system calls have read RTP packets? */
+	unsigned int rxsyscallpackets;  /*!< How many RTP packets have those system calls read? */
+	unsigned int txsyscalls;        /*!< How many system calls have sent RTP packets? */
+	unsigned int txsyscallpackets;  /*!< How many RTP packets have those system calls sent? */
+	struct rtp_batch *rx_batch;     /*!< Packets read together but not yet processed */
+	struct rtp_batch *tx_batch;     /*!< Packets queued to send together */
+	unsigned int tx_batching:1;     /*!< Queue RTP packets on the tx_batch instead of sending them */
+	struct rtp_io_thread *io;       /*!< RTP I/O thread reading the sockets instead of the channel thread */
+	struct rtp_io_entry *io_entry;  /*!< The instance's entry on the RTP I/O thread */
 	unsigned int cycles;            /*!< Shifted count of sequence number cycles */
 	double rxjitter;                /*!< Interarrival jitter at the moment in seconds */
 	double rxtransit;               /*!< Relative transit time for previous packet */
 	struct ast_format *lasttxformat;
 	struct ast_format *lastrxformat;
+	/*! Payloads recently used to send formats, indexed by format pointer */
+	struct rtp_tx_payload_cache tx_payload_cache[RTP_TX_PAYLOAD_CACHE_SIZE];
 
 	/* DTMF Reception Variables */
 	char resp;                        /*!< The current digit being processed */
@@ -517,8 +586,8 @@ struct rtp_red {
 	int num_gen; /*!< Number of generations */
 	int schedid; /*!< Timer id */
 	int ti; /*!< How long to buffer data before send */
+	/*! RED packet, primary data is buffered in place after the last generation */
 	unsigned char t140red_data[64000];
-	unsigned char buf_data[64000]; /*!< buffered primary data */
 	int hdrlen;
 	long int prev_ts;
 };
@@ -534,6 +603,7 @@ AST_LIST_HEAD_NOLOCK(frame_list, ast_frame);
 /* Forward Declarations */
 static int ast_rtp_new(struct ast_rtp_instance *instance, struct ast_sched_context *sched, struct ast_sockaddr *addr, void *data);
 static int ast_rtp_destroy(struct ast_rtp_instance *instance);
+static void ast_rtp_release(struct ast_rtp_instance *instance);
 static int ast_rtp_dtmf_begin(struct ast_rtp_instance *instance, char digit);
 static int ast_rtp_dtmf_end(struct ast_rtp_instance *instance, char digit);
 static int ast_rtp_dtmf_end_with_duration(struct ast_rtp_instance *instance, char digit, unsigned int duration);
@@ -1923,24 +1993,169 @@ error:
 	return -1;
 }
 
-static int load_dtls_certificate(struct ast_rtp_instance *instance,
-								 const struct ast_rtp_dtls_cfg *dtls_cfg,
-								 struct dtls_cert_info *cert_info)
+/*! \brief A certificate and private key used for DTLS */
+struct dtls_cert {
+	EVP_PKEY *private_key;
+	X509 *certificate;
+	/*! Modification time of the certificate file when it was read */
+	time_t certfile_mtime;
+	/*! Modification time of the private key file when it was read */
+	time_t pvtfile_mtime;
+	/*! Fingerprints of the certificate indexed by hash, empty until first needed */
+	char fingerprint[AST_RTP_DTLS_HASH_SHA1 + 1][160];
+	/*! The certificate and private key files separated by a newline, empty if ephemeral */
+	char files[0];
+};
+
+/*! Certificates read from files, shared by every session configured with them */
+static struct ao2_container *dtls_certs;
+
+#define DTLS_CERT_BUCKETS 7
+
+AO2_STRING_FIELD_HASH_FN(dtls_cert, files);
+AO2_STRING_FIELD_CMP_FN(dtls_cert, files);
+
+static void dtls_cert_destroy(void *obj)
 {
+	struct dtls_cert *cert = obj;
+
+	EVP_PKEY_free(cert->private_key);
+	X509_free(cert->certificate);
+}
+
+/*!
+ * \internal
+ * \brief Wrap a certificate and private key, taking over their references
+ */
+static struct dtls_cert *dtls_cert_alloc(const char *files, struct dtls_cert_info *cert_info)
+{
+	struct dtls_cert *cert;
+
+	cert = ao2_alloc(sizeof(*cert) + strlen(files) + 1, dtls_cert_destroy);
+	if (!cert) {
+		EVP_PKEY_free(cert_info->private_key);
+		X509_free(cert_info->certificate);
+		return NULL;
+	}
+
+	cert->private_key = cert_info->private_key;
+	cert->certificate = cert_info->certificate;
+	strcpy(cert->files, files); /* Safe */
+
+	return cert;
+}
+
+/*!
+ * \internal
+ * \brief Get the certificate to use for a DTLS configuration
+ *
+ * Certificates read from files are kept and handed to every session using
+ * the same files until the files change. Ephemeral certificates are created
+ * for each session.
+ *
+ * \return the certificate with a reference the caller must release, or NULL
+ */
+static struct dtls_cert *dtls_cert_get(struct ast_rtp_instance *instance,
+									   const struct ast_rtp_dtls_cfg *dtls_cfg)
+{
+	struct dtls_cert_info cert_info;
+	struct dtls_cert *cert;
+	struct stat certfile_stat = { 0, };
+	struct stat pvtfile_stat = { 0, };
+	const char *pvtfile;
+	char *files;
+
 	if (dtls_cfg->ephemeral_cert) {
-		return create_certificate_ephemeral(instance, dtls_cfg, cert_info);
-	} else if (!ast_strlen_zero(dtls_cfg->certfile)) {
-		return create_certificate_from_file(instance, dtls_cfg, cert_info);
+		if (create_certificate_ephemeral(instance, dtls_cfg, &cert_info)) {
+			return NULL;
+		}
+		return dtls_cert_alloc("", &cert_info);
+	} else if (ast_strlen_zero(dtls_cfg->certfile)) {
+		return NULL;
+	}
+
+	pvtfile = S_OR(dtls_cfg->pvtfile, dtls_cfg->certfile);
+	files = ast_alloca(strlen(dtls_cfg->certfile) + strlen(pvtfile) + 2);
+	sprintf(files, "%s\n%s", dtls_cfg->certfile, pvtfile); /* Safe */
+
+	/* Failures are left for reading the files to report */
+	stat(dtls_cfg->certfile, &certfile_stat);
+	stat(pvtfile, &pvtfile_stat);
+
+	ao2_lock(dtls_certs);
+	cert = ao2_find(dtls_certs, files, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if (cert && (cert->certfile_mtime != certfile_stat.st_mtime
+		|| cert->pvtfile_mtime != pvtfile_stat.st_mtime)) {
+		ao2_unlink_flags(dtls_certs, cert, OBJ_NOLOCK);
+		ao2_ref(cert, -1);
+		cert = NULL;
+	}
+	if (!cert && !create_certificate_from_file(instance, dtls_cfg, &cert_info)) {
+		cert = dtls_cert_alloc(files, &cert_info);
+		if (cert) {
+			cert->certfile_mtime = certfile_stat.st_mtime;
+			cert->pvtfile_mtime = pvtfile_stat.st_mtime;
+			ao2_link_flags(dtls_certs, cert, OBJ_NOLOCK);
+		}
+	}
+	ao2_unlock(dtls_certs);
+
+	return cert;
+}
+
+/*!
+ * \internal
+ * \brief Get the fingerprint of a certificate, computing it on first use
+ *
+ * \return the fingerprint, or NULL if it could not be produced
+ */
+static const char *dtls_cert_fingerprint(struct ast_rtp_instance *instance,
+										 struct dtls_cert *cert, enum ast_rtp_dtls_hash hash)
+{
+	const EVP_MD *type;
+	unsigned int size, i;
+	unsigned char fingerprint[EVP_MAX_MD_SIZE];
+	char *local_fingerprint;
+	const char *res;
+
+	if (hash == AST_RTP_DTLS_HASH_SHA1) {
+		type = EVP_sha1();
+	} else if (hash == AST_RTP_DTLS_HASH_SHA256) {
+		type = EVP_sha256();
 	} else {
-		return -1;
+		ast_log(LOG_ERROR, "Unsupported fingerprint hash type on RTP instance '%p'\n",
+			instance);
+		return NULL;
 	}
+
+	res = cert->fingerprint[hash];
+
+	ao2_lock(cert);
+	if (!cert->fingerprint[hash][0]) {
+		if (!X509_digest(cert->certificate, type, fingerprint, &size) || !size) {
+			ast_log(LOG_ERROR, "Could not produce fingerprint from certificate for RTP instance '%p'\n",
+					instance);
+			res = NULL;
+		} else {
+			local_fingerprint = cert->fingerprint[hash];
+			for (i = 0; i < size; i++) {
+				sprintf(local_fingerprint, "%02hhX:", fingerprint[i]);
+				local_fingerprint += 3;
+			}
+
+			*(local_fingerprint - 1) = 0;
+		}
+	}
+	ao2_unlock(cert);
+
+	return res;
 }
 
 /*! \pre instance is locked */
 static int ast_rtp_dtls_set_configuration(struct ast_rtp_instance *instance, const struct ast_rtp_dtls_cfg *dtls_cfg)
 {
 	struct ast_rtp *rtp = ast_rtp_instance_get_data(instance);
-	struct dtls_cert_info cert_info = { 0 };
+	struct dtls_cert *cert;
 	int res;
 
 	if (!dtls_cfg->enabled) {
@@ -1982,50 +2197,34 @@ static int ast_rtp_dtls_set_configuration(struct ast_rtp_instance *instance, con
 
 	rtp->local_hash = dtls_cfg->hash;
 
-	if (!load_dtls_certificate(instance, dtls_cfg, &cert_info)) {
-		const EVP_MD *type;
-		unsigned int size, i;
-		unsigned char fingerprint[EVP_MAX_MD_SIZE];
-		char *local_fingerprint = rtp->local_fingerprint;
+	cert = dtls_cert_get(instance, dtls_cfg);
+	if (cert) {
+		const char *fingerprint;
 
-		if (!SSL_CTX_use_certificate(rtp->ssl_ctx, cert_info.certificate)) {
+		/* The SSL context takes its own references to the certificate and key */
+		if (!SSL_CTX_use_certificate(rtp->ssl_ctx, cert->certificate)) {
 			ast_log(LOG_ERROR, "Specified certificate for RTP instance '%p' could not be used\n",
 					instance);
+			ao2_ref(cert, -1);
 			return -1;
 		}
 
-		if (!SSL_CTX_use_PrivateKey(rtp->ssl_ctx, cert_info.private_key)
+		if (!SSL_CTX_use_PrivateKey(rtp->ssl_ctx, cert->private_key)
 		    || !SSL_CTX_check_private_key(rtp->ssl_ctx)) {
 			ast_log(LOG_ERROR, "Specified private key for RTP instance '%p' could not be used\n",
 					instance);
+			ao2_ref(cert, -1);
 			return -1;
 		}
 
-		if (rtp->local_hash == AST_RTP_DTLS_HASH_SHA1) {
-			type = EVP_sha1();
-		} else if (rtp->local_hash == AST_RTP_DTLS_HASH_SHA256) {
-			type = EVP_sha256();
-		} else {
-			ast_log(LOG_ERROR, "Unsupported fingerprint hash type on RTP instance '%p'\n",
-				instance);
-			return -1;
-		}
-
-		if (!X509_digest(cert_info.certificate, type, fingerprint, &size) || !size) {
-			ast_log(LOG_ERROR, "Could not produce fingerprint from certificate for RTP instance '%p'\n",
-					instance);
+		fingerprint = dtls_cert_fingerprint(instance, cert, rtp->local_hash);
+		if (!fingerprint) {
+			ao2_ref(cert, -1);
 			return -1;
 		}
+		ast_copy_string(rtp->local_fingerprint, fingerprint, sizeof(rtp->local_fingerprint));
 
-		for (i = 0; i < size; i++) {
-			sprintf(local_fingerprint, "%02hhX:", fingerprint[i]);
-			local_fingerprint += 3;
-		}
-
-		*(local_fingerprint - 1) = 0;
-
-		EVP_PKEY_free(cert_info.private_key);
-		X509_free(cert_info.certificate);
+		ao2_ref(cert, -1);
 	}
 
 	if (!ast_strlen_zero(dtls_cfg->cipher)) {
@@ -2276,6 +2475,7 @@ static struct ast_rtp_engine asterisk_rtp_engine = {
 	.set_stream_num = ast_rtp_set_stream_num,
 	.extension_enable = ast_rtp_extension_enable,
 	.bundle = ast_rtp_bundle,
+	.release = ast_rtp_release,
 };
 
 #if defined(HAVE_OPENSSL) && (OPENSSL_VERSION_NUMBER >= 0x10001000L) && !defined(OPENSSL_NO_SRTP)
@@ -2293,6 +2493,9 @@ static void dtls_perform_handshake(struct ast_rtp_instance *instance, struct dtl
 	}
 
 	SSL_do_handshake(dtls->ssl);
+	if (ast_tvzero(dtls->handshake_start)) {
+		dtls->handshake_start = ast_tvnow();
+	}
 
 	/*
 	 * A race condition is prevented between this function and __rtp_recvfrom()
@@ -2320,6 +2523,7 @@ static void dtls_perform_setup(struct dtls_details *dtls)
 	}
 
 	SSL_clear(dtls->ssl);
+	dtls->handshake_start = ast_tv(0, 0);
 	if (dtls->dtls_setup == AST_RTP_DTLS_SETUP_PASSIVE) {
 		SSL_set_accept_state(dtls->ssl);
 	} else {
@@ -2821,6 +3025,248 @@ static int rtcp_mux(struct ast_rtp *rtp, const unsigned char *packet)
 	return 0;
 }
 
+#ifdef HAVE_RTP_BATCH_IO
+static struct rtp_batch *rtp_batch_alloc(unsigned int size)
+{
+	struct rtp_batch *batch;
+	unsigned int i;
+
+	batch = ast_calloc(1, sizeof(*batch) + size * (sizeof(*batch->msgs) + sizeof(*batch->iovs)
+		+ sizeof(*batch->addrs) + RTP_BATCH_PACKET_SIZE));
+	if (!batch) {
+		return NULL;
+	}
+
+	batch->size = size;
+	batch->msgs = (struct mmsghdr *) (batch + 1);
+	batch->iovs = (struct iovec *) (batch->msgs + size);
+	batch->addrs = (struct ast_sockaddr *) (batch->iovs + size);
+	batch->bufs = (unsigned char *) (batch->addrs + size);
+
+	for (i = 0; i < size; ++i) {
+		batch->iovs[i].iov_base = batch->bufs + i * RTP_BATCH_PACKET_SIZE;
+		batch->iovs[i].iov_len = RTP_BATCH_PACKET_SIZE;
+		batch->msgs[i].msg_hdr.msg_iov = &batch->iovs[i];
+		batch->msgs[i].msg_hdr.msg_iovlen = 1;
+		batch->msgs[i].msg_hdr.msg_name = &batch->addrs[i].ss;
+	}
+
+	return batch;
+}
+
+/*!
+ * \brief Read the next RTP packet, reading as many as are waiting when none are left
+ *
+ * \pre instance is locked
+ */
+static int rtp_batch_recv(struct ast_rtp *rtp, void *buf, size_t size, int flags, struct ast_sockaddr *sa)
+{
+	struct rtp_batch *batch = rtp->rx_batch;
+	struct mmsghdr *msg;
+	unsigned int i;
+	int res;
+
+	if (batch->next == batch->count) {
+		batch->next = batch->count = 0;
+		for (i = 0; i < batch->size; ++i) {
+			batch->msgs[i].msg_hdr.msg_namelen = sizeof(batch->addrs[i].ss);
+		}
+		if ((res = recvmmsg(rtp->s, batch->msgs, batch->size, flags, NULL)) <= 0) {
+			return res;
+		}
+		batch->count = res;
+		rtp->rxsyscalls++;
+		rtp->rxsyscallpackets += res;
+	}
+
+	msg = &batch->msgs[batch->next];
+	batch->addrs[batch->next].len = msg->msg_hdr.msg_namelen;
+	ast_sockaddr_copy(sa, &batch->addrs[batch->next]);
+	batch->next++;
+
+	if ((msg->msg_hdr.msg_flags & MSG_TRUNC) || msg->msg_len > size) {
+		ast_debug(1, "%p -- Dropping RTP packet from %s too large for batched reading\n",
+			rtp, ast_sockaddr_stringify(sa));
+		errno = EAGAIN;
+		return -1;
+	}
+
+	memcpy(buf, msg->msg_hdr.msg_iov->iov_base, msg->msg_len);
+	return msg->msg_len;
+}
+
+/*!
+ * \brief Protect every packet queued on the batch with one SRTP call
+ *
+ * Packets that fail to be protected are dropped from the batch.
+ *
+ * \pre instance is locked
+ */
+static void rtp_batch_protect(struct rtp_batch *batch)
+{
+	void *bufs[RTP_BATCH_MAX];
+	int lens[RTP_BATCH_MAX];
+	unsigned int i, kept = 0;
+
+	for (i = 0; i < batch->count; ++i) {
+		bufs[i] = batch->iovs[i].iov_base;
+		lens[i] = batch->iovs[i].iov_len;
+	}
+
+	res_srtp->protect_batch(batch->srtp, bufs, lens, batch->count, RTP_BATCH_PACKET_SIZE, 0);
+	batch->srtp = NULL;
+
+	for (i = 0; i < batch->count; ++i) {
+		if (lens[i] < 0) {
+			continue;
+		}
+		if (i != kept) {
+			memcpy(batch->iovs[kept].iov_base, batch->iovs[i].iov_base, lens[i]);
+			ast_sockaddr_copy(&batch->addrs[kept], &batch->addrs[i]);
+			batch->msgs[kept].msg_hdr.msg_namelen = batch->msgs[i].msg_hdr.msg_namelen;
+		}
+		batch->iovs[kept].iov_len = lens[i];
+		kept++;
+	}
+	batch->count = kept;
+}
+
+/*!
+ * \brief Send every packet queued on the batch
+ *
+ * \pre instance is locked
+ */
+static int rtp_batch_flush(struct ast_rtp *rtp)
+{
+	struct rtp_batch *batch = rtp->tx_batch;
+	unsigned int sent = 0;
+	int res = 0;
+
+	if (batch->srtp) {
+		rtp_batch_protect(batch);
+	}
+
+	while (sent < batch->count) {
+		if ((res = sendmmsg(rtp->s, batch->msgs + sent, batch->count - sent, 0)) <= 0) {
+			ast_log(LOG_ERROR, "RTP Transmission error of %u batched packets to %s: %s\n",
+				batch->count - sent, ast_sockaddr_stringify(&batch->addrs[sent]), strerror(errno));
+			res = -1;
+			break;
+		}
+		rtp->txsyscalls++;
+		rtp->txsyscallpackets += res;
+		sent += res;
+	}
+	batch->count = 0;
+
+	return res < 0 ? -1 : sent;
+}
+
+/*!
+ * \brief Queue an RTP packet to send with the rest of the batch
+ *
+ * \param srtp If not NULL the packet is not protected yet and is protected
+ *        by this session together with the rest of the batch when it is sent
+ *
+ * \retval -1 if the packet should be sent on its own
+ *
+ * \pre instance is locked
+ */
+static int rtp_batch_queue(struct ast_rtp *rtp, const void *buf, int len, struct ast_sockaddr *sa, struct ast_srtp *srtp)
+{
+	struct rtp_batch *batch = rtp->tx_batch;
+	unsigned int idx;
+
+	if (len > RTP_BATCH_PACKET_SIZE) {
+		/* Keep the packets in order ahead of one that has to go on its own */
+		if (batch->count) {
+			rtp_batch_flush(rtp);
+		}
+		return -1;
+	}
+	/* Every packet of a batch is protected, or not, the same way */
+	if (batch->count == batch->size || (batch->count && batch->srtp != srtp)) {
+		rtp_batch_flush(rtp);
+	}
+
+	batch->srtp = srtp;
+	idx = batch->count++;
+	memcpy(batch->iovs[idx].iov_base, buf, len);
+	batch->iovs[idx].iov_len = len;
+	ast_sockaddr_copy(&batch->addrs[idx], sa);
+	batch->msgs[idx].msg_hdr.msg_namelen = sa->len;
+
+	return len;
+}
+#endif
+
+/*!
+ * \brief Queue the RTP packets sent until rtp_send_batch_end() to send them together
+ *
+ * \pre instance is locked
+ */
+static void rtp_send_batch_begin(struct ast_rtp *rtp)
+{
+#ifdef HAVE_RTP_BATCH_IO
+	if (batchio <= 1 || rtp->bundled) {
+		return;
+	}
+	if (!rtp->tx_batch && !(rtp->tx_batch = rtp_batch_alloc(batchio))) {
+		return;
+	}
+	rtp->tx_batching = 1;
+#endif
+}
+
+/*!
+ * \brief Send the RTP packets queued since rtp_send_batch_begin()
+ *
+ * \retval -1 if sending failed
+ *
+ * \pre instance is locked
+ */
+static int rtp_send_batch_end(struct ast_rtp *rtp)
+{
+#ifdef HAVE_RTP_BATCH_IO
+	if (!rtp->tx_batching) {
+		return 0;
+	}
+	rtp->tx_batching = 0;
+	if (rtp->tx_batch->count && rtp_batch_flush(rtp) < 0) {
+		return -1;
+	}
+#endif
+	return 0;
+}
+
+/*! \pre instance is locked */
+static int rtp_socket_recvfrom(struct ast_rtp *rtp, void *buf, size_t size, int flags, struct ast_sockaddr *sa, int rtcp)
+{
+	int len;
+
+	if (rtcp) {
+		return ast_recvfrom(rtp->rtcp->s, buf, size, flags, sa);
+	}
+
+#ifdef HAVE_RTP_BATCH_IO
+	if (rtp->rx_batch) {
+		return rtp_batch_recv(rtp, buf, size, flags, sa);
+	}
+#endif
+
+	if ((len = ast_recvfrom(rtp->s, buf, size, flags, sa)) >= 0) {
+		rtp->rxsyscalls++;
+		rtp->rxsyscallpackets++;
+	}
+	return len;
+}
+
+/*! \brief Determine if packets already read are waiting to be processed */
+static int rtp_recv_pending(struct ast_rtp *rtp)
+{
+	return rtp->rx_batch && rtp->rx_batch->next < rtp->rx_batch->count;
+}
+
 /*! \pre instance is locked */
 static int __rtp_recvfrom(struct ast_rtp_instance *instance, void *buf, size_t size, int flags, struct ast_sockaddr *sa, int rtcp)
 {
@@ -2833,7 +3279,7 @@ static int __rtp_recvfrom(struct ast_rtp_instance *instance, void *buf, size_t s
 	struct ast_sockaddr *loop = rtcp ? &rtp->rtcp_loop : &rtp->rtp_loop;
 #endif
 
-	if ((len = ast_recvfrom(rtcp ? rtp->rtcp->s : rtp->s, buf, size, flags, sa)) < 0) {
+	if ((len = rtp_socket_recvfrom(rtp, buf, size, flags, sa, rtcp)) < 0) {
 	   return len;
 	}
 
@@ -2872,6 +3318,10 @@ static int __rtp_recvfrom(struct ast_rtp_instance *instance, void *buf, size_t s
 
 		dtls_srtp_check_pending(instance, rtp, rtcp);
 
+		if (ast_tvzero(dtls->handshake_start) && !SSL_is_init_finished(dtls->ssl)) {
+			dtls->handshake_start = ast_tvnow();
+		}
+
 		BIO_write(dtls->read_bio, buf, len);
 
 		len = SSL_read(dtls->ssl, buf, len);
@@ -2886,6 +3336,11 @@ static int __rtp_recvfrom(struct ast_rtp_instance *instance, void *buf, size_t s
 		dtls_srtp_check_pending(instance, rtp, rtcp);
 
 		if (SSL_is_init_finished(dtls->ssl)) {
+			if (!ast_tvzero(dtls->handshake_start)) {
+				ast_debug(1, "DTLS handshake for %s of RTP instance '%p' completed in %" PRId64 " ms\n",
+					rtcp ? "RTCP" : "RTP", instance, ast_tvdiff_ms(ast_tvnow(), dtls->handshake_start));
+				dtls->handshake_start = ast_tv(0, 0);
+			}
 			/* Any further connections will be existing since this is now established */
 			dtls->connection = AST_RTP_DTLS_CONNECTION_EXISTING;
 			/* Use the keying material to set up key/salt information */
@@ -2983,11 +3438,22 @@ static int __rtp_sendto(struct ast_rtp_instance *instance, void *buf, size_t siz
 	struct ast_rtp_instance *transport = rtp->bundled ? rtp->bundled : instance;
 	struct ast_rtp *transport_rtp = ast_rtp_instance_get_data(transport);
 	struct ast_srtp *srtp = ast_rtp_instance_get_srtp(transport, rtcp);
+	int protect_later = 0;
 	int res;
 
 	*via_ice = 0;
 
-	if (use_srtp && res_srtp && srtp && res_srtp->protect(srtp, &temp, &len, rtcp) < 0) {
+#ifdef HAVE_RTP_BATCH_IO
+	/* A packet going into the send batch is protected in place together with
+	 * the rest of the batch, saving the copy into the SRTP session's buffer. */
+	protect_later = !rtcp && rtp->tx_batching && use_srtp && res_srtp && srtp && res_srtp->protect_batch
+#ifdef HAVE_PJPROJECT
+		&& !transport_rtp->ice
+#endif
+		&& len + RTP_BATCH_SRTP_ROOM <= RTP_BATCH_PACKET_SIZE;
+#endif
+
+	if (!protect_later && use_srtp && res_srtp && srtp && res_srtp->protect(srtp, &temp, &len, rtcp) < 0) {
 		return -1;
 	}
 
@@ -3022,9 +3488,20 @@ static int __rtp_sendto(struct ast_rtp_instance *instance, void *buf, size_t siz
 	}
 #endif
 
+#ifdef HAVE_RTP_BATCH_IO
+	if (!rtcp && rtp->tx_batching && (res = rtp_batch_queue(rtp, temp, len, sa, protect_later ? srtp : NULL)) > 0) {
+		ast_rtp_instance_set_last_tx(instance, time(NULL));
+		return res;
+	}
+#endif
+
 	res = ast_sendto(rtcp ? transport_rtp->rtcp->s : transport_rtp->s, temp, len, flags, sa);
 	if (res > 0) {
 		ast_rtp_instance_set_last_tx(instance, time(NULL));
+		if (!rtcp) {
+			transport_rtp->txsyscalls++;
+			transport_rtp->txsyscallpackets++;
+		}
 	}
 
 	return res;
@@ -3060,43 +3537,34 @@ static int rtp_get_rate(struct ast_format *format)
 	return (ast_format_cmp(format, ast_format_g722) == AST_FORMAT_CMP_EQUAL) ? 8000 : (int)ast_format_get_sample_rate(format);
 }
 
+/*!
+ * \brief Calculate the time until the next RTCP report
+ *
+ * As in RFC 3550 Section 6.3.1 the configured interval is randomized between
+ * half and one and a half times its value, so reports of sessions that were
+ * set up together do not all become due on the same scheduler pass.
+ */
 static unsigned int ast_rtcp_calc_interval(struct ast_rtp *rtp)
 {
-	unsigned int interval;
-	/*! \todo XXX Do a more reasonable calculation on this one
-	 * Look in RFC 3550 Section A.7 for an example*/
-	interval = rtcpinterval;
-	return interval;
+	return rtcpinterval / 2 + ast_random() % (rtcpinterval + 1);
 }
 
-/*! \brief Calculate normal deviation */
-static double normdev_compute(double normdev, double sample, unsigned int sample_count)
+/*!
+ * \brief Add a sample to a running mean and variance
+ *
+ * \param sample The new sample
+ * \param mean The mean of the previous samples, updated in place
+ * \param variance The variance of the previous samples, updated in place
+ * \param sample_count The number of previous samples
+ *
+ * This is Welford's single pass method, the standard deviation is the square
+ * root of the variance and is only computed when it is displayed.
+ */
+static void calc_mean_and_variance(double sample, double *mean, double *variance, unsigned int sample_count)
 {
-	normdev = normdev * sample_count + sample;
-	sample_count++;
-
-	/*
-	 It's possible the sample_count hits the maximum value and back to 0.
-	 Set to 1 to prevent the divide by zero crash if the sample_count is 0.
-	 */
-	if (sample_count == 0) {
-		sample_count = 1;
-	}
-
-	return normdev / sample_count;
-}
+	double delta = sample - *mean;
+	double weight;
 
-static double stddev_compute(double stddev, double sample, double normdev, double normdev_curent, unsigned int sample_count)
-{
-/*
-		for the formula check http://www.cs.umd.edu/~austinjp/constSD.pdf
-		return sqrt( (sample_count*pow(stddev,2) + sample_count*pow((sample-normdev)/(sample_count+1),2) + pow(sample-normdev_curent,2)) / (sample_count+1));
-		we can compute the sigma^2 and that way we would have to do the sqrt only 1 time at the end and would save another pow 2 compute
-		optimized formula
-*/
-#define SQUARE(x) ((x) * (x))
-
-	stddev = sample_count * stddev;
 	sample_count++;
 
 	/*
@@ -3107,11 +3575,9 @@ static double stddev_compute(double stddev, double sample, double normdev, doubl
 		sample_count = 1;
 	}
 
-	return stddev +
-		( sample_count * SQUARE( (sample - normdev) / sample_count ) ) +
-		( SQUARE(sample - normdev_curent) / sample_count );
-
-#undef SQUARE
+	weight = 1.0 / sample_count;
+	*mean += delta * weight;
+	*variance += (delta * (sample - *mean) - *variance) * weight;
 }
 
 static int create_new_socket(const char *type, int af)
@@ -3269,6 +3735,67 @@ static int stun_address_is_blacklisted(const struct ast_sockaddr *addr)
 	return result;
 }
 
+/*!
+ * \internal
+ * \brief Get the external address of a port from the cached STUN mapping
+ *
+ * The cached address is only used for stun_cache_interval seconds after it
+ * was mapped. The NAT is assumed to keep the port number of the mapped
+ * port, as a one to one NAT does.
+ *
+ * \param answer Filled in with the external address on success
+ * \param port Local port to get the external address of
+ *
+ * \retval 0 on success
+ * \retval -1 if there is no usable cached address
+ */
+static int stun_cache_get(struct sockaddr_in *answer, int port)
+{
+	int res = -1;
+
+	if (!stun_cache_interval) {
+		return -1;
+	}
+
+	ast_mutex_lock(&stun_cache_lock);
+	if (!ast_tvzero(stun_cache_time)
+		&& ast_tvdiff_ms(ast_tvnow(), stun_cache_time) < (int64_t) stun_cache_interval * 1000) {
+		*answer = stun_cache_answer;
+		answer->sin_port = htons(port);
+		res = 0;
+	}
+	ast_mutex_unlock(&stun_cache_lock);
+
+	return res;
+}
+
+/*!
+ * \internal
+ * \brief Remember the external address just mapped by the STUN server
+ */
+static void stun_cache_put(const struct sockaddr_in *answer)
+{
+	if (!stun_cache_interval) {
+		return;
+	}
+
+	ast_mutex_lock(&stun_cache_lock);
+	stun_cache_answer = *answer;
+	stun_cache_time = ast_tvnow();
+	ast_mutex_unlock(&stun_cache_lock);
+}
+
+/*!
+ * \internal
+ * \brief Forget the cached STUN mapped address
+ */
+static void stun_cache_clear(void)
+{
+	ast_mutex_lock(&stun_cache_lock);
+	stun_cache_time = ast_tv(0, 0);
+	ast_mutex_unlock(&stun_cache_lock);
+}
+
 /*! \pre instance is locked */
 static void rtp_add_candidates_to_ice(struct ast_rtp_instance *instance, struct ast_rtp *rtp, struct ast_sockaddr *addr, int port, int component,
 				      int transport)
@@ -3310,14 +3837,20 @@ static void rtp_add_candidates_to_ice(struct ast_rtp_instance *instance, struct
 		struct sockaddr_in answer;
 		int rsp;
 
-		/*
-		 * The instance should not be locked because we can block
-		 * waiting for a STUN respone.
-		 */
-		ao2_unlock(instance);
-		rsp = ast_stun_request(component == AST_RTP_ICE_COMPONENT_RTCP
-			? rtp->rtcp->s : rtp->s, &stunaddr, NULL, &answer);
-		ao2_lock(instance);
+		rsp = stun_cache_get(&answer, port);
+		if (rsp) {
+			/*
+			 * The instance should not be locked because we can block
+			 * waiting for a STUN respone.
+			 */
+			ao2_unlock(instance);
+			rsp = ast_stun_request(component == AST_RTP_ICE_COMPONENT_RTCP
+				? rtp->rtcp->s : rtp->s, &stunaddr, NULL, &answer);
+			ao2_lock(instance);
+			if (!rsp) {
+				stun_cache_put(&answer);
+			}
+		}
 		if (!rsp) {
 			pj_sockaddr base;
 
@@ -3513,135 +4046,566 @@ static int rtp_allocate_transport(struct ast_rtp_instance *instance, struct ast_
 			break;
 		}
 
-		x += 2;
-		if (x > rtpend) {
-			x = (rtpstart + 1) & ~1;
+		x += 2;
+		if (x > rtpend) {
+			x = (rtpstart + 1) & ~1;
+		}
+
+		/* See if we ran out of ports or if the bind actually failed because of something other than the address being in use */
+		if (x == startplace || (errno != EADDRINUSE && errno != EACCES)) {
+			ast_log(LOG_ERROR, "Oh dear... we couldn't allocate a port for RTP instance '%p'\n", instance);
+			close(rtp->s);
+			rtp->s = -1;
+			return -1;
+		}
+	}
+
+#ifdef HAVE_PJPROJECT
+	/* Initialize synchronization aspects */
+	ast_cond_init(&rtp->cond, NULL);
+
+	generate_random_string(rtp->local_ufrag, sizeof(rtp->local_ufrag));
+	generate_random_string(rtp->local_passwd, sizeof(rtp->local_passwd));
+
+	/* Create an ICE session for ICE negotiation */
+	if (icesupport) {
+		rtp->ice_num_components = 2;
+		ast_debug(3, "Creating ICE session %s (%d) for RTP instance '%p'\n", ast_sockaddr_stringify(&rtp->bind_address), x, instance);
+		if (ice_create(instance, &rtp->bind_address, x, 0)) {
+			ast_log(LOG_NOTICE, "Failed to create ICE session\n");
+		} else {
+			rtp->ice_port = x;
+			ast_sockaddr_copy(&rtp->ice_original_rtp_addr, &rtp->bind_address);
+		}
+	}
+#endif
+
+#if defined(HAVE_OPENSSL) && (OPENSSL_VERSION_NUMBER >= 0x10001000L) && !defined(OPENSSL_NO_SRTP)
+	rtp->rekeyid = -1;
+	rtp->dtls.timeout_timer = -1;
+#endif
+
+	return 0;
+}
+
+static void rtp_deallocate_transport(struct ast_rtp_instance *instance, struct ast_rtp *rtp)
+{
+	int saved_rtp_s = rtp->s;
+#ifdef HAVE_PJPROJECT
+	struct timeval wait = ast_tvadd(ast_tvnow(), ast_samp2tv(TURN_STATE_WAIT_TIME, 1000));
+	struct timespec ts = { .tv_sec = wait.tv_sec, .tv_nsec = wait.tv_usec * 1000, };
+#endif
+
+#if defined(HAVE_OPENSSL) && (OPENSSL_VERSION_NUMBER >= 0x10001000L) && !defined(OPENSSL_NO_SRTP)
+	ast_rtp_dtls_stop(instance);
+#endif
+
+	/* Close our own socket so we no longer get packets */
+	if (rtp->s > -1) {
+		close(rtp->s);
+		rtp->s = -1;
+	}
+
+	/* Packets already read from the socket went away with it */
+	if (rtp->rx_batch) {
+		rtp->rx_batch->next = rtp->rx_batch->count = 0;
+	}
+
+	/* Destroy RTCP if it was being used */
+	if (rtp->rtcp && rtp->rtcp->s > -1) {
+		if (saved_rtp_s != rtp->rtcp->s) {
+			close(rtp->rtcp->s);
+		}
+		rtp->rtcp->s = -1;
+	}
+
+#ifdef HAVE_PJPROJECT
+	pj_thread_register_check();
+
+	/*
+	 * The instance lock is already held.
+	 *
+	 * Destroy the RTP TURN relay if being used
+	 */
+	if (rtp->turn_rtp) {
+		rtp->turn_state = PJ_TURN_STATE_NULL;
+
+		/* Release the instance lock to avoid deadlock with PJPROJECT group lock */
+		ao2_unlock(instance);
+		pj_turn_sock_destroy(rtp->turn_rtp);
+		ao2_lock(instance);
+		while (rtp->turn_state != PJ_TURN_STATE_DESTROYING) {
+			ast_cond_timedwait(&rtp->cond, ao2_object_get_lockaddr(instance), &ts);
+		}
+		rtp->turn_rtp = NULL;
+	}
+
+	/* Destroy the RTCP TURN relay if being used */
+	if (rtp->turn_rtcp) {
+		rtp->turn_state = PJ_TURN_STATE_NULL;
+
+		/* Release the instance lock to avoid deadlock with PJPROJECT group lock */
+		ao2_unlock(instance);
+		pj_turn_sock_destroy(rtp->turn_rtcp);
+		ao2_lock(instance);
+		while (rtp->turn_state != PJ_TURN_STATE_DESTROYING) {
+			ast_cond_timedwait(&rtp->cond, ao2_object_get_lockaddr(instance), &ts);
+		}
+		rtp->turn_rtcp = NULL;
+	}
+
+	/* Destroy any ICE session */
+	ast_rtp_ice_stop(instance);
+
+	/* Destroy any candidates */
+	if (rtp->ice_local_candidates) {
+		ao2_ref(rtp->ice_local_candidates, -1);
+		rtp->ice_local_candidates = NULL;
+	}
+
+	if (rtp->ice_active_remote_candidates) {
+		ao2_ref(rtp->ice_active_remote_candidates, -1);
+		rtp->ice_active_remote_candidates = NULL;
+	}
+
+	if (rtp->ioqueue) {
+		/*
+		 * We cannot hold the instance lock because we could wait
+		 * for the ioqueue thread to die and we might deadlock as
+		 * a result.
+		 */
+		ao2_unlock(instance);
+		rtp_ioqueue_thread_remove(rtp->ioqueue);
+		ao2_lock(instance);
+		rtp->ioqueue = NULL;
+	}
+#endif
+}
+
+/*!
+ * \brief An RTP instance whose sockets are read by an RTP I/O thread
+ *
+ * The entry holds a reference to the instance until its owner destroys it.
+ */
+struct rtp_io_entry {
+	/*! \brief The instance, NULL once its owner has destroyed it */
+	struct ast_rtp_instance *instance;
+	/*! \brief Channel the frames read are queued to, NULL until the instance has one */
+	struct ast_channel *chan;
+	/*! \brief Unique id of chan, compared with the instance's to notice a new channel */
+	char chan_id[AST_MAX_UNIQUEID];
+	/*! \brief Set once reading failed, the channel is hung up */
+	unsigned int failed:1;
+};
+
+/*!
+ * \brief A thread reading RTP instances instead of the channel threads
+ *
+ * \note Lock order is I/O thread, then RTP instance. Channels are never
+ * locked, looked up, or released while the I/O thread lock is held.
+ */
+struct rtp_io_thread {
+	ast_mutex_t lock;
+	pthread_t thread;
+	/*! \brief Wakes the thread to see changed entries or to exit */
+	int alert_pipe[2];
+	/*! \brief Bumped each time the entries change */
+	unsigned int generation;
+	/*! \brief Set when the thread should exit */
+	unsigned int stop:1;
+	AST_VECTOR(, struct rtp_io_entry *) entries;
+};
+
+/*! \brief A socket polled by an RTP I/O thread */
+struct rtp_io_poll {
+	struct rtp_io_entry *entry;
+	int rtcp;
+};
+
+/*! \brief Frames for a channel read by an RTP I/O thread */
+struct rtp_io_delivery {
+	struct ast_channel *chan;
+	/*! \brief The frames to queue, NULL to hang up the channel */
+	struct ast_frame *frames;
+};
+
+/*! \brief A channel lookup for an entry whose instance got a new channel */
+struct rtp_io_lookup {
+	struct rtp_io_entry *entry;
+	char chan_id[AST_MAX_UNIQUEID];
+};
+
+/*! \brief The running RTP I/O threads */
+static struct rtp_io_thread **io_threads;
+
+/*! \brief Number of RTP I/O threads running, 0 if channel threads read RTP themselves */
+static unsigned int io_thread_count;
+
+/*! \brief The RTP I/O thread given the next instance */
+static unsigned int io_thread_next;
+
+static void rtp_io_entry_destroy(void *obj)
+{
+	struct rtp_io_entry *entry = obj;
+
+	ao2_cleanup(entry->instance);
+	ast_channel_cleanup(entry->chan);
+}
+
+/*!
+ * \internal
+ * \brief Make copies of the frames read to queue them later
+ *
+ * The RTP engine reuses its frames once the instance is read again.
+ */
+static struct ast_frame *rtp_io_frames_isolate(struct ast_frame *frame)
+{
+	AST_LIST_HEAD_NOLOCK(, ast_frame) frames;
+	struct ast_frame *next;
+
+	AST_LIST_HEAD_INIT_NOLOCK(&frames);
+	for (; frame; frame = next) {
+		next = AST_LIST_NEXT(frame, frame_list);
+		AST_LIST_NEXT(frame, frame_list) = NULL;
+		if (frame == &ast_null_frame || !(frame = ast_frisolate(frame))) {
+			continue;
+		}
+		AST_LIST_INSERT_TAIL(&frames, frame, frame_list);
+	}
+
+	return AST_LIST_FIRST(&frames);
+}
+
+/*!
+ * \internal
+ * \brief Find the channels of entries whose instance changed channels
+ *
+ * \note Called without the I/O thread lock as looking up a channel locks channels.
+ */
+static void rtp_io_lookup_channels(struct rtp_io_thread *io, struct rtp_io_lookup *lookups, unsigned int count)
+{
+	struct ast_channel *chan;
+	unsigned int idx;
+
+	for (idx = 0; idx < count; ++idx) {
+		struct rtp_io_entry *entry = lookups[idx].entry;
+
+		chan = ast_strlen_zero(lookups[idx].chan_id) ? NULL : ast_channel_get_by_name(lookups[idx].chan_id);
+
+		ast_mutex_lock(&io->lock);
+		if (entry->instance) {
+			SWAP(entry->chan, chan);
+			ast_copy_string(entry->chan_id, lookups[idx].chan_id, sizeof(entry->chan_id));
+			entry->failed = 0;
+			io->generation++;
+		}
+		ast_mutex_unlock(&io->lock);
+
+		ast_channel_cleanup(chan);
+		ao2_ref(entry, -1);
+	}
+}
+
+static void *rtp_io_thread_run(void *data)
+{
+	struct rtp_io_thread *io = data;
+	struct pollfd *fds = NULL;
+	struct rtp_io_poll *polled = NULL;
+	unsigned int fds_size = 0;
+	AST_VECTOR(, struct rtp_io_delivery) deliveries;
+	AST_VECTOR(, struct rtp_io_lookup) lookups;
+	AST_VECTOR(, struct ast_channel *) released;
+	struct rtp_io_delivery *delivery;
+	struct rtp_io_entry *entry;
+	struct ast_frame *frame;
+	unsigned int generation;
+	unsigned int count;
+	unsigned int idx;
+	int res;
+
+	AST_VECTOR_INIT(&deliveries, 0);
+	AST_VECTOR_INIT(&lookups, 0);
+	AST_VECTOR_INIT(&released, 0);
+
+	for (;;) {
+		ast_mutex_lock(&io->lock);
+		if (io->stop) {
+			ast_mutex_unlock(&io->lock);
+			break;
+		}
+		/* Each instance has at most an RTP and an RTCP socket */
+		if (AST_VECTOR_SIZE(&io->entries) * 2 + 1 > fds_size) {
+			unsigned int size = AST_VECTOR_SIZE(&io->entries) * 2 + 1;
+			struct pollfd *grown_fds = ast_realloc(fds, size * sizeof(*fds));
+			struct rtp_io_poll *grown_polled;
+
+			if (grown_fds) {
+				fds = grown_fds;
+			}
+			grown_polled = ast_realloc(polled, size * sizeof(*polled));
+			if (grown_polled) {
+				polled = grown_polled;
+			}
+			if (!grown_fds || !grown_polled) {
+				ast_mutex_unlock(&io->lock);
+				usleep(1000);
+				continue;
+			}
+			fds_size = size;
+		}
+		fds[0].fd = ast_alertpipe_readfd(io->alert_pipe);
+		fds[0].events = POLLIN;
+		count = 1;
+		for (idx = 0; idx < AST_VECTOR_SIZE(&io->entries); ++idx) {
+			struct ast_rtp *rtp;
+			const char *chan_id;
+
+			entry = AST_VECTOR_GET(&io->entries, idx);
+
+			/* Channels are not held on to once they are gone */
+			if (entry->chan && ast_test_flag(ast_channel_flags(entry->chan), AST_FLAG_ZOMBIE)
+				&& !AST_VECTOR_APPEND(&released, entry->chan)) {
+				entry->chan = NULL;
+			}
+
+			ao2_lock(entry->instance);
+			chan_id = ast_rtp_instance_get_channel_id(entry->instance);
+			if (strcmp(chan_id, entry->chan_id)) {
+				struct rtp_io_lookup lookup = { .entry = ao2_bump(entry), };
+
+				ast_copy_string(lookup.chan_id, chan_id, sizeof(lookup.chan_id));
+				if (AST_VECTOR_APPEND(&lookups, lookup)) {
+					ao2_ref(entry, -1);
+				}
+			}
+			rtp = ast_rtp_instance_get_data(entry->instance);
+			/* Until there is a channel to give frames to the packets wait in the socket */
+			if (entry->chan && !entry->failed && !rtp->bundled && rtp->s >= 0) {
+				fds[count].fd = rtp->s;
+				fds[count].events = POLLIN;
+				polled[count].entry = entry;
+				polled[count].rtcp = 0;
+				count++;
+				if (rtp->rtcp && rtp->rtcp->s >= 0 && rtp->rtcp->s != rtp->s) {
+					fds[count].fd = rtp->rtcp->s;
+					fds[count].events = POLLIN;
+					polled[count].entry = entry;
+					polled[count].rtcp = 1;
+					count++;
+				}
+			}
+			ao2_unlock(entry->instance);
+		}
+		generation = io->generation;
+		ast_mutex_unlock(&io->lock);
+
+		AST_VECTOR_RESET(&released, ast_channel_unref);
+		if (AST_VECTOR_SIZE(&lookups)) {
+			rtp_io_lookup_channels(io, AST_VECTOR_GET_ADDR(&lookups, 0), AST_VECTOR_SIZE(&lookups));
+			AST_VECTOR_RESET(&lookups, AST_VECTOR_ELEM_CLEANUP_NOOP);
+			continue;
 		}
 
-		/* See if we ran out of ports or if the bind actually failed because of something other than the address being in use */
-		if (x == startplace || (errno != EADDRINUSE && errno != EACCES)) {
-			ast_log(LOG_ERROR, "Oh dear... we couldn't allocate a port for RTP instance '%p'\n", instance);
-			close(rtp->s);
-			rtp->s = -1;
-			return -1;
+		/* Wake up now and then to let go of channels that have hung up */
+		if ((res = ast_poll(fds, count, 1000)) < 0) {
+			if (errno != EINTR) {
+				ast_log(LOG_WARNING, "RTP I/O thread poll failed: %s\n", strerror(errno));
+				usleep(1000);
+			}
+			continue;
+		}
+		if (!res) {
+			continue;
+		}
+		if (fds[0].revents) {
+			ast_alertpipe_read(io->alert_pipe);
 		}
-	}
 
-#ifdef HAVE_PJPROJECT
-	/* Initialize synchronization aspects */
-	ast_cond_init(&rtp->cond, NULL);
+		ast_mutex_lock(&io->lock);
+		/* If the entries changed the sockets polled may be gone, poll again */
+		for (idx = 1; generation == io->generation && idx < count; ++idx) {
+			struct rtp_io_delivery pending;
 
-	generate_random_string(rtp->local_ufrag, sizeof(rtp->local_ufrag));
-	generate_random_string(rtp->local_passwd, sizeof(rtp->local_passwd));
+			if (!fds[idx].revents) {
+				continue;
+			}
+			entry = polled[idx].entry;
+			if (entry->failed) {
+				continue;
+			}
+			frame = ast_rtp_instance_read(entry->instance, polled[idx].rtcp);
+			if (frame == &ast_null_frame) {
+				continue;
+			}
+			if (!frame) {
+				/* The channel thread would hang up on a read error */
+				entry->failed = 1;
+			}
+			pending.chan = ast_channel_ref(entry->chan);
+			pending.frames = frame ? rtp_io_frames_isolate(frame) : NULL;
+			if ((frame && !pending.frames) || AST_VECTOR_APPEND(&deliveries, pending)) {
+				ast_frfree(pending.frames);
+				ast_channel_unref(pending.chan);
+			}
+		}
+		ast_mutex_unlock(&io->lock);
 
-	/* Create an ICE session for ICE negotiation */
-	if (icesupport) {
-		rtp->ice_num_components = 2;
-		ast_debug(3, "Creating ICE session %s (%d) for RTP instance '%p'\n", ast_sockaddr_stringify(&rtp->bind_address), x, instance);
-		if (ice_create(instance, &rtp->bind_address, x, 0)) {
-			ast_log(LOG_NOTICE, "Failed to create ICE session\n");
-		} else {
-			rtp->ice_port = x;
-			ast_sockaddr_copy(&rtp->ice_original_rtp_addr, &rtp->bind_address);
+		/* Queue outside of the I/O thread lock to keep to the lock order */
+		for (idx = 0; idx < AST_VECTOR_SIZE(&deliveries); ++idx) {
+			delivery = AST_VECTOR_GET_ADDR(&deliveries, idx);
+			if (delivery->frames) {
+				ast_queue_frame(delivery->chan, delivery->frames);
+				ast_frfree(delivery->frames);
+			} else {
+				ast_queue_hangup(delivery->chan);
+			}
+			ast_channel_unref(delivery->chan);
 		}
+		AST_VECTOR_RESET(&deliveries, AST_VECTOR_ELEM_CLEANUP_NOOP);
 	}
-#endif
 
-#if defined(HAVE_OPENSSL) && (OPENSSL_VERSION_NUMBER >= 0x10001000L) && !defined(OPENSSL_NO_SRTP)
-	rtp->rekeyid = -1;
-	rtp->dtls.timeout_timer = -1;
-#endif
+	AST_VECTOR_FREE(&deliveries);
+	AST_VECTOR_FREE(&lookups);
+	AST_VECTOR_FREE(&released);
+	ast_free(polled);
+	ast_free(fds);
 
-	return 0;
+	return NULL;
 }
 
-static void rtp_deallocate_transport(struct ast_rtp_instance *instance, struct ast_rtp *rtp)
+/*!
+ * \internal
+ * \brief Have an RTP I/O thread read a new instance
+ *
+ * \pre instance is locked
+ */
+static void rtp_io_add(struct ast_rtp_instance *instance, struct ast_rtp *rtp)
 {
-	int saved_rtp_s = rtp->s;
-#ifdef HAVE_PJPROJECT
-	struct timeval wait = ast_tvadd(ast_tvnow(), ast_samp2tv(TURN_STATE_WAIT_TIME, 1000));
-	struct timespec ts = { .tv_sec = wait.tv_sec, .tv_nsec = wait.tv_usec * 1000, };
-#endif
+	struct rtp_io_thread *io;
+	struct rtp_io_entry *entry;
 
-#if defined(HAVE_OPENSSL) && (OPENSSL_VERSION_NUMBER >= 0x10001000L) && !defined(OPENSSL_NO_SRTP)
-	ast_rtp_dtls_stop(instance);
-#endif
+	if (!io_thread_count) {
+		return;
+	}
 
-	/* Close our own socket so we no longer get packets */
-	if (rtp->s > -1) {
-		close(rtp->s);
-		rtp->s = -1;
+	entry = ao2_alloc_options(sizeof(*entry), rtp_io_entry_destroy, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!entry) {
+		return;
 	}
+	entry->instance = ao2_bump(instance);
 
-	/* Destroy RTCP if it was being used */
-	if (rtp->rtcp && rtp->rtcp->s > -1) {
-		if (saved_rtp_s != rtp->rtcp->s) {
-			close(rtp->rtcp->s);
-		}
-		rtp->rtcp->s = -1;
+	io = io_threads[ast_atomic_fetchadd_int((int *) &io_thread_next, 1) % io_thread_count];
+	ast_mutex_lock(&io->lock);
+	if (AST_VECTOR_APPEND(&io->entries, entry)) {
+		ast_mutex_unlock(&io->lock);
+		/* Not read by a thread, the channel thread reads it instead */
+		ao2_ref(entry->instance, -1);
+		entry->instance = NULL;
+		ao2_ref(entry, -1);
+		return;
 	}
+	io->generation++;
+	ast_mutex_unlock(&io->lock);
+	ast_alertpipe_write(io->alert_pipe);
 
-#ifdef HAVE_PJPROJECT
-	pj_thread_register_check();
+	rtp->io = io;
+	rtp->io_entry = entry;
+}
 
-	/*
-	 * The instance lock is already held.
-	 *
-	 * Destroy the RTP TURN relay if being used
-	 */
-	if (rtp->turn_rtp) {
-		rtp->turn_state = PJ_TURN_STATE_NULL;
+/*!
+ * \brief The owner of an instance is done with it, stop reading it
+ *
+ * \note instance is not locked
+ */
+static void ast_rtp_release(struct ast_rtp_instance *instance)
+{
+	struct ast_rtp *rtp = ast_rtp_instance_get_data(instance);
+	struct rtp_io_thread *io = rtp->io;
+	struct rtp_io_entry *entry = rtp->io_entry;
+	struct ast_channel *chan;
 
-		/* Release the instance lock to avoid deadlock with PJPROJECT group lock */
-		ao2_unlock(instance);
-		pj_turn_sock_destroy(rtp->turn_rtp);
-		ao2_lock(instance);
-		while (rtp->turn_state != PJ_TURN_STATE_DESTROYING) {
-			ast_cond_timedwait(&rtp->cond, ao2_object_get_lockaddr(instance), &ts);
-		}
-		rtp->turn_rtp = NULL;
+	if (!entry) {
+		return;
 	}
 
-	/* Destroy the RTCP TURN relay if being used */
-	if (rtp->turn_rtcp) {
-		rtp->turn_state = PJ_TURN_STATE_NULL;
+	ast_mutex_lock(&io->lock);
+	AST_VECTOR_REMOVE_ELEM_UNORDERED(&io->entries, entry, AST_VECTOR_ELEM_CLEANUP_NOOP);
+	instance = entry->instance;
+	entry->instance = NULL;
+	chan = entry->chan;
+	entry->chan = NULL;
+	io->generation++;
+	ast_mutex_unlock(&io->lock);
+	ast_alertpipe_write(io->alert_pipe);
 
-		/* Release the instance lock to avoid deadlock with PJPROJECT group lock */
-		ao2_unlock(instance);
-		pj_turn_sock_destroy(rtp->turn_rtcp);
-		ao2_lock(instance);
-		while (rtp->turn_state != PJ_TURN_STATE_DESTROYING) {
-			ast_cond_timedwait(&rtp->cond, ao2_object_get_lockaddr(instance), &ts);
+	ast_channel_cleanup(chan);
+	ao2_ref(entry, -1);
+	/* The owner still holds its own reference */
+	ao2_ref(instance, -1);
+}
+
+static void rtp_io_threads_destroy(void)
+{
+	unsigned int idx;
+
+	for (idx = 0; idx < io_thread_count; ++idx) {
+		struct rtp_io_thread *io = io_threads[idx];
+
+		if (io->thread != AST_PTHREADT_NULL) {
+			ast_mutex_lock(&io->lock);
+			io->stop = 1;
+			ast_mutex_unlock(&io->lock);
+			ast_alertpipe_write(io->alert_pipe);
+			pthread_join(io->thread, NULL);
 		}
-		rtp->turn_rtcp = NULL;
+		ast_alertpipe_close(io->alert_pipe);
+		ast_mutex_destroy(&io->lock);
+		AST_VECTOR_FREE(&io->entries);
+		ast_free(io);
 	}
+	ast_free(io_threads);
+	io_threads = NULL;
+	io_thread_count = 0;
+}
 
-	/* Destroy any ICE session */
-	ast_rtp_ice_stop(instance);
-
-	/* Destroy any candidates */
-	if (rtp->ice_local_candidates) {
-		ao2_ref(rtp->ice_local_candidates, -1);
-		rtp->ice_local_candidates = NULL;
+static int rtp_io_threads_create(unsigned int count)
+{
+	if (!count) {
+		return 0;
 	}
 
-	if (rtp->ice_active_remote_candidates) {
-		ao2_ref(rtp->ice_active_remote_candidates, -1);
-		rtp->ice_active_remote_candidates = NULL;
+	io_threads = ast_calloc(count, sizeof(*io_threads));
+	if (!io_threads) {
+		return -1;
 	}
 
-	if (rtp->ioqueue) {
-		/*
-		 * We cannot hold the instance lock because we could wait
-		 * for the ioqueue thread to die and we might deadlock as
-		 * a result.
-		 */
-		ao2_unlock(instance);
-		rtp_ioqueue_thread_remove(rtp->ioqueue);
-		ao2_lock(instance);
-		rtp->ioqueue = NULL;
+	for (io_thread_count = 0; io_thread_count < count; ++io_thread_count) {
+		struct rtp_io_thread *io = ast_calloc(1, sizeof(*io));
+
+		if (!io) {
+			goto failure;
+		}
+		io_threads[io_thread_count] = io;
+		ast_mutex_init(&io->lock);
+		io->thread = AST_PTHREADT_NULL;
+		AST_VECTOR_INIT(&io->entries, 0);
+		if (ast_alertpipe_init(io->alert_pipe)) {
+			io_thread_count++;
+			goto failure;
+		}
+		if (ast_pthread_create(&io->thread, NULL, rtp_io_thread_run, io)) {
+			io->thread = AST_PTHREADT_NULL;
+			io_thread_count++;
+			goto failure;
+		}
 	}
-#endif
+
+	return 0;
+
+failure:
+	ast_log(LOG_ERROR, "Unable to start the RTP I/O threads, channel threads will read RTP\n");
+	rtp_io_threads_destroy();
+	return -1;
 }
 
 /*! \pre instance is locked */
@@ -3681,6 +4645,15 @@ static int ast_rtp_new(struct ast_rtp_instance *instance,
 	rtp->lasttxformat = ao2_bump(ast_format_none);
 	rtp->stream_num = -1;
 
+#ifdef HAVE_RTP_BATCH_IO
+	/* Without a batch packets are simply read one at a time */
+	if (batchio > 1) {
+		rtp->rx_batch = rtp_batch_alloc(batchio);
+	}
+#endif
+
+	rtp_io_add(instance, rtp);
+
 	return 0;
 }
 
@@ -3699,6 +4672,7 @@ static int ast_rtp_new(struct ast_rtp_instance *instance,
 static int ast_rtp_destroy(struct ast_rtp_instance *instance)
 {
 	struct ast_rtp *rtp = ast_rtp_instance_get_data(instance);
+	int i;
 
 	if (rtp->bundled) {
 		struct ast_rtp *bundled_rtp;
@@ -3752,8 +4726,14 @@ static int ast_rtp_destroy(struct ast_rtp_instance *instance)
 		ast_data_buffer_free(rtp->recv_buffer);
 	}
 
+	ast_free(rtp->rx_batch);
+	ast_free(rtp->tx_batch);
+
 	ao2_cleanup(rtp->lasttxformat);
 	ao2_cleanup(rtp->lastrxformat);
+	for (i = 0; i < RTP_TX_PAYLOAD_CACHE_SIZE; i++) {
+		ao2_cleanup(rtp->tx_payload_cache[i].format);
+	}
 	ao2_cleanup(rtp->f.subclass.format);
 	AST_VECTOR_FREE(&rtp->ssrc_mapping);
 	AST_VECTOR_FREE(&rtp->missing_seqno);
@@ -3947,6 +4927,7 @@ static int ast_rtp_dtmf_end_with_duration(struct ast_rtp_instance *instance, cha
 	rtpheader[3] |= htonl((1 << 23));
 
 	/* Send it 3 times, that's the magical number */
+	rtp_send_batch_begin(rtp);
 	for (i = 0; i < 3; i++) {
 		int ice;
 
@@ -3969,6 +4950,11 @@ static int ast_rtp_dtmf_end_with_duration(struct ast_rtp_instance *instance, cha
 
 		rtp->seqno++;
 	}
+	if (rtp_send_batch_end(rtp) < 0) {
+		ast_log(LOG_ERROR, "RTP Transmission error to %s: %s\n",
+			ast_sockaddr_stringify(&remote_address),
+			strerror(errno));
+	}
 	res = 0;
 
 	/* Oh and we can't forget to turn off the stuff that says we are sending DTMF */
@@ -4079,7 +5065,6 @@ static void calculate_lost_packet_statistics(struct ast_rtp *rtp,
 	unsigned int expected_packets;
 	unsigned int expected_interval;
 	unsigned int received_interval;
-	double rxlost_current;
 	int lost_interval;
 
 	/* Compute statistics */
@@ -4115,15 +5100,8 @@ static void calculate_lost_packet_statistics(struct ast_rtp *rtp,
 	if (lost_interval > rtp->rtcp->maxrxlost) {
 		rtp->rtcp->maxrxlost = rtp->rtcp->rxlost;
 	}
-	rxlost_current = normdev_compute(rtp->rtcp->normdev_rxlost,
-			rtp->rtcp->rxlost,
-			rtp->rtcp->rxlost_count);
-	rtp->rtcp->stdev_rxlost = stddev_compute(rtp->rtcp->stdev_rxlost,
-			rtp->rtcp->rxlost,
-			rtp->rtcp->normdev_rxlost,
-			rxlost_current,
-			rtp->rtcp->rxlost_count);
-	rtp->rtcp->normdev_rxlost = rxlost_current;
+	calc_mean_and_variance(rtp->rtcp->rxlost, &rtp->rtcp->normdev_rxlost,
+			&rtp->rtcp->stdev_rxlost, rtp->rtcp->rxlost_count);
 	rtp->rtcp->rxlost_count++;
 }
 
@@ -4170,12 +5148,7 @@ static int ast_rtcp_generate_report(struct ast_rtp_instance *instance, unsigned
 	}
 
 	if (rtp->themssrc_valid) {
-		report_block = ast_calloc(1, sizeof(*report_block));
-		if (!report_block) {
-			return 1;
-		}
-
-		rtcp_report->report_block[0] = report_block;
+		report_block = rtcp_report->report_block[0];
 		report_block->source_ssrc = rtp->themssrc;
 		report_block->lost_count.fraction = (fraction_lost & 0xff);
 		report_block->lost_count.packets = (lost_packets & 0xffffff);
@@ -4409,7 +5382,7 @@ static int ast_rtcp_write(const void *data)
 	unsigned char *rtcpheader;
 	unsigned char bdata[AST_UUID_STR_LEN + 128] = ""; /* More than enough */
 	RAII_VAR(struct ast_rtp_rtcp_report *, rtcp_report,
-			ast_rtp_rtcp_report_alloc(rtp->themssrc_valid ? 1 : 0),
+			ast_rtp_rtcp_report_alloc_inline(1),
 			ao2_cleanup);
 
 	if (!rtp || !rtp->rtcp || rtp->rtcp->schedid == -1) {
@@ -4464,9 +5437,11 @@ cleanup:
 		 */
 		rtp->rtcp->schedid = -1;
 		ao2_ref(instance, -1);
+		return 0;
 	}
 
-	return res;
+	/* Each report picks a new random interval, keeping the sessions spread out */
+	return ast_rtcp_calc_interval(rtp);
 }
 
 static void put_unaligned_time24(void *p, uint32_t time_msw, uint32_t time_lsw)
@@ -4667,10 +5642,11 @@ static int rtp_raw_write(struct ast_rtp_instance *instance, struct ast_frame *fr
 				ast_set_flag(rtp, FLAG_NAT_INACTIVE_NOWARN);
 			}
 		} else {
+			ast_media_trace_stage(frame, AST_MEDIA_TRACE_SEND, NULL);
 			if (rtp->rtcp && rtp->rtcp->schedid < 0) {
 				ast_debug(1, "Starting RTCP transmission on RTP instance '%p'\n", instance);
 				ao2_ref(instance, +1);
-				rtp->rtcp->schedid = ast_sched_add(rtp->sched, ast_rtcp_calc_interval(rtp), ast_rtcp_write, instance);
+				rtp->rtcp->schedid = ast_sched_add_variable(rtp->sched, ast_rtcp_calc_interval(rtp), ast_rtcp_write, instance, 1);
 				if (rtp->rtcp->schedid < 0) {
 					ao2_ref(instance, -1);
 					ast_log(LOG_WARNING, "scheduling RTCP transmission failed.\n");
@@ -4703,12 +5679,12 @@ static struct ast_frame *red_t140_to_red(struct rtp_red *red)
 	int len = 0;
 	int i;
 
-	/* replace most aged generation */
+	/* replace most aged generation, the buffered primary data moves along with the rest */
 	if (red->len[0]) {
 		for (i = 1; i < red->num_gen+1; i++)
 			len += red->len[i];
 
-		memmove(&data[red->hdrlen], &data[red->hdrlen+red->len[0]], len);
+		memmove(&data[red->hdrlen], &data[red->hdrlen+red->len[0]], len + red->t140.datalen);
 	}
 
 	/* Store length of each generation and primary data length*/
@@ -4722,10 +5698,12 @@ static struct ast_frame *red_t140_to_red(struct rtp_red *red)
 		len += data[i*4+3] = red->len[i];
 	}
 
-	/* add primary data to buffer */
-	memcpy(&data[len], red->t140.data.ptr, red->t140.datalen);
+	/* primary data is already in place after the generations */
 	red->t140red.datalen = len + red->t140.datalen;
 
+	/* new primary data goes after this packet */
+	red->t140.data.ptr = &data[red->t140red.datalen];
+
 	/* no primary data and no generations to send */
 	if (len == red->hdrlen && !red->t140.datalen) {
 		return NULL;
@@ -4825,6 +5803,39 @@ static void rtp_write_rtcp_psfb(struct ast_rtp_instance *instance, struct ast_rt
 	}
 }
 
+/*!
+ * \internal
+ * \brief Find the payload to send a format with
+ *
+ * The payload found for a format is cached on the RTP instance until the
+ * payload mappings it came from change, so sending a stream of frames does
+ * not need to search the codecs for every frame.
+ *
+ * \pre instance is locked
+ *
+ * \return the payload, or -1 if the format can not be sent
+ */
+static int rtp_tx_payload_lookup(struct ast_rtp_instance *instance, struct ast_rtp *rtp, struct ast_format *format)
+{
+	struct ast_rtp_codecs *codecs = ast_rtp_instance_get_codecs(instance);
+	struct rtp_tx_payload_cache *entry;
+	unsigned int generation;
+
+	entry = &rtp->tx_payload_cache[((uintptr_t) format >> 4) % RTP_TX_PAYLOAD_CACHE_SIZE];
+
+	/* Read the generation first so a change made during the lookup is not hidden */
+	generation = ast_rtp_codecs_get_tx_generation(codecs);
+	if (entry->format == format && entry->generation == generation) {
+		return entry->payload;
+	}
+
+	entry->payload = ast_rtp_codecs_payload_code_tx(codecs, 1, format, 0);
+	entry->generation = generation;
+	ao2_replace(entry->format, format);
+
+	return entry->payload;
+}
+
 /*! \pre instance is locked */
 static int ast_rtp_write(struct ast_rtp_instance *instance, struct ast_frame *frame)
 {
@@ -4872,8 +5883,7 @@ static int ast_rtp_write(struct ast_rtp_instance *instance, struct ast_frame *fr
 	}
 
 	/* Grab the subclass and look up the payload we are going to use */
-	codec = ast_rtp_codecs_payload_code_tx(ast_rtp_instance_get_codecs(instance),
-		1, frame->subclass.format, 0);
+	codec = rtp_tx_payload_lookup(instance, rtp, frame->subclass.format);
 	if (codec < 0) {
 		ast_log(LOG_WARNING, "Don't know how to send format %s packets with RTP\n",
 			ast_format_get_name(frame->subclass.format));
@@ -4961,7 +5971,6 @@ static void calc_rxstamp(struct timeval *tv, struct ast_rtp *rtp, unsigned int t
 	double prog;
 	int rate = rtp_get_rate(rtp->f.subclass.format);
 
-	double normdev_rxjitter_current;
 	if ((!rtp->rxcore.tv_sec && !rtp->rxcore.tv_usec) || mark) {
 		gettimeofday(&rtp->rxcore, NULL);
 		rtp->drxcore = (double) rtp->rxcore.tv_sec + (double) rtp->rxcore.tv_usec / 1000000;
@@ -4996,10 +6005,8 @@ static void calc_rxstamp(struct timeval *tv, struct ast_rtp *rtp, unsigned int t
 		if (rtp->rtcp && rtp->rxjitter < rtp->rtcp->minrxjitter)
 			rtp->rtcp->minrxjitter = rtp->rxjitter;
 
-		normdev_rxjitter_current = normdev_compute(rtp->rtcp->normdev_rxjitter,rtp->rxjitter,rtp->rtcp->rxjitter_count);
-		rtp->rtcp->stdev_rxjitter = stddev_compute(rtp->rtcp->stdev_rxjitter,rtp->rxjitter,rtp->rtcp->normdev_rxjitter,normdev_rxjitter_current,rtp->rtcp->rxjitter_count);
-
-		rtp->rtcp->normdev_rxjitter = normdev_rxjitter_current;
+		calc_mean_and_variance(rtp->rxjitter, &rtp->rtcp->normdev_rxjitter,
+			&rtp->rtcp->stdev_rxjitter, rtp->rtcp->rxjitter_count);
 		rtp->rtcp->rxjitter_count++;
 	}
 }
@@ -5307,7 +6314,6 @@ static int update_rtt_stats(struct ast_rtp *rtp, unsigned int lsr, unsigned int
 	unsigned int rtt_lsw;
 	unsigned int lsr_a;
 	unsigned int rtt;
-	double normdevrtt_current;
 
 	gettimeofday(&now, NULL);
 	timeval2ntp(now, &msw, &lsw);
@@ -5344,15 +6350,8 @@ static int update_rtt_stats(struct ast_rtp *rtp, unsigned int lsr, unsigned int
 		rtp->rtcp->maxrtt = rtp->rtcp->rtt;
 	}
 
-	normdevrtt_current = normdev_compute(rtp->rtcp->normdevrtt,
-			rtp->rtcp->rtt,
-			rtp->rtcp->rtt_count);
-	rtp->rtcp->stdevrtt = stddev_compute(rtp->rtcp->stdevrtt,
-			rtp->rtcp->rtt,
-			rtp->rtcp->normdevrtt,
-			normdevrtt_current,
-			rtp->rtcp->rtt_count);
-	rtp->rtcp->normdevrtt = normdevrtt_current;
+	calc_mean_and_variance(rtp->rtcp->rtt, &rtp->rtcp->normdevrtt,
+		&rtp->rtcp->stdevrtt, rtp->rtcp->rtt_count);
 	rtp->rtcp->rtt_count++;
 
 	return 0;
@@ -5365,7 +6364,6 @@ static int update_rtt_stats(struct ast_rtp *rtp, unsigned int lsr, unsigned int
 static void update_jitter_stats(struct ast_rtp *rtp, unsigned int ia_jitter)
 {
 	double reported_jitter;
-	double reported_normdev_jitter_current;
 
 	rtp->rtcp->reported_jitter = ia_jitter;
 	reported_jitter = (double) rtp->rtcp->reported_jitter;
@@ -5378,9 +6376,8 @@ static void update_jitter_stats(struct ast_rtp *rtp, unsigned int ia_jitter)
 	if (reported_jitter > rtp->rtcp->reported_maxjitter) {
 		rtp->rtcp->reported_maxjitter = reported_jitter;
 	}
-	reported_normdev_jitter_current = normdev_compute(rtp->rtcp->reported_normdev_jitter, reported_jitter, rtp->rtcp->reported_jitter_count);
-	rtp->rtcp->reported_stdev_jitter = stddev_compute(rtp->rtcp->reported_stdev_jitter, reported_jitter, rtp->rtcp->reported_normdev_jitter, reported_normdev_jitter_current, rtp->rtcp->reported_jitter_count);
-	rtp->rtcp->reported_normdev_jitter = reported_normdev_jitter_current;
+	calc_mean_and_variance(reported_jitter, &rtp->rtcp->reported_normdev_jitter,
+		&rtp->rtcp->reported_stdev_jitter, rtp->rtcp->reported_jitter_count);
 }
 
 /*!
@@ -5390,7 +6387,6 @@ static void update_jitter_stats(struct ast_rtp *rtp, unsigned int ia_jitter)
 static void update_lost_stats(struct ast_rtp *rtp, unsigned int lost_packets)
 {
 	double reported_lost;
-	double reported_normdev_lost_current;
 
 	rtp->rtcp->reported_lost = lost_packets;
 	reported_lost = (double)rtp->rtcp->reported_lost;
@@ -5403,9 +6399,8 @@ static void update_lost_stats(struct ast_rtp *rtp, unsigned int lost_packets)
 	if (reported_lost > rtp->rtcp->reported_maxlost) {
 		rtp->rtcp->reported_maxlost = reported_lost;
 	}
-	reported_normdev_lost_current = normdev_compute(rtp->rtcp->reported_normdev_lost, reported_lost, rtp->rtcp->reported_jitter_count);
-	rtp->rtcp->reported_stdev_lost = stddev_compute(rtp->rtcp->reported_stdev_lost, reported_lost, rtp->rtcp->reported_normdev_lost, reported_normdev_lost_current, rtp->rtcp->reported_jitter_count);
-	rtp->rtcp->reported_normdev_lost = reported_normdev_lost_current;
+	calc_mean_and_variance(reported_lost, &rtp->rtcp->reported_normdev_lost,
+		&rtp->rtcp->reported_stdev_lost, rtp->rtcp->reported_jitter_count);
 }
 
 /*! \pre instance is locked */
@@ -5516,6 +6511,7 @@ static int ast_rtp_rtcp_handle_nack(struct ast_rtp_instance *instance, unsigned
 	 * We use index 3 because with feedback messages, the FCI (Feedback Control Information)
 	 * does not begin until after the version, packet SSRC, and media SSRC words.
 	 */
+	rtp_send_batch_begin(rtp);
 	for (packet_index = 3; packet_index < length; packet_index++) {
 		current_word = ntohl(nackdata[position + packet_index]);
 		pid = current_word >> 16;
@@ -5558,6 +6554,9 @@ static int ast_rtp_rtcp_handle_nack(struct ast_rtp_instance *instance, unsigned
 			blp_index++;
 		}
 	}
+	if (rtp_send_batch_end(rtp) < 0) {
+		res = -1;
+	}
 
 	return res;
 }
@@ -6383,7 +7382,7 @@ static struct ast_frame *ast_rtp_interpret(struct ast_rtp_instance *instance, st
 	if (rtp->rtcp && !ast_sockaddr_isnull(&rtp->rtcp->them) && rtp->rtcp->schedid < 0) {
 		/* Schedule transmission of Receiver Report */
 		ao2_ref(instance, +1);
-		rtp->rtcp->schedid = ast_sched_add(rtp->sched, ast_rtcp_calc_interval(rtp), ast_rtcp_write, instance);
+		rtp->rtcp->schedid = ast_sched_add_variable(rtp->sched, ast_rtcp_calc_interval(rtp), ast_rtcp_write, instance, 1);
 		if (rtp->rtcp->schedid < 0) {
 			ao2_ref(instance, -1);
 			ast_log(LOG_WARNING, "scheduling RTCP transmission failed.\n");
@@ -6586,12 +7585,13 @@ static struct ast_frame *ast_rtp_interpret(struct ast_rtp_instance *instance, st
 		return &ast_null_frame;
 	}
 
+	ast_media_trace_start(&rtp->f);
 	AST_LIST_INSERT_TAIL(&frames, &rtp->f, frame_list);
 	return AST_LIST_FIRST(&frames);
 }
 
 /*! \pre instance is locked */
-static struct ast_frame *ast_rtp_read(struct ast_rtp_instance *instance, int rtcp)
+static struct ast_frame *rtp_read_packet(struct ast_rtp_instance *instance, int rtcp)
 {
 	struct ast_rtp *rtp = ast_rtp_instance_get_data(instance);
 	struct ast_srtp *srtp;
@@ -7142,7 +8142,7 @@ static struct ast_frame *ast_rtp_read(struct ast_rtp_instance *instance, int rtc
 			size_t data_size = AST_UUID_STR_LEN + 128 + (seqno - rtp->expectedrxseqno) / 17;
 			RAII_VAR(unsigned char *, rtcpheader, NULL, ast_free_ptr);
 			RAII_VAR(struct ast_rtp_rtcp_report *, rtcp_report,
-					ast_rtp_rtcp_report_alloc(rtp->themssrc_valid ? 1 : 0),
+					ast_rtp_rtcp_report_alloc_inline(1),
 					ao2_cleanup);
 
 			rtcpheader = ast_malloc(sizeof(*rtcpheader) + data_size);
@@ -7188,6 +8188,58 @@ static struct ast_frame *ast_rtp_read(struct ast_rtp_instance *instance, int rtc
 	return &ast_null_frame;
 }
 
+/*!
+ * \brief Add the frames of a packet to those returned for the whole batch
+ *
+ * \param isolate Copy the frames since reading the next packet reuses the
+ * instance's buffers.
+ */
+static void rtp_batch_frames_append(struct frame_list *frames, struct ast_frame *frame, int isolate)
+{
+	struct ast_frame *next;
+
+	for (; frame; frame = next) {
+		next = AST_LIST_NEXT(frame, frame_list);
+		AST_LIST_NEXT(frame, frame_list) = NULL;
+		if (frame == &ast_null_frame) {
+			continue;
+		}
+		if (isolate && !(frame = ast_frisolate(frame))) {
+			continue;
+		}
+		AST_LIST_INSERT_TAIL(frames, frame, frame_list);
+	}
+}
+
+/*! \pre instance is locked */
+static struct ast_frame *ast_rtp_read(struct ast_rtp_instance *instance, int rtcp)
+{
+	struct ast_rtp *rtp = ast_rtp_instance_get_data(instance);
+	struct frame_list frames;
+	struct ast_frame *frame;
+
+	frame = rtp_read_packet(instance, rtcp);
+	if (rtcp || !frame || !rtp_recv_pending(rtp)) {
+		return frame;
+	}
+
+	/*
+	 * The socket may not poll readable again for the packets read along
+	 * with this one, so hand them all to the channel now.
+	 */
+	AST_LIST_HEAD_INIT_NOLOCK(&frames);
+	do {
+		rtp_batch_frames_append(&frames, frame, 1);
+		if (!(frame = rtp_read_packet(instance, 0))) {
+			/* Still deliver what was already read, only a batch of one fails the read */
+			return AST_LIST_FIRST(&frames) ?: &ast_null_frame;
+		}
+	} while (rtp_recv_pending(rtp));
+	rtp_batch_frames_append(&frames, frame, 0);
+
+	return AST_LIST_FIRST(&frames) ?: &ast_null_frame;
+}
+
 /*! \pre instance is locked */
 static void ast_rtp_prop_set(struct ast_rtp_instance *instance, enum ast_rtp_property property, int value)
 {
@@ -7348,6 +8400,11 @@ static int ast_rtp_fd(struct ast_rtp_instance *instance, int rtcp)
 {
 	struct ast_rtp *rtp = ast_rtp_instance_get_data(instance);
 
+	/* Keep the channel thread from waking up for packets an RTP I/O thread reads */
+	if (rtp->io_entry) {
+		return -1;
+	}
+
 	return rtcp ? (rtp->rtcp ? rtp->rtcp->s : -1) : rtp->s;
 }
 
@@ -7441,7 +8498,6 @@ static int rtp_red_init(struct ast_rtp_instance *instance, int buffer_time, int
 
 	rtp->red->t140.frametype = AST_FRAME_TEXT;
 	rtp->red->t140.subclass.format = ast_format_t140_red;
-	rtp->red->t140.data.ptr = &rtp->red->buf_data;
 
 	rtp->red->t140red = rtp->red->t140;
 	rtp->red->t140red.data.ptr = &rtp->red->t140red_data;
@@ -7449,6 +8505,7 @@ static int rtp_red_init(struct ast_rtp_instance *instance, int buffer_time, int
 	rtp->red->ti = buffer_time;
 	rtp->red->num_gen = generations;
 	rtp->red->hdrlen = generations * 4 + 1;
+	rtp->red->t140.data.ptr = &rtp->red->t140red_data[rtp->red->hdrlen];
 
 	for (x = 0; x < generations; x++) {
 		rtp->red->pt[x] = payloads[x];
@@ -7473,7 +8530,7 @@ static int rtp_red_buffer(struct ast_rtp_instance *instance, struct ast_frame *f
 
 	if (frame->datalen > 0) {
 		if (red->t140.datalen > 0) {
-			const unsigned char *primary = red->buf_data;
+			const unsigned char *primary = red->t140.data.ptr;
 
 			/* There is something already in the T.140 buffer */
 			if (primary[0] == 0x08 || primary[0] == 0x0a || primary[0] == 0x0d) {
@@ -7488,7 +8545,18 @@ static int rtp_red_buffer(struct ast_rtp_instance *instance, struct ast_frame *f
 			}
 		}
 
-		memcpy(&red->buf_data[red->t140.datalen], frame->data.ptr, frame->datalen);
+		/* Each generation length has to fit in its RED header byte */
+		if (red->t140.datalen > 0 && red->t140.datalen + frame->datalen > UCHAR_MAX) {
+			ast_rtp_write(instance, &rtp->red->t140);
+		}
+
+		if ((unsigned char *) red->t140.data.ptr + red->t140.datalen + frame->datalen
+			> red->t140red_data + sizeof(red->t140red_data)) {
+			ast_log(LOG_WARNING, "No room to buffer %d bytes of T.140 data\n", frame->datalen);
+			return 0;
+		}
+
+		memcpy((unsigned char *) red->t140.data.ptr + red->t140.datalen, frame->data.ptr, frame->datalen);
 		red->t140.datalen += frame->datalen;
 		red->t140.ts = frame->ts;
 	}
@@ -7525,6 +8593,10 @@ static int ast_rtp_get_stat(struct ast_rtp_instance *instance, struct ast_rtp_in
 	AST_RTP_STAT_SET(AST_RTP_INSTANCE_STAT_RXCOUNT, -1, stats->rxcount, rtp->rxcount);
 	AST_RTP_STAT_SET(AST_RTP_INSTANCE_STAT_TXOCTETCOUNT, -1, stats->txoctetcount, rtp->txoctetcount);
 	AST_RTP_STAT_SET(AST_RTP_INSTANCE_STAT_RXOCTETCOUNT, -1, stats->rxoctetcount, rtp->rxoctetcount);
+	AST_RTP_STAT_SET(AST_RTP_INSTANCE_STAT_TXPACKETSPERSYSCALL, -1, stats->txpacketspersyscall,
+		rtp->txsyscalls ? (double) rtp->txsyscallpackets / rtp->txsyscalls : 0.0);
+	AST_RTP_STAT_SET(AST_RTP_INSTANCE_STAT_RXPACKETSPERSYSCALL, -1, stats->rxpacketspersyscall,
+		rtp->rxsyscalls ? (double) rtp->rxsyscallpackets / rtp->rxsyscalls : 0.0);
 
 	AST_RTP_STAT_SET(AST_RTP_INSTANCE_STAT_TXPLOSS, AST_RTP_INSTANCE_STAT_COMBINED_LOSS, stats->txploss, rtp->rtcp->reported_lost);
 	AST_RTP_STAT_SET(AST_RTP_INSTANCE_STAT_RXPLOSS, AST_RTP_INSTANCE_STAT_COMBINED_LOSS, stats->rxploss, rtp->rtcp->expected_prior - rtp->rtcp->received_prior);
@@ -8088,6 +9160,8 @@ static int rtp_reload(int reload)
 	strictrtp = DEFAULT_STRICT_RTP;
 	learning_min_sequential = DEFAULT_LEARNING_MIN_SEQUENTIAL;
 	learning_min_duration = DEFAULT_LEARNING_MIN_DURATION;
+	batchio = DEFAULT_BATCHIO;
+	iothreads = DEFAULT_IOTHREADS;
 
 	/** This resource is not "reloaded" so much as unloaded and loaded again.
 	 * In the case of the TURN related variables, the memory referenced by a
@@ -8101,6 +9175,8 @@ static int rtp_reload(int reload)
 	icesupport = DEFAULT_ICESUPPORT;
 	turnport = DEFAULT_TURN_PORT;
 	memset(&stunaddr, 0, sizeof(stunaddr));
+	stun_cache_interval = DEFAULT_STUN_CACHE_INTERVAL;
+	stun_cache_clear();
 	turnaddr = pj_str(NULL);
 	turnusername = pj_str(NULL);
 	turnpassword = pj_str(NULL);
@@ -8165,6 +9241,29 @@ static int rtp_reload(int reload)
 		}
 		learning_min_duration = CALC_LEARNING_MIN_DURATION(learning_min_sequential);
 	}
+	if ((s = ast_variable_retrieve(cfg, "general", "batchio"))) {
+		if ((sscanf(s, "%30u", &batchio) != 1) || batchio > RTP_BATCH_MAX) {
+			ast_log(LOG_WARNING, "Value for 'batchio' could not be read or is above %d, using default of '%d' instead\n",
+				RTP_BATCH_MAX, DEFAULT_BATCHIO);
+			batchio = DEFAULT_BATCHIO;
+		}
+#ifndef HAVE_RTP_BATCH_IO
+		if (batchio > 1) {
+			ast_log(LOG_WARNING, "Batched RTP I/O is not supported on this operating system!\n");
+			batchio = DEFAULT_BATCHIO;
+		}
+#endif
+	}
+	if ((s = ast_variable_retrieve(cfg, "general", "iothreads"))) {
+		if ((sscanf(s, "%30u", &iothreads) != 1) || iothreads > RTP_IO_THREADS_MAX) {
+			ast_log(LOG_WARNING, "Value for 'iothreads' could not be read or is above %d, using default of '%d' instead\n",
+				RTP_IO_THREADS_MAX, DEFAULT_IOTHREADS);
+			iothreads = DEFAULT_IOTHREADS;
+		}
+		if (reload && iothreads != io_thread_count) {
+			ast_log(LOG_WARNING, "Changing 'iothreads' requires a restart to take effect\n");
+		}
+	}
 #ifdef HAVE_PJPROJECT
 	if ((s = ast_variable_retrieve(cfg, "general", "icesupport"))) {
 		icesupport = ast_true(s);
@@ -8175,6 +9274,12 @@ static int rtp_reload(int reload)
 			ast_log(LOG_WARNING, "Invalid STUN server address: %s\n", s);
 		}
 	}
+	if ((s = ast_variable_retrieve(cfg, "general", "stun_cache_interval"))) {
+		if (sscanf(s, "%30u", &stun_cache_interval) != 1) {
+			ast_log(LOG_WARNING, "Invalid stun_cache_interval value '%s', disabling the STUN cache\n", s);
+			stun_cache_interval = DEFAULT_STUN_CACHE_INTERVAL;
+		}
+	}
 	if ((s = ast_variable_retrieve(cfg, "general", "turnaddr"))) {
 		struct sockaddr_in addr;
 		addr.sin_port = htons(DEFAULT_TURN_PORT);
@@ -8307,7 +9412,21 @@ static int load_module(void)
 
 #endif
 
+#if defined(HAVE_OPENSSL) && (OPENSSL_VERSION_NUMBER >= 0x10001000L) && !defined(OPENSSL_NO_SRTP)
+	dtls_certs = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0, DTLS_CERT_BUCKETS,
+		dtls_cert_hash_fn, NULL, dtls_cert_cmp_fn);
+	if (!dtls_certs) {
+#ifdef HAVE_PJPROJECT
+		rtp_terminate_pjproject();
+#endif
+		return AST_MODULE_LOAD_DECLINE;
+	}
+#endif
+
 	if (ast_rtp_engine_register(&asterisk_rtp_engine)) {
+#if defined(HAVE_OPENSSL) && (OPENSSL_VERSION_NUMBER >= 0x10001000L) && !defined(OPENSSL_NO_SRTP)
+		ao2_ref(dtls_certs, -1);
+#endif
 #ifdef HAVE_PJPROJECT
 		rtp_terminate_pjproject();
 #endif
@@ -8315,8 +9434,11 @@ static int load_module(void)
 	}
 
 	if (ast_cli_register_multiple(cli_rtp, ARRAY_LEN(cli_rtp))) {
-#ifdef HAVE_PJPROJECT
 		ast_rtp_engine_unregister(&asterisk_rtp_engine);
+#if defined(HAVE_OPENSSL) && (OPENSSL_VERSION_NUMBER >= 0x10001000L) && !defined(OPENSSL_NO_SRTP)
+		ao2_ref(dtls_certs, -1);
+#endif
+#ifdef HAVE_PJPROJECT
 		rtp_terminate_pjproject();
 #endif
 		return AST_MODULE_LOAD_DECLINE;
@@ -8324,6 +9446,9 @@ static int load_module(void)
 
 	rtp_reload(0);
 
+	/* The threads only start here, new instances see them right away */
+	rtp_io_threads_create(iothreads);
+
 	return AST_MODULE_LOAD_SUCCESS;
 }
 
@@ -8332,6 +9457,13 @@ static int unload_module(void)
 	ast_rtp_engine_unregister(&asterisk_rtp_engine);
 	ast_cli_unregister_multiple(cli_rtp, ARRAY_LEN(cli_rtp));
 
+	rtp_io_threads_destroy();
+
+#if defined(HAVE_OPENSSL) && (OPENSSL_VERSION_NUMBER >= 0x10001000L) && !defined(OPENSSL_NO_SRTP)
+	ao2_cleanup(dtls_certs);
+	dtls_certs = NULL;
+#endif
+
 #ifdef HAVE_PJPROJECT
 	host_candidate_overrides_clear();
 	pj_thread_register_check();
@@ -38,6 +38,7 @@
 #include "asterisk/config.h"
 #include "asterisk/uuid.h"
 #include "asterisk/hashtab.h"
+#include "asterisk/utils.h"
 
 /*! \brief Structure for storing configuration file sourced objects */
 struct sorcery_config {
@@ -62,10 +63,27 @@ struct sorcery_config {
 	/*! \brief Enable enforcement of a single configuration object of this type */
 	unsigned int single_object:1;
 
+	/*! \brief Keep existing objects whose configuration did not change on reload */
+	unsigned int reuse_unchanged:1;
+
+	/*! \brief Signatures of the configuration each current object was built from */
+	struct ao2_container *signatures;
+
 	/*! \brief Filename of the configuration file */
 	char filename[];
 };
 
+/*! \brief Signature of the configuration an object was built from */
+struct sorcery_config_signature {
+	/*! \brief MD5 of the object's configuration variables */
+	char md5[33];
+	/*! \brief Object identifier */
+	char id[0];
+};
+
+AO2_STRING_FIELD_HASH_FN(sorcery_config_signature, id);
+AO2_STRING_FIELD_CMP_FN(sorcery_config_signature, id);
+
 /*! \brief Structure used for fields comparison */
 struct sorcery_config_fields_cmp_params {
 	/*! \brief Pointer to the sorcery structure */
@@ -120,6 +138,7 @@ static void sorcery_config_destructor(void *obj)
 	ast_rwlock_destroy(&config->objects.lock);
 	ast_variables_destroy(config->criteria);
 	ast_free(config->explicit_name);
+	ao2_cleanup(config->signatures);
 }
 
 static int sorcery_config_fields_cmp(void *obj, void *arg, int flags)
@@ -306,6 +325,58 @@ static int sorcery_is_configuration_met(const struct ast_sorcery *sorcery, const
 	}
 }
 
+/*! \brief Internal function which computes the signature of a category's variables */
+static void sorcery_config_signature_calc(struct ast_category *category, struct ast_str **buf, char *md5)
+{
+	struct ast_variable *field;
+
+	ast_str_reset(*buf);
+	for (field = ast_category_first(category); field; field = field->next) {
+		ast_str_append(buf, 0, "%s=%s\n", field->name, field->value);
+	}
+	ast_md5_hash(md5, ast_str_buffer(*buf));
+}
+
+/*! \brief Internal function which records the signature an object was built from */
+static void sorcery_config_signature_add(struct ao2_container *signatures, const char *id, const char *md5)
+{
+	struct sorcery_config_signature *signature;
+
+	signature = ao2_alloc_options(sizeof(*signature) + strlen(id) + 1, NULL, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!signature) {
+		return;
+	}
+	ast_copy_string(signature->md5, md5, sizeof(signature->md5));
+	strcpy(signature->id, id); /* Safe */
+	ao2_link(signatures, signature);
+	ao2_ref(signature, -1);
+}
+
+/*!
+ * \brief Internal function which finds the existing object if its configuration is unchanged
+ *
+ * \retval NULL if the object is new or its configuration changed
+ * \retval non-NULL existing object with a reference
+ */
+static void *sorcery_config_unchanged_object(struct sorcery_config *config, struct ao2_container *old_objects,
+	const char *id, const char *md5)
+{
+	struct sorcery_config_signature *signature;
+	void *obj = NULL;
+
+	if (!config->signatures || !old_objects) {
+		return NULL;
+	}
+
+	signature = ao2_find(config->signatures, id, OBJ_SEARCH_KEY);
+	if (signature && !strcmp(signature->md5, md5)) {
+		obj = ao2_find(old_objects, id, OBJ_SEARCH_KEY);
+	}
+	ao2_cleanup(signature);
+
+	return obj;
+}
+
 static void sorcery_config_internal_load(void *data, const struct ast_sorcery *sorcery, const char *type, unsigned int reload)
 {
 	struct sorcery_config *config = data;
@@ -313,8 +384,13 @@ static void sorcery_config_internal_load(void *data, const struct ast_sorcery *s
 	struct ast_config *cfg = ast_config_load2(config->filename, config->uuid, flags);
 	struct ast_category *category = NULL;
 	RAII_VAR(struct ao2_container *, objects, NULL, ao2_cleanup);
+	RAII_VAR(struct ao2_container *, old_objects, NULL, ao2_cleanup);
+	RAII_VAR(struct ao2_container *, signatures, NULL, ao2_cleanup);
+	RAII_VAR(struct ast_str *, buf, NULL, ast_free);
+	char md5[33];
 	const char *id = NULL;
 	unsigned int buckets = 0;
+	unsigned int reused = 0;
 
 	if (!cfg) {
 		ast_log(LOG_ERROR, "Unable to load config file '%s'\n", config->filename);
@@ -375,6 +451,19 @@ static void sorcery_config_internal_load(void *data, const struct ast_sorcery *s
 		return;
 	}
 
+	if (config->reuse_unchanged) {
+		signatures = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_NOLOCK, 0, buckets,
+			sorcery_config_signature_hash_fn, NULL, sorcery_config_signature_cmp_fn);
+		buf = ast_str_create(512);
+		if (!signatures || !buf) {
+			ast_log(LOG_ERROR, "Could not track configuration changes for objects from '%s', keeping existing objects\n",
+				config->filename);
+			ast_config_destroy(cfg);
+			return;
+		}
+		old_objects = ao2_global_obj_ref(config->objects);
+	}
+
 	while ((category = ast_category_browse_filtered(cfg, NULL, category, NULL))) {
 		RAII_VAR(void *, obj, NULL, ao2_cleanup);
 		id = ast_category_get_name(category);
@@ -395,6 +484,19 @@ static void sorcery_config_internal_load(void *data, const struct ast_sorcery *s
 			return;
 		}
 
+		if (signatures) {
+			sorcery_config_signature_calc(category, &buf, md5);
+
+			/* Keep the existing object, and skip applying it again, if nothing changed */
+			obj = sorcery_config_unchanged_object(config, old_objects, id, md5);
+			if (obj) {
+				sorcery_config_signature_add(signatures, id, md5);
+				ao2_link(objects, obj);
+				reused++;
+				continue;
+			}
+		}
+
 		if (!(obj = ast_sorcery_alloc(sorcery, type, id)) ||
 		    ast_sorcery_objectset_apply(sorcery, obj, ast_category_first(category))) {
 
@@ -416,11 +518,24 @@ static void sorcery_config_internal_load(void *data, const struct ast_sorcery *s
 			}
 
 			ast_log(LOG_NOTICE, "Retaining existing configuration for object of type '%s' with id '%s'\n", type, id);
+
+			/* The retained object no longer matches the configuration */
+			if (signatures) {
+				sorcery_config_signature_add(signatures, id, "");
+			}
+		} else if (signatures) {
+			sorcery_config_signature_add(signatures, id, md5);
 		}
 
 		ao2_link(objects, obj);
 	}
 
+	if (signatures) {
+		ast_debug(1, "Kept %u unchanged objects of type '%s' from '%s'\n",
+			reused, type, config->filename);
+		ao2_replace(config->signatures, signatures);
+	}
+
 	ao2_global_obj_replace_unref(config->objects, objects);
 	ast_config_destroy(cfg);
 }
@@ -499,6 +614,8 @@ static void *sorcery_config_open(const char *data)
 				ao2_ref(config, -1);
 				return NULL;
 			}
+		} else if (!strcasecmp(name, "reuse_unchanged")) {
+			config->reuse_unchanged = ast_true(value);
 		} else if (!strcasecmp(name, "single_object")) {
 			if (ast_strlen_zero(value)) {
 				ast_log(LOG_ERROR, "Could not set single object value for configuration file '%s' as the value is empty\n",
@@ -31,6 +31,7 @@
 #include "asterisk.h"
 
 #include <regex.h>
+#include <math.h>
 
 #include "asterisk/module.h"
 #include "asterisk/sorcery.h"
@@ -39,6 +40,40 @@
 /*! \brief Number of buckets for sorcery objects */
 #define OBJECT_BUCKETS 53
 
+/*! \brief Number of buckets for the field indexes of a wizard */
+#define INDEX_BUCKETS 7
+
+/*! \brief Number of buckets for the distinct values of an indexed field */
+#define VALUE_BUCKETS 53
+
+/*! \brief Objects held by one instance of the memory wizard */
+struct sorcery_memory {
+	/*! \brief The objects, keyed by id */
+	struct ao2_container *objects;
+	/*!
+	 * \brief Equality indexes, one per field that has been looked up by value
+	 *
+	 * \note Only accessed with the objects container locked.
+	 */
+	struct ao2_container *indexes;
+};
+
+/*! \brief Index of the objects by the value of one field */
+struct sorcery_memory_index {
+	/*! \brief Distinct values of the field, each a struct sorcery_memory_value */
+	struct ao2_container *values;
+	/*! \brief Name of the field */
+	char name[0];
+};
+
+/*! \brief Objects sharing a value of an indexed field */
+struct sorcery_memory_value {
+	/*! \brief The objects, keyed by id */
+	struct ao2_container *objects;
+	/*! \brief Normalized value, see sorcery_memory_index_key */
+	char key[0];
+};
+
 static void *sorcery_memory_open(const char *data);
 static int sorcery_memory_create(const struct ast_sorcery *sorcery, void *data, void *object);
 static void *sorcery_memory_retrieve_id(const struct ast_sorcery *sorcery, void *data, const char *type, const char *id);
@@ -102,22 +137,278 @@ static int sorcery_memory_cmp(void *obj, void *arg, int flags)
 	return !strcmp(ast_sorcery_object_get_id(obj), flags & OBJ_KEY ? id : ast_sorcery_object_get_id(arg)) ? CMP_MATCH | CMP_STOP : 0;
 }
 
+static void sorcery_memory_index_destructor(void *obj)
+{
+	struct sorcery_memory_index *index = obj;
+
+	ao2_cleanup(index->values);
+}
+
+static void sorcery_memory_value_destructor(void *obj)
+{
+	struct sorcery_memory_value *value = obj;
+
+	ao2_cleanup(value->objects);
+}
+
+AO2_STRING_FIELD_HASH_FN(sorcery_memory_index, name);
+AO2_STRING_FIELD_CMP_FN(sorcery_memory_index, name);
+AO2_STRING_FIELD_HASH_FN(sorcery_memory_value, key);
+AO2_STRING_FIELD_CMP_FN(sorcery_memory_value, key);
+
+/*!
+ * \brief Normalize a field value for an equality index
+ *
+ * Field lookups compare values with ast_strings_match(), which treats two
+ * values that both parse as numbers as equal when the numbers are equal.
+ * Numbers are therefore keyed by their canonical form and everything else
+ * by its text.
+ *
+ * \param value The field value
+ * \param query Non-zero if the value is being looked up rather than indexed
+ * \param key Buffer to receive the key
+ *
+ * \retval 0 success
+ * \retval -1 the value can not be looked up through an index
+ */
+static int sorcery_memory_index_key(const char *value, int query, struct ast_str **key)
+{
+	size_t len = strlen(value);
+	double num;
+
+	if (query && len >= 2 && value[0] == '/' && value[len - 1] == '/') {
+		/* A regular expression */
+		return -1;
+	}
+
+	if (sscanf(value, "%lf", &num) > 0) {
+		if (!isnan(num)) {
+			ast_str_set(key, 0, "#%.17g", num);
+			return 0;
+		} else if (query) {
+			/* NaN never compares equal to anything */
+			return -1;
+		}
+	}
+
+	ast_str_set(key, 0, "$%s", value);
+	return 0;
+}
+
+/*! \brief Add an object to, or remove it from, a field index */
+static void sorcery_memory_index_update(struct sorcery_memory_index *index, void *object,
+	const struct ast_variable *objset, int add)
+{
+	const struct ast_variable *field;
+	struct sorcery_memory_value *value;
+	RAII_VAR(struct ast_str *, key, NULL, ast_free);
+
+	/* Lookups only consider the first occurrence of a field */
+	field = ast_variable_find_variable_in_list(objset, index->name);
+	if (!field || !(key = ast_str_create(64)) || sorcery_memory_index_key(field->value, 0, &key)) {
+		return;
+	}
+
+	value = ao2_find(index->values, ast_str_buffer(key), OBJ_SEARCH_KEY);
+	if (!add) {
+		if (value) {
+			ao2_find(value->objects, ast_sorcery_object_get_id(object), OBJ_KEY | OBJ_UNLINK | OBJ_NODATA);
+			if (!ao2_container_count(value->objects)) {
+				ao2_unlink(index->values, value);
+			}
+			ao2_ref(value, -1);
+		}
+		return;
+	}
+
+	if (!value) {
+		value = ao2_alloc_options(sizeof(*value) + ast_str_strlen(key) + 1,
+			sorcery_memory_value_destructor, AO2_ALLOC_OPT_LOCK_NOLOCK);
+		if (!value) {
+			return;
+		}
+		strcpy(value->key, ast_str_buffer(key)); /* Safe */
+		value->objects = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_NOLOCK, 0, 1,
+			sorcery_memory_hash, NULL, sorcery_memory_cmp);
+		if (!value->objects || !ao2_link(index->values, value)) {
+			ao2_ref(value, -1);
+			return;
+		}
+	}
+	ao2_link(value->objects, object);
+	ao2_ref(value, -1);
+}
+
+/*!
+ * \brief Add an object to, or remove it from, every field index
+ *
+ * \pre The objects container is locked
+ */
+static void sorcery_memory_indexes_update(const struct ast_sorcery *sorcery,
+	struct sorcery_memory *memory, void *object, int add)
+{
+	struct ast_variable *objset;
+	struct ao2_iterator it;
+	struct sorcery_memory_index *index;
+
+	if (!ao2_container_count(memory->indexes)) {
+		return;
+	}
+
+	objset = ast_sorcery_objectset_create(sorcery, object);
+	it = ao2_iterator_init(memory->indexes, 0);
+	while ((index = ao2_iterator_next(&it))) {
+		sorcery_memory_index_update(index, object, objset, add);
+		ao2_ref(index, -1);
+	}
+	ao2_iterator_destroy(&it);
+	ast_variables_destroy(objset);
+}
+
+/*!
+ * \brief Get the index of a field, building it on first use
+ *
+ * \pre The objects container is locked
+ */
+static struct sorcery_memory_index *sorcery_memory_index_get(const struct ast_sorcery *sorcery,
+	struct sorcery_memory *memory, const char *name)
+{
+	struct sorcery_memory_index *index;
+	struct ao2_iterator it;
+	void *object;
+
+	index = ao2_find(memory->indexes, name, OBJ_SEARCH_KEY);
+	if (index) {
+		return index;
+	}
+
+	index = ao2_alloc_options(sizeof(*index) + strlen(name) + 1,
+		sorcery_memory_index_destructor, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!index) {
+		return NULL;
+	}
+	strcpy(index->name, name); /* Safe */
+	index->values = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_NOLOCK, 0, VALUE_BUCKETS,
+		sorcery_memory_value_hash_fn, NULL, sorcery_memory_value_cmp_fn);
+	if (!index->values) {
+		ao2_ref(index, -1);
+		return NULL;
+	}
+
+	it = ao2_iterator_init(memory->objects, AO2_ITERATOR_DONTLOCK);
+	while ((object = ao2_iterator_next(&it))) {
+		struct ast_variable *objset = ast_sorcery_objectset_create(sorcery, object);
+
+		sorcery_memory_index_update(index, object, objset, 1);
+		ast_variables_destroy(objset);
+		ao2_ref(object, -1);
+	}
+	ao2_iterator_destroy(&it);
+
+	if (!ao2_link(memory->indexes, index)) {
+		ao2_ref(index, -1);
+		return NULL;
+	}
+
+	return index;
+}
+
+/*!
+ * \brief Retrieve objects matching fields through a field index
+ *
+ * \param sorcery The sorcery instance
+ * \param memory The wizard data
+ * \param fields The fields to match
+ * \param container Container to put the matches in, or NULL to return the first match
+ * \param single Receives the first match when container is NULL
+ *
+ * \retval 0 the lookup was done through an index
+ * \retval -1 no field is suitable for an index, the caller has to scan
+ */
+static int sorcery_memory_retrieve_indexed(const struct ast_sorcery *sorcery, struct sorcery_memory *memory,
+	const struct ast_variable *fields, struct ao2_container *container, void **single)
+{
+	const struct ast_variable *field;
+	struct sorcery_memory_index *index;
+	struct sorcery_memory_value *value;
+	struct ao2_iterator it;
+	RAII_VAR(struct ast_str *, key, ast_str_create(64), ast_free);
+	void *object;
+
+	if (!key) {
+		return -1;
+	}
+
+	/* Use the first plain equality comparison */
+	for (field = fields; field; field = field->next) {
+		if (!strchr(field->name, ' ') && !sorcery_memory_index_key(field->value, 1, &key)) {
+			break;
+		}
+	}
+	if (!field) {
+		return -1;
+	}
+
+	ao2_lock(memory->objects);
+	index = sorcery_memory_index_get(sorcery, memory, field->name);
+	if (!index) {
+		ao2_unlock(memory->objects);
+		return -1;
+	}
+
+	value = ao2_find(index->values, ast_str_buffer(key), OBJ_SEARCH_KEY);
+	ao2_ref(index, -1);
+	if (!value) {
+		ao2_unlock(memory->objects);
+		return 0;
+	}
+
+	it = ao2_iterator_init(value->objects, 0);
+	while ((object = ao2_iterator_next(&it))) {
+		/* Anything besides the indexed field still has to be checked */
+		if (fields->next) {
+			struct ast_variable *objset = ast_sorcery_objectset_create(sorcery, object);
+			int match = objset && ast_variable_lists_match(objset, fields, 0);
+
+			ast_variables_destroy(objset);
+			if (!match) {
+				ao2_ref(object, -1);
+				continue;
+			}
+		}
+
+		if (!container) {
+			*single = object;
+			break;
+		}
+		ao2_link(container, object);
+		ao2_ref(object, -1);
+	}
+	ao2_iterator_destroy(&it);
+	ao2_ref(value, -1);
+	ao2_unlock(memory->objects);
+
+	return 0;
+}
+
 static int sorcery_memory_create(const struct ast_sorcery *sorcery, void *data, void *object)
 {
+	struct sorcery_memory *memory = data;
 	void *existing;
 
-	ao2_lock(data);
+	ao2_lock(memory->objects);
 
-	existing = ao2_find(data, ast_sorcery_object_get_id(object), OBJ_KEY | OBJ_NOLOCK);
+	existing = ao2_find(memory->objects, ast_sorcery_object_get_id(object), OBJ_KEY | OBJ_NOLOCK);
 	if (existing) {
 		ao2_ref(existing, -1);
-		ao2_unlock(data);
+		ao2_unlock(memory->objects);
 		return -1;
 	}
 
-	ao2_link_flags(data, object, OBJ_NOLOCK);
+	ao2_link_flags(memory->objects, object, OBJ_NOLOCK);
+	sorcery_memory_indexes_update(sorcery, memory, object, 1);
 
-	ao2_unlock(data);
+	ao2_unlock(memory->objects);
 
 	return 0;
 }
@@ -160,38 +451,52 @@ static int sorcery_memory_fields_cmp(void *obj, void *arg, int flags)
 
 static void *sorcery_memory_retrieve_fields(const struct ast_sorcery *sorcery, void *data, const char *type, const struct ast_variable *fields)
 {
+	struct sorcery_memory *memory = data;
 	struct sorcery_memory_fields_cmp_params params = {
 		.sorcery = sorcery,
 		.fields = fields,
 		.container = NULL,
 	};
+	void *object = NULL;
 
 	/* If no fields are present return nothing, we require *something* */
 	if (!fields) {
 		return NULL;
 	}
 
-	return ao2_callback(data, 0, sorcery_memory_fields_cmp, &params);
+	if (!sorcery_memory_retrieve_indexed(sorcery, memory, fields, NULL, &object)) {
+		return object;
+	}
+
+	return ao2_callback(memory->objects, 0, sorcery_memory_fields_cmp, &params);
 }
 
 static void *sorcery_memory_retrieve_id(const struct ast_sorcery *sorcery, void *data, const char *type, const char *id)
 {
-	return ao2_find(data, id, OBJ_KEY);
+	struct sorcery_memory *memory = data;
+
+	return ao2_find(memory->objects, id, OBJ_KEY);
 }
 
 static void sorcery_memory_retrieve_multiple(const struct ast_sorcery *sorcery, void *data, const char *type, struct ao2_container *objects, const struct ast_variable *fields)
 {
+	struct sorcery_memory *memory = data;
 	struct sorcery_memory_fields_cmp_params params = {
 		.sorcery = sorcery,
 		.fields = fields,
 		.container = objects,
 	};
 
-	ao2_callback(data, 0, sorcery_memory_fields_cmp, &params);
+	if (fields && !sorcery_memory_retrieve_indexed(sorcery, memory, fields, objects, NULL)) {
+		return;
+	}
+
+	ao2_callback(memory->objects, 0, sorcery_memory_fields_cmp, &params);
 }
 
 static void sorcery_memory_retrieve_regex(const struct ast_sorcery *sorcery, void *data, const char *type, struct ao2_container *objects, const char *regex)
 {
+	struct sorcery_memory *memory = data;
 	regex_t expression;
 	struct sorcery_memory_fields_cmp_params params = {
 		.sorcery = sorcery,
@@ -207,12 +512,13 @@ static void sorcery_memory_retrieve_regex(const struct ast_sorcery *sorcery, voi
 		return;
 	}
 
-	ao2_callback(data, 0, sorcery_memory_fields_cmp, &params);
+	ao2_callback(memory->objects, 0, sorcery_memory_fields_cmp, &params);
 	regfree(&expression);
 }
 
 static void sorcery_memory_retrieve_prefix(const struct ast_sorcery *sorcery, void *data, const char *type, struct ao2_container *objects, const char *prefix, const size_t prefix_len)
 {
+	struct sorcery_memory *memory = data;
 	struct sorcery_memory_fields_cmp_params params = {
 		.sorcery = sorcery,
 		.container = objects,
@@ -220,38 +526,75 @@ static void sorcery_memory_retrieve_prefix(const struct ast_sorcery *sorcery, vo
 		.prefix_len = prefix_len,
 	};
 
-	ao2_callback(data, 0, sorcery_memory_fields_cmp, &params);
+	ao2_callback(memory->objects, 0, sorcery_memory_fields_cmp, &params);
 }
 
 static int sorcery_memory_update(const struct ast_sorcery *sorcery, void *data, void *object)
 {
+	struct sorcery_memory *memory = data;
 	RAII_VAR(void *, existing, NULL, ao2_cleanup);
 
-	ao2_lock(data);
+	ao2_lock(memory->objects);
 
-	if (!(existing = ao2_find(data, ast_sorcery_object_get_id(object), OBJ_KEY | OBJ_UNLINK))) {
-		ao2_unlock(data);
+	if (!(existing = ao2_find(memory->objects, ast_sorcery_object_get_id(object), OBJ_KEY | OBJ_UNLINK))) {
+		ao2_unlock(memory->objects);
 		return -1;
 	}
+	sorcery_memory_indexes_update(sorcery, memory, existing, 0);
 
-	ao2_link(data, object);
+	ao2_link(memory->objects, object);
+	sorcery_memory_indexes_update(sorcery, memory, object, 1);
 
-	ao2_unlock(data);
+	ao2_unlock(memory->objects);
 
 	return 0;
 }
 
 static int sorcery_memory_delete(const struct ast_sorcery *sorcery, void *data, void *object)
 {
-	RAII_VAR(void *, existing, ao2_find(data, ast_sorcery_object_get_id(object), OBJ_KEY | OBJ_UNLINK), ao2_cleanup);
+	struct sorcery_memory *memory = data;
+	void *existing;
+
+	ao2_lock(memory->objects);
+
+	existing = ao2_find(memory->objects, ast_sorcery_object_get_id(object), OBJ_KEY | OBJ_UNLINK);
+	if (existing) {
+		sorcery_memory_indexes_update(sorcery, memory, existing, 0);
+		ao2_ref(existing, -1);
+	}
+
+	ao2_unlock(memory->objects);
 
 	return existing ? 0 : -1;
 }
 
+static void sorcery_memory_destructor(void *obj)
+{
+	struct sorcery_memory *memory = obj;
+
+	ao2_cleanup(memory->indexes);
+	ao2_cleanup(memory->objects);
+}
+
 static void *sorcery_memory_open(const char *data)
 {
-	return ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0, OBJECT_BUCKETS,
+	struct sorcery_memory *memory;
+
+	memory = ao2_alloc_options(sizeof(*memory), sorcery_memory_destructor, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!memory) {
+		return NULL;
+	}
+
+	memory->objects = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0, OBJECT_BUCKETS,
 		sorcery_memory_hash, NULL, sorcery_memory_cmp);
+	memory->indexes = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_NOLOCK, 0, INDEX_BUCKETS,
+		sorcery_memory_index_hash_fn, NULL, sorcery_memory_index_cmp_fn);
+	if (!memory->objects || !memory->indexes) {
+		ao2_ref(memory, -1);
+		return NULL;
+	}
+
+	return memory;
 }
 
 static void sorcery_memory_close(void *data)
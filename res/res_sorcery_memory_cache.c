@@ -137,6 +137,12 @@ struct sorcery_memory_cache {
 	unsigned int expire_on_reload;
 	/*! \brief Whether this is a cache of the entire backend, 0 if disabled */
 	unsigned int full_backend_cache;
+	/*! \brief The time (in seconds) an id no backend had is remembered as missing, 0 if disabled */
+	unsigned int negative_lifetime;
+	/*! \brief The maximum number of ids remembered as missing, 0 if no limit */
+	unsigned int negative_maximum;
+	/*! \brief Ids of objects no backend had when they were last retrieved */
+	struct ao2_container *negatives;
 	/*! \brief Heap of cached objects. Oldest object is at the top. */
 	struct ast_heap *object_heap;
 	/*! \brief Scheduler item for expiring oldest object. */
@@ -175,6 +181,17 @@ struct sorcery_memory_cached_object {
 	struct ast_variable *objectset;
 };
 
+/*! \brief Structure for an id known not to exist in the backend */
+struct sorcery_memory_cache_negative {
+	/*! \brief When the backend last reported the id missing */
+	struct timeval created;
+	/*! \brief The id of the missing object */
+	char id[0];
+};
+
+AO2_STRING_FIELD_HASH_FN(sorcery_memory_cache_negative, id);
+AO2_STRING_FIELD_CMP_FN(sorcery_memory_cache_negative, id);
+
 /*! \brief Structure used for fields comparison */
 struct sorcery_memory_cache_fields_cmp_params {
 	/*! \brief Pointer to the sorcery structure */
@@ -209,6 +226,10 @@ static void sorcery_memory_cache_retrieve_prefix(const struct ast_sorcery *sorce
 	struct ao2_container *objects, const char *prefix, const size_t prefix_len);
 static int sorcery_memory_cache_delete(const struct ast_sorcery *sorcery, void *data, void *object);
 static void sorcery_memory_cache_close(void *data);
+static int sorcery_memory_cache_is_missing(const struct ast_sorcery *sorcery, void *data, const char *type,
+	const char *id);
+static void sorcery_memory_cache_missing(const struct ast_sorcery *sorcery, void *data, const char *type,
+	const char *id);
 
 static struct ast_sorcery_wizard memory_cache_object_wizard = {
 	.name = "memory_cache",
@@ -224,6 +245,8 @@ static struct ast_sorcery_wizard memory_cache_object_wizard = {
 	.retrieve_regex = sorcery_memory_cache_retrieve_regex,
 	.retrieve_prefix = sorcery_memory_cache_retrieve_prefix,
 	.close = sorcery_memory_cache_close,
+	.is_missing = sorcery_memory_cache_is_missing,
+	.missing = sorcery_memory_cache_missing,
 };
 
 /*! \brief The bucket size for the container of caches */
@@ -426,6 +449,7 @@ static void sorcery_memory_cache_destructor(void *obj)
 		ast_heap_destroy(cache->object_heap);
 	}
 	ao2_cleanup(cache->objects);
+	ao2_cleanup(cache->negatives);
 	ast_free(cache->object_type);
 }
 
@@ -816,6 +840,10 @@ static int sorcery_memory_cache_create(const struct ast_sorcery *sorcery, void *
 	 * one here we remove any old objects using the object identifier.
 	 */
 
+	if (cache->negatives) {
+		ao2_find(cache->negatives, ast_sorcery_object_get_id(object), OBJ_SEARCH_KEY | OBJ_UNLINK | OBJ_NODATA);
+	}
+
 	ao2_wrlock(cache->objects);
 	remove_from_cache(cache, ast_sorcery_object_get_id(object), 1);
 	if (cache->maximum_objects && ao2_container_count(cache->objects) >= cache->maximum_objects) {
@@ -907,6 +935,11 @@ static int stale_cache_update(const void *data)
 {
 	struct stale_cache_update_task_data *task_data = (struct stale_cache_update_task_data *) data;
 	struct ao2_container *backend_objects;
+	AST_VECTOR(, struct sorcery_memory_cached_object *) refreshed;
+	struct sorcery_memory_cached_object *cached;
+	struct ao2_iterator it;
+	void *object;
+	int i;
 
 	start_passthru_update();
 	backend_objects = ast_sorcery_retrieve_by_fields(task_data->sorcery, task_data->type,
@@ -927,10 +960,34 @@ static int stale_cache_update(const void *data)
 		return 0;
 	}
 
+	/* Building a cached object creates its objectset, which is the expensive part of a refresh.
+	 * Do it before taking the write lock so lookups are only blocked while the new objects
+	 * are swapped in.
+	 */
+	if (AST_VECTOR_INIT(&refreshed, ao2_container_count(backend_objects))) {
+		task_data->cache->stale_update_sched_id = -1;
+		ao2_ref(backend_objects, -1);
+		ao2_ref(task_data, -1);
+		return 0;
+	}
+	it = ao2_iterator_init(backend_objects, 0);
+	while ((object = ao2_iterator_next(&it))) {
+		cached = sorcery_memory_cached_object_alloc(task_data->sorcery, task_data->cache, object);
+		ao2_ref(object, -1);
+		if (!cached || AST_VECTOR_APPEND(&refreshed, cached)) {
+			ao2_cleanup(cached);
+			break;
+		}
+	}
+	ao2_iterator_destroy(&it);
+
 	ao2_wrlock(task_data->cache->objects);
 	remove_all_from_cache(task_data->cache);
-	ao2_callback_data(backend_objects, OBJ_NOLOCK | OBJ_NODATA | OBJ_MULTIPLE, object_add_to_cache_callback,
-		task_data->sorcery, task_data->cache);
+	for (i = 0; i < AST_VECTOR_SIZE(&refreshed); i++) {
+		if (add_to_cache(task_data->cache, AST_VECTOR_GET(&refreshed, i))) {
+			break;
+		}
+	}
 
 	/* If the number of cached objects does not match the number of backend objects we encountered a memory allocation
 	 * failure and the cache is incomplete, so drop everything and fall back to querying the backend directly
@@ -943,6 +1000,8 @@ static int stale_cache_update(const void *data)
 	}
 
 	ao2_unlock(task_data->cache->objects);
+	AST_VECTOR_CALLBACK_VOID(&refreshed, ao2_ref, -1);
+	AST_VECTOR_FREE(&refreshed);
 	ao2_ref(backend_objects, -1);
 
 	task_data->cache->stale_update_sched_id = -1;
@@ -1240,6 +1299,96 @@ static void *sorcery_memory_cache_retrieve_id(const struct ast_sorcery *sorcery,
 	return object;
 }
 
+/*!
+ * \internal
+ * \brief Callback function to check whether an id is remembered as missing from the backend
+ *
+ * \param sorcery The sorcery instance
+ * \param data The sorcery memory cache
+ * \param type The type of the object
+ * \param id The id of the object
+ *
+ * \retval 1 the backend recently did not have the object
+ * \retval 0 otherwise
+ */
+static int sorcery_memory_cache_is_missing(const struct ast_sorcery *sorcery, void *data, const char *type,
+	const char *id)
+{
+	struct sorcery_memory_cache *cache = data;
+	struct sorcery_memory_cache_negative *negative;
+	int missing = 0;
+
+	if (!cache->negatives || is_passthru_update()) {
+		return 0;
+	}
+
+	negative = ao2_find(cache->negatives, id, OBJ_SEARCH_KEY);
+	if (!negative) {
+		return 0;
+	}
+
+	if (ast_tvdiff_ms(ast_tvnow(), negative->created) < cache->negative_lifetime * 1000LL) {
+		missing = 1;
+	} else {
+		ao2_unlink(cache->negatives, negative);
+	}
+	ao2_ref(negative, -1);
+
+	return missing;
+}
+
+/*!
+ * \internal
+ * \brief AO2 callback function for removing expired missing ids
+ */
+static int negative_expired_cb(void *obj, void *arg, int flags)
+{
+	struct sorcery_memory_cache_negative *negative = obj;
+	struct sorcery_memory_cache *cache = arg;
+
+	return ast_tvdiff_ms(ast_tvnow(), negative->created) >= cache->negative_lifetime * 1000LL ? CMP_MATCH : 0;
+}
+
+/*!
+ * \internal
+ * \brief Callback function to remember that no backend had an object
+ *
+ * \param sorcery The sorcery instance
+ * \param data The sorcery memory cache
+ * \param type The type of the object
+ * \param id The id of the object
+ */
+static void sorcery_memory_cache_missing(const struct ast_sorcery *sorcery, void *data, const char *type,
+	const char *id)
+{
+	struct sorcery_memory_cache *cache = data;
+	struct sorcery_memory_cache_negative *negative;
+
+	if (!cache->negatives) {
+		return;
+	}
+
+	ao2_lock(cache->negatives);
+	if (cache->negative_maximum && ao2_container_count(cache->negatives) >= cache->negative_maximum) {
+		ao2_callback(cache->negatives, OBJ_NOLOCK | OBJ_MULTIPLE | OBJ_UNLINK | OBJ_NODATA,
+			negative_expired_cb, cache);
+		if (ao2_container_count(cache->negatives) >= cache->negative_maximum) {
+			ao2_unlock(cache->negatives);
+			return;
+		}
+	}
+
+	negative = ao2_alloc_options(sizeof(*negative) + strlen(id) + 1, NULL, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (negative) {
+		negative->created = ast_tvnow();
+		strcpy(negative->id, id); /* Safe */
+		ao2_find(cache->negatives, id, OBJ_SEARCH_KEY | OBJ_UNLINK | OBJ_NODATA | OBJ_NOLOCK);
+		ao2_link_flags(cache->negatives, negative, OBJ_NOLOCK);
+		ao2_ref(negative, -1);
+	}
+	ao2_unlock(cache->negatives);
+}
+
 /*!
  * \internal
  * \brief AO2 callback function for comparing a retrieval request and finding applicable objects
@@ -1459,6 +1608,11 @@ static void sorcery_memory_cache_reload(void *data, const struct ast_sorcery *so
 {
 	struct sorcery_memory_cache *cache = data;
 
+	/* Objects may have been added to the backend by the reload */
+	if (cache->negatives) {
+		ao2_callback(cache->negatives, OBJ_MULTIPLE | OBJ_UNLINK | OBJ_NODATA, NULL, NULL);
+	}
+
 	if (!cache->expire_on_reload) {
 		return;
 	}
@@ -1550,6 +1704,18 @@ static void *sorcery_memory_cache_open(const char *data)
 			cache->expire_on_reload = ast_true(value);
 		} else if (!strcasecmp(name, "full_backend_cache")) {
 			cache->full_backend_cache = ast_true(value);
+		} else if (!strcasecmp(name, "negative_lifetime")) {
+			if (configuration_parse_unsigned_integer(value, &cache->negative_lifetime) != 1) {
+				ast_log(LOG_ERROR, "Unsupported negative lifetime value of '%s' used for memory cache\n",
+					value);
+				return NULL;
+			}
+		} else if (!strcasecmp(name, "negative_maximum")) {
+			if (configuration_parse_unsigned_integer(value, &cache->negative_maximum) != 1) {
+				ast_log(LOG_ERROR, "Unsupported negative maximum value of '%s' used for memory cache\n",
+					value);
+				return NULL;
+			}
 		} else {
 			ast_log(LOG_ERROR, "Unsupported option '%s' used for memory cache\n", name);
 			return NULL;
@@ -1564,6 +1730,16 @@ static void *sorcery_memory_cache_open(const char *data)
 		return NULL;
 	}
 
+	if (cache->negative_lifetime) {
+		cache->negatives = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0,
+			CACHE_CONTAINER_BUCKET_SIZE, sorcery_memory_cache_negative_hash_fn, NULL,
+			sorcery_memory_cache_negative_cmp_fn);
+		if (!cache->negatives) {
+			ast_log(LOG_ERROR, "Could not create a container to hold missing ids for memory cache\n");
+			return NULL;
+		}
+	}
+
 	cache->object_heap = ast_heap_create(CACHE_HEAP_INIT_HEIGHT, age_cmp,
 		offsetof(struct sorcery_memory_cached_object, __heap_index));
 	if (!cache->object_heap) {
@@ -1720,6 +1896,12 @@ static char *sorcery_memory_cache_show(struct ast_cli_entry *e, int cmd, struct
 		ast_cli(a->fd, "Object staleness is not enabled - cached objects will not go stale\n");
 	}
 	ast_cli(a->fd, "Expire all objects on reload: %s\n", AST_CLI_ONOFF(cache->expire_on_reload));
+	if (cache->negatives) {
+		ast_cli(a->fd, "Number of seconds missing objects are remembered: %d\n", cache->negative_lifetime);
+		ast_cli(a->fd, "Number of missing objects remembered: %d\n", ao2_container_count(cache->negatives));
+	} else {
+		ast_cli(a->fd, "Negative caching is not enabled - missing objects are not remembered\n");
+	}
 
 	ao2_ref(cache, -1);
 
@@ -37,10 +37,80 @@
 #include "asterisk/term.h"
 #include "asterisk/speech.h"
 #include "asterisk/format_cache.h"
+#include "asterisk/taskprocessor.h"
+#include "asterisk/threadpool.h"
+
+/*! Seconds to wait for queued asynchronous writes when a speech structure is destroyed */
+#define SPEECH_WRITE_SHUTDOWN_TIMEOUT 10
 
 static AST_RWLIST_HEAD_STATIC(engines, ast_speech_engine);
 static struct ast_speech_engine *default_engine = NULL;
 
+/*! \brief A chunk of audio queued for an asynchronous write */
+struct speech_write {
+	/*! Speech session the audio belongs to */
+	struct speech_session *session;
+	/*! Utterance the audio belongs to */
+	unsigned int epoch;
+	/*! When the chunk was handed off */
+	struct timeval queued;
+	/*! Number of bytes of audio in data */
+	size_t len;
+	unsigned char data[0];
+};
+
+/*! \brief Core private data kept alongside each speech structure */
+struct speech_session {
+	/*! The structure handed out to users, must be first */
+	struct ast_speech speech;
+	/*! Serializer asynchronous writes are executed on */
+	struct ast_taskprocessor *serializer;
+	/*! Used to wait for queued writes before destroying */
+	struct ast_serializer_shutdown_group *shutdown_group;
+	/*! Bumped on every start so audio queued for an old utterance is dropped */
+	unsigned int epoch;
+	/*! Audio collected in to the next chunk */
+	struct speech_write *pending;
+	AST_LIST_ENTRY(speech_session) list;
+};
+
+/*! \brief Idle sessions and statistics for a registered engine */
+struct speech_engine_pool {
+	struct ast_speech_engine *engine;
+	/*! Sessions waiting to be reused */
+	AST_LIST_HEAD_NOLOCK(, speech_session) idle;
+	unsigned int idle_count;
+	/*! Number of sessions the engine had to create */
+	unsigned int created;
+	/*! Number of sessions taken from the idle list */
+	unsigned int reused;
+	/*! Number of asynchronous writes passed to the engine */
+	unsigned int writes;
+	/*! Total and worst time from queueing a chunk until the engine took it, in microseconds */
+	uint64_t write_latency_total;
+	unsigned int write_latency_max;
+	AST_LIST_ENTRY(speech_engine_pool) list;
+};
+
+static AST_LIST_HEAD_STATIC(engine_pools, speech_engine_pool);
+
+/*! Threadpool asynchronous writes run on */
+static struct ast_threadpool *speech_threadpool;
+
+/*! \brief Find the pool of an engine, engine_pools must be locked */
+static struct speech_engine_pool *find_engine_pool(const struct ast_speech_engine *engine)
+{
+	struct speech_engine_pool *pool;
+
+	AST_LIST_TRAVERSE(&engine_pools, pool, list) {
+		if (pool->engine == engine) {
+			break;
+		}
+	}
+
+	return pool;
+}
+
 /*! \brief Find a speech recognition engine of specified name, if NULL then use the default one */
 static struct ast_speech_engine *find_engine(const char *engine_name)
 {
@@ -117,6 +187,17 @@ int ast_speech_results_free(struct ast_speech_result *result)
 	return res;
 }
 
+/*! \brief Drop audio collected or queued but not yet written to the engine */
+static void speech_discard_writes(struct speech_session *session)
+{
+	ast_mutex_lock(&session->speech.lock);
+	session->epoch++;
+	if (session->pending) {
+		session->pending->len = 0;
+	}
+	ast_mutex_unlock(&session->speech.lock);
+}
+
 /*! \brief Start speech recognition on a speech structure */
 void ast_speech_start(struct ast_speech *speech)
 {
@@ -132,6 +213,9 @@ void ast_speech_start(struct ast_speech *speech)
 		speech->results = NULL;
 	}
 
+	/* Anything still queued belongs to the previous utterance */
+	speech_discard_writes((struct speech_session *) speech);
+
 	/* If the engine needs to start stuff up, do it */
 	if (speech->engine->start)
 		speech->engine->start(speech);
@@ -139,13 +223,98 @@ void ast_speech_start(struct ast_speech *speech)
 	return;
 }
 
+/*! \brief Hand a queued chunk of audio to the engine */
+static int speech_write_task(void *data)
+{
+	struct speech_write *write = data;
+	struct ast_speech *speech = &write->session->speech;
+	struct speech_engine_pool *pool;
+	unsigned int latency;
+	int written = 0;
+
+	ast_mutex_lock(&speech->lock);
+	if (write->epoch == write->session->epoch && speech->state == AST_SPEECH_STATE_READY) {
+		speech->engine->write(speech, write->data, write->len);
+		written = 1;
+	}
+	ast_mutex_unlock(&speech->lock);
+
+	if (written) {
+		latency = ast_tvdiff_us(ast_tvnow(), write->queued);
+
+		AST_LIST_LOCK(&engine_pools);
+		if ((pool = find_engine_pool(speech->engine))) {
+			pool->writes++;
+			pool->write_latency_total += latency;
+			if (latency > pool->write_latency_max) {
+				pool->write_latency_max = latency;
+			}
+		}
+		AST_LIST_UNLOCK(&engine_pools);
+	}
+
+	ast_free(write);
+	return 0;
+}
+
+/*! \brief Collect audio in to chunks and queue them for the engine */
+static int speech_write_async(struct speech_session *session, void *data, int len)
+{
+	unsigned int chunk = session->speech.engine->write_chunk;
+	unsigned char *audio = data;
+	int res = 0;
+
+	ast_mutex_lock(&session->speech.lock);
+	while (len > 0) {
+		size_t copy;
+
+		if (!session->pending) {
+			session->pending = ast_malloc(sizeof(*session->pending) + chunk);
+			if (!session->pending) {
+				res = -1;
+				break;
+			}
+			session->pending->session = session;
+			session->pending->len = 0;
+		}
+
+		copy = MIN(len, chunk - session->pending->len);
+		memcpy(session->pending->data + session->pending->len, audio, copy);
+		session->pending->len += copy;
+		audio += copy;
+		len -= copy;
+
+		if (session->pending->len == chunk) {
+			struct speech_write *write = session->pending;
+
+			session->pending = NULL;
+			write->epoch = session->epoch;
+			write->queued = ast_tvnow();
+			if (ast_taskprocessor_push(session->serializer, speech_write_task, write)) {
+				ast_free(write);
+				res = -1;
+				break;
+			}
+		}
+	}
+	ast_mutex_unlock(&session->speech.lock);
+
+	return res;
+}
+
 /*! \brief Write in signed linear audio to be recognized */
 int ast_speech_write(struct ast_speech *speech, void *data, int len)
 {
+	struct speech_session *session = (struct speech_session *) speech;
+
 	/* Make sure the speech engine is ready to accept audio */
 	if (speech->state != AST_SPEECH_STATE_READY)
 		return -1;
 
+	if (session->serializer) {
+		return speech_write_async(session, data, len);
+	}
+
 	return speech->engine->write(speech, data, len);
 }
 
@@ -176,12 +345,154 @@ int ast_speech_get_setting(struct ast_speech *speech, const char *name, char *bu
 	return (speech->engine->get_setting ? speech->engine->get_setting(speech, name, buf, len) : -1);
 }
 
+/*! \brief Free a speech structure along with the engine's data for it */
+static void speech_session_free(struct speech_session *session)
+{
+	struct ast_speech *speech = &session->speech;
+
+	/* Make sure nothing is still queued before the engine tears down */
+	if (session->serializer) {
+		int remaining;
+
+		ast_taskprocessor_unreference(session->serializer);
+		session->serializer = NULL;
+
+		remaining = ast_serializer_shutdown_group_join(session->shutdown_group,
+			SPEECH_WRITE_SHUTDOWN_TIMEOUT);
+		if (remaining) {
+			/* The writes still reference us, leaking is the lesser evil */
+			ast_log(LOG_WARNING, "Speech recognition engine '%s' did not finish %d queued writes, leaking speech structure\n",
+				speech->engine->name, remaining);
+			return;
+		}
+	}
+	ao2_cleanup(session->shutdown_group);
+
+	/* Call our engine so we are destroyed properly */
+	speech->engine->destroy(speech);
+
+	/* Deinitialize the lock */
+	ast_mutex_destroy(&speech->lock);
+
+	/* If results exist on the speech structure, destroy them */
+	if (speech->results)
+		ast_speech_results_free(speech->results);
+
+	/* If a processing sound is set - free the memory used by it */
+	if (speech->processing_sound)
+		ast_free(speech->processing_sound);
+
+	ao2_ref(speech->format, -1);
+
+	ast_free(session->pending);
+
+	/* Aloha we are done */
+	ast_free(session);
+}
+
+/*! \brief Take an idle speech structure for the engine and format if there is one */
+static struct speech_session *speech_pool_take(struct ast_speech_engine *engine, struct ast_format *format)
+{
+	struct speech_engine_pool *pool;
+	struct speech_session *session = NULL;
+
+	AST_LIST_LOCK(&engine_pools);
+	if ((pool = find_engine_pool(engine))) {
+		AST_LIST_TRAVERSE_SAFE_BEGIN(&pool->idle, session, list) {
+			if (ast_format_cmp(session->speech.format, format) == AST_FORMAT_CMP_EQUAL) {
+				AST_LIST_REMOVE_CURRENT(list);
+				pool->idle_count--;
+				pool->reused++;
+				break;
+			}
+		}
+		AST_LIST_TRAVERSE_SAFE_END;
+	}
+	AST_LIST_UNLOCK(&engine_pools);
+
+	if (session && engine->reset(&session->speech)) {
+		speech_session_free(session);
+		session = NULL;
+	}
+
+	return session;
+}
+
+/*!
+ * \brief Keep a finished speech structure for reuse if the engine allows it
+ *
+ * \retval 1 if the pool took ownership
+ * \retval 0 if the caller should free it
+ */
+static int speech_pool_put(struct speech_session *session)
+{
+	struct ast_speech *speech = &session->speech;
+	struct speech_engine_pool *pool;
+	int res = 0;
+
+	if (!speech->engine->reset || !speech->engine->pool_size) {
+		return 0;
+	}
+
+	speech_discard_writes(session);
+
+	ast_mutex_lock(&speech->lock);
+	if (speech->results) {
+		ast_speech_results_free(speech->results);
+		speech->results = NULL;
+	}
+	ast_free(speech->processing_sound);
+	speech->processing_sound = NULL;
+	speech->flags = 0;
+	speech->results_type = AST_SPEECH_RESULTS_TYPE_NORMAL;
+	ast_speech_change_state(speech, AST_SPEECH_STATE_NOT_READY);
+	ast_mutex_unlock(&speech->lock);
+
+	AST_LIST_LOCK(&engine_pools);
+	pool = find_engine_pool(speech->engine);
+	if (pool && pool->idle_count < speech->engine->pool_size) {
+		AST_LIST_INSERT_HEAD(&pool->idle, session, list);
+		pool->idle_count++;
+		res = 1;
+	}
+	AST_LIST_UNLOCK(&engine_pools);
+
+	return res;
+}
+
+/*! \brief Set up asynchronous writes for a new speech structure */
+static void speech_session_async_init(struct speech_session *session)
+{
+	char tps_name[AST_TASKPROCESSOR_MAX_NAME + 1];
+
+	if (!session->speech.engine->write_chunk || !speech_threadpool) {
+		return;
+	}
+
+	session->shutdown_group = ast_serializer_shutdown_group_alloc();
+	if (!session->shutdown_group) {
+		return;
+	}
+
+	ast_taskprocessor_build_name(tps_name, sizeof(tps_name), "speech/%s",
+		session->speech.engine->name);
+	session->serializer = ast_threadpool_serializer_group(tps_name, speech_threadpool,
+		session->shutdown_group);
+	if (!session->serializer) {
+		/* Writes will just happen on the caller's thread */
+		ao2_ref(session->shutdown_group, -1);
+		session->shutdown_group = NULL;
+	}
+}
+
 /*! \brief Create a new speech structure using the engine specified */
 struct ast_speech *ast_speech_new(const char *engine_name, const struct ast_format_cap *cap)
 {
 	struct ast_speech_engine *engine = NULL;
+	struct speech_session *session;
 	struct ast_speech *new_speech = NULL;
 	struct ast_format_cap *joint;
+	struct speech_engine_pool *pool;
 	RAII_VAR(struct ast_format *, best, NULL, ao2_cleanup);
 
 	/* Try to find the speech recognition engine that was requested */
@@ -205,10 +516,16 @@ struct ast_speech *ast_speech_new(const char *engine_name, const struct ast_form
 		}
 	}
 
+	/* An idle structure saves the engine setting up a new session */
+	if (engine->reset && engine->pool_size && (session = speech_pool_take(engine, best))) {
+		return &session->speech;
+	}
+
 	/* Allocate our own speech structure, and try to allocate a structure from the engine too */
-	if (!(new_speech = ast_calloc(1, sizeof(*new_speech)))) {
+	if (!(session = ast_calloc(1, sizeof(*session)))) {
 		return NULL;
 	}
+	new_speech = &session->speech;
 
 	/* Initialize the lock */
 	ast_mutex_init(&new_speech->lock);
@@ -220,7 +537,7 @@ struct ast_speech *ast_speech_new(const char *engine_name, const struct ast_form
 	new_speech->engine = engine;
 
 	/* Can't forget the format audio is going to be in */
-	new_speech->format = best;
+	new_speech->format = ao2_bump(best);
 
 	/* We are not ready to accept audio yet */
 	ast_speech_change_state(new_speech, AST_SPEECH_STATE_NOT_READY);
@@ -228,38 +545,32 @@ struct ast_speech *ast_speech_new(const char *engine_name, const struct ast_form
 	/* Pass ourselves to the engine so they can set us up some more and if they error out then do not create a structure */
 	if (engine->create(new_speech, best)) {
 		ast_mutex_destroy(&new_speech->lock);
-		ast_free(new_speech);
-		new_speech = NULL;
+		ao2_ref(new_speech->format, -1);
+		ast_free(session);
+		return NULL;
 	}
 
+	speech_session_async_init(session);
+
+	AST_LIST_LOCK(&engine_pools);
+	if ((pool = find_engine_pool(engine))) {
+		pool->created++;
+	}
+	AST_LIST_UNLOCK(&engine_pools);
+
 	return new_speech;
 }
 
 /*! \brief Destroy a speech structure */
 int ast_speech_destroy(struct ast_speech *speech)
 {
-	int res = 0;
-
-	/* Call our engine so we are destroyed properly */
-	speech->engine->destroy(speech);
+	struct speech_session *session = (struct speech_session *) speech;
 
-	/* Deinitialize the lock */
-	ast_mutex_destroy(&speech->lock);
-
-	/* If results exist on the speech structure, destroy them */
-	if (speech->results)
-		ast_speech_results_free(speech->results);
-
-	/* If a processing sound is set - free the memory used by it */
-	if (speech->processing_sound)
-		ast_free(speech->processing_sound);
-
-	ao2_ref(speech->format, -1);
-
-	/* Aloha we are done */
-	ast_free(speech);
+	if (!speech_pool_put(session)) {
+		speech_session_free(session);
+	}
 
-	return res;
+	return 0;
 }
 
 /*! \brief Change state of a speech structure */
@@ -290,6 +601,7 @@ int ast_speech_change_results_type(struct ast_speech *speech, enum ast_speech_re
 /*! \brief Register a speech recognition engine */
 int ast_speech_register(struct ast_speech_engine *engine)
 {
+	struct speech_engine_pool *pool;
 	int res = 0;
 
 	/* Confirm the engine meets the minimum API requirements */
@@ -304,6 +616,14 @@ int ast_speech_register(struct ast_speech_engine *engine)
 		return -1;
 	}
 
+	if (!(pool = ast_calloc(1, sizeof(*pool)))) {
+		return -1;
+	}
+	pool->engine = engine;
+	AST_LIST_LOCK(&engine_pools);
+	AST_LIST_INSERT_TAIL(&engine_pools, pool, list);
+	AST_LIST_UNLOCK(&engine_pools);
+
 	ast_verb(2, "Registered speech recognition engine '%s'\n", engine->name);
 
 	/* Add to the engine linked list and make default if needed */
@@ -322,6 +642,8 @@ int ast_speech_register(struct ast_speech_engine *engine)
 int ast_speech_unregister(const char *engine_name)
 {
 	struct ast_speech_engine *engine = NULL;
+	struct speech_engine_pool *pool = NULL;
+	struct speech_session *session;
 	int res = -1;
 
 	if (ast_strlen_zero(engine_name))
@@ -345,9 +667,75 @@ int ast_speech_unregister(const char *engine_name)
 	AST_RWLIST_TRAVERSE_SAFE_END;
 	AST_RWLIST_UNLOCK(&engines);
 
+	if (!res) {
+		AST_LIST_LOCK(&engine_pools);
+		AST_LIST_TRAVERSE_SAFE_BEGIN(&engine_pools, pool, list) {
+			if (pool->engine == engine) {
+				AST_LIST_REMOVE_CURRENT(list);
+				break;
+			}
+		}
+		AST_LIST_TRAVERSE_SAFE_END;
+		AST_LIST_UNLOCK(&engine_pools);
+	}
+
+	/* Idle sessions still belong to the engine, so get rid of them while it is around */
+	if (pool) {
+		while ((session = AST_LIST_REMOVE_HEAD(&pool->idle, list))) {
+			speech_session_free(session);
+		}
+		ast_free(pool);
+	}
+
 	return res;
 }
 
+/*! \brief CLI command to show registered engines and their statistics */
+static char *handle_cli_speech_show_engines(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+#define FORMAT "%-20.20s %-7.7s %-9.9s %-9.9s %-9.9s %-10.10s %-12.12s %-12.12s\n"
+#define FORMAT2 "%-20.20s %-7.7s %4u/%-4u %-9u %-9u %-10u %-12u %-12u\n"
+	struct speech_engine_pool *pool;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "speech show engines";
+		e->usage =
+			"Usage: speech show engines\n"
+			"       Shows registered speech recognition engines along with\n"
+			"       session reuse and asynchronous write statistics.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	ast_cli(a->fd, FORMAT, "Engine", "Default", "Idle/Max", "Created", "Reused",
+		"Writes", "Avg Lat(us)", "Max Lat(us)");
+
+	AST_LIST_LOCK(&engine_pools);
+	AST_LIST_TRAVERSE(&engine_pools, pool, list) {
+		ast_cli(a->fd, FORMAT2, pool->engine->name,
+			pool->engine == default_engine ? "Yes" : "No",
+			pool->idle_count, pool->engine->reset ? pool->engine->pool_size : 0,
+			pool->created, pool->reused, pool->writes,
+			pool->writes ? (unsigned int) (pool->write_latency_total / pool->writes) : 0,
+			pool->write_latency_max);
+	}
+	AST_LIST_UNLOCK(&engine_pools);
+
+	return CLI_SUCCESS;
+#undef FORMAT
+#undef FORMAT2
+}
+
+static struct ast_cli_entry cli_speech[] = {
+	AST_CLI_DEFINE(handle_cli_speech_show_engines, "Show speech recognition engines"),
+};
+
 static int unload_module(void)
 {
 	/* We can not be unloaded */
@@ -356,6 +744,22 @@ static int unload_module(void)
 
 static int load_module(void)
 {
+	struct ast_threadpool_options options = {
+		.version = AST_THREADPOOL_OPTIONS_VERSION,
+		.idle_timeout = 60,
+		.auto_increment = 1,
+		.initial_size = 0,
+		.max_size = 0,
+	};
+
+	/* Engines asking for asynchronous writes fall back to writing directly without it */
+	speech_threadpool = ast_threadpool_create("speech", NULL, &options);
+	if (!speech_threadpool) {
+		ast_log(LOG_WARNING, "Unable to create the speech threadpool, audio will be written on the channel thread.\n");
+	}
+
+	ast_cli_register_multiple(cli_speech, ARRAY_LEN(cli_speech));
+
 	return AST_MODULE_LOAD_SUCCESS;
 }
 
@@ -89,6 +89,7 @@ static int ast_srtp_change_source(struct ast_srtp *srtp, unsigned int from_ssrc,
 
 static int ast_srtp_unprotect(struct ast_srtp *srtp, void *buf, int *len, int rtcp);
 static int ast_srtp_protect(struct ast_srtp *srtp, void **buf, int *len, int rtcp);
+static int ast_srtp_protect_batch(struct ast_srtp *srtp, void **bufs, int *lens, int count, size_t size, int rtcp);
 static void ast_srtp_set_cb(struct ast_srtp *srtp, const struct ast_srtp_cb *cb, void *data);
 static int ast_srtp_get_random(unsigned char *key, size_t len);
 
@@ -108,7 +109,8 @@ static struct ast_srtp_res srtp_res = {
 	.set_cb = ast_srtp_set_cb,
 	.unprotect = ast_srtp_unprotect,
 	.protect = ast_srtp_protect,
-	.get_random = ast_srtp_get_random
+	.get_random = ast_srtp_get_random,
+	.protect_batch = ast_srtp_protect_batch,
 };
 
 static struct ast_srtp_policy_res policy_res = {
@@ -498,6 +500,35 @@ static int ast_srtp_protect(struct ast_srtp *srtp, void **buf, int *len, int rtc
 	return *len;
 }
 
+/*!
+ * \brief Protect several packets in place
+ *
+ * Unlike ast_srtp_protect() the packets are not copied into the session's
+ * own buffer first, the caller provides buffers with room for the trailer.
+ */
+static int ast_srtp_protect_batch(struct ast_srtp *srtp, void **bufs, int *lens, int count, size_t size, int rtcp)
+{
+	int protected = 0;
+	int res;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if ((lens[i] + SRTP_MAX_TRAILER_LEN) > size) {
+			lens[i] = -1;
+			continue;
+		}
+
+		if ((res = rtcp ? srtp_protect_rtcp(srtp->session, bufs[i], &lens[i]) : srtp_protect(srtp->session, bufs[i], &lens[i])) != err_status_ok && res != err_status_replay_fail) {
+			ast_log(LOG_WARNING, "SRTP protect: %s\n", srtp_errstr(res));
+			lens[i] = -1;
+			continue;
+		}
+		protected++;
+	}
+
+	return protected;
+}
+
 static int ast_srtp_create(struct ast_srtp **srtp, struct ast_rtp_instance *rtp, struct ast_srtp_policy *policy)
 {
 	struct ast_srtp *temp;
@@ -190,15 +190,13 @@ static struct ast_frame *snoop_read(struct ast_channel *chan)
 	if (snoop->spy_direction != AST_AUDIOHOOK_DIRECTION_BOTH) {
 		/*
 		 * When a singular direction is chosen frames are still written to the
-		 * opposing direction's queue. Those frames must be read so the queue
-		 * does not continue to grow, however since they are not needed for the
-		 * selected direction they can be dropped.
+		 * opposing direction's queue. That queue must be emptied so it does
+		 * not continue to grow, however since its audio is not needed for the
+		 * selected direction it is flushed rather than read into a frame and
+		 * translated only to be dropped.
 		 */
-		enum ast_audiohook_direction opposing_direction =
-			snoop->spy_direction == AST_AUDIOHOOK_DIRECTION_READ ?
-			AST_AUDIOHOOK_DIRECTION_WRITE : AST_AUDIOHOOK_DIRECTION_READ;
-		ast_frame_dtor(ast_audiohook_read_frame(&snoop->spy, snoop->spy_samples,
-							opposing_direction, snoop->spy_format));
+		ast_slinfactory_flush(snoop->spy_direction == AST_AUDIOHOOK_DIRECTION_READ ?
+			&snoop->spy.write_factory : &snoop->spy.read_factory);
 	}
 
 	frame = ast_audiohook_read_frame(&snoop->spy, snoop->spy_samples, snoop->spy_direction, snoop->spy_format);
@@ -45,6 +45,21 @@
 				<configOption name="add_newline">
 					<synopsis>Append a newline to every event. This is useful if you want to fake out a server using netcat (nc -lu 8125)</synopsis>
 				</configOption>
+				<configOption name="flush_interval">
+					<synopsis>Milliseconds between batched sends to the statsd server</synopsis>
+					<description>
+						<para>When set to 0, the default, every metric is sent in its own
+						datagram as soon as it is logged.</para>
+						<para>Otherwise metrics are sent from a background thread at this
+						interval. Unsampled counters are summed and unsampled absolute gauges
+						keep their last value over the interval. All other metrics are queued
+						as they are. Metrics are packed, one per line, into datagrams of up to
+						<replaceable>max_packet_size</replaceable> bytes.</para>
+					</description>
+				</configOption>
+				<configOption name="max_packet_size">
+					<synopsis>Largest datagram to send when batching metrics</synopsis>
+				</configOption>
 			</configObject>
 		</configFile>
 	</configInfo>
@@ -63,6 +78,15 @@
 
 #define MAX_PREFIX 40
 
+/*! Default largest batched datagram, fits an ethernet MTU with IPv6 and UDP headers */
+#define DEFAULT_MAX_PACKET_SIZE 1432
+
+/*! Queued metrics beyond which new ones are sent right away instead */
+#define MAX_PENDING_SIZE (256 * 1024)
+
+/*! Buckets for aggregated metrics */
+#define AGGREGATE_BUCKETS 127
+
 /*! Socket for sending statd messages */
 static int socket_fd = -1;
 
@@ -76,6 +100,10 @@ struct conf_global_options {
 	struct ast_sockaddr statsd_server;
 	/*! Prefix to put on every stat. */
 	char prefix[MAX_PREFIX + 1];
+	/*! Milliseconds between batched sends, 0 to send every metric right away. */
+	unsigned int flush_interval;
+	/*! Largest datagram to send when batching. */
+	unsigned int max_packet_size;
 };
 
 /*! \brief All configuration options for statsd client. */
@@ -95,6 +123,292 @@ static void conf_server(const struct conf *cfg, struct ast_sockaddr *addr)
 	}
 }
 
+/*! \brief A counter or gauge aggregated over a flush interval */
+struct statsd_aggregate {
+	/*! Summed counter or last gauge value */
+	intmax_t value;
+	/*! Length of the metric name at the start of key */
+	size_t name_len;
+	/*! "name|type" */
+	char key[0];
+};
+
+/*! Counters and gauges waiting for the next flush */
+static struct ao2_container *aggregates;
+
+/*! Protects pending */
+AST_MUTEX_DEFINE_STATIC(pending_lock);
+/*! Formatted metrics waiting for the next flush, one per line */
+static struct ast_str *pending;
+
+/*! Protects the flush thread state */
+AST_MUTEX_DEFINE_STATIC(flush_lock);
+static ast_cond_t flush_cond;
+static pthread_t flush_thread = AST_PTHREADT_NULL;
+static int flush_stop;
+
+AO2_STRING_FIELD_HASH_FN(statsd_aggregate, key);
+AO2_STRING_FIELD_CMP_FN(statsd_aggregate, key);
+
+AST_THREADSTORAGE(statsd_key_buf);
+
+/*!
+ * \internal
+ * \brief Fold a counter or absolute gauge into the aggregate for its metric.
+ *
+ * \retval 0 if the metric was aggregated.
+ * \retval -1 if the metric has to be sent as it is.
+ */
+static int statsd_aggregate_add(const char *metric_name, const char *metric_type,
+	const char *value, double sample_rate)
+{
+	struct statsd_aggregate *aggregate;
+	struct ast_str *key;
+	intmax_t num;
+	char *end;
+	int is_gauge;
+
+	/* Sampled counters are scaled by the server */
+	if (sample_rate < 1.0) {
+		return -1;
+	}
+
+	if (!strcmp(metric_type, AST_STATSD_COUNTER)) {
+		is_gauge = 0;
+	} else if (!strcmp(metric_type, AST_STATSD_GAUGE)) {
+		/* A signed gauge value is relative to the previous one */
+		if (*value == '+' || *value == '-') {
+			return -1;
+		}
+		is_gauge = 1;
+	} else {
+		return -1;
+	}
+
+	errno = 0;
+	num = strtoimax(value, &end, 10);
+	if (errno || end == value || *end) {
+		return -1;
+	}
+
+	key = ast_str_thread_get(&statsd_key_buf, 128);
+	if (!key || ast_str_set(&key, 0, "%s|%s", metric_name, metric_type) == AST_DYNSTR_BUILD_FAILED) {
+		return -1;
+	}
+
+	ao2_lock(aggregates);
+	aggregate = ao2_find(aggregates, ast_str_buffer(key), OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if (!aggregate) {
+		aggregate = ao2_alloc_options(sizeof(*aggregate) + ast_str_strlen(key) + 1, NULL,
+			AO2_ALLOC_OPT_LOCK_NOLOCK);
+		if (!aggregate) {
+			ao2_unlock(aggregates);
+			return -1;
+		}
+		strcpy(aggregate->key, ast_str_buffer(key));/* Safe */
+		aggregate->name_len = strlen(metric_name);
+		ao2_link_flags(aggregates, aggregate, OBJ_NOLOCK);
+	}
+	if (is_gauge) {
+		aggregate->value = num;
+	} else {
+		aggregate->value += num;
+	}
+	ao2_unlock(aggregates);
+	ao2_ref(aggregate, -1);
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Queue a formatted metric for the next flush.
+ *
+ * \retval 0 if the metric was queued.
+ * \retval -1 if the metric has to be sent right away.
+ */
+static int statsd_queue(const char *line)
+{
+	int res = -1;
+
+	ast_mutex_lock(&pending_lock);
+	if (pending && ast_str_strlen(pending) < MAX_PENDING_SIZE
+		&& ast_str_append(&pending, 0, "%s\n", line) != AST_DYNSTR_BUILD_FAILED) {
+		res = 0;
+	}
+	ast_mutex_unlock(&pending_lock);
+
+	return res;
+}
+
+/*!
+ * \internal
+ * \brief Add one metric to a batched datagram, sending it first if it would get too big.
+ */
+static void statsd_packet_add(struct ast_str **packet, const char *line, size_t len,
+	const struct conf *cfg, const struct ast_sockaddr *server)
+{
+	size_t used = ast_str_strlen(*packet);
+
+	if (used && used + 1 + len + cfg->global->add_newline > cfg->global->max_packet_size) {
+		if (cfg->global->add_newline) {
+			ast_str_append(packet, 0, "\n");
+		}
+		ast_sendto(socket_fd, ast_str_buffer(*packet), ast_str_strlen(*packet), 0, server);
+		ast_str_reset(*packet);
+		used = 0;
+	}
+
+	if (used) {
+		ast_str_append(packet, 0, "\n");
+	}
+	ast_str_append_substr(packet, 0, line, len);
+}
+
+/*!
+ * \internal
+ * \brief Send everything aggregated and queued since the last flush.
+ */
+static void statsd_flush(void)
+{
+	struct conf *cfg;
+	struct ast_sockaddr statsd_server;
+	struct ast_str *queued;
+	struct ast_str *packet;
+	struct ast_str *line;
+	struct ao2_iterator *iter;
+	struct statsd_aggregate *aggregate;
+	char *lines;
+	char *cur;
+
+	cfg = ao2_global_obj_ref(confs);
+	if (!cfg || socket_fd == -1) {
+		ao2_cleanup(cfg);
+		return;
+	}
+	conf_server(cfg, &statsd_server);
+
+	packet = ast_str_create(cfg->global->max_packet_size + 1);
+	line = ast_str_create(128);
+	queued = ast_str_create(1024);
+	if (!packet || !line || !queued) {
+		ast_free(packet);
+		ast_free(line);
+		ast_free(queued);
+		ao2_ref(cfg, -1);
+		return;
+	}
+
+	/* Take what was queued so logging can carry on while it is sent */
+	ast_mutex_lock(&pending_lock);
+	SWAP(pending, queued);
+	ast_mutex_unlock(&pending_lock);
+
+	iter = ao2_callback(aggregates, OBJ_UNLINK | OBJ_MULTIPLE, NULL, NULL);
+	if (iter) {
+		for (; (aggregate = ao2_iterator_next(iter)); ao2_ref(aggregate, -1)) {
+			ast_str_set(&line, 0, "%s%s%.*s:%jd|%s",
+				cfg->global->prefix, ast_strlen_zero(cfg->global->prefix) ? "" : ".",
+				(int) aggregate->name_len, aggregate->key, aggregate->value,
+				aggregate->key + aggregate->name_len + 1);
+			statsd_packet_add(&packet, ast_str_buffer(line), ast_str_strlen(line),
+				cfg, &statsd_server);
+		}
+		ao2_iterator_destroy(iter);
+	}
+
+	if (queued) {
+		lines = ast_str_buffer(queued);
+		while ((cur = strsep(&lines, "\n"))) {
+			if (!ast_strlen_zero(cur)) {
+				statsd_packet_add(&packet, cur, strlen(cur), cfg, &statsd_server);
+			}
+		}
+		ast_free(queued);
+	}
+
+	if (ast_str_strlen(packet)) {
+		if (cfg->global->add_newline) {
+			ast_str_append(&packet, 0, "\n");
+		}
+		ast_sendto(socket_fd, ast_str_buffer(packet), ast_str_strlen(packet), 0, &statsd_server);
+	}
+
+	ast_free(line);
+	ast_free(packet);
+	ao2_ref(cfg, -1);
+}
+
+static void *statsd_flush_thread_run(void *data)
+{
+	ast_mutex_lock(&flush_lock);
+	while (!flush_stop) {
+		struct conf *cfg = ao2_global_obj_ref(confs);
+		unsigned int interval = cfg ? cfg->global->flush_interval : 0;
+		struct timeval when;
+		struct timespec ts;
+
+		ao2_cleanup(cfg);
+		when = ast_tvadd(ast_tvnow(), ast_samp2tv(MAX(interval, 1), 1000));
+		ts.tv_sec = when.tv_sec;
+		ts.tv_nsec = when.tv_usec * 1000;
+		ast_cond_timedwait(&flush_cond, &flush_lock, &ts);
+
+		ast_mutex_unlock(&flush_lock);
+		statsd_flush();
+		ast_mutex_lock(&flush_lock);
+	}
+	ast_mutex_unlock(&flush_lock);
+
+	return NULL;
+}
+
+/*! \brief Start sending batched metrics, if not already doing so */
+static int statsd_flush_thread_start(void)
+{
+	if (flush_thread != AST_PTHREADT_NULL) {
+		return 0;
+	}
+
+	ast_mutex_lock(&pending_lock);
+	if (!pending) {
+		pending = ast_str_create(1024);
+	}
+	ast_mutex_unlock(&pending_lock);
+	if (!pending) {
+		return -1;
+	}
+
+	flush_stop = 0;
+	if (ast_pthread_create(&flush_thread, NULL, statsd_flush_thread_run, NULL)) {
+		ast_log(LOG_ERROR, "Unable to start statsd flush thread\n");
+		flush_thread = AST_PTHREADT_NULL;
+		return -1;
+	}
+	return 0;
+}
+
+/*! \brief Stop sending batched metrics, sending what is left first */
+static void statsd_flush_thread_stop(void)
+{
+	if (flush_thread == AST_PTHREADT_NULL) {
+		return;
+	}
+
+	ast_mutex_lock(&flush_lock);
+	flush_stop = 1;
+	ast_cond_signal(&flush_cond);
+	ast_mutex_unlock(&flush_lock);
+	pthread_join(flush_thread, NULL);
+	flush_thread = AST_PTHREADT_NULL;
+
+	/* Anything logged after the thread's last pass goes out right away from now on */
+	ast_mutex_lock(&pending_lock);
+	ast_free(pending);
+	pending = NULL;
+	ast_mutex_unlock(&pending_lock);
+}
+
 void AST_OPTIONAL_API_NAME(ast_statsd_log_string)(const char *metric_name,
 	const char *metric_type, const char *value, double sample_rate)
 {
@@ -117,6 +431,13 @@ void AST_OPTIONAL_API_NAME(ast_statsd_log_string)(const char *metric_name,
 	}
 
 	cfg = ao2_global_obj_ref(confs);
+
+	if (cfg->global->flush_interval && flush_thread != AST_PTHREADT_NULL
+		&& !statsd_aggregate_add(metric_name, metric_type, value, sample_rate)) {
+		ao2_cleanup(cfg);
+		return;
+	}
+
 	conf_server(cfg, &statsd_server);
 
 	msg = ast_str_create(40);
@@ -135,6 +456,13 @@ void AST_OPTIONAL_API_NAME(ast_statsd_log_string)(const char *metric_name,
 		ast_str_append(&msg, 0, "|@%.2f", sample_rate);
 	}
 
+	if (cfg->global->flush_interval && flush_thread != AST_PTHREADT_NULL
+		&& !statsd_queue(ast_str_buffer(msg))) {
+		ao2_cleanup(cfg);
+		ast_free(msg);
+		return;
+	}
+
 	if (cfg->global->add_newline) {
 		ast_str_append(&msg, 0, "\n");
 	}
@@ -303,6 +631,15 @@ static int statsd_init(void)
 	ast_debug(3, "  statsd server = %s.\n", server);
 	ast_debug(3, "  add newline = %s\n", AST_YESNO(cfg->global->add_newline));
 	ast_debug(3, "  prefix = %s\n", cfg->global->prefix);
+	ast_debug(3, "  flush interval = %u\n", cfg->global->flush_interval);
+
+	if (cfg->global->flush_interval) {
+		if (statsd_flush_thread_start()) {
+			return -1;
+		}
+	} else {
+		statsd_flush_thread_stop();
+	}
 
 	return 0;
 }
@@ -310,6 +647,7 @@ static int statsd_init(void)
 static void statsd_shutdown(void)
 {
 	ast_debug(3, "Shutting down statsd client.\n");
+	statsd_flush_thread_stop();
 	if (socket_fd != -1) {
 		close(socket_fd);
 		socket_fd = -1;
@@ -321,13 +659,26 @@ static int unload_module(void)
 	statsd_shutdown();
 	aco_info_destroy(&cfg_info);
 	ao2_global_obj_release(confs);
+	ao2_cleanup(aggregates);
+	aggregates = NULL;
+	ast_cond_destroy(&flush_cond);
 	return 0;
 }
 
 static int load_module(void)
 {
+	aggregates = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0, AGGREGATE_BUCKETS,
+		statsd_aggregate_hash_fn, NULL, statsd_aggregate_cmp_fn);
+	if (!aggregates) {
+		return AST_MODULE_LOAD_DECLINE;
+	}
+	ast_cond_init(&flush_cond, NULL);
+
 	if (aco_info_init(&cfg_info)) {
 		aco_info_destroy(&cfg_info);
+		ao2_ref(aggregates, -1);
+		aggregates = NULL;
+		ast_cond_destroy(&flush_cond);
 		return AST_MODULE_LOAD_DECLINE;
 	}
 
@@ -347,6 +698,14 @@ static int load_module(void)
 		"", OPT_CHAR_ARRAY_T, 0,
 		CHARFLDSET(struct conf_global_options, prefix));
 
+	aco_option_register(&cfg_info, "flush_interval", ACO_EXACT, global_options,
+		"0", OPT_UINT_T, 0,
+		FLDSET(struct conf_global_options, flush_interval));
+
+	aco_option_register(&cfg_info, "max_packet_size", ACO_EXACT, global_options,
+		__stringify(DEFAULT_MAX_PACKET_SIZE), OPT_UINT_T, PARSE_IN_RANGE,
+		FLDSET(struct conf_global_options, max_packet_size), 64, 65000);
+
 	if (aco_process_config(&cfg_info, 0) == ACO_PROCESS_ERROR) {
 		struct conf *cfg;
 
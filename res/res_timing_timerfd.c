@@ -31,6 +31,7 @@
 #include "asterisk.h"
 
 #include <sys/timerfd.h>
+#include <sys/eventfd.h>
 
 #include "asterisk/module.h"
 #include "asterisk/astobj2.h"
@@ -38,6 +39,9 @@
 #include "asterisk/logger.h"
 #include "asterisk/utils.h"
 #include "asterisk/time.h"
+#include "asterisk/alertpipe.h"
+#include "asterisk/poll-compat.h"
+#include "asterisk/vector.h"
 
 static void *timing_funcs_handle;
 
@@ -50,6 +54,7 @@ static int timerfd_timer_disable_continuous(void *data);
 static enum ast_timer_event timerfd_timer_get_event(void *data);
 static unsigned int timerfd_timer_get_max_rate(void *data);
 static int timerfd_timer_fd(void *data);
+static void timerfd_timer_get_sources(void *data, unsigned int *timers, unsigned int *sources);
 
 static struct ast_timing_interface timerfd_timing = {
 	.name = "timerfd",
@@ -63,19 +68,209 @@ static struct ast_timing_interface timerfd_timing = {
 	.timer_get_event = timerfd_timer_get_event,
 	.timer_get_max_rate = timerfd_timer_get_max_rate,
 	.timer_fd = timerfd_timer_fd,
+	.timer_get_sources = timerfd_timer_get_sources,
 };
 
 #define TIMERFD_MAX_RATE 1000
 
+/*!
+ * \brief A kernel timer shared by all timers with the same rate
+ *
+ * The fan out thread reads its ticks and adds them to the eventfd of each
+ * of its timers, so only one timerfd is armed and fires per rate in use.
+ */
+struct timerfd_source {
+	int fd;
+	unsigned int rate;
+	/*! Timers ticking from this source, they remove themselves under sources_lock */
+	AST_VECTOR(, struct timerfd_timer *) timers;
+};
+
 struct timerfd_timer {
+	/*! The eventfd ticks are fanned out to */
 	int fd;
-	struct itimerspec saved_timer;
+	/*! The source the timer ticks from, NULL when stopped */
+	struct timerfd_source *source;
 	unsigned int is_continuous:1;
 };
 
+AST_MUTEX_DEFINE_STATIC(sources_lock);
+/*! Sources by rate, protected by sources_lock */
+static AST_VECTOR(, struct timerfd_source *) sources;
+/*! Number of open timers, protected by sources_lock */
+static unsigned int timer_count;
+/*! Wakes the fan out thread when sources come or go */
+static int sources_alert_pipe[2] = { -1, -1 };
+static pthread_t fanout_thread = AST_PTHREADT_NULL;
+static int fanout_stop;
+
+static void source_destroy(void *obj)
+{
+	struct timerfd_source *source = obj;
+
+	if (source->fd > -1) {
+		close(source->fd);
+	}
+	AST_VECTOR_FREE(&source->timers);
+}
+
+/*! \brief Find or create the source for a rate, sources_lock must be held */
+static struct timerfd_source *source_get(unsigned int rate)
+{
+	struct timerfd_source *source;
+	struct itimerspec interval = { { 0, }, };
+	int i;
+
+	for (i = 0; i < AST_VECTOR_SIZE(&sources); i++) {
+		source = AST_VECTOR_GET(&sources, i);
+		if (source->rate == rate) {
+			return source;
+		}
+	}
+
+	if (!(source = ao2_alloc_options(sizeof(*source), source_destroy, AO2_ALLOC_OPT_LOCK_NOLOCK))) {
+		return NULL;
+	}
+	source->rate = rate;
+	if (AST_VECTOR_INIT(&source->timers, 8)) {
+		source->fd = -1;
+		ao2_ref(source, -1);
+		return NULL;
+	}
+
+	interval.it_value.tv_nsec = (long) (1000000000 / rate);
+	interval.it_interval.tv_nsec = interval.it_value.tv_nsec;
+	if ((source->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK)) < 0
+		|| timerfd_settime(source->fd, 0, &interval, NULL)) {
+		ast_log(LOG_ERROR, "Failed to create timerfd timer: %s\n", strerror(errno));
+		ao2_ref(source, -1);
+		return NULL;
+	}
+
+	if (AST_VECTOR_APPEND(&sources, source)) {
+		ao2_ref(source, -1);
+		return NULL;
+	}
+	ast_alertpipe_write(sources_alert_pipe);
+
+	return source;
+}
+
+/*! \brief Drop a source no timer ticks from anymore, sources_lock must be held */
+static void source_prune(struct timerfd_source *source)
+{
+	if (AST_VECTOR_SIZE(&source->timers)) {
+		return;
+	}
+
+	/* The fan out thread may still poll the timerfd, it goes with its last reference */
+	AST_VECTOR_REMOVE_ELEM_UNORDERED(&sources, source, AST_VECTOR_ELEM_CLEANUP_NOOP);
+	ast_alertpipe_write(sources_alert_pipe);
+	ao2_ref(source, -1);
+}
+
+/*! \brief Stop a timer ticking from its source, sources_lock must be held */
+static void source_leave(struct timerfd_timer *timer)
+{
+	struct timerfd_source *source = timer->source;
+
+	if (!source) {
+		return;
+	}
+	timer->source = NULL;
+
+	AST_VECTOR_REMOVE_ELEM_UNORDERED(&source->timers, timer, AST_VECTOR_ELEM_CLEANUP_NOOP);
+	source_prune(source);
+}
+
+static void *fanout_run(void *data)
+{
+	AST_VECTOR(, struct timerfd_source *) polled;
+	struct pollfd *pfds = NULL;
+	size_t pfds_size = 0;
+
+	AST_VECTOR_INIT(&polled, 8);
+
+	while (!fanout_stop) {
+		size_t count;
+		int i;
+
+		/* Take a reference to every source so their fds stay open while polled */
+		ast_mutex_lock(&sources_lock);
+		count = AST_VECTOR_SIZE(&sources) + 1;
+		if (count > pfds_size) {
+			struct pollfd *grown = ast_realloc(pfds, count * sizeof(*pfds));
+
+			if (!grown) {
+				ast_mutex_unlock(&sources_lock);
+				usleep(100000);
+				continue;
+			}
+			pfds = grown;
+			pfds_size = count;
+		}
+		pfds[0].fd = ast_alertpipe_readfd(sources_alert_pipe);
+		pfds[0].events = POLLIN;
+		for (i = 0; i < AST_VECTOR_SIZE(&sources); i++) {
+			struct timerfd_source *source = AST_VECTOR_GET(&sources, i);
+
+			if (AST_VECTOR_APPEND(&polled, ao2_bump(source))) {
+				ao2_ref(source, -1);
+				break;
+			}
+			pfds[i + 1].fd = source->fd;
+			pfds[i + 1].events = POLLIN;
+		}
+		count = AST_VECTOR_SIZE(&polled) + 1;
+		ast_mutex_unlock(&sources_lock);
+
+		while (!fanout_stop && ast_poll(pfds, count, 1000) >= 0) {
+			if (pfds[0].revents) {
+				ast_alertpipe_flush(sources_alert_pipe);
+				break;
+			}
+
+			ast_mutex_lock(&sources_lock);
+			for (i = 1; i < count; i++) {
+				struct timerfd_source *source = AST_VECTOR_GET(&polled, i - 1);
+				uint64_t expirations;
+				int j;
+
+				if (!pfds[i].revents
+					|| read(source->fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+					continue;
+				}
+
+				for (j = 0; j < AST_VECTOR_SIZE(&source->timers); j++) {
+					struct timerfd_timer *timer = AST_VECTOR_GET(&source->timers, j);
+
+					/* A continuous timer is already readable */
+					if (!timer->is_continuous && write(timer->fd, &expirations, sizeof(expirations)) < 0) {
+						ast_debug(1, "Failed to tick timer %d: %s\n", timer->fd, strerror(errno));
+					}
+				}
+			}
+			ast_mutex_unlock(&sources_lock);
+		}
+
+		AST_VECTOR_RESET(&polled, ao2_cleanup);
+	}
+
+	AST_VECTOR_FREE(&polled);
+	ast_free(pfds);
+
+	return NULL;
+}
+
 static void timer_destroy(void *obj)
 {
 	struct timerfd_timer *timer = obj;
+
+	ast_mutex_lock(&sources_lock);
+	source_leave(timer);
+	timer_count--;
+	ast_mutex_unlock(&sources_lock);
+
 	if (timer->fd > -1) {
 		close(timer->fd);
 	}
@@ -89,8 +284,13 @@ static void *timerfd_timer_open(void)
 		ast_log(LOG_ERROR, "Could not allocate memory for timerfd_timer structure\n");
 		return NULL;
 	}
-	if ((timer->fd = timerfd_create(CLOCK_MONOTONIC, 0)) < 0) {
-		ast_log(LOG_ERROR, "Failed to create timerfd timer: %s\n", strerror(errno));
+
+	ast_mutex_lock(&sources_lock);
+	timer_count++;
+	ast_mutex_unlock(&sources_lock);
+
+	if ((timer->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0) {
+		ast_log(LOG_ERROR, "Failed to create timer eventfd: %s\n", strerror(errno));
 		ao2_ref(timer, -1);
 		return NULL;
 	}
@@ -106,19 +306,36 @@ static void timerfd_timer_close(void *data)
 static int timerfd_timer_set_rate(void *data, unsigned int rate)
 {
 	struct timerfd_timer *timer = data;
+	struct timerfd_source *source = NULL;
 	int res = 0;
 
 	ao2_lock(timer);
+	ast_mutex_lock(&sources_lock);
+
+	if (!rate) {
+		source_leave(timer);
+	} else if (!timer->source || timer->source->rate != rate) {
+		if (!(source = source_get(rate))) {
+			res = -1;
+		} else if (AST_VECTOR_APPEND(&source->timers, timer)) {
+			source_prune(source);
+			res = -1;
+		} else {
+			source_leave(timer);
+			timer->source = source;
+		}
+	}
 
-	timer->saved_timer.it_value.tv_sec = 0;
-	timer->saved_timer.it_value.tv_nsec = rate ? (long) (1000000000 / rate) : 0L;
-	timer->saved_timer.it_interval.tv_sec = timer->saved_timer.it_value.tv_sec;
-	timer->saved_timer.it_interval.tv_nsec = timer->saved_timer.it_value.tv_nsec;
+	/* Like rearming a timerfd, drop the ticks counted at the old rate */
+	if (!res && !timer->is_continuous) {
+		uint64_t expirations;
 
-	if (!timer->is_continuous) {
-		res = timerfd_settime(timer->fd, 0, &timer->saved_timer, NULL);
+		if (read(timer->fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+			ast_debug(1, "Failed to clear timer %d: %s\n", timer->fd, strerror(errno));
+		}
 	}
 
+	ast_mutex_unlock(&sources_lock);
 	ao2_unlock(timer);
 
 	return res;
@@ -127,39 +344,34 @@ static int timerfd_timer_set_rate(void *data, unsigned int rate)
 static int timerfd_timer_ack(void *data, unsigned int quantity)
 {
 	struct timerfd_timer *timer = data;
-	uint64_t expirations;
+	uint64_t expirations = 0;
 	int read_result = 0;
 	int res = 0;
 
 	ao2_lock(timer);
 
-	do {
-		struct itimerspec timer_status;
-
-		if (timerfd_gettime(timer->fd, &timer_status)) {
-			ast_log(LOG_ERROR, "Call to timerfd_gettime() using handle %d error: %s\n", timer->fd, strerror(errno));
-			expirations = 0;
-			res = -1;
-			break;
-		}
-
-		if (timer_status.it_value.tv_sec == 0 && timer_status.it_value.tv_nsec == 0) {
-			ast_debug(1, "Avoiding read on disarmed timerfd %d\n", timer->fd);
-			expirations = 0;
-			break;
-		}
-
-		read_result = read(timer->fd, &expirations, sizeof(expirations));
-		if (read_result == -1) {
-			if (errno == EINTR || errno == EAGAIN) {
-				continue;
-			} else {
-				ast_log(LOG_ERROR, "Read error: %s\n", strerror(errno));
-				res = -1;
-				break;
+	/* A stopped or continuous timer gets no ticks to read */
+	if (!timer->source || timer->is_continuous) {
+		ast_debug(1, "Avoiding read on disarmed timer %d\n", timer->fd);
+	} else {
+		do {
+			read_result = read(timer->fd, &expirations, sizeof(expirations));
+			if (read_result == -1) {
+				if (errno == EINTR) {
+					continue;
+				} else if (errno == EAGAIN) {
+					/* No tick has been fanned out yet */
+					expirations = 0;
+					break;
+				} else {
+					ast_log(LOG_ERROR, "Read error: %s\n", strerror(errno));
+					expirations = 0;
+					res = -1;
+					break;
+				}
 			}
-		}
-	} while (read_result != sizeof(expirations));
+		} while (read_result != sizeof(expirations));
+	}
 
 	ao2_unlock(timer);
 
@@ -173,10 +385,8 @@ static int timerfd_timer_ack(void *data, unsigned int quantity)
 static int timerfd_timer_enable_continuous(void *data)
 {
 	struct timerfd_timer *timer = data;
-	int res;
-	static const struct itimerspec continuous_timer = {
-		.it_value.tv_nsec = 1L,
-	};
+	uint64_t tick = 1;
+	int res = 0;
 
 	ao2_lock(timer);
 
@@ -188,8 +398,14 @@ static int timerfd_timer_enable_continuous(void *data)
 		return 0;
 	}
 
-	res = timerfd_settime(timer->fd, 0, &continuous_timer, &timer->saved_timer);
-	timer->is_continuous = 1;
+	/* Ticks are no longer read, so one keeps the timer readable */
+	ast_mutex_lock(&sources_lock);
+	if (write(timer->fd, &tick, sizeof(tick)) < 0) {
+		res = -1;
+	} else {
+		timer->is_continuous = 1;
+	}
+	ast_mutex_unlock(&sources_lock);
 	ao2_unlock(timer);
 
 	return res;
@@ -198,7 +414,7 @@ static int timerfd_timer_enable_continuous(void *data)
 static int timerfd_timer_disable_continuous(void *data)
 {
 	struct timerfd_timer *timer = data;
-	int res;
+	uint64_t expirations;
 
 	ao2_lock(timer);
 
@@ -210,12 +426,16 @@ static int timerfd_timer_disable_continuous(void *data)
 		return 0;
 	}
 
-	res = timerfd_settime(timer->fd, 0, &timer->saved_timer, NULL);
+	/* Drop the continuous tick, the fan out thread adds new ones from here */
+	ast_mutex_lock(&sources_lock);
 	timer->is_continuous = 0;
-	memset(&timer->saved_timer, 0, sizeof(timer->saved_timer));
+	if (read(timer->fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+		ast_debug(1, "Failed to clear timer %d: %s\n", timer->fd, strerror(errno));
+	}
+	ast_mutex_unlock(&sources_lock);
 	ao2_unlock(timer);
 
-	return res;
+	return 0;
 }
 
 static enum ast_timer_event timerfd_timer_get_event(void *data)
@@ -248,6 +468,26 @@ static int timerfd_timer_fd(void *data)
 	return timer->fd;
 }
 
+static void timerfd_timer_get_sources(void *data, unsigned int *timers, unsigned int *kernel_timers)
+{
+	ast_mutex_lock(&sources_lock);
+	*timers = timer_count;
+	*kernel_timers = AST_VECTOR_SIZE(&sources);
+	ast_mutex_unlock(&sources_lock);
+}
+
+static void fanout_shutdown(void)
+{
+	if (fanout_thread != AST_PTHREADT_NULL) {
+		fanout_stop = 1;
+		ast_alertpipe_write(sources_alert_pipe);
+		pthread_join(fanout_thread, NULL);
+		fanout_thread = AST_PTHREADT_NULL;
+	}
+	AST_VECTOR_FREE(&sources);
+	ast_alertpipe_close(sources_alert_pipe);
+}
+
 static int load_module(void)
 {
 	int fd;
@@ -260,7 +500,21 @@ static int load_module(void)
 
 	close(fd);
 
+	if (ast_alertpipe_init(sources_alert_pipe) || AST_VECTOR_INIT(&sources, 4)) {
+		fanout_shutdown();
+		return AST_MODULE_LOAD_DECLINE;
+	}
+
+	fanout_stop = 0;
+	if (ast_pthread_create_background(&fanout_thread, NULL, fanout_run, NULL)) {
+		ast_log(LOG_ERROR, "Failed to start the timerfd fan out thread\n");
+		fanout_thread = AST_PTHREADT_NULL;
+		fanout_shutdown();
+		return AST_MODULE_LOAD_DECLINE;
+	}
+
 	if (!(timing_funcs_handle = ast_register_timing_interface(&timerfd_timing))) {
+		fanout_shutdown();
 		return AST_MODULE_LOAD_DECLINE;
 	}
 
@@ -269,7 +523,13 @@ static int load_module(void)
 
 static int unload_module(void)
 {
-	return ast_unregister_timing_interface(timing_funcs_handle);
+	int res = ast_unregister_timing_interface(timing_funcs_handle);
+
+	if (!res) {
+		fanout_shutdown();
+	}
+
+	return res;
 }
 
 AST_MODULE_INFO(ASTERISK_GPL_KEY, AST_MODFLAG_LOAD_ORDER, "Timerfd Timing Interface",
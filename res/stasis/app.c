@@ -344,6 +344,8 @@ static void sub_subscription_change_handler(void *data, struct stasis_subscripti
 	}
 }
 
+static int app_event_type_allowed(struct stasis_app *app, const char *type);
+
 static void sub_default_handler(void *data, struct stasis_subscription *sub,
 	struct stasis_message *message)
 {
@@ -533,13 +535,32 @@ static struct ast_json *channel_connected_line(
 		"channel", json_channel);
 }
 
-static channel_snapshot_monitor channel_monitors[] = {
-	channel_state,
-	channel_dialplan,
-	channel_callerid,
-	channel_connected_line,
+static const struct {
+	channel_snapshot_monitor monitor;
+	/*! The types of the events the monitor creates */
+	const char *types[3];
+} channel_monitors[] = {
+	{ channel_state, { "ChannelCreated", "ChannelDestroyed", "ChannelStateChange" } },
+	{ channel_dialplan, { "ChannelDialplan" } },
+	{ channel_callerid, { "ChannelCallerId" } },
+	{ channel_connected_line, { "ChannelConnectedLine" } },
 };
 
+/*! \brief Determine if the app takes any event a channel monitor creates */
+static int channel_monitor_allowed(struct stasis_app *app, int monitor)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_LEN(channel_monitors[monitor].types)
+			&& channel_monitors[monitor].types[i]; ++i) {
+		if (app_event_type_allowed(app, channel_monitors[monitor].types[i])) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
 static void sub_channel_update_handler(void *data,
 	struct stasis_subscription *sub,
 	struct stasis_message *message)
@@ -551,7 +572,12 @@ static void sub_channel_update_handler(void *data,
 	for (i = 0; i < ARRAY_LEN(channel_monitors); ++i) {
 		struct ast_json *msg;
 
-		msg = channel_monitors[i](update->old_snapshot, update->new_snapshot,
+		if (!channel_monitor_allowed(app, i)) {
+			/* Don't render events the app would discard */
+			continue;
+		}
+
+		msg = channel_monitors[i].monitor(update->old_snapshot, update->new_snapshot,
 			stasis_message_timestamp(message));
 		if (msg) {
 			app_send(app, msg);
@@ -644,7 +670,7 @@ static void sub_endpoint_update_handler(void *data,
 	new_snapshot = stasis_message_data(update->new_snapshot);
 	old_snapshot = stasis_message_data(update->old_snapshot);
 
-	if (new_snapshot) {
+	if (new_snapshot && app_event_type_allowed(app, "EndpointStateChange")) {
 		struct ast_json *json;
 
 		tv = stasis_message_timestamp(update->new_snapshot);
@@ -693,11 +719,16 @@ static void sub_bridge_update_handler(void *data,
 	tv = stasis_message_timestamp(message);
 
 	if (!update->new_snapshot) {
-		json = simple_bridge_event("BridgeDestroyed", update->old_snapshot, tv);
+		if (app_event_type_allowed(app, "BridgeDestroyed")) {
+			json = simple_bridge_event("BridgeDestroyed", update->old_snapshot, tv);
+		}
 	} else if (!update->old_snapshot) {
-		json = simple_bridge_event("BridgeCreated", update->new_snapshot, tv);
+		if (app_event_type_allowed(app, "BridgeCreated")) {
+			json = simple_bridge_event("BridgeCreated", update->new_snapshot, tv);
+		}
 	} else if (update->new_snapshot && update->old_snapshot
-		&& strcmp(update->new_snapshot->video_source_id, update->old_snapshot->video_source_id)) {
+		&& strcmp(update->new_snapshot->video_source_id, update->old_snapshot->video_source_id)
+		&& app_event_type_allowed(app, "BridgeVideoSourceChanged")) {
 		json = simple_bridge_event("BridgeVideoSourceChanged", update->new_snapshot, tv);
 		if (json && !ast_strlen_zero(update->old_snapshot->video_source_id)) {
 			ast_json_object_set(json, "old_video_source_id",
@@ -1041,6 +1072,10 @@ void app_send(struct stasis_app *app, struct ast_json *message)
 	char eid[20];
 	void *data;
 
+	if (!app_event_type_allowed(app, ast_json_string_get(ast_json_object_get(message, "type")))) {
+		return;
+	}
+
 	if (ast_json_object_set(message, "asterisk_id", ast_json_string_create(
 			ast_eid_to_str(eid, sizeof(eid), &ast_eid_default)))) {
 		ast_log(AST_LOG_WARNING, "Failed to append EID to outgoing event %s\n",
@@ -1700,7 +1735,7 @@ int stasis_app_event_filter_set(struct stasis_app *app, struct ast_json *filter)
 	return app_events_disallowed_set(app, filter) || app_events_allowed_set(app, filter);
 }
 
-static int app_event_filter_matched(struct ast_json *array, struct ast_json *event, int empty)
+static int app_event_filter_matched(struct ast_json *array, const char *type, int empty)
 {
 	struct ast_json *obj;
 	int i;
@@ -1712,8 +1747,7 @@ static int app_event_filter_matched(struct ast_json *array, struct ast_json *eve
 	for (i = 0; i < ast_json_array_size(array) &&
 			(obj = ast_json_array_get(array, i)); ++i) {
 
-		if (ast_strings_equal(ast_json_object_string_get(obj, "type"),
-				ast_json_object_string_get(event, "type"))) {
+		if (ast_strings_equal(ast_json_object_string_get(obj, "type"), type)) {
 			return 1;
 		}
 	}
@@ -1721,6 +1755,24 @@ static int app_event_filter_matched(struct ast_json *array, struct ast_json *eve
 	return 0;
 }
 
+/*!
+ * \internal
+ * \brief Determine if the app's event filters let events of a type through.
+ *
+ * Checked before an event is rendered, so filtered out events cost no JSON.
+ */
+static int app_event_type_allowed(struct stasis_app *app, const char *type)
+{
+	int res;
+
+	ao2_lock(app);
+	res = !app_event_filter_matched(app->events_disallowed, type, 0) &&
+		app_event_filter_matched(app->events_allowed, type, 1);
+	ao2_unlock(app);
+
+	return res;
+}
+
 int stasis_app_event_allowed(const char *app_name, struct ast_json *event)
 {
 	struct stasis_app *app = stasis_app_get_by_name(app_name);
@@ -1730,10 +1782,7 @@ int stasis_app_event_allowed(const char *app_name, struct ast_json *event)
 		return 0;
 	}
 
-	ao2_lock(app);
-	res = !app_event_filter_matched(app->events_disallowed, event, 0) &&
-		app_event_filter_matched(app->events_allowed, event, 1);
-	ao2_unlock(app);
+	res = app_event_type_allowed(app, ast_json_object_string_get(event, "type"));
 	ao2_ref(app, -1);
 
 	return res;
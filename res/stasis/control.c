@@ -901,6 +901,78 @@ int stasis_app_send_command(struct stasis_app_control *control,
 	return app_send_command_on_condition(control, command_fn, data, data_destructor, NULL);
 }
 
+/*!
+ * \internal
+ * \brief Fail the commands of a batch that could not be queued
+ *
+ * Requests without a command object still own their data.
+ */
+static void app_send_commands_fail(struct stasis_app_command **commands,
+	struct stasis_app_command_request *requests, size_t count)
+{
+	size_t idx;
+
+	for (idx = 0; idx < count; ++idx) {
+		requests[idx].result = -1;
+		if (commands && commands[idx]) {
+			ao2_ref(commands[idx], -1);
+		} else if (requests[idx].data_destructor) {
+			requests[idx].data_destructor(requests[idx].data);
+		}
+	}
+}
+
+int stasis_app_send_commands(struct stasis_app_control *control,
+	struct stasis_app_command_request *requests, size_t count)
+{
+	struct stasis_app_command **commands;
+	size_t idx;
+
+	if (!count) {
+		return 0;
+	}
+
+	commands = ast_calloc(count, sizeof(*commands));
+	if (!commands || !control || control->is_done) {
+		app_send_commands_fail(NULL, requests, count);
+		ast_free(commands);
+		return -1;
+	}
+
+	for (idx = 0; idx < count; ++idx) {
+		commands[idx] = command_create(requests[idx].command ?: noop_cb,
+			requests[idx].data, requests[idx].data_destructor);
+		if (!commands[idx]) {
+			/* command_create() already destroyed this request's data */
+			requests[idx].data_destructor = NULL;
+			app_send_commands_fail(commands, requests, count);
+			ast_free(commands);
+			return -1;
+		}
+	}
+
+	ao2_lock(control->command_queue);
+	if (control->is_done) {
+		ao2_unlock(control->command_queue);
+		app_send_commands_fail(commands, requests, count);
+		ast_free(commands);
+		return -1;
+	}
+	for (idx = 0; idx < count; ++idx) {
+		ao2_link_flags(control->command_queue, commands[idx], OBJ_NOLOCK);
+	}
+	ast_cond_signal(&control->wait_cond);
+	ao2_unlock(control->command_queue);
+
+	for (idx = 0; idx < count; ++idx) {
+		requests[idx].result = command_join(commands[idx]);
+		ao2_ref(commands[idx], -1);
+	}
+	ast_free(commands);
+
+	return 0;
+}
+
 int stasis_app_send_command_async(struct stasis_app_control *control,
 	stasis_app_command_cb command_fn, void *data,
 	command_data_destructor_fn data_destructor)
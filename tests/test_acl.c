@@ -36,6 +36,7 @@
 #include "asterisk/module.h"
 #include "asterisk/netsock2.h"
 #include "asterisk/config.h"
+#include "asterisk/astobj2.h"
 
 AST_TEST_DEFINE(invalid_acl)
 {
@@ -433,10 +434,158 @@ acl_cleanup:
 	return res;
 }
 
+/*! \brief A small linear congruential generator, so the generated rules are repeatable */
+static unsigned int trie_test_random(unsigned int *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return (*seed >> 8) & 0xffffff;
+}
+
+static int trie_test_compare(struct ast_test *test, const struct ast_ha *ha,
+	const struct ast_ha_trie *trie, const char *address)
+{
+	struct ast_sockaddr addr;
+	int expected;
+	int actual;
+
+	if (!ast_sockaddr_parse(&addr, address, PARSE_PORT_FORBID)) {
+		ast_test_status_update(test, "Could not parse test address %s\n", address);
+		return -1;
+	}
+
+	expected = ast_apply_ha(ha, &addr);
+	actual = ast_apply_ha_trie(trie, &addr);
+	if (expected != actual) {
+		ast_test_status_update(test, "Access not as expected to %s on the compiled ACL. "
+			"Expected %d but got %d instead\n", address, expected, actual);
+		return -1;
+	}
+
+	return 0;
+}
+
+AST_TEST_DEFINE(acl_trie)
+{
+	struct acl fixed[] = {
+		{ "0.0.0.0/0", "deny" },
+		{ "10.0.0.0/8", "permit" },
+		{ "10.1.0.0/16,!10.1.2.0/24", "deny" },
+		{ "10.1.0.0/16", "permit" },
+		{ "10.0.0.0/255.0.255.0", "deny" },
+		{ "192.168.1.1", "permit" },
+		{ "::/0", "deny" },
+		{ "fe80::/64,!fe80::1", "permit" },
+		{ "2001:db8::/32", "permit" },
+		{ "2001:db8:0:1::/ffff:ffff:0:ffff::", "deny" },
+		{ "192.168.1.1", "deny" },
+	};
+	const char *fixed_addresses[] = {
+		"10.1.1.1", "10.1.2.3", "10.2.0.5", "10.200.0.1", "192.168.1.1",
+		"192.168.1.2", "172.16.0.1", "::ffff:10.1.2.3", "::ffff:192.168.1.1",
+		"fe80::1", "fe80::2", "fe80:0:0:1::1", "2001:db8::1", "2001:db8:5:1::1",
+		"2001:db9::1", "::1",
+	};
+	struct ast_acl_list *acl_list = NULL;
+	struct ast_ha_trie *trie = NULL;
+	struct ast_ha *ha = NULL;
+	enum ast_test_result_state res = AST_TEST_PASS;
+	struct ast_sockaddr addr;
+	unsigned int seed = 1;
+	char address[64];
+	int err = 0;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "acl_trie";
+		info->category = "/main/acl/";
+		info->summary = "Compiled ACL unit test";
+		info->description =
+			"Tests that compiled ACLs permit and deny the same hosts as the "
+			"rules they were compiled from";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	if (build_ha(fixed, ARRAY_LEN(fixed), &ha, "fixed", &err, test, &res)) {
+		goto acl_trie_cleanup;
+	}
+
+	if (!(trie = ast_ha_trie_alloc(ha))) {
+		ast_test_status_update(test, "Failed to compile the fixed ACL\n");
+		res = AST_TEST_FAIL;
+		goto acl_trie_cleanup;
+	}
+
+	for (i = 0; i < ARRAY_LEN(fixed_addresses); ++i) {
+		if (trie_test_compare(test, ha, trie, fixed_addresses[i])) {
+			res = AST_TEST_FAIL;
+		}
+	}
+
+	ao2_ref(trie, -1);
+	trie = NULL;
+	ast_free_ha(ha);
+	ha = NULL;
+
+	/* A large deny list of overlapping ranges with the odd exception */
+	for (i = 0; i < 5000; ++i) {
+		unsigned int net = trie_test_random(&seed) << 8 | (trie_test_random(&seed) & 0xff);
+
+		snprintf(address, sizeof(address), "%s%u.%u.%u.%u/%u", i % 7 ? "" : "!",
+			(net >> 24) & 0x0f, (net >> 16) & 0xff, (net >> 8) & 0xff, net & 0xff,
+			8 + trie_test_random(&seed) % 25);
+		if (!(ha = ast_append_ha("deny", address, ha, &err)) || err) {
+			ast_test_status_update(test, "Failed to add rule %s\n", address);
+			res = AST_TEST_FAIL;
+			goto acl_trie_cleanup;
+		}
+	}
+
+	if (!(trie = ast_ha_trie_alloc(ha))) {
+		ast_test_status_update(test, "Failed to compile the generated ACL\n");
+		res = AST_TEST_FAIL;
+		goto acl_trie_cleanup;
+	}
+
+	for (i = 0; i < 5000; ++i) {
+		unsigned int host = trie_test_random(&seed) << 8 | (trie_test_random(&seed) & 0xff);
+
+		snprintf(address, sizeof(address), "%u.%u.%u.%u",
+			(host >> 24) & 0x0f, (host >> 16) & 0xff, (host >> 8) & 0xff, host & 0xff);
+		if (trie_test_compare(test, ha, trie, address)) {
+			res = AST_TEST_FAIL;
+			break;
+		}
+	}
+
+	/* Rules appended to an ACL after it has been applied must take effect */
+	ast_append_acl("deny", "10.0.0.0/8", &acl_list, &err, NULL);
+	ast_sockaddr_parse(&addr, "10.1.1.1", PARSE_PORT_FORBID);
+	if (err || ast_apply_acl(acl_list, &addr, "Test ACL: ") != AST_SENSE_DENY) {
+		ast_test_status_update(test, "Address was not denied by the ACL list\n");
+		res = AST_TEST_FAIL;
+		goto acl_trie_cleanup;
+	}
+	ast_append_acl("permit", "10.1.0.0/16", &acl_list, &err, NULL);
+	if (err || ast_apply_acl(acl_list, &addr, "Test ACL: ") != AST_SENSE_ALLOW) {
+		ast_test_status_update(test, "Address was not permitted after appending to the ACL list\n");
+		res = AST_TEST_FAIL;
+	}
+
+acl_trie_cleanup:
+	ast_free_acl_list(acl_list);
+	ao2_cleanup(trie);
+	ast_free_ha(ha);
+	return res;
+}
+
 static int unload_module(void)
 {
 	AST_TEST_UNREGISTER(invalid_acl);
 	AST_TEST_UNREGISTER(acl);
+	AST_TEST_UNREGISTER(acl_trie);
 	return 0;
 }
 
@@ -444,6 +593,7 @@ static int load_module(void)
 {
 	AST_TEST_REGISTER(invalid_acl);
 	AST_TEST_REGISTER(acl);
+	AST_TEST_REGISTER(acl_trie);
 	return AST_MODULE_LOAD_SUCCESS;
 }
 
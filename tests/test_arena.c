@@ -0,0 +1,157 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2019, Sangoma Technologies Corporation
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*! \file
+ * \brief Arena allocator tests
+ */
+
+/*** MODULEINFO
+	<depend>TEST_FRAMEWORK</depend>
+	<support_level>core</support_level>
+ ***/
+
+#include "asterisk.h"
+#include "asterisk/test.h"
+#include "asterisk/arena.h"
+#include "asterisk/module.h"
+
+AST_TEST_DEFINE(arena_alloc)
+{
+	struct ast_arena *arena;
+	struct ast_arena_mark outer;
+	struct ast_arena_mark inner;
+	char *first;
+	char *second;
+	char *big;
+	void *ptr;
+	int i;
+	enum ast_test_result_state res = AST_TEST_PASS;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "arena_alloc";
+		info->category = "/main/arena/";
+		info->summary = "Arena allocator unit test";
+		info->description =
+			"Allocates from an arena across several chunks and "
+			"checks that releasing to a mark reuses the memory.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	arena = ast_arena_create(64);
+	if (!arena) {
+		return AST_TEST_FAIL;
+	}
+
+	ast_arena_mark(arena, &outer);
+	first = ast_arena_strdup(arena, "first");
+	ast_arena_mark(arena, &inner);
+	second = ast_arena_strdup(arena, "second");
+	if (!first || !second || strcmp(first, "first") || strcmp(second, "second")) {
+		ast_test_status_update(test, "Failed to copy strings into the arena\n");
+		res = AST_TEST_FAIL;
+		goto end;
+	}
+
+	/* Spill over into more chunks, including one larger than the chunk size */
+	for (i = 0; i < 20; ++i) {
+		ptr = ast_arena_alloc(arena, 24);
+		if (!ptr || ((uintptr_t) ptr % sizeof(void *))) {
+			ast_test_status_update(test, "Bad allocation %p from the arena\n", ptr);
+			res = AST_TEST_FAIL;
+			goto end;
+		}
+		memset(ptr, 0xff, 24);
+	}
+	big = ast_arena_alloc(arena, 1000);
+	if (!big) {
+		res = AST_TEST_FAIL;
+		goto end;
+	}
+	memset(big, 0xff, 1000);
+
+	ast_arena_release(arena, &inner);
+	if (strcmp(first, "first")) {
+		ast_test_status_update(test, "Releasing the inner mark clobbered '%s'\n", first);
+		res = AST_TEST_FAIL;
+		goto end;
+	}
+	if (ast_arena_strdup(arena, "again") != second) {
+		ast_test_status_update(test, "Released memory was not reused\n");
+		res = AST_TEST_FAIL;
+		goto end;
+	}
+
+	ast_arena_release(arena, &outer);
+	if (ast_arena_strdup(arena, "x") != first) {
+		ast_test_status_update(test, "Arena did not return to its starting point\n");
+		res = AST_TEST_FAIL;
+	}
+
+end:
+	ast_arena_destroy(arena);
+	return res;
+}
+
+AST_TEST_DEFINE(arena_thread)
+{
+	struct ast_arena *arena;
+	struct ast_arena_mark mark;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "arena_thread";
+		info->category = "/main/arena/";
+		info->summary = "Per-thread arena unit test";
+		info->description =
+			"Checks that the thread's arena is reused between calls.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	arena = ast_arena_thread_get();
+	if (!arena || arena != ast_arena_thread_get()) {
+		ast_test_status_update(test, "Did not get the same thread arena twice\n");
+		return AST_TEST_FAIL;
+	}
+
+	ast_arena_mark(arena, &mark);
+	if (!ast_arena_strdup(arena, "thread")) {
+		return AST_TEST_FAIL;
+	}
+	ast_arena_release(arena, &mark);
+
+	return AST_TEST_PASS;
+}
+
+static int unload_module(void)
+{
+	AST_TEST_UNREGISTER(arena_alloc);
+	AST_TEST_UNREGISTER(arena_thread);
+	return 0;
+}
+
+static int load_module(void)
+{
+	AST_TEST_REGISTER(arena_alloc);
+	AST_TEST_REGISTER(arena_thread);
+	return AST_MODULE_LOAD_SUCCESS;
+}
+
+AST_MODULE_INFO_STANDARD(ASTERISK_GPL_KEY, "Arena allocator test module");
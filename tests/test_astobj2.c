@@ -2051,6 +2051,497 @@ AST_TEST_DEFINE(astobj2_test_perf)
 	return res;
 }
 
+/*!
+ * \brief Number of objects linked into the container under test before iterating.
+ */
+#define RESIZE_OBJS_BEFORE 100
+
+/*!
+ * \brief Number of objects linked into the container under test while iterating.
+ */
+#define RESIZE_OBJS_DURING 2000
+
+static int test_hash_resize_link(struct ao2_container *c, int num, int *destructor_count)
+{
+	struct test_obj *obj;
+	int res;
+
+	obj = ao2_alloc(sizeof(struct test_obj), test_obj_destructor);
+	if (!obj) {
+		return -1;
+	}
+	obj->destructor_count = destructor_count;
+	obj->i = num;
+	++*destructor_count;
+	res = ao2_link(c, obj) ? 0 : -1;
+	ao2_ref(obj, -1);
+
+	return res;
+}
+
+static enum ast_test_result_state test_hash_resize(struct ast_test *test, int use_sort,
+	enum ao2_iterator_flags flags)
+{
+	struct ao2_container *c;
+	struct ao2_iterator iter;
+	struct test_obj *obj;
+	unsigned char seen[RESIZE_OBJS_BEFORE + RESIZE_OBJS_DURING] = { 0, };
+	int destructor_count = 0;
+	int res = AST_TEST_PASS;
+	int linked;
+	int num;
+
+	ast_test_status_update(test, "Resizable hash container (%s, %s).\n",
+		use_sort ? "sorted" : "non-sorted",
+		(flags & AO2_ITERATOR_DESCENDING) ? "descending" : "ascending");
+
+	c = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, AO2_CONTAINER_ALLOC_OPT_HASH_RESIZE,
+		3, test_hash_cb, use_sort ? test_sort_cb : NULL, test_cmp_cb);
+	if (!c) {
+		ast_test_status_update(test, "Container creation failed.\n");
+		return AST_TEST_FAIL;
+	}
+
+	for (linked = 0; linked < RESIZE_OBJS_BEFORE; ++linked) {
+		if (test_hash_resize_link(c, linked, &destructor_count)) {
+			ast_test_status_update(test, "Object %d could not be linked.\n", linked);
+			res = AST_TEST_FAIL;
+			goto cleanup;
+		}
+	}
+
+	/* Grow the container underneath an iterator part way through it. */
+	iter = ao2_iterator_init(c, flags);
+	while ((obj = ao2_iterator_next(&iter))) {
+		if (seen[obj->i]++) {
+			ast_test_status_update(test, "Object %d was iterated more than once.\n", obj->i);
+			res = AST_TEST_FAIL;
+		}
+		ao2_ref(obj, -1);
+
+		for (num = 0; num < RESIZE_OBJS_DURING / RESIZE_OBJS_BEFORE
+			&& linked < ARRAY_LEN(seen); ++num, ++linked) {
+			if (test_hash_resize_link(c, linked, &destructor_count)) {
+				ast_test_status_update(test, "Object %d could not be linked.\n", linked);
+				res = AST_TEST_FAIL;
+			}
+		}
+	}
+	ao2_iterator_destroy(&iter);
+
+	for (num = 0; num < RESIZE_OBJS_BEFORE; ++num) {
+		if (seen[num] != 1) {
+			ast_test_status_update(test, "Object %d was not iterated.\n", num);
+			res = AST_TEST_FAIL;
+		}
+	}
+
+	if (ao2_container_count(c) != ARRAY_LEN(seen)) {
+		ast_test_status_update(test, "Container has %d objects instead of %d.\n",
+			ao2_container_count(c), (int) ARRAY_LEN(seen));
+		res = AST_TEST_FAIL;
+	}
+
+	if (ao2_container_check(c, 0)) {
+		ast_test_status_update(test, "Container integrity check failed.\n");
+		res = AST_TEST_FAIL;
+	}
+
+	/* Every object must still be found in the bucket it hashes to now. */
+	for (num = 0; num < ARRAY_LEN(seen); ++num) {
+		obj = ao2_find(c, &num, OBJ_SEARCH_KEY);
+		if (!obj) {
+			ast_test_status_update(test, "Object %d was not found.\n", num);
+			res = AST_TEST_FAIL;
+			continue;
+		}
+		ao2_ref(obj, -1);
+	}
+
+	/* A full traversal must also visit each object once. */
+	memset(seen, 0, sizeof(seen));
+	iter = ao2_iterator_init(c, flags);
+	while ((obj = ao2_iterator_next(&iter))) {
+		if (seen[obj->i]++) {
+			ast_test_status_update(test, "Object %d was iterated more than once.\n", obj->i);
+			res = AST_TEST_FAIL;
+		}
+		ao2_ref(obj, -1);
+	}
+	ao2_iterator_destroy(&iter);
+	for (num = 0; num < ARRAY_LEN(seen); ++num) {
+		if (seen[num] != 1) {
+			ast_test_status_update(test, "Object %d was not iterated after growing.\n", num);
+			res = AST_TEST_FAIL;
+			break;
+		}
+	}
+
+cleanup:
+	ao2_ref(c, -1);
+
+	if (destructor_count) {
+		ast_test_status_update(test, "%d objects were not destroyed.\n", destructor_count);
+		res = AST_TEST_FAIL;
+	}
+
+	return res;
+}
+
+AST_TEST_DEFINE(astobj2_test_hash_resize)
+{
+	int res = AST_TEST_PASS;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "astobj2_test_hash_resize";
+		info->category = "/main/astobj2/";
+		info->summary = "Test resizable hash containers";
+		info->description =
+			"Grows resizable hash containers far beyond their initial bucket "
+			"count while iterating them.  Verifies that iterators see each "
+			"object once and that every object can still be found.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	if (test_hash_resize(test, 0, 0) == AST_TEST_FAIL
+		|| test_hash_resize(test, 1, 0) == AST_TEST_FAIL
+		|| test_hash_resize(test, 0, AO2_ITERATOR_DESCENDING) == AST_TEST_FAIL
+		|| test_hash_resize(test, 1, AO2_ITERATOR_DESCENDING) == AST_TEST_FAIL) {
+		res = AST_TEST_FAIL;
+	}
+
+	return res;
+}
+
+/*!
+ * \brief Number of objects in the read-mostly container under test.
+ */
+#define READ_MOSTLY_OBJS 200
+
+struct read_mostly_reader {
+	struct ao2_container *c;
+	/*! Number of lookups that found the wrong object. */
+	int wrong;
+	int stop;
+};
+
+static void read_mostly_obj_destructor(void *v_obj)
+{
+	struct test_obj *obj = v_obj;
+
+	ast_atomic_fetchadd_int(obj->destructor_count, -1);
+}
+
+static int read_mostly_link(struct ao2_container *c, int num, int *destructor_count)
+{
+	struct test_obj *obj;
+	int res;
+
+	obj = ao2_alloc(sizeof(struct test_obj), read_mostly_obj_destructor);
+	if (!obj) {
+		return -1;
+	}
+	obj->destructor_count = destructor_count;
+	obj->i = num;
+	ast_atomic_fetchadd_int(destructor_count, 1);
+	res = ao2_link(c, obj) ? 0 : -1;
+	ao2_ref(obj, -1);
+
+	return res;
+}
+
+static void *read_mostly_reader_thread(void *data)
+{
+	struct read_mostly_reader *reader = data;
+	struct test_obj *obj;
+	int num = 0;
+
+	while (!ast_atomic_load_n(&reader->stop, __ATOMIC_RELAXED)) {
+		obj = ao2_find(reader->c, &num, OBJ_SEARCH_KEY);
+		if (obj) {
+			if (obj->i != num) {
+				ast_atomic_fetchadd_int(&reader->wrong, 1);
+			}
+			ao2_ref(obj, -1);
+		}
+		num = (num + 1) % READ_MOSTLY_OBJS;
+	}
+
+	return NULL;
+}
+
+static enum ast_test_result_state test_read_mostly(struct ast_test *test, int use_sort,
+	unsigned int options)
+{
+	struct read_mostly_reader reader = { .c = NULL, };
+	struct test_obj *obj;
+	pthread_t thread = AST_PTHREADT_NULL;
+	int destructor_count = 0;
+	int res = AST_TEST_PASS;
+	int round;
+	int num;
+
+	ast_test_status_update(test, "Read-mostly hash container (%s%s).\n",
+		use_sort ? "sorted" : "non-sorted",
+		(options & AO2_CONTAINER_ALLOC_OPT_HASH_RESIZE) ? ", resizable" : "");
+
+	reader.c = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_RWLOCK,
+		AO2_CONTAINER_ALLOC_OPT_READ_MOSTLY | options, 7, test_hash_cb,
+		use_sort ? test_sort_cb : NULL, test_cmp_cb);
+	if (!reader.c) {
+		ast_test_status_update(test, "Container creation failed.\n");
+		return AST_TEST_FAIL;
+	}
+
+	for (num = 0; num < READ_MOSTLY_OBJS; ++num) {
+		if (read_mostly_link(reader.c, num, &destructor_count)) {
+			ast_test_status_update(test, "Object %d could not be linked.\n", num);
+			res = AST_TEST_FAIL;
+			goto cleanup;
+		}
+	}
+
+	if (ast_pthread_create(&thread, NULL, read_mostly_reader_thread, &reader)) {
+		ast_test_status_update(test, "Could not start the reader thread.\n");
+		res = AST_TEST_FAIL;
+		goto cleanup;
+	}
+
+	/* Odd objects come and go while the other thread keeps looking them up. */
+	for (round = 0; round < 4; ++round) {
+		for (num = 1; num < READ_MOSTLY_OBJS; num += 2) {
+			obj = ao2_find(reader.c, &num, OBJ_SEARCH_KEY | OBJ_UNLINK);
+			if (!obj) {
+				ast_test_status_update(test, "Object %d could not be unlinked.\n", num);
+				res = AST_TEST_FAIL;
+				continue;
+			}
+			ao2_ref(obj, -1);
+		}
+
+		/* Twice so the second pass is answered from the lookup copy. */
+		for (num = 0; num < READ_MOSTLY_OBJS * 2; ++num) {
+			int key = num % READ_MOSTLY_OBJS;
+
+			obj = ao2_find(reader.c, &key, OBJ_SEARCH_KEY);
+			if ((obj == NULL) != (key % 2 == 1)) {
+				ast_test_status_update(test, "Object %d was %sfound.\n", key, obj ? "" : "not ");
+				res = AST_TEST_FAIL;
+			} else if (obj && obj->i != key) {
+				ast_test_status_update(test, "Object %d found for key %d.\n", obj->i, key);
+				res = AST_TEST_FAIL;
+			}
+			ao2_cleanup(obj);
+		}
+
+		for (num = 1; num < READ_MOSTLY_OBJS; num += 2) {
+			if (read_mostly_link(reader.c, num, &destructor_count)) {
+				ast_test_status_update(test, "Object %d could not be linked.\n", num);
+				res = AST_TEST_FAIL;
+			}
+		}
+
+		for (num = 0; num < READ_MOSTLY_OBJS; ++num) {
+			obj = ao2_find(reader.c, &num, OBJ_SEARCH_KEY);
+			if (!obj) {
+				ast_test_status_update(test, "Object %d was not found after relinking.\n", num);
+				res = AST_TEST_FAIL;
+				continue;
+			}
+			ao2_ref(obj, -1);
+		}
+	}
+
+	ast_atomic_store_n(&reader.stop, 1, __ATOMIC_RELAXED);
+	pthread_join(thread, NULL);
+	if (reader.wrong) {
+		ast_test_status_update(test, "%d lookups found the wrong object.\n", reader.wrong);
+		res = AST_TEST_FAIL;
+	}
+
+	if (ao2_container_check(reader.c, 0)) {
+		ast_test_status_update(test, "Container integrity check failed.\n");
+		res = AST_TEST_FAIL;
+	}
+
+cleanup:
+	ao2_ref(reader.c, -1);
+
+	if (destructor_count) {
+		ast_test_status_update(test, "%d objects were not destroyed.\n", destructor_count);
+		res = AST_TEST_FAIL;
+	}
+
+	return res;
+}
+
+AST_TEST_DEFINE(astobj2_test_read_mostly)
+{
+	int res = AST_TEST_PASS;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "astobj2_test_read_mostly";
+		info->category = "/main/astobj2/";
+		info->summary = "Test read-mostly hash containers";
+		info->description =
+			"Links and unlinks objects of read-mostly hash containers while "
+			"another thread looks them up.  Verifies that lookups never see "
+			"stale or wrong objects and that every object is released once "
+			"the container is destroyed.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	if (test_read_mostly(test, 0, 0) == AST_TEST_FAIL
+		|| test_read_mostly(test, 1, 0) == AST_TEST_FAIL
+		|| test_read_mostly(test, 0, AO2_CONTAINER_ALLOC_OPT_HASH_RESIZE) == AST_TEST_FAIL
+		|| test_read_mostly(test, 1, AO2_CONTAINER_ALLOC_OPT_HASH_RESIZE) == AST_TEST_FAIL) {
+		res = AST_TEST_FAIL;
+	}
+
+	return res;
+}
+
+/*!
+ * \brief Number of threads referencing the sharded object under test.
+ */
+#define SHARD_THREADS 4
+
+/*!
+ * \brief Number of references each thread takes and keeps.
+ */
+#define SHARD_REFS 1000
+
+struct shard_worker {
+	struct test_obj *obj;
+	pthread_t thread;
+};
+
+static void *shard_worker_thread(void *data)
+{
+	struct shard_worker *worker = data;
+	int num;
+
+	for (num = 0; num < SHARD_REFS * 10; ++num) {
+		ao2_ref(worker->obj, +1);
+		ao2_ref(worker->obj, -1);
+	}
+	/* Keep some so they are still out when the object is unsharded. */
+	for (num = 0; num < SHARD_REFS; ++num) {
+		ao2_ref(worker->obj, +1);
+	}
+
+	return NULL;
+}
+
+static void *shard_release_thread(void *data)
+{
+	struct shard_worker *worker = data;
+	int num;
+
+	for (num = 0; num < SHARD_REFS; ++num) {
+		ao2_ref(worker->obj, -1);
+	}
+
+	return NULL;
+}
+
+static int test_ref_shard_threads(struct shard_worker *workers, void *(*fn)(void *))
+{
+	int idx;
+	int res = 0;
+
+	for (idx = 0; idx < SHARD_THREADS; ++idx) {
+		if (ast_pthread_create(&workers[idx].thread, NULL, fn, &workers[idx])) {
+			workers[idx].thread = AST_PTHREADT_NULL;
+			res = -1;
+		}
+	}
+	for (idx = 0; idx < SHARD_THREADS; ++idx) {
+		if (workers[idx].thread != AST_PTHREADT_NULL) {
+			pthread_join(workers[idx].thread, NULL);
+		} else {
+			/* Do on this thread what the worker would have. */
+			fn(&workers[idx]);
+		}
+	}
+
+	return res;
+}
+
+AST_TEST_DEFINE(astobj2_test_ref_shard)
+{
+	struct ao2_global_obj holder = { .obj = NULL, };
+	struct shard_worker workers[SHARD_THREADS];
+	struct test_obj *obj;
+	int destructor_count = 1;
+	int res = AST_TEST_PASS;
+	int idx;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "astobj2_test_ref_shard";
+		info->category = "/main/astobj2/";
+		info->summary = "Test per CPU reference counting";
+		info->description =
+			"References an object published in a global holder from several "
+			"threads, releases it from the holder while references taken on "
+			"CPU counters are still out, and verifies the count is exact "
+			"afterwards and the object is destroyed with its last reference.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	obj = ao2_alloc_options(sizeof(*obj), test_obj_destructor,
+		AO2_ALLOC_OPT_LOCK_MUTEX | AO2_ALLOC_OPT_REF_SHARDED);
+	if (!obj) {
+		return AST_TEST_FAIL;
+	}
+	obj->destructor_count = &destructor_count;
+	ast_rwlock_init(&holder.lock);
+
+	/* The holder shards the object, the allocation reference goes on a CPU counter. */
+	ao2_global_obj_replace_unref(holder, obj);
+	ao2_ref(obj, -1);
+	for (idx = 0; idx < SHARD_THREADS; ++idx) {
+		workers[idx].obj = obj;
+	}
+	if (test_ref_shard_threads(workers, shard_worker_thread)) {
+		ast_test_status_update(test, "Could not start all threads.\n");
+		res = AST_TEST_FAIL;
+	}
+
+	ao2_global_obj_release(holder);
+	if (ao2_ref(obj, 0) != SHARD_THREADS * SHARD_REFS) {
+		ast_test_status_update(test, "Object has %d references instead of %d.\n",
+			ao2_ref(obj, 0), SHARD_THREADS * SHARD_REFS);
+		res = AST_TEST_FAIL;
+	}
+
+	/* Release what the workers kept, the last release destroys the object. */
+	ao2_ref(obj, +1);
+	test_ref_shard_threads(workers, shard_release_thread);
+	if (destructor_count != 1 || ao2_ref(obj, 0) != 1) {
+		ast_test_status_update(test, "Object lost track of its references.\n");
+		res = AST_TEST_FAIL;
+	}
+	ao2_ref(obj, -1);
+	if (destructor_count) {
+		ast_test_status_update(test, "Object was not destroyed.\n");
+		res = AST_TEST_FAIL;
+	}
+
+	ast_rwlock_destroy(&holder.lock);
+
+	return res;
+}
+
 static int unload_module(void)
 {
 	AST_TEST_UNREGISTER(astobj2_test_1);
@@ -2058,6 +2549,9 @@ static int unload_module(void)
 	AST_TEST_UNREGISTER(astobj2_test_3);
 	AST_TEST_UNREGISTER(astobj2_test_4);
 	AST_TEST_UNREGISTER(astobj2_test_perf);
+	AST_TEST_UNREGISTER(astobj2_test_hash_resize);
+	AST_TEST_UNREGISTER(astobj2_test_read_mostly);
+	AST_TEST_UNREGISTER(astobj2_test_ref_shard);
 	return 0;
 }
 
@@ -2068,6 +2562,9 @@ static int load_module(void)
 	AST_TEST_REGISTER(astobj2_test_3);
 	AST_TEST_REGISTER(astobj2_test_4);
 	AST_TEST_REGISTER(astobj2_test_perf);
+	AST_TEST_REGISTER(astobj2_test_hash_resize);
+	AST_TEST_REGISTER(astobj2_test_read_mostly);
+	AST_TEST_REGISTER(astobj2_test_ref_shard);
 	return AST_MODULE_LOAD_SUCCESS;
 }
 
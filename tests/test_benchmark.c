@@ -0,0 +1,581 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2019, Sangoma Technologies Corporation
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*!
+ * \file
+ * \brief Benchmarks of core hot paths
+ *
+ * Each test runs a fixed number of operations and reports operations
+ * per second along with the median, 99th percentile and worst latency
+ * of a single operation. The operation counts are fixed so results can
+ * be compared between builds and releases run on the same machine.
+ *
+ * \ingroup tests
+ */
+
+/*** MODULEINFO
+	<depend>TEST_FRAMEWORK</depend>
+	<support_level>core</support_level>
+ ***/
+
+#include "asterisk.h"
+
+#include "asterisk/astobj2.h"
+#include "asterisk/format_cache.h"
+#include "asterisk/frame.h"
+#include "asterisk/module.h"
+#include "asterisk/sched.h"
+#include "asterisk/sem.h"
+#include "asterisk/stasis.h"
+#include "asterisk/taskprocessor.h"
+#include "asterisk/test.h"
+#include "asterisk/time.h"
+#include "asterisk/translate.h"
+#include "asterisk/utils.h"
+
+/*! Operations run by each benchmark */
+#define BENCH_OPS 100000
+
+/*! Buckets of the benchmarked ao2 hash container */
+#define BENCH_HASH_BUCKETS 1009
+
+/*! Subscribers a benchmarked stasis message is fanned out to */
+#define BENCH_SUBSCRIBERS 10
+
+/*! Messages published in the stasis benchmark */
+#define BENCH_MESSAGES 10000
+
+/*! Frames translated in the translation benchmark */
+#define BENCH_FRAMES 10000
+
+/*! Longest a benchmark waits for queued work to finish */
+#define BENCH_WAIT_SECONDS 30
+
+/*! \brief Latencies of one benchmark run */
+struct bench {
+	/*! When the run started */
+	struct timeval start;
+	/*! When the run ended */
+	struct timeval end;
+	/*! Latency of each operation, in nanoseconds */
+	int64_t *samples;
+	/*! Number of recorded samples */
+	size_t count;
+	/*! Room for samples */
+	size_t max;
+};
+
+static int bench_init(struct bench *bench, size_t max)
+{
+	bench->samples = ast_calloc(max, sizeof(*bench->samples));
+	if (!bench->samples) {
+		return -1;
+	}
+	bench->count = 0;
+	bench->max = max;
+	bench->start = ast_tvnow();
+	return 0;
+}
+
+static void bench_record(struct bench *bench, struct timeval start)
+{
+	struct timeval now = ast_tvnow();
+
+	if (bench->count < bench->max) {
+		bench->samples[bench->count++] = ast_tvdiff_us(now, start) * 1000;
+	}
+}
+
+static int bench_sample_cmp(const void *left, const void *right)
+{
+	int64_t l = *(const int64_t *) left;
+	int64_t r = *(const int64_t *) right;
+
+	return l < r ? -1 : l > r;
+}
+
+/*!
+ * \internal
+ * \brief Report a benchmark run and free its samples
+ */
+static void bench_report(struct ast_test *test, struct bench *bench, const char *what,
+	size_t ops)
+{
+	int64_t elapsed;
+
+	bench->end = ast_tvnow();
+	elapsed = ast_tvdiff_us(bench->end, bench->start);
+
+	qsort(bench->samples, bench->count, sizeof(*bench->samples), bench_sample_cmp);
+
+	ast_test_status_update(test, "%s: %zu ops in %" PRId64 " us, %.0f ops/sec\n",
+		what, ops, elapsed, elapsed ? ops * 1000000.0 / elapsed : 0.0);
+	if (bench->count) {
+		ast_test_status_update(test, "%s: latency p50 %" PRId64 " ns, p99 %" PRId64
+			" ns, max %" PRId64 " ns\n", what,
+			bench->samples[bench->count / 2],
+			bench->samples[bench->count * 99 / 100],
+			bench->samples[bench->count - 1]);
+	}
+
+	ast_free(bench->samples);
+	bench->samples = NULL;
+}
+
+/*! \brief Absolute deadline for waiting on queued benchmark work */
+static struct timespec bench_deadline(void)
+{
+	struct timeval when = ast_tvadd(ast_tvnow(), ast_tv(BENCH_WAIT_SECONDS, 0));
+	struct timespec ts = {
+		.tv_sec = when.tv_sec,
+		.tv_nsec = when.tv_usec * 1000,
+	};
+
+	return ts;
+}
+
+struct bench_obj {
+	int key;
+};
+
+static int bench_obj_hash(const void *obj, const int flags)
+{
+	const struct bench_obj *object = obj;
+	const int *key = obj;
+
+	return (flags & OBJ_SEARCH_MASK) == OBJ_SEARCH_KEY ? *key : object->key;
+}
+
+static int bench_obj_cmp(void *obj, void *arg, int flags)
+{
+	const struct bench_obj *object = obj;
+	const struct bench_obj *object_right = arg;
+	const int *key = arg;
+
+	if ((flags & OBJ_SEARCH_MASK) == OBJ_SEARCH_KEY) {
+		return object->key == *key ? CMP_MATCH : 0;
+	}
+	return object->key == object_right->key ? CMP_MATCH : 0;
+}
+
+AST_TEST_DEFINE(bench_ao2_hash)
+{
+	struct ao2_container *container;
+	struct bench_obj *obj;
+	struct bench bench;
+	struct timeval start;
+	enum ast_test_result_state res = AST_TEST_PASS;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "ao2_hash";
+		info->category = "/main/benchmark/";
+		info->summary = "Benchmark an ao2 hash container";
+		info->description =
+			"Links, finds and unlinks " __stringify(BENCH_OPS) " objects in an ao2\n"
+			"hash container and reports the rate and latency of each.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	container = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0, BENCH_HASH_BUCKETS,
+		bench_obj_hash, NULL, bench_obj_cmp);
+	if (!container || bench_init(&bench, BENCH_OPS)) {
+		ao2_cleanup(container);
+		return AST_TEST_FAIL;
+	}
+
+	for (i = 0; i < BENCH_OPS; ++i) {
+		obj = ao2_alloc_options(sizeof(*obj), NULL, AO2_ALLOC_OPT_LOCK_NOLOCK);
+		if (!obj) {
+			res = AST_TEST_FAIL;
+			break;
+		}
+		obj->key = i;
+		start = ast_tvnow();
+		ao2_link(container, obj);
+		bench_record(&bench, start);
+		ao2_ref(obj, -1);
+	}
+	bench_report(test, &bench, "ao2_link", i);
+
+	if (res == AST_TEST_PASS && !bench_init(&bench, BENCH_OPS)) {
+		for (i = 0; i < BENCH_OPS; ++i) {
+			start = ast_tvnow();
+			obj = ao2_find(container, &i, OBJ_SEARCH_KEY);
+			bench_record(&bench, start);
+			if (!obj) {
+				ast_test_status_update(test, "Object %d not found\n", i);
+				res = AST_TEST_FAIL;
+				break;
+			}
+			ao2_ref(obj, -1);
+		}
+		bench_report(test, &bench, "ao2_find", i);
+	}
+
+	if (res == AST_TEST_PASS && !bench_init(&bench, BENCH_OPS)) {
+		for (i = 0; i < BENCH_OPS; ++i) {
+			start = ast_tvnow();
+			ao2_find(container, &i, OBJ_SEARCH_KEY | OBJ_UNLINK | OBJ_NODATA);
+			bench_record(&bench, start);
+		}
+		bench_report(test, &bench, "ao2_unlink", i);
+	}
+
+	ao2_ref(container, -1);
+
+	return res;
+}
+
+/*! \brief Shared state of the taskprocessor benchmark */
+struct bench_tps {
+	struct bench bench;
+	struct ast_sem done;
+	int remaining;
+};
+
+/*! \brief A task timing its wait in the queue */
+struct bench_task {
+	struct bench_tps *state;
+	struct timeval pushed;
+};
+
+static int bench_task_exec(void *data)
+{
+	struct bench_task *task = data;
+	struct bench_tps *state = task->state;
+
+	bench_record(&state->bench, task->pushed);
+	ast_free(task);
+	if (ast_atomic_fetchadd_int(&state->remaining, -1) == 1) {
+		ast_sem_post(&state->done);
+	}
+	return 0;
+}
+
+AST_TEST_DEFINE(bench_taskprocessor)
+{
+	struct ast_taskprocessor *tps;
+	struct bench_tps state;
+	struct bench_task *task;
+	struct timespec deadline;
+	enum ast_test_result_state res = AST_TEST_PASS;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "taskprocessor";
+		info->category = "/main/benchmark/";
+		info->summary = "Benchmark taskprocessor push and execution";
+		info->description =
+			"Pushes " __stringify(BENCH_OPS) " tasks to a taskprocessor and reports\n"
+			"the task rate and the time each task waited to be run.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	tps = ast_taskprocessor_get("test/benchmark", TPS_REF_DEFAULT);
+	if (!tps) {
+		return AST_TEST_FAIL;
+	}
+	if (bench_init(&state.bench, BENCH_OPS)) {
+		ast_taskprocessor_unreference(tps);
+		return AST_TEST_FAIL;
+	}
+	ast_sem_init(&state.done, 0, 0);
+	state.remaining = BENCH_OPS;
+
+	for (i = 0; i < BENCH_OPS; ++i) {
+		task = ast_malloc(sizeof(*task));
+		if (!task) {
+			break;
+		}
+		task->state = &state;
+		task->pushed = ast_tvnow();
+		if (ast_taskprocessor_push(tps, bench_task_exec, task)) {
+			ast_free(task);
+			break;
+		}
+	}
+
+	if (i < BENCH_OPS) {
+		/* Tasks that were never pushed will not count down */
+		if (ast_atomic_fetchadd_int(&state.remaining, -(BENCH_OPS - i)) == BENCH_OPS - i) {
+			ast_sem_post(&state.done);
+		}
+		res = AST_TEST_FAIL;
+	}
+
+	deadline = bench_deadline();
+	if (ast_sem_timedwait(&state.done, &deadline)) {
+		ast_test_status_update(test, "Timed out waiting for tasks to run\n");
+		/* The tasks reference state, so it can not be released */
+		ast_taskprocessor_unreference(tps);
+		return AST_TEST_FAIL;
+	}
+
+	bench_report(test, &state.bench, "taskprocessor", i);
+	ast_taskprocessor_unreference(tps);
+	ast_sem_destroy(&state.done);
+
+	return res;
+}
+
+static int bench_sched_cb(const void *data)
+{
+	return 0;
+}
+
+AST_TEST_DEFINE(bench_sched)
+{
+	struct ast_sched_context *con;
+	struct bench bench;
+	struct timeval start;
+	int *ids;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "sched";
+		info->category = "/main/benchmark/";
+		info->summary = "Benchmark scheduler add and delete";
+		info->description =
+			"Adds " __stringify(BENCH_OPS) " entries to a scheduler context, then\n"
+			"deletes them, and reports the rate and latency of each.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	con = ast_sched_context_create();
+	ids = ast_calloc(BENCH_OPS, sizeof(*ids));
+	if (!con || !ids || bench_init(&bench, BENCH_OPS)) {
+		ast_free(ids);
+		if (con) {
+			ast_sched_context_destroy(con);
+		}
+		return AST_TEST_FAIL;
+	}
+
+	for (i = 0; i < BENCH_OPS; ++i) {
+		start = ast_tvnow();
+		/* Spread the entries so they are not all at the same time */
+		ids[i] = ast_sched_add(con, 60000 + ast_random() % 60000, bench_sched_cb, NULL);
+		bench_record(&bench, start);
+	}
+	bench_report(test, &bench, "ast_sched_add", BENCH_OPS);
+
+	if (!bench_init(&bench, BENCH_OPS)) {
+		for (i = 0; i < BENCH_OPS; ++i) {
+			start = ast_tvnow();
+			AST_SCHED_DEL(con, ids[i]);
+			bench_record(&bench, start);
+		}
+		bench_report(test, &bench, "ast_sched_del", BENCH_OPS);
+	}
+
+	ast_free(ids);
+	ast_sched_context_destroy(con);
+
+	return AST_TEST_PASS;
+}
+
+/*! \brief Shared state of the stasis benchmark */
+struct bench_stasis {
+	struct ast_sem done;
+	int remaining;
+};
+
+static void bench_stasis_cb(void *data, struct stasis_subscription *sub,
+	struct stasis_message *message)
+{
+	struct bench_stasis *state = data;
+
+	if (stasis_subscription_final_message(sub, message)) {
+		return;
+	}
+	if (ast_atomic_fetchadd_int(&state->remaining, -1) == 1) {
+		ast_sem_post(&state->done);
+	}
+}
+
+AST_TEST_DEFINE(bench_stasis_fanout)
+{
+	struct stasis_message_type *type = NULL;
+	struct stasis_topic *topic;
+	struct stasis_subscription *subs[BENCH_SUBSCRIBERS] = { NULL, };
+	struct stasis_message *message;
+	struct bench_stasis state;
+	struct bench bench;
+	struct timeval start;
+	struct timespec deadline;
+	struct ao2_container *payload;
+	enum ast_test_result_state res = AST_TEST_PASS;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "stasis_fanout";
+		info->category = "/main/benchmark/";
+		info->summary = "Benchmark stasis publish fan-out";
+		info->description =
+			"Publishes " __stringify(BENCH_MESSAGES) " messages to a topic with "
+			__stringify(BENCH_SUBSCRIBERS) "\n"
+			"subscribers and reports the publish latency and delivery rate.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	topic = stasis_topic_create("test/benchmark");
+	payload = ao2_container_alloc_list(AO2_ALLOC_OPT_LOCK_NOLOCK, 0, NULL, NULL);
+	if (!topic || !payload
+		|| stasis_message_type_create("BenchmarkMessage", NULL, &type) != STASIS_MESSAGE_TYPE_SUCCESS) {
+		ao2_cleanup(payload);
+		ao2_cleanup(topic);
+		ao2_cleanup(type);
+		return AST_TEST_FAIL;
+	}
+
+	ast_sem_init(&state.done, 0, 0);
+	state.remaining = BENCH_MESSAGES * BENCH_SUBSCRIBERS;
+
+	for (i = 0; i < BENCH_SUBSCRIBERS; ++i) {
+		subs[i] = stasis_subscribe(topic, bench_stasis_cb, &state);
+		if (!subs[i]) {
+			res = AST_TEST_FAIL;
+			goto cleanup;
+		}
+	}
+
+	message = stasis_message_create(type, payload);
+	if (!message || bench_init(&bench, BENCH_MESSAGES)) {
+		ao2_cleanup(message);
+		res = AST_TEST_FAIL;
+		goto cleanup;
+	}
+
+	for (i = 0; i < BENCH_MESSAGES; ++i) {
+		start = ast_tvnow();
+		stasis_publish(topic, message);
+		bench_record(&bench, start);
+	}
+	ao2_ref(message, -1);
+
+	deadline = bench_deadline();
+	if (ast_sem_timedwait(&state.done, &deadline)) {
+		ast_test_status_update(test, "Timed out waiting for deliveries\n");
+		res = AST_TEST_FAIL;
+	}
+	bench_report(test, &bench, "stasis deliveries", BENCH_MESSAGES * BENCH_SUBSCRIBERS);
+
+cleanup:
+	for (i = 0; i < BENCH_SUBSCRIBERS; ++i) {
+		stasis_unsubscribe_and_join(subs[i]);
+	}
+	ast_sem_destroy(&state.done);
+	ao2_ref(payload, -1);
+	ao2_ref(topic, -1);
+	ao2_ref(type, -1);
+
+	return res;
+}
+
+AST_TEST_DEFINE(bench_translate)
+{
+	struct ast_trans_pvt *path;
+	struct ast_frame *out;
+	struct bench bench;
+	struct timeval start;
+	int16_t samples[160] = { 0, };
+	struct ast_frame frame = {
+		.frametype = AST_FRAME_VOICE,
+		.datalen = sizeof(samples),
+		.samples = ARRAY_LEN(samples),
+		.src = __PRETTY_FUNCTION__,
+		.data.ptr = samples,
+	};
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "translate";
+		info->category = "/main/benchmark/";
+		info->summary = "Benchmark slin to ulaw translation";
+		info->description =
+			"Translates " __stringify(BENCH_FRAMES) " 20ms signed linear frames to\n"
+			"ulaw and reports the rate and latency of each translation.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	path = ast_translator_build_path(ast_format_ulaw, ast_format_slin);
+	if (!path) {
+		ast_test_status_update(test, "No slin to ulaw translation path, is codec_ulaw loaded?\n");
+		return AST_TEST_NOT_RUN;
+	}
+
+	if (bench_init(&bench, BENCH_FRAMES)) {
+		ast_translator_free_path(path);
+		return AST_TEST_FAIL;
+	}
+
+	frame.subclass.format = ast_format_slin;
+	for (i = 0; i < ARRAY_LEN(samples); ++i) {
+		samples[i] = (int16_t) (ast_random() & 0x7fff);
+	}
+
+	for (i = 0; i < BENCH_FRAMES; ++i) {
+		start = ast_tvnow();
+		out = ast_translate(path, &frame, 0);
+		bench_record(&bench, start);
+		if (out) {
+			ast_frfree(out);
+		}
+	}
+	bench_report(test, &bench, "slin to ulaw", BENCH_FRAMES);
+
+	ast_translator_free_path(path);
+
+	return AST_TEST_PASS;
+}
+
+static int unload_module(void)
+{
+	AST_TEST_UNREGISTER(bench_ao2_hash);
+	AST_TEST_UNREGISTER(bench_taskprocessor);
+	AST_TEST_UNREGISTER(bench_sched);
+	AST_TEST_UNREGISTER(bench_stasis_fanout);
+	AST_TEST_UNREGISTER(bench_translate);
+	return 0;
+}
+
+static int load_module(void)
+{
+	AST_TEST_REGISTER(bench_ao2_hash);
+	AST_TEST_REGISTER(bench_taskprocessor);
+	AST_TEST_REGISTER(bench_sched);
+	AST_TEST_REGISTER(bench_stasis_fanout);
+	AST_TEST_REGISTER(bench_translate);
+	return AST_MODULE_LOAD_SUCCESS;
+}
+
+AST_MODULE_INFO_STANDARD(ASTERISK_GPL_KEY, "Core hot path benchmarks");
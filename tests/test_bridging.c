@@ -52,6 +52,10 @@ struct test_bridging_chan_pvt {
 	int condition;
 	/*! \brief The number of indicated things */
 	unsigned int indicated;
+	/*! \brief Hold voice frames written by another channel's bridge thread */
+	int hold_direct;
+	/*! \brief Set while a held voice frame is being written */
+	int in_direct_write;
 };
 
 /*! \brief Callback function for when a frame is written to a channel */
@@ -66,6 +70,33 @@ static int test_bridging_chan_indicate(struct ast_channel *chan, int condition,
 	return 0;
 }
 
+/*! \brief Callback function for when a frame is written to a channel */
+static int test_bridging_chan_write(struct ast_channel *chan, struct ast_frame *frame)
+{
+	struct test_bridging_chan_pvt *test_pvt = ast_channel_tech_pvt(chan);
+	struct ast_bridge_channel *bridge_channel;
+
+	if (frame->frametype != AST_FRAME_VOICE || !test_pvt->hold_direct) {
+		return 0;
+	}
+
+	/* Only hold frames written directly from the other party's bridge thread */
+	bridge_channel = ast_channel_internal_bridge_channel(chan);
+	if (!bridge_channel || pthread_equal(bridge_channel->thread, pthread_self())) {
+		return 0;
+	}
+
+	test_pvt->in_direct_write = 1;
+	while (test_pvt->hold_direct) {
+		struct timespec sleep_time = {0, 1000000};
+
+		nanosleep(&sleep_time, NULL);
+	}
+	test_pvt->in_direct_write = 0;
+
+	return 0;
+}
+
 /*! \brief Callback function for when a channel is hung up */
 static int test_bridging_chan_hangup(struct ast_channel *chan)
 {
@@ -82,6 +113,7 @@ static struct ast_channel_tech test_bridging_chan_tech = {
 	.type = CHANNEL_TECH_NAME,
 	.description = "Mock channel technology for bridge tests",
 	.indicate = test_bridging_chan_indicate,
+	.write = test_bridging_chan_write,
 	.hangup = test_bridging_chan_hangup,
 	.properties = AST_CHAN_TP_INTERNAL,
 };
@@ -262,8 +294,92 @@ AST_TEST_DEFINE(test_bridging_deferred_queue)
 	return AST_TEST_PASS;
 }
 
+AST_TEST_DEFINE(test_bridging_direct_write_unlocked)
+{
+	RAII_VAR(struct ast_channel *, chan_alice, NULL, safe_channel_release);
+	struct test_bridging_chan_pvt *alice_pvt;
+	RAII_VAR(struct ast_channel *, chan_bob, NULL, safe_channel_release);
+	struct test_bridging_chan_pvt *bob_pvt;
+	RAII_VAR(struct ast_bridge *, bridge1, NULL, safe_bridge_destroy);
+	short samples[160] = { 0, };
+	struct ast_frame frame = {
+		.frametype = AST_FRAME_VOICE,
+		.data.ptr = samples,
+		.datalen = sizeof(samples),
+		.samples = ARRAY_LEN(samples),
+		.src = __func__,
+		.stream_num = -1,
+	};
+	int ms;
+	int tries;
+	int locked;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = TEST_CATEGORY;
+		info->summary = "Test that voice frames are written directly without the bridge lock";
+		info->description =
+			"This test places two channels into a bridge and streams voice frames from\n"
+			"one of them. The write of a frame passed straight to the other channel is\n"
+			"held, and the bridge must be lockable from another thread in the meantime.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	frame.subclass.format = TEST_CHANNEL_FORMAT;
+
+	bridge1 = ast_bridge_basic_new();
+	ast_test_validate(test, bridge1 != NULL);
+
+	START_ALICE(chan_alice, alice_pvt);
+	START_BOB(chan_bob, bob_pvt);
+	bob_pvt->hold_direct = 1;
+
+	ast_test_validate(test, !ast_bridge_impart(bridge1, chan_alice, NULL, NULL, AST_BRIDGE_IMPART_CHAN_DEPARTABLE));
+	wait_for_bridged(chan_alice);
+	ast_test_validate(test, !ast_bridge_impart(bridge1, chan_bob, NULL, NULL, AST_BRIDGE_IMPART_CHAN_DEPARTABLE));
+	wait_for_bridged(chan_bob);
+
+	/* Stream voice from alice until one of the frames is written directly to bob */
+	for (ms = 0; ms < 5000 && !bob_pvt->in_direct_write; ms += 20) {
+		ast_queue_frame(chan_alice, &frame);
+		test_nanosleep(0, 20000000);
+	}
+
+	/*
+	 * Alice's bridge thread is stuck inside the write, so the bridge must
+	 * not be locked. Retry for a bit in case bob's bridge thread has it.
+	 */
+	locked = 0;
+	for (tries = 0; bob_pvt->in_direct_write && !locked && tries < 100; ++tries) {
+		locked = !ast_bridge_trylock(bridge1);
+		if (locked) {
+			ast_bridge_unlock(bridge1);
+		} else {
+			test_nanosleep(0, 1000000);
+		}
+	}
+	bob_pvt->hold_direct = 0;
+
+	ast_test_validate(test, !ast_bridge_depart(chan_bob));
+	wait_for_unbridged(chan_bob);
+	ast_test_validate(test, !ast_bridge_depart(chan_alice));
+	wait_for_unbridged(chan_alice);
+
+	HANGUP_CHANNEL(chan_alice);
+	HANGUP_CHANNEL(chan_bob);
+
+	ast_test_validate(test, ms < 5000);
+	ast_test_validate(test, locked);
+
+	return AST_TEST_PASS;
+}
+
 static int unload_module(void)
 {
+	AST_TEST_UNREGISTER(test_bridging_direct_write_unlocked);
 	AST_TEST_UNREGISTER(test_bridging_deferred_queue);
 
 	ast_channel_unregister(&test_bridging_chan_tech);
@@ -283,6 +399,7 @@ static int load_module(void)
 	ast_channel_register(&test_bridging_chan_tech);
 
 	AST_TEST_REGISTER(test_bridging_deferred_queue);
+	AST_TEST_REGISTER(test_bridging_direct_write_unlocked);
 
 	return AST_MODULE_LOAD_SUCCESS;
 }
@@ -1680,6 +1680,96 @@ AST_TEST_DEFINE(test_cel_local_optimize)
 	return AST_TEST_PASS;
 }
 
+#define TEST_BATCH_BACKEND_NAME "CEL Test Batch Logging"
+
+/*! \brief Lock protecting the batch backend state below */
+AST_MUTEX_DEFINE_STATIC(batch_lock);
+
+/*! \brief Fail every batch handed to the batch backend while set */
+static int batch_fail;
+
+/*! \brief Number of batches the batch backend refused */
+static int batch_failures;
+
+/*! \brief Number of test channel events the batch backend accepted */
+static int batch_received;
+
+static int test_batch_sub(struct ast_event **events, size_t count)
+{
+	SCOPED_MUTEX(lock, &batch_lock);
+	size_t i;
+
+	if (batch_fail) {
+		++batch_failures;
+		return -1;
+	}
+
+	for (i = 0; i < count; ++i) {
+		const char *chan_name = ast_event_get_ie_str(events[i], AST_EVENT_IE_CEL_CHANNAME);
+
+		if (chan_name && !strncmp(chan_name, CHANNEL_TECH_NAME, 14)) {
+			++batch_received;
+		}
+	}
+
+	return 0;
+}
+
+AST_TEST_DEFINE(test_cel_batch_spool)
+{
+	RAII_VAR(struct ast_channel *, chan, NULL, safe_channel_release);
+	struct ast_party_caller caller = ALICE_CALLERID;
+	int received = 0;
+	int failures;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = TEST_CATEGORY;
+		info->summary = "Test batched CEL backends";
+		info->description =
+			"Test that events a batched backend fails to write are\n"
+			"spooled and written once the backend recovers.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	batch_fail = 1;
+	batch_failures = 0;
+	batch_received = 0;
+	if (ast_cel_backend_register_batch(TEST_BATCH_BACKEND_NAME, test_batch_sub, 4, 100, 8)) {
+		return AST_TEST_FAIL;
+	}
+
+	for (i = 0; i < 2; ++i) {
+		CREATE_ALICE_CHANNEL(chan, (&caller));
+		HANGUP_CHANNEL(chan, AST_CAUSE_NORMAL, "");
+	}
+	do_sleep();
+
+	ast_mutex_lock(&batch_lock);
+	failures = batch_failures;
+	batch_fail = 0;
+	ast_mutex_unlock(&batch_lock);
+
+	/* Spooled events are only retried after a backoff of several seconds */
+	for (i = 0; i < 150 && received < 6; ++i) {
+		usleep(100000);
+		ast_mutex_lock(&batch_lock);
+		received = batch_received;
+		ast_mutex_unlock(&batch_lock);
+	}
+
+	ast_cel_backend_unregister(TEST_BATCH_BACKEND_NAME);
+
+	ast_test_validate(test, failures > 0);
+	ast_test_validate(test, received == 6);
+
+	return AST_TEST_PASS;
+}
+
 /*! Container for astobj2 duplicated ast_events */
 static struct ao2_container *cel_received_events = NULL;
 
@@ -2140,6 +2230,7 @@ static int unload_module(void)
 	AST_TEST_UNREGISTER(test_cel_dial_pickup);
 
 	AST_TEST_UNREGISTER(test_cel_local_optimize);
+	AST_TEST_UNREGISTER(test_cel_batch_spool);
 
 	ast_channel_unregister(&test_cel_chan_tech);
 
@@ -2219,6 +2310,7 @@ static int load_module(void)
 	AST_TEST_REGISTER(test_cel_dial_pickup);
 
 	AST_TEST_REGISTER(test_cel_local_optimize);
+	AST_TEST_REGISTER(test_cel_batch_spool);
 
 	/* ast_test_register_* has to happen after AST_TEST_REGISTER */
 	/* Verify received vs expected events and clean things up after every test */
@@ -102,10 +102,189 @@ done:
 	return res;
 }
 
+/*! \brief Count the channels an iterator returns */
+static int iterator_count(struct ast_channel_iterator *iter)
+{
+	struct ast_channel *chan;
+	int count = 0;
+
+	if (!iter) {
+		return -1;
+	}
+
+	while ((chan = ast_channel_iterator_next(iter))) {
+		++count;
+		ast_channel_unref(chan);
+	}
+	ast_channel_iterator_destroy(iter);
+
+	return count;
+}
+
+AST_TEST_DEFINE(lookup_index)
+{
+	struct ast_channel *alpha = NULL;
+	struct ast_channel *beta = NULL;
+	struct ast_channel *gamma = NULL;
+	struct ast_channel *found;
+	enum ast_test_result_state res = AST_TEST_PASS;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "lookup_index";
+		info->category = "/main/channel/";
+		info->summary = "channel name prefix and linkedid lookup test";
+		info->description =
+			"Test that channels are found by name prefix and linkedid, including after renames and linkedid changes";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	alpha = ast_channel_alloc(0, AST_STATE_DOWN, NULL, NULL, NULL, NULL, NULL, NULL, NULL, 0, "TestIndex/alpha-1");
+	beta = ast_channel_alloc(0, AST_STATE_DOWN, NULL, NULL, NULL, NULL, NULL, NULL, NULL, 0, "TestIndex/ALPHA-2");
+	gamma = ast_channel_alloc(0, AST_STATE_DOWN, NULL, NULL, NULL, NULL, NULL, NULL, NULL, 0, "TestIndex/beta-1");
+	ast_test_validate_cleanup(test, alpha && beta && gamma, res, done);
+	ast_channel_unlock(alpha);
+	ast_channel_unlock(beta);
+	ast_channel_unlock(gamma);
+
+	ast_test_validate_cleanup(test, iterator_count(ast_channel_iterator_by_name_new("testindex/alpha", 15)) == 2, res, done);
+	ast_test_validate_cleanup(test, iterator_count(ast_channel_iterator_by_name_new("TestIndex/", 10)) == 3, res, done);
+	ast_test_validate_cleanup(test, iterator_count(ast_channel_iterator_by_name_new("TestIndex/gamma", 15)) == 0, res, done);
+
+	found = ast_channel_get_by_name_prefix("TestIndex/beta", 14);
+	ast_test_validate_cleanup(test, found == gamma, res, done);
+	ast_channel_cleanup(found);
+
+	ast_change_name(gamma, "TestIndex/alpha-3");
+	ast_test_validate_cleanup(test, iterator_count(ast_channel_iterator_by_name_new("TestIndex/alpha", 15)) == 3, res, done);
+	found = ast_channel_get_by_name_prefix("TestIndex/beta", 14);
+	ast_test_validate_cleanup(test, !found, res, done);
+
+	ast_test_validate_cleanup(test, iterator_count(ast_channel_iterator_by_linkedid_new(ast_channel_linkedid(alpha))) == 1, res, done);
+	ast_channel_internal_copy_linkedid(beta, alpha);
+	ast_channel_internal_copy_linkedid(gamma, alpha);
+	ast_test_validate_cleanup(test, iterator_count(ast_channel_iterator_by_linkedid_new(ast_channel_linkedid(alpha))) == 3, res, done);
+
+	ast_hangup(beta);
+	beta = NULL;
+	ast_test_validate_cleanup(test, iterator_count(ast_channel_iterator_by_linkedid_new(ast_channel_linkedid(alpha))) == 2, res, done);
+	ast_test_validate_cleanup(test, iterator_count(ast_channel_iterator_by_name_new("TestIndex/alpha", 15)) == 2, res, done);
+
+done:
+	if (alpha) {
+		ast_hangup(alpha);
+	}
+	if (beta) {
+		ast_hangup(beta);
+	}
+	if (gamma) {
+		ast_hangup(gamma);
+	}
+
+	return res;
+}
+
+#define WAITFOR_PIPES 10
+
+AST_TEST_DEFINE(waitfor_many_fds)
+{
+	struct ast_channel *mock_channel;
+	struct ast_channel *winner;
+	enum ast_test_result_state res = AST_TEST_PASS;
+	int pipes[WAITFOR_PIPES][2];
+	int extra[2] = { -1, -1 };
+	int outfd;
+	int ms;
+	int pos;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "waitfor_many_fds";
+		info->category = "/main/channel/";
+		info->summary = "channel waiting on many file descriptors test";
+		info->description =
+			"Test that waiting on a channel with many file descriptors reports the ready one, including after the descriptors change";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	for (pos = 0; pos < WAITFOR_PIPES; pos++) {
+		pipes[pos][0] = pipes[pos][1] = -1;
+	}
+
+	mock_channel = ast_channel_alloc(0, AST_STATE_DOWN, NULL, NULL, NULL, NULL, NULL, NULL, NULL, 0, "TestChannel");
+	ast_test_validate_cleanup(test, mock_channel, res, done);
+	ast_channel_unlock(mock_channel);
+
+	for (pos = 0; pos < WAITFOR_PIPES; pos++) {
+		ast_test_validate_cleanup(test, !pipe(pipes[pos]), res, done);
+		ast_channel_set_fd(mock_channel, AST_EXTENDED_FDS + pos, pipes[pos][0]);
+	}
+	ast_test_validate_cleanup(test, !pipe(extra), res, done);
+
+	ms = 0;
+	winner = ast_waitfor_n(&mock_channel, 1, &ms);
+	ast_test_validate_cleanup(test, !winner, res, done);
+
+	/* Waiting twice on the same fds must keep reporting the ready one */
+	ast_test_validate_cleanup(test, write(pipes[3][1], "x", 1) == 1, res, done);
+	for (pos = 0; pos < 2; pos++) {
+		ms = 1000;
+		winner = ast_waitfor_n(&mock_channel, 1, &ms);
+		ast_test_validate_cleanup(test, winner == mock_channel, res, done);
+		ast_test_validate_cleanup(test, ast_channel_fdno(mock_channel) == AST_EXTENDED_FDS + 3, res, done);
+	}
+
+	/* Replacing the fd must stop reporting the old one */
+	ast_channel_set_fd(mock_channel, AST_EXTENDED_FDS + 3, pipes[4][0]);
+	ast_channel_set_fd(mock_channel, AST_EXTENDED_FDS + 4, -1);
+	ms = 0;
+	winner = ast_waitfor_n(&mock_channel, 1, &ms);
+	ast_test_validate_cleanup(test, !winner, res, done);
+
+	ast_test_validate_cleanup(test, write(pipes[4][1], "x", 1) == 1, res, done);
+	ms = 1000;
+	winner = ast_waitfor_n(&mock_channel, 1, &ms);
+	ast_test_validate_cleanup(test, winner == mock_channel, res, done);
+	ast_test_validate_cleanup(test, ast_channel_fdno(mock_channel) == AST_EXTENDED_FDS + 3, res, done);
+
+	/* Individual fds take priority over channel fds */
+	ast_test_validate_cleanup(test, write(extra[1], "x", 1) == 1, res, done);
+	ms = 1000;
+	outfd = -1;
+	winner = ast_waitfor_nandfds(&mock_channel, 1, &extra[0], 1, NULL, &outfd, &ms);
+	ast_test_validate_cleanup(test, !winner && outfd == extra[0], res, done);
+
+done:
+	if (mock_channel) {
+		for (pos = 0; pos < WAITFOR_PIPES; pos++) {
+			ast_channel_set_fd(mock_channel, AST_EXTENDED_FDS + pos, -1);
+		}
+		ast_hangup(mock_channel);
+	}
+	for (pos = 0; pos < WAITFOR_PIPES; pos++) {
+		if (pipes[pos][0] > -1) {
+			close(pipes[pos][0]);
+			close(pipes[pos][1]);
+		}
+	}
+	if (extra[0] > -1) {
+		close(extra[0]);
+		close(extra[1]);
+	}
+
+	return res;
+}
+
 static int unload_module(void)
 {
 	AST_TEST_UNREGISTER(set_fd_grow);
 	AST_TEST_UNREGISTER(add_fd);
+	AST_TEST_UNREGISTER(lookup_index);
+	AST_TEST_UNREGISTER(waitfor_many_fds);
 	return 0;
 }
 
@@ -113,6 +292,8 @@ static int load_module(void)
 {
 	AST_TEST_REGISTER(set_fd_grow);
 	AST_TEST_REGISTER(add_fd);
+	AST_TEST_REGISTER(lookup_index);
+	AST_TEST_REGISTER(waitfor_many_fds);
 	return AST_MODULE_LOAD_SUCCESS;
 }
 
@@ -848,6 +848,84 @@ cleanup:
 	return res;
 }
 
+AST_TEST_DEFINE(resolver_resolve_sync_cached)
+{
+	RAII_VAR(struct ast_dns_result *, result, NULL, ast_dns_result_free);
+	RAII_VAR(struct ast_dns_result *, cached, NULL, ast_dns_result_free);
+	const struct ast_dns_record *record;
+	const struct ast_dns_record *cached_record;
+	enum ast_test_result_state res = AST_TEST_PASS;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "resolver_resolve_sync_cached";
+		info->category = "/main/dns/";
+		info->summary = "Test that a repeated DNS resolution is answered from the cache";
+		info->description =
+			"This test performs the same synchronous DNS resolution twice. The first\n"
+			"resolution must call into the resolver, while the second must be answered\n"
+			"from the cache with the same records and a TTL no longer than the original.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	if (ast_dns_resolver_register(&test_resolver)) {
+		ast_test_status_update(test, "Unable to register test resolver\n");
+		return AST_TEST_FAIL;
+	}
+
+	resolver_data_init();
+
+	if (ast_dns_resolve("asterisk.org", T_A, C_IN, &result) || !result) {
+		ast_test_status_update(test, "Resolution of address failed\n");
+		res = AST_TEST_FAIL;
+		goto cleanup;
+	}
+
+	test_resolver_data.resolve_called = 0;
+
+	if (ast_dns_resolve("asterisk.org", T_A, C_IN, &cached) || !cached) {
+		ast_test_status_update(test, "Repeated resolution of address failed\n");
+		res = AST_TEST_FAIL;
+		goto cleanup;
+	}
+
+	if (test_resolver_data.resolve_called) {
+		ast_test_status_update(test, "Repeated resolution called resolver's resolve() method\n");
+		res = AST_TEST_FAIL;
+		goto cleanup;
+	}
+
+	record = ast_dns_result_get_records(result);
+	cached_record = ast_dns_result_get_records(cached);
+	if (!record || !cached_record) {
+		ast_test_status_update(test, "Resolution yielded no records\n");
+		res = AST_TEST_FAIL;
+		goto cleanup;
+	}
+
+	if (ast_dns_record_get_data_size(record) != ast_dns_record_get_data_size(cached_record)
+		|| memcmp(ast_dns_record_get_data(record), ast_dns_record_get_data(cached_record),
+			ast_dns_record_get_data_size(record))) {
+		ast_test_status_update(test, "Cached record differs from the resolved record\n");
+		res = AST_TEST_FAIL;
+		goto cleanup;
+	}
+
+	if (ast_dns_record_get_ttl(cached_record) > ast_dns_record_get_ttl(record)) {
+		ast_test_status_update(test, "Cached record TTL %d exceeds the original TTL %d\n",
+			ast_dns_record_get_ttl(cached_record), ast_dns_record_get_ttl(record));
+		res = AST_TEST_FAIL;
+		goto cleanup;
+	}
+
+cleanup:
+	ast_dns_resolver_unregister(&test_resolver);
+	resolver_data_cleanup();
+	return res;
+}
+
 /*!
  * \brief A resolve() method that simply fails
  *
@@ -1307,6 +1385,7 @@ static int unload_module(void)
 	AST_TEST_UNREGISTER(resolver_add_record);
 	AST_TEST_UNREGISTER(resolver_add_record_off_nominal);
 	AST_TEST_UNREGISTER(resolver_resolve_sync);
+	AST_TEST_UNREGISTER(resolver_resolve_sync_cached);
 	AST_TEST_UNREGISTER(resolver_resolve_sync_off_nominal);
 	AST_TEST_UNREGISTER(resolver_resolve_async);
 	AST_TEST_UNREGISTER(resolver_resolve_async_off_nominal);
@@ -1326,6 +1405,7 @@ static int load_module(void)
 	AST_TEST_REGISTER(resolver_add_record);
 	AST_TEST_REGISTER(resolver_add_record_off_nominal);
 	AST_TEST_REGISTER(resolver_resolve_sync);
+	AST_TEST_REGISTER(resolver_resolve_sync_cached);
 	AST_TEST_REGISTER(resolver_resolve_sync_off_nominal);
 	AST_TEST_REGISTER(resolver_resolve_async);
 	AST_TEST_REGISTER(resolver_resolve_async_off_nominal);
@@ -25,8 +25,14 @@
 #include "asterisk.h"
 #include <sys/stat.h>
 #include <stdio.h>
+#include <math.h>
+#include <utime.h>
 
 #include "asterisk/file.h"
+#include "asterisk/channel.h"
+#include "asterisk/format_cache.h"
+#include "asterisk/mod_format.h"
+#include "asterisk/options.h"
 #include "asterisk/paths.h"
 #include "asterisk/test.h"
 #include "asterisk/module.h"
@@ -180,15 +186,416 @@ AST_TEST_DEFINE(read_dirs_test)
 	return res;
 }
 
+/*! \brief What the prompt cache test channel was sent */
+static struct {
+	/*! ulaw bytes written */
+	unsigned char data[16000];
+	size_t len;
+	/*! Number of frames written */
+	int frames;
+	/*! Number of them played from the prompt cache */
+	int cached;
+} prompt_sent;
+
+static int prompt_cache_chan_write(struct ast_channel *chan, struct ast_frame *frame)
+{
+	if (frame->datalen <= sizeof(prompt_sent.data) - prompt_sent.len) {
+		memcpy(prompt_sent.data + prompt_sent.len, frame->data.ptr, frame->datalen);
+		prompt_sent.len += frame->datalen;
+	}
+	++prompt_sent.frames;
+	if (frame->src && !strcmp(frame->src, "prompt_cache")) {
+		++prompt_sent.cached;
+	}
+
+	return 0;
+}
+
+static const struct ast_channel_tech prompt_cache_chan_tech = {
+	.type = "TestPrompt",
+	.write = prompt_cache_chan_write,
+};
+
+/*!
+ * \internal
+ * \brief Play a file to a ulaw channel to the end.
+ */
+static int prompt_cache_play(struct ast_test *test, const char *filename)
+{
+	struct ast_format_cap *caps;
+	struct ast_channel *chan;
+	int max;
+
+	memset(&prompt_sent, 0, sizeof(prompt_sent));
+
+	caps = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
+	if (!caps || ast_format_cap_append(caps, ast_format_ulaw, 0)) {
+		ao2_cleanup(caps);
+		return -1;
+	}
+	chan = ast_channel_alloc(0, AST_STATE_UP, NULL, NULL, NULL, NULL, NULL, NULL, NULL, 0, "TestPrompt/cache");
+	if (!chan) {
+		ao2_ref(caps, -1);
+		return -1;
+	}
+	ast_channel_tech_set(chan, &prompt_cache_chan_tech);
+	ast_channel_nativeformats_set(chan, caps);
+	ao2_ref(caps, -1);
+	ast_channel_set_rawwriteformat(chan, ast_format_ulaw);
+	ast_channel_set_writeformat(chan, ast_format_ulaw);
+	ast_channel_unlock(chan);
+
+	if (ast_streamfile(chan, filename, NULL)) {
+		ast_test_status_update(test, "Failed to play %s\n", filename);
+		ast_hangup(chan);
+		return -1;
+	}
+	/* Push the frames instead of waiting for the stream timer */
+	for (max = 100; max && !ast_playstream(ast_channel_stream(chan)); --max) {
+	}
+	ast_stopstream(chan);
+	ast_hangup(chan);
+
+	return 0;
+}
+
+AST_TEST_DEFINE(prompt_cache_test)
+{
+	char tmp_dir[] = "/tmp/tmpdir.XXXXXX";
+	char filename[64];
+	char path[sizeof(filename) + 4];
+	unsigned char expected[sizeof(prompt_sent.data)];
+	size_t expected_len;
+	unsigned int saved_size = ast_option_prompt_cache_size;
+	enum ast_test_result_state res = AST_TEST_FAIL;
+	short samples[8000];
+	struct utimbuf times;
+	FILE *file;
+	int idx;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "prompt_cache";
+		info->category = "/main/file/";
+		info->summary = "Play a prompt from the translated prompt cache";
+		info->description =
+			"Plays a signed linear file to a ulaw channel with and without the\n"
+			"prompt cache and checks the channel gets the same audio.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	if (!ast_get_format_for_file_ext("sln")) {
+		ast_test_status_update(test, "format_sln is not loaded\n");
+		return AST_TEST_NOT_RUN;
+	}
+
+	if (!(mkdtemp(tmp_dir))) {
+		ast_test_status_update(test, "Failed to create directory: %s\n", tmp_dir);
+		return AST_TEST_FAIL;
+	}
+	snprintf(filename, sizeof(filename), "%s/prompt", tmp_dir);
+	snprintf(path, sizeof(path), "%s.sln", filename);
+
+	for (idx = 0; idx < ARRAY_LEN(samples); ++idx) {
+		samples[idx] = 8000.0 * sin(2.0 * M_PI * 440.0 * idx / 8000.0);
+	}
+	if (!(file = fopen(path, "w"))) {
+		ast_test_status_update(test, "Failed to create file: %s\n", path);
+		goto cleanup_dir;
+	}
+	idx = fwrite(samples, sizeof(samples), 1, file);
+	fclose(file);
+	if (idx != 1) {
+		ast_test_status_update(test, "Failed to write file: %s\n", path);
+		goto cleanup;
+	}
+	/*
+	 * A file of a previous run may have had the same inode, size and
+	 * modification time and still be in the cache.
+	 */
+	times.actime = times.modtime = ast_random();
+	utime(path, &times);
+
+	/* What the channel translator makes of it */
+	ast_option_prompt_cache_size = 0;
+	if (prompt_cache_play(test, filename)) {
+		goto cleanup;
+	}
+	expected_len = prompt_sent.len;
+	memcpy(expected, prompt_sent.data, expected_len);
+	if (expected_len != ARRAY_LEN(samples)) {
+		ast_test_status_update(test, "Sent %zu bytes of %zu samples\n", expected_len, ARRAY_LEN(samples));
+		goto cleanup;
+	}
+
+	ast_option_prompt_cache_size = 1024;
+	for (idx = 0; idx < 2; ++idx) {
+		if (prompt_cache_play(test, filename)) {
+			goto cleanup;
+		}
+		if (prompt_sent.len != expected_len || memcmp(prompt_sent.data, expected, expected_len)) {
+			ast_test_status_update(test, "Playback %d sent different audio\n", idx + 1);
+			goto cleanup;
+		}
+		/* The first playback fills the cache and the second plays from it */
+		if (prompt_sent.cached != (idx ? prompt_sent.frames : 0)) {
+			ast_test_status_update(test, "Playback %d sent %d of %d frames from the cache\n",
+				idx + 1, prompt_sent.cached, prompt_sent.frames);
+			goto cleanup;
+		}
+	}
+
+	res = AST_TEST_PASS;
+
+cleanup:
+	ast_option_prompt_cache_size = saved_size;
+	unlink(path);
+cleanup_dir:
+	rmdir(tmp_dir);
+	return res;
+}
+
+/*!
+ * \internal
+ * \brief Read a frame from a stream and check it holds the samples expected.
+ */
+static int mmap_check_frame(struct ast_test *test, struct ast_filestream *fs,
+	const short *expected, int samples)
+{
+	struct ast_frame *fr = ast_readframe(fs);
+
+	if (!fr) {
+		ast_test_status_update(test, "Stream ended early\n");
+		return -1;
+	}
+	if (fr->samples != samples || fr->datalen != samples * sizeof(*expected)
+		|| memcmp(fr->data.ptr, expected, fr->datalen)) {
+		ast_test_status_update(test, "Frame of %d samples holds different audio\n", fr->samples);
+		ast_frfree(fr);
+		return -1;
+	}
+	ast_frfree(fr);
+
+	return 0;
+}
+
+AST_TEST_DEFINE(mmap_read_test)
+{
+	char tmp_dir[] = "/tmp/tmpdir.XXXXXX";
+	char filename[64];
+	char path[sizeof(filename) + 4];
+	int saved = ast_opt_mmap_sound_files;
+	enum ast_test_result_state res = AST_TEST_FAIL;
+	struct ast_filestream *fs = NULL;
+	short samples[1000];
+	FILE *file;
+	int idx;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "mmap_read";
+		info->category = "/main/file/";
+		info->summary = "Read a sound file through a memory map";
+		info->description =
+			"Reads, seeks in and tells the position of a mapped signed linear\n"
+			"file and checks the frames hold the right audio.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	if (!ast_get_format_for_file_ext("sln")) {
+		ast_test_status_update(test, "format_sln is not loaded\n");
+		return AST_TEST_NOT_RUN;
+	}
+
+	if (!(mkdtemp(tmp_dir))) {
+		ast_test_status_update(test, "Failed to create directory: %s\n", tmp_dir);
+		return AST_TEST_FAIL;
+	}
+	snprintf(filename, sizeof(filename), "%s/prompt", tmp_dir);
+	snprintf(path, sizeof(path), "%s.sln", filename);
+
+	for (idx = 0; idx < ARRAY_LEN(samples); ++idx) {
+		samples[idx] = idx * 17 - 8000;
+	}
+	if (!(file = fopen(path, "w"))) {
+		ast_test_status_update(test, "Failed to create file: %s\n", path);
+		goto cleanup_dir;
+	}
+	idx = fwrite(samples, sizeof(samples), 1, file);
+	fclose(file);
+	if (idx != 1) {
+		ast_test_status_update(test, "Failed to write file: %s\n", path);
+		goto cleanup;
+	}
+
+	ast_set_flag(&ast_options, AST_OPT_FLAG_MMAP_SOUND_FILES);
+	if (!(fs = ast_readfile(filename, "sln", NULL, O_RDONLY, 0, 0))) {
+		ast_test_status_update(test, "Failed to open %s\n", path);
+		goto cleanup;
+	}
+	if (!fs->map) {
+		ast_test_status_update(test, "File was not mapped\n");
+		goto cleanup;
+	}
+
+	/* 1000 samples are six frames, the last one short */
+	for (idx = 0; idx + 160 <= ARRAY_LEN(samples); idx += 160) {
+		if (mmap_check_frame(test, fs, samples + idx, 160)) {
+			goto cleanup;
+		}
+	}
+	if (mmap_check_frame(test, fs, samples + idx, ARRAY_LEN(samples) - idx)
+		|| ast_readframe(fs)) {
+		ast_test_status_update(test, "Stream did not end with the file\n");
+		goto cleanup;
+	}
+
+	ast_seekstream(fs, 320, SEEK_SET);
+	if (ast_tellstream(fs) != 320 || mmap_check_frame(test, fs, samples + 320, 160)) {
+		ast_test_status_update(test, "Seeking from the start failed\n");
+		goto cleanup;
+	}
+	ast_seekstream(fs, -200, SEEK_CUR);
+	if (ast_tellstream(fs) != 280 || mmap_check_frame(test, fs, samples + 280, 160)) {
+		ast_test_status_update(test, "Seeking back failed\n");
+		goto cleanup;
+	}
+	ast_seekstream(fs, 100, SEEK_END);
+	if (ast_tellstream(fs) != 900 || mmap_check_frame(test, fs, samples + 900, 100)) {
+		ast_test_status_update(test, "Seeking from the end failed\n");
+		goto cleanup;
+	}
+	ast_seekstream(fs, 5000, SEEK_CUR);
+	if (ast_tellstream(fs) != ARRAY_LEN(samples) || ast_readframe(fs)) {
+		ast_test_status_update(test, "Seeking past the end failed\n");
+		goto cleanup;
+	}
+
+	res = AST_TEST_PASS;
+
+cleanup:
+	if (fs) {
+		ast_closestream(fs);
+	}
+	ast_set2_flag(&ast_options, saved, AST_OPT_FLAG_MMAP_SOUND_FILES);
+	unlink(path);
+cleanup_dir:
+	rmdir(tmp_dir);
+	return res;
+}
+
+AST_TEST_DEFINE(async_write_test)
+{
+	char tmp_dir[] = "/tmp/tmpdir.XXXXXX";
+	char filename[64];
+	char path[sizeof(filename) + 4];
+	enum ast_test_result_state res = AST_TEST_FAIL;
+	struct ast_filestream *fs;
+	short samples[1000];
+	short written[ARRAY_LEN(samples) + 1];
+	struct ast_frame fr = {
+		.frametype = AST_FRAME_VOICE,
+		.subclass.format = ast_format_slin,
+	};
+	FILE *file;
+	int idx;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "async_write";
+		info->category = "/main/file/";
+		info->summary = "Write a sound file from the background writers";
+		info->description =
+			"Writes a signed linear file through ast_filestream_set_async()\n"
+			"and checks the file holds all of the frames in order.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	if (!ast_get_format_for_file_ext("sln")) {
+		ast_test_status_update(test, "format_sln is not loaded\n");
+		return AST_TEST_NOT_RUN;
+	}
+
+	if (!(mkdtemp(tmp_dir))) {
+		ast_test_status_update(test, "Failed to create directory: %s\n", tmp_dir);
+		return AST_TEST_FAIL;
+	}
+	snprintf(filename, sizeof(filename), "%s/recording", tmp_dir);
+	snprintf(path, sizeof(path), "%s.sln", filename);
+
+	if (!(fs = ast_writefile(filename, "sln", NULL, O_CREAT | O_TRUNC | O_WRONLY, 0, AST_FILE_MODE))) {
+		ast_test_status_update(test, "Failed to create %s\n", path);
+		goto cleanup_dir;
+	}
+	if (ast_filestream_set_async(fs, 0, 20)) {
+		ast_test_status_update(test, "Background writers are disabled\n");
+		ast_closestream(fs);
+		res = AST_TEST_NOT_RUN;
+		goto cleanup;
+	}
+
+	for (idx = 0; idx < ARRAY_LEN(samples); ++idx) {
+		samples[idx] = idx * 23 - 11000;
+	}
+	/* Six frames of 160 samples and a short one */
+	for (idx = 0; idx < ARRAY_LEN(samples); idx += fr.samples) {
+		fr.samples = MIN(160, ARRAY_LEN(samples) - idx);
+		fr.datalen = fr.samples * sizeof(*samples);
+		fr.data.ptr = samples + idx;
+		if (ast_writestream(fs, &fr)) {
+			ast_test_status_update(test, "Failed to queue frame at sample %d\n", idx);
+			ast_closestream(fs);
+			goto cleanup;
+		}
+	}
+	if (ast_tellstream(fs) != ARRAY_LEN(samples)) {
+		ast_test_status_update(test, "Stream is not at the end of the frames written\n");
+		ast_closestream(fs);
+		goto cleanup;
+	}
+	ast_closestream(fs);
+
+	if (!(file = fopen(path, "r"))) {
+		ast_test_status_update(test, "Failed to open %s\n", path);
+		goto cleanup;
+	}
+	idx = fread(written, sizeof(*written), ARRAY_LEN(written), file);
+	fclose(file);
+	if (idx != ARRAY_LEN(samples) || memcmp(written, samples, sizeof(samples))) {
+		ast_test_status_update(test, "File holds %d samples of different audio\n", idx);
+		goto cleanup;
+	}
+
+	res = AST_TEST_PASS;
+
+cleanup:
+	unlink(path);
+cleanup_dir:
+	rmdir(tmp_dir);
+	return res;
+}
+
 static int unload_module(void)
 {
 	AST_TEST_UNREGISTER(read_dirs_test);
+	AST_TEST_UNREGISTER(prompt_cache_test);
+	AST_TEST_UNREGISTER(mmap_read_test);
+	AST_TEST_UNREGISTER(async_write_test);
 	return 0;
 }
 
 static int load_module(void)
 {
 	AST_TEST_REGISTER(read_dirs_test);
+	AST_TEST_REGISTER(prompt_cache_test);
+	AST_TEST_REGISTER(mmap_read_test);
+	AST_TEST_REGISTER(async_write_test);
 	return AST_MODULE_LOAD_SUCCESS;
 }
 
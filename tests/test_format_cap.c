@@ -37,6 +37,7 @@
 #include "asterisk/frame.h"
 #include "asterisk/format.h"
 #include "asterisk/format_cap.h"
+#include "asterisk/format_cache.h"
 
 AST_TEST_DEFINE(format_cap_alloc)
 {
@@ -1067,6 +1068,71 @@ AST_TEST_DEFINE(format_cap_iscompatible)
 	return AST_TEST_PASS;
 }
 
+AST_TEST_DEFINE(format_cap_remove_iscompatible)
+{
+	RAII_VAR(struct ast_format_cap *, all_caps, NULL, ao2_cleanup);
+	RAII_VAR(struct ast_format_cap *, ulaw_caps, NULL, ao2_cleanup);
+	RAII_VAR(struct ast_format_cap *, joint, NULL, ao2_cleanup);
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "format_cap_remove_iscompatible";
+		info->category = "/main/format_cap/";
+		info->summary = "format capabilities negotiation after removal unit test";
+		info->description =
+			"Test that formats removed from a capabilities structure no longer take part in negotiation";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	all_caps = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
+	ulaw_caps = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
+	joint = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
+	if (!all_caps || !ulaw_caps || !joint) {
+		ast_test_status_update(test, "Could not allocate an empty format capabilities structure\n");
+		return AST_TEST_FAIL;
+	}
+
+	if (ast_format_cap_append_by_type(all_caps, AST_MEDIA_TYPE_UNKNOWN)) {
+		ast_test_status_update(test, "Failed to add all media formats of all types to capabilities structure\n");
+		return AST_TEST_FAIL;
+	} else if (ast_format_cap_append(ulaw_caps, ast_format_ulaw, 0)) {
+		ast_test_status_update(test, "Could not add ulaw format to ulaw capabilities\n");
+		return AST_TEST_FAIL;
+	}
+
+	if (!ast_format_cap_iscompatible(all_caps, ulaw_caps)) {
+		ast_test_status_update(test, "Capabilities with every format are not compatible with ulaw\n");
+		return AST_TEST_FAIL;
+	}
+
+	ast_format_cap_remove_by_type(all_caps, AST_MEDIA_TYPE_AUDIO);
+	if (ast_format_cap_iscompatible(all_caps, ulaw_caps)) {
+		ast_test_status_update(test, "Capabilities with audio removed are still compatible with ulaw\n");
+		return AST_TEST_FAIL;
+	}
+
+	if (ast_format_cap_append(all_caps, ast_format_ulaw, 0)) {
+		ast_test_status_update(test, "Could not add ulaw format back to capabilities\n");
+		return AST_TEST_FAIL;
+	} else if (!ast_format_cap_iscompatible(all_caps, ulaw_caps)) {
+		ast_test_status_update(test, "Capabilities with ulaw added back are not compatible with ulaw\n");
+		return AST_TEST_FAIL;
+	}
+
+	ast_format_cap_remove(all_caps, ast_format_ulaw);
+	if (ast_format_cap_iscompatible(all_caps, ulaw_caps)) {
+		ast_test_status_update(test, "Capabilities with ulaw removed are still compatible with ulaw\n");
+		return AST_TEST_FAIL;
+	} else if (ast_format_cap_get_compatible(all_caps, ulaw_caps, joint) || ast_format_cap_count(joint)) {
+		ast_test_status_update(test, "Capabilities with ulaw removed still produced joint formats with ulaw\n");
+		return AST_TEST_FAIL;
+	}
+
+	return AST_TEST_PASS;
+}
+
 AST_TEST_DEFINE(format_cap_get_names)
 {
 	RAII_VAR(struct ast_format_cap *, empty_caps, NULL, ao2_cleanup);
@@ -1442,6 +1508,7 @@ static int unload_module(void)
 	AST_TEST_UNREGISTER(format_cap_iscompatible_format);
 	AST_TEST_UNREGISTER(format_cap_get_compatible);
 	AST_TEST_UNREGISTER(format_cap_iscompatible);
+	AST_TEST_UNREGISTER(format_cap_remove_iscompatible);
 	AST_TEST_UNREGISTER(format_cap_best_by_type);
 	AST_TEST_UNREGISTER(format_cap_replace_from_cap);
 	return 0;
@@ -1467,6 +1534,7 @@ static int load_module(void)
 	AST_TEST_REGISTER(format_cap_iscompatible_format);
 	AST_TEST_REGISTER(format_cap_get_compatible);
 	AST_TEST_REGISTER(format_cap_iscompatible);
+	AST_TEST_REGISTER(format_cap_remove_iscompatible);
 	AST_TEST_REGISTER(format_cap_best_by_type);
 	AST_TEST_REGISTER(format_cap_replace_from_cap);
 	ast_codec_register(&test_law);
@@ -0,0 +1,325 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2019, Sangoma Technologies Corporation
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*! \file
+ *
+ * \brief Frame allocation tests
+ */
+
+/*** MODULEINFO
+	<depend>TEST_FRAMEWORK</depend>
+	<support_level>core</support_level>
+ ***/
+
+#include "asterisk.h"
+
+#include "asterisk/module.h"
+#include "asterisk/test.h"
+#include "asterisk/frame.h"
+#include "asterisk/format_cache.h"
+#include "asterisk/utils.h"
+
+/*! Number of frames each test keeps outstanding, more than one slab chunk */
+#define FRAME_COUNT 64
+
+/*! 20ms of signed linear at 8kHz */
+#define FRAME_SAMPLES 160
+
+struct frame_batch {
+	struct ast_frame *frames[FRAME_COUNT];
+};
+
+static void frame_batch_fill(struct frame_batch *batch, int isolate)
+{
+	int16_t samples[FRAME_SAMPLES];
+	struct ast_frame f = {
+		.frametype = AST_FRAME_VOICE,
+		.datalen = sizeof(samples),
+		.samples = FRAME_SAMPLES,
+		.data.ptr = samples,
+		.src = "test_frame",
+	};
+	int i;
+	int j;
+
+	f.subclass.format = ast_format_slin;
+	for (i = 0; i < FRAME_COUNT; ++i) {
+		for (j = 0; j < FRAME_SAMPLES; ++j) {
+			samples[j] = i * FRAME_SAMPLES + j;
+		}
+		if (!isolate) {
+			batch->frames[i] = ast_frdup(&f);
+			continue;
+		}
+		/* A malloc'd header with borrowed data has only its data and source copied */
+		if ((batch->frames[i] = ast_malloc(sizeof(f)))) {
+			*batch->frames[i] = f;
+			ao2_bump(batch->frames[i]->subclass.format);
+			batch->frames[i]->mallocd = AST_MALLOCD_HDR;
+			batch->frames[i] = ast_frisolate(batch->frames[i]);
+		}
+	}
+}
+
+static int frame_batch_check(struct ast_test *test, struct frame_batch *batch)
+{
+	int16_t *samples;
+	int i;
+	int j;
+
+	for (i = 0; i < FRAME_COUNT; ++i) {
+		if (!batch->frames[i]) {
+			ast_test_status_update(test, "Frame %d could not be allocated\n", i);
+			return -1;
+		}
+		if (batch->frames[i]->datalen != FRAME_SAMPLES * sizeof(*samples)
+			|| strcmp(batch->frames[i]->src, "test_frame")) {
+			ast_test_status_update(test, "Frame %d has the wrong length or source\n", i);
+			return -1;
+		}
+		samples = batch->frames[i]->data.ptr;
+		for (j = 0; j < FRAME_SAMPLES; ++j) {
+			if (samples[j] != (int16_t) (i * FRAME_SAMPLES + j)) {
+				ast_test_status_update(test, "Frame %d sample %d was overwritten\n", i, j);
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static void frame_batch_free(struct frame_batch *batch)
+{
+	int i;
+
+	for (i = 0; i < FRAME_COUNT; ++i) {
+		ast_frfree(batch->frames[i]);
+		batch->frames[i] = NULL;
+	}
+}
+
+static void *frame_free_thread(void *data)
+{
+	frame_batch_free(data);
+	return NULL;
+}
+
+static void *frame_alloc_thread(void *data)
+{
+	frame_batch_fill(data, 0);
+	return NULL;
+}
+
+static void *frame_isolate_thread(void *data)
+{
+	frame_batch_fill(data, 1);
+	return NULL;
+}
+
+AST_TEST_DEFINE(frame_slab_remote_free)
+{
+	struct frame_batch batch;
+	pthread_t thread;
+	int round;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "frame_slab_remote_free";
+		info->category = "/main/frame/";
+		info->summary = "Test freeing frames on a thread that did not allocate them";
+		info->description =
+			"Duplicates and isolates frames on the test thread, frees them on "
+			"another thread, and makes sure frames allocated afterwards from the "
+			"reclaimed memory are intact.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	for (round = 0; round < 4; ++round) {
+		frame_batch_fill(&batch, round % 2);
+		if (frame_batch_check(test, &batch)) {
+			frame_batch_free(&batch);
+			return AST_TEST_FAIL;
+		}
+
+		if (ast_pthread_create(&thread, NULL, frame_free_thread, &batch)) {
+			ast_test_status_update(test, "Could not start the freeing thread\n");
+			frame_batch_free(&batch);
+			return AST_TEST_FAIL;
+		}
+		pthread_join(thread, NULL);
+	}
+
+	return AST_TEST_PASS;
+}
+
+AST_TEST_DEFINE(frame_slab_thread_exit)
+{
+	struct frame_batch batch;
+	pthread_t thread;
+	int round;
+	int res;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "frame_slab_thread_exit";
+		info->category = "/main/frame/";
+		info->summary = "Test frames outliving the thread that allocated them";
+		info->description =
+			"Duplicates and isolates frames on a thread that exits before the "
+			"frames are checked and freed by the test thread.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	for (round = 0; round < 2; ++round) {
+		if (ast_pthread_create(&thread, NULL, round ? frame_isolate_thread : frame_alloc_thread, &batch)) {
+			ast_test_status_update(test, "Could not start the allocating thread\n");
+			return AST_TEST_FAIL;
+		}
+		pthread_join(thread, NULL);
+
+		res = frame_batch_check(test, &batch);
+		frame_batch_free(&batch);
+		if (res) {
+			return AST_TEST_FAIL;
+		}
+	}
+
+	return AST_TEST_PASS;
+}
+
+AST_TEST_DEFINE(frame_dup_shared)
+{
+	struct frame_batch batch;
+	struct ast_frame *shared;
+	struct ast_frame *copy;
+	int16_t samples[FRAME_SAMPLES];
+	struct ast_frame f = {
+		.frametype = AST_FRAME_VIDEO,
+		.datalen = sizeof(samples),
+		.data.ptr = samples,
+		.src = "test_frame",
+	};
+	int i;
+	int res = AST_TEST_PASS;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "frame_dup_shared";
+		info->category = "/main/frame/";
+		info->summary = "Test duplicating frames with a shared payload";
+		info->description =
+			"Duplicates a frame with a shared payload many times and makes sure "
+			"the payload is not copied, each duplicate keeps its own header, and "
+			"the payload outlives the frame it was shared from. A plain copy of "
+			"the frame must get its own payload with AST_FRIENDLY_OFFSET room.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	f.subclass.format = ast_format_h264;
+	for (i = 0; i < FRAME_SAMPLES; ++i) {
+		samples[i] = i;
+	}
+
+	shared = ast_frdup_shared(&f);
+	if (!shared) {
+		ast_test_status_update(test, "Could not share the frame\n");
+		return AST_TEST_FAIL;
+	}
+	memset(samples, 0, sizeof(samples));
+
+	for (i = 0; i < FRAME_COUNT; ++i) {
+		batch.frames[i] = ast_frdup_readonly(shared);
+		if (batch.frames[i]) {
+			batch.frames[i]->stream_num = i;
+		}
+	}
+
+	/* A plain duplicate must be a writable copy with room for headers */
+	copy = ast_frdup(shared);
+	if (!copy) {
+		ast_test_status_update(test, "Could not copy the shared frame\n");
+		res = AST_TEST_FAIL;
+	} else {
+		if (copy->offset < AST_FRIENDLY_OFFSET) {
+			ast_test_status_update(test, "Copy of a shared frame has offset %d\n", copy->offset);
+			res = AST_TEST_FAIL;
+		}
+		if (copy->data.ptr == shared->data.ptr
+			|| memcmp(copy->data.ptr, shared->data.ptr, shared->datalen)) {
+			ast_test_status_update(test, "Copy of a shared frame has the wrong payload\n");
+			res = AST_TEST_FAIL;
+		}
+		ast_frfree(copy);
+	}
+	ast_frfree(shared);
+
+	for (i = 0; res == AST_TEST_PASS && i < FRAME_COUNT; ++i) {
+		if (!batch.frames[i]) {
+			ast_test_status_update(test, "Frame %d could not be duplicated\n", i);
+			res = AST_TEST_FAIL;
+			break;
+		}
+		if (batch.frames[i]->data.ptr != batch.frames[0]->data.ptr) {
+			ast_test_status_update(test, "Frame %d did not share the payload\n", i);
+			res = AST_TEST_FAIL;
+			break;
+		}
+		if (batch.frames[i]->stream_num != i || strcmp(batch.frames[i]->src, "test_frame")) {
+			ast_test_status_update(test, "Frame %d has the wrong stream or source\n", i);
+			res = AST_TEST_FAIL;
+			break;
+		}
+	}
+	if (res == AST_TEST_PASS) {
+		int16_t *payload = batch.frames[FRAME_COUNT - 1]->data.ptr;
+
+		for (i = 0; i < FRAME_SAMPLES; ++i) {
+			if (payload[i] != i) {
+				ast_test_status_update(test, "Shared payload sample %d is wrong\n", i);
+				res = AST_TEST_FAIL;
+				break;
+			}
+		}
+	}
+
+	frame_batch_free(&batch);
+	return res;
+}
+
+static int unload_module(void)
+{
+	AST_TEST_UNREGISTER(frame_dup_shared);
+	AST_TEST_UNREGISTER(frame_slab_remote_free);
+	AST_TEST_UNREGISTER(frame_slab_thread_exit);
+	return 0;
+}
+
+static int load_module(void)
+{
+	AST_TEST_REGISTER(frame_slab_remote_free);
+	AST_TEST_REGISTER(frame_dup_shared);
+	AST_TEST_REGISTER(frame_slab_thread_exit);
+	return AST_MODULE_LOAD_SUCCESS;
+}
+
+AST_MODULE_INFO_STANDARD(ASTERISK_GPL_KEY, "Frame allocation tests");
@@ -1233,6 +1233,101 @@ cleanup:
 	return result;
 }
 
+/*!
+ * \internal
+ * \brief Compare two delays for sorting the history
+ */
+static int test_jb_delay_cmp(const void *a, const void *b)
+{
+	long delay_a = *(const long *)a;
+	long delay_b = *(const long *)b;
+
+	return (delay_a > delay_b) - (delay_a < delay_b);
+}
+
+AST_TEST_DEFINE(jitterbuffer_history_percentile)
+{
+	enum ast_test_result_state result = AST_TEST_FAIL;
+	struct jitterbuf *jb = NULL;
+	struct jb_frame frame;
+	struct jb_info jbinfo;
+	struct jb_conf jbconf;
+	long sorted[JB_HISTORY_SZ];
+	unsigned int seed = 1;
+	int count;
+	int idx;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "jitterbuffer_history_percentile";
+		info->category = "/main/jitterbuf/";
+		info->summary = "Tests the jitter measured over the delay history";
+		info->description = "Voice frames with varying delays are sent to a jitter "
+			"buffer.  After each frame the minimum delay and jitter it reports, "
+			"which leave out the highest and lowest delays, are compared against "
+			"those found by sorting the whole history.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	JB_TEST_BEGIN("jitterbuffer_history_percentile");
+
+	if (!(jb = jb_new())) {
+		ast_test_status_update(test, "Failed to allocate memory for jitterbuffer\n");
+		goto cleanup;
+	}
+
+	test_jb_populate_config(&jbconf);
+	jbconf.max_jitterbuf = 100000;
+	jbconf.resync_threshold = -1;
+	if (jb_setconf(jb, &jbconf) != JB_OK) {
+		ast_test_status_update(test, "Failed to set jitterbuffer configuration\n");
+		goto cleanup;
+	}
+
+	for (i = 1; i <= JB_HISTORY_SZ * 4; i++) {
+		/* Alternate between calm and bursty periods so the history keeps changing */
+		seed = seed * 1103515245 + 12345;
+		if (jb_put(jb, NULL, JB_TYPE_VOICE, 20, i * 20, i * 20 + (seed >> 16) % ((i / 300) % 2 ? 400 : 40)) == JB_DROP) {
+			ast_test_status_update(test, "Jitter buffer dropped packet %d\n", i);
+			goto cleanup;
+		}
+		while (jb_getall(jb, &frame) == JB_OK) { }
+
+		if (jb_getinfo(jb, &jbinfo) != JB_OK) {
+			ast_test_status_update(test, "Failed to get jitterbuffer information\n");
+			goto cleanup;
+		}
+
+		count = (i < JB_HISTORY_SZ) ? i : JB_HISTORY_SZ;
+		memcpy(sorted, jb->history, count * sizeof(sorted[0]));
+		qsort(sorted, count, sizeof(sorted[0]), test_jb_delay_cmp);
+		idx = count * JB_HISTORY_DROPPCT / 100;
+		if (idx > JB_HISTORY_MAXBUF_SZ - 1) {
+			idx = JB_HISTORY_MAXBUF_SZ - 1;
+		}
+
+		JB_NUMERIC_TEST(jbinfo.min, sorted[idx]);
+		JB_NUMERIC_TEST(jbinfo.jitter, sorted[count - 1 - idx] - sorted[idx]);
+	}
+
+	result = AST_TEST_PASS;
+
+cleanup:
+	if (jb) {
+		/* No need to do anything - this will put all frames on the 'free' list,
+		 * so jb_destroy will dispose of them */
+		while (jb_getall(jb, &frame) == JB_OK) { }
+		jb_destroy(jb);
+	}
+
+	JB_TEST_END;
+
+	return result;
+}
+
 static int unload_module(void)
 {
 	AST_TEST_UNREGISTER(jitterbuffer_nominal_voice_frames);
@@ -1247,6 +1342,7 @@ static int unload_module(void)
 	AST_TEST_UNREGISTER(jitterbuffer_overflow_control);
 	AST_TEST_UNREGISTER(jitterbuffer_resynch_voice);
 	AST_TEST_UNREGISTER(jitterbuffer_resynch_control);
+	AST_TEST_UNREGISTER(jitterbuffer_history_percentile);
 	return 0;
 }
 
@@ -1276,6 +1372,9 @@ static int load_module(void)
 	AST_TEST_REGISTER(jitterbuffer_resynch_voice);
 	AST_TEST_REGISTER(jitterbuffer_resynch_control);
 
+	/* Jitter measured over the history */
+	AST_TEST_REGISTER(jitterbuffer_history_percentile);
+
 	return AST_MODULE_LOAD_SUCCESS;
 }
 
@@ -1705,6 +1705,76 @@ AST_TEST_DEFINE(json_test_cep)
 	return AST_TEST_PASS;
 }
 
+/*!
+ * \internal
+ * \brief Check that encoding the elements of \a array one at a time
+ *        produces the same text as encoding the whole array.
+ */
+static int check_array_encoder(struct ast_json *array, enum ast_json_encoding_format format)
+{
+	RAII_VAR(struct ast_str *, expected, ast_str_create(64), ast_free);
+	RAII_VAR(struct ast_str *, uut, NULL, ast_free);
+	struct ast_json_array_encoder *encoder;
+	size_t i;
+
+	if (!expected || ast_json_dump_str_format(array, &expected, format)) {
+		return -1;
+	}
+
+	encoder = ast_json_array_encoder_create(format);
+	if (!encoder) {
+		return -1;
+	}
+	for (i = 0; i < ast_json_array_size(array); ++i) {
+		if (ast_json_array_encoder_append(encoder,
+			ast_json_ref(ast_json_array_get(array, i)))) {
+			ast_json_array_encoder_free(encoder);
+			return -1;
+		}
+	}
+	uut = ast_json_array_encoder_finish(encoder);
+
+	return !uut || strcmp(ast_str_buffer(expected), ast_str_buffer(uut)) ? -1 : 0;
+}
+
+AST_TEST_DEFINE(json_test_array_encoder)
+{
+	RAII_VAR(struct ast_json *, array, NULL, ast_json_unref);
+	struct ast_json_array_encoder *encoder;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "array_encoder";
+		info->category = CATEGORY;
+		info->summary = "Incrementally encoded arrays match whole array encoding.";
+		info->description = "Test JSON abstraction library.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	array = ast_json_array_create();
+	ast_test_validate(test, 0 == check_array_encoder(array, AST_JSON_COMPACT));
+	ast_test_validate(test, 0 == check_array_encoder(array, AST_JSON_PRETTY));
+
+	ast_json_unref(array);
+	array = ast_json_pack("[{s: s, s: {s: i, s: [i, i]}, s: {}}, s, [], {s: s}]",
+		"id", "1234.5", "nested", "count", 2, "list", 1, 2, "empty",
+		"line\nbreak", "name", "two");
+	ast_test_validate(test, NULL != array);
+	ast_test_validate(test, 0 == check_array_encoder(array, AST_JSON_COMPACT));
+	ast_test_validate(test, 0 == check_array_encoder(array, AST_JSON_PRETTY));
+
+	/* A failed conversion fails the whole array */
+	encoder = ast_json_array_encoder_create(AST_JSON_COMPACT);
+	ast_test_validate(test, NULL != encoder);
+	ast_test_validate(test, 0 == ast_json_array_encoder_append(encoder, ast_json_integer_create(1)));
+	ast_test_validate(test, 0 != ast_json_array_encoder_append(encoder, NULL));
+	ast_test_validate(test, NULL == ast_json_array_encoder_finish(encoder));
+
+	return AST_TEST_PASS;
+}
+
 static int unload_module(void)
 {
 	AST_TEST_UNREGISTER(json_test_false);
@@ -1758,6 +1828,7 @@ static int unload_module(void)
 	AST_TEST_UNREGISTER(json_test_name_number);
 	AST_TEST_UNREGISTER(json_test_timeval);
 	AST_TEST_UNREGISTER(json_test_cep);
+	AST_TEST_UNREGISTER(json_test_array_encoder);
 	return 0;
 }
 
@@ -1814,6 +1885,7 @@ static int load_module(void)
 	AST_TEST_REGISTER(json_test_name_number);
 	AST_TEST_REGISTER(json_test_timeval);
 	AST_TEST_REGISTER(json_test_cep);
+	AST_TEST_REGISTER(json_test_array_encoder);
 
 	ast_test_register_init(CATEGORY, json_test_init);
 	ast_test_register_cleanup(CATEGORY, json_test_cleanup);
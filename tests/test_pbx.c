@@ -33,9 +33,11 @@
 
 #include "asterisk.h"
 
+#include "asterisk/lock.h"
 #include "asterisk/module.h"
 #include "asterisk/pbx.h"
 #include "asterisk/test.h"
+#include "asterisk/utils.h"
 
 #include <signal.h>
 
@@ -323,6 +325,172 @@ cleanup:
 	return res;
 }
 
+static int test_lookup(struct ast_test *test, const char *context, const char *exten,
+	int priority, const char *expected)
+{
+	struct pbx_find_info pfi = { { 0 }, };
+	struct ast_exten *found;
+	const char *data;
+
+	found = pbx_find_extension(NULL, NULL, &pfi, context, exten, priority, NULL, NULL, E_SPAWN);
+	data = found ? ast_get_extension_app_data(found) : NULL;
+	if (!expected != !data || (expected && strcmp(expected, data))) {
+		ast_test_status_update(test, "Looking up %s@%s priority %d found '%s' instead of '%s'\n",
+			exten, context, priority, S_OR(data, "nothing"), S_OR(expected, "nothing"));
+		return -1;
+	}
+	return 0;
+}
+
+AST_TEST_DEFINE(lookup_cache_test)
+{
+	static const char registrar[] = "test_pbx";
+	static const char TEST_OUTER[] = "test_cache";
+	static const char TEST_INNER[] = "test_cache_include";
+	enum ast_test_result_state res = AST_TEST_FAIL;
+	int old_engine = -1;
+	int engine;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "lookup_cache_test";
+		info->category = "/main/pbx/";
+		info->summary = "Test repeated extension lookups";
+		info->description = "Look up the same extensions while changing the dialplan and\n"
+			"check every lookup sees the change.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	if (!ast_context_find_or_create(NULL, NULL, TEST_OUTER, registrar)
+		|| !ast_context_find_or_create(NULL, NULL, TEST_INNER, registrar)
+		|| ast_context_add_include(TEST_OUTER, TEST_INNER, registrar)
+		|| ast_add_extension(TEST_INNER, 0, "_3XXX", 1, NULL, NULL, "Noop", "inner", NULL, registrar)) {
+		ast_test_status_update(test, "Failed to build the dialplan\n");
+		goto cleanup;
+	}
+
+	for (engine = 0; engine < 2; ++engine) {
+		i = pbx_set_extenpatternmatchnew(engine);
+		if (old_engine < 0) {
+			old_engine = i;
+		}
+
+		for (i = 0; i < 2; ++i) {
+			if (test_lookup(test, TEST_OUTER, "3000", 1, "inner")
+				|| test_lookup(test, TEST_OUTER, "3000", 2, NULL)) {
+				goto cleanup;
+			}
+		}
+
+		if (ast_add_extension(TEST_OUTER, 0, "3000", 1, NULL, NULL, "Noop", "outer", NULL, registrar)) {
+			ast_test_status_update(test, "Failed to add extension\n");
+			goto cleanup;
+		}
+		for (i = 0; i < 2; ++i) {
+			if (test_lookup(test, TEST_OUTER, "3000", 1, "outer")
+				|| test_lookup(test, TEST_OUTER, "3001", 1, "inner")) {
+				goto cleanup;
+			}
+		}
+
+		if (ast_context_remove_extension(TEST_OUTER, "3000", 1, registrar)) {
+			ast_test_status_update(test, "Failed to remove extension\n");
+			goto cleanup;
+		}
+		for (i = 0; i < 2; ++i) {
+			if (test_lookup(test, TEST_OUTER, "3000", 1, "inner")) {
+				goto cleanup;
+			}
+		}
+	}
+	res = AST_TEST_PASS;
+
+cleanup:
+	if (old_engine >= 0) {
+		pbx_set_extenpatternmatchnew(old_engine);
+	}
+	ast_context_destroy(NULL, registrar);
+
+	return res;
+}
+
+struct lookup_thread_info {
+	const char *context;
+	const char *exten;
+	int found;
+	int done;
+};
+
+static void *lookup_thread(void *data)
+{
+	struct lookup_thread_info *info = data;
+
+	info->found = ast_exists_extension(NULL, info->context, info->exten, 1, NULL);
+	ast_atomic_store_n(&info->done, 1, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+AST_TEST_DEFINE(lockless_lookup_test)
+{
+	static const char registrar[] = "test_pbx";
+	static const char TEST_CONTEXT[] = "test_lockless";
+	struct lookup_thread_info lookup = { .context = TEST_CONTEXT, .exten = "4000", };
+	enum ast_test_result_state res = AST_TEST_FAIL;
+	pthread_t thread;
+	int waited;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "lockless_lookup_test";
+		info->category = "/main/pbx/";
+		info->summary = "Test repeated lookups while the dialplan is locked";
+		info->description = "Look up an extension again while another thread holds\n"
+			"the contexts lock, as a reload merging leftovers would.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	if (!ast_context_find_or_create(NULL, NULL, TEST_CONTEXT, registrar)
+		|| ast_add_extension(TEST_CONTEXT, 0, "_4XXX", 1, NULL, NULL, "Noop", "", NULL, registrar)) {
+		ast_test_status_update(test, "Failed to build the dialplan\n");
+		goto cleanup;
+	}
+
+	if (!ast_exists_extension(NULL, TEST_CONTEXT, lookup.exten, 1, NULL)) {
+		ast_test_status_update(test, "Failed to find %s@%s\n", lookup.exten, TEST_CONTEXT);
+		goto cleanup;
+	}
+
+	ast_rdlock_contexts();
+	if (ast_pthread_create(&thread, NULL, lookup_thread, &lookup)) {
+		ast_unlock_contexts();
+		ast_test_status_update(test, "Failed to start the lookup thread\n");
+		goto cleanup;
+	}
+	for (waited = 0; waited < 2000 && !ast_atomic_load_n(&lookup.done, __ATOMIC_ACQUIRE); ++waited) {
+		usleep(1000);
+	}
+	ast_unlock_contexts();
+	pthread_join(thread, NULL);
+
+	if (waited == 2000) {
+		ast_test_status_update(test, "Lookup waited for the contexts lock\n");
+	} else if (!lookup.found) {
+		ast_test_status_update(test, "Lookup failed while the contexts were locked\n");
+	} else {
+		res = AST_TEST_PASS;
+	}
+
+cleanup:
+	ast_context_destroy(NULL, registrar);
+
+	return res;
+}
+
 AST_TEST_DEFINE(segv)
 {
 	switch (cmd) {
@@ -388,6 +556,8 @@ static int unload_module(void)
 	AST_TEST_UNREGISTER(call_backtrace);
 	AST_TEST_UNREGISTER(call_assert);
 	AST_TEST_UNREGISTER(segv);
+	AST_TEST_UNREGISTER(lockless_lookup_test);
+	AST_TEST_UNREGISTER(lookup_cache_test);
 	AST_TEST_UNREGISTER(pattern_match_test);
 	return 0;
 }
@@ -395,6 +565,8 @@ static int unload_module(void)
 static int load_module(void)
 {
 	AST_TEST_REGISTER(pattern_match_test);
+	AST_TEST_REGISTER(lookup_cache_test);
+	AST_TEST_REGISTER(lockless_lookup_test);
 	AST_TEST_REGISTER(segv);
 	AST_TEST_REGISTER(call_assert);
 	AST_TEST_REGISTER(call_backtrace);
@@ -104,26 +104,13 @@ static int sched_order_8_cb(const void *data)
 	return 0;
 }
 
-AST_TEST_DEFINE(sched_test_order)
+static enum ast_test_result_state sched_test_order_run(struct ast_test *test, enum ast_sched_backend backend)
 {
 	struct ast_sched_context *con;
 	enum ast_test_result_state res = AST_TEST_FAIL;
 	int id1, id2, id3, wait;
 
-	switch (cmd) {
-	case TEST_INIT:
-		info->name = "sched_test_order";
-		info->category = "/main/sched/";
-		info->summary = "Test ordering of events in the scheduler API";
-		info->description =
-			"This test ensures that events are properly ordered by the "
-			"time they are scheduled to execute in the scheduler API.";
-		return AST_TEST_NOT_RUN;
-	case TEST_EXECUTE:
-		break;
-	}
-
-	if (!(con = ast_sched_context_create())) {
+	if (!(con = ast_sched_context_create_with_backend(backend))) {
 		ast_test_status_update(test,
 				"Test failed - could not create scheduler context\n");
 		return AST_TEST_FAIL;
@@ -262,25 +249,136 @@ return_cleanup:
 	return res;
 }
 
+AST_TEST_DEFINE(sched_test_order)
+{
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "sched_test_order";
+		info->category = "/main/sched/";
+		info->summary = "Test ordering of events in the scheduler API";
+		info->description =
+			"This test ensures that events are properly ordered by the "
+			"time they are scheduled to execute in the scheduler API.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	return sched_test_order_run(test, AST_SCHED_BACKEND_HEAP);
+}
+
+AST_TEST_DEFINE(sched_test_order_wheel)
+{
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "sched_test_order_wheel";
+		info->category = "/main/sched/";
+		info->summary = "Test ordering of events in the timing wheel scheduler";
+		info->description =
+			"This test ensures that events are properly ordered by the "
+			"time they are scheduled to execute when the scheduler context "
+			"uses the timing wheel backend.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	return sched_test_order_run(test, AST_SCHED_BACKEND_WHEEL);
+}
+
+AST_TEST_DEFINE(sched_test_wheel_levels)
+{
+	struct ast_sched_context *con;
+	enum ast_test_result_state res = AST_TEST_FAIL;
+	/* One entry per wheel level plus the overflow list, in ms */
+	static const int whens[] = { 5, 100, 400, 1000, 20000, 2 * 3600 * 1000, 30 * 3600 * 1000 };
+	int ids[ARRAY_LEN(whens)];
+	int wait;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "sched_test_wheel_levels";
+		info->category = "/main/sched/";
+		info->summary = "Test the timing wheel scheduler across its levels";
+		info->description =
+			"This test ensures that ast_sched_wait(), ast_sched_del() and "
+			"ast_sched_runq() work for timing wheel entries on every level, "
+			"including entries beyond the span of the wheel.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	if (!(con = ast_sched_context_create_with_backend(AST_SCHED_BACKEND_WHEEL))) {
+		ast_test_status_update(test,
+				"Test failed - could not create scheduler context\n");
+		return AST_TEST_FAIL;
+	}
+
+	/* Add them latest first so the earliest is not simply the first added. */
+	for (i = ARRAY_LEN(whens) - 1; i >= 0; --i) {
+		ids[i] = ast_sched_add(con, whens[i], sched_order_1_cb, test);
+		ast_test_validate_cleanup(test, -1 < ids[i], res, return_cleanup);
+	}
+
+	ast_test_validate_cleanup(test, (30 * 3600) - 1 <= ast_sched_when(con, ids[ARRAY_LEN(whens) - 1]),
+		res, return_cleanup);
+
+	/* Deleting the earliest entry each time exposes the next level. */
+	for (i = 0; i < ARRAY_LEN(whens); ++i) {
+		wait = ast_sched_wait(con);
+		if (wait > whens[i] || (i && wait <= whens[i - 1])) {
+			ast_test_status_update(test,
+				"ast_sched_wait() returned '%d' for an entry due in %d ms\n",
+				wait, whens[i]);
+			goto return_cleanup;
+		}
+		ast_test_validate_cleanup(test, 0 == ast_sched_del(con, ids[i]), res, return_cleanup);
+	}
+
+	ast_test_validate_cleanup(test, -1 == ast_sched_del(con, ids[0]), res, return_cleanup);
+	ast_test_validate_cleanup(test, -1 == ast_sched_wait(con), res, return_cleanup);
+
+	/* Entries spanning a level 1 cascade still run in order. */
+	order_check = 0;
+	order_check_failed = 0;
+	ast_test_validate_cleanup(test, -1 < ast_sched_add(con, 600, sched_order_3_cb, test), res, return_cleanup);
+	ast_test_validate_cleanup(test, -1 < ast_sched_add(con, 20, sched_order_1_cb, test), res, return_cleanup);
+	ast_test_validate_cleanup(test, -1 < ast_sched_add(con, 300, sched_order_2_cb, test), res, return_cleanup);
+	usleep(700 * 1000);
+	ast_test_validate_cleanup(test, 3 == ast_sched_runq(con), res, return_cleanup);
+	ast_test_validate_cleanup(test, !order_check_failed, res, return_cleanup);
+	ast_test_validate_cleanup(test, -1 == ast_sched_wait(con), res, return_cleanup);
+
+	res = AST_TEST_PASS;
+
+return_cleanup:
+	ast_sched_context_destroy(con);
+
+	return res;
+}
+
 static char *handle_cli_sched_bench(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
 	struct ast_sched_context *con;
 	struct timeval start;
 	unsigned int num, i;
 	int *sched_ids = NULL;
+	enum ast_sched_backend backend = AST_SCHED_BACKEND_HEAP;
 
 	switch (cmd) {
 	case CLI_INIT:
 		e->command = "sched benchmark";
 		e->usage = ""
-			"Usage: sched benchmark <num>\n"
+			"Usage: sched benchmark <num> [wheel]\n"
 			"";
 		return NULL;
 	case CLI_GENERATE:
 		return NULL;
 	}
 
-	if (a->argc != e->args + 1) {
+	if (a->argc != e->args + 1 && a->argc != e->args + 2) {
 		return CLI_SHOWUSAGE;
 	}
 
@@ -288,7 +386,14 @@ static char *handle_cli_sched_bench(struct ast_cli_entry *e, int cmd, struct ast
 		return CLI_SHOWUSAGE;
 	}
 
-	if (!(con = ast_sched_context_create())) {
+	if (a->argc == e->args + 2) {
+		if (strcasecmp(a->argv[e->args + 1], "wheel")) {
+			return CLI_SHOWUSAGE;
+		}
+		backend = AST_SCHED_BACKEND_WHEEL;
+	}
+
+	if (!(con = ast_sched_context_create_with_backend(backend))) {
 		ast_cli(a->fd, "Test failed - could not create scheduler context\n");
 		return CLI_FAILURE;
 	}
@@ -343,6 +448,8 @@ static struct ast_cli_entry cli_sched[] = {
 static int unload_module(void)
 {
 	AST_TEST_UNREGISTER(sched_test_order);
+	AST_TEST_UNREGISTER(sched_test_order_wheel);
+	AST_TEST_UNREGISTER(sched_test_wheel_levels);
 	ast_cli_unregister_multiple(cli_sched, ARRAY_LEN(cli_sched));
 	return 0;
 }
@@ -350,6 +457,8 @@ static int unload_module(void)
 static int load_module(void)
 {
 	AST_TEST_REGISTER(sched_test_order);
+	AST_TEST_REGISTER(sched_test_order_wheel);
+	AST_TEST_REGISTER(sched_test_wheel_levels);
 	ast_cli_register_multiple(cli_sched, ARRAY_LEN(cli_sched));
 	return AST_MODULE_LOAD_SUCCESS;
 }
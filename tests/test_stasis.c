@@ -159,6 +159,92 @@ AST_TEST_DEFINE(message)
 	return AST_TEST_PASS;
 }
 
+/*! Number of times counted_json() and counted_ami() have rendered */
+static int render_count;
+
+static struct ast_json *counted_json(struct stasis_message *message, const struct stasis_message_sanitizer *sanitize)
+{
+	++render_count;
+	return ast_json_pack("{s: s, s: {s: s}}", "type", "Counted",
+		"nested", "text", (const char *) stasis_message_data(message));
+}
+
+static struct ast_manager_event_blob *counted_ami(struct stasis_message *message)
+{
+	++render_count;
+	return fake_ami(message);
+}
+
+AST_TEST_DEFINE(message_render_cached)
+{
+	RAII_VAR(struct stasis_message_type *, type, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_message *, uut, NULL, ao2_cleanup);
+	RAII_VAR(char *, data, NULL, ao2_cleanup);
+	RAII_VAR(struct ast_json *, json1, NULL, ast_json_unref);
+	RAII_VAR(struct ast_json *, json2, NULL, ast_json_unref);
+	RAII_VAR(struct ast_json *, json3, NULL, ast_json_unref);
+	RAII_VAR(struct ast_manager_event_blob *, ami1, NULL, ao2_cleanup);
+	RAII_VAR(struct ast_manager_event_blob *, ami2, NULL, ao2_cleanup);
+	struct stasis_message_vtable vtable = {
+		.to_json = counted_json,
+		.to_ami = counted_ami,
+	};
+	struct stasis_message_sanitizer sanitize = { 0, };
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = test_category;
+		info->summary = "Test that message representations are rendered once";
+		info->description = "Converts a message to JSON and AMI several times and\n"
+			"makes sure each is rendered only once per sanitizer, with every\n"
+			"JSON caller getting its own copy.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	ast_test_validate(test, stasis_message_type_create("RenderCached", &vtable, &type) == STASIS_MESSAGE_TYPE_SUCCESS);
+	data = ao2_alloc(strlen("SomeData") + 1, NULL);
+	ast_test_validate(test, NULL != data);
+	strcpy(data, "SomeData");/* Safe */
+	uut = stasis_message_create(type, data);
+	ast_test_validate(test, NULL != uut);
+
+	render_count = 0;
+	json1 = stasis_message_to_json(uut, NULL);
+	json2 = stasis_message_to_json(uut, NULL);
+	ast_test_validate(test, NULL != json1 && NULL != json2);
+	ast_test_validate(test, 1 == render_count);
+	ast_test_validate(test, json1 != json2);
+	ast_test_validate(test, ast_json_equal(json1, json2));
+
+	/* Changes by one caller, at any depth, are not seen by the next */
+	ast_test_validate(test, 0 == ast_json_object_set(json1, "application", ast_json_string_create("app")));
+	ast_test_validate(test, 0 == ast_json_object_set(ast_json_object_get(json1, "nested"),
+		"text", ast_json_string_create("Changed")));
+	ast_json_unref(json2);
+	json2 = stasis_message_to_json(uut, NULL);
+	ast_test_validate(test, NULL == ast_json_object_get(json2, "application"));
+	ast_test_validate(test, !strcmp("SomeData",
+		ast_json_string_get(ast_json_object_get(ast_json_object_get(json2, "nested"), "text"))));
+	ast_test_validate(test, 1 == render_count);
+
+	/* A different sanitizer renders again */
+	json3 = stasis_message_to_json(uut, &sanitize);
+	ast_test_validate(test, NULL != json3);
+	ast_test_validate(test, 2 == render_count);
+
+	render_count = 0;
+	ami1 = stasis_message_to_ami(uut);
+	ami2 = stasis_message_to_ami(uut);
+	ast_test_validate(test, NULL != ami1);
+	ast_test_validate(test, 1 == render_count);
+	ast_test_validate(test, ami1 == ami2);
+
+	return AST_TEST_PASS;
+}
+
 struct consumer {
 	ast_cond_t out;
 	struct stasis_message **messages_rxed;
@@ -676,6 +762,90 @@ AST_TEST_DEFINE(forward)
 	return AST_TEST_PASS;
 }
 
+AST_TEST_DEFINE(forward_diamond)
+{
+	RAII_VAR(struct stasis_topic *, parent_topic, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_topic *, middle_topic, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_topic *, topic, NULL, ao2_cleanup);
+
+	RAII_VAR(struct consumer *, parent_consumer, NULL, ao2_cleanup);
+
+	RAII_VAR(struct stasis_forward *, forward_direct, NULL, stasis_forward_cancel);
+	RAII_VAR(struct stasis_forward *, forward_middle, NULL, stasis_forward_cancel);
+	RAII_VAR(struct stasis_forward *, forward_parent, NULL, stasis_forward_cancel);
+	RAII_VAR(struct stasis_subscription *, parent_sub, NULL, stasis_unsubscribe);
+
+	RAII_VAR(char *, test_data, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_message_type *, test_message_type, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_message *, test_message, NULL, ao2_cleanup);
+	int actual_len;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = test_category;
+		info->summary = "Test forwarding to a topic through two paths";
+		info->description = "Test forwarding to a topic through two paths.\n"
+			"This test forwards a topic to a parent topic both directly\n"
+			"and through a middle topic, and verifies a subscriber of the\n"
+			"parent sees each message once, whichever forwards remain";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	parent_topic = stasis_topic_create("ParentTestTopic");
+	ast_test_validate(test, NULL != parent_topic);
+	middle_topic = stasis_topic_create("MiddleTestTopic");
+	ast_test_validate(test, NULL != middle_topic);
+	topic = stasis_topic_create("TestTopic");
+	ast_test_validate(test, NULL != topic);
+
+	/* The direct path is forwarded before the parent has a subscriber, the
+	 * path through the middle topic after */
+	forward_direct = stasis_forward_all(topic, parent_topic);
+	ast_test_validate(test, NULL != forward_direct);
+
+	parent_consumer = consumer_create(1);
+	ast_test_validate(test, NULL != parent_consumer);
+	parent_sub = stasis_subscribe(parent_topic, consumer_exec, parent_consumer);
+	ast_test_validate(test, NULL != parent_sub);
+	ao2_ref(parent_consumer, +1);
+
+	forward_middle = stasis_forward_all(topic, middle_topic);
+	ast_test_validate(test, NULL != forward_middle);
+	forward_parent = stasis_forward_all(middle_topic, parent_topic);
+	ast_test_validate(test, NULL != forward_parent);
+	ast_test_validate(test, 1 == stasis_topic_subscribers(topic));
+
+	test_data = ao2_alloc(1, NULL);
+	ast_test_validate(test, NULL != test_data);
+	ast_test_validate(test, stasis_message_type_create("TestMessage", NULL, &test_message_type) == STASIS_MESSAGE_TYPE_SUCCESS);
+	test_message = stasis_message_create(test_message_type, test_data);
+
+	stasis_publish(topic, test_message);
+	actual_len = consumer_wait_for(parent_consumer, 1);
+	ast_test_validate(test, 1 == actual_len);
+	actual_len = consumer_should_stay(parent_consumer, 1);
+	ast_test_validate(test, 1 == actual_len);
+
+	/* Still reached through the middle topic */
+	forward_direct = stasis_forward_cancel(forward_direct);
+	stasis_publish(topic, test_message);
+	actual_len = consumer_wait_for(parent_consumer, 2);
+	ast_test_validate(test, 2 == actual_len);
+	actual_len = consumer_should_stay(parent_consumer, 2);
+	ast_test_validate(test, 2 == actual_len);
+
+	forward_parent = stasis_forward_cancel(forward_parent);
+	ast_test_validate(test, 0 == stasis_topic_subscribers(topic));
+	stasis_publish(topic, test_message);
+	actual_len = consumer_should_stay(parent_consumer, 2);
+	ast_test_validate(test, 2 == actual_len);
+
+	return AST_TEST_PASS;
+}
+
 AST_TEST_DEFINE(interleaving)
 {
 	RAII_VAR(struct stasis_topic *, parent_topic, NULL, ao2_cleanup);
@@ -1030,6 +1200,125 @@ AST_TEST_DEFINE(cache_filter)
 	return AST_TEST_PASS;
 }
 
+/*! \brief Holds up a subscription's mailbox until opened */
+static struct {
+	ast_mutex_t lock;
+	ast_cond_t cond;
+	int open;
+} coalesce_gate;
+
+static void coalesce_gate_exec(void *data, struct stasis_subscription *sub, struct stasis_message *message)
+{
+	struct timeval start = ast_tvnow();
+	struct timespec end = {
+		.tv_sec = start.tv_sec + 5,
+		.tv_nsec = start.tv_usec * 1000
+	};
+
+	ast_mutex_lock(&coalesce_gate.lock);
+	while (!coalesce_gate.open) {
+		if (ast_cond_timedwait(&coalesce_gate.cond, &coalesce_gate.lock, &end) == ETIMEDOUT) {
+			break;
+		}
+	}
+	ast_mutex_unlock(&coalesce_gate.lock);
+
+	consumer_exec(data, sub, message);
+}
+
+static void coalesce_gate_open(int open)
+{
+	ast_mutex_lock(&coalesce_gate.lock);
+	coalesce_gate.open = open;
+	ast_cond_signal(&coalesce_gate.cond);
+	ast_mutex_unlock(&coalesce_gate.lock);
+}
+
+AST_TEST_DEFINE(cache_coalesce)
+{
+	RAII_VAR(struct stasis_message_type *, cache_type, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_topic *, topic, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_cache *, cache, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_caching_topic *, caching_topic, NULL, stasis_caching_unsubscribe);
+	RAII_VAR(struct consumer *, consumer, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_subscription *, sub, NULL, stasis_unsubscribe);
+	RAII_VAR(struct stasis_message *, test_message1_1, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_message *, test_message1_2, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_message *, test_message1_3, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_message *, test_message2_1, NULL, ao2_cleanup);
+	struct stasis_cache_update *actual_update;
+	int actual_len;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = test_category;
+		info->summary = "Test coalescing cache updates waiting for a subscription.";
+		info->description = "Test that only the newest of the cache updates for an\n"
+			"ID waiting in a coalescing subscription's mailbox is dispatched.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	ast_test_validate(test, stasis_message_type_create("Cacheable", NULL, &cache_type) == STASIS_MESSAGE_TYPE_SUCCESS);
+	ast_test_validate(test, NULL != cache_type);
+	topic = stasis_topic_create("SomeTopic");
+	ast_test_validate(test, NULL != topic);
+	cache = stasis_cache_create(cache_test_data_id);
+	ast_test_validate(test, NULL != cache);
+	caching_topic = stasis_caching_topic_create(topic, cache);
+	ast_test_validate(test, NULL != caching_topic);
+	consumer = consumer_create(1);
+	ast_test_validate(test, NULL != consumer);
+
+	/* The subscribe message holds up the mailbox until the gate opens */
+	coalesce_gate_open(0);
+	sub = stasis_subscribe(stasis_caching_get_topic(caching_topic), coalesce_gate_exec, consumer);
+	ast_test_validate(test, NULL != sub);
+	ao2_ref(consumer, +1);
+	ast_test_validate(test, 0 == stasis_subscription_coalesce_cache_updates(sub));
+
+	test_message1_1 = cache_test_message_create(cache_type, "1", "1");
+	ast_test_validate(test, NULL != test_message1_1);
+	test_message1_2 = cache_test_message_create(cache_type, "1", "2");
+	ast_test_validate(test, NULL != test_message1_2);
+	test_message1_3 = cache_test_message_create(cache_type, "1", "3");
+	ast_test_validate(test, NULL != test_message1_3);
+	test_message2_1 = cache_test_message_create(cache_type, "2", "1");
+	ast_test_validate(test, NULL != test_message2_1);
+
+	stasis_publish(topic, test_message1_1);
+	stasis_publish(topic, test_message2_1);
+	stasis_publish(topic, test_message1_2);
+	stasis_publish(topic, test_message1_3);
+	coalesce_gate_open(1);
+
+	actual_len = consumer_wait_for(consumer, 2);
+	ast_test_validate(test, 2 == actual_len);
+	actual_len = consumer_should_stay(consumer, 2);
+	ast_test_validate(test, 2 == actual_len);
+
+	/* The update for ID 1 keeps its place in the mailbox, with the newest value */
+	actual_update = stasis_message_data(consumer->messages_rxed[0]);
+	ast_test_validate(test, !strcmp("1", actual_update->id));
+	ast_test_validate(test, test_message1_2 == actual_update->old_snapshot);
+	ast_test_validate(test, test_message1_3 == actual_update->new_snapshot);
+	actual_update = stasis_message_data(consumer->messages_rxed[1]);
+	ast_test_validate(test, !strcmp("2", actual_update->id));
+	ast_test_validate(test, NULL == actual_update->old_snapshot);
+	ast_test_validate(test, test_message2_1 == actual_update->new_snapshot);
+
+	/* Once dispatched, later updates are queued again */
+	stasis_publish(topic, test_message1_1);
+	actual_len = consumer_wait_for(consumer, 3);
+	ast_test_validate(test, 3 == actual_len);
+	actual_update = stasis_message_data(consumer->messages_rxed[2]);
+	ast_test_validate(test, test_message1_1 == actual_update->new_snapshot);
+
+	return AST_TEST_PASS;
+}
+
 AST_TEST_DEFINE(cache)
 {
 	RAII_VAR(struct stasis_message_type *, cache_type, NULL, ao2_cleanup);
@@ -1129,6 +1418,65 @@ AST_TEST_DEFINE(cache)
 	return AST_TEST_PASS;
 }
 
+AST_TEST_DEFINE(cache_dump_many)
+{
+	RAII_VAR(struct stasis_message_type *, cache_type, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_topic *, topic, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_cache *, cache, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_caching_topic *, caching_topic, NULL, stasis_caching_unsubscribe);
+	RAII_VAR(struct ao2_container *, cache_dump, NULL, ao2_cleanup);
+	struct stasis_message *test_message;
+	char id[16];
+	int idx;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = test_category;
+		info->summary = "Test cache dump routines with many entries.";
+		info->description = "Test that dumping a cache finds entries spread over\n"
+			"all of its shards, and that each can be retrieved.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	ast_test_validate(test, stasis_message_type_create("Cacheable", NULL, &cache_type) == STASIS_MESSAGE_TYPE_SUCCESS);
+	ast_test_validate(test, NULL != cache_type);
+	topic = stasis_topic_create("SomeTopic");
+	ast_test_validate(test, NULL != topic);
+	cache = stasis_cache_create(cache_test_data_id);
+	ast_test_validate(test, NULL != cache);
+	caching_topic = stasis_caching_topic_create(topic, cache);
+	ast_test_validate(test, NULL != caching_topic);
+
+	/* The caching topic updates the cache as the message is published */
+	for (idx = 0; idx < 200; ++idx) {
+		snprintf(id, sizeof(id), "%d", idx);
+		test_message = cache_test_message_create(cache_type, id, "1");
+		ast_test_validate(test, NULL != test_message);
+		stasis_publish(topic, test_message);
+		ao2_ref(test_message, -1);
+	}
+
+	cache_dump = stasis_cache_dump(cache, NULL);
+	ast_test_validate(test, NULL != cache_dump);
+	ast_test_validate(test, 200 == ao2_container_count(cache_dump));
+	ao2_cleanup(cache_dump);
+	cache_dump = stasis_cache_dump_all(cache, cache_type);
+	ast_test_validate(test, NULL != cache_dump);
+	ast_test_validate(test, 200 == ao2_container_count(cache_dump));
+
+	for (idx = 0; idx < 200; ++idx) {
+		snprintf(id, sizeof(id), "%d", idx);
+		test_message = stasis_cache_get(cache, cache_type, id);
+		ast_test_validate(test, NULL != test_message);
+		ao2_ref(test_message, -1);
+	}
+
+	return AST_TEST_PASS;
+}
+
 AST_TEST_DEFINE(cache_dump)
 {
 	RAII_VAR(struct stasis_message_type *, cache_type, NULL, ao2_cleanup);
@@ -2298,6 +2646,46 @@ AST_TEST_DEFINE(type_filters)
 	return AST_TEST_PASS;
 }
 
+AST_TEST_DEFINE(topic_wants_type)
+{
+	RAII_VAR(struct cts *, cts, NULL, ao2_cleanup);
+	RAII_VAR(struct test_message_types *, types, NULL, ao2_cleanup);
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = test_category "filtering/";
+		info->summary = "Test checking a topic for subscribers of a type";
+		info->description = "Test checking a topic for subscribers of a type\n"
+			"before and after a subscriber filters by type";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	types = create_message_types(test);
+	ast_test_validate(test, NULL != types);
+
+	cts = create_cts(test);
+	ast_test_validate(test, NULL != cts);
+
+	/* An unfiltered subscriber wants everything */
+	ast_test_validate(test, stasis_topic_wants_message_type(cts->topic, types->type1));
+	ast_test_validate(test, stasis_topic_wants_message_type(cts->topic, types->type3));
+
+	ast_test_validate(test, stasis_subscription_accept_message_type(cts->sub, types->type1) == 0);
+	ast_test_validate(test, stasis_subscription_set_filter(cts->sub, STASIS_SUBSCRIPTION_FILTER_SELECTIVE) == 0);
+
+	ast_test_validate(test, stasis_topic_wants_message_type(cts->topic, types->type1));
+	ast_test_validate(test, !stasis_topic_wants_message_type(cts->topic, types->type2));
+	ast_test_validate(test, !stasis_topic_wants_message_type(cts->topic, types->type3));
+
+	ast_test_validate(test, stasis_subscription_decline_message_type(cts->sub, types->type1) == 0);
+	ast_test_validate(test, !stasis_topic_wants_message_type(cts->topic, types->type1));
+
+	return AST_TEST_PASS;
+}
+
 AST_TEST_DEFINE(formatter_filters)
 {
 	RAII_VAR(struct cts *, cts, NULL, ao2_cleanup);
@@ -2437,6 +2825,7 @@ static int unload_module(void)
 {
 	AST_TEST_UNREGISTER(message_type);
 	AST_TEST_UNREGISTER(message);
+	AST_TEST_UNREGISTER(message_render_cached);
 	AST_TEST_UNREGISTER(subscription_messages);
 	AST_TEST_UNREGISTER(subscription_pool_messages);
 	AST_TEST_UNREGISTER(publish);
@@ -2444,9 +2833,12 @@ static int unload_module(void)
 	AST_TEST_UNREGISTER(publish_pool);
 	AST_TEST_UNREGISTER(unsubscribe_stops_messages);
 	AST_TEST_UNREGISTER(forward);
+	AST_TEST_UNREGISTER(forward_diamond);
 	AST_TEST_UNREGISTER(cache_filter);
 	AST_TEST_UNREGISTER(cache);
+	AST_TEST_UNREGISTER(cache_coalesce);
 	AST_TEST_UNREGISTER(cache_dump);
+	AST_TEST_UNREGISTER(cache_dump_many);
 	AST_TEST_UNREGISTER(cache_eid_aggregate);
 	AST_TEST_UNREGISTER(router);
 	AST_TEST_UNREGISTER(router_pool);
@@ -2460,15 +2852,23 @@ static int unload_module(void)
 	AST_TEST_UNREGISTER(dtor_order);
 	AST_TEST_UNREGISTER(caching_dtor_order);
 	AST_TEST_UNREGISTER(type_filters);
+	AST_TEST_UNREGISTER(topic_wants_type);
 	AST_TEST_UNREGISTER(formatter_filters);
 	AST_TEST_UNREGISTER(combo_filters);
+
+	ast_mutex_destroy(&coalesce_gate.lock);
+	ast_cond_destroy(&coalesce_gate.cond);
 	return 0;
 }
 
 static int load_module(void)
 {
+	ast_mutex_init(&coalesce_gate.lock);
+	ast_cond_init(&coalesce_gate.cond, NULL);
+
 	AST_TEST_REGISTER(message_type);
 	AST_TEST_REGISTER(message);
+	AST_TEST_REGISTER(message_render_cached);
 	AST_TEST_REGISTER(subscription_messages);
 	AST_TEST_REGISTER(subscription_pool_messages);
 	AST_TEST_REGISTER(publish);
@@ -2476,9 +2876,12 @@ static int load_module(void)
 	AST_TEST_REGISTER(publish_pool);
 	AST_TEST_REGISTER(unsubscribe_stops_messages);
 	AST_TEST_REGISTER(forward);
+	AST_TEST_REGISTER(forward_diamond);
 	AST_TEST_REGISTER(cache_filter);
 	AST_TEST_REGISTER(cache);
+	AST_TEST_REGISTER(cache_coalesce);
 	AST_TEST_REGISTER(cache_dump);
+	AST_TEST_REGISTER(cache_dump_many);
 	AST_TEST_REGISTER(cache_eid_aggregate);
 	AST_TEST_REGISTER(router);
 	AST_TEST_REGISTER(router_pool);
@@ -2492,6 +2895,7 @@ static int load_module(void)
 	AST_TEST_REGISTER(dtor_order);
 	AST_TEST_REGISTER(caching_dtor_order);
 	AST_TEST_REGISTER(type_filters);
+	AST_TEST_REGISTER(topic_wants_type);
 	AST_TEST_REGISTER(formatter_filters);
 	AST_TEST_REGISTER(combo_filters);
 	return AST_MODULE_LOAD_SUCCESS;
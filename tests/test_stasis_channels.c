@@ -306,6 +306,61 @@ AST_TEST_DEFINE(channel_snapshot_json)
 	return AST_TEST_PASS;
 }
 
+AST_TEST_DEFINE(channel_snapshot_segments)
+{
+	RAII_VAR(struct ast_channel *, chan, NULL, safe_channel_release);
+	RAII_VAR(struct ast_channel_snapshot *, first, NULL, ao2_cleanup);
+	RAII_VAR(struct ast_channel_snapshot *, second, NULL, ao2_cleanup);
+	RAII_VAR(struct ast_channel_snapshot *, third, NULL, ao2_cleanup);
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = test_category;
+		info->summary = "Test sharing of unchanged channel snapshot segments";
+		info->description = "Test that a new channel snapshot shares the segments\n"
+			"of the previous one that did not change, and recreates the rest";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	chan = ast_channel_alloc(0, AST_STATE_DOWN, "cid_num", "cid_name", "acctcode", "exten", "context", NULL, NULL, 0, "TEST/name");
+	ast_test_validate(test, NULL != chan);
+	ast_channel_publish_snapshot(chan);
+	first = ao2_bump(ast_channel_snapshot(chan));
+	ast_channel_unlock(chan);
+	ast_test_validate(test, NULL != first);
+
+	/* Only the dialplan changes */
+	ast_channel_lock(chan);
+	ast_channel_data_set(chan, "app data");
+	ast_channel_publish_snapshot(chan);
+	second = ao2_bump(ast_channel_snapshot(chan));
+	ast_channel_unlock(chan);
+	ast_test_validate(test, NULL != second && second != first);
+	ast_test_validate(test, second->dialplan != first->dialplan);
+	ast_test_validate(test, !strcmp("app data", second->dialplan->data));
+	ast_test_validate(test, second->base == first->base);
+	ast_test_validate(test, second->caller == first->caller);
+	ast_test_validate(test, second->connected == first->connected);
+
+	/* Caller information is not tracked by the channel, but is still noticed */
+	ast_set_callerid(chan, NULL, "new_name", NULL);
+	ast_channel_lock(chan);
+	ast_channel_publish_snapshot(chan);
+	third = ao2_bump(ast_channel_snapshot(chan));
+	ast_channel_unlock(chan);
+	ast_test_validate(test, NULL != third && third != second);
+	ast_test_validate(test, third->caller != second->caller);
+	ast_test_validate(test, !strcmp("new_name", third->caller->name));
+	ast_test_validate(test, !strcmp("cid_num", third->caller->number));
+	ast_test_validate(test, third->connected == second->connected);
+	ast_test_validate(test, third->dialplan == second->dialplan);
+
+	return AST_TEST_PASS;
+}
+
 static int unload_module(void)
 {
 	AST_TEST_UNREGISTER(channel_blob_create);
@@ -313,6 +368,7 @@ static int unload_module(void)
 	AST_TEST_UNREGISTER(multi_channel_blob_create);
 	AST_TEST_UNREGISTER(multi_channel_blob_snapshots);
 	AST_TEST_UNREGISTER(channel_snapshot_json);
+	AST_TEST_UNREGISTER(channel_snapshot_segments);
 
 	return 0;
 }
@@ -324,6 +380,7 @@ static int load_module(void)
 	AST_TEST_REGISTER(multi_channel_blob_create);
 	AST_TEST_REGISTER(multi_channel_blob_snapshots);
 	AST_TEST_REGISTER(channel_snapshot_json);
+	AST_TEST_REGISTER(channel_snapshot_segments);
 
 	return AST_MODULE_LOAD_SUCCESS;
 }
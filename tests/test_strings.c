@@ -249,6 +249,66 @@ cleanup:
 	return res;
 }
 
+AST_TEST_DEFINE(str_append_raw_test)
+{
+	struct ast_str *stack_str;
+	struct ast_str *heap_str;
+	enum ast_test_result_state res = AST_TEST_PASS;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "str_append_raw_test";
+		info->category = "/main/strings/";
+		info->summary = "Test appending to dynamic strings without format strings";
+		info->description = "Test ast_str_append_raw(), ast_str_append_literal() and ast_str_append_int()";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	heap_str = ast_str_create(4);
+	if (!heap_str) {
+		return AST_TEST_FAIL;
+	}
+
+	/* A bounded append may only grow the string up to max_len */
+	ast_str_append_raw(&heap_str, 6, "abcdefgh", 8);
+	if (strcmp(ast_str_buffer(heap_str), "abcde")) {
+		ast_test_status_update(test, "Bounded append gave '%s'\n", ast_str_buffer(heap_str));
+		res = AST_TEST_FAIL;
+	}
+
+	ast_str_reset(heap_str);
+	ast_str_append_literal(&heap_str, 0, "Key: ");
+	ast_str_append_int(&heap_str, 0, -1234567890123LL);
+	ast_str_append_literal(&heap_str, 0, "\r\nZero: ");
+	ast_str_append_int(&heap_str, 0, 0);
+	ast_str_append_cstr(&heap_str, 0, "\r\n");
+	if (strcmp(ast_str_buffer(heap_str), "Key: -1234567890123\r\nZero: 0\r\n")
+		|| ast_str_strlen(heap_str) != strlen(ast_str_buffer(heap_str))) {
+		ast_test_status_update(test, "Heap string contains '%s'\n", ast_str_buffer(heap_str));
+		res = AST_TEST_FAIL;
+	}
+
+	ast_str_reset(heap_str);
+	ast_str_append_int(&heap_str, 0, INTMAX_MIN);
+	if (strcmp(ast_str_buffer(heap_str), "-9223372036854775808")) {
+		ast_test_status_update(test, "INTMAX_MIN rendered as '%s'\n", ast_str_buffer(heap_str));
+		res = AST_TEST_FAIL;
+	}
+
+	stack_str = ast_str_alloca(8);
+	ast_str_append_literal(&stack_str, 0, "abc");
+	ast_str_append_literal(&stack_str, 0, "defghijk");
+	if (strcmp(ast_str_buffer(stack_str), "abcdefg")) {
+		ast_test_status_update(test, "Stack string contains '%s'\n", ast_str_buffer(stack_str));
+		res = AST_TEST_FAIL;
+	}
+
+	ast_free(heap_str);
+	return res;
+}
+
 AST_TEST_DEFINE(begins_with_test)
 {
 	switch (cmd) {
@@ -586,6 +646,7 @@ AST_TEST_DEFINE(strings_match)
 static int unload_module(void)
 {
 	AST_TEST_UNREGISTER(str_test);
+	AST_TEST_UNREGISTER(str_append_raw_test);
 	AST_TEST_UNREGISTER(begins_with_test);
 	AST_TEST_UNREGISTER(ends_with_test);
 	AST_TEST_UNREGISTER(strsep_test);
@@ -598,6 +659,7 @@ static int unload_module(void)
 static int load_module(void)
 {
 	AST_TEST_REGISTER(str_test);
+	AST_TEST_REGISTER(str_append_raw_test);
 	AST_TEST_REGISTER(begins_with_test);
 	AST_TEST_REGISTER(ends_with_test);
 	AST_TEST_REGISTER(strsep_test);
@@ -425,6 +425,213 @@ test_end:
 	return res;
 }
 
+#define MPSC_PRODUCERS 8
+#define MPSC_TASKS_PER_PRODUCER 2500
+#define MPSC_HIGH_WATER_MARK 100
+
+/*!
+ * \brief Relevant data associated with the MPSC taskprocessor test
+ */
+static struct mpsc_task_data {
+	/*! Condition used to indicate a task has completed or the gate opened */
+	ast_cond_t cond;
+	/*! Lock used to protect the condition */
+	ast_mutex_t lock;
+	/*! Boolean holding the consumer in the gate task while producers push */
+	int gate_closed;
+	/*! Counter of the number of completed tasks */
+	int tasks_completed;
+	/*! Boolean set if a producer's tasks ran out of order */
+	int out_of_order;
+	/*! Sequence number last executed for each producer */
+	int last_seq[MPSC_PRODUCERS];
+} mpsc_results;
+
+/*! \brief A task encoding its producer and per-producer sequence number */
+struct mpsc_task {
+	int producer;
+	int seq;
+};
+
+static struct mpsc_task mpsc_tasks[MPSC_PRODUCERS][MPSC_TASKS_PER_PRODUCER];
+
+/*! \brief Arguments for a producer thread */
+struct mpsc_producer {
+	struct ast_taskprocessor *tps;
+	int producer;
+	int failed;
+};
+
+static int mpsc_gate_task(void *data)
+{
+	SCOPED_MUTEX(lock, &mpsc_results.lock);
+	while (mpsc_results.gate_closed) {
+		ast_cond_wait(&mpsc_results.cond, &mpsc_results.lock);
+	}
+	return 0;
+}
+
+static int mpsc_load_task(void *data)
+{
+	struct mpsc_task *task = data;
+	SCOPED_MUTEX(lock, &mpsc_results.lock);
+
+	if (mpsc_results.last_seq[task->producer] + 1 != task->seq) {
+		mpsc_results.out_of_order = 1;
+	}
+	mpsc_results.last_seq[task->producer] = task->seq;
+	++mpsc_results.tasks_completed;
+	ast_cond_signal(&mpsc_results.cond);
+	return 0;
+}
+
+static void *mpsc_producer_thread(void *data)
+{
+	struct mpsc_producer *producer = data;
+	int i;
+
+	for (i = 0; i < MPSC_TASKS_PER_PRODUCER; ++i) {
+		struct mpsc_task *task = &mpsc_tasks[producer->producer][i];
+
+		task->producer = producer->producer;
+		task->seq = i;
+		if (ast_taskprocessor_push(producer->tps, mpsc_load_task, task)) {
+			producer->failed = 1;
+			break;
+		}
+	}
+	return NULL;
+}
+
+/*!
+ * \brief Load test for a taskprocessor using the lock-free MPSC queue
+ *
+ * Several threads push tasks concurrently while the consumer is held in a
+ * gate task.  The test ensures every task runs, each producer's tasks run in
+ * the order they were pushed, and the high water alert is raised and cleared.
+ */
+AST_TEST_DEFINE(taskprocessor_mpsc_load)
+{
+	struct ast_taskprocessor *tps;
+	struct mpsc_producer producers[MPSC_PRODUCERS];
+	pthread_t threads[MPSC_PRODUCERS];
+	struct timeval start;
+	struct timespec ts;
+	enum ast_test_result_state res = AST_TEST_PASS;
+	unsigned int alert_level;
+	int total = MPSC_PRODUCERS * MPSC_TASKS_PER_PRODUCER;
+	int started = 0;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "taskprocessor_mpsc_load";
+		info->category = "/main/taskprocessor/";
+		info->summary = "Load test of an MPSC taskprocessor";
+		info->description =
+			"Ensure tasks pushed concurrently onto an MPSC taskprocessor are\n"
+			"all executed in per-producer order and water marks still work.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	tps = ast_taskprocessor_get("test_mpsc", TPS_REF_DEFAULT | TPS_QUEUE_MPSC);
+	if (!tps) {
+		ast_test_status_update(test, "Unable to create test taskprocessor\n");
+		return AST_TEST_FAIL;
+	}
+	ast_taskprocessor_alert_set_levels(tps, -1, MPSC_HIGH_WATER_MARK);
+	alert_level = ast_taskprocessor_alert_get();
+
+	ast_cond_init(&mpsc_results.cond, NULL);
+	ast_mutex_init(&mpsc_results.lock);
+	mpsc_results.gate_closed = 1;
+	mpsc_results.tasks_completed = 0;
+	mpsc_results.out_of_order = 0;
+	for (i = 0; i < MPSC_PRODUCERS; ++i) {
+		mpsc_results.last_seq[i] = -1;
+	}
+
+	if (ast_taskprocessor_push(tps, mpsc_gate_task, NULL)) {
+		ast_test_status_update(test, "Failed to queue gate task\n");
+		res = AST_TEST_FAIL;
+		goto test_end;
+	}
+
+	for (i = 0; i < MPSC_PRODUCERS; ++i) {
+		producers[i].tps = tps;
+		producers[i].producer = i;
+		producers[i].failed = 0;
+		if (ast_pthread_create(&threads[i], NULL, mpsc_producer_thread, &producers[i])) {
+			ast_test_status_update(test, "Failed to start producer thread\n");
+			res = AST_TEST_FAIL;
+			break;
+		}
+		++started;
+	}
+	for (i = 0; i < started; ++i) {
+		pthread_join(threads[i], NULL);
+		if (producers[i].failed) {
+			ast_test_status_update(test, "Producer %d failed to queue a task\n", i);
+			res = AST_TEST_FAIL;
+		}
+	}
+
+	if (res == AST_TEST_PASS) {
+		if (ast_taskprocessor_size(tps) != total) {
+			ast_test_status_update(test, "Unexpected queue size. Expected %d but got %ld\n",
+				total, ast_taskprocessor_size(tps));
+			res = AST_TEST_FAIL;
+		}
+		if (ast_taskprocessor_alert_get() != alert_level + 1) {
+			ast_test_status_update(test, "High water alert was not raised\n");
+			res = AST_TEST_FAIL;
+		}
+	}
+
+	start = ast_tvnow();
+	ts.tv_sec = start.tv_sec + 60;
+	ts.tv_nsec = start.tv_usec * 1000;
+
+	ast_mutex_lock(&mpsc_results.lock);
+	mpsc_results.gate_closed = 0;
+	ast_cond_broadcast(&mpsc_results.cond);
+	while (mpsc_results.tasks_completed < started * MPSC_TASKS_PER_PRODUCER) {
+		if (ast_cond_timedwait(&mpsc_results.cond, &mpsc_results.lock, &ts) == ETIMEDOUT) {
+			break;
+		}
+	}
+	ast_mutex_unlock(&mpsc_results.lock);
+
+	if (res != AST_TEST_PASS) {
+		goto test_end;
+	}
+
+	if (mpsc_results.tasks_completed != total) {
+		ast_test_status_update(test, "Unexpected number of tasks executed. Expected %d but got %d\n",
+			total, mpsc_results.tasks_completed);
+		res = AST_TEST_FAIL;
+		goto test_end;
+	}
+
+	if (mpsc_results.out_of_order) {
+		ast_test_status_update(test, "Queued tasks did not execute in order\n");
+		res = AST_TEST_FAIL;
+	}
+
+	if (ast_taskprocessor_alert_get() != alert_level) {
+		ast_test_status_update(test, "High water alert was not cleared\n");
+		res = AST_TEST_FAIL;
+	}
+
+test_end:
+	tps = ast_taskprocessor_unreference(tps);
+	ast_mutex_destroy(&mpsc_results.lock);
+	ast_cond_destroy(&mpsc_results.cond);
+	return res;
+}
+
 /*!
  * \brief Private data for the test taskprocessor listener
  */
@@ -640,6 +847,159 @@ test_exit:
 	return res;
 }
 
+#define BATCH_TASKS 5
+#define BATCH_SIZE 3
+
+/*! Sequence numbers of the batch test tasks in the order they executed */
+static int batch_results[BATCH_TASKS];
+/*! Number of batch test tasks executed */
+static int batch_executed;
+
+/*!
+ * \brief Queued task for the taskprocessor batch test.
+ *
+ * Appends its sequence number to the array of executed tasks.
+ */
+static int batch_test_task(void *data)
+{
+	int *seq = data;
+
+	batch_results[batch_executed++] = *seq;
+	return 0;
+}
+
+/*!
+ * \brief Run the batch test against a taskprocessor created with \a options
+ */
+static enum ast_test_result_state batch_test_run(struct ast_test *test, enum ast_tps_options options)
+{
+	struct ast_taskprocessor *tps = NULL;
+	struct ast_taskprocessor_listener *listener = NULL;
+	struct test_listener_pvt *pvt = NULL;
+	enum ast_test_result_state res = AST_TEST_PASS;
+	int seq[BATCH_TASKS];
+	void *datap[BATCH_TASKS];
+	int i;
+
+	pvt = test_listener_pvt_alloc();
+	if (!pvt) {
+		ast_test_status_update(test, "Unable to allocate test taskprocessor listener user data\n");
+		return AST_TEST_FAIL;
+	}
+
+	listener = ast_taskprocessor_listener_alloc(&test_callbacks, pvt);
+	if (!listener) {
+		ast_test_status_update(test, "Unable to allocate test taskprocessor listener\n");
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	tps = ast_taskprocessor_create_with_listener_options("test_batch", listener, options);
+	if (!tps) {
+		ast_test_status_update(test, "Unable to allocate test taskprocessor\n");
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	if (!ast_taskprocessor_set_batch_size(tps, 0)) {
+		ast_test_status_update(test, "A batch size of zero was accepted\n");
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+	ast_taskprocessor_set_batch_size(tps, BATCH_SIZE);
+
+	batch_executed = 0;
+	for (i = 0; i < BATCH_TASKS; ++i) {
+		seq[i] = i;
+		datap[i] = &seq[i];
+	}
+
+	if (ast_taskprocessor_push_batch(tps, batch_test_task, datap, BATCH_TASKS)) {
+		ast_test_status_update(test, "Failed to queue batch\n");
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	/* The listener sees one notification per task, only the first on an empty queue */
+	if (check_stats(test, pvt, BATCH_TASKS, 0, 1) < 0
+		|| ast_taskprocessor_size(tps) != BATCH_TASKS) {
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	if (!ast_taskprocessor_execute(tps) || batch_executed != BATCH_SIZE) {
+		ast_test_status_update(test, "Expected %d tasks from the first batch but got %d\n",
+			BATCH_SIZE, batch_executed);
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	if (check_stats(test, pvt, BATCH_TASKS, 0, 1) < 0) {
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	if (ast_taskprocessor_execute(tps) || batch_executed != BATCH_TASKS) {
+		ast_test_status_update(test, "Expected %d tasks after the second batch but got %d\n",
+			BATCH_TASKS, batch_executed);
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	if (check_stats(test, pvt, BATCH_TASKS, 1, 1) < 0) {
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	for (i = 0; i < BATCH_TASKS; ++i) {
+		if (batch_results[i] != i) {
+			ast_test_status_update(test, "Batched tasks did not execute in order\n");
+			res = AST_TEST_FAIL;
+			goto test_exit;
+		}
+	}
+
+	if (ast_taskprocessor_execute(tps)) {
+		ast_test_status_update(test, "Empty taskprocessor reported remaining tasks\n");
+		res = AST_TEST_FAIL;
+	}
+
+test_exit:
+	ao2_cleanup(listener);
+	/* This is safe even if tps is NULL */
+	ast_taskprocessor_unreference(tps);
+	ast_free(pvt);
+	return res;
+}
+
+/*!
+ * \brief Test of batched pushes and batched execution.
+ *
+ * Pushes several tasks with a single call and executes them in batches,
+ * for both the locked list and the MPSC queue.
+ */
+AST_TEST_DEFINE(taskprocessor_batch)
+{
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "taskprocessor_batch";
+		info->category = "/main/taskprocessor/";
+		info->summary = "Test of batched taskprocessor pushes and execution";
+		info->description =
+			"Ensures batched tasks are queued and executed in order and\n"
+			"that listener callbacks are called when expected.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	if (batch_test_run(test, TPS_REF_DEFAULT) != AST_TEST_PASS) {
+		return AST_TEST_FAIL;
+	}
+
+	return batch_test_run(test, TPS_QUEUE_MPSC);
+}
+
 struct shutdown_data {
 	ast_cond_t in;
 	ast_cond_t out;
@@ -893,8 +1253,10 @@ static int unload_module(void)
 {
 	ast_test_unregister(default_taskprocessor);
 	ast_test_unregister(default_taskprocessor_load);
+	ast_test_unregister(taskprocessor_mpsc_load);
 	ast_test_unregister(subsystem_alert);
 	ast_test_unregister(taskprocessor_listener);
+	ast_test_unregister(taskprocessor_batch);
 	ast_test_unregister(taskprocessor_shutdown);
 	ast_test_unregister(taskprocessor_push_local);
 	return 0;
@@ -904,8 +1266,10 @@ static int load_module(void)
 {
 	ast_test_register(default_taskprocessor);
 	ast_test_register(default_taskprocessor_load);
+	ast_test_register(taskprocessor_mpsc_load);
 	ast_test_register(subsystem_alert);
 	ast_test_register(taskprocessor_listener);
+	ast_test_register(taskprocessor_batch);
 	ast_test_register(taskprocessor_shutdown);
 	ast_test_register(taskprocessor_push_local);
 	return AST_MODULE_LOAD_SUCCESS;
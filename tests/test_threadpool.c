@@ -1798,6 +1798,234 @@ end:
 	return res;
 }
 
+struct steal_me_data {
+	/*! The work-stealing threadpool */
+	struct ast_threadpool *pool;
+	/*! Data for the task that must be stolen */
+	struct simple_task_data *stolen;
+	/*! Marked executed once the stolen task has run */
+	struct simple_task_data *done;
+};
+
+/*!
+ * \brief Task that queues a second task and waits for someone else to run it
+ *
+ * Since the second task is pushed from a worker thread it is placed on that
+ * worker's own queue. The worker is blocked here so the only way for the
+ * second task to run is for another worker to steal it.
+ */
+static int steal_me_task(void *data)
+{
+	struct steal_me_data *smd = data;
+	struct simple_task_data *std = smd->stolen;
+	struct timeval start = ast_tvnow();
+	struct timespec end = {
+		.tv_sec = start.tv_sec + 5,
+		.tv_nsec = start.tv_usec * 1000
+	};
+	int executed;
+
+	ast_mutex_lock(&std->lock);
+	if (ast_threadpool_push(smd->pool, simple_task, std)) {
+		ast_mutex_unlock(&std->lock);
+		return 0;
+	}
+
+	/* simple_task needs std->lock, which waiting releases */
+	while (!std->task_executed) {
+		if (ast_cond_timedwait(&std->cond, &std->lock, &end) == ETIMEDOUT) {
+			break;
+		}
+	}
+	executed = std->task_executed;
+	ast_mutex_unlock(&std->lock);
+
+	if (executed) {
+		simple_task(smd->done);
+	}
+	return 0;
+}
+
+AST_TEST_DEFINE(threadpool_work_stealing)
+{
+	struct ast_threadpool *pool = NULL;
+	struct simple_task_data *stolen = NULL;
+	struct simple_task_data *done = NULL;
+	struct steal_me_data smd;
+	enum ast_test_result_state res = AST_TEST_FAIL;
+	struct ast_threadpool_options options = {
+		.version = AST_THREADPOOL_OPTIONS_VERSION,
+		.idle_timeout = 0,
+		.auto_increment = 0,
+		.initial_size = 2,
+		.max_size = 0,
+		.work_stealing = 1,
+	};
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "work_stealing";
+		info->category = "/main/threadpool/";
+		info->summary = "Test that idle threads steal queued tasks";
+		info->description =
+			"Have a task in a work-stealing threadpool push a second task\n"
+			"and then block until the second task is run. The second task\n"
+			"lands on the blocked thread's own queue so it can only run if\n"
+			"the other thread steals it.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	pool = ast_threadpool_create(info->name, NULL, &options);
+	if (!pool) {
+		goto end;
+	}
+
+	stolen = simple_task_data_alloc();
+	done = simple_task_data_alloc();
+	if (!stolen || !done) {
+		goto end;
+	}
+
+	smd.pool = pool;
+	smd.stolen = stolen;
+	smd.done = done;
+	if (ast_threadpool_push(pool, steal_me_task, &smd)) {
+		goto end;
+	}
+
+	res = wait_for_completion(test, done);
+
+end:
+	ast_threadpool_shutdown(pool);
+	simple_task_data_free(stolen);
+	simple_task_data_free(done);
+	return res;
+}
+
+#define WORK_STEALING_TASKS 200
+
+struct ordered_task_data {
+	/*! Serializer the tasks belong to */
+	struct ast_taskprocessor *serializer;
+	/*! Next sequence number expected by a task */
+	int next;
+	/*! Number of tasks that saw the wrong sequence number or serializer */
+	int out_of_order;
+	ast_mutex_t lock;
+	ast_cond_t cond;
+};
+
+struct ordered_task {
+	struct ordered_task_data *otd;
+	int seq;
+};
+
+static int ordered_task(void *data)
+{
+	struct ordered_task *ot = data;
+	struct ordered_task_data *otd = ot->otd;
+	SCOPED_MUTEX(lock, &otd->lock);
+
+	if (ot->seq != otd->next || ast_threadpool_serializer_get_current() != otd->serializer) {
+		++otd->out_of_order;
+	}
+	++otd->next;
+	ast_cond_signal(&otd->cond);
+	ast_free(ot);
+	return 0;
+}
+
+AST_TEST_DEFINE(threadpool_work_stealing_serializer)
+{
+	struct ast_threadpool *pool = NULL;
+	struct ast_taskprocessor *uut = NULL;
+	struct ordered_task_data otd = { 0, };
+	struct timeval start;
+	struct timespec end;
+	enum ast_test_result_state res = AST_TEST_FAIL;
+	int i;
+	struct ast_threadpool_options options = {
+		.version = AST_THREADPOOL_OPTIONS_VERSION,
+		.idle_timeout = 0,
+		.auto_increment = 0,
+		.initial_size = 4,
+		.max_size = 0,
+		.work_stealing = 1,
+	};
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "work_stealing_serializer";
+		info->category = "/main/threadpool/";
+		info->summary = "Test serializer ordering in a work-stealing threadpool";
+		info->description =
+			"Push a burst of tasks to a serializer of a work-stealing\n"
+			"threadpool and ensure they all execute, in order, as part of\n"
+			"that serializer.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	ast_mutex_init(&otd.lock);
+	ast_cond_init(&otd.cond, NULL);
+
+	pool = ast_threadpool_create(info->name, NULL, &options);
+	if (!pool) {
+		goto end;
+	}
+
+	uut = ast_threadpool_serializer("ws_ser1", pool);
+	if (!uut) {
+		goto end;
+	}
+	otd.serializer = uut;
+
+	for (i = 0; i < WORK_STEALING_TASKS; ++i) {
+		struct ordered_task *ot = ast_malloc(sizeof(*ot));
+
+		if (!ot) {
+			goto end;
+		}
+		ot->otd = &otd;
+		ot->seq = i;
+		if (ast_taskprocessor_push(uut, ordered_task, ot)) {
+			ast_free(ot);
+			goto end;
+		}
+	}
+
+	start = ast_tvnow();
+	end.tv_sec = start.tv_sec + 5;
+	end.tv_nsec = start.tv_usec * 1000;
+
+	ast_mutex_lock(&otd.lock);
+	while (otd.next < WORK_STEALING_TASKS) {
+		if (ast_cond_timedwait(&otd.cond, &otd.lock, &end) == ETIMEDOUT) {
+			break;
+		}
+	}
+	ast_mutex_unlock(&otd.lock);
+
+	if (otd.next != WORK_STEALING_TASKS) {
+		ast_test_status_update(test, "Only %d of %d tasks executed\n",
+			otd.next, WORK_STEALING_TASKS);
+	} else if (otd.out_of_order) {
+		ast_test_status_update(test, "%d tasks executed out of order\n", otd.out_of_order);
+	} else {
+		res = AST_TEST_PASS;
+	}
+
+end:
+	ast_taskprocessor_unreference(uut);
+	ast_threadpool_shutdown(pool);
+	ast_mutex_destroy(&otd.lock);
+	ast_cond_destroy(&otd.cond);
+	return res;
+}
+
 static int unload_module(void)
 {
 	ast_test_unregister(threadpool_push);
@@ -1816,6 +2044,8 @@ static int unload_module(void)
 	ast_test_unregister(threadpool_more_destruction);
 	ast_test_unregister(threadpool_serializer);
 	ast_test_unregister(threadpool_serializer_dupe);
+	ast_test_unregister(threadpool_work_stealing);
+	ast_test_unregister(threadpool_work_stealing_serializer);
 	return 0;
 }
 
@@ -1837,6 +2067,8 @@ static int load_module(void)
 	ast_test_register(threadpool_more_destruction);
 	ast_test_register(threadpool_serializer);
 	ast_test_register(threadpool_serializer_dupe);
+	ast_test_register(threadpool_work_stealing);
+	ast_test_register(threadpool_work_stealing_serializer);
 	return AST_MODULE_LOAD_SUCCESS;
 }
 
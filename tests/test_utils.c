@@ -42,6 +42,8 @@
 #include "asterisk/agi.h"
 #include "asterisk/channel.h"
 #include "asterisk/module.h"
+#include "asterisk/ulaw.h"
+#include "asterisk/alaw.h"
 
 #include <sys/stat.h>
 
@@ -613,6 +615,160 @@ AST_TEST_DEFINE(quote_unescaping)
 	return AST_TEST_PASS;
 }
 
+AST_TEST_DEFINE(slinear_saturated_array)
+{
+	/* Odd sizes and offsets exercise the unaligned heads and scalar tails */
+	short input[203];
+	short value[203];
+	short expected[203];
+	unsigned int magnitude;
+	int offset;
+	int len;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "slinear_saturated_array";
+		info->category = "/main/utils/";
+		info->summary = "Test saturated signed linear array arithmetic";
+		info->description =
+			"This tests that ast_slinear_saturated_add_array() and "
+			"ast_slinear_saturated_subtract_array() give the same results "
+			"as the per-sample functions, and that "
+			"ast_slinear_average_magnitude() matches a plain average.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	ast_test_status_update(test, "Using the %s kernels\n", ast_slinear_simd_name());
+
+	for (offset = 0; offset < 3; ++offset) {
+		for (len = 0; len + offset <= ARRAY_LEN(input); len += 7) {
+			for (i = 0; i < ARRAY_LEN(input); ++i) {
+				/* Full range values so both directions saturate */
+				input[i] = (short) (ast_random() & 0xffff);
+				value[i] = (short) (ast_random() & 0xffff);
+				expected[i] = input[i];
+			}
+
+			for (i = offset; i < offset + len; ++i) {
+				ast_slinear_saturated_add(&expected[i], &value[i]);
+			}
+			ast_slinear_saturated_add_array(input + offset, value + offset, len);
+			if (memcmp(input, expected, sizeof(input))) {
+				ast_test_status_update(test, "Add of %d samples at offset %d differs\n",
+					len, offset);
+				return AST_TEST_FAIL;
+			}
+
+			for (i = offset; i < offset + len; ++i) {
+				ast_slinear_saturated_subtract(&expected[i], &value[i]);
+			}
+			ast_slinear_saturated_subtract_array(input + offset, value + offset, len);
+			if (memcmp(input, expected, sizeof(input))) {
+				ast_test_status_update(test, "Subtract of %d samples at offset %d differs\n",
+					len, offset);
+				return AST_TEST_FAIL;
+			}
+
+			input[offset] = -32768;
+			magnitude = 0;
+			for (i = offset; i < offset + len; ++i) {
+				magnitude += abs(input[i]);
+			}
+			if (len && ast_slinear_average_magnitude(input + offset, len) != magnitude / len) {
+				ast_test_status_update(test, "Magnitude of %d samples at offset %d differs\n",
+					len, offset);
+				return AST_TEST_FAIL;
+			}
+		}
+	}
+
+	return AST_TEST_PASS;
+}
+
+AST_TEST_DEFINE(g711_array)
+{
+	/* Odd sizes and offsets exercise the scalar tails */
+	unsigned char law[203];
+	short lin[203];
+	int offset;
+	int len;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "g711_array";
+		info->category = "/main/utils/";
+		info->summary = "Test G.711 array conversion";
+		info->description =
+			"This tests that the mu-law and A-law array conversions give "
+			"the same results as the per-sample macros.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	ast_test_status_update(test, "Using the %s kernels\n", ast_g711_simd_name());
+
+	for (offset = 0; offset < 3; ++offset) {
+		for (len = 0; len + offset <= ARRAY_LEN(law); len += 7) {
+			for (i = 0; i < ARRAY_LEN(law); ++i) {
+				law[i] = ast_random() & 0xff;
+				lin[i] = (short) (ast_random() & 0xffff);
+			}
+			/* The extremes index the ends of the tables */
+			law[offset] = 0xff;
+			lin[offset] = -1;
+			if (len > 1) {
+				law[offset + 1] = 0;
+				lin[offset + 1] = -32768;
+			}
+
+			ast_ulaw_decode_array(lin + offset, law + offset, len);
+			for (i = offset; i < offset + len; ++i) {
+				if (lin[i] != AST_MULAW(law[i])) {
+					ast_test_status_update(test, "mu-law decode of %d samples at offset %d differs\n",
+						len, offset);
+					return AST_TEST_FAIL;
+				}
+			}
+			ast_alaw_decode_array(lin + offset, law + offset, len);
+			for (i = offset; i < offset + len; ++i) {
+				if (lin[i] != AST_ALAW(law[i])) {
+					ast_test_status_update(test, "A-law decode of %d samples at offset %d differs\n",
+						len, offset);
+					return AST_TEST_FAIL;
+				}
+			}
+
+			for (i = 0; i < ARRAY_LEN(lin); ++i) {
+				lin[i] = (short) (ast_random() & 0xffff);
+			}
+			lin[offset] = -1;
+			ast_ulaw_encode_array(law + offset, lin + offset, len);
+			for (i = offset; i < offset + len; ++i) {
+				if (law[i] != AST_LIN2MU(lin[i])) {
+					ast_test_status_update(test, "mu-law encode of %d samples at offset %d differs\n",
+						len, offset);
+					return AST_TEST_FAIL;
+				}
+			}
+			ast_alaw_encode_array(law + offset, lin + offset, len);
+			for (i = offset; i < offset + len; ++i) {
+				if (law[i] != AST_LIN2A(lin[i])) {
+					ast_test_status_update(test, "A-law encode of %d samples at offset %d differs\n",
+						len, offset);
+					return AST_TEST_FAIL;
+				}
+			}
+		}
+	}
+
+	return AST_TEST_PASS;
+}
+
 static int unload_module(void)
 {
 	AST_TEST_UNREGISTER(uri_encode_decode_test);
@@ -627,6 +783,8 @@ static int unload_module(void)
 	AST_TEST_UNREGISTER(crypt_test);
 	AST_TEST_UNREGISTER(quote_mutation);
 	AST_TEST_UNREGISTER(quote_unescaping);
+	AST_TEST_UNREGISTER(slinear_saturated_array);
+	AST_TEST_UNREGISTER(g711_array);
 	return 0;
 }
 
@@ -644,6 +802,8 @@ static int load_module(void)
 	AST_TEST_REGISTER(crypt_test);
 	AST_TEST_REGISTER(quote_mutation);
 	AST_TEST_REGISTER(quote_unescaping);
+	AST_TEST_REGISTER(slinear_saturated_array);
+	AST_TEST_REGISTER(g711_array);
 	return AST_MODULE_LOAD_SUCCESS;
 }
 